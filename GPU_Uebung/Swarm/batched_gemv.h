@@ -0,0 +1,51 @@
+#pragma once
+
+#include "cuda_runtime.h"
+
+#include "cuda_device_array.h"
+
+/*
+ * Many small independent matrix vector products in one launch, e.g. a transform per school.
+ * Strided batch layout: matrix b is the row major ROWS x COLS block at b * ROWS * COLS,
+ * its vector is at b * COLS and its result at b * ROWS.
+ * The device buffers are kept and only grow, so the same batch can run every frame without cudaMalloc.
+ * Implemented in kernel.cu for float and double.
+ */
+template <class T>
+class BatchedGemv
+{
+public:
+
+	BatchedGemv(int rows, int cols, int capacity = 0);
+
+	// Makes room for batch products. Keeps the buffers, if they are large enough.
+	void reserve(int batch);
+
+	// Copy batch matrices or vectors from the host into the strided device buffers.
+	void setMatrices(const T* src, int batch);
+	void setVectors(const T* src, int batch);
+
+	// All products of the batch in one launch. Asynchronous on the stream.
+	void run(int batch, cudaStream_t stream = 0);
+
+	// Copy the results of the batch to the host. Waits for run.
+	void getResults(T* dest, int batch);
+
+	int getRows() const { return rows_; }
+	int getCols() const { return cols_; }
+	int getCapacity() const { return capacity_; }
+
+	// Device buffers, for callers which fill them with own kernels.
+	T* getMatrices() { return matrices_.getData(); }
+	T* getVectors() { return vectors_.getData(); }
+	T* getResults() { return results_.getData(); }
+
+private:
+
+	int rows_;
+	int cols_;
+	int capacity_;
+	CudaDeviceArray<T> matrices_;
+	CudaDeviceArray<T> vectors_;
+	CudaDeviceArray<T> results_;
+};
@@ -1,49 +1,427 @@
 ﻿#include "kernel.cuh"
 #include "cuda_device_array.h"
+#include "batched_gemv.h"
+#include "cuda_timer.h"
+#include "launch_check.h"
+#include "device_reduce.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <cub/cub.cuh>
+#include <cublas_v2.h>
+#include <cuda_fp16.h>
+
+#define CUBLAS_CHECK( func ) \
+{ \
+	cublasStatus_t status = func; \
+	if (status != CUBLAS_STATUS_SUCCESS) \
+		cerr << "cuBLAS error: " << status << endl; \
+}
 
 __global__ void add(int a, int b, int* sum)
 {
 	*sum = a + b;
 }
 
-__global__ void multiplyVM(double* matrix, double* vector, int cols, double* resultMatrix)
+// Does nothing, so a launch costs only its overhead.
+__global__ void emptyKernel()
+{
+}
+
+// Grid stride copy, reads or writes mapped host memory directly when one side is a mapped pointer.
+__global__ void copyKernel(const float4* src, float4* dst, size_t count)
+{
+	for (size_t i = blockIdx.x * (size_t)blockDim.x + threadIdx.x; i < count; i += (size_t)blockDim.x * gridDim.x)
+		dst[i] = src[i];
+}
+
+// threadIdx.x walks the columns with a stride of blockDim.x, so rows longer than a block work too.
+template <class T>
+__global__ void multiplyVM(const T* matrix, const T* vector, int cols, T* resultMatrix)
 {
 	//printf("block x: %d, block y: %d, thread x: %d\n", blockIdx.x, blockIdx.y, threadIdx.x);
 	int const row = blockIdx.x;
-	int const col = threadIdx.x;
 
-	resultMatrix[(row * cols) + col] = matrix[(row * cols) + col] * vector[col];
+	for (int col = threadIdx.x; col < cols; col += blockDim.x)
+		resultMatrix[(row * cols) + col] = matrix[(row * cols) + col] * vector[col];
 }
 
-__global__ void matrixVectorMultiplicationKernel(double* matrix, double* vector, double* result_matrix, int cols, int rows)
+// Type of the sums: half products are summed in float, the rest in their own type.
+template <class T> struct Accumulator { typedef T type; };
+template <> struct Accumulator<__half> { typedef float type; };
+
+__host__ __device__ inline float toAccumulator(__half value) { return __half2float(value); }
+template <class T> __host__ __device__ inline T toAccumulator(T value) { return value; }
+
+template <class T> __host__ __device__ inline T fromAccumulator(typename Accumulator<T>::type value) { return T(value); }
+template <> __host__ __device__ inline __half fromAccumulator<__half>(float value) { return __float2half(value); }
+
+// Fused matrix vector product: one warp per row. The lanes walk the row with a stride of warpSize,
+// so the loads are coalesced, and the warp sums its partial products with shuffles.
+// Every row is written once, there is no intermediate matrix and no second pass.
+template <class T>
+__global__ void gemvKernel(const T* matrix, const T* vector, T* result, int cols, int rows)
 {
-	int ROW = blockIdx.y * blockDim.y + threadIdx.y;
-	int COL = blockIdx.x * blockDim.x + threadIdx.x;
-	if (ROW < rows && COL < cols) {
-		result_matrix[(ROW * cols) + COL] = matrix[(ROW * cols) + COL] * vector[COL];
-	} else result_matrix[ROW * cols + COL] = 0;
-	//printf("result_matrix value: %f\n", result_matrix[(ROW * cols) + COL]);
+	int const row = blockIdx.x * GEMV_WARPS + threadIdx.x / warpSize;
+	int const lane = threadIdx.x % warpSize;
+	if (row >= rows) return;								// The whole warp leaves, the shuffles stay complete
+
+	typename Accumulator<T>::type sum = 0;
+	for (int col = lane; col < cols; col += warpSize)
+		sum += toAccumulator(matrix[(row * cols) + col]) * toAccumulator(vector[col]);
+
+	for (int offset = warpSize / 2; offset > 0; offset /= 2)
+		sum += __shfl_down_sync(0xffffffff, sum, offset);
+
+	if (lane == 0) result[row] = fromAccumulator<T>(sum);
 }
 
-__global__ void arrayAdd(double* matrix, int cols, int rows, double* result)
+// cuBLAS is column major: the row major ROWS x COLS matrix is a COLS x ROWS matrix there, y = A x is its transposed product.
+static bool cublasGemv(cublasHandle_t handle, const float* matrix, const float* vector, float* result, int cols, int rows)
 {
-	int ROW = blockIdx.y * blockDim.y + threadIdx.y;
-	int COL = blockIdx.x * blockDim.x + threadIdx.x;
-	
-	//if (ROW < rows && COL < cols) {
-		for (int i = 0; i < cols; i++)
+	const float one = 1, zero = 0;
+	CUBLAS_CHECK(cublasSgemv(handle, CUBLAS_OP_T, cols, rows, &one, matrix, cols, vector, 1, &zero, result, 1));
+	return true;
+}
+
+static bool cublasGemv(cublasHandle_t handle, const double* matrix, const double* vector, double* result, int cols, int rows)
+{
+	const double one = 1, zero = 0;
+	CUBLAS_CHECK(cublasDgemv(handle, CUBLAS_OP_T, cols, rows, &one, matrix, cols, vector, 1, &zero, result, 1));
+	return true;
+}
+
+// No gemv in cuBLAS for this type, e.g. half.
+template <class T>
+static bool cublasGemv(cublasHandle_t, const T*, const T*, T*, int, int)
+{
+	return false;
+}
+
+template <class T> struct HasCublasGemv { static const bool value = false; };
+template <> struct HasCublasGemv<float> { static const bool value = true; };
+template <> struct HasCublasGemv<double> { static const bool value = true; };
+
+// Matrix vector product of a row major ROWS x COLS matrix on the device.
+// AUTO: cuBLAS from GEMV_CUBLAS_ELEMENTS elements on, if it supports the type, gemvKernel below.
+template <class T>
+static void gemv(cublasHandle_t handle, const T* matrix, const T* vector, T* result, int cols, int rows, GemvPath path = GemvPath::AUTO)
+{
+	bool library = path == GemvPath::CUBLAS || (path == GemvPath::AUTO && (long long)rows * cols >= GEMV_CUBLAS_ELEMENTS);
+	if (library && cublasGemv(handle, matrix, vector, result, cols, rows))
+		return;
+
+	gemvKernel<T> <<<(rows + GEMV_WARPS - 1) / GEMV_WARPS, GEMV_WARPS * 32>>> (matrix, vector, result, cols, rows);
+	CUDA_CHECK_LAUNCH("gemvKernel", 0);
+}
+
+// Batched products: one thread per row of a product, grid stride over all rows of the batch.
+// The matrices are tiny, one thread sums a whole row and the launch covers thousands of them.
+template <class T>
+__global__ void batchedGemvKernel(const T* matrices, const T* vectors, T* results, int rows, int cols, int batch)
+{
+	int const total = rows * batch;
+	for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < total; i += blockDim.x * gridDim.x)
+	{
+		int const product = i / rows;
+		const T* matrix = matrices + (size_t)i * cols;				// Row i of all rows, the matrices follow each other
+		const T* vector = vectors + (size_t)product * cols;
+
+		T sum = 0;
+		for (int col = 0; col < cols; col++)
+			sum += matrix[col] * vector[col];
+		results[i] = sum;
+	}
+}
+
+// Tiled matrix matrix product C = A B of row major matrices, A is M x K, B is K x N.
+// A block computes a GEMM_TILE x GEMM_TILE tile of C. It walks K in steps of GEMM_TILE_K: both tiles go into shared memory,
+// A transposed, so a thread reads its GEMM_THREAD_TILE values of A and of B as rows of the tiles. Every thread keeps
+// GEMM_THREAD_TILE x GEMM_THREAD_TILE sums in registers; its rows and columns are GEMM_TILE / GEMM_THREAD_TILE apart,
+// so the neighbouring threads of a warp read neighbouring words and write neighbouring columns of C.
+// Values outside of the matrices are loaded as 0, any size works.
+template <class T>
+__global__ void gemmKernel(const T* A, const T* B, T* C, int M, int N, int K)
+{
+	const int THREADS = GEMM_TILE / GEMM_THREAD_TILE;				// Threads per row and column of the block
+	__shared__ T tileA[GEMM_TILE_K][GEMM_TILE];						// Transposed: tileA[k][row]
+	__shared__ T tileB[GEMM_TILE_K][GEMM_TILE];
+
+	int const tx = threadIdx.x, ty = threadIdx.y;
+	int const thread = ty * THREADS + tx;
+	int const rowBase = blockIdx.y * GEMM_TILE, colBase = blockIdx.x * GEMM_TILE;
+
+	T sum[GEMM_THREAD_TILE][GEMM_THREAD_TILE] = {};
+	for (int k0 = 0; k0 < K; k0 += GEMM_TILE_K)
+	{
+		for (int i = thread; i < GEMM_TILE * GEMM_TILE_K; i += THREADS * THREADS)
+		{
+			int const k = i % GEMM_TILE_K, row = i / GEMM_TILE_K;	// Along the rows of A, coalesced
+			int const globalRow = rowBase + row, globalK = k0 + k;
+			tileA[k][row] = globalRow < M && globalK < K ? A[(size_t)globalRow * K + globalK] : T(0);
+			int const col = i % GEMM_TILE, kB = i / GEMM_TILE;		// Along the rows of B
+			int const globalCol = colBase + col, globalKB = k0 + kB;
+			tileB[kB][col] = globalKB < K && globalCol < N ? B[(size_t)globalKB * N + globalCol] : T(0);
+		}
+		__syncthreads();
+
+		for (int k = 0; k < GEMM_TILE_K; k++)
 		{
-			result[ROW] += matrix[(i * cols) + COL];
+			T a[GEMM_THREAD_TILE], b[GEMM_THREAD_TILE];
+			for (int i = 0; i < GEMM_THREAD_TILE; i++)
+			{
+				a[i] = tileA[k][ty + i * THREADS];
+				b[i] = tileB[k][tx + i * THREADS];
+			}
+			for (int i = 0; i < GEMM_THREAD_TILE; i++)
+				for (int j = 0; j < GEMM_THREAD_TILE; j++)
+					sum[i][j] += a[i] * b[j];
 		}
-		//for (int i = 0; i < cols; i++)
-		//{
-		//	//printf("matrix value: %f\n", matrix[(ROW * cols) + COL]);
-		//	result[ROW] += matrix[(ROW * cols) + COL];
-		//}
-	//}
+		__syncthreads();											// The tiles are overwritten next
+	}
+
+	for (int i = 0; i < GEMM_THREAD_TILE; i++)
+	{
+		int const row = rowBase + ty + i * THREADS;
+		for (int j = 0; j < GEMM_THREAD_TILE; j++)
+		{
+			int const col = colBase + tx + j * THREADS;
+			if (row < M && col < N)
+				C[(size_t)row * N + col] = sum[i][j];
+		}
+	}
+}
+
+// Matrix matrix product C = A B of row major matrices on the device, A is M x K, B is K x N.
+template <class T>
+static void gemm(const T* A, const T* B, T* C, int M, int N, int K, cudaStream_t stream = 0)
+{
+	dim3 const threads(GEMM_TILE / GEMM_THREAD_TILE, GEMM_TILE / GEMM_THREAD_TILE);
+	dim3 const blocks((N + GEMM_TILE - 1) / GEMM_TILE, (M + GEMM_TILE - 1) / GEMM_TILE);
+	gemmKernel<T> <<<blocks, threads, 0, stream>>> (A, B, C, M, N, K);
+	CUDA_CHECK_LAUNCH("gemmKernel", stream);
+}
+
+// cuBLAS is column major: row major C = A B is C^T = B^T A^T there, the same memory without transposes.
+static void cublasGemm(cublasHandle_t handle, const float* A, const float* B, float* C, int M, int N, int K)
+{
+	const float one = 1, zero = 0;
+	CUBLAS_CHECK(cublasSgemm(handle, CUBLAS_OP_N, CUBLAS_OP_N, N, M, K, &one, B, N, A, K, &zero, C, N));
+}
+
+static void cublasGemm(cublasHandle_t handle, const double* A, const double* B, double* C, int M, int N, int K)
+{
+	const double one = 1, zero = 0;
+	CUBLAS_CHECK(cublasDgemm(handle, CUBLAS_OP_N, CUBLAS_OP_N, N, M, K, &one, B, N, A, K, &zero, C, N));
+}
+
+// Variants of benchmark_reduce. MULTI is deviceReduce of SwarmCore.
+enum class ReducePath { ATOMIC, TREE, SHUFFLE, MULTI, CUB_BLOCK, CUB_DEVICE };
+static const ReducePath REDUCE_PATHS[] = { ReducePath::ATOMIC, ReducePath::TREE, ReducePath::SHUFFLE, ReducePath::MULTI, ReducePath::CUB_BLOCK, ReducePath::CUB_DEVICE };
+static const char* const REDUCE_PATH_NAMES[] = { "atomic", "tree", "shuffle", "multi", "cub block", "cub device" };
+
+// Word of the compare and swap of atomicCombine.
+template <class T> struct AtomicWord { typedef unsigned int type; };
+template <> struct AtomicWord<double> { typedef unsigned long long type; };
+
+// Combine a value into a value in global memory with a compare and swap loop, so any 4 or 8 byte type and operation works.
+template <class T, class Op>
+__device__ void atomicCombine(T* target, T value, Op op)
+{
+	typedef typename AtomicWord<T>::type Word;
+	Word* address = reinterpret_cast<Word*>(target);
+	Word old = *address, assumed;
+	do
+	{
+		assumed = old;
+		T current;
+		memcpy(&current, &assumed, sizeof(T));
+		T next = op(current, value);
+		Word word;
+		memcpy(&word, &next, sizeof(T));
+		old = atomicCAS(address, assumed, word);
+	} while (old != assumed);
+}
+
+// Naive: every thread combines its element into the result directly. All threads fight for one word.
+template <class T, class Op>
+__global__ void reduceAtomicKernel(const T* data, size_t count, T* result, Op op)
+{
+	size_t const i = blockIdx.x * (size_t)blockDim.x + threadIdx.x;
+	if (i < count)
+		atomicCombine(result, data[i], op);
+}
+
+// Shared memory tree with sequential addressing: one element per thread, half of the threads drop out per level.
+template <class T, class Op>
+__global__ void reduceTreeKernel(const T* data, size_t count, T* out, Op op)
+{
+	__shared__ T values[REDUCE_THREADS];
+	size_t const i = blockIdx.x * (size_t)REDUCE_THREADS + threadIdx.x;
+	values[threadIdx.x] = i < count ? data[i] : Op::template identity<T>();
 	__syncthreads();
+	for (unsigned int s = REDUCE_THREADS / 2; s > 0; s /= 2)
+	{
+		if (threadIdx.x < s)
+			values[threadIdx.x] = op(values[threadIdx.x], values[threadIdx.x + s]);
+		__syncthreads();
+	}
+	if (threadIdx.x == 0)
+		out[blockIdx.x] = values[0];
+}
+
+// Warp shuffles: one element per thread, the warps reduce in registers and only their results go through shared memory.
+template <class T, class Op>
+__global__ void reduceShuffleKernel(const T* data, size_t count, T* out, Op op)
+{
+	size_t const i = blockIdx.x * (size_t)REDUCE_THREADS + threadIdx.x;
+	T value = blockReduce<REDUCE_THREADS>(i < count ? data[i] : Op::template identity<T>(), op);
+	if (threadIdx.x == 0)
+		out[blockIdx.x] = value;
+}
+
+// cub::BlockReduce over a grid stride of many elements per thread, like deviceReduceKernel.
+template <class T, class Op>
+__global__ void reduceCubBlockKernel(const T* data, size_t count, T* out, Op op)
+{
+	typedef cub::BlockReduce<T, REDUCE_THREADS> BlockReduce;
+	__shared__ typename BlockReduce::TempStorage storage;
+
+	T value = Op::template identity<T>();
+	for (size_t i = blockIdx.x * (size_t)REDUCE_THREADS + threadIdx.x; i < count; i += (size_t)REDUCE_THREADS * gridDim.x)
+		value = op(value, data[i]);
+	value = BlockReduce(storage).Reduce(value, op);
+	if (threadIdx.x == 0)
+		out[blockIdx.x] = value;
+}
+
+// Scratch of all variants for one size: partials of the passes and the temporary storage of cub::DeviceReduce.
+template <class T>
+struct ReduceBuffers
+{
+	CudaDeviceArray<T> partials;
+	CudaDeviceArray<T> result;
+	CudaDeviceArray<unsigned char> cubStorage;
+};
+
+// One reduction of count elements into buffers.result with a variant. Asynchronous.
+// The one element per thread variants run pass after pass over the partials of the pass before, until one block is left.
+template <class T, class Op>
+static void reduce(ReducePath path, const T* data, size_t count, ReduceBuffers<T>& buffers, Op op)
+{
+	T* const result = buffers.result.getData();
+	switch (path)
+	{
+	case ReducePath::ATOMIC:
+	{
+		T const identity = Op::template identity<T>();
+		CUDA_CHECK(cudaMemcpyAsync(result, &identity, sizeof(T), cudaMemcpyHostToDevice, 0));
+		reduceAtomicKernel<T, Op> <<<(unsigned int)((count + REDUCE_THREADS - 1) / REDUCE_THREADS), REDUCE_THREADS>>> (data, count, result, op);
+		CUDA_CHECK_LAUNCH("reduceAtomicKernel", 0);
+		break;
+	}
+	case ReducePath::TREE:
+	case ReducePath::SHUFFLE:
+	{
+		const T* in = data;
+		T* out = buffers.partials.getData();
+		while (true)
+		{
+			unsigned int const blocks = (unsigned int)((count + REDUCE_THREADS - 1) / REDUCE_THREADS);
+			T* const target = blocks == 1 ? result : out;
+			if (path == ReducePath::TREE)
+				reduceTreeKernel<T, Op> <<<blocks, REDUCE_THREADS>>> (in, count, target, op);
+			else
+				reduceShuffleKernel<T, Op> <<<blocks, REDUCE_THREADS>>> (in, count, target, op);
+			CUDA_CHECK_LAUNCH(path == ReducePath::TREE ? "reduceTreeKernel" : "reduceShuffleKernel", 0);
+			if (blocks == 1)
+				break;
+			in = target;
+			out = target + blocks;										// The next pass writes behind its input
+			count = blocks;
+		}
+		break;
+	}
+	case ReducePath::MULTI:
+		deviceReduce(data, count, buffers.partials.getData(), result, op);
+		break;
+	case ReducePath::CUB_BLOCK:
+	{
+		unsigned int const blocks = deviceReduceBlocks(count);
+		reduceCubBlockKernel<T, Op> <<<blocks, REDUCE_THREADS>>> (data, count, buffers.partials.getData(), op);
+		CUDA_CHECK_LAUNCH("reduceCubBlockKernel", 0);
+		reduceCubBlockKernel<T, Op> <<<1, REDUCE_THREADS>>> (buffers.partials.getData(), blocks, result, op);
+		CUDA_CHECK_LAUNCH("reduceCubBlockKernel", 0);
+		break;
+	}
+	default:
+	{
+		size_t bytes = buffers.cubStorage.getSize();
+		CUDA_CHECK(cub::DeviceReduce::Reduce(buffers.cubStorage.getData(), bytes, data, result, (int)count, op, Op::template identity<T>()));
+		break;
+	}
+	}
+}
+
+template <class T>
+BatchedGemv<T>::BatchedGemv(int rows, int cols, int capacity)
+	: rows_(rows), cols_(cols), capacity_(0)
+{
+	reserve(capacity);
+}
+
+template <class T>
+void BatchedGemv<T>::reserve(int batch)
+{
+	if (batch <= capacity_)
+		return;
+
+	matrices_.resize((size_t)batch * rows_ * cols_);
+	vectors_.resize((size_t)batch * cols_);
+	results_.resize((size_t)batch * rows_);
+	capacity_ = batch;
+}
+
+template <class T>
+void BatchedGemv<T>::setMatrices(const T* src, int batch)
+{
+	reserve(batch);
+	matrices_.set(src, (size_t)batch * rows_ * cols_);
+}
+
+template <class T>
+void BatchedGemv<T>::setVectors(const T* src, int batch)
+{
+	reserve(batch);
+	vectors_.set(src, (size_t)batch * cols_);
 }
 
+template <class T>
+void BatchedGemv<T>::run(int batch, cudaStream_t stream)
+{
+	batch = min(batch, capacity_);
+	if (batch == 0)
+		return;
+
+	int const threads = 256;
+	int const blocks = min((rows_ * batch + threads - 1) / threads, 4096);
+	batchedGemvKernel<T> <<<blocks, threads, 0, stream>>> (matrices_.getData(), vectors_.getData(), results_.getData(), rows_, cols_, batch);
+	CUDA_CHECK_LAUNCH("batchedGemvKernel", stream);
+}
+
+template <class T>
+void BatchedGemv<T>::getResults(T* dest, int batch)
+{
+	results_.get(dest, (size_t)min(batch, capacity_) * rows_);
+}
+
+template class BatchedGemv<float>;
+template class BatchedGemv<double>;
+
 int add(int a, int b)
 {
 	int hostSum = 0;
@@ -60,6 +438,211 @@ int add(int a, int b)
 	return hostSum;
 }
 
+typedef std::chrono::steady_clock Clock;
+
+// Host time since a time point in us.
+static double elapsedUs(Clock::time_point from)
+{
+	return std::chrono::duration<double, std::micro>(Clock::now() - from).count();
+}
+
+// Memory kinds of the transfers. Mapped memory is read and written by copyKernel through its device pointer (zero copy).
+enum class HostMemory { PAGEABLE, PINNED, MAPPED };
+static const char* const HOST_MEMORY_NAMES[] = { "pageable", "pinned", "mapped" };
+
+// Mean GB/s of TRANSFER_RUNS copies of bytes between host memory of a kind and the device, after one warm up copy.
+static double timeTransfer(HostMemory memory, bool toDevice, size_t bytes)
+{
+	size_t const count = bytes / sizeof(float4);
+	CudaDeviceArray<float4> device(count);
+	std::vector<float4> pageable;
+	float4* host = NULL;
+	float4* mapped = NULL;
+	if (memory == HostMemory::PAGEABLE)
+	{
+		pageable.resize(count);
+		host = pageable.data();
+	}
+	else
+	{
+		CUDA_CHECK(cudaHostAlloc((void**)&host, bytes, memory == HostMemory::MAPPED ? cudaHostAllocMapped : cudaHostAllocDefault));
+		if (memory == HostMemory::MAPPED)
+			CUDA_CHECK(cudaHostGetDevicePointer((void**)&mapped, host, 0));
+	}
+	memset(host, 0, bytes);
+
+	CudaTimer timer;
+	for (int run = 0; run <= TRANSFER_RUNS; run++)
+	{
+		if (run == 1)
+			timer.start();
+		if (memory == HostMemory::MAPPED)
+		{
+			unsigned int const blocks = (unsigned int)min((count + 255) / 256, (size_t)4096);
+			copyKernel <<<blocks, 256>>> (toDevice ? mapped : device.getData(), toDevice ? device.getData() : mapped, count);
+			CUDA_CHECK_LAUNCH("copyKernel", 0);
+		}
+		else
+			CUDA_CHECK(cudaMemcpyAsync(toDevice ? (void*)device.getData() : (void*)host, toDevice ? (void*)host : (void*)device.getData(),
+				bytes, toDevice ? cudaMemcpyHostToDevice : cudaMemcpyDeviceToHost, 0));	// Pageable: staged by the driver, blocking
+	}
+	timer.stop();
+	double const ms = timer.elapsedMs() / TRANSFER_RUNS;
+
+	if (memory != HostMemory::PAGEABLE)
+		CUDA_CHECK(cudaFreeHost(host));
+	return bytes / 1e9 / (ms / 1e3);
+}
+
+// Write the constants of this machine into MACHINE_PROFILE, replacing the line of the same GPU and driver, like the
+// tuning profile of the autotuner: name, driver, then tab separated values.
+static void storeMachineProfile(const std::string& key, const std::string& values)
+{
+	std::vector<std::string> lines;
+	{
+		std::ifstream file(MACHINE_PROFILE, std::ios::in);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			bool same = line.compare(0, key.size(), key) == 0 && line.size() > key.size() && line[key.size()] == '\t';
+			if (!line.empty() && !same)
+				lines.push_back(line);											// Other GPUs and drivers
+		}
+	}
+	lines.push_back(key + "\t" + values);
+
+	std::ofstream file(MACHINE_PROFILE, std::ios::out | std::ios::trunc);
+	for (const std::string& line : lines)
+		file << line << "\n";
+	file.close();
+	if (!file)
+		cerr << "Impossible to write " << MACHINE_PROFILE << "!" << endl;
+}
+
+void benchmark_latency()
+{
+	cudaStream_t stream;
+	CUDA_CHECK(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
+
+	// Launch latency: host time per launch of a burst (throughput of the launch path) and of a launch with a
+	// synchronisation after it (round trip), in a stream and as nodes of a graph.
+	emptyKernel <<<1, 1, 0, stream>>> ();
+	CUDA_CHECK_LAUNCH("emptyKernel", stream);
+	CUDA_CHECK(cudaStreamSynchronize(stream));
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < LATENCY_LAUNCHES; i++)
+		emptyKernel <<<1, 1, 0, stream>>> ();
+	CUDA_CHECK(cudaStreamSynchronize(stream));
+	double const streamUs = elapsedUs(start) / LATENCY_LAUNCHES;
+	start = Clock::now();
+	for (int i = 0; i < LATENCY_LAUNCHES; i++)
+	{
+		emptyKernel <<<1, 1, 0, stream>>> ();
+		CUDA_CHECK(cudaStreamSynchronize(stream));
+	}
+	double const streamRoundTripUs = elapsedUs(start) / LATENCY_LAUNCHES;
+
+	cudaGraph_t graph, single;
+	cudaGraphExec_t exec, singleExec;
+	CUDA_CHECK(cudaStreamBeginCapture(stream, cudaStreamCaptureModeThreadLocal));
+	for (int i = 0; i < LATENCY_GRAPH_BATCH; i++)
+		emptyKernel <<<1, 1, 0, stream>>> ();
+	CUDA_CHECK(cudaStreamEndCapture(stream, &graph));
+	CUDA_CHECK(cudaStreamBeginCapture(stream, cudaStreamCaptureModeThreadLocal));
+	emptyKernel <<<1, 1, 0, stream>>> ();
+	CUDA_CHECK(cudaStreamEndCapture(stream, &single));
+	CUDA_CHECK(cudaGraphInstantiate(&exec, graph, NULL, NULL, 0));
+	CUDA_CHECK(cudaGraphInstantiate(&singleExec, single, NULL, NULL, 0));
+	CUDA_CHECK(cudaGraphLaunch(exec, stream));							// Warm up, uploads the graph
+	CUDA_CHECK(cudaGraphLaunch(singleExec, stream));
+	CUDA_CHECK(cudaStreamSynchronize(stream));
+	start = Clock::now();
+	for (int i = 0; i < LATENCY_LAUNCHES / LATENCY_GRAPH_BATCH; i++)
+		CUDA_CHECK(cudaGraphLaunch(exec, stream));
+	CUDA_CHECK(cudaStreamSynchronize(stream));
+	double const graphUs = elapsedUs(start) / LATENCY_LAUNCHES;
+	start = Clock::now();
+	for (int i = 0; i < LATENCY_LAUNCHES; i++)
+	{
+		CUDA_CHECK(cudaGraphLaunch(singleExec, stream));
+		CUDA_CHECK(cudaStreamSynchronize(stream));
+	}
+	double const graphRoundTripUs = elapsedUs(start) / LATENCY_LAUNCHES;
+	CUDA_CHECK(cudaGraphExecDestroy(exec));
+	CUDA_CHECK(cudaGraphExecDestroy(singleExec));
+	CUDA_CHECK(cudaGraphDestroy(graph));
+	CUDA_CHECK(cudaGraphDestroy(single));
+
+	cout << "launch: path, us per launch, us per launch and synchronize" << endl;
+	cout << "stream, " << streamUs << ", " << streamRoundTripUs << endl;
+	cout << "graph, " << graphUs << ", " << graphRoundTripUs << endl;
+
+	// Allocation: host time of an allocation and its free. The pool keeps its memory (no release threshold), so after
+	// the warm up it hands out the same block again without going to the driver.
+	cudaMemPool_t pool;
+	int device;
+	CUDA_CHECK(cudaGetDevice(&device));
+	CUDA_CHECK(cudaDeviceGetDefaultMemPool(&pool, device));
+	unsigned long long threshold = ~0ull;
+	CUDA_CHECK(cudaMemPoolSetAttribute(pool, cudaMemPoolAttrReleaseThreshold, &threshold));
+	double mallocUs = 0, poolUs = 0;
+	cout << "alloc: bytes, cudaMalloc us, pool us" << endl;
+	for (size_t bytes = 1 << 10; bytes <= (size_t)1 << 26; bytes *= 16)
+	{
+		void* memory;
+		CUDA_CHECK(cudaMallocAsync(&memory, bytes, stream));
+		CUDA_CHECK(cudaFreeAsync(memory, stream));
+		CUDA_CHECK(cudaStreamSynchronize(stream));
+		start = Clock::now();
+		for (int run = 0; run < ALLOC_RUNS; run++)
+		{
+			CUDA_CHECK(cudaMalloc(&memory, bytes));
+			CUDA_CHECK(cudaFree(memory));								// Synchronizes the device
+		}
+		mallocUs = elapsedUs(start) / ALLOC_RUNS;
+		start = Clock::now();
+		for (int run = 0; run < ALLOC_RUNS; run++)
+		{
+			CUDA_CHECK(cudaMallocAsync(&memory, bytes, stream));
+			CUDA_CHECK(cudaFreeAsync(memory, stream));
+		}
+		CUDA_CHECK(cudaStreamSynchronize(stream));
+		poolUs = elapsedUs(start) / ALLOC_RUNS;
+		cout << bytes << ", " << mallocUs << ", " << poolUs << endl;
+	}
+	CUDA_CHECK(cudaStreamDestroy(stream));
+
+	// Bandwidth over sizes, the values of the largest size go into the profile.
+	double bandwidth[3][2] = {};
+	cout << "transfer: bytes";
+	for (const char* name : HOST_MEMORY_NAMES)
+		cout << ", " << name << " H2D GB/s, " << name << " D2H GB/s";
+	cout << endl;
+	for (size_t bytes = 1 << 12; bytes <= (size_t)1 << 28; bytes *= 16)
+	{
+		cout << bytes;
+		for (int memory = 0; memory < 3; memory++)
+			for (int toHost = 0; toHost < 2; toHost++)
+			{
+				bandwidth[memory][toHost] = timeTransfer((HostMemory)memory, toHost == 0, bytes);
+				cout << ", " << bandwidth[memory][toHost];
+			}
+		cout << endl;
+	}
+
+	cudaDeviceProp properties;
+	int driver;
+	CUDA_CHECK(cudaGetDeviceProperties(&properties, device));
+	CUDA_CHECK(cudaDriverGetVersion(&driver));
+	std::ostringstream key, values;
+	key << properties.name << "\t" << driver;
+	values << streamUs << "\t" << streamRoundTripUs << "\t" << graphUs << "\t" << graphRoundTripUs << "\t" << mallocUs << "\t" << poolUs;
+	for (int memory = 0; memory < 3; memory++)
+		values << "\t" << bandwidth[memory][0] << "\t" << bandwidth[memory][1];
+	storeMachineProfile(key.str(), values.str());
+	cout << "machine profile: " << MACHINE_PROFILE << endl;
+}
+
 void new_multiply()
 {
 	const int ROWS = 64;
@@ -77,74 +660,334 @@ void new_multiply()
 	double* host_result = new double[ROWS];
 
 	// Allocate memory on the device
-	DeviceArray<double> device_A(SIZE);
-	DeviceArray<double> device_vector(COLS);
-	DeviceArray<double> device_matrix_result(SIZE);
-	DeviceArray<double> device_result(ROWS);
+	CudaDeviceArray<double> device_A(SIZE);
+	CudaDeviceArray<double> device_vector(COLS);
+	CudaDeviceArray<double> device_result(ROWS);
 
 	device_A.set(&host_A[0], SIZE);
 	device_vector.set(&host_vector[0], COLS);
 
-
-	dim3 blocks_per_grid(1, 1);
-	dim3 threads_per_block(COLS, ROWS);
-
-	if (SIZE > 512)
-	{
-		threads_per_block.x = 32;
-		threads_per_block.y = 32;
-		blocks_per_grid.x = (unsigned int) ceil(double(COLS) / double(threads_per_block.x));
-		blocks_per_grid.y = (unsigned int) ceil(double(ROWS) / double(threads_per_block.y));
-	}
-	std::cout << blocks_per_grid.x << std::endl;
-	std::cout << blocks_per_grid.y << std::endl;
-	matrixVectorMultiplicationKernel <<<blocks_per_grid, threads_per_block>>> (device_A.getData(), device_vector.getData(), device_matrix_result.getData(), COLS, ROWS);
-	// multiplyVM <<<blocks_per_grid, threads_per_block>>>(device_A.getData(), device_vector.getData(), COLS, device_matrix_result.getData());
-	device_matrix_result.get(&host_A[0], SIZE);
-	//std::cout << "result:" << endl; // [20, 22]
-	//for (int i = 0; i < ROWS; i++)
-	//{
-	//	for (int j = 0; j < COLS; j++)
-	//	{
-	//		std::cout << host_A[i * COLS + j] << " ";		
-	//	}
-	//	std::cout << std::endl;
-	//}
-
-	arrayAdd <<<blocks_per_grid, threads_per_block>>>(device_matrix_result.getData(), COLS, ROWS, device_result.getData());
-	std::cout << device_result.getSize() << std::endl;
+	// Small product: always gemvKernel, GEMV_WARPS rows per block, one warp per row
+	gemv<double>(NULL, device_A.getData(), device_vector.getData(), device_result.getData(), COLS, ROWS, GemvPath::KERNEL);
 	device_result.get(&host_result[0], ROWS);
-	cudaDeviceSynchronize();
 
-	double* cpu_C;
-	cpu_C = new double[ROWS];
-
-	// Now do the matrix vector multiplication on the CPU
-	double sum;
+	// Validation: the same product on the CPU
+	double err = 0;
 	for (int row = 0; row < ROWS; row++) {
-		sum = 0.f;
+		double sum = 0;
 		for (int col = 0; col < COLS; col++) {
 			sum += host_A[(row * COLS) + col] * host_vector[col];
 		}
-		cpu_C[row] = sum;
+		err = max(err, fabs(sum - host_result[row]));
 	}
 
+	cout << "Max error: " << err << endl;
+
+	delete[] host_A;
+	delete[] host_result;
+}
+
+// Fills a matrix or vector with small values, which are exact in half and sum up without overflow.
+template <class T>
+static void fillPattern(std::vector<T>& data, int seed)
+{
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] = fromAccumulator<T>(float(int((i * 7 + seed) % 9) - 4) * 0.125f);
+}
+
+// Times one path of gemv: mean of GEMV_BENCHMARK_RUNS launches after a warm up, in ms.
+template <class T>
+static float timeGemv(cublasHandle_t handle, CudaDeviceArray<T>& matrix, CudaDeviceArray<T>& vector, CudaDeviceArray<T>& result, int size, GemvPath path)
+{
+	CudaTimer timer;
+
+	gemv<T>(handle, matrix.getData(), vector.getData(), result.getData(), size, size, path);
+	timer.start();
+	for (int run = 0; run < GEMV_BENCHMARK_RUNS; run++)
+		gemv<T>(handle, matrix.getData(), vector.getData(), result.getData(), size, size, path);
+	timer.stop();
+	return timer.elapsedMs() / GEMV_BENCHMARK_RUNS;
+}
+
+// One line per size: time and bandwidth of gemvKernel and cuBLAS, and the largest difference of their results.
+template <class T>
+static void benchmarkGemv(cublasHandle_t handle, const char* name)
+{
+	const int SIZES[] = { 64, 256, 1024, 2048, 4096, 8192 };
+	int crossover = 0;
+
+	cout << name << ": size, kernel ms, kernel GB/s, cuBLAS ms, cuBLAS GB/s, max difference" << endl;
+	for (int size : SIZES)
+	{
+		std::vector<T> host_matrix((size_t)size * size), host_vector(size), host_kernel(size), host_library(size);
+		fillPattern(host_matrix, 0);
+		fillPattern(host_vector, 3);
+
+		CudaDeviceArray<T> device_matrix(host_matrix.size());
+		CudaDeviceArray<T> device_vector(size);
+		CudaDeviceArray<T> device_result(size);
+		device_matrix.set(host_matrix.data(), host_matrix.size());
+		device_vector.set(host_vector.data(), size);
+
+		double gigabytes = double(sizeof(T)) * ((double)size * size + 2.0 * size) / 1e9;
+
+		float kernel_ms = timeGemv(handle, device_matrix, device_vector, device_result, size, GemvPath::KERNEL);
+		device_result.get(host_kernel.data(), size);
+		cout << size << ", " << kernel_ms << ", " << gigabytes / (kernel_ms / 1e3);
+
+		if (!HasCublasGemv<T>::value)
+		{
+			cout << ", -, -, -" << endl;									// Nothing to compare against
+			continue;
+		}
+
+		float library_ms = timeGemv(handle, device_matrix, device_vector, device_result, size, GemvPath::CUBLAS);
+		device_result.get(host_library.data(), size);
+
+		double difference = 0;
+		for (int row = 0; row < size; row++)
+			difference = max(difference, fabs(double(toAccumulator(host_kernel[row])) - double(toAccumulator(host_library[row]))));
+		cout << ", " << library_ms << ", " << gigabytes / (library_ms / 1e3) << ", " << difference << endl;
+
+		if (crossover == 0 && library_ms < kernel_ms)
+			crossover = size;
+	}
+
+	if (crossover > 0)
+		cout << name << ": cuBLAS is faster from " << crossover << " x " << crossover << " on (GEMV_CUBLAS_ELEMENTS = " << GEMV_CUBLAS_ELEMENTS << ")" << endl;
+	else
+		cout << name << ": gemvKernel is faster or as fast at all sizes" << endl;
+}
+
+void benchmark_gemv()
+{
+	cublasHandle_t handle;
+	CUBLAS_CHECK(cublasCreate(&handle));
+
+	benchmarkGemv<float>(handle, "float");
+	benchmarkGemv<double>(handle, "double");
+	benchmarkGemv<__half>(handle, "half");
+
+	CUBLAS_CHECK(cublasDestroy(handle));
+}
+
+// Largest difference of gemmKernel to the product on the CPU.
+template <class T>
+static double checkGemm(int M, int N, int K)
+{
+	std::vector<T> host_A((size_t)M * K), host_B((size_t)K * N), host_C((size_t)M * N);
+	fillPattern(host_A, 0);
+	fillPattern(host_B, 3);
+
+	CudaDeviceArray<T> device_A(host_A.size());
+	CudaDeviceArray<T> device_B(host_B.size());
+	CudaDeviceArray<T> device_C(host_C.size());
+	device_A.set(host_A.data(), host_A.size());
+	device_B.set(host_B.data(), host_B.size());
+	gemm<T>(device_A.getData(), device_B.getData(), device_C.getData(), M, N, K);
+	device_C.get(host_C.data(), host_C.size());
+
 	double err = 0;
-	// Check the result and make sure it is correct
-	for (int ROW = 0; ROW < ROWS; ROW++) {
-			err += cpu_C[ROW] - host_result[ROW];
+	for (int row = 0; row < M; row++) {
+		for (int col = 0; col < N; col++) {
+			double sum = 0;
+			for (int k = 0; k < K; k++) {
+				sum += double(host_A[(size_t)row * K + k]) * double(host_B[(size_t)k * N + col]);
+			}
+			err = max(err, fabs(sum - double(host_C[(size_t)row * N + col])));
+		}
+	}
+	return err;
+}
+
+// Times gemmKernel or cuBLAS: mean of GEMM_BENCHMARK_RUNS launches after a warm up, in ms.
+template <class T>
+static float timeGemm(cublasHandle_t handle, CudaDeviceArray<T>& A, CudaDeviceArray<T>& B, CudaDeviceArray<T>& C, int size, bool library)
+{
+	CudaTimer timer;
 
+	for (int run = 0; run <= GEMM_BENCHMARK_RUNS; run++)
+	{
+		if (run == 1)
+			timer.start();											// After the warm up
+		if (library)
+			cublasGemm(handle, A.getData(), B.getData(), C.getData(), size, size, size);
+		else
+			gemm<T>(A.getData(), B.getData(), C.getData(), size, size, size);
 	}
+	timer.stop();
+	return timer.elapsedMs() / GEMM_BENCHMARK_RUNS;
+}
+
+// One line per size: time and GFLOP/s of gemmKernel and cuBLAS, the largest difference of their results
+// and, up to GEMM_REFERENCE_SIZE, of gemmKernel to the CPU.
+template <class T>
+static void benchmarkGemm(cublasHandle_t handle, const char* name)
+{
+	const int SIZES[] = { 64, 128, 256, 512, 1024, 2048, 4096 };
 
-	cout << "Error: " << err << endl;
+	cout << name << ": odd shape 100 x 33 times 33 x 70, max error against the CPU: " << checkGemm<T>(100, 70, 33) << endl;
+	cout << name << ": size, kernel ms, kernel GFLOP/s, cuBLAS ms, cuBLAS GFLOP/s, max difference, max error against the CPU" << endl;
+	for (int size : SIZES)
+	{
+		size_t const elements = (size_t)size * size;
+		std::vector<T> host_A(elements), host_B(elements), host_kernel(elements), host_library(elements);
+		fillPattern(host_A, 0);
+		fillPattern(host_B, 3);
+
+		CudaDeviceArray<T> device_A(elements);
+		CudaDeviceArray<T> device_B(elements);
+		CudaDeviceArray<T> device_C(elements);
+		device_A.set(host_A.data(), elements);
+		device_B.set(host_B.data(), elements);
+
+		double gigaflops = 2.0 * size * size * size / 1e9;
+
+		float kernel_ms = timeGemm(handle, device_A, device_B, device_C, size, false);
+		device_C.get(host_kernel.data(), elements);
+		float library_ms = timeGemm(handle, device_A, device_B, device_C, size, true);
+		device_C.get(host_library.data(), elements);
+
+		double difference = 0;
+		for (size_t i = 0; i < elements; i++)
+			difference = max(difference, fabs(double(host_kernel[i]) - double(host_library[i])));
+		cout << size << ", " << kernel_ms << ", " << gigaflops / (kernel_ms / 1e3) << ", " << library_ms << ", "
+			 << gigaflops / (library_ms / 1e3) << ", " << difference;
+		if (size <= GEMM_REFERENCE_SIZE)
+			cout << ", " << checkGemm<T>(size, size, size) << endl;
+		else
+			cout << ", -" << endl;										// O(n^3) on one core takes too long
+	}
+}
 
-	//return 0;
+void benchmark_gemm()
+{
+	cublasHandle_t handle;
+	CUBLAS_CHECK(cublasCreate(&handle));
+
+	benchmarkGemm<float>(handle, "float");
+	benchmarkGemm<double>(handle, "double");
+
+	CUBLAS_CHECK(cublasDestroy(handle));
+}
+
+// One line per size: mean time of every reduction variant after a warm up, the fastest one and the largest error
+// of all variants against the CPU. At the end the variant which was the fastest most often.
+template <class T, class Op>
+static void benchmarkReduce(const char* name, Op op)
+{
+	const int SIZES[] = { 1 << 10, 1 << 14, 1 << 18, 1 << 20, 1 << 22, 1 << 24 };
+	const int PATHS = sizeof(REDUCE_PATHS) / sizeof(REDUCE_PATHS[0]);
+	int wins[PATHS] = {};
+
+	cout << name << ": size";
+	for (int p = 0; p < PATHS; p++)
+		cout << ", " << REDUCE_PATH_NAMES[p] << " ms";
+	cout << ", fastest, fastest GB/s, max error" << endl;
+	for (int size : SIZES)
+	{
+		std::vector<T> host_data(size);
+		for (int i = 0; i < size; i++)
+			host_data[i] = T(int((i * 7) % 9) - 4);						// Small integers: every order of the operations is exact
+		T reference = Op::template identity<T>();
+		for (int i = 0; i < size; i++)
+			reference = op(reference, host_data[i]);
+
+		CudaDeviceArray<T> device_data(size);
+		device_data.set(host_data.data(), size);
+		ReduceBuffers<T> buffers;
+		buffers.partials.resize(size / (REDUCE_THREADS - 1) + REDUCE_MAX_BLOCKS + 8);	// All passes of the tree, or the blocks of deviceReduce
+		buffers.result.resize(1);
+		size_t cubBytes = 0;
+		CUDA_CHECK(cub::DeviceReduce::Reduce(NULL, cubBytes, device_data.getData(), buffers.result.getData(), size, op, Op::template identity<T>()));
+		buffers.cubStorage.resize(cubBytes);
+
+		cout << size;
+		double err = 0;
+		int fastest = 0;
+		float fastest_ms = 0;
+		for (int p = 0; p < PATHS; p++)
+		{
+			CudaTimer timer;
+			reduce(REDUCE_PATHS[p], device_data.getData(), size, buffers, op);	// Warm up
+			timer.start();
+			for (int run = 0; run < REDUCE_BENCHMARK_RUNS; run++)
+				reduce(REDUCE_PATHS[p], device_data.getData(), size, buffers, op);
+			timer.stop();
+			float ms = timer.elapsedMs() / REDUCE_BENCHMARK_RUNS;
+
+			T value;
+			buffers.result.get(&value, 1);
+			err = max(err, fabs(double(value) - double(reference)));
+			if (p == 0 || ms < fastest_ms)
+			{
+				fastest = p;
+				fastest_ms = ms;
+			}
+			cout << ", " << ms;
+		}
+		wins[fastest]++;
+		cout << ", " << REDUCE_PATH_NAMES[fastest] << ", " << double(sizeof(T)) * size / 1e9 / (fastest_ms / 1e3) << ", " << err << endl;
+	}
+
+	int best = 0;
+	for (int p = 1; p < PATHS; p++)
+		if (wins[p] > wins[best])
+			best = p;
+	cout << name << ": " << REDUCE_PATH_NAMES[best] << " is the fastest at " << wins[best] << " of " << sizeof(SIZES) / sizeof(SIZES[0]) << " sizes" << endl;
+}
+
+void benchmark_reduce()
+{
+	benchmarkReduce<float>("float sum", ReduceSum());
+	benchmarkReduce<double>("double sum", ReduceSum());
+	benchmarkReduce<float>("float min", ReduceMin());
+	benchmarkReduce<int>("int max", ReduceMax());
+}
+
+void batched_multiply()
+{
+	const int BATCH = 10000;
+	const int N = 4;												// 4 x 4 transforms, like one per school
+
+	std::vector<float> host_matrices(BATCH * N * N), host_vectors(BATCH * N), host_results(BATCH * N);
+	fillPattern(host_matrices, 0);
+	fillPattern(host_vectors, 3);
+
+	BatchedGemv<float> batched(N, N, BATCH);
+	batched.setMatrices(host_matrices.data(), BATCH);
+	batched.setVectors(host_vectors.data(), BATCH);
+
+	CudaTimer timer;
+
+	batched.run(BATCH);												// Warm up
+	timer.start();
+	batched.run(BATCH);
+	timer.stop();
+	float batched_ms = timer.elapsedMs();
+	batched.getResults(host_results.data(), BATCH);
+
+	// The same products with one launch each, as multiply does it
+	timer.start();
+	for (int b = 0; b < BATCH; b++)
+		gemv<float>(NULL, batched.getMatrices() + b * N * N, batched.getVectors() + b * N, batched.getResults() + b * N, N, N, GemvPath::KERNEL);
+	timer.stop();
+	float single_ms = timer.elapsedMs();
+
+	// Validation against the CPU
+	double err = 0;
+	for (int b = 0; b < BATCH; b++) {
+		for (int row = 0; row < N; row++) {
+			double sum = 0;
+			for (int col = 0; col < N; col++) {
+				sum += host_matrices[(b * N + row) * N + col] * host_vectors[b * N + col];
+			}
+			err = max(err, fabs(sum - host_results[b * N + row]));
+		}
+	}
 
-	//std::cout << "result:" << endl; // [20, 22]
-	//for (int i = 0; i < ROWS; i++)
-	//{
-	//	std::cout << (i+1) << ": \t" << host_result[i] << endl;
-	//}
+	cout << "Batched " << BATCH << " x " << N << "x" << N << ": " << batched_ms << " ms in one launch, "
+		 << single_ms << " ms with one launch each, max error: " << err << endl;
 }
 
 void multiply()
@@ -181,9 +1024,9 @@ void multiply()
 	//int blockRows = (int)ceil(rows / (double)BLOCK_HEIGHT);
 
 	dim3 blockSettings(rows);
-	dim3 threadSettings(cols);
+	dim3 threadSettings(min(cols, 1024u));
 
-	multiplyVM <<<blockSettings, threadSettings>>> (cudaMatrix, cudaVector, cols, cudaResultMatrix);
+	multiplyVM<double> <<<blockSettings, threadSettings>>> (cudaMatrix, cudaVector, cols, cudaResultMatrix);
 
 	//arrayAdd <<<blockSettings, 1>>> (cudaResultMatrix, cols, cudaResult);
 
@@ -8,9 +8,43 @@
 
 #define BLOCK_HEIGHT 1024
 #define BLOCK_WIDTH  64
+#define GEMV_WARPS   8					// Rows per block of gemvKernel, one warp per row
+#define GEMV_CUBLAS_ELEMENTS (1 << 20)	// Matrix size from which gemv uses cuBLAS, see benchmark_gemv
+#define GEMV_BENCHMARK_RUNS  20			// Timed launches per size and path
+#define GEMM_TILE            64			// Rows and columns of C per block of gemmKernel
+#define GEMM_TILE_K          16			// Depth of the tiles of A and B in shared memory
+#define GEMM_THREAD_TILE     4			// Rows and columns of C per thread, held in registers
+#define GEMM_BENCHMARK_RUNS  10			// Timed launches per size and path
+#define GEMM_REFERENCE_SIZE  256		// Largest size benchmark_gemm checks against the CPU
+#define REDUCE_BENCHMARK_RUNS 20		// Timed reductions per size and path
+#define LATENCY_LAUNCHES     1000		// Timed launches of emptyKernel per path
+#define LATENCY_GRAPH_BATCH  100		// Launches of emptyKernel per graph
+#define ALLOC_RUNS           100		// Timed allocations per size and allocator
+#define TRANSFER_RUNS        10			// Timed copies per size and memory kind
+#define MACHINE_PROFILE      "machine_profile.txt"	// Results of benchmark_latency, one line per GPU and driver
 
 int add(int a, int b);
 
+// Launch latency of an empty kernel (stream and graph), cudaMalloc against the pool of cudaMallocAsync, and H2D and D2H
+// bandwidth of pageable, pinned and mapped memory over sizes. The constants of this machine go into MACHINE_PROFILE.
+void benchmark_latency();
+
 void multiply();
 
 void new_multiply();
+
+// Paths of gemv. AUTO picks by size.
+enum class GemvPath { AUTO, KERNEL, CUBLAS };
+
+// Compares gemvKernel with cuBLAS for float, double and half over matrix sizes.
+void benchmark_gemv();
+
+// 10000 4x4 products with BatchedGemv in one launch, compared with one launch per product.
+void batched_multiply();
+
+// Checks gemmKernel against the CPU and compares it with cuBLAS for float and double over matrix sizes.
+void benchmark_gemm();
+
+// Sweeps the reduction variants (global atomics, shared tree, warp shuffle, many elements per thread, CUB) over sizes,
+// for sums, minima and maxima of several types, each checked against the CPU.
+void benchmark_reduce();
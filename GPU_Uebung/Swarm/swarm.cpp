@@ -15,7 +15,12 @@ int main()
 	std::cout << device << std::endl;
 	std::cout << "" << a << " + " << b << " = " << add(a, b) << std::endl;
 
+	benchmark_latency();
 	new_multiply();
+	benchmark_gemv();
+	batched_multiply();
+	benchmark_gemm();
+	benchmark_reduce();
 
 	return 0;
 }
\ No newline at end of file
@@ -38,10 +38,13 @@ public:
 	void rotatePitch( DegreeAngle const & _rotation );
 	void rotateYaw( DegreeAngle const & _rotation );
 	void resetAngles();
+	void setAngles( DegreeAngle const & _pitch, DegreeAngle const & _yaw );
 
 	CameraType const type() const;
 
 	glm::vec4 const eyePoint() const;
+	DegreeAngle const pitch() const;
+	DegreeAngle const yaw() const;
 	glm::vec4 const viewDirection() const;
 	glm::vec4 const upDirection() const;
 	glm::vec4 const horizontalDirection() const;
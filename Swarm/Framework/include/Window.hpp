@@ -2,7 +2,10 @@
 
 #include <glew.h>
 #include <glfw3.h>
+#include <atomic>
+#include <set>
 #include <string>
+#include <vector>
 #include "Camera.hpp"
 
 /**
@@ -70,12 +73,51 @@ public:
 		double y;
 	};
 
+	struct CameraState
+	{
+		glm::mat4x4 view;			//!< View matrix of the camera.
+		glm::mat4x4 projection;		//!< Projection matrix of the camera.
+	};
+
+	struct CameraPose
+	{
+		glm::vec4 eyePoint;			//!< Eye point of the camera.
+		GLfloat pitch;				//!< Pitch angle in degrees.
+		GLfloat yaw;				//!< Yaw angle in degrees.
+	};
+
 	void open( std::string const& _title );
 	void updateDisplay();
 
 	static double getCurrentTime();
 	CursorPosition getCursorPos();
 
+	void setBenchmarkMode( bool _benchmark );
+	bool isBenchmarkMode() const;
+	void setGLVersion( int _major, int _minor );
+	int getGLVersion() const;
+	void setVisible( bool _visible );
+	void setSamples( int _samples );
+	void setEglDevice( int _device );
+	bool isOffscreen() const;
+	bool isVisible() const;
+	double getGlewInitTime() const;
+	void setTitleInfo( std::string const & _info );
+	bool consumeKeyPress( GLint const & _key );
+	bool consumeClick( CursorPosition & _position );
+	bool isPaused() const;
+	bool consumeStep();
+	bool consumeRedraw();
+	bool isIconified() const;
+	void waitEvents();
+	void pollEvents();
+	CameraState getCameraState() const;
+	CameraPose getCameraPose() const;
+	void setCameraPose( CameraPose const & _pose );
+	void setKeyLog( bool _enabled );
+	std::vector<GLint> takeKeyLog();
+	void injectKeyPress( GLint const & _key );
+
 	std::string windowTitle_;
 
 private:
@@ -86,12 +128,49 @@ private:
 	double lastUpdate_;
 
 	int fpsCount_ = 0;
+	bool benchmarkMode_ = false;	//!< V-Sync off, frames per second are also printed.
+	int requestedMajor_ = 3;		//!< Context version asked for by setGLVersion.
+	int requestedMinor_ = 3;
+	int glVersion_ = 0;				//!< Version of the created context, major * 10 + minor. 0: no context.
+	double glewInitTime_ = 0.0;		//!< Seconds of glewInit in the last open.
+	bool visible_ = true;			//!< false: hidden window, only the context is used, e.g. to record videos.
+	int samples_ = 4;				//!< Multisampling of the default framebuffer. 0: off, e.g. with an own render target.
+	int eglDevice_ = -1;			//!< CUDA device of the EGL context (setEglDevice). -1: GLFW window.
+	void * eglDisplay_ = NULL;		//!< EGLDisplay of the device platform. NULL: no EGL context.
+	void * eglSurface_ = NULL;		//!< EGLSurface, a pbuffer as default framebuffer.
+	void * eglContext_ = NULL;		//!< EGLContext.
+	GLuint eglWidth_ = 0;			//!< Size of the pbuffer in pixels.
+	GLuint eglHeight_ = 0;
+	std::string titleInfo_;			//!< Shown behind the frame rate, e.g. stage times.
+	std::set<GLint> pressedKeys_;	//!< Keys pressed since they were consumed last.
+	bool clicked_ = false;			//!< Left mouse button pressed since consumeClick.
+	CursorPosition click_ = {};		//!< Cursor at the last click, in window coordinates.
+	bool keyLogEnabled_ = false;	//!< Record the key presses for takeKeyLog.
+	std::vector<GLint> keyLog_;		//!< Key presses since the last takeKeyLog, in order.
+	bool paused_ = false;			//!< P: no steps, the main loop waits for events.
+	bool stepRequested_ = false;	//!< Period while paused: one step with the next frame.
+	bool redraw_ = true;			//!< Key, resize or expose since the last frame, the paused scene has to be drawn again.
+	bool iconified_ = false;		//!< Minimized, nothing is shown.
+
+	struct CameraSlot
+	{
+		std::atomic<unsigned int> sequence{ 0 };	//!< Odd while the state is written.
+		CameraState state;
+	};
+	CameraSlot cameraSlots_[2];		//!< Double buffered camera state, written by the event handlers.
+	std::atomic<unsigned int> cameraLatest_{ 0 };	//!< Slot of the last publishCamera.
 
 	static void APIENTRY openglErrorCallback( GLenum _source, GLenum _type, GLenum id, GLenum severity,
 		GLsizei _length, const GLchar* _message, const void* _userParam );
 
 	static void errorCallback( int _error, const char* _description );
 	static void scrollCallback( GLFWwindow* window, double xoffset, double yoffset );
+	static void mouseButtonCallback( GLFWwindow* _window, int _button, int _action, int _mods );
+	static void iconifyCallback( GLFWwindow* _window, int _iconified );
+	static void refreshCallback( GLFWwindow* _window );
 
 	void computeFPS();
+	void publishCamera();
+	bool openEgl( GLuint const & _pixelWidth, GLuint const & _pixelHeight );
+	void closeEgl();
 };
\ No newline at end of file
@@ -138,6 +138,18 @@ void Camera::resetAngles()
 	m_yaw = 0.0f;
 }
 
+/**
+	Sets both rotation angles, e.g. to restore a recorded camera.
+
+	@param	_pitch	The new pitch angle.
+	@param	_yaw	The new yaw angle.
+*/
+void Camera::setAngles( DegreeAngle const & _pitch, DegreeAngle const & _yaw )
+{
+	m_pitch = _pitch;
+	m_yaw = _yaw;
+}
+
 /**
 	@return	Returns the type of the camera.
 */
@@ -154,6 +166,22 @@ glm::vec4 const Camera::eyePoint() const
 	return m_eyePoint;
 }
 
+/**
+	@return	Returns the current pitch angle.
+*/
+DegreeAngle const Camera::pitch() const
+{
+	return m_pitch;
+}
+
+/**
+	@return	Returns the current yaw angle.
+*/
+DegreeAngle const Camera::yaw() const
+{
+	return m_yaw;
+}
+
 /**
 	@return	Returns the current view direction. Is normalized to 1.
 			The view system is a right-handed coordinate system.
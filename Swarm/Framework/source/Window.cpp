@@ -1,13 +1,23 @@
 #include "Window.hpp"
+#include <chrono>
 #include <iostream>
 #include <glew.h>
 #include <glfw3.h>
+#ifdef SWARM_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 
 /**
 	The window instance must be initialized with null.
 */
 Window * Window::m_instance = NULL;
 
+/**
+	GLFW is initialized, its timer runs. Without a display, e.g. on a render farm node, it can't be.
+*/
+static bool glfwReady = false;
+
 /**
 	Initializes the window instance and returns always the same object.
 
@@ -35,15 +45,12 @@ Window::Window() :
 	lastUpdate_ = getCurrentTime();
 
 	glewExperimental = GL_TRUE;
-	if( GL_FALSE == glfwInit() )
+	m_camera.setDistancePlanes( 1.0f, 10000.0f );
+	glfwReady = GL_TRUE == glfwInit();
+	if( !glfwReady )
 	{
 		std::cerr << "Unable to initialize glfw library." << std::endl;
 	}
-
-	else
-	{
-		m_camera.setDistancePlanes( 1.0f, 10000.0f );
-	}
 }
 
 /**
@@ -54,12 +61,15 @@ Window::~Window()
 {
 	close();
 
-	glfwTerminate();
+	if( glfwReady )
+	{
+		glfwTerminate();
+	}
 }
 
 void Window::setWindowTitle( const char* _title )
 {
-	if ( isOpen() )
+	if ( NULL != m_window )
 	{ 
 		glfwSetWindowTitle( m_window, _title );
 	}
@@ -76,22 +86,73 @@ void Window::open( std::string const & _title,
 				   GLuint const & _pixelWidth,
 				   GLuint const & _pixelHeight)
 {
+	if( !isOpen() && eglDevice_ >= 0 && openEgl( _pixelWidth, _pixelHeight ) )
+	{
+		// No window system: no events, the camera only moves by setEyePoint and setCameraPose
+		double const glewStart = getCurrentTime();
+		GLenum const glewError = glewInit();
+		glewInitTime_ = getCurrentTime() - glewStart;
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+		if( GLEW_OK != glewError && GLEW_ERROR_NO_GLX_DISPLAY != glewError )	// GLEW without EGL support still loads the core functions
+#else
+		if( GLEW_OK != glewError )
+#endif
+		{
+			close();
+			std::cerr << "Unable to initialize glew library: ";
+			std::cerr << glewGetErrorString( glewError ) << std::endl;
+			return;
+		}
+
+		GLint major = 0;
+		GLint minor = 0;
+		glGetIntegerv( GL_MAJOR_VERSION, &major );
+		glGetIntegerv( GL_MINOR_VERSION, &minor );
+		glVersion_ = 10 * major + minor;
+		std::cout << "OpenGL " << major << "." << minor << " EGL context on the device platform." << std::endl;
+
+		m_camera.setWindowSize( static_cast< GLfloat > ( _pixelWidth ),
+								static_cast< GLfloat >( _pixelHeight ) );
+		publishCamera();
+		visible_ = false;
+
+		glEnable( GL_DEBUG_OUTPUT );
+		glEnable( GL_DEBUG_OUTPUT_SYNCHRONOUS );
+		glDebugMessageCallback( openglErrorCallback, NULL );
+		glDebugMessageControl( GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, static_cast< GLboolean >( true ) );
+
+		windowTitle_ = _title;
+	}
+
 	if( !isOpen() )
 	{
 		// Set GLFW error callback
 		glfwSetErrorCallback( errorCallback );
 
-		glfwWindowHint( GLFW_SAMPLES, 4 );
-		glfwWindowHint( GLFW_CONTEXT_VERSION_MAJOR, 3 );
-		glfwWindowHint( GLFW_CONTEXT_VERSION_MINOR, 3 );
+		glfwWindowHint( GLFW_SAMPLES, samples_ );
+		glfwWindowHint( GLFW_CONTEXT_VERSION_MAJOR, requestedMajor_ );
+		glfwWindowHint( GLFW_CONTEXT_VERSION_MINOR, requestedMinor_ );
 		glfwWindowHint( GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE );
+		glfwWindowHint( GLFW_VISIBLE, visible_ ? GL_TRUE : GL_FALSE );
 
 		m_window = glfwCreateWindow( static_cast< int >( _pixelWidth ),
 									 static_cast< int >( _pixelHeight ),
 									 _title.c_str(), NULL, NULL );
+		if( NULL == m_window && ( requestedMajor_ != 3 || requestedMinor_ != 3 ) )
+		{
+			// Driver doesn't offer the newer context, everything also runs on 3.3
+			std::cerr << "OpenGL " << requestedMajor_ << "." << requestedMinor_ << " context failed, falling back to 3.3." << std::endl;
+			glfwWindowHint( GLFW_CONTEXT_VERSION_MAJOR, 3 );
+			glfwWindowHint( GLFW_CONTEXT_VERSION_MINOR, 3 );
+			m_window = glfwCreateWindow( static_cast< int >( _pixelWidth ),
+										 static_cast< int >( _pixelHeight ),
+										 _title.c_str(), NULL, NULL );
+		}
 		setActive();
 		
+		double const glewStart = getCurrentTime();
 		GLenum const glewError = glewInit();
+		glewInitTime_ = getCurrentTime() - glewStart;
 		if( GLEW_OK != glewError )
 		{
 			close();
@@ -112,20 +173,26 @@ void Window::open( std::string const & _title,
 
 		else
 		{
-			std::cout << "OpenGL 3.3 is supported." << std::endl;
+			glVersion_ = 10 * glfwGetWindowAttrib( m_window, GLFW_CONTEXT_VERSION_MAJOR )
+				+ glfwGetWindowAttrib( m_window, GLFW_CONTEXT_VERSION_MINOR );
+			std::cout << "OpenGL " << glVersion_ / 10 << "." << glVersion_ % 10 << " context." << std::endl;
 		}
 
 		m_camera.setWindowSize( static_cast< GLfloat > ( _pixelWidth ),
 								static_cast< GLfloat >( _pixelHeight ) );
+		publishCamera();
 		glfwSetKeyCallback( m_window, Window::handleKeyEvent );
 		glfwSetWindowSizeCallback( m_window, Window::handleResizeEvent );
 		glfwSetFramebufferSizeCallback( m_window, Window::handleFramebufferResizeEvent );
 
 		// Set Scroll Callback
 		glfwSetScrollCallback( m_window, Window::scrollCallback );
+		glfwSetMouseButtonCallback( m_window, Window::mouseButtonCallback );
+		glfwSetWindowIconifyCallback( m_window, Window::iconifyCallback );
+		glfwSetWindowRefreshCallback( m_window, Window::refreshCallback );
 
 		/* Enable / Disable V-Sync */
-		glfwSwapInterval( 1 );
+		glfwSwapInterval( benchmarkMode_ ? 0 : 1 );
 
 		// Enable opengl debug callback
 		glEnable( GL_DEBUG_OUTPUT );
@@ -142,7 +209,7 @@ void Window::open( std::string const & _title,
 */
 GLboolean Window::isOpen() const
 {
-	return NULL != m_window;
+	return NULL != m_window || NULL != eglContext_;
 }
 
 /**
@@ -151,11 +218,16 @@ GLboolean Window::isOpen() const
 */
 void Window::close()
 {
-	if( isOpen() )
+	closeEgl();
+
+	if( NULL != m_window )
 	{
 		glfwSetKeyCallback( m_window, NULL );
 		glfwSetWindowSizeCallback( m_window, NULL );
 		glfwSetFramebufferSizeCallback( m_window, NULL );
+		glfwSetWindowIconifyCallback( m_window, NULL );
+		glfwSetWindowRefreshCallback( m_window, NULL );
+		glfwSetMouseButtonCallback( m_window, NULL );
 
 		glfwSetWindowShouldClose( m_window, GL_FALSE );
 		
@@ -171,6 +243,7 @@ void Window::close()
 void Window::setEyePoint( glm::vec4 const & _eyePoint )
 {
 	m_camera.setEyePoint( _eyePoint );
+	publishCamera();
 }
 
 /**
@@ -178,7 +251,12 @@ void Window::setEyePoint( glm::vec4 const & _eyePoint )
 */
 GLuint Window::getWidth() const
 {
-	if( isOpen() )
+	if( NULL != eglContext_ )
+	{
+		return eglWidth_;
+	}
+
+	else if( isOpen() )
 	{
 		int width = 0;
 		glfwGetWindowSize( m_window, &width, NULL );
@@ -196,7 +274,12 @@ GLuint Window::getWidth() const
 */
 GLuint Window::getHeight() const
 {
-	if( isOpen() )
+	if( NULL != eglContext_ )
+	{
+		return eglHeight_;
+	}
+
+	else if( isOpen() )
 	{
 		int height = 0;
 		glfwGetWindowSize( m_window, NULL, &height );
@@ -214,6 +297,14 @@ GLuint Window::getHeight() const
 */
 void Window::setActive()
 {
+#ifdef SWARM_EGL
+	if( NULL != eglContext_ )
+	{
+		eglMakeCurrent( eglDisplay_, eglSurface_, eglSurface_, eglContext_ );
+		return;
+	}
+#endif
+
 	if( isOpen() )
 	{
 		glfwMakeContextCurrent( m_window );
@@ -226,6 +317,14 @@ void Window::setActive()
 */
 void Window::swapBuffer()
 {
+#ifdef SWARM_EGL
+	if( NULL != eglContext_ )
+	{
+		eglSwapBuffers( eglDisplay_, eglSurface_ );	// Nothing is shown, ends the frame of the pbuffer
+		return;
+	}
+#endif
+
 	if( isOpen() )
 	{
 		setActive();
@@ -314,8 +413,33 @@ void Window::handleKeyEvent( GLint const & _key,
 		{
 			// std::cout << "Handle key " << _key << "." << std::endl;
 
+			if( GLFW_PRESS == _action )
+			{
+				pressedKeys_.insert( _key );
+			}
+			if( keyLogEnabled_ && _key > 0 )
+			{
+				keyLog_.push_back( GLFW_PRESS == _action ? _key : -_key );
+			}
+
+			// Every key may move the camera, a paused scene is drawn again
+			redraw_ = true;
+
 			switch( _key )
 			{
+				case GLFW_KEY_P:
+					if( GLFW_PRESS == _action )
+					{
+						paused_ = !paused_;
+						stepRequested_ = false;
+						setWindowTitle( ( windowTitle_ + ( paused_ ? " (paused)" : "" ) ).c_str() );
+					}
+					break;
+
+				case GLFW_KEY_PERIOD:
+					stepRequested_ = paused_;
+					break;
+
 				case GLFW_KEY_W:
 					m_camera.translateEyePoint( m_camera.viewDirection() * 10.0f );
 					break;
@@ -364,6 +488,8 @@ void Window::handleKeyEvent( GLint const & _key,
 				default:
 					break;
 			}
+
+			publishCamera();
 		}
 	}
 }
@@ -380,8 +506,10 @@ void Window::handleResizeEvent( GLuint const & _width,
 	if( isOpen() )
 	{
 		std::cout << "Window resized." << std::endl;
+		redraw_ = true;
 		m_camera.setWindowSize( static_cast< GLfloat >( _width ),
 								static_cast< GLfloat >( _height ) );
+		publishCamera();
 	}
 }
 
@@ -413,13 +541,256 @@ void Window::updateDisplay()
 
 double Window::getCurrentTime()
 {
+	if( !glfwReady )
+	{
+		// Same clock for frame rates and stage times without GLFW
+		static std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+		return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+	}
 	return glfwGetTime();
 }
 
+/**
+	Enables or disables the benchmark mode.
+	Benchmark mode turns V-Sync off, so the frame rate is not capped by the display.
+
+	@param _benchmark True, to enable benchmark mode.
+*/
+void Window::setBenchmarkMode( bool _benchmark )
+{
+	benchmarkMode_ = _benchmark;
+
+	if ( NULL != m_window )
+	{
+		glfwSwapInterval( benchmarkMode_ ? 0 : 1 );
+	}
+}
+
+/**
+	@return Returns true, if benchmark mode is enabled.
+*/
+bool Window::isBenchmarkMode() const
+{
+	return benchmarkMode_;
+}
+
+/**
+	Sets the OpenGL version of the context. Must be called before open.
+	If the driver can't create it, open falls back to 3.3.
+
+	@param _major Major version, e.g. 4.
+	@param _minor Minor version, e.g. 5.
+*/
+void Window::setGLVersion( int _major, int _minor )
+{
+	requestedMajor_ = _major;
+	requestedMinor_ = _minor;
+}
+
+/**
+	@return Version of the created context as major * 10 + minor, e.g. 45. 0 before open.
+*/
+int Window::getGLVersion() const
+{
+	return glVersion_;
+}
+
+/**
+	Shows or hides the window. Must be called before open.
+	A hidden window still has a context, which renders into framebuffer objects.
+
+	@param _visible False, to open the window hidden.
+*/
+void Window::setVisible( bool _visible )
+{
+	visible_ = _visible;
+}
+
+/**
+	Sets the samples per pixel of the default framebuffer. Must be called before open.
+
+	@param _samples Samples, e.g. 4. 0 turns multisampling off.
+*/
+void Window::setSamples( int _samples )
+{
+	samples_ = _samples;
+}
+
+/**
+	Renders without a window system: open creates an EGL context of the device platform on the GPU
+	of a CUDA device, with a pbuffer as default framebuffer. No X server or display is needed, the frames only
+	go into framebuffer objects, e.g. of the video recorder. Several processes can render on one GPU at once.
+	Needs a build with SWARM_EGL, the EGL headers and libEGL (GLEW built with GLEW_EGL); without it,
+	or if no EGL device is found, open falls back to a GLFW window. Must be called before open.
+
+	@param _device CUDA device ordinal, matched by EGL_NV_device_cuda, else the EGL device with this index. -1: GLFW window (default).
+*/
+void Window::setEglDevice( int _device )
+{
+	eglDevice_ = _device;
+}
+
+/**
+	@return Returns true, if the context is an EGL context without window.
+*/
+bool Window::isOffscreen() const
+{
+	return NULL != eglContext_;
+}
+
+/**
+	Creates the EGL context of setEglDevice and makes it current.
+
+	@param _pixelWidth The width of the pbuffer in pixels.
+	@param _pixelHeight The height of the pbuffer in pixels.
+	@return Returns true, if the context exists. False, if a GLFW window has to be opened instead.
+*/
+bool Window::openEgl( GLuint const & _pixelWidth, GLuint const & _pixelHeight )
+{
+#ifdef SWARM_EGL
+	PFNEGLQUERYDEVICESEXTPROC const queryDevices = reinterpret_cast< PFNEGLQUERYDEVICESEXTPROC >( eglGetProcAddress( "eglQueryDevicesEXT" ) );
+	PFNEGLQUERYDEVICEATTRIBEXTPROC const queryDeviceAttrib = reinterpret_cast< PFNEGLQUERYDEVICEATTRIBEXTPROC >( eglGetProcAddress( "eglQueryDeviceAttribEXT" ) );
+	PFNEGLGETPLATFORMDISPLAYEXTPROC const getPlatformDisplay = reinterpret_cast< PFNEGLGETPLATFORMDISPLAYEXTPROC >( eglGetProcAddress( "eglGetPlatformDisplayEXT" ) );
+	if( NULL == queryDevices || NULL == getPlatformDisplay )
+	{
+		std::cerr << "EGL has no device platform, opening a window instead." << std::endl;
+		return false;
+	}
+
+	EGLDeviceEXT devices[16];
+	EGLint count = 0;
+	if( !queryDevices( 16, devices, &count ) || 0 == count )
+	{
+		std::cerr << "No EGL device, opening a window instead." << std::endl;
+		return false;
+	}
+
+	// The GPU of the CUDA device, so the interop stays on one GPU
+	EGLDeviceEXT device = devices[eglDevice_ < count ? eglDevice_ : 0];
+	for( EGLint i = 0; i < count && NULL != queryDeviceAttrib; i++ )
+	{
+		EGLAttrib cudaDevice = -1;
+		if( queryDeviceAttrib( devices[i], EGL_CUDA_DEVICE_NV, &cudaDevice ) && cudaDevice == eglDevice_ )
+		{
+			device = devices[i];
+			break;
+		}
+	}
+
+	EGLDisplay const display = getPlatformDisplay( EGL_PLATFORM_DEVICE_EXT, device, NULL );
+	EGLint eglMajor = 0;
+	EGLint eglMinor = 0;
+	if( EGL_NO_DISPLAY == display || !eglInitialize( display, &eglMajor, &eglMinor ) )
+	{
+		std::cerr << "Unable to initialize the EGL display, opening a window instead." << std::endl;
+		return false;
+	}
+
+	EGLint const configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_SAMPLE_BUFFERS, samples_ > 0 ? 1 : 0,
+		EGL_SAMPLES, samples_,
+		EGL_NONE };
+	EGLConfig config;
+	EGLint configs = 0;
+	if( !eglChooseConfig( display, configAttribs, &config, 1, &configs ) || 0 == configs || !eglBindAPI( EGL_OPENGL_API ) )
+	{
+		eglTerminate( display );
+		std::cerr << "No EGL config for OpenGL pbuffers, opening a window instead." << std::endl;
+		return false;
+	}
+
+	EGLint const surfaceAttribs[] = { EGL_WIDTH, static_cast< EGLint >( _pixelWidth ), EGL_HEIGHT, static_cast< EGLint >( _pixelHeight ), EGL_NONE };
+	EGLSurface const surface = eglCreatePbufferSurface( display, config, surfaceAttribs );
+
+	EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, requestedMajor_,
+		EGL_CONTEXT_MINOR_VERSION, requestedMinor_,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE };
+	EGLContext context = EGL_NO_SURFACE == surface ? EGL_NO_CONTEXT : eglCreateContext( display, config, EGL_NO_CONTEXT, contextAttribs );
+	if( EGL_NO_SURFACE != surface && EGL_NO_CONTEXT == context && ( requestedMajor_ != 3 || requestedMinor_ != 3 ) )
+	{
+		// Same fallback as the window
+		std::cerr << "OpenGL " << requestedMajor_ << "." << requestedMinor_ << " context failed, falling back to 3.3." << std::endl;
+		contextAttribs[1] = 3;
+		contextAttribs[3] = 3;
+		context = eglCreateContext( display, config, EGL_NO_CONTEXT, contextAttribs );
+	}
+	if( EGL_NO_CONTEXT == context || !eglMakeCurrent( display, surface, surface, context ) )
+	{
+		if( EGL_NO_CONTEXT != context )
+		{
+			eglDestroyContext( display, context );
+		}
+		if( EGL_NO_SURFACE != surface )
+		{
+			eglDestroySurface( display, surface );
+		}
+		eglTerminate( display );
+		std::cerr << "Unable to create the EGL context, opening a window instead." << std::endl;
+		return false;
+	}
+
+	eglDisplay_ = display;
+	eglSurface_ = surface;
+	eglContext_ = context;
+	eglWidth_ = _pixelWidth;
+	eglHeight_ = _pixelHeight;
+	eglSwapInterval( display, 0 );									// Nothing to wait for
+	std::cout << "EGL " << eglMajor << "." << eglMinor << " on the device of CUDA device " << eglDevice_ << "." << std::endl;
+	return true;
+#else
+	std::cerr << "EGL needs a build with SWARM_EGL, opening a window instead." << std::endl;
+	return false;
+#endif
+}
+
+/**
+	Destroys the EGL context, if there is one.
+*/
+void Window::closeEgl()
+{
+#ifdef SWARM_EGL
+	if( NULL != eglContext_ )
+	{
+		eglMakeCurrent( eglDisplay_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+		eglDestroyContext( eglDisplay_, eglContext_ );
+		eglDestroySurface( eglDisplay_, eglSurface_ );
+		eglTerminate( eglDisplay_ );
+	}
+#endif
+	eglDisplay_ = NULL;
+	eglSurface_ = NULL;
+	eglContext_ = NULL;
+}
+
+/**
+	@return Returns the seconds glewInit took in the last open, e.g. for a startup report.
+*/
+double Window::getGlewInitTime() const
+{
+	return glewInitTime_;
+}
+
+/**
+	@return Returns true, if the window is shown.
+*/
+bool Window::isVisible() const
+{
+	return visible_;
+}
+
 Window::CursorPosition Window::getCursorPos()
 {
-	double x, y;
-	glfwGetCursorPos( m_window, &x, &y );
+	double x = 0.0, y = 0.0;
+	if( NULL != m_window )
+	{
+		glfwGetCursorPos( m_window, &x, &y );
+	}
 	return { x, y };
 }
 
@@ -476,6 +847,263 @@ void Window::scrollCallback( GLFWwindow * window, double xoffset, double yoffset
 	
 }
 
+/**
+	GLFW mouse button callback function. Keeps the cursor of the last left click for consumeClick.
+
+	@param _window The window instance of the event.
+	@param _button The mouse button ( GLFW_MOUSE_BUTTON_* ).
+	@param _action The action of the event ( GLFW_PRESS or GLFW_RELEASE ).
+	@param _mods Unused.
+*/
+void Window::mouseButtonCallback( GLFWwindow * _window, int _button, int _action, int _mods )
+{
+	Window * const window = getInstance();
+	if( GLFW_MOUSE_BUTTON_LEFT == _button && GLFW_PRESS == _action )
+	{
+		glfwGetCursorPos( _window, &window->click_.x, &window->click_.y );
+		window->clicked_ = true;
+		window->redraw_ = true;
+	}
+}
+
+/**
+	Sets text which is shown behind the frame rate in the window title.
+	The title is updated with the frame rate, once per second.
+
+	@param _info The text. Empty shows only the frame rate.
+*/
+void Window::setTitleInfo( std::string const & _info )
+{
+	titleInfo_ = _info;
+}
+
+/**
+	Checks if a key was pressed since the last check. Lets the application react to keys
+	without an own callback.
+
+	@param _key The key enumeration ( GLFW_KEY_* ).
+	@return Returns true once per key press.
+*/
+bool Window::consumeKeyPress( GLint const & _key )
+{
+	return pressedKeys_.erase( _key ) > 0;
+}
+
+/**
+	Checks if the left mouse button was clicked since the last check. Several clicks in between
+	count as the last one.
+
+	@param _position Set to the cursor of the click in window coordinates, origin top left.
+	@return Returns true once per click.
+*/
+bool Window::consumeClick( CursorPosition & _position )
+{
+	if( !clicked_ )
+	{
+		return false;
+	}
+	_position = click_;
+	clicked_ = false;
+	return true;
+}
+
+/**
+	@return Returns true, if the simulation is paused by key P.
+*/
+bool Window::isPaused() const
+{
+	return paused_;
+}
+
+/**
+	Checks if a single step was requested with the period key while paused.
+
+	@return Returns true once per request.
+*/
+bool Window::consumeStep()
+{
+	bool step = stepRequested_;
+	stepRequested_ = false;
+	return step;
+}
+
+/**
+	Checks if the scene has to be drawn again, e.g. because the camera moved or the window was exposed.
+	Only needed while paused or minimized, otherwise every frame is drawn.
+
+	@return Returns true once per change.
+*/
+bool Window::consumeRedraw()
+{
+	bool redraw = redraw_;
+	redraw_ = false;
+	return redraw;
+}
+
+/**
+	@return Returns true, if the window is minimized.
+*/
+bool Window::isIconified() const
+{
+	return iconified_;
+}
+
+/**
+	Sleeps until an event arrives instead of polling, e.g. while paused.
+	Handles the events like swapBuffer, also the close request.
+*/
+void Window::waitEvents()
+{
+	if( NULL != m_window )
+	{
+		glfwWaitEvents();
+
+		if( GL_TRUE == glfwWindowShouldClose( m_window ) )
+		{
+			close();
+		}
+	}
+}
+
+/**
+	Handles the events which arrived since the last poll without waiting, also the close request.
+	Lets the application apply the newest input right before its draws, not only after the swap.
+*/
+void Window::pollEvents()
+{
+	if( NULL != m_window )
+	{
+		glfwPollEvents();
+
+		if( GL_TRUE == glfwWindowShouldClose( m_window ) )
+		{
+			close();
+		}
+	}
+}
+
+/**
+	Returns the matrices of the camera after the last event. The state is double buffered,
+	so it can be read from another thread than the one which handles the events.
+
+	@return Returns the view and projection matrix.
+*/
+Window::CameraState Window::getCameraState() const
+{
+	for( int attempt = 0; attempt < 8; attempt++ )
+	{
+		CameraSlot const & slot = cameraSlots_[cameraLatest_.load( std::memory_order_acquire )];
+		unsigned int const before = slot.sequence.load( std::memory_order_acquire );
+		if( before % 2 == 1 )
+		{
+			continue;
+		}
+
+		CameraState const state = slot.state;
+		std::atomic_thread_fence( std::memory_order_acquire );
+		if( slot.sequence.load( std::memory_order_relaxed ) == before )
+		{
+			return state;
+		}
+	}
+
+	// Events are handled much less often than this is read, only on the same thread
+	return { m_camera.viewMatrix(), m_camera.projectionMatrix() };
+}
+
+/**
+	@return Returns eye point and angles of the camera, e.g. to record a camera path.
+*/
+Window::CameraPose Window::getCameraPose() const
+{
+	return { m_camera.eyePoint(), m_camera.pitch().toFloat(), m_camera.yaw().toFloat() };
+}
+
+/**
+	Moves the camera to a pose, e.g. of a recorded camera path. The paused scene is drawn again.
+
+	@param _pose Eye point and angles of the camera.
+*/
+void Window::setCameraPose( CameraPose const & _pose )
+{
+	m_camera.setEyePoint( _pose.eyePoint );
+	m_camera.setAngles( _pose.pitch, _pose.yaw );
+	redraw_ = true;
+	publishCamera();
+}
+
+/**
+	Enables or disables the key log. While enabled, every key press and repeat is kept for takeKeyLog.
+
+	@param _enabled True, to record the keys.
+*/
+void Window::setKeyLog( bool _enabled )
+{
+	keyLogEnabled_ = _enabled;
+	keyLog_.clear();
+}
+
+/**
+	Returns the keys since the last call and clears the log.
+
+	@return Returns the keys in order. Presses as key, repeats as -key.
+*/
+std::vector<GLint> Window::takeKeyLog()
+{
+	std::vector<GLint> keys;
+	keys.swap( keyLog_ );
+	return keys;
+}
+
+/**
+	Handles a key as if it was pressed in the window, e.g. to replay a key log.
+
+	@param _key The key enumeration ( GLFW_KEY_* ). Negative: a repeat of -_key.
+*/
+void Window::injectKeyPress( GLint const & _key )
+{
+	handleKeyEvent( _key < 0 ? -_key : _key, _key < 0 ? GLFW_REPEAT : GLFW_PRESS, 0 );
+}
+
+/**
+	Writes the matrices of the camera into the slot not read by getCameraState and makes it the latest.
+	Called after every change of the camera.
+*/
+void Window::publishCamera()
+{
+	unsigned int const next = 1 - cameraLatest_.load( std::memory_order_relaxed );
+	CameraSlot & slot = cameraSlots_[next];
+	slot.sequence.fetch_add( 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+	slot.state.view = m_camera.viewMatrix();
+	slot.state.projection = m_camera.projectionMatrix();
+	slot.sequence.fetch_add( 1, std::memory_order_release );
+	cameraLatest_.store( next, std::memory_order_release );
+}
+
+/**
+	GLFW iconify callback function.
+
+	@param _window The window instance of the event.
+	@param _iconified GL_TRUE, if the window was minimized, GL_FALSE, if it was restored.
+*/
+void Window::iconifyCallback( GLFWwindow * _window, int _iconified )
+{
+	Window * const window = getInstance();
+	window->iconified_ = GL_TRUE == _iconified;
+	window->redraw_ = true;
+}
+
+/**
+	GLFW refresh callback function. The content of the window was damaged, e.g. by another window.
+
+	@param _window The window instance of the event.
+*/
+void Window::refreshCallback( GLFWwindow * _window )
+{
+	getInstance()->redraw_ = true;
+}
+
 void Window::computeFPS()
 {
 	fpsCount_++;
@@ -488,9 +1116,12 @@ void Window::computeFPS()
 		float framesPerms = ( timeDiff * 1000 ) / double( fpsCount_ );
 		float ifps = double( fpsCount_ ) / timeDiff;
 
-		sprintf_s( fps, "%s: %3.1f FPS || %3.3f ms/frame", windowTitle_.c_str(), ifps, framesPerms );
+		sprintf_s( fps, "%s: %3.1f FPS || %3.3f ms/frame%s%s", windowTitle_.c_str(), ifps, framesPerms, titleInfo_.empty() ? "" : " || ", titleInfo_.c_str() );
 		setWindowTitle( fps );
 
+		if ( benchmarkMode_ )
+			std::cout << fps << std::endl;
+
 		fpsCount_ = 0;
 		lastUpdate_ = getCurrentTime();
 	}
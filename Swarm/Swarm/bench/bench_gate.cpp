@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "bench_gate.h"
+
+TrialStats trialStats( std::vector<double> values )
+{
+	TrialStats stats;
+	size_t n = values.size();
+	stats.trials = static_cast< unsigned int >( n );
+	if ( n == 0 )
+		return stats;
+
+	std::sort( values.begin(), values.end() );
+	stats.median = n % 2 == 1 ? values[n / 2] : 0.5 * ( values[n / 2 - 1] + values[n / 2] );
+
+	// Ranks of the interval: n / 2 -+ 1.96 * sqrt( n ) / 2 (normal approximation of the binomial), 1-based.
+	double spread = 0.98 * std::sqrt( static_cast< double >( n ) );
+	long lower = static_cast< long >( std::floor( n / 2.0 - spread ) );
+	long upper = static_cast< long >( std::ceil( n / 2.0 + 1.0 + spread ) );
+	if ( n < 6 )																// Too few trials for the approximation
+	{
+		lower = 1;
+		upper = static_cast< long >( n );
+	}
+	stats.low = values[std::min( std::max( lower, 1L ), static_cast< long >( n ) ) - 1];
+	stats.high = values[std::min( std::max( upper, 1L ), static_cast< long >( n ) ) - 1];
+	return stats;
+}
+
+std::string baselinePath( const std::string& pattern, const std::string& deviceName )
+{
+	std::string gpu = deviceName;
+	for ( char& c : gpu )
+	{
+		if ( !std::isalnum( static_cast< unsigned char >( c ) ) )
+			c = '_';
+	}
+
+	std::string path = pattern;
+	size_t at = path.find( "{gpu}" );
+	if ( at != std::string::npos )
+		path.replace( at, 5, gpu );
+	return path;
+}
+
+/*!
+ * @brief Split a CSV line at the commas.
+ * @param line line without newline.
+ * @return fields.
+ */
+static std::vector<std::string> splitCsv( const std::string& line )
+{
+	std::vector<std::string> fields;
+	std::stringstream stream( line );
+	std::string field;
+	while ( std::getline( stream, field, ',' ) )
+		fields.push_back( field );
+	return fields;
+}
+
+bool loadBaseline( const std::string& path, std::map<std::string, TrialStats>& baseline )
+{
+	std::ifstream file( path );
+	std::string line;
+	if ( !file.is_open() || !std::getline( file, line ) )
+		return false;
+
+	std::vector<std::string> header = splitCsv( line );
+	auto column = [&header]( const char* name ) -> int
+	{
+		auto found = std::find( header.begin(), header.end(), name );
+		return found == header.end() ? -1 : static_cast< int >( found - header.begin() );
+	};
+	int mode = column( "mode" );
+	int particles = column( "particles" );
+	int median = column( "ns_per_particle_step" );
+	int low = column( "ci_low" );
+	int high = column( "ci_high" );
+	int trials = column( "trials" );
+	if ( mode < 0 || particles < 0 || median < 0 )
+		return false;
+
+	while ( std::getline( file, line ) )
+	{
+		std::vector<std::string> fields = splitCsv( line );
+		if ( static_cast< int >( fields.size() ) < static_cast< int >( header.size() ) )
+			continue;															// Empty or truncated line
+
+		TrialStats stats;
+		stats.median = std::atof( fields[median].c_str() );
+		stats.low = low < 0 ? stats.median : std::atof( fields[low].c_str() );
+		stats.high = high < 0 ? stats.median : std::atof( fields[high].c_str() );
+		stats.trials = trials < 0 ? 1 : static_cast< unsigned int >( std::strtoul( fields[trials].c_str(), NULL, 10 ) );
+		baseline[fields[mode] + "," + fields[particles]] = stats;
+	}
+	return true;
+}
+
+/*!
+ * @brief Find a value of a JSON key in a line.
+ * @param line line.
+ * @param key key without quotes.
+ * @return text after the colon, strings without their quotes. Empty, if the line has no such key.
+ */
+static std::string jsonValue( const std::string& line, const std::string& key )
+{
+	size_t at = line.find( "\"" + key + "\":" );
+	if ( at == std::string::npos )
+		return std::string();
+	at = line.find_first_not_of( ' ', at + key.size() + 3 );
+	if ( at == std::string::npos )
+		return std::string();
+	if ( line[at] == '"' )
+		return line.substr( at + 1, line.find( '"', at + 1 ) - at - 1 );
+	return line.substr( at, line.find_first_of( ",}", at ) - at );
+}
+
+bool loadStartupReport( const std::string& path, std::vector<std::pair<std::string, double> >& phases )
+{
+	std::ifstream file( path );
+	if ( !file.is_open() )
+		return false;
+
+	std::string line;
+	std::string total;
+	while ( std::getline( file, line ) )
+	{
+		std::string name = jsonValue( line, "name" );
+		if ( !name.empty() )
+			phases.push_back( std::make_pair( jsonValue( line, "thread" ) + "/" + name, std::atof( jsonValue( line, "ms" ).c_str() ) ) );
+		else if ( total.empty() )
+			total = jsonValue( line, "total_ms" );
+	}
+	if ( total.empty() )
+		return false;
+	phases.push_back( std::make_pair( std::string( "total" ), std::atof( total.c_str() ) ) );
+	return true;
+}
+
+unsigned int compareBaseline( const std::map<std::string, TrialStats>& baseline, const StageResults& current, double threshold, std::ostream& os )
+{
+	auto interval = []( const TrialStats& s )
+	{
+		std::stringstream text;
+		text << std::fixed << std::setprecision( 3 ) << s.median << " [" << s.low << ", " << s.high << "]";
+		return text.str();
+	};
+
+	os << std::left << std::setw( 22 ) << "stage" << std::setw( 30 ) << "baseline ns" << std::setw( 30 ) << "current ns" << std::setw( 10 ) << "change" << "verdict\n";
+	unsigned int regressions = 0;
+	for ( const auto& stage : current )
+	{
+		os << std::left << std::setw( 22 ) << stage.first;
+		auto found = baseline.find( stage.first );
+		if ( found == baseline.end() )
+		{
+			os << std::setw( 30 ) << "-" << std::setw( 30 ) << interval( stage.second ) << std::setw( 10 ) << "-" << "new\n";
+			continue;
+		}
+
+		const TrialStats& before = found->second;
+		const TrialStats& after = stage.second;
+		double change = before.median > 0.0 ? after.median / before.median - 1.0 : 0.0;
+		const char* verdict = "ok";
+		if ( change > threshold && after.low > before.high )					// Slower beyond the noise of both runs
+		{
+			verdict = "REGRESSION";
+			regressions++;
+		}
+		else if ( change < -threshold && after.high < before.low )
+			verdict = "faster";
+		else if ( std::fabs( change ) > threshold )
+			verdict = "noisy";													// Beyond the threshold, but the intervals overlap
+
+		std::stringstream percent;
+		percent << std::showpos << std::fixed << std::setprecision( 1 ) << change * 100.0 << "%";
+		os << std::setw( 30 ) << interval( before ) << std::setw( 30 ) << interval( after ) << std::setw( 10 ) << percent.str() << verdict << "\n";
+	}
+	os << regressions << " of " << current.size() << " stages regressed (threshold " << threshold * 100.0 << "%)" << std::endl;
+	return regressions;
+}
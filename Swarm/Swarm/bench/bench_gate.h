@@ -0,0 +1,69 @@
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*!
+ * @brief Median and confidence interval of the trials of one benchmark case.
+ */
+struct TrialStats
+{
+	double median = 0.0;						//!< Median of the trials.
+	double low = 0.0;							//!< Lower bound of the 95% confidence interval of the median.
+	double high = 0.0;							//!< Upper bound of the 95% confidence interval of the median.
+	unsigned int trials = 0;					//!< Number of trials.
+};
+
+/*!
+ * @brief Results of a sweep by stage ("mode,particles"), in the order of the sweep.
+ */
+typedef std::vector<std::pair<std::string, TrialStats> > StageResults;
+
+/*!
+ * @brief Median and its confidence interval from the order statistics of the trials, no assumption about the distribution.
+ * Below 6 trials the interval is the range of the trials.
+ * @param values one value per trial.
+ * @return statistics. All 0 without trials.
+ */
+TrialStats trialStats( std::vector<double> values );
+
+/*!
+ * @brief Replace {gpu} in a baseline path by the device name, spaces and other characters outside of [A-Za-z0-9] as '_'.
+ * One baseline file per GPU model, e.g. bench/baselines/{gpu}.csv.
+ * @param pattern path, with or without {gpu}.
+ * @param deviceName cudaDeviceProp::name.
+ * @return path.
+ */
+std::string baselinePath( const std::string& pattern, const std::string& deviceName );
+
+/*!
+ * @brief Load a CSV of SwarmBench (--out) as baseline. The columns are found by the header, CSVs without ci_low and ci_high
+ * (a single trial) get the median as interval.
+ * @param path CSV file.
+ * @param baseline Output: ns per particle and step by stage.
+ * @return false, if the file can't be read or has no mode, particles and ns_per_particle_step columns.
+ */
+bool loadBaseline( const std::string& path, std::map<std::string, TrialStats>& baseline );
+
+/*!
+ * @brief Compare the stages of a sweep with the baseline and print a table: baseline and current medians with their
+ * intervals, the change and a verdict. A stage regressed if its median is more than threshold slower and the intervals
+ * don't overlap, so noise alone never fails the gate. Stages missing in the baseline are listed as new.
+ * @param baseline ns per particle and step by stage.
+ * @param current results of the sweep.
+ * @param threshold allowed slowdown, e.g. 0.05 for 5%.
+ * @param os stream of the table.
+ * @return number of regressed stages.
+ */
+/*!
+ * @brief Load a startup report of Swarm (--startup_bench), one phase per line as StartupPhases::writeJson writes it.
+ * @param path JSON file.
+ * @param phases Output: ms by "thread/name" of the phase, in the order of the file, then "total".
+ * @return false, if the file can't be read or has no total_ms.
+ */
+bool loadStartupReport( const std::string& path, std::vector<std::pair<std::string, double> >& phases );
+
+unsigned int compareBaseline( const std::map<std::string, TrialStats>& baseline, const StageResults& current, double threshold, std::ostream& os );
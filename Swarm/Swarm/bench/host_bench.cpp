@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Camera.hpp"
+#include "bench_gate.h"
+#include "host_simulation.h"
+#include "vec3.h"
+#include "waypoint_list.h"
+
+/*!
+ * @brief Settings of the host benchmarks.
+ */
+struct HostBenchConfig
+{
+	unsigned int operations = 1000000;			//!< Timed operations per trial and case.
+	unsigned int trials = 5;					//!< Trials per case, the median is reported.
+	std::string output;							//!< CSV file, {gpu} is "host". Empty: console only.
+	std::string baseline;						//!< Baseline CSV of an earlier --out. Empty: no gate.
+	double threshold = 0.05;					//!< Gate: allowed slowdown of a case relative to the baseline.
+};
+
+/*!
+ * @brief One benchmark case: a name, a size and a body that runs a given number of operations.
+ */
+struct HostCase
+{
+	std::string name;							//!< Name in the mode column.
+	unsigned int size;							//!< Size of the working set in the particles column (uniforms, waypoints, vectors).
+	std::function<void( unsigned int )> run;	//!< Runs the given number of operations.
+};
+
+// Uniforms the renderer and the compute path set by name, for the lookups of Shader::getUniformLocation.
+static const char* const UNIFORM_NAMES[] = { "u_acceleration", "u_cellSize", "u_center", "u_centerThreshold", "u_count", "u_firstK",
+	"u_fishDist", "u_fishies", "u_jitter", "u_length", "u_origin", "u_pass", "u_seed", "u_sharkBiteDist", "u_sharkCount",
+	"u_sharkDist", "u_speed", "u_step", "u_trail_x", "u_trail_y", "u_trail_z" };
+
+// Results of the cases end up here, so the compiler can't drop the work.
+static volatile float sink;
+
+/*!
+ * @brief Read the settings from the command line.
+ * Arguments: --operations <n>, --trials <n>, --out <file.csv>, --baseline <file.csv>, --threshold <percent>
+ * @param argc number of arguments.
+ * @param argv arguments.
+ * @return settings.
+ */
+static HostBenchConfig parseArguments( int argc, char** argv )
+{
+	HostBenchConfig config;
+	for ( int i = 1; i + 1 < argc; i += 2 )
+	{
+		std::string key = argv[i];
+		std::string value = argv[i + 1];
+		unsigned int number = static_cast< unsigned int >( std::strtoul( value.c_str(), NULL, 10 ) );
+
+		if ( key == "--operations" )
+			config.operations = std::max( number, 1u );
+		else if ( key == "--trials" )
+			config.trials = std::max( number, 1u );
+		else if ( key == "--out" )
+			config.output = value;
+		else if ( key == "--baseline" )
+			config.baseline = value;
+		else if ( key == "--threshold" )
+			config.threshold = std::atof( value.c_str() ) / 100.0;
+		else
+			std::cerr << "Unknown argument '" << key << "'" << std::endl;
+	}
+	return config;
+}
+
+/*!
+ * @brief Build the cases. Each keeps its working set alive in the closure.
+ * @return cases in the order of the CSV.
+ */
+static std::vector<HostCase> hostCases()
+{
+	std::vector<HostCase> cases;
+	const unsigned int uniformCount = sizeof( UNIFORM_NAMES ) / sizeof( UNIFORM_NAMES[0] );
+
+	// Cache hit of Shader::getUniformLocation: same container, names built per call like the string literals of the setters.
+	auto uniforms = std::make_shared<std::unordered_map<std::string, int> >();
+	for ( unsigned int i = 0; i < uniformCount; i++ )
+		( *uniforms )[UNIFORM_NAMES[i]] = static_cast< int >( i );
+	cases.push_back( { "uniform-lookup", uniformCount, [uniforms, uniformCount]( unsigned int operations )
+	{
+		int sum = 0;
+		for ( unsigned int i = 0; i < operations; i++ )
+		{
+			std::string name = UNIFORM_NAMES[i % uniformCount];
+			if ( uniforms->find( name ) != uniforms->end() )
+				sum += ( *uniforms )[name];
+		}
+		sink = static_cast< float >( sum );
+	} } );
+
+	const unsigned int pathLength = 1024;
+	auto path = std::make_shared<WaypointList>();
+	cases.push_back( { "waypoint-append", pathLength, [path, pathLength]( unsigned int operations )
+	{
+		for ( unsigned int i = 0; i < operations; i++ )
+		{
+			if ( i % pathLength == 0 )
+				path->clear();													// Reuses the capacity, as a recorded path does
+			path->append( Vector3( static_cast< float >( i ), 0.0f, 0.0f ) );
+		}
+		sink = static_cast< float >( path->length() );
+	} } );
+
+	auto route = std::make_shared<WaypointList>( swarmWaypoints() );
+	cases.push_back( { "waypoint-next", static_cast< unsigned int >( route->length() ), [route]( unsigned int operations )
+	{
+		float sum = 0.0f;
+		for ( unsigned int i = 0; i < operations; i++ )
+			sum += route->getNext().x;
+		sink = sum;
+	} } );
+
+	const unsigned int vectorCount = 1024;
+	auto vectors = std::make_shared<std::vector<Vector3> >();
+	for ( unsigned int i = 0; i < vectorCount; i++ )
+		vectors->push_back( Vector3( randf( -5.0f, 5.0f ), randf( -5.0f, 5.0f ), randf( -5.0f, 5.0f ) ) );
+	cases.push_back( { "vector3", vectorCount, [vectors, vectorCount]( unsigned int operations )
+	{
+		Vector3 center( 0.0f, 0.0f, 0.0f );										// The arithmetic of moveSwarmCenter
+		float sum = 0.0f;
+		for ( unsigned int i = 0; i < operations; i++ )
+		{
+			Vector3& target = ( *vectors )[i % vectorCount];
+			Vector3 diff = target - center;
+			center += diff.normalized() * 0.015f;
+			sum += diff.dot( &target );
+		}
+		sink = sum + center.x;
+	} } );
+
+	auto camera = std::make_shared<Camera>( CameraType::PERSPECTIVE, glm::vec4( 0.0f, 0.0f, 10.0f, 1.0f ) );
+	camera->setWindowSize( 1920.0f, 1080.0f );
+	camera->setDistancePlanes( 1.0f, 1000.0f );
+	cases.push_back( { "camera-view", 1, [camera]( unsigned int operations )
+	{
+		float sum = 0.0f;
+		for ( unsigned int i = 0; i < operations; i++ )
+		{
+			camera->rotateYaw( DegreeAngle( 0.1f ) );							// A new view per frame, as while the user turns
+			sum += camera->viewMatrix()[3][0];
+		}
+		sink = sum;
+	} } );
+	cases.push_back( { "camera-projection", 1, [camera]( unsigned int operations )
+	{
+		float sum = 0.0f;
+		for ( unsigned int i = 0; i < operations; i++ )
+			sum += camera->projectionMatrix()[0][0];
+		sink = sum;
+	} } );
+	return cases;
+}
+
+/*!
+ * @brief Micro-benchmarks of the host hot paths: uniform lookups, waypoint list, Vector3 and camera matrices. No GPU and no window.
+ * Prints the CSV of SwarmBench, so the same baselines and gate work: mode is the case, particles the size of its working set,
+ * steps the operations per trial and ns_per_particle_step the ns per operation. Bandwidth and occupancy are 0.
+ * @param argc number of arguments
+ * @param argv arguments (see parseArguments)
+ * @return 0, 2 if a case regressed or the baseline is missing
+ */
+int main( int argc, char** argv )
+{
+	HostBenchConfig config = parseArguments( argc, argv );
+	srand( 1 );
+
+	std::ofstream file;
+	if ( !config.output.empty() )
+		file.open( baselinePath( config.output, "host" ) );
+
+	std::string header = "mode,particles,steps,trials,ns_per_particle_step,ci_low,ci_high,bandwidth_gb_s,occupancy";
+	std::cout << header << std::endl;
+	if ( file.is_open() )
+		file << header << "\n";
+
+	StageResults stages;
+	for ( const HostCase& c : hostCases() )
+	{
+		c.run( config.operations / 10 + 1 );									// Warm up caches and the branch predictor
+
+		std::vector<double> nsPerTrial;
+		for ( unsigned int t = 0; t < config.trials; t++ )
+		{
+			auto start = std::chrono::steady_clock::now();
+			c.run( config.operations );
+			auto stop = std::chrono::steady_clock::now();
+			nsPerTrial.push_back( std::chrono::duration<double, std::nano>( stop - start ).count() / config.operations );
+		}
+
+		std::stringstream stage;
+		stage << c.name << "," << c.size;
+		TrialStats ns = trialStats( nsPerTrial );
+		stages.push_back( std::make_pair( stage.str(), ns ) );
+
+		std::stringstream line;
+		line << stage.str() << "," << config.operations << "," << ns.trials << "," << ns.median << "," << ns.low << "," << ns.high << ",0,0";
+		std::cout << line.str() << std::endl;
+		if ( file.is_open() )
+			file << line.str() << "\n";
+	}
+
+	if ( config.baseline.empty() )
+		return 0;
+
+	std::map<std::string, TrialStats> baseline;
+	std::string path = baselinePath( config.baseline, "host" );
+	if ( !config.output.empty() && baselinePath( config.output, "host" ) == path )
+	{
+		std::cerr << "Baseline recorded in " << path << std::endl;
+		return 0;
+	}
+	if ( !loadBaseline( path, baseline ) )
+	{
+		std::cerr << "No baseline in " << path << ", record one with --out " << path << std::endl;
+		return 2;
+	}
+	std::cerr << "Baseline: " << path << std::endl;
+	return compareBaseline( baseline, stages, config.threshold, std::cerr ) > 0 ? 2 : 0;
+}
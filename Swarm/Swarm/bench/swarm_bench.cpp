@@ -0,0 +1,353 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench_gate.h"
+#include "cuda_device_array.h"
+#include "cuda_host_array.h"
+#include "host_simulation.h"
+#include "launch_check.h"
+#include "kernel.h"
+#include "particle_store.h"
+#include "swarm_config.h"
+#include "waypoint_list.h"
+
+/*!
+ * @brief Settings of a benchmark sweep.
+ */
+struct BenchConfig
+{
+	unsigned int minParticles = 1000;			//!< Smallest swarm.
+	unsigned int maxParticles = 1000000;		//!< Largest swarm.
+	unsigned int maxAllPairs = 262144;			//!< Largest swarm for the O(N^2) searches (brute, tiled, warp, tensor).
+	unsigned int warmupSteps = 5;				//!< Steps before the measurement.
+	unsigned int steps = 50;					//!< Measured steps per trial.
+	unsigned int trials = 5;					//!< Trials per swarm size, the median is reported.
+	unsigned int numSharks = 1;					//!< Number of sharks.
+	unsigned int seed = 1;						//!< Seed of the host spawn and the GPU random numbers.
+	bool packed = false;						//!< Grid search reads packed 16 bit positions (kernel_set_packed_positions).
+	std::vector<SearchMode> modes = { SearchMode::BRUTE_FORCE, SearchMode::TILED, SearchMode::WARP, SearchMode::GRID, SearchMode::VERLET, SearchMode::TENSOR };
+	std::string output;							//!< CSV file, {gpu} is the device name. Empty: console only.
+	std::string baseline;						//!< Baseline CSV of an earlier --out, {gpu} is the device name. Empty: no gate.
+	double threshold = 0.05;					//!< Gate: allowed slowdown of a stage relative to the baseline.
+	std::vector<std::string> startupReports;	//!< Startup reports of Swarm (--startup_bench), one per trial. Empty: no startup stages.
+};
+
+/*!
+ * @brief Result of one swarm size and search mode.
+ */
+struct BenchResult
+{
+	TrialStats nsPerParticleStep;				//!< Kernel time per fish and step over the trials.
+	double bandwidth;							//!< Particle state read and written per second in GB/s, at the median.
+	float occupancy;							//!< Theoretical occupancy of the advance kernel.
+};
+
+// Names of SearchMode values, same order as the enum.
+static const char* const MODE_NAMES[] = { "auto", "brute", "tiled", "grid", "warp", "verlet", "tensor" };
+
+// Bytes of the particle state a step reads and writes once per fish (SoA: position, speed, mass, alive).
+static const double BYTES_PER_FISH = 2.0 * ( 7 * sizeof( float ) + sizeof( unsigned char ) );
+
+/*!
+ * @brief Parse a search mode name.
+ * @param name name (brute, tiled, grid, warp, verlet, tensor).
+ * @param mode Output: search mode.
+ * @return true, if the name is valid.
+ */
+static bool parseMode( const std::string& name, SearchMode& mode )
+{
+	for ( unsigned int i = 0; i < sizeof( MODE_NAMES ) / sizeof( MODE_NAMES[0] ); i++ )
+	{
+		if ( name == MODE_NAMES[i] )
+		{
+			mode = static_cast< SearchMode >( i );
+			return true;
+		}
+	}
+	return false;
+}
+
+/*!
+ * @brief Read the sweep settings from the command line.
+ * Arguments: --min <n>, --max <n>, --max-all-pairs <n>, --steps <n>, --trials <n>, --warmup <n>, --sharks <n>, --seed <n>, --packed <0|1>, --modes <brute,tiled,...>, --out <file.csv>,
+ * --baseline <file.csv>, --threshold <percent>, --startup <a.json,b.json,...>
+ * @param argc number of arguments.
+ * @param argv arguments.
+ * @return settings.
+ */
+static BenchConfig parseArguments( int argc, char** argv )
+{
+	BenchConfig config;
+	for ( int i = 1; i + 1 < argc; i += 2 )
+	{
+		std::string key = argv[i];
+		std::string value = argv[i + 1];
+		unsigned int number = static_cast< unsigned int >( std::strtoul( value.c_str(), NULL, 10 ) );
+
+		if ( key == "--min" )
+			config.minParticles = std::max( number, 1u );
+		else if ( key == "--max" )
+			config.maxParticles = number;
+		else if ( key == "--max-all-pairs" )
+			config.maxAllPairs = number;
+		else if ( key == "--steps" )
+			config.steps = std::max( number, 1u );
+		else if ( key == "--trials" )
+			config.trials = std::max( number, 1u );
+		else if ( key == "--warmup" )
+			config.warmupSteps = number;
+		else if ( key == "--sharks" )
+			config.numSharks = number;
+		else if ( key == "--seed" )
+			config.seed = number;
+		else if ( key == "--packed" )
+			config.packed = number != 0;
+		else if ( key == "--out" )
+			config.output = value;
+		else if ( key == "--baseline" )
+			config.baseline = value;
+		else if ( key == "--threshold" )
+			config.threshold = std::atof( value.c_str() ) / 100.0;
+		else if ( key == "--startup" )
+		{
+			std::stringstream list( value );
+			std::string path;
+			while ( std::getline( list, path, ',' ) )
+				config.startupReports.push_back( path );
+		}
+		else if ( key == "--modes" )
+		{
+			config.modes.clear();
+			std::stringstream list( value );
+			std::string name;
+			while ( std::getline( list, name, ',' ) )
+			{
+				SearchMode mode;
+				if ( parseMode( name, mode ) )
+					config.modes.push_back( mode );
+				else
+					std::cerr << "Unknown search mode '" << name << "'" << std::endl;
+			}
+		}
+		else
+			std::cerr << "Unknown argument '" << key << "'" << std::endl;
+	}
+	return config;
+}
+
+/*!
+ * @brief Run one swarm size with one search mode. Only kernel_advance is timed, without compaction, reorder or rendering.
+ * The trials time config.steps steps each, one after the other on the same swarm.
+ * @param config sweep settings.
+ * @param mode search mode.
+ * @param count number of fishies.
+ * @param properties device properties.
+ * @return result.
+ */
+static BenchResult runCase( const BenchConfig& config, SearchMode mode, unsigned int count, const cudaDeviceProp& properties )
+{
+	srand( config.seed );														// Same swarm for every mode
+	std::vector<float> h_data, h_state, h_shark_data, h_shark_state;
+	spawnFish( count, h_data, h_state );
+	spawnSharks( config.numSharks, h_shark_data, h_shark_state );
+
+	ParticleStore* particles[2];
+	for ( int i = 0; i < 2; i++ )
+	{
+		particles[i] = new ParticleStore( count );
+		particles[i]->set( h_data.data(), h_state.data(), count );
+	}
+	CudaDeviceArray<float> d_sharks( config.numSharks * 4 );
+	d_sharks.set( h_shark_data.data(), config.numSharks * 4 );
+
+	cudaStream_t stream;
+	CUDA_CHECK( cudaStreamCreateWithFlags( &stream, cudaStreamNonBlocking ) );
+	cudaEvent_t start, stop;
+	CUDA_CHECK( cudaEventCreate( &start ) );
+	CUDA_CHECK( cudaEventCreate( &stop ) );
+
+	kernel_set_params( SwarmParams::defaults() );
+	kernel_set_seed( config.seed );
+	kernel_set_behaviour( Behaviour::CLASSIC );
+	kernel_set_search_mode( mode );
+	kernel_set_first_k( 0 );
+	kernel_set_packed_positions( config.packed );
+	kernel_init_grid( count, properties );
+
+	WaypointList waypoints( swarmWaypoints() );
+	Vector3 swarmCenter = waypoints.get();										// Fixed center, every step costs the same
+	float speed = SWARM_SPEED / 60.0f;
+	unsigned int current = 0;
+
+	auto advance = [&]()
+	{
+		kernel_advance( particles[current]->getArrays(), particles[1 - current]->getArrays(), count, speed, swarmCenter,
+			reinterpret_cast<float4*>( d_sharks.getData() ), config.numSharks, stream );
+		current = 1 - current;
+	};
+
+	for ( unsigned int i = 0; i < config.warmupSteps; i++ )
+		advance();
+
+	// Grid placed around the swarm, as in the simulation.
+	CudaHostArray<SwarmStats> h_stats( 1 );
+	kernel_reduce_stats( particles[current]->getArrays(), count, stream );
+	kernel_read_stats( h_stats.getData(), stream );
+	CUDA_CHECK( cudaStreamSynchronize( stream ) );
+	kernel_set_grid_bounds( h_stats[0] );
+
+	double updates = static_cast< double >( count ) * config.steps;
+	std::vector<double> nsPerTrial;
+	for ( unsigned int t = 0; t < config.trials; t++ )
+	{
+		CUDA_CHECK( cudaEventRecord( start, stream ) );
+		for ( unsigned int i = 0; i < config.steps; i++ )
+			advance();
+		CUDA_CHECK( cudaEventRecord( stop, stream ) );
+		CUDA_CHECK( cudaEventSynchronize( stop ) );
+		CUDA_CHECK_FRAME( stream );
+
+		float ms = 0.0f;
+		CUDA_CHECK( cudaEventElapsedTime( &ms, start, stop ) );
+		nsPerTrial.push_back( ms * 1e6 / updates );
+	}
+
+	BenchResult result;
+	result.nsPerParticleStep = trialStats( nsPerTrial );
+	result.bandwidth = BYTES_PER_FISH / result.nsPerParticleStep.median;	// Bytes per ns are GB/s
+	result.occupancy = kernel_occupancy( count, properties );
+
+	kernel_cleanup();
+	CUDA_CHECK( cudaEventDestroy( start ) );
+	CUDA_CHECK( cudaEventDestroy( stop ) );
+	CUDA_CHECK( cudaStreamDestroy( stream ) );
+	for ( int i = 0; i < 2; i++ )
+		delete particles[i];
+	return result;
+}
+
+/*!
+ * @brief Benchmark sweep of the neighbour searches: every mode for swarm sizes from --min to --max.
+ * Prints CSV: mode, particles, trials, median ns per particle and step with its 95% confidence interval, effective bandwidth
+ * and theoretical occupancy. With --startup the phases of the startup reports follow as rows "startup,<thread>/<phase>" with the
+ * median ms in the ns column. With --baseline the medians are compared with the baseline of this GPU (regression gate).
+ * @param argc number of arguments
+ * @param argv arguments (see parseArguments)
+ * @return 0, 1 if a kernel failed, 2 if a stage regressed or the baseline is missing
+ */
+int main( int argc, char** argv )
+{
+	BenchConfig config = parseArguments( argc, argv );
+
+	cudaDeviceProp properties;
+	CUDA_CHECK( cudaGetDeviceProperties( &properties, 0 ) );
+	CUDA_CHECK( cudaSetDevice( 0 ) );
+	std::cerr << "Device: " << properties.name << std::endl;
+
+	std::ofstream file;
+	if ( !config.output.empty() )
+		file.open( baselinePath( config.output, properties.name ) );			// {gpu} records the baseline of this GPU
+
+	std::string header = "mode,particles,steps,trials,ns_per_particle_step,ci_low,ci_high,bandwidth_gb_s,occupancy";
+	std::cout << header << std::endl;
+	if ( file.is_open() )
+		file << header << "\n";
+
+	std::vector<unsigned int> sizes;											// Times 4 per row, the largest size is always included
+	for ( unsigned long long count = config.minParticles; count < config.maxParticles; count *= 4 )
+		sizes.push_back( static_cast< unsigned int >( count ) );
+	sizes.push_back( config.maxParticles );
+
+	StageResults stages;
+	for ( SearchMode mode : config.modes )
+	{
+		if ( mode == SearchMode::TENSOR && properties.major < 7 )				// Would run tiled, the numbers of tiled again
+		{
+			std::cerr << "No tensor cores, tensor skipped" << std::endl;
+			continue;
+		}
+
+		bool allPairs = mode == SearchMode::BRUTE_FORCE || mode == SearchMode::TILED || mode == SearchMode::WARP || mode == SearchMode::TENSOR;
+		for ( unsigned int count : sizes )
+		{
+			if ( allPairs && count > config.maxAllPairs )						// O(N^2) takes minutes per step there
+				break;
+
+			BenchResult result = runCase( config, mode, count, properties );
+
+			std::stringstream stage;
+			stage << MODE_NAMES[static_cast< int >( mode )] << ( config.packed && mode == SearchMode::GRID ? "-packed" : "" ) << "," << count;
+			stages.push_back( std::make_pair( stage.str(), result.nsPerParticleStep ) );
+
+			const TrialStats& ns = result.nsPerParticleStep;
+			std::stringstream line;
+			line << stage.str() << "," << config.steps << "," << ns.trials << "," << ns.median << "," << ns.low << "," << ns.high << ","
+				 << result.bandwidth << "," << result.occupancy;
+			std::cout << line.str() << std::endl;
+			if ( file.is_open() )
+				file << line.str() << "\n";
+		}
+	}
+
+	// Startup phases as stages "startup,<thread>/<phase>", the ms per phase in the ns column, one trial per report.
+	std::vector<std::string> phaseNames;
+	std::map<std::string, std::vector<double> > phaseTimes;
+	for ( const std::string& path : config.startupReports )
+	{
+		std::vector<std::pair<std::string, double> > phases;
+		if ( !loadStartupReport( path, phases ) )
+		{
+			std::cerr << "No startup report in " << path << std::endl;
+			continue;
+		}
+		for ( const auto& phase : phases )
+		{
+			if ( phaseTimes.find( phase.first ) == phaseTimes.end() )
+				phaseNames.push_back( phase.first );
+			phaseTimes[phase.first].push_back( phase.second );
+		}
+	}
+	for ( const std::string& name : phaseNames )
+	{
+		TrialStats ms = trialStats( phaseTimes[name] );
+		std::string stage = "startup," + name;
+		stages.push_back( std::make_pair( stage, ms ) );
+
+		std::stringstream line;
+		line << stage << ",0," << ms.trials << "," << ms.median << "," << ms.low << "," << ms.high << ",0,0";
+		std::cout << line.str() << std::endl;
+		if ( file.is_open() )
+			file << line.str() << "\n";
+	}
+
+	if ( launchErrorCount() > 0 )												// Failed kernels are fast, the numbers are worthless
+	{
+		std::cerr << launchErrorCount() << " CUDA errors, the results are invalid" << std::endl;
+		return 1;
+	}
+
+	if ( config.baseline.empty() )
+		return 0;
+
+	std::map<std::string, TrialStats> baseline;
+	std::string path = baselinePath( config.baseline, properties.name );
+	if ( !config.output.empty() && baselinePath( config.output, properties.name ) == path )
+	{
+		std::cerr << "Baseline recorded in " << path << std::endl;					// Nothing to compare with
+		return 0;
+	}
+	if ( !loadBaseline( path, baseline ) )
+	{
+		std::cerr << "No baseline in " << path << ", record one with --out " << path << std::endl;
+		return 2;
+	}
+	std::cerr << "Baseline: " << path << std::endl;
+	return compareBaseline( baseline, stages, config.threshold, std::cerr ) > 0 ? 2 : 0;
+}
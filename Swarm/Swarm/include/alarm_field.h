@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+
+#include "vec3.h"
+
+/*!
+ * @brief Alarm of the fishies on a coarse grid of its own: fishies which evade a shark deposit alarm, a diffusion and decay
+ * stencil spreads it from cell to cell every step, and the other fishies swim down its gradient. See kernel_set_alarm.
+ */
+struct AlarmField
+{
+	float deposit = 0.0f;			//!< Alarm an evading fish adds to its cell per step. 0: no alarm.
+	float decay = 0.9f;				//!< Fraction of the alarm a cell keeps per step.
+	Vector3 origin;					//!< Position of the first cell corner.
+	float cellSize = 0.0f;			//!< Edge length of the cells.
+	unsigned int width = 0;			//!< Cells along x.
+	unsigned int height = 0;		//!< Cells along y.
+	unsigned int depth = 0;			//!< Cells along z.
+};
+
+/*!
+ * @brief Place the grid of the alarm. It covers the spawn box and the waypoints plus margin on every side;
+ * fishies outside deposit into and sample the border cells.
+ * @param deposit alarm an evading fish adds per step. Not positive: no alarm, an empty field.
+ * @param decay fraction of the alarm a cell keeps per step.
+ * @param spawnMin lower corner of the spawn box.
+ * @param spawnMax upper corner of the spawn box.
+ * @param waypoints route of the swarm.
+ * @param margin distance added around the covered box, e.g. the center threshold.
+ * @param resolution cells along the longest axis, at least 2.
+ * @return field.
+ */
+AlarmField placeAlarm( float deposit, float decay, const Vector3& spawnMin, const Vector3& spawnMax,
+	const std::vector<Vector3>& waypoints, float margin, unsigned int resolution );
@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+
+#include "vec3.h"
+
+/*!
+ * @brief Point of interest the fishies swim to or away from: food patch, lure or disturbance.
+ */
+struct Attractor
+{
+	Vector3 position;				//!< Center.
+	float strength = 1.0f;			//!< Peak acceleration, in full accelerations of the fish. Positive: attracts, negative: repels.
+	float radius = 1.0f;			//!< Reach. The pull is 0 at the center and from this distance on.
+};
+
+/*!
+ * @brief Attractors with the grid of their summed field. The field is baked into a 3D texture on the GPU by kernel_set_attractors.
+ */
+struct AttractorVolume
+{
+	Vector3 origin;					//!< Position of the first sample.
+	float cellSize = 0.0f;			//!< Distance between two samples along every axis.
+	unsigned int width = 0;			//!< Samples along x.
+	unsigned int height = 0;		//!< Samples along y.
+	unsigned int depth = 0;			//!< Samples along z.
+	std::vector<Attractor> attractors;	//!< Attractors, baked by every context. Empty: none.
+};
+
+/*!
+ * @brief Place the grid of the attractor field. It covers the spawn box, the waypoints and the reach of all attractors,
+ * so the field is 0 on its border and the clamped lookups outside stay 0.
+ * @param attractors attractors. Empty: an empty volume.
+ * @param spawnMin lower corner of the spawn box.
+ * @param spawnMax upper corner of the spawn box.
+ * @param waypoints route of the swarm.
+ * @param resolution samples along the longest axis, at least 2.
+ * @return volume, without texels.
+ */
+AttractorVolume placeAttractors( const std::vector<Attractor>& attractors, const Vector3& spawnMin, const Vector3& spawnMax,
+	const std::vector<Vector3>& waypoints, unsigned int resolution );
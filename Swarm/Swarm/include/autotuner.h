@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+
+#include "kernel.h"
+#include "swarm_config.h"
+
+/*!
+ * @brief Autotuner times short trials of the search settings on this GPU and keeps the fastest one: block size of the search
+ * kernels (the tile of the tiled search), grid cell size and Verlet skin. None of them changes the results, only the speed.
+ * The winner is stored in a tuning profile file, one line per GPU model, driver version, search, behaviour and swarm size
+ * (rounded up to a power of two), so later runs on the same kind of GPU load it without trials.
+ * Tuning profile line: name, driver, search, behaviour, fishies, block size, cell scale, skin, ms per step, separated by tabs.
+ */
+class Autotuner
+{
+private:
+
+	/*!
+	 * @brief Settings and time of one trial.
+	 */
+	struct Trial
+	{
+		KernelTuning tuning;					//!< Block size and cell size.
+		float verletSkin;						//!< Verlet skin.
+		double msPerStep;						//!< Measured time per step. 0: not measured.
+	};
+
+	static const unsigned int WARMUP_STEPS = 3;	//!< Untimed steps of a trial (Verlet build, caches).
+	static const unsigned int TIMED_STEPS = 20;	//!< Timed steps of a trial.
+
+	std::string path_;							//!< Tuning profile file.
+	std::string key_;							//!< GPU model, driver, search, behaviour and swarm size of this run.
+	TuneMode mode_;								//!< Load, time or both.
+	bool usesGrid_;								//!< The search builds a grid, the cell size matters.
+	bool usesVerlet_;							//!< The search keeps Verlet lists, the skin matters.
+	SwarmParams params_;						//!< Parameters of the kernels at construction. The Verlet skin is tuned.
+	Trial best_;								//!< Fastest trial, or the loaded one.
+
+	/*!
+	 * @brief Find the entry of key_ in the tuning profile.
+	 * @param trial Output: stored settings. Unchanged, if there is no entry.
+	 * @return true, if the profile has an entry for key_.
+	 */
+	bool load( Trial& trial ) const;
+
+	/*!
+	 * @brief Write best_ into the tuning profile, replacing the old entry of key_.
+	 */
+	void store() const;
+
+	/*!
+	 * @brief Set the settings of a trial in the kernels.
+	 * @param trial settings.
+	 */
+	void apply( const Trial& trial );
+
+	/*!
+	 * @brief Time the steps of kernel_advance with the settings of a trial, on two stores of freshly spawned fishies.
+	 * @param trial settings. Output: msPerStep.
+	 * @param stores two stores for the ping-pong of the trial.
+	 * @param count number of fishies.
+	 * @param speed speed of the fishies per step.
+	 * @param swarmCenter swarm center.
+	 * @param sharks shark positions on the device (read only).
+	 * @param sharkCount number of sharks.
+	 * @param stream simulation stream.
+	 */
+	void time( Trial& trial, ParticleStore* stores[2], unsigned int count, float speed, Vector3 swarmCenter,
+		const float4* sharks, unsigned int sharkCount, cudaStream_t stream );
+
+public:
+
+	/*!
+	 * @brief Constructor. Builds the profile key of this run. Call after kernel_set_params.
+	 * @param config search, behaviour, autotune mode and tuning profile.
+	 * @param count number of fishies.
+	 * @param properties GPU the kernels run on.
+	 */
+	Autotuner( const SwarmConfig& config, unsigned int count, const cudaDeviceProp& properties );
+
+	/*!
+	 * @brief Load the settings of the tuning profile or time the trials, then set the winner in the kernels.
+	 * Call after kernel_init_grid and before the first step. The random numbers of the run are not changed by the trials.
+	 * @param count number of fishies.
+	 * @param speed speed of the fishies per step.
+	 * @param swarmCenter swarm center.
+	 * @param sharks shark positions on the device (read only).
+	 * @param sharkCount number of sharks.
+	 * @param stream simulation stream. Waits for it.
+	 */
+	void run( unsigned int count, float speed, Vector3 swarmCenter, const float4* sharks, unsigned int sharkCount, cudaStream_t stream );
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Window.hpp"
+
+#include "frame_profiler.h"
+
+/*
+ * Camera path file: CameraPathHeader, then one record per frame: CameraPathFrame, followed by its keyCount keys (int each,
+ * GLFW_KEY_*, a repeat as -key). All values in the byte order of the writing machine.
+ */
+
+static const char CAMERA_PATH_MAGIC[8] = { 'S', 'W', 'A', 'R', 'M', 'C', 'A', 'M' };
+static const unsigned int CAMERA_PATH_VERSION = 1;
+
+/*!
+ * @brief Header of a camera path file.
+ */
+struct CameraPathHeader
+{
+	char magic[8];							//!< CAMERA_PATH_MAGIC.
+	unsigned int version;					//!< CAMERA_PATH_VERSION.
+	unsigned int seed;						//!< Seed of the recorded run, the replay uses the same one.
+};
+
+/*!
+ * @brief Camera and input of one frame.
+ */
+struct CameraPathFrame
+{
+	float eyePoint[3];						//!< Eye point of the camera.
+	float pitch;							//!< Pitch angle in degrees.
+	float yaw;								//!< Yaw angle in degrees.
+	unsigned int keyCount;					//!< Keys pressed since the frame before.
+};
+
+/*!
+ * @brief CameraPath records the camera and the keys of every frame into a file, or replays such a file, so render benchmarks
+ * see the same flight through the swarm every run. The replay presses the recorded keys before the frame and then puts
+ * the camera exactly where it was, so rounding in the key handling doesn't add up. The main loop calls frame() before
+ * every render and collect() after it; after the last frame the replay reports the stage times of the whole flight,
+ * the draw from its OpenGL timer queries, and closes the window.
+ */
+class CameraPath
+{
+private:
+
+	std::ofstream record_;					//!< File of the recording. Closed: no recording.
+	std::vector<CameraPathFrame> frames_;	//!< Frames of the replay. Empty: no replay.
+	std::vector<int> keys_;					//!< Keys of all frames of the replay, in order.
+	size_t nextFrame_ = 0;					//!< Frame of the next replay call.
+	size_t nextKey_ = 0;					//!< Key of that frame.
+	unsigned int seed_ = 0;					//!< Seed of the replayed file.
+	std::vector<StageTimes> times_;			//!< Replay: samples of every stage over all frames.
+
+	/*!
+	 * @brief Read a camera path file.
+	 * @param path file.
+	 * @return true, if the file is a valid camera path of this version.
+	 */
+	bool read( const std::string& path );
+
+public:
+
+	/*!
+	 * @brief Constructor. Opens the recording or reads the replay.
+	 * @param recordPath file to record into, e.g. config.cameraRecord. Empty: no recording.
+	 * @param replayPath file to replay, e.g. config.cameraReplay. Empty: no replay. Replays, if both are set.
+	 * @param seed seed of the run, written into the recording.
+	 */
+	CameraPath( const std::string& recordPath, const std::string& replayPath, unsigned int seed );
+
+	CameraPath( const CameraPath& ) = delete;
+	CameraPath& operator=( const CameraPath& ) = delete;
+
+	/*!
+	 * @brief Check if a file is replayed.
+	 * @return true, if frames were read.
+	 */
+	inline bool isReplaying() const { return !frames_.empty(); }
+
+	/*!
+	 * @brief Check if the frames are recorded. The window has to log its keys meanwhile (Window::setKeyLog).
+	 * @return true, if the recording is open.
+	 */
+	inline bool isRecording() const { return record_.is_open(); }
+
+	/*!
+	 * @brief Get the seed of the replayed recording.
+	 * @return seed.
+	 */
+	inline unsigned int getSeed() const { return seed_; }
+
+	/*!
+	 * @brief Record or replay the camera and keys of the next frame. Does nothing without recording and replay.
+	 * @param window window with the camera and the keys.
+	 * @return false, if the replay is done with its last frame.
+	 */
+	bool frame( Window& window );
+
+	/*!
+	 * @brief Add the stage times of the frame the profiler collected last, during a replay.
+	 * @param profiler stage timers of the renderer.
+	 */
+	void collect( const FrameProfiler& profiler );
+
+	/*!
+	 * @brief Mean and percentiles per stage over the replayed frames.
+	 * @return report with one line per stage.
+	 */
+	std::string report() const;
+};
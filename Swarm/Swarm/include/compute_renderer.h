@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+
+#include "compute_simulation.h"
+#include "scene_target.h"
+#include "simulation_backend.h"
+#include "shader.h"
+#include "swarm_config.h"
+#include "uniform_buffer.h"
+#include "vertex_array.h"
+#include "vertex_buffer.h"
+
+/*!
+ * @brief ComputeRenderer simulates with ComputeSimulation and draws the position buffers directly, no CUDA is called.
+ * Fishies are drawn as points. Fixed timestep and frame timers work like in Renderer, the GPU stages are timed with OpenGL queries.
+ */
+class ComputeRenderer : public SimulationBackend
+{
+private:
+
+	Shader shader_;							//!< Contains Shader (Vertex und Fragment shader).
+	UniformBuffer* frameUniforms_ = NULL;	//!< Matrices of the frame (FrameUniforms block).
+	int pointSizeLocation_;					//!< Location of u_pointsize in shader_.
+	ComputeSimulation* simulation_;			//!< Fishies and sharks in OpenGL buffers.
+	VertexArray va_[2];						//!< Vertex Arrays to render particles. One per position buffer.
+	VertexArray vaShark_;					//!< Vertex Array to render sharks.
+	VertexBuffer* vbC_;						//!< Color buffer.
+	VertexBuffer* vbSharkC_;				//!< Shark color buffer.
+	SceneTarget* sceneTarget_ = NULL;		//!< Scaled off-screen target with config.renderScale. NULL: the draws go into the window.
+
+	FrameProfiler profiler_;				//!< Times advance, draw and swap of every frame.
+	FrameTimeRecorder frameTimes_;			//!< Wall time of the last frames: simulation, render and present.
+	std::string frameDump_;					//!< File for the frame times at exit. Empty: no dump at exit.
+
+	double lastUpdate_;						//!< time of the last frame.
+	double dt_;								//!< Simulated time per step (fixed timestep).
+	double accumulator_ = 0.0;				//!< Elapsed time which is not simulated yet.
+
+	static const unsigned int MAX_SUBSTEPS = 8;	//!< Maximum steps per frame. Remaining time is dropped.
+
+public:
+
+	/*!
+	 * @brief Constructor. Compiles the shaders and creates the simulation. Needs an OpenGL 4.3 context.
+	 * @param config Number of particles and sharks, behaviour and frame timer settings.
+	 */
+	ComputeRenderer( const SwarmConfig& config );
+
+	/*!
+	 * @brief Simulate the steps of the elapsed time and draw fishies and sharks.
+	 */
+	void render() override;
+
+	/*!
+	 * @brief Get aggregates of the living fishies.
+	 * @return aggregates. Read back without waiting, so they can be some frames old.
+	 */
+	inline const SwarmStats& getStats() const override { return simulation_->getStats(); }
+
+	/*!
+	 * @brief Get the stage timers, e.g. to time the buffer swap.
+	 * @return profiler.
+	 */
+	inline FrameProfiler& getProfiler() override { return profiler_; }
+
+	/*!
+	 * @brief Get the frame time recorder, e.g. to time the buffer swap.
+	 * @return recorder.
+	 */
+	inline FrameTimeRecorder& getFrameTimes() override { return frameTimes_; }
+
+	/*!
+	 * @brief Delete simulation and buffers.
+	 * Prints the frame time report and writes the frame times, if a dump file is set.
+	 */
+	void cleanUp() override;
+};
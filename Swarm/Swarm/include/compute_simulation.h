@@ -0,0 +1,143 @@
+#pragma once
+
+#include "glew.h"
+#include "shader.h"
+#include "swarm_config.h"
+#include "swarm_stats.h"
+#include "vertex_buffer.h"
+#include "waypoint_list.h"
+
+/*!
+ * @brief ComputeSimulation runs the classic behaviour with OpenGL compute shaders, for GPUs without CUDA.
+ * The fishies live in the position VBOs, so drawing needs neither interop nor map / unmap.
+ * Every step builds the uniform grid as counting sort (compute_grid.glsl), then moves the fishies (compute_advance.glsl)
+ * and the sharks (compute_sharks.glsl). Eaten fishies keep their slots: there is no compaction, reorder or emitter.
+ * Needs OpenGL 4.3 (glHasComputeShaders).
+ */
+class ComputeSimulation
+{
+public:
+
+	static const unsigned int GRID_SIZE = 64;	//!< Cells per axis, same as in compute_grid.glsl.
+	static const unsigned int GRID_NUM_CELLS = GRID_SIZE * GRID_SIZE * GRID_SIZE;
+
+private:
+
+	static const unsigned int WORK_GROUP_SIZE = 256;	//!< local_size_x of the fish shaders.
+	static const unsigned int SCAN_CELLS = 1024;		//!< Cells per work group of the first scan pass.
+
+	Shader gridShader_;						//!< Passes of the grid build.
+	Shader advanceShader_;					//!< Fish behaviour.
+	Shader sharkShader_;					//!< Shark movement.
+	Shader statsShader_;					//!< Passes of the stats reduction.
+
+	VertexBuffer* positions_[2];			//!< Positions (w < 0: eaten), ping-pong. Drawn as VBOs.
+	VertexBuffer* states_[2];				//!< Speed vectors and masses, ping-pong.
+	VertexBuffer* sharks_;					//!< Shark positions. Drawn as VBO.
+	VertexBuffer* sharkStates_;				//!< Shark speed vectors and masses.
+	VertexBuffer* cellCount_;				//!< Fishies per cell.
+	VertexBuffer* cellStart_;				//!< Index of the first fish per cell in sorted_.
+	VertexBuffer* blockSums_;				//!< Fishies per work group of the scan.
+	VertexBuffer* fishCell_;				//!< Cell hash per fish.
+	VertexBuffer* fishRank_;				//!< Slot of the fish inside its cell.
+	VertexBuffer* sorted_;					//!< Positions in cell order, index of the fish in w.
+	VertexBuffer* statsPartials_;			//!< Partial aggregates of the first stats pass.
+	VertexBuffer* stats_;					//!< SwarmStats on the GPU.
+	GLsync statsFence_ = NULL;				//!< Signaled after the last stats reduction. NULL: nothing to read back.
+	SwarmStats h_stats_;					//!< Last stats read back.
+
+	unsigned int current_ = 0;				//!< Index of the buffers that contain the latest positions and states.
+	unsigned int numParticles_;				//!< Number of Particles
+	unsigned int numSharks_;				//!< Number of Sharks
+	SwarmParams params_;					//!< Behaviour parameters.
+	unsigned int firstK_;					//!< See NeighbourQuery.
+	unsigned int seed_;						//!< Seed of the jitter.
+	unsigned int stepCount_ = 0;			//!< Simulated steps, part of the jitter.
+	glm::vec3 gridOrigin_;					//!< Lower corner of cell (0, 0, 0).
+	float cellSize_;						//!< Edge length of a cell, at least fishDist.
+
+	const float WAYPOINT_THRESHOLD = 0.1;	//!< Threshold for waypoint goal.
+
+	float speed;							//!< speed of particles per step (SwarmConfig::swarmSpeed * dt).
+	WaypointList* waypointList;				//!< Waypoint List contains waypoints for particles.
+	Vector3 swarmCenter;					//!< Position of swarm center.
+
+	/*!
+	 * @brief Move Swarm center to waypoint
+	 */
+	void moveSwarmCenter();
+
+	/*!
+	 * @brief Place the grid on the bounding box of the last stats. Cells outside of it wrap around.
+	 */
+	void placeGrid();
+
+	/*!
+	 * @brief Sort the fishies of the current buffer into the grid cells.
+	 */
+	void buildGrid();
+
+public:
+
+	/*!
+	 * @brief Constructor. Compiles the shaders, spawns the fishies and sharks and uploads them. Needs a current context.
+	 * @param config Number of particles and sharks, behaviour parameters, first k, seed and simulation rate.
+	 */
+	ComputeSimulation( const SwarmConfig& config );
+
+	/*!
+	 * @brief Destructor. Deletes the buffers.
+	 */
+	~ComputeSimulation();
+
+	ComputeSimulation( const ComputeSimulation& ) = delete;
+	ComputeSimulation& operator=( const ComputeSimulation& ) = delete;
+
+	/*!
+	 * @brief Calculate one simulation step. Only issues the dispatches, no waiting.
+	 */
+	void step();
+
+	/*!
+	 * @brief Reduce the stats of the current buffer. The result is read back later, when the GPU is done.
+	 * Skipped while the last reduction is still running.
+	 */
+	void reduceStats();
+
+	/*!
+	 * @brief Get the aggregates of the living fishies, read back by reduceStats.
+	 * @return aggregates. Can be some frames old.
+	 */
+	inline const SwarmStats& getStats() const { return h_stats_; }
+
+	/*!
+	 * @brief Get a position buffer. Drawing needs a glMemoryBarrier( GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT ), step sets it.
+	 * @param i 0 or 1.
+	 * @return position buffer (vec4 per fish, w < 0: eaten).
+	 */
+	inline const VertexBuffer& getPositions( unsigned int i ) const { return *positions_[i]; }
+
+	/*!
+	 * @brief Get the index of the position buffer with the latest positions.
+	 * @return 0 or 1.
+	 */
+	inline unsigned int getCurrent() const { return current_; }
+
+	/*!
+	 * @brief Get the shark position buffer.
+	 * @return shark positions (vec4 per shark).
+	 */
+	inline const VertexBuffer& getSharks() const { return *sharks_; }
+
+	/*!
+	 * @brief Get the number of fishies.
+	 * @return number of fishies, including the eaten ones.
+	 */
+	inline unsigned int getNumParticles() const { return numParticles_; }
+
+	/*!
+	 * @brief Get the number of sharks.
+	 * @return number of sharks.
+	 */
+	inline unsigned int getNumSharks() const { return numSharks_; }
+};
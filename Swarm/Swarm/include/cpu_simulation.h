@@ -0,0 +1,170 @@
+#pragma once
+
+#include <vector>
+
+#include "swarm_config.h"
+#include "swarm_stats.h"
+#include "thread_pool.h"
+#include "waypoint_list.h"
+
+/*!
+ * @brief CpuSimulation runs the classic behaviour on the CPU, for machines without CUDA device.
+ * Same rules as d_swim with the uniform grid search of kernel.cu: the grid is rebuilt every step as counting sort,
+ * the fishies are advanced in chunks on a ThreadPool and the distances to the fishies of a cell are evaluated
+ * with SSE2 or, if the build enables it, AVX2. The random numbers are the Philox numbers of d_random4.
+ * Eaten fishies keep their slots: there is no compaction, reorder or emitter.
+ */
+class CpuSimulation
+{
+public:
+
+	static const unsigned int GRID_SIZE = 64;	//!< Maximum number of cells per axis, as in kernel.cu.
+	static const unsigned int GRID_NUM_CELLS = GRID_SIZE * GRID_SIZE * GRID_SIZE;
+
+private:
+
+	/*!
+	 * @brief Fishies in SoA layout.
+	 */
+	struct Fishies
+	{
+		std::vector<float> x, y, z;				//!< Positions.
+		std::vector<float> vx, vy, vz;			//!< Speed vectors.
+		std::vector<float> mass;				//!< Masses.
+		std::vector<unsigned char> alive;		//!< 0: eaten.
+
+		/*!
+		 * @brief Allocate all arrays.
+		 * @param count number of fishies.
+		 */
+		void resize( unsigned int count );
+	};
+
+	/*!
+	 * @brief Sums of one chunk of fishies for reduceStats.
+	 */
+	struct StatsPartial
+	{
+		double position[3];						//!< Sum of the positions.
+		float boundsMin[3];						//!< Lower corner of the bounding box.
+		float boundsMax[3];						//!< Upper corner of the bounding box.
+		double speed;							//!< Sum of the speed vector lengths.
+		float topSpeed;							//!< Largest speed vector length.
+		unsigned int count;						//!< Number of living fishies.
+	};
+
+	static const unsigned int CHUNK = 256;	//!< Fishies per chunk of the thread pool.
+
+	ThreadPool pool_;						//!< Threads of the steps.
+	Fishies fishies_[2];					//!< Ping-pong stores.
+	unsigned int current_ = 0;				//!< Index of the store that contains the latest positions and states.
+	std::vector<float> sharks_;				//!< Shark positions (x, y, z, w).
+	std::vector<float> sharkState_;			//!< Shark speed vectors and masses.
+
+	std::vector<unsigned int> cellOf_;		//!< Cell hash per fish, DEAD_CELL for eaten ones.
+	std::vector<unsigned int> cellStart_;	//!< Index of the first fish per cell in the sorted arrays, one more entry for the end.
+	std::vector<unsigned int> sortedIndex_;	//!< Fish index in cell order.
+	std::vector<float> sortedX_, sortedY_, sortedZ_;	//!< Positions in cell order.
+	std::vector<StatsPartial> partials_;	//!< Sums per chunk of reduceStats.
+
+	float origin_[3];						//!< Lower corner of cell (0, 0, 0).
+	float cellSize_;						//!< Edge length of a cell (fishDist).
+	int dims_[3];							//!< Cells per axis (3 to GRID_SIZE). Cells outside wrap around.
+
+	unsigned int numParticles_;				//!< Number of Particles
+	unsigned int numSharks_;				//!< Number of Sharks
+	SwarmParams params_;					//!< Behaviour parameters.
+	unsigned int firstK_;					//!< See NeighbourQuery.
+	unsigned long long seed_;				//!< Seed of the random numbers.
+	unsigned int stepCount_ = 0;			//!< Simulated steps, part of the random numbers.
+	SwarmStats stats_;						//!< Aggregates of the current store.
+	double particleUpdates_ = 0.0;			//!< Number of fish updates of the last run.
+
+	const float WAYPOINT_THRESHOLD = 0.1;	//!< Threshold for waypoint goal.
+
+	float speed;							//!< speed of particles per step (SwarmConfig::swarmSpeed * dt).
+	double dt_;								//!< Simulated time per step.
+	WaypointList* waypointList;				//!< Waypoint List contains waypoints for particles.
+	Vector3 swarmCenter;					//!< Position of swarm center.
+
+	/*!
+	 * @brief Move Swarm center to waypoint
+	 */
+	void moveSwarmCenter();
+
+	/*!
+	 * @brief Aggregate the current store into stats_.
+	 */
+	void reduceStats();
+
+	/*!
+	 * @brief Place the grid around the bounding box of stats_, like kernel_set_grid_bounds.
+	 */
+	void placeGrid();
+
+	/*!
+	 * @brief Sort the fishies of the current store into the grid cells.
+	 */
+	void buildGrid();
+
+	/*!
+	 * @brief Cell hash of a position, wrapped like d_calcGridHash.
+	 * @param cell cell coordinates.
+	 * @return hash.
+	 */
+	unsigned int cellHash( const int cell[3] ) const;
+
+	/*!
+	 * @brief Advance one fish with the rules of d_swim.
+	 * @param i index of the fish.
+	 * @param next store of the new state.
+	 */
+	void swim( unsigned int i, Fishies& next ) const;
+
+	/*!
+	 * @brief Find the closest fish in the 27 cells around a position, like GridSearch.
+	 * @param p position.
+	 * @param self index of the searching fish.
+	 * @param closest Output: difference vector to the closest fish.
+	 * @return distance to the closest fish, FLT_MAX if there is none.
+	 */
+	float closestFish( const float p[3], unsigned int self, float closest[3] ) const;
+
+	/*!
+	 * @brief Move the sharks with the rules of d_moveSharks.
+	 */
+	void moveSharks();
+
+public:
+
+	/*!
+	 * @brief Constructor. Spawns fishies and sharks and starts the threads.
+	 * @param config Number of particles and sharks, behaviour parameters, first k, seed and simulation rate.
+	 */
+	CpuSimulation( const SwarmConfig& config );
+
+	/*!
+	 * @brief Destructor.
+	 */
+	~CpuSimulation();
+
+	CpuSimulation( const CpuSimulation& ) = delete;
+	CpuSimulation& operator=( const CpuSimulation& ) = delete;
+
+	/*!
+	 * @brief Calculate one simulation step.
+	 */
+	void step();
+
+	/*!
+	 * @brief Calculate the given number of steps and print the throughput.
+	 * @param steps number of steps.
+	 */
+	void run( unsigned int steps );
+
+	/*!
+	 * @brief Get the aggregates of the living fishies after the last step.
+	 * @return aggregates.
+	 */
+	inline const SwarmStats& getStats() const { return stats_; }
+};
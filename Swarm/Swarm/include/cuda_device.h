@@ -1,20 +1,31 @@
 #pragma once
+#include <functional>
 #include <iostream>
-
-#include <glew.h>
-#include <glfw3.h>
+#include <vector>
 
 #include "cuda_runtime.h"
-#include "cuda_gl_interop.h"
 #include "device_launch_parameters.h"
 
 #include "macros.h"
-#include "vertex_buffer.h"
 
 using namespace std;
 
+class VertexBuffer;
+
+/*!
+ * @brief Scheduling class of a stream. The GPU starts blocks of higher priority streams first, as soon as resources free up,
+ * so background work fills the gaps of the advance and render-critical kernels instead of delaying them.
+ */
+enum class StreamClass
+{
+	CRITICAL,		//!< Advance and render-critical kernels: highest priority of the device.
+	BACKGROUND		//!< Analytics and copies (export, trajectories, current fills): lowest priority, non-blocking.
+};
+
 /*!
  * @brief CudaDeivce class is used to simply manipulate a NVIDIA GPU.
+ * Needs no OpenGL. registerGLBuffer and the OpenGL device query live in cuda_device_gl.cpp,
+ * which only the application with window compiles.
  */
 class CudaDevice
 {
@@ -23,13 +34,26 @@ private:
 	cudaDeviceProp properties;						//!< CudaDeviceProperties. Can be used for informations about the GPU.
 	int deviceIndex;								//!< Index of device which should be handled by instance (Standard is 0).
 
-	cudaGraphicsResource* cuda_vbo_resource = NULL;	//!< CudaGraphicsResouce. Is used to manipulate an OpenGL VertexBuffer directly via CUDA.
+	std::vector<cudaGraphicsResource*> cuda_vbo_resources;	//!< CudaGraphicsResouces. Are used to manipulate OpenGL VertexBuffers directly via CUDA.
+	std::vector<cudaGraphicsResource*> mapped_resources;	//!< Resources mapped by the last call of mapResources.
+	std::vector<cudaGraphicsResource*> held_resources;		//!< Resources mapped by holdResources, independent of mapResources.
+	std::vector<cudaStream_t> streams;						//!< Streams created by createStream.
+
+	cudaStream_t stageOrigin = NULL;						//!< Stream of beginStages.
+	cudaEvent_t stageFork = NULL;							//!< Recorded on the origin by beginStages, root stages on other streams wait for it.
+	std::vector<cudaStream_t> stageStreams;					//!< Streams of the stages besides the origin, created on demand, reused every frame.
+	std::vector<cudaEvent_t> stageEvents;					//!< Recorded after every stage of the frame, reused every frame.
+	std::vector<int> stageSlots;							//!< Stream of every stage of the frame. 0: origin, i: stageStreams[i - 1].
+	std::vector<int> slotTails;								//!< Last stage on every stream of the frame. -1: not used in this frame.
+
+	static std::vector<int> ( *glDeviceQuery )();			//!< Set by enableGLDevices. NULL: no OpenGL, getGLDevices is empty.
 
 public:
 
 	/*!
-	 * @brief Standard Constructor. Initialize instance with deviceIndex 0, 
-	 *		  to manipulate the first found CUDA device.
+	 * @brief Standard Constructor. Initialize instance with the device of selectDevice(),
+	 *		  the GPU which drives the OpenGL context or else the biggest one.
+	 *		  Without CUDA device the index is -1 and the properties are zero.
 	 */
 	CudaDevice();
 
@@ -59,31 +83,109 @@ public:
 
 	/*!
 	 * @brief Register an OpenGL Vertex Buffer. This Buffer will be manipulated directly via CUDA.
+	 * Use cudaGraphicsRegisterFlagsWriteDiscard for buffers CUDA overwrites completely,
+	 * so the old content doesn't have to be synchronized with OpenGL on every map.
+	 * Defined in cuda_device_gl.cpp.
 	 * @param vb OpenGL VertexBuffer.
+	 * @param flags register flags (cudaGraphicsRegisterFlags).
+	 * @return index of the registered resource.
 	 */
-	void registerGLBuffer( VertexBuffer vb );
+	int registerGLBuffer( const VertexBuffer& vb, unsigned int flags = cudaGraphicsRegisterFlagsNone );
 
 	/*!
-	 * @brief Unregister OpenGL Vertex Buffer source.
+	 * @brief Unregister all OpenGL Vertex Buffer sources.
 	 */
 	void unregisterGLBuffer();
 
 	/*!
-	 * @brief Map OpenGL Buffer Resource to get access to this directly via CUDA.
+	 * @brief Map all OpenGL Buffer Resources to get access to these directly via CUDA.
+	 * A mapped buffer must not be used by OpenGL, so it can't stay mapped while drawing.
+	 * @param stream map is ordered with the work in this stream. Work issued before in the stream has to finish first.
+	 */
+	void mapResources( cudaStream_t stream = 0 );
+
+	/*!
+	 * @brief Map only the given OpenGL Buffer Resources in one call.
+	 * @param resources indices returned by registerGLBuffer.
+	 * @param stream map is ordered with the work in this stream.
+	 */
+	void mapResources( const std::vector<int>& resources, cudaStream_t stream = 0 );
+
+	/*!
+	 * @brief Unmap all OpenGL Buffer Resources mapped by the last call of mapResources.
+	 * OpenGL commands issued afterwards wait for the work of the stream before the unmap.
+	 * @param stream should be the same stream used for mapResources and the kernels.
+	 */
+	void unmapResources( cudaStream_t stream = 0 );
+
+	/*!
+	 * @brief Map buffers CUDA works on for longer than a frame, e.g. particle arrays OpenGL only reads while drawing.
+	 * They stay mapped across mapResources and unmapResources until releaseResources. The pointers can change with every map.
+	 * @param resources indices returned by registerGLBuffer.
+	 * @param stream map is ordered with the work in this stream.
 	 */
-	void mapResources();
+	void holdResources( const std::vector<int>& resources, cudaStream_t stream = 0 );
 
 	/*!
-	 * @brief Unmap OpenGL Buffer Resource.
+	 * @brief Unmap the buffers of the last holdResources, e.g. for a draw. Nothing happens if none are held.
+	 * @param stream should be the same stream used for holdResources and the kernels.
 	 */
-	void unmapResources();
+	void releaseResources( cudaStream_t stream = 0 );
 
 	/*!
 	 * @brief Returns a device pointer to the OpenGL Buffer (Must be mapped!).
 	 * @param dev_ptr Device pointer will point to Buffer in CUDA.
 	 * @param size size of buffer.
+	 * @param resource index of the resource returned by registerGLBuffer.
+	 */
+	void getMappedPointer( void** dev_ptr, size_t* size, int resource = 0 );
+
+	/*!
+	 * @brief Get the number of registered OpenGL Buffers.
+	 * @return resources, indices 0 to count - 1.
+	 */
+	inline int getResourceCount() const { return static_cast< int >( cuda_vbo_resources.size() ); }
+
+	/*!
+	 * @brief Create a new stream on the device.
+	 * @param streamClass priority of the stream.
+	 * @return index of the stream.
+	 */
+	int createStream( StreamClass streamClass = StreamClass::CRITICAL );
+
+	/*!
+	 * @brief Get a stream created by createStream.
+	 * @param stream index returned by createStream.
+	 * @return stream.
+	 */
+	inline cudaStream_t getStream( int stream = 0 ) { return streams[stream]; }
+
+	/*!
+	 * @brief Wait for all work in all streams and destroy them, also the streams and events of the stages.
+	 */
+	void destroyStreams();
+
+	/*!
+	 * @brief Start the stages of a frame or step. Stages which don't depend on each other run on their own streams,
+	 * so small kernels overlap with large ones. While the origin is captured (e.g. kernel_begin_capture), the forks and
+	 * joins become branches of the graph, and the replay keeps the overlap.
+	 * @param origin stream which issues the frame. Stages without dependency start after the work issued before in it.
+	 */
+	void beginStages( cudaStream_t origin );
+
+	/*!
+	 * @brief Issue a stage after its dependencies. It continues a stream whose last stage is one of its dependencies,
+	 * otherwise it takes a stream of its own. Dependencies on other streams are joined with their events.
+	 * @param after stages of this frame returned by runStage. Empty: a root stage.
+	 * @param work issues the kernels and copies of the stage on the given stream. Called right away.
+	 * @return index of the stage.
 	 */
-	void getMappedPointer( void** dev_ptr, size_t* size );
+	int runStage( const std::vector<int>& after, const std::function<void( cudaStream_t )>& work );
+
+	/*!
+	 * @brief Join the streams of the stages into the origin: its next work waits for every stage of the frame.
+	 */
+	void endStages();
 
 	/*!
 	 * @brief Returns the number of processors on the GPU.
@@ -103,6 +205,12 @@ public:
 	*/
 	cudaDeviceProp getProperties();
 
+	/*!
+	 * @brief Check if the GPU can keep data persisting in L2 with an access policy window.
+	 * @return true for compute capability 8.0 (Ampere) or newer with a persisting L2 size.
+	 */
+	bool supportsL2Persistence() const;
+
 	/*!
 	 * @brief Set Cuda instance via equals.
 	 * @param cdv CudaDevice instance
@@ -110,6 +218,76 @@ public:
 	 */
 	CudaDevice& operator=(const CudaDevice& cdv);
 
+	/*!
+	 * @brief Get the priority of a stream class on the current device (cudaDeviceGetStreamPriorityRange).
+	 * @param streamClass class.
+	 * @return priority for cudaStreamCreateWithPriority, lower numbers are higher priorities.
+	 */
+	static int getStreamPriority( StreamClass streamClass );
+
+	/*!
+	 * @brief Create a stream of a class on the current device for subsystems without CudaDevice instance.
+	 * The caller destroys it, unlike the streams of createStream.
+	 * @param streamClass priority of the stream. BACKGROUND streams don't synchronize with the legacy default stream.
+	 * @return stream.
+	 */
+	static cudaStream_t newStream( StreamClass streamClass );
+
+	/*!
+	 * @brief Get the number of CUDA devices.
+	 * @return number of devices, 0 if there is no driver or no device.
+	 */
+	static int getDeviceCount();
+
+	/*!
+	 * @brief Let the driver keep the kernels it JIT compiles from PTX (GPUs without SASS in the build) in the given directory,
+	 *		  so the compile runs once per machine and not once per user profile. Sets CUDA_CACHE_PATH and a larger
+	 *		  CUDA_CACHE_MAXSIZE, both only if not set in the environment. Call before the first CUDA call of the process.
+	 * @param path cache directory. Empty: the default of the driver.
+	 */
+	static void configureComputeCache( const std::string& path );
+
+	/*!
+	 * @brief Let getGLDevices ask the current OpenGL context. Defined in cuda_device_gl.cpp,
+	 *		  so programs without OpenGL (SwarmSimulation library) never link GLFW.
+	 */
+	static void enableGLDevices();
+
+	/*!
+	 * @brief Get the indices of the GPUs which drive the current OpenGL context.
+	 * @return device indices. Empty if enableGLDevices wasn't called, no context is current or its GPU is no CUDA device.
+	 */
+	static std::vector<int> getGLDevices();
+
+	/*!
+	 * @brief Order all devices by preference: the GPUs of the current OpenGL context first,
+	 *		  so interop doesn't copy between GPUs, then more processors, then more memory.
+	 * @param preferred device index to put first regardless of the ranking. -1: none.
+	 * @return device indices.
+	 */
+	static std::vector<int> rankDevices( int preferred = -1 );
+
+	/*!
+	 * @brief Select the device to use.
+	 * @param preferred device index from the configuration. -1 or an invalid index: the first of rankDevices().
+	 * @return device index.
+	 */
+	static int selectDevice( int preferred = -1 );
+
+	/*!
+	 * @brief Select a GPU which doesn't run the OpenGL context, for the simulation of a split display (PeerDisplay).
+	 * @param preferred device index from the configuration. Valid: used as is.
+	 * @return device index. The first of rankDevices() without the OpenGL GPUs, selectDevice() if all of them run it.
+	 */
+	static int selectComputeDevice( int preferred = -1 );
+
+	/*!
+	 * @brief Print index, name, processors and memory of all devices, the preferred one marked.
+	 * @param os stream.
+	 * @param selected index of the used device.
+	 */
+	static void printDevices( ostream& os, int selected );
+
 	/*!
 	 * @brief Print some information about the Cuda Device with iostream.
 	 * @param os stream
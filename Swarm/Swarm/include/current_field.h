@@ -0,0 +1,69 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "swarm_config.h"
+#include "vec3.h"
+
+/*
+ * Current file: CurrentHeader, then slices * width * height * depth velocities (x, y, z as float), x fastest,
+ * one time slice after the other. All values in the byte order of the writing machine.
+ */
+
+static const char CURRENT_MAGIC[8] = { 'S', 'W', 'A', 'R', 'M', 'C', 'U', 'R' };
+static const unsigned int CURRENT_FILE_VERSION = 1;
+
+/*!
+ * @brief Header of a current file.
+ */
+struct CurrentHeader
+{
+	char magic[8];							//!< CURRENT_MAGIC.
+	unsigned int version;					//!< CURRENT_FILE_VERSION.
+	unsigned int width;						//!< Samples along x.
+	unsigned int height;					//!< Samples along y.
+	unsigned int depth;						//!< Samples along z.
+	unsigned int slices;					//!< Time slices.
+	float origin[3];						//!< Position of the first sample.
+	float cellSize;							//!< Distance between two samples along every axis.
+};
+
+/*!
+ * @brief Time varying velocity field of the water, sampled on a regular grid. Uploaded into 3D textures by kernel_set_current.
+ */
+struct CurrentVolume
+{
+	Vector3 origin;							//!< Position of the first sample.
+	float cellSize = 0.0f;					//!< Distance between two samples along every axis.
+	unsigned int width = 0;					//!< Samples along x. 0: no current.
+	unsigned int height = 0;				//!< Samples along y.
+	unsigned int depth = 0;					//!< Samples along z.
+	unsigned int slices = 0;				//!< Time slices in texels, played in a loop. 0: curl noise, generated on the GPU.
+	float noiseScale = 0.25f;				//!< Curl noise: features per distance.
+	std::vector<float> texels;				//!< 3 floats per sample (velocity x, y, z), x fastest, one slice after the other.
+};
+
+/*!
+ * @brief Read a current file.
+ * @param path file.
+ * @param volume Output: the current.
+ * @return true, if the file is a valid current of this version.
+ */
+bool readCurrent( const std::string& path, CurrentVolume& volume );
+
+/*!
+ * @brief Curl noise current over the spawn box and the waypoints. Only the grid, the slices are generated on the GPU.
+ * @param spawnMin lower corner of the spawn box.
+ * @param spawnMax upper corner of the spawn box.
+ * @param waypoints route of the swarm.
+ * @param resolution samples along the longest axis, at least 2.
+ * @return volume without texels.
+ */
+CurrentVolume curlNoiseCurrent( const Vector3& spawnMin, const Vector3& spawnMax, const std::vector<Vector3>& waypoints, unsigned int resolution );
+
+/*!
+ * @brief Current of a config: none, curl noise or a file.
+ * @param config config with the current ("curl" or file, empty: none), spawn box, waypoints and resolution.
+ * @return volume. Without current or if the file can't be read: width 0.
+ */
+CurrentVolume loadCurrent( const SwarmConfig& config );
@@ -0,0 +1,71 @@
+#pragma once
+#include "cuda_device.h"
+#include "cuda_device_array.h"
+#include "cuda_host_array.h"
+#include "event_log.h"
+#include "particle_store.h"
+#include "swarm_config.h"
+#include "swarm_ensemble.h"
+#include "swarm_stats.h"
+#include "waypoint_list.h"
+
+/*!
+ * @brief EnsembleSimulation runs many small independent swarms with different behaviour parameters in one process, without window.
+ * All members live back to back in one particle store and are advanced by one launch (kernel_advance_ensemble),
+ * so a parameter sweep fills the GPU instead of starting one process per run. No compaction, reorder or emitter.
+ */
+class EnsembleSimulation
+{
+private:
+	CudaDevice device_;						//!< Cuda Device. Used to simply communicate with the gpu.
+	cudaStream_t stream_;					//!< Stream for all simulation kernels and copies.
+	ParticleStore* particles_[2];			//!< Fishies of all members (ping-pong).
+	unsigned int current_ = 0;				//!< Index of the store that contains the latest positions and states.
+	CudaDeviceArray<float> d_sharks;		//!< contains shark positions of all members in memory on device.
+	CudaDeviceArray<float> d_shark_state;	//!< contains shark forces and masses of all members in memory on device.
+	CudaHostArray<SwarmStats> h_stats_;	//!< Aggregates per member, read back after the run.
+	static const unsigned int EVENT_INTERVAL = 16;	//!< Steps between two drains of the fish events.
+	SwarmEnsemble ensemble_;				//!< Offsets, sizes and parameters of the members.
+	std::vector<ParamSweep> sweeps_;		//!< Swept parameters, printed per member.
+	unsigned int members_;					//!< Number of members.
+	unsigned int numParticles_;				//!< Number of fishies of all members.
+	unsigned int numSharks_;				//!< Number of sharks of all members.
+	unsigned long long stepCount_ = 0;		//!< Simulated steps since the start.
+	EventLog* events_;						//!< Writes the fish events of all members. Fish ids are slots, member = id / fishies per member.
+	const float WAYPOINT_THRESHOLD = 0.1;	//!< Threshold for waypoint goal.
+	float speed;							//!< speed of particles per step (SwarmConfig::swarmSpeed * dt).
+	double dt_;								//!< Simulated time per step.
+	WaypointList* waypointList;				//!< Waypoint List contains waypoints for particles.
+	Vector3 swarmCenter;					//!< Position of swarm center, the same for all members.
+
+	/*!
+	 * @brief Move Swarm center to waypoint
+	 */
+	void moveSwarmCenter();
+
+public:
+
+	/*!
+	 * @brief Constructor.
+	 * Builds the ensemble of config.ensemble members with config.numParticles fishies and config.numSharks sharks each
+	 * and spawns them on the GPU. Every member starts with the same sharks.
+	 * @param config ensemble size, sweeps and the base parameters of every member.
+	 */
+	EnsembleSimulation( const SwarmConfig& config );
+
+	/*!
+	 * @brief Calculate one simulation step of all members.
+	 */
+	void step();
+
+	/*!
+	 * @brief Calculate the given number of steps, print the throughput and the aggregates of every member.
+	 * @param steps number of steps.
+	 */
+	void run( unsigned int steps );
+
+	/*!
+	 * @brief Free Memory on GPU.
+	 */
+	void cleanUp();
+};
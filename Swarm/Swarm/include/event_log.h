@@ -0,0 +1,64 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <cuda_runtime.h>
+
+#include "swarm_config.h"
+#include "swarm_event.h"
+
+/*!
+ * @brief EventLog writes the fish events of the GPU (deaths, spawns, near misses) into a CSV file.
+ * The kernels append them to a buffer in mapped pinned memory (kernel_init_events), drain reads the buffer of the last call
+ * and switches the buffers, so the simulation never waits for the file. One line per event: step,type,fish,shark,x,y,z,distance.
+ */
+class EventLog
+{
+private:
+	std::string path_;						//!< CSV file. Empty: disabled.
+	std::ofstream file_;					//!< Open CSV file.
+	cudaStream_t stream_;					//!< Simulation stream. The buffers are switched behind its work.
+	std::vector<SwarmEvent> events_;		//!< Events of the last drain. Kept to reuse the memory.
+	unsigned long long counts_[3] = {};		//!< Written events per SwarmEventType.
+	unsigned long long dropped_ = 0;		//!< Events that didn't fit into a buffer.
+
+	/*!
+	 * @brief Append the drained events to the file.
+	 */
+	void write();
+
+public:
+
+	/*!
+	 * @brief Constructor. Opens the file and allocates the event buffers of the active device, if config.events is set.
+	 * @param config event settings (events, event_capacity).
+	 * @param stream simulation stream.
+	 */
+	EventLog( const SwarmConfig& config, cudaStream_t stream );
+
+	/*!
+	 * @brief Destructor. Drains the last events.
+	 */
+	~EventLog();
+
+	EventLog( const EventLog& ) = delete;
+	EventLog& operator=( const EventLog& ) = delete;
+
+	/*!
+	 * @brief Write the events of the last call and switch the buffers. Call once per frame, after the steps of the frame.
+	 */
+	void drain();
+
+	/*!
+	 * @brief Write all remaining events, close the file and print the number of events.
+	 */
+	void finish();
+
+	/*!
+	 * @brief Check if the log writes a file.
+	 * @return true, if a path is set.
+	 */
+	inline bool isEnabled() const { return !path_.empty(); }
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+
+#include <glew.h>
+
+#include "job_system.h"
+#include "swarm_config.h"
+
+/*!
+ * @brief FrameCapture saves the frames of the window as TGA images without stalling the pipeline.
+ * A capture reads the back buffer into a pixel buffer object of a small ring (glReadPixels into GL_PIXEL_PACK_BUFFER) and
+ * sets a fence. A later frame maps the buffer once its fence is signaled, copies the pixels and a job of the JobSystem writes
+ * the file. Nothing waits for the GPU: if all buffers are still in flight, the capture is dropped and counted.
+ * Captures are taken every config.captureEvery frames and on key C.
+ */
+class FrameCapture
+{
+private:
+
+	static const unsigned int SLOTS = 3;	//!< Captures in flight.
+
+	/*!
+	 * @brief One pixel buffer of the ring.
+	 */
+	struct Slot
+	{
+		GLuint pbo = 0;						//!< Pixel buffer object.
+		size_t capacity = 0;				//!< Bytes of the buffer.
+		GLsync fence = 0;					//!< Signaled when the read is done. 0: free.
+		GLsizei width = 0;					//!< Size of the captured frame in pixels.
+		GLsizei height = 0;
+		std::string path;					//!< File of the capture.
+	};
+
+	JobSystem& jobs_;						//!< Workers of the file writes.
+	std::string prefix_;					//!< Files are prefix_<frame>.tga.
+	unsigned int every_;					//!< Frames between two periodic captures. 0: only on key C.
+	Slot slots_[SLOTS];						//!< Ring of pixel buffers.
+	unsigned long long frame_ = 0;			//!< Frames since the start.
+	unsigned long long captured_ = 0;		//!< Captures written or in flight.
+	unsigned long long dropped_ = 0;		//!< Captures dropped because all buffers were in flight.
+	JobSystem::Handle lastWrite_;			//!< Newest file write. The writes run in order, each one waits for the one before.
+
+	/*!
+	 * @brief Read the back buffer into a free slot.
+	 * @param path file of the capture.
+	 */
+	void read( const std::string& path );
+
+	/*!
+	 * @brief Copy the pixels of the slots whose read is done and hand them to a job.
+	 * @param wait true: wait for the reads, e.g. at exit.
+	 */
+	void collect( bool wait );
+
+public:
+
+	/*!
+	 * @brief Constructor. Creates the pixel buffers. Needs a current OpenGL context.
+	 * @param config capture prefix and interval.
+	 * @param jobs workers of the file writes.
+	 */
+	FrameCapture( const SwarmConfig& config, JobSystem& jobs );
+
+	/*!
+	 * @brief Destructor. Writes the captures in flight, waits for the files and deletes the buffers.
+	 */
+	~FrameCapture();
+
+	FrameCapture( const FrameCapture& ) = delete;
+	FrameCapture& operator=( const FrameCapture& ) = delete;
+
+	/*!
+	 * @brief Collect finished captures and capture this frame, if it is due or requested. Call after the last draw, before the swap.
+	 * @param requested capture this frame, e.g. on a key press.
+	 */
+	void endFrame( bool requested );
+
+	/*!
+	 * @brief Get the number of dropped captures.
+	 * @return captures, which found no free buffer.
+	 */
+	inline unsigned long long getDropped() const { return dropped_; }
+};
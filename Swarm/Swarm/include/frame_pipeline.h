@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+
+#include "glew.h"
+#include "cuda_runtime.h"
+
+#include "cuda_device.h"
+#include "cuda_device_array.h"
+
+/*!
+ * @brief FramePipeline lets the simulation run one frame ahead of the draws (SwarmConfig::pipelineDepth 1).
+ * The packs of step N+1 go into back buffers on the device while OpenGL draws step N from the VBOs, the front buffers.
+ * At the start of the next frame present waits for the event of the packs and the fence of the last draws, then copies
+ * the back buffers into the VBOs in one map. After the unmap the stream is free for the advance, which runs while OpenGL
+ * draws the copied step: the draws only wait for the copies, not for the whole frame of CUDA work.
+ * The event also bounds the queue to one frame, the render thread never runs further ahead.
+ * Depth 0: disabled, the VBOs are mapped and written in the frame which draws them, the lowest latency.
+ */
+class FramePipeline
+{
+private:
+
+	/*!
+	 * @brief Back buffer of a registered VBO.
+	 */
+	struct Back
+	{
+		CudaDeviceArray<unsigned char>* buffer = NULL;	//!< Written by the packs. NULL: not used yet.
+		size_t bytes = 0;					//!< Size of the VBO.
+		bool written = false;				//!< Written since the last present.
+	};
+
+	unsigned int depth_;					//!< Frames the simulation runs ahead: 0 or 1.
+	CudaDevice* device_ = NULL;				//!< Registers the VBOs, set by attach.
+	std::vector<Back> backs_;				//!< Back buffer per resource of device_.
+	cudaEvent_t packed_ = NULL;				//!< Recorded after the packs of a frame.
+	GLsync drawn_ = NULL;					//!< Signaled, when the draws of the last frame are done.
+	bool pending_ = false;					//!< Packs recorded, not presented yet.
+
+public:
+
+	/*!
+	 * @brief Constructor.
+	 * @param depth frames the simulation runs ahead, e.g. config.pipelineDepth. 0: disabled.
+	 */
+	FramePipeline( unsigned int depth );
+
+	/*!
+	 * @brief Destructor. Frees the back buffers, the event and the fence.
+	 */
+	~FramePipeline();
+
+	FramePipeline( const FramePipeline& ) = delete;
+	FramePipeline& operator=( const FramePipeline& ) = delete;
+
+	/*!
+	 * @brief Check if the simulation runs ahead of the draws.
+	 * @return true for depth 1.
+	 */
+	inline bool isEnabled() const { return depth_ > 0; }
+
+	/*!
+	 * @brief Take the sizes of all registered VBOs, after they are created. Nothing if disabled.
+	 * @param device registers the VBOs.
+	 * @param stream stream of the packs.
+	 */
+	void attach( CudaDevice& device, cudaStream_t stream );
+
+	/*!
+	 * @brief Get the back buffer of a VBO for the packs of this frame.
+	 * @param resource index returned by registerGLBuffer.
+	 * @return device pointer, as large as the VBO.
+	 */
+	void* stage( int resource );
+
+	/*!
+	 * @brief After the packs of a frame: record the event, present copies them with the next frame.
+	 * @param stream stream of the packs.
+	 */
+	void finish( cudaStream_t stream );
+
+	/*!
+	 * @brief After the draws of a frame, which read the VBOs.
+	 */
+	void fence();
+
+	/*!
+	 * @brief Copy the back buffers of the last finish into the VBOs, before the advance of this frame.
+	 * @param stream stream of the packs.
+	 */
+	void present( cudaStream_t stream );
+};
@@ -0,0 +1,364 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include <glew.h>
+
+#include "cuda_runtime.h"
+
+#include "macros.h"
+#include "trace_exporter.h"
+
+/*!
+ * @brief Stages of a frame, which are timed by the FrameProfiler.
+ */
+enum class FrameStage
+{
+	MAP,			//!< Map the VBOs for CUDA (GPU time).
+	ADVANCE,		//!< All simulation steps of the frame (GPU time).
+	PACK,			//!< Write positions and colors into the VBOs (GPU time).
+	CULL,			//!< Frustum culling or depth sort into the draw buffers, including map and unmap (GPU time).
+	UNMAP,			//!< Unmap the VBOs (GPU time).
+	DRAW,			//!< Draw fishies and sharks (OpenGL time).
+	SWAP,			//!< Swap the window buffers (CPU time, includes waiting for V-Sync).
+	COUNT			//!< Number of stages.
+};
+
+/*!
+ * @brief Get the name of a stage, as in the reports.
+ * @param stage stage, not COUNT.
+ * @return name, e.g. "advance".
+ */
+const char* frameStageName( FrameStage stage );
+
+/*!
+ * @brief Rolling window of the last samples of one stage. Gives mean and percentiles.
+ */
+class StageTimes
+{
+private:
+
+	std::vector<float> samples_;			//!< Ring buffer of the samples in ms.
+	size_t next_ = 0;						//!< Slot of the next sample.
+	size_t count_ = 0;						//!< Number of valid samples.
+
+public:
+
+	/*!
+	 * @brief Constructor.
+	 * @param window number of samples kept.
+	 */
+	explicit StageTimes( size_t window = 240 );
+
+	/*!
+	 * @brief Add a sample. Replaces the oldest one, if the window is full.
+	 * @param ms time in ms.
+	 */
+	void add( float ms );
+
+	/*!
+	 * @brief Get the mean of the samples.
+	 * @return mean in ms. 0 without samples.
+	 */
+	float mean() const;
+
+	/*!
+	 * @brief Get a percentile of the samples (nearest rank).
+	 * @param p percentile in [0, 100].
+	 * @return time in ms. 0 without samples.
+	 */
+	float percentile( float p ) const;
+
+	/*!
+	 * @brief Get a sample by age.
+	 * @param i index in [0, count()). 0 is the oldest sample.
+	 * @return time in ms.
+	 */
+	float at( size_t i ) const;
+
+	/*!
+	 * @brief Get the number of samples.
+	 * @return number of samples in the window.
+	 */
+	inline size_t count() const { return count_; }
+
+	/*!
+	 * @brief Get the size of the window.
+	 * @return number of samples kept.
+	 */
+	inline size_t window() const { return samples_.size(); }
+};
+
+/*!
+ * @brief FrameProfiler measures the stages of every frame without stalling the pipeline.
+ * GPU stages are timed with CUDA events, the draw with an OpenGL timer query, the swap on the CPU.
+ * The results of a frame are read FRAMES_IN_FLIGHT frames later, when they are ready for sure.
+ * With a TraceExporter the collected stages also go into the trace: CUDA events are placed on the host clock by their
+ * elapsed time since an epoch event, whose host time is calibrated with one synchronize at the start and then chained
+ * to a new epoch event every few seconds, so the float milliseconds stay short. OpenGL stages get a timestamp query at
+ * their start, calibrated once against GL_TIMESTAMP. CPU stages are traced as they end.
+ */
+class FrameProfiler
+{
+public:
+
+	static const unsigned int FRAMES_IN_FLIGHT = 3;	//!< Frames until the timers of a frame are read.
+
+private:
+
+	static const unsigned int STAGES = static_cast< unsigned int >( FrameStage::COUNT );
+
+	/*!
+	 * @brief Timers of one frame.
+	 */
+	struct FrameTimers
+	{
+		cudaEvent_t start[STAGES];			//!< CUDA events before the stages.
+		cudaEvent_t stop[STAGES];			//!< CUDA events after the stages.
+		GLuint query[STAGES];				//!< OpenGL timer queries.
+		GLuint stamp[STAGES];				//!< OpenGL timestamp queries at the start of the stages. Only with trace_.
+		double hostMs[STAGES];				//!< CPU times.
+		unsigned char used[STAGES];			//!< 0: not timed, 1: CUDA, 2: OpenGL, 3: CPU.
+		unsigned int tag;					//!< Set by tagFrame, e.g. what the frame simulated.
+	};
+
+	bool enabled_;							//!< false: all methods do nothing.
+	bool cudaTimers_;						//!< false: no CUDA events, only OpenGL and CPU stages are timed.
+	FrameTimers frames_[FRAMES_IN_FLIGHT];	//!< Timers of the frames in flight.
+	unsigned int current_ = 0;				//!< Frame recorded now.
+	StageTimes times_[STAGES];				//!< Rolling samples per stage.
+	float collectedMs_[STAGES];				//!< Samples of the frame collected by the last beginFrame. < 0: not timed or not ready.
+	unsigned int collectedTag_ = 0;			//!< Tag of that frame.
+	double reportInterval_;					//!< Seconds between two console reports. 0: no report.
+	double lastReport_ = 0.0;				//!< Time of the last report.
+
+	TraceExporter* trace_;					//!< Trace of the collected stages. NULL: no trace.
+	cudaEvent_t epoch_ = NULL;				//!< CUDA event of known host time, the CUDA stages are traced relative to it.
+	cudaEvent_t nextEpoch_ = NULL;			//!< Recorded for the next rebase, replaces epoch_ once it completed.
+	bool rebasing_ = false;					//!< nextEpoch_ is recorded and not completed yet.
+	double epochHost_ = 0.0;				//!< Host time of epoch_ in seconds.
+	double lastRebase_ = 0.0;				//!< Host time of the last record of nextEpoch_.
+	GLint64 epochGl_ = 0;					//!< GL_TIMESTAMP in ns at epochGlHost_.
+	double epochGlHost_ = 0.0;				//!< Host time of the OpenGL calibration in seconds.
+
+	/*!
+	 * @brief Move epoch_ forward to a newer event without waiting: record nextEpoch_, take it once it completed.
+	 */
+	void rebase();
+
+	/*!
+	 * @brief Read the timers of a frame into the samples and mark them unused.
+	 * @param frame timers of a frame which is FRAMES_IN_FLIGHT frames old.
+	 */
+	void collect( FrameTimers& frame );
+
+public:
+
+	/*!
+	 * @brief Constructor. Creates the events and queries. Needs a current OpenGL context.
+	 * @param enabled false: no timers are created or recorded.
+	 * @param reportInterval seconds between two console reports. 0: no report.
+	 * @param cudaTimers false: CUDA is never called, e.g. for the OpenGL compute backend. beginCuda and endCuda do nothing.
+	 * @param trace trace of the collected stages, the caller keeps it alive. NULL or disabled: no trace.
+	 */
+	FrameProfiler( bool enabled = true, double reportInterval = 5.0, bool cudaTimers = true, TraceExporter* trace = NULL );
+
+	/*!
+	 * @brief Destructor. Destroys events and queries.
+	 */
+	~FrameProfiler();
+
+	FrameProfiler( const FrameProfiler& ) = delete;
+	FrameProfiler& operator=( const FrameProfiler& ) = delete;
+
+	/*!
+	 * @brief Start a new frame. Collects the timers of the oldest frame in flight.
+	 */
+	void beginFrame();
+
+	/*!
+	 * @brief Record the start of a GPU stage on a stream.
+	 * @param stage stage.
+	 * @param stream stream of the stage.
+	 */
+	void beginCuda( FrameStage stage, cudaStream_t stream );
+
+	/*!
+	 * @brief Record the end of a GPU stage on a stream.
+	 * @param stage stage.
+	 * @param stream stream of the stage.
+	 */
+	void endCuda( FrameStage stage, cudaStream_t stream );
+
+	/*!
+	 * @brief Start the OpenGL timer query of a stage. Only one can be active at a time.
+	 * @param stage stage.
+	 */
+	void beginGl( FrameStage stage );
+
+	/*!
+	 * @brief End the OpenGL timer query of a stage.
+	 * @param stage stage.
+	 */
+	void endGl( FrameStage stage );
+
+	/*!
+	 * @brief Add the CPU time of a stage.
+	 * @param stage stage.
+	 * @param ms time in ms.
+	 */
+	void addHost( FrameStage stage, double ms );
+
+	/*!
+	 * @brief Tag the frame recorded now. The tag comes back with its samples, FRAMES_IN_FLIGHT frames later (getCollected).
+	 * @param tag value of the caller, e.g. the search mode and the number of steps of the frame. 0 by default.
+	 */
+	void tagFrame( unsigned int tag );
+
+	/*!
+	 * @brief Get a sample of the frame collected by the last beginFrame, e.g. to compare the frames of different settings.
+	 * @param stage stage.
+	 * @param tag Output: tag of the frame (tagFrame).
+	 * @return time in ms. < 0: the stage wasn't timed in that frame or its timer wasn't ready.
+	 */
+	float getCollected( FrameStage stage, unsigned int& tag ) const;
+
+	/*!
+	 * @brief Get the rolling samples of a stage.
+	 * @param stage stage.
+	 * @return samples.
+	 */
+	inline const StageTimes& getTimes( FrameStage stage ) const { return times_[static_cast< unsigned int >( stage )]; }
+
+	/*!
+	 * @brief Short summary for the window title: mean time per stage.
+	 * @return summary, empty if disabled.
+	 */
+	std::string summary() const;
+
+	/*!
+	 * @brief Full report: mean, p50, p95 and p99 per stage.
+	 * @return report with one line per stage.
+	 */
+	std::string report() const;
+
+	/*!
+	 * @brief Print the report to the console, if reportInterval seconds have passed since the last one.
+	 * @return true, if the report was printed.
+	 */
+	bool reportIfDue();
+
+	/*!
+	 * @brief Check if reportInterval seconds have passed since the last report and restart the interval.
+	 * For callers which print the report themselves, e.g. on a worker thread.
+	 * @return true, if a report is due.
+	 */
+	bool consumeReportDue();
+
+	/*!
+	 * @brief Check if the profiler records timers.
+	 * @return true, if enabled.
+	 */
+	inline bool isEnabled() const { return enabled_; }
+};
+
+/*!
+ * @brief RAII timer of a GPU stage: records CUDA events on a stream at construction and destruction.
+ */
+class ScopedCudaTimer
+{
+private:
+
+	FrameProfiler& profiler_;				//!< Profiler of the frame.
+	FrameStage stage_;						//!< Timed stage.
+	cudaStream_t stream_;					//!< Stream of the stage.
+
+public:
+
+	/*!
+	 * @brief Record the start of the stage.
+	 * @param profiler profiler of the frame.
+	 * @param stage timed stage.
+	 * @param stream stream of the stage.
+	 */
+	ScopedCudaTimer( FrameProfiler& profiler, FrameStage stage, cudaStream_t stream ) :
+		profiler_( profiler ), stage_( stage ), stream_( stream )
+	{
+		profiler_.beginCuda( stage_, stream_ );
+	}
+
+	/*!
+	 * @brief Record the end of the stage.
+	 */
+	~ScopedCudaTimer()
+	{
+		profiler_.endCuda( stage_, stream_ );
+	}
+
+	ScopedCudaTimer( const ScopedCudaTimer& ) = delete;
+	ScopedCudaTimer& operator=( const ScopedCudaTimer& ) = delete;
+};
+
+/*!
+ * @brief RAII timer of an OpenGL stage with a GL_TIME_ELAPSED query.
+ */
+class ScopedGlTimer
+{
+private:
+
+	FrameProfiler& profiler_;				//!< Profiler of the frame.
+	FrameStage stage_;						//!< Timed stage.
+
+public:
+
+	/*!
+	 * @brief Start the query of the stage.
+	 * @param profiler profiler of the frame.
+	 * @param stage timed stage.
+	 */
+	ScopedGlTimer( FrameProfiler& profiler, FrameStage stage ) :
+		profiler_( profiler ), stage_( stage )
+	{
+		profiler_.beginGl( stage_ );
+	}
+
+	/*!
+	 * @brief End the query of the stage.
+	 */
+	~ScopedGlTimer()
+	{
+		profiler_.endGl( stage_ );
+	}
+
+	ScopedGlTimer( const ScopedGlTimer& ) = delete;
+	ScopedGlTimer& operator=( const ScopedGlTimer& ) = delete;
+};
+
+/*!
+ * @brief RAII timer of a CPU stage, e.g. the buffer swap.
+ */
+class ScopedHostTimer
+{
+private:
+
+	FrameProfiler& profiler_;				//!< Profiler of the frame.
+	FrameStage stage_;						//!< Timed stage.
+	double start_;							//!< Start time in seconds.
+
+public:
+
+	/*!
+	 * @brief Start the timer.
+	 * @param profiler profiler of the frame.
+	 * @param stage timed stage.
+	 */
+	ScopedHostTimer( FrameProfiler& profiler, FrameStage stage );
+
+	/*!
+	 * @brief Add the elapsed time to the stage.
+	 */
+	~ScopedHostTimer();
+
+	ScopedHostTimer( const ScopedHostTimer& ) = delete;
+	ScopedHostTimer& operator=( const ScopedHostTimer& ) = delete;
+};
@@ -0,0 +1,165 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "frame_profiler.h"
+#include "gpu_telemetry.h"
+
+/*!
+ * @brief Parts of the wall time of a frame, which are recorded by the FrameTimeRecorder.
+ */
+enum class FramePart
+{
+	SIMULATION,		//!< Launch of the simulation steps, map, pack and unmap (CPU time of Renderer::runCuda).
+	RENDER,			//!< Rest of Renderer::render: clear, uniforms and draw calls.
+	PRESENT,		//!< Buffer swap, includes waiting for V-Sync and for the GPU.
+	COUNT			//!< Number of parts.
+};
+
+/*!
+ * @brief FrameTimeRecorder keeps the wall time of the last frames, split into simulation, render and present.
+ * Smoothness depends on the slow frames, so it reports percentiles, frames over budget and a histogram instead of the mean.
+ * All times are CPU times, they don't need any GPU timers.
+ */
+class FrameTimeRecorder
+{
+public:
+
+	static const unsigned int HISTOGRAM_BINS = 64;	//!< 1 ms bins. The last one collects all slower frames.
+
+private:
+
+	static const unsigned int PARTS = static_cast< unsigned int >( FramePart::COUNT );
+
+	StageTimes total_;						//!< Wall time from frame to frame in ms.
+	StageTimes parts_[PARTS];				//!< Time of the parts in ms. Same window as total_, so sample i is the same frame.
+	double current_[PARTS];					//!< Parts of the frame recorded now in ms.
+	double partStart_[PARTS];				//!< Start of the parts timed with beginPart in seconds.
+	double frameStart_ = -1.0;				//!< Start of the frame recorded now in seconds. < 0: no frame yet.
+	float budget_;							//!< Frame budget in ms, e.g. 16.7 for 60 Hz.
+	unsigned long long frames_ = 0;			//!< Frames since the start.
+	unsigned long long overBudget_ = 0;		//!< Frames over budget since the start.
+	unsigned long long histogram_[HISTOGRAM_BINS] = {};	//!< Frames per 1 ms bin since the start.
+	TraceExporter* trace_ = NULL;			//!< Trace of the frames and their parts. NULL: no trace.
+	const GpuTelemetry* telemetry_ = NULL;	//!< GPU readings of the frames. NULL: not recorded.
+	std::vector<GpuSample> samples_;		//!< Newest GPU reading at the end of every frame. Same window as total_, once telemetry_ is set.
+
+public:
+
+	/*!
+	 * @brief Constructor.
+	 * @param budget frame budget in ms.
+	 * @param window number of frames kept for percentiles and the dump.
+	 */
+	explicit FrameTimeRecorder( float budget = 1000.0f / 60.0f, size_t window = 3600 );
+
+	/*!
+	 * @brief End the last frame and start the next one. Call once per frame, before its parts are added.
+	 * The wall time of the last frame is the time between two calls.
+	 */
+	void beginFrame();
+
+	/*!
+	 * @brief Add time to a part of the frame recorded now.
+	 * @param part part.
+	 * @param ms time in ms.
+	 */
+	void add( FramePart part, double ms );
+
+	/*!
+	 * @brief Start timing a part.
+	 * @param part part.
+	 */
+	void beginPart( FramePart part );
+
+	/*!
+	 * @brief Add the time since beginPart to a part.
+	 * @param part part.
+	 */
+	void endPart( FramePart part );
+
+	/*!
+	 * @brief Get the frame budget.
+	 * @return budget in ms.
+	 */
+	inline float getBudget() const { return budget_; }
+
+	/*!
+	 * @brief Trace every frame and every timed part from now on, as ranges of the render thread.
+	 * @param trace trace, the caller keeps it alive. NULL or disabled: no trace.
+	 */
+	inline void setTrace( TraceExporter* trace ) { trace_ = trace != NULL && trace->isEnabled() ? trace : NULL; }
+
+	/*!
+	 * @brief Record the newest GPU reading with every frame from now on, the dump writes it with every row.
+	 * @param telemetry telemetry, the caller keeps it alive. NULL or disabled: not recorded.
+	 */
+	void setTelemetry( const GpuTelemetry* telemetry );
+
+	/*!
+	 * @brief Get the wall times of the last frames, e.g. for a graph.
+	 * @return samples in ms, oldest first.
+	 */
+	inline const StageTimes& getTotal() const { return total_; }
+
+	/*!
+	 * @brief Get the number of frames since the start.
+	 * @return number of frames.
+	 */
+	inline unsigned long long getFrames() const { return frames_; }
+
+	/*!
+	 * @brief Get the number of frames over budget since the start.
+	 * @return number of frames.
+	 */
+	inline unsigned long long getOverBudget() const { return overBudget_; }
+
+	/*!
+	 * @brief Get the time of a part of the last ended frame.
+	 * @param part part.
+	 * @return time in ms. 0 before the first frame ended.
+	 */
+	float getLast( FramePart part ) const;
+
+	/*!
+	 * @brief Report: p50, p95 and p99 of the frame time and its parts, frames over budget.
+	 * @return report with one line per part.
+	 */
+	std::string report() const;
+
+	/*!
+	 * @brief Write report, histogram and the frames of the window as CSV into a file.
+	 * @param path path of the file.
+	 * @return true, if the file could be written.
+	 */
+	bool dump( const std::string& path ) const;
+};
+
+/*!
+ * @brief RAII timer of a part of the frame.
+ */
+class ScopedFramePart
+{
+private:
+
+	FrameTimeRecorder& recorder_;			//!< Recorder of the frame.
+	FramePart part_;						//!< Timed part.
+	double start_;							//!< Start time in seconds.
+
+public:
+
+	/*!
+	 * @brief Start the timer.
+	 * @param recorder recorder of the frame.
+	 * @param part timed part.
+	 */
+	ScopedFramePart( FrameTimeRecorder& recorder, FramePart part );
+
+	/*!
+	 * @brief Add the elapsed time to the part.
+	 */
+	~ScopedFramePart();
+
+	ScopedFramePart( const ScopedFramePart& ) = delete;
+	ScopedFramePart& operator=( const ScopedFramePart& ) = delete;
+};
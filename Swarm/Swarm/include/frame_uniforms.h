@@ -0,0 +1,27 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/*!
+ * @brief Uniform block FrameUniforms of the shaders (std140).
+ */
+struct FrameUniforms
+{
+	glm::mat4 model;															//!< Model matrix.
+	glm::mat4 view;																//!< View matrix of the camera.
+	glm::mat4 projection;														//!< Projection matrix of the camera.
+	float fishSize;																//!< Length from head to body center of the fish meshes.
+	float padding[3];															//!< std140 rounds the block up to 16 bytes.
+};
+static unsigned int const FRAME_UNIFORMS_BINDING = 0;
+
+static unsigned int const MAX_SCHOOL_DRAWS = 64;								//!< Entries of SchoolDraws, CULL_MAX_SCHOOLS.
+
+/*!
+ * @brief Uniform block SchoolDraws of the shaders (std140): data per command of the culled multi draws, read with gl_DrawIDARB.
+ */
+struct SchoolDraws
+{
+	glm::vec4 colors[MAX_SCHOOL_DRAWS];											//!< Hue of the school (rgb) and its weight over the fish colors (w).
+};
+static unsigned int const SCHOOL_DRAWS_BINDING = 1;
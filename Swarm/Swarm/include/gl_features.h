@@ -0,0 +1,51 @@
+#pragma once
+
+#include "glew.h"
+
+/*!
+ * @brief Check if direct state access can be used (OpenGL 4.5 or ARB_direct_state_access).
+ * Evaluated at the first call, which needs a current context. Then VertexArray, VertexBuffer and Shader don't bind objects to change them.
+ * @return true, if the DSA functions are available.
+ */
+inline bool glHasDirectStateAccess()
+{
+	static const bool available = GLEW_VERSION_4_5 || GLEW_ARB_direct_state_access;
+	return available;
+}
+
+/*!
+ * @brief Check if compute shaders can be used (OpenGL 4.3 or ARB_compute_shader). Needs a current context.
+ * @return true, if compute shaders are available.
+ */
+inline bool glHasComputeShaders()
+{
+	static const bool available = GLEW_VERSION_4_3 || GLEW_ARB_compute_shader;
+	return available;
+}
+
+/*!
+ * @brief Check if shader storage buffers can be used (OpenGL 4.3 or ARB_shader_storage_buffer_object). Needs a current context.
+ * @return true, if vertex shaders can read buffers bound to GL_SHADER_STORAGE_BUFFER.
+ */
+inline bool glHasShaderStorage()
+{
+	static const bool available = GLEW_VERSION_4_3 || GLEW_ARB_shader_storage_buffer_object;
+	return available;
+}
+
+/*!
+ * @brief Check if linked programs can be saved and loaded as binaries (OpenGL 4.1 or ARB_get_program_binary, and at least one format).
+ * Needs a current context.
+ * @return true, if glGetProgramBinary and glProgramBinary can be used.
+ */
+inline bool glHasProgramBinary()
+{
+	static const bool available = [] {
+		if ( !GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary )
+			return false;
+		int formats = 0;
+		glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &formats );
+		return formats > 0;
+	}();
+	return available;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cuda_runtime.h>
+
+#include "cuda_device_array.h"
+#include "swarm_config.h"
+
+/*!
+ * @brief GpuCompressor compresses device buffers with nvCOMP (LZ4, Cascaded or Bitcomp) on a stream and decompresses them on
+ * the device again, so snapshots and trajectory chunks cross the bus and reach the disk compressed. A buffer is cut into
+ * chunks of CHUNK_SIZE bytes, compressed as one batch and gathered into a record (kernel_compression_gather): record bytes,
+ * raw bytes, chunk count, the compressed size of every chunk, then the chunks. The scratch buffers are shared, so one
+ * compressor serves one stream at a time.
+ * nvCOMP isn't part of the CUDA toolkit: build with SWARM_NVCOMP, its include directory and nvcomp.lib.
+ * Without it the compressor prints a message and stays disabled, the callers write raw data.
+ */
+class GpuCompressor
+{
+private:
+
+	static const size_t CHUNK_SIZE = 65536;	//!< Bytes per nvCOMP chunk. The default of the nvCOMP examples, in all limits of the codecs.
+
+	struct Codec;							//!< nvCOMP options and temp buffer, defined with SWARM_NVCOMP only.
+
+	Codec* codec_ = NULL;					//!< NULL: disabled.
+	unsigned int maxChunks_ = 0;			//!< Chunks of the biggest buffer.
+	size_t slotSize_ = 0;					//!< Bytes per compressed chunk slot, the maximum output of the codec padded to 8.
+
+	CudaDeviceArray<char> slots_;			//!< Output slots of the compression, one per chunk.
+	CudaDeviceArray<const void*> inputPtrs_;	//!< Raw chunks (compression) or compressed chunks (decompression).
+	CudaDeviceArray<size_t> inputBytes_;	//!< Sizes of the chunks in inputPtrs_.
+	CudaDeviceArray<void*> outputPtrs_;		//!< Output slots (compression) or destinations (decompression).
+	CudaDeviceArray<size_t> outputBytes_;	//!< Compressed sizes (compression) or raw sizes (decompression).
+	CudaDeviceArray<size_t> actualBytes_;	//!< Decompressed sizes reported by nvCOMP.
+	CudaDeviceArray<unsigned long long> destinations_;	//!< Offsets of the chunks in the record.
+
+	/*!
+	 * @brief Get the number of chunks of a buffer.
+	 * @param bytes size of the buffer.
+	 * @return chunks.
+	 */
+	static inline unsigned int chunkCount( size_t bytes ) { return static_cast< unsigned int >( ( bytes + CHUNK_SIZE - 1 ) / CHUNK_SIZE ); }
+
+public:
+
+	/*!
+	 * @brief Constructor. Sets up the codec and allocates the scratch buffers for buffers up to maxBytes.
+	 * @param compression codec. OFF: disabled.
+	 * @param maxBytes size of the biggest buffer.
+	 * @param elementSize bytes per value of the data (1, 2, 4 or 8), Cascaded and Bitcomp work on values of this size.
+	 */
+	GpuCompressor( Compression compression, size_t maxBytes, unsigned int elementSize );
+
+	/*!
+	 * @brief Destructor. Frees the temp buffer of nvCOMP.
+	 */
+	~GpuCompressor();
+
+	GpuCompressor( const GpuCompressor& ) = delete;
+	GpuCompressor& operator=( const GpuCompressor& ) = delete;
+
+	/*!
+	 * @brief Check if the compressor works.
+	 * @return true, if a codec is set and nvCOMP is built in.
+	 */
+	inline bool isEnabled() const { return codec_ != NULL; }
+
+	/*!
+	 * @brief Get the size of a record in the worst case, for the output buffers.
+	 * @param bytes size of the buffer.
+	 * @return bytes of the record.
+	 */
+	size_t maxRecordSize( size_t bytes ) const;
+
+	/*!
+	 * @brief Compress a device buffer into a record at output + *offset and move *offset behind it, on the stream.
+	 * Only the record is written, so output can be mapped pinned memory: just the compressed bytes cross the bus.
+	 * @param input buffer on the device.
+	 * @param bytes size of the buffer, up to maxBytes.
+	 * @param output records, on the device or mapped, with room for maxRecordSize( bytes ) at *offset.
+	 * @param offset offset in output, a multiple of 8, on the device or mapped.
+	 * @param stream CUDA stream.
+	 */
+	void compress( const void* input, size_t bytes, char* output, unsigned long long* offset, cudaStream_t stream );
+
+	/*!
+	 * @brief Decompress a record of compress on the stream.
+	 * @param record record on the device, at a multiple of 8.
+	 * @param output buffer on the device.
+	 * @param bytes raw size of the record, up to maxBytes.
+	 * @param stream CUDA stream.
+	 */
+	void decompress( const char* record, void* output, size_t bytes, cudaStream_t stream );
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+/*!
+ * @brief One reading of the GPU or the means of a run.
+ */
+struct GpuSample
+{
+	float smClock = 0.0f;					//!< SM clock in MHz.
+	float memoryClock = 0.0f;				//!< Memory clock in MHz.
+	float power = 0.0f;						//!< Board power draw in W.
+	float temperature = 0.0f;				//!< GPU temperature in degrees Celsius. Maximum in the means of a run.
+	unsigned long long throttle = 0;		//!< Clock throttle reasons, bits of nvmlClocksThrottleReasons. All seen bits in the means of a run.
+};
+
+/*!
+ * @brief GpuTelemetry samples clocks, power, temperature and throttle reasons of one GPU with NVML on a background thread.
+ * Benchmarks read the newest sample per CSV row and the energy of the run (the energy counter of the board if it has one,
+ * else the integrated power), so a throughput can be given as joules per million fish steps and throttled runs are visible.
+ * NVML comes with the driver: build with SWARM_NVML, nvml.h of the CUDA toolkit on the include path and nvml.lib.
+ * Without it the telemetry prints a message and stays disabled.
+ */
+class GpuTelemetry
+{
+private:
+
+	static const unsigned int INTERVAL_MS = 50;	//!< Time between two samples. NVML updates the power about every 20 to 100 ms.
+
+	struct Device;							//!< NVML handle, defined with SWARM_NVML only.
+
+	Device* device_ = NULL;					//!< NULL: disabled.
+	std::thread sampler_;					//!< Reads the GPU every INTERVAL_MS.
+	mutable std::mutex mutex_;				//!< Guards everything below and stop_.
+	std::condition_variable wakeUp_;		//!< Signals the stop.
+	bool stop_ = false;						//!< Sampler thread ends.
+
+	GpuSample last_;						//!< Newest sample.
+	GpuSample sum_;							//!< Sums of clocks and power, maximum temperature and all throttle bits since begin.
+	unsigned long long samples_ = 0;		//!< Samples since begin.
+	double joules_ = 0.0;					//!< Energy since begin.
+	bool running_ = true;					//!< Samples are added to the run. From the start until end.
+	double lastTime_ = 0.0;					//!< Time of last_ in seconds, for the integrated power.
+	unsigned long long lastEnergy_ = 0;		//!< Energy counter of the board at last_ in mJ.
+
+	/*!
+	 * @brief Sampler thread: read the GPU every INTERVAL_MS until stop_ is set.
+	 */
+	void sample();
+
+	/*!
+	 * @brief Read the GPU once and add the reading to the run. Holds mutex_.
+	 */
+	void read();
+
+public:
+
+	/*!
+	 * @brief Constructor. Opens the GPU in NVML and starts the sampler thread.
+	 * @param enabled sample at all, e.g. config.telemetry.
+	 * @param cudaDevice CUDA index of the GPU, matched to NVML by its PCI bus id.
+	 */
+	GpuTelemetry( bool enabled, int cudaDevice );
+
+	/*!
+	 * @brief Destructor. Stops the sampler thread and closes NVML.
+	 */
+	~GpuTelemetry();
+
+	GpuTelemetry( const GpuTelemetry& ) = delete;
+	GpuTelemetry& operator=( const GpuTelemetry& ) = delete;
+
+	/*!
+	 * @brief Check if the GPU is sampled.
+	 * @return true, if NVML found the GPU.
+	 */
+	inline bool isEnabled() const { return device_ != NULL; }
+
+	/*!
+	 * @brief Start a run: reset means and energy, e.g. right before the timed steps.
+	 * Without begin the run starts with the constructor.
+	 */
+	void begin();
+
+	/*!
+	 * @brief End the run: later samples only update getSample, means and energy stay, e.g. right after the timed steps.
+	 */
+	void end();
+
+	/*!
+	 * @brief Get the newest sample.
+	 * @return sample, zero if disabled.
+	 */
+	GpuSample getSample() const;
+
+	/*!
+	 * @brief Get the means of clocks and power of the run, the maximum temperature and all throttle reasons seen.
+	 * @return means, zero without samples.
+	 */
+	GpuSample getMean() const;
+
+	/*!
+	 * @brief Get the energy of the run.
+	 * @return energy in J.
+	 */
+	double getJoules() const;
+
+	/*!
+	 * @brief Report of the run: clocks, power, temperature, throttle reasons and energy per million fish steps.
+	 * @param fishSteps fish updates of the run.
+	 * @return report with one line per value, aligned like the other reports. Empty, if disabled.
+	 */
+	std::string report( double fishSteps ) const;
+
+	/*!
+	 * @brief Get the names of throttle reasons.
+	 * @param throttle bits of nvmlClocksThrottleReasons.
+	 * @return names separated by "|", "none" without a reason.
+	 */
+	static std::string throttleNames( unsigned long long throttle );
+
+	/*!
+	 * @brief Get the CSV columns of a sample, each starting with a comma.
+	 * @return ",sm_mhz,memory_mhz,power_w,temperature_c,throttle".
+	 */
+	static const char* csvColumns();
+
+	/*!
+	 * @brief Write a sample as the CSV columns of csvColumns.
+	 * @param os stream of the row.
+	 * @param sample sample.
+	 */
+	static void writeCsv( std::ostream& os, const GpuSample& sample );
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "event_log.h"
+#include "gpu_telemetry.h"
+#include "position_export.h"
+#include "snapshot.h"
+#include "swarm_config.h"
+#include "swarm_simulation.h"
+#include "trajectory_recorder.h"
+
+/*!
+ * @brief HeadlessSimulation runs the swarm without window, shader or OpenGL interop.
+ * Particles only live in device memory. Used on machines without display and to measure the kernel throughput.
+ * The steps are the ones of SwarmSimulation, this class adds snapshots, trajectories, events and the report.
+ */
+class HeadlessSimulation
+{
+private:
+
+	SwarmSimulation simulation_;			//!< Device, stores, sharks and swarm center. Restores config.restore.
+
+	static const unsigned int GRID_UPDATE_INTERVAL = 16;	//!< Steps between two updates of the grid bounds.
+
+	double particleUpdates_ = 0.0;			//!< Number of fish updates of the last run.
+	unsigned int stepsSinceGridUpdate_ = 0;	//!< Steps since the last update of the grid bounds.
+
+	SnapshotWriter snapshotWriter_;			//!< Writes snapshots while the simulation continues.
+	std::string snapshotPath_;				//!< Snapshot file. Empty: no snapshots.
+	unsigned int snapshotInterval_;			//!< Steps between two snapshots. 0: only after the run.
+	DeltaWriter deltaWriter_;				//!< Writes the delta checkpoints between the full snapshots.
+	unsigned int snapshotDeltas_;			//!< Delta checkpoints between two full snapshots. 0: only full snapshots.
+	Behaviour behaviour_;					//!< Fish behaviour. The cost model of the report only covers the classic searches.
+	TrajectoryRecorder* trajectory_;		//!< Writes the positions every few steps. Does nothing without config.trajectory.
+	EventLog* events_;						//!< Writes the fish events every GRID_UPDATE_INTERVAL steps. Does nothing without config.events.
+	PositionExport* export_;				//!< Publishes the positions every step. Does nothing without config.exportName.
+	GpuTelemetry* telemetry_;				//!< Clocks, power and energy of the run. Disabled without config.telemetry.
+
+	/*!
+	 * @brief Start writing a snapshot of the current state into snapshotPath_.
+	 * @param delta true: a delta checkpoint, unless the chain needs a full snapshot or already has snapshotDeltas_ checkpoints.
+	 */
+	void writeSnapshot( bool delta = false );
+
+public:
+
+	/*!
+	 * @brief Constructor. 
+	 * Initialize Waypoints and allocate particles on the GPU.
+	 * The particles are spawned, or loaded from config.restore. A snapshot replaces particles, sharks, parameters and seed of the config.
+	 * @param config Number of particles and sharks.
+	 */
+	HeadlessSimulation( const SwarmConfig& config );
+
+	/*!
+	 * @brief Calculate one simulation step.
+	 */
+	void step();
+
+	/*!
+	 * @brief Calculate the given number of steps and print the throughput.
+	 * @param steps number of steps.
+	 */
+	void run( unsigned int steps );
+
+	/*!
+	 * @brief Free Memory on GPU. Waits for the last snapshot.
+	 */
+	void cleanUp();
+};
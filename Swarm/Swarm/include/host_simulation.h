@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+#include "vec3.h"
+
+/*
+ * Host side parts of the simulation. Used by the renderer and the headless simulation.
+ */
+
+static const float SWARM_SPEED = 0.9f;	//!< Default distance a fish swims per simulated second (SwarmConfig::swarmSpeed). speed per step is swarmSpeed * dt.
+static const float SPAWN_BOX = 5.0f;	//!< Default spawn box [-SPAWN_BOX, SPAWN_BOX]^3 (SwarmConfig::spawnMin and spawnMax).
+
+/*!
+ * @brief Creates a random float value between a and b.
+ * @param a first barrier.
+ * @param b second barrier.
+ * @return random float value.
+*/
+float randf( float a, float b );
+
+/*!
+ * @brief Default waypoints the swarm center follows (SwarmConfig::waypoints).
+ * @return waypoints.
+ */
+std::vector<Vector3> swarmWaypoints();
+
+/*!
+ * @brief Routes of several schools for kernel_set_schools. School 0 follows route,
+ * the others the same route turned around the y axis.
+ * @param route waypoints of the swarm, e.g. SwarmConfig::waypoints.
+ * @param schools number of schools. 0 counts as 1.
+ * @return waypoints per school.
+ */
+std::vector<std::vector<Vector3>> schoolWaypoints( const std::vector<Vector3>& route, unsigned int schools );
+
+/*!
+ * @brief Spawn fishies at random positions in the spawn box.
+ * @param count number of fishies.
+ * @param data Output: positions (x, y, z, w) per fish.
+ * @param state Output: speed (x, y, z) and random mass (w) per fish.
+ * @param boxMin lower corner of the spawn box.
+ * @param boxMax upper corner of the spawn box.
+ */
+void spawnFish( unsigned int count, std::vector<float>& data, std::vector<float>& state,
+	const Vector3& boxMin = Vector3( -SPAWN_BOX, -SPAWN_BOX, -SPAWN_BOX ), const Vector3& boxMax = Vector3( SPAWN_BOX, SPAWN_BOX, SPAWN_BOX ) );
+
+/*!
+ * @brief Spawn sharks on the upper z face of the spawn box. The first shark starts in the corner.
+ * @param count number of sharks.
+ * @param data Output: positions (x, y, z, w) per shark.
+ * @param state Output: speed (x, y, z) and mass (w) per shark.
+ * @param boxMin lower corner of the spawn box.
+ * @param boxMax upper corner of the spawn box.
+ */
+void spawnSharks( unsigned int count, std::vector<float>& data, std::vector<float>& state,
+	const Vector3& boxMin = Vector3( -SPAWN_BOX, -SPAWN_BOX, -SPAWN_BOX ), const Vector3& boxMax = Vector3( SPAWN_BOX, SPAWN_BOX, SPAWN_BOX ) );
+
+/*!
+ * @brief Random shades of orange for the fishies.
+ * @param count number of fishies.
+ * @param color_data Output: color (r, g, b, a) per fish, 8 bit each (RGBA8).
+ */
+void spawnColors( unsigned int count, std::vector<unsigned char>& color_data );
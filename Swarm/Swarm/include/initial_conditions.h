@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+
+#include "cuda_host_array.h"
+#include "particle_store.h"
+
+/*
+ * Initial condition file, e.g. written by an offline tool from survey data: InitialHeader, then the columns anywhere in the
+ * file at the offsets of the header, like the buffers of an Arrow record batch. Every column holds count floats in the byte
+ * order of the reading machine, at a multiple of 4 bytes. x, y and z are needed; vx, vy, vz and mass may be missing
+ * (offset 0), those keep the values of kernel_spawn: no speed and a random mass.
+ */
+
+static const char INITIAL_MAGIC[8] = { 'S', 'W', 'A', 'R', 'M', 'I', 'N', 'I' };
+static const unsigned int INITIAL_VERSION = 1;
+static const unsigned int INITIAL_COLUMNS = 7;	//!< x, y, z, vx, vy, vz, mass.
+
+/*!
+ * @brief Header of an initial condition file.
+ */
+struct InitialHeader
+{
+	char magic[8];							//!< INITIAL_MAGIC.
+	unsigned int version;					//!< INITIAL_VERSION.
+	unsigned int headerSize;				//!< sizeof( InitialHeader ) of the writer.
+	unsigned long long count;				//!< Number of fishies.
+	unsigned long long offsets[INITIAL_COLUMNS];	//!< Byte offset of the columns x, y, z, vx, vy, vz, mass. 0: no column.
+};
+
+/*!
+ * @brief InitialConditionFile maps an initial condition file into memory and streams its columns to the GPU.
+ * Nothing is parsed: chunks of a column are copied from the mapping into one of two pinned slots, which reads them from disk,
+ * while the slot before goes to the device asynchronously. The kernel reads ahead in the mapping (sequential access), so the
+ * load runs at the speed of the disk.
+ */
+class InitialConditionFile
+{
+private:
+
+	static const size_t CHUNK = 1 << 20;		//!< Floats per chunk and slot, 4 MB.
+	static const unsigned int SLOTS = 2;		//!< Pinned slots: one filled from the mapping, one copied to the device.
+
+	const char* data_ = NULL;				//!< Mapped file.
+	size_t size_ = 0;						//!< Size of the file.
+	void* file_ = NULL;						//!< File and mapping handles (Windows).
+	void* mapping_ = NULL;
+
+	/*!
+	 * @brief Unmap the file.
+	 */
+	void close();
+
+public:
+
+	InitialConditionFile() = default;
+
+	/*!
+	 * @brief Destructor. Unmaps the file.
+	 */
+	~InitialConditionFile();
+
+	InitialConditionFile( const InitialConditionFile& ) = delete;
+	InitialConditionFile& operator=( const InitialConditionFile& ) = delete;
+
+	/*!
+	 * @brief Map a file and check the header and the column offsets.
+	 * @param path path of the file.
+	 * @return true, if the file is a valid initial condition file with at least one fish.
+	 */
+	bool open( const std::string& path );
+
+	/*!
+	 * @brief Get the header. Only valid after open.
+	 * @return header.
+	 */
+	inline const InitialHeader& getHeader() const { return *reinterpret_cast< const InitialHeader* >( data_ ); }
+
+	/*!
+	 * @brief Get the number of fishies of the file. Only valid after open.
+	 * @return number of fishies.
+	 */
+	inline unsigned int getCount() const { return static_cast< unsigned int >( getHeader().count ); }
+
+	/*!
+	 * @brief Stream the columns of the file into a store, chunk by chunk through the pinned slots. Returns after the copies
+	 * are done. Columns the file doesn't have are left as they are, e.g. spawned by kernel_spawn before.
+	 * @param particles store with at least getCount slots.
+	 * @param stream stream of the copies.
+	 * @return bytes copied.
+	 */
+	size_t upload( ParticleStore& particles, cudaStream_t stream );
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "cuda_device.h"
+#include "cuda_device_array.h"
+#include "swarm_config.h"
+
+/*!
+ * @brief Ways to move the positions of a frame from CUDA into a buffer OpenGL draws.
+ */
+enum class InteropStrategy
+{
+	REGISTERED,		//!< Registered VBO, mapped and unmapped every frame (the packed points of the Renderer).
+	PBO,			//!< cudaMemcpy into a mapped pixel buffer, then glCopyBufferSubData into the VBO. No CUDA interop.
+	SSBO,			//!< Storage buffer registered once and held mapped, released only around the draw (the pulled stores).
+	VULKAN			//!< Vulkan external memory imported into both APIs, ordered by semaphores (VulkanInterop).
+};
+
+/*!
+ * @brief Get the name of a strategy.
+ * @param strategy interop strategy.
+ * @return name, e.g. "registered".
+ */
+const char* interopStrategyName( InteropStrategy strategy );
+
+/*!
+ * @brief Mean cost of one strategy at one size.
+ */
+struct InteropResult
+{
+	InteropStrategy strategy;				//!< Strategy.
+	unsigned int particles;					//!< Positions (float4) per frame.
+	double transferMs;						//!< GPU time of the copy (CUDA events around it).
+	double syncMs;							//!< Host time of the map, unmap, acquire and release calls.
+	double frameMs;							//!< Host time of the whole frame: write, sync, a draw read and glFinish.
+};
+
+/*!
+ * @brief InteropBenchmark moves N positions per frame from a CUDA array into an OpenGL buffer through every InteropStrategy
+ * and times the transfer and the synchronisation, for N from MIN_PARTICLES up to SwarmConfig::numParticles (x4 a size).
+ * Every frame OpenGL reads the last position of the buffer, so the frame waits for the write like a draw does.
+ * Vulkan is skipped if VulkanInterop can't be created. Needs the current OpenGL context of the window (--interop_bench).
+ */
+class InteropBenchmark
+{
+private:
+
+	static const unsigned int MIN_PARTICLES = 1 << 16;	//!< Smallest size.
+	static const unsigned int WARMUP = 10;	//!< Untimed frames per strategy and size.
+	static const unsigned int FRAMES = 100;	//!< Timed frames per strategy and size.
+
+	CudaDevice device_;						//!< GPU of the window, registers the buffers.
+	cudaStream_t stream_;					//!< Stream of the copies.
+	std::vector<unsigned int> sizes_;		//!< Particles per frame of the runs.
+	std::vector<InteropResult> results_;	//!< Results of run, by size and strategy.
+
+	/*!
+	 * @brief Time one strategy at one size.
+	 * @param strategy interop strategy.
+	 * @param source positions on the device.
+	 * @param particles positions per frame.
+	 * @param result Output: mean cost.
+	 * @return false, if the strategy is not available.
+	 */
+	bool measure( InteropStrategy strategy, const CudaDeviceArray<float4>& source, unsigned int particles, InteropResult& result );
+
+public:
+
+	/*!
+	 * @brief Constructor. Creates the stream and the sizes.
+	 * @param config configuration, numParticles is the largest size.
+	 */
+	explicit InteropBenchmark( const SwarmConfig& config );
+
+	/*!
+	 * @brief Destructor. Destroys the stream.
+	 */
+	~InteropBenchmark();
+
+	InteropBenchmark( const InteropBenchmark& ) = delete;
+	InteropBenchmark& operator=( const InteropBenchmark& ) = delete;
+
+	/*!
+	 * @brief Run all strategies at all sizes.
+	 */
+	void run();
+
+	/*!
+	 * @brief Print the results as a table, one row per size and strategy.
+	 * @param os stream.
+	 */
+	void report( std::ostream& os ) const;
+
+	/*!
+	 * @brief Write the results as JSON.
+	 * @param path file.
+	 * @return false, if the file can't be written.
+	 */
+	bool writeJson( const std::string& path ) const;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * @brief JobSystem runs small CPU jobs on worker threads while the main thread keeps launching GPU work.
+ * A job can depend on other jobs, it starts after all of them are done. The jobs of a frame form a task graph:
+ * the renderer submits them after the launches and only waits for the jobs the next frame reads.
+ */
+class JobSystem
+{
+private:
+
+	/*!
+	 * @brief One job of the graph.
+	 */
+	struct Job
+	{
+		std::function<void()> task;				//!< Work of the job.
+		unsigned int pending = 0;				//!< Dependencies which are not done yet.
+		std::vector<std::shared_ptr<Job>> dependents;	//!< Jobs which wait for this one.
+		bool done = false;						//!< Task ran.
+	};
+
+public:
+
+	typedef std::shared_ptr<Job> Handle;		//!< Submitted job. Empty handles count as done.
+
+private:
+
+	std::vector<std::thread> workers_;		//!< Worker threads.
+	std::mutex mutex_;						//!< Guards the queue, the jobs and stop_.
+	std::condition_variable wakeUp_;		//!< Signals a ready job or the stop.
+	std::condition_variable finished_;		//!< Signals a finished job.
+	std::vector<Handle> ready_;				//!< Jobs without pending dependencies, oldest first. Few, a vector doesn't allocate per job like a deque.
+	std::vector<Handle> running_;			//!< Submitted jobs which are not done yet, for waitAll.
+	std::vector<Handle> spare_;				//!< Done jobs, reused by submit once nobody holds them, so a frame doesn't allocate.
+	bool stop_ = false;						//!< Workers return.
+
+	static const size_t MAX_SPARE_JOBS = 16;	//!< Done jobs kept for reuse.
+
+	/*!
+	 * @brief Run a ready job and release its dependents. Called without lock.
+	 * @param job job taken from ready_.
+	 */
+	void execute( const Handle& job );
+
+	/*!
+	 * @brief Worker thread: run ready jobs until stop_ is set.
+	 */
+	void work();
+
+public:
+
+	/*!
+	 * @brief Constructor. Starts the workers.
+	 * @param threads number of worker threads. 0: one per hardware thread except the main thread, at least one.
+	 */
+	explicit JobSystem( unsigned int threads = 0 );
+
+	/*!
+	 * @brief Destructor. Runs the remaining jobs and joins the workers.
+	 */
+	~JobSystem();
+
+	JobSystem( const JobSystem& ) = delete;
+	JobSystem& operator=( const JobSystem& ) = delete;
+
+	/*!
+	 * @brief Submit a job.
+	 * @param task work of the job. Must not touch OpenGL or the data of the main thread without waiting for the job.
+	 * @param dependencies jobs which have to be done before. Empty handles are ignored.
+	 * @return handle to wait for.
+	 */
+	Handle submit( std::function<void()> task, const std::vector<Handle>& dependencies = std::vector<Handle>() );
+
+	/*!
+	 * @brief Wait until a job is done. Runs ready jobs meanwhile.
+	 * @param job handle of submit. Empty: returns at once.
+	 */
+	void wait( const Handle& job );
+
+	/*!
+	 * @brief Wait until all submitted jobs are done.
+	 */
+	void waitAll();
+
+	/*!
+	 * @brief Check a job without waiting.
+	 * @param job handle of submit.
+	 * @return true, if the job is done or the handle is empty.
+	 */
+	bool isDone( const Handle& job );
+};
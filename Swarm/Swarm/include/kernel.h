@@ -1,28 +1,1312 @@
 #pragma once
+#include <ostream>
+#include <vector>
+
+#include <cuda_fp16.h>
+
 #include "vec3.h"
-#include "renderer.h"
+#include "obstacles.h"
+#include "attractors.h"
+#include "alarm_field.h"
+#include "current_field.h"
+#include "scenario_timeline.h"
+#include "particle_store.h"
+#include "swarm_stats.h"
+#include "swarm_event.h"
+#include "swarm_ensemble.h"
 
 using namespace std;
 
 /*!
  * @brief Call Kernel to calculate new positions.
- * @param verts Vertices
- * @param states States of particles
+ * Reads from the input store and writes to the output store (ping-pong), so the input is never modified.
+ * @param in Particles of the last step
+ * @param out Output: Particles of the new step
  * @param mesh_count Number of particles
  * @param speed speed of particles
  * @param swarmCenter swarm center
- * @param shark shark position
+ * @param sharks shark positions (device memory). Copied to constant memory for small numbers of sharks.
+ * @param shark_count number of sharks
+ * @param stream stream for all kernels of the step
 */
 void kernel_advance(
-    float4* verts,
-    float4* states,
+    ParticleArrays in,
+    ParticleArrays out,
     unsigned int mesh_count,
     float speed,
     Vector3 swarmCenter,
-    Vector3 shark);
+    const float4* sharks,
+    unsigned int shark_count,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Push overlapping fishies apart after kernel_advance (kernel_set_collisions), position based: the grid is built over the new
+ * positions, then every iteration computes the correction of each fish from the overlaps in the 27 cells around it into a delta buffer
+ * (Jacobi, no atomics) and applies it. Costs a grid build and two launches per iteration. Only the positions change.
+ * @param particles Particles of the new step (the out store of kernel_advance). Will be updated.
+ * @param mesh_count Number of particles
+ * @param stream stream of the step
+*/
+void kernel_resolve_collisions(ParticleArrays particles, unsigned int mesh_count, cudaStream_t stream = 0);
+
+/*!
+ * @brief Upload the layout and the parameter table of an ensemble (see kernel_advance_ensemble).
+ * Only valid after kernel_init_grid with the total number of fishies.
+ * @param ensemble members. Without members kernel_advance_ensemble does nothing.
+*/
+void kernel_set_ensemble(const SwarmEnsemble& ensemble);
+
+/*!
+ * @brief Advance all members of the ensemble with one launch. Every member is an independent swarm with its own parameters:
+ * its fishies only see each other and the sharks of the member (tiled all-pairs search over the member).
+ * Classic behaviour with a single school, no evasion split, Verlet lists or grid. Obstacles and current apply to all members.
+ * @param in Particles of the last step, members at their offsets
+ * @param out Output: Particles of the new step
+ * @param speed speed of particles
+ * @param swarmCenter swarm center, the same for all members
+ * @param sharks shark positions (device memory), SwarmEnsemble::sharksPerMember per member. Move them with kernel_move_sharks.
+ * @param stream stream for all kernels of the step
+*/
+void kernel_advance_ensemble(
+    ParticleArrays in,
+    ParticleArrays out,
+    float speed,
+    Vector3 swarmCenter,
+    const float4* sharks,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Summarize every member of the ensemble on the GPU: survival, centroid, cohesion, speed and the distances to the closest fish.
+ * Two reduction passes, the result is copied asynchronously. Synchronize the stream before reading it.
+ * @param particles Particles of the ensemble, members at their offsets
+ * @param metrics Output: one summary per member (host memory, pinned for an asynchronous copy)
+ * @param stream stream for the kernels and the copy
+*/
+void kernel_ensemble_metrics(
+    ParticleArrays particles,
+    EnsembleMetrics* metrics,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Theoretical occupancy of the advance kernel kernel_advance uses with the current behaviour and search mode.
+ * Only valid after kernel_init_grid.
+ * @param mesh_count Number of fishies.
+ * @param properties Properties of the device (CudaDevice::getProperties).
+ * @return resident warps per multiprocessor relative to the maximum, in [0, 1].
+*/
+float kernel_occupancy(unsigned int mesh_count, const cudaDeviceProp& properties);
+
+/*!
+ * @brief Print registers, local memory (spills), shared memory and theoretical occupancy of every advance kernel variant
+ * and the other large kernels with their launch configurations. For the logs when tuning block sizes on another GPU.
+ * Only valid after kernel_init_grid.
+ * @param os output stream.
+ * @param mesh_count Number of fishies.
+ * @param properties Properties of the device (CudaDevice::getProperties).
+*/
+void kernel_print_resources(std::ostream& os, unsigned int mesh_count, const cudaDeviceProp& properties);
+
+/*!
+ * @brief Check whether the kernels run from SASS of the build or were JIT compiled from PTX by the driver, and print it.
+ * A JIT compiled kernel reports the architecture of the device as binary version, but the older one of its PTX.
+ * Needs the CodeGeneration pairs compute_XX,sm_XX of the project files with the same XX.
+ * @param os output stream.
+ * @param properties Properties of the device (CudaDevice::getProperties).
+ * @return true, if the driver compiled the PTX (a new GPU without SASS in the build).
+*/
+bool kernel_check_binary(std::ostream& os, const cudaDeviceProp& properties);
+
+/*!
+ * @brief Set the behaviour parameters. They are uploaded to constant memory before the next step, only if they changed.
+ * Can be called at any time to tune the simulation live.
+ * @param params new parameters.
+*/
+void kernel_set_params(const SwarmParams& params);
+
+/*!
+ * @brief Get the current behaviour parameters.
+ * @return parameters.
+*/
+SwarmParams kernel_get_params();
+
+/*!
+ * @brief Set the routes of the schools. They are copied to constant memory before the next step, like the parameters.
+ * Fish i belongs to school id % schools. With more than one school every school center follows its own route on the GPU
+ * (all schools in one launch of kernel_advance) and the swarmCenter of kernel_advance is ignored.
+ * Up to 64 schools and 256 waypoints of all routes together, the rest is dropped.
+ * On spline paths the centers follow a closed centripetal Catmull-Rom spline through the waypoints instead of straight lines with sharp
+ * turns. An arc length table per route is built here and kept on the device, so d_moveSchools finds the center at the distance travelled
+ * in constant time. Then also a single school moves on the GPU and the swarmCenter is ignored, the steps need nothing from the host.
+ * @param routes waypoints per school, e.g. schoolWaypoints(). A single route: all fishies follow the swarmCenter, unless spline.
+ * @param spline true: spline paths, false: straight lines between the waypoints.
+*/
+void kernel_set_schools(const std::vector<std::vector<Vector3>>& routes, bool spline);
+
+/*!
+ * @brief Set the species of the fishies. The table is copied to constant memory before the next step, like the parameters, and the advance
+ * kernels look up speed, perception, fear and mass range of every fish in it. The species follows from the stable id by a hash, the shares
+ * decide how many fishies belong to each species. Only with more than one species the kernels take the variants which read the table,
+ * a single species costs nothing. Up to MAX_SPECIES species, the rest is dropped.
+ * @param species traits per species. Empty or a single one with factors 1: all fishies alike (default).
+*/
+void kernel_set_species(const std::vector<SpeciesParams>& species);
+
+/*!
+ * @brief Set the distance field of the static obstacles. It is copied into a 3D texture with trilinear filtering before the next step,
+ * like the parameters. Fishies closer than range to an obstacle are pushed along the gradient of the field, one texture fetch per fish
+ * and step, in all advance kernels. The texels hold the gradient next to the distance, so the fetch gives both.
+ * @param volume distance field, e.g. bakeObstacles(). Empty: no obstacles (default).
+ * @param range fishies closer than this are pushed away. The push grows linearly to the surface.
+*/
+void kernel_set_obstacles(const ObstacleVolume& volume, float range);
+
+/*!
+ * @brief Set the attractors and repulsors (food patches, lures). They are copied into a device array and their summed field is baked
+ * into a 3D texture on the GPU before the next step, in every context, like the parameters. A fish pays one trilinear fetch per step
+ * for any number of attractors, in all advance kernels; only the bake loops over them. Call again whenever they change.
+ * @param volume attractors and the grid of their field, e.g. placeAttractors(). Empty: no attractors (default).
+*/
+void kernel_set_attractors(const AttractorVolume& volume);
+
+/*!
+ * @brief Set the alarm field. Fishies which evade a shark deposit alarm into their cell of a coarse grid; before every step one small
+ * kernel over the cells spreads it to the neighbour cells and lets it decay, and the other fishies swim down its gradient. So the alarm
+ * runs through the school in waves, for the cost of a grid sized stencil instead of another neighbour pass. In all advance kernels
+ * except the substeps. The field is allocated per context before the next step, like the parameters, and starts quiet.
+ * @param field grid and rates, e.g. placeAlarm(). Empty (deposit 0): no alarm (default).
+*/
+void kernel_set_alarm(const AlarmField& field);
+
+/*!
+ * @brief Set the current of the water. Fishies drift with the velocity of the current at their position, sampled from half precision
+ * 3D textures with trilinear filtering and blended between two time slices, in all advance kernels.
+ * Three slices are on the device: the two blended ones and the next one, which is generated (curl noise) or copied from pinned memory
+ * on a side stream meanwhile. The steps only wait for it on the GPU, a new slice never stalls the simulation.
+ * @param volume current, e.g. loadCurrent(). Width 0: still water (default).
+ * @param strength distance per step a fish drifts at a velocity of 1.
+ * @param period steps between two time slices, at least the steps of one graph (16).
+*/
+void kernel_set_current(const CurrentVolume& volume, float strength, unsigned int period);
+
+/*!
+ * @brief Set the scenario timeline. The events stay on the device: a small launch per step applies the due ones to the parameters,
+ * the swarm center, the current and the emitter, and kernel_move_sharks parks and wakes the sharks. No host call per event,
+ * so captured graphs replay the timeline. Steps with a timeline don't run as substeps or with the runtime compiled advance.
+ * @param events events sorted by step, e.g. loadTimeline(), at most MAX_TIMELINE_EVENTS. Empty: no timeline (default).
+*/
+void kernel_set_timeline(const std::vector<TimelineEvent>& events);
+
+/*!
+ * @brief Set the far field: long range cohesion and alignment of the whole swarm, in addition to the short range neighbour search.
+ * kernel_advance builds a linear BVH over the fishies every step (Karras, from their Morton codes) with mass, center and
+ * speed per node, and every flocking fish walks it Barnes-Hut style: O(N log N) instead of all pairs.
+ * With the far field the steps are neither captured as graph nor run as substeps, the sort of the tree waits for the host.
+ * @param cohesion pull to the mass of the far fishies, relative to the acceleration of a fish. 0: none (default).
+ * @param alignment share of the mean speed vector of the far fishies steered to per step. 0: none (default).
+ * @param theta opening angle: a node counts as a whole if its longest edge is below theta * distance. 0: exact.
+*/
+void kernel_set_far_field(float cohesion, float alignment, float theta);
+
+/*!
+ * @brief Get the number of schools of kernel_set_schools.
+ * @return number of schools, 0 before kernel_set_schools.
+*/
+unsigned int kernel_get_schools();
+
+/*!
+ * @brief Set the seed of the GPU random numbers (jitter, respawn) and restart the step counter.
+ * The same seed and config give the same random numbers.
+ * @param seed seed.
+*/
+void kernel_set_seed(unsigned long long seed);
+
+/*!
+ * @brief Set the box the emitter respawns fishies in (kernel_respawn). Should be the box of spawnFish.
+ * @param boxMin lower corner.
+ * @param boxMax upper corner.
+*/
+void kernel_set_spawn_box(const Vector3& boxMin, const Vector3& boxMax);
+
+/*!
+ * @brief Get the step counter of the GPU random numbers. Counts kernel_advance calls since kernel_set_seed.
+ * @return step counter.
+*/
+unsigned int kernel_get_random_step();
+
+/*!
+ * @brief Set the step counter of the GPU random numbers, e.g. to run a step again with the same random numbers.
+ * The next kernel_advance uses step + 1.
+ * @param step step counter.
+*/
+void kernel_set_random_step(unsigned int step);
+
+/*!
+ * @brief Select the fish behaviour of kernel_advance.
+ * @param behaviour CLASSIC: closest fish and swarm center. BOIDS: separation, alignment and cohesion on the uniform grid.
+*/
+void kernel_set_behaviour(Behaviour behaviour);
+
+/*!
+ * @brief Approximate the boids neighbourhood with the mean speed vector and centroid of the 27 cells around a fish.
+ * One pass over the sorted grid computes the means per cell, the advance reads 27 cells instead of every neighbour,
+ * so a step costs about the grid build however dense the school is. Separation sees the cells, not single fishies.
+ * @param enabled true: mean field. false: every neighbour inside the radius.
+*/
+void kernel_set_mean_field(bool enabled);
+
+/*!
+ * @brief Enable the hard collisions of kernel_resolve_collisions. Without them fishies only steer away from their closest neighbour
+ * and can pass through each other. The radius is taken at most as the grid cell size, so the 27 cells hold all contacts.
+ * @param radius distance of two fish centers at contact. 0: off (default).
+ * @param iterations Jacobi iterations per step. 0: off.
+*/
+void kernel_set_collisions(float radius, unsigned int iterations);
+
+/*!
+ * @brief Select the neighbour search of kernel_advance.
+ * @param mode AUTO: tiled search for small swarms, uniform grid for large ones.
+ * VERLET: candidate lists within fishDist + verletSkin, rebuilt when a fish moved more than verletSkin / 2.
+*/
+void kernel_set_search_mode(SearchMode mode);
+
+/*!
+ * @brief Get the neighbour search kernel_advance runs with the classic behaviour.
+ * @param mesh_count Number of fishies.
+ * @return search of kernel_set_search_mode with AUTO, the tensor fallback and the deterministic mode resolved.
+*/
+SearchMode kernel_get_search_mode(unsigned int mesh_count);
+
+/*!
+ * @brief Settings of kernel_advance which only change the speed, not the results. Found by timing trials (Autotuner).
+ */
+struct KernelTuning
+{
+    unsigned int searchThreads = 0;     //!< Block size of the search kernels, also the tile of the tiled search. 0: highest occupancy.
+    float cellScale = 1.0f;             //!< Edge length of a grid cell relative to fishDist, at least 1.
+};
+
+/*!
+ * @brief Set the tuned settings of kernel_advance. Shared by all contexts, like the search mode.
+ * @param tuning block size and cell size. The block size is limited per kernel (LaunchConfig::maxThreads).
+*/
+void kernel_set_tuning(const KernelTuning& tuning);
+
+/*!
+ * @brief Get the tuned settings of kernel_advance.
+ * @return settings of the last kernel_set_tuning.
+*/
+KernelTuning kernel_get_tuning();
+
+/*!
+ * @brief Set semantics of the neighbour query.
+ * @param firstK 0: every fish avoids its closest neighbour.
+ *				 k > 0: the search stops after k fishies inside the avoid distance and takes the closest of the fishies seen so far.
+*/
+void kernel_set_first_k(unsigned int firstK);
+
+/*!
+ * @brief Let the grid search read 16 bit positions relative to the cells instead of float positions.
+ * The grid build writes one 8 byte copy per fish, the search loads it instead of three floats per candidate.
+ * The positions are stored as floats either way; the resolution of the search is cellSize / 65535.
+ * @param packed true: packed positions, false: float positions (default).
+*/
+void kernel_set_packed_positions(bool packed);
+
+/*!
+ * @brief Let the grid search build the grid and search in one cooperative launch: a counting sort into the cells and
+ * the search, separated by grid wide barriers (cooperative_groups::this_grid().sync()) instead of one launch per phase.
+ * Only on GPUs with cudaDevAttrCooperativeLaunch and outside of graph capture, else the grid is built by separate launches.
+ * The order of the fishies inside a cell depends on atomics, with firstK the fishies found first can differ.
+ * @param cooperative true: one launch, false: hash, sort, reorder and search launches (default).
+*/
+void kernel_set_cooperative_grid(bool cooperative);
+
+/*!
+ * @brief Start the grid search of every fish with the distance to its closest fish of the last step (temporal coherence).
+ * Cells further away than this bound are skipped, the closest fish found is kept for the next step. The result is the same.
+ * Not with firstK, which takes the fishies in the order they are found.
+ * @param warm true: bounded search (default), false: all 27 cells.
+*/
+void kernel_set_warm_start(bool warm);
+
+/*!
+ * @brief Set how the grid build sorts the fishies into the cells. The counting sort counts the fishies per cell with one
+ * atomic per cell and warp, scans the counts and scatters, the radix sort sorts the cell hashes. Deterministic mode
+ * always takes the radix sort, the counting sort orders the fishies inside a cell by the atomics.
+ * @param sort AUTO: counting sort up to 4 cells per fish (default), RADIX or COUNTING: always.
+*/
+void kernel_set_grid_sort(GridSort sort);
+
+/*!
+ * @brief Multi-rate steps of the grid search: fishies far from the sharks and from the focus (kernel_set_focus) are only
+ * advanced every interval steps and then move interval steps along their new speed vector; the others every step.
+ * A classification pass after the grid build sorts them into the two buckets, each bucket is its own launch.
+ * Fishies that wait are still neighbours of the others. Other searches, the boids and the substeps ignore it.
+ * @param interval steps between two advances of an unimportant fish. Up to 1: every fish every step (default).
+ * @param sharkRange fishies closer than sharkRange * sharkDist to a shark advance every step (default 3).
+ * @param focusRange fishies closer than this to the focus advance every step. 0: only the sharks count (default).
+*/
+void kernel_set_multi_rate(unsigned int interval, float sharkRange, float focusRange);
+
+/*!
+ * @brief Set the focus of the multi-rate steps, e.g. the camera position. Used from the next step on.
+ * @param focus position in the space of the fishies.
+*/
+void kernel_set_focus(Vector3 focus);
+
+/*!
+ * @brief Split the brute force step into two launches while sharks are around: the first one moves the evading
+ * and eaten fishies and lists the flocking ones, the second one runs the O(N) search only over the list.
+ * Warps don't wait for the search of single flocking lanes then. Results are the same as without the split.
+ * @param split true: two launches, false: one launch of d_advance (default).
+*/
+void kernel_set_evasion_split(bool split);
+
+/*!
+ * @brief Balance the grid search of clustered swarms, e.g. around a waypoint or during an attack: fishies with more candidates
+ * in their 27 cells are listed and searched by a whole warp each in a second launch, the others are advanced as usual.
+ * Warps don't wait for the few fishies of dense cells then. Results are the same, except with first k, which keeps one launch.
+ * @param candidates Fishies with more candidates go to the warps, e.g. 256. 0: one launch of d_advance_grid (default).
+*/
+void kernel_set_dense_cells(unsigned int candidates);
+
+/*!
+ * @brief Set the priority of the side streams of the kernels (the fills of the current slices), e.g.
+ * CudaDevice::getStreamPriority( StreamClass::BACKGROUND ). Applies to side streams created afterwards.
+ * @param priority stream priority, 0 (default): normal.
+*/
+void kernel_set_background_priority(int priority);
+
+/*!
+ * @brief Grid search over distributed shared memory on Hopper (compute capability 9.0): every block of a thread block cluster
+ * loads one cell into shared memory and the fishies of the cluster read the 8 cells of the cluster cube from there,
+ * the other 19 of their 27 cells from global memory. Same result as d_advance_grid, no warm start and no packed positions.
+ * Older GPUs and builds without sm_90 keep the usual grid search.
+ * @param cluster true: d_advance_cluster if the GPU has clusters. false: d_advance_grid (default).
+*/
+void kernel_set_cluster_search(bool cluster);
+
+/*!
+ * @brief Keep the cells of the grid in a hash table instead of wrapping them around: every grid build inserts the occupied
+ * cells into an open addressing table with linear probing, the searches look their 27 cells up there, a warp probes 32 slots
+ * at once. Schools far apart, e.g. on different waypoint loops, no longer share buckets, and the domain is unbounded
+ * (2^20 cells per axis around the grid). The table has twice as many slots as fishies, at most GRID_NUM_CELLS / 2.
+ * The cooperative grid, the cluster search and the runtime compiled advance keep the wrapped grid, so they are skipped.
+ * Call before kernel_init_grid, which allocates the table.
+ * @param hashed true: hashed cells, false: cells wrap around (default).
+*/
+void kernel_set_hash_grid(bool hashed);
+
+/*!
+ * @brief Keep the cell start and end tables of the grid search persisting in L2 (Ampere or newer): every fish reads them for
+ * its 27 cells, the stores stream through L2 once per step and would evict them. The window is set on the stream of the next
+ * kernel_advance and sized from persistingL2CacheMaxSize of the device. The parameters are in constant memory and have their own cache.
+ * @param persistent true: window over the tables, only if CudaDevice::supportsL2Persistence. false: no window (default).
+*/
+void kernel_set_l2_persistence(bool persistent);
+
+/*!
+ * @brief Get the access policy window of the cell tables of this context.
+ * @param bytes window size, 0 without window.
+ * @param hitRatio part of the window that persists.
+ * @return true, if a window is set.
+*/
+bool kernel_get_l2_window(size_t& bytes, float& hitRatio);
+
+/*!
+ * @brief Deterministic mode, to diff kernels and replay runs: positions and speed vectors are snapped to a 16.16 fixed-point
+ * lattice after every step, the search is brute force or grid (others fall back to the grid, without the cooperative launch),
+ * which visit the fishies in the order of their slots, the stats sum in an order that only depends on the number of fishies,
+ * and the emitter reuses the dead slots in ascending order. No graphs and no substeps.
+ * Launch configurations and autotuning don't change the result. Between GPU architectures the lattice absorbs most,
+ * but not all, differences of the float math.
+ * @param deterministic true: deterministic, false: fastest paths (default).
+*/
+void kernel_set_deterministic(bool deterministic);
+
+/*!
+ * @brief Runtime compiled kernels: kernel_init_grid compiles the grid advance of the classic behaviour with NVRTC for this GPU,
+ * with fish distance, shark distances, center threshold, acceleration, cell size and block size as literals (see RtcAdvance).
+ * Steps without optional features (jitter, schools, first k, packed positions, obstacles, current, far field, events,
+ * hunting sharks, multi-rate, cooperative launch, deterministic mode) take it instead of d_advance_grid.
+ * Rebuilt when the constants change. Without NVRTC (SWARM_NVRTC) or if the compile fails, d_advance_grid stays.
+ * @param rtc true: runtime compiled grid advance, false: the precompiled kernels only (default).
+*/
+void kernel_set_rtc(bool rtc);
+
+/*!
+ * @brief Set what the sharks hunt. With NEAREST and DENSEST each shark searches the grid of the last kernel_advance ring by ring
+ * around its cell, so the cost is independent of the number of fishies. The sharks bite then, not the fishies: a fish inside
+ * the bite distance is claimed with an atomic, two sharks can't eat the same one. Steps without grid (other search modes) use CENTER.
+ * With INTERCEPT one warp per shark weighs the cells around it by the mean speed vector, centroid and count of their fishies
+ * (d_cellMeans over the grid) and swims to the meeting point with the best one. No fish is read, the fishies bite themselves off.
+ * @param target target of the sharks (default CENTER).
+*/
+void kernel_set_shark_target(SharkTarget target);
+
+/*!
+ * @brief Set how the fishies and sharks move over a step. EULER and VERLET treat the steering of a step as acceleration, so the
+ * step can be longer than the base step 1 / simulationRate (kernel_set_step_scale). LEGACY is the original update, bit for bit.
+ * @param integrator integrator (default LEGACY). LEGACY resets the step scale to 1.
+*/
+void kernel_set_integrator(Integrator integrator);
+
+/*!
+ * @brief Set the length of the next steps in base steps, e.g. from SwarmStats::maxSpeed and a CFL number.
+ * Read with every kernel_advance, so captured graphs and substeps take it without a rebuild.
+ * @param scale step length / base step. Ignored (1) with Integrator::LEGACY or if not positive.
+*/
+void kernel_set_step_scale(float scale);
+
+/*!
+ * @brief Get the step length of kernel_set_step_scale.
+ * @return step length / base step.
+*/
+float kernel_get_step_scale();
+
+/*!
+ * @brief Identifies the steps recorded into a CUDA graph. A graph is only valid for the same key.
+ */
+struct CaptureKey
+{
+	const void* first;			//!< Any pointer of the particle store the first step reads, e.g. ParticleArrays::x.
+	unsigned int count;			//!< Number of fishies.
+	unsigned int steps;			//!< Number of steps.
+};
+
+/*!
+ * @brief Check if the steps can be recorded into a CUDA graph with the current settings.
+ * Only the searches without host decisions or synchronisation per step can be captured (brute force, tiled, warp).
+ * @param mesh_count Number of fishies.
+ * @param steps Number of steps per graph.
+ * @return true, if kernel_begin_capture can be used.
+*/
+bool kernel_can_capture(unsigned int mesh_count, unsigned int steps);
+
+/*!
+ * @brief Check if the steps can run as one kernel_advance_substeps launch: classic behaviour with one school, sharks that
+ * follow the swarm center, still water, no event log, and the swarm fits into the shared memory of one block.
+ * @param mesh_count Number of fishies.
+ * @param shark_count Number of sharks.
+ * @param steps Number of steps, at most 32.
+ * @return true, if kernel_advance_substeps can be used.
+*/
+bool kernel_can_substep(unsigned int mesh_count, unsigned int shark_count, unsigned int steps);
+
+/*!
+ * @brief Advance fishies and sharks by several steps in one launch of a single block, which keeps the swarm in shared memory.
+ * Same behaviour as the same number of kernel_advance and kernel_move_sharks calls with a brute force search, without respawn.
+ * Only for the kernel_can_substep cases.
+ * @param in particles of the last step (read only).
+ * @param out Output: particles after the last step.
+ * @param mesh_count number of fishies.
+ * @param speed speed of particles per step.
+ * @param swarmCenters swarm center of every step.
+ * @param steps number of steps.
+ * @param sharks shark positions. Will be updated.
+ * @param sharkStates shark forces and masses. Will be updated.
+ * @param shark_count number of sharks.
+ * @param stream stream for all kernels and copies.
+*/
+void kernel_advance_substeps(ParticleArrays in, ParticleArrays out, unsigned int mesh_count, float speed, const Vector3* swarmCenters, unsigned int steps,
+	float4* sharks, float4* sharkStates, unsigned int shark_count, cudaStream_t stream = 0);
+
+/*!
+ * @brief Start recording the following kernel_advance, kernel_move_sharks and kernel_respawn calls into a CUDA graph.
+ * Nothing runs until kernel_launch_capture. Swarm center and random key are no graph parameters,
+ * they are set per replay with kernel_set_captured_step.
+ * @param stream stream of the steps.
+*/
+void kernel_begin_capture(cudaStream_t stream = 0);
+
+/*!
+ * @brief Stop recording and make the graph executable. Updates the last graph in place, if only parameters changed.
+ * @param key key of the recorded steps.
+ * @param stream stream of kernel_begin_capture.
+*/
+void kernel_end_capture(const CaptureKey& key, cudaStream_t stream = 0);
+
+/*!
+ * @brief Check if the last captured graph can be replayed. Changing behaviour, search mode or first k makes it stale.
+ * @param key key of the steps to run.
+ * @return true, if the graph was captured for key.
+*/
+bool kernel_has_capture(const CaptureKey& key);
+
+/*!
+ * @brief Set the inputs of one captured step before kernel_launch_capture. Must be called for every step, in order.
+ * Waits until the last replay has read its inputs.
+ * @param step index of the step in the graph.
+ * @param swarmCenter swarm center of the step.
+*/
+void kernel_set_captured_step(unsigned int step, Vector3 swarmCenter);
+
+/*!
+ * @brief Replay the last captured graph.
+ * @param stream stream for the graph.
+*/
+void kernel_launch_capture(cudaStream_t stream = 0);
+
+/*!
+ * @brief Call Kernel to move all sharks on the GPU. They follow the swarm center of the last kernel_advance.
+ * @param sharks shark positions (device memory). Will be updated.
+ * @param states shark speeds and masses (device memory). Will be updated.
+ * @param shark_count number of sharks
+ * @param speed speed of particles
+ * @param stream stream for the kernel
+*/
+void kernel_move_sharks(
+    float4* sharks,
+    float4* states,
+    unsigned int shark_count,
+    float speed,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Check if kernel_move_sharks hunts in the grid of the last kernel_advance. Then the sharks bite fishies of the step
+ * and have to run before later kernels on the fishies, e.g. kernel_respawn. Otherwise they only touch their own arrays.
+ * @return true, if the sharks read and write the fishies.
+*/
+bool kernel_sharks_hunt();
+
+static const unsigned int QUERY_MAX_K = 16;	//!< Most fishies per probe of kernel_query_nearest.
+
+/*!
+ * @brief Count the living fishies within a radius of every probe point. Runs in the grid of the last kernel_advance, if it
+ * built one (grid search or boids) and the slots haven't moved since (kernel_compact, kernel_reorder), else over all fishies.
+ * The distances are to the positions after the step; the grid allows for one cell of movement, so a fish which moved farther
+ * in one step may be missed.
+ * @param particles Fishies after the last step, e.g. SwarmSimulation::getParticles.
+ * @param mesh_count Number of fishies.
+ * @param probes Probe positions (x, y, z) on the device.
+ * @param probe_count Number of probes.
+ * @param radius Radius around every probe.
+ * @param counts Output: Fishies per probe, on the device or mapped.
+ * @param stream stream of the step, the query runs between two steps.
+*/
+void kernel_query_radius(
+    ParticleArrays particles,
+    unsigned int mesh_count,
+    const float4* probes,
+    unsigned int probe_count,
+    float radius,
+    unsigned int* counts,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Find the k nearest living fishies of every probe point. In the grid of the last kernel_advance like kernel_query_radius,
+ * ring by ring up to 8 rings; probes whose nearest aren't certain there (far from the swarm, sparse fishies) and all probes
+ * of steps without grid are answered by a pass over all fishies.
+ * @param particles Fishies after the last step, e.g. SwarmSimulation::getParticles.
+ * @param mesh_count Number of fishies.
+ * @param probes Probe positions (x, y, z) on the device.
+ * @param probe_count Number of probes.
+ * @param k Fishies per probe, at most QUERY_MAX_K.
+ * @param ids Output: Stable ids of the k nearest of probe i at i * k, closest first. Missing fishies: 0xffffffff.
+ * @param distances Output: Their distances at i * k. Missing fishies: FLT_MAX.
+ * @param fallback Scratch: probe_count + 1 values on the device.
+ * @param stream stream of the step, the query runs between two steps.
+*/
+void kernel_query_nearest(
+    ParticleArrays particles,
+    unsigned int mesh_count,
+    const float4* probes,
+    unsigned int probe_count,
+    unsigned int k,
+    unsigned int* ids,
+    float* distances,
+    unsigned int* fallback,
+    cudaStream_t stream = 0);
+
+static const unsigned int PICK_NONE = 0xffffffff;	//!< PickResult::id of a ray without fish.
+
+/*!
+ * @brief Fish hit by a pick ray, with its state after the last step.
+ */
+struct PickResult
+{
+	unsigned int id;			//!< Stable id of the fish. PICK_NONE: no living fish near the ray.
+	unsigned int slot;			//!< Slot of the fish in the store of the step.
+	float4 position;			//!< Position (x, y, z), mass in w.
+	float4 velocity;			//!< Speed vector (x, y, z), its length in w.
+	float depth;				//!< Distance from the ray origin to the fish along the ray.
+	float offset;				//!< Distance of the fish from the ray.
+};
+
+/*!
+ * @brief Find the living fish a ray hits first, e.g. under the mouse. A fish is hit, if it is within radius of the ray; the hit
+ * with the smallest depth wins. In the grid of the last kernel_advance (see kernel_query_radius) one warp walks the ray cell by
+ * cell through the grid box and tests the cells around it, so the cost is bounded by the cells the ray crosses, not the fishies.
+ * Stops one cell behind the first hit. Fishies outside of the grid box aren't found there. Steps without grid test all fishies.
+ * @param particles Fishies after the last step, e.g. SwarmSimulation::getParticles.
+ * @param mesh_count Number of fishies.
+ * @param origin Start of the ray in simulation coordinates.
+ * @param direction Direction of the ray, normalized.
+ * @param maxDepth Length of the ray.
+ * @param radius Distance from the ray a fish is hit at, at most the cell size.
+ * @param result Output: Hit fish, on the device or mapped (CudaMailbox::slot).
+ * @param stream stream of the step, the query runs between two steps.
+*/
+void kernel_pick(
+    ParticleArrays particles,
+    unsigned int mesh_count,
+    Vector3 origin,
+    Vector3 direction,
+    float maxDepth,
+    float radius,
+    PickResult* result,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Write the positions the renderer needs into the VBO. Dead particles get w = -1.
+ * @param particles Particles
+ * @param verts Output: Vertices
+ * @param directions Output: Direction of the velocity (x forward if the fish doesn't move), speed in w. For the fish meshes. NULL: not written.
+ * @param mesh_count Number of particles
+ * @param stream stream for the kernel
+*/
+void kernel_pack(
+    ParticleArrays particles,
+    float4* verts,
+    float4* directions,
+    unsigned int mesh_count,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Write the positions of the living fishies into a trajectory frame, ordered by stable id (see TrajectoryRecorder).
+ * Entries of dead fishies are NaN (float) or 0xFFFF (quantised).
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param stride Only every stride-th id is recorded.
+ * @param entries Number of recorded ids.
+ * @param bounds Bounding box on the device (kernel_get_stats_device), must be reduced before on the same stream.
+ * @param quantize true: 16 bit per coordinate relative to bounds, false: float.
+ * @param positions Output: x, then y, then z with entries values each.
+ * @param stream CUDA stream.
+*/
+void kernel_pack_trajectory(
+    ParticleArrays particles,
+    unsigned int mesh_count,
+    unsigned int stride,
+    unsigned int entries,
+    const SwarmStats* bounds,
+    bool quantize,
+    void* positions,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Unpack a trajectory frame (see TrajectoryRecorder) into a position buffer of the renderer, for the playback.
+ * Dead fishies get w = -1, so the point shader discards them.
+ * @param bounds Bounding box of the frame on the device, its first bytes. Used for the quantisation.
+ * @param positions Positions of the frame on the device: x, then y, then z with entries values each.
+ * @param entries Number of recorded ids.
+ * @param quantized true: 16 bit per coordinate relative to the bounding box of the frame, false: float.
+ * @param verts Output: entries positions (float4).
+ * @param stream CUDA stream.
+*/
+void kernel_unpack_trajectory(
+    const SwarmStats* bounds,
+    const void* positions,
+    unsigned int entries,
+    bool quantized,
+    float4* verts,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Replace the 16 bit positions of a trajectory frame by their difference to a key frame, or back (modulo 2^16, lossless).
+ * Fishies move little between the frames of a chunk, so the differences are small numbers which compress well.
+ * @param positions 16 bit positions of the frame, changed in place.
+ * @param key same positions of the key frame.
+ * @param count number of values (3 * entries).
+ * @param encode true: position - key, false: position + key.
+ * @param stream CUDA stream.
+*/
+void kernel_delta_trajectory(
+    unsigned short* positions,
+    const unsigned short* key,
+    size_t count,
+    bool encode,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Pointers and sizes of the chunks of a buffer for a batched nvCOMP compression (GpuCompressor).
+ * @param input buffer on the device.
+ * @param bytes size of the buffer.
+ * @param chunkSize bytes per chunk, the last one can be smaller.
+ * @param compressed output slots of the compressed chunks, stride bytes apart.
+ * @param stride bytes per output slot, a multiple of 8.
+ * @param inputPtrs Output: start of every chunk.
+ * @param inputBytes Output: size of every chunk.
+ * @param compressedPtrs Output: output slot of every chunk.
+ * @param count number of chunks.
+ * @param stream CUDA stream.
+*/
+void kernel_compression_batch(
+    const char* input,
+    size_t bytes,
+    size_t chunkSize,
+    char* compressed,
+    size_t stride,
+    const void** inputPtrs,
+    size_t* inputBytes,
+    void** compressedPtrs,
+    unsigned int count,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Gather the compressed chunks of a batch into one record at output + *offset and move *offset behind it.
+ * Record: record bytes, raw bytes, chunk count, compressed bytes per chunk (unsigned long long each), then the chunks,
+ * each at a multiple of 8. Only the compressed bytes are written, so output can be mapped pinned memory.
+ * @param compressedPtrs output slots of the compression, multiples of 8 apart.
+ * @param compressedBytes compressed size of every chunk.
+ * @param count number of chunks.
+ * @param rawBytes size before the compression.
+ * @param output buffer of the records, on the device or mapped.
+ * @param offset offset of the record in output, a multiple of 8, on the device or mapped. Advanced by the record size.
+ * @param destinations scratch, count entries.
+ * @param stream CUDA stream.
+*/
+void kernel_compression_gather(
+    const void* const* compressedPtrs,
+    const size_t* compressedBytes,
+    unsigned int count,
+    unsigned long long rawBytes,
+    char* output,
+    unsigned long long* offset,
+    unsigned long long* destinations,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Pointers and sizes of the chunks of a record of kernel_compression_gather for a batched nvCOMP decompression.
+ * @param record record on the device, at a multiple of 8.
+ * @param count number of chunks of the record.
+ * @param chunkSize bytes per chunk before the compression.
+ * @param output buffer of the decompressed data.
+ * @param bytes size of the decompressed data.
+ * @param compressedPtrs Output: start of every compressed chunk.
+ * @param compressedBytes Output: size of every compressed chunk.
+ * @param outputPtrs Output: destination of every chunk.
+ * @param outputBytes Output: decompressed size of every chunk.
+ * @param stream CUDA stream.
+*/
+void kernel_decompression_batch(
+    const char* record,
+    unsigned int count,
+    size_t chunkSize,
+    char* output,
+    size_t bytes,
+    const void** compressedPtrs,
+    size_t* compressedBytes,
+    void** outputPtrs,
+    size_t* outputBytes,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Stream compaction: copy the live fishies of in to the front of out, in their order.
+ * Dead fishies are dropped, so the following steps only have to handle the returned number.
+ * The ids of in are updated too, so both stores have the same ids.
+ * Blocks until the number of live fishies is known.
+ * @param in Particle arrays with dead fishies (read only).
+ * @param out Output: Live fishies. Must hold mesh_count fishies.
+ * @param mesh_count Number of fishies in in.
+ * @param stream stream for the compaction.
+ * @return number of live fishies in out.
+*/
+unsigned int kernel_compact(
+    ParticleArrays in,
+    ParticleArrays out,
+    unsigned int mesh_count,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Sort the fishies along a Morton curve (Z-curve) over the box of the uniform grid,
+ * so fishies close in space are close in memory. Dead fishies end up at the back.
+ * The ids move with the fishies, the ids of in are updated too, so both stores have the same ids.
+ * @param in Particles in the old order (read only, except the ids).
+ * @param out Output: Particles in the new order. Must hold mesh_count fishies.
+ * @param mesh_count Number of fishies.
+ * @param stream stream for all kernels.
+*/
+void kernel_reorder(
+    ParticleArrays in,
+    ParticleArrays out,
+    unsigned int mesh_count,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Lists of kernel_partition_slab.
+ */
+enum SlabList
+{
+	SLAB_KEEP = 0,				//!< Stays in the slab.
+	SLAB_TO_LOWER,				//!< Crossed the lower bound, migrates to the lower slab.
+	SLAB_TO_UPPER,				//!< Crossed the upper bound, migrates to the upper slab.
+	SLAB_HALO_LOWER,			//!< Stays, within halo of the lower bound: halo of the lower slab.
+	SLAB_HALO_UPPER,			//!< Stays, within halo of the upper bound: halo of the upper slab.
+	SLAB_HALO_SELF,				//!< Migrates, but within halo of the bounds: stays as halo of this slab.
+	SLAB_LIST_COUNT
+};
+
+/*!
+ * @brief Part of space simulated by one GPU: lower <= x < upper.
+ */
+struct SlabBounds
+{
+	float lower;				//!< Lower bound on the x axis. -FLT_MAX for the first slab.
+	float upper;				//!< Upper bound on the x axis. FLT_MAX for the last slab.
+	float halo;					//!< Width of the halo: fishies this close to a bound are copied to the neighbour slab.
+};
+
+/*!
+ * @brief Multi GPU: sort the living fishies of a slab into the SlabList lists after a step. Eaten fishies are dropped.
+ * The order in a list depends on the order of the atomic operations.
+ * @param particles Owned fishies of the slab (read only).
+ * @param mesh_count Number of owned fishies (not the halo).
+ * @param slab Bounds of the slab.
+ * @param lists Output: Slots, list l starts at l * capacity (SLAB_LIST_COUNT * capacity entries).
+ * @param capacity Length of a list. Fishies past it are counted, but not written.
+ * @param counts Output: Number of fishies per list (SLAB_LIST_COUNT entries, device memory).
+ * @param stream stream for the kernel.
+*/
+void kernel_partition_slab(
+    ParticleArrays particles,
+    unsigned int mesh_count,
+    SlabBounds slab,
+    unsigned int* lists,
+    unsigned int capacity,
+    unsigned int* counts,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Gather fishies including their ids: out[i] = in[indices[i]].
+ * @param in Fishies (read only).
+ * @param out Output: Gathered fishies, e.g. a ParticleArrays with offset (offsetParticles).
+ * @param indices Slots in in.
+ * @param count Number of fishies to gather.
+ * @param stream stream for the kernel.
+*/
+void kernel_gather(
+    ParticleArrays in,
+    ParticleArrays out,
+    const unsigned int* indices,
+    unsigned int count,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Write the colors of all fishies by slot, after kernel_compact or kernel_reorder moved them.
+ * @param ids Stable id of each fish (ParticleArrays::id).
+ * @param colors Colors (RGBA8) by id.
+ * @param out Output: Colors by slot, e.g. the mapped color VBO.
+ * @param mesh_count Number of fishies.
+ * @param schools 0: the colors by id. Otherwise one hue per school (id % schools), colors is not read.
+ * @param stream stream for the kernel.
+*/
+void kernel_pack_colors(
+    const unsigned int* ids,
+    const uchar4* colors,
+    uchar4* out,
+    unsigned int mesh_count,
+    unsigned int schools = 0,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Sort the fishies by view depth, farthest first for correct blending of the points, or closest first for opaque points,
+ * so the depth test rejects the hidden ones before they are shaded.
+ * Key-value radix sort on the GPU, the keys use the scratch of the uniform grid. Nothing is read back.
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param depthRow Row of the view * model matrix which gives the view space z: (m[0][2], m[1][2], m[2][2], m[3][2]) with glm.
+ * @param indices Output: Slots in draw order, e.g. the mapped index buffer of glDrawElements. Must hold mesh_count indices.
+ * @param stream stream for the kernels.
+ * @param frontToBack true: closest first, eaten fishies last. false: farthest first, eaten fishies first.
+*/
+void kernel_depth_sort(
+    ParticleArrays particles,
+    unsigned int mesh_count,
+    float4 depthRow,
+    unsigned int* indices,
+    cudaStream_t stream = 0,
+    bool frontToBack = false);
+
+static const unsigned int DENSITY_SIZE = 128;	//!< Texels per axis of the density map of kernel_density.
+
+/*!
+ * @brief Density map of the swarm: count the living fishies per texel of the x/z plane over the box of the uniform grid
+ * (kernel_set_grid_bounds), with atomics on the GPU. Optionally also writes one heat colored point per texel on the floor of the box.
+ * The counts stay on the GPU for the shark steering and analytics, e.g. as kernel parameter.
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param verts Output: DENSITY_SIZE * DENSITY_SIZE positions, w < 0 for empty texels. NULL: no points.
+ * @param colors Output: DENSITY_SIZE * DENSITY_SIZE heat colors (RGBA8). NULL: no points.
+ * @param stream stream for the kernels.
+ * @return device pointer to the counts (z * DENSITY_SIZE + x). Valid until the next call.
+*/
+const unsigned int* kernel_density(
+    ParticleArrays particles,
+    unsigned int mesh_count,
+    float4* verts = NULL,
+    uchar4* colors = NULL,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Append the positions of the fishies to their trails: ring buffers of length entries per fish id, x, y and z in
+ * separate half arrays with entry * fishies + id. The entry head is cleared first, so dead or compacted fishies get NaN there.
+ * A fish whose last entry is NaN or farther away than maxJump was (re)spawned, its whole trail starts at the new position.
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param x Output: x of the trails, e.g. a mapped VBO. length * fishies values, NaN (0xFFFF) before the first call.
+ * @param y Output: y of the trails.
+ * @param z Output: z of the trails.
+ * @param fishies Number of fish ids.
+ * @param length Entries per trail.
+ * @param head Entry written now, the one after the last call.
+ * @param maxJump Longer distances to the last entry are respawns.
+ * @param stream stream for the kernel.
+*/
+void kernel_append_trail(
+    ParticleArrays particles,
+    unsigned int mesh_count,
+    __half* x,
+    __half* y,
+    __half* z,
+    unsigned int fishies,
+    unsigned int length,
+    unsigned int head,
+    float maxJump,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Camera of the culling pass, in the model space of the fishies.
+ */
+struct CullParams
+{
+	float planes[6][4];			//!< Frustum planes (normal pointing inside, distance), normalized.
+	float eyeX, eyeY, eyeZ;		//!< Camera position.
+	float radius;				//!< A fish is visible, if its bounding sphere with this radius touches the frustum.
+	float lodDistance;			//!< Closer fishies are drawn as meshes, the others as points. 0: only points.
+	float clusterDistance;		//!< Farther fishies are aggregated into cluster impostors. 0: no clusters.
+	float clusterCellSize;		//!< Edge of a cluster cell at clusterDistance, doubled with every doubling of the distance.
+};
+
+static const unsigned int CULL_CLUSTER_SLOTS = 4096;	//!< Cluster cells per frame of kernel_cull, also the most cluster impostors.
+static const unsigned int CULL_MAX_SCHOOLS = 64;		//!< Schools with draw commands of their own in kernel_cull, as many as kernel_set_schools moves.
+
+/*!
+ * @brief Layout of a glDrawArraysIndirect command.
+ */
+struct DrawCommand
+{
+	unsigned int count;			//!< Vertices per instance.
+	unsigned int instanceCount;	//!< Number of instances.
+	unsigned int first;			//!< First vertex.
+	unsigned int baseInstance;	//!< Must be 0 before OpenGL 4.2.
+};
+
+/*!
+ * @brief Drop eaten fishies and fishies outside of the view frustum and compact the others into the VBOs.
+ * Every school (id % schools) owns a fixed range of the slots, as many as it has ids below capacity. Mesh fishies (closer than
+ * params.lodDistance) are written from the start of the range upwards, point fishies from its end downwards.
+ * commands[school] draws the meshes of a school (instanced, baseInstance at its range), commands[schools + school] its points,
+ * so a glMultiDrawArraysIndirect per tier draws all schools and nothing is read back to the host. One school: the whole buffer.
+ * With clusters, fishies beyond params.clusterDistance are summed up per cluster cell (count, centroid, spread, color) and
+ * commands[2 * schools] draws one impostor per cell instead, so far schools cost about their screen coverage, not their fishies.
+ * The cells grow with the distance like the levels of an octree. A fish whose cell no longer fits into the table stays a point.
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param colors Colors (RGBA8) by id.
+ * @param params Camera.
+ * @param verts Output: Positions of the visible fishies.
+ * @param directions Output: Unit velocity and speed of the mesh fishies, see kernel_pack. NULL: only points.
+ * @param out_colors Output: Colors of the visible fishies.
+ * @param capacity Slots of the output buffers. With more than one school all ids are below capacity.
+ * @param counts Scratch for 2 * schools + 1 counters on the device.
+ * @param commands Output: 2 * schools draw commands, e.g. the mapped indirect buffer.
+ * @param mesh_vertices Vertices of the fish mesh.
+ * @param schools Schools with commands of their own, 1 to CULL_MAX_SCHOOLS.
+ * @param clusters Output: Centroid (x, y, z) and radius (w) of the cluster impostors, CULL_CLUSTER_SLOTS slots. NULL: no clusters,
+ * commands have no impostor entry.
+ * @param cluster_colors Output: Mean colors of the cluster impostors, alpha grows with the fishies.
+ * @param stream stream for the kernels.
+*/
+void kernel_cull(
+    ParticleArrays particles,
+    unsigned int mesh_count,
+    const uchar4* colors,
+    const CullParams& params,
+    float4* verts,
+    float4* directions,
+    uchar4* out_colors,
+    unsigned int capacity,
+    unsigned int* counts,
+    DrawCommand* commands,
+    unsigned int mesh_vertices,
+    unsigned int schools,
+    float4* clusters = NULL,
+    uchar4* cluster_colors = NULL,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Spawn all fishies on the GPU, like spawnFish and spawnColors: random positions in the spawn box (kernel_set_spawn_box),
+ * no speed, random masses and shades of orange. Nothing is staged in host memory.
+ * The numbers only depend on seed (kernel_set_seed), slot and step, so stores spawned at the same step are equal.
+ * Only valid after kernel_init_grid.
+ * @param particles Output: All fishies. Slot i gets id i, all of them are alive.
+ * @param mesh_count Number of fishies.
+ * @param colors Output: Colors (RGBA8) by id, e.g. the device colors of the renderer. NULL: no colors.
+ * @param stream stream for the kernel.
+*/
+void kernel_spawn(
+    ParticleArrays particles,
+    unsigned int mesh_count,
+    uchar4* colors = NULL,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Emitter: bring up to maxSpawn dead fishies back to life at random positions in the spawn box.
+ * Dead slots are collected into a free list on the GPU, no synchronisation with the host is needed.
+ * Positions only depend on seed (kernel_set_seed), slot and step. Which slots are reused first, if more than maxSpawn are dead,
+ * depends on the order of the atomic operations.
+ * @param particles All fishies. Will be updated.
+ * @param mesh_count Number of fishies.
+ * @param maxSpawn Maximum number of fishies to spawn. 0 does nothing.
+ * @param stream stream for all kernels.
+*/
+void kernel_respawn(
+    ParticleArrays particles,
+    unsigned int mesh_count,
+    unsigned int maxSpawn,
+    cudaStream_t stream = 0);
+
+static const unsigned int CHECKPOINT_COMPONENTS = 6;	//!< Quantised arrays of a delta checkpoint: x, y, z, vx, vy, vz.
+static const float CHECKPOINT_STEPS = 32767.0f;		//!< Quantisation steps of the largest difference of a component.
+
+/*!
+ * @brief Fish of a delta checkpoint which is stored in full: another fish took its slot, it died, respawned or changed its mass.
+ */
+struct CheckpointEvent
+{
+	unsigned int slot;			//!< Slot of the fish.
+	unsigned int id;			//!< Stable id.
+	unsigned int alive;			//!< Alive flag.
+	float values[7];			//!< x, y, z, vx, vy, vz, mass.
+};
+
+/*!
+ * @brief Encode the fishies as delta checkpoint against a reference store on the GPU, e.g. the state of the last checkpoint.
+ * Per component the differences are quantised to 16 bit with the step range / CHECKPOINT_STEPS, range being the largest
+ * difference of all unchanged slots. The reference gets the decoded values, not the exact ones, so the error of a chain of
+ * checkpoints stays below half a step of the last one instead of adding up. Slots with another id, alive flag or mass go
+ * into the event list with their exact values, their differences are 0.
+ * @param particles fishies (read only).
+ * @param reference state the decoder has so far, numParticles slots. Will be updated.
+ * @param mesh_count number of slots.
+ * @param deltas Output: CHECKPOINT_COMPONENTS arrays of mesh_count differences, component c starts at c * stride.
+ * @param stride distance of the arrays in deltas.
+ * @param events Output: changed slots, in no particular order.
+ * @param maxEvents capacity of events.
+ * @param counters Output (device): CHECKPOINT_COMPONENTS ranges as float bits, then the number of changed slots. It can be
+ * larger than maxEvents, then the list is cut and the checkpoint is no use.
+ * @param stream stream for all kernels.
+*/
+void kernel_encode_checkpoint(
+    ParticleArrays particles,
+    ParticleArrays reference,
+    unsigned int mesh_count,
+    short* deltas,
+    size_t stride,
+    CheckpointEvent* events,
+    unsigned int maxEvents,
+    unsigned int* counters,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Decode a delta checkpoint of kernel_encode_checkpoint into the store it was made against: adds the differences with
+ * the same arithmetic as the encoder and writes the changed slots. Applied to the last state, the result is bit for bit the
+ * reference of the encoder.
+ * @param particles state of the checkpoint before. Will be updated.
+ * @param mesh_count number of slots.
+ * @param deltas differences on the device, like kernel_encode_checkpoint.
+ * @param stride distance of the arrays in deltas.
+ * @param range largest difference of every component (the counters of kernel_encode_checkpoint).
+ * @param events changed slots on the device.
+ * @param eventCount number of events.
+ * @param stream stream for all kernels.
+*/
+void kernel_apply_checkpoint(
+    ParticleArrays particles,
+    unsigned int mesh_count,
+    const short* deltas,
+    size_t stride,
+    const float range[CHECKPOINT_COMPONENTS],
+    const CheckpointEvent* events,
+    unsigned int eventCount,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Compute centroid, bounding box, number and mean speed of the living fishies on the GPU.
+ * Two pass reduction with warp shuffles. The result stays on the GPU (kernel_get_stats_device, kernel_read_stats).
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param stream stream for all kernels.
+ * @param mailbox mapped host memory the result is written to as well (CudaMailbox::slot), no kernel_read_stats needed. NULL: none.
+*/
+void kernel_reduce_stats(
+    ParticleArrays particles,
+    unsigned int mesh_count,
+    cudaStream_t stream = 0,
+    SwarmStats* mailbox = NULL);
+
+/*!
+ * @brief kernel_pack and kernel_reduce_stats fused: one pass over the fishies writes the VBO and the partial aggregates
+ * of the blocks, a one block kernel finishes the aggregates. Same results as the two calls.
+ * @param particles All fishies (read only).
+ * @param verts Output: Vertices, see kernel_pack.
+ * @param directions Output: Direction of the velocity and speed, see kernel_pack. NULL: not written.
+ * @param mesh_count Number of fishies.
+ * @param stream stream for all kernels.
+ * @param mailbox mapped host memory the aggregates are written to as well (CudaMailbox::slot). NULL: none.
+*/
+void kernel_pack_stats(
+    ParticleArrays particles,
+    float4* verts,
+    float4* directions,
+    unsigned int mesh_count,
+    cudaStream_t stream = 0,
+    SwarmStats* mailbox = NULL);
+
+/*!
+ * @brief Place the uniform grid around the bounding box of the swarm, so the cells are used evenly.
+ * Only the cells of the bounding box are cleared every step. Axes longer than the maximum grid wrap around (hashed grid).
+ * Old bounds are fine, fishies outside of the grid are still found.
+ * @param stats aggregates of kernel_reduce_stats. Nothing changes without living fishies.
+*/
+void kernel_set_grid_bounds(const SwarmStats& stats);
+
+/*!
+ * @brief Get the aggregates of the last kernel_reduce_stats on the GPU, e.g. as kernel parameter.
+ * In the unified memory mode the pointer is managed: the host reads it after the stream is synchronized, without kernel_read_stats.
+ * @return device pointer to the aggregates.
+*/
+const SwarmStats* kernel_get_stats_device();
+
+/*!
+ * @brief Copy the aggregates of the last kernel_reduce_stats to the host asynchronously.
+ * @param stats Output: aggregates. Should be pinned memory (CudaHostArray), valid after the stream was synchronized.
+ * @param stream stream of kernel_reduce_stats.
+*/
+void kernel_read_stats(SwarmStats* stats, cudaStream_t stream = 0);
+
+/*!
+ * @brief Pick evenly spread fishies as probes for the distance histogram of kernel_stats_sample.
+ * @param particles Fishies after the last step.
+ * @param mesh_count Number of fishies.
+ * @param probes Output: probe_count positions, w = 1 for living fishies, -1 for dead ones.
+ * @param probe_count Number of probes, at most mesh_count.
+ * @param stream stream of the step.
+*/
+void kernel_stats_probes(
+    ParticleArrays particles,
+    unsigned int mesh_count,
+    float4* probes,
+    unsigned int probe_count,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Write the aggregates of the last kernel_reduce_stats (or kernel_pack_stats) and the histogram of the distances of the
+ * probes to their closest fish into a StatsSample on the device. Nothing is read back.
+ * @param probes Probes of kernel_stats_probes.
+ * @param probe_count Number of probes. 0: the distance histogram stays empty, e.g. for kernel_swarm_analytics.
+ * @param distances Distances of kernel_query_nearest with k = 2 for the probes: the first one is the probe itself.
+ * @param binWidth Width of a histogram bin.
+ * @param step Steps since the start.
+ * @param sample Output: sample, e.g. the next entry of a device ring.
+ * @param stream stream of kernel_reduce_stats and kernel_query_nearest.
+*/
+void kernel_stats_sample(
+    const float4* probes,
+    unsigned int probe_count,
+    const float* distances,
+    float binWidth,
+    unsigned long long step,
+    StatsSample* sample,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Check if the last kernel_advance left the closest fish of every slot behind (grid search with warm start, classic
+ * behaviour, no first k, not deterministic), so kernel_swarm_analytics fills the distance histogram without a search.
+ * @return true, until the slots move or a step without it runs.
+*/
+bool kernel_has_advance_nearest();
+
+/*!
+ * @brief Fill the analytics of a StatsSample from what the last kernel_advance left behind, without a neighbour search:
+ * the local density (fishies in the grid cell of each fish, if the step built the grid), the polarisation (sum of the headings)
+ * and, if kernel_has_advance_nearest, the distance to the closest fish and the alignment with it over all fishies.
+ * The histograms are counted in shared memory per block. Call after kernel_stats_sample, whose distance histogram is added to:
+ * it should sample nothing if kernel_has_advance_nearest.
+ * @param particles Fishies after the last step.
+ * @param mesh_count Number of fishies.
+ * @param nearestBinWidth Width of a bin of the distance histogram, the one of kernel_stats_sample.
+ * @param sample Output: sample on the device.
+ * @param stream stream of the step.
+*/
+void kernel_swarm_analytics(
+    ParticleArrays particles,
+    unsigned int mesh_count,
+    float nearestBinWidth,
+    StatsSample* sample,
+    cudaStream_t stream = 0);
+
+/*!
+ * @brief Allocate the fish event buffers of the active context: deaths, spawns and near misses are logged from the next step on.
+ * Two buffers in mapped pinned memory alternate, so the host reads one while the kernels append to the other one.
+ * @param capacity events per buffer, i.e. per drain. Further events are counted as dropped. 0: free the buffers, no events.
+*/
+void kernel_init_events(unsigned int capacity);
+
+/*!
+ * @brief Append the events of the buffer closed by the last call and close the active one. Call once per frame, between the steps.
+ * Waits only for the read back of the last call, so the events arrive one call late. Call twice to get all events after the last step.
+ * @param events Output: the events are appended, in no particular order.
+ * @param stream simulation stream. The active buffer is closed behind the work queued on it.
+ * @return number of events of that buffer that didn't fit into its capacity.
+*/
+unsigned int kernel_drain_events(std::vector<SwarmEvent>& events, cudaStream_t stream = 0);
 
 /*!
  * @brief Initialization of kernel related values.
+ * Allocates the uniform grid used for the neighbour search and picks the block size of every kernel.
  * @param mesh_count Number of fishies.
+ * @param properties Properties of the device the kernels run on (CudaDevice::getProperties).
+*/
+void kernel_init_grid(int mesh_count, const cudaDeviceProp& properties);
+
+/*!
+ * @brief Free memory allocated by kernel_init_grid.
+*/
+void kernel_cleanup();
+
+/*!
+ * @brief State of the kernels on one device: grid, launch configurations, scratch memory, Verlet lists and graph.
+ * Behaviour, search mode, parameters and the random key are shared by all contexts.
+ */
+struct KernelContext;
+
+/*!
+ * @brief Create an empty context, e.g. for another GPU. Use it with kernel_use_context, then call kernel_init_grid.
+ * @return new context.
+*/
+KernelContext* kernel_create_context();
+
+/*!
+ * @brief Make a context active. All other kernel_* functions work on the active context.
+ * The current CUDA device is not changed, it has to match the device of the context.
+ * @param context context of kernel_create_context. NULL: the default context.
+*/
+void kernel_use_context(KernelContext* context);
+
+/*!
+ * @brief Delete a context. Call kernel_cleanup with the context active first.
+ * @param context context of kernel_create_context. Switches to the default context, if it is active.
 */
-void kernel_init_grid(int mesh_count);
+void kernel_destroy_context(KernelContext* context);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+
+#include <cuda_runtime.h>
+
+#include "kernel.h"
+#include "swarm_config.h"
+
+/*!
+ * @brief Analytic cost of one fish step of kernel_advance: bytes the kernels load and store and floating point operations.
+ * Counted from the kernels of a search: the load and store of the fish in d_swim, the shark scan, the checked neighbour
+ * candidates and the grid build. Loads that hit shared memory are not counted, loads that hit L1 or L2 are, so the
+ * bandwidth is the one the kernels ask for, an upper bound of the DRAM traffic.
+ */
+struct KernelCost
+{
+	double candidates = 0.0;				//!< Neighbour candidates checked per fish.
+	double loadBytes = 0.0;					//!< Bytes loaded from global memory per fish step.
+	double storeBytes = 0.0;				//!< Bytes stored to global memory per fish step.
+	double flops = 0.0;						//!< Floating point operations per fish step, an FMA counts two.
+};
+
+/*!
+ * @brief Peaks of a GPU from its properties.
+ */
+struct DevicePeaks
+{
+	double bandwidth = 0.0;					//!< DRAM bandwidth in GB/s: memory clock * 2 (double data rate) * bus width.
+	double gflops = 0.0;					//!< FP32 peak in GFLOP/s: SMs * FP32 lanes per SM * 2 (FMA) * clock.
+};
+
+/*!
+ * @brief Model the cost of a fish step of a search. The candidates of grid and Verlet search are the fishies in the
+ * searched volume at the mean density of the bounding box of the swarm.
+ * @param mode search kernel_advance runs (kernel_get_search_mode).
+ * @param stats live fishies and bounding box, e.g. of the last step.
+ * @param sharks number of sharks, every fish scans all of them.
+ * @param params fish distance and Verlet skin.
+ * @param tuning tile of the tiled search and grid cell size (kernel_get_tuning).
+ * @return cost per fish step.
+ */
+KernelCost advanceCost( SearchMode mode, const SwarmStats& stats, unsigned int sharks, const SwarmParams& params, const KernelTuning& tuning );
+
+/*!
+ * @brief Compute the peaks of a GPU.
+ * @param properties properties of the GPU (memory clock, bus width, SMs, clock and compute capability).
+ * @return peaks. FP32 lanes per SM by compute capability, 64 for unknown ones.
+ */
+DevicePeaks devicePeaks( const cudaDeviceProp& properties );
+
+/*!
+ * @brief Report of a timed run against the roofline: achieved GB/s and GFLOP/s, their fraction of the peaks,
+ * the arithmetic intensity and the bound.
+ * @param mode search of the run.
+ * @param cost model of a fish step (advanceCost).
+ * @param fishSteps fish updates of the run.
+ * @param seconds wall time of the run.
+ * @param properties properties of the GPU of the run.
+ * @return report with one line per value, aligned like the other reports.
+ */
+std::string rooflineReport( SearchMode mode, const KernelCost& cost, double fishSteps, double seconds, const cudaDeviceProp& properties );
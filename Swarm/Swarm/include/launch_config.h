@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cuda_runtime.h>
+
+#include "macros.h"
+
+/*!
+ * @brief Launch configuration of a kernel: grid size, block size and dynamic shared memory.
+ */
+struct LaunchConfig
+{
+	unsigned int blocks = 1;			//!< Number of blocks.
+	unsigned int threads = 128;			//!< Threads per block.
+	size_t sharedMemory = 0;			//!< Dynamic shared memory per block in bytes.
+	size_t sharedPerThread = 0;			//!< Dynamic shared memory needed per thread.
+	size_t sharedPerBlock = 0;			//!< Dynamic shared memory needed per block, independent of the block size.
+	unsigned int maxThreads = 1024;		//!< Largest block size the kernel can be launched with (registers, shared memory).
+
+	/*!
+	 * @brief Compute grid size and shared memory for a number of threads.
+	 * The block size is kept, only small launches use smaller blocks.
+	 * @param count number of threads the kernel needs (one per fish for most kernels).
+	 * @return this configuration.
+	 */
+	LaunchConfig& resize( unsigned int count )
+	{
+		unsigned int size = count > 0 ? count : 1;
+		unsigned int used = size < threads ? size : threads;
+		blocks = ( size + used - 1 ) / used;
+		sharedMemory = sharedPerThread * used + sharedPerBlock;
+		return *this;
+	}
+
+	/*!
+	 * @brief Same configuration with the grid size for a different number of threads.
+	 * @param count number of threads.
+	 * @return configuration for count threads.
+	 */
+	LaunchConfig forCount( unsigned int count ) const
+	{
+		LaunchConfig config = *this;
+		return config.resize( count );
+	}
+
+	/*!
+	 * @brief Same configuration with another block size, e.g. one found by timing trials instead of the occupancy calculator.
+	 * @param blockSize threads per block, limited to maxThreads. 0: keep the block size.
+	 * @return configuration with the new block size. Call forCount for the grid size.
+	 */
+	LaunchConfig withThreads( unsigned int blockSize ) const
+	{
+		LaunchConfig config = *this;
+		if ( blockSize > 0 )
+			config.threads = blockSize < maxThreads ? blockSize : maxThreads;
+		return config;
+	}
+};
+
+/*!
+ * @brief Dynamic shared memory of a block as function of the block size. Used by the occupancy calculator.
+ */
+struct SharedMemoryDemand
+{
+	size_t perThread;					//!< Bytes per thread.
+	size_t perBlock;					//!< Bytes per block.
+
+	size_t operator()( int blockSize ) const
+	{
+		return perThread * blockSize + perBlock;
+	}
+};
+
+/*!
+ * @brief Ask the occupancy calculator for the block size with the highest occupancy of a kernel on a device.
+ * The block size is limited by the device properties and rounded down to a multiple of granularity.
+ * If the query fails, fallbackBlockSize is used.
+ * @param kernel kernel function.
+ * @param count number of threads the kernel needs.
+ * @param properties properties of the device the kernel runs on (CudaDevice::getProperties).
+ * @param sharedPerThread dynamic shared memory per thread in bytes.
+ * @param sharedPerBlock dynamic shared memory per block in bytes.
+ * @param granularity block size has to be a multiple of this value (e.g. the warp size).
+ * @param fallbackBlockSize block size if the occupancy calculator fails.
+ * @return launch configuration for count threads.
+ */
+template<class Kernel>
+LaunchConfig occupancyLaunchConfig(
+	Kernel kernel,
+	unsigned int count,
+	const cudaDeviceProp& properties,
+	size_t sharedPerThread = 0,
+	size_t sharedPerBlock = 0,
+	unsigned int granularity = 1,
+	unsigned int fallbackBlockSize = 128 )
+{
+	int minGridSize = 0;
+	int blockSize = 0;
+	SharedMemoryDemand demand = { sharedPerThread, sharedPerBlock };
+	CUDA_CHECK( cudaOccupancyMaxPotentialBlockSizeVariableSMem( &minGridSize, &blockSize, kernel, demand, properties.maxThreadsPerBlock ) );
+
+	// Shared memory of the whole block must fit into the device limit.
+	while (blockSize > 0 && demand( blockSize ) > properties.sharedMemPerBlock)
+		blockSize -= granularity;
+
+	blockSize -= blockSize % granularity;
+	if (blockSize <= 0)
+		blockSize = fallbackBlockSize;
+
+	// Registers and shared memory limit the block sizes of withThreads.
+	cudaFuncAttributes attributes;
+	CUDA_CHECK( cudaFuncGetAttributes( &attributes, kernel ) );
+	unsigned int maxThreads = static_cast< unsigned int >( attributes.maxThreadsPerBlock );
+	while (maxThreads > granularity && sharedPerThread * maxThreads + sharedPerBlock > properties.sharedMemPerBlock)
+		maxThreads -= granularity;
+	maxThreads -= maxThreads % granularity;
+
+	LaunchConfig config;
+	config.threads = blockSize;
+	config.sharedPerThread = sharedPerThread;
+	config.sharedPerBlock = sharedPerBlock;
+	config.maxThreads = maxThreads > 0 ? maxThreads : config.threads;
+	return config.resize( count );
+}
+
+/*!
+ * @brief Theoretical occupancy of a kernel with a launch configuration: resident warps per multiprocessor relative to the maximum.
+ * Achieved occupancy can be lower (tail effects, load imbalance), it is only measured by the profiler.
+ * @param kernel kernel function.
+ * @param config launch configuration, e.g. from occupancyLaunchConfig and LaunchConfig::forCount.
+ * @param properties properties of the device the kernel runs on.
+ * @return occupancy in [0, 1].
+ */
+template<class Kernel>
+float theoreticalOccupancy( Kernel kernel, const LaunchConfig& config, const cudaDeviceProp& properties )
+{
+	int blocksPerMultiprocessor = 0;
+	CUDA_CHECK( cudaOccupancyMaxActiveBlocksPerMultiprocessor( &blocksPerMultiprocessor, kernel, config.threads, config.sharedMemory ) );
+	return static_cast< float >( blocksPerMultiprocessor * config.threads ) / properties.maxThreadsPerMultiProcessor;
+}
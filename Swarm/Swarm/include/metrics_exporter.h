@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <thread>
+
+/*!
+ * @brief Values of one publication, e.g. every half second of the renderer.
+ */
+struct MetricsSample
+{
+	unsigned long long frames = 0;			//!< Frames since the start.
+	unsigned long long overBudget = 0;		//!< Frames over budget since the start.
+	float frameP50 = 0.0f;					//!< Frame time percentiles of the recent frames in ms.
+	float frameP95 = 0.0f;
+	float frameP99 = 0.0f;
+	double stepsPerSecond = 0.0;			//!< Simulation steps per second since the last publication.
+	unsigned long long steps = 0;			//!< Simulation steps since the start.
+	unsigned int liveFishies = 0;			//!< Living fishies.
+	size_t deviceBytes = 0;					//!< Tracked device memory.
+	size_t devicePeakBytes = 0;				//!< Peak of the tracked device memory.
+	unsigned int seriesFrames = 0;			//!< Frames of the stats series (StatsRing) behind the values below. 0: no series, not served.
+	float nearestP50 = 0.0f;				//!< Percentiles of the distance to the closest fish in the newest frame of the series.
+	float nearestP95 = 0.0f;
+	float nearestMean = 0.0f;				//!< Mean distance to the closest fish over the series.
+	float meanSpeed = 0.0f;					//!< Mean speed over the series.
+	float extent = 0.0f;					//!< Diagonal of the bounding box in the newest frame of the series.
+	float polarisation = 0.0f;				//!< Mean polarisation (order parameter) over the series.
+	float alignment = 0.0f;					//!< Mean cosine between the heading of a fish and the one of its closest fish over the series.
+	unsigned int cellDensity = 0;			//!< Median of the fishies per grid cell in the newest frame. 0: no grid.
+};
+
+/*!
+ * @brief MetricsExporter serves the newest MetricsSample in the Prometheus text format (GET /metrics) on a TCP port,
+ * so unattended installations can be scraped by the fleet monitoring.
+ * The render thread publishes into a small ring of seqlocked slots, like the PositionRingSlot of PositionExport: it never
+ * takes a lock and never touches a socket. The server thread copies the newest slot and retries, if the renderer
+ * overwrote it meanwhile. Each connection gets one response and is closed (HTTP/1.0).
+ */
+class MetricsExporter
+{
+private:
+
+	static const unsigned int SLOTS = 4;				//!< Publications in the ring.
+	static const unsigned int POLL_MS = 200;			//!< Time the server waits for a connection before it checks stop_.
+
+	/*!
+	 * @brief Seqlock and values of one publication.
+	 */
+	struct alignas( 64 ) Slot
+	{
+		std::atomic<unsigned long long> sequence{ 0 };	//!< Odd while the slot is written.
+		MetricsSample sample;							//!< Values of the publication.
+	};
+
+	unsigned int port_;									//!< TCP port. 0: disabled.
+	Slot slots_[SLOTS];									//!< Ring of the publications.
+	std::atomic<unsigned long long> latest_{ 0 };		//!< Number of the newest complete publication. 0: none yet.
+	unsigned long long published_ = 0;					//!< Publications, render thread only.
+	std::atomic<bool> stop_{ false };					//!< Server thread ends.
+	std::thread server_;								//!< Accepts the connections and writes the responses.
+	unsigned long long listener_;						//!< Listening socket (SOCKET or int), valid while server_ runs.
+
+	/*!
+	 * @brief Server thread: answer connections until stop_ is set.
+	 */
+	void serve();
+
+	/*!
+	 * @brief Copy the newest publication out of the ring.
+	 * @param sample Output: values. Unchanged on false.
+	 * @return true, if a complete publication was copied.
+	 */
+	bool read( MetricsSample& sample ) const;
+
+	/*!
+	 * @brief Format a publication as Prometheus text.
+	 * @param sample values.
+	 * @return metrics, one sample line per value with HELP and TYPE.
+	 */
+	static std::string format( const MetricsSample& sample );
+
+public:
+
+	/*!
+	 * @brief Constructor. Opens the port and starts the server thread.
+	 * @param port TCP port, e.g. config.metricsPort. 0: disabled, publish does nothing.
+	 */
+	explicit MetricsExporter( unsigned int port );
+
+	/*!
+	 * @brief Destructor. Stops the server thread and closes the port.
+	 */
+	~MetricsExporter();
+
+	MetricsExporter( const MetricsExporter& ) = delete;
+	MetricsExporter& operator=( const MetricsExporter& ) = delete;
+
+	/*!
+	 * @brief Check if the values are served.
+	 * @return true, if the port is open.
+	 */
+	inline bool isEnabled() const { return server_.joinable(); }
+
+	/*!
+	 * @brief Publish new values. Lock free and without I/O, call from the render thread only.
+	 * @param sample values.
+	 */
+	void publish( const MetricsSample& sample );
+};
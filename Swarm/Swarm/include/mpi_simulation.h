@@ -0,0 +1,145 @@
+#pragma once
+
+#ifdef SWARM_MPI
+
+#include <vector>
+
+#include <mpi.h>
+
+#include "cuda_device.h"
+#include "cuda_device_array.h"
+#include "cuda_host_array.h"
+#include "kernel.h"
+#include "particle_store.h"
+#include "swarm_config.h"
+#include "swarm_stats.h"
+#include "waypoint_list.h"
+
+/*!
+ * @brief MpiSimulation splits the swarm into slabs along the x axis, one per MPI rank, each on a GPU of its node. Without window.
+ * The same decomposition as MultiGpuSimulation, across processes: after each step migrating fishies and halos go to the
+ * neighbour ranks as MPI messages. With CUDA-aware MPI the messages use the device buffers directly (GPUDirect RDMA where the
+ * network supports it), otherwise they are staged through pinned host memory.
+ * Sharks are moved on rank 0 and broadcast. Stats, slab loads and the throughput are global reductions, rank 0 prints them.
+ * Only compiled with SWARM_MPI.
+ */
+class MpiSimulation
+{
+private:
+
+	static const unsigned int GRID_UPDATE_INTERVAL = 16;	//!< Steps between two updates of grid bounds and slab bounds.
+	static constexpr float CAPACITY_FACTOR = 2.0f;			//!< Slots per rank relative to an even split.
+
+	MPI_Comm comm_;							//!< Communicator of all ranks, ordered by x.
+	int rank_;								//!< Index of the own slab.
+	int ranks_;								//!< Number of slabs.
+	int lower_;								//!< Rank of the lower slab. MPI_PROC_NULL for the first one.
+	int upper_;								//!< Rank of the upper slab. MPI_PROC_NULL for the last one.
+	bool gpuDirect_;						//!< Pass device pointers to MPI (SwarmConfig::mpiGpuDirect).
+
+	CudaDevice device_;						//!< GPU of this rank.
+	cudaStream_t stream_;					//!< Stream for all kernels and copies.
+	ParticleStore* particles_[2];			//!< [0]: owned fishies, then halo. [1]: after the step.
+	ParticleStore* send_;					//!< Fishies for the neighbours: to lower, halo lower, to upper, halo upper.
+	PinnedParticleStore* hostSend_ = NULL;	//!< Staging of send_ without gpuDirect_.
+	PinnedParticleStore* hostReceive_ = NULL;	//!< Staging of the received fishies without gpuDirect_, same layout as particles_[0].
+	CudaDeviceArray<unsigned int>* lists_;	//!< Lists of kernel_partition_slab.
+	CudaDeviceArray<unsigned int>* counts_;	//!< Number of fishies per list.
+	CudaHostArray<unsigned int>* h_counts_;	//!< Read back of counts_.
+	CudaHostArray<SwarmStats>* h_stats_;	//!< Read back of the stats for the grid bounds.
+	CudaDeviceArray<float>* d_sharks;		//!< Shark positions, the same on every rank.
+	CudaDeviceArray<float>* d_shark_state;	//!< Shark speeds and masses. Only used on rank 0.
+	CudaHostArray<float>* h_sharks_ = NULL;	//!< Staging of the broadcast without gpuDirect_.
+	std::vector<SlabBounds> bounds_;		//!< Bounds of all slabs, the same on every rank.
+
+	unsigned int numParticles_;				//!< Number of Particles of all ranks.
+	unsigned int numSharks_;				//!< Number of Sharks.
+	unsigned int capacity_;					//!< Slots of this rank for owned and halo fishies.
+	unsigned int owned_ = 0;				//!< Number of owned fishies.
+	unsigned int haloCount_ = 0;			//!< Number of halo fishies behind the owned ones.
+	float halo_;							//!< Width of the halos (fishDist).
+	double particleUpdates_ = 0.0;			//!< Number of fish updates of this rank in the last run.
+	unsigned int stepsSinceUpdate_ = 0;		//!< Steps since the last update of the bounds.
+
+	const float WAYPOINT_THRESHOLD = 0.1;	//!< Threshold for waypoint goal.
+
+	float speed;							//!< speed of particles per step (SwarmConfig::swarmSpeed * dt).
+	double dt_;								//!< Simulated time per step.
+	WaypointList* waypointList;				//!< Waypoint List contains waypoints for particles.
+	Vector3 swarmCenter;					//!< Position of swarm center. Moved the same way on every rank.
+
+	/*!
+	 * @brief Move Swarm center to waypoint
+	 */
+	void moveSwarmCenter();
+
+	/*!
+	 * @brief Post the messages of all arrays of some fishies.
+	 * @param fishies first fish, device memory with gpuDirect_, else pinned host memory.
+	 * @param count number of fishies. Nothing is posted for 0.
+	 * @param peer rank of the neighbour.
+	 * @param list SlabList of the sender, tells the messages apart.
+	 * @param receive receive instead of send.
+	 * @param requests Output: requests of the messages are appended.
+	 */
+	void postParticles( ParticleArrays fishies, unsigned int count, int peer, int list, bool receive, std::vector<MPI_Request>& requests );
+
+	/*!
+	 * @brief Broadcast the shark positions of rank 0. Waits for the stream.
+	 */
+	void broadcastSharks();
+
+	/*!
+	 * @brief Sort the fishies of particles_[1] into kept, migrating and halo fishies and exchange them with the neighbours
+	 * into particles_[0]. The ranks wait for their neighbours.
+	 * @param readStats also read back the stats of the slab.
+	 * @return false on every rank, if a rank ran out of slots.
+	 */
+	bool exchange( bool readStats );
+
+	/*!
+	 * @brief Move the slab bounds towards the slabs with less fishies and let the grid follow the fishies of the slab.
+	 */
+	void updateBounds();
+
+public:
+
+	/*!
+	 * @brief Constructor. Picks a GPU of the node by the rank on the node, spawns the share of the fishies of this rank
+	 * into its slab and builds the halos. Collective.
+	 * @param config Number of particles and sharks, behaviour. The Verlet search falls back to the grid.
+	 * @param comm communicator of all ranks. MPI has to be initialized.
+	 */
+	MpiSimulation( const SwarmConfig& config, MPI_Comm comm );
+
+	/*!
+	 * @brief Calculate one simulation step and exchange the fishies with the neighbours. Collective.
+	 * @return false, if a rank ran out of slots. The state is not valid anymore.
+	 */
+	bool step();
+
+	/*!
+	 * @brief Get aggregates of the owned fishies of all ranks. Collective, waits for the last step.
+	 * @return aggregates.
+	 */
+	SwarmStats getStats();
+
+	/*!
+	 * @brief Calculate the given number of steps, rank 0 prints the throughput. Collective.
+	 * @param steps number of steps.
+	 */
+	void run( unsigned int steps );
+
+	/*!
+	 * @brief Get the index of the own slab.
+	 * @return rank.
+	 */
+	inline int getRank() const { return rank_; }
+
+	/*!
+	 * @brief Free Memory on GPU. Waits for the last step.
+	 */
+	void cleanUp();
+};
+
+#endif
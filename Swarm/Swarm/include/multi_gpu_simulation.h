@@ -0,0 +1,139 @@
+#pragma once
+
+#include <vector>
+
+#include "cuda_device.h"
+#include "cuda_device_array.h"
+#include "cuda_host_array.h"
+#include "kernel.h"
+#include "particle_store.h"
+#include "swarm_config.h"
+#include "swarm_stats.h"
+#include "waypoint_list.h"
+
+/*!
+ * @brief MultiGpuSimulation splits the swarm into slabs along the x axis, one per GPU.
+ * Every GPU owns the fishies of its slab and keeps a copy of the fishies of the neighbour slabs within fishDist of its bounds (halo),
+ * so the neighbour search finds every close fish. After each step the fishies which crossed a bound migrate to the neighbour
+ * and the halos are exchanged, with peer to peer copies where the GPUs support them.
+ * The slab bounds follow the load, so every GPU holds about the same number of fishies.
+ * Sharks are moved on the first GPU and copied to the others. Random numbers only depend on fish id and step,
+ * so the split doesn't change them.
+ */
+class MultiGpuSimulation
+{
+private:
+
+	/*!
+	 * @brief Fishies and buffers of one GPU.
+	 */
+	struct Slab
+	{
+		CudaDevice* device = NULL;				//!< GPU of the slab.
+		cudaStream_t stream = NULL;				//!< Stream for all kernels and copies of the slab.
+		KernelContext* context = NULL;			//!< Grid and launch configuration on this GPU.
+		ParticleStore* particles[2] = {};		//!< [0]: owned fishies, then halo. [1]: after the step.
+		ParticleStore* send = NULL;				//!< Fishies for the neighbours: to lower, halo lower, to upper, halo upper.
+		CudaDeviceArray<unsigned int>* lists = NULL;	//!< Lists of kernel_partition_slab.
+		CudaDeviceArray<unsigned int>* counts = NULL;	//!< Number of fishies per list.
+		CudaHostArray<unsigned int>* h_counts = NULL;	//!< Read back of counts.
+		CudaHostArray<SwarmStats>* h_stats = NULL;		//!< Read back of the stats for the grid bounds.
+		CudaDeviceArray<float>* sharks = NULL;	//!< Shark positions on this GPU.
+		cudaEvent_t exchanged = NULL;			//!< Recorded after the copies to the neighbours.
+		SlabBounds bounds;						//!< Bounds on the x axis.
+		unsigned int owned = 0;					//!< Number of owned fishies.
+		unsigned int halo = 0;					//!< Number of halo fishies behind the owned ones.
+	};
+
+	std::vector<Slab> slabs_;				//!< One per GPU, ordered by x.
+	CudaDeviceArray<float>* d_shark_state;	//!< Shark speeds and masses on the first GPU.
+	cudaEvent_t sharksMoved_;				//!< Recorded on the first GPU after the copies of the shark positions.
+	cudaEvent_t gathered_;					//!< Recorded after the last gather, on the stream of the gather.
+	bool gatherPending_ = false;			//!< gathered_ was recorded, the next step waits for it.
+
+	static const unsigned int GRID_UPDATE_INTERVAL = 16;	//!< Steps between two updates of grid bounds and slab bounds.
+	static constexpr float CAPACITY_FACTOR = 2.0f;			//!< Slots per GPU relative to an even split.
+
+	unsigned int numParticles_;				//!< Number of Particles
+	unsigned int numSharks_;				//!< Number of Sharks. Moved on the first GPU.
+	unsigned int capacity_;					//!< Slots per GPU for owned and halo fishies.
+	float halo_;							//!< Width of the halos (fishDist).
+	double particleUpdates_ = 0.0;			//!< Number of fish updates of the last run.
+	unsigned int stepsSinceUpdate_ = 0;		//!< Steps since the last update of the bounds.
+
+	const float WAYPOINT_THRESHOLD = 0.1;	//!< Threshold for waypoint goal.
+
+	float speed;							//!< speed of particles per step (SwarmConfig::swarmSpeed * dt).
+	double dt_;								//!< Simulated time per step.
+	WaypointList* waypointList;				//!< Waypoint List contains waypoints for particles.
+	Vector3 swarmCenter;					//!< Position of swarm center.
+
+	/*!
+	 * @brief Move Swarm center to waypoint
+	 */
+	void moveSwarmCenter();
+
+	/*!
+	 * @brief Make the GPU and the kernel context of a slab current.
+	 * @param slab slab.
+	 */
+	void use( const Slab& slab );
+
+	/*!
+	 * @brief Partition the fishies of particles[1] of every slab, then migrate and exchange the halos into particles[0].
+	 * @param readStats also read back the stats of every slab for the bounds.
+	 * @return false, if a slab has no room for its fishies.
+	 */
+	bool exchange( bool readStats );
+
+	/*!
+	 * @brief Move the slab bounds towards the GPUs with less fishies and place the grids around the slabs.
+	 */
+	void updateBounds();
+
+	/*!
+	 * @brief Switch back to the first GPU and the default kernel context.
+	 */
+	void restore();
+
+public:
+
+	/*!
+	 * @brief Constructor. Spawns the fishies, splits them into slabs of equal size and uploads them.
+	 * @param config Number of particles, sharks and GPUs and the kernel settings. The Verlet search falls back to the grid.
+	 */
+	MultiGpuSimulation( const SwarmConfig& config );
+
+	/*!
+	 * @brief Calculate one simulation step on all GPUs. Waits for the slabs to know the migrating fishies.
+	 * @return false, if a slab ran out of slots. The state is not valid anymore.
+	 */
+	bool step();
+
+	/*!
+	 * @brief Calculate the given number of steps and print the throughput.
+	 * @param steps number of steps.
+	 */
+	void run( unsigned int steps );
+
+	/*!
+	 * @brief Copy the owned fishies of all slabs and the sharks into memory of the first GPU, e.g. for the renderer.
+	 * The next step waits until the copies are done.
+	 * @param particles Output: Fishies, at least numParticles slots on the first GPU.
+	 * @param sharks Output: Shark positions (numSharks float4) on the first GPU.
+	 * @param stream stream of the first GPU.
+	 * @return number of fishies written.
+	 */
+	unsigned int gather( ParticleArrays particles, float* sharks, cudaStream_t stream );
+
+	/*!
+	 * @brief Aggregates of the owned fishies of all slabs. Waits for the GPUs.
+	 * @return aggregates.
+	 */
+	SwarmStats getStats();
+
+	/*!
+	 * @brief Free Memory on all GPUs.
+	 */
+	void cleanUp();
+};
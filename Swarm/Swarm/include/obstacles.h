@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+
+#include "vec3.h"
+
+/*!
+ * @brief Shapes of the static obstacles.
+ */
+enum class ObstacleShape
+{
+	SPHERE,			//!< Solid sphere, size.x is the radius.
+	BOX,			//!< Solid box, size is the half extent.
+	TANK			//!< Inverted box: the water is inside, the walls outside. size is the half extent.
+};
+
+/*!
+ * @brief Static obstacle the fishies swim around.
+ */
+struct Obstacle
+{
+	ObstacleShape shape;			//!< Shape.
+	Vector3 center;					//!< Center of the shape.
+	Vector3 size;					//!< Radius (x) or half extent, see ObstacleShape.
+};
+
+/*!
+ * @brief Signed distance field of the obstacles, sampled on a regular grid. Uploaded into a 3D texture by kernel_set_obstacles.
+ */
+struct ObstacleVolume
+{
+	Vector3 origin;					//!< Position of the first sample.
+	float cellSize = 0.0f;			//!< Distance between two samples along every axis.
+	unsigned int width = 0;			//!< Samples along x.
+	unsigned int height = 0;		//!< Samples along y.
+	unsigned int depth = 0;			//!< Samples along z.
+	std::vector<float> texels;		//!< 4 floats per sample, x fastest: gradient of the distance (x, y, z) and distance (w). Empty: no obstacles.
+};
+
+/*!
+ * @brief Signed distance of a point to the nearest obstacle surface. Negative inside an obstacle.
+ * @param obstacles obstacles.
+ * @param point point.
+ * @return distance, FLT_MAX without obstacles.
+ */
+float obstacleDistance( const std::vector<Obstacle>& obstacles, const Vector3& point );
+
+/*!
+ * @brief Sample the distance field of the obstacles with the gradient, so a lookup gives both at once.
+ * The volume covers the spawn box, the waypoints and all finite obstacles plus margin on every side.
+ * @param obstacles obstacles. Empty: an empty volume.
+ * @param spawnMin lower corner of the spawn box.
+ * @param spawnMax upper corner of the spawn box.
+ * @param waypoints route of the swarm.
+ * @param margin distance added around the covered box, e.g. the avoidance range.
+ * @param resolution samples along the longest axis, at least 2.
+ * @return volume.
+ */
+ObstacleVolume bakeObstacles( const std::vector<Obstacle>& obstacles, const Vector3& spawnMin, const Vector3& spawnMax,
+	const std::vector<Vector3>& waypoints, float margin, unsigned int resolution );
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <vector>
+
+#include "cuda_device.h"
+#include "cuda_device_array.h"
+#include "cuda_host_array.h"
+#include "kernel.h"
+#include "particle_store.h"
+#include "swarm_config.h"
+#include "swarm_stats.h"
+#include "waypoint_list.h"
+
+/*!
+ * @brief OutOfCoreSimulation runs a swarm larger than device memory on one GPU, without window.
+ * Space is split into bricks along the x axis, like the slabs of MultiGpuSimulation. The fishies of all bricks live in
+ * pinned host memory; every step streams the bricks through the GPU in the order of x: upload the owned fishies and the halo,
+ * advance, sort them into the SlabList lists (kernel_partition_slab) and copy the lists back into the bricks of the next step.
+ * Each brick runs on one of STREAMS lanes with its own stream, kernel context and buffers, so the copies of one brick
+ * overlap with the step of the next one. Device memory only depends on the brick size.
+ */
+class OutOfCoreSimulation
+{
+private:
+
+	/*!
+	 * @brief Parts of the fishies of a brick, uploaded in this order.
+	 */
+	enum BrickPart
+	{
+		BRICK_OWNED = 0,						//!< Fishies inside the bounds.
+		BRICK_HALO_SELF,						//!< Fishies that left the brick in the last step, but are still inside its halo.
+		BRICK_HALO_LOWER,						//!< Halo from the lower brick.
+		BRICK_HALO_UPPER,						//!< Halo from the upper brick.
+		BRICK_PART_COUNT
+	};
+
+	/*!
+	 * @brief Fishies of one brick in pinned host memory, before ([current_]) and after the step.
+	 */
+	struct Brick
+	{
+		PinnedParticleStore* parts[BRICK_PART_COUNT][2] = {};	//!< Fishies per part and step.
+		unsigned int counts[BRICK_PART_COUNT][2] = {};			//!< Number of fishies per part and step.
+		CudaHostArray<SwarmStats>* h_stats = NULL;	//!< Read back of the stats for the grid bounds.
+		SlabBounds bounds;						//!< Bounds on the x axis.
+	};
+
+	/*!
+	 * @brief Stream and device buffers a brick is stepped with.
+	 */
+	struct Lane
+	{
+		cudaStream_t stream = NULL;				//!< Stream for all kernels and copies of the lane.
+		KernelContext* context = NULL;			//!< Grid and launch configuration of the lane.
+		ParticleStore* particles[2] = {};		//!< [0]: all parts of the brick. [1]: after the step.
+		CudaDeviceArray<unsigned int>* lists = NULL;	//!< Lists of kernel_partition_slab.
+		CudaDeviceArray<unsigned int>* counts = NULL;	//!< Number of fishies per list.
+		CudaHostArray<unsigned int>* h_counts = NULL;	//!< Read back of counts.
+		cudaEvent_t counted = NULL;				//!< Recorded after the read back of counts.
+		bool empty = true;						//!< The last brick of the lane had no fishies.
+	};
+
+	static const unsigned int STREAMS = 3;					//!< Lanes: one brick uploads while one steps and one copies back.
+	static const unsigned int GRID_UPDATE_INTERVAL = 16;	//!< Steps between two updates of grid bounds and brick bounds.
+	static constexpr float CAPACITY_FACTOR = 1.5f;			//!< Owned slots per brick relative to an even split.
+	static constexpr float HALO_FACTOR = 0.25f;				//!< Slots per halo part relative to the owned slots.
+
+	CudaDevice device_;						//!< GPU all bricks are streamed through.
+	std::vector<Brick> bricks_;				//!< Ordered by x.
+	Lane lanes_[STREAMS];					//!< Brick b runs on lane b % STREAMS.
+	CudaDeviceArray<float>* d_sharks;		//!< Shark positions.
+	CudaDeviceArray<float>* d_shark_state;	//!< Shark speeds and masses.
+	cudaEvent_t sharksMoved_;				//!< Recorded on the first lane after the sharks moved.
+
+	unsigned int current_ = 0;				//!< Index of the parts that hold the latest step.
+	unsigned int numParticles_;				//!< Number of Particles
+	unsigned int numSharks_;				//!< Number of Sharks.
+	unsigned int capacity_;					//!< Owned slots per brick.
+	unsigned int haloCapacity_;				//!< Slots per halo part.
+	float halo_;							//!< Width of the halos (fishDist).
+	double particleUpdates_ = 0.0;			//!< Number of fish updates of the last run.
+	unsigned int stepsSinceUpdate_ = 0;		//!< Steps since the last update of the bounds.
+
+	const float WAYPOINT_THRESHOLD = 0.1;	//!< Threshold for waypoint goal.
+
+	float speed;							//!< speed of particles per step (SwarmConfig::swarmSpeed * dt).
+	double dt_;								//!< Simulated time per step.
+	WaypointList* waypointList;				//!< Waypoint List contains waypoints for particles.
+	Vector3 swarmCenter;					//!< Position of swarm center.
+
+	/*!
+	 * @brief Move Swarm center to waypoint
+	 */
+	void moveSwarmCenter();
+
+	/*!
+	 * @brief Make the kernel context of a lane current.
+	 * @param lane lane.
+	 */
+	void use( const Lane& lane );
+
+	/*!
+	 * @brief Switch back to the default kernel context.
+	 */
+	void restore();
+
+	/*!
+	 * @brief Upload a brick to its lane, step it and sort it into the lists. Doesn't wait.
+	 * @param b index of the brick.
+	 * @param advance false: only sort the uploaded owned fishies, e.g. to build the first halos.
+	 * @param readStats also read back the stats of the brick for the grid bounds.
+	 */
+	void launchBrick( unsigned int b, bool advance, bool readStats );
+
+	/*!
+	 * @brief Wait for the list counts of a brick and copy its lists into the parts of the next step.
+	 * The bricks have to be drained in order of x.
+	 * @param b index of the brick.
+	 * @return false, if a part has no room for its fishies.
+	 */
+	bool drainBrick( unsigned int b );
+
+	/*!
+	 * @brief Stream all bricks through the GPU once and swap the parts.
+	 * @param advance false: only sort the fishies into the parts.
+	 * @param readStats also read back the stats of every brick.
+	 * @return false, if a part ran out of slots.
+	 */
+	bool streamBricks( bool advance, bool readStats );
+
+	/*!
+	 * @brief Move the brick bounds towards the bricks with less fishies.
+	 */
+	void updateBounds();
+
+public:
+
+	/*!
+	 * @brief Constructor. Spawns the fishies into config.bricks bricks of equal width over the spawn box and builds the halos.
+	 * @param config Number of particles, sharks and bricks and the kernel settings. The Verlet search falls back to the grid.
+	 */
+	OutOfCoreSimulation( const SwarmConfig& config );
+
+	/*!
+	 * @brief Calculate one simulation step of all bricks. Waits for the last brick.
+	 * @return false, if a brick ran out of slots. The state is not valid anymore.
+	 */
+	bool step();
+
+	/*!
+	 * @brief Calculate the given number of steps and print the throughput.
+	 * @param steps number of steps.
+	 */
+	void run( unsigned int steps );
+
+	/*!
+	 * @brief Free Memory on the GPU and the pinned memory of the bricks.
+	 */
+	void cleanUp();
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "cuda_device_array.h"
+#include "cuda_host_array.h"
+
+/*!
+ * @brief Device pointers to the particle data (structure of arrays).
+ * Small enough to be passed by value into a kernel.
+ */
+struct ParticleArrays
+{
+	float* x;				//!< x position.
+	float* y;				//!< y position.
+	float* z;				//!< z position.
+	float* vx;				//!< x speed.
+	float* vy;				//!< y speed.
+	float* vz;				//!< z speed.
+	float* mass;			//!< Random factor per fish (speed and distances depend on it).
+	unsigned char* alive;	//!< 1 while the fish is alive, 0 after it was eaten.
+	unsigned int* id;		//!< Stable id of the fish (its index in spawn order). Kept when fishies are moved to other slots.
+};
+
+/*!
+ * @brief Get the arrays starting at a slot, e.g. to write a range of a store.
+ * @param arrays device pointers.
+ * @param offset first slot.
+ * @return device pointers to the slot offset.
+ */
+inline ParticleArrays offsetParticles( const ParticleArrays& arrays, size_t offset )
+{
+	ParticleArrays result = { arrays.x + offset, arrays.y + offset, arrays.z + offset, arrays.vx + offset, arrays.vy + offset,
+		arrays.vz + offset, arrays.mass + offset, arrays.alive + offset, arrays.id + offset };
+	return result;
+}
+
+/*!
+ * @brief ParticleStore holds all particle data on the GPU as structure of arrays.
+ * The neighbour search only has to load the positions (12 bytes per fish) this way.
+ */
+class ParticleStore
+{
+private:
+	size_t size_;							//!< Number of particles.
+
+	CudaDeviceArray<float> x_;				//!< x positions on device.
+	CudaDeviceArray<float> y_;				//!< y positions on device.
+	CudaDeviceArray<float> z_;				//!< z positions on device.
+	CudaDeviceArray<float> vx_;				//!< x speeds on device.
+	CudaDeviceArray<float> vy_;				//!< y speeds on device.
+	CudaDeviceArray<float> vz_;				//!< z speeds on device.
+	CudaDeviceArray<float> mass_;			//!< masses on device.
+	CudaDeviceArray<unsigned char> alive_;	//!< alive flags on device.
+	CudaDeviceArray<unsigned int> id_;		//!< stable ids on device.
+	ParticleArrays external_ = {};			//!< Positions, alive flags and speeds in buffers of another owner (attachPositions, attachSpeeds). NULL: the own arrays.
+
+public:
+
+	/*!
+	 * @brief Allocate the arrays for the given number of particles on the GPU.
+	 * @param size number of particles.
+	 */
+	explicit ParticleStore( size_t size );
+
+	ParticleStore( const ParticleStore& ) = delete;
+	ParticleStore& operator=( const ParticleStore& ) = delete;
+
+	/*!
+	 * @brief Copy interleaved host data to the GPU. All particles will be alive, the id is the index. Only before attachPositions and attachSpeeds.
+	 * @param verts positions (x, y, z, w) per particle. w is ignored.
+	 * @param states speed (x, y, z) and mass (w) per particle.
+	 * @param size number of particles to copy.
+	 */
+	void set( const float* verts, const float* states, size_t size );
+
+	/*!
+	 * @brief Migrate all arrays, e.g. to the host before an analysis reads them through getArrays.
+	 * Only has an effect in the unified memory mode (CudaMallocAllocator::setUnifiedMemory).
+	 * @param device target GPU, cudaCpuDeviceId: host.
+	 * @param stream the migration is ordered in this stream.
+	 */
+	void prefetch( int device, cudaStream_t stream );
+
+	/*!
+	 * @brief Get device pointers to all arrays.
+	 * @return device pointers.
+	 */
+	ParticleArrays getArrays();
+
+	/*!
+	 * @brief Keep positions and alive flags in buffers of another owner, e.g. the storage buffers OpenGL draws from.
+	 * The first call copies the own arrays into them and frees those. Later calls only take the new pointers, e.g. after
+	 * the buffers were mapped again, their content stays. The buffers must be mapped while getArrays is used.
+	 * @param x x positions, getSize entries.
+	 * @param y y positions.
+	 * @param z z positions.
+	 * @param alive alive flags.
+	 * @param stream the first copy is ordered in this stream.
+	 */
+	void attachPositions( float* x, float* y, float* z, unsigned char* alive, cudaStream_t stream );
+
+	/*!
+	 * @brief Keep the speeds in buffers of another owner, like attachPositions.
+	 * @param vx x speeds, getSize entries.
+	 * @param vy y speeds.
+	 * @param vz z speeds.
+	 * @param stream the first copy is ordered in this stream.
+	 */
+	void attachSpeeds( float* vx, float* vy, float* vz, cudaStream_t stream );
+
+	/*!
+	 * @brief Get number of particles.
+	 * @return number of particles.
+	 */
+	inline size_t getSize() const { return size_; }
+};
+
+/*!
+ * @brief PinnedParticleStore holds particle data in page-locked CPU memory, with the same arrays as ParticleStore.
+ * Ranges are copied to and from a ParticleStore asynchronously, e.g. to stream a swarm larger than device memory through the GPU.
+ */
+class PinnedParticleStore
+{
+private:
+	size_t size_;							//!< Number of particles.
+
+	CudaHostArray<float> x_;				//!< x positions on host.
+	CudaHostArray<float> y_;				//!< y positions on host.
+	CudaHostArray<float> z_;				//!< z positions on host.
+	CudaHostArray<float> vx_;				//!< x speeds on host.
+	CudaHostArray<float> vy_;				//!< y speeds on host.
+	CudaHostArray<float> vz_;				//!< z speeds on host.
+	CudaHostArray<float> mass_;				//!< masses on host.
+	CudaHostArray<unsigned char> alive_;	//!< alive flags on host.
+	CudaHostArray<unsigned int> id_;		//!< stable ids on host.
+
+public:
+
+	/*!
+	 * @brief Allocate the arrays for the given number of particles in pinned memory.
+	 * @param size number of particles.
+	 */
+	explicit PinnedParticleStore( size_t size );
+
+	PinnedParticleStore( const PinnedParticleStore& ) = delete;
+	PinnedParticleStore& operator=( const PinnedParticleStore& ) = delete;
+
+	/*!
+	 * @brief Get host pointers to all arrays. They are valid for cudaMemcpyAsync in both directions.
+	 * @return host pointers.
+	 */
+	ParticleArrays getArrays();
+
+	/*!
+	 * @brief Get number of particles.
+	 * @return number of particles.
+	 */
+	inline size_t getSize() const { return size_; }
+};
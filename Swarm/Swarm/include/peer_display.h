@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+
+#include "cuda_runtime.h"
+
+#include "cuda_device.h"
+#include "cuda_device_array.h"
+
+/*!
+ * @brief PeerDisplay splits simulation and display over two GPUs: the simulation runs on its compute GPU, the VBOs are
+ * registered and mapped on the GPU of the OpenGL context, which the desktop compositor shares. The packs of a frame are
+ * written into staging buffers on the compute GPU and copied peer to peer (cudaMemcpyPeerAsync) into the mapped VBOs,
+ * so the display GPU only draws while the compute GPU steps, the two only meet at the copies.
+ * The map and unmap are ordered on a stream of the display GPU: the compute stream waits for the map with an event,
+ * the unmap waits for the copies. Without a second GPU, or if the simulation runs on the one of the display, the split
+ * is disabled and the VBOs are mapped on the simulation GPU as usual.
+ */
+class PeerDisplay
+{
+private:
+
+	/*!
+	 * @brief VBO mapped in this frame.
+	 */
+	struct Mapping
+	{
+		int resource;						//!< Registered resource of the display GPU.
+		void* target;						//!< Mapped pointer on the display GPU.
+		size_t bytes;						//!< Size of the VBO.
+		bool staged;						//!< Written through stage in this frame, copied by unmap.
+	};
+
+	int computeDevice_;						//!< GPU of the simulation.
+	CudaDevice* display_ = NULL;			//!< GPU of the OpenGL context. NULL: disabled.
+	cudaStream_t displayStream_ = NULL;		//!< Stream of the display GPU for map and unmap.
+	cudaEvent_t mapped_ = NULL;				//!< Recorded on displayStream_ after the map.
+	cudaEvent_t copied_ = NULL;				//!< Recorded on the compute stream after the copies.
+	std::vector<Mapping> mappings_;			//!< VBOs of the last map.
+	std::vector<CudaDeviceArray<unsigned char>*> staging_;	//!< Staging buffer on the compute GPU per resource. NULL: not staged yet.
+
+public:
+
+	/*!
+	 * @brief Constructor. Picks the first GPU of the current OpenGL context as display GPU and enables peer access to it.
+	 * @param enabled false: disabled, e.g. config.splitDisplay.
+	 * @param computeDevice GPU of the simulation (CudaDevice::selectComputeDevice). Current afterwards.
+	 */
+	PeerDisplay( bool enabled, int computeDevice );
+
+	/*!
+	 * @brief Destructor. Waits for the display stream, frees the staging buffers. The VBOs have to be unregistered before.
+	 */
+	~PeerDisplay();
+
+	PeerDisplay( const PeerDisplay& ) = delete;
+	PeerDisplay& operator=( const PeerDisplay& ) = delete;
+
+	/*!
+	 * @brief Check if simulation and display run on different GPUs.
+	 * @return true, if the VBOs live on another GPU than the simulation.
+	 */
+	inline bool isEnabled() const { return display_ != NULL; }
+
+	/*!
+	 * @brief Get the display GPU, which registers the VBOs. Only if isEnabled.
+	 * @return device.
+	 */
+	inline CudaDevice& getDevice() { return *display_; }
+
+	/*!
+	 * @brief Make the display GPU current, e.g. to register or unregister the VBOs. Nothing if disabled.
+	 */
+	void makeDisplayCurrent();
+
+	/*!
+	 * @brief Make the compute GPU current again. Nothing if disabled.
+	 */
+	void makeComputeCurrent();
+
+	/*!
+	 * @brief Map VBOs on the display GPU. Later work of the stream waits for the map.
+	 * @param resources resources of getDevice() written in this frame.
+	 * @param stream stream of the simulation.
+	 */
+	void map( const std::vector<int>& resources, cudaStream_t stream );
+
+	/*!
+	 * @brief Get the staging buffer on the compute GPU of a mapped VBO, unmap copies it into the VBO.
+	 * @param resource resource of the last map.
+	 * @return device pointer of the compute GPU, as large as the VBO.
+	 */
+	void* stage( int resource );
+
+	/*!
+	 * @brief Copy the staged buffers peer to peer after the earlier work of the stream and unmap all VBOs once they arrived.
+	 * @param stream stream of the simulation.
+	 */
+	void unmap( cudaStream_t stream );
+};
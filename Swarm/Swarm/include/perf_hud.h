@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstring>
+
+#include "frame_profiler.h"
+#include "shader.h"
+#include "streaming_vertex_buffer.h"
+#include "vertex_array.h"
+
+/*!
+ * @brief PerfHud draws text and graphs over the frame, e.g. stage times and the frame time history for operators without a console.
+ * Text uses a built-in 5x7 pixel font: every run of lit font pixels of a row is one quad. All quads of a frame are written
+ * between begin and end into a region of one StreamingVertexBuffer, which is persistently mapped if the driver has
+ * ARB_buffer_storage, and go out in a single draw call. The HUD only draws what it is given, it reads nothing back itself.
+ */
+class PerfHud
+{
+private:
+
+	static const unsigned int MAX_QUADS = 8192;			//!< Quads per frame, the rest of a frame is dropped.
+	static const unsigned int VERTEX_FLOATS = 4;		//!< x, y in NDC, 0xRRGGBB and alpha.
+	static const unsigned int GLYPH_WIDTH = 5;			//!< Font pixels per glyph row.
+	static const unsigned int GLYPH_HEIGHT = 7;			//!< Rows per glyph.
+
+	Shader shader_;										//!< Plain colored triangles in NDC.
+	StreamingVertexBuffer* vb_ = NULL;					//!< Vertices of the frames in flight.
+	VertexArray va_;									//!< Single vec4 attribute.
+	float* vertices_ = NULL;							//!< Region of the frame between begin and end. NULL: not drawing.
+	unsigned int quads_ = 0;							//!< Quads written into vertices_.
+	float scaleX_ = 0.0f;								//!< NDC per pixel of the viewport.
+	float scaleY_ = 0.0f;
+	float pixel_;										//!< Screen pixels per font pixel.
+	bool shown_;										//!< Draw the HUD, toggled by the renderer.
+
+public:
+
+	/*!
+	 * @brief Constructor. Creates shader and buffer. Needs a current OpenGL context.
+	 * @param shown draw from the start.
+	 * @param pixel screen pixels per font pixel, e.g. 2.
+	 */
+	explicit PerfHud( bool shown, float pixel = 2.0f );
+
+	/*!
+	 * @brief Destructor. Deletes the buffer.
+	 */
+	~PerfHud();
+
+	PerfHud( const PerfHud& ) = delete;
+	PerfHud& operator=( const PerfHud& ) = delete;
+
+	/*!
+	 * @brief Show or hide the HUD.
+	 */
+	inline void toggle() { shown_ = !shown_; }
+
+	/*!
+	 * @brief Check if the HUD is drawn.
+	 * @return true, if shown.
+	 */
+	inline bool isShown() const { return shown_; }
+
+	/*!
+	 * @brief Get the height of a text line including the gap to the next one.
+	 * @return height in pixels.
+	 */
+	inline float lineHeight() const { return ( GLYPH_HEIGHT + 3 ) * pixel_; }
+
+	/*!
+	 * @brief Get the width of a text.
+	 * @param text text.
+	 * @return width in pixels.
+	 */
+	inline float textWidth( const char* text ) const { return std::strlen( text ) * ( GLYPH_WIDTH + 1 ) * pixel_; }
+
+	/*!
+	 * @brief Start the quads of a frame for the current viewport.
+	 */
+	void begin();
+
+	/*!
+	 * @brief Add a filled rectangle.
+	 * @param x left edge in pixels from the left of the viewport.
+	 * @param y top edge in pixels from the top of the viewport.
+	 * @param width width in pixels.
+	 * @param height height in pixels.
+	 * @param color 0xRRGGBB.
+	 * @param alpha opacity in [0, 1].
+	 */
+	void addRect( float x, float y, float width, float height, unsigned int color, float alpha = 1.0f );
+
+	/*!
+	 * @brief Add a line of text. Lower case is drawn as upper case, characters without a glyph as space.
+	 * @param x left edge in pixels.
+	 * @param y top edge in pixels.
+	 * @param text text.
+	 * @param color 0xRRGGBB.
+	 */
+	void addText( float x, float y, const char* text, unsigned int color );
+
+	/*!
+	 * @brief Add a bar graph of the newest samples, oldest on the left, with a line at the budget.
+	 * Bars over the budget are red, the others green. The scale is twice the budget.
+	 * @param x left edge in pixels.
+	 * @param y top edge in pixels.
+	 * @param width width in pixels, one bar per pixel column group.
+	 * @param height height in pixels.
+	 * @param times samples in ms.
+	 * @param budget budget in ms, > 0.
+	 * @param bars number of newest samples drawn.
+	 */
+	void addGraph( float x, float y, float width, float height, const StageTimes& times, float budget, unsigned int bars );
+
+	/*!
+	 * @brief Draw the quads of the frame in one call, with blending and without depth test.
+	 */
+	void end();
+};
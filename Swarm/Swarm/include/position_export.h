@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+
+#include "cuda_device_array.h"
+#include "particle_store.h"
+#include "position_ring.h"
+#include "swarm_config.h"
+
+/*!
+ * @brief PositionExport publishes the positions of every frame in a named shared memory ring (position_ring.h), so other processes
+ * can read them without sockets. The positions are packed by id on the simulation stream into a device ring, which other GPU
+ * processes open with the CUDA IPC handle, and copied once per frame into the registered shared memory for CPU processes.
+ * Any number of consumers read the same frames, nobody copies per consumer and the producer never waits for them.
+ * If the copy of a slot is still running when it comes round again, the frame is dropped and counted instead of waiting.
+ */
+class PositionExport
+{
+private:
+
+	/*!
+	 * @brief Argument of the host callback which publishes a slot after its copy.
+	 */
+	struct Pending
+	{
+		PositionRingHeader* header = NULL;		//!< Shared memory.
+		unsigned int slot = 0;					//!< Slot of the frame.
+		unsigned long long frame = 0;			//!< Number of the frame.
+	};
+
+	std::string name_;							//!< Name of the shared memory. Empty: disabled.
+	unsigned int slots_;						//!< Frames in the ring.
+	unsigned int entries_ = 0;					//!< Fishies per frame.
+	size_t slotBytes_ = 0;						//!< Bytes per frame.
+	size_t size_ = 0;							//!< Bytes of the shared memory.
+
+	PositionRingHeader* header_ = NULL;			//!< Start of the shared memory.
+	char* data_ = NULL;							//!< First frame in the shared memory.
+	bool registered_ = false;					//!< Shared memory is page locked for the GPU (cudaHostRegister).
+#ifdef _WIN32
+	void* mapping_ = NULL;						//!< Handle of the file mapping.
+#endif
+
+	CudaDeviceArray<char> d_ring_;				//!< Frames on the device, exported by CUDA IPC.
+	cudaStream_t copyStream_ = NULL;			//!< Side stream of the copies into shared memory.
+	cudaEvent_t packed_[EXPORT_MAX_SLOTS];		//!< Recorded on the simulation stream after packing a slot.
+	cudaEvent_t slotDone_[EXPORT_MAX_SLOTS];	//!< Recorded on the copy stream after publishing a slot.
+	Pending pending_[EXPORT_MAX_SLOTS];			//!< Callback arguments per slot.
+
+	unsigned long long published_ = 0;			//!< Published frames, also the number of the last one.
+	unsigned long long dropped_ = 0;			//!< Frames dropped, because the slot was still copied.
+	bool finished_ = false;						//!< finish was called, nothing is published anymore.
+
+	/*!
+	 * @brief Create and map the shared memory.
+	 * @return true, if header_ is valid.
+	 */
+	bool openSharedMemory();
+
+	/*!
+	 * @brief Unmap and remove the shared memory.
+	 */
+	void closeSharedMemory();
+
+	/*!
+	 * @brief Host callback on the copy stream: the frame of a slot is complete, end the write of the seqlock.
+	 * @param pending Pending of the slot.
+	 */
+	static void CUDART_CB onCopied( void* pending );
+
+public:
+
+	/*!
+	 * @brief Constructor. Creates the shared memory and the device ring, if config.exportName is set.
+	 * @param config export settings (export, export_slots, export_ipc).
+	 * @param numParticles number of fishies (ids 0 to numParticles - 1).
+	 * @param device GPU of the simulation, written into the header for the IPC consumers.
+	 */
+	PositionExport( const SwarmConfig& config, unsigned int numParticles, int device );
+
+	/*!
+	 * @brief Destructor. Waits for the last copy and removes the shared memory.
+	 */
+	~PositionExport();
+
+	PositionExport( const PositionExport& ) = delete;
+	PositionExport& operator=( const PositionExport& ) = delete;
+
+	/*!
+	 * @brief Publish the positions of the fishies. Returns without waiting for the GPU.
+	 * @param particles current state.
+	 * @param mesh_count number of fishies in the active set.
+	 * @param step number of the step.
+	 * @param stream simulation stream. The particles are read on it before the next kernels.
+	 */
+	void publish( ParticleArrays particles, unsigned int mesh_count, unsigned long long step, cudaStream_t stream );
+
+	/*!
+	 * @brief Wait for the last copy and print the number of published and dropped frames.
+	 */
+	void finish();
+
+	/*!
+	 * @brief Check if the positions are exported.
+	 * @return true, if the shared memory exists.
+	 */
+	inline bool isEnabled() const { return header_ != NULL; }
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+
+#include <cuda_runtime.h>
+
+/*
+ * Shared memory ring of PositionExport, named by --export: PositionRingHeader, padded to its size, then slots frames of
+ * slotBytes each. A frame is x, then y, then z of all fishies in the order of their ids (entries floats each, NaN for dead fishies),
+ * like an unquantised trajectory frame. With ipc set, the same frames are in device memory behind ipcHandle, at the same offsets.
+ * Every slot is guarded by a seqlock: sequence is odd while the producer writes the slot. A consumer reads latest, the slot
+ * latest % slots, copies it and accepts the copy if sequence was even and didn't change (readPositionRing).
+ */
+
+static const char POSITION_RING_MAGIC[8] = { 'S', 'W', 'A', 'R', 'M', 'I', 'P', 'C' };
+static const unsigned int POSITION_RING_VERSION = 1;
+static const unsigned int EXPORT_MAX_SLOTS = 16;		//!< Largest --export_slots.
+
+static_assert( std::atomic<unsigned long long>::is_always_lock_free, "The seqlocks are shared between processes" );
+
+/*!
+ * @brief Seqlock and description of one frame of the ring.
+ */
+struct alignas( 64 ) PositionRingSlot
+{
+	std::atomic<unsigned long long> sequence;	//!< Odd while the frame is written. Changes with every write.
+	unsigned long long frame;					//!< Number of the published frame, 1 for the first one.
+	unsigned long long step;					//!< Simulation step of the frame.
+	unsigned int live;							//!< Fishies in the active set at this step.
+};
+
+/*!
+ * @brief Header at the start of the shared memory.
+ */
+struct PositionRingHeader
+{
+	char magic[8];								//!< POSITION_RING_MAGIC.
+	unsigned int version;						//!< POSITION_RING_VERSION.
+	unsigned int slots;							//!< Frames in the ring.
+	unsigned int entries;						//!< Fishies per frame (ids 0 to entries - 1).
+	unsigned int ipc;							//!< 1: ipcHandle and device are valid.
+	unsigned long long slotBytes;				//!< Bytes per frame, 3 * entries floats padded to 256 bytes.
+	unsigned long long dataOffset;				//!< Offset of the first frame from the start of the shared memory.
+	int device;									//!< GPU of ipcHandle.
+	cudaIpcMemHandle_t ipcHandle;				//!< Device frames, open with cudaIpcOpenMemHandle on a GPU with peer access to device.
+	std::atomic<unsigned long long> latest;		//!< Number of the newest complete frame. 0: none yet.
+	PositionRingSlot slot[EXPORT_MAX_SLOTS];	//!< Seqlocks of the frames.
+};
+
+/*!
+ * @brief Copy the newest frame out of the ring (CPU consumers). Doesn't block the producer: gives up if the producer
+ * overwrites the frame during the copy, so call it again on false.
+ * @param header start of the shared memory.
+ * @param out Output: 3 * header->entries floats.
+ * @param frame Output: number of the copied frame. Unchanged on false.
+ * @param step Output: simulation step of the copied frame. Unchanged on false.
+ * @return true, if out holds a complete frame.
+ */
+inline bool readPositionRing( const PositionRingHeader* header, float* out, unsigned long long& frame, unsigned long long& step )
+{
+	unsigned long long latest = header->latest.load( std::memory_order_acquire );
+	if ( latest == 0 )
+		return false;
+
+	const PositionRingSlot& slot = header->slot[latest % header->slots];
+	unsigned long long before = slot.sequence.load( std::memory_order_acquire );
+	if ( before % 2 == 1 )														// Being written
+		return false;
+
+	unsigned long long copiedFrame = slot.frame;
+	unsigned long long copiedStep = slot.step;
+	const char* data = reinterpret_cast< const char* >( header ) + header->dataOffset + latest % header->slots * header->slotBytes;
+	std::memcpy( out, data, header->entries * 3 * sizeof( float ) );
+	std::atomic_thread_fence( std::memory_order_acquire );						// Copy before the second read of the sequence
+	if ( slot.sequence.load( std::memory_order_relaxed ) != before )
+		return false;
+
+	frame = copiedFrame;
+	step = copiedStep;
+	return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+
+#include "swarm_config.h"
+
+/*!
+ * @brief Knobs of one quality level of the window. Level 0 is the configuration, every further level is cheaper.
+ */
+struct QualityLevel
+{
+	unsigned int maxSubsteps;				//!< Steps per frame at most, the rest of the elapsed time is dropped.
+	unsigned int firstK;					//!< Neighbour query stops after this number of close fishies (kernel_set_first_k). 0: closest fish.
+	unsigned int multiRate;					//!< Unimportant fishies advance every this number of steps (kernel_set_multi_rate).
+	float lodDistance;						//!< Culling with instanced: fishies farther from the camera are drawn as points.
+	unsigned int trailLength;				//!< Newest entries drawn per trail, at most config.trails.
+	float renderScale;						//!< Resolution of the scene target relative to the window (SceneTarget).
+};
+
+/*!
+ * @brief QualityController holds the frame work inside a budget by trading fidelity for time, e.g. when the whole swarm
+ * crowds into one waypoint or fill rate limits a large window. It watches the load of every frame: the larger of the CPU time
+ * (simulation and render parts of the FrameTimeRecorder) and the GPU time of the collected frame (FrameProfiler),
+ * so waiting for V-Sync doesn't count.
+ * If the mean of a window of frames exceeds the budget, the next cheaper level is taken. If it stays below the budget
+ * by the hysteresis for longer, the next better level comes back. A level that was over budget right after it came back
+ * waits twice as long for the next try, so the controller doesn't toggle between two levels.
+ */
+class QualityController
+{
+private:
+
+	static const unsigned int WINDOW = 30;			//!< Frames per decision. Cleared on every change, so the old level doesn't count.
+	static const unsigned int UPGRADE_FRAMES = 120;	//!< Frames below the low water mark before the better level comes back.
+	static const unsigned int MAX_UPGRADE_FRAMES = 3840;	//!< Longest wait after failed upgrades, about a minute at 60 Hz.
+
+	bool enabled_;									//!< false: level 0 is kept.
+	float budget_;									//!< Target of the frame work in ms.
+	std::vector<QualityLevel> levels_;				//!< Levels from the configuration to the cheapest one.
+	size_t level_ = 0;								//!< Level in use.
+	double sum_ = 0.0;								//!< Sum of the loads of the window in ms.
+	unsigned int samples_ = 0;						//!< Frames in the window.
+	unsigned int calmFrames_ = 0;					//!< Frames in a row below the low water mark.
+	unsigned int upgradeFrames_ = UPGRADE_FRAMES;	//!< Calm frames the next upgrade waits for.
+	unsigned int sinceUpgrade_ = 0;					//!< Frames since the last upgrade. A downgrade within two windows doubles upgradeFrames_.
+	bool upgraded_ = false;							//!< The last change was an upgrade.
+
+	/*!
+	 * @brief Take another level and start a new window.
+	 * @param level index in levels_.
+	 */
+	void change( size_t level );
+
+public:
+
+	/*!
+	 * @brief Constructor. Builds the levels from the configuration, enabled with config.qualityBudget on one GPU.
+	 * @param config budget, knobs of level 0, trails and culling.
+	 * @param maxSubsteps steps per frame of level 0.
+	 */
+	QualityController( const SwarmConfig& config, unsigned int maxSubsteps );
+
+	/*!
+	 * @brief Add the load of a frame and go on with the decision. Call once per frame.
+	 * @param cpuMs CPU time of the frame without waiting for the display.
+	 * @param gpuMs GPU time of the collected frame. < 0: no sample.
+	 * @return true, if the knobs changed (getLevel).
+	 */
+	bool update( double cpuMs, double gpuMs );
+
+	/*!
+	 * @brief Get the knobs of the level in use.
+	 * @return knobs.
+	 */
+	inline const QualityLevel& getLevel() const { return levels_[level_]; }
+
+	/*!
+	 * @brief Get the index of the level in use.
+	 * @return 0: configuration, higher is cheaper.
+	 */
+	inline size_t getIndex() const { return level_; }
+
+	/*!
+	 * @brief Check if the level can change.
+	 * @return true, if a budget is set.
+	 */
+	inline bool isEnabled() const { return enabled_; }
+};
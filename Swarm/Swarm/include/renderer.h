@@ -2,86 +2,403 @@
 
 #include "cuda_device.h"
 #include "cuda_device_array.h"
+#include "cuda_mailbox.h"
+#include "event_log.h"
+#include "frame_capture.h"
+#include "frame_pipeline.h"
+#include "frame_profiler.h"
+#include "frame_times.h"
+#include "gpu_telemetry.h"
+#include "job_system.h"
+#include "metrics_exporter.h"
+#include "particle_store.h"
+#include "peer_display.h"
+#include "perf_hud.h"
+#include "position_export.h"
+#include "quality_controller.h"
+#include "scene_target.h"
+#include "search_selector.h"
 #include "shader.h"
+#include "stats_ring.h"
+#include "simulation_backend.h"
+#include "swarm_simulation.h"
+#include "swarm_stats.h"
 #include "vertex_array.h"
-#include "waypoint_list.h"
+#include "swarm_config.h"
+#include "trajectory_recorder.h"
+#include "video_recorder.h"
+#include "vulkan_interop.h"
+#include "uniform_buffer.h"
+#include "streaming_vertex_buffer.h"
+
+class StartupOrchestrator;
+
+class MultiGpuSimulation;
 
 /*!
  * @brief Renderer is used as main class.
- * Class contains methods to render the scene.
+ * Class contains methods to render the scene. CUDA backend: the kernels write into the VBOs through the interop.
+ * The steps are the ones of SwarmSimulation, the renderer only packs and draws its stores.
  */
-class Renderer
+class Renderer : public SimulationBackend
 {
 private:
 
 	Shader shader_;							//!< Contains Shader (Vertex und Fragment shader).
-	VertexArray va_;						//!< Vertex Array to render particles.
+	Shader fishShader_;						//!< Shader for the instanced fish meshes.
+	Shader trailShader_;					//!< Shader of the trails, reads the ring buffers as texture buffers.
+	int trailHeadLocation_ = -1;			//!< Location of u_head in trailShader_.
+	Shader impostorShader_;					//!< Shader of the sphere impostors, writes the depth of the sphere.
+	int impostorPointSizeLocation_ = -1;	//!< Location of u_pointsize in impostorShader_.
+	int impostorLagLocation_ = -1;			//!< Location of u_lag in impostorShader_.
+	int impostorViewportLocation_ = -1;		//!< Location of u_viewport in impostorShader_.
+	Shader clusterShader_;					//!< Shader of the cluster impostors, soft splats as large as the spread of the cluster.
+	int clusterViewportLocation_ = -1;		//!< Location of u_viewport in clusterShader_.
+	UniformBuffer* frameUniforms_ = NULL;	//!< Matrices and fish size of the frame (FrameUniforms block of both shaders).
+	UniformBuffer* schoolDraws_ = NULL;		//!< Data per school of the culled multi draws (SchoolDraws), written once. NULL: no ARB_shader_draw_parameters.
+	int schoolDrawsLocation_ = -1;			//!< Location of u_schooldraws in shader_.
+	unsigned int cullSchools_ = 1;			//!< Schools with draw commands of their own in the culling pass. 1: one mesh and one point draw for all.
+	int pointSizeLocation_;					//!< Location of u_pointsize in shader_.
+	int lagLocation_;						//!< Location of u_lag in shader_.
+	Shader* pullShader_ = NULL;				//!< Shader of the points with vertex pulling, reads the particle stores as storage buffers. NULL: packed points.
+	int pullPointSizeLocation_ = -1;		//!< Location of u_pointsize in pullShader_.
+	int colorModeLocation_ = -1;			//!< Location of u_colormode in shader_.
+	int pullColorModeLocation_ = -1;		//!< Location of u_colormode in pullShader_.
+	ColorMode colorMode_;					//!< What the colors of the point fishies show, key M switches.
+	bool stateColors_ = false;				//!< The point shaders compute the colors (no culling, meshes or impostors), colorMode_ can change.
+	unsigned int schools_;					//!< Schools of the simulation, one hue each in ColorMode::SCHOOL.
+	GLuint sharkTexture_ = 0;				//!< Texture buffer (GL_RGBA32F) of vbShark_, the fear colors read it.
+	static const int SHARK_TEXTURE_UNIT = 3;	//!< Texture unit of sharkTexture_, after the ones of the trails.
+	static constexpr float SHARK_POINT_SCALE = 3.75f;	//!< Point size of a shark over the one of a fish (15 to 4 pixels).
+	bool agents_ = false;					//!< Sharks live behind the fishies in vb_, one draw for all agents. Packed points without impostors or depth sort.
+	VertexArray va_[2];						//!< Vertex Arrays to render particles. One per position buffer, the other one is the previous position.
+	VertexArray vaFish_[2];					//!< Vertex Arrays to render instanced fish meshes. One per position buffer.
+	VertexArray vaCullMesh_;				//!< Vertex Array of the culled mesh fishies (instanced).
+	VertexArray vaCullPoints_;				//!< Vertex Array of the culled point fishies.
+	VertexArray vaClusters_;				//!< Vertex Array of the cluster impostors.
 	VertexArray vaShark;					//!< Vertex Array to render shark.
+	VertexArray vaOverlay_;					//!< Vertex Array of the debug overlay.
+	VertexArray vaDensity_;					//!< Vertex Array of the density map.
+	VertexArray vaTrail_;					//!< Vertex Array of the trails. No attributes, the shader fetches by instance and vertex.
+	VertexArray vaPull_;					//!< Vertex Array of the pulled points. Only the colors are an attribute.
+
+	VertexBuffer* vb_[2] = {};				//!< Position buffers. The kernel packs the new positions into one while the other one holds the last step.
+	static const unsigned int PULLED_ARRAYS = 7;	//!< Arrays of a store in vbParticles_, in the order of the storage buffer bindings.
+	VertexBuffer* vbParticles_[2][PULLED_ARRAYS] = {};	//!< Vertex pulling: x, y, z, alive, vx, vy and vz of both particle stores. CUDA holds them mapped except while they are drawn.
+	std::vector<int> particleResources_;	//!< CUDA resource indices of vbParticles_, store by store.
+	VertexBuffer* vbC_;						//!< Color buffer.
+	VertexBuffer* vbShark_;					//!< Shark position buffer. Written by CUDA.
+	VertexBuffer* vbSharkC_;				//!< Shark color buffer.
+	VertexBuffer* vbAgent_ = NULL;			//!< Type (0: fish, 1: shark) and point size factor of every agent in vb_. Only with agents_.
+	VertexBuffer* vbMesh_ = NULL;			//!< Fish mesh, same for every instance.
+	VertexBuffer* vbDir_ = NULL;			//!< Direction buffer of the fish meshes and the speed colors of the points. Written by CUDA.
+	VertexBuffer* vbCull_[3] = {};			//!< Visible fishies: positions, colors, directions. Written by the culling pass.
+	VertexBuffer* vbIndirect_ = NULL;		//!< Draw commands of the culling pass (DrawCommand).
+	VertexBuffer* vbClusters_[2] = {};		//!< Cluster impostors: centroids with radius, colors. Written by the culling pass.
+	VertexBuffer* vbDensity_[2] = {};		//!< Density map: positions and colors of the texels. Written by CUDA.
+	VertexBuffer* ibDepth_ = NULL;			//!< Depth sort: slots in draw order, element buffer of the point draw. Written by CUDA.
+	VertexBuffer* vbTrail_[3] = {};			//!< Trails: x, y and z (half) by entry * numParticles_ + id. Appended by CUDA.
+	GLuint trailTextures_[3] = {};			//!< Texture buffers (GL_R16F) of vbTrail_.
+	StreamingVertexBuffer* vbOverlay_[2] = {};	//!< Positions and colors of the debug overlay, written by the CPU every frame.
+	bool overlay_;							//!< Draw the debug overlay.
+	bool lateInput_;						//!< Take the camera of the events right before the draws.
+	bool lateLatch_;						//!< Overwrite the matrices of the main view after its draws are issued.
+	int vbResource_[2];						//!< CUDA resource index of the position buffers.
+	int vbSharkResource_;					//!< CUDA resource index of the shark position buffer.
+	VulkanInterop* interop_ = NULL;			//!< Shares vb_, vbC_ and vbShark_ with CUDA without a map. Disabled: they are registered and mapped.
+	int vbExternal_[2] = { -1, -1 };		//!< Buffers of interop_ under vb_. -1: registered.
+	int vbCExternal_ = -1;					//!< Buffer of interop_ under vbC_. -1: registered.
+	int vbSharkExternal_ = -1;				//!< Buffer of interop_ under vbShark_. -1: registered.
+	int vbCResource_;						//!< CUDA resource index of the color buffer.
+	int vbDirResource_ = -1;				//!< CUDA resource index of the direction buffer.
+	int vbCullResource_[3] = { -1, -1, -1 };	//!< CUDA resource indices of vbCull_.
+	int vbIndirectResource_ = -1;			//!< CUDA resource index of vbIndirect_.
+	int vbClustersResource_[2] = { -1, -1 };	//!< CUDA resource indices of vbClusters_.
+	int ibDepthResource_ = -1;				//!< CUDA resource index of ibDepth_.
+	int vbDensityResource_[2] = { -1, -1 };	//!< CUDA resource indices of vbDensity_.
+	int vbTrailResource_[3] = { -1, -1, -1 };	//!< CUDA resource indices of vbTrail_.
+	bool density_;							//!< Draw the density map.
+	unsigned int trailLength_;				//!< Entries per trail. 0: no trails.
+	unsigned int trailDrawn_;				//!< Newest entries drawn per trail, set by quality_. 0: trails are appended but not drawn.
+	unsigned int trailEvery_;				//!< Steps between two appends.
+	unsigned int trailHead_ = 0;			//!< Newest entry of the trails.
+	unsigned int stepsSinceTrail_ = 0;		//!< Steps since the last append.
+	bool instanced_;						//!< Draw fish meshes instead of points.
+	bool culling_;							//!< Draw only the visible fishies, the GPU writes the draw commands.
+	float lodDistance_;						//!< Culling: closer fishies are meshes, the others points.
+	float clusterDistance_;					//!< Culling: farther fishies are drawn as cluster impostors. 0: no clusters.
+	float clusterCellSize_;					//!< Edge of a cluster cell at clusterDistance_, doubled with the distance.
+	bool depthSort_;						//!< Draw the points back to front, sorted on the GPU every frame. Front to back with impostors_.
+	bool impostors_;						//!< Draw the point fishies as opaque sphere impostors with depth test, without blending.
+	bool interpolate_;						//!< Draw the points between the last two packed steps.
+	unsigned int sharkViews_ = 0;			//!< Close-up viewports, one per followed shark. 0: only the camera of the window.
+	bool sharkViewsShown_ = true;			//!< Key V hides and shows the shark views.
+	bool previousValid_ = false;			//!< The other position buffer holds the step before the newest one, in the same slots.
+	CudaDeviceArray<unsigned int> d_cullCounts;	//!< Counters of the culling pass.
+	bool colorsDirty_ = false;				//!< Fishies moved to other slots, the color buffer has to be rewritten.
+	unsigned int drawn_ = 0;				//!< Index of the position buffer with the newest packed step. Swapped with every pack.
 	
-	CudaDevice device_;						//!< Cuda Device. Used to simply communicate with the gpu.
+	SwarmSimulation* simulation_ = NULL;	//!< Stores, colors, sharks and stats on the GPU. Stepped by runCuda.
+	CudaDevice* device_ = NULL;				//!< Device of simulation_, or the display GPU of peer_. Registers and maps the VBOs.
+	FramePipeline* pipeline_ = NULL;		//!< Back buffers of the packs, if the simulation runs a frame ahead of the draws.
+	PeerDisplay* peer_ = NULL;				//!< Copies the packs from the GPU of simulation_ into the VBOs on the display GPU. Disabled: same GPU.
+	cudaStream_t stream_;					//!< Stream of simulation_, for all kernels and copies.
+	TraceExporter trace_;					//!< Chrome trace of the frames and stages. Before profiler_ and frameTimes_, so it outlives them.
+	FrameProfiler profiler_;				//!< Times map, advance, pack, unmap, draw and swap of every frame.
+	SearchSelector selector_;				//!< Neighbour search from the advance times of profiler_, key N switches by hand.
+	QualityController quality_;				//!< Levels of substeps, first k, multi-rate, LOD distance and trails for config.qualityBudget.
+	float multiRateShark_;					//!< Shark range of the multi-rate steps, kept by every quality level.
+	float multiRateFocus_;					//!< Focus range of the multi-rate steps, kept by every quality level.
+	FrameTimeRecorder frameTimes_;			//!< Wall time of the last frames: simulation, render and present.
+	std::string frameDump_;					//!< File for the frame times at exit. Empty: no dump at exit.
+	GpuTelemetry* telemetry_ = NULL;		//!< Clocks, power and energy of the GPU of simulation_, recorded with every frame. Disabled without config.telemetry.
+	double fishSteps_ = 0.0;				//!< Fish updates since the start, for the energy per fish step.
+	MetricsExporter metrics_;				//!< Serves the values of publishMetrics on config.metricsPort. Disabled without a port.
+	double metricsTime_ = -1.0;				//!< Time of the last publication. < 0: none yet.
+	StatsRing* statsRing_ = NULL;			//!< Aggregates of every frame on the GPU, read back in bulk. Disabled without config.statsHistory.
+	MetricsSample series_;					//!< Series values of the last read back of statsRing_ (MetricsSample::seriesFrames on).
+	std::vector<int> mapList_;				//!< Resources of the current map, filled again every frame without allocating.
+	unsigned int steadyFrames_ = 0;			//!< Frames since the start or the last reconfiguration, see checkAllocations.
+	unsigned int allocationReports_ = 0;	//!< Steady frames reported by checkAllocations.
+	unsigned long long metricsSteps_ = 0;	//!< Simulation steps at the last publication.
+	TrajectoryRecorder trajectory_;			//!< Writes the positions every few frames. Does nothing without config.trajectory.
+	EventLog* events_ = NULL;				//!< Writes the fish events every frame. NULL: no config.events or several GPUs.
+	PositionExport* export_ = NULL;			//!< Publishes the positions every frame. Does nothing without config.exportName.
+	MultiGpuSimulation* multi_ = NULL;		//!< Simulates on several GPUs, the fishies are gathered into particles_ for drawing. NULL: one GPU.
+	VideoRecorder* video_ = NULL;			//!< Encodes the frames with NVENC. NULL: no config.video or no encoder.
+	PerfHud* hud_ = NULL;					//!< Stage times, frame graph, fishies, memory and search over the window, key H.
+	FrameCapture* capture_ = NULL;			//!< Reads the frames back into pixel buffers and writes them on jobs_, key C or config.capture.
+	SceneTarget* sceneTarget_ = NULL;		//!< Scaled off-screen target of the draws. NULL: the draws go into the window or the video frame.
+	float pixelScale_ = 1.0f;				//!< Scale of sceneTarget_ in the frame, point sizes in pixels are scaled with it.
+	unsigned long long videoFrames_ = 0;	//!< Close the window after this number of video frames (headless video). 0: no limit.
 
-	std::vector<float> h_data;				//!< contains positions on host.
-	std::vector<float> h_color;				//!< contains colors on host.
-	std::vector<float> h_state;				//!< contains vec3 force and mass on host.
-	std::vector<float> h_shark_data;		//!< contains shark position on host.
-	std::vector<float> h_shark_color;		//!< contains shark color on host.
-	std::vector<float> h_shark_state;		//!< contains force and mass on host.
+	JobSystem jobs_;						//!< CPU jobs of a frame, run while the GPU simulates and draws. After profiler_ and frameTimes_, so it is destroyed first.
+	JobSystem::Handle statsJob_;			//!< Title summary and console report. Reads the profiler samples, so the next frame waits for it before beginFrame.
+	JobSystem::Handle dumpJob_;				//!< Frame time file of key F. Writes a copy of frameTimes_, only waited for by the next dump and at exit.
+	std::string titleInfo_;					//!< Summary for the window title, written by statsJob_.
 
-	CudaDeviceArray<float>* d_state;		//!< contains force and mass in memory on device.
-	CudaDeviceArray<float>* d_color;		//!< contains color in memory on device.
+	unsigned int numParticles_;				//!< Number of Particles
+	unsigned int numSharks_;				//!< Number of Sharks. Moved on GPU.
 
-	const float WAYPOINT_THRESHOLD = 0.1;	//!< Threshold for waypoint goal.
+	static const unsigned int MAX_SHARK_VIEWS = 4;	//!< Shark views side by side along the top edge.
+	static const unsigned int ALLOCATION_WARMUP = 120;	//!< Frames after a reconfiguration which may allocate, see checkAllocations.
+	static const unsigned int MAX_ALLOCATION_REPORTS = 8;	//!< Reported steady frames, the first ones show the culprit.
 
-	float speed = 0.015;					//!< speed of particles.
-	WaypointList* waypointList;				//!< Waypoint List contains waypoints for particles.
-	Vector3 swarmCenter;					//!< Position of swarm center.
+	/*!
+	 * @brief Positions of the followed sharks, read back for the cameras of the shark views.
+	 */
+	struct SharkPositions
+	{
+		float4 positions[MAX_SHARK_VIEWS];	//!< Swarm space, in the order of the sharks.
+	};
+	CudaMailbox<SharkPositions>* sharkMailbox_ = NULL;	//!< Shark positions of the last frame, without a wait. NULL: no shark views.
+	CudaMailbox<PickResult>* pickMailbox_ = NULL;	//!< Fish under the last click, written by kernel_pick.
+	bool picked_ = false;					//!< A pick arrived, the HUD shows pickMailbox_->value().
 
 	double lastUpdate_, currentTime_;		//!< times for v-sync.
+	double dt_;								//!< Simulated time per step (fixed timestep).
+	double accumulator_ = 0.0;				//!< Elapsed time which is not simulated yet.
+
+	static const unsigned int MAX_SUBSTEPS = 8;	//!< Maximum steps per frame. Remaining time is dropped, so a slow frame can't stall the next ones.
+	unsigned int maxSubsteps_ = MAX_SUBSTEPS;	//!< Maximum steps per frame of the quality level.
 
 	/*!
 	 * @brief Create Buffers.
-	 * Allocate memory on GPU and initialize gpu grid.
-	 * Also register VBO with CUDA.
+	 * Allocate the VBOs and register them with CUDA. The particles are the ones of simulation_.
+	 * @param config config of the run (spawn box).
 	 */
-	void createBuffers();
+	void createBuffers( const SwarmConfig& config );
+
+	/*!
+	 * @brief Create a buffer CUDA writes every frame: on memory of interop_, if it is enabled, else a VertexBuffer.
+	 * @param data initial content, size bytes. NULL: undefined.
+	 * @param size size in bytes.
+	 * @param external Output: buffer of interop_. -1: a VertexBuffer, register it with CUDA.
+	 * @return buffer.
+	 */
+	VertexBuffer* createSharedBuffer( const void* data, unsigned int size, int& external );
+
+	/*!
+	 * @brief Get the CUDA pointer of a buffer of createSharedBuffer. Mapped buffers have to be mapped.
+	 * @param resource CUDA resource index of a registered buffer.
+	 * @param external buffer of interop_. -1: the mapped resource.
+	 * @return device pointer.
+	 */
+	void* sharedPointer( int resource, int external );
 
 	/*!
 	 * @brief Call CUDA Function to calculate new positions per particle.
+	 * Writes the positions of the last step into the VBO.
+	 * @param steps number of steps to simulate. Nothing is calculated for 0.
+	 */
+	void runCuda( unsigned int steps );
+
+	/*!
+	 * @brief Culling pass: write the visible fishies of the current buffer and their draw commands.
+	 * Runs every frame and viewport, also without steps, because the camera moves. The caller times it.
+	 * @param modelView view * model matrix.
+	 * @param projection projection matrix.
+	 */
+	void cullFishies( const glm::mat4& modelView, const glm::mat4& projection );
+
+	/*!
+	 * @brief Depth sort: write the slots of the current buffer back to front into the index buffer.
+	 * Runs every frame and viewport, also without steps, because the camera moves. The caller times it.
+	 * @param modelView view * model matrix.
+	 */
+	void sortFishies( const glm::mat4& modelView );
+
+	/*!
+	 * @brief Vertex pulling: map the buffers of the particle stores for CUDA and attach the stores to them again,
+	 * because the pointers can change with every map.
+	 */
+	void holdParticles();
+
+	/*!
+	 * @brief Vertex pulling: draw the points straight from the buffers of the current store with pullShader_.
+	 * The buffers are released for the draw and held again afterwards.
+	 */
+	void drawPulledFishies();
+
+	/*!
+	 * @brief Draw fishies, trails, density map and sharks into the viewport, with the matrices of the last upload of frameUniforms_.
+	 * The culled buffers or the depth order have to be the ones of this viewport.
+	 * @param lag steps behind the newest one for the interpolation.
+	 */
+	void drawScene( float lag );
+
+	/*!
+	 * @brief Draw the shark views over the top edge of the viewport. Each one clears its rectangle, uploads the matrices
+	 * of a camera behind its shark, culls or sorts for it and draws the scene again. The step is the one of the main view.
+	 * @param model model matrix of the frame.
+	 * @param lag steps behind the newest one for the interpolation.
+	 */
+	void drawSharkViews( const glm::mat4& model, float lag );
+
+	/*!
+	 * @brief Take the shark positions which arrived and read the ones of this frame into sharkMailbox_. Call after the steps.
+	 */
+	void readSharks();
+
+	/*!
+	 * @brief Take a pick which arrived and print the fish. On a click unproject the cursor into a ray in swarm space and
+	 * pick the first fish along it on stream_ (kernel_pick), the hit arrives in pickMailbox_ without a wait. Call after the steps.
+	 * @param modelView model and view matrix of the frame.
+	 * @param projection projection matrix of the frame.
+	 */
+	void pickFish( const glm::mat4& modelView, const glm::mat4& projection );
+
+	/*!
+	 * @brief Draw swarm center (white) and current waypoint (red) as big points with shader_.
+	 */
+	void drawOverlay();
+
+	/*!
+	 * @brief Draw one line strip per fish through its trail, oldest entry first, with trailShader_.
 	 */
-	void runCuda();
+	void drawTrails();
 
 	/*!
-	 * @brief Move Swarm center to waypoint
+	 * @brief Draw the performance HUD into the top left corner of the window. Only reads what is on the host already:
+	 * collected timers of the profiler, frame times, the stats mailbox, the memory counters and the search of selector_.
 	 */
-	void moveSwarmCenter();
+	void drawHud();
 
 	/*!
-	 * @brief Move shark in a pseudo realistic manner.
-	 * It moves roughly through the swarm center to maximise probability of catching a fish.
-	 * Sometimes circles around the swarm.
+	 * @brief Take a read back of statsRing_ which arrived and sum the series up into series_, for the HUD and the metrics.
 	 */
-	void moveShark();
+	void readStatsSeries();
+
+	/*!
+	 * @brief Hand frame time percentiles, steps per second, live fishies and device memory to metrics_, twice per second.
+	 * Lock free, the network I/O is on the thread of the exporter.
+	 */
+	void publishMetrics();
+
+	/*!
+	 * @brief Debug builds: report steady frames which allocated. A frame is steady ALLOCATION_WARMUP frames after the start
+	 * and after every reconfiguration (search, quality level, keys), when the lazily created buffers exist.
+	 * @param before countedAllocations at the start of the frame.
+	 * @param reconfigured the frame changed the search, the quality level or a mode.
+	 */
+	void checkAllocations( unsigned long long before, bool reconfigured );
+
+	/*!
+	 * @brief Bind the shader of the fish points: shader_ or, with impostors_, impostorShader_ without blending.
+	 * @param lag steps behind the newest one for the interpolation. 0: newest step.
+	 */
+	void beginFishPoints( float lag );
+
+	/*!
+	 * @brief Back to shader_ and blending after the fish points, e.g. for the sharks.
+	 */
+	void endFishPoints();
+
+	/*!
+	 * @brief Draw the cluster impostors of the culling pass as soft splats, without depth writes.
+	 */
+	void drawClusters();
+
+	/*!
+	 * @brief Set the color mode of a bound point shader and bind the sharks for the fear colors.
+	 * @param shader shader_ or pullShader_, bound.
+	 * @param location location of u_colormode in shader.
+	 * @param fishies true: colorMode_ for the fishies. false: static colors again, e.g. for the sharks.
+	 */
+	void setFishColors( Shader& shader, int location, bool fishies );
+
+	/*!
+	 * @brief Feed the load of the last frame to quality_ and apply the knobs of a new level.
+	 * @return true, if a new level was applied.
+	 */
+	bool updateQuality();
 
 
 public:
-	static const unsigned int NUM_PARTICLES = 1000;	//!< Number of Particles
-	static const unsigned int NUM_SHARKS = 1;		//!< Number of Sharks. While on CPU only one shark.
+	/*!
+	 * @brief Constructor. 
+	 * Initialize the simulation, Buffers and Shader.
+	 * @param config Number of particles and sharks.
+	 * @param startup takes the simulation spawned in the background and times the phases. NULL: spawned here.
+	 */
+	Renderer( const SwarmConfig& config = SwarmConfig(), StartupOrchestrator* startup = NULL );
 
 	/*!
-	 * @brief Default Constructor. 
-	 * Initialize Waypoints, Buffers and Shader.
+	 * @brief Configuration of the simulation of the window: no restore, and with several GPUs no graphs, compaction and reorder.
+	 * @param config configuration of the renderer.
+	 * @return configuration of SwarmSimulation.
 	 */
-	Renderer();
+	static SwarmConfig simulationConfig( const SwarmConfig& config );
 
 	/*!
 	 * @brief Render new scene.
 	*/
-	void render();
+	void render() override;
+
+	/*!
+	 * @brief Get aggregates of the living fishies (centroid, bounding box, number, mean speed).
+	 * Read back asynchronously, so they can be one frame old.
+	 * @return aggregates.
+	 */
+	inline const SwarmStats& getStats() const override { return simulation_->getStats(); }
+
+	/*!
+	 * @brief Get the stage timers, e.g. to time the buffer swap.
+	 * @return profiler.
+	 */
+	inline FrameProfiler& getProfiler() override { return profiler_; }
+
+	/*!
+	 * @brief Get the frame time recorder, e.g. to time the buffer swap.
+	 * @return recorder.
+	 */
+	inline FrameTimeRecorder& getFrameTimes() override { return frameTimes_; }
 
 	/*!
 	 * @brief Free Memory on GPU. Unbind Shader and VAOs.
+	 * Prints the frame time report and writes the frame times, if a dump file is set.
 	 */
-	void cleanUp();
+	void cleanUp() override;
 
 private:
 
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+
+#include "cuda_runtime.h"
+
+#include "particle_store.h"
+#include "swarm_params.h"
+
+/*!
+ * @brief Scenario constants folded into the runtime compiled grid advance kernel. Fixed during a run.
+ */
+struct RtcAdvanceKey
+{
+	SwarmParams params;					//!< Behaviour parameters. Only the ones of the classic behaviour are folded.
+	float cellSize = 0.0f;				//!< Edge length of the grid cells (GridLayout::cellSize).
+	unsigned int threads = 0;			//!< Block size, also __launch_bounds__.
+
+	/*!
+	 * @brief Compare the folded constants.
+	 * @param other other key.
+	 * @return true, if both compile to the same kernel.
+	 */
+	bool operator==( const RtcAdvanceKey& other ) const;
+};
+
+/*!
+ * @brief RtcAdvance is the grid advance of the classic behaviour, compiled with NVRTC at runtime for one scenario.
+ * fishDist, sharkDist, sharkBiteDist, centerThreshold, acceleration, cell size and block size are literals in the source,
+ * so the compiler folds them and the constant loads leave the inner loop. The source follows GridSearch and d_swim
+ * without optional features (jitter, schools, first k, packed positions, obstacles, attractors, current, far field, events, hunting sharks).
+ * kernel_advance only takes this path for those steps and falls back to d_advance_grid otherwise.
+ * The cubin is cached on disk (rtc_cache_<hash>.cubin in the working directory), keyed by source, architecture and NVRTC version.
+ * Only compiled with SWARM_NVRTC, else build always fails.
+ */
+class RtcAdvance
+{
+private:
+
+	RtcAdvanceKey key_;					//!< Constants of the kernel.
+	void* module_ = NULL;				//!< CUmodule of the cubin.
+	void* function_ = NULL;				//!< CUfunction d_advance_rtc.
+
+	RtcAdvance() = default;
+
+public:
+
+	/*!
+	 * @brief Destructor. Unloads the module.
+	 */
+	~RtcAdvance();
+
+	RtcAdvance( const RtcAdvance& ) = delete;
+	RtcAdvance& operator=( const RtcAdvance& ) = delete;
+
+	/*!
+	 * @brief Generate the source for the constants, compile it or load it from the cache, for the current device.
+	 * @param key folded constants.
+	 * @param properties properties of the current device.
+	 * @param log stream of the compiler log and the timing.
+	 * @return kernel, NULL if NVRTC is missing or the compile failed.
+	 */
+	static RtcAdvance* build( const RtcAdvanceKey& key, const cudaDeviceProp& properties, std::ostream& log );
+
+	/*!
+	 * @brief Generate the source of the kernel.
+	 * @param key folded constants.
+	 * @return CUDA source.
+	 */
+	static std::string source( const RtcAdvanceKey& key );
+
+	/*!
+	 * @brief Get the folded constants.
+	 * @return key.
+	 */
+	inline const RtcAdvanceKey& getKey() const { return key_; }
+
+	/*!
+	 * @brief Launch the kernel on the sorted fishies of the grid, same arguments as d_advance_grid.
+	 * @param out Output: New positions, speed vectors and masses of all fishies.
+	 * @param sorted Particles sorted by cell.
+	 * @param gridParticleIndex Original fish index of each sorted fish.
+	 * @param cellStart Index of first fish in cell.
+	 * @param cellEnd Index after last fish in cell.
+	 * @param mesh_count Number of fishies.
+	 * @param origin lower corner of the grid (GridLayout::origin).
+	 * @param dims cells per axis (GridLayout::dims).
+	 * @param speed Approximate maximum speed of fishies.
+	 * @param center swarm center of the step.
+	 * @param sharks Positions of all sharks in global memory.
+	 * @param shark_count Number of sharks.
+	 * @param warm Fishies of the last step for the warm start (WarmStart::particles).
+	 * @param warmCount Number of fishies of warm.
+	 * @param nearest Closest fish per slot of the last step. NULL: no warm start.
+	 * @param stream stream.
+	 */
+	void launch( ParticleArrays out, ParticleArrays sorted, const unsigned int* gridParticleIndex, const unsigned int* cellStart,
+		const unsigned int* cellEnd, unsigned int mesh_count, float3 origin, int3 dims, float speed, float4 center,
+		const float4* sharks, unsigned int shark_count, ParticleArrays warm, unsigned int warmCount, unsigned int* nearest,
+		cudaStream_t stream ) const;
+};
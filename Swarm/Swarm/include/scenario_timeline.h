@@ -0,0 +1,57 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "swarm_config.h"
+
+/*
+ * Timeline file: one event per line, "<seconds> <action> <values>", '#' starts a comment. Actions:
+ *   param <key> <value>     behaviour parameter from that step on, key as on the command line (e.g. separation, shark_dist)
+ *   sharks <n> <x,y,z>      n sharks hunt from that step on, new ones appear at x,y,z, the others are parked
+ *   route <dx,dy,dz>        the swarm center follows the waypoints with this offset
+ *   current <strength>      strength of the current in distance per second
+ *   respawn <n>             the emitter brings back at most n fishies per step (at most --respawn)
+ * Each event holds until the next event of its kind (for param: of its key).
+ */
+
+static const unsigned int MAX_TIMELINE_EVENTS = 64;			// Events of one timeline, all in constant memory.
+
+/*!
+ * @brief What a timeline event changes.
+ */
+enum class TimelineAction : unsigned int
+{
+	PARAM,									//!< The SwarmParams float at index is value[0].
+	SHARKS,									//!< index sharks are active, new ones start at value.
+	ROUTE,									//!< Offset value of the swarm center.
+	CURRENT,								//!< Strength of the current value[0] in distance per step.
+	RESPAWN,								//!< At most index spawns per step.
+	COUNT
+};
+
+/*!
+ * @brief Event of a scenario timeline, applied on the device at its step (kernel_set_timeline).
+ */
+struct TimelineEvent
+{
+	unsigned int step;						//!< First step (random step of kernel_advance) of the event.
+	TimelineAction action;					//!< What the event changes.
+	unsigned int index;						//!< PARAM: float index in SwarmParams. SHARKS, RESPAWN: count.
+	float value[3];							//!< New value, see TimelineAction.
+};
+
+/*!
+ * @brief Read a timeline file.
+ * @param path file.
+ * @param simulationRate steps per second, converts the times and the current strength.
+ * @param events Output: events sorted by step, at most MAX_TIMELINE_EVENTS.
+ * @return true, if every line is a valid event.
+ */
+bool readTimeline( const std::string& path, float simulationRate, std::vector<TimelineEvent>& events );
+
+/*!
+ * @brief Timeline of a config.
+ * @param config config with the timeline file (empty: none), simulation rate, sharks and emitter.
+ * @return events. Without timeline or if the file can't be read: none.
+ */
+std::vector<TimelineEvent> loadTimeline( const SwarmConfig& config );
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glew.h>
+
+#include "swarm_config.h"
+
+/*!
+ * @brief SceneTarget renders the scene into an off-screen framebuffer at a fraction of the window resolution and scales it up.
+ * Overlapping point sprites with discard cost fill rate per pixel, so a smaller target is cheaper in proportion to its area.
+ * The target has its own multisampling, which is resolved at the small size and then blitted with linear filtering
+ * into the framebuffer that was bound at beginFrame (the window or the video frame). The window itself needs no samples then.
+ * The size follows the viewport of that framebuffer and the scale, the buffers are only recreated when it changes.
+ */
+class SceneTarget
+{
+private:
+
+	unsigned int samples_;					//!< Samples per pixel of the target. 0: no multisampling, rendered into the resolve buffer directly.
+	float scale_;							//!< Pixels per viewport pixel along each axis.
+	GLsizei width_ = 0;						//!< Size of the buffers in pixels. 0: not created yet.
+	GLsizei height_ = 0;
+	GLuint sceneFbo_ = 0;					//!< Multisampled render target. 0 without samples.
+	GLuint sceneColor_ = 0;					//!< RGBA8 renderbuffer of sceneFbo_.
+	GLuint sceneDepth_ = 0;					//!< Depth renderbuffer of sceneFbo_ or, without samples, of resolveFbo_.
+	GLuint resolveFbo_ = 0;					//!< Single sampled copy at the same size, source of the scaled blit.
+	GLuint resolveColor_ = 0;				//!< RGBA8 renderbuffer of resolveFbo_.
+	GLint viewport_[4] = {};				//!< Viewport of the destination, restored by endFrame.
+	GLint destination_ = 0;					//!< Framebuffer bound at beginFrame.
+	bool failed_ = false;					//!< The buffers were incomplete, the frames go into the destination directly.
+
+	/*!
+	 * @brief Create the buffers for a size, deletes the old ones.
+	 * @param width width in pixels.
+	 * @param height height in pixels.
+	 * @return true, if the framebuffers are complete.
+	 */
+	bool resize( GLsizei width, GLsizei height );
+
+	/*!
+	 * @brief Delete the buffers.
+	 */
+	void release();
+
+public:
+
+	/*!
+	 * @brief Constructor. The buffers are created by the first beginFrame. Needs a current OpenGL context from then on.
+	 * @param samples samples per pixel, e.g. 4. 0: no multisampling.
+	 * @param scale fraction of the viewport resolution, e.g. 0.5 for a quarter of the pixels. Above 1 supersamples.
+	 */
+	SceneTarget( unsigned int samples, float scale );
+
+	/*!
+	 * @brief Destructor. Deletes the buffers.
+	 */
+	~SceneTarget();
+
+	/*!
+	 * @brief Check if the window draws through a scene target: with a render scale, or with a quality budget, which drives the scale.
+	 * The window is opened without samples then.
+	 * @param config render scale, multisampling, quality budget and backend.
+	 * @return true, if the renderer creates a target.
+	 */
+	static bool isNeeded( const SwarmConfig& config );
+
+	SceneTarget( const SceneTarget& ) = delete;
+	SceneTarget& operator=( const SceneTarget& ) = delete;
+
+	/*!
+	 * @brief Set the scale, used from the next beginFrame on.
+	 * @param scale fraction of the viewport resolution, > 0.
+	 */
+	inline void setScale( float scale ) { scale_ = scale; }
+
+	/*!
+	 * @brief Get the scale, e.g. to scale point sizes in pixels.
+	 * @return fraction of the viewport resolution.
+	 */
+	inline float getScale() const { return scale_; }
+
+	/*!
+	 * @brief Redirect the draws of the frame into the target and set its viewport. Call before the clear.
+	 */
+	void beginFrame();
+
+	/*!
+	 * @brief Resolve the target, scale it into the framebuffer of beginFrame and restore its viewport. Call after the last draw.
+	 */
+	void endFrame();
+};
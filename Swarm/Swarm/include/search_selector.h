@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+
+#include "swarm_config.h"
+
+/*!
+ * @brief SearchSelector picks the neighbour search of the window from the ADVANCE times of the FrameProfiler.
+ * The best search depends on the number of fishies, their density and how far they move, which changes a lot during shark attacks.
+ * Every interval frames the other searches are probed for a few frames each. The fastest one is kept, if it beats the current
+ * one by more than the hysteresis, otherwise the current one comes back. A key can also step through the searches by hand,
+ * which pins the search until it steps back to the automatic choice.
+ * The frames are tagged with search and steps (FrameProfiler::tagFrame), so samples which arrive later are still assigned.
+ */
+class SearchSelector
+{
+private:
+
+	static const unsigned int PROBE_SAMPLES = 6;	//!< Samples per probed search. The first one is not used (graph capture, Verlet build).
+	static const unsigned int PROBE_TIMEOUT = 60;	//!< Frames a probe waits for its samples, e.g. while rendering runs ahead.
+	static const unsigned int ALL_PAIRS_LIMIT = 32768;	//!< All pairs searches are only probed up to this number of fishies.
+
+	/*!
+	 * @brief Samples of one search.
+	 */
+	struct Candidate
+	{
+		SearchMode mode;							//!< Search.
+		double sum = 0.0;							//!< Sum of the used samples in ms per step.
+		unsigned int samples = 0;					//!< Received samples, including the unused first one.
+
+		/*!
+		 * @brief Get the mean of the used samples.
+		 * @return ms per step. 0 without samples.
+		 */
+		inline double mean() const { return samples > 1 ? sum / ( samples - 1 ) : 0.0; }
+	};
+
+	bool enabled_;									//!< false: the mode never changes.
+	unsigned int interval_;							//!< Frames between two probes. 0: only by hand.
+	float hysteresis_;								//!< Relative gain a search needs to replace the current one.
+	std::vector<Candidate> candidates_;				//!< Searches to choose from.
+	size_t current_ = 0;							//!< Candidate in use between the probes.
+	size_t active_ = 0;								//!< Candidate the kernels use now.
+	bool probing_ = false;							//!< The other searches are probed.
+	bool pinned_ = false;							//!< Chosen by hand, no probes.
+	unsigned int framesSinceProbe_ = 0;				//!< Frames since the last probe.
+	unsigned int probeFrames_ = 0;					//!< Frames of the probe of active_.
+	size_t probeNext_ = 0;							//!< Candidate probed after active_.
+
+	/*!
+	 * @brief Start the probe of the next candidate after active_, or decide if all of them were probed.
+	 */
+	void nextProbe();
+
+	/*!
+	 * @brief Find a candidate by search.
+	 * @param mode search.
+	 * @return index in candidates_. candidates_.size(), if not found.
+	 */
+	size_t find( SearchMode mode ) const;
+
+public:
+
+	/*!
+	 * @brief Constructor. The selector is enabled for the classic behaviour on one GPU.
+	 * @param config search of the first frames, interval (search_select), number of fishies and behaviour.
+	 */
+	SearchSelector( const SwarmConfig& config );
+
+	/*!
+	 * @brief Get the tag of a frame with the search used now, for FrameProfiler::tagFrame.
+	 * @param steps simulation steps of the frame.
+	 * @return tag. 0 for frames without steps.
+	 */
+	unsigned int frameTag( unsigned int steps ) const;
+
+	/*!
+	 * @brief Add the ADVANCE sample of a collected frame and go on with probe or choice. Call once per frame.
+	 * @param ms ADVANCE time of the collected frame (FrameProfiler::getCollected). < 0: no sample.
+	 * @param tag tag of the collected frame.
+	 * @return true, if the kernels have to use another search (getMode).
+	 */
+	bool update( float ms, unsigned int tag );
+
+	/*!
+	 * @brief Step to the next search by hand. After the last one the automatic choice comes back.
+	 * @return true, if the kernels have to use another search (getMode).
+	 */
+	bool cycle();
+
+	/*!
+	 * @brief Get the search the kernels have to use now.
+	 * @return search.
+	 */
+	inline SearchMode getMode() const { return candidates_[active_].mode; }
+
+	/*!
+	 * @brief Check if the search changes without the key.
+	 * @return true, if the searches are probed every interval frames.
+	 */
+	inline bool isAutomatic() const { return enabled_ && interval_ > 0 && !pinned_; }
+};
@@ -1,18 +1,22 @@
 #pragma once
 
 #include <string>
-#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <glm/glm.hpp>
 
 /*!
  * @brief Represent a Shader.
+ * Linked programs are cached on disk as driver binaries (shader_cache_<key>.bin in the working directory). The key is a hash of
+ * the sources and the vendor, renderer and version strings, so a new driver or an edited shader compiles again. If the driver
+ * rejects a cached binary, the program is compiled from source and the cache is rewritten.
  */
 class Shader
 {
 private:
 
 	unsigned int renderID_;										//!< ID of shader program
-	std::unordered_map<std::string, int> uniformLocationCache_; //!< Cache for uniform locations in shader
+	std::vector<std::pair<std::string, int>> uniformLocationCache_;	//!< Locations of all uniforms sorted by name, filled once after linking
 
 public:
 
@@ -23,6 +27,12 @@ public:
 	 */
 	Shader( const std::string& _vertexFilePath, const std::string& _fragmentFilePath );
 
+	/*!
+	 * @brief Constructor of a compute shader program. Needs OpenGL 4.3 (glHasComputeShaders).
+	 * @param _computeFilePath path to compute file
+	 */
+	explicit Shader( const std::string& _computeFilePath );
+
 	/*!
 	 * @brief Destructor. Destroys shader program.
 	 */
@@ -39,25 +49,75 @@ public:
 	void unbind() const;
 
 	/*!
-	 * @brief Set integer value to uniform
+	 * @brief Run the compute shader program. The caller sets the glMemoryBarrier for the readers of the results.
+	 * @param _groupsX number of work groups in x
+	 * @param _groupsY number of work groups in y
+	 * @param _groupsZ number of work groups in z
+	 */
+	void dispatch( unsigned int _groupsX, unsigned int _groupsY = 1, unsigned int _groupsZ = 1 ) const;
+
+	/*!
+	 * @brief Set integer value to uniform. The setters don't need the program to be bound with direct state access.
 	 * @param _name uniform name
 	 * @param _value value
 	 */
-	void setUniform1i( const std::string& _name, int _value );
+	void setUniform1i( const char* _name, int _value );
 
 	/*!
 	 * @brief Set float value to uniform
 	 * @param _name uniform name
 	 * @param _value value
 	 */
-	void setUniform1f( const std::string& _name, float _value );
+	void setUniform1f( const char* _name, float _value );
+
+	/*!
+	 * @brief Set vector to uniform
+	 * @param _name uniform name
+	 * @param _vector vector
+	 */
+	void setUniform3f( const char* _name, const glm::vec3& _vector );
 
 	/*!
 	 * @brief Set matrix to uniform
 	 * @param _name uniform name
 	 * @param _matrix matrix
 	 */
-	void setUniformMat4f( const std::string& _name, const glm::mat4& _matrix );
+	void setUniformMat4f( const char* _name, const glm::mat4& _matrix );
+
+	/*!
+	 * @brief Get the location of a uniform once, for the setters without string lookup.
+	 * @param _name uniform name
+	 * @return location. -1 if the uniform doesn't exist (setters ignore it).
+	 */
+	int getUniformHandle( const char* _name );
+
+	/*!
+	 * @brief Set float value to uniform
+	 * @param _location location from getUniformHandle
+	 * @param _value value
+	 */
+	void setUniform1f( int _location, float _value );
+
+	/*!
+	 * @brief Set integer value to uniform
+	 * @param _location location from getUniformHandle
+	 * @param _value value
+	 */
+	void setUniform1i( int _location, int _value );
+
+	/*!
+	 * @brief Set matrix to uniform
+	 * @param _location location from getUniformHandle
+	 * @param _matrix matrix
+	 */
+	void setUniformMat4f( int _location, const glm::mat4& _matrix );
+
+	/*!
+	 * @brief Connect a uniform block with a binding point, e.g. of a UniformBuffer.
+	 * @param _block name of the uniform block
+	 * @param _binding binding point
+	 */
+	void bindUniformBlock( const std::string& _block, unsigned int _binding );
 
 private:
 
@@ -80,7 +140,7 @@ private:
 
 	/*!
 	 * @brief compile shader
-	 * @param _type shader type. Either vertex or fragment.
+	 * @param _type shader type. Vertex, fragment or compute.
 	 * @param _source program source.
 	 * @return shader id.
 	 */
@@ -95,9 +155,29 @@ private:
 	unsigned int createShader( const std::string& _vertexShader, const std::string& _fragmentShader );
 
 	/*!
-	 * @brief get location of Uniform in shader
+	 * @brief create compute shader program
+	 * @param _computeShader compute shader source
+	 * @return render / program id
+	 */
+	unsigned int createComputeShader( const std::string& _computeShader );
+
+	/*!
+	 * @brief Link a program from the shaders of the given types and sources, or load it from the binary cache.
+	 * @param _types shader types, e.g. GL_VERTEX_SHADER and GL_FRAGMENT_SHADER.
+	 * @param _sources sources of the shaders, same order as _types.
+	 * @return render / program id
+	 */
+	unsigned int createProgram( const std::vector<unsigned int>& _types, const std::vector<std::string>& _sources );
+
+	/*!
+	 * @brief Resolve the locations of all active uniforms after linking.
+	 */
+	void cacheUniformLocations();
+
+	/*!
+	 * @brief get location of Uniform in shader. Binary search without a std::string of the name, so the setters don't allocate.
 	 * @param name of uniform.
 	 * @return uniform location.
 	 */
-	int getUniformLocation( const std::string& name );
+	int getUniformLocation( const char* name );
 };
\ No newline at end of file
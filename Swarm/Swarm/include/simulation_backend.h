@@ -0,0 +1,48 @@
+#pragma once
+
+#include "frame_profiler.h"
+#include "frame_times.h"
+#include "swarm_stats.h"
+
+/*!
+ * @brief Simulation and drawing of the swarm in the window, driven by the main loop once per frame.
+ * Renderer simulates with CUDA on the VBOs through the OpenGL interop, ComputeRenderer with OpenGL compute shaders
+ * on GPUs without CUDA. Selected with config.backend.
+ */
+class SimulationBackend
+{
+public:
+
+	/*!
+	 * @brief Destructor.
+	 */
+	virtual ~SimulationBackend() {}
+
+	/*!
+	 * @brief Simulate the steps of the elapsed time and draw the scene.
+	 */
+	virtual void render() = 0;
+
+	/*!
+	 * @brief Get aggregates of the living fishies. Read back asynchronously, so they can be one frame old.
+	 * @return aggregates.
+	 */
+	virtual const SwarmStats& getStats() const = 0;
+
+	/*!
+	 * @brief Get the stage timers, e.g. to time the buffer swap.
+	 * @return profiler.
+	 */
+	virtual FrameProfiler& getProfiler() = 0;
+
+	/*!
+	 * @brief Get the frame time recorder, e.g. to time the buffer swap.
+	 * @return recorder.
+	 */
+	virtual FrameTimeRecorder& getFrameTimes() = 0;
+
+	/*!
+	 * @brief Free the GPU memory. Prints the frame time report.
+	 */
+	virtual void cleanUp() = 0;
+};
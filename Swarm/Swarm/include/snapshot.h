@@ -0,0 +1,315 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cuda_device_array.h"
+#include "cuda_host_array.h"
+#include "gpu_compressor.h"
+#include "kernel.h"
+#include "particle_store.h"
+#include "swarm_config.h"
+#include "swarm_params.h"
+
+/*
+ * Snapshot file: SnapshotHeader, then the raw arrays in this order, each starting at a multiple of SNAPSHOT_ALIGNMENT:
+ * x, y, z, vx, vy, vz, mass (float), alive (unsigned char), id (unsigned int) with numParticles entries,
+ * shark positions and shark states (float4) with numSharks entries.
+ * All values in the byte order of the writing machine.
+ * Compressed snapshots (compression set) hold one GpuCompressor record per array instead, in the same order and one after
+ * the other from the first aligned offset on. Empty arrays (no sharks) have no record.
+ */
+
+static const char SNAPSHOT_MAGIC[8] = { 'S', 'W', 'A', 'R', 'M', 'S', 'N', 'P' };
+static const unsigned int SNAPSHOT_VERSION = 2;
+static const size_t SNAPSHOT_ALIGNMENT = 64;	//!< Alignment of the arrays in the file.
+
+/*!
+ * @brief Header of a snapshot file. Everything needed to continue a run, besides the arrays.
+ */
+struct SnapshotHeader
+{
+	char magic[8];							//!< SNAPSHOT_MAGIC.
+	unsigned int version;					//!< SNAPSHOT_VERSION.
+	unsigned int headerSize;				//!< sizeof( SnapshotHeader ) of the writer.
+	unsigned int numParticles;				//!< Number of slots.
+	unsigned int liveParticles;				//!< Number of fishies in the active set (front of the arrays).
+	unsigned int numSharks;					//!< Number of sharks.
+	unsigned int randomStep;				//!< Step counter of the GPU random numbers (kernel_get_random_step).
+	unsigned long long seed;				//!< Seed of the GPU random numbers.
+	unsigned long long step;				//!< Simulated steps since the start of the run.
+	SwarmParams params;						//!< Behaviour parameters.
+	float swarmCenter[3];					//!< Position of the swarm center.
+	float waypoint[3];						//!< Waypoint the swarm center moves to.
+	unsigned int compression;				//!< Compression of the arrays, 0 (OFF): raw. Version 2.
+};
+
+/*
+ * Delta checkpoint file <snapshot>.delta<k>, k = 1, 2, ... after the full snapshot <snapshot> with the step baseStep:
+ * DeltaHeader, then, each starting at a multiple of SNAPSHOT_ALIGNMENT, the quantised differences of x, y, z, vx, vy, vz
+ * to checkpoint k - 1 (short, numParticles entries), shark positions and shark states (float4, numSharks entries) and
+ * the changed slots (CheckpointEvent, events entries). Restore applies the chain in order, up to the first missing or
+ * foreign file; each one replaces the header state of the one before.
+ */
+
+static const char DELTA_MAGIC[8] = { 'S', 'W', 'A', 'R', 'M', 'D', 'L', 'T' };
+static const unsigned int DELTA_VERSION = 1;
+
+/*!
+ * @brief Header of a delta checkpoint file.
+ */
+struct DeltaHeader
+{
+	char magic[8];							//!< DELTA_MAGIC.
+	unsigned int version;					//!< DELTA_VERSION.
+	unsigned int headerSize;				//!< sizeof( DeltaHeader ) of the writer.
+	SnapshotHeader state;					//!< State after the checkpoint, like a snapshot header. compression is 0.
+	unsigned long long baseStep;			//!< Step of the full snapshot the chain starts at.
+	unsigned int sequence;					//!< k, 1 for the first checkpoint after the full snapshot.
+	unsigned int events;					//!< Number of changed slots.
+	float range[CHECKPOINT_COMPONENTS];		//!< Largest difference of every component, the quantisation step is range / CHECKPOINT_STEPS.
+};
+
+/*!
+ * @brief Get the path of a delta checkpoint.
+ * @param snapshot path of the full snapshot.
+ * @param sequence number of the checkpoint after it, from 1 on.
+ * @return path.
+ */
+std::string deltaPath( const std::string& snapshot, unsigned int sequence );
+
+/*!
+ * @brief Get the size of a snapshot file.
+ * @param numParticles number of slots.
+ * @param numSharks number of sharks.
+ * @return size in bytes.
+ */
+size_t snapshotSize( unsigned int numParticles, unsigned int numSharks );
+
+/*!
+ * @brief SnapshotWriter writes snapshots while the simulation continues.
+ * The arrays are copied into pinned memory on the simulation stream, a thread writes them into the file after the copy.
+ * The file is written under a temporary name and renamed at the end, so a run killed while writing keeps the last snapshot.
+ * With a compression the arrays are compressed on the stream straight into mapped staging memory, only the compressed
+ * bytes cross the bus and are written.
+ */
+class SnapshotWriter
+{
+private:
+
+	CudaHostArray<char>* staging_ = NULL;	//!< Pinned copy of the file. Reused while the size fits. Mapped, if compressed.
+	cudaEvent_t copied_;					//!< Recorded after the copies into staging_.
+	Compression compression_;				//!< Codec of the arrays.
+	GpuCompressor* words_ = NULL;			//!< Compresses the arrays of 4 byte values. NULL until the first compressed write.
+	GpuCompressor* flags_ = NULL;			//!< Compresses the alive flags.
+	CudaHostArray<unsigned long long>* used_ = NULL;	//!< End of the records in staging_, written by the GPU. Mapped.
+	size_t capacity_ = 0;					//!< Number of slots, the compressors are made for.
+	std::thread worker_;					//!< Writes the file.
+	bool failed_ = false;					//!< The last write failed.
+
+public:
+
+	/*!
+	 * @brief Constructor. Creates the event.
+	 * @param compression codec of the arrays (--compression). OFF: raw files.
+	 */
+	explicit SnapshotWriter( Compression compression = Compression::OFF );
+
+	/*!
+	 * @brief Destructor. Waits for the last write.
+	 */
+	~SnapshotWriter();
+
+	SnapshotWriter( const SnapshotWriter& ) = delete;
+	SnapshotWriter& operator=( const SnapshotWriter& ) = delete;
+
+	/*!
+	 * @brief Start writing a snapshot and return. Waits for the last write first, only one is written at a time.
+	 * The copies are ordered in the stream, later kernels may overwrite the arrays.
+	 * @param path path of the file.
+	 * @param header header. magic, version, headerSize are set here.
+	 * @param particles fishies (numParticles slots).
+	 * @param sharks shark positions on the device (numSharks float4).
+	 * @param sharkState shark states on the device (numSharks float4).
+	 * @param stream simulation stream.
+	 */
+	void write( const std::string& path, SnapshotHeader header, ParticleArrays particles, const float* sharks, const float* sharkState, cudaStream_t stream );
+
+	/*!
+	 * @brief Wait until the last snapshot is in the file.
+	 * @return true, if it was written.
+	 */
+	bool wait();
+};
+
+/*!
+ * @brief DeltaWriter writes delta checkpoints between two full snapshots (--snapshot_deltas). A copy of the state the decoder
+ * will have stays on the GPU; every checkpoint is encoded against it with kernel_encode_checkpoint and updates it, so
+ * only 12 bytes per fish plus the changed slots are written, against 33 bytes of a raw snapshot.
+ * Written like SnapshotWriter: copies into pinned memory on the stream, a thread writes the file under a temporary name.
+ * A compaction or reorder changes the slots of most fishies; if the event list overflows, no file is written and
+ * needsBase asks for a full snapshot.
+ */
+class DeltaWriter
+{
+private:
+
+	static const unsigned int MIN_EVENTS = 1024;	//!< Smallest capacity of the event list, else numParticles / 16.
+
+	ParticleStore* reference_ = NULL;		//!< State of the decoder. NULL before the first reset.
+	CudaDeviceArray<short> d_deltas_;		//!< Quantised differences, CHECKPOINT_COMPONENTS arrays of stride_ entries.
+	CudaDeviceArray<CheckpointEvent> d_events_;	//!< Changed slots.
+	CudaDeviceArray<unsigned int> d_counters_;	//!< Ranges as float bits and the event counter (kernel_encode_checkpoint).
+	CudaHostArray<char>* staging_ = NULL;	//!< Pinned copy of the file with room for maxEvents_ events.
+	CudaHostArray<unsigned int>* counters_ = NULL;	//!< Copy of d_counters_.
+	size_t stride_ = 0;						//!< Entries between the delta arrays, aligned like the file.
+	unsigned int maxEvents_ = 0;			//!< Capacity of d_events_.
+	unsigned long long baseStep_ = 0;		//!< Step of the full snapshot of the chain.
+	unsigned int sequence_ = 0;				//!< Checkpoints written since the full snapshot.
+	cudaEvent_t copied_;					//!< Recorded after the copies into staging_.
+	std::thread worker_;					//!< Writes the file.
+	bool failed_ = false;					//!< The last write failed.
+	bool needsBase_ = true;					//!< The chain is broken or not started, the next checkpoint must be a full snapshot.
+
+public:
+
+	/*!
+	 * @brief Constructor. Creates the event, the buffers follow with the first reset.
+	 */
+	DeltaWriter();
+
+	/*!
+	 * @brief Destructor. Waits for the last write.
+	 */
+	~DeltaWriter();
+
+	DeltaWriter( const DeltaWriter& ) = delete;
+	DeltaWriter& operator=( const DeltaWriter& ) = delete;
+
+	/*!
+	 * @brief Start a new chain at a full snapshot: copies the fishies into the reference. Call right after the snapshot
+	 * is written from the same arrays, on the same stream.
+	 * @param particles fishies of the snapshot.
+	 * @param numParticles number of slots.
+	 * @param baseStep step of the snapshot.
+	 * @param stream simulation stream.
+	 */
+	void reset( ParticleArrays particles, unsigned int numParticles, unsigned long long baseStep, cudaStream_t stream );
+
+	/*!
+	 * @brief Start writing the next delta checkpoint of the chain and return. Waits for the last write first.
+	 * @param snapshot path of the full snapshot, the file is deltaPath( snapshot, k ).
+	 * @param header state after the checkpoint, like for SnapshotWriter. numParticles must be the one of reset.
+	 * @param particles fishies.
+	 * @param sharks shark positions on the device (numSharks float4).
+	 * @param sharkState shark states on the device (numSharks float4).
+	 * @param stream simulation stream.
+	 */
+	void write( const std::string& snapshot, const SnapshotHeader& header, ParticleArrays particles, const float* sharks, const float* sharkState, cudaStream_t stream );
+
+	/*!
+	 * @brief Check if the next checkpoint has to be a full snapshot. Waits for the last write.
+	 * @return true before the first reset, after an overflow of the event list and after a failed write.
+	 */
+	bool needsBase();
+
+	/*!
+	 * @brief Get the number of checkpoints written since the full snapshot.
+	 * @return number of checkpoints.
+	 */
+	inline unsigned int getSequence() const { return sequence_; }
+
+	/*!
+	 * @brief Wait until the last checkpoint is in the file.
+	 * @return true, if it was written.
+	 */
+	bool wait();
+};
+
+/*!
+ * @brief SnapshotFile maps a snapshot file and the delta checkpoints after it into memory and uploads them to the GPU.
+ */
+class SnapshotFile
+{
+private:
+
+	const char* data_ = NULL;				//!< Mapped file.
+	size_t size_ = 0;						//!< Size of the file.
+	void* file_ = NULL;						//!< File and mapping handles (Windows).
+	void* mapping_ = NULL;
+	std::vector<std::vector<char>> deltas_;	//!< Delta checkpoint files of the snapshot, in chain order.
+
+	/*!
+	 * @brief Read the delta checkpoints of the snapshot up to the first missing or foreign one.
+	 * @param path path of the snapshot.
+	 */
+	void openDeltas( const std::string& path );
+
+	/*!
+	 * @brief Get the header of the full snapshot.
+	 * @return header.
+	 */
+	inline const SnapshotHeader& getBaseHeader() const { return *reinterpret_cast< const SnapshotHeader* >( data_ ); }
+
+	/*!
+	 * @brief Copy the arrays of the full snapshot to the GPU, see upload.
+	 * @param particles store with at least numParticles slots.
+	 * @param sharks shark positions with at least numSharks float4.
+	 * @param sharkState shark states with at least numSharks float4.
+	 * @param stream stream of the copies.
+	 * @return false, if the snapshot is compressed with a codec this build doesn't have.
+	 */
+	bool uploadBase( ParticleStore& particles, CudaDeviceArray<float>& sharks, CudaDeviceArray<float>& sharkState, cudaStream_t stream );
+
+	/*!
+	 * @brief Unmap the file.
+	 */
+	void close();
+
+public:
+
+	SnapshotFile() = default;
+
+	/*!
+	 * @brief Destructor. Unmaps the file.
+	 */
+	~SnapshotFile();
+
+	SnapshotFile( const SnapshotFile& ) = delete;
+	SnapshotFile& operator=( const SnapshotFile& ) = delete;
+
+	/*!
+	 * @brief Map a file and check the header. Reads the delta checkpoints after it as well.
+	 * @param path path of the file.
+	 * @return true, if the file is a valid snapshot.
+	 */
+	bool open( const std::string& path );
+
+	/*!
+	 * @brief Get the header of the restored state: the one of the last delta checkpoint, else the one of the snapshot.
+	 * Only valid after open.
+	 * @return header.
+	 */
+	inline const SnapshotHeader& getHeader() const
+	{
+		return deltas_.empty() ? getBaseHeader() : reinterpret_cast< const DeltaHeader* >( deltas_.back().data() )->state;
+	}
+
+	/*!
+	 * @brief Get the number of delta checkpoints applied after the snapshot.
+	 * @return number of checkpoints.
+	 */
+	inline size_t getDeltaCount() const { return deltas_.size(); }
+
+	/*!
+	 * @brief Copy the arrays through pinned memory to the GPU. Returns after the copy is done.
+	 * The records of a compressed snapshot are uploaded as they are and decompressed on the GPU.
+	 * The delta checkpoints are uploaded one after the other and applied on the GPU (kernel_apply_checkpoint).
+	 * @param particles store with at least numParticles slots.
+	 * @param sharks shark positions with at least numSharks float4.
+	 * @param sharkState shark states with at least numSharks float4.
+	 * @param stream stream of the copies.
+	 */
+	void upload( ParticleStore& particles, CudaDeviceArray<float>& sharks, CudaDeviceArray<float>& sharkState, cudaStream_t stream );
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "cuda_device_array.h"
+#include "cuda_host_array.h"
+#include "kernel.h"
+#include "swarm_simulation.h"
+
+/*!
+ * @brief SpatialQuery answers batches of probe points against the current step of a SwarmSimulation on the GPU: the number of
+ * fishies within a radius of every probe or the k nearest fishies (ids and distances). The probes go through pinned memory,
+ * the queries run on the simulation stream between two steps (kernel_query_radius, kernel_query_nearest) in the grid of the
+ * step, and the results are copied back into pinned memory without waiting. Read them after isReady or wait.
+ * Call it on the thread of the simulation, with its GPU current.
+ */
+class SpatialQuery
+{
+private:
+
+	SwarmSimulation& simulation_;			//!< Swarm of the queries.
+	unsigned int maxProbes_;				//!< Most probes per query.
+	unsigned int maxK_;						//!< Most fishies per probe of nearest.
+
+	CudaHostArray<float4>* probesHost_ = NULL;	//!< Probes of the running query.
+	CudaDeviceArray<float4> d_probes_;		//!< Probes on the device.
+	CudaDeviceArray<unsigned int> d_counts_;	//!< Fishies per probe of countWithin.
+	CudaDeviceArray<unsigned int> d_ids_;	//!< Ids of the nearest.
+	CudaDeviceArray<float> d_distances_;	//!< Distances of the nearest.
+	CudaDeviceArray<unsigned int> d_fallback_;	//!< Probes the grid couldn't answer (kernel_query_nearest).
+	CudaHostArray<unsigned int>* counts_ = NULL;	//!< Results of countWithin.
+	CudaHostArray<unsigned int>* ids_ = NULL;	//!< Results of nearest: ids.
+	CudaHostArray<float>* distances_ = NULL;	//!< Results of nearest: distances.
+	cudaEvent_t done_;						//!< Recorded after the copies of the results.
+	unsigned int probeCount_ = 0;			//!< Probes of the last query.
+	unsigned int k_ = 0;					//!< Fishies per probe of the last query. 0: countWithin.
+
+	/*!
+	 * @brief Wait for the last query and copy the probes into pinned memory and to the device.
+	 * @param probes probe positions (x, y, z per probe) on the host.
+	 * @param count number of probes, at most maxProbes.
+	 * @return number of probes of the query.
+	 */
+	unsigned int upload( const float* probes, unsigned int count );
+
+public:
+
+	/*!
+	 * @brief Constructor. Allocates probe and result buffers.
+	 * @param simulation swarm of the queries.
+	 * @param maxProbes most probes per query.
+	 * @param maxK most fishies per probe of nearest, at most QUERY_MAX_K.
+	 */
+	SpatialQuery( SwarmSimulation& simulation, unsigned int maxProbes, unsigned int maxK = QUERY_MAX_K );
+
+	/*!
+	 * @brief Destructor. Waits for the last query.
+	 */
+	~SpatialQuery();
+
+	SpatialQuery( const SpatialQuery& ) = delete;
+	SpatialQuery& operator=( const SpatialQuery& ) = delete;
+
+	/*!
+	 * @brief Start counting the fishies within a radius of every probe and return. Waits for the last query first.
+	 * @param probes probe positions (x, y, z per probe).
+	 * @param count number of probes. More than maxProbes are cut off.
+	 * @param radius radius around every probe.
+	 */
+	void countWithin( const float* probes, unsigned int count, float radius );
+
+	/*!
+	 * @brief Start finding the k nearest fishies of every probe and return. Waits for the last query first.
+	 * @param probes probe positions (x, y, z per probe).
+	 * @param count number of probes. More than maxProbes are cut off.
+	 * @param k fishies per probe. More than maxK are cut off.
+	 */
+	void nearest( const float* probes, unsigned int count, unsigned int k );
+
+	/*!
+	 * @brief Check if the results of the last query are in pinned memory.
+	 * @return true, if they can be read.
+	 */
+	bool isReady() const;
+
+	/*!
+	 * @brief Wait until the results of the last query are in pinned memory.
+	 */
+	void wait() const;
+
+	/*!
+	 * @brief Get the probes of the last query.
+	 * @return number of probes.
+	 */
+	inline unsigned int getProbeCount() const { return probeCount_; }
+
+	/*!
+	 * @brief Get the fishies per probe of the last nearest.
+	 * @return k, 0 after countWithin.
+	 */
+	inline unsigned int getK() const { return k_; }
+
+	/*!
+	 * @brief Get the results of the last countWithin. Valid after isReady or wait.
+	 * @return fishies per probe.
+	 */
+	inline const unsigned int* getCounts() const { return counts_->getData(); }
+
+	/*!
+	 * @brief Get the ids of the last nearest. Valid after isReady or wait.
+	 * @return getK() ids per probe, closest first. Missing fishies: 0xffffffff.
+	 */
+	inline const unsigned int* getIds() const { return ids_->getData(); }
+
+	/*!
+	 * @brief Get the distances of the last nearest. Valid after isReady or wait.
+	 * @return getK() distances per probe, same order as getIds. Missing fishies: FLT_MAX.
+	 */
+	inline const float* getDistances() const { return distances_->getData(); }
+};
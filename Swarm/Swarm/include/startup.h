@@ -0,0 +1,88 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <thread>
+
+#include "startup_phases.h"
+#include "swarm_config.h"
+#include "swarm_simulation.h"
+
+/*!
+ * @brief StartupOrchestrator overlaps the CUDA start with the window: a thread creates the CUDA context, loads the kernel modules
+ * and spawns the swarm (SwarmSimulation) while the main thread opens the window, the OpenGL context and compiles the shaders.
+ * The renderer joins before it registers the interop buffers. The phases of both threads are timed from the process start up to
+ * the first frame, including the ones of the SwarmSimulation constructor, and can be written as JSON (--startup_bench).
+ * The thread sees no OpenGL context, so it picks the configured GPU or the biggest one. If the window runs on another GPU,
+ * the swarm is spawned again on the main thread.
+ */
+class StartupOrchestrator
+{
+private:
+
+	std::thread worker_;					//!< Creates the context and the simulation.
+	bool started_ = false;					//!< worker_ runs (SwarmConfig::parallelStartup with the CUDA backend).
+	SwarmSimulation* simulation_ = NULL;	//!< Built by worker_, handed over by join.
+	int configDevice_;						//!< SwarmConfig::device. -1: the OpenGL GPU should win.
+	double contextMs_ = 0.0;				//!< Time of the context creation in worker_.
+	double simulationMs_ = 0.0;				//!< Time of the SwarmSimulation constructor in worker_.
+	StartupPhases main_{ "main", StartupPhases::processStart() };	//!< Phases of the main thread, from the process start on.
+	StartupPhases cuda_{ "cuda" };			//!< Phases of worker_, read after the join.
+
+public:
+
+	/*!
+	 * @brief Constructor. Starts the thread, if config.parallelStartup is set and the backend is CUDA.
+	 * @param config the configuration of the renderer. The thread builds the simulation of Renderer::simulationConfig.
+	 */
+	explicit StartupOrchestrator( const SwarmConfig& config );
+
+	/*!
+	 * @brief Destructor. Joins the thread and frees a simulation nobody took.
+	 */
+	~StartupOrchestrator();
+
+	StartupOrchestrator( const StartupOrchestrator& ) = delete;
+	StartupOrchestrator& operator=( const StartupOrchestrator& ) = delete;
+
+	/*!
+	 * @brief End a phase of the main thread: it took the time since the last phase.
+	 * @param name name in the report.
+	 */
+	void phase( const std::string& name );
+
+	/*!
+	 * @brief End two phases of the main thread at once, the second one timed by the caller (StartupPhases::end).
+	 * @param name name of the first phase.
+	 * @param tail name of the second phase.
+	 * @param tailMs duration of the second phase.
+	 */
+	void phase( const std::string& name, const std::string& tail, double tailMs );
+
+	/*!
+	 * @brief Take over phases that ran on the main thread, e.g. of a SwarmSimulation built there.
+	 * @param phases phases.
+	 */
+	void append( const StartupPhases& phases );
+
+	/*!
+	 * @brief Wait for the thread and take its simulation. Needs the OpenGL context current, to compare the GPUs.
+	 * The waiting is a phase of its own. Makes the GPU of the simulation current on the calling thread.
+	 * @return simulation, the caller owns it. NULL without thread or if the window runs on another GPU: build it yourself.
+	 */
+	SwarmSimulation* join();
+
+	/*!
+	 * @brief Print the phases of both threads and the total since the process start.
+	 * @param os stream.
+	 */
+	void report( std::ostream& os ) const;
+
+	/*!
+	 * @brief Write the phases of both threads as JSON: total ms up to the last phase of the main thread and per phase
+	 * its thread, start since the process start and duration.
+	 * @param path file.
+	 * @return true, if the file was written.
+	 */
+	bool writeJson( const std::string& path ) const;
+};
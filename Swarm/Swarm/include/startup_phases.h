@@ -0,0 +1,108 @@
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*!
+ * @brief Timed phases of the startup of one thread. Every phase starts where the one before ended, the times count from
+ * the process start (static initialization), so the phases of several threads line up in one report.
+ */
+class StartupPhases
+{
+public:
+
+	typedef std::chrono::steady_clock Clock;
+
+	/*!
+	 * @brief One phase.
+	 */
+	struct Phase
+	{
+		std::string name;					//!< Name in the reports, e.g. "GLEW init".
+		std::string thread;					//!< Thread of the phase, e.g. "main".
+		double startMs;						//!< Start since the process start.
+		double ms;							//!< Duration.
+	};
+
+private:
+
+	std::string thread_;					//!< Thread of the phases of end.
+	Clock::time_point last_;				//!< End of the last phase, the start of the next one.
+	std::vector<Phase> phases_;				//!< Phases in the order they ended.
+
+public:
+
+	/*!
+	 * @brief Constructor. The first phase starts now.
+	 * @param thread thread of the phases, e.g. "main".
+	 */
+	explicit StartupPhases( const std::string& thread );
+
+	/*!
+	 * @brief Constructor. The first phase starts at start, e.g. processStart() for the arguments and static initialization.
+	 * @param thread thread of the phases, e.g. "main".
+	 * @param start start of the first phase.
+	 */
+	StartupPhases( const std::string& thread, Clock::time_point start );
+
+	/*!
+	 * @brief Get the time since the process start.
+	 * @return ms.
+	 */
+	static double sinceProcessStart();
+
+	/*!
+	 * @brief Get the process start.
+	 * @return time of the static initialization.
+	 */
+	static Clock::time_point processStart();
+
+	/*!
+	 * @brief End a phase: it ran since the last one.
+	 * @param name name in the reports.
+	 */
+	void end( const std::string& name );
+
+	/*!
+	 * @brief End two phases at once: the time since the last phase without tailMs, then tailMs. For a call which times its
+	 * last part itself, e.g. GLEW init at the end of the window creation.
+	 * @param name name of the first phase.
+	 * @param tail name of the second phase.
+	 * @param tailMs duration of the second phase.
+	 */
+	void end( const std::string& name, const std::string& tail, double tailMs );
+
+	/*!
+	 * @brief Take over the phases of another recorder, e.g. of a constructor that ran on the thread of this one.
+	 * They get the thread of this one. The next phase of this one starts after the last of the other one, if that is later.
+	 * @param other phases.
+	 */
+	void append( const StartupPhases& other );
+
+	/*!
+	 * @brief Add the phases of another thread for the reports. They keep their thread, the next phase of this one still starts
+	 * at the end of its last one.
+	 * @param other phases.
+	 */
+	void merge( const StartupPhases& other );
+
+	/*!
+	 * @brief Get the phases.
+	 * @return phases in the order they ended.
+	 */
+	inline const std::vector<Phase>& get() const { return phases_; }
+
+	/*!
+	 * @brief Get the end of the last phase.
+	 * @return ms since the process start.
+	 */
+	double lastMs() const;
+
+	/*!
+	 * @brief Write the phases as JSON: the ms since the process start up to the last phase and one object per phase.
+	 * @param os stream.
+	 */
+	void writeJson( std::ostream& os ) const;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vector>
+
+#include "cuda_device_array.h"
+#include "cuda_host_array.h"
+#include "kernel.h"
+#include "particle_store.h"
+#include "swarm_stats.h"
+
+/*!
+ * @brief StatsRing records the aggregates of every frame into a ring of StatsSample on the device: the stats of the last
+ * reduction (centroid, bounding box, live count, mean speed) and the analytics of kernel_swarm_analytics (density, alignment,
+ * polarisation). The distances to the closest fish come from the grid search of the step, if it left them, else from
+ * PROBES evenly spread fishies (kernel_query_nearest in the grid of the step). Recording never waits and reads nothing back.
+ * Every few seconds the whole ring is copied into pinned memory in one go; the series arrives with a later update.
+ * Call it on the thread of the simulation, with its GPU current.
+ */
+class StatsRing
+{
+private:
+
+	static const unsigned int PROBES = 1024;	//!< Fishies per histogram.
+
+	unsigned int length_;					//!< Frames in the ring. 0: off.
+	double readInterval_;					//!< Seconds between two read backs.
+	float binWidth_;						//!< Width of a histogram bin.
+	CudaDeviceArray<StatsSample> d_ring_;	//!< Samples, frame i at i % length_.
+	CudaDeviceArray<float4> d_probes_;		//!< Probes of the histogram.
+	CudaDeviceArray<unsigned int> d_ids_;	//!< Closest fishies of the probes, the probe itself and the closest other one.
+	CudaDeviceArray<float> d_distances_;	//!< Their distances.
+	CudaDeviceArray<unsigned int> d_fallback_;	//!< Probes the grid couldn't answer (kernel_query_nearest).
+	CudaHostArray<StatsSample>* host_ = NULL;	//!< Copy of the ring.
+	cudaEvent_t copied_;					//!< Recorded after the copy into host_.
+	bool copyPending_ = false;				//!< host_ is copied and not taken yet.
+	unsigned long long written_ = 0;		//!< Frames recorded since the start.
+	unsigned long long copyWritten_ = 0;	//!< Frames recorded before the copy into host_.
+	double lastRead_ = -1.0;				//!< Time of the last read back. < 0: none yet.
+	std::vector<StatsSample> series_;		//!< Frames of the last read back, oldest first.
+
+public:
+
+	/*!
+	 * @brief Constructor. Allocates the ring and the buffers of the histogram.
+	 * @param length frames in the ring, e.g. config.statsHistory. 0: off, nothing is allocated.
+	 * @param readInterval seconds between two read backs.
+	 * @param binWidth width of a histogram bin; the NEAREST_BINS bins reach NEAREST_BINS * binWidth.
+	 */
+	StatsRing( unsigned int length, float readInterval, float binWidth );
+
+	/*!
+	 * @brief Destructor. Waits for a copy in flight.
+	 */
+	~StatsRing();
+
+	StatsRing( const StatsRing& ) = delete;
+	StatsRing& operator=( const StatsRing& ) = delete;
+
+	/*!
+	 * @brief Check if frames are recorded.
+	 * @return true, if the ring has frames.
+	 */
+	inline bool isEnabled() const { return length_ > 0; }
+
+	/*!
+	 * @brief Append the frame: the aggregates of the last kernel_reduce_stats or kernel_pack_stats and the histogram of the
+	 * fishies after the step. Call after the stats of the frame are requested, on their stream.
+	 * @param particles fishies after the step.
+	 * @param mesh_count number of fishies.
+	 * @param step steps since the start.
+	 * @param stream simulation stream.
+	 */
+	void record( ParticleArrays particles, unsigned int mesh_count, unsigned long long step, cudaStream_t stream );
+
+	/*!
+	 * @brief Take a read back which arrived and start the next one after readInterval. Doesn't wait. Call once per frame.
+	 * @param now current time in seconds.
+	 * @param stream simulation stream, the copy comes after the frames recorded so far.
+	 * @return true, if a new series arrived.
+	 */
+	bool update( double now, cudaStream_t stream );
+
+	/*!
+	 * @brief Get the frames of the last read back.
+	 * @return samples, oldest first. Empty before the first read back.
+	 */
+	inline const std::vector<StatsSample>& getSeries() const { return series_; }
+
+	/*!
+	 * @brief Get a percentile of the distances to the closest fish of a sample, interpolated inside its bin.
+	 * @param sample sample.
+	 * @param percent percentile, 0 to 100.
+	 * @return distance. 0 without sampled fishies.
+	 */
+	float nearestPercentile( const StatsSample& sample, float percent ) const;
+
+	/*!
+	 * @brief Get the polarisation of a sample: length of the mean heading of the moving fishies.
+	 * @param sample sample.
+	 * @return 0 (headings in all directions) to 1 (all fishies swim the same way).
+	 */
+	static float polarisation( const StatsSample& sample );
+
+	/*!
+	 * @brief Get the median of the fishies per grid cell of a sample, at the power of two of its bin.
+	 * @param sample sample.
+	 * @return fishies per cell. 0 without density histogram (no grid in the step).
+	 */
+	static unsigned int densityMedian( const StatsSample& sample );
+};
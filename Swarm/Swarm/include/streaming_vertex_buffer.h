@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include "glew.h"
+#include "vertex_buffer.h"
+
+/*!
+ * @brief StreamingVertexBuffer is a VertexBuffer the CPU rewrites every frame without reallocating it.
+ * It has three regions in a ring. With ARB_buffer_storage the buffer stays persistently mapped and a region is only
+ * rewritten after the fence of the frame which drew from it, so writing normally never waits.
+ * Without it the region is written with glBufferSubData from a host copy.
+ * Draws of a region use getFirstVertex() as first vertex, so the attribute pointers never change.
+ */
+class StreamingVertexBuffer : public VertexBuffer
+{
+private:
+
+	static const unsigned int FRAMES = 3;	//!< Regions in the ring.
+
+	unsigned int regionSize_;				//!< Bytes per region.
+	char* mapped_ = NULL;					//!< Persistent mapping of all regions. NULL: glBufferSubData.
+	std::vector<char> staging_;				//!< Host copy of a region without persistent mapping.
+	GLsync fences_[FRAMES] = {};			//!< Signaled, when the draws from the region are done.
+	unsigned int region_ = FRAMES - 1;		//!< Region of the last write.
+
+public:
+
+	/*!
+	 * @brief Create the buffer with all regions.
+	 * @param regionSize bytes per frame.
+	 */
+	StreamingVertexBuffer( unsigned int regionSize );
+
+	/*!
+	 * @brief Unmap the buffer and delete the fences.
+	 */
+	~StreamingVertexBuffer();
+
+	StreamingVertexBuffer( const StreamingVertexBuffer& ) = delete;
+	StreamingVertexBuffer& operator=( const StreamingVertexBuffer& ) = delete;
+
+	/*!
+	 * @brief Get the next region for writing. Draws issued before this call keep reading their region.
+	 * @return regionSize bytes, valid until commit.
+	 */
+	void* beginWrite();
+
+	/*!
+	 * @brief Make the written region visible for the next draws.
+	 */
+	void commit();
+
+	/*!
+	 * @brief First vertex of the current region.
+	 * @param vertexSize bytes per vertex of the attribute.
+	 * @return first vertex for glDrawArrays.
+	 */
+	inline unsigned int getFirstVertex( unsigned int vertexSize ) const { return region_ * regionSize_ / vertexSize; }
+};
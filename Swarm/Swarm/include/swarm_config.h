@@ -0,0 +1,319 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "host_simulation.h"
+#include "attractors.h"
+#include "obstacles.h"
+#include "swarm_ensemble.h"
+#include "swarm_params.h"
+#include "vec3.h"
+
+/*!
+ * @brief Neighbour search used to find the closest fish.
+ */
+enum class SearchMode
+{
+	AUTO,			//!< TILED for small swarms, GRID for large ones.
+	BRUTE_FORCE,	//!< Every thread scans all fishies in global memory (reference).
+	TILED,			//!< All pairs, tiles of positions in shared memory. From Ampere on the next tile loads while one is scanned.
+	GRID,			//!< Uniform grid, only the 27 neighbour cells are searched.
+	WARP,			//!< All pairs, one warp per fish with shuffle reduction.
+	VERLET,			//!< Candidate list per fish built on the uniform grid, reused until the fishies moved too far.
+	TENSOR,			//!< All pairs as matrix product on the tensor cores (experimental). TILED without tensor cores or with --firstk.
+	CELL			//!< Uniform grid, one block per cell with the fishies of the 27 cells around it in shared memory. GRID with --firstk or --hash_grid.
+};
+
+/*!
+ * @brief Get the name of a search mode, as in --search.
+ * @param mode search mode.
+ * @return name, e.g. "grid".
+ */
+const char* searchModeName( SearchMode mode );
+
+/*!
+ * @brief Behaviour of the fishies.
+ */
+enum class Behaviour
+{
+	CLASSIC,		//!< Avoid the closest fish, return to the swarm center.
+	BOIDS			//!< Separation, alignment and cohesion with all neighbours inside a radius. Always uses the grid.
+};
+
+/*!
+ * @brief What the sharks of the CUDA backend hunt.
+ */
+enum class SharkTarget
+{
+	CENTER,			//!< The swarm or school center, the fishies bite themselves off inside the bite distance.
+	NEAREST,		//!< The nearest fish, found in the grid of the step. The sharks bite, each fish is eaten by one shark only.
+	DENSEST,		//!< The fullest grid cell close to the shark. Bites like NEAREST.
+	INTERCEPT		//!< The meeting point with the cell it can reach soonest for most fishies, from the cell aggregates. Bites like CENTER.
+};
+
+/*!
+ * @brief How the CUDA backend moves the fishies and sharks over a step (kernel_set_integrator).
+ */
+enum class Integrator
+{
+	LEGACY,			//!< The steering changes the speed vector of a base step, the fish moves by it. Step length fixed.
+	EULER,			//!< Semi-implicit Euler: the steering is an acceleration over the step length, the fish moves with the new speed.
+	VERLET			//!< Velocity Verlet: like EULER, the fish moves with the mean of the old and the new speed.
+};
+
+/*!
+ * @brief How the grid build of the CUDA backend sorts the fishies into the cells (kernel_set_grid_sort).
+ */
+enum class GridSort
+{
+	AUTO,			//!< Counting sort for grids with few cells per fish, else radix sort.
+	RADIX,			//!< Radix sort of the cell hashes. Keeps the slot order inside a cell.
+	COUNTING		//!< Count per cell, scan and scatter.
+};
+
+/*!
+ * @brief What the color of a point fish shows, computed by the vertex shader of the points.
+ */
+enum class ColorMode
+{
+	STATIC,			//!< Random shade of orange per fish.
+	SPEED,			//!< Speed of the fish, blue (resting) to orange (twice the swarm speed).
+	FEAR,			//!< Distance to the nearest shark, red inside the evasion distance.
+	SCHOOL			//!< One hue per school (fish id % schools).
+};
+
+/*!
+ * @brief Get the name of a color mode, as in --color_mode.
+ * @param mode color mode.
+ * @return name, e.g. "speed".
+ */
+const char* colorModeName( ColorMode mode );
+
+/*!
+ * @brief When the Autotuner times the kernel settings.
+ */
+enum class TuneMode
+{
+	OFF,			//!< Occupancy block sizes, cells of fishDist, the configured Verlet skin.
+	CACHED,			//!< Settings of the tuning profile, timed and stored once per GPU model, driver, search and swarm size.
+	FORCE			//!< Time the settings again and replace the entry of the tuning profile.
+};
+
+/*!
+ * @brief Simulation backend of the window.
+ */
+enum class Backend
+{
+	CUDA,			//!< CUDA kernels on the VBOs through the OpenGL interop. All features.
+	GL_COMPUTE,		//!< OpenGL compute shaders on the VBOs, for GPUs without CUDA. Classic behaviour with the grid search only.
+	CPU,			//!< Threads with SSE2 / AVX2 on the CPU (CpuSimulation), for machines without CUDA device. Headless and classic behaviour only.
+	THRUST			//!< Thrust algorithms on the device system of the build (ThrustSimulation): CUDA, OpenMP or TBB. Headless and classic behaviour only.
+};
+
+/*!
+ * @brief GPU compression of snapshots and trajectory chunks (GpuCompressor, nvCOMP).
+ */
+enum class Compression
+{
+	OFF,			//!< Raw arrays.
+	LZ4,			//!< General purpose byte codec.
+	CASCADED,		//!< Run length, delta and bit packing of integers, best for the 16 bit trajectory deltas.
+	BITCOMP			//!< Bit packing of the differences, the fastest one for numeric data.
+};
+
+/*!
+ * @brief Get the name of a compression, as in --compression.
+ * @param compression compression.
+ * @return name, e.g. "lz4".
+ */
+const char* compressionName( Compression compression );
+
+/*!
+ * @brief SwarmConfig contains the settings of a simulation run which can be set at startup.
+ * Values can be read from a config file (key = value per line, # for comments) and the command line.
+ * Command line arguments override values from the config file. A config file can describe a whole scenario:
+ * counts, spawn box, waypoints, speed, behaviour, backend, window and benchmark options.
+ */
+class SwarmConfig
+{
+public:
+	unsigned int numParticles = 1000;	//!< Number of Particles
+	unsigned int numSharks = 1;			//!< Number of Sharks
+	unsigned int simulationRate = 60;	//!< Simulation steps per second (fixed timestep).
+	unsigned int headlessSteps = 0;		//!< Run this number of steps without window. 0 opens the window.
+	unsigned int ensemble = 0;			//!< Headless: advance this number of independent swarms (particles and sharks each) with one launch. 0: one swarm.
+	std::vector<ParamSweep> ensembleSweeps;	//!< Parameters that change linearly from the first to the last ensemble member.
+	std::vector<ParamSweep> sweep;		//!< Headless: axes of a full factorial parameter sweep over all GPUs (SweepDriver). Empty: no sweep.
+	std::string sweepOutput;			//!< Sweep: write the summary of every run into this CSV file. Empty: standard output.
+	int device = -1;					//!< Index of the GPU to use (first GPU with several GPUs). -1: the OpenGL GPU or else the biggest one.
+	unsigned int gpus = 1;				//!< Split the swarm into slabs over this number of GPUs (MultiGpuSimulation). 0: all GPUs.
+	bool mpi = false;					//!< Headless: one slab per MPI rank (MpiSimulation). Needs a build with SWARM_MPI, started by mpirun.
+	bool mpiGpuDirect = true;			//!< MPI: pass device buffers to MPI (CUDA-aware MPI). Off: stage the messages through pinned host memory.
+	unsigned int bricks = 0;			//!< Headless: stream the swarm through one GPU in this number of bricks (OutOfCoreSimulation). Up to 1: resident.
+	std::string snapshot;				//!< Headless: write the state into this file after the run. Empty: no snapshots.
+	unsigned int snapshotInterval = 0;	//!< Headless: also write the snapshot every this number of steps. 0: only after the run.
+	unsigned int snapshotDeltas = 0;	//!< Headless: write this number of delta checkpoints (DeltaWriter) between two full snapshots of the interval. 0: only full snapshots.
+	std::string restore;				//!< Headless: continue the run of this snapshot file instead of spawning new fishies.
+	std::string initial;				//!< Take the fishies (and their number) from this initial condition file (InitialConditionFile) instead of random ones. Not with restore.
+	std::string trajectory;				//!< Path prefix of the trajectory chunk files. Empty: no trajectory.
+	unsigned int trajectoryEvery = 1;	//!< Record the trajectory every this number of steps (headless) or frames.
+	unsigned int trajectoryStride = 1;	//!< Record every this number of fishies (by id).
+	bool trajectoryQuantize = false;	//!< Record 16 bit positions relative to the bounding box instead of floats.
+	unsigned int trajectoryChunk = 16;	//!< Frames per trajectory chunk file.
+	std::string playback;				//!< Window: play the trajectory chunk files of this path prefix instead of simulating (TrajectoryPlayer). Empty: simulate.
+	float playbackRate = 1.0f;			//!< Playback speed, 1: the recorded steps at --rate steps per second.
+	Compression compression = Compression::OFF;	//!< Compress snapshots and trajectory chunks on the GPU before they are copied to the host.
+	std::string events;					//!< CSV file of the fish events (deaths, spawns, near misses). Empty: no events.
+	unsigned int eventCapacity = 65536;	//!< Events per frame (headless: per 16 steps). Further events are dropped and counted.
+	std::string exportName;				//!< Publish the positions in this shared memory ring (PositionExport). Empty: no export.
+	unsigned int exportSlots = 3;		//!< Frames in the export ring. Consumers read the newest, the producer overwrites the oldest.
+	bool exportIpc = true;				//!< Also publish a CUDA IPC handle of the device ring for GPU consumers.
+	unsigned int validateSteps = 0;		//!< Validate the search mode against brute force for this number of steps, without window. 0: no validation.
+	float tolerance = 1e-4f;			//!< Largest position difference per step the validation accepts.
+	Behaviour behaviour = Behaviour::CLASSIC;	//!< Fish behaviour.
+	float collisionRadius = 0.0f;		//!< Hard collisions: distance of two fish centers at contact (kernel_set_collisions). 0: off.
+	unsigned int collisionIterations = 4;	//!< Hard collisions: Jacobi iterations per step.
+	bool meanField = false;				//!< Boids: neighbourhood from the mean speed and centroid of the 27 cells around a fish. Constant cost per fish.
+	SearchMode searchMode = SearchMode::AUTO;	//!< Neighbour search (classic behaviour only).
+	unsigned int searchSelect = 0;		//!< Window: probe the other searches every this number of frames and keep the fastest (SearchSelector). 0: fixed, key N still switches.
+	unsigned int firstK = 0;			//!< Neighbour query stops after this number of close fishies. 0: closest fish.
+	bool packedPositions = false;		//!< Grid search reads 16 bit positions relative to the cells (kernel_set_packed_positions).
+	bool cooperativeGrid = false;		//!< Grid search builds the grid and searches in one cooperative launch (kernel_set_cooperative_grid).
+	bool warmStart = true;				//!< Grid search starts with the closest fish of the last step (kernel_set_warm_start).
+	GridSort gridSort = GridSort::AUTO;	//!< How the grid build sorts the fishies into the cells (kernel_set_grid_sort).
+	unsigned int multiRate = 0;			//!< Unimportant fishies advance every this number of steps (kernel_set_multi_rate). Up to 1: every step.
+	float multiRateShark = 3.0f;		//!< Multi-rate: fishies closer than this times sharkDist to a shark advance every step.
+	float multiRateFocus = 0.0f;		//!< Multi-rate: fishies closer than this to the camera advance every step. 0: only the sharks count.
+	bool evasionSplit = false;			//!< Brute force search skips the fishies evading a shark (kernel_set_evasion_split).
+	unsigned int denseCells = 0;		//!< Grid search: fishies with more candidates in their 27 cells get a warp each (kernel_set_dense_cells). 0: off.
+	bool clusterSearch = false;			//!< Grid search: cells of a cluster from distributed shared memory on Hopper (kernel_set_cluster_search).
+	bool hashGrid = false;				//!< Grid: cells in a hash table instead of wrapping around, for schools far apart (kernel_set_hash_grid).
+	bool l2Persistence = false;			//!< Grid search: cell tables persisting in L2 on Ampere or newer (kernel_set_l2_persistence).
+	bool deterministic = false;			//!< Bitwise reproducible runs: fixed-point state, ordered search and reductions (kernel_set_deterministic).
+	bool rtcKernels = false;			//!< Grid advance compiled at runtime with the constants of the scenario folded in (kernel_set_rtc, needs SWARM_NVRTC).
+	SharkTarget sharkTarget = SharkTarget::CENTER;	//!< What the sharks hunt (kernel_set_shark_target). Only with the grid, else CENTER.
+	Integrator integrator = Integrator::LEGACY;	//!< How the fishies move over a step (kernel_set_integrator). CUDA backend only.
+	bool adaptiveStep = false;			//!< Step length from the fastest fish of the last stats (kernel_set_step_scale). Not with LEGACY.
+	float cflNumber = 0.5f;				//!< Adaptive step: the fastest fish moves at most this fraction of fishDist per step.
+	float maxStepScale = 4.0f;			//!< Adaptive step: longest step in base steps (1 / simulationRate). At least 1.
+	TuneMode autotune = TuneMode::OFF;	//!< Time block size, cell size and Verlet skin of the search on this GPU (Autotuner).
+	std::string tuneProfile = "swarm_tuning.txt";	//!< Tuning profile: the winners per GPU model, driver, search and swarm size.
+	unsigned int compactInterval = 60;	//!< Drop eaten fishies from the active set every this number of steps. 0: never.
+	unsigned int reorderInterval = 100;	//!< Sort the fishies along a Morton curve every this number of steps. 0: never.
+	unsigned int respawnRate = 0;		//!< Emitter: bring back up to this number of eaten fishies per step. 0: no emitter. Replaces the compaction.
+	unsigned int seed = 1;				//!< Seed of the GPU random numbers.
+	SwarmParams params = SwarmParams::defaults();	//!< Behaviour parameters (center_threshold, shark_dist, shark_bite_dist, fish_dist, acceleration, jitter, skin, separation, alignment, cohesion, goal).
+	bool benchmark = false;				//!< Uncapped frames: no V-Sync, no frame gate, one step per frame.
+	bool telemetry = false;				//!< Sample clocks, power, temperature and throttle reasons with NVML: per CSV row and energy per fish step.
+	std::string computeCache = "compute_cache";	//!< Directory of the kernels the driver JIT compiles for GPUs without SASS in the build. Empty: driver default.
+	bool parallelStartup = true;		//!< Window: create the CUDA context and spawn the swarm on a thread while the window opens (StartupOrchestrator).
+	std::string startupBench;			//!< Window: write the startup phases up to the first present as JSON into this file and close after the first frame. Empty: off.
+	std::string interopBench;			//!< Window: time the CUDA to OpenGL transfer strategies (InteropBenchmark) up to numParticles, write JSON into this file and close. Empty: off.
+	bool unifiedMemory = false;			//!< Particle stores, stats and parameter tables in managed memory with access hints (CudaMallocAllocator::setUnifiedMemory).
+	bool instanced = true;				//!< Draw the fishies as instanced meshes oriented by their velocity. false: round points.
+	unsigned int glVersion = 33;		//!< OpenGL context version (major * 10 + minor), e.g. 45 for direct state access. Falls back to 3.3.
+	Backend backend = Backend::CUDA;	//!< Simulation backend. GL_COMPUTE needs OpenGL 4.3, CPU and THRUST are headless only. Validation and several GPUs always use CUDA.
+	unsigned int threads = 0;			//!< Threads of the CPU backend. 0: one per hardware thread.
+	unsigned int schools = 1;			//!< Independent schools with their own route, fish i swims in school i % schools. At most 64, CUDA backends only.
+	bool splinePath = false;			//!< Centers follow a spline through the waypoints, evaluated on the GPU (kernel_set_schools). CUDA backends only.
+	std::vector<SpeciesParams> species;	//!< Species with their own speed, perception, fear and mass range (kernel_set_species). Empty: all fishies alike. CUDA backends only.
+	bool overlay = false;				//!< Draw the swarm center and the current waypoint.
+	bool hud = false;					//!< Show the performance HUD from the start: stage times, frame graph, fishies, memory and search. Key H toggles it.
+	bool culling = true;				//!< Drop fishies outside of the view on the GPU and draw the rest with glDrawArraysIndirect.
+	float lodDistance = 3.0f;			//!< Culling with instanced: fishies farther from the camera are drawn as points.
+	float clusterDistance = 0.0f;		//!< Culling: fishies farther from the camera are summed up into cluster impostors. 0: off.
+	float clusterCellSize = 1.0f;		//!< Edge of a cluster cell at clusterDistance, doubled with every doubling of the distance.
+	bool density = false;				//!< Draw the density map of the swarm (kernel_density) as heat colored points under the swarm.
+	unsigned int trails = 0;			//!< Positions per fish in its trail, drawn as line strip. 0: no trails.
+	unsigned int trailEvery = 4;		//!< Append to the trails every this number of steps.
+	bool depthSort = false;				//!< Sort the points by view depth on the GPU every frame for correct blending. Needs culling and instanced off.
+	bool impostors = false;				//!< Draw the point fishies as opaque sphere impostors which write their depth. With depthSort sorted front to back.
+	unsigned int sharkViews = 0;		//!< Close-up viewports along the top edge, each one follows a shark. Same step, culled per viewport. At most 4.
+	bool interpolate = false;			//!< Draw the points between the last two steps, smooth at display rates above the simulation rate. Needs culling and instanced off.
+	bool vertexPulling = false;			//!< Draw the points straight from the particle store, kept in storage buffers (OpenGL 4.3), without pack. Needs culling and instanced off.
+	bool vulkanInterop = false;			//!< Share the point, color and shark buffers with CUDA through Vulkan external memory and semaphores, without a map per frame. Needs SWARM_VULKAN.
+	bool lateInput = false;				//!< Handle the input events again right before the draws of a frame and take the newest camera, not the one of the frame start.
+	bool lateLatch = false;				//!< After the draws are issued, handle the events once more and overwrite the matrices in the mapped uniform block. Needs ARB_buffer_storage.
+	unsigned int pipelineDepth = 0;		//!< Frames the simulation runs ahead of the draws. 0: same frame, lowest latency. 1: the next step is packed while OpenGL draws this one, more throughput.
+	bool splitDisplay = false;			//!< Simulate on a GPU without the OpenGL context and copy the packed buffers peer to peer into the VBOs of the display GPU. Needs two GPUs.
+	ColorMode colorMode = ColorMode::STATIC;	//!< What the colors of the point fishies show. Key M switches. Needs culling, instanced and impostors off.
+	bool graphs = true;					//!< Replay the steps of a frame as CUDA graph, if the search allows it.
+	bool substeps = false;				//!< Run the steps of a frame in one launch of a single block, if the swarm fits into its shared memory.
+	unsigned int profileInterval = 10;	//!< Seconds between two console reports of the stage times. 0: no stage timers.
+	float frameBudget = 1000.0f / 60.0f;	//!< Frame budget in ms. Slower frames are counted as over budget.
+	float qualityBudget = 0.0f;			//!< Window: CPU and GPU work per frame in ms the quality levels hold (QualityController). 0: fixed quality.
+	std::string frameDump;				//!< File for the frame times, written at exit. Empty: only written on key F, into frame_times.csv.
+	unsigned int metricsPort = 0;		//!< Window: serve frame times, steps per second, fishies and device memory as Prometheus metrics on this TCP port. 0: off.
+	unsigned int statsHistory = 0;		//!< Window: aggregates, closest fish, density and alignment histograms of this number of frames in a ring on the GPU (StatsRing), for the HUD and the metrics. 0: off.
+	float statsReadback = 2.0f;			//!< Seconds between two read backs of the whole stats ring.
+	std::string trace;					//!< Chrome Trace Event JSON of the frames, their parts and the GPU stages (chrome://tracing, Perfetto). Empty: no trace.
+	std::string capture;				//!< Prefix of the periodic frame captures, <prefix>_<frame>.tga. Empty: only on key C, as screenshot_<frame>.tga.
+	unsigned int captureEvery = 600;	//!< Frames between two periodic captures.
+	std::string cameraRecord;			//!< Window: record the camera and keys of every frame into this file (CameraPath). Empty: no recording.
+	std::string cameraReplay;			//!< Window: replay a camera path file with its seed, one step per frame, and close after the last frame. Empty: no replay.
+	std::string video;					//!< Raw H.264 stream of the frames, encoded with NVENC (.hevc or .h265: HEVC). With headless: a hidden window renders headlessSteps frames.
+	bool egl = false;					//!< Headless video: render in an EGL context of the device platform instead of a hidden window, no X server or display needed (SWARM_EGL builds).
+	Vector3 spawnMin = Vector3( -SPAWN_BOX, -SPAWN_BOX, -SPAWN_BOX );	//!< Lower corner of the box the fishies spawn and respawn in.
+	Vector3 spawnMax = Vector3( SPAWN_BOX, SPAWN_BOX, SPAWN_BOX );		//!< Upper corner of the spawn box. The sharks start on its upper z face.
+	std::vector<Vector3> waypoints = swarmWaypoints();	//!< Route of the swarm center (and of school 0). Starts again after the last waypoint.
+	std::vector<Obstacle> obstacles;	//!< Static obstacles, baked into a distance field the CUDA advance kernels avoid (kernel_set_obstacles).
+	float obstacleRange = 1.0f;			//!< Fishies closer than this to an obstacle are pushed away from it.
+	unsigned int obstacleResolution = 64;	//!< Samples of the distance field along its longest axis.
+	std::vector<Attractor> attractors;	//!< Food patches, lures and repulsors, baked into one field the CUDA advance kernels steer along (kernel_set_attractors).
+	unsigned int attractorResolution = 48;	//!< Samples of the attractor field along its longest axis.
+	float alarm = 0.0f;					//!< Alarm an evading fish deposits per step, spread as a wave through the school (kernel_set_alarm). 0: no alarm.
+	float alarmDecay = 0.9f;			//!< Fraction of the alarm a cell keeps per step.
+	unsigned int alarmResolution = 32;	//!< Cells of the alarm field along its longest axis.
+	std::string current;				//!< Current of the water: "curl" (curl noise generated on the GPU) or a current file. Empty: still water.
+	float currentStrength = 1.0f;		//!< Distance per second a fish drifts at a velocity of 1 in the current.
+	unsigned int currentPeriod = 240;	//!< Steps between two time slices of the current. At least 16, the steps of one graph.
+	unsigned int currentResolution = 48;	//!< Samples of the curl noise current along its longest axis.
+	std::string timeline;				//!< Scenario timeline file (readTimeline): scripted events the GPU applies at their step. Empty: none.
+	float farCohesion = 0.0f;			//!< Far field: pull to the far fishies, relative to the acceleration (kernel_set_far_field). 0: none.
+	float farAlignment = 0.0f;			//!< Far field: share of the mean far speed vector steered to per step. 0: none.
+	float farTheta = 0.5f;				//!< Far field: opening angle of the Barnes-Hut walk. Smaller: more exact, slower.
+	float swarmSpeed = SWARM_SPEED;		//!< Distance a fish swims per simulated second.
+	unsigned int windowWidth = 1600;	//!< Width of the window in pixels.
+	unsigned int windowHeight = 1200;	//!< Height of the window in pixels.
+	unsigned int msaa = 4;				//!< Samples per pixel of the scene, in the window or in the scene target. 0: no multisampling.
+	float renderScale = 1.0f;			//!< Resolution of the scene target relative to the window, scaled up. 1 without quality budget: no target.
+
+	/*!
+	 * @brief Standard Constructor. Uses default values.
+	 */
+	SwarmConfig() = default;
+
+	/*!
+	 * @brief Read config from command line.
+	 * Supported arguments: --config <file>, --particles <n>, --sharks <n>, --rate <steps per second>, --headless <steps>, --ensemble <n>, --ensemble_sweep <param:from:to,...>, --sweep <param:from:to:n,...>, --sweep_output <file>, --device <auto|index>, --gpus <n>, --mpi <0|1>, --mpi_gpudirect <0|1>, --bricks <n>, --snapshot <file>, --snapshot_interval <steps>, --snapshot_deltas <n>, --restore <file>, --initial <file>, --trajectory <prefix>, --trajectory_every <n>, --trajectory_stride <n>, --trajectory_quantize <0|1>, --trajectory_chunk <frames>, --play <prefix>, --play_rate <factor>, --compression <off|lz4|cascaded|bitcomp>, --events <file>, --event_capacity <n>, --export <name>, --export_slots <n>, --export_ipc <0|1>, --validate <steps>, --tolerance <distance>, --benchmark <0|1>, --telemetry <0|1>, --parallel_startup <0|1>, --startup_bench <file.json>, --interop_bench <file.json>, --compute_cache <dir>, --unified_memory <0|1>, --gl <3.3|4.5|4.6>, --backend <cuda|gl|cpu|thrust>, --threads <n>, --schools <n>, --spline_path <0|1>, --species <share:speed:perception:fear:mass_min:mass_max;...>, --instanced <0|1>, --overlay <0|1>, --hud <0|1>, --culling <0|1>, --lod_distance <distance>, --cluster_distance <distance>, --cluster_cell <size>, --depth_sort <0|1>, --impostors <0|1>, --shark_views <n>, --interpolate <0|1>, --vertex_pulling <0|1>, --vulkan_interop <0|1>, --split_display <0|1>, --pipeline <0|1>, --late_input <0|1>, --late_latch <0|1>, --color_mode <static|speed|fear|school>, --density <0|1>, --trails <positions>, --trail_every <steps>, --graph <0|1>, --substeps <0|1>, --profile <seconds>, --budget <ms>, --quality_budget <ms>, --frame_dump <file>, --metrics_port <port>, --stats_history <frames>, --stats_readback <seconds>, --trace <file>, --capture <prefix>, --capture_every <frames>, --record_camera <file>, --replay_camera <file>, --video <file>, --egl <0|1>, --firstk <k>, --packed_positions <0|1>, --cooperative <0|1>, --warm_start <0|1>, --grid_sort <auto|radix|counting>, --multi_rate <steps>, --multi_rate_shark <factor>, --multi_rate_focus <distance>, --evasion_split <0|1>, --dense_cells <candidates>, --clusters <0|1>, --hash_grid <0|1>, --l2_persistence <0|1>, --deterministic <0|1>, --rtc <0|1>, --shark_target <center|nearest|densest|intercept>, --integrator <legacy|euler|verlet>, --adaptive_dt <0|1>, --cfl <fraction>, --max_dt_scale <factor>, --autotune <off|cached|force>, --tune_profile <file>, --compact <steps>, --reorder <steps>, --respawn <n>, --seed <n>, --search <auto|brute|tiled|grid|warp|verlet|tensor|cell>, --search_select <frames>, --behaviour <classic|boids>, --mean_field <0|1>, --collision_radius <distance>, --collision_iterations <n>,
+	 * --spawn_min <x,y,z>, --spawn_max <x,y,z>, --waypoints <x,y,z;x,y,z;...>, --obstacles <sphere:x,y,z:r;box:x,y,z:hx,hy,hz;tank:x,y,z:hx,hy,hz;...>, --obstacle_range <distance>, --obstacle_resolution <n>, --attractors <x,y,z:strength:radius;...>, --attractor_resolution <n>, --alarm <deposit>, --alarm_decay <fraction>, --alarm_resolution <n>, --current <curl|file>, --current_strength <distance per second>, --current_period <steps>, --current_resolution <n>, --timeline <file>, --far_cohesion <factor>, --far_alignment <factor>, --far_theta <angle>, --speed <distance per second>, --window <width>x<height>, --msaa <samples>, --render_scale <factor>
+	 * @param argc number of arguments.
+	 * @param argv arguments.
+	 * @return config with the values of the command line and the config file.
+	 */
+	static SwarmConfig fromCommandLine( int argc, char** argv );
+
+	/*!
+	 * @brief Read values from a config file.
+	 * @param path path to config file.
+	 * @return true, if the file could be read.
+	 */
+	bool load( const std::string& path );
+
+	/*!
+	 * @brief Set a value by name.
+	 * @param key name of value (e.g. particles).
+	 * @param value value as string.
+	 * @return true, if key and value are valid.
+	 */
+	bool set( const std::string& key, const std::string& value );
+
+	/*!
+	 * @brief Print config with iostream.
+	 * @param os stream.
+	 * @param config config to print.
+	 * @return stream.
+	 */
+	friend std::ostream& operator<<( std::ostream& os, const SwarmConfig& config );
+};
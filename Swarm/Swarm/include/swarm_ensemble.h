@@ -0,0 +1,83 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include <cuda_runtime.h>
+
+#include "swarm_params.h"
+
+/*!
+ * @brief Behaviour parameter that changes linearly over the members of an ensemble, or one axis of a sweep (sweepMatrix).
+ */
+struct ParamSweep
+{
+	std::string name;				//!< Name of the parameter, as the config key (e.g. shark_dist).
+	float SwarmParams::* field;		//!< The parameter.
+	float from;						//!< Value of the first member.
+	float to;						//!< Value of the last member.
+	unsigned int values = 0;		//!< Axis of a sweep: number of values from from to to. 0: linear over the members.
+};
+
+/*!
+ * @brief Independent swarms packed into one particle store (kernel_set_ensemble). Member m owns the slots
+ * offsets[m] to offsets[m] + counts[m] - 1 and the sharks m * sharksPerMember to (m + 1) * sharksPerMember - 1.
+ */
+struct SwarmEnsemble
+{
+	std::vector<unsigned int> offsets;	//!< First slot per member.
+	std::vector<unsigned int> counts;	//!< Fishies per member.
+	std::vector<SwarmParams> params;	//!< Behaviour parameters per member.
+	unsigned int sharksPerMember = 0;	//!< Sharks per member.
+};
+
+/*!
+ * @brief Summary of one ensemble member, reduced on the GPU by kernel_ensemble_metrics.
+ */
+struct EnsembleMetrics
+{
+	unsigned int liveCount;			//!< Number of living fishies.
+	float survival;					//!< Living fishies relative to the slots of the member.
+	float3 centroid;				//!< Mean position of the living fishies.
+	float cohesion;					//!< Radius of gyration: root mean square distance to the centroid. Small: tight swarm.
+	float meanSpeed;				//!< Mean distance a fish swims per step.
+	float nearestMean;				//!< Mean distance to the closest living fish.
+	float nearestStdDev;			//!< Standard deviation of that distance.
+	float nearestMin;				//!< Smallest distance between two fishies. 0 without pairs.
+};
+
+/*!
+ * @brief Find a behaviour parameter by its config key.
+ * @param name key, e.g. shark_dist.
+ * @param field Output: the parameter.
+ * @return true, if the key names a parameter.
+ */
+bool findParam( const std::string& name, float SwarmParams::*& field );
+
+/*!
+ * @brief Ensemble of equal sized members, back to back in the store.
+ * @param base parameters of every member.
+ * @param sweeps parameters that change from the first to the last member, all at once.
+ * @param members number of members.
+ * @param fishies fishies per member.
+ * @param sharks sharks per member.
+ * @return ensemble.
+ */
+SwarmEnsemble uniformEnsemble( const SwarmParams& base, const std::vector<ParamSweep>& sweeps, unsigned int members, unsigned int fishies, unsigned int sharks );
+
+/*!
+ * @brief Full factorial run matrix of a sweep: every combination of the values of all axes.
+ * The last axis changes fastest.
+ * @param base parameters of every run.
+ * @param axes sweep axes with values > 0. An axis with one value sets the parameter to from.
+ * @return parameters per run.
+ */
+std::vector<SwarmParams> sweepMatrix( const SwarmParams& base, const std::vector<ParamSweep>& axes );
+
+/*!
+ * @brief Ensemble of equal sized members with the given parameters, back to back in the store.
+ * @param params parameters per member.
+ * @param fishies fishies per member.
+ * @param sharks sharks per member.
+ * @return ensemble.
+ */
+SwarmEnsemble packEnsemble( const std::vector<SwarmParams>& params, unsigned int fishies, unsigned int sharks );
@@ -0,0 +1,27 @@
+#pragma once
+
+/*!
+ * @brief Kinds of fish events, see SwarmEvent.
+ */
+enum class SwarmEventType : unsigned int
+{
+	DEATH = 0,					//!< A shark ate the fish.
+	SPAWN = 1,					//!< The emitter brought the fish back (kernel_respawn).
+	NEAR_MISS = 2				//!< A shark came closer than twice the bite distance, the fish evaded it.
+};
+
+/*!
+ * @brief Event of one fish, appended on the GPU and drained by kernel_drain_events.
+ * 32 bytes, so a warp writes whole cache lines.
+ */
+struct SwarmEvent
+{
+	unsigned int type;			//!< SwarmEventType.
+	unsigned int fish;			//!< Stable id of the fish.
+	unsigned int shark;			//!< Index of the shark. 0xffffffff: no shark (spawn) or unknown.
+	unsigned int step;			//!< Number of the step (kernel_get_random_step).
+	float x;					//!< Position of the fish.
+	float y;
+	float z;
+	float distance;				//!< Distance to the shark. 0 for spawns.
+};
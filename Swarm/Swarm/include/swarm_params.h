@@ -0,0 +1,74 @@
+#pragma once
+
+/*!
+ * @brief Parameters of the fish behaviour. Stored in constant memory on the GPU (see kernel_set_params).
+ * Plain struct without constructor, because __constant__ variables can't be initialized dynamically.
+ */
+struct SwarmParams
+{
+	float centerThreshold;		//!< Fishies further away from the swarm center return to it.
+	float sharkDist;			//!< Fishies closer to a shark evade it.
+	float sharkBiteDist;		//!< Fishies closer to a shark are eaten.
+	float fishDist;				//!< Fishies closer to each other keep distance. Also edge length of the grid cells and perception radius of boids.
+	float accelerationFactor;	//!< Acceleration relative to the speed of a fish.
+	float jitter;				//!< Random acceleration per step relative to the speed of a fish. 0: none.
+	float verletSkin;			//!< Verlet search: candidates are collected up to fishDist + verletSkin.
+
+	float boidsSeparation;		//!< Boids: steer away from close neighbours.
+	float boidsAlignment;		//!< Boids: match the mean speed vector of the neighbours.
+	float boidsCohesion;		//!< Boids: steer to the mean position of the neighbours.
+	float boidsGoal;			//!< Boids: steer to the waypoint, so the swarm still follows the path.
+
+	/*!
+	 * @brief Default parameters.
+	 * @return default parameters.
+	 */
+	static SwarmParams defaults()
+	{
+		SwarmParams params;
+		params.centerThreshold = 2.0f;
+		params.sharkDist = 0.7f;
+		params.sharkBiteDist = 0.05f;
+		params.fishDist = 0.4f;
+		params.accelerationFactor = 0.09f;
+		params.jitter = 0.0f;
+		params.verletSkin = 0.2f;
+		params.boidsSeparation = 0.06f;
+		params.boidsAlignment = 0.05f;
+		params.boidsCohesion = 0.02f;
+		params.boidsGoal = 0.015f;
+		return params;
+	}
+};
+
+static const unsigned int MAX_SPECIES = 8;	//!< Entries of the species table in constant memory.
+
+/*!
+ * @brief Traits of one species, as factors on SwarmParams. Stored in a table in constant memory on the GPU (see kernel_set_species).
+ * Plain struct without constructor, like SwarmParams.
+ */
+struct SpeciesParams
+{
+	float share;				//!< Fraction of the fishies of this species, relative to the sum of all shares.
+	float speed;				//!< Factor on the maximum speed.
+	float perception;			//!< Factor on fishDist, the distance kept to the closest fish. At most 1, the grid cells are fishDist wide.
+	float fear;					//!< Factor on sharkDist.
+	float massMin;				//!< Mass of the lightest fish. The random mass of a fish (0.875 to 1.125) is mapped onto massMin to massMax.
+	float massMax;				//!< Mass of the heaviest fish.
+
+	/*!
+	 * @brief Traits of the default fish: all factors 1, the spawn mass range.
+	 * @return default traits.
+	 */
+	static SpeciesParams defaults()
+	{
+		SpeciesParams species;
+		species.share = 1.0f;
+		species.speed = 1.0f;
+		species.perception = 1.0f;
+		species.fear = 1.0f;
+		species.massMin = 0.875f;
+		species.massMax = 1.125f;
+		return species;
+	}
+};
@@ -0,0 +1,341 @@
+#pragma once
+
+#include <vector>
+
+#include "cuda_device.h"
+#include "cuda_device_array.h"
+#include "cuda_host_array.h"
+#include "cuda_mailbox.h"
+#include "kernel.h"
+#include "particle_store.h"
+#include "snapshot.h"
+#include "startup_phases.h"
+#include "swarm_config.h"
+#include "swarm_params.h"
+#include "swarm_stats.h"
+#include "waypoint_list.h"
+
+/*!
+ * @brief SwarmSimulation is the swarm of one GPU without window: device, stream, particle stores, sharks, swarm center and stats.
+ * It needs no OpenGL, so other programs can link it as library (SwarmSimulation.vcxproj) and step, query and tune the swarm.
+ * Renderer and HeadlessSimulation are consumers: they only add drawing, recording and snapshots.
+ * The kernels run in the default kernel context of the calling thread.
+ */
+class SwarmSimulation
+{
+private:
+
+	StartupPhases startupPhases_{ "simulation" };	//!< Phases of the constructor. First member, so it starts before device_.
+	CudaDevice device_;						//!< Cuda Device. Used to simply communicate with the gpu.
+	cudaStream_t stream_;					//!< Stream for all simulation kernels and copies.
+
+	ParticleStore* particles_[2];			//!< contains positions, forces and masses in memory on device (ping-pong).
+	unsigned int current_ = 0;				//!< Index of the store that contains the latest positions and states.
+	CudaDeviceArray<uchar4> d_color;		//!< contains color (RGBA8) by fish id in memory on device. Empty without colors.
+	CudaDeviceArray<float> d_sharks;		//!< contains shark positions in memory on device.
+	CudaDeviceArray<float> d_shark_state;	//!< contains shark forces and masses in memory on device.
+	CudaMailbox<SwarmStats>* stats_;		//!< Aggregates of the swarm, written to mapped memory by requestStats.
+
+	unsigned int numParticles_;				//!< Number of Particles
+	unsigned int numSharks_;				//!< Number of Sharks. Moved on GPU.
+	unsigned int liveParticles_;			//!< Number of fishies in the active set. Eaten fishies are compacted out.
+	unsigned int compactInterval_;			//!< Steps between two compactions. 0: never.
+	unsigned int respawnRate_;				//!< Emitter: maximum number of fishies spawned per step. 0: no emitter.
+	unsigned int stepsSinceCompact_ = 0;	//!< Steps since the last compaction.
+	unsigned int reorderInterval_;			//!< Steps between two Morton reorders. 0: never.
+	unsigned int stepsSinceReorder_ = 0;	//!< Steps since the last Morton reorder.
+	bool graphs_;							//!< Replay the steps of advance as CUDA graph, if possible.
+	bool substeps_;							//!< Run the steps of advance in one launch of a single block, if the swarm fits.
+	std::vector<Vector3> substepCenters_;	//!< Swarm centers of the steps of runSubsteps.
+	bool slotsMoved_ = false;				//!< Fishies moved to other slots since the last takeSlotsMoved.
+	unsigned long long stepCount_ = 0;		//!< Simulated steps since the start, including the steps of a restored snapshot.
+	unsigned long long seed_;				//!< Seed of the GPU random numbers.
+
+	const float WAYPOINT_THRESHOLD = 0.1;	//!< Threshold for waypoint goal.
+
+	float speed;							//!< speed of particles per step (SwarmConfig::swarmSpeed * dt).
+	double dt_;								//!< Simulated time per step.
+	bool adaptiveStep_;						//!< Step length from the fastest fish of the stats (SwarmConfig::adaptiveStep).
+	float cflDistance_;						//!< Adaptive step: distance the fastest fish may move per step (cflNumber * fishDist).
+	float maxStepScale_;					//!< Adaptive step: longest step in base steps.
+	float stepScale_ = 1.0f;				//!< Length of the next steps in base steps (kernel_set_step_scale).
+	double simulatedTime_ = 0.0;			//!< Simulated seconds since the start, the sum of the step lengths.
+	WaypointList* waypointList;				//!< Waypoint List contains waypoints for particles.
+	Vector3 swarmCenter;					//!< Position of swarm center.
+
+	/*!
+	 * @brief Move Swarm center to waypoint
+	 */
+	void moveSwarmCenter();
+
+	/*!
+	 * @brief Advance fishies and sharks by one step, swap the particle stores and respawn eaten fishies.
+	 * Uses the current swarm center.
+	 */
+	void advanceStep();
+
+	/*!
+	 * @brief Check if a compaction or a reorder is due within the steps. Both synchronize with the host.
+	 * @param steps number of steps.
+	 * @return true, if the steps have to run one by one.
+	 */
+	bool hostWorkDue( unsigned int steps ) const;
+
+	/*!
+	 * @brief Check if the steps can be replayed as CUDA graph.
+	 * Compaction and reorder synchronize with the host, calls with one of them run without graph.
+	 * @param steps number of steps.
+	 * @return true, if replaySteps can be used.
+	 */
+	bool canReplay( unsigned int steps ) const;
+
+	/*!
+	 * @brief Check if the steps can run as one launch of kernel_advance_substeps. Not with the emitter, which respawns every step.
+	 * @param steps number of steps.
+	 * @return true, if runSubsteps can be used.
+	 */
+	bool canSubstep( unsigned int steps ) const;
+
+	/*!
+	 * @brief Run the steps in one launch of kernel_advance_substeps. Moves the swarm center once per step.
+	 * @param steps number of steps.
+	 */
+	void runSubsteps( unsigned int steps );
+
+	/*!
+	 * @brief Run the steps as CUDA graph. The graph is captured again, if the steps, stores or counts changed.
+	 * Only swarm center and random key change between replays, they are no graph parameters.
+	 * @param steps number of steps.
+	 */
+	void replaySteps( unsigned int steps );
+
+	/*!
+	 * @brief Drop eaten fishies from the active set, if compactInterval_ steps have passed since the last time.
+	 * Swaps the particle stores.
+	 */
+	void compactParticles();
+
+	/*!
+	 * @brief Sort the fishies along a Morton curve, if reorderInterval_ steps have passed since the last time.
+	 * Swaps the particle stores.
+	 */
+	void reorderParticles();
+
+public:
+
+	/*!
+	 * @brief Constructor. Selects the GPU (config.device), sets the behaviour of the kernels and spawns fishies and sharks.
+	 * The particles are loaded from config.restore, if set. A snapshot replaces particles, sharks, parameters and seed of the config.
+	 * @param config Number of particles and sharks, behaviour, intervals.
+	 * @param colors keep a color per fish on the GPU (getColors), e.g. for drawing.
+	 */
+	SwarmSimulation( const SwarmConfig& config, bool colors = false );
+
+	SwarmSimulation( const SwarmSimulation& ) = delete;
+	SwarmSimulation& operator=( const SwarmSimulation& ) = delete;
+
+	/*!
+	 * @brief Calculate one simulation step, then compact and reorder if due.
+	 */
+	void step();
+
+	/*!
+	 * @brief Calculate the given number of steps. One launch for small swarms with config.substeps, else replayed as one
+	 * CUDA graph, if config.graphs is set. Both only if no compaction or reorder is due. Nothing is calculated for 0.
+	 * @param steps number of steps.
+	 */
+	void advance( unsigned int steps );
+
+	/*!
+	 * @brief Let the grid follow the swarm: use the stats of the last requestStats, if they arrived. Doesn't wait.
+	 */
+	void updateGridBounds();
+
+	/*!
+	 * @brief Reduce the aggregates of the current step. The kernel writes them to mapped host memory, there is no copy.
+	 * getStats has them after the stream reached this point.
+	 */
+	void requestStats();
+
+	/*!
+	 * @brief Write the current step into the VBO and reduce its aggregates in the same pass (kernel_pack_stats),
+	 * instead of kernel_pack and requestStats.
+	 * @param verts Output: Vertices of the VBO.
+	 * @param directions Output: Directions of the fish meshes. NULL: not written.
+	 */
+	void packWithStats( float4* verts, float4* directions );
+
+	/*!
+	 * @brief Get aggregates of the living fishies (centroid, bounding box, number, mean speed) of the newest requestStats that arrived.
+	 * @return aggregates, zero before the first one arrived.
+	 */
+	inline const SwarmStats& getStats() { stats_->poll(); return stats_->value(); }
+
+	/*!
+	 * @brief Copy the positions of the live fishies to the host. Waits for the stream.
+	 * @return x, y, z per live fish.
+	 */
+	std::vector<float> readPositions();
+
+	/*!
+	 * @brief Set the behaviour parameters. Used from the next step on.
+	 * @param params parameters.
+	 */
+	void setParams( const SwarmParams& params );
+
+	/*!
+	 * @brief Get the current behaviour parameters.
+	 * @return parameters.
+	 */
+	SwarmParams getParams() const;
+
+	/*!
+	 * @brief Get device pointers to the store with the latest step.
+	 * @return device pointers. Valid until the next step.
+	 */
+	inline ParticleArrays getParticles() { return particles_[current_]->getArrays(); }
+
+	/*!
+	 * @brief Get the store getParticles reads, e.g. to draw the buffers it is attached to.
+	 * @return 0 or 1.
+	 */
+	inline unsigned int getCurrentStore() const { return current_; }
+
+	/*!
+	 * @brief Keep positions and alive flags of a store in buffers of the renderer (ParticleStore::attachPositions).
+	 * @param store 0 or 1.
+	 * @param x x positions, one per fish.
+	 * @param y y positions.
+	 * @param z z positions.
+	 * @param alive alive flags.
+	 */
+	void attachPositions( unsigned int store, float* x, float* y, float* z, unsigned char* alive );
+
+	/*!
+	 * @brief Keep the speeds of a store in buffers of the renderer (ParticleStore::attachSpeeds).
+	 * @param store 0 or 1.
+	 * @param vx x speeds, one per fish.
+	 * @param vy y speeds.
+	 * @param vz z speeds.
+	 */
+	void attachSpeeds( unsigned int store, float* vx, float* vy, float* vz );
+
+	/*!
+	 * @brief Get the colors by fish id.
+	 * @return device pointer. NULL without colors.
+	 */
+	inline uchar4* getColors() { return d_color.getData(); }
+
+	/*!
+	 * @brief Get the shark positions (x, y, z, 1) on the device.
+	 * @return device pointer.
+	 */
+	inline float* getSharks() { return d_sharks.getData(); }
+
+	/*!
+	 * @brief Get the shark forces and masses on the device.
+	 * @return device pointer.
+	 */
+	inline float* getSharkState() { return d_shark_state.getData(); }
+
+	/*!
+	 * @brief Get the number of fishies in the active set.
+	 * @return number of live slots.
+	 */
+	inline unsigned int getLiveCount() const { return liveParticles_; }
+
+	/*!
+	 * @brief Set the number of fishies in the active set, after another writer (e.g. MultiGpuSimulation::gather) replaced them.
+	 * @param count number of live slots.
+	 */
+	inline void setLiveCount( unsigned int count ) { liveParticles_ = count; slotsMoved_ = true; }
+
+	/*!
+	 * @brief Check if fishies moved to other slots (compaction, reorder, setLiveCount) since the last call.
+	 * @return true, if data by slot has to be rewritten.
+	 */
+	inline bool takeSlotsMoved() { bool moved = slotsMoved_; slotsMoved_ = false; return moved; }
+
+	/*!
+	 * @brief Get the number of particles.
+	 * @return number of slots per store.
+	 */
+	inline unsigned int getNumParticles() const { return numParticles_; }
+
+	/*!
+	 * @brief Get the number of sharks.
+	 * @return number of sharks.
+	 */
+	inline unsigned int getNumSharks() const { return numSharks_; }
+
+	/*!
+	 * @brief Get the simulated steps since the start, including the steps of a restored snapshot.
+	 * @return number of steps.
+	 */
+	inline unsigned long long getStepCount() const { return stepCount_; }
+
+	/*!
+	 * @brief Get the seed of the GPU random numbers.
+	 * @return seed.
+	 */
+	inline unsigned long long getSeed() const { return seed_; }
+
+	/*!
+	 * @brief Get the simulated time per step.
+	 * @return seconds.
+	 */
+	inline double getTimeStep() const { return dt_; }
+
+	/*!
+	 * @brief Get the length of the next steps in base steps (getTimeStep). 1 without adaptive step.
+	 * @return step length / base step.
+	 */
+	inline float getStepScale() const { return stepScale_; }
+
+	/*!
+	 * @brief Get the simulated time since the start, the sum of the step lengths.
+	 * @return seconds.
+	 */
+	inline double getSimulatedTime() const { return simulatedTime_; }
+
+	/*!
+	 * @brief Get the distance the swarm center moves per step.
+	 * @return speed per step.
+	 */
+	inline float getSpeed() const { return speed; }
+
+	/*!
+	 * @brief Get the position of the swarm center.
+	 * @return swarm center.
+	 */
+	inline Vector3 getSwarmCenter() const { return swarmCenter; }
+
+	/*!
+	 * @brief Get the waypoint the swarm center moves to.
+	 * @return waypoint.
+	 */
+	inline Vector3 getWaypoint() const { return waypointList->get(); }
+
+	/*!
+	 * @brief Get the device.
+	 * @return device, e.g. to register buffers.
+	 */
+	inline CudaDevice& getDevice() { return device_; }
+
+	/*!
+	 * @brief Get the timed phases of the constructor: device selection and properties, CUDA context, buffers, kernel setup, spawn and tuning.
+	 * @return phases, e.g. for StartupOrchestrator::append.
+	 */
+	inline const StartupPhases& getStartupPhases() const { return startupPhases_; }
+
+	/*!
+	 * @brief Get the stream of the simulation. Work of other consumers in this stream is ordered with the steps.
+	 * @return stream.
+	 */
+	inline cudaStream_t getStream() const { return stream_; }
+
+	/*!
+	 * @brief Free Memory on GPU. Waits for the last step.
+	 */
+	void cleanUp();
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cuda_runtime.h>
+
+/*!
+ * @brief Aggregates of the living fishies, computed on the GPU by kernel_reduce_stats.
+ * Small enough to be read back every frame.
+ */
+struct SwarmStats
+{
+	float3 centroid;			//!< Mean position. 0 without living fishies.
+	float3 boundsMin;			//!< Lower corner of the bounding box.
+	float3 boundsMax;			//!< Upper corner of the bounding box.
+	float meanSpeed;			//!< Mean distance a fish swims per step.
+	unsigned int liveCount;		//!< Number of living fishies.
+	float maxSpeed;				//!< Largest distance a fish swims per base step. CUDA and CPU backends, 0 elsewhere.
+};
+
+static const unsigned int NEAREST_BINS = 16;	//!< Bins of the distance histogram of StatsSample.
+static const unsigned int DENSITY_BINS = 12;	//!< Bins of the density histogram of StatsSample, powers of two.
+static const unsigned int ALIGNMENT_BINS = 16;	//!< Bins of the alignment histogram of StatsSample over [-1, 1].
+
+/*!
+ * @brief Aggregates of one frame in the ring of a StatsRing, written on the GPU by kernel_stats_sample and kernel_swarm_analytics.
+ */
+struct StatsSample
+{
+	unsigned long long step;	//!< Steps since the start (kernel_get_random_step).
+	SwarmStats stats;			//!< Aggregates of the frame.
+	unsigned int nearest[NEAREST_BINS];	//!< Sampled fishies per distance to their closest fish, the last bin holds the farther ones.
+	float nearestSum;			//!< Sum of the sampled distances.
+	unsigned int sampled;		//!< Sampled fishies with a closest fish. All of them, if the step left its closest fishies.
+	unsigned int density[DENSITY_BINS];	//!< Fishies per fishies in their grid cell: bin i holds 2^i to 2^(i+1) - 1, the last one more.
+	unsigned int alignment[ALIGNMENT_BINS];	//!< Fishies per cosine between their heading and the one of their closest fish.
+	float alignmentSum;			//!< Sum of these cosines.
+	unsigned int aligned;		//!< Fishies in the alignment histogram: moving, with a moving closest fish.
+	float3 headingSum;			//!< Sum of the unit speed vectors, polarisation = |headingSum| / headed.
+	unsigned int headed;		//!< Moving living fishies.
+};
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <cmath>
+
+// CUDA and glm types are only known where their headers are on the include path (HostBench has no CUDA, SwarmSimulation no glm).
+#if defined( __has_include )
+#if __has_include( <vector_types.h> )
+#include <vector_types.h>
+#define SWARM_VECTOR_CUDA_TYPES
+#endif
+#if __has_include( <glm/vec3.hpp> )
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#define SWARM_VECTOR_GLM
+#endif
+#endif
+
+#ifdef __CUDACC__
+#define SWARM_HOST_DEVICE __host__ __device__
+#else
+#define SWARM_HOST_DEVICE
+#endif
+
+/*!
+ * @brief Vector of the host and the kernels: position or direction in xyz, w is a payload (mass, alive flag, 0 for directions).
+ * 16 byte aligned like float4, so it converts to float4 by a copy and loads with a single vector instruction.
+ * All operations work on xyz with single precision and fused multiply-adds, w of the left operand is kept.
+ * Unlike DeviceVector, length and normalization never include w, unlike Vector3 there is no epsilon in normalized3.
+ */
+class alignas( 16 ) SwarmVector
+{
+public:
+	float x;	//!< x value
+	float y;	//!< y value
+	float z;	//!< z value
+	float w;	//!< payload, ignored by the math
+
+	/*!
+	 * @brief Standard Constructor. Zero vector.
+	 */
+	SWARM_HOST_DEVICE constexpr SwarmVector() :
+		x( 0.0f ), y( 0.0f ), z( 0.0f ), w( 0.0f )
+	{}
+
+	/*!
+	 * @brief Constructor.
+	 * @param x x value.
+	 * @param y y value.
+	 * @param z z value.
+	 * @param w payload.
+	 */
+	SWARM_HOST_DEVICE constexpr SwarmVector( float x, float y, float z, float w = 0.0f ) :
+		x( x ), y( y ), z( z ), w( w )
+	{}
+
+#ifdef SWARM_VECTOR_CUDA_TYPES
+	/*!
+	 * @brief Constructor.
+	 * @param v float4 struct.
+	 */
+	SWARM_HOST_DEVICE constexpr SwarmVector( const float4& v ) :
+		x( v.x ), y( v.y ), z( v.z ), w( v.w )
+	{}
+
+	/*!
+	 * @brief Constructor.
+	 * @param v float3 struct.
+	 * @param w payload.
+	 */
+	SWARM_HOST_DEVICE constexpr SwarmVector( const float3& v, float w = 0.0f ) :
+		x( v.x ), y( v.y ), z( v.z ), w( w )
+	{}
+
+	/*!
+	 * @brief Get the float4 of the vector, e.g. for constant memory or a kernel parameter.
+	 * @return float4 struct.
+	 */
+	SWARM_HOST_DEVICE constexpr float4 toFloat4() const
+	{
+		return float4{ x, y, z, w };
+	}
+
+	/*!
+	 * @brief Get xyz as float3.
+	 * @return float3 struct.
+	 */
+	SWARM_HOST_DEVICE constexpr float3 toFloat3() const
+	{
+		return float3{ x, y, z };
+	}
+#endif
+
+#ifdef SWARM_VECTOR_GLM
+	/*!
+	 * @brief Constructor.
+	 * @param v glm vector.
+	 * @param w payload.
+	 */
+	constexpr SwarmVector( const glm::vec3& v, float w = 0.0f ) :
+		x( v.x ), y( v.y ), z( v.z ), w( w )
+	{}
+
+	/*!
+	 * @brief Constructor.
+	 * @param v glm vector.
+	 */
+	constexpr SwarmVector( const glm::vec4& v ) :
+		x( v.x ), y( v.y ), z( v.z ), w( v.w )
+	{}
+
+	/*!
+	 * @brief Get xyz as glm vector, e.g. for a uniform.
+	 * @return glm vector.
+	 */
+	glm::vec3 toGlm() const
+	{
+		return glm::vec3( x, y, z );
+	}
+
+	/*!
+	 * @brief Get the glm vector with w.
+	 * @return glm vector.
+	 */
+	glm::vec4 toGlm4() const
+	{
+		return glm::vec4( x, y, z, w );
+	}
+#endif
+
+	/*!
+	 * @brief Dot product of xyz.
+	 * @param v other vector.
+	 * @return dot product.
+	 */
+	SWARM_HOST_DEVICE float dot3( const SwarmVector& v ) const
+	{
+		return fmaf( x, v.x, fmaf( y, v.y, z * v.z ) );
+	}
+
+	/*!
+	 * @brief Get squared length of xyz.
+	 * @return squared length.
+	 */
+	SWARM_HOST_DEVICE float length3Squared() const
+	{
+		return dot3( *this );
+	}
+
+	/*!
+	 * @brief Get length of xyz.
+	 * @return length.
+	 */
+	SWARM_HOST_DEVICE float length3() const
+	{
+		return sqrtf( length3Squared() );
+	}
+
+	/*!
+	 * @brief Normalize xyz, w is kept. The zero vector has no direction, it stays NaN like the division.
+	 * @return normalized vector.
+	 */
+	SWARM_HOST_DEVICE SwarmVector normalized3() const
+	{
+#ifdef __CUDA_ARCH__
+		float inv = rsqrtf( length3Squared() );
+#else
+		float inv = 1.0f / sqrtf( length3Squared() );
+#endif
+		return SwarmVector( x * inv, y * inv, z * inv, w );
+	}
+
+	/*!
+	 * @brief Cross product of xyz.
+	 * @param v other vector.
+	 * @return cross product, w of this vector.
+	 */
+	SWARM_HOST_DEVICE SwarmVector cross( const SwarmVector& v ) const
+	{
+		return SwarmVector( fmaf( y, v.z, -z * v.y ), fmaf( z, v.x, -x * v.z ), fmaf( x, v.y, -y * v.x ), w );
+	}
+
+	/*!
+	 * @brief Fused this + v * s, one rounding per component.
+	 * @param v direction.
+	 * @param s factor.
+	 * @return sum, w of this vector.
+	 */
+	SWARM_HOST_DEVICE SwarmVector madd( const SwarmVector& v, float s ) const
+	{
+		return SwarmVector( fmaf( v.x, s, x ), fmaf( v.y, s, y ), fmaf( v.z, s, z ), w );
+	}
+
+	/*!
+	 * @brief Add two vectors.
+	 * @param v other vector.
+	 * @return sum, w of this vector.
+	 */
+	SWARM_HOST_DEVICE constexpr SwarmVector operator+( const SwarmVector& v ) const
+	{
+		return SwarmVector( x + v.x, y + v.y, z + v.z, w );
+	}
+
+	/*!
+	 * @brief Subtract two vectors.
+	 * @param v other vector.
+	 * @return difference, w of this vector.
+	 */
+	SWARM_HOST_DEVICE constexpr SwarmVector operator-( const SwarmVector& v ) const
+	{
+		return SwarmVector( x - v.x, y - v.y, z - v.z, w );
+	}
+
+	/*!
+	 * @brief Negate xyz.
+	 * @return negated vector.
+	 */
+	SWARM_HOST_DEVICE constexpr SwarmVector operator-() const
+	{
+		return SwarmVector( -x, -y, -z, w );
+	}
+
+	/*!
+	 * @brief Multiply componentwise.
+	 * @param v other vector.
+	 * @return product, w of this vector.
+	 */
+	SWARM_HOST_DEVICE constexpr SwarmVector operator*( const SwarmVector& v ) const
+	{
+		return SwarmVector( x * v.x, y * v.y, z * v.z, w );
+	}
+
+	/*!
+	 * @brief Multiply with a number.
+	 * @param s number.
+	 * @return product, w of this vector.
+	 */
+	SWARM_HOST_DEVICE constexpr SwarmVector operator*( float s ) const
+	{
+		return SwarmVector( x * s, y * s, z * s, w );
+	}
+
+	/*!
+	 * @brief Add a vector to xyz.
+	 * @param v other vector.
+	 * @return this vector.
+	 */
+	SWARM_HOST_DEVICE SwarmVector& operator+=( const SwarmVector& v )
+	{
+		x += v.x; y += v.y; z += v.z;
+		return *this;
+	}
+
+	/*!
+	 * @brief Subtract a vector from xyz.
+	 * @param v other vector.
+	 * @return this vector.
+	 */
+	SWARM_HOST_DEVICE SwarmVector& operator-=( const SwarmVector& v )
+	{
+		x -= v.x; y -= v.y; z -= v.z;
+		return *this;
+	}
+
+	/*!
+	 * @brief Multiply xyz with a number.
+	 * @param s number.
+	 * @return this vector.
+	 */
+	SWARM_HOST_DEVICE SwarmVector& operator*=( float s )
+	{
+		x *= s; y *= s; z *= s;
+		return *this;
+	}
+};
+
+static_assert( sizeof( SwarmVector ) == 16 && alignof( SwarmVector ) == 16, "SwarmVector must match float4" );
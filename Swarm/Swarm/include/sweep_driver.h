@@ -0,0 +1,106 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "cuda_device.h"
+#include "cuda_device_array.h"
+#include "cuda_host_array.h"
+#include "gpu_telemetry.h"
+#include "kernel.h"
+#include "particle_store.h"
+#include "swarm_config.h"
+#include "swarm_ensemble.h"
+#include "waypoint_list.h"
+
+/*!
+ * @brief SweepDriver runs a full factorial parameter sweep without window.
+ * The run matrix (sweepMatrix) is split into contiguous parts, one per visible GPU, and every GPU advances its part
+ * as one ensemble (kernel_advance_ensemble). All GPUs are driven from this thread, like the slabs of MultiGpuSimulation.
+ * After the last step every run is summarized on its GPU (kernel_ensemble_metrics) and written as one CSV line.
+ */
+class SweepDriver
+{
+private:
+
+	/*!
+	 * @brief Runs and buffers of one GPU.
+	 */
+	struct Shard
+	{
+		CudaDevice* device = NULL;				//!< GPU of the shard.
+		cudaStream_t stream = NULL;				//!< Stream for all kernels and copies of the shard.
+		KernelContext* context = NULL;			//!< Launch configuration and ensemble tables on this GPU.
+		ParticleStore* particles[2] = {};		//!< Fishies of all runs of the shard (ping-pong).
+		CudaDeviceArray<float>* sharks = NULL;	//!< Shark positions of all runs.
+		CudaDeviceArray<float>* sharkState = NULL;	//!< Shark forces and masses of all runs.
+		CudaHostArray<EnsembleMetrics>* h_metrics = NULL;	//!< Read back of the summaries.
+		GpuTelemetry* telemetry = NULL;			//!< Clocks, power and energy of the GPU during the steps. Disabled without config.telemetry.
+		unsigned int first = 0;					//!< Index of the first run in the run matrix.
+		unsigned int runs = 0;					//!< Number of runs.
+	};
+
+	std::vector<Shard> shards_;				//!< One per used GPU.
+	std::vector<ParamSweep> axes_;			//!< Axes of the sweep, printed per run.
+	std::vector<SwarmParams> matrix_;		//!< Parameters per run.
+	std::string output_;					//!< CSV file of the summaries. Empty: standard output.
+	unsigned int current_ = 0;				//!< Index of the stores that contain the latest positions and states.
+	unsigned int fishies_;					//!< Fishies per run.
+	unsigned int sharksPerRun_;				//!< Sharks per run.
+
+	const float WAYPOINT_THRESHOLD = 0.1;	//!< Threshold for waypoint goal.
+
+	float speed;							//!< speed of particles per step (SwarmConfig::swarmSpeed * dt).
+	double dt_;								//!< Simulated time per step.
+	WaypointList* waypointList;				//!< Waypoint List contains waypoints for particles.
+	Vector3 swarmCenter;					//!< Position of swarm center, the same for all runs.
+
+	/*!
+	 * @brief Move Swarm center to waypoint
+	 */
+	void moveSwarmCenter();
+
+	/*!
+	 * @brief Make the GPU and the kernel context of a shard current.
+	 * @param shard shard.
+	 */
+	void use( const Shard& shard );
+
+	/*!
+	 * @brief Switch back to the first GPU and the default kernel context.
+	 */
+	void restore();
+
+	/*!
+	 * @brief Write the summaries of all runs. With telemetry every line gets the means of its GPU and its energy per million fish steps.
+	 * @param os output stream.
+	 * @param steps number of steps of the run.
+	 */
+	void writeSummary( std::ostream& os, unsigned int steps );
+
+public:
+
+	/*!
+	 * @brief Constructor. Builds the run matrix of config.sweep, shards it over the GPUs and spawns every run
+	 * with config.numParticles fishies and config.numSharks sharks. Every run starts with the same sharks.
+	 * @param config sweep axes, output and the base parameters of every run. --device limits the sweep to one GPU.
+	 */
+	SweepDriver( const SwarmConfig& config );
+
+	/*!
+	 * @brief Calculate one simulation step of all runs on all GPUs.
+	 */
+	void step();
+
+	/*!
+	 * @brief Calculate the given number of steps, print the throughput and write the summaries of all runs.
+	 * @param steps number of steps.
+	 */
+	void run( unsigned int steps );
+
+	/*!
+	 * @brief Free Memory on all GPUs.
+	 */
+	void cleanUp();
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * @brief ThreadPool runs loops over index ranges on worker threads, e.g. the fishies of a CPU simulation step.
+ * The range is split into chunks which the threads take from a shared counter until none are left,
+ * so fast threads take over the chunks of slow ones. The calling thread works on the chunks too.
+ */
+class ThreadPool
+{
+public:
+
+	/*!
+	 * @brief Body of a parallel loop.
+	 * @param begin first index of the chunk.
+	 * @param end index after the last one of the chunk.
+	 */
+	typedef std::function<void( unsigned int begin, unsigned int end )> RangeBody;
+
+private:
+
+	std::vector<std::thread> workers_;		//!< Worker threads, the caller is the last thread.
+	std::mutex mutex_;						//!< Guards the loop settings, generation_, active_ and stop_.
+	std::condition_variable wakeUp_;		//!< Signals a new loop or the stop.
+	std::condition_variable done_;			//!< Signals that the last worker finished the loop.
+	const RangeBody* body_ = NULL;			//!< Body of the current loop.
+	unsigned int count_ = 0;				//!< Number of indices of the current loop.
+	unsigned int chunk_ = 1;				//!< Indices per chunk of the current loop.
+	std::atomic<unsigned int> next_;		//!< First index of the next free chunk.
+	unsigned long long generation_ = 0;		//!< Number of started loops.
+	unsigned int active_ = 0;				//!< Workers still busy with the current loop.
+	bool stop_ = false;						//!< Workers return.
+
+	/*!
+	 * @brief Take chunks of the current loop and run them until none are left.
+	 */
+	void runChunks();
+
+	/*!
+	 * @brief Worker thread: wait for loops until stop_ is set.
+	 */
+	void work();
+
+public:
+
+	/*!
+	 * @brief Constructor. Starts the workers.
+	 * @param threads number of threads including the caller. 0: one per hardware thread.
+	 */
+	explicit ThreadPool( unsigned int threads = 0 );
+
+	/*!
+	 * @brief Destructor. Stops and joins the workers.
+	 */
+	~ThreadPool();
+
+	ThreadPool( const ThreadPool& ) = delete;
+	ThreadPool& operator=( const ThreadPool& ) = delete;
+
+	/*!
+	 * @brief Run body for all chunks of [0, count) and wait until all are done. Not reentrant.
+	 * @param count number of indices.
+	 * @param chunk indices per chunk. Chunk i starts at i * chunk.
+	 * @param body body of the loop. Called from several threads at once.
+	 */
+	void parallelFor( unsigned int count, unsigned int chunk, const RangeBody& body );
+
+	/*!
+	 * @brief Get the number of threads of a loop.
+	 * @return workers and the caller.
+	 */
+	inline unsigned int getThreadCount() const { return static_cast< unsigned int >( workers_.size() ) + 1; }
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vector>
+
+#include "swarm_config.h"
+#include "swarm_stats.h"
+#include "waypoint_list.h"
+
+/*!
+ * @brief ThrustSimulation runs the classic behaviour with thrust algorithms over thrust::device_vector, as portable reference.
+ * Same rules as d_swim and CpuSimulation: the grid is rebuilt every step with transform, stable_sort_by_key, lower_bound
+ * and gather, the fishies are advanced with for_each and the stats are one transform_reduce. The device system is chosen
+ * at compile time with THRUST_DEVICE_SYSTEM (CUDA by default, THRUST_DEVICE_SYSTEM_OMP or THRUST_DEVICE_SYSTEM_TBB for the CPU),
+ * so the same source runs on every machine. Not tuned: the numbers are the baseline of the d_advance variants.
+ * Eaten fishies keep their slots: there is no compaction, reorder or emitter.
+ */
+class ThrustSimulation
+{
+public:
+
+	static const unsigned int GRID_SIZE = 64;	//!< Maximum number of cells per axis, as in kernel.cu.
+	static const unsigned int GRID_NUM_CELLS = GRID_SIZE * GRID_SIZE * GRID_SIZE;
+
+private:
+
+	struct Arrays;							//!< Device vectors of the stores and the grid, defined in thrust_simulation.cu.
+
+	Arrays* arrays_;						//!< Stores, grid and sharks on the device system.
+	unsigned int current_ = 0;				//!< Index of the store that contains the latest positions and states.
+	std::vector<float> sharks_;				//!< Shark positions (x, y, z, w), moved on the host.
+	std::vector<float> sharkState_;			//!< Shark speed vectors and masses.
+
+	float origin_[3];						//!< Lower corner of cell (0, 0, 0).
+	float cellSize_;						//!< Edge length of a cell (fishDist).
+	int dims_[3];							//!< Cells per axis (3 to GRID_SIZE). Cells outside wrap around.
+
+	unsigned int numParticles_;				//!< Number of Particles
+	unsigned int numSharks_;				//!< Number of Sharks
+	SwarmParams params_;					//!< Behaviour parameters.
+	unsigned int firstK_;					//!< See NeighbourQuery.
+	unsigned long long seed_;				//!< Seed of the random numbers.
+	unsigned int stepCount_ = 0;			//!< Simulated steps, part of the random numbers.
+	SwarmStats stats_;						//!< Aggregates of the current store.
+	double particleUpdates_ = 0.0;			//!< Number of fish updates of the last run.
+
+	const float WAYPOINT_THRESHOLD = 0.1;	//!< Threshold for waypoint goal.
+
+	float speed;							//!< speed of particles per step (SwarmConfig::swarmSpeed * dt).
+	double dt_;								//!< Simulated time per step.
+	WaypointList* waypointList;				//!< Waypoint List contains waypoints for particles.
+	Vector3 swarmCenter;					//!< Position of swarm center.
+
+	/*!
+	 * @brief Move Swarm center to waypoint
+	 */
+	void moveSwarmCenter();
+
+	/*!
+	 * @brief Aggregate the current store into stats_.
+	 */
+	void reduceStats();
+
+	/*!
+	 * @brief Place the grid around the bounding box of stats_, like kernel_set_grid_bounds.
+	 */
+	void placeGrid();
+
+	/*!
+	 * @brief Sort the fishies of the current store into the grid cells.
+	 */
+	void buildGrid();
+
+	/*!
+	 * @brief Move the sharks with the rules of d_moveSharks and copy them to the device system.
+	 */
+	void moveSharks();
+
+public:
+
+	/*!
+	 * @brief Constructor. Spawns fishies and sharks and copies them to the device system.
+	 * @param config Number of particles and sharks, behaviour parameters, first k, seed and simulation rate.
+	 */
+	ThrustSimulation( const SwarmConfig& config );
+
+	/*!
+	 * @brief Destructor.
+	 */
+	~ThrustSimulation();
+
+	ThrustSimulation( const ThrustSimulation& ) = delete;
+	ThrustSimulation& operator=( const ThrustSimulation& ) = delete;
+
+	/*!
+	 * @brief Name of the device system of the build.
+	 * @return "CUDA", "OpenMP", "TBB" or "C++".
+	 */
+	static const char* deviceSystem();
+
+	/*!
+	 * @brief Check if the device system of the build needs a CUDA device.
+	 * @return true for THRUST_DEVICE_SYSTEM_CUDA.
+	 */
+	static bool needsCuda();
+
+	/*!
+	 * @brief Calculate one simulation step.
+	 */
+	void step();
+
+	/*!
+	 * @brief Calculate the given number of steps and print the throughput.
+	 * @param steps number of steps.
+	 */
+	void run( unsigned int steps );
+
+	/*!
+	 * @brief Get the aggregates of the living fishies after the last step.
+	 * @return aggregates.
+	 */
+	inline const SwarmStats& getStats() const { return stats_; }
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*!
+ * @brief Tracks of the trace, one row each in the viewer.
+ */
+enum class TraceTrack
+{
+	MAIN,			//!< Render thread: frames, their parts and the swap.
+	CUDA,			//!< GPU stages on the simulation stream, from CUDA events.
+	OPENGL,			//!< GPU stages of OpenGL, from timestamp queries.
+	COUNT			//!< Number of tracks.
+};
+
+/*!
+ * @brief TraceExporter writes timed ranges as Chrome Trace Event JSON, which chrome://tracing and the Perfetto UI open.
+ * All ranges are on the steady clock of the host. The GPU timers are converted to it by their producers (FrameProfiler),
+ * so CPU and GPU tracks line up. Ranges are collected in batches by the render thread and written by a background thread,
+ * the frame never waits for the disk. add and submit must be called by the same thread.
+ */
+class TraceExporter
+{
+private:
+
+	static const size_t BATCH = 1024;		//!< Ranges per batch handed to the writer.
+
+	/*!
+	 * @brief One complete range ("ph":"X").
+	 */
+	struct TraceEvent
+	{
+		const char* name;					//!< Static name, e.g. a stage name.
+		TraceTrack track;					//!< Row of the range.
+		double start;						//!< Start on the steady clock in seconds.
+		double ms;							//!< Duration in ms.
+	};
+
+	std::string path_;						//!< Trace file. Empty: disabled.
+	std::FILE* file_ = NULL;				//!< Written by the writer thread only, after the constructor.
+	double epoch_;							//!< Steady clock time of ts 0 in seconds.
+	std::vector<TraceEvent> pending_;		//!< Ranges of the render thread, not handed over yet.
+	unsigned long long events_ = 0;			//!< Ranges written. Writer thread only.
+
+	std::thread writer_;					//!< Writes the batches into file_.
+	std::mutex mutex_;						//!< Guards queue_ and stop_.
+	std::condition_variable wakeUp_;		//!< Signals a new batch or the stop.
+	std::deque<std::vector<TraceEvent>> queue_;	//!< Batches to write.
+	bool stop_ = false;						//!< Writer thread ends, when the queue is empty.
+
+	/*!
+	 * @brief Writer thread: write queued batches until stop_ is set.
+	 */
+	void writeEvents();
+
+public:
+
+	/*!
+	 * @brief Constructor. Opens the file, writes the track names and starts the writer thread.
+	 * @param path trace file, e.g. frames.json. Empty: disabled, add does nothing.
+	 */
+	explicit TraceExporter( const std::string& path );
+
+	/*!
+	 * @brief Destructor. Writes the pending ranges, closes the JSON and the file.
+	 */
+	~TraceExporter();
+
+	TraceExporter( const TraceExporter& ) = delete;
+	TraceExporter& operator=( const TraceExporter& ) = delete;
+
+	/*!
+	 * @brief Check if ranges are written.
+	 * @return true, if the file is open.
+	 */
+	inline bool isEnabled() const { return file_ != NULL; }
+
+	/*!
+	 * @brief Get the time of the steady clock, the clock of all ranges.
+	 * @return time in seconds.
+	 */
+	static double now();
+
+	/*!
+	 * @brief Add a range. Cheap, the range is only stored until the next batch.
+	 * @param name static name, must outlive the exporter.
+	 * @param track row.
+	 * @param start start on the steady clock (now) in seconds.
+	 * @param ms duration in ms.
+	 */
+	void add( const char* name, TraceTrack track, double start, double ms );
+
+	/*!
+	 * @brief Hand the pending ranges to the writer thread, if a batch is full. Call once per frame.
+	 */
+	void submit();
+};
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cuda_device.h"
+#include "cuda_device_array.h"
+#include "cuda_host_array.h"
+#include "gpu_compressor.h"
+#include "shader.h"
+#include "simulation_backend.h"
+#include "swarm_config.h"
+#include "trajectory_recorder.h"
+#include "uniform_buffer.h"
+#include "vertex_array.h"
+#include "vertex_buffer.h"
+
+/*!
+ * @brief TrajectoryPlayer plays the chunk files of a TrajectoryRecorder in the window instead of simulating. The files are
+ * memory-mapped; a loader thread copies the next frames into pinned slots (the reads from disk happen there), the main thread
+ * uploads loaded slots on a copy stream while the current frame is drawn and unpacks the wanted one into the position VBO.
+ * Keys: P pauses, period shows the next frame, page up and down seek 10 seconds, home restarts, [ and ] halve and double the rate.
+ * The recorded steps are played at --rate steps per second times the rate. Sharks aren't recorded, only fishies are drawn.
+ * Compressed recordings move the compressed records through the slots and are decompressed on the device before the unpack.
+ */
+class TrajectoryPlayer : public SimulationBackend
+{
+private:
+
+	/*!
+	 * @brief A mapped chunk file.
+	 */
+	struct MappedChunk
+	{
+		const char* data = NULL;			//!< Mapped file.
+		size_t size = 0;					//!< Size of the file.
+		void* file = NULL;					//!< File and mapping handles (Windows).
+		void* mapping = NULL;
+	};
+
+	/*!
+	 * @brief A recorded frame in one of the mapped chunks.
+	 */
+	struct FrameRef
+	{
+		const char* data;					//!< Frame or record in the mapping.
+		size_t bytes;						//!< Bytes at data: frameSize_, or the record size if compressed.
+		const char* key;					//!< First frame of the chunk, the differences are to it (delta_).
+		unsigned long long step;			//!< Recorded step.
+	};
+
+	/*!
+	 * @brief Where a slot is in the pipeline. The loader thread only takes FREE slots, everything else is done by render.
+	 */
+	enum class SlotState
+	{
+		FREE,								//!< Unused, the copy from it is done.
+		LOADING,							//!< The loader thread copies a frame from the mapping into it.
+		LOADED,								//!< Pinned memory holds the frame.
+		UPLOADED,							//!< Copy to the device issued on copyStream_.
+		SHOWN								//!< Unpacked into the VBO, kept while wanted and until its copy is done.
+	};
+
+	/*!
+	 * @brief Pinned and device memory of one frame in flight.
+	 */
+	struct Slot
+	{
+		CudaHostArray<char>* host = NULL;	//!< Frame read from the mapping.
+		CudaDeviceArray<char> device;		//!< Frame on the device.
+		cudaEvent_t copied;					//!< Recorded on copyStream_ after the upload.
+		cudaEvent_t unpacked;				//!< Recorded on stream_ after the unpack, the next upload waits for it.
+		SlotState state = SlotState::FREE;	//!< Guarded by mutex_.
+		size_t frame = 0;					//!< Frame in the slot, unless FREE.
+	};
+
+	static const unsigned int SLOTS = 4;	//!< Frames in flight: loading, loaded, uploading and shown.
+
+	std::vector<MappedChunk> chunks_;		//!< Mapped chunk files, in the order of their numbers.
+	std::vector<FrameRef> frames_;			//!< All frames, in the order of their steps.
+	unsigned int entries_ = 0;				//!< Recorded fishies per frame.
+	bool quantized_ = false;				//!< 16 bit positions.
+	size_t frameSize_ = 0;					//!< Bytes per frame.
+	unsigned int compression_ = 0;			//!< Compression of the chunks (TrajectoryChunkHeader::compression), 0: raw.
+	bool delta_ = false;					//!< Frames are differences to the first one of their chunk.
+	size_t slotSize_ = 0;					//!< Bytes per slot: frameSize_, or the biggest record if compressed.
+
+	CudaDevice device_;						//!< Registers and maps the position VBO.
+	cudaStream_t stream_ = NULL;			//!< Unpacks into the VBO.
+	cudaStream_t copyStream_ = NULL;		//!< Uploads of the slots, beside the unpacks and draws.
+	Slot slots_[SLOTS];						//!< Frames in flight.
+
+	GpuCompressor* compressor_ = NULL;		//!< Decompresses the records on stream_, if compressed.
+	CudaDeviceArray<char> d_frame_;			//!< Decompressed frame, read by the unpack.
+	CudaDeviceArray<char> d_key_;			//!< Decompressed first frame of the chunk keyData_, if delta_.
+	const char* keyData_ = NULL;			//!< Key (FrameRef::key) in d_key_. NULL: none yet.
+	CudaHostArray<char>* keyHost_ = NULL;	//!< Upload of a key, which wasn't shown before the frames after it (seeks).
+	CudaDeviceArray<char> d_keyRecord_;		//!< Record of that key on the device.
+	CudaHostArray<SwarmStats>* statsHost_ = NULL;	//!< Stats of the decompressed frame, read in the next frame.
+	cudaEvent_t statsCopied_;				//!< Recorded on stream_ after the copy into statsHost_.
+	bool statsPending_ = false;				//!< statsHost_ is copied and not read yet.
+
+	std::thread loader_;					//!< Copies frames from the mapping into FREE slots.
+	std::mutex mutex_;						//!< Guards the slot states, wanted_, stride_ and stop_.
+	std::condition_variable wakeUp_;		//!< Signals a free slot, a new wanted frame or the stop.
+	size_t wanted_ = 0;						//!< Frame of the playhead, the loader loads wanted_ + k * stride_.
+	size_t stride_ = 1;						//!< Recorded frames per drawn frame at the current rate.
+	bool stop_ = false;						//!< Loader thread ends.
+
+	Shader shader_;							//!< Same point shader as the simulating backends.
+	UniformBuffer* frameUniforms_ = NULL;	//!< Matrices of the frame (FrameUniforms block).
+	int pointSizeLocation_;					//!< Location of u_pointsize in shader_.
+	VertexArray va_;						//!< Positions and colors.
+	VertexBuffer* vb_ = NULL;				//!< Positions of the shown frame. Written by CUDA.
+	VertexBuffer* vbC_ = NULL;				//!< Color buffer.
+	int vbResource_ = -1;					//!< CUDA resource index of vb_.
+
+	FrameProfiler profiler_;				//!< Times map, unpack (pack), unmap, draw and swap of every frame.
+	FrameTimeRecorder frameTimes_;			//!< Wall time of the last frames: upload and unpack, render and present.
+	std::string frameDump_;					//!< File for the frame times at exit. Empty: no dump at exit.
+	SwarmStats stats_ = {};					//!< Bounding box of the shown frame.
+
+	double stepsPerSecond_;					//!< Recorded steps per second at rate 1 (--rate).
+	float rate_;							//!< Playback speed, keys [ and ].
+	double playhead_ = 0.0;					//!< Step at the playhead.
+	double lastUpdate_;						//!< Time of the last frame.
+	size_t shown_ = SIZE_MAX;				//!< Frame in the VBO. SIZE_MAX: none yet.
+	unsigned long long late_ = 0;			//!< Frames the wanted frame wasn't uploaded yet and an older one stayed.
+
+	/*!
+	 * @brief Map the chunk files <prefix>_00000.traj, <prefix>_00001.traj, ... up to the first missing one and index their frames.
+	 * @param prefix path prefix of the recording.
+	 * @return false, if no chunk can be read or the chunks don't fit together.
+	 */
+	bool open( const std::string& prefix );
+
+	/*!
+	 * @brief Find the frame of a step.
+	 * @param step step.
+	 * @return last frame with a step up to this one, the first frame before it.
+	 */
+	size_t frameAt( double step ) const;
+
+	/*!
+	 * @brief Check if the loader should have a frame in a slot now. Needs mutex_.
+	 * @param frame frame.
+	 * @return true, if it is wanted_ + k * stride_ for k < SLOTS.
+	 */
+	bool isWanted( size_t frame ) const;
+
+	/*!
+	 * @brief Loader thread: copy the wanted frames which are in no slot yet into free slots until stop_ is set.
+	 */
+	void loadFrames();
+
+	/*!
+	 * @brief Move the slots on: free the ones which aren't wanted any more and whose copy is done, upload the loaded ones
+	 * and unpack the wanted frame into the VBO, if it is on the device.
+	 */
+	void updateSlots();
+
+	/*!
+	 * @brief Decompress a record of a slot into d_frame_ and add the key frame back, on stream_. Keeps a key frame in d_key_.
+	 * A key which isn't in d_key_ yet is uploaded from the mapping: only after a seek into the middle of a chunk.
+	 * @param slot uploaded slot.
+	 * @return d_frame_.
+	 */
+	const char* decode( const Slot& slot );
+
+	/*!
+	 * @brief Keys of the playback: seek, restart, rate and single frames.
+	 * @param elapsed seconds since the last frame.
+	 */
+	void handleKeys( double elapsed );
+
+public:
+
+	/*!
+	 * @brief Constructor. Maps the recording, allocates the slots and the VBO and starts the loader thread. Needs the OpenGL context.
+	 * @param config playback prefix and rate, device, simulation rate, frame timer settings.
+	 */
+	TrajectoryPlayer( const SwarmConfig& config );
+
+	/*!
+	 * @brief Destructor. Stops the loader thread and unmaps the files.
+	 */
+	~TrajectoryPlayer();
+
+	TrajectoryPlayer( const TrajectoryPlayer& ) = delete;
+	TrajectoryPlayer& operator=( const TrajectoryPlayer& ) = delete;
+
+	/*!
+	 * @brief Check if a recording was found.
+	 * @return true, if there is at least one frame.
+	 */
+	inline bool isOpen() const { return !frames_.empty(); }
+
+	/*!
+	 * @brief Advance the playhead by the elapsed time, show its frame as soon as it is uploaded and draw it.
+	 */
+	void render() override;
+
+	/*!
+	 * @brief Get the bounding box of the shown frame. The other aggregates aren't recorded.
+	 * @return aggregates.
+	 */
+	inline const SwarmStats& getStats() const override { return stats_; }
+
+	/*!
+	 * @brief Get the stage timers, e.g. to time the buffer swap.
+	 * @return profiler.
+	 */
+	inline FrameProfiler& getProfiler() override { return profiler_; }
+
+	/*!
+	 * @brief Get the frame time recorder, e.g. to time the buffer swap.
+	 * @return recorder.
+	 */
+	inline FrameTimeRecorder& getFrameTimes() override { return frameTimes_; }
+
+	/*!
+	 * @brief Stop the loader, free slots and buffers. Prints the frame time report and the late frames.
+	 */
+	void cleanUp() override;
+};
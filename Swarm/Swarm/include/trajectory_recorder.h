@@ -0,0 +1,150 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cuda_device_array.h"
+#include "cuda_host_array.h"
+#include "gpu_compressor.h"
+#include "particle_store.h"
+#include "swarm_config.h"
+
+/*
+ * Trajectory chunk file <prefix>_<chunk>.traj: TrajectoryChunkHeader, the steps of the frames (unsigned long long each),
+ * then the frames with frameSize bytes each. A frame starts with the SwarmStats of the step (bounding box for the
+ * quantisation), padded to TRAJECTORY_POSITIONS_OFFSET, followed by x, then y, then z of the recorded fishies in the order of their ids.
+ * Float positions are NaN for dead fishies. Quantised positions are lower + q / 65534 * ( upper - lower ), 0xFFFF for dead fishies.
+ * Compressed chunks (version 2, compression set) hold one GpuCompressor record per frame instead, each a multiple of 8 bytes.
+ * With delta set, the quantised positions of all but the first frame of the chunk are differences to the first one (modulo 2^16).
+ */
+
+static const char TRAJECTORY_MAGIC[8] = { 'S', 'W', 'A', 'R', 'M', 'T', 'R', 'J' };
+static const unsigned int TRAJECTORY_VERSION = 2;
+static const size_t TRAJECTORY_POSITIONS_OFFSET = 64;	//!< Offset of the positions in a frame.
+
+/*!
+ * @brief Header of a trajectory chunk file.
+ */
+struct TrajectoryChunkHeader
+{
+	char magic[8];							//!< TRAJECTORY_MAGIC.
+	unsigned int version;					//!< TRAJECTORY_VERSION.
+	unsigned int entries;					//!< Recorded fishies per frame.
+	unsigned int stride;					//!< Fish id of entry i is i * stride.
+	unsigned int quantized;					//!< 1: 16 bit positions, 0: float.
+	unsigned int frameCount;				//!< Frames in this chunk.
+	unsigned int frameSize;					//!< Bytes per frame, before the compression.
+	unsigned int compression;				//!< Compression of the frames, 0 (OFF): raw. Version 2.
+	unsigned int delta;						//!< 1: frames are differences to the first one of the chunk. Version 2.
+};
+
+/*!
+ * @brief TrajectoryRecorder writes the positions of the fishies every few steps into chunk files, without stalling the simulation.
+ * The positions are packed by id on the simulation stream into one of two device frames, copied into pinned chunk memory on
+ * a side stream and written by a background thread. Two chunks alternate: one is filled while the other one is written.
+ * If the disk is slower than the simulation, frames are dropped and counted instead of waiting.
+ * With --compression the frames are compressed on the side stream straight into mapped chunk memory, so only the compressed
+ * bytes cross the bus. Quantised frames are stored as differences to the first frame of their chunk, which compress far better.
+ */
+class TrajectoryRecorder
+{
+private:
+
+	/*!
+	 * @brief Pinned memory of a chunk file.
+	 */
+	struct Chunk
+	{
+		CudaHostArray<char>* data = NULL;	//!< Frames of the chunk. Mapped, if compressed.
+		char* deviceData = NULL;			//!< Device pointer of data, if compressed.
+		CudaHostArray<unsigned long long>* used = NULL;	//!< Bytes of the compressed records in data, written by the GPU. Mapped.
+		unsigned long long* deviceUsed = NULL;	//!< Device pointer of used.
+		std::vector<unsigned long long> steps;	//!< Step of every frame.
+		cudaEvent_t copied;					//!< Recorded on the copy stream after the last frame.
+		bool busy = false;					//!< Queued for or being written by the writer thread. Guarded by mutex_.
+	};
+
+	std::string prefix_;					//!< Path prefix of the chunk files. Empty: disabled.
+	unsigned int every_;					//!< Record every this number of calls of record.
+	unsigned int stride_;					//!< Record every stride-th fish.
+	bool quantize_;							//!< Record 16 bit positions.
+	unsigned int framesPerChunk_;			//!< Frames per chunk file.
+	unsigned int entries_ = 0;				//!< Recorded fishies per frame.
+	size_t frameSize_ = 0;					//!< Bytes per frame.
+	Compression compression_;				//!< Codec of the frames (--compression).
+	GpuCompressor* compressor_ = NULL;		//!< Compresses the frames on copyStream_. NULL or disabled: raw frames.
+	bool delta_ = false;					//!< Compressed quantised frames are differences to the first one of their chunk.
+	CudaDeviceArray<char> d_key_;			//!< First frame of the chunk which is filled now, if delta_.
+
+	cudaStream_t copyStream_ = NULL;		//!< Side stream of the copies into pinned memory.
+	CudaDeviceArray<char> d_frame_[2];		//!< Packed frames on the device. One is packed while the other one is copied.
+	cudaEvent_t packed_[2];					//!< Recorded on the simulation stream after packing a device frame.
+	cudaEvent_t frameCopied_[2];			//!< Recorded on the copy stream after copying a device frame.
+	unsigned int nextFrame_ = 0;			//!< Device frame of the next record.
+
+	Chunk chunks_[2];						//!< Chunks in pinned memory.
+	unsigned int filling_ = 0;				//!< Chunk which is filled now.
+	unsigned int chunkIndex_ = 0;			//!< Number of the next chunk file.
+
+	std::thread writer_;					//!< Writes full chunks into files.
+	std::mutex mutex_;						//!< Guards queue_, stop_ and Chunk::busy.
+	std::condition_variable wakeUp_;		//!< Signals a new chunk or the stop.
+	std::deque<std::pair<unsigned int, unsigned int>> queue_;	//!< Chunks to write: (chunk, file number).
+	bool stop_ = false;						//!< Writer thread ends, when the queue is empty.
+
+	unsigned long long calls_ = 0;			//!< Calls of record.
+	unsigned long long recorded_ = 0;		//!< Recorded frames.
+	unsigned long long dropped_ = 0;		//!< Frames dropped, because no chunk was free.
+
+	/*!
+	 * @brief Queue the chunk which is filled now for writing and switch to the other one.
+	 */
+	void submit();
+
+	/*!
+	 * @brief Writer thread: write queued chunks until stop_ is set.
+	 */
+	void writeChunks();
+
+public:
+
+	/*!
+	 * @brief Constructor. Allocates device frames and pinned chunks and starts the writer thread, if config.trajectory is set.
+	 * @param config trajectory settings (trajectory, trajectory_every, trajectory_stride, trajectory_quantize, trajectory_chunk, compression).
+	 * @param numParticles number of fishies (ids 0 to numParticles - 1).
+	 */
+	TrajectoryRecorder( const SwarmConfig& config, unsigned int numParticles );
+
+	/*!
+	 * @brief Destructor. Writes the last chunk.
+	 */
+	~TrajectoryRecorder();
+
+	TrajectoryRecorder( const TrajectoryRecorder& ) = delete;
+	TrajectoryRecorder& operator=( const TrajectoryRecorder& ) = delete;
+
+	/*!
+	 * @brief Record the positions of the fishies, if this call is one of every_. Returns without waiting for the GPU.
+	 * Reduces the stats on the stream, so the frame has the bounding box of this step.
+	 * @param particles current state.
+	 * @param mesh_count number of fishies in the active set.
+	 * @param step number of the step.
+	 * @param stream simulation stream. The particles are read on it before the next kernels.
+	 */
+	void record( ParticleArrays particles, unsigned int mesh_count, unsigned long long step, cudaStream_t stream );
+
+	/*!
+	 * @brief Write the last chunk, stop the writer thread and print the number of recorded and dropped frames.
+	 */
+	void finish();
+
+	/*!
+	 * @brief Check if the recorder writes files.
+	 * @return true, if a path prefix is set.
+	 */
+	inline bool isEnabled() const { return !prefix_.empty(); }
+};
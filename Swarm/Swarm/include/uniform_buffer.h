@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+
+#include "glew.h"
+
+/*!
+ * @brief UniformBuffer holds a uniform block which is rewritten every frame, e.g. the matrices of all draw calls.
+ * The buffer has a region per upload in flight. With ARB_buffer_storage the regions are persistently mapped
+ * and a region is only rewritten after the fence of its last frame, else glBufferSubData is used.
+ */
+class UniformBuffer
+{
+private:
+
+	static const unsigned int FRAMES = 3;	//!< Frames in flight, so the GPU can still read the last frames while the next one is written.
+
+	unsigned int renderID_;					//!< Holds the id of the created buffer.
+	unsigned int binding_;					//!< Uniform buffer binding point of the block.
+	size_t size_;							//!< Size of the block.
+	size_t stride_;							//!< Distance of two regions, aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+	char* mapped_ = NULL;					//!< Persistent mapping of the whole buffer. NULL: glBufferSubData.
+	unsigned int regions_;					//!< FRAMES regions per upload of a frame.
+	std::vector<GLsync> fences_;			//!< Signaled, when the draws which used the region are done.
+	unsigned int region_;					//!< Region of the last upload.
+
+public:
+
+	/*!
+	 * @brief Create the buffer.
+	 * @param size size of the block (std140 layout).
+	 * @param binding binding point. Shaders connect their block with Shader::bindUniformBlock.
+	 * @param uploadsPerFrame uploads of a frame, e.g. one per viewport. Each one gets regions of its own.
+	 */
+	UniformBuffer( size_t size, unsigned int binding, unsigned int uploadsPerFrame = 1 );
+
+	/*!
+	 * @brief Destroy the buffer and the fences.
+	 */
+	~UniformBuffer();
+
+	UniformBuffer( const UniformBuffer& ) = delete;
+	UniformBuffer& operator=( const UniformBuffer& ) = delete;
+
+	/*!
+	 * @brief Write the block of the next frame or viewport and bind it to the binding point.
+	 * Draws issued before this call keep reading the old region.
+	 * @param data block, size bytes.
+	 * @return region of the upload, for rewrite.
+	 */
+	unsigned int upload( const void* data );
+
+	/*!
+	 * @brief Overwrite an uploaded block in place after its draws were issued, without glFinish (late latch).
+	 * The draws read whichever block is in memory when the GPU runs them, so they only see it if they haven't started.
+	 * @param region region returned by upload in this frame.
+	 * @param data block, size bytes.
+	 * @return false without persistent mapping, the draws keep the uploaded block.
+	 */
+	bool rewrite( unsigned int region, const void* data );
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "cuda_device.h"
+#include "cuda_device_array.h"
+#include "cuda_host_array.h"
+#include "particle_store.h"
+#include "swarm_config.h"
+#include "waypoint_list.h"
+
+/*!
+ * @brief ValidationRun checks a neighbour search against the brute force reference (d_advance).
+ * Both start from the same seed and spawn. Every step, the candidate runs on the state of the reference
+ * with the same random numbers, so the difference is the error of one step and doesn't grow with the chaos of the swarm.
+ * Without window and compaction, reorder or emitter, so slot i is fish i in both.
+ */
+class ValidationRun
+{
+private:
+
+	CudaDevice device_;						//!< Cuda Device. Used to simply communicate with the gpu.
+	cudaStream_t stream_;					//!< Stream for all kernels and copies.
+
+	ParticleStore* reference_[2];			//!< State of the reference (ping-pong).
+	ParticleStore* candidate_;				//!< Result of the candidate step.
+	unsigned int current_ = 0;				//!< Index of the reference store with the latest state.
+	CudaDeviceArray<float> d_sharks;		//!< contains shark positions in memory on device.
+	CudaDeviceArray<float> d_shark_state;	//!< contains shark forces and masses in memory on device.
+
+	CudaHostArray<float> h_reference_;		//!< Positions of the reference step (x, then y, then z).
+	CudaHostArray<float> h_candidate_;		//!< Positions of the candidate step (x, then y, then z).
+	CudaHostArray<unsigned char> h_referenceAlive_;	//!< Alive flags of the reference step.
+	CudaHostArray<unsigned char> h_candidateAlive_;	//!< Alive flags of the candidate step.
+
+	static const unsigned int GRID_UPDATE_INTERVAL = 16;	//!< Steps between two updates of the grid bounds.
+	static const unsigned int MAX_REPORTED_STEPS = 10;		//!< Diverged steps printed in detail.
+
+	unsigned int numParticles_;				//!< Number of Particles
+	unsigned int numSharks_;				//!< Number of Sharks. Moved on GPU.
+	SearchMode candidateMode_;				//!< Neighbour search which is validated.
+	float tolerance_;						//!< Largest allowed position difference per step.
+
+	const float WAYPOINT_THRESHOLD = 0.1;	//!< Threshold for waypoint goal.
+
+	float speed;							//!< speed of particles per step (SwarmConfig::swarmSpeed * dt).
+	WaypointList* waypointList;				//!< Waypoint List contains waypoints for particles.
+	Vector3 swarmCenter;					//!< Position of swarm center.
+
+	/*!
+	 * @brief Move Swarm center to waypoint
+	 */
+	void moveSwarmCenter();
+
+	/*!
+	 * @brief Update the grid bounds from the reference state. Waits for the GPU.
+	 */
+	void updateGridBounds();
+
+	/*!
+	 * @brief Copy positions and alive flags of a store into host memory.
+	 * @param particles store.
+	 * @param positions Output: positions (x, then y, then z).
+	 * @param alive Output: alive flags.
+	 */
+	void download( ParticleStore& particles, CudaHostArray<float>& positions, CudaHostArray<unsigned char>& alive );
+
+public:
+
+	/*!
+	 * @brief Constructor.
+	 * Spawns the fishies and allocates reference and candidate on the GPU.
+	 * @param config Number of particles and sharks, search mode of the candidate, tolerance.
+	 */
+	ValidationRun( const SwarmConfig& config );
+
+	/*!
+	 * @brief Run the steps, compare the positions after every step and print the divergence.
+	 * @param steps number of steps.
+	 * @return true, if no position differed by more than the tolerance and the same fishies were eaten.
+	 */
+	bool run( unsigned int steps );
+
+	/*!
+	 * @brief Free Memory on GPU.
+	 */
+	void cleanUp();
+};
@@ -3,6 +3,8 @@
 #include <iostream>
 #include <cmath>
 
+#include "swarm_vector.h"
+
 using namespace std;
 
 /*!
@@ -30,31 +32,56 @@ public:
 	 */
 	Vector3( float x, float y, float z );
 
+	/*!
+	 * @brief Constructor from the shared vector type, w is dropped.
+	 * @param v vector.
+	 */
+	Vector3( const SwarmVector& v ) :
+		x( v.x ), y( v.y ), z( v.z )
+	{}
+
+	/*!
+	 * @brief Get the shared vector type, e.g. for a float4 of the kernels or a glm vector of the renderer.
+	 * @param w payload.
+	 * @return vector.
+	 */
+	SwarmVector toSwarmVector( float w = 0.0f ) const
+	{
+		return SwarmVector( x, y, z, w );
+	}
+
+	/*!
+	 * @brief Multiplicate to vectors.
+	 * @param vec an other vector.
+	 * @return Get Euclidian distance.
+	 */
+	float dot( const Vector3& vec ) const;
+
 	/*!
 	 * @brief Multiplicate to vectors.
 	 * @param vec an other vector.
 	 * @return Get Euclidian distance.
 	 */
-	float dot( Vector3* vec );
+	float dot( const Vector3* vec ) const;
 
 	/*!
 	 * @brief Get length of the vector.
 	 * @return length.
 	 */
-	float length();
+	float length() const;
 
 	/*!
 	 * @brief Norm Vector.
 	 * @return a normalized vector.
 	 */
-	Vector3 normalized();
+	Vector3 normalized() const;
 
 	/*!
 	 * @brief add two vectors.
 	 * @param vec other vector.
 	 * @return sum of this vectors in a new vector.
 	 */
-	Vector3 operator+( const Vector3& vec )
+	Vector3 operator+( const Vector3& vec ) const
 	{
 		return Vector3( x + vec.x, y + vec.y, z + vec.z );
 	}
@@ -75,7 +102,7 @@ public:
 	 * @param vec other vector.
 	 * @return difference of this vectors in a new vector.
 	 */
-	Vector3 operator-( const Vector3& vec )
+	Vector3 operator-( const Vector3& vec ) const
 	{
 		return Vector3( x - vec.x, y - vec.y, z - vec.z );
 	}
@@ -85,7 +112,7 @@ public:
 	 * @param vec other vector.
 	 * @return product of this vectors in a new vector.
 	 */
-	Vector3 operator*( const Vector3& vec )
+	Vector3 operator*( const Vector3& vec ) const
 	{
 		return Vector3( x * vec.x, y * vec.y, z * vec.z );
 	}
@@ -95,7 +122,7 @@ public:
 	 * @param number number.
 	 * @return product of this vectors in a new vector.
 	 */
-	Vector3 operator*(const float number)
+	Vector3 operator*(const float number) const
 	{
 		return Vector3(x * number, y * number, z * number);
 	}
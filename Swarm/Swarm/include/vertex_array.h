@@ -11,10 +11,19 @@ class VertexArray
 private:
 	unsigned int renderID_;	//!< Holds the id of the created VertexArray.
 
+	/*!
+	 * @brief Set up one vertex attribute. With direct state access nothing is bound.
+	 * @param _vb VertexBuffer.
+	 * @param _vbElement Format and offset of the attribute.
+	 * @param _vertexIndex Index of the attribute (and of its buffer binding with DSA).
+	 * @param _divisor 0: per vertex. n: per n instances.
+	 */
+	void addAttribute( const VertexBuffer& _vb, const VertexBufferElement& _vbElement, unsigned int _vertexIndex, unsigned int _divisor );
+
 public:
 
 	/*!
-	 * @brief Standard Constructor. Generates a new OpenGL VertexArray.
+	 * @brief Standard Constructor. Generates a new OpenGL VertexArray (glCreateVertexArrays with direct state access).
 	 */
 	VertexArray();
 
@@ -35,8 +44,9 @@ public:
 	 * @param _vb VertexBuffer.
 	 * @param _vbElement VertexBufferElement contains informations about how to handle the elements in the vertex buffer.
 	 * @param _vertexIndex Specifies the index of the generic vertex attribute to be modified.
+	 * @param _divisor 0: next element per vertex. n: next element every n instances (glDrawArraysInstanced).
 	 */
-	void addBuffer( const VertexBuffer& _vb, const VertexBufferElement _vbElement, int _vertexIndex );
+	void addBuffer( const VertexBuffer& _vb, const VertexBufferElement _vbElement, int _vertexIndex, unsigned int _divisor = 0 );
 
 	/*!
 	 * @brief Bind Vertex Array.
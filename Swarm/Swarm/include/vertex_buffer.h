@@ -7,6 +7,20 @@ class VertexBuffer
 {
 private:
 	unsigned int renderID_;	//!< Holds the id of the created VertexBuffer.
+	unsigned int size_ = 0;	//!< Size of the storage, counted by the memory tracker.
+
+protected:
+
+	/*!
+	 * @brief Create and bind an OpenGL VertexBuffer without storage. Used by buffers which allocate their own storage.
+	 */
+	VertexBuffer();
+
+	/*!
+	 * @brief Count the storage of the buffer in the memory report. Called once by buffers which allocate their own storage.
+	 * @param size size of the storage in bytes.
+	 */
+	void trackStorage( unsigned int size );
 
 public:
 
@@ -20,7 +34,7 @@ public:
 	/*!
 	 * @brief Destroy Instance and delete OpenGL Buffer.
 	 */
-	~VertexBuffer();
+	virtual ~VertexBuffer();
 
 	/*!
 	 * @brief Bind Buffer.
@@ -13,6 +13,16 @@ struct VertexBufferElement
 	unsigned int count;			//!< Number of elements for One Vertex in Buffer. (For Example 3 = triangle, ...)
 	unsigned int normalized;	//!< Is the data normalized
 	unsigned int offset;		//!< Offset. Where should begins this type of vertexbufferelemty
+
+	/*!
+	 * @brief Get the size of a data type in the buffer.
+	 * @param type GL_FLOAT, GL_UNSIGNED_INT or GL_UNSIGNED_BYTE.
+	 * @return size in bytes.
+	 */
+	static unsigned int getSizeOfType( unsigned int type )
+	{
+		return type == GL_UNSIGNED_BYTE ? 1 : 4;
+	}
 };
 
 /*!
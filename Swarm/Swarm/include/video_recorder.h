@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+
+#include <glew.h>
+
+#include "cuda_runtime.h"
+#include "cuda_gl_interop.h"
+
+#include "cuda_device_array.h"
+#include "swarm_config.h"
+
+/*!
+ * @brief VideoRecorder renders the frames into a framebuffer object and encodes them with NVENC into a raw H.264 or HEVC stream.
+ * The frame is flipped into a renderbuffer which is registered with CUDA, copied into device memory on the stream of the
+ * renderer and encoded from there. The pixels never go through host memory, only the bitstream does.
+ * NVENC needs the Video Codec SDK: build with SWARM_NVENC, nvEncodeAPI.h on the include path and nvencodeapi.lib and cuda.lib.
+ * Without it the recorder prints a message and stays disabled.
+ */
+class VideoRecorder
+{
+private:
+
+	struct Encoder;							//!< NVENC session, defined with SWARM_NVENC only.
+
+	std::string path_;						//!< File of the bitstream. Empty: disabled.
+	unsigned int width_;					//!< Size of the frames in pixels.
+	unsigned int height_;
+	Encoder* encoder_ = NULL;				//!< NULL: disabled.
+	unsigned long long frames_ = 0;			//!< Encoded frames.
+
+	GLuint sceneFbo_ = 0;					//!< Render target of the frame.
+	GLuint sceneColor_ = 0;					//!< RGBA8 renderbuffer of sceneFbo_.
+	GLuint sceneDepth_ = 0;					//!< Depth renderbuffer of sceneFbo_.
+	GLuint captureFbo_ = 0;					//!< Flipped copy of the frame, top row first like the encoder expects.
+	GLuint captureColor_ = 0;				//!< RGBA8 renderbuffer of captureFbo_, registered with CUDA.
+	GLint viewport_[4] = {};				//!< Viewport of the window, restored by endFrame.
+	cudaGraphicsResource_t captureResource_ = NULL;	//!< captureColor_ for CUDA.
+	CudaDeviceArray<uchar4> d_frame_;		//!< Linear copy of the frame, registered with NVENC.
+
+	/*!
+	 * @brief Open the encode session on the current CUDA context and register d_frame_.
+	 * @param fps frame rate written into the stream.
+	 * @return true, if NVENC is available and the session is open.
+	 */
+	bool openEncoder( unsigned int fps );
+
+	/*!
+	 * @brief Encode d_frame_ and append the bitstream to the file. d_frame_ must be ready.
+	 */
+	void encodeFrame();
+
+	/*!
+	 * @brief Flush the encoder, close the file and the session.
+	 */
+	void closeEncoder();
+
+public:
+
+	/*!
+	 * @brief Constructor. Creates the render target and the encoder. Needs a current OpenGL context and CUDA device.
+	 * @param config config with the video file and the window size. Empty video: disabled.
+	 * @param fps frame rate written into the stream.
+	 */
+	VideoRecorder( const SwarmConfig& config, unsigned int fps );
+
+	/*!
+	 * @brief Destructor. Finishes the stream and deletes the render target.
+	 */
+	~VideoRecorder();
+
+	VideoRecorder( const VideoRecorder& ) = delete;
+	VideoRecorder& operator=( const VideoRecorder& ) = delete;
+
+	/*!
+	 * @brief Redirect the draws of the frame into the render target. Call before the clear.
+	 */
+	void beginFrame();
+
+	/*!
+	 * @brief Show the frame in the window, if it is visible, and encode it. Call after the last draw.
+	 * @param stream stream of the copy out of the renderbuffer, waited for before the encode.
+	 */
+	void endFrame( cudaStream_t stream );
+
+	/*!
+	 * @brief Check if frames are recorded.
+	 * @return true, if the encoder is open.
+	 */
+	inline bool isEnabled() const { return encoder_ != NULL; }
+
+	/*!
+	 * @brief Get the number of encoded frames.
+	 * @return frames.
+	 */
+	inline unsigned long long getFrames() const { return frames_; }
+};
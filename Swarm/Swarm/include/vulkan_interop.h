@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vector>
+
+#include <glew.h>
+
+#include "cuda_runtime.h"
+
+#include "vertex_buffer.h"
+
+/*!
+ * @brief ExternalVertexBuffer is a VertexBuffer on memory of another API, imported as OpenGL memory object (EXT_memory_object).
+ */
+class ExternalVertexBuffer : public VertexBuffer
+{
+public:
+
+	/*!
+	 * @brief Create the buffer on the memory object.
+	 * @param memoryObject imported memory, e.g. VulkanInterop::getMemoryObject. Must outlive the buffer.
+	 * @param size size of the buffer in bytes, at most the size of the memory.
+	 */
+	ExternalVertexBuffer( GLuint memoryObject, unsigned int size );
+};
+
+/*!
+ * @brief VulkanInterop shares buffers between CUDA and OpenGL without cudaGraphicsMapResources and cudaGraphicsUnmapResources.
+ * Vulkan allocates exportable device memory on the GPU of CUDA (same UUID); CUDA imports it with cudaImportExternalMemory and
+ * OpenGL with EXT_memory_object, so both see the same bytes all the time. Two exported semaphores order the APIs instead of
+ * the map: acquire lets OpenGL signal after the draws issued so far and the CUDA stream wait for it, release lets CUDA signal
+ * after its writes and OpenGL wait for it. Both waits are on the GPU, the render thread never blocks, and the draws of the
+ * last frame overlap the steps of this one until the first write.
+ * The semaphores are binary, because EXT_semaphore has no timeline values: every signal has exactly one wait.
+ * Vulkan needs the SDK: build with SWARM_VULKAN, vulkan.h on the include path and vulkan-1.lib. Without it, or without the
+ * OpenGL extensions, the interop prints a message and stays disabled.
+ */
+class VulkanInterop
+{
+private:
+
+	struct Context;							//!< Vulkan instance, device, memory and semaphores, defined with SWARM_VULKAN only.
+
+	/*!
+	 * @brief Memory shared by both APIs.
+	 */
+	struct Buffer
+	{
+		GLuint memoryObject = 0;			//!< OpenGL import of the memory.
+		cudaExternalMemory_t cudaMemory = NULL;	//!< CUDA import of the memory.
+		void* devicePointer = NULL;			//!< CUDA mapping of the whole memory.
+		size_t size = 0;					//!< Requested bytes.
+	};
+
+	Context* context_ = NULL;				//!< NULL: disabled.
+	std::vector<Buffer> buffers_;			//!< All buffers of createBuffer.
+	std::vector<GLuint> glBuffers_;			//!< OpenGL buffers on the memory, for the barriers of the semaphores (addGLBuffer).
+	GLuint glDrawsDone_ = 0;				//!< OpenGL import of the semaphore OpenGL signals after its draws.
+	GLuint glWritesDone_ = 0;				//!< OpenGL import of the semaphore CUDA signals after its writes.
+	cudaExternalSemaphore_t cudaDrawsDone_ = NULL;	//!< CUDA import of the semaphore of glDrawsDone_.
+	cudaExternalSemaphore_t cudaWritesDone_ = NULL;	//!< CUDA import of the semaphore of glWritesDone_.
+
+	/*!
+	 * @brief Free the buffers, the semaphores and the Vulkan objects. Disabled afterwards.
+	 */
+	void destroy();
+
+public:
+
+	/*!
+	 * @brief Constructor. Creates a Vulkan device on the GPU of CUDA and the semaphores. Needs a current OpenGL context.
+	 * @param enabled false: disabled, e.g. config.vulkanInterop.
+	 * @param cudaDevice GPU of CUDA, which also has to run the OpenGL context.
+	 */
+	VulkanInterop( bool enabled, int cudaDevice );
+
+	/*!
+	 * @brief Destructor. Frees the memory and the semaphores. The OpenGL buffers on the memory have to be deleted before.
+	 */
+	~VulkanInterop();
+
+	VulkanInterop( const VulkanInterop& ) = delete;
+	VulkanInterop& operator=( const VulkanInterop& ) = delete;
+
+	/*!
+	 * @brief Check if the buffers are shared.
+	 * @return true, if Vulkan, CUDA and OpenGL are set up.
+	 */
+	inline bool isEnabled() const { return context_ != NULL; }
+
+	/*!
+	 * @brief Allocate memory and import it into CUDA and OpenGL.
+	 * @param size bytes.
+	 * @return index of the buffer. -1: failed, use a registered VertexBuffer instead.
+	 */
+	int createBuffer( size_t size );
+
+	/*!
+	 * @brief Get the OpenGL memory object of a buffer, for an ExternalVertexBuffer.
+	 * @param buffer index of createBuffer.
+	 * @return memory object.
+	 */
+	inline GLuint getMemoryObject( int buffer ) const { return buffers_[buffer].memoryObject; }
+
+	/*!
+	 * @brief Get the CUDA pointer of a buffer. Valid all the time, write only between acquire and release.
+	 * @param buffer index of createBuffer.
+	 * @return device pointer.
+	 */
+	inline void* getDevicePointer( int buffer ) const { return buffers_[buffer].devicePointer; }
+
+	/*!
+	 * @brief Name an OpenGL buffer on the memory, so the semaphores make its writes visible.
+	 * @param glBuffer buffer id, e.g. of an ExternalVertexBuffer.
+	 */
+	void addGLBuffer( GLuint glBuffer );
+
+	/*!
+	 * @brief Before CUDA writes the buffers: OpenGL signals after the draws issued so far, the stream waits for it.
+	 * @param stream stream of the writes.
+	 */
+	void acquire( cudaStream_t stream );
+
+	/*!
+	 * @brief After CUDA wrote the buffers: the stream signals, the next OpenGL commands wait for it.
+	 * @param stream stream of the writes.
+	 */
+	void release( cudaStream_t stream );
+};
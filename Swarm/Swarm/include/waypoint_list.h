@@ -6,25 +6,15 @@
 
 /*!
  * @brief WaypointList contains waypoints for particles.
- * Contains methods to handle linked list.
+ * Ring of waypoints in one contiguous array with a cursor on the current one, so the path can be copied
+ * to the GPU as it is. Appending is O(1), there is no allocation per waypoint.
  */
 class WaypointList
 {
 private:
 
-	/*!
-	 * @brief Node for linked list.
-	 */
-	class Node
-	{
-	public:
-		Vector3 data;	//!< Waypoint
-		Node* next;		//!< Next node in linked list
-		Node* prev;		//!< Previous node in linked list
-	};
-
-	Node* head = NULL;	//!< Head node of linked list
-	Node* idx = NULL;	//!< Current index of linked list. Used for getter methods.
+	std::vector<Vector3> points_;	//!< Waypoints in path order. After the last one the path starts again.
+	size_t cursor_ = 0;				//!< Index of the current waypoint. Used for getter methods.
 
 public:
 	/*!
@@ -33,15 +23,15 @@ public:
 	WaypointList();
 
 	/*!
-	 * @brief Constructor initializes linked list with given waypoints
+	 * @brief Constructor initializes the path with given waypoints
 	 * @param waypoints waypoints for particles.
 	 */
 	WaypointList( std::vector<Vector3> waypoints );
 
 	/*!
-	 * @brief Default Destructor. Destroys linked list.
+	 * @brief Default Destructor.
 	 */
-	~WaypointList();
+	~WaypointList() = default;
 
 	/*!
 	 * @brief Append a new waypoint
@@ -56,24 +46,24 @@ public:
 	void append( std::vector<Vector3> waypoints );
 
 	/*!
-	 * @brief push waypoint as first item in linked list.
+	 * @brief push waypoint as first item of the path. The cursor stays on its waypoint.
 	 * @param data waypoint.
 	 */
 	void push( Vector3 data );
 
 	/*!
-	 * @brief push waypoints as first items in linked list.
+	 * @brief push waypoints as first items of the path. The cursor stays on its waypoint.
 	 * @param waypoints list of waypoints
 	 */
 	void push( std::vector<Vector3> waypoints );
 
 	/*!
-	 * @brief pop first waypoint in linked list
+	 * @brief pop first waypoint of the path. A cursor on it moves to the next one.
 	 */
 	void pop();
 
 	/*!
-	 * @brief remove waypoint at the given index
+	 * @brief remove waypoint at the given index. A cursor on it moves to the next one.
 	 * @param index waypoint index.
 	 */
 	void remove( int index );
@@ -87,20 +77,20 @@ public:
 	 * @brief get number of waypoints.
 	 * @return length
 	 */
-	int length();
+	int length() const;
 
 	/*!
 	 * @brief get waypoint at the given index.
 	 * @param index index
-	 * @return v(0, 0, 0, 1) if head is empty or index is out of scope or vector at the given valid position.
+	 * @return v(0, 0, 0) if the path is empty or index is out of scope or vector at the given valid position.
 	 */
-	Vector3 get( int index );
+	Vector3 get( int index ) const;
 
 	/*!
 	 * @brief get current waypoint
-	 * @return current waypoint
+	 * @return current waypoint, v(0, 0, 0) if the path is empty.
 	 */
-	Vector3 get();
+	Vector3 get() const;
 
 	/*!
 	 * @brief Get next waypoint in list.
@@ -114,4 +104,16 @@ public:
 	 */
 	Vector3 getPrev();
 
+	/*!
+	 * @brief Get the index of the current waypoint.
+	 * @return cursor in [0, length()).
+	 */
+	inline unsigned int getCursor() const { return static_cast< unsigned int >( cursor_ ); }
+
+	/*!
+	 * @brief Get the waypoints in path order, e.g. for the upload to the GPU.
+	 * @return length() waypoints.
+	 */
+	inline const Vector3* data() const { return points_.data(); }
+
 };
\ No newline at end of file
@@ -0,0 +1,14 @@
+@echo off
+rem Regression gate of the neighbour searches: sweep with 5 trials per stage and compare the medians with the
+rem baseline of this GPU model. Fails (exit code 2) if a stage is more than 5% slower beyond the noise of both runs.
+rem Record or update the baseline first: benchGate.bat --out bench\baselines\{gpu}.csv
+rem The startup up to the first present (5 runs of Swarm --startup_bench) is gated with the same baseline.
+rem Further arguments go to SwarmBench, see bench\swarm_bench.cpp.
+
+pushd "%~dp0.."
+for /L %%i in (1,1,5) do "..\..\Output\bin\Swarm.exe" --startup_bench bench\startup_%%i.json > nul
+set REPORTS=bench\startup_1.json,bench\startup_2.json,bench\startup_3.json,bench\startup_4.json,bench\startup_5.json
+"..\..\Output\bin\SwarmBench.exe" --trials 5 --threshold 5 --baseline bench\baselines\{gpu}.csv --startup %REPORTS% %*
+set RESULT=%ERRORLEVEL%
+popd
+exit /b %RESULT%
@@ -0,0 +1,17 @@
+#version 330 core
+
+in vec4 vertex_color;
+out vec4 frag_color;
+
+// Gaussian falloff, so the fishies of a cluster fade out at its edge instead of ending in a disc
+void main()
+{
+	vec2 circCoord = 2.0 * gl_PointCoord - 1.0;
+	float r2 = dot( circCoord, circCoord );
+	if ( r2 > 1.0 )
+	{
+		discard;
+	}
+
+	frag_color = vec4( vertex_color.rgb, vertex_color.a * exp( -3.0 * r2 ) );
+}
@@ -0,0 +1,25 @@
+#version 330 core
+
+layout( location = 0 ) in vec4 in_position;	// Centroid (xyz) and radius (w) of the cluster, see kernel_cull
+layout( location = 1 ) in vec4 in_color;
+
+out vec4 vertex_color;
+
+layout( std140 ) uniform FrameUniforms	// Written once per frame, see Renderer::render
+{
+	mat4 u_model;
+	mat4 u_view;
+	mat4 u_projection;
+	float u_fishsize;
+};
+
+uniform float u_viewport;	// Viewport height in pixels
+
+// One soft splat per cluster, as large on the screen as the spread of its fishies
+void main()
+{
+	vertex_color = in_color;
+	vec4 view = u_view * u_model * vec4(in_position.xyz, 1);
+	gl_Position = u_projection * view;
+	gl_PointSize = clamp(2.0 * in_position.w * u_projection[1][1] * u_viewport / max(-view.z, 1e-3), 1.0, 256.0);
+}
@@ -0,0 +1,169 @@
+#version 430 core
+
+// Classic fish behaviour of ComputeSimulation, same rules as d_swim in kernel.cu with the grid search.
+// One thread per fish. Reads one position buffer and writes the other one (ping-pong), the position buffers are the VBOs.
+
+layout( local_size_x = 256 ) in;
+
+const uint GRID_SIZE = 64u;							// Same as compute_grid.glsl
+const float FLT_MAX = 3.402823466e+38;
+
+layout( std430, binding = 0 ) readonly buffer PositionsIn { vec4 positionsIn[]; };	// w < 0: eaten
+layout( std430, binding = 1 ) readonly buffer StatesIn { vec4 statesIn[]; };		// speed vector, mass in w
+layout( std430, binding = 2 ) writeonly buffer PositionsOut { vec4 positionsOut[]; };
+layout( std430, binding = 3 ) writeonly buffer StatesOut { vec4 statesOut[]; };
+layout( std430, binding = 4 ) readonly buffer Sharks { vec4 sharks[]; };
+layout( std430, binding = 5 ) readonly buffer CellStart { uint cellStart[]; };
+layout( std430, binding = 6 ) readonly buffer CellCount { uint cellCount[]; };
+layout( std430, binding = 7 ) readonly buffer Sorted { vec4 sorted[]; };			// position, index of the fish in w
+
+uniform int u_count;								// Number of fishies
+uniform int u_sharkCount;
+uniform float u_speed;								// Speed of the fishies per step
+uniform vec3 u_center;								// Swarm center
+uniform vec3 u_origin;								// Grid placement, see compute_grid.glsl
+uniform float u_cellSize;
+uniform int u_firstK;								// See NeighbourQuery
+uniform int u_seed;
+uniform int u_step;
+
+uniform float u_centerThreshold;					// SwarmParams
+uniform float u_sharkDist;
+uniform float u_sharkBiteDist;
+uniform float u_fishDist;
+uniform float u_acceleration;
+uniform float u_jitter;
+
+// DeviceVector::normalized of a difference vector: its w = 1 is part of the length.
+vec3 normalizedDiff( vec3 v )
+{
+	return v * inversesqrt( dot( v, v ) + 1.0 );
+}
+
+uint hash( uint x )
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// Random acceleration in [-1, 1]^3. Depends on seed, fish and step like d_jitter, but not the same numbers as Philox.
+vec3 jitter( uint id )
+{
+	uint key = hash( id ^ hash( uint( u_seed ) ^ hash( uint( u_step ) ) ) );
+	uvec3 bits = uvec3( hash( key ), hash( key + 1u ), hash( key + 2u ) ) >> 8;
+	return vec3( bits ) * ( 2.0 / 16777216.0 ) - 1.0;
+}
+
+// Closest fish in the 27 cells around the fish. Returns the difference vector, the distance in w (FLT_MAX if there is none).
+vec4 closestFish( vec3 vert, uint self )
+{
+	ivec3 cell = ivec3( floor( ( vert - u_origin ) / u_cellSize ) );
+	vec3 closest = vec3( 0 );
+	float closestDist2 = FLT_MAX;
+	uint found = 0u;
+	for ( int c = 0; c < 27; c++ )
+	{
+		ivec3 neighbour = ( cell + ivec3( c % 3 - 1, c / 3 % 3 - 1, c / 9 - 1 ) ) & ivec3( GRID_SIZE - 1u );
+		uint bucket = ( uint( neighbour.z ) * GRID_SIZE + uint( neighbour.y ) ) * GRID_SIZE + uint( neighbour.x );
+		uint start = cellStart[bucket];
+		uint end = start + cellCount[bucket];
+		for ( uint j = start; j < end; j++ )
+		{
+			vec4 other = sorted[j];
+			if ( floatBitsToUint( other.w ) == self )
+				continue;
+			vec3 d = vert - other.xyz;
+			float d2 = dot( d, d );
+			if ( d2 < closestDist2 )
+			{
+				closest = d;
+				closestDist2 = d2;
+			}
+			if ( u_firstK > 0 && d2 < u_fishDist * u_fishDist && ++found >= uint( u_firstK ) )
+				return vec4( closest, sqrt( closestDist2 ) );
+		}
+	}
+	return vec4( closest, closestDist2 < FLT_MAX ? sqrt( closestDist2 ) : FLT_MAX );
+}
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+	if ( i >= uint( u_count ) )
+		return;
+
+	vec4 position = positionsIn[i];
+	vec4 state = statesIn[i];
+	if ( position.w < 0 )
+	{
+		positionsOut[i] = position;
+		statesOut[i] = state;
+		return;
+	}
+
+	vec3 vert = position.xyz;
+	float mySpeed = u_speed * state.w;
+	float accelerationFactor = u_acceleration;
+
+	// nearest shark
+	vec3 sharkDiff = vec3( 0 );
+	float sharkDistance2 = FLT_MAX;
+	for ( int s = 0; s < u_sharkCount; s++ )
+	{
+		vec3 d = sharks[s].xyz - vert;
+		float d2 = dot( d, d );
+		if ( d2 < sharkDistance2 )
+		{
+			sharkDiff = d;
+			sharkDistance2 = d2;
+		}
+	}
+	float sharkDistance = sharkDistance2 < FLT_MAX ? sqrt( sharkDistance2 ) : FLT_MAX;
+
+	// shark eats fish
+	if ( sharkDistance < u_sharkBiteDist )
+	{
+		positionsOut[i] = vec4( vert, -1.0 );
+		statesOut[i] = state;
+		return;
+	}
+	// evade shark
+	if ( sharkDistance < u_sharkDist * state.w )
+	{
+		state.xyz -= normalizedDiff( sharkDiff ) * mySpeed * accelerationFactor;
+	}
+	else
+	{
+		vec4 closest = closestFish( vert, i );
+		vec3 diff = u_center - vert;
+
+		// keep distance to other fishies
+		if ( closest.w < u_fishDist )
+		{
+			state.xyz -= normalizedDiff( closest.xyz ) * mySpeed * accelerationFactor * 0.7;
+			vert += state.xyz;
+			accelerationFactor /= 2;
+		}
+		// return to swarm
+		if ( length( diff ) > u_centerThreshold * state.w )
+		{
+			state.xyz += normalizedDiff( diff ) * mySpeed * ( accelerationFactor * 0.4 );
+		}
+	}
+	if ( u_jitter > 0.0 )
+	{
+		state.xyz += jitter( i ) * ( mySpeed * u_jitter );
+	}
+	if ( length( state.xyz ) > mySpeed * 0.75 )
+	{
+		state.xyz *= 0.96;
+	}
+	vert += state.xyz;
+
+	positionsOut[i] = vec4( vert, 1.0 );
+	statesOut[i] = state;
+}
@@ -0,0 +1,103 @@
+#version 430 core
+
+// Uniform grid of ComputeSimulation, built as counting sort. One pass per dispatch (u_pass):
+// 0: count the fishies per cell, 1: scan SCAN_CELLS cells per work group, 2: scan the sums of the work groups (one work group),
+// 3: add the scanned sums to the cells, 4: scatter the positions into cell order.
+
+layout( local_size_x = 256 ) in;
+
+const uint GRID_SIZE = 64u;							// Cells per axis, power of two. Same as ComputeSimulation::GRID_SIZE
+const uint SCAN_ITEMS = 4u;							// Cells per thread in pass 1
+const uint SCAN_CELLS = 256u * SCAN_ITEMS;			// Cells per work group in pass 1
+const uint DEAD_CELL = 0xffffffffu;
+
+layout( std430, binding = 0 ) readonly buffer Positions { vec4 positions[]; };	// w < 0: eaten
+layout( std430, binding = 1 ) buffer CellCount { uint cellCount[]; };
+layout( std430, binding = 2 ) buffer CellStart { uint cellStart[]; };
+layout( std430, binding = 3 ) buffer BlockSums { uint blockSums[]; };
+layout( std430, binding = 4 ) buffer FishCell { uint fishCell[]; };
+layout( std430, binding = 5 ) buffer FishRank { uint fishRank[]; };
+layout( std430, binding = 6 ) writeonly buffer Sorted { vec4 sorted[]; };		// position, index of the fish in w
+
+uniform int u_pass;
+uniform int u_count;								// Number of fishies
+uniform vec3 u_origin;								// Lower corner of cell (0, 0, 0)
+uniform float u_cellSize;
+
+shared uint s_scan[256];
+
+// Hash of the cell of a position. The grid wraps around like d_calcGridHash, the mask also wraps negative cells.
+uint cellHash( vec3 p )
+{
+	ivec3 cell = ivec3( floor( ( p - u_origin ) / u_cellSize ) ) & ivec3( GRID_SIZE - 1u );
+	return ( uint( cell.z ) * GRID_SIZE + uint( cell.y ) ) * GRID_SIZE + uint( cell.x );
+}
+
+// Exclusive prefix sum over the work group. Every thread has to call it. The total is in s_scan[255] afterwards.
+uint scanWorkGroup( uint value )
+{
+	uint t = gl_LocalInvocationID.x;
+	s_scan[t] = value;
+	barrier();
+	for ( uint offset = 1u; offset < 256u; offset <<= 1 )
+	{
+		uint add = t >= offset ? s_scan[t - offset] : 0u;
+		barrier();
+		s_scan[t] += add;
+		barrier();
+	}
+	return s_scan[t] - value;
+}
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+
+	if ( u_pass == 0 )
+	{
+		if ( i >= uint( u_count ) )
+			return;
+		vec4 p = positions[i];
+		if ( p.w < 0 )										// Eaten fishies are in no cell
+		{
+			fishCell[i] = DEAD_CELL;
+			return;
+		}
+		uint hash = cellHash( p.xyz );
+		fishCell[i] = hash;
+		fishRank[i] = atomicAdd( cellCount[hash], 1u );		// Slot inside the cell
+	}
+	else if ( u_pass == 1 )
+	{
+		uint first = gl_WorkGroupID.x * SCAN_CELLS + gl_LocalInvocationID.x * SCAN_ITEMS;
+		uint counts[SCAN_ITEMS];
+		uint sum = 0u;
+		for ( uint k = 0u; k < SCAN_ITEMS; k++ )
+		{
+			counts[k] = cellCount[first + k];
+			sum += counts[k];
+		}
+		uint start = scanWorkGroup( sum );
+		for ( uint k = 0u; k < SCAN_ITEMS; k++ )
+		{
+			cellStart[first + k] = start;
+			start += counts[k];
+		}
+		if ( gl_LocalInvocationID.x == 255u )
+			blockSums[gl_WorkGroupID.x] = s_scan[255];
+	}
+	else if ( u_pass == 2 )
+	{
+		blockSums[i] = scanWorkGroup( blockSums[i] );		// GRID_SIZE^3 / SCAN_CELLS = 256 sums
+	}
+	else if ( u_pass == 3 )
+	{
+		cellStart[i] += blockSums[i / SCAN_CELLS];
+	}
+	else
+	{
+		if ( i >= uint( u_count ) || fishCell[i] == DEAD_CELL )
+			return;
+		sorted[cellStart[fishCell[i]] + fishRank[i]] = vec4( positions[i].xyz, uintBitsToFloat( i ) );
+	}
+}
@@ -0,0 +1,44 @@
+#version 430 core
+
+// Sharks of ComputeSimulation, same rules as d_moveSharks in kernel.cu. One thread per shark.
+
+layout( local_size_x = 64 ) in;
+
+layout( std430, binding = 0 ) buffer Sharks { vec4 sharks[]; };				// Drawn as points
+layout( std430, binding = 1 ) buffer SharkStates { vec4 sharkStates[]; };	// speed vector, mass in w
+
+uniform int u_count;								// Number of sharks
+uniform float u_speed;								// Speed of the fishies per step
+uniform vec3 u_center;								// Swarm center
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+	if ( i >= uint( u_count ) )
+		return;
+
+	vec3 shark = sharks[i].xyz;
+	vec4 state = sharkStates[i];
+	vec3 diff = u_center - shark;
+
+	// turn back to swarm
+	if ( length( diff ) > 4.0 )
+	{
+		state.xyz += diff * ( u_speed * 0.2 / length( diff ) );
+		if ( length( state.xyz ) > u_speed * 1.3 )
+		{
+			state.xyz *= u_speed * 1.3 / length( state.xyz );
+		}
+	}
+	// swim through swarm or leave it
+	else
+	{
+		if ( length( state.xyz ) < u_speed * 3 )
+		{
+			state.xyz *= 1.1;
+		}
+	}
+
+	sharks[i] = vec4( shark + state.xyz, sharks[i].w );
+	sharkStates[i] = state;
+}
@@ -0,0 +1,102 @@
+#version 430 core
+
+// Aggregates of the living fishies for ComputeSimulation, same result as kernel_reduce_stats. Two passes (u_pass):
+// 0: every work group reduces a part of the fishies into a partial, 1: one work group reduces the partials into the stats.
+
+layout( local_size_x = 256 ) in;
+
+const float FLT_MAX = 3.402823466e+38;
+
+struct Partial
+{
+	vec3 sum;										// Sum of the positions
+	float speed;									// Sum of the speeds
+	vec3 lower;
+	uint count;
+	vec3 upper;
+};
+
+layout( std430, binding = 0 ) readonly buffer Positions { vec4 positions[]; };	// w < 0: eaten
+layout( std430, binding = 1 ) readonly buffer States { vec4 states[]; };
+layout( std430, binding = 2 ) buffer Partials { Partial partials[]; };
+layout( std430, binding = 3 ) writeonly buffer Stats						// Same layout as SwarmStats
+{
+	float centroid[3];
+	float boundsMin[3];
+	float boundsMax[3];
+	float meanSpeed;
+	uint liveCount;
+	float maxSpeed;													// Not reduced here, the GL backend has no adaptive step
+};
+
+uniform int u_pass;
+uniform int u_count;								// Pass 0: number of fishies. Pass 1: number of partials.
+
+shared Partial s_partials[256];
+
+Partial emptyPartial()
+{
+	return Partial( vec3( 0 ), 0.0, vec3( FLT_MAX ), 0u, vec3( -FLT_MAX ) );
+}
+
+void merge( inout Partial a, Partial b )
+{
+	a.sum += b.sum;
+	a.speed += b.speed;
+	a.lower = min( a.lower, b.lower );
+	a.count += b.count;
+	a.upper = max( a.upper, b.upper );
+}
+
+// Tree reduction over the work group. Every thread has to call it. The result is in s_partials[0] afterwards.
+void reduceWorkGroup( Partial p )
+{
+	uint t = gl_LocalInvocationID.x;
+	s_partials[t] = p;
+	barrier();
+	for ( uint stride = 128u; stride > 0u; stride >>= 1 )
+	{
+		if ( t < stride )
+			merge( s_partials[t], s_partials[t + stride] );
+		barrier();
+	}
+}
+
+void main()
+{
+	Partial p = emptyPartial();
+	if ( u_pass == 0 )
+	{
+		for ( uint i = gl_GlobalInvocationID.x; i < uint( u_count ); i += gl_NumWorkGroups.x * 256u )
+		{
+			vec4 position = positions[i];
+			if ( position.w < 0 )
+				continue;
+			merge( p, Partial( position.xyz, length( states[i].xyz ), position.xyz, 1u, position.xyz ) );
+		}
+		reduceWorkGroup( p );
+		if ( gl_LocalInvocationID.x == 0u )
+			partials[gl_WorkGroupID.x] = s_partials[0];
+		return;
+	}
+
+	for ( uint i = gl_LocalInvocationID.x; i < uint( u_count ); i += 256u )
+		merge( p, partials[i] );
+	reduceWorkGroup( p );
+	if ( gl_LocalInvocationID.x != 0u )
+		return;
+
+	Partial s = s_partials[0];
+	liveCount = s.count;
+	float inv = s.count > 0u ? 1.0 / float( s.count ) : 0.0;
+	vec3 lower = s.count > 0u ? s.lower : vec3( 0 );
+	vec3 upper = s.count > 0u ? s.upper : vec3( 0 );
+	for ( int k = 0; k < 3; k++ )
+	{
+		centroid[k] = s.sum[k] * inv;
+		boundsMin[k] = lower[k];
+		boundsMax[k] = upper[k];
+	}
+	meanSpeed = s.speed * inv;
+	maxSpeed = 0.0;
+}
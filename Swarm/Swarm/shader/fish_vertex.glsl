@@ -0,0 +1,57 @@
+#version 330 core
+#extension GL_ARB_shader_draw_parameters : enable
+
+layout( location = 0 ) in vec4 in_position;		// per fish, w < 0: eaten
+layout( location = 1 ) in vec4 in_color;		// per fish
+layout( location = 2 ) in vec4 in_direction;	// per fish: direction of the velocity, speed in w
+layout( location = 3 ) in vec4 in_vertex;		// fish mesh: x forward, y up, z side, brightness in w
+
+out vec4 vertex_color;
+
+layout( std140 ) uniform FrameUniforms	// Written once per frame, see Renderer::render
+{
+	mat4 u_model;
+	mat4 u_view;
+	mat4 u_projection;
+	float u_fishsize;
+};
+
+#ifdef GL_ARB_shader_draw_parameters
+layout( std140 ) uniform SchoolDraws	// Per command of the culled multi draws, see Renderer::Renderer
+{
+	vec4 u_drawcolor[64];	// Hue of the school (rgb), weight over the fish color (w)
+};
+#endif
+uniform int u_schooldraws;		// 1: the draw is a multi draw with one command per school, 0: any other draw
+
+vec4 schoolColor(vec4 color)
+{
+#ifdef GL_ARB_shader_draw_parameters
+	if (u_schooldraws != 0)
+	{
+		vec4 draw = u_drawcolor[gl_DrawIDARB];
+		return vec4(mix(color.rgb, draw.rgb, draw.w), color.a);
+	}
+#endif
+	return color;
+}
+
+void main()
+{
+	if (in_position.w < 0)
+	{
+		gl_Position = vec4(0, 0, 2, 1);			// behind the far plane, the triangle is clipped
+		vertex_color = vec4(0);
+		return;
+	}
+
+	vec3 forward = in_direction.xyz;
+	vec3 up = abs(forward.y) < 0.99 ? vec3(0, 1, 0) : vec3(1, 0, 0);
+	vec3 side = normalize(cross(forward, up));
+	up = cross(side, forward);
+
+	vec3 offset = (forward * in_vertex.x + up * in_vertex.y + side * in_vertex.z) * u_fishsize;
+	gl_Position = u_projection * u_view * u_model * vec4(in_position.xyz + offset, 1);
+	vec4 color = schoolColor(in_color);
+	vertex_color = vec4(color.rgb * in_vertex.w, color.a);
+}
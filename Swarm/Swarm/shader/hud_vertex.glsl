@@ -0,0 +1,12 @@
+#version 330 core
+
+layout( location = 0 ) in vec4 in_vertex;	// x, y in NDC, color as 0xRRGGBB, alpha
+
+out vec4 vertex_color;
+
+void main()
+{
+	uint rgb = uint( in_vertex.z );
+	vertex_color = vec4( float( ( rgb >> 16 ) & 255u ), float( ( rgb >> 8 ) & 255u ), float( rgb & 255u ), 255.0 * in_vertex.w ) / 255.0;
+	gl_Position = vec4( in_vertex.xy, 0.0, 1.0 );
+}
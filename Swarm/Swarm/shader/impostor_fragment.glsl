@@ -0,0 +1,37 @@
+#version 330 core
+#extension GL_ARB_conservative_depth : enable
+
+in vec4 vertex_color;
+flat in vec3 sphere_center;
+flat in float sphere_radius;
+out vec4 frag_color;
+
+#ifdef GL_ARB_conservative_depth
+layout( depth_greater ) out float gl_FragDepth;	// Never in front of the sprite, early depth tests stay on
+#endif
+
+layout( std140 ) uniform FrameUniforms	// Written once per frame, see Renderer::render
+{
+	mat4 u_model;
+	mat4 u_view;
+	mat4 u_projection;
+	float u_fishsize;
+};
+
+// Opaque sphere: the surface point of the pixel gives depth and normal
+void main()
+{
+	vec2 circCoord = vec2(2.0 * gl_PointCoord.x - 1.0, 1.0 - 2.0 * gl_PointCoord.y);	// Point coordinates start at the top
+	float r2 = dot( circCoord, circCoord );
+	if ( r2 > 1.0 || vertex_color.w < 0 )
+	{
+		discard;
+	}
+
+	vec3 normal = vec3( circCoord, sqrt( 1.0 - r2 ) );
+	vec4 clip = u_projection * vec4( sphere_center + sphere_radius * normal, 1.0 );
+	gl_FragDepth = 0.5 * clip.z / clip.w + 0.5;
+
+	float light = 0.35 + 0.65 * max( dot( normal, normalize( vec3( -0.4, 0.6, 0.7 ) ) ), 0.0 );
+	frag_color = vec4( vertex_color.rgb * light, 1.0 );
+}
@@ -0,0 +1,46 @@
+#version 330 core
+
+layout( location = 0 ) in vec4 in_position;
+layout( location = 1 ) in vec4 in_color;
+layout( location = 2 ) in vec4 in_previous;	// Position of the step before, only bound with interpolation
+
+out vec4 vertex_color;
+flat out vec3 sphere_center;				// View space center of the sphere
+flat out float sphere_radius;				// View space radius, the sprite covers the sphere
+
+layout( std140 ) uniform FrameUniforms	// Written once per frame, see Renderer::render
+{
+	mat4 u_model;
+	mat4 u_view;
+	mat4 u_projection;
+	float u_fishsize;
+};
+
+uniform float u_pointsize;
+uniform float u_lag;		// Steps behind the newest one. 0: in_position, 1: in_previous
+uniform float u_viewport;	// Viewport height in pixels
+
+// Same sprite size and position as vertex.glsl, the fragments turn it into a sphere
+void main()
+{
+	vertex_color = in_color;
+	gl_PointSize = u_pointsize;
+	if (in_position.w < 0)
+	{
+		gl_Position = vec4(0, 0, 2, 1);			// dead: behind the far plane
+		vertex_color.w = -1;
+		sphere_center = vec3(0);
+		sphere_radius = 0;
+		return;
+	}
+
+	vec4 position = in_position;
+	if (u_lag > 0 && in_previous.w >= 0)		// Respawned fishies start at the new position
+		position.xyz = mix(in_position.xyz, in_previous.xyz, u_lag);
+	vec4 view = u_view * u_model * position;
+	sphere_center = view.xyz;
+	sphere_radius = u_pointsize * -view.z / (u_projection[1][1] * u_viewport);	// Half the sprite in view space
+
+	// The sprite lies on the front of the sphere, the fragments only move away from it (depth_greater)
+	gl_Position = u_projection * vec4(view.xyz + vec3(0, 0, sphere_radius), 1);
+}
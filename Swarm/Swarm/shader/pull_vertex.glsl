@@ -0,0 +1,64 @@
+#version 430 core
+
+layout( location = 1 ) in vec4 in_color;
+
+out vec4 vertex_color;
+
+layout( std140 ) uniform FrameUniforms	// Written once per frame, see Renderer::render
+{
+	mat4 u_model;
+	mat4 u_view;
+	mat4 u_projection;
+	float u_fishsize;
+};
+
+// Particle store of the newest step, written by the kernels (no pack), see Renderer::drawPulledFishies
+layout( std430, binding = 0 ) readonly buffer ParticleX { float x[]; };
+layout( std430, binding = 1 ) readonly buffer ParticleY { float y[]; };
+layout( std430, binding = 2 ) readonly buffer ParticleZ { float z[]; };
+layout( std430, binding = 3 ) readonly buffer ParticleAlive { uint alive[]; };	// One byte per fish, four per word
+layout( std430, binding = 4 ) readonly buffer ParticleVx { float vx[]; };
+layout( std430, binding = 5 ) readonly buffer ParticleVy { float vy[]; };
+layout( std430, binding = 6 ) readonly buffer ParticleVz { float vz[]; };
+
+uniform float u_pointsize;
+
+uniform int u_colormode;		// ColorMode of the fishies: 0 in_color, 1 speed, 2 distance to the nearest shark, 3 in_color (packed per school)
+uniform float u_maxspeed;		// Speed: orange from this speed on
+uniform float u_feardist;		// Fear: red inside this distance to a shark
+uniform int u_sharkcount;
+uniform samplerBuffer u_sharks;	// Shark positions (xyz), the shark position buffer of the frame
+
+vec4 stateColor(vec3 position, float speed, vec4 color)
+{
+	if (u_colormode == 1)
+		return vec4(mix(vec3(0.1, 0.3, 1.0), vec3(1.0, 0.5, 0.0), clamp(speed / u_maxspeed, 0.0, 1.0)), color.w);
+	if (u_colormode == 2)
+	{
+		float nearest = 1e30;
+		for (int i = 0; i < u_sharkcount; i++)
+			nearest = min(nearest, distance(position, texelFetch(u_sharks, i).xyz));
+		float fear = 1.0 - clamp((nearest - u_feardist) / u_feardist, 0.0, 1.0);	// Calm from twice the distance on
+		return vec4(mix(vec3(0.2, 0.8, 0.3), vec3(1.0, 0.1, 0.1), fear), color.w);
+	}
+	return color;
+}
+
+void main()
+{
+	int fish = gl_VertexID;
+	bool living = ( ( alive[fish >> 2] >> ( 8 * ( fish & 3 ) ) ) & 0xffu ) != 0u;
+	vertex_color = in_color;
+	gl_PointSize = u_pointsize;
+	if (!living)
+	{
+		gl_Position = u_projection * u_view * u_model * vec4(10,-10,10,1);
+		vertex_color.w = -1;
+	}
+	else
+	{
+		vec3 position = vec3(x[fish], y[fish], z[fish]);
+		gl_Position = u_projection * u_view * u_model * vec4(position, 1);
+		vertex_color = stateColor(position, length(vec3(vx[fish], vy[fish], vz[fish])), in_color);
+	}
+}
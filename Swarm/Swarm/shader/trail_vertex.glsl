@@ -0,0 +1,38 @@
+#version 330 core
+
+out vec4 vertex_color;
+
+layout( std140 ) uniform FrameUniforms	// Written once per frame, see Renderer::render
+{
+	mat4 u_model;
+	mat4 u_view;
+	mat4 u_projection;
+	float u_fishsize;
+};
+
+uniform samplerBuffer u_trail_x;	// Trails by entry * u_fishies + id, half precision (kernel_append_trail)
+uniform samplerBuffer u_trail_y;
+uniform samplerBuffer u_trail_z;
+uniform int u_fishies;				// Number of fish ids
+uniform int u_length;				// Entries per trail
+uniform int u_head;					// Newest entry
+
+// One line strip per fish: instance = fish id, vertex = entry from the oldest to the newest one
+void main()
+{
+	int fish = gl_InstanceID;
+	if (isnan(texelFetch(u_trail_x, u_head * u_fishies + fish).r))
+	{
+		gl_Position = vec4(0, 0, 2, 1);			// dead: behind the far plane, the whole strip is clipped
+		vertex_color = vec4(0);
+		return;
+	}
+
+	int entry = (u_head + 1 + gl_VertexID) % u_length;
+	int index = entry * u_fishies + fish;
+	vec4 position = vec4(texelFetch(u_trail_x, index).r, texelFetch(u_trail_y, index).r, texelFetch(u_trail_z, index).r, 1);
+	gl_Position = u_projection * u_view * u_model * position;
+
+	float age = float(gl_VertexID + 1) / float(u_length);	// Fades out towards the oldest entry
+	vertex_color = vec4(0.85, 0.95, 1.0, 0.5 * age);
+}
@@ -1,14 +1,65 @@
 #version 330 core
+#extension GL_ARB_shader_draw_parameters : enable
 
 layout( location = 0 ) in vec4 in_position;
 layout( location = 1 ) in vec4 in_color;
+layout( location = 2 ) in vec4 in_previous;	// Position of the step before, only bound with interpolation
+layout( location = 3 ) in vec4 in_velocity;	// Unit velocity and speed (w), only bound for the speed colors
+layout( location = 4 ) in vec2 in_agent;	// Type (0: fish, 1: shark) and point size factor, only bound with the sharks behind the fishies
 
 out vec4 vertex_color;
 
-uniform mat4 u_model;
-uniform mat4 u_view;
-uniform mat4 u_projection;
+layout( std140 ) uniform FrameUniforms	// Written once per frame, see Renderer::render
+{
+	mat4 u_model;
+	mat4 u_view;
+	mat4 u_projection;
+	float u_fishsize;
+};
+
 uniform float u_pointsize;
+uniform float u_lag;		// Steps behind the newest one. 0: in_position, 1: in_previous
+
+uniform int u_colormode;		// ColorMode of the fishies: 0 in_color, 1 speed, 2 distance to the nearest shark, 3 in_color (packed per school)
+uniform float u_maxspeed;		// Speed: orange from this speed on
+uniform float u_feardist;		// Fear: red inside this distance to a shark
+uniform int u_sharkcount;
+uniform samplerBuffer u_sharks;	// Shark positions (xyz), the shark position buffer of the frame
+
+#ifdef GL_ARB_shader_draw_parameters
+layout( std140 ) uniform SchoolDraws	// Per command of the culled multi draws, see Renderer::Renderer
+{
+	vec4 u_drawcolor[64];	// Hue of the school (rgb), weight over the fish color (w)
+};
+#endif
+uniform int u_schooldraws;		// 1: the draw is a multi draw with one command per school, 0: any other draw
+
+vec4 schoolColor(vec4 color)
+{
+#ifdef GL_ARB_shader_draw_parameters
+	if (u_schooldraws != 0)
+	{
+		vec4 draw = u_drawcolor[gl_DrawIDARB];
+		return vec4(mix(color.rgb, draw.rgb, draw.w), color.a);
+	}
+#endif
+	return color;
+}
+
+vec4 stateColor(vec3 position, float speed, vec4 color)
+{
+	if (u_colormode == 1)
+		return vec4(mix(vec3(0.1, 0.3, 1.0), vec3(1.0, 0.5, 0.0), clamp(speed / u_maxspeed, 0.0, 1.0)), color.w);
+	if (u_colormode == 2)
+	{
+		float nearest = 1e30;
+		for (int i = 0; i < u_sharkcount; i++)
+			nearest = min(nearest, distance(position, texelFetch(u_sharks, i).xyz));
+		float fear = 1.0 - clamp((nearest - u_feardist) / u_feardist, 0.0, 1.0);	// Calm from twice the distance on
+		return vec4(mix(vec3(0.2, 0.8, 0.3), vec3(1.0, 0.1, 0.1), fear), color.w);
+	}
+	return color;
+}
 
 void main()
 {
@@ -19,10 +70,19 @@ void main()
 		vertex_color.w = -1;
 		gl_PointSize = u_pointsize;
 	}
-	else
+	else if (in_agent.x > 0.5)	// Shark: no previous position, no state
 	{
 		gl_Position = u_projection * u_view * u_model * in_position;
-		vertex_color = in_color;
+		vertex_color = vec4(0.8, 0.8, 0.8, 1.0);
+		gl_PointSize = u_pointsize * in_agent.y;
+	}
+	else
+	{
+		vec4 position = in_position;
+		if (u_lag > 0 && in_previous.w >= 0)	// Respawned fishies start at the new position
+			position.xyz = mix(in_position.xyz, in_previous.xyz, u_lag);
+		gl_Position = u_projection * u_view * u_model * position;
+		vertex_color = schoolColor(stateColor(position.xyz, in_velocity.w, in_color));
 		gl_PointSize = u_pointsize;
 	}
 }
@@ -0,0 +1,44 @@
+#include "alarm_field.h"
+
+#include <algorithm>
+#include <cmath>
+
+AlarmField placeAlarm( float deposit, float decay, const Vector3& spawnMin, const Vector3& spawnMax,
+	const std::vector<Vector3>& waypoints, float margin, unsigned int resolution )
+{
+	AlarmField field;
+	if ( deposit <= 0.0f )
+		return field;
+
+	float lower[3] = { spawnMin.x, spawnMin.y, spawnMin.z };
+	float upper[3] = { spawnMax.x, spawnMax.y, spawnMax.z };
+	for ( const Vector3& waypoint : waypoints )
+	{
+		lower[0] = std::min( lower[0], waypoint.x ); upper[0] = std::max( upper[0], waypoint.x );
+		lower[1] = std::min( lower[1], waypoint.y ); upper[1] = std::max( upper[1], waypoint.y );
+		lower[2] = std::min( lower[2], waypoint.z ); upper[2] = std::max( upper[2], waypoint.z );
+	}
+
+	float extent = 0.0f;
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		lower[axis] -= margin;
+		upper[axis] += margin;
+		extent = std::max( extent, upper[axis] - lower[axis] );
+	}
+
+	resolution = std::max( resolution, 2u );
+	field.cellSize = extent / resolution;
+	if ( field.cellSize <= 0.0f )
+		return field;
+	unsigned int cells[3];
+	for ( int axis = 0; axis < 3; axis++ )
+		cells[axis] = std::max( static_cast< unsigned int >( std::ceil( ( upper[axis] - lower[axis] ) / field.cellSize ) ), 2u );
+	field.deposit = deposit;
+	field.decay = decay;
+	field.origin = Vector3( lower[0], lower[1], lower[2] );
+	field.width = cells[0];
+	field.height = cells[1];
+	field.depth = cells[2];
+	return field;
+}
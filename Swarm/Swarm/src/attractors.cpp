@@ -0,0 +1,43 @@
+#include "attractors.h"
+
+#include <algorithm>
+#include <cmath>
+
+AttractorVolume placeAttractors( const std::vector<Attractor>& attractors, const Vector3& spawnMin, const Vector3& spawnMax,
+	const std::vector<Vector3>& waypoints, unsigned int resolution )
+{
+	AttractorVolume volume;
+	if ( attractors.empty() )
+		return volume;
+
+	float lower[3] = { spawnMin.x, spawnMin.y, spawnMin.z };
+	float upper[3] = { spawnMax.x, spawnMax.y, spawnMax.z };
+	auto cover = [&]( float x, float y, float z, float r )
+	{
+		lower[0] = std::min( lower[0], x - r ); upper[0] = std::max( upper[0], x + r );
+		lower[1] = std::min( lower[1], y - r ); upper[1] = std::max( upper[1], y + r );
+		lower[2] = std::min( lower[2], z - r ); upper[2] = std::max( upper[2], z + r );
+	};
+	for ( const Vector3& waypoint : waypoints )
+		cover( waypoint.x, waypoint.y, waypoint.z, 0.0f );
+	for ( const Attractor& attractor : attractors )
+		cover( attractor.position.x, attractor.position.y, attractor.position.z, attractor.radius );
+
+	float extent = 0.0f;
+	for ( int axis = 0; axis < 3; axis++ )
+		extent = std::max( extent, upper[axis] - lower[axis] );
+
+	resolution = std::max( resolution, 2u );
+	volume.cellSize = extent / ( resolution - 1 );
+	if ( volume.cellSize <= 0.0f )
+		return volume;
+	unsigned int samples[3];
+	for ( int axis = 0; axis < 3; axis++ )
+		samples[axis] = std::max( static_cast< unsigned int >( std::ceil( ( upper[axis] - lower[axis] ) / volume.cellSize ) ) + 1, 2u );
+	volume.origin = Vector3( lower[0], lower[1], lower[2] );
+	volume.width = samples[0];
+	volume.height = samples[1];
+	volume.depth = samples[2];
+	volume.attractors = attractors;
+	return volume;
+}
@@ -0,0 +1,197 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "autotuner.h"
+#include "nvtx_range.h"
+#include "particle_store.h"
+
+/*!
+ * @brief Block sizes of the trials. 0 is the one of the occupancy calculator.
+ */
+static const unsigned int TUNE_THREADS[] = { 0, 64, 128, 256, 512 };
+
+/*!
+ * @brief Cell sizes of the trials, relative to fishDist.
+ */
+static const float TUNE_CELL_SCALES[] = { 1.0f, 1.25f, 1.5f, 2.0f };
+
+/*!
+ * @brief Verlet skins of the trials, relative to fishDist.
+ */
+static const float TUNE_SKINS[] = { 0.25f, 0.5f, 1.0f };
+
+/*!
+ * @brief A trial has to be this much faster than the best one so far, timing noise doesn't change the settings.
+ */
+static const double TUNE_MIN_GAIN = 0.98;
+
+Autotuner::Autotuner( const SwarmConfig& config, unsigned int count, const cudaDeviceProp& properties ) :
+	path_( config.tuneProfile ),
+	mode_( config.autotune ),
+	params_( kernel_get_params() )												// Restored snapshots bring their own
+{
+	int driver = 0;
+	CUDA_CHECK( cudaDriverGetVersion( &driver ) );
+	unsigned int bucket = 1;
+	while ( bucket < count && bucket < 0x80000000u )
+		bucket *= 2;															// Similar swarm sizes share an entry
+
+	std::ostringstream key;
+	key << properties.name << "\t" << driver << "\t" << static_cast< int >( config.searchMode ) << "\t" << static_cast< int >( config.behaviour ) << "\t" << bucket;
+	key_ = key.str();
+
+	bool boids = config.behaviour == Behaviour::BOIDS;
+	usesVerlet_ = !boids && config.searchMode == SearchMode::VERLET;
+	usesGrid_ = boids || config.searchMode == SearchMode::GRID || config.searchMode == SearchMode::CELL || config.searchMode == SearchMode::AUTO
+		|| config.sharkTarget != SharkTarget::CENTER;
+
+	best_.tuning = kernel_get_tuning();
+	best_.verletSkin = params_.verletSkin;
+	best_.msPerStep = 0.0;
+}
+
+bool Autotuner::load( Trial& trial ) const
+{
+	std::ifstream file( path_, std::ios::in );
+	std::string line;
+	while ( std::getline( file, line ) )
+	{
+		if ( line.compare( 0, key_.size(), key_ ) != 0 || line.size() <= key_.size() || line[key_.size()] != '\t' )
+			continue;
+		std::istringstream values( line.substr( key_.size() + 1 ) );
+		Trial stored;
+		if ( values >> stored.tuning.searchThreads >> stored.tuning.cellScale >> stored.verletSkin >> stored.msPerStep )
+		{
+			trial = stored;
+			return true;
+		}
+	}
+	return false;
+}
+
+void Autotuner::store() const
+{
+	std::vector<std::string> lines;
+	{
+		std::ifstream file( path_, std::ios::in );
+		std::string line;
+		while ( std::getline( file, line ) )
+		{
+			bool same = line.compare( 0, key_.size(), key_ ) == 0 && line.size() > key_.size() && line[key_.size()] == '\t';
+			if ( !line.empty() && !same )
+				lines.push_back( line );										// Entries of other GPUs, drivers and swarms
+		}
+	}
+
+	std::ostringstream entry;
+	entry << key_ << "\t" << best_.tuning.searchThreads << "\t" << best_.tuning.cellScale << "\t" << best_.verletSkin << "\t" << best_.msPerStep;
+	lines.push_back( entry.str() );
+
+	std::ofstream file( path_, std::ios::out | std::ios::trunc );
+	for ( const std::string& line : lines )
+		file << line << "\n";
+	file.close();
+	if ( !file )
+		std::cerr << "Impossible to write " << path_ << "!" << std::endl;
+}
+
+void Autotuner::apply( const Trial& trial )
+{
+	kernel_set_tuning( trial.tuning );
+	SwarmParams params = params_;
+	params.verletSkin = trial.verletSkin;
+	kernel_set_params( params );												// Rebuilds the Verlet lists, if the skin changed
+}
+
+void Autotuner::time( Trial& trial, ParticleStore* stores[2], unsigned int count, float speed, Vector3 swarmCenter,
+	const float4* sharks, unsigned int sharkCount, cudaStream_t stream )
+{
+	apply( trial );
+	for ( int i = 0; i < 2; i++ )
+		kernel_spawn( stores[i]->getArrays(), count, NULL, stream );			// Same start for every trial
+
+	cudaEvent_t start, end;
+	CUDA_CHECK( cudaEventCreate( &start ) );
+	CUDA_CHECK( cudaEventCreate( &end ) );
+	unsigned int current = 0;
+	for ( unsigned int i = 0; i < WARMUP_STEPS + TIMED_STEPS; i++ )
+	{
+		if ( i == WARMUP_STEPS )
+			CUDA_CHECK( cudaEventRecord( start, stream ) );
+		kernel_advance( stores[current]->getArrays(), stores[1 - current]->getArrays(), count, speed, swarmCenter, sharks, sharkCount, stream );
+		current = 1 - current;
+	}
+	CUDA_CHECK( cudaEventRecord( end, stream ) );
+	CUDA_CHECK( cudaEventSynchronize( end ) );
+
+	float ms = 0.0f;
+	CUDA_CHECK( cudaEventElapsedTime( &ms, start, end ) );
+	trial.msPerStep = ms / TIMED_STEPS;
+	CUDA_CHECK( cudaEventDestroy( start ) );
+	CUDA_CHECK( cudaEventDestroy( end ) );
+}
+
+void Autotuner::run( unsigned int count, float speed, Vector3 swarmCenter, const float4* sharks, unsigned int sharkCount, cudaStream_t stream )
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "Autotuner::run", NVTX_COLOR_SETUP );
+
+	if ( mode_ == TuneMode::OFF )
+		return;
+	if ( mode_ == TuneMode::CACHED && load( best_ ) )
+	{
+		apply( best_ );
+		std::cout << "Autotune:                         block size " << best_.tuning.searchThreads << ", cell scale " << best_.tuning.cellScale
+				  << ", skin " << best_.verletSkin << " from " << path_ << std::endl;
+		return;
+	}
+
+	// Trials on stores of their own, the fishies of the run don't move. Coordinate descent: block size, then cell size, then skin.
+	unsigned int randomStep = kernel_get_random_step();
+	ParticleStore* stores[2] = { new ParticleStore( count ), new ParticleStore( count ) };
+	unsigned int trials = 0;
+	auto tryTrial = [&]( Trial trial )
+	{
+		time( trial, stores, count, speed, swarmCenter, sharks, sharkCount, stream );
+		trials++;
+		if ( best_.msPerStep == 0.0 || trial.msPerStep < best_.msPerStep * TUNE_MIN_GAIN )
+			best_ = trial;
+	};
+
+	double baseline = 0.0;
+	for ( unsigned int threads : TUNE_THREADS )
+	{
+		Trial trial = best_;
+		trial.tuning.searchThreads = threads;
+		tryTrial( trial );
+		if ( trials == 1 )
+			baseline = best_.msPerStep;											// Occupancy block size with the start settings
+	}
+	if ( usesGrid_ )
+	{
+		for ( float scale : TUNE_CELL_SCALES )
+		{
+			Trial trial = best_;
+			trial.tuning.cellScale = scale;
+			tryTrial( trial );
+		}
+	}
+	if ( usesVerlet_ )
+	{
+		for ( float skin : TUNE_SKINS )
+		{
+			Trial trial = best_;
+			trial.verletSkin = skin * params_.fishDist;
+			tryTrial( trial );
+		}
+	}
+
+	delete stores[0];
+	delete stores[1];
+	kernel_set_random_step( randomStep );										// The run gets the random numbers it would have got without trials
+	apply( best_ );
+	store();
+	std::cout << "Autotune:                         " << trials << " trials, block size " << best_.tuning.searchThreads << ", cell scale "
+			  << best_.tuning.cellScale << ", skin " << best_.verletSkin << ", " << best_.msPerStep << " ms per step (" << baseline << " ms untuned)" << std::endl;
+}
@@ -0,0 +1,124 @@
+#include "camera_path.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+CameraPath::CameraPath( const std::string& recordPath, const std::string& replayPath, unsigned int seed )
+{
+	if ( !replayPath.empty() )
+	{
+		if ( read( replayPath ) )
+			std::cout << "Camera path:                      " << frames_.size() << " frames, seed " << seed_ << std::endl;
+		return;																	// Replays are not recorded again
+	}
+	if ( recordPath.empty() )
+		return;
+
+	record_.open( recordPath, std::ios::binary );
+	if ( !record_ )
+	{
+		std::cerr << "Impossible to open " << recordPath << "!" << std::endl;
+		return;
+	}
+	CameraPathHeader header = {};
+	std::memcpy( header.magic, CAMERA_PATH_MAGIC, sizeof( CAMERA_PATH_MAGIC ) );
+	header.version = CAMERA_PATH_VERSION;
+	header.seed = seed;
+	record_.write( reinterpret_cast< const char* >( &header ), sizeof( CameraPathHeader ) );
+}
+
+bool CameraPath::read( const std::string& path )
+{
+	std::ifstream file( path, std::ios::binary );
+	if ( !file )
+	{
+		std::cerr << "Impossible to open " << path << "!" << std::endl;
+		return false;
+	}
+
+	CameraPathHeader header;
+	if ( !file.read( reinterpret_cast< char* >( &header ), sizeof( CameraPathHeader ) )
+		|| std::memcmp( header.magic, CAMERA_PATH_MAGIC, sizeof( CAMERA_PATH_MAGIC ) ) != 0
+		|| header.version != CAMERA_PATH_VERSION )
+	{
+		std::cerr << path << " is no camera path of this version!" << std::endl;
+		return false;
+	}
+
+	CameraPathFrame frame;
+	while ( file.read( reinterpret_cast< char* >( &frame ), sizeof( CameraPathFrame ) ) )
+	{
+		size_t first = keys_.size();
+		keys_.resize( first + frame.keyCount );
+		if ( frame.keyCount > 0 && !file.read( reinterpret_cast< char* >( keys_.data() + first ), frame.keyCount * sizeof( int ) ) )
+		{
+			keys_.resize( first );												// Cut off while recording, e.g. by a crash
+			break;
+		}
+		frames_.push_back( frame );
+	}
+	seed_ = header.seed;
+	if ( frames_.empty() )
+		std::cerr << path << " has no frames!" << std::endl;
+	times_.assign( static_cast< size_t >( FrameStage::COUNT ), StageTimes( std::max<size_t>( frames_.size(), 1 ) ) );
+	return !frames_.empty();
+}
+
+bool CameraPath::frame( Window& window )
+{
+	if ( record_.is_open() )
+	{
+		Window::CameraPose const pose = window.getCameraPose();
+		std::vector<GLint> const keys = window.takeKeyLog();
+		CameraPathFrame frame = { { pose.eyePoint.x, pose.eyePoint.y, pose.eyePoint.z }, pose.pitch, pose.yaw, static_cast< unsigned int >( keys.size() ) };
+		record_.write( reinterpret_cast< const char* >( &frame ), sizeof( CameraPathFrame ) );
+		for ( GLint key : keys )
+		{
+			int value = key;
+			record_.write( reinterpret_cast< const char* >( &value ), sizeof( int ) );
+		}
+		return true;
+	}
+
+	if ( frames_.empty() )
+		return true;
+	if ( nextFrame_ == frames_.size() )
+		return false;
+
+	// Keys first: they toggle the renderer and move the camera, the pose then puts it where it was recorded.
+	const CameraPathFrame& frame = frames_[nextFrame_++];
+	for ( unsigned int k = 0; k < frame.keyCount; k++ )
+		window.injectKeyPress( keys_[nextKey_++] );
+	window.setCameraPose( { glm::vec4( frame.eyePoint[0], frame.eyePoint[1], frame.eyePoint[2], 1.0f ), frame.pitch, frame.yaw } );
+	return true;
+}
+
+void CameraPath::collect( const FrameProfiler& profiler )
+{
+	if ( frames_.empty() )
+		return;
+
+	for ( unsigned int s = 0; s < times_.size(); s++ )
+	{
+		unsigned int tag = 0;
+		float ms = profiler.getCollected( static_cast< FrameStage >( s ), tag );
+		if ( ms >= 0.0f )														// Not timed in that frame
+			times_[s].add( ms );
+	}
+}
+
+std::string CameraPath::report() const
+{
+	std::string text = "Replay      mean ms    p50 ms    p95 ms    p99 ms   frames\n";
+	char line[128];
+	for ( unsigned int s = 0; s < times_.size(); s++ )
+	{
+		const StageTimes& t = times_[s];
+		std::snprintf( line, sizeof( line ), "%-8s %9.3f %9.3f %9.3f %9.3f %8zu\n",
+			frameStageName( static_cast< FrameStage >( s ) ), t.mean(), t.percentile( 50.0f ), t.percentile( 95.0f ), t.percentile( 99.0f ), t.count() );
+		text += line;
+	}
+	return text;
+}
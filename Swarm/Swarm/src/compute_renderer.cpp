@@ -0,0 +1,159 @@
+#include "glew.h"
+
+#include <iostream>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Window.hpp"
+#include "compute_renderer.h"
+#include "frame_uniforms.h"
+#include "host_simulation.h"
+#include "vertex_buffer_layout.h"
+
+ComputeRenderer::ComputeRenderer( const SwarmConfig& config ) :
+	shader_( "vertex.glsl", "fragment.glsl" ),									// Same point shader as the CUDA backend
+	profiler_( config.profileInterval > 0, config.profileInterval, false ),		// Only OpenGL and CPU timers
+	frameTimes_( config.frameBudget ),
+	frameDump_( config.frameDump ),
+	dt_( 1.0 / config.simulationRate )
+{
+	shader_.bindUniformBlock( "FrameUniforms", FRAME_UNIFORMS_BINDING );
+	frameUniforms_ = new UniformBuffer( sizeof( FrameUniforms ), FRAME_UNIFORMS_BINDING );
+	pointSizeLocation_ = shader_.getUniformHandle( "u_pointsize" );
+
+	glEnable( GL_BLEND );														// clean looking points.
+	glEnable( GL_PROGRAM_POINT_SIZE );											// enable to set the point size.
+
+	simulation_ = new ComputeSimulation( config );
+	if ( SceneTarget::isNeeded( config ) )
+		sceneTarget_ = new SceneTarget( config.msaa, config.renderScale );		// Fixed scale, no quality controller
+	unsigned int numParticles = simulation_->getNumParticles();
+	unsigned int numSharks = simulation_->getNumSharks();
+
+	std::vector<unsigned char> h_color;
+	spawnColors( numParticles, h_color );
+	vbC_ = new VertexBuffer( h_color.data(), numParticles * 4 );				// RGBA8
+
+	std::vector<float> h_shark_color( numSharks * 4, 0.8f );					// Grey sharks
+	for ( unsigned int i = 0; i < numSharks; i++ )
+		h_shark_color[i * 4 + 3] = 1.0f;
+	vbSharkC_ = new VertexBuffer( h_shark_color.data(), numSharks * 4 * sizeof( float ) );
+
+	VertexBufferLayout layout;
+	layout.push<float>( 4, 0 );
+	VertexBufferLayout colorLayout;
+	colorLayout.push<unsigned char>( 4, 0 );									// Same packed colors as Renderer
+	for ( int i = 0; i < 2; i++ )												// The simulation writes into both position buffers in turn
+	{
+		va_[i].addBuffer( simulation_->getPositions( i ), layout );
+		va_[i].addBuffer( *vbC_, colorLayout.getElements()[0], 1 );
+		va_[i].unbind();
+	}
+	vaShark_.addBuffer( simulation_->getSharks(), layout );
+	vaShark_.addBuffer( *vbSharkC_, layout.getElements()[0], 1 );
+	vaShark_.unbind();
+	vbSharkC_->unbind();
+
+	lastUpdate_ = Window::getInstance()->getCurrentTime();
+}
+
+void ComputeRenderer::render()
+{
+	Window* window = Window::getInstance();
+	double currentTime = window->getCurrentTime();
+	if ( !window->isBenchmarkMode() && !window->isPaused() && currentTime - lastUpdate_ <= 0.006 )	// Limit render rate. Simulation rate is set by dt_.
+		return;
+
+	profiler_.beginFrame();
+	frameTimes_.beginFrame();
+
+	unsigned int steps = 0;
+	if ( window->isPaused() )													// Pause and single step like Renderer::render
+	{
+		if ( window->consumeStep() )
+			steps = 1;
+	}
+	else
+	{
+		accumulator_ += currentTime - lastUpdate_;								// Fixed timestep like Renderer::render
+		if ( window->isBenchmarkMode() )
+		{
+			steps = 1;
+			accumulator_ = 0.0;
+		}
+		while ( accumulator_ >= dt_ && steps < MAX_SUBSTEPS )
+		{
+			accumulator_ -= dt_;
+			steps++;
+		}
+		if ( steps == MAX_SUBSTEPS )
+			accumulator_ = 0.0;
+	}
+	lastUpdate_ = currentTime;
+
+	{
+		ScopedFramePart timer( frameTimes_, FramePart::SIMULATION );
+		ScopedGlTimer gpuTimer( profiler_, FrameStage::ADVANCE );
+		for ( unsigned int i = 0; i < steps; i++ )
+			simulation_->step();
+		if ( steps > 0 )
+			simulation_->reduceStats();											// Read back some frames later, no stall
+	}
+
+	{
+		ScopedFramePart frameTimer( frameTimes_, FramePart::RENDER );
+		ScopedGlTimer timer( profiler_, FrameStage::DRAW );
+
+		if ( sceneTarget_ != NULL )
+			sceneTarget_->beginFrame();
+		float pixelScale = sceneTarget_ != NULL ? sceneTarget_->getScale() : 1.0f;	// Point sizes are in pixels of the target
+
+		glClearColor( 3.0 / 255.0, 148 / 255.0, 252 / 255.0, 1.0 );				// Set Blue background
+		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+
+		Camera const camera = window->getCamera();
+		FrameUniforms uniforms = {};
+		uniforms.model = glm::scale( glm::mat4( 1.0f ), glm::vec3( 100.0f, 100.0f, 100.0f ) );	// Same scene scale as Renderer
+		uniforms.view = camera.viewMatrix();
+		uniforms.projection = camera.projectionMatrix();
+		frameUniforms_->upload( &uniforms );
+
+		shader_.bind();
+		shader_.setUniform1f( pointSizeLocation_, 4.0f * pixelScale );
+		va_[simulation_->getCurrent()].bind();									// Latest positions, written by the compute shaders
+		glDrawArrays( GL_POINTS, 0, simulation_->getNumParticles() );			// Eaten fishies are discarded by the shader
+		va_[simulation_->getCurrent()].unbind();
+
+		vaShark_.bind();
+		shader_.setUniform1f( pointSizeLocation_, 15.0f * pixelScale );			// Set Point Size bigger than fishies
+		glDrawArrays( GL_POINTS, 0, simulation_->getNumSharks() );
+		vaShark_.unbind();
+
+		if ( sceneTarget_ != NULL )
+			sceneTarget_->endFrame();											// Resolve and scale up
+	}
+
+	window->setTitleInfo( profiler_.summary() );
+	profiler_.reportIfDue();
+
+	if ( window->consumeKeyPress( GLFW_KEY_F ) )								// F: write the frame times now
+	{
+		std::cout << frameTimes_.report() << std::endl;
+		frameTimes_.dump( frameDump_.empty() ? "frame_times.csv" : frameDump_ );
+	}
+}
+
+void ComputeRenderer::cleanUp()
+{
+	std::cout << frameTimes_.report() << std::endl;								// Tail frame times of the run
+	if ( !frameDump_.empty() )
+		frameTimes_.dump( frameDump_ );
+
+	shader_.unbind();
+	delete sceneTarget_;
+	delete simulation_;
+	delete vbC_;
+	delete vbSharkC_;
+	delete frameUniforms_;
+}
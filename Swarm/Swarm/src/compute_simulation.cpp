@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <vector>
+
+#include "compute_simulation.h"
+#include "host_simulation.h"
+
+// Passes of compute_grid.glsl and compute_stats.glsl (u_pass).
+static const int GRID_PASS_COUNT = 0;
+static const int GRID_PASS_SCAN_CELLS = 1;
+static const int GRID_PASS_SCAN_SUMS = 2;
+static const int GRID_PASS_ADD_SUMS = 3;
+static const int GRID_PASS_SCATTER = 4;
+static const int STATS_PASS_PARTIALS = 0;
+static const int STATS_PASS_FINISH = 1;
+
+static const unsigned int MAX_STATS_PARTIALS = 256;								// One work group reduces them in the second pass
+static const unsigned int STATS_PARTIAL_SIZE = 48;								// Partial of compute_stats.glsl (std430)
+static const float MIN_CELL_SIZE = 1e-3f;										// fishDist 0 still gives a valid grid
+
+/*!
+ * @brief Bind a buffer to a shader storage binding point of the next dispatch.
+ * @param binding binding point of the buffer block.
+ * @param buffer buffer.
+ */
+static void bindStorage( unsigned int binding, const VertexBuffer* buffer )
+{
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, binding, buffer->getBufferID() );
+}
+
+/*!
+ * @brief Number of work groups for one thread per item.
+ * @param count number of items.
+ * @param groupSize threads per work group.
+ * @return number of work groups.
+ */
+static unsigned int workGroups( unsigned int count, unsigned int groupSize )
+{
+	return ( count + groupSize - 1 ) / groupSize;
+}
+
+ComputeSimulation::ComputeSimulation( const SwarmConfig& config ) :
+	gridShader_( "compute_grid.glsl" ),
+	advanceShader_( "compute_advance.glsl" ),
+	sharkShader_( "compute_sharks.glsl" ),
+	statsShader_( "compute_stats.glsl" ),
+	h_stats_(),
+	numParticles_( config.numParticles ),
+	numSharks_( config.numSharks ),
+	params_( config.params ),
+	firstK_( config.firstK ),
+	seed_( config.seed ),
+	gridOrigin_( 0.0f ),
+	cellSize_( std::max( config.params.fishDist, MIN_CELL_SIZE ) )
+{
+	speed = static_cast< float >( config.swarmSpeed / config.simulationRate );	// Same distance per simulated second for every rate
+
+	waypointList = new WaypointList( config.waypoints );						// Initialize Waypoint path.
+	swarmCenter = waypointList->get();											// Get first swarm center for particles.
+
+	std::vector<float> h_data, h_state, h_shark_data, h_shark_state;
+	spawnFish( numParticles_, h_data, h_state, config.spawnMin, config.spawnMax );	// init vertex position, force and mass
+	spawnSharks( numSharks_, h_shark_data, h_shark_state, config.spawnMin, config.spawnMax );
+
+	unsigned int vec4Size = 4 * sizeof( float );
+	for ( int i = 0; i < 2; i++ )												// Both buffers start with the same fishies
+	{
+		positions_[i] = new VertexBuffer( h_data.data(), numParticles_ * vec4Size );
+		states_[i] = new VertexBuffer( h_state.data(), numParticles_ * vec4Size );
+	}
+	sharks_ = new VertexBuffer( h_shark_data.data(), numSharks_ * vec4Size );
+	sharkStates_ = new VertexBuffer( h_shark_state.data(), numSharks_ * vec4Size );
+
+	cellCount_ = new VertexBuffer( NULL, GRID_NUM_CELLS * sizeof( unsigned int ) );
+	cellStart_ = new VertexBuffer( NULL, GRID_NUM_CELLS * sizeof( unsigned int ) );
+	blockSums_ = new VertexBuffer( NULL, GRID_NUM_CELLS / SCAN_CELLS * sizeof( unsigned int ) );
+	fishCell_ = new VertexBuffer( NULL, numParticles_ * sizeof( unsigned int ) );
+	fishRank_ = new VertexBuffer( NULL, numParticles_ * sizeof( unsigned int ) );
+	sorted_ = new VertexBuffer( NULL, numParticles_ * vec4Size );
+	statsPartials_ = new VertexBuffer( NULL, MAX_STATS_PARTIALS * STATS_PARTIAL_SIZE );
+	stats_ = new VertexBuffer( NULL, sizeof( SwarmStats ) );
+	stats_->unbind();
+
+	h_stats_.centroid = make_float3( swarmCenter.x, swarmCenter.y, swarmCenter.z );	// Grid around the spawn box until the first read back
+	h_stats_.boundsMin = make_float3( config.spawnMin.x, config.spawnMin.y, config.spawnMin.z );
+	h_stats_.boundsMax = make_float3( config.spawnMax.x, config.spawnMax.y, config.spawnMax.z );
+	h_stats_.liveCount = numParticles_;
+}
+
+ComputeSimulation::~ComputeSimulation()
+{
+	if ( statsFence_ != NULL )
+		glDeleteSync( statsFence_ );
+
+	for ( int i = 0; i < 2; i++ )
+	{
+		delete positions_[i];
+		delete states_[i];
+	}
+	delete sharks_;
+	delete sharkStates_;
+	delete cellCount_;
+	delete cellStart_;
+	delete blockSums_;
+	delete fishCell_;
+	delete fishRank_;
+	delete sorted_;
+	delete statsPartials_;
+	delete stats_;
+	delete waypointList;
+}
+
+void ComputeSimulation::moveSwarmCenter()
+{
+	Vector3 diff = waypointList->get() - swarmCenter;							// Get Next Swarm center
+	if (diff.length() < WAYPOINT_THRESHOLD)										// Check if center was reached
+	{
+		diff = waypointList->getNext() - swarmCenter;
+	}
+
+	diff = diff.normalized() * speed;
+	swarmCenter += diff;
+}
+
+void ComputeSimulation::placeGrid()
+{
+	if ( h_stats_.liveCount == 0 )
+		return;
+
+	float extent = std::max( h_stats_.boundsMax.x - h_stats_.boundsMin.x,
+		std::max( h_stats_.boundsMax.y - h_stats_.boundsMin.y, h_stats_.boundsMax.z - h_stats_.boundsMin.z ) );
+	cellSize_ = std::max( std::max( params_.fishDist, MIN_CELL_SIZE ), extent / GRID_SIZE );	// Larger swarms get larger cells instead of shared buckets
+	gridOrigin_ = glm::vec3( h_stats_.boundsMin.x, h_stats_.boundsMin.y, h_stats_.boundsMin.z );
+}
+
+void ComputeSimulation::buildGrid()
+{
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, cellCount_->getBufferID() );
+	glClearBufferData( GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+	bindStorage( 0, positions_[current_] );
+	bindStorage( 1, cellCount_ );
+	bindStorage( 2, cellStart_ );
+	bindStorage( 3, blockSums_ );
+	bindStorage( 4, fishCell_ );
+	bindStorage( 5, fishRank_ );
+	bindStorage( 6, sorted_ );
+
+	gridShader_.bind();
+	gridShader_.setUniform1i( "u_count", numParticles_ );
+	gridShader_.setUniform3f( "u_origin", gridOrigin_ );
+	gridShader_.setUniform1f( "u_cellSize", cellSize_ );
+
+	glMemoryBarrier( GL_BUFFER_UPDATE_BARRIER_BIT );							// Cleared counts
+	gridShader_.setUniform1i( "u_pass", GRID_PASS_COUNT );
+	gridShader_.dispatch( workGroups( numParticles_, WORK_GROUP_SIZE ) );
+	glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+
+	gridShader_.setUniform1i( "u_pass", GRID_PASS_SCAN_CELLS );
+	gridShader_.dispatch( GRID_NUM_CELLS / SCAN_CELLS );
+	glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+
+	gridShader_.setUniform1i( "u_pass", GRID_PASS_SCAN_SUMS );					// GRID_NUM_CELLS / SCAN_CELLS = one work group of sums
+	gridShader_.dispatch( 1 );
+	glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+
+	gridShader_.setUniform1i( "u_pass", GRID_PASS_ADD_SUMS );
+	gridShader_.dispatch( GRID_NUM_CELLS / WORK_GROUP_SIZE );
+	glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+
+	gridShader_.setUniform1i( "u_pass", GRID_PASS_SCATTER );
+	gridShader_.dispatch( workGroups( numParticles_, WORK_GROUP_SIZE ) );
+	glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+}
+
+void ComputeSimulation::step()
+{
+	moveSwarmCenter();
+	placeGrid();
+	buildGrid();
+
+	unsigned int next = 1 - current_;											// Write into the other buffers
+	bindStorage( 0, positions_[current_] );
+	bindStorage( 1, states_[current_] );
+	bindStorage( 2, positions_[next] );
+	bindStorage( 3, states_[next] );
+	bindStorage( 4, sharks_ );
+	bindStorage( 5, cellStart_ );
+	bindStorage( 6, cellCount_ );
+	bindStorage( 7, sorted_ );
+
+	advanceShader_.bind();
+	advanceShader_.setUniform1i( "u_count", numParticles_ );
+	advanceShader_.setUniform1i( "u_sharkCount", numSharks_ );
+	advanceShader_.setUniform1f( "u_speed", speed );
+	advanceShader_.setUniform3f( "u_center", swarmCenter.toSwarmVector().toGlm() );
+	advanceShader_.setUniform3f( "u_origin", gridOrigin_ );
+	advanceShader_.setUniform1f( "u_cellSize", cellSize_ );
+	advanceShader_.setUniform1i( "u_firstK", firstK_ );
+	advanceShader_.setUniform1i( "u_seed", static_cast< int >( seed_ ) );
+	advanceShader_.setUniform1i( "u_step", static_cast< int >( stepCount_ ) );
+	advanceShader_.setUniform1f( "u_centerThreshold", params_.centerThreshold );
+	advanceShader_.setUniform1f( "u_sharkDist", params_.sharkDist );
+	advanceShader_.setUniform1f( "u_sharkBiteDist", params_.sharkBiteDist );
+	advanceShader_.setUniform1f( "u_fishDist", params_.fishDist );
+	advanceShader_.setUniform1f( "u_acceleration", params_.accelerationFactor );
+	advanceShader_.setUniform1f( "u_jitter", params_.jitter );
+	advanceShader_.dispatch( workGroups( numParticles_, WORK_GROUP_SIZE ) );
+	glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );							// The fishies read the sharks before they move
+
+	current_ = next;															// Swap buffers
+
+	bindStorage( 0, sharks_ );
+	bindStorage( 1, sharkStates_ );
+	sharkShader_.bind();
+	sharkShader_.setUniform1i( "u_count", numSharks_ );
+	sharkShader_.setUniform1f( "u_speed", speed );
+	sharkShader_.setUniform3f( "u_center", swarmCenter.toSwarmVector().toGlm() );
+	sharkShader_.dispatch( workGroups( numSharks_, 64 ) );
+	glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT );	// Next step and draw read the new positions
+
+	stepCount_++;
+}
+
+void ComputeSimulation::reduceStats()
+{
+	if ( statsFence_ != NULL )
+	{
+		GLenum status = glClientWaitSync( statsFence_, 0, 0 );					// Only poll, never wait for the GPU
+		if ( status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED )
+			return;
+
+		glDeleteSync( statsFence_ );
+		statsFence_ = NULL;
+		stats_->bind();
+		glGetBufferSubData( GL_ARRAY_BUFFER, 0, sizeof( SwarmStats ), &h_stats_ );	// Done on the GPU, the copy doesn't stall
+		stats_->unbind();
+	}
+
+	unsigned int partials = std::min( workGroups( numParticles_, WORK_GROUP_SIZE ), MAX_STATS_PARTIALS );
+	bindStorage( 0, positions_[current_] );
+	bindStorage( 1, states_[current_] );
+	bindStorage( 2, statsPartials_ );
+	bindStorage( 3, stats_ );
+
+	statsShader_.bind();
+	statsShader_.setUniform1i( "u_pass", STATS_PASS_PARTIALS );
+	statsShader_.setUniform1i( "u_count", numParticles_ );
+	statsShader_.dispatch( std::max( partials, 1u ) );
+	glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+
+	statsShader_.setUniform1i( "u_pass", STATS_PASS_FINISH );
+	statsShader_.setUniform1i( "u_count", partials );
+	statsShader_.dispatch( 1 );
+	glMemoryBarrier( GL_BUFFER_UPDATE_BARRIER_BIT );							// Read back with glGetBufferSubData
+
+	statsFence_ = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+}
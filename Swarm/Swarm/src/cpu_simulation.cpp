@@ -0,0 +1,578 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#elif defined( __SSE2__ ) || defined( _M_X64 )
+#include <emmintrin.h>
+#endif
+
+#include "cpu_simulation.h"
+#include "host_simulation.h"
+
+static const unsigned int DEAD_CELL = 0xffffffff;		// Cell hash of eaten fishies, they are not sorted into the grid.
+static const unsigned int STATS_CHUNK = 4096;			// Fishies per partial of reduceStats.
+static const unsigned int RANDOM_JITTER = 0;			// RandomUse of kernel.cu.
+static const unsigned int RANDOM_USES = 2;
+
+/*!
+ * @brief One round of Philox4x32-10.
+ * @param ctr counter. Will be updated.
+ * @param key key of the round.
+ */
+static void philoxRound( unsigned int ctr[4], const unsigned int key[2] )
+{
+	unsigned long long p0 = 0xD2511F53ull * ctr[0];
+	unsigned long long p1 = 0xCD9E8D57ull * ctr[2];
+	unsigned int hi0 = static_cast< unsigned int >( p0 >> 32 ), lo0 = static_cast< unsigned int >( p0 );
+	unsigned int hi1 = static_cast< unsigned int >( p1 >> 32 ), lo1 = static_cast< unsigned int >( p1 );
+	unsigned int next[4] = { hi1 ^ ctr[1] ^ key[0], lo1, hi0 ^ ctr[3] ^ key[1], lo0 };
+	std::copy( next, next + 4, ctr );
+}
+
+/*!
+ * @brief Four uniform random numbers in (0, 1], the same as d_random4 on the GPU.
+ * curand_init( seed, id, offset ) with curand_uniform4 is Philox4x32-10 with the counter ( offset / 4, id ) and the seed as key.
+ * @param seed seed of the run.
+ * @param id index of the fish.
+ * @param offset ( step * RANDOM_USES + use ) * 4.
+ * @param random Output: random numbers.
+ */
+static void philoxUniform4( unsigned long long seed, unsigned int id, unsigned long long offset, float random[4] )
+{
+	unsigned long long block = offset / 4;
+	unsigned int ctr[4] = { static_cast< unsigned int >( block ), static_cast< unsigned int >( block >> 32 ), id, 0 };
+	unsigned int key[2] = { static_cast< unsigned int >( seed ), static_cast< unsigned int >( seed >> 32 ) };
+	for ( int round = 0; round < 10; round++ )
+	{
+		if ( round > 0 )
+		{
+			key[0] += 0x9E3779B9;
+			key[1] += 0xBB67AE85;
+		}
+		philoxRound( ctr, key );
+	}
+	for ( int i = 0; i < 4; i++ )
+		random[i] = ctr[i] * 2.3283064e-10f + 2.3283064e-10f / 2.0f;			// curand_uniform
+}
+
+/*!
+ * @brief Normalize a difference vector like DeviceVector::normalized, which counts w = 1 into the length.
+ * @param v vector. Will be updated.
+ */
+static void normalizeDiff( float v[3] )
+{
+	float inv = 1.0f / std::sqrt( v[0] * v[0] + v[1] * v[1] + v[2] * v[2] + 1.0f );
+	v[0] *= inv;
+	v[1] *= inv;
+	v[2] *= inv;
+}
+
+/*!
+ * @brief Length of a vector (x, y, z).
+ * @param v vector.
+ * @return length.
+ */
+static float length3( const float v[3] )
+{
+	return std::sqrt( v[0] * v[0] + v[1] * v[1] + v[2] * v[2] );
+}
+
+void CpuSimulation::Fishies::resize( unsigned int count )
+{
+	x.resize( count );
+	y.resize( count );
+	z.resize( count );
+	vx.resize( count );
+	vy.resize( count );
+	vz.resize( count );
+	mass.resize( count );
+	alive.resize( count );
+}
+
+CpuSimulation::CpuSimulation( const SwarmConfig& config ) :
+	pool_( config.threads ),
+	numParticles_( config.numParticles ),
+	numSharks_( config.numSharks ),
+	params_( config.params ),
+	firstK_( config.firstK ),
+	seed_( config.seed ),
+	dt_( 1.0 / config.simulationRate )
+{
+	speed = static_cast< float >( config.swarmSpeed * dt_ );					// Same distance per simulated second for every rate
+
+	waypointList = new WaypointList( config.waypoints );						// Initialize Waypoint path.
+	swarmCenter = waypointList->get();											// Get first swarm center for particles.
+
+	std::vector<float> h_data;
+	std::vector<float> h_state;
+	spawnFish( numParticles_, h_data, h_state, config.spawnMin, config.spawnMax );	// Same spawn as the GPU backends
+	spawnSharks( numSharks_, sharks_, sharkState_, config.spawnMin, config.spawnMax );
+
+	for ( int i = 0; i < 2; i++ )
+		fishies_[i].resize( numParticles_ );
+	Fishies& fishies = fishies_[current_];
+	for ( unsigned int i = 0; i < numParticles_; i++ )							// AoS spawn data to SoA
+	{
+		fishies.x[i] = h_data[i * 4];
+		fishies.y[i] = h_data[i * 4 + 1];
+		fishies.z[i] = h_data[i * 4 + 2];
+		fishies.vx[i] = h_state[i * 4];
+		fishies.vy[i] = h_state[i * 4 + 1];
+		fishies.vz[i] = h_state[i * 4 + 2];
+		fishies.mass[i] = h_state[i * 4 + 3];
+		fishies.alive[i] = 1;
+	}
+
+	cellOf_.resize( numParticles_ );
+	cellStart_.resize( GRID_NUM_CELLS + 1 );
+	sortedIndex_.resize( numParticles_ );
+	sortedX_.resize( numParticles_ );
+	sortedY_.resize( numParticles_ );
+	sortedZ_.resize( numParticles_ );
+	partials_.resize( ( numParticles_ + STATS_CHUNK - 1 ) / STATS_CHUNK );
+
+	std::cout << "CPU simulation on " << pool_.getThreadCount() << " threads";
+#if defined( __AVX2__ )
+	std::cout << " (AVX2)" << std::endl;
+#elif defined( __SSE2__ ) || defined( _M_X64 )
+	std::cout << " (SSE2)" << std::endl;
+#else
+	std::cout << std::endl;
+#endif
+
+	reduceStats();
+}
+
+CpuSimulation::~CpuSimulation()
+{
+	delete waypointList;
+}
+
+void CpuSimulation::moveSwarmCenter()
+{
+	Vector3 diff = waypointList->get() - swarmCenter;							// Get Next Swarm center
+	if (diff.length() < WAYPOINT_THRESHOLD)										// Check if center was reached
+	{
+		diff = waypointList->getNext() - swarmCenter;
+	}
+
+	diff = diff.normalized() * speed;
+	swarmCenter += diff;
+}
+
+void CpuSimulation::reduceStats()
+{
+	const Fishies& fishies = fishies_[current_];
+	pool_.parallelFor( numParticles_, STATS_CHUNK, [this, &fishies]( unsigned int begin, unsigned int end )
+	{
+		StatsPartial& partial = partials_[begin / STATS_CHUNK];
+		partial = StatsPartial();
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			partial.boundsMin[axis] = FLT_MAX;
+			partial.boundsMax[axis] = -FLT_MAX;
+		}
+		for ( unsigned int i = begin; i < end; i++ )
+		{
+			if ( !fishies.alive[i] )
+				continue;
+			float p[3] = { fishies.x[i], fishies.y[i], fishies.z[i] };
+			float v[3] = { fishies.vx[i], fishies.vy[i], fishies.vz[i] };
+			for ( int axis = 0; axis < 3; axis++ )
+			{
+				partial.position[axis] += p[axis];
+				partial.boundsMin[axis] = std::min( partial.boundsMin[axis], p[axis] );
+				partial.boundsMax[axis] = std::max( partial.boundsMax[axis], p[axis] );
+			}
+			partial.speed += length3( v );
+			partial.topSpeed = std::max( partial.topSpeed, length3( v ) );
+			partial.count++;
+		}
+	} );
+
+	StatsPartial total = StatsPartial();										// Partials in fixed order, same result for every thread count
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		total.boundsMin[axis] = FLT_MAX;
+		total.boundsMax[axis] = -FLT_MAX;
+	}
+	for ( const StatsPartial& partial : partials_ )
+	{
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			total.position[axis] += partial.position[axis];
+			total.boundsMin[axis] = std::min( total.boundsMin[axis], partial.boundsMin[axis] );
+			total.boundsMax[axis] = std::max( total.boundsMax[axis], partial.boundsMax[axis] );
+		}
+		total.speed += partial.speed;
+		total.topSpeed = std::max( total.topSpeed, partial.topSpeed );
+		total.count += partial.count;
+	}
+
+	stats_ = SwarmStats();
+	stats_.liveCount = total.count;
+	if ( total.count == 0 )
+		return;
+	double inv = 1.0 / total.count;
+	stats_.centroid.x = static_cast< float >( total.position[0] * inv );
+	stats_.centroid.y = static_cast< float >( total.position[1] * inv );
+	stats_.centroid.z = static_cast< float >( total.position[2] * inv );
+	stats_.boundsMin.x = total.boundsMin[0];
+	stats_.boundsMin.y = total.boundsMin[1];
+	stats_.boundsMin.z = total.boundsMin[2];
+	stats_.boundsMax.x = total.boundsMax[0];
+	stats_.boundsMax.y = total.boundsMax[1];
+	stats_.boundsMax.z = total.boundsMax[2];
+	stats_.meanSpeed = static_cast< float >( total.speed * inv );
+	stats_.maxSpeed = total.topSpeed;
+}
+
+void CpuSimulation::placeGrid()
+{
+	cellSize_ = params_.fishDist;
+	if ( stats_.liveCount == 0 )
+	{
+		std::fill( origin_, origin_ + 3, 0.0f );
+		std::fill( dims_, dims_ + 3, 3 );
+		return;
+	}
+
+	float margin = 2.0f * cellSize_;											// Same placement as kernel_set_grid_bounds
+	float lower[3] = { stats_.boundsMin.x, stats_.boundsMin.y, stats_.boundsMin.z };
+	float upper[3] = { stats_.boundsMax.x, stats_.boundsMax.y, stats_.boundsMax.z };
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		float cells = std::ceil( ( upper[axis] - lower[axis] + 2.0f * margin ) / cellSize_ );
+		dims_[axis] = static_cast< int >( std::min( std::max( cells, 3.0f ), static_cast< float >( GRID_SIZE ) ) );
+		origin_[axis] = lower[axis] - margin;
+	}
+}
+
+unsigned int CpuSimulation::cellHash( const int cell[3] ) const
+{
+	int wrapped[3];
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		int x = cell[axis] % dims_[axis];
+		wrapped[axis] = x < 0 ? x + dims_[axis] : x;
+	}
+	return ( wrapped[2] * dims_[1] + wrapped[1] ) * dims_[0] + wrapped[0];
+}
+
+void CpuSimulation::buildGrid()
+{
+	const Fishies& fishies = fishies_[current_];
+	pool_.parallelFor( numParticles_, CHUNK, [this, &fishies]( unsigned int begin, unsigned int end )
+	{
+		for ( unsigned int i = begin; i < end; i++ )
+		{
+			if ( !fishies.alive[i] )
+			{
+				cellOf_[i] = DEAD_CELL;
+				continue;
+			}
+			float p[3] = { fishies.x[i], fishies.y[i], fishies.z[i] };
+			int cell[3];
+			for ( int axis = 0; axis < 3; axis++ )
+				cell[axis] = static_cast< int >( std::floor( ( p[axis] - origin_[axis] ) / cellSize_ ) );
+			cellOf_[i] = cellHash( cell );
+		}
+	} );
+
+	unsigned int numCells = dims_[0] * dims_[1] * dims_[2];						// Counting sort, keeps the index order inside a cell
+	std::fill( cellStart_.begin(), cellStart_.begin() + numCells + 1, 0 );
+	for ( unsigned int i = 0; i < numParticles_; i++ )
+	{
+		if ( cellOf_[i] != DEAD_CELL )
+			cellStart_[cellOf_[i] + 1]++;
+	}
+	for ( unsigned int c = 0; c < numCells; c++ )
+		cellStart_[c + 1] += cellStart_[c];
+	for ( unsigned int i = 0; i < numParticles_; i++ )
+	{
+		if ( cellOf_[i] == DEAD_CELL )
+			continue;
+		unsigned int slot = cellStart_[cellOf_[i]]++;							// Moves the start to the end of the cell
+		sortedIndex_[slot] = i;
+		sortedX_[slot] = fishies.x[i];
+		sortedY_[slot] = fishies.y[i];
+		sortedZ_[slot] = fishies.z[i];
+	}
+	for ( unsigned int c = numCells; c > 0; c-- )								// Back to the starts
+		cellStart_[c] = cellStart_[c - 1];
+	cellStart_[0] = 0;
+}
+
+float CpuSimulation::closestFish( const float p[3], unsigned int self, float closest[3] ) const
+{
+	int cell[3];
+	for ( int axis = 0; axis < 3; axis++ )
+		cell[axis] = static_cast< int >( std::floor( ( p[axis] - origin_[axis] ) / cellSize_ ) );
+
+	const float* sx = sortedX_.data();
+	const float* sy = sortedY_.data();
+	const float* sz = sortedZ_.data();
+	float best = FLT_MAX;
+	unsigned int bestSlot = 0;
+	unsigned int found = 0;
+	float fishDist2 = params_.fishDist * params_.fishDist;
+
+	for ( int n = 0; n < 27; n++ )
+	{
+		int neighbour[3] = { cell[0] + n % 3 - 1, cell[1] + n / 3 % 3 - 1, cell[2] + n / 9 - 1 };
+		unsigned int hash = cellHash( neighbour );
+		unsigned int i = cellStart_[hash];
+		unsigned int end = cellStart_[hash + 1];
+
+		if ( firstK_ > 0 )														// Stops inside a cell, scalar like NeighbourQuery
+		{
+			for ( ; i < end; i++ )
+			{
+				if ( sortedIndex_[i] == self )
+					continue;
+				float dx = p[0] - sx[i], dy = p[1] - sy[i], dz = p[2] - sz[i];
+				float d2 = dx * dx + dy * dy + dz * dz;
+				if ( d2 < best )
+				{
+					best = d2;
+					bestSlot = i;
+				}
+				if ( d2 < fishDist2 && ++found >= firstK_ )
+					break;
+			}
+			if ( found >= firstK_ )
+				break;
+			continue;
+		}
+
+		// The distances of a block are computed at once, the block is only scanned if one of them is closer.
+#if defined( __AVX2__ )
+		__m256 px = _mm256_set1_ps( p[0] ), py = _mm256_set1_ps( p[1] ), pz = _mm256_set1_ps( p[2] );
+		for ( ; i + 8 <= end; i += 8 )
+		{
+			__m256 dx = _mm256_sub_ps( px, _mm256_loadu_ps( sx + i ) );
+			__m256 dy = _mm256_sub_ps( py, _mm256_loadu_ps( sy + i ) );
+			__m256 dz = _mm256_sub_ps( pz, _mm256_loadu_ps( sz + i ) );
+			__m256 d2 = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( dx, dx ), _mm256_mul_ps( dy, dy ) ), _mm256_mul_ps( dz, dz ) );
+			if ( _mm256_movemask_ps( _mm256_cmp_ps( d2, _mm256_set1_ps( best ), _CMP_LT_OQ ) ) == 0 )
+				continue;
+			float lanes[8];
+			_mm256_storeu_ps( lanes, d2 );
+			for ( int lane = 0; lane < 8; lane++ )
+			{
+				if ( lanes[lane] < best && sortedIndex_[i + lane] != self )
+				{
+					best = lanes[lane];
+					bestSlot = i + lane;
+				}
+			}
+		}
+#elif defined( __SSE2__ ) || defined( _M_X64 )
+		__m128 px = _mm_set1_ps( p[0] ), py = _mm_set1_ps( p[1] ), pz = _mm_set1_ps( p[2] );
+		for ( ; i + 4 <= end; i += 4 )
+		{
+			__m128 dx = _mm_sub_ps( px, _mm_loadu_ps( sx + i ) );
+			__m128 dy = _mm_sub_ps( py, _mm_loadu_ps( sy + i ) );
+			__m128 dz = _mm_sub_ps( pz, _mm_loadu_ps( sz + i ) );
+			__m128 d2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ), _mm_mul_ps( dz, dz ) );
+			if ( _mm_movemask_ps( _mm_cmplt_ps( d2, _mm_set1_ps( best ) ) ) == 0 )
+				continue;
+			float lanes[4];
+			_mm_storeu_ps( lanes, d2 );
+			for ( int lane = 0; lane < 4; lane++ )
+			{
+				if ( lanes[lane] < best && sortedIndex_[i + lane] != self )
+				{
+					best = lanes[lane];
+					bestSlot = i + lane;
+				}
+			}
+		}
+#endif
+		for ( ; i < end; i++ )													// Rest of the cell
+		{
+			float dx = p[0] - sx[i], dy = p[1] - sy[i], dz = p[2] - sz[i];
+			float d2 = dx * dx + dy * dy + dz * dz;
+			if ( d2 < best && sortedIndex_[i] != self )
+			{
+				best = d2;
+				bestSlot = i;
+			}
+		}
+	}
+
+	if ( best == FLT_MAX )
+		return FLT_MAX;
+	closest[0] = p[0] - sx[bestSlot];
+	closest[1] = p[1] - sy[bestSlot];
+	closest[2] = p[2] - sz[bestSlot];
+	return std::sqrt( best );
+}
+
+void CpuSimulation::swim( unsigned int i, Fishies& next ) const
+{
+	const Fishies& fishies = fishies_[current_];
+	float vert[3] = { fishies.x[i], fishies.y[i], fishies.z[i] };
+	float state[3] = { fishies.vx[i], fishies.vy[i], fishies.vz[i] };
+	float mass = fishies.mass[i];
+	next.mass[i] = mass;
+	next.alive[i] = fishies.alive[i];
+
+	if ( fishies.alive[i] )
+	{
+		float mySpeed = speed * mass;
+		float accelerationFactor = params_.accelerationFactor;
+
+		float sharkDiff[3] = { 0.0f, 0.0f, 0.0f };								// nearest shark
+		float sharkDistance2 = FLT_MAX;
+		for ( unsigned int s = 0; s < numSharks_; s++ )
+		{
+			float d[3] = { sharks_[s * 4] - vert[0], sharks_[s * 4 + 1] - vert[1], sharks_[s * 4 + 2] - vert[2] };
+			float d2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+			if ( d2 < sharkDistance2 )
+			{
+				std::copy( d, d + 3, sharkDiff );
+				sharkDistance2 = d2;
+			}
+		}
+		float sharkDistance = sharkDistance2 < FLT_MAX ? std::sqrt( sharkDistance2 ) : FLT_MAX;
+
+		if ( sharkDistance < params_.sharkBiteDist )							// shark eats fish
+		{
+			next.alive[i] = 0;
+		}
+		else
+		{
+			if ( sharkDistance < params_.sharkDist * mass )						// evade shark
+			{
+				normalizeDiff( sharkDiff );
+				for ( int axis = 0; axis < 3; axis++ )
+					state[axis] -= sharkDiff[axis] * mySpeed * accelerationFactor;
+			}
+			else
+			{
+				float closest[3];												// find closest fish
+				float closestDist = closestFish( vert, i, closest );
+				float diff[3] = { swarmCenter.x - vert[0], swarmCenter.y - vert[1], swarmCenter.z - vert[2] };
+
+				if ( closestDist < params_.fishDist )							// keep distance to other fishies
+				{
+					normalizeDiff( closest );
+					for ( int axis = 0; axis < 3; axis++ )
+					{
+						state[axis] -= closest[axis] * mySpeed * accelerationFactor * 0.7f;
+						vert[axis] += state[axis];
+					}
+					accelerationFactor /= 2;
+				}
+				if ( length3( diff ) > params_.centerThreshold * mass )			// return to swarm
+				{
+					normalizeDiff( diff );
+					for ( int axis = 0; axis < 3; axis++ )
+						state[axis] += diff[axis] * mySpeed * ( accelerationFactor * 0.4f );
+				}
+			}
+			if ( params_.jitter > 0.0f )
+			{
+				float random[4];
+				philoxUniform4( seed_, i, ( static_cast< unsigned long long >( stepCount_ ) * RANDOM_USES + RANDOM_JITTER ) * 4, random );
+				for ( int axis = 0; axis < 3; axis++ )
+					state[axis] += ( 2.0f * random[axis] - 1.0f ) * ( mySpeed * params_.jitter );
+			}
+			if ( length3( state ) > mySpeed * 0.75f )
+			{
+				for ( int axis = 0; axis < 3; axis++ )
+					state[axis] *= 0.96f;
+			}
+			for ( int axis = 0; axis < 3; axis++ )
+				vert[axis] += state[axis];
+		}
+	}
+
+	next.x[i] = vert[0];
+	next.y[i] = vert[1];
+	next.z[i] = vert[2];
+	next.vx[i] = state[0];
+	next.vy[i] = state[1];
+	next.vz[i] = state[2];
+}
+
+void CpuSimulation::moveSharks()
+{
+	for ( unsigned int s = 0; s < numSharks_; s++ )
+	{
+		float* shark = &sharks_[s * 4];
+		float* state = &sharkState_[s * 4];
+		float diff[3] = { swarmCenter.x - shark[0], swarmCenter.y - shark[1], swarmCenter.z - shark[2] };
+
+		float distance = length3( diff );
+		if ( distance > 4.0f )													// turn back to swarm
+		{
+			for ( int axis = 0; axis < 3; axis++ )
+				state[axis] += diff[axis] * ( speed * 0.2f / distance );
+			float length = length3( state );
+			if ( length > speed * 1.3f )
+			{
+				for ( int axis = 0; axis < 3; axis++ )
+					state[axis] *= speed * 1.3f / length;
+			}
+		}
+		else if ( length3( state ) < speed * 3 )								// swim through swarm or leave it
+		{
+			for ( int axis = 0; axis < 3; axis++ )
+				state[axis] *= 1.1f;
+		}
+
+		for ( int axis = 0; axis < 3; axis++ )
+			shark[axis] += state[axis];
+	}
+}
+
+void CpuSimulation::step()
+{
+	moveSwarmCenter();															// Set new Swarm center
+
+	placeGrid();																// Around the fishies of the last step
+	buildGrid();
+
+	stepCount_++;																// Random step of this advance, counted like kernel_advance
+	Fishies& next = fishies_[1 - current_];										// Write into the other store
+	pool_.parallelFor( numParticles_, CHUNK, [this, &next]( unsigned int begin, unsigned int end )
+	{
+		for ( unsigned int i = begin; i < end; i++ )
+			swim( i, next );
+	} );
+	current_ = 1 - current_;													// Swap stores
+	particleUpdates_ += stats_.liveCount;
+
+	moveSharks();																// The fishies saw the old shark positions, as on the GPU
+	reduceStats();
+}
+
+void CpuSimulation::run( unsigned int steps )
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	particleUpdates_ = 0.0;
+
+	for ( unsigned int i = 0; i < steps; i++ )
+		step();
+
+	auto end = std::chrono::high_resolution_clock::now();
+	const SwarmStats& stats = stats_;
+
+	double seconds = std::chrono::duration<double>( end - start ).count();
+	std::cout << "Steps:                            " << steps << "\n";
+	std::cout << "Time:                             " << seconds << " s\n";
+	std::cout << "Simulated time:                   " << steps * dt_ << " s\n";
+	std::cout << "Steps per second:                 " << steps / seconds << "\n";
+	std::cout << "Live particles:                   " << stats.liveCount << " of " << numParticles_ << "\n";
+	std::cout << "Particle updates per second:      " << particleUpdates_ / seconds << "\n";
+	std::cout << "Swarm centroid:                   " << stats.centroid.x << ", " << stats.centroid.y << ", " << stats.centroid.z << "\n";
+	std::cout << "Swarm bounds:                     " << stats.boundsMin.x << ", " << stats.boundsMin.y << ", " << stats.boundsMin.z
+			  << " to " << stats.boundsMax.x << ", " << stats.boundsMax.y << ", " << stats.boundsMax.z << "\n";
+	std::cout << "Mean speed:                       " << stats.meanSpeed / dt_ << " per s" << std::endl;
+}
@@ -1,12 +1,19 @@
+#include <algorithm>
+#include <cstdlib>
+
 #include "cuda_device.h"
+#include "nvtx_range.h"
+
+std::vector<int> ( *CudaDevice::glDeviceQuery )() = NULL;
 
-CudaDevice::CudaDevice()
+CudaDevice::CudaDevice() :
+	properties(),
+	deviceIndex( -1 )															// No device: stays -1, see getDeviceCount
 {
-	int deviceCounter;
-	CUDA_CHECK( cudaGetDeviceCount(&deviceCounter) );
+	int deviceCounter = getDeviceCount();
 	if (deviceCounter != 0)
 	{
-		deviceIndex = 0;
+		deviceIndex = selectDevice();
 		CUDA_CHECK(cudaGetDeviceProperties(&properties, deviceIndex));
 		CUDA_CHECK(cudaSetDevice(deviceIndex));
 	}
@@ -31,30 +38,178 @@ CudaDevice::CudaDevice(const CudaDevice& cdv)
 	deviceIndex = cdv.deviceIndex;
 }
 
-void CudaDevice::registerGLBuffer( VertexBuffer vb )
+void CudaDevice::unregisterGLBuffer()
 {
-	CUDA_CHECK( cudaGraphicsGLRegisterBuffer(&cuda_vbo_resource, vb.getBufferID(), cudaGraphicsMapFlagsNone ) );
+	for ( cudaGraphicsResource* resource : cuda_vbo_resources )
+		CUDA_CHECK( cudaGraphicsUnregisterResource( resource ) );
+	cuda_vbo_resources.clear();
 }
 
-void CudaDevice::unregisterGLBuffer()
+void CudaDevice::mapResources( cudaStream_t stream )
+{
+	NVTX_RANGE( NvtxDomain::DEVICE, "CudaDevice::mapResources", NVTX_COLOR_INTEROP );
+
+	mapped_resources = cuda_vbo_resources;
+	CUDA_CHECK( cudaGraphicsMapResources( static_cast< int >( mapped_resources.size() ), mapped_resources.data(), stream ) );
+}
+
+void CudaDevice::mapResources( const std::vector<int>& resources, cudaStream_t stream )
+{
+	NVTX_RANGE( NvtxDomain::DEVICE, "CudaDevice::mapResources", NVTX_COLOR_INTEROP );
+
+	mapped_resources.clear();
+	for ( int resource : resources )
+		mapped_resources.push_back( cuda_vbo_resources[resource] );
+	if ( mapped_resources.empty() )												// E.g. all buffers of the frame are shared through Vulkan
+		return;
+	CUDA_CHECK( cudaGraphicsMapResources( static_cast< int >( mapped_resources.size() ), mapped_resources.data(), stream ) );
+}
+
+void CudaDevice::unmapResources( cudaStream_t stream )
+{
+	NVTX_RANGE( NvtxDomain::DEVICE, "CudaDevice::unmapResources", NVTX_COLOR_INTEROP );
+
+	if ( !mapped_resources.empty() )
+		CUDA_CHECK( cudaGraphicsUnmapResources( static_cast< int >( mapped_resources.size() ), mapped_resources.data(), stream ) );
+	mapped_resources.clear();
+}
+
+void CudaDevice::holdResources( const std::vector<int>& resources, cudaStream_t stream )
+{
+	NVTX_RANGE( NvtxDomain::DEVICE, "CudaDevice::holdResources", NVTX_COLOR_INTEROP );
+
+	held_resources.clear();
+	for ( int resource : resources )
+		held_resources.push_back( cuda_vbo_resources[resource] );
+	CUDA_CHECK( cudaGraphicsMapResources( static_cast< int >( held_resources.size() ), held_resources.data(), stream ) );
+}
+
+void CudaDevice::releaseResources( cudaStream_t stream )
+{
+	NVTX_RANGE( NvtxDomain::DEVICE, "CudaDevice::releaseResources", NVTX_COLOR_INTEROP );
+
+	if ( held_resources.empty() )
+		return;
+	CUDA_CHECK( cudaGraphicsUnmapResources( static_cast< int >( held_resources.size() ), held_resources.data(), stream ) );
+	held_resources.clear();
+}
+
+void CudaDevice::getMappedPointer(void **dev_ptr, size_t* size, int resource)
+{
+	CUDA_CHECK( cudaGraphicsResourceGetMappedPointer( dev_ptr, size, cuda_vbo_resources[resource] ) );
+}
+
+int CudaDevice::createStream( StreamClass streamClass )
+{
+	streams.push_back( newStream( streamClass ) );
+	return static_cast< int >( streams.size() ) - 1;
+}
+
+int CudaDevice::getStreamPriority( StreamClass streamClass )
 {
-	CUDA_CHECK( cudaGraphicsUnregisterResource( cuda_vbo_resource ) );
-	cuda_vbo_resource = NULL;
+	int least = 0;
+	int greatest = 0;
+	CUDA_CHECK( cudaDeviceGetStreamPriorityRange( &least, &greatest ) );		// Both 0 if the device has no priorities
+	return streamClass == StreamClass::CRITICAL ? greatest : least;
 }
 
-void CudaDevice::mapResources()
+cudaStream_t CudaDevice::newStream( StreamClass streamClass )
 {
-	CUDA_CHECK( cudaGraphicsMapResources( 1, &cuda_vbo_resource, NULL ) );
+	cudaStream_t stream = NULL;
+	unsigned int flags = streamClass == StreamClass::BACKGROUND ? cudaStreamNonBlocking : cudaStreamDefault;
+	CUDA_CHECK( cudaStreamCreateWithPriority( &stream, flags, getStreamPriority( streamClass ) ) );
+	return stream;
 }
 
-void CudaDevice::unmapResources()
+void CudaDevice::destroyStreams()
 {
-	CUDA_CHECK( cudaGraphicsUnmapResources( 1, &cuda_vbo_resource, 0 ) );
+	NVTX_RANGE( NvtxDomain::DEVICE, "CudaDevice::destroyStreams", NVTX_COLOR_SYNC );
+
+	for ( cudaStream_t stream : streams )
+	{
+		CUDA_CHECK( cudaStreamSynchronize( stream ) );
+		CUDA_CHECK( cudaStreamDestroy( stream ) );
+	}
+	streams.clear();
+
+	for ( cudaStream_t stream : stageStreams )
+	{
+		CUDA_CHECK( cudaStreamSynchronize( stream ) );
+		CUDA_CHECK( cudaStreamDestroy( stream ) );
+	}
+	for ( cudaEvent_t event : stageEvents )
+		CUDA_CHECK( cudaEventDestroy( event ) );
+	if ( stageFork != NULL )
+		CUDA_CHECK( cudaEventDestroy( stageFork ) );
+	stageStreams.clear();
+	stageEvents.clear();
+	stageSlots.clear();
+	slotTails.clear();
+	stageFork = NULL;
+}
+
+void CudaDevice::beginStages( cudaStream_t origin )
+{
+	if ( stageFork == NULL )
+		CUDA_CHECK( cudaEventCreateWithFlags( &stageFork, cudaEventDisableTiming ) );
+
+	stageOrigin = origin;
+	stageSlots.clear();
+	slotTails.assign( stageStreams.size() + 1, -1 );
+	CUDA_CHECK( cudaEventRecord( stageFork, origin ) );						// Before the first stage: the later roots must not wait for it
+}
+
+int CudaDevice::runStage( const std::vector<int>& after, const std::function<void( cudaStream_t )>& work )
+{
+	int stage = static_cast< int >( stageSlots.size() );
+	int slot = -1;
+	for ( int dependency : after )												// In order behind a dependency, no join needed
+	{
+		if ( slotTails[stageSlots[dependency]] == dependency )
+		{
+			slot = stageSlots[dependency];
+			break;
+		}
+	}
+	if ( slot < 0 && after.empty() && slotTails[0] == -1 )						// First root: on the origin itself
+		slot = 0;
+	for ( size_t i = 1; slot < 0 && i < slotTails.size(); i++ )					// A stream nobody used in this frame
+		if ( slotTails[i] == -1 )
+			slot = static_cast< int >( i );
+	if ( slot < 0 )
+	{
+		stageStreams.push_back( newStream( StreamClass::CRITICAL ) );
+		slotTails.push_back( -1 );
+		slot = static_cast< int >( stageStreams.size() );
+	}
+	if ( stage == static_cast< int >( stageEvents.size() ) )
+	{
+		cudaEvent_t event = NULL;
+		CUDA_CHECK( cudaEventCreateWithFlags( &event, cudaEventDisableTiming ) );
+		stageEvents.push_back( event );
+	}
+
+	cudaStream_t stream = slot == 0 ? stageOrigin : stageStreams[slot - 1];
+	if ( after.empty() && slot != 0 )
+		CUDA_CHECK( cudaStreamWaitEvent( stream, stageFork, 0 ) );
+	for ( int dependency : after )
+		if ( stageSlots[dependency] != slot )
+			CUDA_CHECK( cudaStreamWaitEvent( stream, stageEvents[dependency], 0 ) );
+
+	work( stream );
+	CUDA_CHECK( cudaEventRecord( stageEvents[stage], stream ) );				// Recorded event state is copied by every wait, reuse is safe
+	stageSlots.push_back( slot );
+	slotTails[slot] = stage;
+	return stage;
 }
 
-void CudaDevice::getMappedPointer(void **dev_ptr, size_t* size)
+void CudaDevice::endStages()
 {
-	CUDA_CHECK( cudaGraphicsResourceGetMappedPointer( dev_ptr, size, cuda_vbo_resource ) );
+	for ( size_t slot = 1; slot < slotTails.size(); slot++ )					// The last stage of a stream covers all before it
+		if ( slotTails[slot] >= 0 )
+			CUDA_CHECK( cudaStreamWaitEvent( stageOrigin, stageEvents[slotTails[slot]], 0 ) );
+	stageSlots.clear();
+	slotTails.clear();
 }
 
 int CudaDevice::getNumProcessors()
@@ -69,6 +224,123 @@ cudaDeviceProp CudaDevice::getProperties()
 	return properties;
 }
 
+bool CudaDevice::supportsL2Persistence() const
+{
+	return properties.major >= 8 && properties.persistingL2CacheMaxSize > 0;
+}
+
+int CudaDevice::getDeviceCount()
+{
+	int count = 0;
+	if ( cudaGetDeviceCount( &count ) != cudaSuccess )
+	{
+		cudaGetLastError();														// No driver: no devices, not fatal here
+		return 0;
+	}
+	return count;
+}
+
+/*!
+ * @brief Set an environment variable of the process, if it isn't set yet.
+ * @param name name.
+ * @param value value.
+ */
+static void setDefaultEnvironment( const char* name, const std::string& value )
+{
+	if ( std::getenv( name ) != NULL )
+		return;																	// Set by the user
+#ifdef _WIN32
+	_putenv_s( name, value.c_str() );
+#else
+	setenv( name, value.c_str(), 0 );
+#endif
+}
+
+void CudaDevice::configureComputeCache( const std::string& path )
+{
+	if ( std::getenv( "CUDA_CACHE_DISABLE" ) != NULL && std::string( std::getenv( "CUDA_CACHE_DISABLE" ) ) == "1" )
+		std::cerr << "CUDA_CACHE_DISABLE is set, PTX is JIT compiled on every start" << std::endl;
+	if ( !path.empty() )
+		setDefaultEnvironment( "CUDA_CACHE_PATH", path );
+	setDefaultEnvironment( "CUDA_CACHE_MAXSIZE", "1073741824" );				// 1 GiB, older drivers keep only 256 MiB
+}
+
+std::vector<int> CudaDevice::getGLDevices()
+{
+	if ( glDeviceQuery == NULL )												// Library without window
+		return std::vector<int>();
+	return glDeviceQuery();
+}
+
+std::vector<int> CudaDevice::rankDevices( int preferred )
+{
+	int count = getDeviceCount();
+	std::vector<cudaDeviceProp> properties( count );
+	for ( int i = 0; i < count; i++ )
+		CUDA_CHECK( cudaGetDeviceProperties( &properties[i], i ) );
+
+	std::vector<int> glDevices = getGLDevices();
+	auto drivesGL = [&glDevices]( int device ) { return std::find( glDevices.begin(), glDevices.end(), device ) != glDevices.end(); };
+
+	std::vector<int> devices;
+	for ( int i = 0; i < count; i++ )
+		if ( properties[i].computeMode != cudaComputeModeProhibited )			// No contexts allowed on this GPU
+			devices.push_back( i );
+
+	std::stable_sort( devices.begin(), devices.end(), [&]( int a, int b )
+	{
+		if ( ( a == preferred ) != ( b == preferred ) )
+			return a == preferred;
+		if ( drivesGL( a ) != drivesGL( b ) )
+			return drivesGL( a );
+		if ( properties[a].multiProcessorCount != properties[b].multiProcessorCount )
+			return properties[a].multiProcessorCount > properties[b].multiProcessorCount;
+		return properties[a].totalGlobalMem > properties[b].totalGlobalMem;
+	} );
+	return devices;
+}
+
+int CudaDevice::selectDevice( int preferred )
+{
+	int count = getDeviceCount();
+	if ( preferred >= count )
+	{
+		std::cerr << "There is no GPU " << preferred << ", only " << count << " GPUs found" << std::endl;
+		preferred = -1;
+	}
+
+	std::vector<int> devices = rankDevices( preferred );
+	return devices.empty() ? 0 : devices[0];
+}
+
+int CudaDevice::selectComputeDevice( int preferred )
+{
+	if ( preferred >= 0 && preferred < getDeviceCount() )
+		return preferred;
+
+	std::vector<int> glDevices = getGLDevices();
+	for ( int device : rankDevices() )
+	{
+		if ( std::find( glDevices.begin(), glDevices.end(), device ) == glDevices.end() )
+			return device;
+	}
+	return selectDevice( preferred );
+}
+
+void CudaDevice::printDevices( ostream& os, int selected )
+{
+	int count = getDeviceCount();
+	std::vector<int> glDevices = getGLDevices();
+	for ( int i = 0; i < count; i++ )
+	{
+		cudaDeviceProp properties;
+		CUDA_CHECK( cudaGetDeviceProperties( &properties, i ) );
+		os << ( i == selected ? "* " : "  " ) << "GPU " << i << ": " << properties.name
+		   << ", " << properties.multiProcessorCount << " SMs, " << ( properties.totalGlobalMem >> 20 ) << " MB"
+		   << ( std::find( glDevices.begin(), glDevices.end(), i ) != glDevices.end() ? ", OpenGL" : "" ) << "\n";
+	}
+}
+
 CudaDevice& CudaDevice::operator=(const CudaDevice& cdv)
 {
 	properties = cdv.properties;
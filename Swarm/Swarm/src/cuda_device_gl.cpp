@@ -0,0 +1,43 @@
+#include <algorithm>
+
+#include <glew.h>
+#include <glfw3.h>
+
+#include "cuda_gl_interop.h"
+
+#include "cuda_device.h"
+#include "vertex_buffer.h"
+
+/*!
+ * @brief Get the indices of the GPUs which drive the current OpenGL context.
+ * @return device indices. Empty if no context is current or its GPU is no CUDA device.
+ */
+static std::vector<int> queryGLDevices()
+{
+	std::vector<int> devices;
+	if ( glfwGetCurrentContext() == NULL )										// cudaGLGetDevices needs a current context
+		return devices;
+
+	unsigned int count = 0;
+	int found[8];
+	if ( cudaGLGetDevices( &count, found, 8, cudaGLDeviceListAll ) != cudaSuccess )
+	{
+		cudaGetLastError();														// e.g. the context runs on a GPU of another vendor
+		return devices;
+	}
+	devices.assign( found, found + std::min( count, 8u ) );
+	return devices;
+}
+
+void CudaDevice::enableGLDevices()
+{
+	glDeviceQuery = &queryGLDevices;
+}
+
+int CudaDevice::registerGLBuffer( const VertexBuffer& vb, unsigned int flags )
+{
+	cudaGraphicsResource* resource = NULL;
+	CUDA_CHECK( cudaGraphicsGLRegisterBuffer( &resource, vb.getBufferID(), flags ) );
+	cuda_vbo_resources.push_back( resource );
+	return static_cast< int >( cuda_vbo_resources.size() ) - 1;
+}
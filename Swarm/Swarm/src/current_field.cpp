@@ -0,0 +1,80 @@
+#include "current_field.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+bool readCurrent( const std::string& path, CurrentVolume& volume )
+{
+	std::ifstream file( path, std::ios::binary );
+	if ( !file )
+	{
+		std::cerr << "Impossible to open " << path << "!" << std::endl;
+		return false;
+	}
+
+	CurrentHeader header;
+	bool valid = file.read( reinterpret_cast< char* >( &header ), sizeof( CurrentHeader ) )
+		&& std::memcmp( header.magic, CURRENT_MAGIC, sizeof( CURRENT_MAGIC ) ) == 0
+		&& header.version == CURRENT_FILE_VERSION
+		&& header.width > 1 && header.height > 1 && header.depth > 1 && header.slices > 0
+		&& header.cellSize > 0.0f;
+	if ( valid )
+	{
+		volume.texels.resize( static_cast< size_t >( header.width ) * header.height * header.depth * header.slices * 3 );
+		valid = static_cast< bool >( file.read( reinterpret_cast< char* >( volume.texels.data() ), volume.texels.size() * sizeof( float ) ) );
+	}
+	if ( !valid )
+	{
+		std::cerr << path << " is no current of this version!" << std::endl;
+		volume = CurrentVolume();
+		return false;
+	}
+
+	volume.origin = Vector3( header.origin[0], header.origin[1], header.origin[2] );
+	volume.cellSize = header.cellSize;
+	volume.width = header.width;
+	volume.height = header.height;
+	volume.depth = header.depth;
+	volume.slices = header.slices;
+	return true;
+}
+
+CurrentVolume curlNoiseCurrent( const Vector3& spawnMin, const Vector3& spawnMax, const std::vector<Vector3>& waypoints, unsigned int resolution )
+{
+	float lower[3] = { spawnMin.x, spawnMin.y, spawnMin.z };
+	float upper[3] = { spawnMax.x, spawnMax.y, spawnMax.z };
+	for ( const Vector3& waypoint : waypoints )
+	{
+		lower[0] = std::min( lower[0], waypoint.x ); upper[0] = std::max( upper[0], waypoint.x );
+		lower[1] = std::min( lower[1], waypoint.y ); upper[1] = std::max( upper[1], waypoint.y );
+		lower[2] = std::min( lower[2], waypoint.z ); upper[2] = std::max( upper[2], waypoint.z );
+	}
+
+	float extent = 0.0f;
+	for ( int axis = 0; axis < 3; axis++ )
+		extent = std::max( extent, upper[axis] - lower[axis] );
+
+	CurrentVolume volume;
+	resolution = std::max( resolution, 2u );
+	if ( extent <= 0.0f )
+		return volume;
+	volume.cellSize = extent / ( resolution - 1 );
+	volume.origin = Vector3( lower[0], lower[1], lower[2] );
+	volume.width = std::max( static_cast< unsigned int >( std::ceil( ( upper[0] - lower[0] ) / volume.cellSize ) ) + 1, 2u );
+	volume.height = std::max( static_cast< unsigned int >( std::ceil( ( upper[1] - lower[1] ) / volume.cellSize ) ) + 1, 2u );
+	volume.depth = std::max( static_cast< unsigned int >( std::ceil( ( upper[2] - lower[2] ) / volume.cellSize ) ) + 1, 2u );
+	return volume;
+}
+
+CurrentVolume loadCurrent( const SwarmConfig& config )
+{
+	CurrentVolume volume;
+	if ( config.current == "curl" )
+		volume = curlNoiseCurrent( config.spawnMin, config.spawnMax, config.waypoints, config.currentResolution );
+	else if ( !config.current.empty() )
+		readCurrent( config.current, volume );
+	return volume;
+}
@@ -0,0 +1,163 @@
+#include <chrono>
+#include <iostream>
+
+#include "ensemble_simulation.h"
+#include "host_simulation.h"
+#include "kernel.h"
+#include "launch_check.h"
+#include "memory_tracker.h"
+#include "nvtx_range.h"
+
+EnsembleSimulation::EnsembleSimulation( const SwarmConfig& config ) :
+	h_stats_( config.ensemble > 0 ? config.ensemble : 1 ),
+	sweeps_( config.ensembleSweeps ),
+	members_( config.ensemble > 0 ? config.ensemble : 1 ),
+	dt_( 1.0 / config.simulationRate )
+{
+	speed = static_cast< float >( config.swarmSpeed * dt_ );					// Same distance per simulated second for every rate
+	numParticles_ = members_ * config.numParticles;
+	numSharks_ = members_ * config.numSharks;
+	ensemble_ = uniformEnsemble( config.params, sweeps_, members_, config.numParticles, config.numSharks );
+
+	waypointList = new WaypointList( config.waypoints );						// Initialize Waypoint path.
+	swarmCenter = waypointList->get();											// Get first swarm center for particles.
+
+	device_ = CudaDevice( CudaDevice::selectDevice( config.device ) );			// Create CUDA Device. The configured one, else the OpenGL GPU or the biggest one.
+	CudaDevice::printDevices( std::cout, device_.getDevice() );
+	std::cout << device_ << std::endl;											// Print out some information about the used GPU
+	stream_ = device_.getStream( device_.createStream() );						// Stream for the simulation
+
+	for ( int i = 0; i < 2; i++ )
+		particles_[i] = new ParticleStore( numParticles_ );						// All members in one store
+	d_sharks.setCategory( MemoryCategory::PARTICLES );
+	d_shark_state.setCategory( MemoryCategory::PARTICLES );
+	d_sharks.resize( numSharks_ * 4 );											// Allocate Memory on GPU for shark positions
+	d_shark_state.resize( numSharks_ * 4 );										// Allocate Memory on GPU for shark forces and masses
+
+	std::vector<float> h_shark_data;
+	std::vector<float> h_shark_state;
+	spawnSharks( config.numSharks, h_shark_data, h_shark_state, config.spawnMin, config.spawnMax );	// Sharks of one member
+	std::vector<float> h_all_data, h_all_state;
+	for ( unsigned int m = 0; m < members_; m++ )								// Every member starts with the same sharks
+	{
+		h_all_data.insert( h_all_data.end(), h_shark_data.begin(), h_shark_data.end() );
+		h_all_state.insert( h_all_state.end(), h_shark_state.begin(), h_shark_state.end() );
+	}
+	d_sharks.set( h_all_data.data(), numSharks_ * 4 );
+	d_shark_state.set( h_all_state.data(), numSharks_ * 4 );
+
+	kernel_set_params( config.params );											// Parameters of the obstacles, the members bring their own
+	kernel_set_seed( config.seed );												// GPU random numbers
+	kernel_set_spawn_box( config.spawnMin, config.spawnMax );					// Box of the spawned fishies
+	kernel_set_obstacles( bakeObstacles( config.obstacles, config.spawnMin, config.spawnMax, config.waypoints, config.obstacleRange,
+		config.obstacleResolution ), config.obstacleRange );					// Distance field of the obstacles
+	kernel_set_attractors( placeAttractors( config.attractors, config.spawnMin, config.spawnMax, config.waypoints,
+		config.attractorResolution ) );											// Field of the food patches and lures
+	kernel_set_alarm( placeAlarm( config.alarm, config.alarmDecay, config.spawnMin, config.spawnMax, config.waypoints,
+		config.params.centerThreshold, config.alarmResolution ) );				// Alarm waves of the evading fishies
+	kernel_set_current( loadCurrent( config ), config.currentStrength / config.simulationRate, config.currentPeriod );	// Current of the water
+	kernel_init_grid( numParticles_, device_.getProperties() );					// Launch configuration for all fishies of the ensemble
+	kernel_set_ensemble( ensemble_ );											// Offsets and parameter table of the members
+	for ( int i = 0; i < 2; i++ )												// Positions, speeds and masses in place, no host memory
+		kernel_spawn( particles_[i]->getArrays(), numParticles_, NULL, stream_ );
+	events_ = new EventLog( config, stream_ );
+	std::cout << memoryReport();												// Device budget after all buffers of the run exist
+}
+
+void EnsembleSimulation::moveSwarmCenter()
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "EnsembleSimulation::moveSwarmCenter", NVTX_COLOR_SIMULATION );
+
+	Vector3 diff = waypointList->get() - swarmCenter;							// Get Next Swarm center
+	if (diff.length() < WAYPOINT_THRESHOLD)										// Check if center was reached
+	{
+		diff = waypointList->getNext() - swarmCenter;
+	}
+
+	diff = diff.normalized() * speed;
+	swarmCenter += diff;
+}
+
+void EnsembleSimulation::step()
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "EnsembleSimulation::step", NVTX_COLOR_SIMULATION );
+
+	moveSwarmCenter();															// Set new Swarm center
+
+	unsigned int next = 1 - current_;											// Write into the other store
+	kernel_advance_ensemble(													// All members in one launch
+		particles_[current_]->getArrays(),
+		particles_[next]->getArrays(),
+		speed,
+		swarmCenter,
+		reinterpret_cast<float4*>( d_sharks.getData() ),
+		stream_);
+	current_ = next;															// Swap stores
+
+	kernel_move_sharks(															// The sharks of all members follow the swarm center
+		reinterpret_cast<float4*>( d_sharks.getData() ),
+		reinterpret_cast<float4*>( d_shark_state.getData() ),
+		numSharks_,
+		speed,
+		stream_);
+
+	if ( ++stepCount_ % EVENT_INTERVAL == 0 )
+		events_->drain();														// Events of the last interval
+	CUDA_CHECK_FRAME( stream_ );												// Errors of finished steps, without waiting
+}
+
+void EnsembleSimulation::run( unsigned int steps )
+{
+	CUDA_CHECK( cudaDeviceSynchronize() );
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for ( unsigned int i = 0; i < steps; i++ )
+		step();
+
+	CUDA_CHECK( cudaDeviceSynchronize() );										// Wait for the last step
+	auto end = std::chrono::high_resolution_clock::now();
+
+	for ( unsigned int m = 0; m < members_; m++ )								// Aggregates of the last step per member
+	{
+		kernel_reduce_stats( offsetParticles( particles_[current_]->getArrays(), ensemble_.offsets[m] ), ensemble_.counts[m], stream_ );
+		kernel_read_stats( h_stats_.getData() + m, stream_ );
+	}
+	CUDA_CHECK( cudaStreamSynchronize( stream_ ) );
+
+	double seconds = std::chrono::duration<double>( end - start ).count();
+	std::cout << "Steps:                            " << steps << "\n";
+	std::cout << "Time:                             " << seconds << " s\n";
+	std::cout << "Ensemble members:                 " << members_ << " of " << numParticles_ / members_ << " fishies\n";
+	std::cout << "Steps per second:                 " << steps / seconds << "\n";
+	std::cout << "Particle updates per second:      " << static_cast< double >( numParticles_ ) * steps / seconds << "\n";
+
+	std::cout << "member";														// CSV, one line per member
+	for ( const ParamSweep& sweep : sweeps_ )
+		std::cout << "," << sweep.name;
+	std::cout << ",live,centroid_x,centroid_y,centroid_z,mean_speed\n";
+	for ( unsigned int m = 0; m < members_; m++ )
+	{
+		const SwarmStats& stats = h_stats_[m];
+		std::cout << m;
+		for ( const ParamSweep& sweep : sweeps_ )
+			std::cout << "," << ensemble_.params[m].*sweep.field;
+		std::cout << "," << stats.liveCount << "," << stats.centroid.x << "," << stats.centroid.y << "," << stats.centroid.z
+				  << "," << stats.meanSpeed / dt_ << "\n";
+	}
+	std::cout << std::flush;
+	CUDA_CHECK_FRAME( stream_ );
+	if ( launchErrorCount() > 0 )
+		std::cerr << launchErrorCount() << " CUDA errors, the results are invalid" << std::endl;
+}
+
+void EnsembleSimulation::cleanUp()
+{
+	delete events_;																// Writes the last events
+	device_.destroyStreams();													// Wait for the last step
+	for ( int i = 0; i < 2; i++ )
+		delete particles_[i];													// Free GPU Memory
+	d_sharks = CudaDeviceArray<float>();										// Free GPU Memory
+	d_shark_state = CudaDeviceArray<float>();									// Free GPU Memory
+	delete waypointList;
+	kernel_cleanup();															// Free uniform grid and ensemble tables
+}
@@ -0,0 +1,75 @@
+#include <iostream>
+
+#include "event_log.h"
+#include "kernel.h"
+#include "nvtx_range.h"
+
+static const char* EVENT_NAMES[3] = { "death", "spawn", "near_miss" };	// CSV names of the SwarmEventTypes
+
+EventLog::EventLog( const SwarmConfig& config, cudaStream_t stream ) :
+	path_( config.events ),
+	stream_( stream )
+{
+	if ( path_.empty() )
+		return;
+
+	file_.open( path_, std::ios::out | std::ios::trunc );
+	if ( !file_ )
+	{
+		std::cerr << "Impossible to open " << path_ << "!" << std::endl;
+		path_.clear();
+		return;
+	}
+	file_ << "step,type,fish,shark,x,y,z,distance\n";
+	events_.reserve( config.eventCapacity );
+	kernel_init_events( config.eventCapacity );
+}
+
+EventLog::~EventLog()
+{
+	finish();
+}
+
+void EventLog::drain()
+{
+	if ( path_.empty() )
+		return;
+
+	NVTX_RANGE( NvtxDomain::RENDERER, "EventLog::drain", NVTX_COLOR_SYNC );
+
+	dropped_ += kernel_drain_events( events_, stream_ );
+	write();
+}
+
+void EventLog::write()
+{
+	for ( const SwarmEvent& event : events_ )
+	{
+		file_ << event.step << "," << EVENT_NAMES[event.type] << "," << event.fish << ",";
+		if ( event.shark != 0xffffffff )
+			file_ << event.shark;
+		file_ << "," << event.x << "," << event.y << "," << event.z << "," << event.distance << "\n";
+		counts_[event.type]++;
+	}
+	events_.clear();
+}
+
+void EventLog::finish()
+{
+	if ( path_.empty() )
+		return;
+
+	drain();																	// Buffer of the last frame
+	drain();																	// Steps after the last frame
+	kernel_init_events( 0 );
+	file_.close();
+	if ( !file_ )
+		std::cerr << "Impossible to write " << path_ << "!" << std::endl;
+
+	std::cout << "Events:                           " << counts_[0] << " deaths, " << counts_[1] << " spawns, " << counts_[2]
+			  << " near misses in " << path_;
+	if ( dropped_ > 0 )
+		std::cout << ", " << dropped_ << " events dropped (raise --event_capacity)";
+	std::cout << std::endl;
+	path_.clear();
+}
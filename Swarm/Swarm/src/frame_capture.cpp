@@ -0,0 +1,141 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "frame_capture.h"
+#include "nvtx_range.h"
+
+/*!
+ * @brief Write an uncompressed 24 bit TGA image. TGA stores the bottom row first and BGR, like the read back, so nothing is converted.
+ * @param path file.
+ * @param width width in pixels.
+ * @param height height in pixels.
+ * @param pixels BGR rows, bottom row first, without padding.
+ * @return true, if the file could be written.
+ */
+static bool writeTga( const std::string& path, unsigned int width, unsigned int height, const std::vector<unsigned char>& pixels )
+{
+	std::FILE* file = std::fopen( path.c_str(), "wb" );
+	if ( file == NULL )
+		return false;
+
+	unsigned char header[18] = {};
+	header[2] = 2;																// Uncompressed true color
+	header[12] = static_cast< unsigned char >( width & 0xFF );
+	header[13] = static_cast< unsigned char >( width >> 8 );
+	header[14] = static_cast< unsigned char >( height & 0xFF );
+	header[15] = static_cast< unsigned char >( height >> 8 );
+	header[16] = 24;															// Bits per pixel, origin at the bottom left
+	bool written = std::fwrite( header, sizeof( header ), 1, file ) == 1
+		&& std::fwrite( pixels.data(), 1, pixels.size(), file ) == pixels.size();
+	return std::fclose( file ) == 0 && written;
+}
+
+FrameCapture::FrameCapture( const SwarmConfig& config, JobSystem& jobs ) :
+	jobs_( jobs ),
+	prefix_( config.capture.empty() ? "screenshot" : config.capture ),
+	every_( config.capture.empty() ? 0 : config.captureEvery )
+{
+	for ( Slot& slot : slots_ )
+		glGenBuffers( 1, &slot.pbo );
+}
+
+FrameCapture::~FrameCapture()
+{
+	collect( true );
+	jobs_.wait( lastWrite_ );
+	for ( Slot& slot : slots_ )
+		glDeleteBuffers( 1, &slot.pbo );
+	if ( captured_ > 0 || dropped_ > 0 )
+		std::cout << "Captured " << captured_ << " frames as " << prefix_ << "_<frame>.tga, dropped " << dropped_ << std::endl;
+}
+
+void FrameCapture::read( const std::string& path )
+{
+	Slot* target = NULL;
+	for ( Slot& slot : slots_ )
+	{
+		if ( slot.fence == 0 )
+		{
+			target = &slot;
+			break;
+		}
+	}
+	if ( target == NULL )															// The GPU is behind, waiting would change the frame time
+	{
+		dropped_++;
+		return;
+	}
+
+	GLint viewport[4];
+	glGetIntegerv( GL_VIEWPORT, viewport );
+	target->width = viewport[2];
+	target->height = viewport[3];
+	target->path = path;
+	size_t bytes = static_cast< size_t >( target->width ) * target->height * 3;
+
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, target->pbo );
+	if ( bytes > target->capacity )												// New size after a resize, else the buffer is reused
+	{
+		glBufferData( GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ );
+		target->capacity = bytes;
+	}
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );										// Rows without padding, like the file
+	glReadBuffer( GL_BACK );
+	glReadPixels( viewport[0], viewport[1], target->width, target->height, GL_BGR, GL_UNSIGNED_BYTE, reinterpret_cast< void* >( 0 ) );	// Into the buffer, returns at once
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+	glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+	target->fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	captured_++;
+}
+
+void FrameCapture::collect( bool wait )
+{
+	for ( Slot& slot : slots_ )
+	{
+		if ( slot.fence == 0 )
+			continue;
+		GLenum status = glClientWaitSync( slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000ull : 0 );
+		if ( status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED )
+			continue;
+		glDeleteSync( slot.fence );
+		slot.fence = 0;
+
+		NVTX_RANGE( NvtxDomain::RENDERER, "FrameCapture::collect", NVTX_COLOR_INTEROP );
+		size_t bytes = static_cast< size_t >( slot.width ) * slot.height * 3;
+		std::shared_ptr<std::vector<unsigned char>> pixels = std::make_shared<std::vector<unsigned char>>( bytes );
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, slot.pbo );
+		const void* mapped = glMapBufferRange( GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT );	// Done, the map doesn't wait
+		if ( mapped != NULL )
+		{
+			std::memcpy( pixels->data(), mapped, bytes );
+			glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+		}
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+		if ( mapped == NULL )
+			continue;
+
+		std::string path = slot.path;
+		unsigned int width = slot.width, height = slot.height;
+		lastWrite_ = jobs_.submit( [path, width, height, pixels]()
+		{
+			if ( !writeTga( path, width, height, *pixels ) )
+				std::cerr << "Can't write capture " << path << std::endl;
+		}, { lastWrite_ } );
+	}
+}
+
+void FrameCapture::endFrame( bool requested )
+{
+	collect( false );
+
+	frame_++;
+	if ( !requested && ( every_ == 0 || frame_ % every_ != 0 ) )
+		return;
+
+	char name[32];
+	std::snprintf( name, sizeof( name ), "_%06llu.tga", frame_ );
+	read( prefix_ + name );
+}
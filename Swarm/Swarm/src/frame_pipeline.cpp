@@ -0,0 +1,98 @@
+#include <stdexcept>
+
+#include "frame_pipeline.h"
+#include "nvtx_range.h"
+
+FramePipeline::FramePipeline( unsigned int depth ) :
+	depth_( depth > 1 ? 1 : depth )												// One frame ahead is enough to overlap both APIs
+{
+}
+
+FramePipeline::~FramePipeline()
+{
+	if ( drawn_ != NULL )
+		glDeleteSync( drawn_ );
+	if ( packed_ != NULL )
+		CUDA_CHECK( cudaEventDestroy( packed_ ) );
+	for ( Back& back : backs_ )
+		delete back.buffer;
+}
+
+void FramePipeline::attach( CudaDevice& device, cudaStream_t stream )
+{
+	if ( !isEnabled() )
+		return;
+
+	device_ = &device;
+	device_->mapResources( stream );											// Once, only for the sizes
+	backs_.resize( device_->getResourceCount() );
+	for ( size_t resource = 0; resource < backs_.size(); resource++ )
+	{
+		void* pointer;
+		device_->getMappedPointer( &pointer, &backs_[resource].bytes, static_cast< int >( resource ) );
+	}
+	device_->unmapResources( stream );
+	CUDA_CHECK( cudaEventCreateWithFlags( &packed_, cudaEventDisableTiming ) );
+}
+
+void* FramePipeline::stage( int resource )
+{
+	if ( resource < 0 || static_cast< size_t >( resource ) >= backs_.size() )
+		throw std::runtime_error( "FramePipeline::stage: resource is not registered" );
+
+	Back& back = backs_[resource];
+	if ( back.buffer == NULL )
+		back.buffer = new CudaDeviceArray<unsigned char>( back.bytes, MemoryCategory::RENDER );
+	back.written = true;
+	return back.buffer->getData();
+}
+
+void FramePipeline::finish( cudaStream_t stream )
+{
+	CUDA_CHECK( cudaEventRecord( packed_, stream ) );
+	pending_ = true;
+}
+
+void FramePipeline::fence()
+{
+	if ( !isEnabled() )
+		return;
+
+	if ( drawn_ != NULL )
+		glDeleteSync( drawn_ );
+	drawn_ = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+}
+
+void FramePipeline::present( cudaStream_t stream )
+{
+	if ( !pending_ )
+		return;
+
+	NVTX_RANGE( NvtxDomain::RENDERER, "FramePipeline::present", NVTX_COLOR_SYNC );
+
+	CUDA_CHECK( cudaEventSynchronize( packed_ ) );								// Normally done, the packs had a whole frame
+	if ( drawn_ != NULL )
+	{
+		glClientWaitSync( drawn_, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64( 1000000000 ) );	// The map doesn't wait for OpenGL then
+		glDeleteSync( drawn_ );
+		drawn_ = NULL;
+	}
+
+	std::vector<int> resources;
+	for ( size_t resource = 0; resource < backs_.size(); resource++ )
+	{
+		if ( backs_[resource].written )
+			resources.push_back( static_cast< int >( resource ) );
+	}
+	device_->mapResources( resources, stream );
+	for ( int resource : resources )
+	{
+		void* front;
+		size_t bytes;
+		device_->getMappedPointer( &front, &bytes, resource );
+		CUDA_CHECK( cudaMemcpyAsync( front, backs_[resource].buffer->getData(), bytes, cudaMemcpyDeviceToDevice, stream ) );
+		backs_[resource].written = false;
+	}
+	device_->unmapResources( stream );											// The draws of this frame wait for the copies only
+	pending_ = false;
+}
@@ -0,0 +1,349 @@
+#include "frame_profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+// Names of the stages, same order as FrameStage.
+static const char* const STAGE_NAMES[] = { "map", "advance", "pack", "cull", "unmap", "draw", "swap" };
+
+// Kinds of timers in FrameTimers::used.
+static const unsigned char TIMER_NONE = 0;
+static const unsigned char TIMER_CUDA = 1;
+static const unsigned char TIMER_GL = 2;
+static const unsigned char TIMER_HOST = 3;
+
+const char* frameStageName( FrameStage stage )
+{
+	return STAGE_NAMES[static_cast< unsigned int >( stage )];
+}
+
+/*!
+ * @brief Get the time of a steady clock.
+ * @return time in seconds.
+ */
+static double hostTime()
+{
+	return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+StageTimes::StageTimes( size_t window ) :
+	samples_( window > 0 ? window : 1, 0.0f )
+{
+}
+
+void StageTimes::add( float ms )
+{
+	samples_[next_] = ms;
+	next_ = ( next_ + 1 ) % samples_.size();
+	count_ = std::min( count_ + 1, samples_.size() );
+}
+
+float StageTimes::mean() const
+{
+	if ( count_ == 0 )
+		return 0.0f;
+
+	double sum = 0.0;
+	for ( size_t i = 0; i < count_; i++ )
+		sum += samples_[i];
+	return static_cast< float >( sum / count_ );
+}
+
+float StageTimes::percentile( float p ) const
+{
+	if ( count_ == 0 )
+		return 0.0f;
+
+	std::vector<float> sorted( samples_.begin(), samples_.begin() + count_ );
+	size_t rank = static_cast< size_t >( p / 100.0f * ( count_ - 1 ) + 0.5f );
+	rank = std::min( rank, count_ - 1 );
+	std::nth_element( sorted.begin(), sorted.begin() + rank, sorted.end() );
+	return sorted[rank];
+}
+
+float StageTimes::at( size_t i ) const
+{
+	size_t oldest = count_ < samples_.size() ? 0 : next_;
+	return samples_[( oldest + i ) % samples_.size()];
+}
+
+FrameProfiler::FrameProfiler( bool enabled, double reportInterval, bool cudaTimers, TraceExporter* trace ) :
+	enabled_( enabled ),
+	cudaTimers_( cudaTimers ),
+	reportInterval_( reportInterval ),
+	trace_( enabled && trace != NULL && trace->isEnabled() ? trace : NULL )
+{
+	for ( FrameTimers& frame : frames_ )
+	{
+		for ( unsigned int s = 0; s < STAGES; s++ )
+		{
+			frame.start[s] = NULL;
+			frame.stop[s] = NULL;
+			frame.query[s] = 0;
+			frame.stamp[s] = 0;
+			frame.hostMs[s] = 0.0;
+			frame.used[s] = TIMER_NONE;
+		}
+		frame.tag = 0;
+
+		if ( !enabled_ )
+			continue;
+
+		for ( unsigned int s = 0; s < STAGES && cudaTimers_; s++ )
+		{
+			CUDA_CHECK( cudaEventCreate( &frame.start[s] ) );
+			CUDA_CHECK( cudaEventCreate( &frame.stop[s] ) );
+		}
+		glGenQueries( STAGES, frame.query );
+		if ( trace_ != NULL )
+			glGenQueries( STAGES, frame.stamp );
+	}
+	for ( unsigned int s = 0; s < STAGES; s++ )
+		collectedMs_[s] = -1.0f;
+	lastReport_ = hostTime();
+
+	if ( trace_ == NULL )
+		return;
+	if ( cudaTimers_ )
+	{
+		CUDA_CHECK( cudaEventCreate( &epoch_ ) );
+		CUDA_CHECK( cudaEventCreate( &nextEpoch_ ) );
+		CUDA_CHECK( cudaEventRecord( epoch_, 0 ) );
+		CUDA_CHECK( cudaEventSynchronize( epoch_ ) );							// Once at the start: the GPU is idle, the event completes now
+		epochHost_ = TraceExporter::now();
+		lastRebase_ = epochHost_;
+	}
+	glGetInteger64v( GL_TIMESTAMP, &epochGl_ );									// GPU time now, without waiting
+	epochGlHost_ = TraceExporter::now();
+}
+
+FrameProfiler::~FrameProfiler()
+{
+	if ( !enabled_ )
+		return;
+
+	for ( FrameTimers& frame : frames_ )
+	{
+		for ( unsigned int s = 0; s < STAGES && cudaTimers_; s++ )
+		{
+			CUDA_CHECK( cudaEventDestroy( frame.start[s] ) );
+			CUDA_CHECK( cudaEventDestroy( frame.stop[s] ) );
+		}
+		glDeleteQueries( STAGES, frame.query );
+		if ( trace_ != NULL )
+			glDeleteQueries( STAGES, frame.stamp );
+	}
+	if ( epoch_ != NULL )
+	{
+		CUDA_CHECK( cudaEventDestroy( epoch_ ) );
+		CUDA_CHECK( cudaEventDestroy( nextEpoch_ ) );
+	}
+}
+
+void FrameProfiler::rebase()
+{
+	if ( rebasing_ )
+	{
+		if ( cudaEventQuery( nextEpoch_ ) != cudaSuccess )
+			return;
+		float ms = 0.0f;
+		CUDA_CHECK( cudaEventElapsedTime( &ms, epoch_, nextEpoch_ ) );			// A few seconds, exact in float
+		epochHost_ += ms * 1e-3;
+		std::swap( epoch_, nextEpoch_ );
+		rebasing_ = false;
+		return;
+	}
+
+	double now = TraceExporter::now();
+	if ( now - lastRebase_ < 5.0 )
+		return;
+	CUDA_CHECK( cudaEventRecord( nextEpoch_, 0 ) );
+	rebasing_ = true;
+	lastRebase_ = now;
+}
+
+void FrameProfiler::collect( FrameTimers& frame )
+{
+	collectedTag_ = frame.tag;
+	frame.tag = 0;
+	for ( unsigned int s = 0; s < STAGES; s++ )
+	{
+		collectedMs_[s] = -1.0f;
+		if ( frame.used[s] == TIMER_CUDA && cudaEventQuery( frame.stop[s] ) == cudaSuccess )	// Not ready yet: drop the sample instead of waiting
+		{
+			float ms = 0.0f;
+			CUDA_CHECK( cudaEventElapsedTime( &ms, frame.start[s], frame.stop[s] ) );
+			times_[s].add( ms );
+			collectedMs_[s] = ms;
+			if ( trace_ != NULL )
+			{
+				float since = 0.0f;
+				CUDA_CHECK( cudaEventElapsedTime( &since, epoch_, frame.start[s] ) );	// Negative, if the epoch is newer
+				trace_->add( STAGE_NAMES[s], TraceTrack::CUDA, epochHost_ + since * 1e-3, ms );
+			}
+		}
+		else if ( frame.used[s] == TIMER_GL )
+		{
+			GLint available = 0;
+			glGetQueryObjectiv( frame.query[s], GL_QUERY_RESULT_AVAILABLE, &available );
+			if ( available )
+			{
+				GLuint64 ns = 0;
+				glGetQueryObjectui64v( frame.query[s], GL_QUERY_RESULT, &ns );
+				times_[s].add( static_cast< float >( ns * 1e-6 ) );
+				collectedMs_[s] = static_cast< float >( ns * 1e-6 );
+				if ( trace_ != NULL )
+				{
+					GLuint64 start = 0;
+					glGetQueryObjectui64v( frame.stamp[s], GL_QUERY_RESULT, &start );	// Before the elapsed query, so available too
+					trace_->add( STAGE_NAMES[s], TraceTrack::OPENGL, epochGlHost_ + ( static_cast< GLint64 >( start ) - epochGl_ ) * 1e-9, ns * 1e-6 );
+				}
+			}
+		}
+		else if ( frame.used[s] == TIMER_HOST )
+		{
+			times_[s].add( static_cast< float >( frame.hostMs[s] ) );
+			collectedMs_[s] = static_cast< float >( frame.hostMs[s] );
+		}
+
+		frame.used[s] = TIMER_NONE;
+		frame.hostMs[s] = 0.0;
+	}
+}
+
+void FrameProfiler::beginFrame()
+{
+	if ( !enabled_ )
+		return;
+
+	current_ = ( current_ + 1 ) % FRAMES_IN_FLIGHT;
+	collect( frames_[current_] );												// Oldest frame, its timers are reused now
+	if ( trace_ != NULL )
+	{
+		if ( epoch_ != NULL )
+			rebase();
+		trace_->submit();
+	}
+}
+
+void FrameProfiler::beginCuda( FrameStage stage, cudaStream_t stream )
+{
+	if ( !enabled_ || !cudaTimers_ )
+		return;
+
+	unsigned int s = static_cast< unsigned int >( stage );
+	CUDA_CHECK( cudaEventRecord( frames_[current_].start[s], stream ) );
+}
+
+void FrameProfiler::endCuda( FrameStage stage, cudaStream_t stream )
+{
+	if ( !enabled_ || !cudaTimers_ )
+		return;
+
+	unsigned int s = static_cast< unsigned int >( stage );
+	CUDA_CHECK( cudaEventRecord( frames_[current_].stop[s], stream ) );
+	frames_[current_].used[s] = TIMER_CUDA;
+}
+
+void FrameProfiler::beginGl( FrameStage stage )
+{
+	if ( !enabled_ )
+		return;
+
+	if ( trace_ != NULL )
+		glQueryCounter( frames_[current_].stamp[static_cast< unsigned int >( stage )], GL_TIMESTAMP );
+	glBeginQuery( GL_TIME_ELAPSED, frames_[current_].query[static_cast< unsigned int >( stage )] );
+}
+
+void FrameProfiler::endGl( FrameStage stage )
+{
+	if ( !enabled_ )
+		return;
+
+	glEndQuery( GL_TIME_ELAPSED );
+	frames_[current_].used[static_cast< unsigned int >( stage )] = TIMER_GL;
+}
+
+void FrameProfiler::addHost( FrameStage stage, double ms )
+{
+	if ( !enabled_ )
+		return;
+
+	unsigned int s = static_cast< unsigned int >( stage );
+	frames_[current_].hostMs[s] += ms;
+	frames_[current_].used[s] = TIMER_HOST;
+	if ( trace_ != NULL )
+		trace_->add( STAGE_NAMES[s], TraceTrack::MAIN, TraceExporter::now() - ms * 1e-3, ms );	// Ends now
+}
+
+void FrameProfiler::tagFrame( unsigned int tag )
+{
+	if ( enabled_ )
+		frames_[current_].tag = tag;
+}
+
+float FrameProfiler::getCollected( FrameStage stage, unsigned int& tag ) const
+{
+	tag = collectedTag_;
+	return collectedMs_[static_cast< unsigned int >( stage )];
+}
+
+std::string FrameProfiler::summary() const
+{
+	if ( !enabled_ )
+		return std::string();
+
+	std::string text;
+	char line[64];
+	for ( unsigned int s = 0; s < STAGES; s++ )
+	{
+		std::snprintf( line, sizeof( line ), "%s%s %.2f", s > 0 ? " | " : "", STAGE_NAMES[s], times_[s].mean() );
+		text += line;
+	}
+	return text + " ms";
+}
+
+std::string FrameProfiler::report() const
+{
+	std::string text = "Stage       mean ms    p50 ms    p95 ms    p99 ms  samples\n";
+	char line[128];
+	for ( unsigned int s = 0; s < STAGES; s++ )
+	{
+		const StageTimes& t = times_[s];
+		std::snprintf( line, sizeof( line ), "%-8s %9.3f %9.3f %9.3f %9.3f %8zu\n",
+			STAGE_NAMES[s], t.mean(), t.percentile( 50.0f ), t.percentile( 95.0f ), t.percentile( 99.0f ), t.count() );
+		text += line;
+	}
+	return text;
+}
+
+bool FrameProfiler::reportIfDue()
+{
+	if ( !consumeReportDue() )
+		return false;
+
+	std::cout << report() << std::endl;
+	return true;
+}
+
+bool FrameProfiler::consumeReportDue()
+{
+	double now = hostTime();
+	if ( !enabled_ || reportInterval_ <= 0.0 || now - lastReport_ < reportInterval_ )
+		return false;
+
+	lastReport_ = now;
+	return true;
+}
+
+ScopedHostTimer::ScopedHostTimer( FrameProfiler& profiler, FrameStage stage ) :
+	profiler_( profiler ), stage_( stage ), start_( hostTime() )
+{
+}
+
+ScopedHostTimer::~ScopedHostTimer()
+{
+	profiler_.addHost( stage_, ( hostTime() - start_ ) * 1000.0 );
+}
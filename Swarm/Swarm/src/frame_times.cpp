@@ -0,0 +1,156 @@
+#include "frame_times.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+// Names of the parts, same order as FramePart.
+static const char* const PART_NAMES[] = { "simulation", "render", "present" };
+
+/*!
+ * @brief Get the time of a steady clock.
+ * @return time in seconds.
+ */
+static double hostTime()
+{
+	return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+FrameTimeRecorder::FrameTimeRecorder( float budget, size_t window ) :
+	total_( window ),
+	budget_( budget )
+{
+	for ( unsigned int p = 0; p < PARTS; p++ )
+	{
+		parts_[p] = StageTimes( window );
+		current_[p] = 0.0;
+		partStart_[p] = 0.0;
+	}
+}
+
+void FrameTimeRecorder::beginFrame()
+{
+	double now = hostTime();
+	if ( frameStart_ >= 0.0 )
+	{
+		float ms = static_cast< float >( ( now - frameStart_ ) * 1000.0 );
+		total_.add( ms );
+		if ( trace_ != NULL )
+			trace_->add( "frame", TraceTrack::MAIN, frameStart_, ms );
+		for ( unsigned int p = 0; p < PARTS; p++ )
+			parts_[p].add( static_cast< float >( current_[p] ) );
+		if ( telemetry_ != NULL )
+			samples_[frames_ % samples_.size()] = telemetry_->getSample();		// Slot of the frame in the ring of total_
+
+		frames_++;
+		if ( ms > budget_ )
+			overBudget_++;
+		histogram_[std::min( static_cast< unsigned int >( ms ), HISTOGRAM_BINS - 1 )]++;
+	}
+
+	frameStart_ = now;
+	for ( unsigned int p = 0; p < PARTS; p++ )
+		current_[p] = 0.0;
+}
+
+void FrameTimeRecorder::setTelemetry( const GpuTelemetry* telemetry )
+{
+	telemetry_ = telemetry != NULL && telemetry->isEnabled() ? telemetry : NULL;
+	samples_.assign( telemetry_ != NULL ? total_.window() : 0, GpuSample() );	// Frames before are zero
+}
+
+void FrameTimeRecorder::add( FramePart part, double ms )
+{
+	current_[static_cast< unsigned int >( part )] += ms;
+	if ( trace_ != NULL )
+		trace_->add( PART_NAMES[static_cast< unsigned int >( part )], TraceTrack::MAIN, hostTime() - ms * 1e-3, ms );	// Parts are added as they end
+}
+
+void FrameTimeRecorder::beginPart( FramePart part )
+{
+	partStart_[static_cast< unsigned int >( part )] = hostTime();
+}
+
+void FrameTimeRecorder::endPart( FramePart part )
+{
+	add( part, ( hostTime() - partStart_[static_cast< unsigned int >( part )] ) * 1000.0 );
+}
+
+float FrameTimeRecorder::getLast( FramePart part ) const
+{
+	const StageTimes& times = parts_[static_cast< unsigned int >( part )];
+	return times.count() > 0 ? times.at( times.count() - 1 ) : 0.0f;
+}
+
+std::string FrameTimeRecorder::report() const
+{
+	char line[128];
+	std::snprintf( line, sizeof( line ), "Frames %llu, over budget (%.1f ms) %llu (%.2f %%)\n",
+		frames_, budget_, overBudget_, frames_ > 0 ? 100.0 * overBudget_ / frames_ : 0.0 );
+	std::string text = line;
+
+	text += "Part          p50 ms    p95 ms    p99 ms    max ms\n";
+	for ( unsigned int p = 0; p <= PARTS; p++ )
+	{
+		const StageTimes& t = p < PARTS ? parts_[p] : total_;				// Frame time last
+		std::snprintf( line, sizeof( line ), "%-10s %9.3f %9.3f %9.3f %9.3f\n", p < PARTS ? PART_NAMES[p] : "frame",
+			t.percentile( 50.0f ), t.percentile( 95.0f ), t.percentile( 99.0f ), t.percentile( 100.0f ) );
+		text += line;
+	}
+	return text;
+}
+
+bool FrameTimeRecorder::dump( const std::string& path ) const
+{
+	std::ofstream file( path );
+	if ( !file.is_open() )
+	{
+		std::cerr << "Impossible to open " << path << "!" << std::endl;
+		return false;
+	}
+
+	// Report as comment, so the file can be read as CSV.
+	std::string text = report();
+	size_t start = 0;
+	for ( size_t end = text.find( '\n' ); end != std::string::npos; start = end + 1, end = text.find( '\n', start ) )
+		file << "# " << text.substr( start, end - start ) << "\n";
+
+	file << "# Histogram: frames per 1 ms bin since the start, the last bin holds all slower frames\n";
+	file << "# ";
+	for ( unsigned int b = 0; b < HISTOGRAM_BINS; b++ )
+		file << ( b > 0 ? "," : "" ) << histogram_[b];
+	file << "\n";
+
+	file << "frame,total_ms";
+	for ( unsigned int p = 0; p < PARTS; p++ )
+		file << "," << PART_NAMES[p] << "_ms";
+	if ( telemetry_ != NULL )
+		file << GpuTelemetry::csvColumns();
+	file << "\n";
+
+	unsigned long long first = frames_ - total_.count();						// Frame of the oldest sample
+	for ( size_t i = 0; i < total_.count(); i++ )
+	{
+		file << i << "," << total_.at( i );
+		for ( unsigned int p = 0; p < PARTS; p++ )
+			file << "," << parts_[p].at( i );
+		if ( telemetry_ != NULL )
+			GpuTelemetry::writeCsv( file, samples_[( first + i ) % samples_.size()] );
+		file << "\n";
+	}
+
+	std::cout << "Frame times written to " << path << std::endl;
+	return true;
+}
+
+ScopedFramePart::ScopedFramePart( FrameTimeRecorder& recorder, FramePart part ) :
+	recorder_( recorder ), part_( part ), start_( hostTime() )
+{
+}
+
+ScopedFramePart::~ScopedFramePart()
+{
+	recorder_.add( part_, ( hostTime() - start_ ) * 1000.0 );
+}
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <iostream>
+
+#include "gpu_compressor.h"
+#include "kernel.h"
+#include "nvtx_range.h"
+
+#ifdef SWARM_NVCOMP
+#include <nvcomp/bitcomp.h>
+#include <nvcomp/cascaded.h>
+#include <nvcomp/lz4.h>
+
+/*!
+ * @brief Options of the nvCOMP codec and its temp buffer.
+ */
+struct GpuCompressor::Codec
+{
+	Compression compression;				//!< LZ4, CASCADED or BITCOMP.
+	nvcompBatchedLZ4Opts_t lz4 = nvcompBatchedLZ4DefaultOpts;
+	nvcompBatchedCascadedOpts_t cascaded = nvcompBatchedCascadedDefaultOpts;
+	nvcompBatchedBitcompFormatOpts bitcomp = nvcompBatchedBitcompDefaultOpts;
+	CudaDeviceArray<char> temp;				//!< Temp buffer of the compression and the decompression.
+	CudaDeviceArray<nvcompStatus_t> statuses;	//!< Status of every decompressed chunk.
+};
+
+/*!
+ * @brief Get the nvCOMP type of values with a size.
+ * @param elementSize bytes per value.
+ * @return type, char for unknown sizes.
+ */
+static nvcompType_t nvcompTypeOf( unsigned int elementSize )
+{
+	return elementSize == 2 ? NVCOMP_TYPE_USHORT : elementSize == 4 ? NVCOMP_TYPE_UINT : elementSize == 8 ? NVCOMP_TYPE_ULONGLONG : NVCOMP_TYPE_CHAR;
+}
+
+/*!
+ * @brief Print a failed nvCOMP call.
+ * @param status result.
+ * @param call name of the call.
+ * @return true, if the call worked.
+ */
+static bool nvcompCheck( nvcompStatus_t status, const char* call )
+{
+	if ( status != nvcompSuccess )
+		std::cerr << call << " failed: nvcomp status " << static_cast< int >( status ) << std::endl;
+	return status == nvcompSuccess;
+}
+#endif
+
+GpuCompressor::GpuCompressor( Compression compression, size_t maxBytes, unsigned int elementSize )
+{
+	if ( compression == Compression::OFF || maxBytes == 0 )
+		return;
+
+#ifdef SWARM_NVCOMP
+	Codec* codec = new Codec();
+	codec->compression = compression;
+	codec->lz4.data_type = nvcompTypeOf( elementSize );
+	codec->cascaded.type = nvcompTypeOf( elementSize );
+	codec->bitcomp.data_type = nvcompTypeOf( elementSize );
+
+	maxChunks_ = chunkCount( maxBytes );
+	size_t maxOutput = 0;
+	size_t compressTemp = 0;
+	size_t decompressTemp = 0;
+	bool ok;
+	switch ( compression )
+	{
+	case Compression::LZ4:
+		ok = nvcompCheck( nvcompBatchedLZ4CompressGetMaxOutputChunkSize( CHUNK_SIZE, codec->lz4, &maxOutput ), "nvcompBatchedLZ4CompressGetMaxOutputChunkSize" )
+			&& nvcompCheck( nvcompBatchedLZ4CompressGetTempSize( maxChunks_, CHUNK_SIZE, codec->lz4, &compressTemp ), "nvcompBatchedLZ4CompressGetTempSize" )
+			&& nvcompCheck( nvcompBatchedLZ4DecompressGetTempSize( maxChunks_, CHUNK_SIZE, &decompressTemp ), "nvcompBatchedLZ4DecompressGetTempSize" );
+		break;
+	case Compression::CASCADED:
+		ok = nvcompCheck( nvcompBatchedCascadedCompressGetMaxOutputChunkSize( CHUNK_SIZE, codec->cascaded, &maxOutput ), "nvcompBatchedCascadedCompressGetMaxOutputChunkSize" )
+			&& nvcompCheck( nvcompBatchedCascadedCompressGetTempSize( maxChunks_, CHUNK_SIZE, codec->cascaded, &compressTemp ), "nvcompBatchedCascadedCompressGetTempSize" )
+			&& nvcompCheck( nvcompBatchedCascadedDecompressGetTempSize( maxChunks_, CHUNK_SIZE, &decompressTemp ), "nvcompBatchedCascadedDecompressGetTempSize" );
+		break;
+	default:
+		ok = nvcompCheck( nvcompBatchedBitcompCompressGetMaxOutputChunkSize( CHUNK_SIZE, codec->bitcomp, &maxOutput ), "nvcompBatchedBitcompCompressGetMaxOutputChunkSize" )
+			&& nvcompCheck( nvcompBatchedBitcompCompressGetTempSize( maxChunks_, CHUNK_SIZE, codec->bitcomp, &compressTemp ), "nvcompBatchedBitcompCompressGetTempSize" )
+			&& nvcompCheck( nvcompBatchedBitcompDecompressGetTempSize( maxChunks_, CHUNK_SIZE, &decompressTemp ), "nvcompBatchedBitcompDecompressGetTempSize" );
+		break;
+	}
+	if ( !ok )
+	{
+		delete codec;
+		maxChunks_ = 0;
+		return;
+	}
+
+	slotSize_ = ( maxOutput + 7 ) / 8 * 8;										// The gather copies 8 bytes per thread
+	slots_.resize( maxChunks_ * slotSize_ );
+	inputPtrs_.resize( maxChunks_ );
+	inputBytes_.resize( maxChunks_ );
+	outputPtrs_.resize( maxChunks_ );
+	outputBytes_.resize( maxChunks_ );
+	actualBytes_.resize( maxChunks_ );
+	destinations_.resize( maxChunks_ );
+	codec->temp.resize( std::max<size_t>( std::max( compressTemp, decompressTemp ), 1 ) );
+	codec->statuses.resize( maxChunks_ );
+	codec_ = codec;
+#else
+	(void)elementSize;
+	std::cerr << "Built without SWARM_NVCOMP, no compression." << std::endl;
+#endif
+}
+
+GpuCompressor::~GpuCompressor()
+{
+#ifdef SWARM_NVCOMP
+	delete codec_;
+#endif
+}
+
+size_t GpuCompressor::maxRecordSize( size_t bytes ) const
+{
+	if ( codec_ == NULL )
+		return bytes;
+	size_t count = chunkCount( bytes );
+	return ( 3 + count ) * sizeof( unsigned long long ) + count * slotSize_;
+}
+
+void GpuCompressor::compress( const void* input, size_t bytes, char* output, unsigned long long* offset, cudaStream_t stream )
+{
+	if ( codec_ == NULL || bytes == 0 )
+		return;
+
+	NVTX_RANGE( NvtxDomain::KERNEL, "GpuCompressor::compress", NVTX_COLOR_INTEROP );
+
+	unsigned int count = chunkCount( bytes );
+	kernel_compression_batch( static_cast< const char* >( input ), bytes, CHUNK_SIZE, slots_.getData(), slotSize_, inputPtrs_.getData(),
+		inputBytes_.getData(), outputPtrs_.getData(), count, stream );
+#ifdef SWARM_NVCOMP
+	switch ( codec_->compression )
+	{
+	case Compression::LZ4:
+		nvcompCheck( nvcompBatchedLZ4CompressAsync( inputPtrs_.getData(), inputBytes_.getData(), CHUNK_SIZE, count, codec_->temp.getData(),
+			codec_->temp.getSize(), outputPtrs_.getData(), outputBytes_.getData(), codec_->lz4, stream ), "nvcompBatchedLZ4CompressAsync" );
+		break;
+	case Compression::CASCADED:
+		nvcompCheck( nvcompBatchedCascadedCompressAsync( inputPtrs_.getData(), inputBytes_.getData(), CHUNK_SIZE, count, codec_->temp.getData(),
+			codec_->temp.getSize(), outputPtrs_.getData(), outputBytes_.getData(), codec_->cascaded, stream ), "nvcompBatchedCascadedCompressAsync" );
+		break;
+	default:
+		nvcompCheck( nvcompBatchedBitcompCompressAsync( inputPtrs_.getData(), inputBytes_.getData(), CHUNK_SIZE, count, codec_->temp.getData(),
+			codec_->temp.getSize(), outputPtrs_.getData(), outputBytes_.getData(), codec_->bitcomp, stream ), "nvcompBatchedBitcompCompressAsync" );
+		break;
+	}
+#endif
+	kernel_compression_gather( outputPtrs_.getData(), outputBytes_.getData(), count, bytes, output, offset, destinations_.getData(), stream );
+}
+
+void GpuCompressor::decompress( const char* record, void* output, size_t bytes, cudaStream_t stream )
+{
+	if ( codec_ == NULL || bytes == 0 )
+		return;
+
+	NVTX_RANGE( NvtxDomain::KERNEL, "GpuCompressor::decompress", NVTX_COLOR_INTEROP );
+
+	unsigned int count = chunkCount( bytes );
+	kernel_decompression_batch( record, count, CHUNK_SIZE, static_cast< char* >( output ), bytes, inputPtrs_.getData(), inputBytes_.getData(),
+		outputPtrs_.getData(), outputBytes_.getData(), stream );
+#ifdef SWARM_NVCOMP
+	switch ( codec_->compression )
+	{
+	case Compression::LZ4:
+		nvcompCheck( nvcompBatchedLZ4DecompressAsync( inputPtrs_.getData(), inputBytes_.getData(), outputBytes_.getData(), actualBytes_.getData(),
+			count, codec_->temp.getData(), codec_->temp.getSize(), outputPtrs_.getData(), codec_->statuses.getData(), stream ), "nvcompBatchedLZ4DecompressAsync" );
+		break;
+	case Compression::CASCADED:
+		nvcompCheck( nvcompBatchedCascadedDecompressAsync( inputPtrs_.getData(), inputBytes_.getData(), outputBytes_.getData(), actualBytes_.getData(),
+			count, codec_->temp.getData(), codec_->temp.getSize(), outputPtrs_.getData(), codec_->statuses.getData(), stream ), "nvcompBatchedCascadedDecompressAsync" );
+		break;
+	default:
+		nvcompCheck( nvcompBatchedBitcompDecompressAsync( inputPtrs_.getData(), inputBytes_.getData(), outputBytes_.getData(), actualBytes_.getData(),
+			count, codec_->temp.getData(), codec_->temp.getSize(), outputPtrs_.getData(), codec_->statuses.getData(), stream ), "nvcompBatchedBitcompDecompressAsync" );
+		break;
+	}
+#endif
+}
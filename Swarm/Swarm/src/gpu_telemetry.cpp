@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+#include "cuda_runtime.h"
+
+#include "gpu_telemetry.h"
+
+#ifdef SWARM_NVML
+#include <nvml.h>
+
+/*!
+ * @brief NVML handle of the sampled GPU.
+ */
+struct GpuTelemetry::Device
+{
+	nvmlDevice_t handle = NULL;				//!< GPU in NVML.
+	bool energyCounter = false;				//!< nvmlDeviceGetTotalEnergyConsumption works (Volta and newer).
+};
+#endif
+
+/*!
+ * @brief Throttle reason bit of nvmlClocksThrottleReasons and its name, so the names don't need NVML.
+ */
+struct ThrottleReason
+{
+	unsigned long long bit;
+	const char* name;
+};
+
+static const ThrottleReason THROTTLE_REASONS[] = {
+	{ 0x001ull, "idle" },
+	{ 0x002ull, "app_clocks" },
+	{ 0x004ull, "sw_power_cap" },
+	{ 0x008ull, "hw_slowdown" },
+	{ 0x010ull, "sync_boost" },
+	{ 0x020ull, "sw_thermal" },
+	{ 0x040ull, "hw_thermal" },
+	{ 0x080ull, "hw_power_brake" },
+	{ 0x100ull, "display_clocks" },
+};
+
+/*!
+ * @brief Get the time of a steady clock.
+ * @return time in seconds.
+ */
+static double hostTime()
+{
+	return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+GpuTelemetry::GpuTelemetry( bool enabled, int cudaDevice )
+{
+	if ( !enabled )
+		return;
+
+#ifdef SWARM_NVML
+	char busId[32];
+	if ( cudaDeviceGetPCIBusId( busId, sizeof( busId ), cudaDevice ) != cudaSuccess )
+	{
+		std::cerr << "No PCI bus id of device " << cudaDevice << ", no GPU telemetry." << std::endl;
+		return;
+	}
+	nvmlReturn_t result = nvmlInit_v2();
+	if ( result != NVML_SUCCESS )
+	{
+		std::cerr << "nvmlInit failed: " << nvmlErrorString( result ) << std::endl;
+		return;
+	}
+	Device* device = new Device();
+	result = nvmlDeviceGetHandleByPciBusId_v2( busId, &device->handle );		// Same GPU as CUDA, the indices may differ
+	if ( result != NVML_SUCCESS )
+	{
+		std::cerr << "nvmlDeviceGetHandleByPciBusId failed: " << nvmlErrorString( result ) << std::endl;
+		delete device;
+		nvmlShutdown();
+		return;
+	}
+	device->energyCounter = nvmlDeviceGetTotalEnergyConsumption( device->handle, &lastEnergy_ ) == NVML_SUCCESS;
+	device_ = device;
+
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		read();																	// First sample before the first row
+	}
+	sampler_ = std::thread( &GpuTelemetry::sample, this );
+	std::cout << "GPU telemetry:                    every " << INTERVAL_MS << " ms, energy " << ( device->energyCounter ? "counter" : "integrated power" ) << std::endl;
+#else
+	(void)cudaDevice;
+	std::cerr << "Built without SWARM_NVML, no GPU telemetry." << std::endl;
+#endif
+}
+
+GpuTelemetry::~GpuTelemetry()
+{
+	if ( device_ == NULL )
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		stop_ = true;
+	}
+	wakeUp_.notify_one();
+	sampler_.join();
+#ifdef SWARM_NVML
+	delete device_;
+	nvmlShutdown();
+#endif
+	device_ = NULL;
+}
+
+void GpuTelemetry::sample()
+{
+	std::unique_lock<std::mutex> lock( mutex_ );
+	while ( !wakeUp_.wait_for( lock, std::chrono::milliseconds( INTERVAL_MS ), [this]() { return stop_; } ) )
+		read();																	// NVML calls take microseconds, the lock is never held long
+}
+
+void GpuTelemetry::read()
+{
+#ifdef SWARM_NVML
+	nvmlDevice_t handle = device_->handle;
+	unsigned int sm = 0, memory = 0, milliwatts = 0, temperature = 0;
+	unsigned long long throttle = 0;
+	nvmlDeviceGetClockInfo( handle, NVML_CLOCK_SM, &sm );						// Failed reads stay 0
+	nvmlDeviceGetClockInfo( handle, NVML_CLOCK_MEM, &memory );
+	nvmlDeviceGetPowerUsage( handle, &milliwatts );
+	nvmlDeviceGetTemperature( handle, NVML_TEMPERATURE_GPU, &temperature );
+	nvmlDeviceGetCurrentClocksThrottleReasons( handle, &throttle );
+
+	GpuSample sample;
+	sample.smClock = static_cast< float >( sm );
+	sample.memoryClock = static_cast< float >( memory );
+	sample.power = milliwatts * 1e-3f;
+	sample.temperature = static_cast< float >( temperature );
+	sample.throttle = throttle;
+
+	double now = hostTime();
+	double joules = 0.0;
+	if ( device_->energyCounter )
+	{
+		unsigned long long energy = lastEnergy_;
+		if ( nvmlDeviceGetTotalEnergyConsumption( handle, &energy ) == NVML_SUCCESS )
+		{
+			joules = ( energy - lastEnergy_ ) * 1e-3;							// mJ since the last sample
+			lastEnergy_ = energy;
+		}
+	}
+	else if ( lastTime_ > 0.0 )
+		joules = 0.5 * ( last_.power + sample.power ) * ( now - lastTime_ );	// Trapezoid of the two readings
+
+	last_ = sample;
+	lastTime_ = now;
+	if ( !running_ )
+		return;
+	joules_ += joules;
+	sum_.smClock += sample.smClock;
+	sum_.memoryClock += sample.memoryClock;
+	sum_.power += sample.power;
+	sum_.temperature = std::max( sum_.temperature, sample.temperature );
+	sum_.throttle |= sample.throttle;
+	samples_++;
+#endif
+}
+
+void GpuTelemetry::begin()
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	sum_ = GpuSample();
+	samples_ = 0;
+	joules_ = 0.0;
+	running_ = true;
+}
+
+void GpuTelemetry::end()
+{
+	if ( device_ == NULL )
+		return;
+
+	std::lock_guard<std::mutex> lock( mutex_ );
+	read();																		// Energy up to now, not up to the last sample
+	running_ = false;
+}
+
+GpuSample GpuTelemetry::getSample() const
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	return last_;
+}
+
+GpuSample GpuTelemetry::getMean() const
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	GpuSample mean = sum_;
+	if ( samples_ > 0 )
+	{
+		mean.smClock /= samples_;
+		mean.memoryClock /= samples_;
+		mean.power /= samples_;
+	}
+	return mean;
+}
+
+double GpuTelemetry::getJoules() const
+{
+	std::lock_guard<std::mutex> lock( mutex_ );
+	return joules_;
+}
+
+std::string GpuTelemetry::report( double fishSteps ) const
+{
+	if ( device_ == NULL )
+		return std::string();
+
+	GpuSample mean = getMean();
+	double joules = getJoules();
+	char line[160];
+	std::string text;
+	std::snprintf( line, sizeof( line ), "GPU clocks:                       SM %.0f MHz, memory %.0f MHz (mean)\n", mean.smClock, mean.memoryClock );
+	text += line;
+	std::snprintf( line, sizeof( line ), "GPU power:                        %.1f W (mean), max %.0f C\n", mean.power, mean.temperature );
+	text += line;
+	text += "GPU throttle reasons:             " + throttleNames( mean.throttle ) + "\n";
+	std::snprintf( line, sizeof( line ), "GPU energy:                       %.1f J\n", joules );
+	text += line;
+	if ( fishSteps > 0.0 )
+	{
+		std::snprintf( line, sizeof( line ), "Energy per million fish steps:    %.4g J\n", joules / ( fishSteps * 1e-6 ) );
+		text += line;
+	}
+	return text;
+}
+
+std::string GpuTelemetry::throttleNames( unsigned long long throttle )
+{
+	std::string names;
+	for ( const ThrottleReason& reason : THROTTLE_REASONS )
+	{
+		if ( ( throttle & reason.bit ) == 0 )
+			continue;
+		if ( !names.empty() )
+			names += "|";
+		names += reason.name;
+	}
+	return names.empty() ? "none" : names;
+}
+
+const char* GpuTelemetry::csvColumns()
+{
+	return ",sm_mhz,memory_mhz,power_w,temperature_c,throttle";
+}
+
+void GpuTelemetry::writeCsv( std::ostream& os, const GpuSample& sample )
+{
+	os << "," << sample.smClock << "," << sample.memoryClock << "," << sample.power << "," << sample.temperature << "," << throttleNames( sample.throttle );
+}
@@ -0,0 +1,145 @@
+#include <chrono>
+#include <iostream>
+
+#include "headless_simulation.h"
+#include "kernel.h"
+#include "kernel_cost.h"
+#include "launch_check.h"
+#include "memory_tracker.h"
+#include "nvtx_range.h"
+
+HeadlessSimulation::HeadlessSimulation( const SwarmConfig& config ) :
+	simulation_( config ),
+	snapshotWriter_( config.compression ),
+	snapshotPath_( config.snapshot ),
+	snapshotInterval_( config.snapshotInterval ),
+	snapshotDeltas_( config.snapshotDeltas ),
+	behaviour_( config.behaviour )
+{
+	trajectory_ = new TrajectoryRecorder( config, simulation_.getNumParticles() );	// Ids of the restored fishies are below the count too
+	events_ = new EventLog( config, simulation_.getStream() );
+	export_ = new PositionExport( config, simulation_.getNumParticles(), simulation_.getDevice().getDevice() );
+	telemetry_ = new GpuTelemetry( config.telemetry, simulation_.getDevice().getDevice() );
+	std::cout << memoryReport();												// Device budget after all buffers of the run exist
+}
+
+void HeadlessSimulation::step()
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "HeadlessSimulation::step", NVTX_COLOR_SIMULATION );
+
+	cudaStream_t stream = simulation_.getStream();
+	particleUpdates_ += simulation_.getLiveCount();								// Fishies of the advance, before a compaction
+	simulation_.step();
+
+	trajectory_->record( simulation_.getParticles(), simulation_.getLiveCount(), simulation_.getStepCount(), stream );
+	export_->publish( simulation_.getParticles(), simulation_.getLiveCount(), simulation_.getStepCount(), stream );	// Dropped while the slot is copied
+	if ( snapshotInterval_ > 0 && !snapshotPath_.empty() && simulation_.getStepCount() % snapshotInterval_ == 0 )
+		writeSnapshot( true );													// Written while the next steps run
+
+	if ( ++stepsSinceGridUpdate_ >= GRID_UPDATE_INTERVAL )						// Grid follows the swarm, without waiting for the GPU
+	{
+		stepsSinceGridUpdate_ = 0;
+		simulation_.updateGridBounds();
+		simulation_.requestStats();
+		events_->drain();														// Events of the last interval
+	}
+	CUDA_CHECK_FRAME( stream );													// Errors of finished steps, without waiting
+}
+
+void HeadlessSimulation::writeSnapshot( bool delta )
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "HeadlessSimulation::writeSnapshot", NVTX_COLOR_SYNC );
+
+	SnapshotHeader header = {};
+	header.numParticles = simulation_.getNumParticles();
+	header.liveParticles = simulation_.getLiveCount();
+	header.numSharks = simulation_.getNumSharks();
+	header.randomStep = kernel_get_random_step();
+	header.seed = simulation_.getSeed();
+	header.step = simulation_.getStepCount();
+	header.params = simulation_.getParams();
+	Vector3 swarmCenter = simulation_.getSwarmCenter();
+	header.swarmCenter[0] = swarmCenter.x;
+	header.swarmCenter[1] = swarmCenter.y;
+	header.swarmCenter[2] = swarmCenter.z;
+	Vector3 waypoint = simulation_.getWaypoint();
+	header.waypoint[0] = waypoint.x;
+	header.waypoint[1] = waypoint.y;
+	header.waypoint[2] = waypoint.z;
+
+	if ( delta && snapshotDeltas_ > 0 && deltaWriter_.getSequence() < snapshotDeltas_ && !deltaWriter_.needsBase() )
+	{
+		deltaWriter_.write( snapshotPath_, header, simulation_.getParticles(),
+			simulation_.getSharks(), simulation_.getSharkState(), simulation_.getStream() );
+		return;
+	}
+
+	snapshotWriter_.write( snapshotPath_, header, simulation_.getParticles(),
+		simulation_.getSharks(), simulation_.getSharkState(), simulation_.getStream() );
+	if ( snapshotDeltas_ > 0 )													// The next checkpoints are differences to this one
+		deltaWriter_.reset( simulation_.getParticles(), header.numParticles, header.step, simulation_.getStream() );
+}
+
+void HeadlessSimulation::run( unsigned int steps )
+{
+	CUDA_CHECK( cudaDeviceSynchronize() );
+	auto start = std::chrono::high_resolution_clock::now();
+	particleUpdates_ = 0.0;
+	telemetry_->begin();														// Energy of the timed steps only
+
+	for ( unsigned int i = 0; i < steps; i++ )
+		step();
+
+	CUDA_CHECK( cudaDeviceSynchronize() );										// Wait for the last step
+	auto end = std::chrono::high_resolution_clock::now();
+	telemetry_->end();
+
+	if ( !snapshotPath_.empty() )												// State after the run
+	{
+		writeSnapshot();
+		if ( snapshotWriter_.wait() )
+			std::cout << "Snapshot written to " << snapshotPath_ << " at step " << simulation_.getStepCount() << std::endl;
+	}
+
+	simulation_.requestStats();													// Aggregates of the last step
+	CUDA_CHECK( cudaStreamSynchronize( simulation_.getStream() ) );
+	const SwarmStats& stats = simulation_.getStats();
+	double dt = simulation_.getTimeStep();
+
+	double seconds = std::chrono::duration<double>( end - start ).count();
+	std::cout << "Steps:                            " << steps << "\n";
+	std::cout << "Time:                             " << seconds << " s\n";
+	std::cout << "Simulated time:                   " << simulation_.getSimulatedTime() << " s\n";
+	std::cout << "Steps per second:                 " << steps / seconds << "\n";
+	std::cout << "Live particles:                   " << stats.liveCount << " of " << simulation_.getNumParticles() << "\n";
+	std::cout << "Particle updates per second:      " << particleUpdates_ / seconds << "\n";
+	std::cout << "Swarm centroid:                   " << stats.centroid.x << ", " << stats.centroid.y << ", " << stats.centroid.z << "\n";
+	std::cout << "Swarm bounds:                     " << stats.boundsMin.x << ", " << stats.boundsMin.y << ", " << stats.boundsMin.z
+			  << " to " << stats.boundsMax.x << ", " << stats.boundsMax.y << ", " << stats.boundsMax.z << "\n";
+	std::cout << "Mean speed:                       " << stats.meanSpeed / dt << " per s\n";
+	if ( behaviour_ == Behaviour::CLASSIC )
+	{
+		SearchMode mode = kernel_get_search_mode( stats.liveCount );			// Model of the last step, with the live fishies and bounds of the run end
+		KernelCost cost = advanceCost( mode, stats, simulation_.getNumSharks(), simulation_.getParams(), kernel_get_tuning() );
+		std::cout << rooflineReport( mode, cost, particleUpdates_, seconds, simulation_.getDevice().getProperties() );
+	}
+	size_t l2Bytes = 0;
+	float l2HitRatio = 0.0f;
+	if ( kernel_get_l2_window( l2Bytes, l2HitRatio ) )							// Compare with a run without --l2_persistence
+		std::cout << "L2 persistence:                   " << l2Bytes / 1024 << " KB window, hit ratio " << l2HitRatio << "\n";
+	std::cout << telemetry_->report( particleUpdates_ ) << std::flush;
+	CUDA_CHECK_FRAME( simulation_.getStream() );
+	if ( launchErrorCount() > 0 )
+		std::cerr << launchErrorCount() << " CUDA errors, the results are invalid" << std::endl;
+}
+
+void HeadlessSimulation::cleanUp()
+{
+	snapshotWriter_.wait();														// Last snapshot is in the file
+	deltaWriter_.wait();
+	delete trajectory_;															// Writes the last chunk
+	delete events_;																// Writes the last events
+	delete export_;																// Removes the shared memory
+	delete telemetry_;
+	simulation_.cleanUp();														// Free GPU Memory
+}
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "host_simulation.h"
+
+// Constant orange. Is used for random color generation for each particle.
+static float const color[3] = { 200.0f / 255.0f, 117.0f / 255.0f, 26.0f / 255.0f };
+
+/*!
+ * @brief Random Function. Creates a random color value.
+ * @return random float value
+*/
+static float randC()
+{
+	float inverse_scale = 2;
+	return float( rand() ) / float( RAND_MAX ) / inverse_scale + (1 - 1 / inverse_scale / 2);
+}
+
+float randf( float a, float b )
+{
+	float random = ( ( float ) rand() ) / ( float ) RAND_MAX;
+	float diff = b - a;
+	float r = random * diff;
+	return a + r;
+}
+
+std::vector<Vector3> swarmWaypoints()
+{
+	return std::vector<Vector3>
+	{
+		// zig zag
+		Vector3(-4.0, -3.0, 0.0),
+		Vector3(4.0, -2.0, 0.0),
+		Vector3(-4.0, -1.0, 0.0),
+		Vector3(4.0, 2.0, 0.0),
+		
+		// Square
+		//Vector3(-5.0, 5.0, 0.0),
+		//Vector3(-5.0, -5.0, 0.0),
+		//Vector3(5.0, -5.0, 0.0),
+		//Vector3(5.0, 5.0, 0.0),
+
+		// not moving
+		//Vector3(0,0,0)
+	};
+}
+
+std::vector<std::vector<Vector3>> schoolWaypoints( const std::vector<Vector3>& route, unsigned int schools )
+{
+	std::vector<std::vector<Vector3>> routes( std::max( schools, 1u ) );
+	for ( size_t school = 0; school < routes.size(); school++ )
+	{
+		// Every school swims the same route, turned around the y axis, so the schools spread over the box.
+		float angle = 6.2831853f * school / routes.size();
+		float c = std::cos( angle );
+		float s = std::sin( angle );
+		for ( const Vector3& point : route )
+			routes[school].push_back( Vector3( c * point.x + s * point.z, point.y, c * point.z - s * point.x ) );
+	}
+	return routes;
+}
+
+void spawnFish( unsigned int count, std::vector<float>& data, std::vector<float>& state, const Vector3& boxMin, const Vector3& boxMax )
+{
+	for ( unsigned int i = 0; i < count; i++ )
+	{
+		data.push_back( randf( boxMin.x, boxMax.x ) );							// random vertex.x
+		data.push_back( randf( boxMin.y, boxMax.y ) );							// random vertex.y
+		data.push_back( randf( boxMin.z, boxMax.z ) );							// random vertex.z
+		data.push_back( 1.0f );													// vertex.w
+	}
+
+	for ( unsigned int i = 0; i < count; i++ )									// init forces.
+	{
+		state.push_back( 0.0f );												// force.x
+		state.push_back( 0.0f );												// force.y
+		state.push_back( 0.0f );												// force.z
+		state.push_back( static_cast< float >( rand() ) / RAND_MAX / 4 + 0.875 );	// random mass for each particle
+	}
+}
+
+void spawnSharks( unsigned int count, std::vector<float>& data, std::vector<float>& state, const Vector3& boxMin, const Vector3& boxMax )
+{
+	for ( unsigned int i = 0; i < count; i++ )
+	{
+		data.push_back( i == 0 ? boxMax.x : randf( boxMin.x, boxMax.x ) );
+		data.push_back( i == 0 ? boxMax.y : randf( boxMin.y, boxMax.y ) );
+		data.push_back( boxMax.z );
+		data.push_back( 1.0f );
+
+		state.push_back( 0.01f );												// Shark forces and mass
+		state.push_back( 0.01f );
+		state.push_back( 0.01f );
+		state.push_back( 0.01f );
+	}
+}
+
+void spawnColors( unsigned int count, std::vector<unsigned char>& color_data )
+{
+	for ( unsigned int i = 0; i < count; i++ )
+	{
+		color_data.push_back( static_cast< unsigned char >( 255.0f * color[0] * randC() + 0.5f ) );	// Red
+		color_data.push_back( static_cast< unsigned char >( 255.0f * color[1] * randC() + 0.5f ) );	// Green
+		color_data.push_back( static_cast< unsigned char >( 255.0f * color[2] * randC() + 0.5f ) );	// Blue
+		color_data.push_back( 255 );											// Alpha
+	}
+}
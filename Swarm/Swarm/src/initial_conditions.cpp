@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "initial_conditions.h"
+#include "nvtx_range.h"
+
+InitialConditionFile::~InitialConditionFile()
+{
+	close();
+}
+
+void InitialConditionFile::close()
+{
+#ifdef _WIN32
+	if ( data_ != NULL )
+		UnmapViewOfFile( data_ );
+	if ( mapping_ != NULL )
+		CloseHandle( mapping_ );
+	if ( file_ != NULL )
+		CloseHandle( file_ );
+#else
+	if ( data_ != NULL )
+		munmap( const_cast< char* >( data_ ), size_ );
+#endif
+	data_ = NULL;
+	mapping_ = NULL;
+	file_ = NULL;
+	size_ = 0;
+}
+
+bool InitialConditionFile::open( const std::string& path )
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if ( file != INVALID_HANDLE_VALUE )
+	{
+		file_ = file;
+		LARGE_INTEGER size;
+		if ( GetFileSizeEx( file, &size ) && size.QuadPart > 0 )
+		{
+			size_ = static_cast< size_t >( size.QuadPart );
+			mapping_ = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+			if ( mapping_ != NULL )
+				data_ = static_cast< const char* >( MapViewOfFile( mapping_, FILE_MAP_READ, 0, 0, 0 ) );
+		}
+	}
+#else
+	int file = ::open( path.c_str(), O_RDONLY );
+	if ( file >= 0 )
+	{
+		struct stat status;
+		if ( fstat( file, &status ) == 0 && status.st_size > 0 )
+		{
+			size_ = static_cast< size_t >( status.st_size );
+			void* data = mmap( NULL, size_, PROT_READ, MAP_PRIVATE, file, 0 );
+			data_ = data == MAP_FAILED ? NULL : static_cast< const char* >( data );
+			if ( data_ != NULL )
+				madvise( data, size_, MADV_SEQUENTIAL );						// Read ahead of the chunk copies
+		}
+		::close( file );														// The mapping keeps the file open
+	}
+#endif
+
+	if ( data_ == NULL )
+	{
+		std::cerr << "Impossible to open " << path << "!" << std::endl;
+		close();
+		return false;
+	}
+
+	const InitialHeader& header = getHeader();
+	bool valid = size_ >= sizeof( InitialHeader )
+		&& std::memcmp( header.magic, INITIAL_MAGIC, sizeof( INITIAL_MAGIC ) ) == 0
+		&& header.version == INITIAL_VERSION
+		&& header.headerSize == sizeof( InitialHeader )
+		&& header.count > 0 && header.count <= UINT_MAX;
+	for ( unsigned int i = 0; i < INITIAL_COLUMNS && valid; i++ )
+	{
+		unsigned long long offset = header.offsets[i];
+		if ( offset == 0 )
+		{
+			valid = i >= 3;														// Positions are needed
+			continue;
+		}
+		valid = offset >= sizeof( InitialHeader ) && offset % sizeof( float ) == 0
+			&& offset <= size_ && header.count <= ( size_ - offset ) / sizeof( float );
+	}
+	if ( !valid )
+	{
+		std::cerr << path << " is no initial condition file of this version!" << std::endl;
+		close();
+	}
+	return valid;
+}
+
+size_t InitialConditionFile::upload( ParticleStore& particles, cudaStream_t stream )
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "InitialConditionFile::upload", NVTX_COLOR_SETUP );
+
+	const InitialHeader& header = getHeader();
+	ParticleArrays arrays = particles.getArrays();
+	float* const targets[INITIAL_COLUMNS] = { arrays.x, arrays.y, arrays.z, arrays.vx, arrays.vy, arrays.vz, arrays.mass };
+	size_t count = std::min( static_cast< size_t >( header.count ), particles.getSize() );
+	size_t const chunk = CHUNK;
+
+	CudaHostArray<float>* slots[SLOTS];
+	cudaEvent_t copied[SLOTS];
+	bool pending[SLOTS] = {};
+	for ( unsigned int s = 0; s < SLOTS; s++ )
+	{
+		slots[s] = new CudaHostArray<float>( std::min( chunk, count ) );
+		CUDA_CHECK( cudaEventCreateWithFlags( &copied[s], cudaEventDisableTiming ) );
+	}
+
+	size_t bytes = 0;
+	unsigned int slot = 0;
+	for ( unsigned int i = 0; i < INITIAL_COLUMNS; i++ )
+	{
+		if ( header.offsets[i] == 0 )
+			continue;
+		const float* column = reinterpret_cast< const float* >( data_ + header.offsets[i] );
+		for ( size_t first = 0; first < count; first += chunk )
+		{
+			size_t n = std::min( chunk, count - first );
+			if ( pending[slot] )
+				CUDA_CHECK( cudaEventSynchronize( copied[slot] ) );				// The copy out of this slot is done
+			std::memcpy( slots[slot]->getData(), column + first, n * sizeof( float ) );	// Page faults: the reads from disk, beside the copy of the other slot
+			CUDA_CHECK( cudaMemcpyAsync( targets[i] + first, slots[slot]->getData(), n * sizeof( float ), cudaMemcpyHostToDevice, stream ) );
+			CUDA_CHECK( cudaEventRecord( copied[slot], stream ) );
+			pending[slot] = true;
+			bytes += n * sizeof( float );
+			slot = ( slot + 1 ) % SLOTS;
+		}
+	}
+
+	CUDA_CHECK( cudaStreamSynchronize( stream ) );								// The slots are freed at the return
+	for ( unsigned int s = 0; s < SLOTS; s++ )
+	{
+		CUDA_CHECK( cudaEventDestroy( copied[s] ) );
+		delete slots[s];
+	}
+	return bytes;
+}
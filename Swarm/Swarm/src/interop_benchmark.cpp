@@ -0,0 +1,234 @@
+#include "glew.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "interop_benchmark.h"
+#include "nvtx_range.h"
+#include "vertex_buffer.h"
+#include "vulkan_interop.h"
+
+typedef std::chrono::steady_clock Clock;
+
+/*!
+ * @brief Milliseconds between two time points.
+ */
+static double elapsedMs( Clock::time_point from, Clock::time_point to )
+{
+	return std::chrono::duration< double, std::milli >( to - from ).count();
+}
+
+const char* interopStrategyName( InteropStrategy strategy )
+{
+	switch ( strategy )
+	{
+	case InteropStrategy::PBO:
+		return "pbo";
+	case InteropStrategy::SSBO:
+		return "ssbo";
+	case InteropStrategy::VULKAN:
+		return "vulkan";
+	default:
+		return "registered";
+	}
+}
+
+InteropBenchmark::InteropBenchmark( const SwarmConfig& config )
+{
+	stream_ = device_.getStream( device_.createStream() );
+	unsigned int const largest = config.numParticles > MIN_PARTICLES ? config.numParticles : MIN_PARTICLES;
+	for ( unsigned long long n = MIN_PARTICLES; n < largest; n *= 4 )
+		sizes_.push_back( static_cast< unsigned int >( n ) );
+	sizes_.push_back( largest );
+}
+
+InteropBenchmark::~InteropBenchmark()
+{
+	device_.destroyStreams();
+}
+
+void InteropBenchmark::run()
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "InteropBenchmark::run", NVTX_COLOR_INTEROP );
+
+	results_.clear();
+	for ( unsigned int particles : sizes_ )
+	{
+		CudaDeviceArray<float4> source( particles, MemoryCategory::SCRATCH );
+		CUDA_CHECK( cudaMemsetAsync( source.getData(), 0, particles * sizeof( float4 ), stream_ ) );
+		for ( InteropStrategy strategy : { InteropStrategy::REGISTERED, InteropStrategy::PBO, InteropStrategy::SSBO, InteropStrategy::VULKAN } )
+		{
+			InteropResult result;
+			if ( measure( strategy, source, particles, result ) )
+				results_.push_back( result );
+			else
+				std::cout << interopStrategyName( strategy ) << " is not available, skipped" << std::endl;
+		}
+	}
+}
+
+bool InteropBenchmark::measure( InteropStrategy strategy, const CudaDeviceArray<float4>& source, unsigned int particles, InteropResult& result )
+{
+	unsigned int const bytes = particles * sizeof( float4 );
+	VulkanInterop* interop = NULL;
+	int external = -1;
+	VertexBuffer* display = NULL;
+	VertexBuffer* pbo = NULL;
+	int resource = -1;
+	if ( strategy == InteropStrategy::VULKAN )
+	{
+		interop = new VulkanInterop( true, device_.getDevice() );
+		external = interop->isEnabled() ? interop->createBuffer( bytes ) : -1;
+		if ( external < 0 )
+		{
+			delete interop;
+			return false;
+		}
+		display = new ExternalVertexBuffer( interop->getMemoryObject( external ), bytes );
+		interop->addGLBuffer( display->getBufferID() );
+	}
+	else
+		display = new VertexBuffer( NULL, bytes );
+	display->unbind();
+	if ( strategy == InteropStrategy::PBO )
+	{
+		pbo = new VertexBuffer( NULL, bytes );
+		pbo->unbind();
+	}
+	else if ( strategy == InteropStrategy::REGISTERED )
+		resource = device_.registerGLBuffer( *display, cudaGraphicsRegisterFlagsWriteDiscard );	// Overwritten completely every frame
+	else if ( strategy == InteropStrategy::SSBO )
+	{
+		resource = device_.registerGLBuffer( *display );
+		glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, display->getBufferID() );	// Bound once like the pulled stores
+		device_.holdResources( { resource }, stream_ );
+	}
+	VertexBuffer sink( NULL, sizeof( float4 ) );									// The draw read of a frame lands here
+	sink.unbind();
+
+	cudaEvent_t start, stop;
+	CUDA_CHECK( cudaEventCreate( &start ) );
+	CUDA_CHECK( cudaEventCreate( &stop ) );
+	result = { strategy, particles, 0.0, 0.0, 0.0 };
+	for ( unsigned int frame = 0; frame < WARMUP + FRAMES; frame++ )
+	{
+		double syncMs = 0.0;
+		Clock::time_point const frameStart = Clock::now();
+		Clock::time_point before = frameStart;
+		void* target = NULL;
+		size_t numBytes;
+		switch ( strategy )
+		{
+		case InteropStrategy::REGISTERED:
+			device_.mapResources( std::vector<int>{ resource }, stream_ );
+			device_.getMappedPointer( &target, &numBytes, resource );
+			break;
+		case InteropStrategy::PBO:
+			glBindBuffer( GL_PIXEL_UNPACK_BUFFER, pbo->getBufferID() );
+			target = glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );	// Host memory of the driver
+			break;
+		case InteropStrategy::SSBO:
+			device_.getMappedPointer( &target, &numBytes, resource );
+			break;
+		default:
+			interop->acquire( stream_ );
+			target = interop->getDevicePointer( external );
+			break;
+		}
+		syncMs += elapsedMs( before, Clock::now() );
+
+		CUDA_CHECK( cudaEventRecord( start, stream_ ) );
+		CUDA_CHECK( cudaMemcpyAsync( target, source.getData(), bytes, strategy == InteropStrategy::PBO ? cudaMemcpyDeviceToHost : cudaMemcpyDeviceToDevice, stream_ ) );
+		CUDA_CHECK( cudaEventRecord( stop, stream_ ) );
+
+		before = Clock::now();
+		switch ( strategy )
+		{
+		case InteropStrategy::REGISTERED:
+			device_.unmapResources( stream_ );
+			break;
+		case InteropStrategy::PBO:
+			CUDA_CHECK( cudaStreamSynchronize( stream_ ) );							// The mapping is only valid until the unmap
+			glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+			glBindBuffer( GL_COPY_WRITE_BUFFER, display->getBufferID() );
+			glCopyBufferSubData( GL_PIXEL_UNPACK_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, bytes );
+			glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+			break;
+		case InteropStrategy::SSBO:
+			device_.releaseResources( stream_ );
+			break;
+		default:
+			interop->release( stream_ );
+			break;
+		}
+		syncMs += elapsedMs( before, Clock::now() );
+
+		glBindBuffer( GL_COPY_READ_BUFFER, display->getBufferID() );				// Read by OpenGL like a draw, after the write
+		glBindBuffer( GL_COPY_WRITE_BUFFER, sink.getBufferID() );
+		glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, bytes - sizeof( float4 ), 0, sizeof( float4 ) );
+		glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+		glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+		if ( strategy == InteropStrategy::SSBO )
+			device_.holdResources( { resource }, stream_ );							// Mapped again until the next draw
+		glFinish();
+		CUDA_CHECK( cudaEventSynchronize( stop ) );
+		double const frameMs = elapsedMs( frameStart, Clock::now() );
+
+		if ( frame < WARMUP )
+			continue;
+		float copyMs;
+		CUDA_CHECK( cudaEventElapsedTime( &copyMs, start, stop ) );
+		result.transferMs += copyMs / FRAMES;
+		result.syncMs += syncMs / FRAMES;
+		result.frameMs += frameMs / FRAMES;
+	}
+
+	if ( strategy == InteropStrategy::SSBO )
+	{
+		device_.releaseResources( stream_ );
+		glBindBufferBase( GL_SHADER_STORAGE_BUFFER, 0, 0 );
+	}
+	CUDA_CHECK( cudaStreamSynchronize( stream_ ) );
+	CUDA_CHECK( cudaEventDestroy( start ) );
+	CUDA_CHECK( cudaEventDestroy( stop ) );
+	device_.unregisterGLBuffer();
+	delete pbo;
+	delete display;																// Before the memory of interop
+	delete interop;
+	return true;
+}
+
+void InteropBenchmark::report( std::ostream& os ) const
+{
+	os << "Interop strategy   Particles   Transfer ms   Sync ms   Frame ms   GB/s\n";
+	for ( const InteropResult& result : results_ )
+	{
+		double const gbs = result.transferMs > 0.0 ? result.particles * sizeof( float4 ) / ( result.transferMs * 1e6 ) : 0.0;
+		os << std::left << std::setw( 19 ) << interopStrategyName( result.strategy ) << std::right << std::setw( 9 ) << result.particles
+			<< std::fixed << std::setprecision( 3 ) << std::setw( 14 ) << result.transferMs << std::setw( 10 ) << result.syncMs
+			<< std::setw( 11 ) << result.frameMs << std::setprecision( 1 ) << std::setw( 7 ) << gbs << "\n";
+	}
+	os.flush();
+}
+
+bool InteropBenchmark::writeJson( const std::string& path ) const
+{
+	std::ofstream file( path );
+	if ( !file )
+	{
+		std::cerr << "Impossible to open " << path << "!" << std::endl;
+		return false;
+	}
+
+	file << std::fixed << std::setprecision( 4 ) << "{\n  \"frames\": " << FRAMES << ",\n  \"results\": [";
+	for ( size_t i = 0; i < results_.size(); i++ )
+	{
+		const InteropResult& result = results_[i];
+		file << ( i == 0 ? "\n" : ",\n" ) << "    { \"strategy\": \"" << interopStrategyName( result.strategy ) << "\", \"particles\": " << result.particles
+			<< ", \"transfer_ms\": " << result.transferMs << ", \"sync_ms\": " << result.syncMs << ", \"frame_ms\": " << result.frameMs << " }";
+	}
+	file << "\n  ]\n}\n";
+	return static_cast< bool >( file );
+}
@@ -0,0 +1,143 @@
+#include <algorithm>
+
+#include "job_system.h"
+
+JobSystem::JobSystem( unsigned int threads )
+{
+	if ( threads == 0 )
+		threads = std::max( std::thread::hardware_concurrency(), 2u ) - 1;		// The main thread launches the GPU work
+
+	ready_.reserve( MAX_SPARE_JOBS );
+	running_.reserve( MAX_SPARE_JOBS );
+	spare_.reserve( MAX_SPARE_JOBS );
+	for ( unsigned int i = 0; i < threads; i++ )
+		workers_.emplace_back( &JobSystem::work, this );
+}
+
+JobSystem::~JobSystem()
+{
+	waitAll();
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		stop_ = true;
+	}
+	wakeUp_.notify_all();
+	for ( std::thread& worker : workers_ )
+		worker.join();
+}
+
+void JobSystem::execute( const Handle& job )
+{
+	job->task();
+
+	std::lock_guard<std::mutex> lock( mutex_ );
+	job->done = true;
+	job->task = nullptr;														// Frees the captures
+	for ( const Handle& dependent : job->dependents )
+	{
+		if ( --dependent->pending == 0 )
+			ready_.push_back( dependent );
+	}
+	job->dependents.clear();
+	running_.erase( std::find( running_.begin(), running_.end(), job ) );
+	if ( spare_.size() < MAX_SPARE_JOBS )
+		spare_.push_back( job );
+	wakeUp_.notify_all();
+	finished_.notify_all();
+}
+
+void JobSystem::work()
+{
+	while ( true )
+	{
+		Handle job;
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			wakeUp_.wait( lock, [this]() { return stop_ || !ready_.empty(); } );
+			if ( ready_.empty() )													// stop_ and nothing left
+				return;
+			job = ready_.front();
+			ready_.erase( ready_.begin() );
+		}
+		execute( job );
+	}
+}
+
+JobSystem::Handle JobSystem::submit( std::function<void()> task, const std::vector<Handle>& dependencies )
+{
+	Handle job;
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		for ( size_t i = 0; i < spare_.size() && !job; i++ )
+		{
+			if ( spare_[i].use_count() > 1 )									// Still held, e.g. by the handle of the last frame
+				continue;
+			job = spare_[i];
+			spare_[i] = spare_.back();
+			spare_.pop_back();
+			job->done = false;
+			job->pending = 0;
+		}
+		if ( !job )
+			job = std::make_shared<Job>();
+		job->task = std::move( task );
+		for ( const Handle& dependency : dependencies )
+		{
+			if ( dependency && !dependency->done )
+			{
+				dependency->dependents.push_back( job );
+				job->pending++;
+			}
+		}
+		running_.push_back( job );
+		if ( job->pending == 0 )
+			ready_.push_back( job );
+	}
+	wakeUp_.notify_one();
+	return job;
+}
+
+void JobSystem::wait( const Handle& job )
+{
+	if ( !job )
+		return;
+
+	std::unique_lock<std::mutex> lock( mutex_ );
+	while ( !job->done )
+	{
+		if ( !ready_.empty() )													// Help instead of sleeping, the job may wait for these
+		{
+			Handle other = ready_.front();
+			ready_.erase( ready_.begin() );
+			lock.unlock();
+			execute( other );
+			lock.lock();
+		}
+		else
+			finished_.wait( lock );
+	}
+}
+
+void JobSystem::waitAll()
+{
+	while ( true )
+	{
+		Handle job;
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			if ( running_.empty() )
+				return;
+			job = running_.front();
+		}
+		wait( job );
+	}
+}
+
+bool JobSystem::isDone( const Handle& job )
+{
+	if ( !job )
+		return true;
+
+	std::lock_guard<std::mutex> lock( mutex_ );
+	return job->done;
+}
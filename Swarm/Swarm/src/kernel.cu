@@ -4,17 +4,932 @@
 #include "device_launch_parameters.h"
 #include "curand.h"
 #include "curand_kernel.h"
+#include <cooperative_groups.h>
+#include <cuda/pipeline>
+#include <mma.h>
 
-static int BLOCK_SIZE = 128;
-static int NUM_BLOCKS;
-static int NUM_THREADS;
-static int NUM_BLOCKS_DISTANCE;
+#include <cfloat>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <thrust/copy.h>
+#include <thrust/device_ptr.h>
+#include <thrust/execution_policy.h>
+#include <thrust/functional.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <thrust/iterator/zip_iterator.h>
+#include <thrust/scan.h>
+#include <thrust/sort.h>
+#include <thrust/tuple.h>
 
-__device__ float CENTER_THRESHOLD = 2.0;
-__device__ float SHARK_DIST = 0.7;
-__device__ float SHARK_BITE_DIST = 0.05;
-__device__ float FISH_DIST = 0.4;
-__device__ float ACCELERATION_FACTOR = 0.2;
+#include "cuda_device_array.h"
+#include "cuda_host_array.h"
+#include "launch_config.h"
+#include "nvtx_range.h"
+#include "launch_check.h"
+#include "particle_store.h"
+#include "rtc_advance.h"
+
+/*
+ * Launch configuration per kernel. Block sizes come from the occupancy calculator in kernel_init_grid,
+ * the grid size is computed for the number of fishies at every launch.
+ */
+static LaunchConfig LAUNCH_ADVANCE;
+static LaunchConfig LAUNCH_TILED;
+static LaunchConfig LAUNCH_TILED_ASYNC;
+static LaunchConfig LAUNCH_WARP;
+static LaunchConfig LAUNCH_HASH;
+static LaunchConfig LAUNCH_REORDER;
+static LaunchConfig LAUNCH_GRID;
+static LaunchConfig LAUNCH_BOIDS;
+static LaunchConfig LAUNCH_SHARKS;
+static LaunchConfig LAUNCH_HUNT;
+static LaunchConfig LAUNCH_PACK;
+static LaunchConfig LAUNCH_TRAJECTORY;
+static LaunchConfig LAUNCH_COLLECT;
+static LaunchConfig LAUNCH_SPAWN;
+static LaunchConfig LAUNCH_SPAWN_ALL;
+static LaunchConfig LAUNCH_STATS;
+static LaunchConfig LAUNCH_MORTON;
+static LaunchConfig LAUNCH_PERMUTE;
+static LaunchConfig LAUNCH_COLORS;
+static LaunchConfig LAUNCH_DEPTH;
+static LaunchConfig LAUNCH_SPLAT;
+static LaunchConfig LAUNCH_SHADE;
+static LaunchConfig LAUNCH_TRAIL;
+static LaunchConfig LAUNCH_CURRENT;
+static LaunchConfig LAUNCH_ENSEMBLE;
+static LaunchConfig LAUNCH_ENSEMBLE_METRICS;
+static LaunchConfig LAUNCH_VERLET_BUILD;
+static LaunchConfig LAUNCH_VERLET;
+static LaunchConfig LAUNCH_DISPLACEMENT;
+static LaunchConfig LAUNCH_PARTITION;
+static LaunchConfig LAUNCH_CLASSIFY;
+static LaunchConfig LAUNCH_BVH_LEAVES;
+static LaunchConfig LAUNCH_BVH_INTERNAL;
+static LaunchConfig LAUNCH_BVH_MERGE;
+static LaunchConfig LAUNCH_RATES;
+
+/*
+ * Uniform grid for neighbour search.
+ * The grid is placed around the bounding box of the swarm (kernel_set_grid_bounds). Cells outside of it wrap around
+ * into the same buckets, so the grid still covers an unbounded domain, e.g. a sparse swarm larger than GRID_SIZE cells.
+ */
+static const unsigned int GRID_SIZE = 64;						// Maximum number of cells per axis. The cell storage is allocated once for this size.
+static const unsigned int GRID_NUM_CELLS = GRID_SIZE * GRID_SIZE * GRID_SIZE;
+static const unsigned int EMPTY_CELL = 0xffffffff;			// Marks an empty cell in cellStart.
+static const unsigned int DEAD_CELL = GRID_NUM_CELLS;			// Dead fishies are sorted into this cell, which is never searched.
+
+/*
+ * Hashed grid (kernel_set_hash_grid): the cells don't wrap around, they are the keys of an open addressing hash table.
+ * The slot of a cell is its hash in cellStart and cellEnd, so schools far apart never share a bucket. Linear probing, a warp
+ * probes 32 slots at once. The table is cleared and filled by every grid build, the slots in use scale with the swarm.
+ */
+static const unsigned long long EMPTY_KEY = 0xffffffffffffffffull;	// Free slot of the cell keys.
+static const int CELL_KEY_BIAS = 1 << 20;						// 21 bits per axis: cells up to 2^20 away from the grid origin.
+static const unsigned int MIN_HASH_SLOTS = 1024;				// Smallest table, also for tiny swarms.
+static bool HASH_GRID = false;									// The grid builds hash the cells into d_cellKeys (kernel_set_hash_grid).
+static unsigned int HASH_SLOTS = MIN_HASH_SLOTS;				// Slots of the table of this context: twice the fishies, a power of two.
+static CudaDeviceArray<unsigned long long>* d_cellKeys = NULL;	// Hashed grid: key of the cell per slot. Allocated by kernel_init_grid.
+
+/*!
+ * @brief Placement of the uniform grid. Passed by value into the grid kernels.
+ */
+struct GridLayout
+{
+	float3 origin;				//!< Lower corner of cell (0, 0, 0).
+	float cellSize;				//!< Edge length of a cell. Must be >= fishDist.
+	int3 dims;					//!< Number of cells per axis (3 to GRID_SIZE). Cells outside wrap around.
+	unsigned long long* cellKeys;	//!< Hashed grid: cell key per slot, the slot is the hash of the cell. NULL: cells wrap around.
+	unsigned int keyMask;		//!< Hashed grid: slots - 1. Slot keyMask + 1 is the empty bucket of the cells not in the table.
+};
+
+static GridLayout GRID_LAYOUT = { { 0.0f, 0.0f, 0.0f }, 0.4f, { GRID_SIZE, GRID_SIZE, GRID_SIZE }, NULL, 0 };	// Set by kernel_set_params and kernel_set_grid_bounds.
+
+static const unsigned int TILED_SEARCH_THRESHOLD = 4096;		// Below this number of fishies the tiled all-pairs search is used instead of the grid.
+static const unsigned int WARP_SIZE = 32;
+static const unsigned int FULL_WARP_MASK = 0xffffffff;
+static Behaviour BEHAVIOUR = Behaviour::CLASSIC;				// Fish behaviour used by kernel_advance.
+static SearchMode SEARCH_MODE = SearchMode::AUTO;				// Neighbour search used by kernel_advance.
+static unsigned int SEARCH_FIRST_K = 0;							// Neighbour query: stop after this number of fishies inside fishDist. 0: closest fish.
+static KernelTuning TUNING;										// Block size of the search kernels and cell size (kernel_set_tuning).
+
+static const unsigned int MAX_CONSTANT_SHARKS = 64;			// Up to this number of sharks the positions are read from constant memory.
+
+static CudaDeviceArray<unsigned int>* d_gridParticleHash;		// Cell hash per fish.
+static CudaDeviceArray<unsigned int>* d_gridParticleIndex;		// Fish index sorted by cell hash.
+static CudaDeviceArray<unsigned int>* d_cellStart;				// Index of first fish in cell.
+static CudaDeviceArray<unsigned int>* d_cellEnd;				// Index after last fish in cell.
+static ParticleStore* d_sorted;									// Particles in sorted order.
+static CudaDeviceArray<ushort4>* d_sortedPacked;				// 16 bit positions of the sorted fishies inside their cells, see d_packCellPosition.
+static bool PACKED_POSITIONS = false;							// Grid search reads d_sortedPacked instead of the float positions.
+static bool COOPERATIVE_GRID = false;							// Grid search builds the grid and searches in one cooperative launch.
+static const unsigned int COOPERATIVE_THREADS = 256;			// Block size of d_advance_cooperative, its scan keeps one entry per thread.
+static unsigned int COOPERATIVE_BLOCKS = 0;						// Blocks of d_advance_cooperative resident at once on this GPU. 0: no cooperative launch.
+static CudaDeviceArray<unsigned int>* d_cellRank;				// Counting sort and cooperative grid: position of each fish inside its cell.
+static CudaDeviceArray<unsigned int>* d_blockSums;				// Cooperative grid: fishies per block of the cell scan.
+static bool WARM_START = true;									// Grid search starts with the closest fish of the last step as bound.
+static GridSort GRID_SORT = GridSort::AUTO;						// How buildGrid sorts the fishies into the cells (kernel_set_grid_sort).
+static const unsigned int COUNTING_SORT_CELLS_PER_FISH = 4;		// AUTO: counting sort up to this number of cells per fish, above the scan of the empty cells costs more than it saves.
+static CudaDeviceArray<unsigned int>* d_nearest;				// Slot of the closest fish of the last step per slot. ~0u: none.
+static const unsigned int TENSOR_WARPS = 4;						// Warps per block of d_advance_tensor, 16 fishies each.
+static const unsigned int TENSOR_THREADS = TENSOR_WARPS * WARP_SIZE;	// Block size of d_advance_tensor.
+static const unsigned int TENSOR_ROWS = TENSOR_WARPS * 16;		// Fishies per block of d_advance_tensor.
+static const unsigned int TENSOR_CHUNK = 64;					// Candidates per shared memory load of d_advance_tensor.
+static const unsigned int TENSOR_DOT_STRIDE = TENSOR_CHUNK + 4;	// Row stride of the dot products in shared memory, padded against bank conflicts.
+static bool TENSOR_CORES = false;								// The GPU has tensor cores (compute capability 7.0), else TENSOR runs TILED.
+static const unsigned int TILE_STAGES = 2;						// Tiles of d_tiledSearchAsync in shared memory at once: one is scanned, the next streams in.
+static bool ASYNC_TILES = false;								// The GPU copies global to shared memory asynchronously (compute capability 8.0), else TILED loads synchronously.
+static DeviceArena* d_arena;									// Scratch memory of one step (temporary storage of the sort).
+static CudaDeviceArray<unsigned int>* d_freeList;				// Emitter: indices of dead fishies.
+static CudaDeviceArray<unsigned int>* d_freeCount;				// Emitter: number of indices in d_freeList.
+static CudaDeviceArray<unsigned int>* d_flockList;				// Evasion split: indices of the flocking fishies. Dense cells: sorted indices of the dense fishies.
+static CudaDeviceArray<unsigned int>* d_flockCount;				// Evasion split and dense cells: number of indices in d_flockList.
+static bool EVASION_SPLIT = false;								// Brute force search runs only over the fishies that don't evade a shark.
+static unsigned int DENSE_CANDIDATES = 0;						// Grid search: fishies with more candidates in their 27 cells are searched by a warp each. 0: off.
+static const unsigned int DENSE_WARPS = 4096;					// Warps of d_advance_dense, they loop over the listed fishies.
+static bool CLUSTER_SEARCH = false;								// Grid search over distributed shared memory (kernel_set_cluster_search).
+static bool CLUSTER_CELLS = false;								// The GPU has thread block clusters (compute capability 9.0), else the grid search stays as it is.
+static const unsigned int CLUSTER_EDGE = 2;						// Cells per axis of a cluster of d_advance_cluster, one block per cell.
+static const unsigned int CLUSTER_BLOCKS = CLUSTER_EDGE * CLUSTER_EDGE * CLUSTER_EDGE;
+static const unsigned int CLUSTER_THREADS = 128;				// Threads per block of d_advance_cluster, they loop over the fishies of their cell.
+static const unsigned int CLUSTER_CELL_CAPACITY = 256;			// Fishies of a cell in shared memory. The blocks read fuller cells from global memory.
+static const unsigned int CELL_THREADS = 128;					// Threads per block of d_advance_cell, they loop over the fishies of their cell.
+static const unsigned int CELL_CAPACITY = 1024;					// Fishies of the 27 cells in shared memory (16 KB). Fuller ones are searched in global memory.
+static bool L2_PERSISTENCE = false;								// Grid search: keep the cell tables persisting in L2 (kernel_set_l2_persistence).
+static size_t L2_PERSIST_MAX = 0;								// persistingL2CacheMaxSize of this device. 0: no persisting L2.
+static size_t L2_WINDOW_MAX = 0;								// accessPolicyMaxWindowSize of this device.
+static cudaStream_t L2_STREAM = NULL;							// Stream with the access policy window of the cell tables.
+static cudaAccessPolicyWindow L2_WINDOW = {};					// Window of L2_STREAM. num_bytes 0: none.
+static bool DETERMINISTIC = false;								// Fixed-point state, ordered searches and reductions (kernel_set_deterministic).
+static const float FIXED_POINT_SCALE = 65536.0f;				// Deterministic mode: state is a multiple of 1 / FIXED_POINT_SCALE (16.16 in an int32).
+static bool RTC_KERNELS = false;								// Classic grid advance compiled at runtime with the constants of the scenario (kernel_set_rtc).
+static bool MEAN_FIELD = false;									// Boids: neighbourhood from the means of the 27 cells instead of every neighbour (kernel_set_mean_field).
+static CudaDeviceArray<float4>* d_cellVelocity = NULL;			// Mean field: mean speed vector (x, y, z) and number of fishies (w) per cell. Allocated by the first step.
+static CudaDeviceArray<float4>* d_cellCentroid = NULL;			// Mean field: mean position per cell.
+static float COLLISION_RADIUS = 0.0f;							// Collisions: distance of two fish centers at contact (kernel_set_collisions). 0: fishies pass through each other.
+static unsigned int COLLISION_ITERATIONS = 0;					// Collisions: Jacobi iterations per step.
+static CudaDeviceArray<float4>* d_collisionPositions = NULL;		// Collisions: positions in sorted order, corrected by every iteration. Allocated by the first pass.
+static CudaDeviceArray<float4>* d_collisionDeltas = NULL;		// Collisions: correction of every sorted fish by the current iteration.
+static CudaDeviceArray<unsigned long long>* d_clusterKeys = NULL;	// Cluster impostors: cell key per slot (d_cull). Allocated by the first kernel_cull with clusters.
+static CudaDeviceArray<float4>* d_clusterSums = NULL;			// Cluster impostors: sum of the offsets into the cell (x, y, z) and fishies (w) per slot.
+static CudaDeviceArray<float4>* d_clusterMoments = NULL;		// Cluster impostors: sum of the squared offsets (x) and of the colors (y, z, w) per slot.
+static RtcAdvance* RTC_ADVANCE = NULL;							// Runtime compiled grid advance of this context. NULL: not built or failed.
+static RtcAdvanceKey RTC_TRIED;									// Constants of the last build, a failed build is not repeated every step.
+static SharkTarget SHARK_TARGET = SharkTarget::CENTER;			// What the sharks hunt (kernel_set_shark_target).
+static const unsigned int SHARK_RINGS = 4;						// Rings of cells around a shark searched for the nearest fish.
+static const unsigned int SHARK_DENSE_RINGS = 2;				// Rings of cells searched for the densest cell, all of them are read.
+static const unsigned int SHARK_INTERCEPT_RINGS = 3;			// Rings of cells an intercepting shark weighs, one warp per shark.
+static const unsigned int INTERCEPT_THREADS = 128;				// Block of d_interceptSharks, a warp per shark.
+static const float INTERCEPT_HORIZON = 60.0f;					// Steps an intercepting shark looks ahead at most.
+static bool SHARK_GRID = false;									// The last kernel_advance built the grid for the sharks and left the bites to them.
+static ParticleArrays SHARK_PREY = {};							// Output of that kernel_advance, the sharks bite into it.
+static bool QUERY_GRID = false;									// The grid of the last kernel_advance fits the slots, for the probe queries.
+static bool ADVANCE_NEAREST = false;							// d_nearest holds the closest fish of every slot of the last kernel_advance.
+static const unsigned int QUERY_MAX_RINGS = 8;					// Rings of cells a nearest query searches before it falls back to all fishies.
+static const unsigned int PICK_THREADS = 256;					// Block of d_pickAll.
+static const unsigned long long PICK_MISS = ~0ull;				// Pick key of no hit.
+static unsigned int SHARK_PREY_COUNT = 0;						// Number of fishies of that kernel_advance.
+static CudaDeviceArray<unsigned int>* d_sharkClaims;			// Shark which bit the fish in this step, per fish. 0xffffffff: none.
+static CudaDeviceArray<uint2>* d_ensembleMembers;				// Ensemble: first slot (x) and number of fishies (y) per member.
+static CudaDeviceArray<SwarmParams>* d_ensembleParams;			// Ensemble: behaviour parameters per member.
+static unsigned int ENSEMBLE_SIZE = 0;							// Ensemble: number of members. 0: no ensemble.
+static unsigned int ENSEMBLE_MAX_COUNT = 0;						// Ensemble: fishies of the largest member.
+static unsigned int ENSEMBLE_SHARKS = 0;						// Ensemble: sharks per member.
+static bool ENSEMBLE_JITTER = false;							// Ensemble: a member has behaviour noise.
+
+/*
+ * Verlet search: every fish keeps a list of the fishies inside fishDist + verletSkin.
+ * The list stays valid until a fish moved more than verletSkin / 2 since it was built.
+ */
+static const unsigned int VERLET_MAX_NEIGHBOURS = 32;				// Length of a list. The closest candidates are kept.
+static CudaDeviceArray<unsigned int>* d_verletList;				// Candidate slots. Entry k of fish i is at k * mesh_count + i (coalesced).
+static CudaDeviceArray<unsigned int>* d_verletCount;				// Number of candidates per fish.
+static CudaDeviceArray<float4>* d_verletRef;						// Positions when the lists were built.
+static CudaDeviceArray<unsigned int>* d_verletMax;				// Float bits of the maximum displacement since the build [0] and in the last step [1].
+static CudaHostArray<float>* h_verletMax;						// Read back of d_verletMax.
+static cudaEvent_t verletRead;									// Recorded after the read back of d_verletMax.
+static bool VERLET_VALID = false;								// Lists match the current slots of the fishies.
+static unsigned int VERLET_COUNT = 0;							// Number of fishies when the lists were built.
+static bool VERLET_READ_PENDING = false;						// A read back of d_verletMax is on the way.
+static bool VERLET_READ_STALE = false;							// The pending displacement was measured against old lists.
+static unsigned int VERLET_READ_AGO = 0;						// Steps since the pending read back was started.
+static float VERLET_DISPLACEMENT = 0.0f;						// Last known maximum displacement since the build.
+static float VERLET_STEP = 0.0f;								// Last known maximum displacement per step.
+static unsigned int VERLET_UNKNOWN_STEPS = 0;					// Steps after the last known displacement.
+
+static float3 SPAWN_MIN = make_float3( -5.0f, -5.0f, -5.0f );	// Emitter: lower corner of the spawn box, like the first ones (kernel_set_spawn_box).
+static float3 SPAWN_MAX = make_float3( 5.0f, 5.0f, 5.0f );		// Emitter: upper corner of the spawn box.
+
+/*!
+ * @brief Partial aggregates of a part of the fishies. Reduced to SwarmStats by kernel_reduce_stats.
+ */
+struct StatsPartial
+{
+	float3 sum;					//!< Sum of the positions.
+	float3 lower;				//!< Minimum of the positions.
+	float3 upper;				//!< Maximum of the positions.
+	float speed;				//!< Sum of the speeds.
+	float topSpeed;				//!< Maximum of the speeds.
+	unsigned int count;			//!< Number of living fishies.
+};
+
+/*!
+ * @brief Partial summary of a part of the fishies of an ensemble member. Reduced to EnsembleMetrics by kernel_ensemble_metrics.
+ */
+struct MetricsPartial
+{
+	float3 sum;					//!< Sum of the positions.
+	float squared;				//!< Sum of the squared distances to the origin.
+	float speed;				//!< Sum of the speeds.
+	float nearest;				//!< Sum of the distances to the closest fish.
+	float nearestSquared;		//!< Sum of the squared distances to the closest fish.
+	float nearestMin;			//!< Smallest distance to the closest fish.
+	unsigned int count;			//!< Number of living fishies.
+	unsigned int paired;		//!< Number of living fishies with another living fish.
+};
+
+static const unsigned int MAX_STATS_BLOCKS = 256;				// Number of partial results of the first reduction pass.
+static const unsigned int DETERMINISTIC_STATS_THREADS = 256;	// Block size of the stats reduction in deterministic mode, the same on every GPU.
+static const unsigned int STATS_SAMPLE_THREADS = 256;			// Block of d_storeStatsSample.
+static const unsigned int ANALYTICS_THREADS = 256;				// Block of d_swarmAnalytics.
+static const unsigned int MAX_BLOCK_WARPS = 32;				// Warps per block for 1024 threads.
+static CudaDeviceArray<StatsPartial>* d_statsPartial;			// Partial results of the first reduction pass, one per block.
+static CudaDeviceArray<SwarmStats>* d_stats;					// Aggregates of the last kernel_reduce_stats.
+static CudaDeviceArray<unsigned int>* d_density;				// Fishies per texel of the last kernel_density, DENSITY_SIZE x DENSITY_SIZE.
+static CudaDeviceArray<MetricsPartial>* d_ensembleMetricsPartial;	// Ensemble: partial summaries, one per block and member.
+static CudaDeviceArray<EnsembleMetrics>* d_ensembleMetrics;		// Ensemble: summaries of the last kernel_ensemble_metrics.
+
+__constant__ SwarmParams c_params;								// Behaviour parameters. Read by all threads at once (broadcast).
+static SwarmParams h_params = SwarmParams::defaults();			// Host copy of c_params.
+static bool h_paramsDirty = true;								// h_params has to be uploaded before the next step.
+static unsigned int PARAMS_VERSION = 0;							// Incremented by kernel_set_params, so other contexts see the change.
+
+static const unsigned int MAX_WAYPOINTS = 256;					// Waypoints of all routes in constant memory.
+static const unsigned int MAX_SCHOOLS = 64;						// Schools with an own route and center.
+static const float SCHOOL_WAYPOINT_THRESHOLD = 0.1f;			// A school center closer to its waypoint goes on to the next one, like WAYPOINT_THRESHOLD on the host.
+static const unsigned int SPLINE_SAMPLES = 16;					// Spline paths: arc length samples per segment of a route.
+static const unsigned int SPLINE_FINE_STEPS = 64;				// Spline paths: chords per segment the arc length is measured with.
+static const unsigned int MAX_SPLINE_SAMPLES = MAX_WAYPOINTS * SPLINE_SAMPLES;	// Arc length samples of all routes, every route fits.
+
+/*!
+ * @brief Routes of the schools in constant memory (kernel_set_schools). Uploaded together with c_params.
+ */
+struct WaypointPath
+{
+	float4 points[MAX_WAYPOINTS];	// Waypoints of all routes (x, y, z), one route after the other.
+	uint2 routes[MAX_SCHOOLS];		// First waypoint and number of waypoints per school. After the last one the route starts again.
+	unsigned int count;				// Number of waypoints.
+	unsigned int schools;			// Number of schools. Up to 1 all fishies follow c_step.swarmCenter and the school table is unused, unless spline.
+	unsigned int spline;			// 1: the centers follow a closed centripetal Catmull-Rom spline through the waypoints, also a single school.
+	uint2 samples[MAX_SCHOOLS];		// Spline: first arc length sample in d_splineTable and number of samples per school.
+	float lengths[MAX_SCHOOLS];		// Spline: length of the closed route per school. 0: a single waypoint, the center stays.
+};
+
+__constant__ WaypointPath c_path;								// Routes of the schools. Read by all threads at once (broadcast).
+static WaypointPath h_path = {};								// Host copy of c_path.
+
+/*!
+ * @brief Center of a school, moved along its route on the GPU by d_moveSchools.
+ */
+struct SchoolState
+{
+	float4 center;					// Position the fishies of the school return to (x, y, z).
+	unsigned int cursor;			// Current waypoint, index inside the route of the school.
+	float distance;					// Spline: distance along the route since its first waypoint, below its length.
+};
+
+__device__ SchoolState d_schoolTable[MAX_SCHOOLS];				// School centers. Exists per device, every device moves its own copy.
+static SchoolState h_schoolTable[MAX_SCHOOLS];					// Start of the school centers, uploaded once per context.
+__device__ float d_splineTable[MAX_SPLINE_SAMPLES];				// Spline: parameter (segment + fraction) at evenly spaced distances along the routes.
+static float h_splineTable[MAX_SPLINE_SAMPLES];					// Host copy of d_splineTable, uploaded with h_schoolTable.
+static bool h_schoolsDirty = true;								// h_schoolTable has to be uploaded before the next step.
+static unsigned int SCHOOLS_VERSION = 0;						// Incremented by kernel_set_schools, so other contexts see the change.
+
+/*!
+ * @brief Species of the fishies (kernel_set_species). Uploaded together with c_params.
+ */
+struct SpeciesTable
+{
+	unsigned int count;				// Species. Up to 1 all fishies are alike and FEATURE_SPECIES is off.
+	float bounds[MAX_SPECIES];		// Cumulative shares: a fish belongs to the first species whose bound is above the hash of its id.
+	float reach;					// Largest fear * massMax of all species, for the conservative shark ranges outside d_swim.
+	SpeciesParams params[MAX_SPECIES];	// Traits per species.
+};
+
+__constant__ SpeciesTable c_species;							// Species. A warp of mixed species reads one entry per species in it.
+static SpeciesTable h_species = { 1, { 1.0f }, 1.0f, { SpeciesParams::defaults() } };	// Species of kernel_set_species.
+
+/*!
+ * @brief Distance field of the static obstacles (kernel_set_obstacles). Uploaded together with c_params.
+ */
+struct ObstacleField
+{
+	cudaTextureObject_t volume;		// float4 texels: gradient of the distance (x, y, z) and distance (w), trilinear filtered. 0: no obstacles.
+	float4 origin;					// Position of the first texel center.
+	float invCellSize;				// Texels per distance.
+	float range;					// Fishies closer than this to an obstacle are pushed away.
+};
+
+__constant__ ObstacleField c_obstacles;							// Obstacles. Read by all threads at once (broadcast), the volume by one fetch per fish.
+static ObstacleVolume h_obstacles;								// Texels of the volume, shared by all contexts.
+static float OBSTACLE_RANGE = 0.0f;								// Range of kernel_set_obstacles.
+static unsigned int OBSTACLES_VERSION = 0;						// Incremented by kernel_set_obstacles, every context rebuilds its texture.
+static cudaArray_t d_obstacleArray = NULL;						// 3D array of the volume on the device of this context.
+static cudaTextureObject_t d_obstacleVolume = 0;				// Texture of d_obstacleArray. 0: none.
+static unsigned int obstacleVersion = 0;						// OBSTACLES_VERSION of d_obstacleArray.
+
+static const unsigned int ATTRACTOR_THREADS = 256;				// Block of d_bakeAttractors, also the attractors per tile in shared memory.
+static const float ATTRACTOR_PEAK = 2.598076f;					// 1 / maximum of q (1 - q^2), at q = 1 / sqrt(3): scales the pull to its strength.
+
+/*!
+ * @brief An attractor in the device array of kernel_set_attractors.
+ */
+struct AttractorSource
+{
+	float4 center;					// Position (x, y, z) and 1 / radius (w).
+	float strength;					// Peak acceleration in full accelerations. Negative: repels.
+};
+
+/*!
+ * @brief Summed field of the attractors (kernel_set_attractors). Uploaded together with c_params.
+ */
+struct AttractorField
+{
+	cudaTextureObject_t volume;		// float4 texels: acceleration in full accelerations (x, y, z) and potential (w), trilinear filtered. 0: no attractors.
+	float4 origin;					// Position of the first texel center.
+	float invCellSize;				// Texels per distance.
+};
+
+__constant__ AttractorField c_attractors;						// Attractors. Read by all threads at once (broadcast), the volume by one fetch per fish.
+static AttractorVolume h_attractors;							// Grid of the field, shared by all contexts.
+static std::vector<AttractorSource> h_attractorSources;			// Attractors of h_attractors, converted once, shared by all contexts.
+static unsigned int ATTRACTORS_VERSION = 0;						// Incremented by kernel_set_attractors, every context bakes its texture again.
+static CudaDeviceArray<AttractorSource>* d_attractorSources = NULL;	// Attractors on the device of this context.
+static cudaArray_t d_attractorArray = NULL;						// 3D array of the field on the device of this context, written by d_bakeAttractors.
+static cudaSurfaceObject_t d_attractorSurface = 0;				// Surface of d_attractorArray for the bake.
+static cudaTextureObject_t d_attractorVolume = 0;				// Texture of d_attractorArray. 0: none.
+static unsigned int attractorVersion = 0;						// ATTRACTORS_VERSION of d_attractorArray.
+
+static const unsigned int ALARM_THREADS = 256;					// Block of d_diffuseAlarm.
+static const float ALARM_DIFFUSION = 0.15f;						// Share of the difference to each of the 6 neighbour cells that flows per step. Below 1/6 for stability.
+static const float ALARM_QUIET = 1e-3f;							// Fishies ignore less alarm than this.
+
+/*!
+ * @brief Alarm field (kernel_set_alarm). Uploaded together with c_params, the buffers are the ones of the context.
+ */
+struct AlarmGrid
+{
+	float* levels[2];				// Alarm per cell, x fastest. A step reads levels[(step & 1) ^ 1], d_diffuseAlarm writes it from the other one.
+	float* deposits;				// Alarm deposited during the step, added and cleared by the next d_diffuseAlarm. NULL: no alarm.
+	int3 dims;						// Cells along x, y and z.
+	float4 origin;					// Position of the first cell corner.
+	float invCellSize;				// Cells per distance.
+	float deposit;					// Alarm an evading fish deposits per step.
+	float decay;					// Fraction a cell keeps per step.
+};
+
+__constant__ AlarmGrid c_alarm;									// Alarm. Read by all threads at once (broadcast).
+static AlarmField h_alarm;										// Grid and rates of kernel_set_alarm, shared by all contexts.
+static unsigned int ALARM_VERSION = 0;							// Incremented by kernel_set_alarm, every context allocates its field again.
+static CudaDeviceArray<float>* d_alarm = NULL;					// Both levels and the deposits of this context, cells floats each.
+static unsigned int alarmVersion = 0;							// ALARM_VERSION of d_alarm.
+
+static const unsigned int CURRENT_SLOTS = 3;					// Time slices of the current on the device: from, to and the next one.
+
+/*!
+ * @brief Current of the water (kernel_set_current). Uploaded together with c_params, the slots of a step are in c_step.
+ */
+struct CurrentField
+{
+	cudaTextureObject_t slices[CURRENT_SLOTS];	// half4 texels: velocity (x, y, z), trilinear filtered. slices[0] == 0: still water.
+	float4 origin;					// Position of the first texel center.
+	float invCellSize;				// Texels per distance.
+	float strength;					// Distance per step at a velocity of 1.
+};
+
+/*!
+ * @brief Time slices of the current on the device of a context. Slice s is in slot s % CURRENT_SLOTS.
+ * When the steps go on to the next slice, the slot of the last one is refilled on the side stream.
+ */
+struct CurrentSlots
+{
+	cudaArray_t arrays[CURRENT_SLOTS] = {};
+	cudaTextureObject_t textures[CURRENT_SLOTS] = {};
+	cudaSurfaceObject_t surfaces[CURRENT_SLOTS] = {};	// Curl noise only, written by d_curlNoise.
+	cudaEvent_t ready[CURRENT_SLOTS] = {};				// Recorded on the side stream after a slot was filled.
+	unsigned int fill[CURRENT_SLOTS] = {};				// Slice of the next refill per slot.
+	cudaEvent_t released = NULL;						// Recorded on the step stream before the refills, the steps before are done with the slots.
+	cudaStream_t stream = NULL;							// Side stream of the fills.
+	unsigned int version = 0;							// CURRENT_FIELD_VERSION of the slots.
+	unsigned int step = 0;								// Steps since the slots were filled.
+	unsigned int waits = 0;								// Bit per slot the step stream has to wait for before the next step.
+	unsigned int refills = 0;							// Bit per slot to refill once the steps before are enqueued.
+};
+
+__constant__ CurrentField c_current;							// Current. Read by all threads at once (broadcast), the slices by two fetches per fish.
+static CurrentVolume h_current;									// Grid of the current, without texels.
+static CudaHostArray<__half>* h_currentTexels = NULL;			// Slices of a current file as half4, pinned for the async refills. Shared by all contexts.
+static float CURRENT_STRENGTH = 0.0f;							// Strength of kernel_set_current.
+static unsigned int CURRENT_PERIOD = 240;						// Steps per slice.
+static unsigned int CURRENT_FIELD_VERSION = 0;					// Incremented by kernel_set_current, every context fills its slots again.
+static int BACKGROUND_PRIORITY = 0;								// Priority of the side streams (kernel_set_background_priority).
+static CurrentSlots currentSlots;								// Slots of this context.
+
+/*!
+ * @brief Node of the linear BVH of the far field (kernel_set_far_field). For n fishies nodes 0 to n - 2 are internal
+ * with node 0 as root, leaf i is node n - 1 + i and holds the i-th fish in Morton order. A single fish is the root itself.
+ */
+struct BvhNode
+{
+	float4 center;					// Mass weighted center of the fishies below (x, y, z) and their mass (w). Dead fishies have mass 0.
+	float4 velocity;				// Mass weighted sum of their speed vectors (x, y, z) and longest edge of the box (w).
+	float4 boxMin;					// Lower corner of the bounding box (x, y, z).
+	float4 boxMax;					// Upper corner of the bounding box (x, y, z). Below boxMin: empty.
+	int2 children;					// Left and right child. -1: leaf.
+	int parent;						// Parent node. -1: root.
+	unsigned int fish;				// Leaf: slot of the fish.
+};
+
+/*!
+ * @brief Far field of the swarm (kernel_set_far_field): the BVH of this step and the strength of its forces.
+ * Uploaded by every advance that rebuilds the tree.
+ */
+struct FarField
+{
+	const BvhNode* nodes;			// Nodes of the tree. NULL: no far field.
+	float cohesion;					// Pull to the far fishies, relative to the acceleration of a fish.
+	float alignment;				// Share of the mean far speed vector steered to per step.
+	float theta2;					// Squared opening angle: a node counts as a whole if its edge^2 < theta2 * distance^2.
+	float nearDist2;				// Fishies closer than fishDist are left to the neighbour search (squared).
+};
+
+static const unsigned int BVH_STACK_SIZE = 64;					// Traversal stack of d_farFieldSteer. Deeper trees are cut off, the node counts as a whole.
+
+__constant__ FarField c_farField;								// Far field. Read by all threads at once (broadcast), the nodes through the cache.
+static float FAR_COHESION = 0.0f;								// Cohesion of kernel_set_far_field. 0 and FAR_ALIGNMENT 0: no tree.
+static float FAR_ALIGNMENT = 0.0f;								// Alignment of kernel_set_far_field.
+static float FAR_THETA = 0.5f;									// Opening angle of kernel_set_far_field.
+static CudaDeviceArray<BvhNode>* d_bvhNodes = NULL;				// Far field: 2 n - 1 nodes. Allocated by the first build.
+static CudaDeviceArray<unsigned int>* d_bvhCodes = NULL;		// Far field: Morton codes, sorted.
+static CudaDeviceArray<unsigned int>* d_bvhOrder = NULL;		// Far field: slot of each fish in Morton order.
+static CudaDeviceArray<unsigned int>* d_bvhVisits = NULL;		// Far field: children of each internal node merged so far.
+
+/*
+ * Random numbers: counter based Philox generator keyed by (seed, fish, step, use).
+ * Nothing has to be stored per fish, the same seed always gives the same numbers.
+ */
+struct RandomKey
+{
+	unsigned long long seed;		// Seed of the simulation.
+	unsigned int step;				// Number of the current step.
+};
+
+enum RandomUse
+{
+	RANDOM_JITTER = 0,				// Behaviour noise in d_swim and d_swimBoids.
+	RANDOM_SPAWN = 1,				// Position and mass of spawned and respawned fishies.
+	RANDOM_COLOR = 2,				// Shade of spawned fishies (kernel_spawn).
+	RANDOM_USES = 3
+};
+
+/*
+ * Append buffer of the fish events of a step (see EventBuffers). events is NULL without events.
+ */
+struct EventQueue
+{
+	SwarmEvent* events;				// Buffer, device pointer of mapped pinned memory.
+	unsigned int* count;			// Counter of the buffer. Events beyond the capacity are counted, but not written.
+	unsigned int capacity;			// Length of the buffer.
+};
+
+/*
+ * Inputs that change every step. They are in constant memory instead of kernel parameters,
+ * so a captured CUDA graph can be replayed with new values (see kernel_begin_capture).
+ */
+struct StepInputs
+{
+	RandomKey random;				// Random key of the step.
+	float4 swarmCenter;				// Waypoint the swarm follows (x, y, z).
+	uint2 currentSlots;				// Slots of c_current.slices blended in this step (from, to).
+	float currentBlend;				// Weight of the second slot.
+	unsigned int sharkBites;		// 1: the sharks bite in d_huntSharks, the fishies don't check the bite distance.
+	EventQueue events;				// Buffer the fish events of this step are appended to.
+	float4 focus;					// Camera position of kernel_set_focus (x, y, z), fishies close to it advance every step.
+	float fixedPoint;				// Deterministic mode: lattice points per unit of positions and speed vectors. 0: off.
+	float dtScale;					// Length of the step in base steps (kernel_set_step_scale). 1 with Integrator::LEGACY.
+	Integrator integrator;			// How the fishies and sharks move over the step (kernel_set_integrator).
+};
+
+__constant__ StepInputs c_step;									// Inputs of the current step.
+static StepInputs h_step = { { 1, 0 }, { 0, 0, 0, 0 }, { 0, 1 }, 0.0f, 0, { NULL, NULL, 0 }, { 0, 0, 0, 0 }, 0.0f, 1.0f, Integrator::LEGACY };	// Host copy of c_step. random.step counts the calls of kernel_advance.
+
+/*
+ * Scenario timeline (kernel_set_timeline): the events are in constant memory, d_applyTimeline folds the ones up to the step
+ * of c_step into d_timelineState and device to device copies move it into c_params, c_step and c_current. The sharks are parked
+ * and woken by d_timelineSharks. No host call per event, so captured graphs replay the timeline as well.
+ */
+struct Timeline
+{
+	TimelineEvent events[MAX_TIMELINE_EVENTS];	// Sorted by step.
+	unsigned int count;				// Number of events. 0: no timeline.
+	unsigned int actions;			// Bit per TimelineAction of the events.
+	SwarmParams base;				// Parameters of kernel_set_params, the PARAM events replace single fields.
+	float currentStrength;			// Strength of kernel_set_current, until the first CURRENT event.
+};
+
+/*
+ * Inputs of the step after the due events, written by d_applyTimeline.
+ */
+struct TimelineState
+{
+	SwarmParams params;				// Copied into c_params.
+	float4 swarmCenter;				// Copied into c_step.swarmCenter.
+	float currentStrength;			// Copied into c_current.strength.
+	unsigned int respawnLimit;		// Spawns per step, read by d_spawn.
+};
+
+static const float SHARK_PARK_DISTANCE = 1.0e4f;				// Inactive sharks wait this far away from the origin, where no fish sees them.
+
+__constant__ Timeline c_timeline;								// Events of the timeline.
+__device__ TimelineState d_timelineState;						// Result of d_applyTimeline for this step.
+static Timeline h_timeline = {};								// Host copy of c_timeline, uploaded with the parameters.
+
+/*!
+ * @brief Check if the timeline has events of an action.
+ * @param action action.
+ * @return true, if at least one event of the action is set.
+ */
+static bool timelineHas(TimelineAction action)
+{
+	return ( h_timeline.actions & ( 1u << static_cast< unsigned int >( action ) ) ) != 0;
+}
+
+/*
+ * Multi-rate steps (kernel_set_multi_rate): the grid search sorts the fishies into buckets by importance every step.
+ * Bucket 0 is advanced every step, bucket 1 every interval steps with interval steps of motion, one launch per bucket.
+ */
+struct RateSettings
+{
+	unsigned int interval;			// Steps between two advances of an unimportant fish. Up to 1: no buckets.
+	float sharkRange;				// Fishies closer than sharkRange * sharkDist to a shark are in bucket 0.
+	float focusRange;				// Fishies closer than this to the focus are in bucket 0. 0: the focus doesn't count.
+};
+
+static const unsigned int RATE_BUCKETS = 2;						// Every step, every interval steps.
+static RateSettings MULTI_RATE = { 0, 3.0f, 0.0f };				// Settings of the multi-rate steps.
+static CudaDeviceArray<unsigned int>* d_rateBuckets;			// Multi-rate: sorted indices of bucket b from b * mesh_count on.
+static CudaDeviceArray<unsigned int>* d_rateCounts;				// Multi-rate: number of indices per bucket.
+
+/*
+ * Substeps (kernel_advance_substeps): one block runs several steps of a small swarm in shared memory.
+ * The steps of a launch can't read c_step, their swarm centers and random steps are a kernel parameter.
+ */
+static const unsigned int MAX_SUBSTEPS = 32;					// Steps per launch of d_advance_substeps.
+static const unsigned int SUBSTEP_THREADS = 512;				// Block size of d_advance_substeps.
+static unsigned int SUBSTEP_SHARED = 0;							// Dynamic shared memory d_advance_substeps may use on this GPU.
+
+/*
+ * Inputs of all steps of one d_advance_substeps launch.
+ */
+struct SubstepInputs
+{
+	float4 swarmCenter[MAX_SUBSTEPS];	// Swarm center of every step.
+	unsigned int firstStep;				// Random step of the first step, the next ones follow.
+	unsigned int steps;					// Number of steps.
+};
+
+/*
+ * Inputs of the running step inside d_advance_substeps, read instead of c_step with FEATURE_SUBSTEPS.
+ */
+struct SubstepState
+{
+	float4 swarmCenter;				// Swarm center of the step.
+	unsigned int step;				// Random step of the step.
+};
+
+__shared__ SubstepState s_substep;								// Written by thread 0 before every step.
+
+/*
+ * Fish events (kernel_init_events): two append buffers in mapped pinned memory. The kernels of a frame append to one,
+ * while the host reads the other one, which kernel_drain_events closed a frame before. Every buffer has its own counter on the device.
+ */
+struct EventBuffers
+{
+	CudaHostArray<SwarmEvent>* events[2] = { NULL, NULL };	// Mapped pinned buffers.
+	SwarmEvent* deviceEvents[2] = { NULL, NULL };			// Device pointers of the buffers.
+	CudaDeviceArray<unsigned int>* count = NULL;			// Appended events per buffer, including the ones beyond the capacity.
+	CudaHostArray<unsigned int>* hostCount = NULL;			// Read back of count.
+	cudaEvent_t read = NULL;								// Recorded after the read back of the counter of the closed buffer.
+	unsigned int capacity = 0;								// Events per buffer. 0: no events.
+	unsigned int active = 0;								// Buffer the kernels append to.
+	bool pending = false;									// The other buffer was closed and is not drained yet.
+};
+
+static EventBuffers EVENTS;										// Event buffers of this device.
+
+/*!
+ * @brief Queue of the buffer the kernels append to now.
+ * @return queue, events is NULL without event buffers.
+ */
+static EventQueue activeEventQueue()
+{
+	EventQueue queue = { NULL, NULL, 0 };
+	if (EVENTS.capacity > 0)
+	{
+		queue.events = EVENTS.deviceEvents[EVENTS.active];
+		queue.count = EVENTS.count->getData() + EVENTS.active;
+		queue.capacity = EVENTS.capacity;
+	}
+	return queue;
+}
+
+/*!
+ * @brief Free the event buffers of this device. The next steps log no events.
+ */
+static void releaseEvents()
+{
+	for (int i = 0; i < 2; i++)
+		delete EVENTS.events[i];
+	delete EVENTS.count;
+	delete EVENTS.hostCount;
+	if (EVENTS.read != NULL)
+		CUDA_CHECK( cudaEventDestroy( EVENTS.read ) );
+	EVENTS = EventBuffers();
+}
+
+/*
+ * Captured steps (kernel_begin_capture): the graph copies c_step of step i from pinned slot i,
+ * which kernel_set_captured_step fills before every replay.
+ */
+static const unsigned int MAX_CAPTURED_STEPS = 16;				// Slots, i.e. maximum steps per graph.
+static CudaHostArray<StepInputs>* h_capturedSteps;				// Pinned inputs of the captured steps.
+static cudaEvent_t capturedStepsRead;							// Recorded after the last replay, the slots can be written again.
+static cudaGraphExec_t capturedGraph = NULL;					// Executable graph of the last capture.
+static CaptureKey capturedKey;									// Key of capturedGraph.
+static unsigned int capturedVersion = 0;						// GRAPH_VERSION of capturedGraph.
+static unsigned int capturedSteps = 0;							// Number of steps in capturedGraph.
+static unsigned int CAPTURE_SLOT = 0;							// Slot of the next step while capturing.
+static unsigned int CAPTURE_STEP = 0;							// h_step.random.step when the capture started.
+static unsigned int GRAPH_VERSION = 0;							// Incremented by settings that are baked into a captured graph.
+
+/*!
+ * @brief Everything above that belongs to one device: launch configurations, grid, scratch memory, Verlet lists and graph.
+ * The module keeps working on the statics, kernel_use_context swaps them with the members of a context.
+ * Behaviour, search mode, parameters and the random key are shared by all contexts.
+ */
+struct KernelContext
+{
+	LaunchConfig launchAdvance, launchTiled, launchTiledAsync, launchWarp, launchHash, launchReorder, launchGrid, launchBoids, launchSharks, launchHunt, launchPack,
+		launchTrajectory, launchCollect, launchSpawn, launchSpawnAll, launchStats, launchMorton, launchPermute, launchColors, launchVerletBuild,
+		launchVerlet, launchDisplacement, launchPartition, launchClassify, launchDepth, launchSplat, launchShade, launchTrail,
+		launchCurrent, launchEnsemble, launchEnsembleMetrics, launchBvhLeaves, launchBvhInternal, launchBvhMerge, launchRates;
+	GridLayout gridLayout = GRID_LAYOUT;
+	CudaDeviceArray<unsigned int>* gridParticleHash = NULL;
+	CudaDeviceArray<unsigned int>* gridParticleIndex = NULL;
+	CudaDeviceArray<unsigned int>* cellStart = NULL;
+	CudaDeviceArray<unsigned int>* cellEnd = NULL;
+	ParticleStore* sorted = NULL;
+	CudaDeviceArray<ushort4>* sortedPacked = NULL;
+	unsigned int cooperativeBlocks = 0;
+	bool tensorCores = false;
+	bool asyncTiles = false;
+	bool clusterCells = false;
+	unsigned int substepShared = 0;
+	CudaDeviceArray<unsigned int>* cellRank = NULL;
+	CudaDeviceArray<unsigned int>* blockSums = NULL;
+	CudaDeviceArray<unsigned int>* nearest = NULL;
+	CudaDeviceArray<float4>* cellVelocity = NULL;
+	CudaDeviceArray<float4>* cellCentroid = NULL;
+	CudaDeviceArray<float4>* collisionPositions = NULL;
+	CudaDeviceArray<float4>* collisionDeltas = NULL;
+	CudaDeviceArray<unsigned long long>* cellKeys = NULL;
+	unsigned int hashSlots = MIN_HASH_SLOTS;
+	CudaDeviceArray<unsigned long long>* clusterKeys = NULL;
+	CudaDeviceArray<float4>* clusterSums = NULL;
+	CudaDeviceArray<float4>* clusterMoments = NULL;
+	size_t l2PersistMax = 0;
+	size_t l2WindowMax = 0;
+	cudaStream_t l2Stream = NULL;
+	cudaAccessPolicyWindow l2Window = {};
+	DeviceArena* arena = NULL;
+	CudaDeviceArray<unsigned int>* freeList = NULL;
+	CudaDeviceArray<unsigned int>* freeCount = NULL;
+	CudaDeviceArray<unsigned int>* flockList = NULL;
+	CudaDeviceArray<unsigned int>* flockCount = NULL;
+	CudaDeviceArray<unsigned int>* rateBuckets = NULL;
+	CudaDeviceArray<unsigned int>* rateCounts = NULL;
+	CudaDeviceArray<unsigned int>* sharkClaims = NULL;
+	bool sharkGrid = false;
+	ParticleArrays sharkPrey = {};
+	bool queryGrid = false;
+	bool advanceNearest = false;
+	unsigned int sharkPreyCount = 0;
+	CudaDeviceArray<uint2>* ensembleMembers = NULL;
+	CudaDeviceArray<SwarmParams>* ensembleParams = NULL;
+	unsigned int ensembleSize = 0;
+	unsigned int ensembleMaxCount = 0;
+	unsigned int ensembleSharks = 0;
+	bool ensembleJitter = false;
+	CudaDeviceArray<MetricsPartial>* ensembleMetricsPartial = NULL;
+	CudaDeviceArray<EnsembleMetrics>* ensembleMetrics = NULL;
+	CudaDeviceArray<BvhNode>* bvhNodes = NULL;
+	CudaDeviceArray<unsigned int>* bvhCodes = NULL;
+	CudaDeviceArray<unsigned int>* bvhOrder = NULL;
+	CudaDeviceArray<unsigned int>* bvhVisits = NULL;
+	CudaDeviceArray<unsigned int>* verletList = NULL;
+	CudaDeviceArray<unsigned int>* verletCount = NULL;
+	CudaDeviceArray<float4>* verletRef = NULL;
+	CudaDeviceArray<unsigned int>* verletMax = NULL;
+	CudaHostArray<float>* hostVerletMax = NULL;
+	cudaEvent_t verletRead = NULL;
+	bool verletValid = false;
+	unsigned int verletCount_ = 0;
+	bool verletReadPending = false;
+	bool verletReadStale = false;
+	unsigned int verletReadAgo = 0;
+	float verletDisplacement = 0.0f;
+	float verletStep = 0.0f;
+	unsigned int verletUnknownSteps = 0;
+	CudaDeviceArray<StatsPartial>* statsPartial = NULL;
+	CudaDeviceArray<SwarmStats>* stats = NULL;
+	CudaDeviceArray<unsigned int>* density = NULL;
+	bool paramsDirty = true;										// c_params exists per device, a new context uploads it once.
+	unsigned int paramsVersion = PARAMS_VERSION;
+	bool schoolsDirty = true;										// d_schoolTable exists per device too.
+	unsigned int schoolsVersion = SCHOOLS_VERSION;
+	cudaArray_t obstacleArray = NULL;								// The texture exists per device as well.
+	cudaTextureObject_t obstacleVolume = 0;
+	unsigned int obstacleVersion_ = 0;
+	CudaDeviceArray<AttractorSource>* attractorSources = NULL;
+	cudaArray_t attractorArray = NULL;
+	cudaSurfaceObject_t attractorSurface = 0;
+	cudaTextureObject_t attractorVolume = 0;
+	unsigned int attractorVersion_ = 0;
+	CudaDeviceArray<float>* alarm = NULL;
+	unsigned int alarmVersion_ = 0;
+	CurrentSlots currentSlots;
+	EventBuffers events;
+	CudaHostArray<StepInputs>* capturedStepsHost = NULL;
+	cudaEvent_t capturedStepsRead = NULL;
+	cudaGraphExec_t capturedGraph = NULL;
+	CaptureKey capturedKey = {};
+	unsigned int capturedVersion = 0;
+	unsigned int capturedSteps = 0;
+	unsigned int captureSlot = 0;
+	unsigned int captureStep = 0;
+	RtcAdvance* rtcAdvance = NULL;									// Modules are loaded per device.
+	RtcAdvanceKey rtcTried;
+};
+
+static KernelContext* ACTIVE_CONTEXT = NULL;					// Context whose state is in the statics. NULL: the default context.
+static KernelContext DEFAULT_CONTEXT;							// Holds the state of the default context while another one is active.
+
+/*!
+ * @brief Swap the per device statics with a context.
+ * @param c context.
+ */
+static void swapContext(KernelContext& c)
+{
+	std::swap( LAUNCH_ADVANCE, c.launchAdvance );
+	std::swap( LAUNCH_TILED, c.launchTiled );
+	std::swap( LAUNCH_TILED_ASYNC, c.launchTiledAsync );
+	std::swap( LAUNCH_WARP, c.launchWarp );
+	std::swap( LAUNCH_HASH, c.launchHash );
+	std::swap( LAUNCH_REORDER, c.launchReorder );
+	std::swap( LAUNCH_GRID, c.launchGrid );
+	std::swap( LAUNCH_BOIDS, c.launchBoids );
+	std::swap( LAUNCH_SHARKS, c.launchSharks );
+	std::swap( LAUNCH_HUNT, c.launchHunt );
+	std::swap( LAUNCH_PACK, c.launchPack );
+	std::swap( LAUNCH_TRAJECTORY, c.launchTrajectory );
+	std::swap( LAUNCH_COLLECT, c.launchCollect );
+	std::swap( LAUNCH_SPAWN, c.launchSpawn );
+	std::swap( LAUNCH_SPAWN_ALL, c.launchSpawnAll );
+	std::swap( LAUNCH_STATS, c.launchStats );
+	std::swap( LAUNCH_MORTON, c.launchMorton );
+	std::swap( LAUNCH_PERMUTE, c.launchPermute );
+	std::swap( LAUNCH_COLORS, c.launchColors );
+	std::swap( LAUNCH_DEPTH, c.launchDepth );
+	std::swap( LAUNCH_SPLAT, c.launchSplat );
+	std::swap( LAUNCH_SHADE, c.launchShade );
+	std::swap( LAUNCH_TRAIL, c.launchTrail );
+	std::swap( LAUNCH_CURRENT, c.launchCurrent );
+	std::swap( LAUNCH_ENSEMBLE, c.launchEnsemble );
+	std::swap( LAUNCH_ENSEMBLE_METRICS, c.launchEnsembleMetrics );
+	std::swap( LAUNCH_VERLET_BUILD, c.launchVerletBuild );
+	std::swap( LAUNCH_VERLET, c.launchVerlet );
+	std::swap( LAUNCH_DISPLACEMENT, c.launchDisplacement );
+	std::swap( LAUNCH_PARTITION, c.launchPartition );
+	std::swap( LAUNCH_CLASSIFY, c.launchClassify );
+	std::swap( LAUNCH_BVH_LEAVES, c.launchBvhLeaves );
+	std::swap( LAUNCH_BVH_INTERNAL, c.launchBvhInternal );
+	std::swap( LAUNCH_BVH_MERGE, c.launchBvhMerge );
+	std::swap( LAUNCH_RATES, c.launchRates );
+	std::swap( GRID_LAYOUT, c.gridLayout );
+	std::swap( d_gridParticleHash, c.gridParticleHash );
+	std::swap( d_gridParticleIndex, c.gridParticleIndex );
+	std::swap( d_cellStart, c.cellStart );
+	std::swap( d_cellEnd, c.cellEnd );
+	std::swap( d_sorted, c.sorted );
+	std::swap( d_sortedPacked, c.sortedPacked );
+	std::swap( COOPERATIVE_BLOCKS, c.cooperativeBlocks );
+	std::swap( TENSOR_CORES, c.tensorCores );
+	std::swap( ASYNC_TILES, c.asyncTiles );
+	std::swap( CLUSTER_CELLS, c.clusterCells );
+	std::swap( SUBSTEP_SHARED, c.substepShared );
+	std::swap( d_cellRank, c.cellRank );
+	std::swap( d_nearest, c.nearest );
+	std::swap( d_cellVelocity, c.cellVelocity );
+	std::swap( d_cellCentroid, c.cellCentroid );
+	std::swap( d_collisionPositions, c.collisionPositions );
+	std::swap( d_collisionDeltas, c.collisionDeltas );
+	std::swap( d_cellKeys, c.cellKeys );
+	std::swap( HASH_SLOTS, c.hashSlots );
+	std::swap( d_clusterKeys, c.clusterKeys );
+	std::swap( d_clusterSums, c.clusterSums );
+	std::swap( d_clusterMoments, c.clusterMoments );
+	std::swap( L2_PERSIST_MAX, c.l2PersistMax );
+	std::swap( L2_WINDOW_MAX, c.l2WindowMax );
+	std::swap( L2_STREAM, c.l2Stream );
+	std::swap( L2_WINDOW, c.l2Window );
+	std::swap( d_blockSums, c.blockSums );
+	std::swap( d_arena, c.arena );
+	std::swap( d_freeList, c.freeList );
+	std::swap( d_freeCount, c.freeCount );
+	std::swap( d_flockList, c.flockList );
+	std::swap( d_rateBuckets, c.rateBuckets );
+	std::swap( d_rateCounts, c.rateCounts );
+	std::swap( d_flockCount, c.flockCount );
+	std::swap( d_sharkClaims, c.sharkClaims );
+	std::swap( SHARK_GRID, c.sharkGrid );
+	std::swap( SHARK_PREY, c.sharkPrey );
+	std::swap( QUERY_GRID, c.queryGrid );
+	std::swap( ADVANCE_NEAREST, c.advanceNearest );
+	std::swap( SHARK_PREY_COUNT, c.sharkPreyCount );
+	std::swap( d_ensembleMembers, c.ensembleMembers );
+	std::swap( d_ensembleParams, c.ensembleParams );
+	std::swap( ENSEMBLE_SIZE, c.ensembleSize );
+	std::swap( ENSEMBLE_MAX_COUNT, c.ensembleMaxCount );
+	std::swap( ENSEMBLE_SHARKS, c.ensembleSharks );
+	std::swap( ENSEMBLE_JITTER, c.ensembleJitter );
+	std::swap( d_ensembleMetricsPartial, c.ensembleMetricsPartial );
+	std::swap( d_ensembleMetrics, c.ensembleMetrics );
+	std::swap( d_bvhNodes, c.bvhNodes );
+	std::swap( d_bvhCodes, c.bvhCodes );
+	std::swap( d_bvhOrder, c.bvhOrder );
+	std::swap( d_bvhVisits, c.bvhVisits );
+	std::swap( d_verletList, c.verletList );
+	std::swap( d_verletCount, c.verletCount );
+	std::swap( d_verletRef, c.verletRef );
+	std::swap( d_verletMax, c.verletMax );
+	std::swap( h_verletMax, c.hostVerletMax );
+	std::swap( verletRead, c.verletRead );
+	std::swap( VERLET_VALID, c.verletValid );
+	std::swap( VERLET_COUNT, c.verletCount_ );
+	std::swap( VERLET_READ_PENDING, c.verletReadPending );
+	std::swap( VERLET_READ_STALE, c.verletReadStale );
+	std::swap( VERLET_READ_AGO, c.verletReadAgo );
+	std::swap( VERLET_DISPLACEMENT, c.verletDisplacement );
+	std::swap( VERLET_STEP, c.verletStep );
+	std::swap( VERLET_UNKNOWN_STEPS, c.verletUnknownSteps );
+	std::swap( d_statsPartial, c.statsPartial );
+	std::swap( d_stats, c.stats );
+	std::swap( d_density, c.density );
+	std::swap( h_paramsDirty, c.paramsDirty );
+	std::swap( h_schoolsDirty, c.schoolsDirty );
+	std::swap( d_obstacleArray, c.obstacleArray );
+	std::swap( d_obstacleVolume, c.obstacleVolume );
+	std::swap( obstacleVersion, c.obstacleVersion_ );
+	std::swap( d_attractorSources, c.attractorSources );
+	std::swap( d_attractorArray, c.attractorArray );
+	std::swap( d_attractorSurface, c.attractorSurface );
+	std::swap( d_attractorVolume, c.attractorVolume );
+	std::swap( attractorVersion, c.attractorVersion_ );
+	std::swap( d_alarm, c.alarm );
+	std::swap( alarmVersion, c.alarmVersion_ );
+	std::swap( currentSlots, c.currentSlots );
+	std::swap( EVENTS, c.events );
+	std::swap( h_capturedSteps, c.capturedStepsHost );
+	std::swap( capturedStepsRead, c.capturedStepsRead );
+	std::swap( capturedGraph, c.capturedGraph );
+	std::swap( capturedKey, c.capturedKey );
+	std::swap( capturedVersion, c.capturedVersion );
+	std::swap( capturedSteps, c.capturedSteps );
+	std::swap( CAPTURE_SLOT, c.captureSlot );
+	std::swap( CAPTURE_STEP, c.captureStep );
+	std::swap( RTC_ADVANCE, c.rtcAdvance );
+	std::swap( RTC_TRIED, c.rtcTried );
+}
+
+__constant__ float4 c_sharks[MAX_CONSTANT_SHARKS];				// Shark positions for small numbers of sharks. All threads read the same shark at once (broadcast).
+
+/*
+ * Build option: define SWARM_PRECISE_MATH to use the old double precision vector math (pow, sqrt) in DeviceVector.
+ * It is kept to validate the fast single precision path, which is used by default.
+ */
 
 class DeviceVector;
 
@@ -93,6 +1008,23 @@ public:
 		x( x ), y( y ), z( z ), w( w )
 	{}
 
+	/*!
+	 * @brief Constructor.
+	 * @param v shared vector type, w is taken over.
+	 */
+	__host__ __device__ DeviceVector( const SwarmVector& v ) :
+		x( v.x ), y( v.y ), z( v.z ), w( v.w )
+	{}
+
+	/*!
+	 * @brief Get the shared vector type. Its math ignores w, so results can differ from the one of DeviceVector.
+	 * @return vector.
+	 */
+	__host__ __device__ SwarmVector toSwarmVector() const
+	{
+		return SwarmVector( x, y, z, w );
+	}
+
 	/*!
 	 * @brief Calculate Dot Product of two Device Vectors.
 	 * @param vec Other DeviceVector instance.
@@ -103,13 +1035,35 @@ public:
 		return x * vec->x + y * vec->y + z * vec->z;
 	}
 
+	/*!
+	 * @brief Get squared Length of DeviceVector.
+	 * @return squared length
+	 */
+	__device__ float lengthSquared() const
+	{
+		return fmaf(x, x, fmaf(y, y, fmaf(z, z, w * w)));
+	}
+
+	/*!
+	 * @brief Get squared Length of DeviceVector(3)
+	 * @return squared length
+	 */
+	__device__ float length3Squared() const
+	{
+		return fmaf(x, x, fmaf(y, y, z * z));
+	}
+
 	/*!
 	 * @brief Get Length of DeviceVector.
 	 * @return length
 	 */
 	__device__ float length()
 	{
+#ifdef SWARM_PRECISE_MATH
 		return sqrt(pow(x, 2) + pow(y, 2) + pow(z, 2) + pow(w, 2) );
+#else
+		return sqrtf(lengthSquared());
+#endif
 	}
 
 	/*!
@@ -118,7 +1072,11 @@ public:
 	 */
 	__device__ float length3()
 	{
+#ifdef SWARM_PRECISE_MATH
 		return sqrt(pow(x, 2) + pow(y, 2) + pow(z, 2));
+#else
+		return sqrtf(length3Squared());
+#endif
 	}
 
 	/*!
@@ -153,8 +1111,13 @@ public:
 	 */
 	__device__ DeviceVector normalized()
 	{
+#ifdef SWARM_PRECISE_MATH
 		float len = length();
 		return DeviceVector( x / len, y / len, z / len );
+#else
+		float inv = rsqrtf(lengthSquared());
+		return DeviceVector( x * inv, y * inv, z * inv );
+#endif
 	}
 
 	/*!
@@ -235,142 +1198,9711 @@ public:
 
 /********************************
  *
- * Kernel Stuff
+ * Uniform Grid
  *
  ********************************/
 
-
-/*
- * The following 2 functions taken from the cuda samples
+/*!
+ * @brief Calculate the cell of a position in the uniform grid.
+ * @param p position.
+ * @param grid grid placement.
+ * @return cell coordinates (can be outside of the grid).
  */
-int iDivUp(int a, int b)
+__device__ int3 d_calcGridPos( DeviceVector p, const GridLayout& grid )
 {
-    return (a % b != 0) ? (a / b + 1) : (a / b);
+	int3 gridPos;
+	gridPos.x = floorf( ( p.x - grid.origin.x ) / grid.cellSize );
+	gridPos.y = floorf( ( p.y - grid.origin.y ) / grid.cellSize );
+	gridPos.z = floorf( ( p.z - grid.origin.z ) / grid.cellSize );
+	return gridPos;
 }
 
-/**
- * Compute the ideal grid size for the number of particles that we have
+/*!
+ * @brief Wrap a cell coordinate into [0, dim).
+ * @param x cell coordinate.
+ * @param dim number of cells on the axis.
+ * @return wrapped coordinate.
  */
-void computeGridSize(int n, int blockSize)
+__device__ int d_wrapCell( int x, int dim )
 {
-    NUM_THREADS = std::min(blockSize, n);
-    NUM_BLOCKS = iDivUp(n, NUM_THREADS);
+	x %= dim;
+	return x < 0 ? x + dim : x;
 }
 
 /*!
- * @brief Kernel function that controls behavior of a fish in the swarm.
- * Fishies can be eaten by shark, try to evade shark, keep distance to other fishies and return to swarm when to far away.
- * At the moment not effiecient due to big for loop that iterates over all fishies in order to get the closest.
- * Swarm behavior can be modified by changing global variables at the beginning of this file.
- * @param verts Positions of all fishies.
- * @param states Speed Vectors of all fishies (x, y z) and a random variable (w) to avoid creating new random values on the GPU all the time.
- * @param mesh_count Number of fishies.
- * @param speed Approximate maximum speed of fishies. Approximate because it can get higher depending on random value states.w.
- * @param swarmCenter The center of the swarm that each fish tries to reach.
- * @param sharkVec Position of the shark.
-*/
-__global__ void d_advance(
-    float4* verts,
-    float4* states,
-    unsigned int mesh_count,
-    float speed,
-    Vector3 swarmCenter,
-	Vector3 sharkVec)
+ * @brief Key of a cell in the hashed grid: the biased coordinates, 21 bits per axis. Never EMPTY_KEY.
+ * @param gridPos cell coordinates (not wrapped).
+ * @return key.
+ */
+__device__ unsigned long long d_cellKey( int3 gridPos )
 {
-    int t_x = threadIdx.x;
-    int b_x = blockIdx.x;
-    int in_x = b_x * blockDim.x + t_x;
+	unsigned long long x = static_cast< unsigned int >( gridPos.x + CELL_KEY_BIAS ) & 0x1fffffu;
+	unsigned long long y = static_cast< unsigned int >( gridPos.y + CELL_KEY_BIAS ) & 0x1fffffu;
+	unsigned long long z = static_cast< unsigned int >( gridPos.z + CELL_KEY_BIAS ) & 0x1fffffu;
+	return x | ( y << 21 ) | ( z << 42 );
+}
 
-    DeviceVector vert(verts[in_x]);
-	DeviceVector state(states[in_x]);
-	DeviceVector shark(&sharkVec);
-	float my_speed = speed * state.w;
-	float acceleration_factor = 0.09;
+/*!
+ * @brief Home slot of a cell key: the finalizer of MurmurHash3, so neighbouring cells spread over the table.
+ * @param key cell key.
+ * @param mask slots - 1.
+ * @return slot where the probing starts.
+ */
+__device__ unsigned int d_keySlot( unsigned long long key, unsigned int mask )
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdull;
+	key ^= key >> 33;
+	return static_cast< unsigned int >( key ) & mask;
+}
 
-	DeviceVector sharkDiff = shark - vert;
-	float sharkDistance = sharkDiff.length3();
+/*!
+ * @brief Find or insert the slot of a key in an open addressing table. The active lanes of the warp probe together: one distinct
+ * key after the other, every lane reads one slot, so each window of the linear probing is one coalesced load and a ballot.
+ * Lanes with the same key share the probe. An insert claims the first free slot with atomicCAS and looks at the window
+ * again if another warp took it first.
+ * @param key key, not EMPTY_KEY.
+ * @param keys key per slot, EMPTY_KEY for free slots.
+ * @param keyMask slots - 1, the slots are a power of two.
+ * @param insert true: add the key if it is missing, false: look up only.
+ * @return slot of the key, keyMask + 1 if it is not in the table (or the table is full).
+ */
+__device__ unsigned int d_probeKey( unsigned long long key, unsigned long long* keys, unsigned int keyMask, bool insert )
+{
+	unsigned int missing = keyMask + 1;
+	unsigned int active = __activemask();
+	unsigned int lane = threadIdx.x % WARP_SIZE;
+	unsigned int rank = __popc( active & ( ( 1u << lane ) - 1u ) );		// Position inside the window
+	unsigned int width = __popc( active );
+#if !defined(__CUDA_ARCH__) || __CUDA_ARCH__ >= 700
+	unsigned int peers = __match_any_sync( active, key );
+	unsigned int pending = __ballot_sync( active, lane == __ffs( peers ) - 1 );	// One probe per distinct cell
+#else
+	unsigned int pending = active;											// No __match_any_sync before Volta
+#endif
 
-	// shark eats fish
-	if (sharkDistance < SHARK_BITE_DIST || state.w < 0)
-	{
-		verts[in_x].w = -1;
-		return;
-	}
-	// evade shark
-	if (sharkDistance < SHARK_DIST * state.w)
-	{
-		sharkDiff = sharkDiff.normalized() * my_speed * acceleration_factor;
-		state -= sharkDiff;
-	}
-	else
+	unsigned int result = missing;
+	while (pending != 0)
 	{
-		DeviceVector center(&swarmCenter);
-		DeviceVector closest = vert - DeviceVector(verts[0]);
-		float closest_dist = closest.length3();
+		unsigned int owner = __ffs( pending ) - 1;
+		pending &= pending - 1;
+		unsigned long long wanted = __shfl_sync( active, key, owner );
+		unsigned int home = d_keySlot( wanted, keyMask );
+		unsigned int found = missing;
+		for (unsigned int offset = 0; offset <= keyMask; )
+		{
+			unsigned int slot = ( home + offset + rank ) & keyMask;
+			unsigned long long stored = insert ? *reinterpret_cast< volatile unsigned long long* >( keys + slot ) : keys[slot];
+			unsigned int stop = __ballot_sync( active, stored == wanted || stored == EMPTY_KEY );
+			if (stop == 0)
+			{
+				offset += width;
+				continue;
+			}
 
-		// find closest fish
-		DeviceVector d;
-		float d_len;
-		for (int i = 1; i < mesh_count; i++)
-		{ 
-			d = vert - verts[i];
-			d_len = d.length3();
-			if ( d_len < closest_dist && i != in_x)
+			// The first slot in probe order that holds the cell or is free. The cell is never behind a free slot.
+			unsigned int first = __ffs( stop ) - 1;
+			unsigned int firstSlot = __shfl_sync( active, slot, first );
+			if (__shfl_sync( active, stored, first ) == wanted)
+			{
+				found = firstSlot;
+				break;
+			}
+			if (!insert)
+				break;
+			unsigned long long previous = 0;
+			if (lane == first)
+				previous = atomicCAS( keys + firstSlot, EMPTY_KEY, wanted );
+			previous = __shfl_sync( active, previous, first );
+			if (previous == EMPTY_KEY || previous == wanted)
 			{
-				closest = d;
-				closest_dist = d_len;
+				found = firstSlot;
+				break;
 			}
 		}
+		if (key == wanted)
+			result = found;
+	}
+	return result;
+}
 
-		DeviceVector diff = center - vert;
+/*!
+ * @brief Find or insert the slot of a cell in the hashed grid, see d_probeKey.
+ * @param gridPos cell coordinates (not wrapped).
+ * @param grid grid placement with cellKeys.
+ * @param insert true: add the cell if it is missing (grid build), false: look up only (search).
+ * @return slot of the cell, keyMask + 1 if it is not in the table.
+ */
+__device__ unsigned int d_probeCell( int3 gridPos, const GridLayout& grid, bool insert )
+{
+	return d_probeKey( d_cellKey( gridPos ), grid.cellKeys, grid.keyMask, insert );
+}
+
+/*!
+ * @brief Calculate the hash of a cell. The grid wraps around, so cells outside of it share buckets.
+ * The hashed grid looks the cell up in its table instead.
+ * @param gridPos cell coordinates.
+ * @param grid grid placement.
+ * @return cell hash.
+ */
+__device__ unsigned int d_calcGridHash( int3 gridPos, const GridLayout& grid )
+{
+	if (grid.cellKeys != NULL)
+		return d_probeCell( gridPos, grid, false );
+
+	gridPos.x = d_wrapCell( gridPos.x, grid.dims.x );
+	gridPos.y = d_wrapCell( gridPos.y, grid.dims.y );
+	gridPos.z = d_wrapCell( gridPos.z, grid.dims.z );
+	return ( gridPos.z * grid.dims.y + gridPos.y ) * grid.dims.x + gridPos.x;
+}
+
+/*!
+ * @brief Calculate the hash of the cell of a fish for the grid build. Adds the cell to the table of the hashed grid.
+ * @param gridPos cell coordinates.
+ * @param grid grid placement.
+ * @return cell hash.
+ */
+__device__ unsigned int d_insertGridHash( int3 gridPos, const GridLayout& grid )
+{
+	return grid.cellKeys != NULL ? d_probeCell( gridPos, grid, true ) : d_calcGridHash( gridPos, grid );
+}
+
+static const unsigned short PACKED_INVALID_TAG = 0x8000;		// Period tag of cells too far outside of the grid.
+
+/*!
+ * @brief Calculate the period tag of a cell: how often the cell coordinates wrapped around on each axis.
+ * Cells sharing a hash bucket have different tags.
+ * @param gridPos cell coordinates (not wrapped).
+ * @param grid grid placement.
+ * @return 5 bits per axis, PACKED_INVALID_TAG for more than 16 periods away from the grid.
+ */
+__device__ unsigned short d_periodTag( int3 gridPos, const GridLayout& grid )
+{
+	int px = ( gridPos.x - d_wrapCell( gridPos.x, grid.dims.x ) ) / grid.dims.x + 16;
+	int py = ( gridPos.y - d_wrapCell( gridPos.y, grid.dims.y ) ) / grid.dims.y + 16;
+	int pz = ( gridPos.z - d_wrapCell( gridPos.z, grid.dims.z ) ) / grid.dims.z + 16;
+	if ( ( px | py | pz ) & ~31 )
+		return PACKED_INVALID_TAG;
+	return px | ( py << 5 ) | ( pz << 10 );
+}
+
+/*!
+ * @brief Pack a position as 16 bit fixed point offset inside its cell and the period tag of the cell.
+ * The resolution is cellSize / 65535 on every axis.
+ * @param p position.
+ * @param grid grid placement.
+ * @return offsets (x, y, z) and period tag (w).
+ */
+__device__ ushort4 d_packCellPosition( DeviceVector p, const GridLayout& grid )
+{
+	int3 cell = d_calcGridPos( p, grid );
+	float fx = ( p.x - grid.origin.x ) / grid.cellSize - cell.x;
+	float fy = ( p.y - grid.origin.y ) / grid.cellSize - cell.y;
+	float fz = ( p.z - grid.origin.z ) / grid.cellSize - cell.z;
+	return make_ushort4(
+		__float2uint_rn( __saturatef( fx ) * 65535.0f ),
+		__float2uint_rn( __saturatef( fy ) * 65535.0f ),
+		__float2uint_rn( __saturatef( fz ) * 65535.0f ),
+		d_periodTag( cell, grid ) );
+}
+
+
+/********************************
+ *
+ * Kernel Stuff
+ *
+ ********************************/
+
+
+/*
+ * The following 2 functions taken from the cuda samples
+ */
+int iDivUp(int a, int b)
+{
+    return (a % b != 0) ? (a / b + 1) : (a / b);
+}
+
+/*!
+ * @brief Load position of a fish from the particle arrays.
+ * @param p particle arrays.
+ * @param i index of fish.
+ * @return position (w = 1).
+ */
+__device__ DeviceVector d_loadPosition( const ParticleArrays& p, unsigned int i )
+{
+	return DeviceVector( p.x[i], p.y[i], p.z[i] );
+}
+
+/*!
+ * @brief Load state of a fish from the particle arrays.
+ * @param p particle arrays.
+ * @param i index of fish.
+ * @return speed (x, y, z) and mass (w).
+ */
+__device__ DeviceVector d_loadState( const ParticleArrays& p, unsigned int i )
+{
+	return DeviceVector( p.vx[i], p.vy[i], p.vz[i], p.mass[i] );
+}
+
+/*!
+ * @brief Snap a value to the fixed-point lattice of the deterministic mode (16.16 in an int32).
+ * Differences in the last bits of the float math round to the same lattice point, so they don't add up over the steps.
+ * @param v value.
+ * @param scale lattice points per unit (c_step.fixedPoint).
+ * @return nearest lattice point.
+ */
+__device__ float d_fixedPoint( float v, float scale )
+{
+	return __int2float_rn( __float2int_rn( v * scale ) ) * ( 1.0f / scale );
+}
+
+/*!
+ * @brief Store a fish into the particle arrays. In deterministic mode position and speed vector are snapped to the fixed-point lattice.
+ * @param p particle arrays.
+ * @param i index of fish.
+ * @param vert position.
+ * @param state speed (x, y, z) and mass (w).
+ * @param alive alive flag.
+ */
+__device__ void d_storeParticle( const ParticleArrays& p, unsigned int i, const DeviceVector& vert, const DeviceVector& state, unsigned char alive )
+{
+	float scale = c_step.fixedPoint;
+	if (scale > 0.0f)
+	{
+		p.x[i] = d_fixedPoint( vert.x, scale );
+		p.y[i] = d_fixedPoint( vert.y, scale );
+		p.z[i] = d_fixedPoint( vert.z, scale );
+		p.vx[i] = d_fixedPoint( state.x, scale );
+		p.vy[i] = d_fixedPoint( state.y, scale );
+		p.vz[i] = d_fixedPoint( state.z, scale );
+		p.mass[i] = state.w;
+		p.alive[i] = alive;
+		return;
+	}
+
+	p.x[i] = vert.x;
+	p.y[i] = vert.y;
+	p.z[i] = vert.z;
+	p.vx[i] = state.x;
+	p.vy[i] = state.y;
+	p.vz[i] = state.z;
+	p.mass[i] = state.w;
+	p.alive[i] = alive;
+}
+
+/*!
+ * @brief Optional parts of the fish behaviour. The advance kernels are templates on a combination of these flags,
+ * so a variant only contains the branches it needs. kernel_advance picks the variant of the current settings (advanceFeatures).
+ */
+enum AdvanceFeature : unsigned int
+{
+	FEATURE_JITTER = 1,				// Behaviour noise, c_params.jitter > 0.
+	FEATURE_SCHOOLS = 2,			// Several schools, every fish returns to the center of its school.
+	FEATURE_SPECIES = 4,			// Several species, speed, distances and mass come from the species table (c_species).
+	FEATURE_FIRST_K = 8,			// Neighbour query stops after firstK fishies inside fishDist.
+	FEATURE_PACKED = 16,			// Grid search reads the packed positions.
+	FEATURE_SUBSTEPS = 32,			// Swarm center and random step come from s_substep (d_advance_substeps). Not part of the variant tables.
+	SWIM_FEATURES = FEATURE_JITTER | FEATURE_SCHOOLS | FEATURE_SPECIES,	// Flags used by every kernel. Variants of the warp and boids kernels.
+	QUERY_FEATURES = SWIM_FEATURES | FEATURE_FIRST_K,			// Variants of the brute force, tiled and Verlet kernels.
+	GRID_FEATURES = QUERY_FEATURES | FEATURE_PACKED				// Variants of the grid kernel.
+};
+
+/*!
+ * @brief Load a waypoint of a school route (kernel_set_schools). Routes are rings, indices after the last waypoint start at the first one again.
+ * @param school index of the school.
+ * @param i index of the waypoint inside the route.
+ * @return waypoint.
+ */
+__device__ DeviceVector d_waypoint( unsigned int school, unsigned int i )
+{
+	uint2 route = c_path.routes[school];
+	return DeviceVector( c_path.points[route.x + i % route.y] );
+}
+
+/*!
+ * @brief Blend two points of the Barry-Goldman pyramid by their knots.
+ * @param a point at knot ta.
+ * @param b point at knot tb.
+ * @param ta first knot.
+ * @param tb second knot, above ta.
+ * @param t knot of the result.
+ * @return point at t.
+ */
+static __host__ __device__ inline float3 splineBlend( float3 a, float3 b, float ta, float tb, float t )
+{
+	float wa = ( tb - t ) / ( tb - ta );
+	float wb = ( t - ta ) / ( tb - ta );
+	return make_float3( wa * a.x + wb * b.x, wa * a.y + wb * b.y, wa * a.z + wb * b.z );
+}
+
+/*!
+ * @brief Knot distance of centripetal Catmull-Rom: square root of the chord length. Never 0, so repeated waypoints don't divide by 0.
+ * @param a first point.
+ * @param b second point.
+ * @return knot interval.
+ */
+static __host__ __device__ inline float splineKnot( float3 a, float3 b )
+{
+	float dx = b.x - a.x, dy = b.y - a.y, dz = b.z - a.z;
+	return sqrtf( sqrtf( dx * dx + dy * dy + dz * dz ) ) + 1e-4f;
+}
+
+/*!
+ * @brief Evaluate the closed centripetal Catmull-Rom spline of a route. Goes through every waypoint without loops or cusps.
+ * Same code on the host (arc length table) and the device (d_moveSchools).
+ * @param points waypoints of all routes, c_path.points or h_path.points.
+ * @param route first waypoint and number of waypoints of the route, at least 2.
+ * @param u parameter: segment (from waypoint floor(u) to the next one) plus the fraction inside it, 0 to the number of waypoints.
+ * @return position.
+ */
+static __host__ __device__ float3 splinePoint( const float4* points, uint2 route, float u )
+{
+	unsigned int segment = static_cast< unsigned int >( u );
+	float fraction = u - segment;
+	segment %= route.y;
+	float4 q0 = points[route.x + ( segment + route.y - 1 ) % route.y];
+	float4 q1 = points[route.x + segment];
+	float4 q2 = points[route.x + ( segment + 1 ) % route.y];
+	float4 q3 = points[route.x + ( segment + 2 ) % route.y];
+	float3 p0 = make_float3( q0.x, q0.y, q0.z ), p1 = make_float3( q1.x, q1.y, q1.z );
+	float3 p2 = make_float3( q2.x, q2.y, q2.z ), p3 = make_float3( q3.x, q3.y, q3.z );
+
+	float t1 = splineKnot( p0, p1 );
+	float t2 = t1 + splineKnot( p1, p2 );
+	float t3 = t2 + splineKnot( p2, p3 );
+	float t = t1 + fraction * ( t2 - t1 );
+	float3 a1 = splineBlend( p0, p1, 0.0f, t1, t );
+	float3 a2 = splineBlend( p1, p2, t1, t2, t );
+	float3 a3 = splineBlend( p2, p3, t2, t3, t );
+	float3 b1 = splineBlend( a1, a2, 0.0f, t2, t );
+	float3 b2 = splineBlend( a2, a3, t1, t3, t );
+	return splineBlend( b1, b2, t1, t2, t );
+}
+
+/*!
+ * @brief Get the school of a fish. The school follows from the stable id, so it moves along with compaction, reorder and respawn.
+ * @tparam FEATURES AdvanceFeature flags. Without FEATURE_SCHOOLS there is a single school.
+ * @param ids stable ids of a particle store.
+ * @param i slot of the fish.
+ * @return school index. 0 with a single school, the id is not read then.
+ */
+template <unsigned int FEATURES>
+__device__ unsigned int d_schoolOf( const unsigned int* __restrict__ ids, unsigned int i )
+{
+	return ( FEATURES & FEATURE_SCHOOLS ) ? ids[i] % c_path.schools : 0;
+}
+
+/*!
+ * @brief Get the center a school returns to.
+ * @tparam FEATURES AdvanceFeature flags. Without FEATURE_SCHOOLS there is a single school.
+ * @param school index of the school (d_schoolOf).
+ * @return center of the school, the swarm center of the step with a single school.
+ */
+template <unsigned int FEATURES>
+__device__ DeviceVector d_schoolCenter( unsigned int school )
+{
+	if (FEATURES & FEATURE_SCHOOLS)
+		return DeviceVector( d_schoolTable[school].center );
+	return DeviceVector( ( FEATURES & FEATURE_SUBSTEPS ) ? s_substep.swarmCenter : c_step.swarmCenter );
+}
+
+/*!
+ * @brief Get the species of a fish. Like the school it follows from the stable id, hashed so schools and species don't correlate.
+ * @param ids stable ids of a particle store.
+ * @param i slot of the fish.
+ * @return species index below c_species.count.
+ */
+__device__ unsigned int d_speciesOf( const unsigned int* __restrict__ ids, unsigned int i )
+{
+	unsigned int hash = ids[i] * 0x9e3779b9u;
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	float u = ( hash >> 8 ) * ( 1.0f / 16777216.0f );			// 24 bits, uniform in [0, 1)
+	unsigned int species = 0;
+	while (species + 1 < c_species.count && u >= c_species.bounds[species])
+		species++;
+	return species;
+}
+
+/*!
+ * @brief Behaviour values of one fish: the parameters scaled by its mass and by the traits of its species.
+ */
+struct FishTraits
+{
+	float mass;						// Mass, scales the distances and the speed.
+	float speed;					// Factor on the maximum speed (mass * species speed).
+	float fishDist;					// Distance kept to the closest fish.
+	float sharkDist;				// Distance the fish evades a shark at, before the mass.
+};
+
+/*!
+ * @brief Get the traits of a fish.
+ * @tparam FEATURES AdvanceFeature flags. Without FEATURE_SPECIES the parameters hold for all fishies, the id is not read then.
+ * @param ids stable ids of a particle store.
+ * @param i slot of the fish.
+ * @param mass random mass of the fish (state.w).
+ * @param params behaviour parameters.
+ * @return traits.
+ */
+template <unsigned int FEATURES>
+__device__ FishTraits d_traitsOf( const unsigned int* __restrict__ ids, unsigned int i, float mass, const SwarmParams& params )
+{
+	FishTraits traits = { mass, mass, params.fishDist, params.sharkDist };
+	if (FEATURES & FEATURE_SPECIES)
+	{
+		const SpeciesParams& species = c_species.params[d_speciesOf( ids, i )];
+		traits.mass = species.massMin + ( mass - 0.875f ) * 4.0f * ( species.massMax - species.massMin );	// Spawn range onto the species range
+		traits.speed = traits.mass * species.speed;
+		traits.fishDist = params.fishDist * species.perception;
+		traits.sharkDist = params.sharkDist * species.fear;
+	}
+	return traits;
+}
+
+/*!
+ * @brief Load position of a shark.
+ * @param sharks Shark positions in global memory, or NULL if they were copied to constant memory.
+ * @param i index of shark.
+ * @return position of shark.
+ */
+__device__ DeviceVector d_loadShark( const float4* __restrict__ sharks, unsigned int i )
+{
+	return DeviceVector( sharks ? sharks[i] : c_sharks[i] );
+}
+
+/*!
+ * @brief Result of a neighbour query. Compares squared distances, the root is only taken for the winner.
+ * With firstK > 0 the query is done after firstK fishies inside fishDist were found
+ * and returns the closest of the fishies seen until then (not necessarily the closest overall).
+ * @tparam FEATURES AdvanceFeature flags. Without FEATURE_FIRST_K the early exit is not compiled in and firstK is ignored.
+ */
+template <unsigned int FEATURES>
+struct NeighbourQuery
+{
+	unsigned int firstK;		//!< Stop after this number of fishies inside fishDist. 0: find the closest fish.
+	DeviceVector closest;		//!< Difference vector to the closest fish so far.
+	float closestDist2;			//!< Squared distance to the closest fish so far.
+	unsigned int index;			//!< Index of the closest fish so far, as passed to add.
+	unsigned int found;			//!< Number of fishies inside fishDist so far.
+
+	/*!
+	 * @brief Start a new query.
+	 * @param firstK Stop after this number of fishies inside fishDist. 0: find the closest fish.
+	 */
+	__device__ NeighbourQuery( unsigned int firstK ) :
+		firstK( firstK ), closestDist2( FLT_MAX ), index( 0 ), found( 0 )
+	{}
+
+	/*!
+	 * @brief Check a candidate.
+	 * @param d Difference vector to the candidate.
+	 * @param i Index of the candidate. Only kept for the caller.
+	 * @return true, if the query is done.
+	 */
+	__device__ bool add( const DeviceVector& d, unsigned int i = 0 )
+	{
+		float d2 = d.length3Squared();
+		if (d2 < closestDist2)
+		{
+			closest = d;
+			closestDist2 = d2;
+			index = i;
+		}
+		return ( FEATURES & FEATURE_FIRST_K ) && d2 < c_params.fishDist * c_params.fishDist && ++found >= firstK;
+	}
+
+	/*!
+	 * @brief Get the result.
+	 * @param closest Difference vector to the closest fish.
+	 * @param closest_dist Distance to the closest fish (FLT_MAX if there is none).
+	 */
+	__device__ void result( DeviceVector* closest, float* closest_dist ) const
+	{
+		*closest = this->closest;
+		*closest_dist = closestDist2 < FLT_MAX ? sqrtf( closestDist2 ) : FLT_MAX;
+	}
+};
+
+/*!
+ * @brief Brute force neighbour search. Iterates over all fishies in order to get the closest.
+ * @tparam FEATURES AdvanceFeature flags of the query.
+ */
+template <unsigned int FEATURES>
+struct BruteForceSearch
+{
+	ParticleArrays particles;	//!< All fishies (read only).
+	unsigned int mesh_count;	//!< Number of fishies.
+	unsigned int firstK;		//!< See NeighbourQuery.
+
+	/*!
+	 * @brief Find the closest living fish.
+	 * @param vert Position of the searching fish.
+	 * @param self Index of the searching fish.
+	 * @param closest Difference vector to the closest fish.
+	 * @param closest_dist Distance to the closest fish.
+	 */
+	__device__ void operator()( DeviceVector vert, unsigned int self, DeviceVector* closest, float* closest_dist ) const
+	{
+		NeighbourQuery<FEATURES> query( firstK );
+		for (unsigned int i = 0; i < mesh_count; i++)
+		{
+			if (i != self && particles.alive[i] && query.add( vert - d_loadPosition( particles, i ) ))
+				break;
+		}
+		query.result( closest, closest_dist );
+	}
+};
+
+/*!
+ * @brief Closest fish of the last step per slot, the start of the next grid search (temporal coherence).
+ * Any living fish is an upper bound of the closest distance, so stale slots after a compaction or reorder
+ * only make the bound worse, never the result wrong.
+ */
+struct WarmStart
+{
+	ParticleArrays particles;						//!< Input store of the step, the bound is read by slot.
+	unsigned int count;								//!< Number of slots.
+	unsigned int* nearest;							//!< Slot of the closest fish per slot, ~0u: none. NULL: no warm start.
+};
+
+/*!
+ * @brief Neighbour search on the uniform grid. Only checks the 27 cells around the fish.
+ * Every fish inside fishDist is found, fishies further away are never close enough to be avoided.
+ * Dead fishies are not part of any searched cell.
+ * With a warm start the distance to the closest fish of the last step bounds the search: cells that are
+ * further away are skipped. The closest fish found is stored for the next step. Not with FEATURE_FIRST_K,
+ * its result depends on the order of the candidates.
+ * @tparam FEATURES AdvanceFeature flags of the query. With FEATURE_PACKED the positions are decoded from packed.
+ */
+template <unsigned int FEATURES>
+struct GridSearch
+{
+	const float* __restrict__ sortedX;				//!< x positions sorted by cell hash.
+	const float* __restrict__ sortedY;				//!< y positions sorted by cell hash.
+	const float* __restrict__ sortedZ;				//!< z positions sorted by cell hash.
+	const unsigned int* __restrict__ cellStart;		//!< Index of first fish in cell (sorted order).
+	const unsigned int* __restrict__ cellEnd;		//!< Index after last fish in cell (sorted order).
+	GridLayout grid;								//!< Grid placement.
+	unsigned int firstK;							//!< See NeighbourQuery.
+	const ushort4* __restrict__ packed;				//!< Packed positions sorted by cell hash, see d_packCellPosition. Only read with FEATURE_PACKED.
+	const unsigned int* __restrict__ slots;			//!< Original fish index of each sorted fish.
+	WarmStart warm;									//!< Closest fishies of the last step.
+
+	/*!
+	 * @brief Find the closest fish.
+	 * @param vert Position of the searching fish.
+	 * @param self Sorted index of the searching fish.
+	 * @param closest Difference vector to the closest fish.
+	 * @param closest_dist Distance to the closest fish.
+	 */
+	__device__ void operator()( DeviceVector vert, unsigned int self, DeviceVector* closest, float* closest_dist ) const
+	{
+		int3 cell = d_calcGridPos( vert, grid );
+		NeighbourQuery<FEATURES> query( firstK );
+
+		// Warm start: no cell further away than the closest fish of the last step can hold a closer one.
+		bool seeded = !( FEATURES & FEATURE_FIRST_K ) && warm.nearest != NULL;
+		unsigned int slot = seeded ? slots[self] : 0;
+		unsigned int last = seeded ? warm.nearest[slot] : ~0u;
+		float bound2 = FLT_MAX;
+		if (last < warm.count && last != slot && warm.particles.alive[last])
+			bound2 = ( vert - d_loadPosition( warm.particles, last ) ).length3Squared();
+		DeviceVector inCell( vert.x - ( grid.origin.x + cell.x * grid.cellSize ), vert.y - ( grid.origin.y + cell.y * grid.cellSize ),
+			vert.z - ( grid.origin.z + cell.z * grid.cellSize ) );
+
+		bool done = false;
+		for (int n = 0; n < 27 && !done; n++)
+		{
+			int3 neighbour = make_int3( cell.x + n % 3 - 1, cell.y + n / 3 % 3 - 1, cell.z + n / 9 - 1 );
+			if (bound2 < FLT_MAX)
+			{
+				float gapX = n % 3 == 0 ? inCell.x : n % 3 == 2 ? grid.cellSize - inCell.x : 0.0f;
+				float gapY = n / 3 % 3 == 0 ? inCell.y : n / 3 % 3 == 2 ? grid.cellSize - inCell.y : 0.0f;
+				float gapZ = n / 9 == 0 ? inCell.z : n / 9 == 2 ? grid.cellSize - inCell.z : 0.0f;
+				if (gapX * gapX + gapY * gapY + gapZ * gapZ > bound2)	// The whole cell is further away
+					continue;
+			}
+			unsigned int hash = d_calcGridHash( neighbour, grid );
+			unsigned int start = cellStart[hash];
+
+			// cell is empty
+			if (start == EMPTY_CELL)
+				continue;
+
+			// Packed positions are decoded relative to this cell. Fishies of other periods in the same bucket are far away.
+			unsigned short tag = ( FEATURES & FEATURE_PACKED ) ? d_periodTag( neighbour, grid ) : PACKED_INVALID_TAG;
+			bool decode = tag != PACKED_INVALID_TAG;
+			float scale = grid.cellSize / 65535.0f;
+			DeviceVector base( grid.origin.x + neighbour.x * grid.cellSize, grid.origin.y + neighbour.y * grid.cellSize, grid.origin.z + neighbour.z * grid.cellSize );
+
+			unsigned int end = cellEnd[hash];
+			for (unsigned int i = start; i < end && !done; i++)
+			{
+				if (i == self)
+					continue;
+
+				if (decode)
+				{
+					ushort4 p = packed[i];											// One 8 byte load instead of three 4 byte loads
+					if (p.w == tag)
+						done = query.add( vert - DeviceVector( base.x + p.x * scale, base.y + p.y * scale, base.z + p.z * scale ), i );
+				}
+				else
+					done = query.add( vert - DeviceVector( sortedX[i], sortedY[i], sortedZ[i] ), i );
+			}
+		}
+		if (seeded && query.closestDist2 < FLT_MAX)
+			warm.nearest[slot] = slots[query.index];								// Else the bound of the last step stays
+		query.result( closest, closest_dist );
+	}
+};
+
+/*!
+ * @brief Grid search of d_advance_cluster. The cluster covers a cube of CLUSTER_EDGE^3 cells, each of its blocks holds the
+ * positions of its cell in shared memory. Cells of the cube are read from the shared memory of their block (distributed
+ * shared memory), the other cells of the 27 from global memory as in GridSearch. Same candidates, same order.
+ * @tparam FEATURES AdvanceFeature flags of the query.
+ */
+template <unsigned int FEATURES>
+struct ClusterSearch
+{
+	const float* __restrict__ sortedX;				//!< x positions sorted by cell hash.
+	const float* __restrict__ sortedY;				//!< y positions sorted by cell hash.
+	const float* __restrict__ sortedZ;				//!< z positions sorted by cell hash.
+	const unsigned int* __restrict__ cellStart;		//!< Index of first fish in cell (sorted order).
+	const unsigned int* __restrict__ cellEnd;		//!< Index after last fish in cell (sorted order).
+	GridLayout grid;								//!< Grid placement.
+	unsigned int firstK;							//!< See NeighbourQuery.
+	int3 cube;										//!< Lowest cell of the cluster.
+	const float4* cells[CLUSTER_BLOCKS];			//!< Positions of the cells of the cube in the shared memory of their block, by block rank.
+	const uint2* info[CLUSTER_BLOCKS];				//!< First sorted index (EMPTY_CELL: empty) and number of fishies of those cells, ~0u: not in shared memory.
+
+	/*!
+	 * @brief Find the closest fish.
+	 * @param vert Position of the searching fish.
+	 * @param self Sorted index of the searching fish.
+	 * @param closest Difference vector to the closest fish.
+	 * @param closest_dist Distance to the closest fish.
+	 */
+	__device__ void operator()( DeviceVector vert, unsigned int self, DeviceVector* closest, float* closest_dist ) const
+	{
+		int3 cell = d_calcGridPos( vert, grid );
+		NeighbourQuery<FEATURES> query( firstK );
+
+		bool done = false;
+		for (int n = 0; n < 27 && !done; n++)
+		{
+			int3 neighbour = make_int3( cell.x + n % 3 - 1, cell.y + n / 3 % 3 - 1, cell.z + n / 9 - 1 );
+			int3 local = make_int3( neighbour.x - cube.x, neighbour.y - cube.y, neighbour.z - cube.z );
+			bool inCube = local.x >= 0 && local.x < CLUSTER_EDGE && local.y >= 0 && local.y < CLUSTER_EDGE && local.z >= 0 && local.z < CLUSTER_EDGE
+				&& neighbour.x < grid.dims.x && neighbour.y < grid.dims.y && neighbour.z < grid.dims.z;	// Wrapped cells are other buckets
+			if (inCube)
+			{
+				unsigned int rank = ( local.z * CLUSTER_EDGE + local.y ) * CLUSTER_EDGE + local.x;
+				uint2 peer = *info[rank];
+				if (peer.x == EMPTY_CELL)
+					continue;
+				if (peer.y != ~0u)
+				{
+					const float4* positions = cells[rank];
+					for (unsigned int k = 0; k < peer.y && !done; k++)
+					{
+						if (peer.x + k != self)
+							done = query.add( vert - positions[k], peer.x + k );
+					}
+					continue;
+				}
+			}
+
+			unsigned int hash = d_calcGridHash( neighbour, grid );
+			unsigned int start = cellStart[hash];
+			if (start == EMPTY_CELL)
+				continue;
+
+			unsigned int end = cellEnd[hash];
+			for (unsigned int i = start; i < end && !done; i++)
+			{
+				if (i != self)
+					done = query.add( vert - DeviceVector( sortedX[i], sortedY[i], sortedZ[i] ), i );
+			}
+		}
+		query.result( closest, closest_dist );
+	}
+};
+
+/*!
+ * @brief Neighbour search over the Verlet list of the fish. Only checks the candidates of the last build.
+ * Dead candidates are skipped.
+ * @tparam FEATURES AdvanceFeature flags of the query.
+ */
+template <unsigned int FEATURES>
+struct VerletSearch
+{
+	ParticleArrays particles;						//!< All fishies (read only).
+	const unsigned int* __restrict__ list;			//!< Candidate slots, entry k of fish i at k * stride + i.
+	const unsigned int* __restrict__ count;			//!< Number of candidates per fish.
+	unsigned int stride;							//!< Number of fishies when the lists were built.
+	unsigned int firstK;							//!< See NeighbourQuery.
+
+	/*!
+	 * @brief Find the closest fish.
+	 * @param vert Position of the searching fish.
+	 * @param self Index of the searching fish.
+	 * @param closest Difference vector to the closest fish.
+	 * @param closest_dist Distance to the closest fish.
+	 */
+	__device__ void operator()( DeviceVector vert, unsigned int self, DeviceVector* closest, float* closest_dist ) const
+	{
+		NeighbourQuery<FEATURES> query( firstK );
+		unsigned int n = count[self];
+		for (unsigned int k = 0; k < n; k++)
+		{
+			unsigned int i = list[k * stride + self];
+			if (particles.alive[i] && query.add( vert - d_loadPosition( particles, i ) ))
+				break;
+		}
+		query.result( closest, closest_dist );
+	}
+};
+
+/*!
+ * @brief Brute force search over the positions of all fishies in shared memory (d_advance_substeps).
+ */
+template <unsigned int FEATURES>
+struct SharedSearch
+{
+	const float4* positions;						//!< Positions of all fishies, w < 0 marks dead fishies.
+	unsigned int count;								//!< Number of fishies.
+	unsigned int firstK;							//!< See NeighbourQuery.
+
+	/*!
+	 * @brief Find the closest fish.
+	 * @param vert Position of the searching fish.
+	 * @param self Index of the searching fish.
+	 * @param closest Difference vector to the closest fish.
+	 * @param closest_dist Distance to the closest fish.
+	 */
+	__device__ void operator()( DeviceVector vert, unsigned int self, DeviceVector* closest, float* closest_dist ) const
+	{
+		NeighbourQuery<FEATURES> query( firstK );
+		for (unsigned int k = 0; k < count; k++)
+		{
+			if (k != self && positions[k].w > 0 && query.add( vert - positions[k] ))
+				break;
+		}
+		query.result( closest, closest_dist );
+	}
+};
+
+/*!
+ * @brief Neighbour search that was already done before, e.g. cooperatively by the whole block.
+ */
+struct PrecomputedSearch
+{
+	DeviceVector closest;		//!< Difference vector to the closest fish.
+	float closest_dist;			//!< Distance to the closest fish.
+
+	/*!
+	 * @brief Return the precomputed closest fish.
+	 * @param vert unused.
+	 * @param self unused.
+	 * @param closest Difference vector to the closest fish.
+	 * @param closest_dist Distance to the closest fish.
+	 */
+	__device__ void operator()( DeviceVector vert, unsigned int self, DeviceVector* closest, float* closest_dist ) const
+	{
+		*closest = this->closest;
+		*closest_dist = this->closest_dist;
+	}
+};
+
+/*!
+ * @brief Tiled all-pairs search for the closest fish (like the n-body sample).
+ * The block loads the positions tile by tile into shared memory, each thread scans the tile.
+ * All threads of the block have to call this function, because of the __syncthreads.
+ * Needs blockDim.x * sizeof(float4) dynamic shared memory.
+ * @tparam FEATURES AdvanceFeature flags of the query.
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param vert Position of the searching fish.
+ * @param self Index of the searching fish.
+ * @param firstK See NeighbourQuery. Threads that are done still take part in the tile loads.
+ * @param closest Difference vector to the closest fish.
+ * @param closest_dist Distance to the closest fish.
+ */
+template <unsigned int FEATURES>
+__device__ void d_tiledSearch(
+	const ParticleArrays& particles,
+	unsigned int mesh_count,
+	DeviceVector vert,
+	unsigned int self,
+	unsigned int firstK,
+	DeviceVector* closest,
+	float* closest_dist)
+{
+	extern __shared__ float4 sharedPos[];	// w < 0 marks dead fishies
+
+	NeighbourQuery<FEATURES> query( firstK );
+	bool done = false;
+	for (unsigned int tileStart = 0; tileStart < mesh_count; tileStart += blockDim.x)
+	{
+		unsigned int j = tileStart + threadIdx.x;
+		if (j < mesh_count)
+			sharedPos[threadIdx.x] = make_float4( particles.x[j], particles.y[j], particles.z[j], particles.alive[j] ? 1.0f : -1.0f );
+
+		__syncthreads();
+
+		unsigned int tileSize = min( blockDim.x, mesh_count - tileStart );
+		for (unsigned int k = 0; k < tileSize && !done; k++)
+		{
+			if (tileStart + k != self && sharedPos[k].w > 0)
+				done = query.add( vert - sharedPos[k] );
+		}
+
+		__syncthreads();
+	}
+	query.result( closest, closest_dist );
+}
+
+/*!
+ * @brief d_tiledSearch with pipelined tile loads: the copies of the next tile are issued with cuda::memcpy_async
+ * before the current tile is scanned, so their latency hides behind the distances (cp.async on compute capability 8.0).
+ * The copies can't convert, so the tiles are kept as they are in the store: x, y and z and the alive flags.
+ * All threads of the block have to call this function, because of the __syncthreads.
+ * Needs TILE_STAGES * blockDim.x * sizeof(float4) dynamic shared memory.
+ * @tparam FEATURES AdvanceFeature flags of the query.
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param vert Position of the searching fish.
+ * @param self Index of the searching fish.
+ * @param firstK See NeighbourQuery. Threads that are done still take part in the tile loads.
+ * @param closest Difference vector to the closest fish.
+ * @param closest_dist Distance to the closest fish.
+ */
+template <unsigned int FEATURES>
+__device__ void d_tiledSearchAsync(
+	const ParticleArrays& particles,
+	unsigned int mesh_count,
+	DeviceVector vert,
+	unsigned int self,
+	unsigned int firstK,
+	DeviceVector* closest,
+	float* closest_dist)
+{
+	extern __shared__ float sharedTiles[];	// x, y and z of all stages, then their alive flags
+	float* tileX = sharedTiles;
+	float* tileY = tileX + TILE_STAGES * blockDim.x;
+	float* tileZ = tileY + TILE_STAGES * blockDim.x;
+	unsigned char* tileAlive = reinterpret_cast< unsigned char* >( tileZ + TILE_STAGES * blockDim.x );
+
+	// Every thread copies its own fish of a tile and waits for its own copies, the __syncthreads publish them to the block.
+	cuda::pipeline<cuda::thread_scope_thread> pipe = cuda::make_pipeline();
+	auto load = [&]( unsigned int tileStart )
+	{
+		pipe.producer_acquire();
+		unsigned int j = tileStart + threadIdx.x;
+		unsigned int slot = ( tileStart / blockDim.x ) % TILE_STAGES * blockDim.x + threadIdx.x;
+		if (j < mesh_count)
+		{
+			cuda::memcpy_async( tileX + slot, particles.x + j, sizeof( float ), pipe );
+			cuda::memcpy_async( tileY + slot, particles.y + j, sizeof( float ), pipe );
+			cuda::memcpy_async( tileZ + slot, particles.z + j, sizeof( float ), pipe );
+			cuda::memcpy_async( tileAlive + slot, particles.alive + j, sizeof( unsigned char ), pipe );
+		}
+		pipe.producer_commit();				// Also past the end, so every tile has its stage
+	};
+
+	for (unsigned int stage = 0; stage + 1 < TILE_STAGES; stage++)
+		load( stage * blockDim.x );
+
+	NeighbourQuery<FEATURES> query( firstK );
+	bool done = false;
+	for (unsigned int tileStart = 0; tileStart < mesh_count; tileStart += blockDim.x)
+	{
+		load( tileStart + ( TILE_STAGES - 1 ) * blockDim.x );
+		pipe.consumer_wait();				// Oldest stage: the current tile
+		__syncthreads();
+
+		unsigned int base = ( tileStart / blockDim.x ) % TILE_STAGES * blockDim.x;
+		unsigned int tileSize = min( blockDim.x, mesh_count - tileStart );
+		for (unsigned int k = 0; k < tileSize && !done; k++)
+		{
+			if (tileStart + k != self && tileAlive[base + k])
+				done = query.add( vert - make_float4( tileX[base + k], tileY[base + k], tileZ[base + k], 1.0f ) );
+		}
+
+		pipe.consumer_release();
+		__syncthreads();					// The stage is loaded again by the next iteration
+	}
+	query.result( closest, closest_dist );
+}
+
+/*!
+ * @brief Four uniform random numbers in (0, 1] for one fish in a step.
+ * Numbers of different fishies, steps and uses are independent.
+ * @param id index of the fish.
+ * @param use what the numbers are used for (RandomUse).
+ * @param step random step.
+ * @return random numbers.
+ */
+__device__ float4 d_random4( unsigned int id, unsigned int use, unsigned int step )
+{
+	curandStatePhilox4_32_10_t rng;
+	curand_init( c_step.random.seed, id, ( static_cast< unsigned long long >( step ) * RANDOM_USES + use ) * 4, &rng );
+	return curand_uniform4( &rng );
+}
+
+/*!
+ * @brief Four uniform random numbers in (0, 1] for one fish in the current step.
+ * Numbers of different fishies, steps and uses are independent.
+ * @param id index of the fish.
+ * @param use what the numbers are used for (RandomUse).
+ * @return random numbers.
+ */
+__device__ float4 d_random4( unsigned int id, unsigned int use )
+{
+	return d_random4( id, use, c_step.random.step );
+}
+
+/*!
+ * @brief Random acceleration of a fish, uniform in [-1, 1]^3.
+ * @tparam FEATURES AdvanceFeature flags. With FEATURE_SUBSTEPS the step comes from s_substep.
+ * @param id index of the fish.
+ * @return random vector (w = 0).
+ */
+template <unsigned int FEATURES>
+__device__ DeviceVector d_jitter( unsigned int id )
+{
+	float4 random = d_random4( id, RANDOM_JITTER, ( FEATURES & FEATURE_SUBSTEPS ) ? s_substep.step : c_step.random.step );
+	return DeviceVector( 2.0f * random.x - 1.0f, 2.0f * random.y - 1.0f, 2.0f * random.z - 1.0f, 0.0f );
+}
+
+/*!
+ * @brief Push away from the static obstacles: one trilinear fetch of the distance field (kernel_set_obstacles).
+ * The push points along the gradient and grows linearly from 0 at range to a full acceleration at the surface, inside up to twice that.
+ * @param vert Position of the fish.
+ * @param acceleration Full acceleration of the fish (maximum speed * accelerationFactor).
+ * @return acceleration (w = 0), 0 without obstacles or farther than range.
+ */
+__device__ DeviceVector d_obstacleSteer( const DeviceVector& vert, float acceleration )
+{
+	if (c_obstacles.volume == 0)								// Uniform branch, the same for all threads
+		return DeviceVector( 0, 0, 0, 0 );
+
+	float u = ( vert.x - c_obstacles.origin.x ) * c_obstacles.invCellSize + 0.5f;	// Texel centers are at +0.5
+	float v = ( vert.y - c_obstacles.origin.y ) * c_obstacles.invCellSize + 0.5f;
+	float w = ( vert.z - c_obstacles.origin.z ) * c_obstacles.invCellSize + 0.5f;
+	float4 field = tex3D<float4>( c_obstacles.volume, u, v, w );
+	if (field.w >= c_obstacles.range)
+		return DeviceVector( 0, 0, 0, 0 );
+
+	DeviceVector gradient( field.x, field.y, field.z, 0.0f );
+	float gradient2 = gradient.length3Squared();
+	if (gradient2 <= 0.0f)
+		return DeviceVector( 0, 0, 0, 0 );
+	float push = fminf( 1.0f - field.w / c_obstacles.range, 2.0f );
+	return gradient * ( acceleration * push * rsqrtf( gradient2 ) );
+}
+
+/*!
+ * @brief Swim to the attractors and away from the repulsors: one trilinear fetch of their summed field (kernel_set_attractors),
+ * whatever the number of attractors.
+ * @param vert Position of the fish.
+ * @param acceleration Full acceleration of the fish (maximum speed * accelerationFactor).
+ * @return acceleration (w = 0), 0 without attractors or out of their reach.
+ */
+__device__ DeviceVector d_attractorSteer( const DeviceVector& vert, float acceleration )
+{
+	if (c_attractors.volume == 0)								// Uniform branch, the same for all threads
+		return DeviceVector( 0, 0, 0, 0 );
+
+	float u = ( vert.x - c_attractors.origin.x ) * c_attractors.invCellSize + 0.5f;	// Texel centers are at +0.5
+	float v = ( vert.y - c_attractors.origin.y ) * c_attractors.invCellSize + 0.5f;
+	float w = ( vert.z - c_attractors.origin.z ) * c_attractors.invCellSize + 0.5f;
+	float4 field = tex3D<float4>( c_attractors.volume, u, v, w );
+	return DeviceVector( field.x, field.y, field.z, 0.0f ) * acceleration;
+}
+
+/*!
+ * @brief Get the alarm cell of a position, clamped to the field.
+ * @param vert Position.
+ * @return cell.
+ */
+__device__ int3 d_alarmPos( const DeviceVector& vert )
+{
+	return make_int3(
+		min( max( static_cast< int >( floorf( ( vert.x - c_alarm.origin.x ) * c_alarm.invCellSize ) ), 0 ), c_alarm.dims.x - 1 ),
+		min( max( static_cast< int >( floorf( ( vert.y - c_alarm.origin.y ) * c_alarm.invCellSize ) ), 0 ), c_alarm.dims.y - 1 ),
+		min( max( static_cast< int >( floorf( ( vert.z - c_alarm.origin.z ) * c_alarm.invCellSize ) ), 0 ), c_alarm.dims.z - 1 ) );
+}
+
+/*!
+ * @brief Index of an alarm cell, x fastest.
+ * @param cell cell inside the field.
+ * @return index.
+ */
+__device__ unsigned int d_alarmIndex( int3 cell )
+{
+	return ( cell.z * c_alarm.dims.y + cell.y ) * c_alarm.dims.x + cell.x;
+}
+
+/*!
+ * @brief Raise the alarm in the cell of a fish which evades a shark (kernel_set_alarm).
+ * @tparam FEATURES AdvanceFeature flags. d_advance_substeps runs several steps without diffusion, it has no alarm.
+ * @param vert Position of the fish.
+ */
+template <unsigned int FEATURES>
+__device__ void d_raiseAlarm( const DeviceVector& vert )
+{
+	if (( FEATURES & FEATURE_SUBSTEPS ) || c_alarm.deposits == NULL)	// Uniform branch, the same for all threads
+		return;
+	atomicAdd( &c_alarm.deposits[d_alarmIndex( d_alarmPos( vert ) )], c_alarm.deposit );
+}
+
+/*!
+ * @brief Flee from the alarm: down its gradient, from the 6 neighbour cells of the fish (kernel_set_alarm).
+ * The push grows with the alarm in the cell of the fish up to a full acceleration at an alarm of 1.
+ * @tparam FEATURES AdvanceFeature flags. No alarm in d_advance_substeps.
+ * @param vert Position of the fish.
+ * @param acceleration Full acceleration of the fish (maximum speed * accelerationFactor).
+ * @return acceleration (w = 0), 0 without alarm or in a quiet cell.
+ */
+template <unsigned int FEATURES>
+__device__ DeviceVector d_alarmSteer( const DeviceVector& vert, float acceleration )
+{
+	if (( FEATURES & FEATURE_SUBSTEPS ) || c_alarm.deposits == NULL)	// Uniform branch, the same for all threads
+		return DeviceVector( 0, 0, 0, 0 );
+
+	const float* __restrict__ level = c_alarm.levels[( c_step.random.step & 1 ) ^ 1];
+	int3 cell = d_alarmPos( vert );
+	float here = level[d_alarmIndex( cell )];
+	if (here < ALARM_QUIET)
+		return DeviceVector( 0, 0, 0, 0 );
+
+	// Central differences, one sided at the border of the field.
+	int3 dims = c_alarm.dims;
+	DeviceVector gradient(
+		level[d_alarmIndex( make_int3( min( cell.x + 1, dims.x - 1 ), cell.y, cell.z ) )] - level[d_alarmIndex( make_int3( max( cell.x - 1, 0 ), cell.y, cell.z ) )],
+		level[d_alarmIndex( make_int3( cell.x, min( cell.y + 1, dims.y - 1 ), cell.z ) )] - level[d_alarmIndex( make_int3( cell.x, max( cell.y - 1, 0 ), cell.z ) )],
+		level[d_alarmIndex( make_int3( cell.x, cell.y, min( cell.z + 1, dims.z - 1 ) ) )] - level[d_alarmIndex( make_int3( cell.x, cell.y, max( cell.z - 1, 0 ) ) )],
+		0.0f );
+	float gradient2 = gradient.length3Squared();
+	if (gradient2 <= 0.0f)
+		return DeviceVector( 0, 0, 0, 0 );
+	return gradient * ( -acceleration * fminf( here, 1.0f ) * rsqrtf( gradient2 ) );
+}
+
+/*!
+ * @brief Drift with the current: two trilinear fetches of the slices of this step (c_step), blended (kernel_set_current).
+ * @param vert Position of the fish.
+ * @return displacement of this step (w = 0), 0 in still water.
+ */
+__device__ DeviceVector d_currentDrift( const DeviceVector& vert )
+{
+	if (c_current.slices[0] == 0)								// Uniform branch, the same for all threads
+		return DeviceVector( 0, 0, 0, 0 );
+
+	float u = ( vert.x - c_current.origin.x ) * c_current.invCellSize + 0.5f;
+	float v = ( vert.y - c_current.origin.y ) * c_current.invCellSize + 0.5f;
+	float w = ( vert.z - c_current.origin.z ) * c_current.invCellSize + 0.5f;
+	float4 from = tex3D<float4>( c_current.slices[c_step.currentSlots.x], u, v, w );
+	float4 to = tex3D<float4>( c_current.slices[c_step.currentSlots.y], u, v, w );
+	float blend = c_step.currentBlend;
+	return DeviceVector( from.x + ( to.x - from.x ) * blend, from.y + ( to.y - from.y ) * blend, from.z + ( to.z - from.z ) * blend, 0.0f ) * c_current.strength;
+}
+
+/*!
+ * @brief Far field of the swarm (kernel_set_far_field), Barnes-Hut style: the BVH is walked from the root and a node
+ * that looks small enough from the fish (opening angle theta) counts as a whole, with its mass at its center.
+ * Every node pulls with mass / distance^2, the mean speed vector of the nodes is weighted the same way. O(log N) nodes per fish.
+ * Fishies inside fishDist, the fish itself among them, are left to the neighbour search.
+ * @param vert Position of the fish.
+ * @param state Speed vector of the fish.
+ * @param acceleration Full acceleration of the fish (maximum speed * accelerationFactor).
+ * @return acceleration (w = 0), 0 without far field.
+ */
+__device__ DeviceVector d_farFieldSteer( const DeviceVector& vert, const DeviceVector& state, float acceleration )
+{
+	if (c_farField.nodes == NULL)								// Uniform branch, the same for all threads
+		return DeviceVector( 0, 0, 0, 0 );
+
+	DeviceVector pull( 0, 0, 0, 0 );
+	DeviceVector flow( 0, 0, 0, 0 );
+	float weight = 0.0f;
+
+	int stack[BVH_STACK_SIZE];
+	unsigned int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const BvhNode* node = c_farField.nodes + stack[--top];
+		float4 center = __ldg( &node->center );
+		if (center.w <= 0.0f)									// Only dead fishies below
+			continue;
+
+		float4 velocity = __ldg( &node->velocity );
+		DeviceVector diff( center.x - vert.x, center.y - vert.y, center.z - vert.z, 0.0f );
+		float dist2 = diff.length3Squared();
+		int2 children = __ldg( &node->children );
+		if (children.x >= 0 && velocity.w * velocity.w >= c_farField.theta2 * dist2 && top + 2 <= BVH_STACK_SIZE)
+		{
+			stack[top++] = children.y;
+			stack[top++] = children.x;
+			continue;
+		}
+		if (dist2 < c_farField.nearDist2)
+			continue;
+
+		float w = center.w / dist2;
+		pull += diff * ( w * rsqrtf( dist2 ) );
+		flow += DeviceVector( velocity.x, velocity.y, velocity.z, 0.0f ) * ( 1.0f / dist2 );	// Sum of mass * speed, weighted like the mass
+		weight += w;
+	}
+
+	DeviceVector steer( 0, 0, 0, 0 );
+	float pull2 = pull.length3Squared();
+	if (pull2 > 0.0f)
+		steer += pull * ( acceleration * c_farField.cohesion * rsqrtf( pull2 ) );
+	if (weight > 0.0f)
+		steer += ( flow * ( 1.0f / weight ) - state ) * c_farField.alignment;
+	return steer;
+}
+
+/*!
+ * @brief Find the nearest shark.
+ * @param vert Position of the fish.
+ * @param sharks Positions of all sharks (NULL: constant memory).
+ * @param shark_count Number of sharks.
+ * @param sharkDiff Output: Difference vector from the fish to the nearest shark.
+ * @param sharkIndex Output: index of the nearest shark. NULL: not needed.
+ * @return Distance to the nearest shark (FLT_MAX without sharks).
+ */
+__device__ float d_nearestShark( DeviceVector vert, const float4* __restrict__ sharks, unsigned int shark_count, DeviceVector* sharkDiff,
+	unsigned int* sharkIndex = NULL )
+{
+	float sharkDistance2 = FLT_MAX;
+	for (unsigned int i = 0; i < shark_count; i++)
+	{
+		DeviceVector d = d_loadShark( sharks, i ) - vert;
+		float d2 = d.length3Squared();
+		if (d2 < sharkDistance2)
+		{
+			*sharkDiff = d;
+			sharkDistance2 = d2;
+			if (sharkIndex != NULL)
+				*sharkIndex = i;
+		}
+	}
+	return sharkDistance2 < FLT_MAX ? sqrtf( sharkDistance2 ) : FLT_MAX;
+}
+
+/*!
+ * @brief Append a fish event to the queue of this step (c_step.events), if there is one.
+ * The active threads of a warp reserve their slots with a single atomic. Events beyond the capacity are only counted.
+ * @param type kind of the event.
+ * @param fish stable id of the fish.
+ * @param shark index of the shark, 0xffffffff: none.
+ * @param vert position of the fish.
+ * @param distance distance to the shark.
+ */
+__device__ void d_logEvent( SwarmEventType type, unsigned int fish, unsigned int shark, DeviceVector vert, float distance )
+{
+	const EventQueue& queue = c_step.events;
+	if (queue.events == NULL)
+		return;
+
+	unsigned int active = __activemask();
+	unsigned int leader = __ffs( active ) - 1;
+	unsigned int lane = threadIdx.x & 31;
+	unsigned int base = 0;
+	if (lane == leader)
+		base = atomicAdd( queue.count, static_cast< unsigned int >( __popc( active ) ) );
+	unsigned int slot = __shfl_sync( active, base, leader ) + __popc( active & ( ( 1u << lane ) - 1 ) );
+	if (slot >= queue.capacity)
+		return;
+
+	SwarmEvent event;
+	event.type = static_cast< unsigned int >( type );
+	event.fish = fish;
+	event.shark = shark;
+	event.step = c_step.random.step;
+	event.x = vert.x;
+	event.y = vert.y;
+	event.z = vert.z;
+	event.distance = distance;
+	queue.events[slot] = event;
+}
+
+/*!
+ * @brief Sums over all neighbours of a fish inside a radius, found on the uniform grid.
+ */
+struct Neighbourhood
+{
+	DeviceVector separation;	//!< Sum of (fish - neighbour) / distance^2. Points away from close neighbours.
+	DeviceVector velocity;		//!< Sum of the speed vectors of the neighbours.
+	DeviceVector position;		//!< Sum of the positions of the neighbours.
+	unsigned int count;			//!< Number of neighbours.
+};
+
+/*!
+ * @brief Collect all fishies inside the radius from the 27 cells around the fish.
+ * @param sorted Particles sorted by cell (read only).
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param grid Grid placement. Edge length of a cell must be >= radius.
+ * @param radius Perception radius of a fish.
+ * @param vert Position of the fish.
+ * @param self Sorted index of the fish.
+ * @return sums over all neighbours.
+ */
+__device__ Neighbourhood d_gridNeighbourhood(
+	const ParticleArrays& sorted,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	const GridLayout& grid,
+	float radius,
+	DeviceVector vert,
+	unsigned int self)
+{
+	Neighbourhood n;
+	n.separation = DeviceVector( 0, 0, 0 );
+	n.velocity = DeviceVector( 0, 0, 0 );
+	n.position = DeviceVector( 0, 0, 0 );
+	n.count = 0;
+
+	int3 cell = d_calcGridPos( vert, grid );
+	float radius2 = radius * radius;
+	for (int c = 0; c < 27; c++)
+	{
+		unsigned int hash = d_calcGridHash( make_int3( cell.x + c % 3 - 1, cell.y + c / 3 % 3 - 1, cell.z + c / 9 - 1 ), grid );
+		unsigned int start = cellStart[hash];
+
+		// cell is empty
+		if (start == EMPTY_CELL)
+			continue;
+
+		unsigned int end = cellEnd[hash];
+		for (unsigned int i = start; i < end; i++)
+		{
+			DeviceVector other = d_loadPosition( sorted, i );
+			DeviceVector d = vert - other;
+			float d2 = d.length3Squared();
+			if (i == self || d2 >= radius2 || d2 == 0.0f)
+				continue;
+
+			n.separation += d * ( 1.0f / d2 );
+			n.velocity += DeviceVector( sorted.vx[i], sorted.vy[i], sorted.vz[i] );
+			n.position += other;
+			n.count++;
+		}
+	}
+	return n;
+}
+
+/*!
+ * @brief Approximate the neighbourhood of a fish from the means of the 27 cells around it (d_cellMeans).
+ * Every cell counts as its fishies at their centroid, so the cost is constant however dense the cells are.
+ * The fish itself is taken out of the means of its own cell.
+ * @param cellVelocity Mean speed vector and number of fishies per cell.
+ * @param cellCentroid Mean position per cell.
+ * @param grid Grid placement.
+ * @param vert Position of the fish.
+ * @param state Speed vector of the fish.
+ * @return sums over all neighbours, as d_gridNeighbourhood.
+ */
+__device__ Neighbourhood d_meanFieldNeighbourhood(
+	const float4* __restrict__ cellVelocity,
+	const float4* __restrict__ cellCentroid,
+	const GridLayout& grid,
+	DeviceVector vert,
+	DeviceVector state)
+{
+	Neighbourhood n;
+	n.separation = DeviceVector( 0, 0, 0 );
+	n.velocity = DeviceVector( 0, 0, 0 );
+	n.position = DeviceVector( 0, 0, 0 );
+	n.count = 0;
+
+	int3 cell = d_calcGridPos( vert, grid );
+	for (int c = 0; c < 27; c++)
+	{
+		unsigned int hash = d_calcGridHash( make_int3( cell.x + c % 3 - 1, cell.y + c / 3 % 3 - 1, cell.z + c / 9 - 1 ), grid );
+		float4 v = cellVelocity[hash];
+		float count = v.w;
+		DeviceVector velocity = DeviceVector( v.x, v.y, v.z ) * count;
+		DeviceVector position = DeviceVector( cellCentroid[hash] ) * count;
+		if (c == 13)															// Own cell without the fish
+		{
+			velocity -= state;
+			position -= vert;
+			count -= 1.0f;
+		}
+		if (count < 0.5f)
+			continue;
+
+		DeviceVector d = vert - position * ( 1.0f / count );
+		float d2 = d.length3Squared();
+		if (d2 > 0.0f)
+			n.separation += d * ( count / d2 );
+		n.velocity += velocity;
+		n.position += position;
+		n.count += static_cast< unsigned int >( count + 0.5f );
+	}
+	return n;
+}
+
+/*!
+ * @brief Apply the steering of a step as acceleration over the step length (kernel_set_integrator).
+ * Nothing with Integrator::LEGACY, the steering is the change of the step as it is.
+ * @param state Speed vector after the steering, per base step. Will be updated.
+ * @param before Speed vector before the steering.
+ */
+__device__ void d_kick( DeviceVector& state, DeviceVector before )
+{
+	if (c_step.integrator == Integrator::LEGACY)
+		return;
+
+	DeviceVector acceleration = state - before;					// Change per base step
+	state = before;												// Keeps the mass
+	state += acceleration * c_step.dtScale;
+}
+
+/*!
+ * @brief Damping factor of a step, the same per simulated second for every step length.
+ * @param perBaseStep factor of one base step.
+ * @return factor of this step.
+ */
+__device__ float d_damping( float perBaseStep )
+{
+	return c_step.integrator == Integrator::LEGACY ? perBaseStep : __powf( perBaseStep, c_step.dtScale );
+}
+
+/*!
+ * @brief Move a fish over the step with the speed vectors before and after the step.
+ * Semi-implicit Euler and LEGACY move with the new speed vector, velocity Verlet with the mean of both:
+ * x + v h + a h^2 / 2, the acceleration of the step start is used for both halves of the kick.
+ * @param vert Position of the fish. Will be updated.
+ * @param before Speed vector at the step start.
+ * @param state Speed vector at the step end.
+ */
+__device__ void d_moveFish( DeviceVector& vert, DeviceVector before, DeviceVector state )
+{
+	if (c_step.integrator == Integrator::VERLET)
+		vert += ( before + state ) * ( 0.5f * c_step.dtScale );
+	else
+		vert += state * c_step.dtScale;
+}
+
+/*!
+ * @brief Calculate behavior of one living fish with the boids model (separation, alignment, cohesion).
+ * Fishies can be eaten by shark and try to evade shark, like in d_swim.
+ * Instead of the global swarm center the local neighbourhood holds the swarm together, the waypoint only gives a weak goal.
+ * @tparam FEATURES AdvanceFeature flags, see SWIM_FEATURES.
+ * @param vert Position of the fish. Will be updated.
+ * @param state Speed vector (x, y, z) and mass (w) of the fish. Will be updated.
+ * @param id Index of the fish in the particle store (key of the random numbers).
+ * @param school School of the fish (d_schoolOf). Its center is the goal.
+ * @param ids Stable ids of the store of id (read for the fish events and the species only).
+ * @param n Neighbourhood of the fish.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks (NULL: constant memory).
+ * @param shark_count Number of sharks.
+ * @return false, if the fish was eaten.
+ */
+template <unsigned int FEATURES>
+__device__ bool d_swimBoids(
+	DeviceVector& vert,
+	DeviceVector& state,
+	unsigned int id,
+	unsigned int school,
+	const unsigned int* __restrict__ ids,
+	const Neighbourhood& n,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count)
+{
+	FishTraits traits = d_traitsOf<FEATURES>( ids, id, state.w, c_params );
+	float my_speed = speed * traits.speed;
+
+	DeviceVector sharkDiff;
+	unsigned int shark = 0xffffffff;
+	float sharkDistance = d_nearestShark( vert, sharks, shark_count, &sharkDiff, &shark );
+
+	// shark eats fish, unless the sharks bite themselves (kernel_set_shark_target)
+	if (sharkDistance < c_params.sharkBiteDist && !c_step.sharkBites)
+	{
+		d_logEvent( SwarmEventType::DEATH, ids[id], shark, vert, sharkDistance );
+		return false;
+	}
+
+	DeviceVector steer( 0, 0, 0 );
+	// evade shark
+	if (sharkDistance < traits.sharkDist * traits.mass)
+	{
+		if (sharkDistance < 2.0f * c_params.sharkBiteDist)
+			d_logEvent( SwarmEventType::NEAR_MISS, ids[id], shark, vert, sharkDistance );
+		steer -= sharkDiff * ( my_speed * c_params.accelerationFactor / sharkDistance );
+		d_raiseAlarm<FEATURES>( vert );
+	}
+	else
+	{
+		steer += d_alarmSteer<FEATURES>( vert, my_speed * c_params.accelerationFactor );
+		if (n.count > 0)
+		{
+			float inv = 1.0f / n.count;
+			DeviceVector separation = n.separation;
+			DeviceVector velocity = n.velocity;
+			DeviceVector position = n.position;
+
+			float separation2 = separation.length3Squared();
+			if (separation2 > 0.0f)
+				steer += separation * ( my_speed * c_params.boidsSeparation * rsqrtf( separation2 ) );
+
+			steer += ( velocity * inv - state ) * c_params.boidsAlignment;
+
+			DeviceVector toCenter = position * inv - vert;
+			float toCenter2 = toCenter.length3Squared();
+			if (toCenter2 > 0.0f)
+				steer += toCenter * ( my_speed * c_params.boidsCohesion * rsqrtf( toCenter2 ) );
+		}
+
+		DeviceVector toGoal = d_schoolCenter<FEATURES>( school ) - vert;
+		float toGoal2 = toGoal.length3Squared();
+		if (toGoal2 > 0.0f)
+			steer += toGoal * ( my_speed * c_params.boidsGoal * rsqrtf( toGoal2 ) );
+
+		steer += d_farFieldSteer( vert, state, my_speed * c_params.accelerationFactor );
+	}
+
+	steer += d_obstacleSteer( vert, my_speed * c_params.accelerationFactor );
+	steer += d_attractorSteer( vert, my_speed * c_params.accelerationFactor );
+	if (FEATURES & FEATURE_JITTER)
+		steer += d_jitter<FEATURES>( id ) * ( my_speed * c_params.jitter );
+
+	DeviceVector before = state;
+	state += steer;
+	d_kick( state, before );
+	float len2 = state.length3Squared();
+	if (len2 > my_speed * my_speed)
+	{
+		state *= my_speed * rsqrtf( len2 );
+	}
+	d_moveFish( vert, before, state );
+	vert += d_currentDrift( vert ) * c_step.dtScale;
+	return true;
+}
+
+/*!
+ * @brief Calculate behavior of one living fish.
+ * Fishies can be eaten by shark, try to evade shark, keep distance to other fishies and return to swarm when to far away.
+ * @tparam FEATURES AdvanceFeature flags, see SWIM_FEATURES. The search has its own flags.
+ * @tparam NeighbourSearch Functor used to find the closest fish.
+ * @param vert Position of the fish. Will be updated.
+ * @param state Speed vector (x, y, z) and mass (w) of the fish. Will be updated.
+ * @param self Index of the fish inside the searched buffer.
+ * @param id Index of the fish in the particle store (key of the random numbers).
+ * @param school School of the fish (d_schoolOf). The fish returns to its center.
+ * @param ids Stable ids of the store of id (read for the fish events and the species only).
+ * @param search Neighbour search functor.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks (NULL: constant memory).
+ * @param shark_count Number of sharks.
+ * @param params Behaviour parameters: c_params, or the ones of an ensemble member (d_advance_ensemble).
+ * @return false, if the fish was eaten.
+ */
+template <unsigned int FEATURES, class NeighbourSearch>
+__device__ bool d_swim(
+	DeviceVector& vert,
+	DeviceVector& state,
+	unsigned int self,
+	unsigned int id,
+	unsigned int school,
+	const unsigned int* __restrict__ ids,
+	const NeighbourSearch& search,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count,
+	const SwarmParams& params)
+{
+	FishTraits traits = d_traitsOf<FEATURES>( ids, id, state.w, params );
+	float my_speed = speed * traits.speed;
+	float acceleration_factor = params.accelerationFactor;
+	DeviceVector before = state;
+
+	// nearest shark
+	DeviceVector sharkDiff;
+	unsigned int shark = 0xffffffff;
+	float sharkDistance = d_nearestShark( vert, sharks, shark_count, &sharkDiff, &shark );
+
+	// shark eats fish, unless the sharks bite themselves (kernel_set_shark_target)
+	if (sharkDistance < params.sharkBiteDist && !c_step.sharkBites)
+	{
+		d_logEvent( SwarmEventType::DEATH, ids[id], shark, vert, sharkDistance );
+		return false;
+	}
+	// evade shark
+	if (sharkDistance < traits.sharkDist * traits.mass)
+	{
+		if (sharkDistance < 2.0f * params.sharkBiteDist)
+			d_logEvent( SwarmEventType::NEAR_MISS, ids[id], shark, vert, sharkDistance );
+		sharkDiff = sharkDiff.normalized() * my_speed * acceleration_factor;
+		state -= sharkDiff;
+		d_raiseAlarm<FEATURES>( vert );
+	}
+	else
+	{
+		state += d_alarmSteer<FEATURES>( vert, my_speed * acceleration_factor );
+		DeviceVector center = d_schoolCenter<FEATURES>( school );
+
+		// find closest fish
+		DeviceVector closest;
+		float closest_dist;
+		search( vert, self, &closest, &closest_dist );
+
+		DeviceVector diff = center - vert;
+
+		// keep distance to other fishies
+		bool too_close = closest_dist < traits.fishDist;
+		if (too_close)
+		{
+			DeviceVector avoid = closest.normalized() * my_speed * acceleration_factor * 0.7f;
+			state -= avoid;
+			vert += state * c_step.dtScale;
+			acceleration_factor /= 2;
+		}
+		// return to swarm
+		if (diff.length3() > params.centerThreshold * traits.mass)
+		{
+			diff = diff.normalized() * my_speed * (acceleration_factor * 0.4f);
+			state += diff;
+		}
+		// stay with the far fishies
+		state += d_farFieldSteer( vert, state, my_speed * acceleration_factor );
+	}
+	state += d_obstacleSteer( vert, my_speed * params.accelerationFactor );
+	state += d_attractorSteer( vert, my_speed * params.accelerationFactor );
+	if (FEATURES & FEATURE_JITTER)
+	{
+		state += d_jitter<FEATURES>( id ) * ( my_speed * params.jitter );
+	}
+	d_kick( state, before );
+	if (state.length3() > my_speed * 0.75f)
+	{
+		state *= d_damping( 0.96f );
+	}
+	d_moveFish( vert, before, state );
+	vert += d_currentDrift( vert ) * c_step.dtScale;				// The water moves the fish, not its speed vector
+	return true;
+}
+
+/*!
+ * @brief Kernel function that controls behavior of a fish in the swarm.
+ * Fishies can be eaten by shark, try to evade shark, keep distance to other fishies and return to swarm when to far away.
+ * Brute force version: iterates over all fishies in order to get the closest. Kept as reference for d_advance_grid.
+ * Swarm behavior can be modified by changing global variables at the beginning of this file.
+ * Reads from one store and writes to the other one (ping-pong), so no fish reads a position that was already updated.
+ * @tparam FEATURES AdvanceFeature flags, see QUERY_FEATURES.
+ * @param in Positions, speed vectors and masses of all fishies (read only).
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param mesh_count Number of fishies.
+ * @param speed Approximate maximum speed of fishies. Approximate because it can get higher depending on the mass.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ * @param firstK See NeighbourQuery.
+*/
+template <unsigned int FEATURES>
+__global__ void d_advance(
+	ParticleArrays in,
+	ParticleArrays out,
+	unsigned int mesh_count,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count,
+	unsigned int firstK)
+{
+	int t_x = threadIdx.x;
+	int b_x = blockIdx.x;
+	int in_x = b_x * blockDim.x + t_x;
+	if (in_x >= mesh_count)
+		return;
+
+	DeviceVector vert = d_loadPosition( in, in_x );
+	DeviceVector state = d_loadState( in, in_x );
+	unsigned char alive = in.alive[in_x];
+
+	BruteForceSearch<FEATURES> search = { in, mesh_count, firstK };
+	if (alive)
+		alive = d_swim<FEATURES>( vert, state, in_x, in_x, d_schoolOf<FEATURES>( in.id, in_x ), in.id, search, speed, sharks, shark_count, c_params );
+
+	d_storeParticle( out, in_x, vert, state, alive );
+}
+
+/*!
+ * @brief First phase of the evasion split (kernel_set_evasion_split): moves the dead, eaten and evading fishies
+ * and appends the flocking ones to a list. Evading fishies don't search, in d_advance their warp still waits
+ * for the O(N) search of its flocking lanes; d_advance_flocking only runs the search over the list.
+ * @tparam FEATURES AdvanceFeature flags, see SWIM_FEATURES.
+ * @param in Positions, speed vectors and masses of all fishies (read only).
+ * @param out Output: New positions, speed vectors and masses of all fishies, except the flocking ones.
+ * @param mesh_count Number of fishies.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ * @param flockList Output: indices of the flocking fishies, in no particular order.
+ * @param flockCount Output: number of indices in flockList. Must be 0 before the launch.
+ */
+template <unsigned int FEATURES>
+__global__ void d_classifyEvaders(
+	ParticleArrays in,
+	ParticleArrays out,
+	unsigned int mesh_count,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count,
+	unsigned int* flockList,
+	unsigned int* flockCount)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	DeviceVector vert = d_loadPosition( in, in_x );
+	DeviceVector state = d_loadState( in, in_x );
+	unsigned char alive = in.alive[in_x];
+
+	if (alive)
+	{
+		// Same decision as d_swim: neither eaten nor evading means the fish searches its neighbours.
+		DeviceVector sharkDiff;
+		float sharkDistance = d_nearestShark( vert, sharks, shark_count, &sharkDiff );
+		FishTraits traits = d_traitsOf<FEATURES>( in.id, in_x, state.w, c_params );
+		if (sharkDistance >= c_params.sharkBiteDist && sharkDistance >= traits.sharkDist * traits.mass)
+		{
+			flockList[atomicAdd( flockCount, 1u )] = in_x;
+			return;
+		}
+
+		PrecomputedSearch search = { DeviceVector(), FLT_MAX };							// Never called, the fish evades or is eaten
+		alive = d_swim<FEATURES>( vert, state, in_x, in_x, d_schoolOf<FEATURES>( in.id, in_x ), in.id, search, speed, sharks, shark_count, c_params );
+	}
+
+	d_storeParticle( out, in_x, vert, state, alive );
+}
+
+/*!
+ * @brief Second phase of the evasion split: brute force d_advance over the flocking fishies of d_classifyEvaders.
+ * Threads beyond the number of flocking fishies leave at once, so whole warps of evaders cost nothing.
+ * @tparam FEATURES AdvanceFeature flags, see QUERY_FEATURES.
+ * @param in Positions, speed vectors and masses of all fishies (read only).
+ * @param out Output: New positions, speed vectors and masses of the flocking fishies.
+ * @param mesh_count Number of fishies.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ * @param flockList indices of the flocking fishies.
+ * @param flockCount number of indices in flockList.
+ * @param firstK See NeighbourQuery.
+ */
+template <unsigned int FEATURES>
+__global__ void d_advance_flocking(
+	ParticleArrays in,
+	ParticleArrays out,
+	unsigned int mesh_count,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count,
+	const unsigned int* __restrict__ flockList,
+	const unsigned int* __restrict__ flockCount,
+	unsigned int firstK)
+{
+	unsigned int k = blockIdx.x * blockDim.x + threadIdx.x;
+	if (k >= *flockCount)
+		return;
+
+	unsigned int in_x = flockList[k];
+	DeviceVector vert = d_loadPosition( in, in_x );
+	DeviceVector state = d_loadState( in, in_x );
+
+	BruteForceSearch<FEATURES> search = { in, mesh_count, firstK };
+	unsigned char alive = d_swim<FEATURES>( vert, state, in_x, in_x, d_schoolOf<FEATURES>( in.id, in_x ), in.id, search, speed, sharks, shark_count, c_params );
+
+	d_storeParticle( out, in_x, vert, state, alive );
+}
+
+/*!
+ * @brief Tiled version of d_advance for small swarms.
+ * Every block loads all positions tile by tile into shared memory instead of reading every fish from global memory.
+ * The search is done by every thread before the behavior, because the whole block has to take part in the tile loads.
+ * @tparam FEATURES AdvanceFeature flags, see QUERY_FEATURES.
+ * @param in Positions, speed vectors and masses of all fishies (read only).
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param mesh_count Number of fishies.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ * @param firstK See NeighbourQuery.
+ */
+template <unsigned int FEATURES>
+__global__ void d_advance_tiled(
+	ParticleArrays in,
+	ParticleArrays out,
+	unsigned int mesh_count,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count,
+	unsigned int firstK)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	bool valid = in_x < mesh_count;
+
+	// Out of range threads still help loading the tiles.
+	DeviceVector vert = valid ? d_loadPosition( in, in_x ) : DeviceVector();
+
+	PrecomputedSearch search;
+	d_tiledSearch<FEATURES>( in, mesh_count, vert, in_x, firstK, &search.closest, &search.closest_dist );
+
+	if (!valid)
+		return;
+
+	DeviceVector state = d_loadState( in, in_x );
+	unsigned char alive = in.alive[in_x];
+	if (alive)
+		alive = d_swim<FEATURES>( vert, state, in_x, in_x, d_schoolOf<FEATURES>( in.id, in_x ), in.id, search, speed, sharks, shark_count, c_params );
+
+	d_storeParticle( out, in_x, vert, state, alive );
+}
+
+/*!
+ * @brief d_advance_tiled with d_tiledSearchAsync: the next tile streams into shared memory while the current one is scanned.
+ * Used instead of d_advance_tiled on compute capability 8.0 or newer.
+ * @tparam FEATURES AdvanceFeature flags, see QUERY_FEATURES.
+ * @param in Positions, speed vectors and masses of all fishies (read only).
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param mesh_count Number of fishies.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ * @param firstK See NeighbourQuery.
+ */
+template <unsigned int FEATURES>
+__global__ void d_advance_tiled_async(
+	ParticleArrays in,
+	ParticleArrays out,
+	unsigned int mesh_count,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count,
+	unsigned int firstK)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	bool valid = in_x < mesh_count;
+
+	// Out of range threads still help loading the tiles.
+	DeviceVector vert = valid ? d_loadPosition( in, in_x ) : DeviceVector();
+
+	PrecomputedSearch search;
+	d_tiledSearchAsync<FEATURES>( in, mesh_count, vert, in_x, firstK, &search.closest, &search.closest_dist );
+
+	if (!valid)
+		return;
+
+	DeviceVector state = d_loadState( in, in_x );
+	unsigned char alive = in.alive[in_x];
+	if (alive)
+		alive = d_swim<FEATURES>( vert, state, in_x, in_x, d_schoolOf<FEATURES>( in.id, in_x ), in.id, search, speed, sharks, shark_count, c_params );
+
+	d_storeParticle( out, in_x, vert, state, alive );
+}
+
+/*!
+ * @brief Ensemble version of d_advance_tiled: independent swarms packed into one store, all advanced by one launch.
+ * Row blockIdx.y of the grid belongs to one member, so the tiles only hold fishies of that member and the parameters
+ * of a block are uniform. A fish only sees the fishies and sharks of its own member. Rows are as long as the largest member.
+ * @tparam FEATURES AdvanceFeature flags, 0 or FEATURE_JITTER. Members have a single school and find the closest fish.
+ * @param in Positions, speed vectors and masses of all fishies (read only).
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param members first slot (x) and number of fishies (y) per member.
+ * @param params behaviour parameters per member.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks, sharksPerMember per member.
+ * @param sharksPerMember Number of sharks per member.
+ */
+template <unsigned int FEATURES>
+__global__ void d_advance_ensemble(
+	ParticleArrays in,
+	ParticleArrays out,
+	const uint2* __restrict__ members,
+	const SwarmParams* __restrict__ params,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int sharksPerMember)
+{
+	uint2 member = members[blockIdx.y];
+	if (blockIdx.x * blockDim.x >= member.y)					// Whole block beyond this member, before any __syncthreads
+		return;
+
+	unsigned int local = blockIdx.x * blockDim.x + threadIdx.x;
+	bool valid = local < member.y;
+	unsigned int in_x = member.x + local;
+
+	// The tiles of the search only cover this member.
+	ParticleArrays swarm = in;
+	swarm.x += member.x;
+	swarm.y += member.x;
+	swarm.z += member.x;
+	swarm.alive += member.x;
+	DeviceVector vert = valid ? d_loadPosition( in, in_x ) : DeviceVector();
+
+	PrecomputedSearch search;
+	d_tiledSearch<FEATURES>( swarm, member.y, vert, local, 0, &search.closest, &search.closest_dist );
+
+	if (!valid)
+		return;
+
+	SwarmParams memberParams = params[blockIdx.y];
+	DeviceVector state = d_loadState( in, in_x );
+	unsigned char alive = in.alive[in_x];
+	if (alive)
+		alive = d_swim<FEATURES>( vert, state, in_x, in_x, 0, in.id, search, speed, sharks + blockIdx.y * sharksPerMember, sharksPerMember, memberParams );
+
+	d_storeParticle( out, in_x, vert, state, alive );
+}
+
+/*!
+ * @brief Warp cooperative version of d_advance. One warp handles one fish:
+ * every lane scans a stripe of the other fishies, the closest one is found with a shuffle reduction.
+ * Spreads the long search loop over more threads, so mid-size swarms fill the SMs.
+ * Number of threads must be mesh_count * WARP_SIZE, block size a multiple of WARP_SIZE.
+ * Always finds the closest fish (firstK is ignored, the lanes can't stop early together).
+ * @tparam FEATURES AdvanceFeature flags, see SWIM_FEATURES.
+ * @param in Positions, speed vectors and masses of all fishies (read only).
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param mesh_count Number of fishies.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ */
+template <unsigned int FEATURES>
+__global__ void d_advance_warp(
+	ParticleArrays in,
+	ParticleArrays out,
+	unsigned int mesh_count,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count)
+{
+	unsigned int thread = blockIdx.x * blockDim.x + threadIdx.x;
+	unsigned int in_x = thread / WARP_SIZE;
+	unsigned int lane = thread % WARP_SIZE;
+
+	// The whole warp leaves together, so the shuffles below always see all lanes.
+	if (in_x >= mesh_count)
+		return;
+
+	DeviceVector vert = d_loadPosition( in, in_x );
+
+	float best = FLT_MAX;
+	unsigned int bestIndex = in_x;
+	for (unsigned int i = lane; i < mesh_count; i += WARP_SIZE)
+	{
+		if (i == in_x || !in.alive[i])
+			continue;
+
+		float d2 = ( vert - d_loadPosition( in, i ) ).length3Squared();
+		if (d2 < best)
+		{
+			best = d2;
+			bestIndex = i;
+		}
+	}
+
+	// Reduce (distance, index) over the warp. Lane 0 gets the closest fish.
+	for (unsigned int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
+	{
+		float otherBest = __shfl_down_sync( FULL_WARP_MASK, best, offset );
+		unsigned int otherIndex = __shfl_down_sync( FULL_WARP_MASK, bestIndex, offset );
+		if (otherBest < best)
+		{
+			best = otherBest;
+			bestIndex = otherIndex;
+		}
+	}
+
+	if (lane != 0)
+		return;
+
+	PrecomputedSearch search;
+	search.closest = best < FLT_MAX ? vert - d_loadPosition( in, bestIndex ) : DeviceVector();
+	search.closest_dist = best < FLT_MAX ? sqrtf( best ) : FLT_MAX;
+
+	DeviceVector state = d_loadState( in, in_x );
+	unsigned char alive = in.alive[in_x];
+	if (alive)
+		alive = d_swim<FEATURES>( vert, state, in_x, in_x, d_schoolOf<FEATURES>( in.id, in_x ), in.id, search, speed, sharks, shark_count, c_params );
+
+	d_storeParticle( out, in_x, vert, state, alive );
+}
+
+/*!
+ * @brief Split a position into the row of a fish (matrix A of d_advance_tensor) or the column of a candidate (matrix B).
+ * Half precision alone can't tell close fishies apart, so every coordinate becomes a half hi and the half remainder lo:
+ * rows are (hi, hi, lo), columns (hi, lo, hi), the rest of the 16 entries is 0. One product sums hi*hi + hi*lo + lo*hi in float,
+ * only lo*lo is lost.
+ * @param p Position relative to the origin of the block.
+ * @param column true: column order (hi, lo, hi).
+ * @param out Output: 16 entries.
+ */
+__device__ void d_splitHalf( const DeviceVector& p, bool column, __half* out )
+{
+	float coords[3] = { p.x, p.y, p.z };
+	for (unsigned int c = 0; c < 3; c++)
+	{
+		__half hi = __float2half( coords[c] );
+		__half lo = __float2half( coords[c] - __half2float( hi ) );
+		out[c] = hi;
+		out[3 + c] = column ? lo : hi;
+		out[6 + c] = column ? hi : lo;
+	}
+	for (unsigned int k = 9; k < 16; k++)
+		out[k] = __float2half( 0.0f );
+}
+
+/*!
+ * @brief Tensor core version of d_advance (experimental). The squared distances |a - b|^2 = |a|^2 + |b|^2 - 2 a.b
+ * of the 16 fishies of a warp to 16 candidates are one 16x16x16 matrix product (WMMA, half inputs, float sums).
+ * The block loads TENSOR_CHUNK candidates at a time into shared memory, every warp multiplies its rows with them
+ * and two lanes per row search the minimum of the products right away (fused row minimum).
+ * Positions are split with d_splitHalf, relative to the first fish of the block: near each other after a Morton reorder.
+ * The distance of the winner is measured again in float, close runners up may still be mixed up.
+ * Block size must be TENSOR_THREADS with TENSOR_ROWS fishies per block. Needs compute capability 7.0, does nothing before.
+ * Always finds the closest fish (firstK is ignored, like d_advance_warp).
+ * @tparam FEATURES AdvanceFeature flags, see SWIM_FEATURES.
+ * @param in Positions, speed vectors and masses of all fishies (read only).
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param mesh_count Number of fishies.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ */
+template <unsigned int FEATURES>
+__global__ void d_advance_tensor(
+	ParticleArrays in,
+	ParticleArrays out,
+	unsigned int mesh_count,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count)
+{
+#if !defined(__CUDA_ARCH__) || __CUDA_ARCH__ >= 700
+	using namespace nvcuda;
+
+	__shared__ __align__( 32 ) __half tensorRows[TENSOR_WARPS][16 * 16];	// Matrix A of every warp, row major
+	__shared__ __align__( 32 ) __half tensorColumns[TENSOR_CHUNK * 16];	// Matrix B of the chunk, column major
+	__shared__ __align__( 32 ) float tensorDots[TENSOR_WARPS][16 * TENSOR_DOT_STRIDE];	// a.b of every warp, row major
+	__shared__ float tensorNorms[TENSOR_CHUNK];	// |b|^2 of the chunk, FLT_MAX for dead fishies
+
+	unsigned int warp = threadIdx.x / WARP_SIZE;
+	unsigned int lane = threadIdx.x % WARP_SIZE;
+	unsigned int row = lane % 16;
+	unsigned int first = blockIdx.x * TENSOR_ROWS;
+	unsigned int in_x = first + warp * 16 + row;
+	bool valid = in_x < mesh_count;
+
+	// Rows beyond mesh_count still multiply, their minimum is dropped.
+	DeviceVector origin = d_loadPosition( in, first );
+	DeviceVector vert = valid ? d_loadPosition( in, in_x ) : origin;
+	DeviceVector local = vert - origin;
+	float rowNorm = local.length3Squared();
+	if (lane < 16)
+		d_splitHalf( local, false, tensorRows[warp] + row * 16 );
+	__syncwarp();
+
+	wmma::fragment<wmma::matrix_a, 16, 16, 16, __half, wmma::row_major> rows;
+	wmma::load_matrix_sync( rows, tensorRows[warp], 16 );
+
+	float best = FLT_MAX;
+	unsigned int bestIndex = in_x;
+	for (unsigned int chunkStart = 0; chunkStart < mesh_count; chunkStart += TENSOR_CHUNK)
+	{
+		if (threadIdx.x < TENSOR_CHUNK)
+		{
+			unsigned int j = chunkStart + threadIdx.x;
+			bool candidate = j < mesh_count && in.alive[j];
+			DeviceVector p = candidate ? d_loadPosition( in, j ) - origin : DeviceVector( 0.0f, 0.0f, 0.0f );
+			d_splitHalf( p, true, tensorColumns + threadIdx.x * 16 );
+			tensorNorms[threadIdx.x] = candidate ? p.length3Squared() : FLT_MAX;	// The product stays 0, the sum can't win
+		}
+
+		__syncthreads();
+
+		for (unsigned int tile = 0; tile < TENSOR_CHUNK / 16; tile++)
+		{
+			wmma::fragment<wmma::matrix_b, 16, 16, 16, __half, wmma::col_major> columns;
+			wmma::fragment<wmma::accumulator, 16, 16, 16, float> dots;
+			wmma::load_matrix_sync( columns, tensorColumns + tile * 16 * 16, 16 );
+			wmma::fill_fragment( dots, 0.0f );
+			wmma::mma_sync( dots, rows, columns, dots );
+			wmma::store_matrix_sync( tensorDots[warp] + tile * 16, dots, TENSOR_DOT_STRIDE, wmma::mem_row_major );
+		}
+		__syncwarp();
+
+		// Lanes row and row + 16 take every other column, with the padded stride at most two lanes share a bank.
+		const float* rowDots = tensorDots[warp] + row * TENSOR_DOT_STRIDE;
+		for (unsigned int c = lane / 16; c < TENSOR_CHUNK; c += 2)
+		{
+			float d2 = rowNorm + tensorNorms[c] - 2.0f * rowDots[c];
+			if (d2 < best && chunkStart + c != in_x)
+			{
+				best = d2;
+				bestIndex = chunkStart + c;
+			}
+		}
+
+		__syncthreads();										// Before the next chunk overwrites the columns
+	}
+
+	float otherBest = __shfl_xor_sync( FULL_WARP_MASK, best, 16 );
+	unsigned int otherIndex = __shfl_xor_sync( FULL_WARP_MASK, bestIndex, 16 );
+	if (otherBest < best)
+	{
+		best = otherBest;
+		bestIndex = otherIndex;
+	}
+
+	if (lane >= 16 || !valid)
+		return;
+
+	PrecomputedSearch search;
+	search.closest = best < FLT_MAX ? vert - d_loadPosition( in, bestIndex ) : DeviceVector();
+	search.closest_dist = best < FLT_MAX ? search.closest.length3() : FLT_MAX;
+
+	DeviceVector state = d_loadState( in, in_x );
+	unsigned char alive = in.alive[in_x];
+	if (alive)
+		alive = d_swim<FEATURES>( vert, state, in_x, in_x, d_schoolOf<FEATURES>( in.id, in_x ), in.id, search, speed, sharks, shark_count, c_params );
+
+	d_storeParticle( out, in_x, vert, state, alive );
+#endif
+}
+
+/*!
+ * @brief Verlet version of d_advance. Every fish only checks the candidates in its list.
+ * @tparam FEATURES AdvanceFeature flags, see QUERY_FEATURES.
+ * @param in Positions, speed vectors and masses of all fishies (read only).
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param mesh_count Number of fishies.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ * @param list Candidate slots, entry k of fish i at k * mesh_count + i.
+ * @param count Number of candidates per fish.
+ * @param firstK See NeighbourQuery.
+ */
+template <unsigned int FEATURES>
+__global__ void d_advance_verlet(
+	ParticleArrays in,
+	ParticleArrays out,
+	unsigned int mesh_count,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count,
+	const unsigned int* __restrict__ list,
+	const unsigned int* __restrict__ count,
+	unsigned int firstK)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	DeviceVector vert = d_loadPosition( in, in_x );
+	DeviceVector state = d_loadState( in, in_x );
+	unsigned char alive = in.alive[in_x];
+
+	VerletSearch<FEATURES> search = { in, list, count, mesh_count, firstK };
+	if (alive)
+		alive = d_swim<FEATURES>( vert, state, in_x, in_x, d_schoolOf<FEATURES>( in.id, in_x ), in.id, search, speed, sharks, shark_count, c_params );
+
+	d_storeParticle( out, in_x, vert, state, alive );
+}
+
+/*!
+ * @brief Calculate grid hash of each fish. Dead fishies get the hash DEAD_CELL, which is never searched.
+ * @param gridParticleHash Output: Hash of the cell each fish is in.
+ * @param gridParticleIndex Output: Index of each fish (sorted with the hash later).
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param grid Grid placement.
+ */
+__global__ void d_calcHash(
+	unsigned int* gridParticleHash,
+	unsigned int* gridParticleIndex,
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	GridLayout grid)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	DeviceVector vert = d_loadPosition( particles, in_x );
+	int3 cell = d_calcGridPos( vert, grid );
+
+	gridParticleHash[in_x] = particles.alive[in_x] ? d_insertGridHash( cell, grid ) : DEAD_CELL;
+	gridParticleIndex[in_x] = in_x;
+}
+
+/*!
+ * @brief Find start and end of each cell in the sorted hash array and
+ * reorder the particles into sorted order, so the neighbour search reads coalesced memory.
+ * @param cellStart Output: Index of first fish in cell.
+ * @param cellEnd Output: Index after last fish in cell.
+ * @param sorted Output: Particles in sorted order.
+ * @param gridParticleHash Sorted cell hashes.
+ * @param gridParticleIndex Fish indices sorted by cell hash.
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param packed Output: Packed positions in sorted order, see d_packCellPosition. NULL: not written.
+ * @param grid Grid placement.
+ */
+__global__ void d_reorderDataAndFindCellStart(
+	unsigned int* cellStart,
+	unsigned int* cellEnd,
+	ParticleArrays sorted,
+	const unsigned int* __restrict__ gridParticleHash,
+	const unsigned int* __restrict__ gridParticleIndex,
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	ushort4* packed,
+	GridLayout grid)
+{
+	extern __shared__ unsigned int sharedHash[];	// blockSize + 1 elements
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+
+	unsigned int hash;
+	if (in_x < mesh_count)
+	{
+		hash = gridParticleHash[in_x];
+
+		// Load hash of previous fish, so every thread can compare its hash with the previous one.
+		sharedHash[threadIdx.x + 1] = hash;
+		if (in_x > 0 && threadIdx.x == 0)
+		{
+			sharedHash[0] = gridParticleHash[in_x - 1];
+		}
+	}
+
+	__syncthreads();
+
+	if (in_x < mesh_count)
+	{
+		// First fish in cell or first fish overall
+		if (in_x == 0 || hash != sharedHash[threadIdx.x])
+		{
+			cellStart[hash] = in_x;
+			if (in_x > 0)
+				cellEnd[sharedHash[threadIdx.x]] = in_x;
+		}
+
+		if (in_x == mesh_count - 1)
+		{
+			cellEnd[hash] = in_x + 1;
+		}
+
+		unsigned int sortedIndex = gridParticleIndex[in_x];
+		DeviceVector vert = d_loadPosition( particles, sortedIndex );
+		d_storeParticle( sorted, in_x, vert, d_loadState( particles, sortedIndex ), particles.alive[sortedIndex] );
+		if (packed != NULL)
+			packed[in_x] = d_packCellPosition( vert, grid );
+	}
+}
+
+/*!
+ * @brief Counting sort of buildGrid, first pass: hash each fish and count the fishies per cell.
+ * The fishies of a warp that share a cell take one atomic: the first of them adds all, the others get their rank from it.
+ * @param gridParticleHash Output: Hash of the cell each fish is in, by original index.
+ * @param cellCounts Output: Fishies per cell, zero before. cellEnd of the grid until d_finishCells.
+ * @param cellRank Output: Position of each fish inside its cell.
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param grid Grid placement.
+ */
+__global__ void d_countCells(
+	unsigned int* gridParticleHash,
+	unsigned int* cellCounts,
+	unsigned int* cellRank,
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	GridLayout grid)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	unsigned int hash = particles.alive[in_x] ? d_insertGridHash( d_calcGridPos( d_loadPosition( particles, in_x ), grid ), grid ) : DEAD_CELL;
+	gridParticleHash[in_x] = hash;
+#if !defined(__CUDA_ARCH__) || __CUDA_ARCH__ >= 700
+	unsigned int lane = threadIdx.x % WARP_SIZE;
+	unsigned int peers = __match_any_sync( __activemask(), hash );
+	unsigned int leader = __ffs( peers ) - 1;
+	unsigned int base = 0;
+	if (lane == leader)
+		base = atomicAdd( &cellCounts[hash], static_cast< unsigned int >( __popc( peers ) ) );
+	base = __shfl_sync( peers, base, leader );
+	cellRank[in_x] = base + __popc( peers & ( ( 1u << lane ) - 1u ) );			// Peers on lower lanes come first
+#else
+	cellRank[in_x] = atomicAdd( &cellCounts[hash], 1u );						// No __match_any_sync before Volta
+#endif
+}
+
+/*!
+ * @brief Counting sort of buildGrid, after the exclusive scan of the counts: turn starts and counts into cell start/end.
+ * One thread per cell of the current grid and one for the dead cell, whose fishies come after all living ones.
+ * @param cellStart Index of first fish in cell from the scan. Output: EMPTY_CELL for empty cells.
+ * @param cellEnd Fishies per cell. Output: Index after last fish in cell.
+ * @param numCells Cells of the current grid.
+ * @param mesh_count Number of fishies.
+ */
+__global__ void d_finishCells(
+	unsigned int* cellStart,
+	unsigned int* cellEnd,
+	unsigned int numCells,
+	unsigned int mesh_count)
+{
+	unsigned int c = blockIdx.x * blockDim.x + threadIdx.x;
+	if (c > numCells)
+		return;
+
+	unsigned int cell = c < numCells ? c : DEAD_CELL;
+	unsigned int fishies = cellEnd[cell];
+	unsigned int start = cell == DEAD_CELL ? mesh_count - fishies : cellStart[cell];
+	cellStart[cell] = fishies > 0 || cell == DEAD_CELL ? start : EMPTY_CELL;	// The dead fishies are scattered too
+	cellEnd[cell] = start + fishies;
+}
+
+/*!
+ * @brief Counting sort of buildGrid, last pass: scatter the fishies to the start of their cell plus their rank,
+ * the same outputs as d_reorderDataAndFindCellStart.
+ * @param sorted Output: Particles in sorted order.
+ * @param gridParticleIndex Output: Original fish index of each sorted fish.
+ * @param cellStart Index of first fish in cell.
+ * @param gridParticleHash Hash of the cell each fish is in, by original index.
+ * @param cellRank Position of each fish inside its cell.
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param packed Output: Packed positions in sorted order, see d_packCellPosition. NULL: not written.
+ * @param grid Grid placement.
+ */
+__global__ void d_scatterCells(
+	ParticleArrays sorted,
+	unsigned int* gridParticleIndex,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ gridParticleHash,
+	const unsigned int* __restrict__ cellRank,
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	ushort4* packed,
+	GridLayout grid)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	unsigned int sortedIndex = cellStart[gridParticleHash[in_x]] + cellRank[in_x];
+	DeviceVector vert = d_loadPosition( particles, in_x );
+	gridParticleIndex[sortedIndex] = in_x;
+	d_storeParticle( sorted, sortedIndex, vert, d_loadState( particles, in_x ), particles.alive[in_x] );
+	if (packed != NULL)
+		packed[sortedIndex] = d_packCellPosition( vert, grid );
+}
+
+/*!
+ * @brief Advance one fish of the sorted copy with the grid search and write it back to its original position.
+ * @tparam FEATURES AdvanceFeature flags, see GRID_FEATURES.
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param sorted Particles sorted by cell.
+ * @param gridParticleIndex Original fish index of each sorted fish.
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param in_x Sorted index of the fish.
+ * @param grid Grid placement.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ * @param firstK See NeighbourQuery.
+ * @param packed Packed positions in sorted order. Only read with FEATURE_PACKED.
+ * @param warm Closest fishies of the last step, see WarmStart.
+ * @param glide Steps the fish was left out (multi-rate steps): it moves on along its new speed vector for each of them.
+ */
+template <unsigned int FEATURES>
+__device__ void d_advanceSorted(
+	ParticleArrays out,
+	ParticleArrays sorted,
+	const unsigned int* gridParticleIndex,
+	const unsigned int* cellStart,
+	const unsigned int* cellEnd,
+	unsigned int in_x,
+	GridLayout grid,
+	float speed,
+	const float4* sharks,
+	unsigned int shark_count,
+	unsigned int firstK,
+	const ushort4* packed,
+	WarmStart warm,
+	float glide = 0.0f)
+{
+	DeviceVector vert = d_loadPosition( sorted, in_x );
+	DeviceVector state = d_loadState( sorted, in_x );
+	unsigned char alive = sorted.alive[in_x];
+	unsigned int originalIndex = gridParticleIndex[in_x];
+
+	GridSearch<FEATURES> search = { sorted.x, sorted.y, sorted.z, cellStart, cellEnd, grid, firstK, packed, gridParticleIndex, warm };
+	if (alive)
+		alive = d_swim<FEATURES>( vert, state, in_x, originalIndex, d_schoolOf<FEATURES>( out.id, originalIndex ), out.id, search, speed, sharks, shark_count, c_params );	// Both stores hold the ids
+	if (alive && glide > 0.0f)
+		vert += state * ( glide * c_step.dtScale );
+
+	d_storeParticle( out, originalIndex, vert, state, alive );
+}
+
+/*!
+ * @brief Grid based version of d_advance. Every thread handles one fish in sorted order
+ * and only checks the 27 surrounding cells for the closest fish.
+ * Reads from the sorted copy and writes back to the original position in the output store.
+ * @tparam FEATURES AdvanceFeature flags, see GRID_FEATURES.
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param sorted Particles sorted by cell (read only).
+ * @param gridParticleIndex Original fish index of each sorted fish.
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param mesh_count Number of fishies.
+ * @param grid Grid placement.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ * @param firstK See NeighbourQuery.
+ * @param packed Packed positions in sorted order. Only read with FEATURE_PACKED.
+ * @param warm Closest fishies of the last step, see WarmStart.
+ */
+template <unsigned int FEATURES>
+__global__ void d_advance_grid(
+	ParticleArrays out,
+	ParticleArrays sorted,
+	const unsigned int* __restrict__ gridParticleIndex,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	unsigned int mesh_count,
+	GridLayout grid,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count,
+	unsigned int firstK,
+	const ushort4* __restrict__ packed,
+	WarmStart warm)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	d_advanceSorted<FEATURES>( out, sorted, gridParticleIndex, cellStart, cellEnd, in_x, grid, speed, sharks, shark_count, firstK, packed, warm );
+}
+
+/*!
+ * @brief Grid search over distributed shared memory (kernel_set_cluster_search, compute capability 9.0).
+ * One block per cell, the blocks of a cluster of CLUSTER_EDGE^3 cells load their cell into shared memory and read the cells
+ * of the others through the cluster (ClusterSearch), so 8 of the 27 cells of every fish don't come from global memory.
+ * The threads of a block loop over the fishies of its cell. Launched with the cluster dimension as launch attribute, blocks
+ * beyond the grid only hold an empty cell. Without clusters in the build (before sm_90) the kernel is empty and never launched.
+ * @tparam FEATURES AdvanceFeature flags, see QUERY_FEATURES.
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param sorted Particles sorted by cell (read only).
+ * @param gridParticleIndex Original fish index of each sorted fish.
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param grid Grid placement.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ * @param firstK See NeighbourQuery.
+ */
+template <unsigned int FEATURES>
+__global__ void d_advance_cluster(
+	ParticleArrays out,
+	ParticleArrays sorted,
+	const unsigned int* __restrict__ gridParticleIndex,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	GridLayout grid,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count,
+	unsigned int firstK)
+{
+#if __CUDA_ARCH__ >= 900
+	__shared__ float4 s_cell[CLUSTER_CELL_CAPACITY];
+	__shared__ uint2 s_info;
+
+	cooperative_groups::cluster_group cluster = cooperative_groups::this_cluster();
+	int3 cell = make_int3( blockIdx.x, blockIdx.y, blockIdx.z );
+	bool inGrid = cell.x < grid.dims.x && cell.y < grid.dims.y && cell.z < grid.dims.z;
+	unsigned int start = inGrid ? cellStart[d_calcGridHash( cell, grid )] : EMPTY_CELL;
+	unsigned int end = start != EMPTY_CELL ? cellEnd[d_calcGridHash( cell, grid )] : start;
+	unsigned int count = end - start;
+	if (count <= CLUSTER_CELL_CAPACITY)
+	{
+		for (unsigned int k = threadIdx.x; k < count; k += blockDim.x)
+			s_cell[k] = make_float4( sorted.x[start + k], sorted.y[start + k], sorted.z[start + k], 1.0f );
+	}
+	if (threadIdx.x == 0)
+		s_info = make_uint2( start, count <= CLUSTER_CELL_CAPACITY ? count : ~0u );
+	cluster.sync();													// All cells of the cube are loaded
+
+	dim3 rank = cluster.block_index();
+	ClusterSearch<FEATURES> search = { sorted.x, sorted.y, sorted.z, cellStart, cellEnd, grid, firstK,
+		make_int3( cell.x - rank.x, cell.y - rank.y, cell.z - rank.z ) };
+	for (unsigned int r = 0; r < CLUSTER_BLOCKS; r++)
+	{
+		search.cells[r] = cluster.map_shared_rank( s_cell, r );
+		search.info[r] = cluster.map_shared_rank( &s_info, r );
+	}
+
+	for (unsigned int in_x = start + threadIdx.x; in_x < end; in_x += blockDim.x)
+	{
+		DeviceVector vert = d_loadPosition( sorted, in_x );
+		DeviceVector state = d_loadState( sorted, in_x );
+		unsigned char alive = sorted.alive[in_x];
+		unsigned int originalIndex = gridParticleIndex[in_x];
+		if (alive)
+			alive = d_swim<FEATURES>( vert, state, in_x, originalIndex, d_schoolOf<FEATURES>( out.id, originalIndex ), out.id, search, speed, sharks, shark_count, c_params );	// Both stores hold the ids
+		d_storeParticle( out, originalIndex, vert, state, alive );
+	}
+	cluster.sync();													// The other blocks may still read this cell
+#endif
+}
+
+/*!
+ * @brief Count the candidates of the grid search of a position: the fishies of the 27 cells around it.
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param grid Grid placement.
+ * @param vert Position.
+ * @return number of fishies, the searching one included.
+ */
+__device__ unsigned int d_gridCandidates(
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	const GridLayout& grid,
+	DeviceVector vert)
+{
+	int3 cell = d_calcGridPos( vert, grid );
+	unsigned int candidates = 0;
+	for (int n = 0; n < 27; n++)
+	{
+		unsigned int hash = d_calcGridHash( make_int3( cell.x + n % 3 - 1, cell.y + n / 3 % 3 - 1, cell.z + n / 9 - 1 ), grid );
+		unsigned int start = cellStart[hash];
+		if (start != EMPTY_CELL)
+			candidates += cellEnd[hash] - start;
+	}
+	return candidates;
+}
+
+/*!
+ * @brief d_advance_grid for the fishies of sparse cells. Living fishies with more than denseLimit candidates
+ * (d_gridCandidates) are only listed for d_advance_dense, so no warp waits for the long loop of a dense cell.
+ * Fishies of a cell are neighbours in sorted order: the listed ones leave in whole warps.
+ * @tparam FEATURES AdvanceFeature flags, see GRID_FEATURES.
+ * @param out Output: New positions, speed vectors and masses of all fishies, except the listed ones.
+ * @param sorted Particles sorted by cell (read only).
+ * @param gridParticleIndex Original fish index of each sorted fish.
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param mesh_count Number of fishies.
+ * @param grid Grid placement.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ * @param firstK See NeighbourQuery.
+ * @param packed Packed positions in sorted order. Only read with FEATURE_PACKED.
+ * @param warm Closest fishies of the last step, see WarmStart.
+ * @param denseLimit Maximum number of candidates of a fish of this kernel.
+ * @param denseList Output: sorted indices of the fishies with more candidates, in no particular order.
+ * @param denseCount Output: number of indices in denseList. Must be 0 before the launch.
+ */
+template <unsigned int FEATURES>
+__global__ void d_advance_sparse(
+	ParticleArrays out,
+	ParticleArrays sorted,
+	const unsigned int* __restrict__ gridParticleIndex,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	unsigned int mesh_count,
+	GridLayout grid,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count,
+	unsigned int firstK,
+	const ushort4* __restrict__ packed,
+	WarmStart warm,
+	unsigned int denseLimit,
+	unsigned int* denseList,
+	unsigned int* denseCount)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	if (sorted.alive[in_x] && d_gridCandidates( cellStart, cellEnd, grid, d_loadPosition( sorted, in_x ) ) > denseLimit)
+	{
+		denseList[atomicAdd( denseCount, 1u )] = in_x;
+		return;
+	}
+	d_advanceSorted<FEATURES>( out, sorted, gridParticleIndex, cellStart, cellEnd, in_x, grid, speed, sharks, shark_count, firstK, packed, warm );
+}
+
+/*!
+ * @brief Second phase of the dense cell split: one warp per fish of the list of d_advance_sparse. The lanes share the candidates
+ * of the 27 cells and reduce (distance, index) like d_advance_warp, so a cell of thousands of fishies costs a 32nd per fish.
+ * The warps loop over the list, whose length stays on the device. Always finds the closest fish (no first k, no packing).
+ * @tparam FEATURES AdvanceFeature flags, see SWIM_FEATURES.
+ * @param out Output: New positions, speed vectors and masses of the listed fishies.
+ * @param sorted Particles sorted by cell (read only).
+ * @param gridParticleIndex Original fish index of each sorted fish.
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param grid Grid placement.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ * @param warm Closest fishies of the last step, updated for the listed ones.
+ * @param denseList sorted indices of the listed fishies.
+ * @param denseCount number of indices in denseList.
+ */
+template <unsigned int FEATURES>
+__global__ void d_advance_dense(
+	ParticleArrays out,
+	ParticleArrays sorted,
+	const unsigned int* __restrict__ gridParticleIndex,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	GridLayout grid,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count,
+	WarmStart warm,
+	const unsigned int* __restrict__ denseList,
+	const unsigned int* __restrict__ denseCount)
+{
+	unsigned int thread = blockIdx.x * blockDim.x + threadIdx.x;
+	unsigned int lane = thread % WARP_SIZE;
+	unsigned int count = *denseCount;
+
+	// All lanes of a warp share k, so the shuffles below always see the whole warp.
+	for (unsigned int k = thread / WARP_SIZE; k < count; k += gridDim.x * blockDim.x / WARP_SIZE)
+	{
+		unsigned int in_x = denseList[k];
+		DeviceVector vert = d_loadPosition( sorted, in_x );
+		int3 cell = d_calcGridPos( vert, grid );
+
+		float best = FLT_MAX;
+		unsigned int bestIndex = in_x;
+		for (int n = 0; n < 27; n++)
+		{
+			unsigned int hash = d_calcGridHash( make_int3( cell.x + n % 3 - 1, cell.y + n / 3 % 3 - 1, cell.z + n / 9 - 1 ), grid );
+			unsigned int start = cellStart[hash];
+			if (start == EMPTY_CELL)
+				continue;
+			unsigned int end = cellEnd[hash];
+			for (unsigned int i = start + lane; i < end; i += WARP_SIZE)
+			{
+				if (i == in_x)
+					continue;
+				float d2 = ( vert - DeviceVector( sorted.x[i], sorted.y[i], sorted.z[i] ) ).length3Squared();
+				if (d2 < best || ( d2 == best && i < bestIndex ))
+				{
+					best = d2;
+					bestIndex = i;
+				}
+			}
+		}
+
+		// Reduce (distance, index) over the warp, ties to the lower index. Lane 0 gets the closest fish.
+		for (unsigned int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
+		{
+			float otherBest = __shfl_down_sync( FULL_WARP_MASK, best, offset );
+			unsigned int otherIndex = __shfl_down_sync( FULL_WARP_MASK, bestIndex, offset );
+			if (otherBest < best || ( otherBest == best && otherIndex < bestIndex ))
+			{
+				best = otherBest;
+				bestIndex = otherIndex;
+			}
+		}
+
+		if (lane != 0)
+			continue;
+
+		PrecomputedSearch search;
+		search.closest = best < FLT_MAX ? vert - d_loadPosition( sorted, bestIndex ) : DeviceVector();
+		search.closest_dist = best < FLT_MAX ? sqrtf( best ) : FLT_MAX;
+		unsigned int originalIndex = gridParticleIndex[in_x];
+		if (warm.nearest != NULL && best < FLT_MAX)
+			warm.nearest[originalIndex] = gridParticleIndex[bestIndex];
+
+		DeviceVector state = d_loadState( sorted, in_x );
+		unsigned char alive = d_swim<FEATURES>( vert, state, in_x, originalIndex, d_schoolOf<FEATURES>( out.id, originalIndex ), out.id, search, speed, sharks, shark_count, c_params );
+		d_storeParticle( out, originalIndex, vert, state, alive );
+	}
+}
+
+/*!
+ * @brief Grid search with one block per cell (SearchMode::CELL). The block loads the fishies of the 27 cells around its cell
+ * into shared memory once, then its threads loop over the fishies of the cell and scan the shared copy: a candidate is read
+ * from global memory once per cell instead of once per searching fish. Block b holds the cell of hash b of the wrapped grid,
+ * fishies of other periods in the same cells are far away and never the closest. Blocks of empty cells leave at once.
+ * A neighbourhood of more than CELL_CAPACITY fishies is searched in global memory like d_advance_grid.
+ * Always finds the closest fish (no first k, no packing), ties go to the lower sorted index like d_advance_dense.
+ * @tparam FEATURES AdvanceFeature flags, see SWIM_FEATURES.
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param sorted Particles sorted by cell (read only).
+ * @param gridParticleIndex Original fish index of each sorted fish.
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param grid Grid placement, without hashed cells.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ * @param warm Closest fishies of the last step, only written here.
+ */
+template <unsigned int FEATURES>
+__global__ void d_advance_cell(
+	ParticleArrays out,
+	ParticleArrays sorted,
+	const unsigned int* __restrict__ gridParticleIndex,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	GridLayout grid,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count,
+	WarmStart warm)
+{
+	__shared__ float4 s_candidates[CELL_CAPACITY];			// Position and sorted index (as float bits)
+	__shared__ unsigned int s_start[27];
+	__shared__ unsigned int s_offset[28];
+
+	unsigned int start = cellStart[blockIdx.x];
+	if (start == EMPTY_CELL)
+		return;														// The whole block
+	unsigned int end = cellEnd[blockIdx.x];
+	int3 cell = make_int3( blockIdx.x % grid.dims.x, blockIdx.x / grid.dims.x % grid.dims.y, blockIdx.x / ( grid.dims.x * grid.dims.y ) );
+
+	if (threadIdx.x < 27)
+	{
+		unsigned int n = threadIdx.x;
+		unsigned int hash = d_calcGridHash( make_int3( cell.x + n % 3 - 1, cell.y + n / 3 % 3 - 1, cell.z + n / 9 - 1 ), grid );
+		unsigned int first = cellStart[hash];
+		s_start[n] = first;
+		s_offset[n + 1] = first != EMPTY_CELL ? cellEnd[hash] - first : 0;
+	}
+	__syncthreads();
+	if (threadIdx.x == 0)
+	{
+		s_offset[0] = 0;
+		for (unsigned int n = 0; n < 27; n++)
+			s_offset[n + 1] += s_offset[n];
+	}
+	__syncthreads();
+
+	unsigned int total = s_offset[27];
+	bool shared = total <= CELL_CAPACITY;							// Same for the whole block
+	if (shared)
+	{
+		for (unsigned int k = threadIdx.x; k < total; k += blockDim.x)
+		{
+			unsigned int n = 0;
+			while (s_offset[n + 1] <= k)
+				n++;
+			unsigned int i = s_start[n] + k - s_offset[n];
+			s_candidates[k] = make_float4( sorted.x[i], sorted.y[i], sorted.z[i], __uint_as_float( i ) );
+		}
+		__syncthreads();
+	}
+
+	for (unsigned int in_x = start + threadIdx.x; in_x < end; in_x += blockDim.x)
+	{
+		if (!shared)
+		{
+			d_advanceSorted<FEATURES>( out, sorted, gridParticleIndex, cellStart, cellEnd, in_x, grid, speed, sharks, shark_count, 0, NULL, warm );
+			continue;
+		}
+
+		DeviceVector vert = d_loadPosition( sorted, in_x );
+		DeviceVector state = d_loadState( sorted, in_x );
+		unsigned char alive = sorted.alive[in_x];
+		unsigned int originalIndex = gridParticleIndex[in_x];
+		if (alive)
+		{
+			float best = FLT_MAX;
+			unsigned int bestIndex = in_x;
+			DeviceVector bestDiff;
+			for (unsigned int k = 0; k < total; k++)
+			{
+				float4 candidate = s_candidates[k];					// Same address in all lanes: a broadcast
+				unsigned int i = __float_as_uint( candidate.w );
+				if (i == in_x)
+					continue;
+				DeviceVector diff = vert - DeviceVector( candidate.x, candidate.y, candidate.z );
+				float d2 = diff.length3Squared();
+				if (d2 < best || ( d2 == best && i < bestIndex ))
+				{
+					best = d2;
+					bestIndex = i;
+					bestDiff = diff;
+				}
+			}
+
+			PrecomputedSearch search;
+			search.closest = bestDiff;
+			search.closest_dist = best < FLT_MAX ? sqrtf( best ) : FLT_MAX;
+			if (warm.nearest != NULL && best < FLT_MAX)
+				warm.nearest[originalIndex] = gridParticleIndex[bestIndex];
+			alive = d_swim<FEATURES>( vert, state, in_x, originalIndex, d_schoolOf<FEATURES>( out.id, originalIndex ), out.id, search, speed, sharks, shark_count, c_params );
+		}
+		d_storeParticle( out, originalIndex, vert, state, alive );
+	}
+}
+
+/*!
+ * @brief Sort the fishies of the grid search into the buckets of the multi-rate steps (kernel_set_multi_rate).
+ * Fishies close to a shark or to the focus go into bucket 0. The others go into bucket 1 every interval steps,
+ * staggered by slot so every step takes its share, and keep position and speed vector in between.
+ * Dead and waiting fishies are written to the output store here, the buckets by d_advance_bucket.
+ * @param out Output: Positions, speed vectors and masses of the fishies that are not advanced in this step.
+ * @param sorted Particles sorted by cell (read only).
+ * @param gridParticleIndex Original fish index of each sorted fish.
+ * @param mesh_count Number of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ * @param rates Settings of the multi-rate steps.
+ * @param buckets Output: sorted indices of bucket b from b * mesh_count on, in no particular order.
+ * @param bucketCounts Output: number of indices per bucket. Must be 0 before the launch.
+ */
+__global__ void d_classifyRates(
+	ParticleArrays out,
+	ParticleArrays sorted,
+	const unsigned int* __restrict__ gridParticleIndex,
+	unsigned int mesh_count,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count,
+	RateSettings rates,
+	unsigned int* buckets,
+	unsigned int* bucketCounts)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	DeviceVector vert = d_loadPosition( sorted, in_x );
+	DeviceVector state = d_loadState( sorted, in_x );
+	unsigned char alive = sorted.alive[in_x];
+	unsigned int originalIndex = gridParticleIndex[in_x];
+
+	if (alive)
+	{
+		// Hunted fishies evade and get eaten every step, the bite distance counts even for a small range.
+		DeviceVector sharkDiff;
+		float sharkDistance = d_nearestShark( vert, sharks, shark_count, &sharkDiff );
+		float fear = c_species.count > 1 ? c_species.reach : state.w;	// Uniform branch, any species evades inside the reach
+		bool hunted = sharkDistance < fmaxf( rates.sharkRange * c_params.sharkDist * fear, c_params.sharkBiteDist );
+		bool watched = rates.focusRange > 0.0f && ( vert - DeviceVector( c_step.focus ) ).length3() < rates.focusRange;
+		if (hunted || watched)
+		{
+			buckets[atomicAdd( &bucketCounts[0], 1u )] = in_x;
+			return;
+		}
+		if (( originalIndex + c_step.random.step ) % rates.interval == 0)
+		{
+			buckets[mesh_count + atomicAdd( &bucketCounts[1], 1u )] = in_x;
+			return;
+		}
+	}
+
+	d_storeParticle( out, originalIndex, vert, state, alive );
+}
+
+/*!
+ * @brief d_advance_grid over one bucket of d_classifyRates.
+ * Threads beyond the size of the bucket leave at once, so the launch can cover all fishies.
+ * @tparam FEATURES AdvanceFeature flags, see GRID_FEATURES.
+ * @param out Output: New positions, speed vectors and masses of the fishies of the bucket.
+ * @param sorted Particles sorted by cell (read only).
+ * @param gridParticleIndex Original fish index of each sorted fish.
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param bucket Sorted indices of the fishies of the bucket.
+ * @param bucketCount Number of indices in bucket.
+ * @param grid Grid placement.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ * @param firstK See NeighbourQuery.
+ * @param packed Packed positions in sorted order. Only read with FEATURE_PACKED.
+ * @param warm Closest fishies of the last step, see WarmStart.
+ * @param glide Steps the fishies of the bucket were left out, see d_advanceSorted.
+ */
+template <unsigned int FEATURES>
+__global__ void d_advance_bucket(
+	ParticleArrays out,
+	ParticleArrays sorted,
+	const unsigned int* __restrict__ gridParticleIndex,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	const unsigned int* __restrict__ bucket,
+	const unsigned int* __restrict__ bucketCount,
+	GridLayout grid,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count,
+	unsigned int firstK,
+	const ushort4* __restrict__ packed,
+	WarmStart warm,
+	float glide)
+{
+	unsigned int k = blockIdx.x * blockDim.x + threadIdx.x;
+	if (k >= *bucketCount)
+		return;
+
+	d_advanceSorted<FEATURES>( out, sorted, gridParticleIndex, cellStart, cellEnd, bucket[k], grid, speed, sharks, shark_count, firstK, packed, warm, glide );
+}
+
+/*!
+ * @brief Exclusive prefix sum over the COOPERATIVE_THREADS threads of a block. All threads of the block have to call it.
+ * @param value Value of this thread.
+ * @param total Output: Sum of the values of all threads.
+ * @return Sum of the values of the threads in front of this one.
+ */
+__device__ unsigned int d_blockExclusiveScan(unsigned int value, unsigned int* total)
+{
+	__shared__ unsigned int scan[COOPERATIVE_THREADS];
+	scan[threadIdx.x] = value;
+	__syncthreads();
+
+	for (unsigned int offset = 1; offset < COOPERATIVE_THREADS; offset *= 2)
+	{
+		unsigned int add = threadIdx.x >= offset ? scan[threadIdx.x - offset] : 0;
+		__syncthreads();
+		scan[threadIdx.x] += add;
+		__syncthreads();
+	}
+
+	*total = scan[COOPERATIVE_THREADS - 1];
+	unsigned int inclusive = scan[threadIdx.x];
+	__syncthreads();											// The next call overwrites scan
+	return inclusive - value;
+}
+
+/*!
+ * @brief Grid build and grid search of one step in one cooperative launch. The phases are separated by grid wide barriers
+ * instead of kernel boundaries: empty the cells, count the fishies per cell, scan the counts into cellStart and cellEnd,
+ * scatter the fishies into sorted order (counting sort) and advance them like d_advance_grid.
+ * All blocks have to be resident at once (cudaLaunchCooperativeKernel, at most COOPERATIVE_BLOCKS), every phase loops over its items.
+ * The order inside a cell depends on the atomics, so with firstK the fishies found first can differ from buildGrid.
+ * There are no __restrict__ pointers: the phases read what the earlier ones wrote, the read-only cache would not see it.
+ * @tparam FEATURES AdvanceFeature flags, see GRID_FEATURES.
+ * @param in Positions, speed vectors and masses of all fishies (read only).
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param mesh_count Number of fishies.
+ * @param grid Grid placement.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ * @param firstK See NeighbourQuery.
+ * @param sorted Output: Particles in sorted order.
+ * @param gridParticleHash Output: Hash of the cell each fish is in, by original index.
+ * @param gridParticleIndex Output: Original fish index of each sorted fish.
+ * @param cellStart Output: Index of first fish in cell.
+ * @param cellEnd Output: Index after last fish in cell. Holds the counts until the scan.
+ * @param cellRank Output: Position of each fish inside its cell.
+ * @param blockSums Output: Fishies per block of the scan, gridDim.x entries.
+ * @param packed Output: Packed positions in sorted order, see d_packCellPosition. NULL: not written.
+ * @param warm Closest fishies of the last step, see WarmStart.
+ */
+template <unsigned int FEATURES>
+__global__ void __launch_bounds__( COOPERATIVE_THREADS ) d_advance_cooperative(
+	ParticleArrays in,
+	ParticleArrays out,
+	unsigned int mesh_count,
+	GridLayout grid,
+	float speed,
+	const float4* sharks,
+	unsigned int shark_count,
+	unsigned int firstK,
+	ParticleArrays sorted,
+	unsigned int* gridParticleHash,
+	unsigned int* gridParticleIndex,
+	unsigned int* cellStart,
+	unsigned int* cellEnd,
+	unsigned int* cellRank,
+	unsigned int* blockSums,
+	ushort4* packed,
+	WarmStart warm)
+{
+	cooperative_groups::grid_group all = cooperative_groups::this_grid();
+	unsigned int first = blockIdx.x * blockDim.x + threadIdx.x;
+	unsigned int stride = gridDim.x * blockDim.x;
+
+	// The cells of the current grid and the dead cell behind them, like the cells buildGrid sorts into.
+	unsigned int numCells = grid.dims.x * grid.dims.y * grid.dims.z;
+	unsigned int entries = numCells + 1;
+
+	for (unsigned int c = first; c < entries; c += stride)
+		cellEnd[c < numCells ? c : DEAD_CELL] = 0;
+	all.sync();
+
+	// Count the fishies per cell. The counter before the increment is the position inside the cell.
+	for (unsigned int in_x = first; in_x < mesh_count; in_x += stride)
+	{
+		unsigned int hash = in.alive[in_x] ? d_calcGridHash( d_calcGridPos( d_loadPosition( in, in_x ), grid ), grid ) : DEAD_CELL;
+		gridParticleHash[in_x] = hash;
+		cellRank[in_x] = atomicAdd( &cellEnd[hash], 1u );
+	}
+	all.sync();
+
+	// Scan: every block takes a contiguous range of the entries, every thread a contiguous part of it.
+	unsigned int perBlock = ( entries + gridDim.x - 1 ) / gridDim.x;
+	unsigned int perThread = ( perBlock + blockDim.x - 1 ) / blockDim.x;
+	unsigned int blockEnd = min( ( blockIdx.x + 1 ) * perBlock, entries );
+	unsigned int begin = min( blockIdx.x * perBlock + threadIdx.x * perThread, blockEnd );
+	unsigned int end = min( begin + perThread, blockEnd );
+
+	unsigned int count = 0;
+	for (unsigned int c = begin; c < end; c++)
+		count += cellEnd[c < numCells ? c : DEAD_CELL];
+	unsigned int blockTotal;
+	unsigned int offset = d_blockExclusiveScan( count, &blockTotal );
+	if (threadIdx.x == 0)
+		blockSums[blockIdx.x] = blockTotal;
+	all.sync();
+
+	// Fishies in the ranges of the blocks in front of this one.
+	unsigned int before = 0;
+	for (unsigned int b = threadIdx.x; b < blockIdx.x; b += blockDim.x)
+		before += blockSums[b];
+	d_blockExclusiveScan( before, &before );
+
+	unsigned int running = before + offset;
+	for (unsigned int c = begin; c < end; c++)
+	{
+		unsigned int cell = c < numCells ? c : DEAD_CELL;
+		unsigned int fishies = cellEnd[cell];
+		cellStart[cell] = fishies > 0 || cell == DEAD_CELL ? running : EMPTY_CELL;	// The dead fishies are scattered too
+		running += fishies;
+		cellEnd[cell] = running;
+	}
+	all.sync();
+
+	// Scatter into sorted order, like d_reorderDataAndFindCellStart.
+	for (unsigned int in_x = first; in_x < mesh_count; in_x += stride)
+	{
+		unsigned int sortedIndex = cellStart[gridParticleHash[in_x]] + cellRank[in_x];
+		DeviceVector vert = d_loadPosition( in, in_x );
+		gridParticleIndex[sortedIndex] = in_x;
+		d_storeParticle( sorted, sortedIndex, vert, d_loadState( in, in_x ), in.alive[in_x] );
+		if (packed != NULL)
+			packed[sortedIndex] = d_packCellPosition( vert, grid );
+	}
+	all.sync();
+
+	for (unsigned int in_x = first; in_x < mesh_count; in_x += stride)
+		d_advanceSorted<FEATURES>( out, sorted, gridParticleIndex, cellStart, cellEnd, in_x, grid, speed, sharks, shark_count, firstK, packed, warm );
+}
+
+/*!
+ * @brief Move the school centers along their routes, like moveSwarmCenter on the host. One thread per school.
+ * Runs before the fishies of the step, so they return to the new centers. On spline paths the distance along the route grows by speed
+ * and the center is looked up in constant time: the arc length table gives the spline parameter, one spline evaluation the position.
+ * @param speed Distance a center moves per step.
+ */
+__global__ void d_moveSchools(float speed)
+{
+	unsigned int school = blockIdx.x * blockDim.x + threadIdx.x;
+	if (school >= c_path.schools)
+		return;
+
+	SchoolState s = d_schoolTable[school];
+	if (c_path.spline)
+	{
+		float length = c_path.lengths[school];
+		if (length <= 0.0f)												// A single waypoint, the center stays on it
+			return;
+
+		uint2 samples = c_path.samples[school];
+		s.distance = fmodf( s.distance + speed, length );
+		float f = s.distance / length * samples.y;
+		unsigned int k = min( static_cast< unsigned int >( f ), samples.y - 1 );
+		float u0 = d_splineTable[samples.x + k];
+		float u1 = k + 1 < samples.y ? d_splineTable[samples.x + k + 1] : static_cast< float >( c_path.routes[school].y );	// End of the closed route
+		float3 center = splinePoint( c_path.points, c_path.routes[school], u0 + ( u1 - u0 ) * ( f - k ) );
+		s.center = make_float4( center.x, center.y, center.z, 0.0f );
+		d_schoolTable[school] = s;
+		return;
+	}
+
+	DeviceVector center( s.center );
+	DeviceVector diff = d_waypoint( school, s.cursor ) - center;
+	if (diff.length3() < SCHOOL_WAYPOINT_THRESHOLD)						// Waypoint reached, go on to the next one
+	{
+		s.cursor = ( s.cursor + 1 ) % c_path.routes[school].y;
+		diff = d_waypoint( school, s.cursor ) - center;
+	}
+
+	center += diff * ( speed / ( diff.length3() + 1e-10f ) );			// Same step as Vector3::normalized() * speed
+	s.center = make_float4( center.x, center.y, center.z, 0.0f );
+	d_schoolTable[school] = s;
+}
+
+/*!
+ * @brief Fold the timeline events up to the step of c_step into d_timelineState. One thread, the events are in order.
+ * PARAM, ROUTE, CURRENT and RESPAWN hold until the next event of their kind, so the state only depends on the step.
+ */
+__global__ void d_applyTimeline()
+{
+	unsigned int const step = c_step.random.step;
+	TimelineState state;
+	state.params = c_timeline.base;
+	state.currentStrength = c_timeline.currentStrength;
+	state.respawnLimit = 0xffffffff;
+	float* params = reinterpret_cast< float* >( &state.params );
+	float3 offset = make_float3( 0.0f, 0.0f, 0.0f );
+	for (unsigned int e = 0; e < c_timeline.count && c_timeline.events[e].step <= step; e++)
+	{
+		const TimelineEvent& event = c_timeline.events[e];
+		switch (event.action)
+		{
+		case TimelineAction::PARAM:
+			params[event.index] = event.value[0];
+			break;
+		case TimelineAction::ROUTE:
+			offset = make_float3( event.value[0], event.value[1], event.value[2] );
+			break;
+		case TimelineAction::CURRENT:
+			state.currentStrength = event.value[0];
+			break;
+		case TimelineAction::RESPAWN:
+			state.respawnLimit = event.index;
+			break;
+		default:
+			break;												// SHARKS: d_timelineSharks
+		}
+	}
+	state.swarmCenter = make_float4( c_step.swarmCenter.x + offset.x, c_step.swarmCenter.y + offset.y, c_step.swarmCenter.z + offset.z, c_step.swarmCenter.w );
+	d_timelineState = state;
+}
+
+/*!
+ * @brief Park the sharks the timeline doesn't need yet and wake the ones of a SHARKS event of this step at its position.
+ * @param sharks Positions of the sharks. Will be updated.
+ * @param states Speed vectors (x, y, z) and masses (w) of the sharks. Will be updated.
+ * @param shark_count Number of sharks.
+ */
+__global__ void d_timelineSharks(float4* sharks, float4* states, unsigned int shark_count)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= shark_count)
+		return;
+
+	unsigned int const step = c_step.random.step;
+	unsigned int active = 0;									// Sharks of this step
+	unsigned int before = 0;									// Sharks of the step before
+	float3 wake = make_float3( 0.0f, 0.0f, 0.0f );
+	for (unsigned int e = 0; e < c_timeline.count && c_timeline.events[e].step <= step; e++)
+	{
+		const TimelineEvent& event = c_timeline.events[e];
+		if (event.action != TimelineAction::SHARKS)
+			continue;
+		if (event.step < step)
+			before = event.index;
+		active = event.index;
+		wake = make_float3( event.value[0], event.value[1], event.value[2] );
+	}
+
+	if (in_x >= active)
+	{
+		sharks[in_x] = make_float4( SHARK_PARK_DISTANCE, SHARK_PARK_DISTANCE, SHARK_PARK_DISTANCE, sharks[in_x].w );
+		states[in_x] = make_float4( 0.0f, 0.0f, 0.0f, states[in_x].w );
+	}
+	else if (in_x >= before)
+		sharks[in_x] = make_float4( wake.x, wake.y, wake.z, sharks[in_x].w );
+}
+
+/*!
+ * @brief Move a shark in a pseudo realistic manner. They move roughly through the swarm center to maximise probability of catching a fish.
+ * Sometimes circle around the swarm. With several schools shark i hunts school i % schools.
+ * @tparam FEATURES AdvanceFeature flags of the swarm center, FEATURE_SUBSTEPS inside d_advance_substeps.
+ * @param shark Position of the shark. Will be updated.
+ * @param state Speed vector (x, y, z) and mass (w) of the shark. Will be updated.
+ * @param in_x Index of the shark.
+ * @param speed Approximate speed of fishies.
+ */
+template <unsigned int FEATURES = 0>
+__device__ void d_followCenter( DeviceVector& shark, DeviceVector& state, unsigned int in_x, float speed )
+{
+	DeviceVector diff = c_path.schools > 1 || c_path.spline ? d_schoolCenter<FEATURE_SCHOOLS>( in_x % c_path.schools ) - shark : d_schoolCenter<FEATURES>( 0 ) - shark;
+
+	// turn back to swarm
+	if (diff.length3() > 4.0f)
+	{
+		state += diff * ( speed * 0.2f / diff.length3() );
+		if (state.length3() > speed * 1.3f)
+		{
+			state *= speed * 1.3f / state.length3();
+		}
+	}
+	// swim through swarm or leave it
+	else
+	{
+		if (state.length3() < speed * 3)
+		{
+			state *= 1.1f;
+		}
+	}
+
+	shark += state * c_step.dtScale;
+}
+
+/*!
+ * @brief Kernel function that moves the sharks in a pseudo realistic manner. One thread per shark, see d_followCenter.
+ * @param sharks Positions of all sharks. Will be updated.
+ * @param states Speed vectors (x, y, z) and masses (w) of all sharks. Will be updated.
+ * @param shark_count Number of sharks.
+ * @param speed Approximate speed of fishies.
+ */
+__global__ void d_moveSharks(
+	float4* sharks,
+	float4* states,
+	unsigned int shark_count,
+	float speed)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= shark_count)
+		return;
+
+	DeviceVector shark( sharks[in_x] );
+	DeviceVector state( states[in_x] );
+	d_followCenter( shark, state, in_x, speed );
+	sharks[in_x] = shark.getFloat4();
+	states[in_x] = state.getFloat4();
+}
+
+/*!
+ * @brief Several steps of a small swarm in one launch of a single block (kernel_advance_substeps).
+ * The block keeps the whole swarm in shared memory: the positions twice (ping-pong like the stores, w < 0 marks dead fishies),
+ * speed vectors and masses once, because only the own fish reads them, and the sharks.
+ * Every step is a brute force search over the shared positions, then the sharks follow the swarm center like in d_moveSharks.
+ * Only the last step is written back. Needs (3 * mesh_count + 2 * shark_count) * sizeof(float4) dynamic shared memory.
+ * @tparam FEATURES AdvanceFeature flags of the query, see QUERY_FEATURES without FEATURE_SCHOOLS.
+ * @param in Positions, speed vectors and masses of all fishies (read only).
+ * @param out Output: Positions, speed vectors and masses after the last step.
+ * @param mesh_count Number of fishies.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharkSpeed Approximate speed of fishies for the sharks, see d_moveSharks.
+ * @param sharks Positions of all sharks. Will be updated.
+ * @param sharkStates Speed vectors (x, y, z) and masses (w) of all sharks. Will be updated.
+ * @param shark_count Number of sharks.
+ * @param firstK See NeighbourQuery.
+ * @param inputs Swarm centers and random steps of the steps.
+ */
+template <unsigned int FEATURES>
+__global__ void __launch_bounds__( SUBSTEP_THREADS ) d_advance_substeps(
+	ParticleArrays in,
+	ParticleArrays out,
+	unsigned int mesh_count,
+	float speed,
+	float sharkSpeed,
+	float4* sharks,
+	float4* sharkStates,
+	unsigned int shark_count,
+	unsigned int firstK,
+	SubstepInputs inputs)
+{
+	extern __shared__ float4 substepShared[];
+	float4* positions[2] = { substepShared, substepShared + mesh_count };
+	float4* states = substepShared + 2 * mesh_count;
+	float4* sharedSharks = substepShared + 3 * mesh_count;
+	float4* sharedSharkStates = sharedSharks + shark_count;
+
+	for (unsigned int i = threadIdx.x; i < mesh_count; i += blockDim.x)
+	{
+		positions[0][i] = make_float4( in.x[i], in.y[i], in.z[i], in.alive[i] ? 1.0f : -1.0f );
+		states[i] = make_float4( in.vx[i], in.vy[i], in.vz[i], in.mass[i] );
+	}
+	for (unsigned int i = threadIdx.x; i < shark_count; i += blockDim.x)
+	{
+		sharedSharks[i] = sharks[i];
+		sharedSharkStates[i] = sharkStates[i];
+	}
+
+	unsigned int current = 0;
+	for (unsigned int s = 0; s < inputs.steps; s++)
+	{
+		if (threadIdx.x == 0)
+		{
+			s_substep.swarmCenter = inputs.swarmCenter[s];
+			s_substep.step = inputs.firstStep + s;
+		}
+		__syncthreads();										// Inputs of the step and everything of the last step are written
+
+		const float4* from = positions[current];
+		float4* to = positions[1 - current];
+		SharedSearch<FEATURES> search = { from, mesh_count, firstK };
+		for (unsigned int i = threadIdx.x; i < mesh_count; i += blockDim.x)
+		{
+			float4 position = from[i];
+			DeviceVector vert( position.x, position.y, position.z );
+			DeviceVector state( states[i] );
+			bool alive = position.w > 0.0f;
+			if (alive)
+				alive = d_swim<FEATURES | FEATURE_SUBSTEPS>( vert, state, i, i, 0, in.id, search, speed, sharedSharks, shark_count, c_params );
+			to[i] = make_float4( vert.x, vert.y, vert.z, alive ? 1.0f : -1.0f );
+			states[i] = state.getFloat4();
+		}
+		__syncthreads();										// All fishies saw the sharks of this step
+
+		for (unsigned int i = threadIdx.x; i < shark_count; i += blockDim.x)
+		{
+			DeviceVector shark( sharedSharks[i] );
+			DeviceVector state( sharedSharkStates[i] );
+			d_followCenter<FEATURE_SUBSTEPS>( shark, state, i, sharkSpeed );
+			sharedSharks[i] = shark.getFloat4();
+			sharedSharkStates[i] = state.getFloat4();
+		}
+		__syncthreads();										// s_substep is read until here
+		current = 1 - current;
+	}
+
+	for (unsigned int i = threadIdx.x; i < mesh_count; i += blockDim.x)
+	{
+		float4 position = positions[current][i];
+		d_storeParticle( out, i, DeviceVector( position.x, position.y, position.z ), DeviceVector( states[i] ), position.w > 0.0f );
+	}
+	for (unsigned int i = threadIdx.x; i < shark_count; i += blockDim.x)
+	{
+		sharks[i] = sharedSharks[i];
+		sharkStates[i] = sharedSharkStates[i];
+	}
+}
+
+/*!
+ * @brief Grid version of d_moveSharks (kernel_set_shark_target). One thread per shark.
+ * Every shark searches the grid of the last step ring by ring around its cell and swims to the nearest fish or into the densest cell.
+ * For the nearest fish the search stops after the first ring which can't hold a closer one. Without fish in the rings the shark
+ * follows the center like in d_moveSharks. The nearest fish inside the bite distance is claimed with an atomic, so it is eaten
+ * by one shark only, even if several sharks reach it in the same step.
+ * @param sharks Positions of all sharks. Will be updated.
+ * @param states Speed vectors (x, y, z) and masses (w) of all sharks. Will be updated.
+ * @param shark_count Number of sharks.
+ * @param speed Approximate speed of fishies.
+ * @param sorted Fishies of the last step sorted by cell (read only).
+ * @param gridParticleIndex Original fish index of each sorted fish.
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param grid Grid placement.
+ * @param rings Rings of cells searched around the cell of the shark.
+ * @param densest true: swim into the fullest cell, false: to the nearest fish.
+ * @param prey Output of the last step. Eaten fishies are marked dead.
+ * @param claims Shark which bit the fish, per original index. Must be 0xffffffff before the launch.
+ */
+__global__ void d_huntSharks(
+	float4* sharks,
+	float4* states,
+	unsigned int shark_count,
+	float speed,
+	ParticleArrays sorted,
+	const unsigned int* __restrict__ gridParticleIndex,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	GridLayout grid,
+	int rings,
+	bool densest,
+	ParticleArrays prey,
+	unsigned int* claims)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= shark_count)
+		return;
+
+	DeviceVector shark( sharks[in_x] );
+	DeviceVector state( states[in_x] );
+	int3 cell = d_calcGridPos( shark, grid );
+
+	float best2 = FLT_MAX;
+	unsigned int best = EMPTY_CELL;
+	unsigned int bestCount = 0;
+	int3 bestCell = cell;
+	for (int r = 0; r <= rings; r++)
+	{
+		for (int dz = -r; dz <= r; dz++)
+			for (int dy = -r; dy <= r; dy++)
+				for (int dx = -r; dx <= r; dx++)
+				{
+					if (max( abs( dx ), max( abs( dy ), abs( dz ) ) ) != r)	// Inner rings are done
+						continue;
+
+					int3 neighbour = make_int3( cell.x + dx, cell.y + dy, cell.z + dz );
+					unsigned int hash = d_calcGridHash( neighbour, grid );
+					unsigned int start = cellStart[hash];
+					if (start == EMPTY_CELL)
+						continue;
+
+					unsigned int end = cellEnd[hash];
+					if (densest && end - start > bestCount)
+					{
+						bestCount = end - start;
+						bestCell = neighbour;
+					}
+					for (unsigned int i = start; i < end; i++)
+					{
+						float d2 = ( DeviceVector( sorted.x[i], sorted.y[i], sorted.z[i] ) - shark ).length3Squared();
+						if (d2 < best2)
+						{
+							best2 = d2;
+							best = i;
+						}
+					}
+				}
+
+		// Fishies in the outer rings are at least r cells away.
+		float reach = r * grid.cellSize;
+		if (!densest && best != EMPTY_CELL && best2 <= reach * reach)
+			break;
+	}
+
+	if (best == EMPTY_CELL)
+	{
+		d_followCenter( shark, state, in_x, speed );
+	}
+	else
+	{
+		if (best2 < c_params.sharkBiteDist * c_params.sharkBiteDist)
+		{
+			unsigned int fish = gridParticleIndex[best];
+			if (atomicCAS( &claims[fish], EMPTY_CELL, in_x ) == EMPTY_CELL)		// First shark at the fish eats it
+			{
+				prey.alive[fish] = 0;
+				d_logEvent( SwarmEventType::DEATH, prey.id[fish], in_x, DeviceVector( sorted.x[best], sorted.y[best], sorted.z[best] ), sqrtf( best2 ) );
+			}
+		}
+
+		DeviceVector target = densest
+			? DeviceVector( grid.origin.x + ( bestCell.x + 0.5f ) * grid.cellSize, grid.origin.y + ( bestCell.y + 0.5f ) * grid.cellSize, grid.origin.z + ( bestCell.z + 0.5f ) * grid.cellSize )
+			: DeviceVector( sorted.x[best], sorted.y[best], sorted.z[best] );
+		DeviceVector diff = target - shark;
+		float distance = diff.length3();
+		if (distance > 0.0f)
+			state += diff * ( speed * 0.3f / distance );
+		if (state.length3() > speed * 1.5f)								// A bit faster than the fishies, which evade
+			state *= speed * 1.5f / state.length3();
+		shark += state * c_step.dtScale;
+	}
+
+	sharks[in_x] = shark.getFloat4();
+	states[in_x] = state.getFloat4();
+}
+
+/*!
+ * @brief Insert a fish into the k nearest of a probe, sorted by distance. Farther fishies than the kth are dropped.
+ * @param d2 squared distance of the fish.
+ * @param slot slot of the fish.
+ * @param best2 squared distances of the nearest so far.
+ * @param bestSlot slots of the nearest so far.
+ * @param found number of nearest so far, at most k.
+ * @param k wanted number.
+ */
+__device__ void d_insertNearest( float d2, unsigned int slot, float* best2, unsigned int* bestSlot, unsigned int& found, unsigned int k )
+{
+	if (found == k && d2 >= best2[k - 1])
+		return;
+
+	unsigned int i = found < k ? found++ : k - 1;
+	for (; i > 0 && best2[i - 1] > d2; i--)
+	{
+		best2[i] = best2[i - 1];
+		bestSlot[i] = bestSlot[i - 1];
+	}
+	best2[i] = d2;
+	bestSlot[i] = slot;
+}
+
+/*!
+ * @brief Write the k nearest of a probe: stable ids and distances, empty entries get EMPTY_CELL and FLT_MAX.
+ */
+__device__ void d_storeNearest( const ParticleArrays& particles, const float* best2, const unsigned int* bestSlot, unsigned int found, unsigned int k,
+	unsigned int* ids, float* distances )
+{
+	for (unsigned int j = 0; j < k; j++)
+	{
+		ids[j] = j < found ? particles.id[bestSlot[j]] : EMPTY_CELL;
+		distances[j] = j < found ? sqrtf( best2[j] ) : FLT_MAX;
+	}
+}
+
+/*!
+ * @brief Count the living fishies within a radius of every probe in the grid of the last step, one thread per probe.
+ * The candidates come from the cells, the distances from the current positions. A fish may have left its cell by the step,
+ * so the rings reach one cell beyond the radius.
+ * @param probes Probe positions (x, y, z).
+ * @param probe_count Number of probes.
+ * @param radius Radius.
+ * @param rings Rings of cells around the cell of the probe.
+ * @param particles Fishies after the step, the slots of the grid.
+ * @param gridParticleIndex Slot of each sorted fish.
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param grid Grid placement.
+ * @param counts Output: Fishies per probe.
+ */
+__global__ void d_queryRadiusGrid(
+	const float4* __restrict__ probes,
+	unsigned int probe_count,
+	float radius,
+	int rings,
+	ParticleArrays particles,
+	const unsigned int* __restrict__ gridParticleIndex,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	GridLayout grid,
+	unsigned int* counts)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= probe_count)
+		return;
+
+	DeviceVector probe( probes[in_x] );
+	int3 cell = d_calcGridPos( probe, grid );
+	float radius2 = radius * radius;
+	unsigned int count = 0;
+	for (int dz = -rings; dz <= rings; dz++)
+		for (int dy = -rings; dy <= rings; dy++)
+			for (int dx = -rings; dx <= rings; dx++)
+			{
+				unsigned int hash = d_calcGridHash( make_int3( cell.x + dx, cell.y + dy, cell.z + dz ), grid );
+				unsigned int start = cellStart[hash];
+				if (start == EMPTY_CELL)
+					continue;
+				unsigned int end = cellEnd[hash];
+				for (unsigned int i = start; i < end; i++)
+				{
+					unsigned int slot = gridParticleIndex[i];
+					if (particles.alive[slot] && ( d_loadPosition( particles, slot ) - probe ).length3Squared() <= radius2)
+						count++;
+				}
+			}
+	counts[in_x] = count;
+}
+
+/*!
+ * @brief Count the living fishies within a radius of every probe over all fishies, for steps without grid. One thread per probe,
+ * the block walks through the fishies in tiles of blockDim.x positions in shared memory (w < 0: dead).
+ * @param probes Probe positions (x, y, z).
+ * @param probe_count Number of probes.
+ * @param radius Radius.
+ * @param particles Fishies.
+ * @param mesh_count Number of fishies.
+ * @param counts Output: Fishies per probe.
+ */
+__global__ void d_queryRadiusAll(
+	const float4* __restrict__ probes,
+	unsigned int probe_count,
+	float radius,
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	unsigned int* counts)
+{
+	extern __shared__ float4 queryTile[];
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	DeviceVector probe( in_x < probe_count ? probes[in_x] : make_float4( 0.0f, 0.0f, 0.0f, 0.0f ) );
+	float radius2 = radius * radius;
+	unsigned int count = 0;
+	for (unsigned int base = 0; base < mesh_count; base += blockDim.x)
+	{
+		unsigned int fish = base + threadIdx.x;
+		DeviceVector p = fish < mesh_count ? d_loadPosition( particles, fish ) : DeviceVector();
+		queryTile[threadIdx.x] = make_float4( p.x, p.y, p.z, fish < mesh_count && particles.alive[fish] ? 1.0f : -1.0f );
+		__syncthreads();
+		unsigned int tile = min( blockDim.x, mesh_count - base );
+		for (unsigned int j = 0; j < tile; j++)
+		{
+			float4 q = queryTile[j];
+			if (q.w > 0.0f && ( DeviceVector( q.x, q.y, q.z ) - probe ).length3Squared() <= radius2)
+				count++;
+		}
+		__syncthreads();
+	}
+	if (in_x < probe_count)
+		counts[in_x] = count;
+}
+
+/*!
+ * @brief k nearest living fishies of every probe in the grid of the last step, ring by ring around the cell of the probe.
+ * Stops after the first ring which can't hold a closer fish, allowing one cell of movement by the step. Probes whose k
+ * nearest aren't certain within maxRings are listed for d_queryNearestAll.
+ * @param probes Probe positions (x, y, z).
+ * @param probe_count Number of probes.
+ * @param k Fishies per probe, at most QUERY_MAX_K.
+ * @param maxRings Rings that are searched at most.
+ * @param particles Fishies after the step, the slots of the grid.
+ * @param gridParticleIndex Slot of each sorted fish.
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param grid Grid placement.
+ * @param ids Output: Stable ids of the k nearest per probe, closest first.
+ * @param distances Output: Their distances.
+ * @param fallback Output: Number of listed probes, then the probes. Number must be 0 before the launch.
+ */
+__global__ void d_queryNearestGrid(
+	const float4* __restrict__ probes,
+	unsigned int probe_count,
+	unsigned int k,
+	int maxRings,
+	ParticleArrays particles,
+	const unsigned int* __restrict__ gridParticleIndex,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	GridLayout grid,
+	unsigned int* ids,
+	float* distances,
+	unsigned int* fallback)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= probe_count)
+		return;
+
+	DeviceVector probe( probes[in_x] );
+	int3 cell = d_calcGridPos( probe, grid );
+	float best2[QUERY_MAX_K];
+	unsigned int bestSlot[QUERY_MAX_K];
+	unsigned int found = 0;
+	bool certain = false;
+	for (int r = 0; r <= maxRings && !certain; r++)
+	{
+		for (int dz = -r; dz <= r; dz++)
+			for (int dy = -r; dy <= r; dy++)
+				for (int dx = -r; dx <= r; dx++)
+				{
+					if (max( abs( dx ), max( abs( dy ), abs( dz ) ) ) != r)	// Inner rings are done
+						continue;
+
+					unsigned int hash = d_calcGridHash( make_int3( cell.x + dx, cell.y + dy, cell.z + dz ), grid );
+					unsigned int start = cellStart[hash];
+					if (start == EMPTY_CELL)
+						continue;
+					unsigned int end = cellEnd[hash];
+					for (unsigned int i = start; i < end; i++)
+					{
+						unsigned int slot = gridParticleIndex[i];
+						if (particles.alive[slot])
+							d_insertNearest( ( d_loadPosition( particles, slot ) - probe ).length3Squared(), slot, best2, bestSlot, found, k );
+					}
+				}
+
+		// Fishies outside of the rings were at least r cells away before the step, at most one cell less now.
+		float reach = ( r - 1 ) * grid.cellSize;
+		certain = found == k && r >= 1 && best2[k - 1] <= reach * reach;
+	}
+
+	if (!certain)
+		fallback[1 + atomicAdd( fallback, 1 )] = in_x;
+	d_storeNearest( particles, best2, bestSlot, found, k, ids + in_x * k, distances + in_x * k );
+}
+
+/*!
+ * @brief k nearest living fishies over all fishies: of all probes (fallback NULL) or of the probes listed by d_queryNearestGrid.
+ * The block walks through the fishies in tiles of blockDim.x positions in shared memory like d_queryRadiusAll.
+ * @param probes Probe positions (x, y, z).
+ * @param probe_count Number of probes, the launch size.
+ * @param k Fishies per probe, at most QUERY_MAX_K.
+ * @param particles Fishies.
+ * @param mesh_count Number of fishies.
+ * @param fallback Number of listed probes, then the probes. NULL: every probe.
+ * @param ids Output: Stable ids of the k nearest per probe, closest first.
+ * @param distances Output: Their distances.
+ */
+__global__ void d_queryNearestAll(
+	const float4* __restrict__ probes,
+	unsigned int probe_count,
+	unsigned int k,
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	const unsigned int* __restrict__ fallback,
+	unsigned int* ids,
+	float* distances)
+{
+	extern __shared__ float4 queryTile[];
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	unsigned int listed = fallback != NULL ? fallback[0] : probe_count;
+	if (blockIdx.x * blockDim.x >= listed)										// The whole block is beyond the list
+		return;
+
+	bool active = in_x < listed;
+	unsigned int p = active ? ( fallback != NULL ? fallback[1 + in_x] : in_x ) : 0;
+	DeviceVector probe( active ? probes[p] : make_float4( 0.0f, 0.0f, 0.0f, 0.0f ) );
+	float best2[QUERY_MAX_K];
+	unsigned int bestSlot[QUERY_MAX_K];
+	unsigned int found = 0;
+	for (unsigned int base = 0; base < mesh_count; base += blockDim.x)
+	{
+		unsigned int fish = base + threadIdx.x;
+		DeviceVector position = fish < mesh_count ? d_loadPosition( particles, fish ) : DeviceVector();
+		queryTile[threadIdx.x] = make_float4( position.x, position.y, position.z, fish < mesh_count && particles.alive[fish] ? 1.0f : -1.0f );
+		__syncthreads();
+		unsigned int tile = min( blockDim.x, mesh_count - base );
+		for (unsigned int j = 0; active && j < tile; j++)
+		{
+			float4 q = queryTile[j];
+			if (q.w > 0.0f)
+				d_insertNearest( ( DeviceVector( q.x, q.y, q.z ) - probe ).length3Squared(), base + j, best2, bestSlot, found, k );
+		}
+		__syncthreads();
+	}
+	if (active)
+		d_storeNearest( particles, best2, bestSlot, found, k, ids + p * k, distances + p * k );
+}
+
+/*!
+ * @brief Sort key of a pick candidate: the depth along the ray in the high bits (not negative, so its bits sort like the float),
+ * the slot in the low bits. The smallest key is the first hit.
+ * @param p position of the fish.
+ * @param slot slot of the fish.
+ * @param origin Start of the ray.
+ * @param direction Direction of the ray, normalized.
+ * @param maxDepth Length of the ray.
+ * @param radius2 Squared distance from the ray a fish is hit at.
+ * @return key, PICK_MISS if the fish isn't hit.
+ */
+__device__ unsigned long long d_pickKey( DeviceVector p, unsigned int slot, DeviceVector origin, DeviceVector direction, float maxDepth, float radius2 )
+{
+	DeviceVector toFish = p - origin;
+	float depth = toFish.dot( &direction );
+	if (depth < 0.0f || depth > maxDepth || toFish.length3Squared() - depth * depth > radius2)
+		return PICK_MISS;
+	return ( static_cast< unsigned long long >( __float_as_uint( depth ) ) << 32 ) | slot;
+}
+
+/*!
+ * @brief Smallest key of the warp, in all lanes.
+ * @param key key of the lane.
+ * @return smallest key.
+ */
+__device__ unsigned long long d_warpMinKey( unsigned long long key )
+{
+	for (unsigned int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
+	{
+		unsigned long long other = __shfl_xor_sync( FULL_WARP_MASK, key, offset );
+		key = other < key ? other : key;
+	}
+	return key;
+}
+
+/*!
+ * @brief Write the fish of the smallest key with its state.
+ * @param particles Fishies after the step.
+ * @param key smallest key, PICK_MISS: none.
+ * @param origin Start of the ray.
+ * @param direction Direction of the ray, normalized.
+ * @param result Output: Hit fish.
+ */
+__device__ void d_storePick( const ParticleArrays& particles, unsigned long long key, DeviceVector origin, DeviceVector direction, PickResult* result )
+{
+	PickResult pick = {};
+	pick.id = PICK_NONE;
+	pick.slot = PICK_NONE;
+	if (key != PICK_MISS)
+	{
+		unsigned int slot = static_cast< unsigned int >( key & 0xffffffff );
+		DeviceVector p = d_loadPosition( particles, slot );
+		DeviceVector state = d_loadState( particles, slot );
+		DeviceVector toFish = p - origin;
+		pick.id = particles.id[slot];
+		pick.slot = slot;
+		pick.position = make_float4( p.x, p.y, p.z, state.w );
+		pick.velocity = make_float4( state.x, state.y, state.z, sqrtf( state.length3Squared() ) );
+		pick.depth = __uint_as_float( static_cast< unsigned int >( key >> 32 ) );
+		pick.offset = sqrtf( fmaxf( toFish.length3Squared() - pick.depth * pick.depth, 0.0f ) );
+	}
+	*result = pick;
+}
+
+/*!
+ * @brief Pick in the grid of the last step. One warp walks the ray through the cells of the grid box (3D DDA), lane i < 27 tests
+ * neighbour cell i of the current cell. Ends in the first cell that starts behind the best hit, after maxSteps cells or at the box.
+ * @param origin Start of the ray.
+ * @param direction Direction of the ray, normalized.
+ * @param maxDepth Length of the ray.
+ * @param radius Distance from the ray a fish is hit at, at most the cell size.
+ * @param maxSteps Cells the ray crosses at most.
+ * @param particles Fishies after the step, the slots of the grid.
+ * @param gridParticleIndex Slot of each sorted fish.
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param grid Grid placement.
+ * @param result Output: Hit fish.
+ */
+__global__ void d_pickGrid(
+	float4 origin,
+	float4 direction,
+	float maxDepth,
+	float radius,
+	int maxSteps,
+	ParticleArrays particles,
+	const unsigned int* __restrict__ gridParticleIndex,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	GridLayout grid,
+	PickResult* result)
+{
+	DeviceVector const o( origin );
+	DeviceVector const d( direction );
+	float const radius2 = radius * radius;
+	float const from[3] = { o.x, o.y, o.z };
+	float const dir[3] = { d.x, d.y, d.z };
+	float const lower[3] = { grid.origin.x, grid.origin.y, grid.origin.z };
+	int const dims[3] = { grid.dims.x, grid.dims.y, grid.dims.z };
+
+	// Clip the ray to the grid box
+	float enter = 0.0f;
+	float leave = maxDepth;
+	for (int a = 0; a < 3; a++)
+	{
+		float inv = 1.0f / dir[a];
+		float t0 = ( lower[a] - from[a] ) * inv;
+		float t1 = ( lower[a] + dims[a] * grid.cellSize - from[a] ) * inv;
+		enter = fmaxf( enter, fminf( t0, t1 ) );								// fminf and fmaxf drop the NaN of a ray in a face
+		leave = fminf( leave, fmaxf( t0, t1 ) );
+	}
+
+	unsigned long long best = PICK_MISS;
+	if (enter <= leave)
+	{
+		int cell[3];
+		int step[3];
+		float next[3];
+		float delta[3];
+		for (int a = 0; a < 3; a++)
+		{
+			float start = from[a] + dir[a] * enter;
+			cell[a] = min( max( static_cast< int >( floorf( ( start - lower[a] ) / grid.cellSize ) ), 0 ), dims[a] - 1 );
+			step[a] = dir[a] > 0.0f ? 1 : ( dir[a] < 0.0f ? -1 : 0 );
+			float bound = lower[a] + ( cell[a] + ( step[a] > 0 ? 1 : 0 ) ) * grid.cellSize;
+			next[a] = step[a] != 0 ? enter + ( bound - start ) / dir[a] : FLT_MAX;		// Depth of the next cell on this axis
+			delta[a] = step[a] != 0 ? grid.cellSize / fabsf( dir[a] ) : FLT_MAX;
+		}
+
+		int const lane = threadIdx.x;
+		int3 const neighbour = make_int3( lane % 3 - 1, lane / 3 % 3 - 1, lane / 9 - 1 );
+		float cellEnter = enter;
+		for (int s = 0; s < maxSteps; s++)
+		{
+			if (lane < 27)
+			{
+				unsigned int hash = d_calcGridHash( make_int3( cell[0] + neighbour.x, cell[1] + neighbour.y, cell[2] + neighbour.z ), grid );
+				unsigned int start = cellStart[hash];
+				unsigned int end = start != EMPTY_CELL ? cellEnd[hash] : start;
+				for (unsigned int i = start; i < end; i++)
+				{
+					unsigned int slot = gridParticleIndex[i];
+					if (particles.alive[slot])
+					{
+						unsigned long long key = d_pickKey( d_loadPosition( particles, slot ), slot, o, d, maxDepth, radius2 );
+						best = key < best ? key : best;
+					}
+				}
+			}
+			best = d_warpMinKey( best );
+
+			// Next cell along the ray, the smallest depth of the next cell boundaries
+			int a = next[0] < next[1] ? ( next[0] < next[2] ? 0 : 2 ) : ( next[1] < next[2] ? 1 : 2 );
+			cellEnter = next[a];
+			if (cellEnter > leave)
+				break;
+			if (best != PICK_MISS && cellEnter > __uint_as_float( static_cast< unsigned int >( best >> 32 ) ))	// Closer hits were in the cells so far
+				break;
+			cell[a] += step[a];
+			next[a] += delta[a];
+		}
+	}
+
+	if (threadIdx.x == 0)
+		d_storePick( particles, best, o, d, result );
+}
+
+/*!
+ * @brief Pick over all fishies, for steps without grid. One block, the threads walk through the fishies and reduce their keys.
+ * @param origin Start of the ray.
+ * @param direction Direction of the ray, normalized.
+ * @param maxDepth Length of the ray.
+ * @param radius Distance from the ray a fish is hit at.
+ * @param particles Fishies.
+ * @param mesh_count Number of fishies.
+ * @param result Output: Hit fish.
+ */
+__global__ void d_pickAll(
+	float4 origin,
+	float4 direction,
+	float maxDepth,
+	float radius,
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	PickResult* result)
+{
+	__shared__ unsigned long long warpBest[PICK_THREADS / WARP_SIZE];
+	DeviceVector const o( origin );
+	DeviceVector const d( direction );
+	float const radius2 = radius * radius;
+	unsigned long long best = PICK_MISS;
+	for (unsigned int fish = threadIdx.x; fish < mesh_count; fish += blockDim.x)
+	{
+		if (particles.alive[fish])
+		{
+			unsigned long long key = d_pickKey( d_loadPosition( particles, fish ), fish, o, d, maxDepth, radius2 );
+			best = key < best ? key : best;
+		}
+	}
+	best = d_warpMinKey( best );
+	if (threadIdx.x % WARP_SIZE == 0)
+		warpBest[threadIdx.x / WARP_SIZE] = best;
+	__syncthreads();
+
+	if (threadIdx.x == 0)
+	{
+		for (unsigned int w = 1; w < blockDim.x / WARP_SIZE; w++)
+			best = warpBest[w] < best ? warpBest[w] : best;
+		d_storePick( particles, best, o, d, result );
+	}
+}
+
+/*!
+ * @brief Boids version of d_advance_grid. Every thread handles one fish in sorted order
+ * and sums up its neighbourhood from the 27 surrounding cells.
+ * @tparam FEATURES AdvanceFeature flags, see SWIM_FEATURES.
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param sorted Particles sorted by cell (read only).
+ * @param gridParticleIndex Original fish index of each sorted fish.
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param mesh_count Number of fishies.
+ * @param grid Grid placement. The edge length of a cell is also the perception radius.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ */
+template <unsigned int FEATURES>
+__global__ void d_advance_boids(
+	ParticleArrays out,
+	ParticleArrays sorted,
+	const unsigned int* __restrict__ gridParticleIndex,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	unsigned int mesh_count,
+	GridLayout grid,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	DeviceVector vert = d_loadPosition( sorted, in_x );
+	DeviceVector state = d_loadState( sorted, in_x );
+	unsigned char alive = sorted.alive[in_x];
+	unsigned int originalIndex = gridParticleIndex[in_x];
+
+	if (alive)
+	{
+		Neighbourhood n = d_gridNeighbourhood( sorted, cellStart, cellEnd, grid, grid.cellSize, vert, in_x );
+		alive = d_swimBoids<FEATURES>( vert, state, originalIndex, d_schoolOf<FEATURES>( out.id, originalIndex ), out.id, n, speed, sharks, shark_count );
+	}
+
+	d_storeParticle( out, originalIndex, vert, state, alive );
+}
+
+/*!
+ * @brief Mean speed vector and centroid of the fishies of every cell, one thread per cell over its sorted range.
+ * @param cellVelocity Output: mean speed vector (x, y, z) and number of fishies (w). All 0 for empty cells.
+ * @param cellCentroid Output: mean position.
+ * @param sorted Particles sorted by cell (read only).
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param numCells Number of cells of the grid.
+ */
+__global__ void d_cellMeans(
+	float4* __restrict__ cellVelocity,
+	float4* __restrict__ cellCentroid,
+	ParticleArrays sorted,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	unsigned int numCells)
+{
+	unsigned int cell = blockIdx.x * blockDim.x + threadIdx.x;
+	if (cell >= numCells)
+		return;
+
+	unsigned int start = cellStart[cell];
+	unsigned int end = start == EMPTY_CELL ? start : cellEnd[cell];
+	float3 velocity = make_float3( 0.0f, 0.0f, 0.0f );
+	float3 position = make_float3( 0.0f, 0.0f, 0.0f );
+	for (unsigned int i = start; i < end; i++)
+	{
+		velocity.x += sorted.vx[i];
+		velocity.y += sorted.vy[i];
+		velocity.z += sorted.vz[i];
+		position.x += sorted.x[i];
+		position.y += sorted.y[i];
+		position.z += sorted.z[i];
+	}
+	float count = static_cast< float >( end - start );
+	float inv = count > 0.0f ? 1.0f / count : 0.0f;
+	cellVelocity[cell] = make_float4( velocity.x * inv, velocity.y * inv, velocity.z * inv, count );
+	cellCentroid[cell] = make_float4( position.x * inv, position.y * inv, position.z * inv, 0.0f );
+}
+
+/*!
+ * @brief Collisions: copy the positions of the sorted fishies into the first iterate. Dead fishies get w = 0 and are skipped.
+ * @param positions Output: position (x, y, z) and alive (w) per sorted fish.
+ * @param sorted Particles sorted by cell (read only).
+ * @param mesh_count Number of fishies.
+ */
+__global__ void d_loadCollisions( float4* __restrict__ positions, ParticleArrays sorted, unsigned int mesh_count )
+{
+	unsigned int i = blockIdx.x * blockDim.x + threadIdx.x;
+	if (i >= mesh_count)
+		return;
+	positions[i] = make_float4( sorted.x[i], sorted.y[i], sorted.z[i], sorted.alive[i] ? 1.0f : 0.0f );
+}
+
+/*!
+ * @brief Collisions: one Jacobi iteration of the overlap constraints. Every fish pushes itself out of each overlapping fish of the 27 cells
+ * around it by half the overlap and averages the pushes; the partner does the same, so both share the correction. Each thread only
+ * writes its own delta, so there are no atomics and the result doesn't depend on the order of the threads.
+ * @param deltas Output: correction per sorted fish.
+ * @param positions Positions of the iteration (d_loadCollisions, then d_applyCollisions).
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param mesh_count Number of fishies.
+ * @param grid Grid placement of the build. The radius fits into a cell, so the 27 cells hold all partners.
+ * @param radius Distance of two centers at contact.
+ */
+__global__ void d_collide(
+	float4* __restrict__ deltas,
+	const float4* __restrict__ positions,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	unsigned int mesh_count,
+	GridLayout grid,
+	float radius)
+{
+	unsigned int i = blockIdx.x * blockDim.x + threadIdx.x;
+	if (i >= mesh_count)
+		return;
+
+	float4 self = positions[i];
+	DeviceVector vert( self );
+	DeviceVector delta( 0, 0, 0, 0 );
+	unsigned int contacts = 0;
+	if (self.w > 0.0f)
+	{
+		int3 cell = d_calcGridPos( vert, grid );
+		for (int c = 0; c < 27; c++)
+		{
+			unsigned int hash = d_calcGridHash( make_int3( cell.x + c % 3 - 1, cell.y + c / 3 % 3 - 1, cell.z + c / 9 - 1 ), grid );
+			unsigned int start = cellStart[hash];
+			unsigned int end = start == EMPTY_CELL ? start : cellEnd[hash];
+			for (unsigned int j = start; j < end; j++)
+			{
+				float4 other = positions[j];
+				if (j == i || other.w == 0.0f)
+					continue;
+				DeviceVector away = vert - DeviceVector( other );
+				float d2 = away.length3Squared();
+				if (d2 >= radius * radius || d2 <= 0.0f)				// Same position: no direction, the next iteration separates them
+					continue;
+				float d = sqrtf( d2 );
+				delta += away * ( 0.5f * ( radius - d ) / d );
+				contacts++;
+			}
+		}
+	}
+	deltas[i] = ( contacts > 0 ? delta * ( 1.0f / contacts ) : DeviceVector( 0, 0, 0, 0 ) ).getFloat4();
+}
+
+/*!
+ * @brief Collisions: apply the corrections of an iteration. The last iteration writes the positions back into the slots of the step.
+ * @param positions Positions of the iteration. Will be updated.
+ * @param deltas Corrections of d_collide.
+ * @param out Particles of the step, only the positions are written, and only by the last iteration.
+ * @param gridParticleIndex Slot of every sorted fish.
+ * @param mesh_count Number of fishies.
+ * @param last true in the last iteration.
+ */
+__global__ void d_applyCollisions(
+	float4* __restrict__ positions,
+	const float4* __restrict__ deltas,
+	ParticleArrays out,
+	const unsigned int* __restrict__ gridParticleIndex,
+	unsigned int mesh_count,
+	bool last)
+{
+	unsigned int i = blockIdx.x * blockDim.x + threadIdx.x;
+	if (i >= mesh_count)
+		return;
+
+	float4 p = positions[i];
+	float4 d = deltas[i];
+	p = make_float4( p.x + d.x, p.y + d.y, p.z + d.z, p.w );
+	positions[i] = p;
+	if (last && p.w > 0.0f)
+	{
+		unsigned int slot = gridParticleIndex[i];
+		out.x[slot] = p.x;
+		out.y[slot] = p.y;
+		out.z[slot] = p.z;
+	}
+}
+
+/*!
+ * @brief First time a shark can meet a cell that moves on with constant speed vector: the positive root t of
+ * |toCell + drift * t| = sharkSpeed * t. A cell as fast as the shark or faster is taken as standing still.
+ * @param toCell Centroid of the cell - position of the shark.
+ * @param drift Mean speed vector of the cell.
+ * @param sharkSpeed Speed of the shark.
+ * @return steps, at most INTERCEPT_HORIZON.
+ */
+__device__ float d_interceptTime( DeviceVector toCell, DeviceVector drift, float sharkSpeed )
+{
+	float a = drift.length3Squared() - sharkSpeed * sharkSpeed;
+	float b = toCell.dot( &drift );
+	float d2 = toCell.length3Squared();
+	float t = a < 0.0f ? ( -b - sqrtf( fmaxf( b * b - a * d2, 0.0f ) ) ) / a : sqrtf( d2 ) / sharkSpeed;	// a < 0: the roots have opposite signs
+	return fminf( t, INTERCEPT_HORIZON );
+}
+
+/*!
+ * @brief Intercepting version of d_moveSharks (SharkTarget::INTERCEPT). One warp per shark, no fish is read:
+ * the lanes weigh the cells in rings around the shark by their aggregates of d_cellMeans. For every cell the shark solves
+ * |centroid + velocity * t - shark| = sharkSpeed * t for the first time t it can meet the cell, which moves with the mean speed
+ * vector of its fishies, and scores it by fishies / (1 + t). The shark swims to the meeting point of the best cell.
+ * Without fishies in the rings it follows the center like in d_moveSharks. The fishies bite themselves off like with CENTER.
+ * @param sharks Positions of all sharks. Will be updated.
+ * @param states Speed vectors (x, y, z) and masses (w) of all sharks. Will be updated.
+ * @param shark_count Number of sharks.
+ * @param speed Approximate speed of fishies.
+ * @param cellVelocity Mean speed vector (x, y, z) and number of fishies (w) per cell (d_cellMeans).
+ * @param cellCentroid Mean position per cell.
+ * @param grid Grid placement.
+ * @param rings Rings of cells weighed around the cell of the shark.
+ */
+__global__ void __launch_bounds__( INTERCEPT_THREADS ) d_interceptSharks(
+	float4* sharks,
+	float4* states,
+	unsigned int shark_count,
+	float speed,
+	const float4* __restrict__ cellVelocity,
+	const float4* __restrict__ cellCentroid,
+	GridLayout grid,
+	int rings)
+{
+	unsigned int in_x = ( blockIdx.x * blockDim.x + threadIdx.x ) / WARP_SIZE;
+	unsigned int lane = threadIdx.x % WARP_SIZE;
+	if (in_x >= shark_count)											// The whole warp leaves
+		return;
+
+	DeviceVector shark( sharks[in_x] );
+	DeviceVector state( states[in_x] );
+	int3 cell = d_calcGridPos( shark, grid );
+	float sharkSpeed = speed * 1.5f;									// Top speed of the sharks, see d_huntSharks
+
+	// Key: inverted score bits above the cell of the lane, the smallest key of the warp is the best cell.
+	int side = 2 * rings + 1;
+	int cells = side * side * side;
+	unsigned long long best = PICK_MISS;
+	for (int c = lane; c < cells; c += WARP_SIZE)
+	{
+		int3 neighbour = make_int3( cell.x + c % side - rings, cell.y + ( c / side ) % side - rings, cell.z + c / ( side * side ) - rings );
+		unsigned int hash = d_calcGridHash( neighbour, grid );
+		float4 velocity = cellVelocity[hash];
+		if (velocity.w <= 0.0f)
+			continue;
+
+		DeviceVector drift( velocity.x, velocity.y, velocity.z, 0.0f );
+		float score = velocity.w / ( 1.0f + d_interceptTime( DeviceVector( cellCentroid[hash] ) - shark, drift, sharkSpeed ) );
+		unsigned long long key = ( static_cast< unsigned long long >( ~__float_as_uint( score ) ) << 32 ) | static_cast< unsigned int >( c );
+		best = key < best ? key : best;
+	}
+	best = d_warpMinKey( best );
+	if (lane != 0)
+		return;
+
+	if (best == PICK_MISS)
+	{
+		d_followCenter( shark, state, in_x, speed );
+	}
+	else
+	{
+		int c = static_cast< int >( best & 0xffffffffu );
+		int3 neighbour = make_int3( cell.x + c % side - rings, cell.y + ( c / side ) % side - rings, cell.z + c / ( side * side ) - rings );
+		unsigned int hash = d_calcGridHash( neighbour, grid );
+		float4 velocity = cellVelocity[hash];
+		DeviceVector centroid( cellCentroid[hash] );
+		DeviceVector drift( velocity.x, velocity.y, velocity.z, 0.0f );
+		DeviceVector diff = centroid + drift * d_interceptTime( centroid - shark, drift, sharkSpeed ) - shark;	// Meeting point
+		float distance = diff.length3();
+		if (distance > 0.0f)
+			state += diff * ( speed * 0.3f / distance );
+		if (state.length3() > sharkSpeed)
+			state *= sharkSpeed / state.length3();
+		shark += state * c_step.dtScale;
+	}
+
+	sharks[in_x] = shark.getFloat4();
+	states[in_x] = state.getFloat4();
+}
+
+/*!
+ * @brief Mean field version of d_advance_boids: the neighbourhood comes from the cell means (d_meanFieldNeighbourhood).
+ * @tparam FEATURES AdvanceFeature flags, see SWIM_FEATURES.
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param sorted Particles sorted by cell (read only).
+ * @param gridParticleIndex Original fish index of each sorted fish.
+ * @param cellVelocity Mean speed vector and number of fishies per cell.
+ * @param cellCentroid Mean position per cell.
+ * @param mesh_count Number of fishies.
+ * @param grid Grid placement.
+ * @param speed Approximate maximum speed of fishies.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ */
+template <unsigned int FEATURES>
+__global__ void d_advance_boids_mean(
+	ParticleArrays out,
+	ParticleArrays sorted,
+	const unsigned int* __restrict__ gridParticleIndex,
+	const float4* __restrict__ cellVelocity,
+	const float4* __restrict__ cellCentroid,
+	unsigned int mesh_count,
+	GridLayout grid,
+	float speed,
+	const float4* __restrict__ sharks,
+	unsigned int shark_count)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	DeviceVector vert = d_loadPosition( sorted, in_x );
+	DeviceVector state = d_loadState( sorted, in_x );
+	unsigned char alive = sorted.alive[in_x];
+	unsigned int originalIndex = gridParticleIndex[in_x];
+
+	if (alive)
+	{
+		Neighbourhood n = d_meanFieldNeighbourhood( cellVelocity, cellCentroid, grid, vert, state );
+		alive = d_swimBoids<FEATURES>( vert, state, originalIndex, d_schoolOf<FEATURES>( out.id, originalIndex ), out.id, n, speed, sharks, shark_count );
+	}
+
+	d_storeParticle( out, originalIndex, vert, state, alive );
+}
+
+/*!
+ * @brief Write the data the renderer needs of one fish into the VBO.
+ * Dead fishies get w = -1, so the shaders can hide them.
+ * @param particles All fishies (read only).
+ * @param verts Output: Positions for the VBO.
+ * @param directions Output: Unit velocity and speed, orientation of the fish meshes. NULL: not written.
+ * @param in_x Index of the fish.
+ * @param alive true, if the fish lives.
+ * @param vert Position of the fish.
+ * @param speed Length of the speed vector of the fish.
+ */
+__device__ void d_packFish(
+	ParticleArrays particles,
+	float4* verts,
+	float4* directions,
+	unsigned int in_x,
+	bool alive,
+	float3 vert,
+	float speed)
+{
+	verts[in_x] = make_float4( vert.x, vert.y, vert.z, alive ? 1.0f : -1.0f );
+
+	if ( directions != NULL )
+	{
+		directions[in_x] = speed > 1e-12f
+			? make_float4( particles.vx[in_x] / speed, particles.vy[in_x] / speed, particles.vz[in_x] / speed, speed )
+			: make_float4( 1.0f, 0.0f, 0.0f, 0.0f );						// Resting fish looks along x
+	}
+}
+
+/*!
+ * @brief Write the data the renderer needs into the VBO, see d_packFish.
+ * @param particles All fishies (read only).
+ * @param verts Output: Positions for the VBO.
+ * @param directions Output: Unit velocity and speed, orientation of the fish meshes. NULL: not written.
+ * @param mesh_count Number of fishies.
+ */
+__global__ void d_pack(
+	ParticleArrays particles,
+	float4* verts,
+	float4* directions,
+	unsigned int mesh_count)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	float speed = directions != NULL ? DeviceVector( particles.vx[in_x], particles.vy[in_x], particles.vz[in_x] ).length3() : 0.0f;
+	d_packFish( particles, verts, directions, in_x, particles.alive[in_x], make_float3( particles.x[in_x], particles.y[in_x], particles.z[in_x] ), speed );
+}
+
+/*!
+ * @brief Write the positions of the living fishies into a trajectory frame, in the order of their stable ids.
+ * Only every stride-th id is recorded. Entries of dead or compacted fishies keep the value before the launch (memset 0xFF: NaN or 0xFFFF).
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param stride Record ids 0, stride, 2 * stride, ...
+ * @param entries Number of recorded ids. x, y and z each have this many entries.
+ * @param bounds Bounding box of the living fishies (kernel_reduce_stats). Used for the quantisation.
+ * @param quantize true: 16 bit relative to the bounding box, 0 to 65534. false: 32 bit float.
+ * @param positions Output: x, then y, then z.
+ */
+__global__ void d_packTrajectory(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	unsigned int stride,
+	unsigned int entries,
+	const SwarmStats* __restrict__ bounds,
+	bool quantize,
+	void* positions)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count || !particles.alive[in_x])
+		return;
+
+	unsigned int id = particles.id[in_x];
+	if (id % stride != 0 || id / stride >= entries)
+		return;
+
+	unsigned int entry = id / stride;
+	float p[3] = { particles.x[in_x], particles.y[in_x], particles.z[in_x] };
+	if (!quantize)
+	{
+		float* out = static_cast< float* >( positions );
+		for (int c = 0; c < 3; c++)
+			out[c * entries + entry] = p[c];
+		return;
+	}
+
+	const float lower[3] = { bounds->boundsMin.x, bounds->boundsMin.y, bounds->boundsMin.z };
+	const float upper[3] = { bounds->boundsMax.x, bounds->boundsMax.y, bounds->boundsMax.z };
+	unsigned short* out = static_cast< unsigned short* >( positions );
+	for (int c = 0; c < 3; c++)
+	{
+		float extent = upper[c] - lower[c];
+		float t = extent > 0.0f ? ( p[c] - lower[c] ) / extent : 0.0f;
+		out[c * entries + entry] = static_cast< unsigned short >( fminf( fmaxf( t, 0.0f ), 1.0f ) * 65534.0f + 0.5f );
+	}
+}
+
+/*!
+ * @brief Read the positions of a trajectory frame back into float4 positions, the inverse of d_packTrajectory.
+ * @param bounds Bounding box of the frame, at its start.
+ * @param positions x, then y, then z of the frame.
+ * @param entries Number of recorded ids.
+ * @param quantize true: 16 bit relative to the bounding box, 0xFFFF for dead fishies. false: float, NaN for dead fishies.
+ * @param verts Output: position of every entry, w = -1 for dead fishies.
+ */
+__global__ void d_unpackTrajectory(
+	const SwarmStats* __restrict__ bounds,
+	const void* __restrict__ positions,
+	unsigned int entries,
+	bool quantize,
+	float4* verts)
+{
+	unsigned int entry = blockIdx.x * blockDim.x + threadIdx.x;
+	if (entry >= entries)
+		return;
+
+	float p[3];
+	bool alive = true;
+	if (!quantize)
+	{
+		const float* in = static_cast< const float* >( positions );
+		for (int c = 0; c < 3; c++)
+			p[c] = in[c * entries + entry];
+		alive = !isnan( p[0] );
+	}
+	else
+	{
+		const float lower[3] = { bounds->boundsMin.x, bounds->boundsMin.y, bounds->boundsMin.z };
+		const float upper[3] = { bounds->boundsMax.x, bounds->boundsMax.y, bounds->boundsMax.z };
+		const unsigned short* in = static_cast< const unsigned short* >( positions );
+		for (int c = 0; c < 3; c++)
+		{
+			unsigned short q = in[c * entries + entry];
+			alive = alive && q != 0xFFFF;
+			p[c] = lower[c] + q / 65534.0f * ( upper[c] - lower[c] );
+		}
+	}
+	verts[entry] = alive ? make_float4( p[0], p[1], p[2], 1.0f ) : make_float4( 0.0f, 0.0f, 0.0f, -1.0f );
+}
+
+/*!
+ * @brief Difference of 16 bit trajectory positions to a key frame, or back. Wraps modulo 2^16, so it is lossless.
+ * @param positions Positions, in place.
+ * @param key Positions of the key frame.
+ * @param count Number of values.
+ * @param encode true: subtract key, false: add key.
+ */
+__global__ void d_deltaTrajectory(
+	unsigned short* positions,
+	const unsigned short* __restrict__ key,
+	size_t count,
+	bool encode)
+{
+	size_t i = static_cast< size_t >( blockIdx.x ) * blockDim.x + threadIdx.x;
+	if (i >= count)
+		return;
+	positions[i] = static_cast< unsigned short >( encode ? positions[i] - key[i] : positions[i] + key[i] );
+}
+
+/*!
+ * @brief Pointers and sizes of the chunks of a buffer, one thread per chunk.
+ */
+__global__ void d_compressionBatch(
+	const char* input,
+	size_t bytes,
+	size_t chunkSize,
+	char* compressed,
+	size_t stride,
+	const void** inputPtrs,
+	size_t* inputBytes,
+	void** compressedPtrs,
+	unsigned int count)
+{
+	unsigned int i = blockIdx.x * blockDim.x + threadIdx.x;
+	if (i >= count)
+		return;
+	size_t start = i * chunkSize;
+	inputPtrs[i] = input + start;
+	inputBytes[i] = bytes - start < chunkSize ? bytes - start : chunkSize;
+	compressedPtrs[i] = compressed + i * stride;
+}
+
+/*!
+ * @brief Write the record header and the destination of every chunk, one thread. Serial over the chunks, a record has
+ * a few thousand at most.
+ */
+__global__ void d_compressionLayout(
+	const size_t* __restrict__ compressedBytes,
+	unsigned int count,
+	unsigned long long rawBytes,
+	char* output,
+	unsigned long long* offset,
+	unsigned long long* destinations)
+{
+	unsigned long long base = *offset;
+	unsigned long long* header = reinterpret_cast< unsigned long long* >( output + base );
+	unsigned long long position = ( 3 + count ) * sizeof( unsigned long long );
+	for (unsigned int i = 0; i < count; i++)
+	{
+		header[3 + i] = compressedBytes[i];
+		destinations[i] = base + position;
+		position += ( compressedBytes[i] + 7 ) / 8 * 8;
+	}
+	header[0] = position;
+	header[1] = rawBytes;
+	header[2] = count;
+	*offset = base + position;
+}
+
+/*!
+ * @brief Copy the compressed chunks to their destinations in the record, one block per chunk, 8 bytes per thread and loop.
+ */
+__global__ void d_compressionGather(
+	const void* const* __restrict__ compressedPtrs,
+	const size_t* __restrict__ compressedBytes,
+	char* output,
+	const unsigned long long* __restrict__ destinations)
+{
+	const unsigned long long* from = static_cast< const unsigned long long* >( compressedPtrs[blockIdx.x] );
+	unsigned long long* to = reinterpret_cast< unsigned long long* >( output + destinations[blockIdx.x] );
+	size_t bytes = compressedBytes[blockIdx.x];
+	size_t words = ( bytes + 7 ) / 8;											// The output slots are padded to 8 bytes
+	for (size_t w = threadIdx.x; w < words; w += blockDim.x)
+	{
+		unsigned long long word = from[w];
+		if (w == words - 1 && bytes % 8 != 0)
+			word &= ( 1ull << ( 8 * ( bytes % 8 ) ) ) - 1;						// Zero padding (little endian), equal states give equal files
+		to[w] = word;
+	}
+}
+
+/*!
+ * @brief Pointers and sizes of the chunks of a record for the decompression, one thread. Serial like d_compressionLayout.
+ */
+__global__ void d_decompressionBatch(
+	const char* record,
+	unsigned int count,
+	size_t chunkSize,
+	char* output,
+	size_t bytes,
+	const void** compressedPtrs,
+	size_t* compressedBytes,
+	void** outputPtrs,
+	size_t* outputBytes)
+{
+	const unsigned long long* header = reinterpret_cast< const unsigned long long* >( record );
+	unsigned long long position = ( 3 + count ) * sizeof( unsigned long long );
+	for (unsigned int i = 0; i < count; i++)
+	{
+		size_t start = i * chunkSize;
+		compressedPtrs[i] = record + position;
+		compressedBytes[i] = header[3 + i];
+		outputPtrs[i] = output + start;
+		outputBytes[i] = bytes - start < chunkSize ? bytes - start : chunkSize;
+		position += ( header[3 + i] + 7 ) / 8 * 8;
+	}
+}
+
+/*!
+ * @brief Spawn all fishies in place, like spawnFish and spawnColors on the host: random position in the spawn box,
+ * no speed, random mass and a random shade of orange.
+ * @param particles Output: All fishies. Slot i gets id i.
+ * @param mesh_count Number of fishies.
+ * @param colors Output: Color per fish (r, g, b, a). NULL: not written.
+ * @param boxMin lower corner of the spawn box.
+ * @param boxMax upper corner of the spawn box.
+ */
+__global__ void d_spawnAll(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	uchar4* colors,
+	float3 boxMin,
+	float3 boxMax)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	float4 random = d_random4( in_x, RANDOM_SPAWN );
+	DeviceVector vert( boxMin.x + random.x * ( boxMax.x - boxMin.x ), boxMin.y + random.y * ( boxMax.y - boxMin.y ), boxMin.z + random.z * ( boxMax.z - boxMin.z ) );
+	d_storeParticle( particles, in_x, vert, DeviceVector( 0.0f, 0.0f, 0.0f, random.w / 4.0f + 0.875f ), 1 );	// Same mass range as spawnFish
+	particles.id[in_x] = in_x;
+
+	if (colors != NULL)
+	{
+		float4 shade = d_random4( in_x, RANDOM_COLOR );
+		colors[in_x] = make_uchar4(												// Same orange and shades as spawnColors
+			static_cast< unsigned char >( 200.0f * ( shade.x / 2.0f + 0.75f ) + 0.5f ),
+			static_cast< unsigned char >( 117.0f * ( shade.y / 2.0f + 0.75f ) + 0.5f ),
+			static_cast< unsigned char >( 26.0f * ( shade.z / 2.0f + 0.75f ) + 0.5f ),
+			255 );
+	}
+}
+
+/*!
+ * @brief Emitter: append the index of every dead fish to the free list.
+ * @param alive alive flags of all fishies.
+ * @param mesh_count Number of fishies.
+ * @param freeList Output: indices of dead fishies, in no particular order.
+ * @param freeCount Output: number of indices in freeList. Must be 0 before the launch.
+ */
+__global__ void d_collectDead(
+	const unsigned char* __restrict__ alive,
+	unsigned int mesh_count,
+	unsigned int* freeList,
+	unsigned int* freeCount)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count || alive[in_x])
+		return;
+
+	freeList[atomicAdd( freeCount, 1u )] = in_x;
+}
+
+/*!
+ * @brief Emitter: bring dead fishies back at a random position in the spawn box.
+ * Thread i reuses the slot freeList[i]. The random numbers only depend on seed, slot and step (see d_random4),
+ * so a slot spawns at the same place in every run.
+ * @param particles All fishies. Will be updated.
+ * @param freeList indices of dead fishies.
+ * @param freeCount number of indices in freeList.
+ * @param maxSpawn Maximum number of fishies to spawn (number of threads).
+ * @param boxMin lower corner of the spawn box.
+ * @param boxMax upper corner of the spawn box.
+ * @param limited true: the timeline lowers maxSpawn to d_timelineState.respawnLimit.
+ */
+__global__ void d_spawn(
+	ParticleArrays particles,
+	const unsigned int* __restrict__ freeList,
+	const unsigned int* __restrict__ freeCount,
+	unsigned int maxSpawn,
+	float3 boxMin,
+	float3 boxMax,
+	bool limited)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= maxSpawn || in_x >= *freeCount || ( limited && in_x >= d_timelineState.respawnLimit ))
+		return;
+
+	unsigned int slot = freeList[in_x];
+	float4 random = d_random4( slot, RANDOM_SPAWN );
+
+	particles.x[slot] = boxMin.x + random.x * ( boxMax.x - boxMin.x );
+	particles.y[slot] = boxMin.y + random.y * ( boxMax.y - boxMin.y );
+	particles.z[slot] = boxMin.z + random.z * ( boxMax.z - boxMin.z );
+	particles.vx[slot] = 0.0f;
+	particles.vy[slot] = 0.0f;
+	particles.vz[slot] = 0.0f;
+	particles.mass[slot] = random.w / 4.0f + 0.875f;			// Same range as spawnFish.
+	particles.alive[slot] = 1;
+	d_logEvent( SwarmEventType::SPAWN, particles.id[slot], 0xffffffff,
+		DeviceVector( particles.x[slot], particles.y[slot], particles.z[slot] ), 0.0f );
+}
+
+/*!
+ * @brief Largest difference of every quantised component of a delta checkpoint, passed by value.
+ */
+struct CheckpointRange
+{
+	float value[CHECKPOINT_COMPONENTS];
+};
+
+/*!
+ * @brief Get the quantised arrays of a store in checkpoint order.
+ * @param particles store.
+ * @param arrays Output: x, y, z, vx, vy, vz.
+ */
+__device__ void d_checkpointArrays( const ParticleArrays& particles, float* arrays[CHECKPOINT_COMPONENTS] )
+{
+	arrays[0] = particles.x;
+	arrays[1] = particles.y;
+	arrays[2] = particles.z;
+	arrays[3] = particles.vx;
+	arrays[4] = particles.vy;
+	arrays[5] = particles.vz;
+}
+
+/*!
+ * @brief Check if a slot goes into the event list of a delta checkpoint instead of the differences.
+ * @param particles current fishies.
+ * @param reference state of the decoder.
+ * @param slot slot.
+ * @return true, if id, alive flag or mass differ.
+ */
+__device__ bool d_checkpointChanged( const ParticleArrays& particles, const ParticleArrays& reference, unsigned int slot )
+{
+	return particles.id[slot] != reference.id[slot] || particles.alive[slot] != reference.alive[slot]
+		|| __float_as_uint( particles.mass[slot] ) != __float_as_uint( reference.mass[slot] );
+}
+
+/*!
+ * @brief Decoded value of a quantised difference. Encoder and decoder use this, so both get the same bits.
+ * @param previous value of the checkpoint before.
+ * @param delta quantised difference.
+ * @param range largest difference of the component.
+ * @return value.
+ */
+__device__ float d_checkpointValue( float previous, short delta, float range )
+{
+	return __fmaf_rn( static_cast< float >( delta ), range / CHECKPOINT_STEPS, previous );
+}
+
+/*!
+ * @brief Largest difference to the reference of every component over the unchanged slots. A warp reduces with shuffles,
+ * lane 0 takes the maximum with atomicMax on the float bits, which orders like the values for positive floats.
+ * @param particles current fishies.
+ * @param reference state of the decoder.
+ * @param mesh_count number of slots.
+ * @param counters Output: CHECKPOINT_COMPONENTS ranges as float bits. Cleared before.
+ */
+__global__ void d_checkpointRange(
+	ParticleArrays particles,
+	ParticleArrays reference,
+	unsigned int mesh_count,
+	unsigned int* counters)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	float difference[CHECKPOINT_COMPONENTS] = {};
+	if (in_x < mesh_count && !d_checkpointChanged( particles, reference, in_x ))
+	{
+		float* current[CHECKPOINT_COMPONENTS];
+		float* previous[CHECKPOINT_COMPONENTS];
+		d_checkpointArrays( particles, current );
+		d_checkpointArrays( reference, previous );
+		for (unsigned int c = 0; c < CHECKPOINT_COMPONENTS; c++)
+			difference[c] = fabsf( current[c][in_x] - previous[c][in_x] );
+	}
+
+	for (unsigned int c = 0; c < CHECKPOINT_COMPONENTS; c++)		// All lanes take part, the ones past the end with 0
+	{
+		float value = difference[c];
+		for (unsigned int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
+			value = fmaxf( value, __shfl_xor_sync( FULL_WARP_MASK, value, offset ) );
+		if (threadIdx.x % WARP_SIZE == 0 && value > 0.0f)
+			atomicMax( counters + c, __float_as_uint( value ) );
+	}
+}
+
+/*!
+ * @brief Quantise the differences of a slot, or put it into the event list, and bring the reference to the decoded state.
+ * @param particles current fishies.
+ * @param reference state of the decoder. Will be updated.
+ * @param mesh_count number of slots.
+ * @param deltas Output: quantised differences, component c at c * stride.
+ * @param stride distance of the arrays in deltas.
+ * @param events Output: changed slots.
+ * @param maxEvents capacity of events.
+ * @param counters ranges of d_checkpointRange, then the event counter.
+ */
+__global__ void d_encodeCheckpoint(
+	ParticleArrays particles,
+	ParticleArrays reference,
+	unsigned int mesh_count,
+	short* deltas,
+	size_t stride,
+	CheckpointEvent* events,
+	unsigned int maxEvents,
+	unsigned int* counters)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	float* current[CHECKPOINT_COMPONENTS];
+	float* previous[CHECKPOINT_COMPONENTS];
+	d_checkpointArrays( particles, current );
+	d_checkpointArrays( reference, previous );
+
+	if (d_checkpointChanged( particles, reference, in_x ))
+	{
+		unsigned int event = atomicAdd( counters + CHECKPOINT_COMPONENTS, 1u );
+		CheckpointEvent record;
+		record.slot = in_x;
+		record.id = particles.id[in_x];
+		record.alive = particles.alive[in_x];
+		for (unsigned int c = 0; c < CHECKPOINT_COMPONENTS; c++)
+		{
+			record.values[c] = current[c][in_x];
+			previous[c][in_x] = current[c][in_x];
+			deltas[c * stride + in_x] = 0;
+		}
+		record.values[CHECKPOINT_COMPONENTS] = particles.mass[in_x];
+		reference.mass[in_x] = particles.mass[in_x];
+		reference.alive[in_x] = particles.alive[in_x];
+		reference.id[in_x] = particles.id[in_x];
+		if (event < maxEvents)
+			events[event] = record;
+		return;
+	}
+
+	for (unsigned int c = 0; c < CHECKPOINT_COMPONENTS; c++)
+	{
+		float range = __uint_as_float( counters[c] );
+		float steps = range > 0.0f ? rintf( ( current[c][in_x] - previous[c][in_x] ) * CHECKPOINT_STEPS / range ) : 0.0f;
+		short delta = static_cast< short >( fminf( fmaxf( steps, -CHECKPOINT_STEPS ), CHECKPOINT_STEPS ) );
+		deltas[c * stride + in_x] = delta;
+		previous[c][in_x] = d_checkpointValue( previous[c][in_x], delta, range );	// What the decoder will have
+	}
+}
+
+/*!
+ * @brief Add the quantised differences of a delta checkpoint to the state of the checkpoint before.
+ * @param particles state of the checkpoint before. Will be updated.
+ * @param mesh_count number of slots.
+ * @param deltas quantised differences, component c at c * stride.
+ * @param stride distance of the arrays in deltas.
+ * @param range largest difference of every component.
+ */
+__global__ void d_applyCheckpoint(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	const short* __restrict__ deltas,
+	size_t stride,
+	CheckpointRange range)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	float* values[CHECKPOINT_COMPONENTS];
+	d_checkpointArrays( particles, values );
+	for (unsigned int c = 0; c < CHECKPOINT_COMPONENTS; c++)
+		values[c][in_x] = d_checkpointValue( values[c][in_x], deltas[c * stride + in_x], range.value[c] );
+}
+
+/*!
+ * @brief Write the changed slots of a delta checkpoint, after d_applyCheckpoint.
+ * @param particles All fishies. Will be updated.
+ * @param events changed slots.
+ * @param eventCount number of events.
+ */
+__global__ void d_applyCheckpointEvents(
+	ParticleArrays particles,
+	const CheckpointEvent* __restrict__ events,
+	unsigned int eventCount)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= eventCount)
+		return;
+
+	const CheckpointEvent& event = events[in_x];
+	float* values[CHECKPOINT_COMPONENTS];
+	d_checkpointArrays( particles, values );
+	for (unsigned int c = 0; c < CHECKPOINT_COMPONENTS; c++)
+		values[c][event.slot] = event.values[c];
+	particles.mass[event.slot] = event.values[CHECKPOINT_COMPONENTS];
+	particles.alive[event.slot] = static_cast< unsigned char >( event.alive );
+	particles.id[event.slot] = event.id;
+}
+
+/*!
+ * @brief Neutral element of the stats reduction.
+ * @return partial aggregates without fishies.
+ */
+__device__ StatsPartial d_emptyStats()
+{
+	StatsPartial s;
+	s.sum = make_float3( 0.0f, 0.0f, 0.0f );
+	s.lower = make_float3( FLT_MAX, FLT_MAX, FLT_MAX );
+	s.upper = make_float3( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+	s.speed = 0.0f;
+	s.topSpeed = 0.0f;
+	s.count = 0;
+	return s;
+}
+
+/*!
+ * @brief Merge the partial aggregates b into a.
+ * @param a partial aggregates. Will be updated.
+ * @param b partial aggregates.
+ */
+__device__ void d_mergeStats( StatsPartial& a, const StatsPartial& b )
+{
+	a.sum = make_float3( a.sum.x + b.sum.x, a.sum.y + b.sum.y, a.sum.z + b.sum.z );
+	a.lower = make_float3( fminf( a.lower.x, b.lower.x ), fminf( a.lower.y, b.lower.y ), fminf( a.lower.z, b.lower.z ) );
+	a.upper = make_float3( fmaxf( a.upper.x, b.upper.x ), fmaxf( a.upper.y, b.upper.y ), fmaxf( a.upper.z, b.upper.z ) );
+	a.speed += b.speed;
+	a.topSpeed = fmaxf( a.topSpeed, b.topSpeed );
+	a.count += b.count;
+}
+
+/*!
+ * @brief Get the partial aggregates of the lane offset lanes above (__shfl_down_sync of every member).
+ * @param s partial aggregates of this lane.
+ * @param offset lane offset.
+ * @return partial aggregates of the other lane.
+ */
+__device__ StatsPartial d_shuffleStats( const StatsPartial& s, unsigned int offset )
+{
+	StatsPartial o;
+	o.sum = make_float3(
+		__shfl_down_sync( FULL_WARP_MASK, s.sum.x, offset ),
+		__shfl_down_sync( FULL_WARP_MASK, s.sum.y, offset ),
+		__shfl_down_sync( FULL_WARP_MASK, s.sum.z, offset ) );
+	o.lower = make_float3(
+		__shfl_down_sync( FULL_WARP_MASK, s.lower.x, offset ),
+		__shfl_down_sync( FULL_WARP_MASK, s.lower.y, offset ),
+		__shfl_down_sync( FULL_WARP_MASK, s.lower.z, offset ) );
+	o.upper = make_float3(
+		__shfl_down_sync( FULL_WARP_MASK, s.upper.x, offset ),
+		__shfl_down_sync( FULL_WARP_MASK, s.upper.y, offset ),
+		__shfl_down_sync( FULL_WARP_MASK, s.upper.z, offset ) );
+	o.speed = __shfl_down_sync( FULL_WARP_MASK, s.speed, offset );
+	o.topSpeed = __shfl_down_sync( FULL_WARP_MASK, s.topSpeed, offset );
+	o.count = __shfl_down_sync( FULL_WARP_MASK, s.count, offset );
+	return o;
+}
+
+/*!
+ * @brief Reduce the partial aggregates of all threads of a block: shuffles inside every warp, then over the warps.
+ * Block size must be a multiple of WARP_SIZE. All threads of the block have to call it.
+ * @param s partial aggregates of this thread.
+ * @return aggregates of the whole block (valid in thread 0).
+ */
+__device__ StatsPartial d_blockReduceStats( StatsPartial s )
+{
+	__shared__ StatsPartial warpStats[MAX_BLOCK_WARPS];
+
+	unsigned int lane = threadIdx.x % WARP_SIZE;
+	unsigned int warp = threadIdx.x / WARP_SIZE;
+
+	for (unsigned int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
+		d_mergeStats( s, d_shuffleStats( s, offset ) );
+
+	if (lane == 0)
+		warpStats[warp] = s;
+	__syncthreads();
+
+	if (warp != 0)
+		return s;
+
+	s = lane < blockDim.x / WARP_SIZE ? warpStats[lane] : d_emptyStats();
+	for (unsigned int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
+		d_mergeStats( s, d_shuffleStats( s, offset ) );
+	return s;
+}
+
+/*!
+ * @brief First pass of the stats reduction. Every block reduces a grid stride part of the fishies.
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param partials Output: partial aggregates, one per block.
+ */
+__global__ void d_reduceStats(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	StatsPartial* partials)
+{
+	StatsPartial s = d_emptyStats();
+	for (unsigned int i = blockIdx.x * blockDim.x + threadIdx.x; i < mesh_count; i += gridDim.x * blockDim.x)
+	{
+		if (!particles.alive[i])
+			continue;
+
+		StatsPartial fish;
+		fish.sum = make_float3( particles.x[i], particles.y[i], particles.z[i] );
+		fish.lower = fish.sum;
+		fish.upper = fish.sum;
+		fish.speed = DeviceVector( particles.vx[i], particles.vy[i], particles.vz[i] ).length3();
+		fish.topSpeed = fish.speed;
+		fish.count = 1;
+		d_mergeStats( s, fish );
+	}
+
+	s = d_blockReduceStats( s );
+	if (threadIdx.x == 0)
+		partials[blockIdx.x] = s;
+}
+
+/*!
+ * @brief Pack and first pass of the stats reduction in one pass over the fishies: every fish is read once for the VBO
+ * (d_packFish) and for the partial aggregates of its block, like d_reduceStats.
+ * @param particles All fishies (read only).
+ * @param verts Output: Positions for the VBO.
+ * @param directions Output: Unit velocity and speed, orientation of the fish meshes. NULL: not written.
+ * @param mesh_count Number of fishies.
+ * @param partials Output: partial aggregates, one per block.
+ */
+__global__ void d_packStats(
+	ParticleArrays particles,
+	float4* verts,
+	float4* directions,
+	unsigned int mesh_count,
+	StatsPartial* partials)
+{
+	StatsPartial s = d_emptyStats();
+	for (unsigned int i = blockIdx.x * blockDim.x + threadIdx.x; i < mesh_count; i += gridDim.x * blockDim.x)
+	{
+		bool alive = particles.alive[i];
+		StatsPartial fish;
+		fish.sum = make_float3( particles.x[i], particles.y[i], particles.z[i] );
+		fish.speed = DeviceVector( particles.vx[i], particles.vy[i], particles.vz[i] ).length3();
+		d_packFish( particles, verts, directions, i, alive, fish.sum, fish.speed );
+		if (!alive)
+			continue;
+
+		fish.lower = fish.sum;
+		fish.upper = fish.sum;
+		fish.topSpeed = fish.speed;
+		fish.count = 1;
+		d_mergeStats( s, fish );
+	}
+
+	s = d_blockReduceStats( s );
+	if (threadIdx.x == 0)
+		partials[blockIdx.x] = s;
+}
+
+/*!
+ * @brief Second pass of the stats reduction. One block reduces the partial aggregates and computes the means.
+ * @param partials partial aggregates of the first pass.
+ * @param partial_count Number of partial aggregates.
+ * @param stats Output: aggregates of all living fishies.
+ * @param mirror Output: copy of the aggregates in mapped host memory (CudaMailbox). NULL: none.
+ */
+__global__ void d_finishStats(
+	const StatsPartial* __restrict__ partials,
+	unsigned int partial_count,
+	SwarmStats* stats,
+	SwarmStats* mirror)
+{
+	StatsPartial s = d_emptyStats();
+	for (unsigned int i = threadIdx.x; i < partial_count; i += blockDim.x)
+		d_mergeStats( s, partials[i] );
+
+	s = d_blockReduceStats( s );
+	if (threadIdx.x != 0)
+		return;
+
+	SwarmStats result;
+	result.liveCount = s.count;
+	if (s.count == 0)
+	{
+		result.centroid = make_float3( 0.0f, 0.0f, 0.0f );
+		result.boundsMin = result.centroid;
+		result.boundsMax = result.centroid;
+		result.meanSpeed = 0.0f;
+		result.maxSpeed = 0.0f;
+	}
+	else
+	{
+		float inv = 1.0f / s.count;
+		result.centroid = make_float3( s.sum.x * inv, s.sum.y * inv, s.sum.z * inv );
+		result.boundsMin = s.lower;
+		result.boundsMax = s.upper;
+		result.meanSpeed = s.speed * inv;
+		result.maxSpeed = s.topSpeed;
+	}
+	*stats = result;
+	if (mirror != NULL)
+		*mirror = result;										// Over the bus, the host polls it without a copy
+}
+
+/*!
+ * @brief Copy evenly spread fishies into the probes of the distance histogram.
+ * @param particles Fishies.
+ * @param mesh_count Number of fishies.
+ * @param probes Output: positions, w = 1 for living fishies, -1 for dead ones.
+ * @param probe_count Number of probes, at most mesh_count.
+ */
+__global__ void d_gatherStatsProbes(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	float4* probes,
+	unsigned int probe_count)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= probe_count)
+		return;
+
+	unsigned int slot = static_cast< unsigned int >( static_cast< unsigned long long >( in_x ) * mesh_count / probe_count );
+	DeviceVector p = d_loadPosition( particles, slot );
+	probes[in_x] = make_float4( p.x, p.y, p.z, particles.alive[slot] ? 1.0f : -1.0f );
+}
+
+/*!
+ * @brief Write a StatsSample: the aggregates of the last reduction and the histogram of the distances of the probes
+ * to their closest fish. One block, the bins are counted in shared memory.
+ * @param probes Probes, w < 0: dead fish, not counted.
+ * @param probe_count Number of probes.
+ * @param distances Two distances per probe, the second one is the closest other fish.
+ * @param binWidth Width of a bin.
+ * @param step Steps since the start.
+ * @param stats Aggregates of the last reduction.
+ * @param sample Output: sample.
+ */
+__global__ void d_storeStatsSample(
+	const float4* __restrict__ probes,
+	unsigned int probe_count,
+	const float* __restrict__ distances,
+	float binWidth,
+	unsigned long long step,
+	const SwarmStats* __restrict__ stats,
+	StatsSample* sample)
+{
+	__shared__ unsigned int bins[NEAREST_BINS];
+	__shared__ float sum;
+	__shared__ unsigned int sampled;
+	if (threadIdx.x < NEAREST_BINS)
+		bins[threadIdx.x] = 0;
+	if (threadIdx.x == 0)
+	{
+		sum = 0.0f;
+		sampled = 0;
+	}
+	__syncthreads();
+
+	for (unsigned int i = threadIdx.x; i < probe_count; i += blockDim.x)
+	{
+		float distance = distances[i * 2 + 1];
+		if (probes[i].w < 0.0f || distance == FLT_MAX)
+			continue;
+		unsigned int bin = min( static_cast< unsigned int >( distance / binWidth ), NEAREST_BINS - 1 );
+		atomicAdd( &bins[bin], 1u );
+		atomicAdd( &sum, distance );
+		atomicAdd( &sampled, 1u );
+	}
+	__syncthreads();
+
+	if (threadIdx.x < NEAREST_BINS)
+		sample->nearest[threadIdx.x] = bins[threadIdx.x];
+	if (threadIdx.x == 0)
+	{
+		sample->step = step;
+		sample->stats = *stats;
+		sample->nearestSum = sum;
+		sample->sampled = sampled;
+	}
+}
+
+/*!
+ * @brief Sum of a value over the warp, in lane 0.
+ * @tparam T float or unsigned int.
+ * @param value value of the lane.
+ * @return sum in lane 0, partial sums in the other lanes.
+ */
+template <class T>
+__device__ T d_warpSum( T value )
+{
+	for (unsigned int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
+		value += __shfl_down_sync( FULL_WARP_MASK, value, offset );
+	return value;
+}
+
+/*!
+ * @brief Swarm analytics of a step from what its advance left behind, without a search of its own: distance to the closest
+ * fish and alignment with it from the closest fishies of the grid search, the local density from the fishies in the grid cell
+ * of each fish, and the sum of the headings for the polarisation. The histograms are privatised per block in shared memory
+ * and added to the sample once per block and bin; counts and sums go through registers and warp shuffles.
+ * @param particles Fishies after the step.
+ * @param mesh_count Number of fishies.
+ * @param nearest Slot of the closest fish per slot. NULL: no distance and alignment histograms.
+ * @param cellStart Index of first fish in cell. NULL: no density histogram.
+ * @param cellEnd Index after last fish in cell.
+ * @param grid Grid placement.
+ * @param nearestBinWidth Width of a bin of the distance histogram.
+ * @param sample Output: the histograms, counts and sums are added. Zero before the launch.
+ */
+__global__ void d_swarmAnalytics(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	const unsigned int* __restrict__ nearest,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	GridLayout grid,
+	float nearestBinWidth,
+	StatsSample* sample)
+{
+	__shared__ unsigned int nearestBins[NEAREST_BINS];
+	__shared__ unsigned int densityBins[DENSITY_BINS];
+	__shared__ unsigned int alignmentBins[ALIGNMENT_BINS];
+	__shared__ float sums[5];													// Distances, cosines, headings x, y, z
+	__shared__ unsigned int counts[3];											// Distances, cosines, headings
+	for (unsigned int i = threadIdx.x; i < NEAREST_BINS; i += blockDim.x)
+		nearestBins[i] = 0;
+	for (unsigned int i = threadIdx.x; i < DENSITY_BINS; i += blockDim.x)
+		densityBins[i] = 0;
+	for (unsigned int i = threadIdx.x; i < ALIGNMENT_BINS; i += blockDim.x)
+		alignmentBins[i] = 0;
+	if (threadIdx.x < 5)
+		sums[threadIdx.x] = 0.0f;
+	if (threadIdx.x < 3)
+		counts[threadIdx.x] = 0;
+	__syncthreads();
+
+	float distanceSum = 0.0f;
+	float cosineSum = 0.0f;
+	float3 heading = make_float3( 0.0f, 0.0f, 0.0f );
+	unsigned int distances = 0;
+	unsigned int cosines = 0;
+	unsigned int headed = 0;
+	for (unsigned int slot = blockIdx.x * blockDim.x + threadIdx.x; slot < mesh_count; slot += gridDim.x * blockDim.x)
+	{
+		if (!particles.alive[slot])
+			continue;
+
+		DeviceVector p = d_loadPosition( particles, slot );
+		DeviceVector v( particles.vx[slot], particles.vy[slot], particles.vz[slot] );
+		float speed = sqrtf( v.length3Squared() );
+		if (speed > 0.0f)
+		{
+			heading.x += v.x / speed;
+			heading.y += v.y / speed;
+			heading.z += v.z / speed;
+			headed++;
+		}
+
+		if (cellStart != NULL)													// The fish may have left its cell by the step, then it is the new one
+		{
+			unsigned int hash = d_calcGridHash( d_calcGridPos( p, grid ), grid );
+			unsigned int start = cellStart[hash];
+			unsigned int occupancy = start != EMPTY_CELL ? max( cellEnd[hash] - start, 1u ) : 1u;
+			atomicAdd( &densityBins[min( 31u - __clz( occupancy ), DENSITY_BINS - 1 )], 1u );
+		}
+
+		unsigned int other = nearest != NULL ? nearest[slot] : ~0u;
+		if (other < mesh_count && other != slot && particles.alive[other])
+		{
+			DeviceVector q = d_loadPosition( particles, other );
+			float distance = sqrtf( ( q - p ).length3Squared() );
+			atomicAdd( &nearestBins[min( static_cast< unsigned int >( distance / nearestBinWidth ), NEAREST_BINS - 1 )], 1u );
+			distanceSum += distance;
+			distances++;
+
+			DeviceVector w( particles.vx[other], particles.vy[other], particles.vz[other] );
+			float otherSpeed = sqrtf( w.length3Squared() );
+			if (speed > 0.0f && otherSpeed > 0.0f)
+			{
+				float cosine = fminf( fmaxf( ( v.x * w.x + v.y * w.y + v.z * w.z ) / ( speed * otherSpeed ), -1.0f ), 1.0f );
+				atomicAdd( &alignmentBins[min( static_cast< unsigned int >( ( cosine + 1.0f ) * 0.5f * ALIGNMENT_BINS ), ALIGNMENT_BINS - 1 )], 1u );
+				cosineSum += cosine;
+				cosines++;
+			}
+		}
+	}
+
+	// Whole warps take part in the shuffles, the loop above left none of them early
+	distanceSum = d_warpSum( distanceSum );
+	cosineSum = d_warpSum( cosineSum );
+	heading.x = d_warpSum( heading.x );
+	heading.y = d_warpSum( heading.y );
+	heading.z = d_warpSum( heading.z );
+	distances = d_warpSum( distances );
+	cosines = d_warpSum( cosines );
+	headed = d_warpSum( headed );
+	if (threadIdx.x % WARP_SIZE == 0)
+	{
+		atomicAdd( &sums[0], distanceSum );
+		atomicAdd( &sums[1], cosineSum );
+		atomicAdd( &sums[2], heading.x );
+		atomicAdd( &sums[3], heading.y );
+		atomicAdd( &sums[4], heading.z );
+		atomicAdd( &counts[0], distances );
+		atomicAdd( &counts[1], cosines );
+		atomicAdd( &counts[2], headed );
+	}
+	__syncthreads();
+
+	for (unsigned int i = threadIdx.x; i < NEAREST_BINS; i += blockDim.x)
+		if (nearestBins[i] > 0)
+			atomicAdd( &sample->nearest[i], nearestBins[i] );
+	for (unsigned int i = threadIdx.x; i < DENSITY_BINS; i += blockDim.x)
+		if (densityBins[i] > 0)
+			atomicAdd( &sample->density[i], densityBins[i] );
+	for (unsigned int i = threadIdx.x; i < ALIGNMENT_BINS; i += blockDim.x)
+		if (alignmentBins[i] > 0)
+			atomicAdd( &sample->alignment[i], alignmentBins[i] );
+	if (threadIdx.x == 0)
+	{
+		atomicAdd( &sample->nearestSum, sums[0] );
+		atomicAdd( &sample->alignmentSum, sums[1] );
+		atomicAdd( &sample->headingSum.x, sums[2] );
+		atomicAdd( &sample->headingSum.y, sums[3] );
+		atomicAdd( &sample->headingSum.z, sums[4] );
+		atomicAdd( &sample->sampled, counts[0] );
+		atomicAdd( &sample->aligned, counts[1] );
+		atomicAdd( &sample->headed, counts[2] );
+	}
+}
+
+/*!
+ * @brief Neutral element of the ensemble metrics reduction.
+ * @return partial summary without fishies.
+ */
+__device__ MetricsPartial d_emptyMetrics()
+{
+	MetricsPartial s;
+	s.sum = make_float3( 0.0f, 0.0f, 0.0f );
+	s.squared = 0.0f;
+	s.speed = 0.0f;
+	s.nearest = 0.0f;
+	s.nearestSquared = 0.0f;
+	s.nearestMin = FLT_MAX;
+	s.count = 0;
+	s.paired = 0;
+	return s;
+}
+
+/*!
+ * @brief Merge the partial summary b into a.
+ * @param a partial summary. Will be updated.
+ * @param b partial summary.
+ */
+__device__ void d_mergeMetrics( MetricsPartial& a, const MetricsPartial& b )
+{
+	a.sum = make_float3( a.sum.x + b.sum.x, a.sum.y + b.sum.y, a.sum.z + b.sum.z );
+	a.squared += b.squared;
+	a.speed += b.speed;
+	a.nearest += b.nearest;
+	a.nearestSquared += b.nearestSquared;
+	a.nearestMin = fminf( a.nearestMin, b.nearestMin );
+	a.count += b.count;
+	a.paired += b.paired;
+}
+
+/*!
+ * @brief Get the partial summary of the lane offset lanes above (__shfl_down_sync of every member).
+ * @param s partial summary of this lane.
+ * @param offset lane offset.
+ * @return partial summary of the other lane.
+ */
+__device__ MetricsPartial d_shuffleMetrics( const MetricsPartial& s, unsigned int offset )
+{
+	MetricsPartial o;
+	o.sum = make_float3(
+		__shfl_down_sync( FULL_WARP_MASK, s.sum.x, offset ),
+		__shfl_down_sync( FULL_WARP_MASK, s.sum.y, offset ),
+		__shfl_down_sync( FULL_WARP_MASK, s.sum.z, offset ) );
+	o.squared = __shfl_down_sync( FULL_WARP_MASK, s.squared, offset );
+	o.speed = __shfl_down_sync( FULL_WARP_MASK, s.speed, offset );
+	o.nearest = __shfl_down_sync( FULL_WARP_MASK, s.nearest, offset );
+	o.nearestSquared = __shfl_down_sync( FULL_WARP_MASK, s.nearestSquared, offset );
+	o.nearestMin = __shfl_down_sync( FULL_WARP_MASK, s.nearestMin, offset );
+	o.count = __shfl_down_sync( FULL_WARP_MASK, s.count, offset );
+	o.paired = __shfl_down_sync( FULL_WARP_MASK, s.paired, offset );
+	return o;
+}
+
+/*!
+ * @brief Reduce the partial summaries of all threads of a block, like d_blockReduceStats.
+ * Block size must be a multiple of WARP_SIZE. All threads of the block have to call it.
+ * @param s partial summary of this thread.
+ * @return summary of the whole block (valid in thread 0).
+ */
+__device__ MetricsPartial d_blockReduceMetrics( MetricsPartial s )
+{
+	__shared__ MetricsPartial warpMetrics[MAX_BLOCK_WARPS];
+
+	unsigned int lane = threadIdx.x % WARP_SIZE;
+	unsigned int warp = threadIdx.x / WARP_SIZE;
+
+	for (unsigned int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
+		d_mergeMetrics( s, d_shuffleMetrics( s, offset ) );
+
+	if (lane == 0)
+		warpMetrics[warp] = s;
+	__syncthreads();
+
+	if (warp != 0)
+		return s;
+
+	s = lane < blockDim.x / WARP_SIZE ? warpMetrics[lane] : d_emptyMetrics();
+	for (unsigned int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
+		d_mergeMetrics( s, d_shuffleMetrics( s, offset ) );
+	return s;
+}
+
+/*!
+ * @brief First pass of the ensemble metrics. Same grid as d_advance_ensemble: row blockIdx.y belongs to one member,
+ * every thread finds the closest fish of its fish with the tiled search over the member.
+ * Needs blockDim.x * sizeof(float4) dynamic shared memory.
+ * @param particles Fishies of all members (read only).
+ * @param members first slot (x) and number of fishies (y) per member.
+ * @param partials Output: partial summaries, gridDim.x per member.
+ */
+__global__ void d_reduceEnsembleMetrics(
+	ParticleArrays particles,
+	const uint2* __restrict__ members,
+	MetricsPartial* partials)
+{
+	uint2 member = members[blockIdx.y];
+	if (blockIdx.x * blockDim.x >= member.y)					// Whole block beyond this member, before any __syncthreads
+	{
+		if (threadIdx.x == 0)
+			partials[blockIdx.y * gridDim.x + blockIdx.x] = d_emptyMetrics();
+		return;
+	}
+
+	unsigned int local = blockIdx.x * blockDim.x + threadIdx.x;
+	bool valid = local < member.y;
+	unsigned int in_x = member.x + local;
+
+	ParticleArrays swarm = particles;
+	swarm.x += member.x;
+	swarm.y += member.x;
+	swarm.z += member.x;
+	swarm.alive += member.x;
+	DeviceVector vert = valid ? d_loadPosition( particles, in_x ) : DeviceVector();
+
+	DeviceVector closest;
+	float closest_dist;
+	d_tiledSearch<0>( swarm, member.y, vert, local, 0, &closest, &closest_dist );
+
+	MetricsPartial s = d_emptyMetrics();
+	if (valid && particles.alive[in_x])
+	{
+		s.sum = make_float3( vert.x, vert.y, vert.z );
+		s.squared = vert.length3Squared();
+		s.speed = DeviceVector( particles.vx[in_x], particles.vy[in_x], particles.vz[in_x] ).length3();
+		s.count = 1;
+		if (closest_dist < FLT_MAX)
+		{
+			s.nearest = closest_dist;
+			s.nearestSquared = closest_dist * closest_dist;
+			s.nearestMin = closest_dist;
+			s.paired = 1;
+		}
+	}
+
+	s = d_blockReduceMetrics( s );
+	if (threadIdx.x == 0)
+		partials[blockIdx.y * gridDim.x + blockIdx.x] = s;
+}
+
+/*!
+ * @brief Second pass of the ensemble metrics. Block m reduces the partial summaries of member m.
+ * @param partials partial summaries of the first pass, partial_count per member.
+ * @param partial_count Number of partial summaries per member.
+ * @param members first slot (x) and number of fishies (y) per member.
+ * @param metrics Output: summary per member.
+ */
+__global__ void d_finishEnsembleMetrics(
+	const MetricsPartial* __restrict__ partials,
+	unsigned int partial_count,
+	const uint2* __restrict__ members,
+	EnsembleMetrics* metrics)
+{
+	MetricsPartial s = d_emptyMetrics();
+	for (unsigned int i = threadIdx.x; i < partial_count; i += blockDim.x)
+		d_mergeMetrics( s, partials[blockIdx.x * partial_count + i] );
+
+	s = d_blockReduceMetrics( s );
+	if (threadIdx.x != 0)
+		return;
+
+	EnsembleMetrics result = {};
+	result.liveCount = s.count;
+	result.survival = members[blockIdx.x].y > 0 ? static_cast< float >( s.count ) / members[blockIdx.x].y : 0.0f;
+	if (s.count > 0)
+	{
+		float inv = 1.0f / s.count;
+		result.centroid = make_float3( s.sum.x * inv, s.sum.y * inv, s.sum.z * inv );
+		float centroid2 = result.centroid.x * result.centroid.x + result.centroid.y * result.centroid.y + result.centroid.z * result.centroid.z;
+		result.cohesion = sqrtf( fmaxf( s.squared * inv - centroid2, 0.0f ) );
+		result.meanSpeed = s.speed * inv;
+	}
+	if (s.paired > 0)
+	{
+		float inv = 1.0f / s.paired;
+		result.nearestMean = s.nearest * inv;
+		result.nearestStdDev = sqrtf( fmaxf( s.nearestSquared * inv - result.nearestMean * result.nearestMean, 0.0f ) );
+		result.nearestMin = s.nearestMin;
+	}
+	metrics[blockIdx.x] = result;
+}
+
+/*!
+ * @brief Build the Verlet list of every fish from the 27 cells around it. One thread per fish in sorted order.
+ * If there are more candidates than VERLET_MAX_NEIGHBOURS, the closest ones are kept.
+ * @param sorted Particles sorted by cell (read only).
+ * @param gridParticleIndex Original fish index of each sorted fish.
+ * @param cellStart Index of first fish in cell.
+ * @param cellEnd Index after last fish in cell.
+ * @param mesh_count Number of fishies.
+ * @param grid Grid placement. Edge length of a cell must be >= radius.
+ * @param radius Candidates are collected inside this radius (fishDist + verletSkin).
+ * @param list Output: Candidate slots (original indices), entry k of fish i at k * mesh_count + i.
+ * @param count Output: Number of candidates per fish.
+ * @param ref Output: Position of each fish at the build.
+ */
+__global__ void d_buildVerlet(
+	ParticleArrays sorted,
+	const unsigned int* __restrict__ gridParticleIndex,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	unsigned int mesh_count,
+	GridLayout grid,
+	float radius,
+	unsigned int* list,
+	unsigned int* count,
+	float4* ref)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	DeviceVector vert = d_loadPosition( sorted, in_x );
+	unsigned int originalIndex = gridParticleIndex[in_x];
+	ref[originalIndex] = make_float4( vert.x, vert.y, vert.z, 1.0f );
+
+	if (!sorted.alive[in_x])
+	{
+		count[originalIndex] = 0;
+		return;
+	}
+
+	unsigned int candidates[VERLET_MAX_NEIGHBOURS];
+	float candidateDist2[VERLET_MAX_NEIGHBOURS];
+	unsigned int n = 0;
+
+	int3 cell = d_calcGridPos( vert, grid );
+	float radius2 = radius * radius;
+	for (int c = 0; c < 27; c++)
+	{
+		unsigned int hash = d_calcGridHash( make_int3( cell.x + c % 3 - 1, cell.y + c / 3 % 3 - 1, cell.z + c / 9 - 1 ), grid );
+		unsigned int start = cellStart[hash];
+
+		// cell is empty
+		if (start == EMPTY_CELL)
+			continue;
+
+		unsigned int end = cellEnd[hash];
+		for (unsigned int i = start; i < end; i++)
+		{
+			float d2 = ( vert - d_loadPosition( sorted, i ) ).length3Squared();
+			if (i == in_x || d2 >= radius2)
+				continue;
+
+			if (n < VERLET_MAX_NEIGHBOURS)
+			{
+				candidates[n] = gridParticleIndex[i];
+				candidateDist2[n] = d2;
+				n++;
+				continue;
+			}
+
+			// List is full: replace the farthest candidate.
+			unsigned int farthest = 0;
+			for (unsigned int k = 1; k < VERLET_MAX_NEIGHBOURS; k++)
+			{
+				if (candidateDist2[k] > candidateDist2[farthest])
+					farthest = k;
+			}
+			if (d2 < candidateDist2[farthest])
+			{
+				candidates[farthest] = gridParticleIndex[i];
+				candidateDist2[farthest] = d2;
+			}
+		}
+	}
+
+	for (unsigned int k = 0; k < n; k++)
+		list[k * mesh_count + originalIndex] = candidates[k];
+	count[originalIndex] = n;
+}
+
+/*!
+ * @brief Maximum displacement of the living fishies since the Verlet build and in the last step.
+ * Warp wide maximum, then one atomicMax per warp. Positive floats compare like their bits as unsigned int.
+ * @param in Particles before the step (read only).
+ * @param out Particles after the step (read only).
+ * @param ref Positions at the Verlet build.
+ * @param mesh_count Number of fishies.
+ * @param result Output: float bits of both maxima. Must be 0 before the launch.
+ */
+__global__ void d_verletDisplacement(
+	ParticleArrays in,
+	ParticleArrays out,
+	const float4* __restrict__ ref,
+	unsigned int mesh_count,
+	unsigned int* result)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+
+	// No early return, all lanes take part in the shuffles.
+	float displacement = 0.0f;
+	float step = 0.0f;
+	if (in_x < mesh_count && out.alive[in_x])
+	{
+		DeviceVector vert = d_loadPosition( out, in_x );
+		displacement = ( vert - DeviceVector( ref[in_x] ) ).length3();
+		step = ( vert - d_loadPosition( in, in_x ) ).length3();
+	}
+
+	for (unsigned int offset = WARP_SIZE / 2; offset > 0; offset /= 2)
+	{
+		displacement = fmaxf( displacement, __shfl_down_sync( FULL_WARP_MASK, displacement, offset ) );
+		step = fmaxf( step, __shfl_down_sync( FULL_WARP_MASK, step, offset ) );
+	}
+
+	if (threadIdx.x % WARP_SIZE == 0)
+	{
+		atomicMax( &result[0], __float_as_uint( displacement ) );
+		atomicMax( &result[1], __float_as_uint( step ) );
+	}
+}
+
+/*!
+ * @brief Spread the lower 10 bits of v, so there are two zero bits between all of them.
+ * @param v value.
+ * @return spread bits.
+ */
+__device__ unsigned int d_expandBits( unsigned int v )
+{
+	v = ( v * 0x00010001u ) & 0xFF0000FFu;
+	v = ( v * 0x00000101u ) & 0x0F00F00Fu;
+	v = ( v * 0x00000011u ) & 0xC30C30C3u;
+	v = ( v * 0x00000005u ) & 0x49249249u;
+	return v;
+}
+
+/*!
+ * @brief 30 bit Morton code (Z-curve) of a position inside the box of the uniform grid.
+ * Positions outside of the box are clamped to its border.
+ * @param p position.
+ * @param grid grid placement.
+ * @return Morton code.
+ */
+__device__ unsigned int d_mortonCode( DeviceVector p, const GridLayout& grid )
+{
+	float x = ( p.x - grid.origin.x ) / ( grid.dims.x * grid.cellSize );
+	float y = ( p.y - grid.origin.y ) / ( grid.dims.y * grid.cellSize );
+	float z = ( p.z - grid.origin.z ) / ( grid.dims.z * grid.cellSize );
+
+	unsigned int ix = static_cast< unsigned int >( fminf( fmaxf( x * 1024.0f, 0.0f ), 1023.0f ) );
+	unsigned int iy = static_cast< unsigned int >( fminf( fmaxf( y * 1024.0f, 0.0f ), 1023.0f ) );
+	unsigned int iz = static_cast< unsigned int >( fminf( fmaxf( z * 1024.0f, 0.0f ), 1023.0f ) );
+	return ( d_expandBits( ix ) << 2 ) | ( d_expandBits( iy ) << 1 ) | d_expandBits( iz );
+}
+
+/*!
+ * @brief Calculate the Morton code of each fish. Dead fishies get the largest key, so they end up behind the living ones.
+ * @param mortonCodes Output: Morton code of each fish.
+ * @param indices Output: Index of each fish (sorted with the codes later).
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param grid Grid placement. Its box is divided into 1024 steps per axis.
+ */
+__global__ void d_calcMorton(
+	unsigned int* mortonCodes,
+	unsigned int* indices,
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	GridLayout grid)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	mortonCodes[in_x] = particles.alive[in_x] ? d_mortonCode( d_loadPosition( particles, in_x ), grid ) : 0xffffffff;
+	indices[in_x] = in_x;
+}
+
+/*!
+ * @brief Far field: fill the leaves of the BVH with the fishies in Morton order and clear the visits of the internal nodes.
+ * @param nodes Output: nodes of the tree, leaves from count - 1 on.
+ * @param visits Output: 0 per internal node.
+ * @param order Slot of each fish in Morton order.
+ * @param particles All fishies (read only).
+ * @param count Number of fishies.
+ */
+__global__ void d_bvhLeaves(
+	BvhNode* nodes,
+	unsigned int* visits,
+	const unsigned int* __restrict__ order,
+	ParticleArrays particles,
+	unsigned int count)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= count)
+		return;
+
+	unsigned int fish = order[in_x];
+	DeviceVector vert = d_loadPosition( particles, fish );
+	DeviceVector state = d_loadState( particles, fish );
+	float mass = particles.alive[fish] ? state.w : 0.0f;
+
+	BvhNode leaf;
+	leaf.center = make_float4( vert.x, vert.y, vert.z, mass );
+	leaf.velocity = make_float4( state.x * mass, state.y * mass, state.z * mass, 0.0f );
+	leaf.boxMin = mass > 0.0f ? make_float4( vert.x, vert.y, vert.z, 0.0f ) : make_float4( FLT_MAX, FLT_MAX, FLT_MAX, 0.0f );
+	leaf.boxMax = mass > 0.0f ? make_float4( vert.x, vert.y, vert.z, 0.0f ) : make_float4( -FLT_MAX, -FLT_MAX, -FLT_MAX, 0.0f );
+	leaf.children = make_int2( -1, -1 );
+	leaf.parent = -1;											// Set by d_bvhInternal, if there is more than one fish
+	leaf.fish = fish;
+	nodes[count - 1 + in_x] = leaf;
+	if (in_x + 1 < count)
+		visits[in_x] = 0;
+}
+
+/*!
+ * @brief Length of the common prefix of the keys of two leaves (Karras). Equal Morton codes are told apart by the index.
+ * @param codes Sorted Morton codes.
+ * @param count Number of fishies.
+ * @param i first leaf.
+ * @param j second leaf.
+ * @return prefix length in bits, -1 if j is out of range.
+ */
+__device__ int d_bvhPrefix( const unsigned int* __restrict__ codes, unsigned int count, int i, int j )
+{
+	if (j < 0 || j >= static_cast< int >( count ))
+		return -1;
+
+	unsigned int a = codes[i];
+	unsigned int b = codes[j];
+	return a == b ? 32 + __clz( i ^ j ) : __clz( a ^ b );
+}
+
+/*!
+ * @brief Far field: build the internal nodes of the BVH in parallel (Karras, "Maximizing parallelism in the construction
+ * of BVHs, octrees, and k-d trees"). Internal node i finds the range of leaves it covers from the common prefixes
+ * of its neighbours, splits it where the prefix gets longer and links both children.
+ * @param nodes Nodes of the tree. Children and parents are written.
+ * @param codes Sorted Morton codes.
+ * @param count Number of fishies, at least 2.
+ */
+__global__ void d_bvhInternal(
+	BvhNode* nodes,
+	const unsigned int* __restrict__ codes,
+	unsigned int count)
+{
+	int i = blockIdx.x * blockDim.x + threadIdx.x;
+	if (i + 1 >= static_cast< int >( count ))
+		return;
+
+	// Direction of the range: towards the neighbour with the longer prefix.
+	int d = d_bvhPrefix( codes, count, i, i + 1 ) > d_bvhPrefix( codes, count, i, i - 1 ) ? 1 : -1;
+	int minPrefix = d_bvhPrefix( codes, count, i, i - d );
+
+	// Other end of the range: exponential, then binary search.
+	int maxLength = 2;
+	while (d_bvhPrefix( codes, count, i, i + maxLength * d ) > minPrefix)
+		maxLength *= 2;
+	int length = 0;
+	for (int t = maxLength / 2; t >= 1; t /= 2)
+	{
+		if (d_bvhPrefix( codes, count, i, i + ( length + t ) * d ) > minPrefix)
+			length += t;
+	}
+	int j = i + length * d;
+
+	// Split: the last leaf that shares more than the prefix of the whole range with i.
+	int nodePrefix = d_bvhPrefix( codes, count, i, j );
+	int split = 0;
+	for (int t = ( length + 1 ) / 2; ; t = ( t + 1 ) / 2)
+	{
+		if (d_bvhPrefix( codes, count, i, i + ( split + t ) * d ) > nodePrefix)
+			split += t;
+		if (t == 1)
+			break;
+	}
+	int gamma = i + split * d + min( d, 0 );
+
+	int leaves = static_cast< int >( count ) - 1;
+	int left = min( i, j ) == gamma ? leaves + gamma : gamma;
+	int right = max( i, j ) == gamma + 1 ? leaves + gamma + 1 : gamma + 1;
+	nodes[i].children = make_int2( left, right );
+	nodes[left].parent = i;
+	nodes[right].parent = i;
+	if (i == 0)
+		nodes[0].parent = -1;
+}
+
+/*!
+ * @brief Load a node written by another block of the running kernel, past the incoherent L1 cache.
+ * @param nodes Nodes of the tree.
+ * @param i node.
+ * @return center, velocity and box of the node.
+ */
+__device__ BvhNode d_loadBvhNode( const BvhNode* nodes, int i )
+{
+	BvhNode node;
+	node.center = __ldcg( &nodes[i].center );
+	node.velocity = __ldcg( &nodes[i].velocity );
+	node.boxMin = __ldcg( &nodes[i].boxMin );
+	node.boxMax = __ldcg( &nodes[i].boxMax );
+	return node;
+}
+
+/*!
+ * @brief Far field: sum the fishies of the BVH bottom up. Every leaf walks to the root, the first child to arrive at a node stops,
+ * the second one merges both children (mass, mass weighted center and speed, box) and goes on. Every node is merged once.
+ * @param nodes Nodes of the tree.
+ * @param visits Arrivals per internal node, 0 before the launch.
+ * @param count Number of fishies.
+ */
+__global__ void d_bvhMerge(
+	BvhNode* nodes,
+	unsigned int* visits,
+	unsigned int count)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= count)
+		return;
+
+	int node = nodes[count - 1 + in_x].parent;
+	while (node >= 0)
+	{
+		__threadfence();										// Children written before the arrival is counted
+		if (atomicAdd( &visits[node], 1 ) == 0)
+			return;
+
+		int2 children = nodes[node].children;
+		BvhNode a = d_loadBvhNode( nodes, children.x );
+		BvhNode b = d_loadBvhNode( nodes, children.y );
+		float mass = a.center.w + b.center.w;
+		float inv = mass > 0.0f ? 1.0f / mass : 0.0f;
+		float4 boxMin = make_float4( fminf( a.boxMin.x, b.boxMin.x ), fminf( a.boxMin.y, b.boxMin.y ), fminf( a.boxMin.z, b.boxMin.z ), 0.0f );
+		float4 boxMax = make_float4( fmaxf( a.boxMax.x, b.boxMax.x ), fmaxf( a.boxMax.y, b.boxMax.y ), fmaxf( a.boxMax.z, b.boxMax.z ), 0.0f );
+		float edge = mass > 0.0f ? fmaxf( boxMax.x - boxMin.x, fmaxf( boxMax.y - boxMin.y, boxMax.z - boxMin.z ) ) : 0.0f;
+
+		nodes[node].center = make_float4(
+			( a.center.x * a.center.w + b.center.x * b.center.w ) * inv,
+			( a.center.y * a.center.w + b.center.y * b.center.w ) * inv,
+			( a.center.z * a.center.w + b.center.z * b.center.w ) * inv,
+			mass );
+		nodes[node].velocity = make_float4( a.velocity.x + b.velocity.x, a.velocity.y + b.velocity.y, a.velocity.z + b.velocity.z, edge );
+		nodes[node].boxMin = boxMin;
+		nodes[node].boxMax = boxMax;
+		node = nodes[node].parent;
+	}
+}
+
+/*!
+ * @brief Gather all fishies in a new order, including their ids.
+ * @param in All fishies (read only).
+ * @param out Output: out[i] = in[indices[i]].
+ * @param indices New order.
+ * @param mesh_count Number of fishies.
+ */
+__global__ void d_permute(
+	ParticleArrays in,
+	ParticleArrays out,
+	const unsigned int* __restrict__ indices,
+	unsigned int mesh_count)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	unsigned int from = indices[in_x];
+	d_storeParticle( out, in_x, d_loadPosition( in, from ), d_loadState( in, from ), in.alive[from] );
+	out.id[in_x] = in.id[from];
+}
+
+/*!
+ * @brief Append a fish to a slab list. Counts past the capacity, so the host sees the overflow.
+ * @param lists Slab lists, list l starts at l * capacity.
+ * @param capacity Length of a list.
+ * @param counts Number of fishies per list.
+ * @param list SlabList.
+ * @param index Slot of the fish.
+ */
+__device__ void d_pushSlab( unsigned int* lists, unsigned int capacity, unsigned int* counts, int list, unsigned int index )
+{
+	unsigned int position = atomicAdd( &counts[list], 1u );
+	if (position < capacity)
+		lists[list * capacity + position] = index;
+}
+
+/*!
+ * @brief Sort the living fishies of a slab into the lists of kernel_partition_slab. Eaten fishies are dropped.
+ * @param particles Owned fishies of the slab (read only).
+ * @param mesh_count Number of owned fishies.
+ * @param slab Bounds of the slab on the x axis.
+ * @param lists Output: Slots per list, list l starts at l * capacity.
+ * @param capacity Length of a list.
+ * @param counts Output: Number of fishies per list. Must be zero before.
+ */
+__global__ void d_partitionSlab(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	SlabBounds slab,
+	unsigned int* lists,
+	unsigned int capacity,
+	unsigned int* counts)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count || !particles.alive[in_x])
+		return;
+
+	float x = particles.x[in_x];
+	if (x < slab.lower)
+	{
+		d_pushSlab( lists, capacity, counts, SLAB_TO_LOWER, in_x );
+		if (x >= slab.lower - slab.halo)									// Still a neighbour of our fishies
+			d_pushSlab( lists, capacity, counts, SLAB_HALO_SELF, in_x );
+	}
+	else if (x >= slab.upper)
+	{
+		d_pushSlab( lists, capacity, counts, SLAB_TO_UPPER, in_x );
+		if (x < slab.upper + slab.halo)
+			d_pushSlab( lists, capacity, counts, SLAB_HALO_SELF, in_x );
+	}
+	else
+	{
+		d_pushSlab( lists, capacity, counts, SLAB_KEEP, in_x );
+		if (x < slab.lower + slab.halo)
+			d_pushSlab( lists, capacity, counts, SLAB_HALO_LOWER, in_x );
+		if (x >= slab.upper - slab.halo)
+			d_pushSlab( lists, capacity, counts, SLAB_HALO_UPPER, in_x );
+	}
+}
+
+/*!
+ * @brief Write the color of every fish into the color VBO, after fishies were moved to other slots.
+ * @param ids Stable id of each fish.
+ * @param colors Colors by id.
+ * @param out Output: Colors by slot for the VBO.
+ * @param mesh_count Number of fishies.
+ * @param schools 0: colors by id. Otherwise a hue per school, around the color wheel.
+ */
+__global__ void d_packColors(
+	const unsigned int* __restrict__ ids,
+	const uchar4* __restrict__ colors,
+	uchar4* out,
+	unsigned int mesh_count,
+	unsigned int schools)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	if ( schools == 0 )
+	{
+		out[in_x] = colors[ids[in_x]];
+		return;
+	}
+	float hue = 6.0f * ( ids[in_x] % schools ) / schools;						// Sector of the color wheel, full saturation and value
+	float r = fminf( fmaxf( fabsf( hue - 3.0f ) - 1.0f, 0.0f ), 1.0f );
+	float g = fminf( fmaxf( 2.0f - fabsf( hue - 2.0f ), 0.0f ), 1.0f );
+	float b = fminf( fmaxf( 2.0f - fabsf( hue - 4.0f ), 0.0f ), 1.0f );
+	out[in_x] = make_uchar4( static_cast< unsigned char >( r * 255.0f ), static_cast< unsigned char >( g * 255.0f ),
+		static_cast< unsigned char >( b * 255.0f ), 255 );
+}
+
+/*!
+ * @brief Depth sort: sort key of every fish by its view depth, farthest or closest first. The slot is the value.
+ * Keys are the float depth bits made unsigned-sortable, so the radix sort is exact. Eaten fishies get key 0 (drawn first, they are discarded),
+ * front to back ~0 (drawn last).
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param depthRow Row of the view * model matrix which gives the view space z.
+ * @param keys Output: Sort key per slot.
+ * @param indices Output: Slot per slot.
+ * @param frontToBack true: closest first.
+ */
+__global__ void d_depthKeys(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	float4 depthRow,
+	unsigned int* keys,
+	unsigned int* indices,
+	bool frontToBack)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	unsigned int key = frontToBack ? 0xFFFFFFFFu : 0u;
+	if (particles.alive[in_x])
+	{
+		float z = depthRow.x * particles.x[in_x] + depthRow.y * particles.y[in_x] + depthRow.z * particles.z[in_x] + depthRow.w;	// Negative in front of the camera
+		unsigned int bits = __float_as_uint( z );
+		key = ( bits & 0x80000000u ) ? ~bits : bits | 0x80000000u;				// Ascending keys: most negative z (farthest) first
+		if (frontToBack)
+			key = ~key;															// Closest first
+		key = min( max( key, 1u ), 0xFFFFFFFEu );								// 0 and ~0 are reserved for eaten fishies
+	}
+	keys[in_x] = key;
+	indices[in_x] = in_x;
+}
+
+/*!
+ * @brief Density map: count every living fish in its texel of the x/z plane over the box of the uniform grid.
+ * Fishies outside of the box are counted at its border.
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param grid grid placement, gives the box.
+ * @param density Output: Fishies per texel (z * DENSITY_SIZE + x). Must be 0 before.
+ */
+__global__ void d_splatDensity(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	GridLayout grid,
+	unsigned int* density)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count || !particles.alive[in_x])
+		return;
+
+	float texels = static_cast< float >( DENSITY_SIZE );
+	int u = static_cast< int >( ( particles.x[in_x] - grid.origin.x ) / ( grid.dims.x * grid.cellSize ) * texels );
+	int v = static_cast< int >( ( particles.z[in_x] - grid.origin.z ) / ( grid.dims.z * grid.cellSize ) * texels );
+	u = min( max( u, 0 ), static_cast< int >( DENSITY_SIZE ) - 1 );
+	v = min( max( v, 0 ), static_cast< int >( DENSITY_SIZE ) - 1 );
+	atomicAdd( &density[v * DENSITY_SIZE + u], 1u );
+}
+
+/*!
+ * @brief Density map: write one point per texel on the floor of the grid box, colored by a heat ramp.
+ * Log scale relative to an even distribution, so sparse and dense scenes both use the whole ramp. Empty texels are discarded.
+ * @param density Fishies per texel of d_splatDensity.
+ * @param mesh_count Number of fishies.
+ * @param grid grid placement, gives the box.
+ * @param verts Output: Position per texel, w < 0: empty.
+ * @param colors Output: Heat color per texel.
+ */
+__global__ void d_shadeDensity(
+	const unsigned int* __restrict__ density,
+	unsigned int mesh_count,
+	GridLayout grid,
+	float4* verts,
+	uchar4* colors)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= DENSITY_SIZE * DENSITY_SIZE)
+		return;
+
+	unsigned int count = density[in_x];
+	float texel = grid.cellSize / DENSITY_SIZE;
+	verts[in_x] = make_float4(
+		grid.origin.x + ( in_x % DENSITY_SIZE + 0.5f ) * grid.dims.x * texel,
+		grid.origin.y,
+		grid.origin.z + ( in_x / DENSITY_SIZE + 0.5f ) * grid.dims.z * texel,
+		count > 0 ? 1.0f : -1.0f );
+
+	float even = fmaxf( static_cast< float >( mesh_count ) / ( DENSITY_SIZE * DENSITY_SIZE ), 1.0f );
+	float t = fminf( log2f( 1.0f + count / even ) / 5.0f, 1.0f );				// 31 times the even density is full red
+	float r = fminf( fmaxf( 2.0f * t - 0.5f, 0.0f ), 1.0f );					// Blue, cyan, yellow, red
+	float g = fminf( 2.0f * t, 2.0f - 2.0f * t );
+	float b = fmaxf( 1.0f - 2.0f * t, 0.0f );
+	colors[in_x] = make_uchar4(
+		static_cast< unsigned char >( 255.0f * r ),
+		static_cast< unsigned char >( 255.0f * g ),
+		static_cast< unsigned char >( 255.0f * b ),
+		160 );
+}
+
+/*!
+ * @brief Trails: write the position of every living fish into entry head of its ring buffer, see kernel_append_trail.
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param x Output: x of the trails, entry * fishies + id.
+ * @param y Output: y of the trails.
+ * @param z Output: z of the trails.
+ * @param fishies Number of fish ids.
+ * @param length Entries per trail.
+ * @param head Entry written now.
+ * @param maxJump Longer distances to the last entry are respawns.
+ */
+__global__ void d_appendTrail(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	__half* x,
+	__half* y,
+	__half* z,
+	unsigned int fishies,
+	unsigned int length,
+	unsigned int head,
+	float maxJump)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count || !particles.alive[in_x])							// Dead: entry head stays NaN
+		return;
+
+	unsigned int id = particles.id[in_x];
+	float px = particles.x[in_x], py = particles.y[in_x], pz = particles.z[in_x];
+	size_t last = static_cast< size_t >( ( head + length - 1 ) % length ) * fishies + id;
+	float dx = px - __half2float( x[last] ), dy = py - __half2float( y[last] ), dz = pz - __half2float( z[last] );
+	float jump = dx * dx + dy * dy + dz * dz;
+
+	__half hx = __float2half( px ), hy = __float2half( py ), hz = __float2half( pz );
+	if ( !( jump <= maxJump * maxJump ) )										// NaN or far away: (re)spawned
+	{
+		for ( unsigned int k = 0; k < length; k++ )
+		{
+			size_t entry = static_cast< size_t >( k ) * fishies + id;
+			x[entry] = hx;
+			y[entry] = hy;
+			z[entry] = hz;
+		}
+		return;
+	}
+
+	size_t entry = static_cast< size_t >( head ) * fishies + id;
+	x[entry] = hx;
+	y[entry] = hy;
+	z[entry] = hz;
+}
+
+/*!
+ * @brief Smooth value noise: random values on the integer lattice, interpolated with smoothstep weights.
+ * @param x, y, z position in lattice units.
+ * @param seed decorrelates the noises of the three components.
+ * @return value in [-1, 1].
+ */
+__device__ float d_valueNoise( float x, float y, float z, unsigned int seed )
+{
+	float fx = floorf( x ), fy = floorf( y ), fz = floorf( z );
+	float tx = x - fx, ty = y - fy, tz = z - fz;
+	tx = tx * tx * ( 3.0f - 2.0f * tx );
+	ty = ty * ty * ( 3.0f - 2.0f * ty );
+	tz = tz * tz * ( 3.0f - 2.0f * tz );
+	int ix = static_cast< int >( fx ), iy = static_cast< int >( fy ), iz = static_cast< int >( fz );
+
+	float corner[8];
+	for (int c = 0; c < 8; c++)
+	{
+		// Integer hash of the lattice point (lowbias32)
+		unsigned int h = static_cast< unsigned int >( ix + ( c & 1 ) ) * 0x8da6b343u
+			^ static_cast< unsigned int >( iy + ( ( c >> 1 ) & 1 ) ) * 0xd8163841u
+			^ static_cast< unsigned int >( iz + ( c >> 2 ) ) * 0xcb1ab31fu ^ seed * 0x9e3779b9u;
+		h ^= h >> 16; h *= 0x7feb352du; h ^= h >> 15; h *= 0x846ca68bu; h ^= h >> 16;
+		corner[c] = h * ( 2.0f / 4294967295.0f ) - 1.0f;
+	}
+	float x00 = corner[0] + ( corner[1] - corner[0] ) * tx, x10 = corner[2] + ( corner[3] - corner[2] ) * tx;
+	float x01 = corner[4] + ( corner[5] - corner[4] ) * tx, x11 = corner[6] + ( corner[7] - corner[6] ) * tx;
+	float y0 = x00 + ( x10 - x00 ) * ty, y1 = x01 + ( x11 - x01 ) * ty;
+	return y0 + ( y1 - y0 ) * tz;
+}
+
+/*!
+ * @brief Vector potential of the curl noise: one value noise per component, drifting with the time.
+ * @param x, y, z position in lattice units.
+ * @param time time slice.
+ * @return potential.
+ */
+__device__ float3 d_potential( float x, float y, float z, float time )
+{
+	return make_float3(
+		d_valueNoise( x + 0.50f * time, y, z, 0 ),
+		d_valueNoise( x, y + 0.50f * time, z, 1 ),
+		d_valueNoise( x, y, z + 0.50f * time, 2 ) );
+}
+
+/*!
+ * @brief Current: write one time slice of curl noise into a slot, see kernel_set_current.
+ * The curl of a potential has no divergence, so the fishies are not gathered in sinks or pushed apart by sources.
+ * @param slice Output: surface of the slot, half4 texels (velocity x, y, z).
+ * @param size Texels along x, y and z.
+ * @param origin Position of the first texel.
+ * @param cellSize Distance between two texels.
+ * @param scale Lattice units per distance.
+ * @param time Time slice.
+ */
+__global__ void d_curlNoise(
+	cudaSurfaceObject_t slice,
+	uint3 size,
+	float4 origin,
+	float cellSize,
+	float scale,
+	float time)
+{
+	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (index >= size.x * size.y * size.z)
+		return;
+
+	unsigned int i = index % size.x;
+	unsigned int j = ( index / size.x ) % size.y;
+	unsigned int k = index / ( size.x * size.y );
+	float x = ( origin.x + i * cellSize ) * scale;
+	float y = ( origin.y + j * cellSize ) * scale;
+	float z = ( origin.z + k * cellSize ) * scale;
+
+	// Central differences in lattice units, so the velocities are about 1 for every scale.
+	const float e = 0.25f;
+	float3 px0 = d_potential( x - e, y, z, time ), px1 = d_potential( x + e, y, z, time );
+	float3 py0 = d_potential( x, y - e, z, time ), py1 = d_potential( x, y + e, z, time );
+	float3 pz0 = d_potential( x, y, z - e, time ), pz1 = d_potential( x, y, z + e, time );
+	float vx = ( ( py1.z - py0.z ) - ( pz1.y - pz0.y ) ) / ( 2.0f * e );
+	float vy = ( ( pz1.x - pz0.x ) - ( px1.z - px0.z ) ) / ( 2.0f * e );
+	float vz = ( ( px1.y - px0.y ) - ( py1.x - py0.x ) ) / ( 2.0f * e );
+
+	ushort4 texel = make_ushort4( __half_as_ushort( __float2half( vx ) ), __half_as_ushort( __float2half( vy ) ), __half_as_ushort( __float2half( vz ) ), 0 );
+	surf3Dwrite( texel, slice, i * sizeof( ushort4 ), j, k );
+}
+
+/*!
+ * @brief Attractors: sum the field of all attractors at one texel, see kernel_set_attractors. Every block walks the attractors
+ * in tiles of ATTRACTOR_THREADS through shared memory. A pull points to the center and is strength * ATTRACTOR_PEAK * q (1 - q^2)
+ * at q = distance / radius, 0 at the center and from the radius on; the potential is strength * (1 - q^2)^2.
+ * @param volume Output: surface of the field, float4 texels (acceleration x, y, z and potential).
+ * @param size Texels along x, y and z.
+ * @param origin Position of the first texel.
+ * @param cellSize Distance between two texels.
+ * @param attractors Attractors.
+ * @param count Number of attractors.
+ */
+__global__ void d_bakeAttractors(
+	cudaSurfaceObject_t volume,
+	uint3 size,
+	float4 origin,
+	float cellSize,
+	const AttractorSource* attractors,
+	unsigned int count)
+{
+	__shared__ AttractorSource tile[ATTRACTOR_THREADS];
+
+	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
+	unsigned int i = index % size.x;
+	unsigned int j = ( index / size.x ) % size.y;
+	unsigned int k = index / ( size.x * size.y );
+	float x = origin.x + i * cellSize;
+	float y = origin.y + j * cellSize;
+	float z = origin.z + k * cellSize;
+
+	float4 field = make_float4( 0.0f, 0.0f, 0.0f, 0.0f );
+	for (unsigned int first = 0; first < count; first += ATTRACTOR_THREADS)	// All threads load the tiles, also the ones past the texels
+	{
+		__syncthreads();
+		if (first + threadIdx.x < count)
+			tile[threadIdx.x] = attractors[first + threadIdx.x];
+		__syncthreads();
+
+		unsigned int tileCount = min( count - first, ATTRACTOR_THREADS );
+		for (unsigned int a = 0; a < tileCount; a++)
+		{
+			float4 center = tile[a].center;
+			float dx = center.x - x, dy = center.y - y, dz = center.z - z;
+			float q2 = ( dx * dx + dy * dy + dz * dz ) * center.w * center.w;
+			if (q2 >= 1.0f)
+				continue;
+			float t = 1.0f - q2;
+			float pull = tile[a].strength * ATTRACTOR_PEAK * center.w * t;
+			field.x += dx * pull;
+			field.y += dy * pull;
+			field.z += dz * pull;
+			field.w += tile[a].strength * t * t;
+		}
+	}
+
+	if (index < size.x * size.y * size.z)
+		surf3Dwrite( field, volume, i * sizeof( float4 ), j, k );
+}
+
+/*!
+ * @brief Free the attractor field of this context.
+ */
+static void releaseAttractors()
+{
+	if (d_attractorVolume != 0)
+		CUDA_CHECK( cudaDestroyTextureObject( d_attractorVolume ) );
+	if (d_attractorSurface != 0)
+		CUDA_CHECK( cudaDestroySurfaceObject( d_attractorSurface ) );
+	if (d_attractorArray != NULL)
+		CUDA_CHECK( cudaFreeArray( d_attractorArray ) );
+	delete d_attractorSources;
+	d_attractorVolume = 0;
+	d_attractorSurface = 0;
+	d_attractorArray = NULL;
+	d_attractorSources = NULL;
+}
+
+/*!
+ * @brief Alarm: spread and decay the alarm by one step and add the deposits of the last step, see kernel_set_alarm.
+ * One thread per cell, a 7 point stencil from levels[step & 1] into the other level. The border reflects, no alarm flows out.
+ * @param cells Cells of the field.
+ */
+__global__ void d_diffuseAlarm( unsigned int cells )
+{
+	unsigned int index = blockIdx.x * blockDim.x + threadIdx.x;
+	if (index >= cells)
+		return;
+
+	int3 dims = c_alarm.dims;
+	int3 cell = make_int3( index % dims.x, ( index / dims.x ) % dims.y, index / ( dims.x * dims.y ) );
+	unsigned int from = c_step.random.step & 1;
+	const float* __restrict__ level = c_alarm.levels[from];
+	float here = level[index];
+	float around = level[d_alarmIndex( make_int3( min( cell.x + 1, dims.x - 1 ), cell.y, cell.z ) )]
+		+ level[d_alarmIndex( make_int3( max( cell.x - 1, 0 ), cell.y, cell.z ) )]
+		+ level[d_alarmIndex( make_int3( cell.x, min( cell.y + 1, dims.y - 1 ), cell.z ) )]
+		+ level[d_alarmIndex( make_int3( cell.x, max( cell.y - 1, 0 ), cell.z ) )]
+		+ level[d_alarmIndex( make_int3( cell.x, cell.y, min( cell.z + 1, dims.z - 1 ) ) )]
+		+ level[d_alarmIndex( make_int3( cell.x, cell.y, max( cell.z - 1, 0 ) ) )];
+	c_alarm.levels[from ^ 1][index] = c_alarm.decay * ( here + ALARM_DIFFUSION * ( around - 6.0f * here ) ) + c_alarm.deposits[index];
+	c_alarm.deposits[index] = 0.0f;
+}
+
+static const unsigned int CLUSTER_LEVELS = 8;					// Cluster impostors: the cell doubles with every doubling of the distance, up to 128 base cells.
+static const int CLUSTER_KEY_BIAS = 1 << 18;					// Cluster impostors: 19 bits per axis and 3 bits of level in a key.
+
+/*!
+ * @brief Aggregate table of the cluster impostors, filled by d_cull and turned into impostors by d_clusterImpostors.
+ */
+struct ClusterTable
+{
+	unsigned long long* keys;	//!< Key of the cell per slot (d_clusterKey), EMPTY_KEY for free slots. NULL: no clusters.
+	float4* sums;				//!< Per slot: sum of the offsets into the cell (x, y, z) and number of fishies (w).
+	float4* moments;			//!< Per slot: sum of the squared offsets (x) and of the colors (y, z, w).
+};
+
+/*!
+ * @brief Key of a cluster cell: 19 bits per axis around the origin and the level in the bits above. Never EMPTY_KEY.
+ * @param cell cell coordinates in cells of the level.
+ * @param level cell size is the base cell times 2^level.
+ * @return key.
+ */
+__device__ unsigned long long d_clusterKey( int3 cell, int level )
+{
+	unsigned long long x = static_cast< unsigned int >( cell.x + CLUSTER_KEY_BIAS ) & 0x7ffffu;
+	unsigned long long y = static_cast< unsigned int >( cell.y + CLUSTER_KEY_BIAS ) & 0x7ffffu;
+	unsigned long long z = static_cast< unsigned int >( cell.z + CLUSTER_KEY_BIAS ) & 0x7ffffu;
+	return x | ( y << 19 ) | ( z << 38 ) | ( static_cast< unsigned long long >( level ) << 57 );
+}
+
+/*!
+ * @brief Add a far fish to the aggregate of its cluster cell. The cells are an octree cut by distance: the edge doubles with
+ * every doubling of the distance beyond params.clusterDistance, so a cluster covers about the same part of the screen.
+ * Offsets into the cell keep the sums small, far from the origin too.
+ * @param x, y, z position.
+ * @param distance distance to the camera, more than params.clusterDistance.
+ * @param color color of the fish.
+ * @param params Camera.
+ * @param clusters Aggregate table.
+ * @return false, if the table is full. The fish is drawn as point then.
+ */
+__device__ bool d_addToCluster( float x, float y, float z, float distance, uchar4 color, const CullParams& params, const ClusterTable& clusters )
+{
+	int level = min( static_cast< int >( log2f( distance / params.clusterDistance ) ), static_cast< int >( CLUSTER_LEVELS ) - 1 );
+	float size = params.clusterCellSize * static_cast< float >( 1 << level );
+	int3 cell = make_int3( floorf( x / size ), floorf( y / size ), floorf( z / size ) );
+	unsigned int slot = d_probeKey( d_clusterKey( cell, level ), clusters.keys, CULL_CLUSTER_SLOTS - 1, true );
+	if (slot >= CULL_CLUSTER_SLOTS)
+		return false;
+
+	float ox = x - cell.x * size, oy = y - cell.y * size, oz = z - cell.z * size;
+	atomicAdd( &clusters.sums[slot].x, ox );
+	atomicAdd( &clusters.sums[slot].y, oy );
+	atomicAdd( &clusters.sums[slot].z, oz );
+	atomicAdd( &clusters.sums[slot].w, 1.0f );
+	atomicAdd( &clusters.moments[slot].x, ox * ox + oy * oy + oz * oz );
+	atomicAdd( &clusters.moments[slot].y, static_cast< float >( color.x ) );
+	atomicAdd( &clusters.moments[slot].z, static_cast< float >( color.y ) );
+	atomicAdd( &clusters.moments[slot].w, static_cast< float >( color.z ) );
+	return true;
+}
+
+/*!
+ * @brief First slot of the range of a school in the outputs of d_cull. School s has the ids s, s + schools, ... below capacity.
+ * @param school school, schools for the end of the last range.
+ * @param schools number of schools.
+ * @param capacity Slots of the outputs.
+ * @return slot.
+ */
+__device__ unsigned int d_cullRange( unsigned int school, unsigned int schools, unsigned int capacity )
+{
+	return school * ( capacity / schools ) + min( school, capacity % schools );
+}
+
+/*!
+ * @brief Culling pass: test every living fish against the view frustum and append the visible ones to the mesh or the point tier
+ * of its school. Fishies beyond params.clusterDistance go into the aggregates of their cluster cell instead, see d_addToCluster.
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param colors Colors by id.
+ * @param params Camera.
+ * @param verts Output: Positions. Meshes from the start of the range of the school up, points from its end down.
+ * @param directions Output: Unit velocity and speed of the mesh fishies. NULL: every fish is a point.
+ * @param out_colors Output: Colors in the slots of verts.
+ * @param capacity Slots of the outputs.
+ * @param schools Schools with ranges of their own (id % schools).
+ * @param counts Output: Number of mesh fishies [school] and point fishies [schools + school]. Must be 0 before.
+ * @param clusters Aggregate table, empty before. keys NULL: no clusters.
+ */
+__global__ void d_cull(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	const uchar4* __restrict__ colors,
+	CullParams params,
+	float4* verts,
+	float4* directions,
+	uchar4* out_colors,
+	unsigned int capacity,
+	unsigned int schools,
+	unsigned int* counts,
+	ClusterTable clusters)
+{
+	unsigned int in_x = blockIdx.x * blockDim.x + threadIdx.x;
+	if (in_x >= mesh_count || !particles.alive[in_x])
+		return;
+
+	float x = particles.x[in_x], y = particles.y[in_x], z = particles.z[in_x];
+	for (int i = 0; i < 6; i++)
+	{
+		const float* plane = params.planes[i];
+		if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < -params.radius)	// Bounding sphere completely outside
+			return;
+	}
+
+	float dx = x - params.eyeX, dy = y - params.eyeY, dz = z - params.eyeZ;
+	float distance2 = dx * dx + dy * dy + dz * dz;
+	if (clusters.keys != NULL && distance2 > params.clusterDistance * params.clusterDistance
+		&& d_addToCluster( x, y, z, sqrtf( distance2 ), colors[particles.id[in_x]], params, clusters ))
+		return;
+	bool mesh = directions != NULL && distance2 < params.lodDistance * params.lodDistance;
+	unsigned int id = particles.id[in_x];
+	unsigned int school = schools > 1 ? id % schools : 0;
+
+	unsigned int slot;
+	if (mesh)
+	{
+		slot = d_cullRange( school, schools, capacity ) + atomicAdd( &counts[school], 1u );
+		float vx = particles.vx[in_x], vy = particles.vy[in_x], vz = particles.vz[in_x];
+		float speed = sqrtf( vx * vx + vy * vy + vz * vz );
+		directions[slot] = speed > 1e-12f
+			? make_float4( vx / speed, vy / speed, vz / speed, speed )
+			: make_float4( 1.0f, 0.0f, 0.0f, 0.0f );
+	}
+	else
+	{
+		slot = d_cullRange( school + 1, schools, capacity ) - 1 - atomicAdd( &counts[schools + school], 1u );	// Mesh and point fishies of a school together are at most its range
+	}
+	verts[slot] = make_float4( x, y, z, 1.0f );
+	out_colors[slot] = colors[id];
+}
+
+/*!
+ * @brief Turn the aggregates of d_cull into cluster impostors: one splat per occupied cell at the centroid, with the size
+ * of the spread of its fishies and their mean color. One thread per slot.
+ * @param clusters Aggregate table.
+ * @param cellSize Edge of a cluster cell of level 0 (CullParams::clusterCellSize).
+ * @param minRadius Smallest splat radius.
+ * @param impostors Output: Centroid (x, y, z) and radius (w) per impostor.
+ * @param colors Output: Mean color per impostor, alpha from the number of fishies.
+ * @param count Output: Number of impostors. Must be 0 before.
+ */
+__global__ void d_clusterImpostors(
+	ClusterTable clusters,
+	float cellSize,
+	float minRadius,
+	float4* impostors,
+	uchar4* colors,
+	unsigned int* count)
+{
+	unsigned int slot = blockIdx.x * blockDim.x + threadIdx.x;
+	if (slot >= CULL_CLUSTER_SLOTS)
+		return;
+	unsigned long long key = clusters.keys[slot];
+	if (key == EMPTY_KEY)
+		return;
+
+	// The cell corner from the key, the sums are offsets into the cell.
+	int level = static_cast< int >( key >> 57 );
+	float size = cellSize * static_cast< float >( 1 << level );
+	int3 cell = make_int3( static_cast< int >( key & 0x7ffffu ) - CLUSTER_KEY_BIAS, static_cast< int >( ( key >> 19 ) & 0x7ffffu ) - CLUSTER_KEY_BIAS,
+		static_cast< int >( ( key >> 38 ) & 0x7ffffu ) - CLUSTER_KEY_BIAS );
+	float4 sum = clusters.sums[slot];
+	float4 moment = clusters.moments[slot];
+	float inv = 1.0f / sum.w;
+	float3 mean = make_float3( sum.x * inv, sum.y * inv, sum.z * inv );
+	float spread = sqrtf( fmaxf( moment.x * inv - ( mean.x * mean.x + mean.y * mean.y + mean.z * mean.z ), 0.0f ) );	// RMS distance to the centroid
+
+	unsigned int index = atomicAdd( count, 1u );
+	impostors[index] = make_float4( cell.x * size + mean.x, cell.y * size + mean.y, cell.z * size + mean.z, fmaxf( 1.5f * spread, minRadius ) );
+	colors[index] = make_uchar4( static_cast< unsigned char >( moment.y * inv ), static_cast< unsigned char >( moment.z * inv ),
+		static_cast< unsigned char >( moment.w * inv ), static_cast< unsigned char >( fminf( 96.0f + sum.w, 255.0f ) ) );	// Fuller clusters are more opaque
+}
+
+/*!
+ * @brief Write the draw commands of the culling pass. One block of CULL_MAX_SCHOOLS threads, one thread per school.
+ * @param counts Number of mesh fishies [school], point fishies [schools + school] and cluster impostors [2 * schools].
+ * @param commands Output: Mesh commands, point commands and, with clusters, the impostor draw command.
+ * @param capacity Slots of the outputs of d_cull.
+ * @param mesh_vertices Vertices of the fish mesh.
+ * @param schools Schools with ranges of their own.
+ * @param clusters true: write the impostor command too.
+ */
+__global__ void d_cullCommands(
+	const unsigned int* counts,
+	DrawCommand* commands,
+	unsigned int capacity,
+	unsigned int mesh_vertices,
+	unsigned int schools,
+	bool clusters)
+{
+	unsigned int school = threadIdx.x;
+	if (school < schools)
+	{
+		unsigned int first = d_cullRange( school, schools, capacity );
+		unsigned int points = counts[schools + school];
+		commands[school] = { mesh_vertices, counts[school], 0u, first };	// Instanced attributes start at the range
+		commands[schools + school] = { points, 1u, d_cullRange( school + 1, schools, capacity ) - points, 0u };
+	}
+	if (school == 0 && clusters)
+		commands[2 * schools] = { counts[2 * schools], 1u, 0u, 0u };
+}
+
+/*!
+ * @brief Counting sort of buildGrid: count per cell, exclusive scan of the counts, scatter. Two passes over the fishies
+ * and two over the cells instead of the passes of the radix sort, faster while the grid has few cells per fish.
+ * The order inside a cell depends on the atomics.
+ * @param particles All fishies.
+ * @param mesh_count Number of fishies.
+ * @param grid grid placement.
+ * @param numCells Cells of the current grid.
+ * @param stream stream for all kernels and copies.
+ * @param packed also write the packed positions into d_sortedPacked.
+ */
+static void countingSortGrid(ParticleArrays particles, unsigned int mesh_count, const GridLayout& grid, unsigned int numCells, cudaStream_t stream, bool packed)
+{
+	CUDA_CHECK( cudaMemsetAsync( d_cellEnd->getData(), 0, numCells * sizeof( unsigned int ), stream ) );
+	CUDA_CHECK( cudaMemsetAsync( d_cellEnd->getData() + DEAD_CELL, 0, sizeof( unsigned int ), stream ) );
+
+	LaunchConfig hash = LAUNCH_HASH.forCount( mesh_count );
+	d_countCells<<<hash.blocks, hash.threads, 0, stream>>> (
+		d_gridParticleHash->getData(),
+		d_cellEnd->getData(),
+		d_cellRank->getData(),
+		particles,
+		mesh_count,
+		grid );
+	CUDA_CHECK_LAUNCH( "d_countCells", stream );
+
+	d_arena->reset();
+	ArenaAllocator scratch;
+	scratch.arena = d_arena;
+
+	thrust::exclusive_scan(
+		thrust::cuda::par( scratch ).on( stream ),
+		thrust::device_ptr<unsigned int>( d_cellEnd->getData() ),
+		thrust::device_ptr<unsigned int>( d_cellEnd->getData() + numCells ),
+		thrust::device_ptr<unsigned int>( d_cellStart->getData() ) );
+
+	LaunchConfig cells = LAUNCH_HASH.forCount( numCells + 1 );
+	d_finishCells<<<cells.blocks, cells.threads, 0, stream>>> ( d_cellStart->getData(), d_cellEnd->getData(), numCells, mesh_count );
+	CUDA_CHECK_LAUNCH( "d_finishCells", stream );
+
+	d_scatterCells<<<hash.blocks, hash.threads, 0, stream>>> (
+		d_sorted->getArrays(),
+		d_gridParticleIndex->getData(),
+		d_cellStart->getData(),
+		d_gridParticleHash->getData(),
+		d_cellRank->getData(),
+		particles,
+		mesh_count,
+		packed ? d_sortedPacked->getData() : NULL,
+		grid );
+	CUDA_CHECK_LAUNCH( "d_scatterCells", stream );
+}
+
+/*!
+ * @brief Number of cell entries the grid builds fill, without the dead cell.
+ * @param grid grid placement.
+ * @return cells of the grid, or the slots and the empty bucket of the hashed grid.
+ */
+static unsigned int gridCellCount(const GridLayout& grid)
+{
+	if (grid.cellKeys != NULL)
+		return grid.keyMask + 2;
+	return grid.dims.x * grid.dims.y * grid.dims.z;
+}
+
+/*!
+ * @brief Build uniform grid: hash fishies into cells, sort by cell and find cell start/end.
+ * Radix sort of the hashes or counting sort (countingSortGrid), see kernel_set_grid_sort.
+ * The hashed grid clears its table first, the hashes fill it.
+ * @param particles All fishies.
+ * @param mesh_count Number of fishies.
+ * @param grid grid placement.
+ * @param stream stream for all kernels and copies.
+ * @param packed also write the packed positions into d_sortedPacked.
+ */
+void buildGrid(ParticleArrays particles, unsigned int mesh_count, const GridLayout& grid, cudaStream_t stream, bool packed = false)
+{
+	size_t numCells = gridCellCount( grid );
+	if (grid.cellKeys != NULL)
+		CUDA_CHECK( cudaMemsetAsync( grid.cellKeys, 0xff, ( grid.keyMask + 1 ) * sizeof( unsigned long long ), stream ) );	// All slots EMPTY_KEY
+	bool counting = GRID_SORT == GridSort::COUNTING
+		|| ( GRID_SORT == GridSort::AUTO && numCells <= COUNTING_SORT_CELLS_PER_FISH * static_cast< size_t >( mesh_count ) );
+	if (counting && !DETERMINISTIC)												// The radix sort keeps the slot order inside a cell
+	{
+		countingSortGrid( particles, mesh_count, grid, static_cast< unsigned int >( numCells ), stream, packed );
+		return;
+	}
+
+	LaunchConfig hash = LAUNCH_HASH.forCount( mesh_count );
+	d_calcHash<<<hash.blocks, hash.threads, 0, stream>>> (
+		d_gridParticleHash->getData(),
+		d_gridParticleIndex->getData(),
+		particles,
+		mesh_count,
+		grid );
+	CUDA_CHECK_LAUNCH( "d_calcHash", stream );
+
+	// Temporary storage of the sort comes from the arena instead of a cudaMalloc/cudaFree per step.
+	d_arena->reset();
+	ArenaAllocator scratch;
+	scratch.arena = d_arena;
+
+	thrust::sort_by_key(
+		thrust::cuda::par( scratch ).on( stream ),
+		thrust::device_ptr<unsigned int>( d_gridParticleHash->getData() ),
+		thrust::device_ptr<unsigned int>( d_gridParticleHash->getData() + mesh_count ),
+		thrust::device_ptr<unsigned int>( d_gridParticleIndex->getData() ) );
+
+	// Mark all cells of the current grid as empty. The dead cell is never read.
+	CUDA_CHECK( cudaMemsetAsync( d_cellStart->getData(), 0xff, numCells * sizeof( unsigned int ), stream ) );
+
+	LaunchConfig reorder = LAUNCH_REORDER.forCount( mesh_count );
+	d_reorderDataAndFindCellStart<<<reorder.blocks, reorder.threads, reorder.sharedMemory, stream>>> (
+		d_cellStart->getData(),
+		d_cellEnd->getData(),
+		d_sorted->getArrays(),
+		d_gridParticleHash->getData(),
+		d_gridParticleIndex->getData(),
+		particles,
+		mesh_count,
+		packed ? d_sortedPacked->getData() : NULL,
+		grid );
+	CUDA_CHECK_LAUNCH( "d_reorderDataAndFindCellStart", stream );
+}
+
+/*!
+ * @brief Check if kernel_set_far_field switched the far field on.
+ * @return true, if kernel_advance builds the BVH.
+ */
+static bool farFieldActive()
+{
+	return FAR_COHESION > 0.0f || FAR_ALIGNMENT > 0.0f;
+}
+
+/*!
+ * @brief Upload c_farField for this context.
+ * @param nodes Nodes of the tree. NULL: no far field.
+ * @param stream stream of the next step.
+ */
+static void uploadFarField(const BvhNode* nodes, cudaStream_t stream)
+{
+	FarField field;
+	field.nodes = nodes;
+	field.cohesion = FAR_COHESION;
+	field.alignment = FAR_ALIGNMENT;
+	field.theta2 = FAR_THETA * FAR_THETA;
+	field.nearDist2 = h_params.fishDist * h_params.fishDist;
+	CUDA_CHECK( cudaMemcpyToSymbolAsync( c_farField, &field, sizeof( FarField ), 0, cudaMemcpyHostToDevice, stream ) );
+}
+
+/*!
+ * @brief Build the BVH of the far field over the fishies and upload c_farField: Morton codes in the box of the grid,
+ * sorted like the Morton reorder, then leaves, internal nodes (d_bvhInternal) and the sums from the leaves up (d_bvhMerge).
+ * O(N) work besides the sort. The sort synchronizes the stream, like the one of the grid.
+ * @param particles All fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @param stream stream of the step.
+ */
+static void buildFarField(ParticleArrays particles, unsigned int mesh_count, cudaStream_t stream)
+{
+	if (d_bvhNodes == NULL || d_bvhNodes->getSize() < 2 * mesh_count - 1)
+	{
+		delete d_bvhNodes;
+		delete d_bvhCodes;
+		delete d_bvhOrder;
+		delete d_bvhVisits;
+		d_bvhNodes = new CudaDeviceArray<BvhNode>( 2 * mesh_count - 1, MemoryCategory::NEIGHBOURS );
+		d_bvhCodes = new CudaDeviceArray<unsigned int>( mesh_count, MemoryCategory::NEIGHBOURS );
+		d_bvhOrder = new CudaDeviceArray<unsigned int>( mesh_count, MemoryCategory::NEIGHBOURS );
+		d_bvhVisits = new CudaDeviceArray<unsigned int>( mesh_count, MemoryCategory::NEIGHBOURS );
+	}
+
+	LaunchConfig morton = LAUNCH_MORTON.forCount( mesh_count );
+	d_calcMorton<<<morton.blocks, morton.threads, 0, stream>>> ( d_bvhCodes->getData(), d_bvhOrder->getData(), particles, mesh_count, GRID_LAYOUT );
+	CUDA_CHECK_LAUNCH( "d_calcMorton", stream );
+
+	d_arena->reset();
+	ArenaAllocator scratch;
+	scratch.arena = d_arena;
+
+	thrust::sort_by_key(
+		thrust::cuda::par( scratch ).on( stream ),
+		thrust::device_ptr<unsigned int>( d_bvhCodes->getData() ),
+		thrust::device_ptr<unsigned int>( d_bvhCodes->getData() + mesh_count ),
+		thrust::device_ptr<unsigned int>( d_bvhOrder->getData() ) );
+
+	LaunchConfig leaves = LAUNCH_BVH_LEAVES.forCount( mesh_count );
+	d_bvhLeaves<<<leaves.blocks, leaves.threads, 0, stream>>> ( d_bvhNodes->getData(), d_bvhVisits->getData(), d_bvhOrder->getData(), particles, mesh_count );
+	CUDA_CHECK_LAUNCH( "d_bvhLeaves", stream );
+
+	if (mesh_count > 1)
+	{
+		LaunchConfig internal = LAUNCH_BVH_INTERNAL.forCount( mesh_count - 1 );
+		d_bvhInternal<<<internal.blocks, internal.threads, 0, stream>>> ( d_bvhNodes->getData(), d_bvhCodes->getData(), mesh_count );
+		CUDA_CHECK_LAUNCH( "d_bvhInternal", stream );
+
+		LaunchConfig merge = LAUNCH_BVH_MERGE.forCount( mesh_count );
+		d_bvhMerge<<<merge.blocks, merge.threads, 0, stream>>> ( d_bvhNodes->getData(), d_bvhVisits->getData(), mesh_count );
+		CUDA_CHECK_LAUNCH( "d_bvhMerge", stream );
+	}
+
+	uploadFarField( d_bvhNodes->getData(), stream );
+}
+
+/*!
+ * @brief Check if the Verlet lists have to be rebuilt.
+ * The maximum displacement is read back asynchronously, so it is some steps old.
+ * The unknown steps are estimated with the last known displacement per step.
+ * @param mesh_count Number of fishies.
+ * @return true, if a fish could have moved more than verletSkin / 2 since the build.
+ */
+static bool verletNeedsRebuild(unsigned int mesh_count)
+{
+	if (VERLET_READ_PENDING && cudaEventQuery( verletRead ) == cudaSuccess)
+	{
+		VERLET_READ_PENDING = false;
+		VERLET_STEP = ( *h_verletMax )[1];
+		if (!VERLET_READ_STALE)
+		{
+			VERLET_DISPLACEMENT = ( *h_verletMax )[0];
+			VERLET_UNKNOWN_STEPS = VERLET_READ_AGO;
+		}
+	}
+
+	if (!VERLET_VALID || VERLET_COUNT != mesh_count)
+		return true;
+
+	// Fishies accelerate, so the unknown steps get some margin.
+	float estimate = VERLET_DISPLACEMENT + VERLET_UNKNOWN_STEPS * VERLET_STEP * 1.5f;
+	return estimate > 0.5f * h_params.verletSkin;
+}
+
+/*!
+ * @brief Rebuild the obstacle texture of this context, if kernel_set_obstacles was called since, and upload c_obstacles.
+ * Part of uploadParams, never runs inside a graph capture.
+ * @param stream stream of the next step.
+ */
+static void uploadObstacles(cudaStream_t stream)
+{
+	if (obstacleVersion != OBSTACLES_VERSION)
+	{
+		if (d_obstacleVolume != 0)
+			CUDA_CHECK( cudaDestroyTextureObject( d_obstacleVolume ) );
+		if (d_obstacleArray != NULL)
+			CUDA_CHECK( cudaFreeArray( d_obstacleArray ) );
+		d_obstacleVolume = 0;
+		d_obstacleArray = NULL;
+
+		if (!h_obstacles.texels.empty())
+		{
+			cudaChannelFormatDesc channel = cudaCreateChannelDesc<float4>();
+			cudaExtent extent = make_cudaExtent( h_obstacles.width, h_obstacles.height, h_obstacles.depth );
+			CUDA_CHECK( cudaMalloc3DArray( &d_obstacleArray, &channel, extent ) );
+
+			cudaMemcpy3DParms copy = {};
+			copy.srcPtr = make_cudaPitchedPtr( h_obstacles.texels.data(), h_obstacles.width * sizeof( float4 ), h_obstacles.width, h_obstacles.height );
+			copy.dstArray = d_obstacleArray;
+			copy.extent = extent;
+			copy.kind = cudaMemcpyHostToDevice;
+			CUDA_CHECK( cudaMemcpy3DAsync( &copy, stream ) );			// h_obstacles lives until the next kernel_set_obstacles
+
+			cudaResourceDesc resource = {};
+			resource.resType = cudaResourceTypeArray;
+			resource.res.array.array = d_obstacleArray;
+			cudaTextureDesc texture = {};
+			texture.addressMode[0] = cudaAddressModeClamp;				// Outside the volume the border texels continue the field
+			texture.addressMode[1] = cudaAddressModeClamp;
+			texture.addressMode[2] = cudaAddressModeClamp;
+			texture.filterMode = cudaFilterModeLinear;					// Trilinear interpolation in the texture unit
+			texture.readMode = cudaReadModeElementType;
+			texture.normalizedCoords = 0;
+			CUDA_CHECK( cudaCreateTextureObject( &d_obstacleVolume, &resource, &texture, NULL ) );
+		}
+		obstacleVersion = OBSTACLES_VERSION;
+	}
+
+	ObstacleField field = {};
+	field.volume = d_obstacleVolume;
+	field.origin = h_obstacles.origin.toSwarmVector().toFloat4();
+	field.invCellSize = h_obstacles.cellSize > 0.0f ? 1.0f / h_obstacles.cellSize : 0.0f;
+	field.range = OBSTACLE_RANGE;
+	CUDA_CHECK( cudaMemcpyToSymbolAsync( c_obstacles, &field, sizeof( ObstacleField ), 0, cudaMemcpyHostToDevice, stream ) );
+}
+
+/*!
+ * @brief Bake the attractor field of this context again, if kernel_set_attractors was called since, and upload c_attractors.
+ * The attractors are copied into the device array and d_bakeAttractors fills the texture on the stream, before the step.
+ * Part of uploadParams, never runs inside a graph capture.
+ * @param stream stream of the next step.
+ */
+static void uploadAttractors(cudaStream_t stream)
+{
+	if (attractorVersion != ATTRACTORS_VERSION)
+	{
+		CUDA_CHECK( cudaStreamSynchronize( stream ) );			// The steps before may still fetch the old texture
+		releaseAttractors();
+
+		unsigned int count = static_cast< unsigned int >( h_attractorSources.size() );
+		if (count > 0 && h_attractors.width > 0)
+		{
+			d_attractorSources = new CudaDeviceArray<AttractorSource>( count, MemoryCategory::OTHER );
+			CUDA_CHECK( cudaMemcpyAsync( d_attractorSources->getData(), h_attractorSources.data(), count * sizeof( AttractorSource ),
+				cudaMemcpyHostToDevice, stream ) );						// h_attractorSources lives until the next kernel_set_attractors
+
+			cudaChannelFormatDesc channel = cudaCreateChannelDesc<float4>();
+			cudaExtent extent = make_cudaExtent( h_attractors.width, h_attractors.height, h_attractors.depth );
+			CUDA_CHECK( cudaMalloc3DArray( &d_attractorArray, &channel, extent, cudaArraySurfaceLoadStore ) );
+
+			cudaResourceDesc resource = {};
+			resource.resType = cudaResourceTypeArray;
+			resource.res.array.array = d_attractorArray;
+			cudaTextureDesc texture = {};
+			texture.addressMode[0] = cudaAddressModeClamp;				// The border texels are out of reach of all attractors: 0 outside
+			texture.addressMode[1] = cudaAddressModeClamp;
+			texture.addressMode[2] = cudaAddressModeClamp;
+			texture.filterMode = cudaFilterModeLinear;					// Trilinear interpolation in the texture unit
+			texture.readMode = cudaReadModeElementType;
+			texture.normalizedCoords = 0;
+			CUDA_CHECK( cudaCreateTextureObject( &d_attractorVolume, &resource, &texture, NULL ) );
+			CUDA_CHECK( cudaCreateSurfaceObject( &d_attractorSurface, &resource ) );
+
+			int texels = static_cast< int >( h_attractors.width * h_attractors.height * h_attractors.depth );
+			d_bakeAttractors<<<iDivUp( texels, ATTRACTOR_THREADS ), ATTRACTOR_THREADS, 0, stream>>> ( d_attractorSurface,
+				make_uint3( h_attractors.width, h_attractors.height, h_attractors.depth ), h_attractors.origin.toSwarmVector().toFloat4(),
+				h_attractors.cellSize, d_attractorSources->getData(), count );
+			CUDA_CHECK_LAUNCH( "d_bakeAttractors", stream );
+		}
+		attractorVersion = ATTRACTORS_VERSION;
+	}
+
+	AttractorField field = {};
+	field.volume = d_attractorVolume;
+	field.origin = h_attractors.origin.toSwarmVector().toFloat4();
+	field.invCellSize = h_attractors.cellSize > 0.0f ? 1.0f / h_attractors.cellSize : 0.0f;
+	CUDA_CHECK( cudaMemcpyToSymbolAsync( c_attractors, &field, sizeof( AttractorField ), 0, cudaMemcpyHostToDevice, stream ) );
+}
+
+/*!
+ * @brief Allocate the alarm field of this context, if kernel_set_alarm was called since, and upload c_alarm.
+ * Part of uploadParams, never runs inside a graph capture.
+ * @param stream stream of the next step.
+ */
+static void uploadAlarm(cudaStream_t stream)
+{
+	size_t cells = static_cast< size_t >( h_alarm.width ) * h_alarm.height * h_alarm.depth;
+	if (alarmVersion != ALARM_VERSION)
+	{
+		CUDA_CHECK( cudaStreamSynchronize( stream ) );			// The steps before may still read the old field
+		delete d_alarm;
+		d_alarm = NULL;
+		if (h_alarm.deposit > 0.0f && cells > 0)
+		{
+			d_alarm = new CudaDeviceArray<float>( 3 * cells, MemoryCategory::NEIGHBOURS );
+			CUDA_CHECK( cudaMemsetAsync( d_alarm->getData(), 0, 3 * cells * sizeof( float ), stream ) );	// Quiet water
+		}
+		alarmVersion = ALARM_VERSION;
+	}
+
+	AlarmGrid grid = {};
+	if (d_alarm != NULL)
+	{
+		grid.levels[0] = d_alarm->getData();
+		grid.levels[1] = d_alarm->getData() + cells;
+		grid.deposits = d_alarm->getData() + 2 * cells;
+		grid.dims = make_int3( h_alarm.width, h_alarm.height, h_alarm.depth );
+		grid.origin = h_alarm.origin.toSwarmVector().toFloat4();
+		grid.invCellSize = 1.0f / h_alarm.cellSize;
+		grid.deposit = h_alarm.deposit;
+		grid.decay = h_alarm.decay;
+	}
+	CUDA_CHECK( cudaMemcpyToSymbolAsync( c_alarm, &grid, sizeof( AlarmGrid ), 0, cudaMemcpyHostToDevice, stream ) );
+}
+
+/*!
+ * @brief Free the slots of the current of this context. Waits for the side stream.
+ */
+static void releaseCurrent()
+{
+	CurrentSlots& slots = currentSlots;
+	if (slots.stream != NULL)
+		CUDA_CHECK( cudaStreamSynchronize( slots.stream ) );
+	for (unsigned int slot = 0; slot < CURRENT_SLOTS; slot++)
+	{
+		if (slots.textures[slot] != 0)
+			CUDA_CHECK( cudaDestroyTextureObject( slots.textures[slot] ) );
+		if (slots.surfaces[slot] != 0)
+			CUDA_CHECK( cudaDestroySurfaceObject( slots.surfaces[slot] ) );
+		if (slots.arrays[slot] != NULL)
+			CUDA_CHECK( cudaFreeArray( slots.arrays[slot] ) );
+		if (slots.ready[slot] != NULL)
+			CUDA_CHECK( cudaEventDestroy( slots.ready[slot] ) );
+	}
+	if (slots.released != NULL)
+		CUDA_CHECK( cudaEventDestroy( slots.released ) );
+	if (slots.stream != NULL)
+		CUDA_CHECK( cudaStreamDestroy( slots.stream ) );
+	slots = CurrentSlots();
+}
+
+/*!
+ * @brief Fill a slot of the current with a time slice on the side stream and record its ready event.
+ * @param slot slot.
+ * @param slice time slice: curl noise of this time or slice % slices of the file.
+ */
+static void fillCurrentSlot(unsigned int slot, unsigned int slice)
+{
+	CurrentSlots& slots = currentSlots;
+	unsigned int texels = h_current.width * h_current.height * h_current.depth;
+	if (h_current.slices == 0)
+	{
+		LaunchConfig launch = LAUNCH_CURRENT.forCount( texels );
+		d_curlNoise<<<launch.blocks, launch.threads, 0, slots.stream>>> ( slots.surfaces[slot], make_uint3( h_current.width, h_current.height, h_current.depth ),
+			h_current.origin.toSwarmVector().toFloat4(), h_current.cellSize, h_current.noiseScale, static_cast< float >( slice ) );
+		CUDA_CHECK_LAUNCH( "d_curlNoise", slots.stream );
+	}
+	else
+	{
+		cudaMemcpy3DParms copy = {};
+		copy.srcPtr = make_cudaPitchedPtr( h_currentTexels->getData() + static_cast< size_t >( slice % h_current.slices ) * texels * 4,
+			h_current.width * 4 * sizeof( __half ), h_current.width, h_current.height );
+		copy.dstArray = slots.arrays[slot];
+		copy.extent = make_cudaExtent( h_current.width, h_current.height, h_current.depth );
+		copy.kind = cudaMemcpyHostToDevice;
+		CUDA_CHECK( cudaMemcpy3DAsync( &copy, slots.stream ) );		// Pinned, so the copy runs beside the steps
+	}
+	CUDA_CHECK( cudaEventRecord( slots.ready[slot], slots.stream ) );
+}
+
+/*!
+ * @brief Fill the slots of this context again, if kernel_set_current was called since, and upload c_current.
+ * Part of uploadParams, never runs inside a graph capture.
+ * @param stream stream of the next step.
+ */
+static void uploadCurrent(cudaStream_t stream)
+{
+	CurrentSlots& slots = currentSlots;
+	if (slots.version != CURRENT_FIELD_VERSION)
+	{
+		releaseCurrent();
+		if (h_current.width > 0)
+		{
+			CUDA_CHECK( cudaStreamCreateWithPriority( &slots.stream, cudaStreamNonBlocking, BACKGROUND_PRIORITY ) );
+			CUDA_CHECK( cudaEventCreateWithFlags( &slots.released, cudaEventDisableTiming ) );
+			cudaChannelFormatDesc channel = cudaCreateChannelDesc( 16, 16, 16, 16, cudaChannelFormatKindFloat );
+			cudaExtent extent = make_cudaExtent( h_current.width, h_current.height, h_current.depth );
+			for (unsigned int slot = 0; slot < CURRENT_SLOTS; slot++)
+			{
+				CUDA_CHECK( cudaMalloc3DArray( &slots.arrays[slot], &channel, extent, h_current.slices == 0 ? cudaArraySurfaceLoadStore : 0 ) );
+				CUDA_CHECK( cudaEventCreateWithFlags( &slots.ready[slot], cudaEventDisableTiming ) );
+
+				cudaResourceDesc resource = {};
+				resource.resType = cudaResourceTypeArray;
+				resource.res.array.array = slots.arrays[slot];
+				cudaTextureDesc texture = {};
+				texture.addressMode[0] = cudaAddressModeClamp;
+				texture.addressMode[1] = cudaAddressModeClamp;
+				texture.addressMode[2] = cudaAddressModeClamp;
+				texture.filterMode = cudaFilterModeLinear;				// Half texels are filtered and read as float
+				texture.readMode = cudaReadModeElementType;
+				texture.normalizedCoords = 0;
+				CUDA_CHECK( cudaCreateTextureObject( &slots.textures[slot], &resource, &texture, NULL ) );
+				if (h_current.slices == 0)
+					CUDA_CHECK( cudaCreateSurfaceObject( &slots.surfaces[slot], &resource ) );
+
+				fillCurrentSlot( slot, slot );
+			}
+			slots.waits = ( 1u << CURRENT_SLOTS ) - 1;					// The steps before the next slice may use any of them
+		}
+		slots.version = CURRENT_FIELD_VERSION;
+	}
+
+	CurrentField field = {};
+	for (unsigned int slot = 0; slot < CURRENT_SLOTS; slot++)
+		field.slices[slot] = slots.textures[slot];
+	field.origin = h_current.origin.toSwarmVector().toFloat4();
+	field.invCellSize = h_current.cellSize > 0.0f ? 1.0f / h_current.cellSize : 0.0f;
+	field.strength = CURRENT_STRENGTH;
+	CUDA_CHECK( cudaMemcpyToSymbolAsync( c_current, &field, sizeof( CurrentField ), 0, cudaMemcpyHostToDevice, stream ) );
+}
+
+/*!
+ * @brief Advance the clock of the current by one step and set the slots and the blend of h_step.
+ * On a new slice the slot of the last one is marked for a refill with the slice after the next one,
+ * and the step stream has to wait for the next one.
+ */
+static void advanceCurrent()
+{
+	CurrentSlots& slots = currentSlots;
+	if (slots.stream == NULL)
+		return;
+
+	unsigned int slice = slots.step / CURRENT_PERIOD;
+	unsigned int phase = slots.step % CURRENT_PERIOD;
+	if (phase == 0 && slice > 0)
+	{
+		unsigned int freed = ( slice - 1 ) % CURRENT_SLOTS;
+		slots.refills |= 1u << freed;
+		slots.fill[freed] = slice + 2;
+		slots.waits |= 1u << ( ( slice + 1 ) % CURRENT_SLOTS );
+	}
+	h_step.currentSlots = make_uint2( slice % CURRENT_SLOTS, ( slice + 1 ) % CURRENT_SLOTS );
+	h_step.currentBlend = static_cast< float >( phase ) / CURRENT_PERIOD;
+	slots.step++;
+}
+
+/*!
+ * @brief Start the marked refills on the side stream, after the steps enqueued so far.
+ * @param stream stream of the steps.
+ */
+static void refillCurrent(cudaStream_t stream)
+{
+	CurrentSlots& slots = currentSlots;
+	if (slots.refills == 0)
+		return;
+
+	CUDA_CHECK( cudaEventRecord( slots.released, stream ) );
+	CUDA_CHECK( cudaStreamWaitEvent( slots.stream, slots.released, 0 ) );
+	for (unsigned int slot = 0; slot < CURRENT_SLOTS; slot++)
+		if (slots.refills & ( 1u << slot ))
+			fillCurrentSlot( slot, slots.fill[slot] );
+	slots.refills = 0;
+}
+
+/*!
+ * @brief Let the step stream wait for the fills of the marked slots. Only the GPU waits, and only if a fill is late.
+ * @param stream stream of the steps.
+ */
+static void waitCurrent(cudaStream_t stream)
+{
+	CurrentSlots& slots = currentSlots;
+	for (unsigned int slot = 0; slot < CURRENT_SLOTS; slot++)
+		if (slots.waits & ( 1u << slot ))
+			CUDA_CHECK( cudaStreamWaitEvent( stream, slots.ready[slot], 0 ) );
+	slots.waits = 0;
+}
+
+/*!
+ * @brief Upload the behaviour parameters, if they changed.
+ * @param stream stream of the next step.
+ */
+static void uploadParams(cudaStream_t stream)
+{
+	if (!h_paramsDirty)
+		return;
+
+	CUDA_CHECK( cudaMemcpyToSymbolAsync( c_params, &h_params, sizeof( SwarmParams ), 0, cudaMemcpyHostToDevice, stream ) );
+	CUDA_CHECK( cudaMemcpyToSymbolAsync( c_path, &h_path, sizeof( WaypointPath ), 0, cudaMemcpyHostToDevice, stream ) );
+	CUDA_CHECK( cudaMemcpyToSymbolAsync( c_species, &h_species, sizeof( SpeciesTable ), 0, cudaMemcpyHostToDevice, stream ) );
+	uploadObstacles( stream );
+	uploadAttractors( stream );
+	uploadAlarm( stream );
+	uploadCurrent( stream );
+	if (!farFieldActive())
+		uploadFarField( NULL, stream );							// Switched off, or the nodes were freed by kernel_cleanup
+	if (h_timeline.count > 0)
+	{
+		h_timeline.base = h_params;
+		h_timeline.currentStrength = CURRENT_STRENGTH;
+		CUDA_CHECK( cudaMemcpyToSymbolAsync( c_timeline, &h_timeline, sizeof( Timeline ), 0, cudaMemcpyHostToDevice, stream ) );
+	}
+	h_paramsDirty = false;
+}
+
+/*!
+ * @brief Apply the timeline to the step of c_step: d_applyTimeline, then copy its result over the inputs the events change.
+ * Only device to device copies after the upload of c_step, so the launches can be captured.
+ * @param stream stream of the step.
+ */
+static void applyTimeline(cudaStream_t stream)
+{
+	d_applyTimeline<<<1, 1, 0, stream>>> ();
+	CUDA_CHECK_LAUNCH( "d_applyTimeline", stream );
+
+	TimelineState* state = NULL;
+	CUDA_CHECK( cudaGetSymbolAddress( reinterpret_cast< void** >( &state ), d_timelineState ) );
+	if (timelineHas( TimelineAction::PARAM ))
+		CUDA_CHECK( cudaMemcpyToSymbolAsync( c_params, &state->params, sizeof( SwarmParams ), 0, cudaMemcpyDeviceToDevice, stream ) );
+	if (timelineHas( TimelineAction::ROUTE ))
+		CUDA_CHECK( cudaMemcpyToSymbolAsync( c_step, &state->swarmCenter, sizeof( float4 ), offsetof( StepInputs, swarmCenter ), cudaMemcpyDeviceToDevice, stream ) );
+	if (timelineHas( TimelineAction::CURRENT ))
+		CUDA_CHECK( cudaMemcpyToSymbolAsync( c_current, &state->currentStrength, sizeof( float ), offsetof( CurrentField, strength ), cudaMemcpyDeviceToDevice, stream ) );
+}
+
+/*!
+ * @brief Upload the start of the school centers, if kernel_set_schools was called since the last upload into this context.
+ * Afterwards only d_moveSchools writes them.
+ * @param stream stream of the next step.
+ */
+static void uploadSchools(cudaStream_t stream)
+{
+	if (!h_schoolsDirty)
+		return;
+
+	CUDA_CHECK( cudaMemcpyToSymbolAsync( d_schoolTable, h_schoolTable, sizeof( h_schoolTable ), 0, cudaMemcpyHostToDevice, stream ) );
+	if (h_path.spline)
+		CUDA_CHECK( cudaMemcpyToSymbolAsync( d_splineTable, h_splineTable, sizeof( h_splineTable ), 0, cudaMemcpyHostToDevice, stream ) );
+	h_schoolsDirty = false;
+}
+
+/*!
+ * @brief Check if the school centers move on the GPU (d_moveSchools): with several schools or on spline paths.
+ * Else all fishies follow the swarmCenter of the host.
+ * @return true, if the kernels read the centers from d_schoolTable.
+ */
+static bool schoolsOnDevice()
+{
+	return h_path.schools > 1 || ( h_path.spline && h_path.schools > 0 );
+}
+
+/*
+ * Pre-instantiated variants of the advance kernels, indexed by the AdvanceFeature flags they support.
+ * kernel_advance launches the variant of advanceFeatures(), so the branches of unused features are not compiled in.
+ */
+#define SWIM_INSTANCES( kernel ) { kernel<0>, kernel<1>, kernel<2>, kernel<3>, kernel<4>, kernel<5>, kernel<6>, kernel<7> }
+#define QUERY_INSTANCES( kernel ) { kernel<0>, kernel<1>, kernel<2>, kernel<3>, kernel<4>, kernel<5>, kernel<6>, kernel<7>, \
+	kernel<8>, kernel<9>, kernel<10>, kernel<11>, kernel<12>, kernel<13>, kernel<14>, kernel<15> }
+#define GRID_INSTANCES( kernel ) { kernel<0>, kernel<1>, kernel<2>, kernel<3>, kernel<4>, kernel<5>, kernel<6>, kernel<7>, \
+	kernel<8>, kernel<9>, kernel<10>, kernel<11>, kernel<12>, kernel<13>, kernel<14>, kernel<15>, \
+	kernel<16>, kernel<17>, kernel<18>, kernel<19>, kernel<20>, kernel<21>, kernel<22>, kernel<23>, \
+	kernel<24>, kernel<25>, kernel<26>, kernel<27>, kernel<28>, kernel<29>, kernel<30>, kernel<31> }
+
+static decltype( &d_advance<0> ) const ADVANCE_VARIANTS[] = QUERY_INSTANCES( d_advance );
+static decltype( &d_advance_tiled<0> ) const TILED_VARIANTS[] = QUERY_INSTANCES( d_advance_tiled );
+static decltype( &d_advance_tiled_async<0> ) const TILED_ASYNC_VARIANTS[] = QUERY_INSTANCES( d_advance_tiled_async );
+static decltype( &d_advance_cluster<0> ) const CLUSTER_VARIANTS[] = QUERY_INSTANCES( d_advance_cluster );
+static decltype( &d_advance_warp<0> ) const WARP_VARIANTS[] = SWIM_INSTANCES( d_advance_warp );
+static decltype( &d_advance_tensor<0> ) const TENSOR_VARIANTS[] = SWIM_INSTANCES( d_advance_tensor );
+static decltype( &d_advance_verlet<0> ) const VERLET_VARIANTS[] = QUERY_INSTANCES( d_advance_verlet );
+static decltype( &d_advance_grid<0> ) const GRID_VARIANTS[] = GRID_INSTANCES( d_advance_grid );
+static decltype( &d_advance_sparse<0> ) const SPARSE_VARIANTS[] = GRID_INSTANCES( d_advance_sparse );
+static decltype( &d_advance_dense<0> ) const DENSE_VARIANTS[] = SWIM_INSTANCES( d_advance_dense );
+static decltype( &d_advance_cell<0> ) const CELL_VARIANTS[] = SWIM_INSTANCES( d_advance_cell );
+static decltype( &d_advance_cooperative<0> ) const COOPERATIVE_VARIANTS[] = GRID_INSTANCES( d_advance_cooperative );
+static decltype( &d_advance_bucket<0> ) const BUCKET_VARIANTS[] = GRID_INSTANCES( d_advance_bucket );
+static decltype( &d_advance_boids<0> ) const BOIDS_VARIANTS[] = SWIM_INSTANCES( d_advance_boids );
+static decltype( &d_advance_boids_mean<0> ) const BOIDS_MEAN_VARIANTS[] = SWIM_INSTANCES( d_advance_boids_mean );
+static decltype( &d_classifyEvaders<0> ) const CLASSIFY_VARIANTS[] = SWIM_INSTANCES( d_classifyEvaders );
+static decltype( &d_advance_flocking<0> ) const FLOCKING_VARIANTS[] = QUERY_INSTANCES( d_advance_flocking );
+static decltype( &d_advance_ensemble<0> ) const ENSEMBLE_VARIANTS[] = { d_advance_ensemble<0>, d_advance_ensemble<FEATURE_JITTER> };
+static decltype( &d_advance_substeps<0> ) const SUBSTEP_VARIANTS[] = QUERY_INSTANCES( d_advance_substeps );
+
+/*!
+ * @brief Get the AdvanceFeature flags of the current settings. Each kernel ignores the flags it has no variants for.
+ * @return flags.
+ */
+static unsigned int advanceFeatures()
+{
+	unsigned int features = 0;
+	if (h_params.jitter > 0.0f)
+		features |= FEATURE_JITTER;
+	if (schoolsOnDevice())
+		features |= FEATURE_SCHOOLS;
+	if (h_species.count > 1)
+		features |= FEATURE_SPECIES;
+	if (SEARCH_FIRST_K > 0)
+		features |= FEATURE_FIRST_K;
+	if (PACKED_POSITIONS)
+		features |= FEATURE_PACKED;
+	return features;
+}
+
+/*!
+ * @brief Verlet search: rebuild the lists if needed, advance the fishies and measure their displacement.
+ * Parameters as kernel_advance.
+ */
+static void advanceVerlet(
+	ParticleArrays in,
+	ParticleArrays out,
+	unsigned int mesh_count,
+	float speed,
+	const float4* sharks,
+	unsigned int shark_count,
+	cudaStream_t stream)
+{
+	if (verletNeedsRebuild( mesh_count ))
+	{
+		// Larger cells, so the 27 cells hold every candidate inside the list radius.
+		float radius = h_params.fishDist + h_params.verletSkin;
+		GridLayout grid = GRID_LAYOUT;
+		grid.cellSize = radius;
+		buildGrid( in, mesh_count, grid, stream );
+
+		LaunchConfig build = LAUNCH_VERLET_BUILD.forCount( mesh_count );
+		d_buildVerlet<<<build.blocks, build.threads, 0, stream>>> (
+			d_sorted->getArrays(),
+			d_gridParticleIndex->getData(),
+			d_cellStart->getData(),
+			d_cellEnd->getData(),
+			mesh_count,
+			grid,
+			radius,
+			d_verletList->getData(),
+			d_verletCount->getData(),
+			d_verletRef->getData() );
+		CUDA_CHECK_LAUNCH( "d_buildVerlet", stream );
+
+		VERLET_VALID = true;
+		VERLET_COUNT = mesh_count;
+		VERLET_DISPLACEMENT = 0.0f;
+		VERLET_UNKNOWN_STEPS = 0;
+		VERLET_READ_STALE = VERLET_READ_PENDING;
+	}
+
+	LaunchConfig verlet = LAUNCH_VERLET.withThreads( TUNING.searchThreads ).forCount( mesh_count );
+	VERLET_VARIANTS[advanceFeatures() & QUERY_FEATURES]<<<verlet.blocks, verlet.threads, 0, stream>>> (
+		in,
+		out,
+		mesh_count,
+		speed * 1.8,
+		sharks,
+		shark_count,
+		d_verletList->getData(),
+		d_verletCount->getData(),
+		SEARCH_FIRST_K );
+	CUDA_CHECK_LAUNCH( "d_advance_verlet", stream );
+
+	VERLET_UNKNOWN_STEPS++;
+	VERLET_READ_AGO++;
+	if (VERLET_READ_PENDING)
+		return;
+
+	// Only one read back at a time, it must not overwrite the pinned memory while the host reads it.
+	CUDA_CHECK( cudaMemsetAsync( d_verletMax->getData(), 0, 2 * sizeof( unsigned int ), stream ) );
+	// Full blocks, so every warp is complete for the shuffles.
+	unsigned int threads = LAUNCH_DISPLACEMENT.threads;
+	d_verletDisplacement<<<iDivUp( mesh_count, threads ), threads, 0, stream>>> ( in, out, d_verletRef->getData(), mesh_count, d_verletMax->getData() );
+	CUDA_CHECK_LAUNCH( "d_verletDisplacement", stream );
+	CUDA_CHECK( cudaMemcpyAsync( h_verletMax->getData(), d_verletMax->getData(), 2 * sizeof( float ), cudaMemcpyDeviceToHost, stream ) );
+	CUDA_CHECK( cudaEventRecord( verletRead, stream ) );
+	VERLET_READ_PENDING = true;
+	VERLET_READ_STALE = false;
+	VERLET_READ_AGO = 0;
+}
+
+/*!
+ * @brief Closest fishies of the last step for the grid search.
+ * @param in Positions, speed vectors and masses of all fishies (read only).
+ * @param mesh_count Number of fishies.
+ * @return warm start, without d_nearest if WARM_START is off.
+ */
+static WarmStart warmStart(ParticleArrays in, unsigned int mesh_count)
+{
+	WarmStart warm = { in, mesh_count, WARM_START ? d_nearest->getData() : NULL };
+	return warm;
+}
+
+/*!
+ * @brief Grid search in multi-rate steps: builds the grid, sorts the fishies into the buckets (d_classifyRates)
+ * and advances every bucket in its own launch. The sizes of the buckets stay on the device.
+ * @param in Positions, speed vectors and masses of all fishies (read only).
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param mesh_count Number of fishies.
+ * @param speed Speed of particles per step.
+ * @param sharks Positions of all sharks. NULL: read from c_sharks.
+ * @param shark_count Number of sharks.
+ * @param features AdvanceFeature flags of the step.
+ * @param stream stream for all kernels and copies.
+ */
+static void advanceRates(ParticleArrays in, ParticleArrays out, unsigned int mesh_count, float speed, const float4* sharks, unsigned int shark_count,
+	unsigned int features, cudaStream_t stream)
+{
+	buildGrid( in, mesh_count, GRID_LAYOUT, stream, PACKED_POSITIONS );
+
+	CUDA_CHECK( cudaMemsetAsync( d_rateCounts->getData(), 0, RATE_BUCKETS * sizeof( unsigned int ), stream ) );
+	LaunchConfig classify = LAUNCH_RATES.forCount( mesh_count );
+	d_classifyRates<<<classify.blocks, classify.threads, 0, stream>>> (
+		out, d_sorted->getArrays(), d_gridParticleIndex->getData(), mesh_count, sharks, shark_count, MULTI_RATE, d_rateBuckets->getData(), d_rateCounts->getData() );
+	CUDA_CHECK_LAUNCH( "d_classifyRates", stream );
+
+	LaunchConfig grid = LAUNCH_GRID.withThreads( TUNING.searchThreads ).forCount( mesh_count );
+	for (unsigned int b = 0; b < RATE_BUCKETS; b++)
+	{
+		float glide = b == 0 ? 0.0f : MULTI_RATE.interval - 1.0f;				// Bucket 1 catches up on the steps it waited
+		BUCKET_VARIANTS[features & GRID_FEATURES]<<<grid.blocks, grid.threads, 0, stream>>> (
+			out,
+			d_sorted->getArrays(),
+			d_gridParticleIndex->getData(),
+			d_cellStart->getData(),
+			d_cellEnd->getData(),
+			d_rateBuckets->getData() + b * mesh_count,
+			d_rateCounts->getData() + b,
+			GRID_LAYOUT,
+			speed * 1.8,
+			sharks,
+			shark_count,
+			SEARCH_FIRST_K,
+			PACKED_POSITIONS ? d_sortedPacked->getData() : NULL,
+			warmStart( in, mesh_count ),
+			glide );
+		CUDA_CHECK_LAUNCH( "d_advance_bucket", stream );
+	}
+}
+
+/*!
+ * @brief Grid search with the grid build in one cooperative launch (d_advance_cooperative) instead of buildGrid and d_advance_grid.
+ * Needs COOPERATIVE_BLOCKS > 0. The grid is the same for kernel_move_sharks.
+ * @param in Positions, speed vectors and masses of all fishies (read only).
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param mesh_count Number of fishies.
+ * @param speed Speed of particles per step.
+ * @param sharks Positions of all sharks. NULL: read from c_sharks.
+ * @param shark_count Number of sharks.
+ * @param features AdvanceFeature flags of the step.
+ * @param stream stream for all kernels and copies.
+ */
+static void advanceCooperative(ParticleArrays in, ParticleArrays out, unsigned int mesh_count, float speed, const float4* sharks, unsigned int shark_count,
+	unsigned int features, cudaStream_t stream)
+{
+	// Grid stride loops: the blocks that are resident at once, but not more than one fish per thread.
+	unsigned int blocks = std::max( 1u, std::min( COOPERATIVE_BLOCKS, ( mesh_count + COOPERATIVE_THREADS - 1 ) / COOPERATIVE_THREADS ) );
+
+	GridLayout grid = GRID_LAYOUT;
+	float fishSpeed = speed * 1.8f;
+	unsigned int firstK = SEARCH_FIRST_K;
+	ParticleArrays sorted = d_sorted->getArrays();
+	unsigned int* gridParticleHash = d_gridParticleHash->getData();
+	unsigned int* gridParticleIndex = d_gridParticleIndex->getData();
+	unsigned int* cellStart = d_cellStart->getData();
+	unsigned int* cellEnd = d_cellEnd->getData();
+	unsigned int* cellRank = d_cellRank->getData();
+	unsigned int* blockSums = d_blockSums->getData();
+	ushort4* packed = PACKED_POSITIONS ? d_sortedPacked->getData() : NULL;
+	WarmStart warm = warmStart( in, mesh_count );
+	void* args[] = { &in, &out, &mesh_count, &grid, &fishSpeed, &sharks, &shark_count, &firstK, &sorted,
+		&gridParticleHash, &gridParticleIndex, &cellStart, &cellEnd, &cellRank, &blockSums, &packed, &warm };
+
+	CUDA_CHECK( cudaLaunchCooperativeKernel( reinterpret_cast< const void* >( COOPERATIVE_VARIANTS[features & GRID_FEATURES] ),
+		dim3( blocks ), dim3( COOPERATIVE_THREADS ), args, 0, stream ) );
+	CUDA_CHECK_LAUNCH( "d_advance_cooperative", stream );
+}
+
+/*!
+ * @brief Launch configuration of d_advance_tensor. The block size is fixed, every warp needs its 16 fishies.
+ * @param mesh_count Number of fishies.
+ * @return TENSOR_THREADS threads per block, one block per TENSOR_ROWS fishies.
+ */
+static LaunchConfig tensorLaunch(unsigned int mesh_count)
+{
+	LaunchConfig config;
+	config.threads = TENSOR_THREADS;
+	config.maxThreads = TENSOR_THREADS;
+	config.blocks = std::max( 1u, ( mesh_count + TENSOR_ROWS - 1 ) / TENSOR_ROWS );
+	return config;
+}
+
+/*!
+ * @brief Launch configuration of d_advance_cluster: one block per cell, the grid rounded up to whole clusters.
+ * @return configuration, blocks is the number of all blocks.
+ */
+static LaunchConfig clusterLaunch()
+{
+	LaunchConfig config;
+	config.threads = CLUSTER_THREADS;
+	config.maxThreads = CLUSTER_THREADS;
+	config.blocks = 1;
+	for (int dim : { GRID_LAYOUT.dims.x, GRID_LAYOUT.dims.y, GRID_LAYOUT.dims.z })
+		config.blocks *= ( dim + CLUSTER_EDGE - 1 ) / CLUSTER_EDGE * CLUSTER_EDGE;
+	return config;
+}
+
+/*!
+ * @brief Launch configuration of d_advance_cell: one block per cell of the wrapped grid.
+ * @return configuration.
+ */
+static LaunchConfig cellLaunch()
+{
+	LaunchConfig config;
+	config.threads = CELL_THREADS;
+	config.maxThreads = CELL_THREADS;
+	config.blocks = GRID_LAYOUT.dims.x * GRID_LAYOUT.dims.y * GRID_LAYOUT.dims.z;
+	return config;
+}
+
+/*!
+ * @brief Grid search over distributed shared memory (d_advance_cluster) after buildGrid. Needs CLUSTER_CELLS.
+ * @param out Output: New positions, speed vectors and masses of all fishies.
+ * @param speed Speed of particles per step.
+ * @param sharks Positions of all sharks.
+ * @param shark_count Number of sharks.
+ * @param features AdvanceFeature flags of the step.
+ * @param stream stream of the launch.
+ */
+static void advanceCluster(ParticleArrays out, float speed, const float4* sharks, unsigned int shark_count, unsigned int features, cudaStream_t stream)
+{
+	ParticleArrays sorted = d_sorted->getArrays();
+	const unsigned int* gridParticleIndex = d_gridParticleIndex->getData();
+	const unsigned int* cellStart = d_cellStart->getData();
+	const unsigned int* cellEnd = d_cellEnd->getData();
+	GridLayout grid = GRID_LAYOUT;
+	float fishSpeed = speed * 1.8f;
+	unsigned int firstK = SEARCH_FIRST_K;
+	void* args[] = { &out, &sorted, &gridParticleIndex, &cellStart, &cellEnd, &grid, &fishSpeed, &sharks, &shark_count, &firstK };
+
+	cudaLaunchAttribute attribute = {};
+	attribute.id = cudaLaunchAttributeClusterDimension;
+	attribute.val.clusterDim.x = CLUSTER_EDGE;
+	attribute.val.clusterDim.y = CLUSTER_EDGE;
+	attribute.val.clusterDim.z = CLUSTER_EDGE;
+
+	cudaLaunchConfig_t config = {};
+	config.gridDim = dim3( ( grid.dims.x + CLUSTER_EDGE - 1 ) / CLUSTER_EDGE * CLUSTER_EDGE,
+		( grid.dims.y + CLUSTER_EDGE - 1 ) / CLUSTER_EDGE * CLUSTER_EDGE, ( grid.dims.z + CLUSTER_EDGE - 1 ) / CLUSTER_EDGE * CLUSTER_EDGE );
+	config.blockDim = dim3( CLUSTER_THREADS );
+	config.stream = stream;
+	config.attrs = &attribute;
+	config.numAttrs = 1;
+	CUDA_CHECK( cudaLaunchKernelExC( &config, reinterpret_cast< const void* >( CLUSTER_VARIANTS[features & QUERY_FEATURES] ), args ) );
+	CUDA_CHECK_LAUNCH( "d_advance_cluster", stream );
+}
+
+/*!
+ * @brief Check if kernel_advance builds the grid: boids or the grid search.
+ * @param mesh_count Number of fishies.
+ * @return true, if the grid is valid after the step.
+ */
+static bool advanceUsesGrid(unsigned int mesh_count)
+{
+	if (BEHAVIOUR == Behaviour::BOIDS)
+		return true;
+	if (DETERMINISTIC)
+		return SEARCH_MODE != SearchMode::BRUTE_FORCE;
+	return SEARCH_MODE == SearchMode::GRID || SEARCH_MODE == SearchMode::CELL || ( SEARCH_MODE == SearchMode::AUTO && mesh_count >= TILED_SEARCH_THRESHOLD );
+}
+
+/*!
+ * @brief Set or remove the access policy window of the cell tables (kernel_set_l2_persistence) on the stream of the grid search.
+ * Both tables are allocated one after the other in kernel_init_grid, the window spans both. If the span is larger than the
+ * largest window, it covers d_cellStart only. The persisting part of L2 is set to the window, at most the maximum of the device,
+ * and the hit ratio scales the window down to it, so the tables don't evict each other. Other data streams through L2.
+ * Not called while a graph is captured: the kernel nodes take the window of the stream, a new window starts a new graph.
+ * @param stream stream of the grid search.
+ */
+static void updateL2Window(cudaStream_t stream)
+{
+	bool wanted = L2_PERSISTENCE && L2_PERSIST_MAX > 0 && L2_WINDOW_MAX > 0;
+	if (wanted ? L2_WINDOW.num_bytes > 0 && L2_STREAM == stream : L2_WINDOW.num_bytes == 0)
+		return;
+
+	cudaStreamAttrValue value = {};
+	if (L2_WINDOW.num_bytes > 0)												// Remove the window of the last stream and release its lines
+	{
+		CUDA_CHECK( cudaStreamSetAttribute( L2_STREAM, cudaStreamAttributeAccessPolicyWindow, &value ) );
+		CUDA_CHECK( cudaCtxResetPersistingL2Cache() );
+		L2_WINDOW = {};
+		L2_STREAM = NULL;
+		GRAPH_VERSION++;
+	}
+	if (!wanted)
+		return;
+
+	const char* start = reinterpret_cast< const char* >( d_cellStart->getData() );
+	const char* end = reinterpret_cast< const char* >( d_cellEnd->getData() );
+	size_t bytes = d_cellStart->getSize() * sizeof( unsigned int );
+	const char* base = std::min( start, end );
+	size_t span = std::max( start, end ) + bytes - base;
+	if (span > L2_WINDOW_MAX)
+	{
+		base = start;
+		span = std::min( bytes, L2_WINDOW_MAX );
+	}
+	size_t persisting = std::min( span, L2_PERSIST_MAX );
+	CUDA_CHECK( cudaDeviceSetLimit( cudaLimitPersistingL2CacheSize, persisting ) );
+
+	value.accessPolicyWindow.base_ptr = const_cast< char* >( base );
+	value.accessPolicyWindow.num_bytes = span;
+	value.accessPolicyWindow.hitRatio = std::min( 1.0f, static_cast< float >( persisting ) / span );
+	value.accessPolicyWindow.hitProp = cudaAccessPropertyPersisting;
+	value.accessPolicyWindow.missProp = cudaAccessPropertyStreaming;
+	CUDA_CHECK( cudaStreamSetAttribute( stream, cudaStreamAttributeAccessPolicyWindow, &value ) );
+	L2_WINDOW = value.accessPolicyWindow;
+	L2_STREAM = stream;
+	GRAPH_VERSION++;															// Graphs captured before have no window
+}
+
+/*!
+ * @brief Build the runtime compiled grid advance of this context (kernel_set_rtc), if its constants changed since the last build.
+ * @param mesh_count Number of fishies.
+ * @param properties properties of the current device. NULL: queried.
+ */
+static void updateRtcAdvance(unsigned int mesh_count, const cudaDeviceProp* properties)
+{
+	if (!RTC_KERNELS)
+		return;
+
+	RtcAdvanceKey key;
+	key.params = h_params;
+	key.cellSize = GRID_LAYOUT.cellSize;
+	key.threads = LAUNCH_GRID.withThreads( TUNING.searchThreads ).forCount( mesh_count ).threads;
+	if (key == RTC_TRIED)
+		return;
+
+	RTC_TRIED = key;
+	if (RTC_ADVANCE != NULL)
+	{
+		CUDA_CHECK( cudaDeviceSynchronize() );					// No launch of the old module may be pending
+		delete RTC_ADVANCE;
+	}
+	cudaDeviceProp current;
+	if (properties == NULL)
+	{
+		int device = 0;
+		CUDA_CHECK( cudaGetDevice( &device ) );
+		CUDA_CHECK( cudaGetDeviceProperties( &current, device ) );
+		properties = &current;
+	}
+	RTC_ADVANCE = RtcAdvance::build( key, *properties, std::cout );
+}
+
+/*!
+ * @brief Check if the step can take the runtime compiled grid advance: classic behaviour without any optional feature.
+ * @param features AdvanceFeature flags of the step.
+ * @return true, if RTC_ADVANCE computes the same as d_advance_grid.
+ */
+static bool rtcAdvanceActive(unsigned int features)
+{
+#ifdef SWARM_PRECISE_MATH
+	return false;												// The source only has the float math
+#else
+	return RTC_KERNELS && RTC_ADVANCE != NULL && BEHAVIOUR == Behaviour::CLASSIC && features == 0 && !DETERMINISTIC && h_obstacles.texels.empty()
+		&& h_attractorSources.empty() && d_alarm == NULL && currentSlots.stream == NULL && !farFieldActive() && EVENTS.capacity == 0 && !SHARK_GRID && h_step.integrator == Integrator::LEGACY
+		&& GRID_LAYOUT.cellKeys == NULL
+		&& !timelineHas( TimelineAction::PARAM ) && !timelineHas( TimelineAction::ROUTE );	// Parameters folded in, swarm center from the host
+#endif
+}
+
+void kernel_advance(
+	ParticleArrays in,
+	ParticleArrays out,
+	unsigned int mesh_count,
+	float speed,
+	Vector3 swarmCenter,
+	const float4* sharks,
+	unsigned int shark_count,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_advance", NVTX_COLOR_SIMULATION );
+
+	cudaStreamCaptureStatus capture = cudaStreamCaptureStatusNone;
+	CUDA_CHECK( cudaStreamIsCapturing( stream, &capture ) );
+	if (capture != cudaStreamCaptureStatusActive)
+	{
+		uploadParams( stream );
+		uploadSchools( stream );
+	}
+
+	// Inputs of this step. They stay valid for kernel_move_sharks and kernel_respawn until the next step.
+	h_step.random.step++;
+	h_step.swarmCenter = swarmCenter.toSwarmVector().toFloat4();
+
+	// The sharks hunt in the grid of this step. Only the grid search and boids build one, they are never captured.
+	SHARK_GRID = SHARK_TARGET != SharkTarget::CENTER && shark_count > 0 && advanceUsesGrid( mesh_count );
+	SHARK_PREY = out;
+	QUERY_GRID = advanceUsesGrid( mesh_count );
+	ADVANCE_NEAREST = QUERY_GRID && BEHAVIOUR == Behaviour::CLASSIC && !DETERMINISTIC && WARM_START && SEARCH_FIRST_K == 0;	// The grid search stored them
+	SHARK_PREY_COUNT = mesh_count;
+	h_step.sharkBites = SHARK_GRID && SHARK_TARGET != SharkTarget::INTERCEPT ? 1 : 0;	// Intercepting sharks read no fishies
+	h_step.events = activeEventQueue();
+	if (capture != cudaStreamCaptureStatusActive)
+	{
+		advanceCurrent();
+		refillCurrent( stream );
+		waitCurrent( stream );
+	}
+	if (capture == cudaStreamCaptureStatusActive)
+	{
+		// Pageable memory can't be captured. The graph reads the slot, whatever it holds at the replay.
+		CUDA_CHECK( cudaMemcpyToSymbolAsync( c_step, h_capturedSteps->getData() + CAPTURE_SLOT, sizeof( StepInputs ), 0, cudaMemcpyHostToDevice, stream ) );
+		CAPTURE_SLOT++;
+	}
+	else
+	{
+		CUDA_CHECK( cudaMemcpyToSymbolAsync( c_step, &h_step, sizeof( StepInputs ), 0, cudaMemcpyHostToDevice, stream ) );
+	}
+	if (h_timeline.count > 0)
+		applyTimeline( stream );
+
+	// Few sharks fit into constant memory. The kernels read them from there, if sharks is NULL.
+	const float4* sharksGlobal = sharks;						// The runtime compiled kernel can't see c_sharks
+	if (shark_count <= MAX_CONSTANT_SHARKS)
+	{
+		CUDA_CHECK( cudaMemcpyToSymbolAsync( c_sharks, sharks, shark_count * sizeof( float4 ), 0, cudaMemcpyDeviceToDevice, stream ) );
+		sharks = NULL;
+	}
+
+	// The alarm of the last step spreads before the fishies sample it. Small launch over the cells, the field stays on the device.
+	if (d_alarm != NULL)
+	{
+		unsigned int cells = h_alarm.width * h_alarm.height * h_alarm.depth;
+		d_diffuseAlarm<<<iDivUp( cells, ALARM_THREADS ), ALARM_THREADS, 0, stream>>> ( cells );
+		CUDA_CHECK_LAUNCH( "d_diffuseAlarm", stream );
+	}
+
+	// All school centers move in one small launch before the fishies, there is no launch per school.
+	if (schoolsOnDevice())
+	{
+		d_moveSchools<<<1, MAX_SCHOOLS, 0, stream>>> ( speed );
+		CUDA_CHECK_LAUNCH( "d_moveSchools", stream );
+	}
+
+	// The tree of the far field covers the positions this step reads. Never captured, see kernel_can_capture.
+	if (farFieldActive() && mesh_count > 0)
+		buildFarField( in, mesh_count, stream );
+
+	unsigned int features = advanceFeatures();
+
+	// Boids need all neighbours inside the radius, only the grid finds them without O(N^2).
+	if (BEHAVIOUR == Behaviour::BOIDS)
+	{
+		buildGrid( in, mesh_count, GRID_LAYOUT, stream );
+		LaunchConfig boids = LAUNCH_BOIDS.withThreads( TUNING.searchThreads ).forCount( mesh_count );
+		if (MEAN_FIELD)
+		{
+			if (d_cellVelocity == NULL)
+			{
+				d_cellVelocity = new CudaDeviceArray<float4>( GRID_NUM_CELLS, MemoryCategory::NEIGHBOURS );
+				d_cellCentroid = new CudaDeviceArray<float4>( GRID_NUM_CELLS, MemoryCategory::NEIGHBOURS );
+			}
+			unsigned int numCells = gridCellCount( GRID_LAYOUT );
+			LaunchConfig cells = LAUNCH_HASH.forCount( numCells );
+			d_cellMeans<<<cells.blocks, cells.threads, 0, stream>>> (
+				d_cellVelocity->getData(), d_cellCentroid->getData(), d_sorted->getArrays(), d_cellStart->getData(), d_cellEnd->getData(), numCells );
+			CUDA_CHECK_LAUNCH( "d_cellMeans", stream );
+
+			BOIDS_MEAN_VARIANTS[features & SWIM_FEATURES]<<<boids.blocks, boids.threads, 0, stream>>> (
+				out,
+				d_sorted->getArrays(),
+				d_gridParticleIndex->getData(),
+				d_cellVelocity->getData(),
+				d_cellCentroid->getData(),
+				mesh_count,
+				GRID_LAYOUT,
+				speed * 1.8,
+				sharks,
+				shark_count );
+			CUDA_CHECK_LAUNCH( "d_advance_boids_mean", stream );
+			return;
+		}
+		BOIDS_VARIANTS[features & SWIM_FEATURES]<<<boids.blocks, boids.threads, 0, stream>>> (
+			out,
+			d_sorted->getArrays(),
+			d_gridParticleIndex->getData(),
+			d_cellStart->getData(),
+			d_cellEnd->getData(),
+			mesh_count,
+			GRID_LAYOUT,
+			speed * 1.8,
+			sharks,
+			shark_count );
+		CUDA_CHECK_LAUNCH( "d_advance_boids", stream );
+		return;
+	}
+
+	SearchMode mode = kernel_get_search_mode( mesh_count );
+
+	// Without sharks nobody evades, the split would only cost the extra launch.
+	if (mode == SearchMode::BRUTE_FORCE && EVASION_SPLIT && shark_count > 0)
+	{
+		CUDA_CHECK( cudaMemsetAsync( d_flockCount->getData(), 0, sizeof( unsigned int ), stream ) );
+		LaunchConfig classify = LAUNCH_CLASSIFY.forCount( mesh_count );
+		CLASSIFY_VARIANTS[features & SWIM_FEATURES]<<<classify.blocks, classify.threads, 0, stream>>> (
+			in, out, mesh_count, speed * 1.8, sharks, shark_count, d_flockList->getData(), d_flockCount->getData() );
+		CUDA_CHECK_LAUNCH( "d_classifyEvaders", stream );
+
+		// The number of flocking fishies stays on the device, the grid covers all of them.
+		LaunchConfig advance = LAUNCH_ADVANCE.forCount( mesh_count );
+		FLOCKING_VARIANTS[features & QUERY_FEATURES]<<<advance.blocks, advance.threads, 0, stream>>> (
+			in, out, mesh_count, speed * 1.8, sharks, shark_count, d_flockList->getData(), d_flockCount->getData(), SEARCH_FIRST_K );
+		CUDA_CHECK_LAUNCH( "d_advance_flocking", stream );
+		return;
+	}
+
+	if (mode == SearchMode::BRUTE_FORCE)
+	{
+		LaunchConfig advance = LAUNCH_ADVANCE.withThreads( TUNING.searchThreads ).forCount( mesh_count );
+		ADVANCE_VARIANTS[features & QUERY_FEATURES]<<<advance.blocks, advance.threads, 0, stream>>> ( in, out, mesh_count, speed * 1.8, sharks, shark_count, SEARCH_FIRST_K );
+		CUDA_CHECK_LAUNCH( "d_advance", stream );
+		return;
+	}
+
+	if (mode == SearchMode::WARP)
+	{
+		LaunchConfig warp = LAUNCH_WARP.withThreads( TUNING.searchThreads ).forCount( mesh_count * WARP_SIZE );
+		WARP_VARIANTS[features & SWIM_FEATURES]<<<warp.blocks, warp.threads, 0, stream>>> ( in, out, mesh_count, speed * 1.8, sharks, shark_count );
+		CUDA_CHECK_LAUNCH( "d_advance_warp", stream );
+		return;
+	}
+
+	if (mode == SearchMode::TENSOR)
+	{
+		LaunchConfig tensor = tensorLaunch( mesh_count );
+		TENSOR_VARIANTS[features & SWIM_FEATURES]<<<tensor.blocks, tensor.threads, 0, stream>>> ( in, out, mesh_count, speed * 1.8, sharks, shark_count );
+		CUDA_CHECK_LAUNCH( "d_advance_tensor", stream );
+		return;
+	}
+
+	if (mode == SearchMode::VERLET)
+	{
+		advanceVerlet( in, out, mesh_count, speed, sharks, shark_count, stream );
+		return;
+	}
+
+	if (mode == SearchMode::TILED)
+	{
+		if (ASYNC_TILES)
+		{
+			LaunchConfig tiled = LAUNCH_TILED_ASYNC.withThreads( TUNING.searchThreads ).forCount( mesh_count );
+			TILED_ASYNC_VARIANTS[features & QUERY_FEATURES]<<<tiled.blocks, tiled.threads, tiled.sharedMemory, stream>>> ( in, out, mesh_count, speed * 1.8, sharks, shark_count, SEARCH_FIRST_K );
+			CUDA_CHECK_LAUNCH( "d_advance_tiled_async", stream );
+			return;
+		}
+		LaunchConfig tiled = LAUNCH_TILED.withThreads( TUNING.searchThreads ).forCount( mesh_count );
+		TILED_VARIANTS[features & QUERY_FEATURES]<<<tiled.blocks, tiled.threads, tiled.sharedMemory, stream>>> ( in, out, mesh_count, speed * 1.8, sharks, shark_count, SEARCH_FIRST_K );
+		CUDA_CHECK_LAUNCH( "d_advance_tiled", stream );
+		return;
+	}
+
+	// Unimportant fishies wait for their turn, the buckets need the grid of this step first.
+	if (MULTI_RATE.interval > 1)
+	{
+		advanceRates( in, out, mesh_count, speed, sharks, shark_count, features, stream );
+		return;
+	}
+
+	// One launch per step. A captured graph already replays the launches of buildGrid without host work.
+	if (COOPERATIVE_GRID && !DETERMINISTIC && COOPERATIVE_BLOCKS > 0 && capture != cudaStreamCaptureStatusActive && GRID_LAYOUT.cellKeys == NULL)	// Cells are filled by atomics
+	{
+		advanceCooperative( in, out, mesh_count, speed, sharks, shark_count, features, stream );
+		return;
+	}
+
+	if (capture != cudaStreamCaptureStatusActive)
+		updateL2Window( stream );
+	buildGrid( in, mesh_count, GRID_LAYOUT, stream, PACKED_POSITIONS );
+
+	// Same step with the constants of the scenario folded in. Never rebuilt while a graph is captured.
+	if (capture != cudaStreamCaptureStatusActive)
+		updateRtcAdvance( mesh_count, NULL );
+	if (rtcAdvanceActive( features ))
+	{
+		WarmStart warm = warmStart( in, mesh_count );
+		RTC_ADVANCE->launch(
+			out,
+			d_sorted->getArrays(),
+			d_gridParticleIndex->getData(),
+			d_cellStart->getData(),
+			d_cellEnd->getData(),
+			mesh_count,
+			GRID_LAYOUT.origin,
+			GRID_LAYOUT.dims,
+			speed * 1.8,
+			h_step.swarmCenter,
+			sharksGlobal,
+			shark_count,
+			warm.particles,
+			warm.count,
+			warm.nearest,
+			stream );
+		CUDA_CHECK_LAUNCH( "d_advance_rtc", stream );
+		return;
+	}
+
+	// One block per cell, the candidates of its 27 cells come from shared memory. Hashed cells have no coordinates to walk.
+	if (mode == SearchMode::CELL && SEARCH_FIRST_K == 0 && GRID_LAYOUT.cellKeys == NULL)
+	{
+		LaunchConfig cells = cellLaunch();
+		CELL_VARIANTS[features & SWIM_FEATURES]<<<cells.blocks, cells.threads, 0, stream>>> (
+			out,
+			d_sorted->getArrays(),
+			d_gridParticleIndex->getData(),
+			d_cellStart->getData(),
+			d_cellEnd->getData(),
+			GRID_LAYOUT,
+			speed * 1.8,
+			sharks,
+			shark_count,
+			warmStart( in, mesh_count ) );
+		CUDA_CHECK_LAUNCH( "d_advance_cell", stream );
+		return;
+	}
+
+	// Hopper: the cells of a cluster come from distributed shared memory. The clusters are cubes of the wrapped grid.
+	if (CLUSTER_SEARCH && CLUSTER_CELLS && GRID_LAYOUT.cellKeys == NULL)
+	{
+		advanceCluster( out, speed, sharks, shark_count, features, stream );
+		return;
+	}
+
+	// Clustered swarm: fishies of dense cells get a warp each, the others the usual thread. The list stays on the device.
+	LaunchConfig grid = LAUNCH_GRID.withThreads( TUNING.searchThreads ).forCount( mesh_count );
+	if (DENSE_CANDIDATES > 0 && SEARCH_FIRST_K == 0)
+	{
+		WarmStart warm = warmStart( in, mesh_count );
+		CUDA_CHECK( cudaMemsetAsync( d_flockCount->getData(), 0, sizeof( unsigned int ), stream ) );
+		SPARSE_VARIANTS[features & GRID_FEATURES]<<<grid.blocks, grid.threads, 0, stream>>> (
+			out,
+			d_sorted->getArrays(),
+			d_gridParticleIndex->getData(),
+			d_cellStart->getData(),
+			d_cellEnd->getData(),
+			mesh_count,
+			GRID_LAYOUT,
+			speed * 1.8,
+			sharks,
+			shark_count,
+			SEARCH_FIRST_K,
+			PACKED_POSITIONS ? d_sortedPacked->getData() : NULL,
+			warm,
+			DENSE_CANDIDATES,
+			d_flockList->getData(),
+			d_flockCount->getData() );
+		CUDA_CHECK_LAUNCH( "d_advance_sparse", stream );
+
+		LaunchConfig dense = LAUNCH_WARP.forCount( std::min( mesh_count, DENSE_WARPS ) * WARP_SIZE );
+		DENSE_VARIANTS[features & SWIM_FEATURES]<<<dense.blocks, dense.threads, 0, stream>>> (
+			out,
+			d_sorted->getArrays(),
+			d_gridParticleIndex->getData(),
+			d_cellStart->getData(),
+			d_cellEnd->getData(),
+			GRID_LAYOUT,
+			speed * 1.8,
+			sharks,
+			shark_count,
+			warm,
+			d_flockList->getData(),
+			d_flockCount->getData() );
+		CUDA_CHECK_LAUNCH( "d_advance_dense", stream );
+		return;
+	}
+
+	// KERNEL CALL
+	GRID_VARIANTS[features & GRID_FEATURES]<<<grid.blocks, grid.threads, 0, stream>>> (
+		out,
+		d_sorted->getArrays(),
+		d_gridParticleIndex->getData(),
+		d_cellStart->getData(),
+		d_cellEnd->getData(),
+		mesh_count,
+		GRID_LAYOUT,
+		speed * 1.8,
+		sharks,
+		shark_count,
+		SEARCH_FIRST_K,
+		PACKED_POSITIONS ? d_sortedPacked->getData() : NULL,
+		warmStart( in, mesh_count ) );
+	CUDA_CHECK_LAUNCH( "d_advance_grid", stream );
+}
+
+/*!
+ * @brief Check if kernel_resolve_collisions has work.
+ * @return true, if kernel_set_collisions enabled the pass.
+ */
+static bool collisionsActive()
+{
+	return COLLISION_ITERATIONS > 0 && COLLISION_RADIUS > 0.0f;
+}
+
+void kernel_resolve_collisions(ParticleArrays particles, unsigned int mesh_count, cudaStream_t stream)
+{
+	if (!collisionsActive() || mesh_count == 0)
+		return;
+
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_resolve_collisions", NVTX_COLOR_SIMULATION );
+	if (d_collisionPositions == NULL || d_collisionPositions->getSize() < mesh_count)
+	{
+		delete d_collisionPositions;
+		delete d_collisionDeltas;
+		d_collisionPositions = new CudaDeviceArray<float4>( mesh_count, MemoryCategory::SCRATCH );
+		d_collisionDeltas = new CudaDeviceArray<float4>( mesh_count, MemoryCategory::SCRATCH );
+	}
+
+	// The grid of the new positions, the advance built its grid from the positions before the step.
+	buildGrid( particles, mesh_count, GRID_LAYOUT, stream );
+	float radius = std::min( COLLISION_RADIUS, GRID_LAYOUT.cellSize );	// Partners further away than a cell would be missed
+	LaunchConfig launch = LAUNCH_HASH.forCount( mesh_count );
+	d_loadCollisions<<<launch.blocks, launch.threads, 0, stream>>> ( d_collisionPositions->getData(), d_sorted->getArrays(), mesh_count );
+	CUDA_CHECK_LAUNCH( "d_loadCollisions", stream );
+	for (unsigned int k = 0; k < COLLISION_ITERATIONS; k++)
+	{
+		d_collide<<<launch.blocks, launch.threads, 0, stream>>> (
+			d_collisionDeltas->getData(), d_collisionPositions->getData(), d_cellStart->getData(), d_cellEnd->getData(), mesh_count, GRID_LAYOUT, radius );
+		CUDA_CHECK_LAUNCH( "d_collide", stream );
+		d_applyCollisions<<<launch.blocks, launch.threads, 0, stream>>> (
+			d_collisionPositions->getData(), d_collisionDeltas->getData(), particles, d_gridParticleIndex->getData(), mesh_count, k + 1 == COLLISION_ITERATIONS );
+		CUDA_CHECK_LAUNCH( "d_applyCollisions", stream );
+	}
+}
+
+/*!
+ * @brief Dynamic shared memory of d_advance_substeps.
+ * @param mesh_count Number of fishies.
+ * @param shark_count Number of sharks.
+ * @return bytes.
+ */
+static size_t substepSharedBytes(unsigned int mesh_count, unsigned int shark_count)
+{
+	return ( 3 * static_cast< size_t >( mesh_count ) + 2 * shark_count ) * sizeof( float4 );
+}
+
+bool kernel_can_substep(unsigned int mesh_count, unsigned int shark_count, unsigned int steps)
+{
+	if (steps == 0 || steps > MAX_SUBSTEPS || BEHAVIOUR == Behaviour::BOIDS || schoolsOnDevice() || DETERMINISTIC || collisionsActive())
+		return false;
+
+	// Hunting sharks, the current, the event log and the tree of the far field need the host between two steps.
+	if (( SHARK_TARGET != SharkTarget::CENTER && shark_count > 0 ) || currentSlots.stream != NULL || EVENTS.capacity > 0 || farFieldActive())
+		return false;
+	if (h_timeline.count > 0)
+		return false;											// The steps of a launch read no c_step, the timeline can't change them
+	return substepSharedBytes( mesh_count, shark_count ) <= SUBSTEP_SHARED;
+}
+
+void kernel_advance_substeps(
+	ParticleArrays in,
+	ParticleArrays out,
+	unsigned int mesh_count,
+	float speed,
+	const Vector3* swarmCenters,
+	unsigned int steps,
+	float4* sharks,
+	float4* sharkStates,
+	unsigned int shark_count,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_advance_substeps", NVTX_COLOR_SIMULATION );
+
+	uploadParams( stream );
+
+	SubstepInputs inputs;
+	inputs.firstStep = h_step.random.step + 1;
+	inputs.steps = steps;
+	for (unsigned int s = 0; s < steps; s++)
+		inputs.swarmCenter[s] = make_float4( swarmCenters[s].x, swarmCenters[s].y, swarmCenters[s].z, 0.0f );
+
+	// Afterwards c_step holds the last step, like after the same number of kernel_advance. The kernel only reads the seed.
+	h_step.random.step += steps;
+	h_step.swarmCenter = inputs.swarmCenter[steps - 1];
+	h_step.sharkBites = 0;
+	h_step.events = activeEventQueue();
+	SHARK_GRID = false;
+	QUERY_GRID = false;
+	ADVANCE_NEAREST = false;
+	CUDA_CHECK( cudaMemcpyToSymbolAsync( c_step, &h_step, sizeof( StepInputs ), 0, cudaMemcpyHostToDevice, stream ) );
+
+	size_t shared = substepSharedBytes( mesh_count, shark_count );
+	SUBSTEP_VARIANTS[advanceFeatures() & QUERY_FEATURES]<<<1, SUBSTEP_THREADS, shared, stream>>> (
+		in, out, mesh_count, speed * 1.8f, speed, sharks, sharkStates, shark_count, SEARCH_FIRST_K, inputs );
+	CUDA_CHECK_LAUNCH( "d_advance_substeps", stream );
+}
+
+/*!
+ * @brief Print one line of kernel_print_resources.
+ * @param os output stream.
+ * @param name name of the kernel.
+ * @param kernel kernel function.
+ * @param config launch configuration of the kernel.
+ * @param properties properties of the device.
+ */
+template<class Kernel>
+static void printKernelResources(std::ostream& os, const std::string& name, Kernel kernel, const LaunchConfig& config, const cudaDeviceProp& properties)
+{
+	cudaFuncAttributes attributes;
+	CUDA_CHECK( cudaFuncGetAttributes( &attributes, kernel ) );
+	os << std::left << std::setw( 32 ) << name << std::right
+		<< std::setw( 8 ) << config.threads
+		<< std::setw( 6 ) << attributes.numRegs
+		<< std::setw( 7 ) << attributes.localSizeBytes
+		<< std::setw( 8 ) << attributes.sharedSizeBytes + config.sharedMemory
+		<< std::setw( 7 ) << static_cast< int >( theoreticalOccupancy( kernel, config, properties ) * 100.0f + 0.5f ) << " %\n";
+}
+
+/*!
+ * @brief Print the lines of all variants of an advance kernel, named kernel<features>.
+ * @param os output stream.
+ * @param name name of the kernel template.
+ * @param variants variant table, indexed by the AdvanceFeature flags.
+ * @param config launch configuration of the kernel.
+ * @param properties properties of the device.
+ */
+template<class Kernel, size_t N>
+static void printVariantResources(std::ostream& os, const char* name, Kernel const (&variants)[N], const LaunchConfig& config, const cudaDeviceProp& properties)
+{
+	for (size_t features = 0; features < N; features++)
+		printKernelResources( os, std::string( name ) + "<" + std::to_string( features ) + ">", variants[features], config, properties );
+}
+
+bool kernel_check_binary(std::ostream& os, const cudaDeviceProp& properties)
+{
+	cudaFuncAttributes attributes;
+	CUDA_CHECK( cudaFuncGetAttributes( &attributes, d_calcHash ) );				// All kernels are in the same fatbin
+	int device = properties.major * 10 + properties.minor;
+	bool jit = attributes.binaryVersion != attributes.ptxVersion;
+	if ( jit )
+	{
+		os << "No SASS for sm_" << device << " in the build, the driver compiled the PTX of compute_" << attributes.ptxVersion
+			<< " (once per machine with the compute cache). Add sm_" << device << " to CodeGeneration.\n";
+	}
+	else
+		os << "Kernels: SASS of sm_" << attributes.binaryVersion << " on sm_" << device << "\n";
+	return jit;
+}
+
+void kernel_print_resources(std::ostream& os, unsigned int mesh_count, const cudaDeviceProp& properties)
+{
+	os << "Kernel resources on " << properties.name << " for " << mesh_count << " fishies"
+		<< " (variants <features>: " << FEATURE_JITTER << " jitter, " << FEATURE_SCHOOLS << " schools, " << FEATURE_SPECIES << " species, "
+		<< FEATURE_FIRST_K << " first k, " << FEATURE_PACKED << " packed; current " << advanceFeatures() << "):\n";
+	os << std::left << std::setw( 32 ) << "Kernel" << std::right
+		<< std::setw( 8 ) << "Threads" << std::setw( 6 ) << "Regs" << std::setw( 7 ) << "Local" << std::setw( 8 ) << "Shared" << std::setw( 9 ) << "Occupancy" << "\n";
+
+	printVariantResources( os, "d_advance", ADVANCE_VARIANTS, LAUNCH_ADVANCE.forCount( mesh_count ), properties );
+	printVariantResources( os, "d_classifyEvaders", CLASSIFY_VARIANTS, LAUNCH_CLASSIFY.forCount( mesh_count ), properties );
+	printVariantResources( os, "d_advance_flocking", FLOCKING_VARIANTS, LAUNCH_ADVANCE.forCount( mesh_count ), properties );
+	printVariantResources( os, "d_advance_tiled", TILED_VARIANTS, LAUNCH_TILED.forCount( mesh_count ), properties );
+	if (CLUSTER_CELLS)
+		printVariantResources( os, "d_advance_cluster", CLUSTER_VARIANTS, clusterLaunch(), properties );
+	if (ASYNC_TILES)
+		printVariantResources( os, "d_advance_tiled_async", TILED_ASYNC_VARIANTS, LAUNCH_TILED_ASYNC.forCount( mesh_count ), properties );
+	printVariantResources( os, "d_advance_ensemble", ENSEMBLE_VARIANTS, LAUNCH_ENSEMBLE.forCount( mesh_count ), properties );
+	printVariantResources( os, "d_advance_warp", WARP_VARIANTS, LAUNCH_WARP.forCount( mesh_count * WARP_SIZE ), properties );
+	printVariantResources( os, "d_advance_tensor", TENSOR_VARIANTS, tensorLaunch( mesh_count ), properties );
+	printVariantResources( os, "d_advance_verlet", VERLET_VARIANTS, LAUNCH_VERLET.forCount( mesh_count ), properties );
+	printVariantResources( os, "d_advance_grid", GRID_VARIANTS, LAUNCH_GRID.forCount( mesh_count ), properties );
+	printVariantResources( os, "d_advance_sparse", SPARSE_VARIANTS, LAUNCH_GRID.forCount( mesh_count ), properties );
+	printVariantResources( os, "d_advance_dense", DENSE_VARIANTS, LAUNCH_WARP.forCount( std::min( mesh_count, DENSE_WARPS ) * WARP_SIZE ), properties );
+	printVariantResources( os, "d_advance_cell", CELL_VARIANTS, cellLaunch(), properties );
+	printVariantResources( os, "d_advance_bucket", BUCKET_VARIANTS, LAUNCH_GRID.forCount( mesh_count ), properties );
+	printKernelResources( os, "d_classifyRates", d_classifyRates, LAUNCH_RATES.forCount( mesh_count ), properties );
+	printVariantResources( os, "d_advance_boids", BOIDS_VARIANTS, LAUNCH_BOIDS.forCount( mesh_count ), properties );
+	printVariantResources( os, "d_advance_boids_mean", BOIDS_MEAN_VARIANTS, LAUNCH_BOIDS.forCount( mesh_count ), properties );
+	printKernelResources( os, "d_calcHash", d_calcHash, LAUNCH_HASH.forCount( mesh_count ), properties );
+	printKernelResources( os, "d_reorderDataAndFindCellStart", d_reorderDataAndFindCellStart, LAUNCH_REORDER.forCount( mesh_count ), properties );
+	printKernelResources( os, "d_buildVerlet", d_buildVerlet, LAUNCH_VERLET_BUILD.forCount( mesh_count ), properties );
+	printKernelResources( os, "d_bvhLeaves", d_bvhLeaves, LAUNCH_BVH_LEAVES.forCount( mesh_count ), properties );
+	printKernelResources( os, "d_bvhInternal", d_bvhInternal, LAUNCH_BVH_INTERNAL.forCount( mesh_count ), properties );
+	printKernelResources( os, "d_bvhMerge", d_bvhMerge, LAUNCH_BVH_MERGE.forCount( mesh_count ), properties );
+	printKernelResources( os, "d_moveSharks", d_moveSharks, LAUNCH_SHARKS, properties );
+	printKernelResources( os, "d_huntSharks", d_huntSharks, LAUNCH_HUNT, properties );
+	printKernelResources( os, "d_pack", d_pack, LAUNCH_PACK.forCount( mesh_count ), properties );
+	printKernelResources( os, "d_reduceStats", d_reduceStats, LAUNCH_STATS.forCount( mesh_count ), properties );
+	printKernelResources( os, "d_packStats", d_packStats, LAUNCH_STATS.forCount( mesh_count ), properties );
+
+	// Local memory holds register spills and the stack. The build log (ptxas -v) shows the spill stores and loads separately.
+	os << "Local: bytes of local memory per thread (spills and stack), Shared: static and dynamic bytes per block.\n";
+}
+
+float kernel_occupancy(unsigned int mesh_count, const cudaDeviceProp& properties)
+{
+	unsigned int features = advanceFeatures();
+	if (BEHAVIOUR == Behaviour::BOIDS && MEAN_FIELD)
+		return theoreticalOccupancy( BOIDS_MEAN_VARIANTS[features & SWIM_FEATURES], LAUNCH_BOIDS.forCount( mesh_count ), properties );
+	if (BEHAVIOUR == Behaviour::BOIDS)
+		return theoreticalOccupancy( BOIDS_VARIANTS[features & SWIM_FEATURES], LAUNCH_BOIDS.forCount( mesh_count ), properties );
+
+	SearchMode mode = SEARCH_MODE;
+	if (mode == SearchMode::AUTO)
+		mode = mesh_count < TILED_SEARCH_THRESHOLD ? SearchMode::TILED : SearchMode::GRID;
+	if (mode == SearchMode::TENSOR && ( !TENSOR_CORES || SEARCH_FIRST_K > 0 ))
+		mode = SearchMode::TILED;
+
+	switch (mode)
+	{
+	case SearchMode::BRUTE_FORCE:
+		return theoreticalOccupancy( ADVANCE_VARIANTS[features & QUERY_FEATURES], LAUNCH_ADVANCE.forCount( mesh_count ), properties );
+	case SearchMode::WARP:
+		return theoreticalOccupancy( WARP_VARIANTS[features & SWIM_FEATURES], LAUNCH_WARP.forCount( mesh_count * WARP_SIZE ), properties );
+	case SearchMode::TENSOR:
+		return theoreticalOccupancy( TENSOR_VARIANTS[features & SWIM_FEATURES], tensorLaunch( mesh_count ), properties );
+	case SearchMode::TILED:
+		if (ASYNC_TILES)
+			return theoreticalOccupancy( TILED_ASYNC_VARIANTS[features & QUERY_FEATURES], LAUNCH_TILED_ASYNC.forCount( mesh_count ), properties );
+		return theoreticalOccupancy( TILED_VARIANTS[features & QUERY_FEATURES], LAUNCH_TILED.forCount( mesh_count ), properties );
+	case SearchMode::VERLET:
+		return theoreticalOccupancy( VERLET_VARIANTS[features & QUERY_FEATURES], LAUNCH_VERLET.forCount( mesh_count ), properties );
+	case SearchMode::CELL:
+		return theoreticalOccupancy( CELL_VARIANTS[features & SWIM_FEATURES], cellLaunch(), properties );
+	default:
+		return theoreticalOccupancy( GRID_VARIANTS[features & GRID_FEATURES], LAUNCH_GRID.forCount( mesh_count ), properties );
+	}
+}
+
+void kernel_set_params(const SwarmParams& params)
+{
+	if (memcmp( &params, &h_params, sizeof( SwarmParams ) ) == 0)
+		return;
+
+	if (( params.jitter > 0.0f ) != ( h_params.jitter > 0.0f ))
+		GRAPH_VERSION++;										// Other kernel variant, see advanceFeatures
+
+	h_params = params;
+	h_paramsDirty = true;
+	PARAMS_VERSION++;
+	VERLET_VALID = false;										// List radius may have changed.
+	GRID_LAYOUT.cellSize = params.fishDist * TUNING.cellScale;	// Every fish inside fishDist has to be in the 27 searched cells.
+}
+
+/*!
+ * @brief Fill the arc length table of a route of the spline path: SPLINE_SAMPLES parameters per segment at evenly spaced distances,
+ * from chords of SPLINE_FINE_STEPS per segment.
+ * @param path routes and points. samples and lengths of the school are set.
+ * @param school school of the route.
+ */
+static void buildSplineTable(WaypointPath& path, unsigned int school)
+{
+	uint2 route = path.routes[school];
+	unsigned int first = school == 0 ? 0 : path.samples[school - 1].x + path.samples[school - 1].y;
+	unsigned int count = route.y * SPLINE_SAMPLES;
+	path.samples[school] = make_uint2( first, count );
+	path.lengths[school] = 0.0f;
+	if (route.y < 2)
+		return;
+
+	std::vector<float> arc( route.y * SPLINE_FINE_STEPS + 1, 0.0f );		// Distance at parameter i / SPLINE_FINE_STEPS
+	float3 last = splinePoint( path.points, route, 0.0f );
+	for (size_t i = 1; i < arc.size(); i++)
+	{
+		float3 p = splinePoint( path.points, route, static_cast< float >( i ) / SPLINE_FINE_STEPS );
+		float dx = p.x - last.x, dy = p.y - last.y, dz = p.z - last.z;
+		arc[i] = arc[i - 1] + sqrtf( dx * dx + dy * dy + dz * dz );
+		last = p;
+	}
+
+	float length = arc.back();
+	size_t j = 0;
+	for (unsigned int k = 0; k < count; k++)
+	{
+		float wanted = length * k / count;
+		while (j + 2 < arc.size() && arc[j + 1] < wanted)
+			j++;
+		float chord = arc[j + 1] - arc[j];
+		float fraction = chord > 0.0f ? ( wanted - arc[j] ) / chord : 0.0f;
+		h_splineTable[first + k] = ( j + fraction ) / SPLINE_FINE_STEPS;
+	}
+	path.lengths[school] = length;
+}
+
+void kernel_set_schools(const std::vector<std::vector<Vector3>>& routes, bool spline)
+{
+	WaypointPath path = {};
+	path.spline = spline ? 1 : 0;
+	unsigned int schools = std::min( static_cast< unsigned int >( routes.size() ), MAX_SCHOOLS );
+	for (unsigned int school = 0; school < schools; school++)
+	{
+		// Constant memory holds a fixed number of waypoints, the schools after a full path are dropped.
+		unsigned int length = std::min( static_cast< unsigned int >( routes[school].size() ), MAX_WAYPOINTS - path.count );
+		if (length == 0)
+			break;
+
+		path.routes[school] = make_uint2( path.count, length );
+		for (unsigned int i = 0; i < length; i++)
+			path.points[path.count + i] = make_float4( routes[school][i].x, routes[school][i].y, routes[school][i].z, 1.0f );
+		h_schoolTable[school].center = make_float4( routes[school][0].x, routes[school][0].y, routes[school][0].z, 0.0f );	// Starts on its first waypoint, like swarmCenter
+		h_schoolTable[school].cursor = 0;
+		h_schoolTable[school].distance = 0.0f;
+		path.count += length;
+		path.schools = school + 1;
+		if (spline)
+			buildSplineTable( path, school );
+	}
+
+	bool wasOnDevice = schoolsOnDevice();
+	h_path = path;
+	if (schoolsOnDevice() != wasOnDevice)
+		GRAPH_VERSION++;										// d_moveSchools and other kernel variants, see advanceFeatures
+
+	h_paramsDirty = true;										// Routes are uploaded with the parameters, also into the other contexts
+	PARAMS_VERSION++;
+	h_schoolsDirty = true;
+	SCHOOLS_VERSION++;
+}
+
+void kernel_set_species(const std::vector<SpeciesParams>& species)
+{
+	SpeciesTable table = { 1, { 1.0f }, 1.0f, { SpeciesParams::defaults() } };
+	unsigned int count = std::min( static_cast< unsigned int >( species.size() ), MAX_SPECIES );
+	float total = 0.0f;
+	for (unsigned int s = 0; s < count; s++)
+		total += species[s].share;
+	if (count > 0 && total > 0.0f)
+	{
+		float bound = 0.0f;
+		table.count = count;
+		table.reach = 0.0f;
+		for (unsigned int s = 0; s < count; s++)
+		{
+			bound += species[s].share / total;
+			table.bounds[s] = bound;
+			table.params[s] = species[s];
+			table.reach = std::max( table.reach, species[s].fear * species[s].massMax );
+		}
+		table.bounds[count - 1] = 1.0f;							// No gap from rounding above the last bound
+	}
+
+	if (( table.count > 1 ) != ( h_species.count > 1 ))
+		GRAPH_VERSION++;										// Other kernel variants, see advanceFeatures
+	h_species = table;
+	h_paramsDirty = true;										// Uploaded with the parameters, also into the other contexts
+	PARAMS_VERSION++;
+}
+
+void kernel_set_far_field(float cohesion, float alignment, float theta)
+{
+	FAR_COHESION = cohesion;
+	FAR_ALIGNMENT = alignment;
+	FAR_THETA = theta;
+	h_paramsDirty = true;										// Switched off: uploaded with the parameters, also into the other contexts
+	PARAMS_VERSION++;
+	GRAPH_VERSION++;
+}
+
+void kernel_set_current(const CurrentVolume& volume, float strength, unsigned int period)
+{
+	delete h_currentTexels;
+	h_currentTexels = NULL;
+	h_current = volume;
+	h_current.texels.clear();
+	if (volume.width > 0 && volume.slices > 0)
+	{
+		// Converted to half once. Portable, every context copies its refills from here.
+		size_t samples = volume.texels.size() / 3;
+		h_currentTexels = new CudaHostArray<__half>( samples * 4, cudaHostAllocPortable );
+		__half* texel = h_currentTexels->getData();
+		for (size_t i = 0; i < samples; i++)
+		{
+			texel[4 * i + 0] = __float2half( volume.texels[3 * i + 0] );
+			texel[4 * i + 1] = __float2half( volume.texels[3 * i + 1] );
+			texel[4 * i + 2] = __float2half( volume.texels[3 * i + 2] );
+			texel[4 * i + 3] = __float2half( 0.0f );
+		}
+	}
+	CURRENT_STRENGTH = strength;
+	CURRENT_PERIOD = std::max( period, MAX_CAPTURED_STEPS );		// At most one new slice per graph
+	CURRENT_FIELD_VERSION++;
+	h_paramsDirty = true;										// Uploaded with the parameters, also into the other contexts
+	PARAMS_VERSION++;
+}
+
+void kernel_set_timeline(const std::vector<TimelineEvent>& events)
+{
+	h_timeline.count = static_cast< unsigned int >( std::min( events.size(), static_cast< size_t >( MAX_TIMELINE_EVENTS ) ) );
+	h_timeline.actions = 0;
+	for (unsigned int e = 0; e < h_timeline.count; e++)
+	{
+		h_timeline.events[e] = events[e];
+		h_timeline.actions |= 1u << static_cast< unsigned int >( events[e].action );
+	}
+	h_paramsDirty = true;										// Uploaded with the parameters, also into the other contexts
+	PARAMS_VERSION++;
+	GRAPH_VERSION++;											// Launches and copies of applyTimeline, kernel parameter of d_spawn
+}
+
+void kernel_set_alarm(const AlarmField& field)
+{
+	h_alarm = field;
+	ALARM_VERSION++;
+	GRAPH_VERSION++;											// d_diffuseAlarm joins or leaves the steps, its cell count is a kernel parameter
+	h_paramsDirty = true;										// Uploaded with the parameters, also into the other contexts
+	PARAMS_VERSION++;
+}
+
+void kernel_set_attractors(const AttractorVolume& volume)
+{
+	h_attractors = volume;
+	h_attractorSources.clear();
+	for (const Attractor& attractor : volume.attractors)
+	{
+		AttractorSource source;
+		source.center = make_float4( attractor.position.x, attractor.position.y, attractor.position.z, 1.0f / attractor.radius );
+		source.strength = attractor.strength;
+		h_attractorSources.push_back( source );
+	}
+	ATTRACTORS_VERSION++;
+	h_paramsDirty = true;										// Uploaded with the parameters, also into the other contexts
+	PARAMS_VERSION++;
+}
+
+void kernel_set_obstacles(const ObstacleVolume& volume, float range)
+{
+	h_obstacles = volume;
+	OBSTACLE_RANGE = range;
+	OBSTACLES_VERSION++;
+	h_paramsDirty = true;										// Uploaded with the parameters, also into the other contexts
+	PARAMS_VERSION++;
+}
+
+unsigned int kernel_get_schools()
+{
+	return h_path.schools;
+}
+
+void kernel_set_grid_bounds(const SwarmStats& stats)
+{
+	if (stats.liveCount == 0)
+		return;
+
+	// The bounds can be some steps old, the margin keeps the fishies which moved meanwhile inside.
+	float cellSize = GRID_LAYOUT.cellSize;
+	float margin = 2.0f * cellSize;
+	float lower[3] = { stats.boundsMin.x, stats.boundsMin.y, stats.boundsMin.z };
+	float upper[3] = { stats.boundsMax.x, stats.boundsMax.y, stats.boundsMax.z };
+	int dims[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		// At least 3 cells, otherwise the 27 searched cells would visit a bucket twice.
+		float cells = ceilf( ( upper[axis] - lower[axis] + 2.0f * margin ) / cellSize );
+		dims[axis] = static_cast< int >( std::min( std::max( cells, 3.0f ), static_cast< float >( GRID_SIZE ) ) );
+	}
+
+	GRID_LAYOUT.origin = make_float3( lower[0] - margin, lower[1] - margin, lower[2] - margin );
+	GRID_LAYOUT.dims = make_int3( dims[0], dims[1], dims[2] );
+}
+
+SwarmParams kernel_get_params()
+{
+	return h_params;
+}
+
+void kernel_set_seed(unsigned long long seed)
+{
+	h_step.random.seed = seed;
+	h_step.random.step = 0;
+}
+
+void kernel_set_spawn_box(const Vector3& boxMin, const Vector3& boxMax)
+{
+	SPAWN_MIN = make_float3( boxMin.x, boxMin.y, boxMin.z );
+	SPAWN_MAX = make_float3( boxMax.x, boxMax.y, boxMax.z );
+	GRAPH_VERSION++;											// Kernel parameters of d_spawn
+}
+
+unsigned int kernel_get_random_step()
+{
+	return h_step.random.step;
+}
+
+void kernel_set_random_step(unsigned int step)
+{
+	h_step.random.step = step;
+}
+
+void kernel_set_behaviour(Behaviour behaviour)
+{
+	BEHAVIOUR = behaviour;
+	GRAPH_VERSION++;
+}
+
+void kernel_set_mean_field(bool enabled)
+{
+	MEAN_FIELD = enabled;
+}
+
+void kernel_set_collisions(float radius, unsigned int iterations)
+{
+	if (( iterations > 0 && radius > 0.0f ) != ( COLLISION_ITERATIONS > 0 && COLLISION_RADIUS > 0.0f ))
+		GRAPH_VERSION++;										// The pass joins or leaves the captured steps
+	COLLISION_RADIUS = radius;
+	COLLISION_ITERATIONS = iterations;
+}
+
+void kernel_set_search_mode(SearchMode mode)
+{
+	SEARCH_MODE = mode;
+	VERLET_VALID = false;										// Displacements are only tracked while the Verlet search runs
+	GRAPH_VERSION++;
+}
+
+SearchMode kernel_get_search_mode(unsigned int mesh_count)
+{
+	SearchMode mode = SEARCH_MODE;
+	if (mode == SearchMode::AUTO)
+	{
+		// Building the grid costs more than it saves for small swarms.
+		mode = mesh_count < TILED_SEARCH_THRESHOLD ? SearchMode::TILED : SearchMode::GRID;
+	}
+	if (mode == SearchMode::TENSOR && ( !TENSOR_CORES || SEARCH_FIRST_K > 0 ))
+		mode = SearchMode::TILED;								// No tensor cores, or the query may stop early
+	if (DETERMINISTIC && mode != SearchMode::BRUTE_FORCE)
+		mode = SearchMode::GRID;								// Only brute force and grid visit the fishies in the order of their slots
+	return mode;
+}
+
+void kernel_set_tuning(const KernelTuning& tuning)
+{
+	TUNING = tuning;
+	TUNING.cellScale = std::max( tuning.cellScale, 1.0f );		// Smaller cells would miss neighbours inside fishDist
+	GRID_LAYOUT.cellSize = h_params.fishDist * TUNING.cellScale;
+	PARAMS_VERSION++;											// The other contexts take the cell size on kernel_use_context
+	VERLET_VALID = false;										// Lists may belong to other stores, e.g. of timing trials
+	GRAPH_VERSION++;											// Launch configurations and grid are baked into a captured graph
+}
+
+KernelTuning kernel_get_tuning()
+{
+	return TUNING;
+}
+
+void kernel_set_first_k(unsigned int firstK)
+{
+	SEARCH_FIRST_K = firstK;
+	GRAPH_VERSION++;
+}
+
+void kernel_set_packed_positions(bool packed)
+{
+	PACKED_POSITIONS = packed;
+	GRAPH_VERSION++;
+}
+
+void kernel_set_cooperative_grid(bool cooperative)
+{
+	COOPERATIVE_GRID = cooperative;
+	GRAPH_VERSION++;
+}
+
+void kernel_set_warm_start(bool warm)
+{
+	WARM_START = warm;
+	GRAPH_VERSION++;
+}
+
+void kernel_set_grid_sort(GridSort sort)
+{
+	GRID_SORT = sort;
+	GRAPH_VERSION++;
+}
+
+void kernel_set_multi_rate(unsigned int interval, float sharkRange, float focusRange)
+{
+	MULTI_RATE.interval = interval;
+	MULTI_RATE.sharkRange = sharkRange;
+	MULTI_RATE.focusRange = focusRange;
+	GRAPH_VERSION++;
+}
+
+void kernel_set_focus(Vector3 focus)
+{
+	h_step.focus = focus.toSwarmVector().toFloat4();
+}
+
+void kernel_set_evasion_split(bool split)
+{
+	EVASION_SPLIT = split;
+	GRAPH_VERSION++;
+}
+
+void kernel_set_dense_cells(unsigned int candidates)
+{
+	DENSE_CANDIDATES = candidates;
+	GRAPH_VERSION++;
+}
+
+void kernel_set_background_priority(int priority)
+{
+	BACKGROUND_PRIORITY = priority;
+}
+
+void kernel_set_cluster_search(bool cluster)
+{
+	CLUSTER_SEARCH = cluster;
+	GRAPH_VERSION++;
+}
+
+void kernel_set_hash_grid(bool hashed)
+{
+	HASH_GRID = hashed;
+	GRID_LAYOUT.cellKeys = hashed && d_cellKeys != NULL ? d_cellKeys->getData() : NULL;
+	GRID_LAYOUT.keyMask = HASH_SLOTS - 1;
+	GRAPH_VERSION++;
+}
+
+void kernel_set_l2_persistence(bool persistent)
+{
+	L2_PERSISTENCE = persistent;
+}
+
+bool kernel_get_l2_window(size_t& bytes, float& hitRatio)
+{
+	bytes = L2_WINDOW.num_bytes;
+	hitRatio = L2_WINDOW.hitRatio;
+	return bytes > 0;
+}
+
+void kernel_set_deterministic(bool deterministic)
+{
+	DETERMINISTIC = deterministic;
+	h_step.fixedPoint = deterministic ? FIXED_POINT_SCALE : 0.0f;
+	GRAPH_VERSION++;
+}
+
+void kernel_set_rtc(bool rtc)
+{
+	RTC_KERNELS = rtc;
+	GRAPH_VERSION++;
+}
+
+void kernel_set_shark_target(SharkTarget target)
+{
+	SHARK_TARGET = target;
+	GRAPH_VERSION++;
+}
+
+void kernel_set_integrator(Integrator integrator)
+{
+	h_step.integrator = integrator;
+	if (integrator == Integrator::LEGACY)
+		h_step.dtScale = 1.0f;
+}
+
+void kernel_set_step_scale(float scale)
+{
+	h_step.dtScale = h_step.integrator == Integrator::LEGACY || !( scale > 0.0f ) ? 1.0f : scale;	// Copied into c_step with every step, also the captured ones
+}
+
+float kernel_get_step_scale()
+{
+	return h_step.dtScale;
+}
+
+bool kernel_can_capture(unsigned int mesh_count, unsigned int steps)
+{
+	if (steps == 0 || steps > MAX_CAPTURED_STEPS || BEHAVIOUR == Behaviour::BOIDS || farFieldActive() || DETERMINISTIC)
+		return false;
+
+	SearchMode mode = SEARCH_MODE;
+	if (mode == SearchMode::AUTO)
+		mode = mesh_count < TILED_SEARCH_THRESHOLD ? SearchMode::TILED : SearchMode::GRID;
+
+	// The thrust sort of the grid synchronizes the stream, Verlet decides on the host every step.
+	return mode == SearchMode::BRUTE_FORCE || mode == SearchMode::TILED || mode == SearchMode::WARP || mode == SearchMode::TENSOR;
+}
+
+void kernel_begin_capture(cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_begin_capture", NVTX_COLOR_SIMULATION );
+
+	// Parameters are uploaded outside of the graph, the replays read them from constant memory.
+	uploadParams( stream );
+
+	CAPTURE_SLOT = 0;
+	CAPTURE_STEP = h_step.random.step;
+	CUDA_CHECK( cudaStreamBeginCapture( stream, cudaStreamCaptureModeThreadLocal ) );
+}
+
+void kernel_end_capture(const CaptureKey& key, cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_end_capture", NVTX_COLOR_SETUP );
+
+	cudaGraph_t graph;
+	CUDA_CHECK( cudaStreamEndCapture( stream, &graph ) );
+
+	// Nothing ran while capturing.
+	h_step.random.step = CAPTURE_STEP;
+
+	// Same topology (e.g. only other buffers or counts): update the executable graph in place, which is much cheaper.
+	bool updated = false;
+	if (capturedGraph != NULL && CAPTURE_SLOT == capturedSteps)
+	{
+		cudaGraphNode_t errorNode;
+		cudaGraphExecUpdateResult result;
+		updated = cudaGraphExecUpdate( capturedGraph, graph, &errorNode, &result ) == cudaSuccess && result == cudaGraphExecUpdateSuccess;
+		cudaGetLastError();										// A failed update is no error, the graph is instantiated again.
+	}
+
+	if (!updated)
+	{
+		if (capturedGraph != NULL)
+			CUDA_CHECK( cudaGraphExecDestroy( capturedGraph ) );
+		CUDA_CHECK( cudaGraphInstantiate( &capturedGraph, graph, NULL, NULL, 0 ) );
+	}
+	CUDA_CHECK( cudaGraphDestroy( graph ) );
+
+	capturedKey = key;
+	capturedVersion = GRAPH_VERSION;
+	capturedSteps = CAPTURE_SLOT;
+}
+
+bool kernel_has_capture(const CaptureKey& key)
+{
+	return capturedGraph != NULL
+		&& capturedVersion == GRAPH_VERSION
+		&& capturedSteps == key.steps
+		&& capturedKey.first == key.first
+		&& capturedKey.count == key.count
+		&& capturedKey.steps == key.steps;
+}
+
+void kernel_set_captured_step(unsigned int step, Vector3 swarmCenter)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_set_captured_step", NVTX_COLOR_SYNC );
+
+	// The last replay has to read its slots first. It is done almost always, the GL buffers were mapped meanwhile.
+	if (step == 0)
+		CUDA_CHECK( cudaEventSynchronize( capturedStepsRead ) );
+
+	h_step.random.step++;
+	h_step.swarmCenter = swarmCenter.toSwarmVector().toFloat4();
+	advanceCurrent();											// Refills start after the replay, see kernel_launch_capture
+	h_step.sharkBites = 0;										// Captured steps don't build the grid
+	h_step.events = activeEventQueue();							// A drain between this call and the replay loses the events of the step
+	( *h_capturedSteps )[step] = h_step;
+}
+
+void kernel_launch_capture(cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_launch_capture", NVTX_COLOR_SIMULATION );
+
+	uploadParams( stream );
+	waitCurrent( stream );
+	CUDA_CHECK( cudaGraphLaunch( capturedGraph, stream ) );
+	CUDA_CHECK( cudaEventRecord( capturedStepsRead, stream ) );
+	refillCurrent( stream );									// The graph may use the freed slot up to its new slice
+}
+
+void kernel_set_ensemble(const SwarmEnsemble& ensemble)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_set_ensemble", NVTX_COLOR_SETUP );
+
+	delete d_ensembleMembers;
+	delete d_ensembleParams;
+	delete d_ensembleMetricsPartial;
+	delete d_ensembleMetrics;
+	d_ensembleMembers = NULL;
+	d_ensembleParams = NULL;
+	d_ensembleMetricsPartial = NULL;
+	d_ensembleMetrics = NULL;
+	ENSEMBLE_SIZE = static_cast< unsigned int >( ensemble.params.size() );
+	ENSEMBLE_MAX_COUNT = 0;
+	ENSEMBLE_SHARKS = ensemble.sharksPerMember;
+	ENSEMBLE_JITTER = false;
+	if (ENSEMBLE_SIZE == 0)
+		return;
+
+	std::vector<uint2> members( ENSEMBLE_SIZE );
+	for (unsigned int m = 0; m < ENSEMBLE_SIZE; m++)
+	{
+		members[m] = make_uint2( ensemble.offsets[m], ensemble.counts[m] );
+		ENSEMBLE_MAX_COUNT = std::max( ENSEMBLE_MAX_COUNT, ensemble.counts[m] );
+		ENSEMBLE_JITTER = ENSEMBLE_JITTER || ensemble.params[m].jitter > 0.0f;
+	}
+	d_ensembleMembers = new CudaDeviceArray<uint2>( ENSEMBLE_SIZE, MemoryCategory::SCRATCH, CudaMallocAllocator::managed( ManagedRole::READ_MOSTLY ) );
+	d_ensembleParams = new CudaDeviceArray<SwarmParams>( ENSEMBLE_SIZE, MemoryCategory::SCRATCH, CudaMallocAllocator::managed( ManagedRole::READ_MOSTLY ) );
+	d_ensembleMembers->set( members.data(), ENSEMBLE_SIZE );
+	d_ensembleParams->set( ensemble.params.data(), ENSEMBLE_SIZE );
+
+	unsigned int rowBlocks = LAUNCH_ENSEMBLE_METRICS.forCount( std::max( ENSEMBLE_MAX_COUNT, 1u ) ).blocks;
+	d_ensembleMetricsPartial = new CudaDeviceArray<MetricsPartial>( rowBlocks * ENSEMBLE_SIZE, MemoryCategory::SCRATCH );
+	d_ensembleMetrics = new CudaDeviceArray<EnsembleMetrics>( ENSEMBLE_SIZE, MemoryCategory::SCRATCH );
+}
+
+void kernel_advance_ensemble(
+	ParticleArrays in,
+	ParticleArrays out,
+	float speed,
+	Vector3 swarmCenter,
+	const float4* sharks,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_advance_ensemble", NVTX_COLOR_SIMULATION );
+
+	if (ENSEMBLE_SIZE == 0 || ENSEMBLE_MAX_COUNT == 0)
+		return;
+
+	uploadParams( stream );														// Obstacles and current, the members bring their own parameters
+
+	// Same inputs as a step of kernel_advance. The sharks of all members follow the swarm center.
+	h_step.random.step++;
+	h_step.swarmCenter = swarmCenter.toSwarmVector().toFloat4();
+	SHARK_GRID = false;
+	QUERY_GRID = false;
+	ADVANCE_NEAREST = false;
+	h_step.sharkBites = 0;
+	h_step.events = activeEventQueue();
+	advanceCurrent();
+	refillCurrent( stream );
+	waitCurrent( stream );
+	CUDA_CHECK( cudaMemcpyToSymbolAsync( c_step, &h_step, sizeof( StepInputs ), 0, cudaMemcpyHostToDevice, stream ) );
+
+	LaunchConfig tiled = LAUNCH_ENSEMBLE.forCount( ENSEMBLE_MAX_COUNT );
+	dim3 blocks( tiled.blocks, ENSEMBLE_SIZE );
+	ENSEMBLE_VARIANTS[ENSEMBLE_JITTER ? FEATURE_JITTER : 0]<<<blocks, tiled.threads, tiled.sharedMemory, stream>>> (
+		in, out, d_ensembleMembers->getData(), d_ensembleParams->getData(), speed * 1.8, sharks, ENSEMBLE_SHARKS );
+	CUDA_CHECK_LAUNCH( "d_advance_ensemble", stream );
+}
+
+void kernel_ensemble_metrics(
+	ParticleArrays particles,
+	EnsembleMetrics* metrics,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_ensemble_metrics", NVTX_COLOR_SIMULATION );
+
+	if (ENSEMBLE_SIZE == 0)
+		return;
+
+	// Rows as long as the largest member, the second pass reads a fixed number of partials per member.
+	LaunchConfig tiled = LAUNCH_ENSEMBLE_METRICS.forCount( std::max( ENSEMBLE_MAX_COUNT, 1u ) );
+	dim3 blocks( tiled.blocks, ENSEMBLE_SIZE );
+	d_reduceEnsembleMetrics<<<blocks, tiled.threads, tiled.sharedMemory, stream>>> ( particles, d_ensembleMembers->getData(), d_ensembleMetricsPartial->getData() );
+	CUDA_CHECK_LAUNCH( "d_reduceEnsembleMetrics", stream );
+	d_finishEnsembleMetrics<<<ENSEMBLE_SIZE, LAUNCH_STATS.threads, 0, stream>>> (
+		d_ensembleMetricsPartial->getData(), tiled.blocks, d_ensembleMembers->getData(), d_ensembleMetrics->getData() );
+	CUDA_CHECK_LAUNCH( "d_finishEnsembleMetrics", stream );
+	CUDA_CHECK( cudaMemcpyAsync( metrics, d_ensembleMetrics->getData(), ENSEMBLE_SIZE * sizeof( EnsembleMetrics ), cudaMemcpyDeviceToHost, stream ) );
+}
+
+/*!
+ * @brief Get the rings of cells a query can search in the grid, so no cell is searched twice, even if the grid wraps around.
+ * @return rings.
+ */
+static int queryRingLimit()
+{
+	return ( std::min( GRID_LAYOUT.dims.x, std::min( GRID_LAYOUT.dims.y, GRID_LAYOUT.dims.z ) ) - 1 ) / 2;
+}
+
+bool kernel_sharks_hunt()
+{
+	return SHARK_GRID && SHARK_TARGET != SharkTarget::INTERCEPT;
+}
+
+void kernel_move_sharks(
+	float4* sharks,
+	float4* states,
+	unsigned int shark_count,
+	float speed,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_move_sharks", NVTX_COLOR_SIMULATION );
+
+	if (shark_count == 0)
+		return;
+
+	if (timelineHas( TimelineAction::SHARKS ))
+	{
+		LaunchConfig park = LAUNCH_SHARKS.forCount( shark_count );
+		d_timelineSharks<<<park.blocks, park.threads, 0, stream>>> ( sharks, states, shark_count );
+		CUDA_CHECK_LAUNCH( "d_timelineSharks", stream );
+	}
+
+	if (SHARK_GRID && SHARK_TARGET == SharkTarget::INTERCEPT)
+	{
+		// The aggregates of the cells, unless the mean field boids made them for this grid already.
+		unsigned int numCells = gridCellCount( GRID_LAYOUT );
+		if (d_cellVelocity == NULL)
+		{
+			d_cellVelocity = new CudaDeviceArray<float4>( GRID_NUM_CELLS, MemoryCategory::NEIGHBOURS );
+			d_cellCentroid = new CudaDeviceArray<float4>( GRID_NUM_CELLS, MemoryCategory::NEIGHBOURS );
+		}
+		if (!( BEHAVIOUR == Behaviour::BOIDS && MEAN_FIELD ))
+		{
+			LaunchConfig cells = LAUNCH_HASH.forCount( numCells );
+			d_cellMeans<<<cells.blocks, cells.threads, 0, stream>>> (
+				d_cellVelocity->getData(), d_cellCentroid->getData(), d_sorted->getArrays(), d_cellStart->getData(), d_cellEnd->getData(), numCells );
+			CUDA_CHECK_LAUNCH( "d_cellMeans", stream );
+		}
+
+		int rings = std::min( static_cast< int >( SHARK_INTERCEPT_RINGS ), queryRingLimit() );
+		d_interceptSharks<<<iDivUp( shark_count * WARP_SIZE, INTERCEPT_THREADS ), INTERCEPT_THREADS, 0, stream>>> (
+			sharks, states, shark_count, speed,
+			d_cellVelocity->getData(),
+			d_cellCentroid->getData(),
+			GRID_LAYOUT,
+			rings );
+		CUDA_CHECK_LAUNCH( "d_interceptSharks", stream );
+		return;
+	}
+
+	if (SHARK_GRID)
+	{
+		// No cell is searched twice, even if the grid wraps around.
+		int rings = SHARK_TARGET == SharkTarget::DENSEST ? SHARK_DENSE_RINGS : SHARK_RINGS;
+		rings = std::min( rings, ( std::min( GRID_LAYOUT.dims.x, std::min( GRID_LAYOUT.dims.y, GRID_LAYOUT.dims.z ) ) - 1 ) / 2 );
+		CUDA_CHECK( cudaMemsetAsync( d_sharkClaims->getData(), 0xff, SHARK_PREY_COUNT * sizeof( unsigned int ), stream ) );
+
+		LaunchConfig hunt = LAUNCH_HUNT.forCount( shark_count );
+		d_huntSharks<<<hunt.blocks, hunt.threads, 0, stream>>> (
+			sharks, states, shark_count, speed,
+			d_sorted->getArrays(),
+			d_gridParticleIndex->getData(),
+			d_cellStart->getData(),
+			d_cellEnd->getData(),
+			GRID_LAYOUT,
+			rings,
+			SHARK_TARGET == SharkTarget::DENSEST,
+			SHARK_PREY,
+			d_sharkClaims->getData() );
+		CUDA_CHECK_LAUNCH( "d_huntSharks", stream );
+		return;
+	}
+
+	LaunchConfig launch = LAUNCH_SHARKS.forCount( shark_count );
+	d_moveSharks<<<launch.blocks, launch.threads, 0, stream>>> ( sharks, states, shark_count, speed );
+	CUDA_CHECK_LAUNCH( "d_moveSharks", stream );
+}
+
+void kernel_query_radius(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	const float4* probes,
+	unsigned int probe_count,
+	float radius,
+	unsigned int* counts,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_query_radius", NVTX_COLOR_SIMULATION );
+
+	if (probe_count == 0)
+		return;
+
+	LaunchConfig launch = LaunchConfig().forCount( probe_count );
+	int rings = static_cast< int >( std::ceil( radius / GRID_LAYOUT.cellSize ) ) + 1;	// One cell of movement by the step
+	if (QUERY_GRID && rings <= queryRingLimit())
+	{
+		d_queryRadiusGrid<<<launch.blocks, launch.threads, 0, stream>>> (
+			probes, probe_count, radius, rings, particles, d_gridParticleIndex->getData(), d_cellStart->getData(), d_cellEnd->getData(), GRID_LAYOUT, counts );
+		CUDA_CHECK_LAUNCH( "d_queryRadiusGrid", stream );
+		return;
+	}
+
+	d_queryRadiusAll<<<launch.blocks, launch.threads, launch.threads * sizeof( float4 ), stream>>> ( probes, probe_count, radius, particles, mesh_count, counts );
+	CUDA_CHECK_LAUNCH( "d_queryRadiusAll", stream );
+}
+
+void kernel_query_nearest(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	const float4* probes,
+	unsigned int probe_count,
+	unsigned int k,
+	unsigned int* ids,
+	float* distances,
+	unsigned int* fallback,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_query_nearest", NVTX_COLOR_SIMULATION );
 
-		// keep distance to other fishies
-		bool too_close = closest_dist < FISH_DIST;
-		if (too_close)
-		{
-			DeviceVector avoid = closest.normalized() * my_speed * acceleration_factor * 0.7;
-			state -= avoid;
-			vert += state;
-			acceleration_factor /= 2;
-		}
-		// return to swarm
-		if (diff.length3() > CENTER_THRESHOLD * state.w)
+	if (probe_count == 0 || k == 0)
+		return;
+
+	k = std::min( k, QUERY_MAX_K );
+	LaunchConfig launch = LaunchConfig().forCount( probe_count );
+	int rings = std::min( static_cast< int >( QUERY_MAX_RINGS ), queryRingLimit() );
+	if (QUERY_GRID && rings >= 1)
+	{
+		// Probes far from the school or between sparse fishies go through all fishies in a second launch.
+		CUDA_CHECK( cudaMemsetAsync( fallback, 0, sizeof( unsigned int ), stream ) );
+		d_queryNearestGrid<<<launch.blocks, launch.threads, 0, stream>>> (
+			probes, probe_count, k, rings, particles, d_gridParticleIndex->getData(), d_cellStart->getData(), d_cellEnd->getData(), GRID_LAYOUT, ids, distances, fallback );
+		CUDA_CHECK_LAUNCH( "d_queryNearestGrid", stream );
+	}
+	else
+		fallback = NULL;
+
+	d_queryNearestAll<<<launch.blocks, launch.threads, launch.threads * sizeof( float4 ), stream>>> ( probes, probe_count, k, particles, mesh_count, fallback, ids, distances );
+	CUDA_CHECK_LAUNCH( "d_queryNearestAll", stream );
+}
+
+void kernel_pick(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	Vector3 origin,
+	Vector3 direction,
+	float maxDepth,
+	float radius,
+	PickResult* result,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_pick", NVTX_COLOR_SIMULATION );
+
+	float4 const from = origin.toSwarmVector().toFloat4();
+	float4 const dir = direction.toSwarmVector().toFloat4();
+	if (QUERY_GRID)
+	{
+		int maxSteps = GRID_LAYOUT.dims.x + GRID_LAYOUT.dims.y + GRID_LAYOUT.dims.z;	// A ray crosses at most this number of cells in the box
+		d_pickGrid<<<1, WARP_SIZE, 0, stream>>> ( from, dir, maxDepth, std::min( radius, GRID_LAYOUT.cellSize ), maxSteps, particles,
+			d_gridParticleIndex->getData(), d_cellStart->getData(), d_cellEnd->getData(), GRID_LAYOUT, result );
+		CUDA_CHECK_LAUNCH( "d_pickGrid", stream );
+		return;
+	}
+
+	d_pickAll<<<1, PICK_THREADS, 0, stream>>> ( from, dir, maxDepth, radius, particles, mesh_count, result );
+	CUDA_CHECK_LAUNCH( "d_pickAll", stream );
+}
+
+void kernel_pack(
+	ParticleArrays particles,
+	float4* verts,
+	float4* directions,
+	unsigned int mesh_count,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_pack", NVTX_COLOR_INTEROP );
+
+	LaunchConfig launch = LAUNCH_PACK.forCount( mesh_count );
+	d_pack<<<launch.blocks, launch.threads, 0, stream>>> ( particles, verts, directions, mesh_count );
+	CUDA_CHECK_LAUNCH( "d_pack", stream );
+}
+
+void kernel_pack_trajectory(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	unsigned int stride,
+	unsigned int entries,
+	const SwarmStats* bounds,
+	bool quantize,
+	void* positions,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_pack_trajectory", NVTX_COLOR_SIMULATION );
+
+	size_t bytes = 3 * entries * ( quantize ? sizeof( unsigned short ) : sizeof( float ) );
+	CUDA_CHECK( cudaMemsetAsync( positions, 0xFF, bytes, stream ) );				// Missing fishies: NaN or 0xFFFF
+
+	LaunchConfig launch = LAUNCH_TRAJECTORY.forCount( mesh_count );
+	d_packTrajectory<<<launch.blocks, launch.threads, 0, stream>>> ( particles, mesh_count, stride > 0 ? stride : 1, entries, bounds, quantize, positions );
+	CUDA_CHECK_LAUNCH( "d_packTrajectory", stream );
+}
+
+void kernel_unpack_trajectory(
+	const SwarmStats* bounds,
+	const void* positions,
+	unsigned int entries,
+	bool quantized,
+	float4* verts,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_unpack_trajectory", NVTX_COLOR_INTEROP );
+
+	LaunchConfig launch = LaunchConfig().forCount( entries );					// The playback sets no grid up, default block size
+	d_unpackTrajectory<<<launch.blocks, launch.threads, 0, stream>>> ( bounds, positions, entries, quantized, verts );
+	CUDA_CHECK_LAUNCH( "d_unpackTrajectory", stream );
+}
+
+void kernel_delta_trajectory(
+	unsigned short* positions,
+	const unsigned short* key,
+	size_t count,
+	bool encode,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_delta_trajectory", NVTX_COLOR_SIMULATION );
+
+	LaunchConfig launch = LaunchConfig().forCount( static_cast< unsigned int >( count ) );
+	d_deltaTrajectory<<<launch.blocks, launch.threads, 0, stream>>> ( positions, key, count, encode );
+	CUDA_CHECK_LAUNCH( "d_deltaTrajectory", stream );
+}
+
+void kernel_compression_batch(
+	const char* input,
+	size_t bytes,
+	size_t chunkSize,
+	char* compressed,
+	size_t stride,
+	const void** inputPtrs,
+	size_t* inputBytes,
+	void** compressedPtrs,
+	unsigned int count,
+	cudaStream_t stream)
+{
+	LaunchConfig launch = LaunchConfig().forCount( count );
+	d_compressionBatch<<<launch.blocks, launch.threads, 0, stream>>> ( input, bytes, chunkSize, compressed, stride, inputPtrs, inputBytes, compressedPtrs, count );
+	CUDA_CHECK_LAUNCH( "d_compressionBatch", stream );
+}
+
+void kernel_compression_gather(
+	const void* const* compressedPtrs,
+	const size_t* compressedBytes,
+	unsigned int count,
+	unsigned long long rawBytes,
+	char* output,
+	unsigned long long* offset,
+	unsigned long long* destinations,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_compression_gather", NVTX_COLOR_INTEROP );
+
+	d_compressionLayout<<<1, 1, 0, stream>>> ( compressedBytes, count, rawBytes, output, offset, destinations );
+	CUDA_CHECK_LAUNCH( "d_compressionLayout", stream );
+	d_compressionGather<<<count, 256, 0, stream>>> ( compressedPtrs, compressedBytes, output, destinations );
+	CUDA_CHECK_LAUNCH( "d_compressionGather", stream );
+}
+
+void kernel_decompression_batch(
+	const char* record,
+	unsigned int count,
+	size_t chunkSize,
+	char* output,
+	size_t bytes,
+	const void** compressedPtrs,
+	size_t* compressedBytes,
+	void** outputPtrs,
+	size_t* outputBytes,
+	cudaStream_t stream)
+{
+	d_decompressionBatch<<<1, 1, 0, stream>>> ( record, count, chunkSize, output, bytes, compressedPtrs, compressedBytes, outputPtrs, outputBytes );
+	CUDA_CHECK_LAUNCH( "d_decompressionBatch", stream );
+}
+
+/*!
+ * @brief Zip all arrays of a particle store, so thrust moves a whole fish at once.
+ * @param p particle arrays.
+ * @return zip iterator to the first fish.
+ */
+static auto zipParticles( const ParticleArrays& p )
+{
+	return thrust::make_zip_iterator( thrust::make_tuple(
+		thrust::device_ptr<float>( p.x ), thrust::device_ptr<float>( p.y ), thrust::device_ptr<float>( p.z ),
+		thrust::device_ptr<float>( p.vx ), thrust::device_ptr<float>( p.vy ), thrust::device_ptr<float>( p.vz ),
+		thrust::device_ptr<float>( p.mass ),
+		thrust::device_ptr<unsigned char>( p.alive ),
+		thrust::device_ptr<unsigned int>( p.id ) ) );
+}
+
+unsigned int kernel_compact(
+	ParticleArrays in,
+	ParticleArrays out,
+	unsigned int mesh_count,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_compact", NVTX_COLOR_SYNC );
+
+	QUERY_GRID = false;															// The slots move and the scan takes the arena
+	ADVANCE_NEAREST = false;
+
+	// Temporary storage of the scan comes from the arena, like the sort in buildGrid.
+	d_arena->reset();
+	ArenaAllocator scratch;
+	scratch.arena = d_arena;
+
+	auto first = zipParticles( in );
+	auto last = first + mesh_count;
+
+	// copy_if is stable, the live fishies keep their order.
+	auto end = thrust::copy_if(
+		thrust::cuda::par( scratch ).on( stream ),
+		first,
+		last,
+		thrust::device_ptr<unsigned char>( in.alive ),
+		zipParticles( out ),
+		thrust::identity<unsigned char>() );
+
+	unsigned int live = static_cast< unsigned int >( end - zipParticles( out ) );
+
+	// The advance kernels don't copy the ids, both stores need the new ones.
+	CUDA_CHECK( cudaMemcpyAsync( in.id, out.id, live * sizeof( unsigned int ), cudaMemcpyDeviceToDevice, stream ) );
+	VERLET_VALID = false;										// Fishies moved to other slots.
+	return live;
+}
+
+void kernel_reorder(
+	ParticleArrays in,
+	ParticleArrays out,
+	unsigned int mesh_count,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_reorder", NVTX_COLOR_SIMULATION );
+
+	QUERY_GRID = false;															// The slots move and the sort takes the grid arrays
+	ADVANCE_NEAREST = false;
+
+	if (mesh_count == 0)
+		return;
+
+	// Codes and indices use the arrays of the uniform grid, which are rebuilt in the next step anyway.
+	LaunchConfig morton = LAUNCH_MORTON.forCount( mesh_count );
+	d_calcMorton<<<morton.blocks, morton.threads, 0, stream>>> (
+		d_gridParticleHash->getData(),
+		d_gridParticleIndex->getData(),
+		in,
+		mesh_count,
+		GRID_LAYOUT );
+	CUDA_CHECK_LAUNCH( "d_calcMorton", stream );
+
+	d_arena->reset();
+	ArenaAllocator scratch;
+	scratch.arena = d_arena;
+
+	thrust::sort_by_key(
+		thrust::cuda::par( scratch ).on( stream ),
+		thrust::device_ptr<unsigned int>( d_gridParticleHash->getData() ),
+		thrust::device_ptr<unsigned int>( d_gridParticleHash->getData() + mesh_count ),
+		thrust::device_ptr<unsigned int>( d_gridParticleIndex->getData() ) );
+
+	LaunchConfig permute = LAUNCH_PERMUTE.forCount( mesh_count );
+	d_permute<<<permute.blocks, permute.threads, 0, stream>>> ( in, out, d_gridParticleIndex->getData(), mesh_count );
+	CUDA_CHECK_LAUNCH( "d_permute", stream );
+
+	// The advance kernels don't copy the ids, both stores need the new ones.
+	CUDA_CHECK( cudaMemcpyAsync( in.id, out.id, mesh_count * sizeof( unsigned int ), cudaMemcpyDeviceToDevice, stream ) );
+	VERLET_VALID = false;										// Fishies moved to other slots.
+}
+
+void kernel_partition_slab(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	SlabBounds slab,
+	unsigned int* lists,
+	unsigned int capacity,
+	unsigned int* counts,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_partition_slab", NVTX_COLOR_SIMULATION );
+
+	CUDA_CHECK( cudaMemsetAsync( counts, 0, SLAB_LIST_COUNT * sizeof( unsigned int ), stream ) );
+	if (mesh_count == 0)
+		return;
+
+	LaunchConfig launch = LAUNCH_PARTITION.forCount( mesh_count );
+	d_partitionSlab<<<launch.blocks, launch.threads, 0, stream>>> ( particles, mesh_count, slab, lists, capacity, counts );
+	CUDA_CHECK_LAUNCH( "d_partitionSlab", stream );
+}
+
+void kernel_gather(
+	ParticleArrays in,
+	ParticleArrays out,
+	const unsigned int* indices,
+	unsigned int count,
+	cudaStream_t stream)
+{
+	if (count == 0)
+		return;
+
+	LaunchConfig launch = LAUNCH_PERMUTE.forCount( count );
+	d_permute<<<launch.blocks, launch.threads, 0, stream>>> ( in, out, indices, count );
+	CUDA_CHECK_LAUNCH( "d_permute", stream );
+}
+
+void kernel_pack_colors(
+	const unsigned int* ids,
+	const uchar4* colors,
+	uchar4* out,
+	unsigned int mesh_count,
+	unsigned int schools,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_pack_colors", NVTX_COLOR_INTEROP );
+
+	LaunchConfig launch = LAUNCH_COLORS.forCount( mesh_count );
+	d_packColors<<<launch.blocks, launch.threads, 0, stream>>> ( ids, colors, out, mesh_count, schools );
+	CUDA_CHECK_LAUNCH( "d_packColors", stream );
+}
+
+void kernel_depth_sort(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	float4 depthRow,
+	unsigned int* indices,
+	cudaStream_t stream,
+	bool frontToBack)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_depth_sort", NVTX_COLOR_INTEROP );
+
+	if (mesh_count == 0)
+		return;
+
+	// Keys use the hash array of the uniform grid like kernel_reorder, it is rebuilt in the next step anyway.
+	LaunchConfig launch = LAUNCH_DEPTH.forCount( mesh_count );
+	d_depthKeys<<<launch.blocks, launch.threads, 0, stream>>> ( particles, mesh_count, depthRow, d_gridParticleHash->getData(), indices, frontToBack );
+	CUDA_CHECK_LAUNCH( "d_depthKeys", stream );
+
+	d_arena->reset();
+	ArenaAllocator scratch;
+	scratch.arena = d_arena;
+
+	thrust::sort_by_key(
+		thrust::cuda::par( scratch ).on( stream ),
+		thrust::device_ptr<unsigned int>( d_gridParticleHash->getData() ),
+		thrust::device_ptr<unsigned int>( d_gridParticleHash->getData() + mesh_count ),
+		thrust::device_ptr<unsigned int>( indices ) );
+}
+
+const unsigned int* kernel_density(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	float4* verts,
+	uchar4* colors,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_density", NVTX_COLOR_INTEROP );
+
+	CUDA_CHECK( cudaMemsetAsync( d_density->getData(), 0, DENSITY_SIZE * DENSITY_SIZE * sizeof( unsigned int ), stream ) );
+	if (mesh_count > 0)
+	{
+		LaunchConfig splat = LAUNCH_SPLAT.forCount( mesh_count );
+		d_splatDensity<<<splat.blocks, splat.threads, 0, stream>>> ( particles, mesh_count, GRID_LAYOUT, d_density->getData() );
+		CUDA_CHECK_LAUNCH( "d_splatDensity", stream );
+	}
+	if (verts != NULL && colors != NULL)
+	{
+		LaunchConfig shade = LAUNCH_SHADE.forCount( DENSITY_SIZE * DENSITY_SIZE );
+		d_shadeDensity<<<shade.blocks, shade.threads, 0, stream>>> ( d_density->getData(), mesh_count, GRID_LAYOUT, verts, colors );
+		CUDA_CHECK_LAUNCH( "d_shadeDensity", stream );
+	}
+	return d_density->getData();
+}
+
+void kernel_append_trail(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	__half* x,
+	__half* y,
+	__half* z,
+	unsigned int fishies,
+	unsigned int length,
+	unsigned int head,
+	float maxJump,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_append_trail", NVTX_COLOR_INTEROP );
+
+	CUDA_CHECK( cudaMemsetAsync( x + static_cast< size_t >( head ) * fishies, 0xFF, fishies * sizeof( __half ), stream ) );	// NaN: hidden, unless a living fish writes it
+	if (mesh_count == 0)
+		return;
+
+	LaunchConfig launch = LAUNCH_TRAIL.forCount( mesh_count );
+	d_appendTrail<<<launch.blocks, launch.threads, 0, stream>>> ( particles, mesh_count, x, y, z, fishies, length, head, maxJump );
+	CUDA_CHECK_LAUNCH( "d_appendTrail", stream );
+}
+
+void kernel_cull(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	const uchar4* colors,
+	const CullParams& params,
+	float4* verts,
+	float4* directions,
+	uchar4* out_colors,
+	unsigned int capacity,
+	unsigned int* counts,
+	DrawCommand* commands,
+	unsigned int mesh_vertices,
+	unsigned int schools,
+	float4* clusters,
+	uchar4* cluster_colors,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_cull", NVTX_COLOR_INTEROP );
+
+	schools = std::min( std::max( schools, 1u ), CULL_MAX_SCHOOLS );
+	ClusterTable table = { NULL, NULL, NULL };
+	if (clusters != NULL && params.clusterDistance > 0.0f)
+	{
+		if (d_clusterKeys == NULL)
 		{
-			diff = diff.normalized() * my_speed * (acceleration_factor * 0.4);
-			state += diff;
+			d_clusterKeys = new CudaDeviceArray<unsigned long long>( CULL_CLUSTER_SLOTS, MemoryCategory::RENDER );
+			d_clusterSums = new CudaDeviceArray<float4>( CULL_CLUSTER_SLOTS, MemoryCategory::RENDER );
+			d_clusterMoments = new CudaDeviceArray<float4>( CULL_CLUSTER_SLOTS, MemoryCategory::RENDER );
 		}
+		table = { d_clusterKeys->getData(), d_clusterSums->getData(), d_clusterMoments->getData() };
+		CUDA_CHECK( cudaMemsetAsync( table.keys, 0xff, CULL_CLUSTER_SLOTS * sizeof( unsigned long long ), stream ) );	// All slots EMPTY_KEY
+		CUDA_CHECK( cudaMemsetAsync( table.sums, 0, CULL_CLUSTER_SLOTS * sizeof( float4 ), stream ) );
+		CUDA_CHECK( cudaMemsetAsync( table.moments, 0, CULL_CLUSTER_SLOTS * sizeof( float4 ), stream ) );
+	}
+
+	CUDA_CHECK( cudaMemsetAsync( counts, 0, ( 2 * schools + 1 ) * sizeof( unsigned int ), stream ) );
+	if ( mesh_count > 0 )
+	{
+		LaunchConfig launch = LAUNCH_PACK.forCount( mesh_count );
+		d_cull<<<launch.blocks, launch.threads, 0, stream>>> ( particles, mesh_count, colors, params, verts, directions, out_colors, capacity, schools, counts, table );
+		CUDA_CHECK_LAUNCH( "d_cull", stream );
 	}
-	if (state.length3() > my_speed * 0.75)
+	if (table.keys != NULL)
 	{
-		state *= 0.96;
+		LaunchConfig launch = LAUNCH_PACK.forCount( CULL_CLUSTER_SLOTS );
+		d_clusterImpostors<<<launch.blocks, launch.threads, 0, stream>>> ( table, params.clusterCellSize, params.radius, clusters, cluster_colors, counts + 2 * schools );
+		CUDA_CHECK_LAUNCH( "d_clusterImpostors", stream );
 	}
-	vert += state;
+	d_cullCommands<<<1, CULL_MAX_SCHOOLS, 0, stream>>> ( counts, commands, capacity, mesh_vertices, schools, clusters != NULL );
+	CUDA_CHECK_LAUNCH( "d_cullCommands", stream );
+}
+
+void kernel_spawn(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	uchar4* colors,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_spawn", NVTX_COLOR_SETUP );
 
-	float4 result;
-	vert.getFloat4(&result);
-	verts[in_x] = result;
-	float4 state_result;
-	state.getFloat4(&state_result);
-	states[in_x] = state_result;
+	if (mesh_count == 0)
+		return;
+
+	// The random key is uploaded with the first step, the spawn runs before.
+	CUDA_CHECK( cudaMemcpyToSymbolAsync( c_step, &h_step, sizeof( StepInputs ), 0, cudaMemcpyHostToDevice, stream ) );
+
+	LaunchConfig spawn = LAUNCH_SPAWN_ALL.forCount( mesh_count );
+	d_spawnAll<<<spawn.blocks, spawn.threads, 0, stream>>> ( particles, mesh_count, colors, SPAWN_MIN, SPAWN_MAX );
+	CUDA_CHECK_LAUNCH( "d_spawnAll", stream );
 }
 
-void kernel_advance(
-    float4* verts,
-    float4* states,
+void kernel_respawn(
+	ParticleArrays particles,
 	unsigned int mesh_count,
-    float speed,
-    Vector3 swarmCenter,
-	Vector3 shark)
+	unsigned int maxSpawn,
+	cudaStream_t stream)
 {
-	// KERNEL CALL
-    d_advance<<<NUM_BLOCKS, NUM_THREADS>>> ( verts, states, mesh_count, speed * 1.8, swarmCenter, shark );
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_respawn", NVTX_COLOR_SIMULATION );
+
+	if (maxSpawn == 0 || mesh_count == 0)
+		return;
+
+	VERLET_VALID = false;										// Respawned fishies are not in any list.
+
+	// The number of dead fishies stays on the GPU, the spawn kernel starts maxSpawn threads and reads it.
+	CUDA_CHECK( cudaMemsetAsync( d_freeCount->getData(), 0, sizeof( unsigned int ), stream ) );
+
+	if (DETERMINISTIC)
+	{
+		// Dead slots in ascending order, so the same ones come back on every GPU. copy_if waits for the stream.
+		d_arena->reset();
+		ArenaAllocator scratch;
+		scratch.arena = d_arena;
+		thrust::device_ptr<unsigned int> freeList( d_freeList->getData() );
+		auto end = thrust::copy_if(
+			thrust::cuda::par( scratch ).on( stream ),
+			thrust::counting_iterator<unsigned int>( 0 ),
+			thrust::counting_iterator<unsigned int>( mesh_count ),
+			thrust::device_ptr<unsigned char>( particles.alive ),
+			freeList,
+			thrust::logical_not<unsigned char>() );
+		unsigned int freeCount = static_cast< unsigned int >( end - freeList );
+		CUDA_CHECK( cudaMemcpyAsync( d_freeCount->getData(), &freeCount, sizeof( unsigned int ), cudaMemcpyHostToDevice, stream ) );
+	}
+	else
+	{
+		LaunchConfig collect = LAUNCH_COLLECT.forCount( mesh_count );
+		d_collectDead<<<collect.blocks, collect.threads, 0, stream>>> ( particles.alive, mesh_count, d_freeList->getData(), d_freeCount->getData() );
+		CUDA_CHECK_LAUNCH( "d_collectDead", stream );
+	}
+
+	maxSpawn = std::min( maxSpawn, mesh_count );
+	LaunchConfig spawn = LAUNCH_SPAWN.forCount( maxSpawn );
+	d_spawn<<<spawn.blocks, spawn.threads, 0, stream>>> ( particles, d_freeList->getData(), d_freeCount->getData(), maxSpawn, SPAWN_MIN, SPAWN_MAX,
+		timelineHas( TimelineAction::RESPAWN ) );
+	CUDA_CHECK_LAUNCH( "d_spawn", stream );
+}
+
+void kernel_encode_checkpoint(
+	ParticleArrays particles,
+	ParticleArrays reference,
+	unsigned int mesh_count,
+	short* deltas,
+	size_t stride,
+	CheckpointEvent* events,
+	unsigned int maxEvents,
+	unsigned int* counters,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_encode_checkpoint", NVTX_COLOR_SIMULATION );
+
+	CUDA_CHECK( cudaMemsetAsync( counters, 0, ( CHECKPOINT_COMPONENTS + 1 ) * sizeof( unsigned int ), stream ) );
+	if (mesh_count == 0)
+		return;
+
+	LaunchConfig launch = LaunchConfig().forCount( mesh_count );				// Whole warps, the range shuffles over all lanes
+	d_checkpointRange<<<launch.blocks, launch.threads, 0, stream>>> ( particles, reference, mesh_count, counters );
+	CUDA_CHECK_LAUNCH( "d_checkpointRange", stream );
+	d_encodeCheckpoint<<<launch.blocks, launch.threads, 0, stream>>> ( particles, reference, mesh_count, deltas, stride, events, maxEvents, counters );
+	CUDA_CHECK_LAUNCH( "d_encodeCheckpoint", stream );
+}
+
+void kernel_apply_checkpoint(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	const short* deltas,
+	size_t stride,
+	const float range[CHECKPOINT_COMPONENTS],
+	const CheckpointEvent* events,
+	unsigned int eventCount,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_apply_checkpoint", NVTX_COLOR_SIMULATION );
+
+	CheckpointRange ranges;
+	for (unsigned int c = 0; c < CHECKPOINT_COMPONENTS; c++)
+		ranges.value[c] = range[c];
+	if (mesh_count > 0)
+	{
+		LaunchConfig launch = LaunchConfig().forCount( mesh_count );
+		d_applyCheckpoint<<<launch.blocks, launch.threads, 0, stream>>> ( particles, mesh_count, deltas, stride, ranges );
+		CUDA_CHECK_LAUNCH( "d_applyCheckpoint", stream );
+	}
+	if (eventCount > 0)
+	{
+		LaunchConfig launch = LaunchConfig().forCount( eventCount );
+		d_applyCheckpointEvents<<<launch.blocks, launch.threads, 0, stream>>> ( particles, events, eventCount );
+		CUDA_CHECK_LAUNCH( "d_applyCheckpointEvents", stream );
+	}
+}
+
+void kernel_reduce_stats(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	cudaStream_t stream,
+	SwarmStats* mailbox)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_reduce_stats", NVTX_COLOR_SIMULATION );
+
+	// Grid stride loop: at most MAX_STATS_BLOCKS partial results, so one block can finish the reduction.
+	// With a fixed block size the order of the sums only depends on the number of fishies.
+	unsigned int threads = DETERMINISTIC ? DETERMINISTIC_STATS_THREADS : LAUNCH_STATS.threads;
+	unsigned int blocks = std::min( std::max( iDivUp( mesh_count, threads ), 1 ), static_cast< int >( MAX_STATS_BLOCKS ) );
+
+	d_reduceStats<<<blocks, threads, 0, stream>>> ( particles, mesh_count, d_statsPartial->getData() );
+	CUDA_CHECK_LAUNCH( "d_reduceStats", stream );
+	d_finishStats<<<1, threads, 0, stream>>> ( d_statsPartial->getData(), blocks, d_stats->getData(), mailbox );
+	CUDA_CHECK_LAUNCH( "d_finishStats", stream );
+}
+
+void kernel_pack_stats(
+	ParticleArrays particles,
+	float4* verts,
+	float4* directions,
+	unsigned int mesh_count,
+	cudaStream_t stream,
+	SwarmStats* mailbox)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_pack_stats", NVTX_COLOR_INTEROP );
+
+	// Same blocks as kernel_reduce_stats, so the sums are the same.
+	unsigned int threads = DETERMINISTIC ? DETERMINISTIC_STATS_THREADS : LAUNCH_STATS.threads;
+	unsigned int blocks = std::min( std::max( iDivUp( mesh_count, threads ), 1 ), static_cast< int >( MAX_STATS_BLOCKS ) );
+
+	d_packStats<<<blocks, threads, 0, stream>>> ( particles, verts, directions, mesh_count, d_statsPartial->getData() );
+	CUDA_CHECK_LAUNCH( "d_packStats", stream );
+	d_finishStats<<<1, threads, 0, stream>>> ( d_statsPartial->getData(), blocks, d_stats->getData(), mailbox );
+	CUDA_CHECK_LAUNCH( "d_finishStats", stream );
+}
+
+const SwarmStats* kernel_get_stats_device()
+{
+	return d_stats->getData();
+}
+
+void kernel_read_stats(SwarmStats* stats, cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_read_stats", NVTX_COLOR_SIMULATION );
+
+	CUDA_CHECK( cudaMemcpyAsync( stats, d_stats->getData(), sizeof( SwarmStats ), cudaMemcpyDeviceToHost, stream ) );
+}
+
+void kernel_stats_probes(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	float4* probes,
+	unsigned int probe_count,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_stats_probes", NVTX_COLOR_SIMULATION );
+
+	if (probe_count == 0)
+		return;
+
+	LaunchConfig launch = LaunchConfig().forCount( probe_count );
+	d_gatherStatsProbes<<<launch.blocks, launch.threads, 0, stream>>> ( particles, mesh_count, probes, probe_count );
+	CUDA_CHECK_LAUNCH( "d_gatherStatsProbes", stream );
+}
+
+void kernel_stats_sample(
+	const float4* probes,
+	unsigned int probe_count,
+	const float* distances,
+	float binWidth,
+	unsigned long long step,
+	StatsSample* sample,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_stats_sample", NVTX_COLOR_SIMULATION );
+
+	d_storeStatsSample<<<1, STATS_SAMPLE_THREADS, 0, stream>>> ( probes, probe_count, distances, binWidth, step, d_stats->getData(), sample );
+	CUDA_CHECK_LAUNCH( "d_storeStatsSample", stream );
+}
+
+bool kernel_has_advance_nearest()
+{
+	return ADVANCE_NEAREST;
+}
+
+void kernel_swarm_analytics(
+	ParticleArrays particles,
+	unsigned int mesh_count,
+	float nearestBinWidth,
+	StatsSample* sample,
+	cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_swarm_analytics", NVTX_COLOR_SIMULATION );
+
+	char* first = reinterpret_cast< char* >( sample->density );					// density up to headed, the rest is kernel_stats_sample's
+	char* last = reinterpret_cast< char* >( &sample->headed + 1 );
+	CUDA_CHECK( cudaMemsetAsync( first, 0, last - first, stream ) );
+	if (mesh_count == 0)
+		return;
+
+	// Full blocks, so every warp is complete for the shuffles. Few blocks, each adds its bins once.
+	unsigned int blocks = std::min( static_cast< unsigned int >( iDivUp( mesh_count, ANALYTICS_THREADS ) ), MAX_STATS_BLOCKS );
+	d_swarmAnalytics<<<blocks, ANALYTICS_THREADS, 0, stream>>> ( particles, mesh_count, ADVANCE_NEAREST ? d_nearest->getData() : NULL,
+		QUERY_GRID ? d_cellStart->getData() : NULL, QUERY_GRID ? d_cellEnd->getData() : NULL, GRID_LAYOUT, nearestBinWidth, sample );
+	CUDA_CHECK_LAUNCH( "d_swarmAnalytics", stream );
+}
+
+void kernel_init_events(unsigned int capacity)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_init_events", NVTX_COLOR_SETUP );
+
+	releaseEvents();
+	if (capacity == 0)
+		return;
+
+	// Mapped: the kernels write the few events straight into host memory, nothing is copied but the counter.
+	for (int i = 0; i < 2; i++)
+	{
+		EVENTS.events[i] = new CudaHostArray<SwarmEvent>( capacity, cudaHostAllocMapped );
+		CUDA_CHECK( cudaHostGetDevicePointer( reinterpret_cast< void** >( &EVENTS.deviceEvents[i] ), EVENTS.events[i]->getData(), 0 ) );
+	}
+	EVENTS.count = new CudaDeviceArray<unsigned int>( 2, MemoryCategory::SCRATCH );
+	EVENTS.hostCount = new CudaHostArray<unsigned int>( 2 );
+	CUDA_CHECK( cudaMemset( EVENTS.count->getData(), 0, 2 * sizeof( unsigned int ) ) );
+	CUDA_CHECK( cudaEventCreateWithFlags( &EVENTS.read, cudaEventDisableTiming ) );
+	EVENTS.capacity = capacity;
+}
+
+unsigned int kernel_drain_events(std::vector<SwarmEvent>& events, cudaStream_t stream)
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_drain_events", NVTX_COLOR_SYNC );
+
+	if (EVENTS.capacity == 0)
+		return 0;
+
+	// The buffer closed by the last drain. Its steps ran a frame ago, the wait is over almost always.
+	unsigned int dropped = 0;
+	unsigned int closed = EVENTS.active;
+	unsigned int other = 1 - closed;
+	if (EVENTS.pending)
+	{
+		CUDA_CHECK( cudaEventSynchronize( EVENTS.read ) );
+		unsigned int count = ( *EVENTS.hostCount )[other];
+		unsigned int stored = std::min( count, EVENTS.capacity );
+		const SwarmEvent* first = EVENTS.events[other]->getData();
+		events.insert( events.end(), first, first + stored );
+		dropped = count - stored;
+	}
+
+	// Close the active buffer behind all steps queued so far and let the next steps append to the drained one.
+	CUDA_CHECK( cudaMemcpyAsync( EVENTS.hostCount->getData() + closed, EVENTS.count->getData() + closed, sizeof( unsigned int ), cudaMemcpyDeviceToHost, stream ) );
+	CUDA_CHECK( cudaEventRecord( EVENTS.read, stream ) );
+	CUDA_CHECK( cudaMemsetAsync( EVENTS.count->getData() + other, 0, sizeof( unsigned int ), stream ) );
+	EVENTS.active = other;
+	EVENTS.pending = true;
+	return dropped;
 }
 
-void kernel_init_grid(int mesh_count)
+void kernel_init_grid(int mesh_count, const cudaDeviceProp& properties)
 {
-	// Compute optimal grid size depending on number 
-	// of fishies and pre defined block size.
-    computeGridSize(mesh_count, BLOCK_SIZE);
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_init_grid", NVTX_COLOR_SETUP );
+
+	// Block size with the highest occupancy per kernel, depends on registers and shared memory on this GPU.
+	// The advance kernels use the variant with all features, it needs the most registers, so the block size fits every variant.
+	LAUNCH_ADVANCE = occupancyLaunchConfig( d_advance<QUERY_FEATURES>, mesh_count, properties );
+	LAUNCH_TILED = occupancyLaunchConfig( d_advance_tiled<QUERY_FEATURES>, mesh_count, properties, sizeof( float4 ) );
+	LAUNCH_TILED_ASYNC = occupancyLaunchConfig( d_advance_tiled_async<QUERY_FEATURES>, mesh_count, properties, TILE_STAGES * sizeof( float4 ) );
+	LAUNCH_WARP = occupancyLaunchConfig( d_advance_warp<SWIM_FEATURES>, mesh_count * WARP_SIZE, properties, 0, 0, WARP_SIZE );
+	LAUNCH_HASH = occupancyLaunchConfig( d_calcHash, mesh_count, properties );
+	LAUNCH_REORDER = occupancyLaunchConfig( d_reorderDataAndFindCellStart, mesh_count, properties, sizeof( unsigned int ), sizeof( unsigned int ) );
+	LAUNCH_GRID = occupancyLaunchConfig( d_advance_grid<GRID_FEATURES>, mesh_count, properties );
+	LAUNCH_BOIDS = occupancyLaunchConfig( d_advance_boids<SWIM_FEATURES>, mesh_count, properties );
+	LAUNCH_SHARKS = occupancyLaunchConfig( d_moveSharks, 1, properties );
+	LAUNCH_HUNT = occupancyLaunchConfig( d_huntSharks, 1, properties );
+	LAUNCH_PACK = occupancyLaunchConfig( d_pack, mesh_count, properties );
+	LAUNCH_TRAJECTORY = occupancyLaunchConfig( d_packTrajectory, mesh_count, properties );
+	LAUNCH_COLLECT = occupancyLaunchConfig( d_collectDead, mesh_count, properties );
+	LAUNCH_SPAWN = occupancyLaunchConfig( d_spawn, mesh_count, properties );
+	LAUNCH_SPAWN_ALL = occupancyLaunchConfig( d_spawnAll, mesh_count, properties );
+	LAUNCH_STATS = occupancyLaunchConfig( d_reduceStats, mesh_count, properties, 0, 0, WARP_SIZE );
+	LAUNCH_MORTON = occupancyLaunchConfig( d_calcMorton, mesh_count, properties );
+	LAUNCH_PERMUTE = occupancyLaunchConfig( d_permute, mesh_count, properties );
+	LAUNCH_COLORS = occupancyLaunchConfig( d_packColors, mesh_count, properties );
+	LAUNCH_DEPTH = occupancyLaunchConfig( d_depthKeys, mesh_count, properties );
+	LAUNCH_SPLAT = occupancyLaunchConfig( d_splatDensity, mesh_count, properties );
+	LAUNCH_SHADE = occupancyLaunchConfig( d_shadeDensity, DENSITY_SIZE * DENSITY_SIZE, properties );
+	LAUNCH_TRAIL = occupancyLaunchConfig( d_appendTrail, mesh_count, properties );
+	LAUNCH_CURRENT = occupancyLaunchConfig( d_curlNoise, mesh_count, properties );
+	LAUNCH_ENSEMBLE = occupancyLaunchConfig( d_advance_ensemble<FEATURE_JITTER>, mesh_count, properties, sizeof( float4 ) );
+	LAUNCH_ENSEMBLE_METRICS = occupancyLaunchConfig( d_reduceEnsembleMetrics, mesh_count, properties, sizeof( float4 ), 0, WARP_SIZE );
+	LAUNCH_VERLET_BUILD = occupancyLaunchConfig( d_buildVerlet, mesh_count, properties );
+	LAUNCH_VERLET = occupancyLaunchConfig( d_advance_verlet<QUERY_FEATURES>, mesh_count, properties );
+	LAUNCH_DISPLACEMENT = occupancyLaunchConfig( d_verletDisplacement, mesh_count, properties, 0, 0, WARP_SIZE );
+	LAUNCH_PARTITION = occupancyLaunchConfig( d_partitionSlab, mesh_count, properties );
+	LAUNCH_CLASSIFY = occupancyLaunchConfig( d_classifyEvaders<SWIM_FEATURES>, mesh_count, properties );
+	LAUNCH_BVH_LEAVES = occupancyLaunchConfig( d_bvhLeaves, mesh_count, properties );
+	LAUNCH_BVH_INTERNAL = occupancyLaunchConfig( d_bvhInternal, mesh_count, properties );
+	LAUNCH_BVH_MERGE = occupancyLaunchConfig( d_bvhMerge, mesh_count, properties );
+	LAUNCH_RATES = occupancyLaunchConfig( d_classifyRates, mesh_count, properties );
+
+	// Substeps: the whole swarm has to fit into the shared memory of one block, up to the opt-in limit of the GPU.
+	cudaFuncAttributes substepAttributes;
+	CUDA_CHECK( cudaFuncGetAttributes( &substepAttributes, d_advance_substeps<QUERY_FEATURES> ) );
+	size_t substepLimit = std::max( properties.sharedMemPerBlockOptin, properties.sharedMemPerBlock );
+	SUBSTEP_SHARED = static_cast< unsigned int >( substepLimit - substepAttributes.sharedSizeBytes );
+	for (auto variant : SUBSTEP_VARIANTS)
+		CUDA_CHECK( cudaFuncSetAttribute( variant, cudaFuncAttributeMaxDynamicSharedMemorySize, SUBSTEP_SHARED ) );
+
+	// Persisting L2 needs Ampere or newer, older GPUs report 0.
+	L2_PERSIST_MAX = properties.major >= 8 ? properties.persistingL2CacheMaxSize : 0;
+	L2_WINDOW_MAX = properties.accessPolicyMaxWindowSize;
+
+	// WMMA needs Volta or newer, older GPUs run the TENSOR search tiled.
+	TENSOR_CORES = properties.major >= 7;
+
+	// Before Ampere memcpy_async falls back to synchronous copies, the tiles are loaded the plain way then.
+	ASYNC_TILES = properties.major >= 8;
+
+	// Thread block clusters need Hopper, older GPUs keep d_advance_grid.
+	CLUSTER_CELLS = properties.major >= 9;
+
+	// A cooperative launch fails if not all of its blocks fit onto the GPU at once.
+	COOPERATIVE_BLOCKS = 0;
+	if (properties.cooperativeLaunch)
+	{
+		int perMultiprocessor = 0;
+		CUDA_CHECK( cudaOccupancyMaxActiveBlocksPerMultiprocessor( &perMultiprocessor, d_advance_cooperative<GRID_FEATURES>, COOPERATIVE_THREADS, 0 ) );
+		COOPERATIVE_BLOCKS = perMultiprocessor * properties.multiProcessorCount;
+	}
+
+	// Allocate uniform grid. One additional cell collects the dead fishies.
+	d_gridParticleHash = new CudaDeviceArray<unsigned int>( mesh_count, MemoryCategory::NEIGHBOURS );
+	d_gridParticleIndex = new CudaDeviceArray<unsigned int>( mesh_count, MemoryCategory::NEIGHBOURS );
+	d_cellStart = new CudaDeviceArray<unsigned int>( GRID_NUM_CELLS + 1, MemoryCategory::NEIGHBOURS );
+	d_cellEnd = new CudaDeviceArray<unsigned int>( GRID_NUM_CELLS + 1, MemoryCategory::NEIGHBOURS );
+
+	// Hashed grid: at most one cell per fish, twice the slots keep the probes short. The slots and the empty bucket fit before the dead cell.
+	HASH_SLOTS = MIN_HASH_SLOTS;
+	while (HASH_SLOTS < 2u * mesh_count && HASH_SLOTS < GRID_NUM_CELLS / 2)
+		HASH_SLOTS *= 2;
+	d_cellKeys = HASH_GRID ? new CudaDeviceArray<unsigned long long>( HASH_SLOTS, MemoryCategory::NEIGHBOURS ) : NULL;
+	GRID_LAYOUT.cellKeys = d_cellKeys != NULL ? d_cellKeys->getData() : NULL;
+	GRID_LAYOUT.keyMask = HASH_SLOTS - 1;
+	d_sorted = new ParticleStore( mesh_count );
+	d_sortedPacked = new CudaDeviceArray<ushort4>( mesh_count, MemoryCategory::NEIGHBOURS );
+	d_cellRank = new CudaDeviceArray<unsigned int>( mesh_count, MemoryCategory::NEIGHBOURS );
+	d_blockSums = COOPERATIVE_BLOCKS > 0 ? new CudaDeviceArray<unsigned int>( COOPERATIVE_BLOCKS, MemoryCategory::SCRATCH ) : NULL;
+	d_nearest = new CudaDeviceArray<unsigned int>( mesh_count, MemoryCategory::NEIGHBOURS );
+	CUDA_CHECK( cudaMemset( d_nearest->getData(), 0xff, mesh_count * sizeof( unsigned int ) ) );	// No closest fish yet
+	d_arena = new DeviceArena();
+	d_freeList = new CudaDeviceArray<unsigned int>( mesh_count, MemoryCategory::SCRATCH );
+	d_freeCount = new CudaDeviceArray<unsigned int>( 1, MemoryCategory::SCRATCH );
+	d_flockList = new CudaDeviceArray<unsigned int>( mesh_count, MemoryCategory::SCRATCH );
+	d_flockCount = new CudaDeviceArray<unsigned int>( 1, MemoryCategory::SCRATCH );
+	d_rateBuckets = new CudaDeviceArray<unsigned int>( RATE_BUCKETS * mesh_count, MemoryCategory::SCRATCH );
+	d_rateCounts = new CudaDeviceArray<unsigned int>( RATE_BUCKETS, MemoryCategory::SCRATCH );
+	d_sharkClaims = new CudaDeviceArray<unsigned int>( mesh_count, MemoryCategory::SCRATCH );
+	d_statsPartial = new CudaDeviceArray<StatsPartial>( MAX_STATS_BLOCKS, MemoryCategory::SCRATCH );
+	d_stats = new CudaDeviceArray<SwarmStats>( 1, MemoryCategory::SCRATCH, CudaMallocAllocator::managed( ManagedRole::HOST_PREFERRED ) );
+	d_density = new CudaDeviceArray<unsigned int>( DENSITY_SIZE * DENSITY_SIZE, MemoryCategory::SCRATCH );
+
+	// Inputs of captured steps.
+	h_capturedSteps = new CudaHostArray<StepInputs>( MAX_CAPTURED_STEPS );
+	CUDA_CHECK( cudaEventCreateWithFlags( &capturedStepsRead, cudaEventDisableTiming ) );
+	capturedGraph = NULL;
+
+	// Verlet lists. Allocated for every search mode, the mode can change at runtime.
+	d_verletList = new CudaDeviceArray<unsigned int>( VERLET_MAX_NEIGHBOURS * mesh_count, MemoryCategory::NEIGHBOURS );
+	d_verletCount = new CudaDeviceArray<unsigned int>( mesh_count, MemoryCategory::NEIGHBOURS );
+	d_verletRef = new CudaDeviceArray<float4>( mesh_count, MemoryCategory::NEIGHBOURS );
+	d_verletMax = new CudaDeviceArray<unsigned int>( 2, MemoryCategory::NEIGHBOURS );
+	h_verletMax = new CudaHostArray<float>( 2 );
+	CUDA_CHECK( cudaEventCreateWithFlags( &verletRead, cudaEventDisableTiming ) );
+	VERLET_VALID = false;
+	VERLET_READ_PENDING = false;
+
+	// NVRTC takes a while, build the specialised grid advance here and not in the first step.
+	updateRtcAdvance( mesh_count, &properties );
+}
+
+void kernel_cleanup()
+{
+	NVTX_RANGE( NvtxDomain::KERNEL, "kernel_cleanup", NVTX_COLOR_SETUP );
+
+	delete d_gridParticleHash;
+	delete d_gridParticleIndex;
+	if (L2_WINDOW.num_bytes > 0)
+	{
+		cudaStreamAttrValue value = {};
+		CUDA_CHECK( cudaStreamSetAttribute( L2_STREAM, cudaStreamAttributeAccessPolicyWindow, &value ) );
+		CUDA_CHECK( cudaCtxResetPersistingL2Cache() );
+		L2_WINDOW = {};
+	}
+	delete d_cellStart;
+	delete d_cellEnd;
+	delete d_sorted;
+	delete d_sortedPacked;
+	delete d_cellRank;
+	delete d_blockSums;
+	delete d_nearest;
+	delete d_cellVelocity;
+	delete d_cellCentroid;
+	delete d_collisionPositions;
+	delete d_collisionDeltas;
+	delete d_cellKeys;
+	delete d_clusterKeys;
+	delete d_clusterSums;
+	delete d_clusterMoments;
+	d_cellVelocity = NULL;
+	d_cellCentroid = NULL;
+	d_collisionPositions = NULL;
+	d_collisionDeltas = NULL;
+	d_cellKeys = NULL;
+	d_clusterKeys = NULL;
+	d_clusterSums = NULL;
+	d_clusterMoments = NULL;
+	GRID_LAYOUT.cellKeys = NULL;
+	delete d_arena;
+	delete d_freeList;
+	delete d_freeCount;
+	delete d_flockList;
+	delete d_sharkClaims;
+	delete d_flockCount;
+	delete d_rateBuckets;
+	delete d_rateCounts;
+	delete d_ensembleMembers;
+	delete d_ensembleParams;
+	delete d_ensembleMetricsPartial;
+	delete d_ensembleMetrics;
+	d_ensembleMembers = NULL;
+	d_ensembleParams = NULL;
+	d_ensembleMetricsPartial = NULL;
+	d_ensembleMetrics = NULL;
+	ENSEMBLE_SIZE = 0;
+	delete d_statsPartial;
+	delete d_stats;
+	delete d_density;
+	delete d_bvhNodes;
+	delete d_bvhCodes;
+	delete d_bvhOrder;
+	delete d_bvhVisits;
+	d_bvhNodes = NULL;
+	d_bvhCodes = NULL;
+	d_bvhOrder = NULL;
+	d_bvhVisits = NULL;
+	delete d_verletList;
+	delete d_verletCount;
+	delete d_verletRef;
+	delete d_verletMax;
+	delete h_verletMax;
+	CUDA_CHECK( cudaEventDestroy( verletRead ) );
+	delete h_capturedSteps;
+	CUDA_CHECK( cudaEventDestroy( capturedStepsRead ) );
+	if (d_obstacleVolume != 0)
+		CUDA_CHECK( cudaDestroyTextureObject( d_obstacleVolume ) );
+	if (d_obstacleArray != NULL)
+		CUDA_CHECK( cudaFreeArray( d_obstacleArray ) );
+	d_obstacleVolume = 0;
+	d_obstacleArray = NULL;
+	obstacleVersion = 0;
+	releaseAttractors();
+	attractorVersion = 0;
+	delete d_alarm;
+	d_alarm = NULL;
+	alarmVersion = 0;
+	releaseCurrent();
+	releaseEvents();
+	h_paramsDirty = true;										// c_obstacles, c_attractors and c_current hold destroyed textures, c_farField freed nodes
+	if (capturedGraph != NULL)
+		CUDA_CHECK( cudaGraphExecDestroy( capturedGraph ) );
+	capturedGraph = NULL;
+	delete RTC_ADVANCE;
+	RTC_ADVANCE = NULL;
+	RTC_TRIED = RtcAdvanceKey();
 }
 
+KernelContext* kernel_create_context()
+{
+	return new KernelContext();
+}
+
+void kernel_use_context(KernelContext* context)
+{
+	if (context == ACTIVE_CONTEXT)
+		return;
+
+	// The object of the active context holds no state, the statics do.
+	KernelContext& from = ACTIVE_CONTEXT != NULL ? *ACTIVE_CONTEXT : DEFAULT_CONTEXT;
+	swapContext( from );
+	from.paramsVersion = PARAMS_VERSION;						// kernel_set_params changed the statics of this context
+	from.schoolsVersion = SCHOOLS_VERSION;
+
+	KernelContext& to = context != NULL ? *context : DEFAULT_CONTEXT;
+	swapContext( to );
+	if (to.paramsVersion != PARAMS_VERSION)						// Parameters changed while another context was active
+	{
+		h_paramsDirty = true;
+		VERLET_VALID = false;
+		GRID_LAYOUT.cellSize = h_params.fishDist * TUNING.cellScale;
+	}
+	if (to.schoolsVersion != SCHOOLS_VERSION)					// Schools were set while another context was active
+		h_schoolsDirty = true;
+	ACTIVE_CONTEXT = context;
+}
 
+void kernel_destroy_context(KernelContext* context)
+{
+	if (context == ACTIVE_CONTEXT)
+		kernel_use_context( NULL );
+	delete context;
+}
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "kernel_cost.h"
+
+static const double FISH_LOAD_BYTES = 33.0;		// Position, speed and mass, alive and id (school) of the fish
+static const double FISH_STORE_BYTES = 29.0;	// Position, speed and mass, alive
+static const double SWIM_FLOPS = 80.0;			// Steering, evasion, speed limit and integration in d_swim, without the searches
+static const double CANDIDATE_FLOPS = 8.0;		// Difference and squared length of a candidate (NeighbourQuery::add)
+static const double SHARK_FLOPS = 8.0;			// Same per shark (d_nearestShark)
+static const double SORT_PASSES = 4.0;			// Radix sort of the 32 bit cell hashes, 8 bits per pass
+
+KernelCost advanceCost( SearchMode mode, const SwarmStats& stats, unsigned int sharks, const SwarmParams& params, const KernelTuning& tuning )
+{
+	KernelCost cost;
+	double fishies = stats.liveCount;
+	double others = std::max( fishies - 1.0, 0.0 );
+	double volume = static_cast< double >( stats.boundsMax.x - stats.boundsMin.x ) * ( stats.boundsMax.y - stats.boundsMin.y )
+		* ( stats.boundsMax.z - stats.boundsMin.z );
+	double density = volume > 1e-9 ? fishies / volume : 0.0;					// Flat or empty swarm: every fish is a candidate
+
+	cost.loadBytes = FISH_LOAD_BYTES + sharks * 16.0;							// float4 per shark
+	cost.storeBytes = FISH_STORE_BYTES;
+	cost.flops = SWIM_FLOPS + sharks * SHARK_FLOPS;
+
+	switch ( mode )
+	{
+	case SearchMode::BRUTE_FORCE:
+	case SearchMode::WARP:														// Every candidate from global memory, once per fish
+		cost.candidates = others;
+		cost.loadBytes += cost.candidates * 13.0;								// x, y, z and alive
+		break;
+	case SearchMode::TILED:
+	case SearchMode::TENSOR:													// One tile load per block, the candidates come from shared memory
+	{
+		double tile = tuning.searchThreads > 0 ? tuning.searchThreads : 256.0;
+		cost.candidates = others;
+		cost.loadBytes += fishies * 13.0 / tile;
+		break;
+	}
+	case SearchMode::AUTO:
+	case SearchMode::GRID:
+	case SearchMode::CELL:														// CELL: the block of a cell loads the 27 cells once for all fishies of the cell
+	{
+		double cell = params.fishDist * std::max( tuning.cellScale, 1.0f );
+		double perCell = mode == SearchMode::CELL ? std::max( cell * cell * cell * density, 1.0 ) : 1.0;
+		cost.candidates = density > 0.0 ? std::min( 27.0 * cell * cell * cell * density, others ) : others;
+		cost.loadBytes += ( 27.0 * 8.0 + cost.candidates * 12.0 ) / perCell;	// Cell start and end, sorted x, y, z
+		cost.loadBytes += 13.0 + SORT_PASSES * 8.0 + 12.0 + FISH_LOAD_BYTES;	// Hash, sort, cell bounds and reorder of the build
+		cost.storeBytes += 8.0 + SORT_PASSES * 8.0 + 8.0 + FISH_LOAD_BYTES;
+		break;
+	}
+	case SearchMode::VERLET:													// List rebuilds are not counted, they are rare
+	{
+		double radius = params.fishDist + params.verletSkin;
+		cost.candidates = density > 0.0 ? std::min( 4.18879 * radius * radius * radius * density, others ) : others;	// 4/3 pi r^3
+		cost.loadBytes += 4.0 + cost.candidates * ( 4.0 + 13.0 );				// Count, then slot and x, y, z, alive per candidate
+		break;
+	}
+	}
+	cost.flops += cost.candidates * CANDIDATE_FLOPS;
+	return cost;
+}
+
+DevicePeaks devicePeaks( const cudaDeviceProp& properties )
+{
+	int lanes = 64;																// FP32 lanes per SM
+	int version = properties.major * 10 + properties.minor;
+	if ( properties.major == 3 )
+		lanes = 192;
+	else if ( properties.major == 5 || version == 61 || version == 62 || version >= 86 )
+		lanes = 128;
+
+	DevicePeaks peaks;
+	peaks.bandwidth = 2.0 * properties.memoryClockRate * 1e3 * ( properties.memoryBusWidth / 8.0 ) * 1e-9;	// kHz, bits
+	peaks.gflops = 2.0 * properties.multiProcessorCount * lanes * properties.clockRate * 1e3 * 1e-9;
+	return peaks;
+}
+
+std::string rooflineReport( SearchMode mode, const KernelCost& cost, double fishSteps, double seconds, const cudaDeviceProp& properties )
+{
+	if ( fishSteps <= 0.0 || seconds <= 0.0 )
+		return std::string();
+
+	DevicePeaks peaks = devicePeaks( properties );
+	double bytes = cost.loadBytes + cost.storeBytes;
+	double gbs = bytes * fishSteps / seconds * 1e-9;
+	double gflops = cost.flops * fishSteps / seconds * 1e-9;
+	double intensity = bytes > 0.0 ? cost.flops / bytes : 0.0;
+	double ridge = peaks.bandwidth > 0.0 ? peaks.gflops / peaks.bandwidth : 0.0;
+	double roof = std::min( peaks.gflops, intensity * peaks.bandwidth );		// Attainable GFLOP/s at this intensity
+	bool memoryBound = intensity < ridge;
+
+	char line[160];
+	std::string text;
+	std::snprintf( line, sizeof( line ), "Cost model:                       %s, %.0f candidates, %.0f bytes, %.0f FLOP per fish step\n",
+		searchModeName( mode ), cost.candidates, bytes, cost.flops );
+	text += line;
+	std::snprintf( line, sizeof( line ), "Achieved bandwidth:               %.1f GB/s, %.1f %% of %.0f GB/s\n",
+		gbs, peaks.bandwidth > 0.0 ? 100.0 * gbs / peaks.bandwidth : 0.0, peaks.bandwidth );
+	text += line;
+	std::snprintf( line, sizeof( line ), "Achieved compute:                 %.1f GFLOP/s, %.1f %% of %.0f GFLOP/s\n",
+		gflops, peaks.gflops > 0.0 ? 100.0 * gflops / peaks.gflops : 0.0, peaks.gflops );
+	text += line;
+	std::snprintf( line, sizeof( line ), "Roofline:                         %.2f FLOP/byte, ridge %.2f: %s bound, %.1f %% of the roof\n",
+		intensity, ridge, memoryBound ? "bandwidth" : "compute", roof > 0.0 ? 100.0 * gflops / roof : 0.0 );
+	text += line;
+	return text;
+}
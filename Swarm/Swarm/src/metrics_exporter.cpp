@@ -0,0 +1,196 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET SocketHandle;
+#define closeSocket closesocket
+#define SEND_FLAGS 0
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int SocketHandle;
+#define INVALID_SOCKET -1
+#define closeSocket close
+#define SEND_FLAGS MSG_NOSIGNAL													// A closed client must not raise SIGPIPE
+#endif
+
+#include "metrics_exporter.h"
+
+MetricsExporter::MetricsExporter( unsigned int port ) :
+	port_( port ),
+	listener_( static_cast< unsigned long long >( INVALID_SOCKET ) )
+{
+	if ( port_ == 0 )
+		return;
+
+#ifdef _WIN32
+	WSADATA wsa;
+	if ( WSAStartup( MAKEWORD( 2, 2 ), &wsa ) != 0 )
+	{
+		std::cerr << "WSAStartup failed, no metrics." << std::endl;
+		return;
+	}
+#endif
+	SocketHandle listener = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+	int reuse = 1;
+	setsockopt( listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast< const char* >( &reuse ), sizeof( reuse ) );	// Restart without waiting for TIME_WAIT
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl( INADDR_ANY );
+	address.sin_port = htons( static_cast< unsigned short >( port_ ) );
+	if ( listener == INVALID_SOCKET || bind( listener, reinterpret_cast< sockaddr* >( &address ), sizeof( address ) ) != 0 || listen( listener, 4 ) != 0 )
+	{
+		std::cerr << "Impossible to serve metrics on port " << port_ << "!" << std::endl;
+		if ( listener != INVALID_SOCKET )
+			closeSocket( listener );
+#ifdef _WIN32
+		WSACleanup();
+#endif
+		return;
+	}
+
+	listener_ = static_cast< unsigned long long >( listener );
+	server_ = std::thread( &MetricsExporter::serve, this );
+	std::cout << "Metrics:                          http://localhost:" << port_ << "/metrics" << std::endl;
+}
+
+MetricsExporter::~MetricsExporter()
+{
+	if ( !server_.joinable() )
+		return;
+
+	stop_.store( true );
+	server_.join();																// Wakes up within POLL_MS
+	closeSocket( static_cast< SocketHandle >( listener_ ) );
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+void MetricsExporter::publish( const MetricsSample& sample )
+{
+	if ( port_ == 0 )
+		return;
+
+	unsigned long long number = published_ + 1;
+	Slot& slot = slots_[number % SLOTS];
+	slot.sequence.fetch_add( 1, std::memory_order_relaxed );					// Odd: being written
+	std::atomic_thread_fence( std::memory_order_release );
+	slot.sample = sample;
+	slot.sequence.fetch_add( 1, std::memory_order_release );					// Even again
+	latest_.store( number, std::memory_order_release );
+	published_ = number;
+}
+
+bool MetricsExporter::read( MetricsSample& sample ) const
+{
+	for ( int attempt = 0; attempt < 8; attempt++ )								// The renderer overwrites a slot only every SLOTS publications
+	{
+		unsigned long long latest = latest_.load( std::memory_order_acquire );
+		if ( latest == 0 )
+			return false;
+
+		const Slot& slot = slots_[latest % SLOTS];
+		unsigned long long before = slot.sequence.load( std::memory_order_acquire );
+		if ( before % 2 == 1 )
+			continue;
+		MetricsSample copy = slot.sample;
+		std::atomic_thread_fence( std::memory_order_acquire );					// Copy before the second read of the sequence
+		if ( slot.sequence.load( std::memory_order_relaxed ) != before )
+			continue;
+
+		sample = copy;
+		return true;
+	}
+	return false;
+}
+
+std::string MetricsExporter::format( const MetricsSample& sample )
+{
+	std::string text;
+	char line[256];
+	auto add = [&text, &line]( const char* name, const char* type, const char* help, const char* labels, double value )
+	{
+		if ( help != NULL )
+		{
+			std::snprintf( line, sizeof( line ), "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type );
+			text += line;
+		}
+		std::snprintf( line, sizeof( line ), "%s%s %.17g\n", name, labels, value );
+		text += line;
+	};
+
+	add( "swarm_frames_total", "counter", "Frames since the start.", "", static_cast< double >( sample.frames ) );
+	add( "swarm_frames_over_budget_total", "counter", "Frames over the frame budget since the start.", "", static_cast< double >( sample.overBudget ) );
+	add( "swarm_frame_time_ms", "gauge", "Frame time percentiles of the recent frames in ms.", "{quantile=\"0.5\"}", sample.frameP50 );
+	add( "swarm_frame_time_ms", "gauge", NULL, "{quantile=\"0.95\"}", sample.frameP95 );
+	add( "swarm_frame_time_ms", "gauge", NULL, "{quantile=\"0.99\"}", sample.frameP99 );
+	add( "swarm_steps_total", "counter", "Simulation steps since the start.", "", static_cast< double >( sample.steps ) );
+	add( "swarm_steps_per_second", "gauge", "Simulation steps per second.", "", sample.stepsPerSecond );
+	add( "swarm_live_fishies", "gauge", "Living fishies.", "", sample.liveFishies );
+	add( "swarm_device_memory_bytes", "gauge", "Tracked device memory.", "", static_cast< double >( sample.deviceBytes ) );
+	add( "swarm_device_memory_peak_bytes", "gauge", "Peak of the tracked device memory.", "", static_cast< double >( sample.devicePeakBytes ) );
+	if ( sample.seriesFrames > 0 )
+	{
+		add( "swarm_series_frames", "gauge", "Frames of the last read back of the stats ring.", "", sample.seriesFrames );
+		add( "swarm_nearest_distance", "gauge", "Distance of the fishies to their closest fish, newest frame.", "{quantile=\"0.5\"}", sample.nearestP50 );
+		add( "swarm_nearest_distance", "gauge", NULL, "{quantile=\"0.95\"}", sample.nearestP95 );
+		add( "swarm_nearest_distance_mean", "gauge", "Mean distance to the closest fish over the series.", "", sample.nearestMean );
+		add( "swarm_mean_speed", "gauge", "Mean speed of the fishies over the series.", "", sample.meanSpeed );
+		add( "swarm_extent", "gauge", "Diagonal of the bounding box of the swarm, newest frame.", "", sample.extent );
+		add( "swarm_polarisation", "gauge", "Mean polarisation of the headings over the series, 0 to 1.", "", sample.polarisation );
+		add( "swarm_alignment", "gauge", "Mean cosine between the headings of closest fishies over the series.", "", sample.alignment );
+		add( "swarm_cell_density", "gauge", "Median of the fishies per grid cell, newest frame.", "", sample.cellDensity );
+	}
+	return text;
+}
+
+void MetricsExporter::serve()
+{
+	SocketHandle listener = static_cast< SocketHandle >( listener_ );
+	while ( !stop_.load() )
+	{
+		fd_set ready;
+		FD_ZERO( &ready );
+		FD_SET( listener, &ready );
+		timeval timeout = { 0, static_cast< long >( POLL_MS * 1000 ) };
+		if ( select( static_cast< int >( listener + 1 ), &ready, NULL, NULL, &timeout ) <= 0 )
+			continue;															// Timeout: check stop_
+
+		SocketHandle client = accept( listener, NULL, NULL );
+		if ( client == INVALID_SOCKET )
+			continue;
+#ifdef _WIN32
+		DWORD wait = POLL_MS;
+#else
+		timeval wait = { 0, static_cast< long >( POLL_MS * 1000 ) };
+#endif
+		setsockopt( client, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast< const char* >( &wait ), sizeof( wait ) );	// A silent or slow client can't hold the server
+		setsockopt( client, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast< const char* >( &wait ), sizeof( wait ) );
+
+		char request[1024];
+		int received = recv( client, request, sizeof( request ) - 1, 0 );		// Only the request line matters
+		request[received > 0 ? received : 0] = '\0';
+		bool metrics = std::strncmp( request, "GET /metrics", 12 ) == 0 || std::strncmp( request, "GET / ", 6 ) == 0;
+
+		MetricsSample sample;
+		std::string body = metrics && read( sample ) ? format( sample ) : std::string();
+		std::string response;
+		if ( !metrics )
+			response = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+		else if ( body.empty() )
+			response = "HTTP/1.0 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";	// No publication yet
+		else
+			response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string( body.size() ) + "\r\n\r\n" + body;
+		send( client, response.data(), static_cast< int >( response.size() ), SEND_FLAGS );
+		closeSocket( client );
+	}
+}
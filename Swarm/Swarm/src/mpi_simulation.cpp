@@ -0,0 +1,488 @@
+#ifdef SWARM_MPI
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include "mpi_simulation.h"
+#include "host_simulation.h"
+#include "nvtx_range.h"
+
+/*!
+ * @brief Check the result of an MPI call. Aborts all ranks, a single rank can't leave a collective run.
+ * @param result result of the call.
+ * @param call text of the call.
+ */
+static void mpiCheck( int result, const char* call )
+{
+	if ( result == MPI_SUCCESS )
+		return;
+
+	char text[MPI_MAX_ERROR_STRING];
+	int length = 0;
+	MPI_Error_string( result, text, &length );
+	std::cerr << call << " failed: " << text << std::endl;
+	MPI_Abort( MPI_COMM_WORLD, result );
+}
+
+#define MPI_CHECK( call ) mpiCheck( ( call ), #call )
+
+MpiSimulation::MpiSimulation( const SwarmConfig& config, MPI_Comm comm ) :
+	comm_( comm ),
+	gpuDirect_( config.mpiGpuDirect ),
+	numParticles_( config.numParticles ),
+	numSharks_( config.numSharks ),
+	halo_( config.params.fishDist ),
+	dt_( 1.0 / config.simulationRate )
+{
+	MPI_CHECK( MPI_Comm_rank( comm_, &rank_ ) );
+	MPI_CHECK( MPI_Comm_size( comm_, &ranks_ ) );
+	lower_ = rank_ > 0 ? rank_ - 1 : MPI_PROC_NULL;
+	upper_ = rank_ + 1 < ranks_ ? rank_ + 1 : MPI_PROC_NULL;
+
+	speed = static_cast< float >( config.swarmSpeed * dt_ );					// Same distance per simulated second for every rate
+
+	waypointList = new WaypointList( config.waypoints );						// Initialize Waypoint path.
+	swarmCenter = waypointList->get();											// Get first swarm center for particles.
+	capacity_ = std::min( numParticles_, static_cast< unsigned int >( CAPACITY_FACTOR * numParticles_ / ranks_ ) + 1024 );
+
+	bool report = rank_ == 0;
+	if ( report && ( config.respawnRate > 0 || !config.snapshot.empty() || !config.restore.empty() ) )
+		std::cerr << "Respawn and snapshots are ignored with MPI" << std::endl;
+	if ( report && ( config.farCohesion > 0.0f || config.farAlignment > 0.0f ) )	// A slab only knows its own fishies and the halo
+		std::cerr << "The far field is ignored with MPI" << std::endl;
+	if ( report && config.multiRate > 1 )										// The slabs exchange every fish every step
+		std::cerr << "Multi-rate steps are ignored with MPI" << std::endl;
+
+	SearchMode searchMode = config.searchMode;
+	if ( searchMode == SearchMode::VERLET )										// The lists keep slots, the exchange moves the fishies every step
+	{
+		if ( report )
+			std::cerr << "Verlet search is not available with MPI, using the grid" << std::endl;
+		searchMode = SearchMode::GRID;
+	}
+
+	// One GPU per rank: the ranks of a node share its GPUs round robin.
+	MPI_Comm node;
+	int nodeRank = 0;
+	MPI_CHECK( MPI_Comm_split_type( comm_, MPI_COMM_TYPE_SHARED, rank_, MPI_INFO_NULL, &node ) );
+	MPI_CHECK( MPI_Comm_rank( node, &nodeRank ) );
+	MPI_CHECK( MPI_Comm_free( &node ) );
+	std::vector<int> devices = CudaDevice::rankDevices( config.device );
+	device_ = CudaDevice( devices[nodeRank % devices.size()] );					// Makes the GPU current
+	std::cout << "Rank " << rank_ << ": " << device_ << std::endl;
+	stream_ = device_.getStream( device_.createStream() );
+
+	kernel_set_params( config.params );											// Behaviour parameters
+	kernel_set_schools( schoolWaypoints( config.waypoints, config.schools ), config.splinePath );	// Routes of the schools in constant memory
+	kernel_set_species( config.species );										// Species table in constant memory
+	kernel_set_seed( config.seed );												// GPU random numbers, by fish id: the same on every rank
+	kernel_set_spawn_box( config.spawnMin, config.spawnMax );					// Box of the respawned fishies
+	kernel_set_behaviour( config.behaviour );									// Fish behaviour
+	kernel_set_mean_field( config.meanField );									// Boids from the cell means
+	kernel_set_search_mode( searchMode );										// Neighbour search
+	kernel_set_first_k( config.firstK );										// Neighbour query semantics
+	kernel_set_packed_positions( config.packedPositions );						// Positions read by the grid search
+	kernel_set_cooperative_grid( config.cooperativeGrid );						// Grid build and search in one launch
+	kernel_set_warm_start( config.warmStart );									// Grid search bounded by the last closest fish
+	kernel_set_grid_sort( config.gridSort );									// Counting or radix sort of the grid build
+	kernel_set_evasion_split( config.evasionSplit );							// Brute force skips the evading fishies
+	kernel_set_dense_cells( config.denseCells );								// Warps for the fishies of dense cells
+	kernel_set_background_priority( CudaDevice::getStreamPriority( StreamClass::BACKGROUND ) );	// Fills of the current behind the steps
+	kernel_set_cluster_search( config.clusterSearch );							// Cells of a cluster in distributed shared memory on Hopper
+	kernel_set_l2_persistence( config.l2Persistence && device_.supportsL2Persistence() );	// Cell tables persisting in L2 on Ampere or newer
+	kernel_set_deterministic( config.deterministic );							// Fixed-point state, ordered search and reductions
+	kernel_set_rtc( config.rtcKernels );										// Grid advance specialised for the scenario
+	if ( report && config.sharkTarget != SharkTarget::CENTER )
+		std::cout << "Shark targets need the grid of all fishies on one GPU, the sharks follow the center." << std::endl;
+	kernel_set_shark_target( SharkTarget::CENTER );								// Every rank only has the grid of its slab
+	kernel_set_integrator( config.integrator );									// Base steps only, the ranks would need one agreed scale
+	kernel_set_obstacles( bakeObstacles( config.obstacles, config.spawnMin, config.spawnMax, config.waypoints, config.obstacleRange,
+		config.obstacleResolution ), config.obstacleRange );					// Distance field of the obstacles
+	kernel_set_attractors( placeAttractors( config.attractors, config.spawnMin, config.spawnMax, config.waypoints,
+		config.attractorResolution ) );											// Field of the food patches and lures
+	kernel_set_alarm( placeAlarm( config.alarm, config.alarmDecay, config.spawnMin, config.spawnMax, config.waypoints,
+		config.params.centerThreshold, config.alarmResolution ) );				// Alarm waves of the evading fishies
+	kernel_set_current( loadCurrent( config ), config.currentStrength / config.simulationRate, config.currentPeriod );	// Current of the water
+	kernel_init_grid( capacity_, device_.getProperties() );						// Uniform grid for the slab
+
+	particles_[0] = new ParticleStore( capacity_ );
+	particles_[1] = new ParticleStore( capacity_ );
+	send_ = new ParticleStore( capacity_ );
+	lists_ = new CudaDeviceArray<unsigned int>( SLAB_LIST_COUNT * capacity_, MemoryCategory::SCRATCH );
+	counts_ = new CudaDeviceArray<unsigned int>( SLAB_LIST_COUNT, MemoryCategory::SCRATCH );
+	h_counts_ = new CudaHostArray<unsigned int>( SLAB_LIST_COUNT );
+	h_stats_ = new CudaHostArray<SwarmStats>( 1 );
+	( *h_stats_ )[0] = SwarmStats();
+	if ( !gpuDirect_ )
+	{
+		hostSend_ = new PinnedParticleStore( capacity_ );
+		hostReceive_ = new PinnedParticleStore( capacity_ );
+		h_sharks_ = new CudaHostArray<float>( numSharks_ * 4 );
+	}
+
+	// Slabs of equal width, every rank spawns its share of the fishies into its own slab. Ids are unique over the ranks.
+	float width = ( config.spawnMax.x - config.spawnMin.x ) / ranks_;
+	bounds_.resize( ranks_ );
+	for ( int r = 0; r < ranks_; r++ )
+	{
+		bounds_[r].lower = r == 0 ? -FLT_MAX : config.spawnMin.x + r * width;
+		bounds_[r].upper = r + 1 == ranks_ ? FLT_MAX : config.spawnMin.x + ( r + 1 ) * width;
+		bounds_[r].halo = halo_;
+	}
+	unsigned int first = static_cast< unsigned int >( static_cast< unsigned long long >( numParticles_ ) * rank_ / ranks_ );
+	unsigned int last = static_cast< unsigned int >( static_cast< unsigned long long >( numParticles_ ) * ( rank_ + 1 ) / ranks_ );
+	Vector3 slabMin = config.spawnMin;
+	Vector3 slabMax = config.spawnMax;
+	slabMin.x = config.spawnMin.x + rank_ * width;
+	slabMax.x = config.spawnMin.x + ( rank_ + 1 ) * width;
+
+	std::vector<float> h_data;
+	std::vector<float> h_state;
+	std::vector<float> h_shark_data;
+	std::vector<float> h_shark_state;
+	std::srand( static_cast< unsigned int >( config.seed ) );					// The same sharks on every rank
+	spawnSharks( numSharks_, h_shark_data, h_shark_state, config.spawnMin, config.spawnMax );
+	std::srand( static_cast< unsigned int >( config.seed ) + rank_ + 1 );		// Different fishies on every rank
+	spawnFish( last - first, h_data, h_state, slabMin, slabMax );				// init vertex position, force and mass
+
+	std::vector<unsigned int> ids( last - first );
+	for ( unsigned int i = first; i < last; i++ )
+		ids[i - first] = i;
+	particles_[1]->set( h_data.data(), h_state.data(), last - first );		// The first exchange sorts out the ones on a bound and builds the halo
+	CUDA_CHECK( cudaMemcpy( particles_[1]->getArrays().id, ids.data(), ids.size() * sizeof( unsigned int ), cudaMemcpyHostToDevice ) );
+	owned_ = last - first;
+
+	d_sharks = new CudaDeviceArray<float>( numSharks_ * 4, MemoryCategory::PARTICLES );
+	d_sharks->set( h_shark_data.data(), numSharks_ * 4 );
+	d_shark_state = new CudaDeviceArray<float>( numSharks_ * 4, MemoryCategory::PARTICLES );
+	d_shark_state->set( h_shark_state.data(), numSharks_ * 4 );
+
+	if ( report )
+		std::cout << "Ranks:                            " << ranks_ << " with " << capacity_ << " slots each, "
+			<< ( gpuDirect_ ? "device buffers" : "staged through the host" ) << std::endl;
+	if ( !exchange( true ) && report )
+		std::cerr << "Initial split doesn't fit into the slabs!" << std::endl;
+	updateBounds();
+}
+
+void MpiSimulation::moveSwarmCenter()
+{
+	Vector3 diff = waypointList->get() - swarmCenter;							// Get Next Swarm center
+	if (diff.length() < WAYPOINT_THRESHOLD)										// Check if center was reached
+	{
+		diff = waypointList->getNext() - swarmCenter;
+	}
+
+	diff = diff.normalized() * speed;
+	swarmCenter += diff;
+}
+
+bool MpiSimulation::step()
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "MpiSimulation::step", NVTX_COLOR_SIMULATION );
+
+	moveSwarmCenter();															// Set new Swarm center
+
+	unsigned int count = owned_ + haloCount_;
+	if ( count > 0 )
+	{
+		ParticleArrays current = particles_[0]->getArrays();
+		ParticleArrays next = particles_[1]->getArrays();
+		CUDA_CHECK( cudaMemcpyAsync( next.id, current.id, owned_ * sizeof( unsigned int ), cudaMemcpyDeviceToDevice, stream_ ) );	// The step doesn't copy the ids
+		kernel_advance( current, next, count, speed, swarmCenter,
+			reinterpret_cast<float4*>( d_sharks->getData() ), numSharks_, stream_ );
+		particleUpdates_ += owned_;
+	}
+	else
+		kernel_set_random_step( kernel_get_random_step() + 1 );				// Same random numbers on every rank
+
+	if ( rank_ == 0 )
+		kernel_move_sharks(														// Calculate new shark positions on rank 0.
+			reinterpret_cast<float4*>( d_sharks->getData() ),
+			reinterpret_cast<float4*>( d_shark_state->getData() ),
+			numSharks_,
+			speed,
+			stream_ );
+
+	bool updateDue = ++stepsSinceUpdate_ >= GRID_UPDATE_INTERVAL;
+	bool fits = exchange( updateDue );
+	if ( fits && updateDue )
+	{
+		stepsSinceUpdate_ = 0;
+		updateBounds();
+	}
+	return fits;
+}
+
+void MpiSimulation::postParticles( ParticleArrays fishies, unsigned int count, int peer, int list, bool receive, std::vector<MPI_Request>& requests )
+{
+	if ( count == 0 || peer == MPI_PROC_NULL )
+		return;
+
+	void* const arrays[9] = { fishies.x, fishies.y, fishies.z, fishies.vx, fishies.vy, fishies.vz, fishies.mass, fishies.alive, fishies.id };
+	for ( int i = 0; i < 9; i++ )
+	{
+		MPI_Datatype type = i < 7 ? MPI_FLOAT : ( i == 7 ? MPI_UNSIGNED_CHAR : MPI_UNSIGNED );
+		int tag = list * 9 + i;
+		requests.push_back( MPI_REQUEST_NULL );
+		if ( receive )
+			MPI_CHECK( MPI_Irecv( arrays[i], static_cast< int >( count ), type, peer, tag, comm_, &requests.back() ) );
+		else
+			MPI_CHECK( MPI_Isend( arrays[i], static_cast< int >( count ), type, peer, tag, comm_, &requests.back() ) );
+	}
+}
+
+void MpiSimulation::broadcastSharks()
+{
+	if ( numSharks_ == 0 )
+		return;
+
+	CUDA_CHECK( cudaStreamSynchronize( stream_ ) );							// Rank 0 finished kernel_move_sharks
+	if ( gpuDirect_ )
+	{
+		MPI_CHECK( MPI_Bcast( d_sharks->getData(), numSharks_ * 4, MPI_FLOAT, 0, comm_ ) );
+		return;
+	}
+	if ( rank_ == 0 )
+		CUDA_CHECK( cudaMemcpy( h_sharks_->getData(), d_sharks->getData(), numSharks_ * 4 * sizeof( float ), cudaMemcpyDeviceToHost ) );
+	MPI_CHECK( MPI_Bcast( h_sharks_->getData(), numSharks_ * 4, MPI_FLOAT, 0, comm_ ) );
+	if ( rank_ != 0 )
+		CUDA_CHECK( cudaMemcpyAsync( d_sharks->getData(), h_sharks_->getData(), numSharks_ * 4 * sizeof( float ), cudaMemcpyHostToDevice, stream_ ) );
+}
+
+bool MpiSimulation::exchange( bool readStats )
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "MpiSimulation::exchange", NVTX_COLOR_SYNC );
+
+	ParticleArrays next = particles_[1]->getArrays();
+	ParticleArrays current = particles_[0]->getArrays();
+	ParticleArrays send = send_->getArrays();
+	kernel_partition_slab( next, owned_, bounds_[rank_], lists_->getData(), capacity_, counts_->getData(), stream_ );
+	CUDA_CHECK( cudaMemcpyAsync( h_counts_->getData(), counts_->getData(), SLAB_LIST_COUNT * sizeof( unsigned int ), cudaMemcpyDeviceToHost, stream_ ) );
+	( *h_stats_ )[0] = SwarmStats();
+	if ( readStats && owned_ + haloCount_ > 0 )									// Owned and halo fishies, the grid holds both
+	{
+		kernel_reduce_stats( next, owned_ + haloCount_, stream_ );
+		kernel_read_stats( h_stats_->getData(), stream_ );
+	}
+	broadcastSharks();															// Also waits for the counts
+	CUDA_CHECK( cudaStreamSynchronize( stream_ ) );
+
+	// Counts of the lists for the neighbours: [0] migrating, [1] halo.
+	const CudaHostArray<unsigned int>& c = *h_counts_;
+	unsigned int toLower[2] = { c[SLAB_TO_LOWER], c[SLAB_HALO_LOWER] };
+	unsigned int toUpper[2] = { c[SLAB_TO_UPPER], c[SLAB_HALO_UPPER] };
+	unsigned int fromLower[2] = { 0, 0 };
+	unsigned int fromUpper[2] = { 0, 0 };
+	MPI_CHECK( MPI_Sendrecv( toUpper, 2, MPI_UNSIGNED, upper_, 0, fromLower, 2, MPI_UNSIGNED, lower_, 0, comm_, MPI_STATUS_IGNORE ) );
+	MPI_CHECK( MPI_Sendrecv( toLower, 2, MPI_UNSIGNED, lower_, 1, fromUpper, 2, MPI_UNSIGNED, upper_, 1, comm_, MPI_STATUS_IGNORE ) );
+
+	// Layout of particles_[0]: kept, from lower, from upper, then halo: own migrants, from lower, from upper.
+	unsigned int fromLowerAt = c[SLAB_KEEP];
+	unsigned int fromUpperAt = fromLowerAt + fromLower[0];
+	unsigned int owned = fromUpperAt + fromUpper[0];
+	unsigned int haloFromLowerAt = owned + c[SLAB_HALO_SELF];
+	unsigned int haloFromUpperAt = haloFromLowerAt + fromLower[1];
+	unsigned int total = haloFromUpperAt + fromUpper[1];
+
+	unsigned int sent = c[SLAB_TO_LOWER] + c[SLAB_HALO_LOWER] + c[SLAB_TO_UPPER] + c[SLAB_HALO_UPPER];
+	int fits = total <= capacity_ && sent <= capacity_;
+	for ( int l = 0; l < SLAB_LIST_COUNT; l++ )
+		fits = fits && c[l] <= capacity_;
+	if ( !fits )
+		std::cerr << "Rank " << rank_ << " has no room for " << std::max( total, sent ) << " fishies (" << capacity_ << " slots)!" << std::endl;
+	MPI_CHECK( MPI_Allreduce( MPI_IN_PLACE, &fits, 1, MPI_INT, MPI_LAND, comm_ ) );	// All ranks stop together
+	if ( !fits )
+		return false;
+
+	const unsigned int* lists = lists_->getData();
+	kernel_gather( next, current, lists + SLAB_KEEP * capacity_, c[SLAB_KEEP], stream_ );
+	kernel_gather( next, offsetParticles( current, owned ), lists + SLAB_HALO_SELF * capacity_, c[SLAB_HALO_SELF], stream_ );
+
+	// Send buffer: to lower, halo lower, to upper, halo upper.
+	unsigned int sendAt[4] = { 0, c[SLAB_TO_LOWER], c[SLAB_TO_LOWER] + c[SLAB_HALO_LOWER], c[SLAB_TO_LOWER] + c[SLAB_HALO_LOWER] + c[SLAB_TO_UPPER] };
+	const int sendLists[4] = { SLAB_TO_LOWER, SLAB_HALO_LOWER, SLAB_TO_UPPER, SLAB_HALO_UPPER };
+	for ( int i = 0; i < 4; i++ )
+		kernel_gather( next, offsetParticles( send, sendAt[i] ), lists + sendLists[i] * capacity_, c[sendLists[i]], stream_ );
+
+	ParticleArrays outgoing = send;
+	ParticleArrays incoming = current;
+	if ( !gpuDirect_ )
+	{
+		outgoing = hostSend_->getArrays();
+		incoming = hostReceive_->getArrays();
+		CUDA_CHECK( cudaMemcpyAsync( outgoing.x, send.x, sent * sizeof( float ), cudaMemcpyDeviceToHost, stream_ ) );
+		CUDA_CHECK( cudaMemcpyAsync( outgoing.y, send.y, sent * sizeof( float ), cudaMemcpyDeviceToHost, stream_ ) );
+		CUDA_CHECK( cudaMemcpyAsync( outgoing.z, send.z, sent * sizeof( float ), cudaMemcpyDeviceToHost, stream_ ) );
+		CUDA_CHECK( cudaMemcpyAsync( outgoing.vx, send.vx, sent * sizeof( float ), cudaMemcpyDeviceToHost, stream_ ) );
+		CUDA_CHECK( cudaMemcpyAsync( outgoing.vy, send.vy, sent * sizeof( float ), cudaMemcpyDeviceToHost, stream_ ) );
+		CUDA_CHECK( cudaMemcpyAsync( outgoing.vz, send.vz, sent * sizeof( float ), cudaMemcpyDeviceToHost, stream_ ) );
+		CUDA_CHECK( cudaMemcpyAsync( outgoing.mass, send.mass, sent * sizeof( float ), cudaMemcpyDeviceToHost, stream_ ) );
+		CUDA_CHECK( cudaMemcpyAsync( outgoing.alive, send.alive, sent * sizeof( unsigned char ), cudaMemcpyDeviceToHost, stream_ ) );
+		CUDA_CHECK( cudaMemcpyAsync( outgoing.id, send.id, sent * sizeof( unsigned int ), cudaMemcpyDeviceToHost, stream_ ) );
+	}
+	CUDA_CHECK( cudaStreamSynchronize( stream_ ) );							// MPI reads the send buffer and writes particles_[0]
+
+	std::vector<MPI_Request> requests;
+	postParticles( offsetParticles( incoming, fromLowerAt ), fromLower[0], lower_, SLAB_TO_UPPER, true, requests );
+	postParticles( offsetParticles( incoming, haloFromLowerAt ), fromLower[1], lower_, SLAB_HALO_UPPER, true, requests );
+	postParticles( offsetParticles( incoming, fromUpperAt ), fromUpper[0], upper_, SLAB_TO_LOWER, true, requests );
+	postParticles( offsetParticles( incoming, haloFromUpperAt ), fromUpper[1], upper_, SLAB_HALO_LOWER, true, requests );
+	for ( int i = 0; i < 4; i++ )
+		postParticles( offsetParticles( outgoing, sendAt[i] ), c[sendLists[i]], i < 2 ? lower_ : upper_, sendLists[i], false, requests );
+	MPI_CHECK( MPI_Waitall( static_cast< int >( requests.size() ), requests.data(), MPI_STATUSES_IGNORE ) );
+
+	if ( !gpuDirect_ )															// Received fishies are behind the kept ones and behind the own migrants
+	{
+		const unsigned int ranges[2][2] = { { fromLowerAt, owned }, { haloFromLowerAt, total } };
+		for ( int r = 0; r < 2; r++ )
+		{
+			unsigned int at = ranges[r][0];
+			unsigned int count = ranges[r][1] - at;
+			if ( count == 0 )
+				continue;
+			ParticleArrays to = offsetParticles( current, at );
+			ParticleArrays from = offsetParticles( incoming, at );
+			CUDA_CHECK( cudaMemcpyAsync( to.x, from.x, count * sizeof( float ), cudaMemcpyHostToDevice, stream_ ) );
+			CUDA_CHECK( cudaMemcpyAsync( to.y, from.y, count * sizeof( float ), cudaMemcpyHostToDevice, stream_ ) );
+			CUDA_CHECK( cudaMemcpyAsync( to.z, from.z, count * sizeof( float ), cudaMemcpyHostToDevice, stream_ ) );
+			CUDA_CHECK( cudaMemcpyAsync( to.vx, from.vx, count * sizeof( float ), cudaMemcpyHostToDevice, stream_ ) );
+			CUDA_CHECK( cudaMemcpyAsync( to.vy, from.vy, count * sizeof( float ), cudaMemcpyHostToDevice, stream_ ) );
+			CUDA_CHECK( cudaMemcpyAsync( to.vz, from.vz, count * sizeof( float ), cudaMemcpyHostToDevice, stream_ ) );
+			CUDA_CHECK( cudaMemcpyAsync( to.mass, from.mass, count * sizeof( float ), cudaMemcpyHostToDevice, stream_ ) );
+			CUDA_CHECK( cudaMemcpyAsync( to.alive, from.alive, count * sizeof( unsigned char ), cudaMemcpyHostToDevice, stream_ ) );
+			CUDA_CHECK( cudaMemcpyAsync( to.id, from.id, count * sizeof( unsigned int ), cudaMemcpyHostToDevice, stream_ ) );
+		}
+	}
+
+	owned_ = owned;
+	haloCount_ = total - owned;
+	return true;
+}
+
+void MpiSimulation::updateBounds()
+{
+	// The loads of all slabs, every rank moves all bounds the same way. Like MultiGpuSimulation::updateBounds.
+	std::vector<unsigned int> owned( ranks_ );
+	MPI_CHECK( MPI_Allgather( &owned_, 1, MPI_UNSIGNED, owned.data(), 1, MPI_UNSIGNED, comm_ ) );
+
+	float minimumWidth = 4.0f * halo_;
+	for ( int k = 0; k + 1 < ranks_; k++ )
+	{
+		SlabBounds& lower = bounds_[k];
+		SlabBounds& upper = bounds_[k + 1];
+		float total = static_cast< float >( owned[k] ) + static_cast< float >( owned[k + 1] );
+		if ( total == 0.0f )
+			continue;
+
+		float imbalance = ( static_cast< float >( owned[k] ) - static_cast< float >( owned[k + 1] ) ) / total;
+		float bound = lower.upper - imbalance * halo_;
+		if ( k > 0 )
+			bound = std::max( bound, lower.lower + minimumWidth );
+		if ( k + 2 < ranks_ )
+			bound = std::min( bound, upper.upper - minimumWidth );
+		lower.upper = bound;
+		upper.lower = bound;
+	}
+
+	kernel_set_grid_bounds( ( *h_stats_ )[0] );									// Grid around owned and halo fishies of the slab
+}
+
+SwarmStats MpiSimulation::getStats()
+{
+	( *h_stats_ )[0] = SwarmStats();
+	if ( owned_ > 0 )
+	{
+		kernel_reduce_stats( particles_[0]->getArrays(), owned_, stream_ );
+		kernel_read_stats( h_stats_->getData(), stream_ );
+	}
+	CUDA_CHECK( cudaStreamSynchronize( stream_ ) );
+	const SwarmStats& stats = ( *h_stats_ )[0];
+
+	// Weighted sums and the box over all ranks. Ranks without fishies don't widen the box.
+	double sums[5] = { static_cast< double >( stats.liveCount ), static_cast< double >( stats.centroid.x ) * stats.liveCount,
+		static_cast< double >( stats.centroid.y ) * stats.liveCount, static_cast< double >( stats.centroid.z ) * stats.liveCount,
+		static_cast< double >( stats.meanSpeed ) * stats.liveCount };
+	float lowest[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float highest[4] = { -FLT_MAX, -FLT_MAX, -FLT_MAX, 0.0f };				// Upper corner and top speed
+	if ( stats.liveCount > 0 )
+	{
+		lowest[0] = stats.boundsMin.x; lowest[1] = stats.boundsMin.y; lowest[2] = stats.boundsMin.z;
+		highest[0] = stats.boundsMax.x; highest[1] = stats.boundsMax.y; highest[2] = stats.boundsMax.z; highest[3] = stats.maxSpeed;
+	}
+	MPI_CHECK( MPI_Allreduce( MPI_IN_PLACE, sums, 5, MPI_DOUBLE, MPI_SUM, comm_ ) );
+	MPI_CHECK( MPI_Allreduce( MPI_IN_PLACE, lowest, 3, MPI_FLOAT, MPI_MIN, comm_ ) );
+	MPI_CHECK( MPI_Allreduce( MPI_IN_PLACE, highest, 4, MPI_FLOAT, MPI_MAX, comm_ ) );
+
+	SwarmStats result = SwarmStats();
+	result.liveCount = static_cast< unsigned int >( sums[0] );
+	if ( result.liveCount > 0 )
+	{
+		result.centroid = make_float3( static_cast< float >( sums[1] / sums[0] ), static_cast< float >( sums[2] / sums[0] ), static_cast< float >( sums[3] / sums[0] ) );
+		result.meanSpeed = static_cast< float >( sums[4] / sums[0] );
+		result.boundsMin = make_float3( lowest[0], lowest[1], lowest[2] );
+		result.boundsMax = make_float3( highest[0], highest[1], highest[2] );
+		result.maxSpeed = highest[3];
+	}
+	return result;
+}
+
+void MpiSimulation::run( unsigned int steps )
+{
+	MPI_CHECK( MPI_Barrier( comm_ ) );
+	auto start = std::chrono::high_resolution_clock::now();
+	particleUpdates_ = 0.0;
+
+	unsigned int done = 0;
+	while ( done < steps && step() )
+		done++;
+
+	CUDA_CHECK( cudaStreamSynchronize( stream_ ) );							// Wait for the last step
+	MPI_CHECK( MPI_Barrier( comm_ ) );
+	auto end = std::chrono::high_resolution_clock::now();
+
+	SwarmStats stats = getStats();
+	double updates = 0.0;
+	MPI_CHECK( MPI_Reduce( &particleUpdates_, &updates, 1, MPI_DOUBLE, MPI_SUM, 0, comm_ ) );
+	unsigned int load[2] = { owned_, haloCount_ };
+	std::vector<unsigned int> loads( 2 * ranks_ );
+	MPI_CHECK( MPI_Gather( load, 2, MPI_UNSIGNED, loads.data(), 2, MPI_UNSIGNED, 0, comm_ ) );
+	if ( rank_ != 0 )
+		return;
+
+	double seconds = std::chrono::duration<double>( end - start ).count();
+	std::cout << "Steps:                            " << done << " of " << steps << "\n";
+	std::cout << "Time:                             " << seconds << " s\n";
+	std::cout << "Simulated time:                   " << done * dt_ << " s\n";
+	std::cout << "Steps per second:                 " << done / seconds << "\n";
+	std::cout << "Live particles:                   " << stats.liveCount << " of " << numParticles_ << "\n";
+	for ( int r = 0; r < ranks_; r++ )
+		std::cout << "Rank " << r << ":                           " << loads[2 * r] << " owned, " << loads[2 * r + 1] << " halo\n";
+	std::cout << "Particle updates per second:      " << updates / seconds << "\n";
+	std::cout << "Swarm centroid:                   " << stats.centroid.x << ", " << stats.centroid.y << ", " << stats.centroid.z << "\n";
+	std::cout << "Mean speed:                       " << stats.meanSpeed / dt_ << " per s" << std::endl;
+}
+
+void MpiSimulation::cleanUp()
+{
+	device_.destroyStreams();													// Wait for the last step
+	delete particles_[0];														// Free GPU Memory
+	delete particles_[1];
+	delete send_;
+	delete hostSend_;
+	delete hostReceive_;
+	delete lists_;
+	delete counts_;
+	delete h_counts_;
+	delete h_stats_;
+	delete d_sharks;
+	delete d_shark_state;
+	delete h_sharks_;
+	kernel_cleanup();															// Free uniform grid
+	delete waypointList;
+}
+
+#endif
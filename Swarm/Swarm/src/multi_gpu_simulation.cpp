@@ -0,0 +1,524 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+
+#include "multi_gpu_simulation.h"
+#include "host_simulation.h"
+#include "nvtx_range.h"
+
+/*!
+ * @brief Copy fishies between GPUs (or on one GPU), all arrays including the ids.
+ * Goes directly over NVLink/PCIe, if peer access is enabled, otherwise through the host.
+ * @param to destination slots.
+ * @param toDevice GPU of to.
+ * @param from source slots.
+ * @param fromDevice GPU of from.
+ * @param count number of fishies.
+ * @param stream stream of the copies (GPU of from).
+ */
+static void copyParticles( ParticleArrays to, int toDevice, ParticleArrays from, int fromDevice, size_t count, cudaStream_t stream )
+{
+	if ( count == 0 )
+		return;
+
+	float* const toFloats[7] = { to.x, to.y, to.z, to.vx, to.vy, to.vz, to.mass };
+	float* const fromFloats[7] = { from.x, from.y, from.z, from.vx, from.vy, from.vz, from.mass };
+	for ( int i = 0; i < 7; i++ )
+		CUDA_CHECK( cudaMemcpyPeerAsync( toFloats[i], toDevice, fromFloats[i], fromDevice, count * sizeof( float ), stream ) );
+	CUDA_CHECK( cudaMemcpyPeerAsync( to.alive, toDevice, from.alive, fromDevice, count * sizeof( unsigned char ), stream ) );
+	CUDA_CHECK( cudaMemcpyPeerAsync( to.id, toDevice, from.id, fromDevice, count * sizeof( unsigned int ), stream ) );
+}
+
+MultiGpuSimulation::MultiGpuSimulation( const SwarmConfig& config ) :
+	numParticles_( config.numParticles ),
+	numSharks_( config.numSharks ),
+	halo_( config.params.fishDist ),
+	dt_( 1.0 / config.simulationRate )
+{
+	speed = static_cast< float >( config.swarmSpeed * dt_ );					// Same distance per simulated second for every rate
+
+	waypointList = new WaypointList( config.waypoints );						// Initialize Waypoint path.
+	swarmCenter = waypointList->get();											// Get first swarm center for particles.
+
+	std::vector<int> devices = CudaDevice::rankDevices( config.device );		// The renderer draws on the first one
+	int deviceCount = static_cast< int >( devices.size() );
+	int gpus = config.gpus == 0 ? deviceCount : std::min( static_cast< int >( config.gpus ), deviceCount );
+	if ( gpus < static_cast< int >( config.gpus ) )
+		std::cerr << "Only " << deviceCount << " GPUs found, using all of them" << std::endl;
+	gpus = std::max( gpus, 1 );
+	capacity_ = std::min( numParticles_, static_cast< unsigned int >( CAPACITY_FACTOR * numParticles_ / gpus ) + 1024 );
+
+	if ( config.respawnRate > 0 || !config.snapshot.empty() || !config.restore.empty() )
+		std::cerr << "Respawn and snapshots are ignored with more than one GPU" << std::endl;
+	if ( config.farCohesion > 0.0f || config.farAlignment > 0.0f )				// A slab only knows its own fishies and the halo
+		std::cerr << "The far field is ignored with more than one GPU" << std::endl;
+	if ( config.multiRate > 1 )													// The slabs exchange every fish every step
+		std::cerr << "Multi-rate steps are ignored with more than one GPU" << std::endl;
+
+	SearchMode searchMode = config.searchMode;
+	if ( searchMode == SearchMode::VERLET )										// The lists keep slots, the exchange moves the fishies every step
+	{
+		std::cerr << "Verlet search is not available with more than one GPU, using the grid" << std::endl;
+		searchMode = SearchMode::GRID;
+	}
+
+	// Shared by all contexts. Set before the contexts are created, so their grids get the cell size.
+	kernel_set_params( config.params );											// Behaviour parameters
+	kernel_set_schools( schoolWaypoints( config.waypoints, config.schools ), config.splinePath );	// Routes of the schools in constant memory
+	kernel_set_species( config.species );										// Species table in constant memory
+	kernel_set_seed( config.seed );												// GPU random numbers
+	kernel_set_spawn_box( config.spawnMin, config.spawnMax );					// Box of the respawned fishies
+	kernel_set_behaviour( config.behaviour );									// Fish behaviour
+	kernel_set_mean_field( config.meanField );									// Boids from the cell means
+	kernel_set_search_mode( searchMode );										// Neighbour search
+	kernel_set_first_k( config.firstK );										// Neighbour query semantics
+	kernel_set_packed_positions( config.packedPositions );						// Positions read by the grid search
+	kernel_set_cooperative_grid( config.cooperativeGrid );						// Grid build and search in one launch
+	kernel_set_warm_start( config.warmStart );									// Grid search bounded by the last closest fish
+	kernel_set_grid_sort( config.gridSort );									// Counting or radix sort of the grid build
+	kernel_set_evasion_split( config.evasionSplit );							// Brute force skips the evading fishies
+	kernel_set_dense_cells( config.denseCells );								// Warps for the fishies of dense cells
+	kernel_set_background_priority( CudaDevice::getStreamPriority( StreamClass::BACKGROUND ) );	// Fills of the current behind the steps
+	kernel_set_cluster_search( config.clusterSearch );							// Cells of a cluster in distributed shared memory on Hopper
+	kernel_set_l2_persistence( config.l2Persistence );							// Cell tables persisting in L2, per device only on Ampere or newer
+	kernel_set_deterministic( config.deterministic );							// Fixed-point state, ordered search and reductions
+	kernel_set_rtc( config.rtcKernels );										// Grid advance specialised for the scenario
+	if ( config.sharkTarget != SharkTarget::CENTER )
+		std::cout << "Shark targets need the grid of all fishies on one GPU, the sharks follow the center." << std::endl;
+	kernel_set_shark_target( SharkTarget::CENTER );								// Every GPU only has the grid of its slab
+	kernel_set_integrator( config.integrator );									// Base steps only, the GPUs would need one agreed scale
+	kernel_set_obstacles( bakeObstacles( config.obstacles, config.spawnMin, config.spawnMax, config.waypoints, config.obstacleRange,
+		config.obstacleResolution ), config.obstacleRange );					// Distance field of the obstacles
+	kernel_set_attractors( placeAttractors( config.attractors, config.spawnMin, config.spawnMax, config.waypoints,
+		config.attractorResolution ) );											// Field of the food patches and lures
+	kernel_set_alarm( placeAlarm( config.alarm, config.alarmDecay, config.spawnMin, config.spawnMax, config.waypoints,
+		config.params.centerThreshold, config.alarmResolution ) );				// Alarm waves of the evading fishies
+	kernel_set_current( loadCurrent( config ), config.currentStrength / config.simulationRate, config.currentPeriod );	// Current of the water
+
+	std::vector<float> h_data;
+	std::vector<float> h_state;
+	std::vector<float> h_shark_data;
+	std::vector<float> h_shark_state;
+	spawnFish( numParticles_, h_data, h_state, config.spawnMin, config.spawnMax );	// init vertex position, force and mass
+	spawnSharks( numSharks_, h_shark_data, h_shark_state, config.spawnMin, config.spawnMax );
+
+	// Equal numbers of fishies per slab: the bounds are quantiles of x.
+	std::vector<unsigned int> order( numParticles_ );
+	std::iota( order.begin(), order.end(), 0u );
+	std::sort( order.begin(), order.end(), [&h_data]( unsigned int a, unsigned int b ) { return h_data[4 * a] < h_data[4 * b]; } );
+
+	slabs_.resize( gpus );
+	for ( int d = 0; d < gpus; d++ )
+	{
+		Slab& slab = slabs_[d];
+		unsigned int first = static_cast< unsigned int >( static_cast< unsigned long long >( numParticles_ ) * d / gpus );
+		unsigned int last = static_cast< unsigned int >( static_cast< unsigned long long >( numParticles_ ) * ( d + 1 ) / gpus );
+		slab.bounds.lower = d == 0 || first >= numParticles_ ? -FLT_MAX : h_data[4 * order[first]];
+		slab.bounds.upper = FLT_MAX;
+		slab.bounds.halo = halo_;
+		if ( d > 0 )
+			slabs_[d - 1].bounds.upper = slab.bounds.lower;
+
+		slab.device = new CudaDevice( devices[d] );										// Makes the GPU current
+		std::cout << *slab.device << std::endl;
+		slab.stream = slab.device->getStream( slab.device->createStream() );
+		slab.context = kernel_create_context();
+		kernel_use_context( slab.context );
+		kernel_init_grid( capacity_, slab.device->getProperties() );			// Grid and launch configuration for this device
+
+		for ( int i = 0; i < 2; i++ )
+			slab.particles[i] = new ParticleStore( capacity_ );
+		slab.send = new ParticleStore( capacity_ );
+		slab.lists = new CudaDeviceArray<unsigned int>( SLAB_LIST_COUNT * capacity_, MemoryCategory::SCRATCH );
+		slab.counts = new CudaDeviceArray<unsigned int>( SLAB_LIST_COUNT, MemoryCategory::SCRATCH );
+		slab.h_counts = new CudaHostArray<unsigned int>( SLAB_LIST_COUNT );
+		slab.h_stats = new CudaHostArray<SwarmStats>( 1 );
+		slab.sharks = new CudaDeviceArray<float>( numSharks_ * 4, MemoryCategory::PARTICLES );
+		slab.sharks->set( h_shark_data.data(), numSharks_ * 4 );
+		CUDA_CHECK( cudaEventCreateWithFlags( &slab.exchanged, cudaEventDisableTiming ) );
+
+		// Fishies of the slab with their ids. The first exchange sorts out the ones on a bound and builds the halo.
+		std::vector<float> data( 4 * ( last - first ) );
+		std::vector<float> state( 4 * ( last - first ) );
+		std::vector<unsigned int> ids( last - first );
+		for ( unsigned int i = first; i < last; i++ )
+		{
+			std::copy( h_data.begin() + 4 * order[i], h_data.begin() + 4 * order[i] + 4, data.begin() + 4 * ( i - first ) );
+			std::copy( h_state.begin() + 4 * order[i], h_state.begin() + 4 * order[i] + 4, state.begin() + 4 * ( i - first ) );
+			ids[i - first] = order[i];
+		}
+		slab.particles[1]->set( data.data(), state.data(), last - first );
+		CUDA_CHECK( cudaMemcpy( slab.particles[1]->getArrays().id, ids.data(), ids.size() * sizeof( unsigned int ), cudaMemcpyHostToDevice ) );
+		slab.owned = last - first;
+	}
+
+	// Neighbours copy halos to each other, every slab copies to the first GPU for the renderer.
+	for ( int d = 0; d < gpus; d++ )
+	{
+		CUDA_CHECK( cudaSetDevice( devices[d] ) );
+		for ( int peer = 0; peer < gpus; peer++ )
+		{
+			if ( peer == d || ( std::abs( peer - d ) > 1 && peer != 0 ) )
+				continue;
+
+			int canAccess = 0;
+			CUDA_CHECK( cudaDeviceCanAccessPeer( &canAccess, devices[d], devices[peer] ) );
+			if ( canAccess )
+			{
+				cudaError_t result = cudaDeviceEnablePeerAccess( devices[peer], 0 );
+				if ( result == cudaErrorPeerAccessAlreadyEnabled )
+					cudaGetLastError();											// Not an error, clear it
+				else
+					CUDA_CHECK( result );
+			}
+			std::cout << "Peer access GPU " << devices[d] << " -> GPU " << devices[peer] << ": " << ( canAccess ? "yes" : "no, copies go through the host" ) << "\n";
+		}
+	}
+
+	use( slabs_[0] );
+	d_shark_state = new CudaDeviceArray<float>( numSharks_ * 4, MemoryCategory::PARTICLES );				// Sharks are moved on the first GPU only
+	d_shark_state->set( h_shark_state.data(), numSharks_ * 4 );
+	CUDA_CHECK( cudaEventCreateWithFlags( &sharksMoved_, cudaEventDisableTiming ) );
+	CUDA_CHECK( cudaEventCreateWithFlags( &gathered_, cudaEventDisableTiming ) );
+
+	std::cout << "Slabs:                            " << gpus << " with " << capacity_ << " slots each" << std::endl;
+	if ( !exchange( true ) )
+		std::cerr << "Initial split doesn't fit into the slabs!" << std::endl;
+	updateBounds();
+	restore();
+}
+
+void MultiGpuSimulation::moveSwarmCenter()
+{
+	Vector3 diff = waypointList->get() - swarmCenter;							// Get Next Swarm center
+	if (diff.length() < WAYPOINT_THRESHOLD)										// Check if center was reached
+	{
+		diff = waypointList->getNext() - swarmCenter;
+	}
+
+	diff = diff.normalized() * speed;
+	swarmCenter += diff;
+}
+
+void MultiGpuSimulation::use( const Slab& slab )
+{
+	CUDA_CHECK( cudaSetDevice( slab.device->getDevice() ) );
+	kernel_use_context( slab.context );
+}
+
+void MultiGpuSimulation::restore()
+{
+	CUDA_CHECK( cudaSetDevice( slabs_[0].device->getDevice() ) );
+	kernel_use_context( NULL );
+}
+
+bool MultiGpuSimulation::step()
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "MultiGpuSimulation::step", NVTX_COLOR_SIMULATION );
+
+	moveSwarmCenter();															// Set new Swarm center
+	unsigned int randomStep = kernel_get_random_step();
+
+	for ( Slab& slab : slabs_ )
+	{
+		use( slab );
+		if ( gatherPending_ )													// The renderer reads particles[0]
+			CUDA_CHECK( cudaStreamWaitEvent( slab.stream, gathered_, 0 ) );
+
+		unsigned int count = slab.owned + slab.halo;
+		if ( count == 0 )
+			continue;
+
+		ParticleArrays current = slab.particles[0]->getArrays();
+		ParticleArrays next = slab.particles[1]->getArrays();
+		CUDA_CHECK( cudaMemcpyAsync( next.id, current.id, slab.owned * sizeof( unsigned int ), cudaMemcpyDeviceToDevice, slab.stream ) );	// The step doesn't copy the ids
+
+		kernel_set_random_step( randomStep );									// Same random numbers on every GPU
+		kernel_advance( current, next, count, speed, swarmCenter,
+			reinterpret_cast<float4*>( slab.sharks->getData() ), numSharks_, slab.stream );
+		particleUpdates_ += slab.owned;
+	}
+	kernel_set_random_step( randomStep + 1 );
+	gatherPending_ = false;
+
+	use( slabs_[0] );
+	kernel_move_sharks(															// Calculate new shark positions on the first GPU.
+		reinterpret_cast<float4*>( slabs_[0].sharks->getData() ),
+		reinterpret_cast<float4*>( d_shark_state->getData() ),
+		numSharks_,
+		speed,
+		slabs_[0].stream );
+
+	bool updateDue = ++stepsSinceUpdate_ >= GRID_UPDATE_INTERVAL;
+	bool fits = exchange( updateDue );
+	if ( fits && updateDue )
+	{
+		stepsSinceUpdate_ = 0;
+		updateBounds();
+	}
+	restore();
+	return fits;
+}
+
+bool MultiGpuSimulation::exchange( bool readStats )
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "MultiGpuSimulation::exchange", NVTX_COLOR_SYNC );
+
+	for ( Slab& slab : slabs_ )
+	{
+		use( slab );
+		ParticleArrays next = slab.particles[1]->getArrays();
+		kernel_partition_slab( next, slab.owned, slab.bounds, slab.lists->getData(), capacity_, slab.counts->getData(), slab.stream );
+		CUDA_CHECK( cudaMemcpyAsync( slab.h_counts->getData(), slab.counts->getData(), SLAB_LIST_COUNT * sizeof( unsigned int ), cudaMemcpyDeviceToHost, slab.stream ) );
+
+		( *slab.h_stats )[0] = SwarmStats();
+		if ( readStats && slab.owned + slab.halo > 0 )							// Owned and halo fishies, the grid holds both
+		{
+			kernel_reduce_stats( next, slab.owned + slab.halo, slab.stream );
+			kernel_read_stats( slab.h_stats->getData(), slab.stream );
+		}
+	}
+	for ( Slab& slab : slabs_ )
+		CUDA_CHECK( cudaStreamSynchronize( slab.stream ) );					// Counts, and every GPU finished reading particles[0]
+
+	// Shark positions of the first GPU for all others.
+	unsigned int n = static_cast< unsigned int >( slabs_.size() );
+	use( slabs_[0] );
+	for ( unsigned int d = 1; d < n; d++ )
+		CUDA_CHECK( cudaMemcpyPeerAsync( slabs_[d].sharks->getData(), d, slabs_[0].sharks->getData(), 0, numSharks_ * 4 * sizeof( float ), slabs_[0].stream ) );
+	CUDA_CHECK( cudaEventRecord( sharksMoved_, slabs_[0].stream ) );
+
+	// Layout of particles[0]: kept, from lower, from upper, then halo: own migrants, from lower, from upper.
+	std::vector<unsigned int> owned( n ), fromLowerAt( n ), fromUpperAt( n ), haloFromLowerAt( n ), haloFromUpperAt( n ), total( n );
+	bool fits = true;
+	for ( unsigned int d = 0; d < n; d++ )
+	{
+		const CudaHostArray<unsigned int>& c = *slabs_[d].h_counts;
+		const unsigned int* lower = d > 0 ? slabs_[d - 1].h_counts->getData() : NULL;
+		const unsigned int* upper = d + 1 < n ? slabs_[d + 1].h_counts->getData() : NULL;
+
+		fromLowerAt[d] = c[SLAB_KEEP];
+		fromUpperAt[d] = fromLowerAt[d] + ( lower ? lower[SLAB_TO_UPPER] : 0 );
+		owned[d] = fromUpperAt[d] + ( upper ? upper[SLAB_TO_LOWER] : 0 );
+		haloFromLowerAt[d] = owned[d] + c[SLAB_HALO_SELF];
+		haloFromUpperAt[d] = haloFromLowerAt[d] + ( lower ? lower[SLAB_HALO_UPPER] : 0 );
+		total[d] = haloFromUpperAt[d] + ( upper ? upper[SLAB_HALO_LOWER] : 0 );
+
+		unsigned int sent = c[SLAB_TO_LOWER] + c[SLAB_HALO_LOWER] + c[SLAB_TO_UPPER] + c[SLAB_HALO_UPPER];
+		bool slabFits = total[d] <= capacity_ && sent <= capacity_;
+		for ( int l = 0; l < SLAB_LIST_COUNT; l++ )
+			slabFits = slabFits && c[l] <= capacity_;
+		if ( !slabFits )
+		{
+			std::cerr << "GPU " << d << " has no room for " << std::max( total[d], sent ) << " fishies (" << capacity_ << " slots)!" << std::endl;
+			fits = false;
+		}
+	}
+	if ( !fits )
+		return false;
+
+	for ( unsigned int d = 0; d < n; d++ )
+	{
+		Slab& slab = slabs_[d];
+		use( slab );
+		const CudaHostArray<unsigned int>& c = *slab.h_counts;
+		const unsigned int* lists = slab.lists->getData();
+		ParticleArrays next = slab.particles[1]->getArrays();
+		ParticleArrays current = slab.particles[0]->getArrays();
+		ParticleArrays send = slab.send->getArrays();
+
+		kernel_gather( next, current, lists + SLAB_KEEP * capacity_, c[SLAB_KEEP], slab.stream );
+		kernel_gather( next, offsetParticles( current, owned[d] ), lists + SLAB_HALO_SELF * capacity_, c[SLAB_HALO_SELF], slab.stream );
+
+		// Send buffer: to lower, halo lower, to upper, halo upper.
+		unsigned int sendAt[4] = { 0, c[SLAB_TO_LOWER], c[SLAB_TO_LOWER] + c[SLAB_HALO_LOWER], c[SLAB_TO_LOWER] + c[SLAB_HALO_LOWER] + c[SLAB_TO_UPPER] };
+		const int sendLists[4] = { SLAB_TO_LOWER, SLAB_HALO_LOWER, SLAB_TO_UPPER, SLAB_HALO_UPPER };
+		for ( int i = 0; i < 4; i++ )
+			kernel_gather( next, offsetParticles( send, sendAt[i] ), lists + sendLists[i] * capacity_, c[sendLists[i]], slab.stream );
+
+		if ( d > 0 )
+		{
+			ParticleArrays target = slabs_[d - 1].particles[0]->getArrays();
+			copyParticles( offsetParticles( target, fromUpperAt[d - 1] ), d - 1, offsetParticles( send, sendAt[0] ), d, c[SLAB_TO_LOWER], slab.stream );
+			copyParticles( offsetParticles( target, haloFromUpperAt[d - 1] ), d - 1, offsetParticles( send, sendAt[1] ), d, c[SLAB_HALO_LOWER], slab.stream );
+		}
+		if ( d + 1 < n )
+		{
+			ParticleArrays target = slabs_[d + 1].particles[0]->getArrays();
+			copyParticles( offsetParticles( target, fromLowerAt[d + 1] ), d + 1, offsetParticles( send, sendAt[2] ), d, c[SLAB_TO_UPPER], slab.stream );
+			copyParticles( offsetParticles( target, haloFromLowerAt[d + 1] ), d + 1, offsetParticles( send, sendAt[3] ), d, c[SLAB_HALO_UPPER], slab.stream );
+		}
+		CUDA_CHECK( cudaEventRecord( slab.exchanged, slab.stream ) );
+	}
+
+	// The next step of a slab needs the fishies of its neighbours and the sharks.
+	for ( unsigned int d = 0; d < n; d++ )
+	{
+		Slab& slab = slabs_[d];
+		if ( d > 0 )
+		{
+			CUDA_CHECK( cudaStreamWaitEvent( slab.stream, slabs_[d - 1].exchanged, 0 ) );
+			CUDA_CHECK( cudaStreamWaitEvent( slab.stream, sharksMoved_, 0 ) );
+		}
+		if ( d + 1 < n )
+			CUDA_CHECK( cudaStreamWaitEvent( slab.stream, slabs_[d + 1].exchanged, 0 ) );
+		slab.owned = owned[d];
+		slab.halo = total[d] - owned[d];
+	}
+	return true;
+}
+
+void MultiGpuSimulation::updateBounds()
+{
+	// Shift every inner bound by up to one halo width towards the slab with more fishies.
+	// Slabs stay wide enough that a fish never skips a neighbour.
+	float minimumWidth = 4.0f * halo_;
+	for ( size_t k = 0; k + 1 < slabs_.size(); k++ )
+	{
+		Slab& lower = slabs_[k];
+		Slab& upper = slabs_[k + 1];
+		float total = static_cast< float >( lower.owned ) + static_cast< float >( upper.owned );
+		if ( total == 0.0f )
+			continue;
+
+		float imbalance = ( static_cast< float >( lower.owned ) - static_cast< float >( upper.owned ) ) / total;
+		float bound = lower.bounds.upper - imbalance * halo_;
+		if ( k > 0 )
+			bound = std::max( bound, lower.bounds.lower + minimumWidth );
+		if ( k + 2 < slabs_.size() )
+			bound = std::min( bound, upper.bounds.upper - minimumWidth );
+		lower.bounds.upper = bound;
+		upper.bounds.lower = bound;
+	}
+
+	for ( Slab& slab : slabs_ )
+	{
+		kernel_use_context( slab.context );
+		kernel_set_grid_bounds( ( *slab.h_stats )[0] );							// Grid around owned and halo fishies of the slab
+	}
+}
+
+unsigned int MultiGpuSimulation::gather( ParticleArrays particles, float* sharks, cudaStream_t stream )
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "MultiGpuSimulation::gather", NVTX_COLOR_INTEROP );
+
+	unsigned int offset = 0;
+	for ( Slab& slab : slabs_ )
+		CUDA_CHECK( cudaStreamWaitEvent( stream, slab.exchanged, 0 ) );			// Own and incoming fishies of every slab arrived
+	for ( size_t d = 0; d < slabs_.size(); d++ )
+	{
+		Slab& slab = slabs_[d];
+		copyParticles( offsetParticles( particles, offset ), 0, slab.particles[0]->getArrays(), static_cast< int >( d ), slab.owned, stream );
+		offset += slab.owned;
+	}
+
+	CUDA_CHECK( cudaStreamWaitEvent( stream, sharksMoved_, 0 ) );
+	CUDA_CHECK( cudaMemcpyAsync( sharks, slabs_[0].sharks->getData(), numSharks_ * 4 * sizeof( float ), cudaMemcpyDeviceToDevice, stream ) );
+	CUDA_CHECK( cudaEventRecord( gathered_, stream ) );
+	gatherPending_ = true;
+	return offset;
+}
+
+SwarmStats MultiGpuSimulation::getStats()
+{
+	for ( Slab& slab : slabs_ )
+	{
+		use( slab );
+		( *slab.h_stats )[0] = SwarmStats();
+		if ( slab.owned == 0 )
+			continue;
+		kernel_reduce_stats( slab.particles[0]->getArrays(), slab.owned, slab.stream );
+		kernel_read_stats( slab.h_stats->getData(), slab.stream );
+	}
+
+	SwarmStats result = SwarmStats();
+	float3 sum = make_float3( 0.0f, 0.0f, 0.0f );
+	double speed = 0.0;
+	for ( Slab& slab : slabs_ )
+	{
+		CUDA_CHECK( cudaStreamSynchronize( slab.stream ) );
+		const SwarmStats& stats = ( *slab.h_stats )[0];
+		if ( stats.liveCount == 0 )
+			continue;
+
+		if ( result.liveCount == 0 )
+		{
+			result.boundsMin = stats.boundsMin;
+			result.boundsMax = stats.boundsMax;
+		}
+		result.boundsMin = make_float3( std::min( result.boundsMin.x, stats.boundsMin.x ), std::min( result.boundsMin.y, stats.boundsMin.y ), std::min( result.boundsMin.z, stats.boundsMin.z ) );
+		result.boundsMax = make_float3( std::max( result.boundsMax.x, stats.boundsMax.x ), std::max( result.boundsMax.y, stats.boundsMax.y ), std::max( result.boundsMax.z, stats.boundsMax.z ) );
+		sum.x += stats.centroid.x * stats.liveCount;
+		sum.y += stats.centroid.y * stats.liveCount;
+		sum.z += stats.centroid.z * stats.liveCount;
+		speed += static_cast< double >( stats.meanSpeed ) * stats.liveCount;
+		result.maxSpeed = std::max( result.maxSpeed, stats.maxSpeed );
+		result.liveCount += stats.liveCount;
+	}
+	if ( result.liveCount > 0 )
+	{
+		result.centroid = make_float3( sum.x / result.liveCount, sum.y / result.liveCount, sum.z / result.liveCount );
+		result.meanSpeed = static_cast< float >( speed / result.liveCount );
+	}
+	restore();
+	return result;
+}
+
+void MultiGpuSimulation::run( unsigned int steps )
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	particleUpdates_ = 0.0;
+
+	unsigned int done = 0;
+	while ( done < steps && step() )
+		done++;
+
+	for ( Slab& slab : slabs_ )
+		CUDA_CHECK( cudaStreamSynchronize( slab.stream ) );					// Wait for the last step
+	auto end = std::chrono::high_resolution_clock::now();
+
+	SwarmStats stats = getStats();
+	double seconds = std::chrono::duration<double>( end - start ).count();
+	std::cout << "Steps:                            " << done << " of " << steps << "\n";
+	std::cout << "Time:                             " << seconds << " s\n";
+	std::cout << "Simulated time:                   " << done * dt_ << " s\n";
+	std::cout << "Steps per second:                 " << done / seconds << "\n";
+	std::cout << "Live particles:                   " << stats.liveCount << " of " << numParticles_ << "\n";
+	for ( size_t d = 0; d < slabs_.size(); d++ )
+		std::cout << "GPU " << d << ":                            " << slabs_[d].owned << " owned, " << slabs_[d].halo << " halo\n";
+	std::cout << "Particle updates per second:      " << particleUpdates_ / seconds << "\n";
+	std::cout << "Swarm centroid:                   " << stats.centroid.x << ", " << stats.centroid.y << ", " << stats.centroid.z << "\n";
+	std::cout << "Mean speed:                       " << stats.meanSpeed / dt_ << " per s" << std::endl;
+}
+
+void MultiGpuSimulation::cleanUp()
+{
+	for ( Slab& slab : slabs_ )
+	{
+		use( slab );
+		slab.device->destroyStreams();											// Wait for the last step
+		for ( int i = 0; i < 2; i++ )
+			delete slab.particles[i];											// Free GPU Memory
+		delete slab.send;
+		delete slab.lists;
+		delete slab.counts;
+		delete slab.h_counts;
+		delete slab.h_stats;
+		delete slab.sharks;
+		CUDA_CHECK( cudaEventDestroy( slab.exchanged ) );
+		kernel_cleanup();														// Free uniform grid of this GPU
+		kernel_destroy_context( slab.context );
+	}
+
+	restore();																	// First GPU, the contexts are gone
+	delete d_shark_state;
+	CUDA_CHECK( cudaEventDestroy( sharksMoved_ ) );
+	CUDA_CHECK( cudaEventDestroy( gathered_ ) );
+	for ( Slab& slab : slabs_ )
+		delete slab.device;
+	slabs_.clear();
+	delete waypointList;
+}
@@ -0,0 +1,119 @@
+#include "obstacles.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+/*!
+ * @brief Signed distance of a point to a box.
+ * @param obstacle box or tank.
+ * @param x, y, z point.
+ * @return distance, negative inside.
+ */
+static float boxDistance( const Obstacle& obstacle, float x, float y, float z )
+{
+	float qx = std::fabs( x - obstacle.center.x ) - obstacle.size.x;
+	float qy = std::fabs( y - obstacle.center.y ) - obstacle.size.y;
+	float qz = std::fabs( z - obstacle.center.z ) - obstacle.size.z;
+	float ox = std::max( qx, 0.0f ), oy = std::max( qy, 0.0f ), oz = std::max( qz, 0.0f );
+	return std::sqrt( ox * ox + oy * oy + oz * oz ) + std::min( std::max( qx, std::max( qy, qz ) ), 0.0f );
+}
+
+/*!
+ * @brief Signed distance of a point to the nearest obstacle surface.
+ * @param obstacles obstacles.
+ * @param x, y, z point.
+ * @return distance, FLT_MAX without obstacles.
+ */
+static float distance( const std::vector<Obstacle>& obstacles, float x, float y, float z )
+{
+	float result = FLT_MAX;
+	for ( const Obstacle& obstacle : obstacles )
+	{
+		float d;
+		switch ( obstacle.shape )
+		{
+		case ObstacleShape::SPHERE:
+		{
+			float dx = x - obstacle.center.x, dy = y - obstacle.center.y, dz = z - obstacle.center.z;
+			d = std::sqrt( dx * dx + dy * dy + dz * dz ) - obstacle.size.x;
+			break;
+		}
+		case ObstacleShape::BOX:
+			d = boxDistance( obstacle, x, y, z );
+			break;
+		default:
+			d = -boxDistance( obstacle, x, y, z );									// The walls are everything outside the box
+			break;
+		}
+		result = std::min( result, d );												// Union of all obstacles
+	}
+	return result;
+}
+
+float obstacleDistance( const std::vector<Obstacle>& obstacles, const Vector3& point )
+{
+	return distance( obstacles, point.x, point.y, point.z );
+}
+
+ObstacleVolume bakeObstacles( const std::vector<Obstacle>& obstacles, const Vector3& spawnMin, const Vector3& spawnMax,
+	const std::vector<Vector3>& waypoints, float margin, unsigned int resolution )
+{
+	ObstacleVolume volume;
+	if ( obstacles.empty() )
+		return volume;
+
+	float lower[3] = { spawnMin.x, spawnMin.y, spawnMin.z };
+	float upper[3] = { spawnMax.x, spawnMax.y, spawnMax.z };
+	auto cover = [&]( float x, float y, float z, float rx, float ry, float rz )
+	{
+		lower[0] = std::min( lower[0], x - rx ); upper[0] = std::max( upper[0], x + rx );
+		lower[1] = std::min( lower[1], y - ry ); upper[1] = std::max( upper[1], y + ry );
+		lower[2] = std::min( lower[2], z - rz ); upper[2] = std::max( upper[2], z + rz );
+	};
+	for ( const Vector3& waypoint : waypoints )
+		cover( waypoint.x, waypoint.y, waypoint.z, 0.0f, 0.0f, 0.0f );
+	for ( const Obstacle& obstacle : obstacles )
+	{
+		if ( obstacle.shape == ObstacleShape::SPHERE )
+			cover( obstacle.center.x, obstacle.center.y, obstacle.center.z, obstacle.size.x, obstacle.size.x, obstacle.size.x );
+		else
+			cover( obstacle.center.x, obstacle.center.y, obstacle.center.z, obstacle.size.x, obstacle.size.y, obstacle.size.z );
+	}
+
+	float extent = 0.0f;
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		lower[axis] -= margin;
+		upper[axis] += margin;
+		extent = std::max( extent, upper[axis] - lower[axis] );
+	}
+
+	resolution = std::max( resolution, 2u );
+	volume.cellSize = extent / ( resolution - 1 );
+	if ( volume.cellSize <= 0.0f )
+		return volume;
+	unsigned int samples[3];
+	for ( int axis = 0; axis < 3; axis++ )
+		samples[axis] = std::max( static_cast< unsigned int >( std::ceil( ( upper[axis] - lower[axis] ) / volume.cellSize ) ) + 1, 2u );
+	volume.origin = Vector3( lower[0], lower[1], lower[2] );
+	volume.width = samples[0];
+	volume.height = samples[1];
+	volume.depth = samples[2];
+	volume.texels.resize( static_cast< size_t >( volume.width ) * volume.height * volume.depth * 4 );
+
+	// Central differences of the analytic field, half a cell wide. Normalized on the GPU after the interpolation.
+	float h = 0.5f * volume.cellSize;
+	float* texel = volume.texels.data();
+	for ( unsigned int k = 0; k < volume.depth; k++ )
+		for ( unsigned int j = 0; j < volume.height; j++ )
+			for ( unsigned int i = 0; i < volume.width; i++ )
+			{
+				float x = lower[0] + i * volume.cellSize, y = lower[1] + j * volume.cellSize, z = lower[2] + k * volume.cellSize;
+				*texel++ = ( distance( obstacles, x + h, y, z ) - distance( obstacles, x - h, y, z ) ) / ( 2.0f * h );
+				*texel++ = ( distance( obstacles, x, y + h, z ) - distance( obstacles, x, y - h, z ) ) / ( 2.0f * h );
+				*texel++ = ( distance( obstacles, x, y, z + h ) - distance( obstacles, x, y, z - h ) ) / ( 2.0f * h );
+				*texel++ = distance( obstacles, x, y, z );
+			}
+	return volume;
+}
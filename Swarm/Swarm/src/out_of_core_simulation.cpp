@@ -0,0 +1,444 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include "out_of_core_simulation.h"
+#include "host_simulation.h"
+#include "memory_tracker.h"
+#include "nvtx_range.h"
+
+/*!
+ * @brief Copy fishies between pinned host memory and the GPU (or on the GPU), all arrays including the ids.
+ * The direction follows from the pointers (unified addressing).
+ * @param to destination slots.
+ * @param from source slots.
+ * @param count number of fishies.
+ * @param stream stream of the copies.
+ */
+static void copyParticlesAsync( ParticleArrays to, ParticleArrays from, size_t count, cudaStream_t stream )
+{
+	if ( count == 0 )
+		return;
+
+	float* const toFloats[7] = { to.x, to.y, to.z, to.vx, to.vy, to.vz, to.mass };
+	float* const fromFloats[7] = { from.x, from.y, from.z, from.vx, from.vy, from.vz, from.mass };
+	for ( int i = 0; i < 7; i++ )
+		CUDA_CHECK( cudaMemcpyAsync( toFloats[i], fromFloats[i], count * sizeof( float ), cudaMemcpyDefault, stream ) );
+	CUDA_CHECK( cudaMemcpyAsync( to.alive, from.alive, count * sizeof( unsigned char ), cudaMemcpyDefault, stream ) );
+	CUDA_CHECK( cudaMemcpyAsync( to.id, from.id, count * sizeof( unsigned int ), cudaMemcpyDefault, stream ) );
+}
+
+OutOfCoreSimulation::OutOfCoreSimulation( const SwarmConfig& config ) :
+	numParticles_( config.numParticles ),
+	numSharks_( config.numSharks ),
+	halo_( config.params.fishDist ),
+	dt_( 1.0 / config.simulationRate )
+{
+	speed = static_cast< float >( config.swarmSpeed * dt_ );					// Same distance per simulated second for every rate
+
+	waypointList = new WaypointList( config.waypoints );						// Initialize Waypoint path.
+	swarmCenter = waypointList->get();											// Get first swarm center for particles.
+
+	unsigned int bricks = std::max( config.bricks, 1u );
+	capacity_ = std::min( numParticles_, static_cast< unsigned int >( CAPACITY_FACTOR * numParticles_ / bricks ) + 1024 );
+	haloCapacity_ = std::min( numParticles_, static_cast< unsigned int >( HALO_FACTOR * capacity_ ) + 1024 );
+
+	if ( config.respawnRate > 0 || !config.snapshot.empty() || !config.restore.empty() )
+		std::cerr << "Respawn and snapshots are ignored out of core" << std::endl;
+	if ( config.farCohesion > 0.0f || config.farAlignment > 0.0f )				// A brick only knows its own fishies and the halo
+		std::cerr << "The far field is ignored out of core" << std::endl;
+	if ( config.multiRate > 1 )
+		std::cerr << "Multi-rate steps are ignored out of core" << std::endl;
+
+	SearchMode searchMode = config.searchMode;
+	if ( searchMode == SearchMode::VERLET )										// The lists keep slots, a lane steps a different brick every time
+	{
+		std::cerr << "Verlet search is not available out of core, using the grid" << std::endl;
+		searchMode = SearchMode::GRID;
+	}
+
+	// Shared by all contexts. Set before the contexts are created, so their grids get the cell size.
+	kernel_set_params( config.params );											// Behaviour parameters
+	kernel_set_schools( schoolWaypoints( config.waypoints, config.schools ), config.splinePath );	// Routes of the schools in constant memory
+	kernel_set_species( config.species );										// Species table in constant memory
+	kernel_set_seed( config.seed );												// GPU random numbers
+	kernel_set_spawn_box( config.spawnMin, config.spawnMax );					// Box of the respawned fishies
+	kernel_set_behaviour( config.behaviour );									// Fish behaviour
+	kernel_set_mean_field( config.meanField );									// Boids from the cell means
+	kernel_set_search_mode( searchMode );										// Neighbour search
+	kernel_set_first_k( config.firstK );										// Neighbour query semantics
+	kernel_set_packed_positions( config.packedPositions );						// Positions read by the grid search
+	kernel_set_cooperative_grid( config.cooperativeGrid );						// Grid build and search in one launch
+	kernel_set_warm_start( config.warmStart );									// Grid search bounded by the last closest fish
+	kernel_set_grid_sort( config.gridSort );									// Counting or radix sort of the grid build
+	kernel_set_evasion_split( config.evasionSplit );							// Brute force skips the evading fishies
+	kernel_set_dense_cells( config.denseCells );								// Warps for the fishies of dense cells
+	kernel_set_background_priority( CudaDevice::getStreamPriority( StreamClass::BACKGROUND ) );	// Fills of the current behind the steps
+	kernel_set_cluster_search( config.clusterSearch );							// Cells of a cluster in distributed shared memory on Hopper
+	kernel_set_l2_persistence( config.l2Persistence && device_.supportsL2Persistence() );	// Cell tables persisting in L2 on Ampere or newer
+	kernel_set_deterministic( config.deterministic );							// Fixed-point state, ordered search and reductions
+	kernel_set_rtc( config.rtcKernels );										// Grid advance specialised for the scenario
+	if ( config.sharkTarget != SharkTarget::CENTER )
+		std::cout << "Shark targets need the grid of all fishies at once, the sharks follow the center." << std::endl;
+	kernel_set_shark_target( SharkTarget::CENTER );								// Every lane only has the grid of one brick
+	kernel_set_integrator( config.integrator );									// Base steps only, the bricks would need one agreed scale
+	kernel_set_obstacles( bakeObstacles( config.obstacles, config.spawnMin, config.spawnMax, config.waypoints, config.obstacleRange,
+		config.obstacleResolution ), config.obstacleRange );					// Distance field of the obstacles
+	kernel_set_attractors( placeAttractors( config.attractors, config.spawnMin, config.spawnMax, config.waypoints,
+		config.attractorResolution ) );											// Field of the food patches and lures
+	kernel_set_alarm( placeAlarm( config.alarm, config.alarmDecay, config.spawnMin, config.spawnMax, config.waypoints,
+		config.params.centerThreshold, config.alarmResolution ) );				// Alarm waves of the evading fishies
+	kernel_set_current( loadCurrent( config ), config.currentStrength / config.simulationRate, config.currentPeriod );	// Current of the water
+
+	device_ = CudaDevice( CudaDevice::selectDevice( config.device ) );			// Makes the GPU current
+	std::cout << device_ << std::endl;
+
+	unsigned int laneCapacity = capacity_ + 3 * haloCapacity_;					// All parts of one brick
+	for ( Lane& lane : lanes_ )
+	{
+		lane.stream = device_.getStream( device_.createStream() );
+		lane.context = kernel_create_context();
+		kernel_use_context( lane.context );
+		kernel_init_grid( laneCapacity, device_.getProperties() );				// Grid and launch configuration for one brick
+
+		for ( int i = 0; i < 2; i++ )
+			lane.particles[i] = new ParticleStore( laneCapacity );
+		lane.lists = new CudaDeviceArray<unsigned int>( SLAB_LIST_COUNT * capacity_, MemoryCategory::SCRATCH );
+		lane.counts = new CudaDeviceArray<unsigned int>( SLAB_LIST_COUNT, MemoryCategory::SCRATCH );
+		lane.h_counts = new CudaHostArray<unsigned int>( SLAB_LIST_COUNT );
+		CUDA_CHECK( cudaEventCreateWithFlags( &lane.counted, cudaEventDisableTiming ) );
+	}
+	restore();
+
+	std::vector<float> h_data;
+	std::vector<float> h_state;
+	std::vector<float> h_shark_data;
+	std::vector<float> h_shark_state;
+	spawnFish( numParticles_, h_data, h_state, config.spawnMin, config.spawnMax );	// init vertex position, force and mass
+	spawnSharks( numSharks_, h_shark_data, h_shark_state, config.spawnMin, config.spawnMax );
+
+	// Bricks of equal width: the fishies are spawned evenly over the box, so this is an even split as well.
+	float width = ( config.spawnMax.x - config.spawnMin.x ) / bricks;
+	bricks_.resize( bricks );
+	for ( unsigned int b = 0; b < bricks; b++ )
+	{
+		Brick& brick = bricks_[b];
+		brick.bounds.lower = b == 0 ? -FLT_MAX : config.spawnMin.x + b * width;
+		brick.bounds.upper = b + 1 == bricks ? FLT_MAX : config.spawnMin.x + ( b + 1 ) * width;
+		brick.bounds.halo = halo_;
+		for ( int p = 0; p < BRICK_PART_COUNT; p++ )
+			for ( int i = 0; i < 2; i++ )
+				brick.parts[p][i] = new PinnedParticleStore( p == BRICK_OWNED ? capacity_ : haloCapacity_ );
+		brick.h_stats = new CudaHostArray<SwarmStats>( 1 );
+		( *brick.h_stats )[0] = SwarmStats();									// No grid bounds until the first read back
+	}
+
+	unsigned int dropped = 0;
+	for ( unsigned int i = 0; i < numParticles_; i++ )
+	{
+		float slot = std::floor( ( h_data[4 * i] - config.spawnMin.x ) / width );
+		Brick& brick = bricks_[static_cast< unsigned int >( std::min( std::max( slot, 0.0f ), static_cast< float >( bricks - 1 ) ) )];
+		unsigned int& at = brick.counts[BRICK_OWNED][current_];
+		if ( at == capacity_ )
+		{
+			dropped++;
+			continue;
+		}
+
+		ParticleArrays owned = brick.parts[BRICK_OWNED][current_]->getArrays();
+		owned.x[at] = h_data[4 * i + 0];
+		owned.y[at] = h_data[4 * i + 1];
+		owned.z[at] = h_data[4 * i + 2];
+		owned.vx[at] = h_state[4 * i + 0];
+		owned.vy[at] = h_state[4 * i + 1];
+		owned.vz[at] = h_state[4 * i + 2];
+		owned.mass[at] = h_state[4 * i + 3];
+		owned.alive[at] = 1;
+		owned.id[at] = i;
+		at++;
+	}
+	if ( dropped > 0 )
+		std::cerr << dropped << " fishies don't fit into their bricks!" << std::endl;
+
+	d_sharks = new CudaDeviceArray<float>( numSharks_ * 4, MemoryCategory::PARTICLES );
+	d_sharks->set( h_shark_data.data(), numSharks_ * 4 );
+	d_shark_state = new CudaDeviceArray<float>( numSharks_ * 4, MemoryCategory::PARTICLES );
+	d_shark_state->set( h_shark_state.data(), numSharks_ * 4 );
+	CUDA_CHECK( cudaEventCreateWithFlags( &sharksMoved_, cudaEventDisableTiming ) );
+
+	std::cout << "Bricks:                           " << bricks << " with " << capacity_ << " slots each, " << STREAMS << " lanes of " << laneCapacity << " slots" << std::endl;
+	if ( !streamBricks( false, true ) )											// Sorts out the fishies on a bound and builds the halos
+		std::cerr << "Initial split doesn't fit into the bricks!" << std::endl;
+	updateBounds();
+	std::cout << memoryReport();												// Device and pinned memory of bricks and lanes
+}
+
+void OutOfCoreSimulation::moveSwarmCenter()
+{
+	Vector3 diff = waypointList->get() - swarmCenter;							// Get Next Swarm center
+	if (diff.length() < WAYPOINT_THRESHOLD)										// Check if center was reached
+	{
+		diff = waypointList->getNext() - swarmCenter;
+	}
+
+	diff = diff.normalized() * speed;
+	swarmCenter += diff;
+}
+
+void OutOfCoreSimulation::use( const Lane& lane )
+{
+	kernel_use_context( lane.context );
+}
+
+void OutOfCoreSimulation::restore()
+{
+	kernel_use_context( NULL );
+}
+
+bool OutOfCoreSimulation::step()
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "OutOfCoreSimulation::step", NVTX_COLOR_SIMULATION );
+
+	moveSwarmCenter();															// Set new Swarm center
+	bool updateDue = ++stepsSinceUpdate_ >= GRID_UPDATE_INTERVAL;
+	bool fits = streamBricks( true, updateDue );
+	if ( fits && updateDue )
+	{
+		stepsSinceUpdate_ = 0;
+		updateBounds();
+	}
+	return fits;
+}
+
+bool OutOfCoreSimulation::streamBricks( bool advance, bool readStats )
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "OutOfCoreSimulation::streamBricks", NVTX_COLOR_SYNC );
+
+	unsigned int randomStep = kernel_get_random_step();
+	unsigned int next = 1 - current_;
+	for ( Brick& brick : bricks_ )
+		for ( int p = 0; p < BRICK_PART_COUNT; p++ )
+			brick.counts[p][next] = 0;
+
+	// Brick b + 1 is uploaded and stepped while brick b is copied back, every brick on the next lane.
+	bool fits = true;
+	unsigned int n = static_cast< unsigned int >( bricks_.size() );
+	for ( unsigned int b = 0; b <= n; b++ )
+	{
+		if ( b < n )
+		{
+			kernel_set_random_step( randomStep );								// Same random numbers in every brick
+			launchBrick( b, advance, readStats );
+		}
+		if ( b > 0 )
+			fits = drainBrick( b - 1 ) && fits;
+	}
+	for ( Lane& lane : lanes_ )
+		CUDA_CHECK( cudaStreamSynchronize( lane.stream ) );					// The parts of the next step are complete
+
+	if ( advance )
+	{
+		kernel_set_random_step( randomStep + 1 );
+		use( lanes_[0] );
+		kernel_move_sharks(														// Calculate new shark positions.
+			reinterpret_cast<float4*>( d_sharks->getData() ),
+			reinterpret_cast<float4*>( d_shark_state->getData() ),
+			numSharks_,
+			speed,
+			lanes_[0].stream );
+		CUDA_CHECK( cudaEventRecord( sharksMoved_, lanes_[0].stream ) );
+		for ( unsigned int l = 1; l < STREAMS; l++ )
+			CUDA_CHECK( cudaStreamWaitEvent( lanes_[l].stream, sharksMoved_, 0 ) );	// The next step of every brick reads them
+	}
+	restore();
+	current_ = next;
+	return fits;
+}
+
+void OutOfCoreSimulation::launchBrick( unsigned int b, bool advance, bool readStats )
+{
+	Brick& brick = bricks_[b];
+	Lane& lane = lanes_[b % STREAMS];
+	use( lane );
+
+	unsigned int owned = brick.counts[BRICK_OWNED][current_];
+	lane.empty = owned == 0;
+	if ( lane.empty )															// A halo alone has nothing to step
+		return;
+
+	// Owned fishies, then the halo parts. Without a step only the owned fishies are sorted, straight from particles[1].
+	ParticleArrays current = lane.particles[0]->getArrays();
+	ParticleArrays next = lane.particles[1]->getArrays();
+	unsigned int count = 0;
+	for ( int p = 0; p < ( advance ? BRICK_PART_COUNT : 1 ); p++ )
+	{
+		copyParticlesAsync( offsetParticles( advance ? current : next, count ), brick.parts[p][current_]->getArrays(), brick.counts[p][current_], lane.stream );
+		count += brick.counts[p][current_];
+	}
+
+	if ( advance )
+	{
+		kernel_set_grid_bounds( ( *brick.h_stats )[0] );						// Grid around the brick and its halo, some steps old
+		CUDA_CHECK( cudaMemcpyAsync( next.id, current.id, owned * sizeof( unsigned int ), cudaMemcpyDeviceToDevice, lane.stream ) );	// The step doesn't copy the ids
+		kernel_advance( current, next, count, speed, swarmCenter, reinterpret_cast<float4*>( d_sharks->getData() ), numSharks_, lane.stream );
+		particleUpdates_ += owned;
+	}
+
+	kernel_partition_slab( next, owned, brick.bounds, lane.lists->getData(), capacity_, lane.counts->getData(), lane.stream );
+	if ( readStats )															// Owned and halo fishies, the grid holds both
+	{
+		kernel_reduce_stats( next, count, lane.stream );
+		kernel_read_stats( brick.h_stats->getData(), lane.stream );
+	}
+	CUDA_CHECK( cudaMemcpyAsync( lane.h_counts->getData(), lane.counts->getData(), SLAB_LIST_COUNT * sizeof( unsigned int ), cudaMemcpyDeviceToHost, lane.stream ) );
+	CUDA_CHECK( cudaEventRecord( lane.counted, lane.stream ) );
+}
+
+bool OutOfCoreSimulation::drainBrick( unsigned int b )
+{
+	Lane& lane = lanes_[b % STREAMS];
+	if ( lane.empty )
+		return true;
+
+	use( lane );
+	CUDA_CHECK( cudaEventSynchronize( lane.counted ) );						// Only this brick, the next one keeps the GPU busy
+
+	/*
+	 * Kept and migrating fishies go into the owned parts of the next step, the halos to the neighbours.
+	 * Every part is filled from its start in the order of the bricks, so the counts are the offsets.
+	 */
+	struct Route
+	{
+		int list;
+		int brick;
+		BrickPart part;
+	};
+	int self = static_cast< int >( b );
+	const Route routes[] = {
+		{ SLAB_KEEP, self, BRICK_OWNED }, { SLAB_TO_LOWER, self - 1, BRICK_OWNED }, { SLAB_TO_UPPER, self + 1, BRICK_OWNED },
+		{ SLAB_HALO_SELF, self, BRICK_HALO_SELF }, { SLAB_HALO_LOWER, self - 1, BRICK_HALO_UPPER }, { SLAB_HALO_UPPER, self + 1, BRICK_HALO_LOWER } };
+
+	unsigned int next = 1 - current_;
+	ParticleArrays sorted = lane.particles[1]->getArrays();
+	ParticleArrays staging = lane.particles[0]->getArrays();					// The input of the step isn't needed anymore
+	bool fits = true;
+	for ( const Route& route : routes )
+	{
+		unsigned int count = ( *lane.h_counts )[route.list];
+		if ( count == 0 || route.brick < 0 || route.brick >= static_cast< int >( bricks_.size() ) )
+			continue;
+
+		Brick& target = bricks_[route.brick];
+		unsigned int& at = target.counts[route.part][next];
+		unsigned int room = route.part == BRICK_OWNED ? capacity_ : haloCapacity_;
+		if ( at + count > room )
+		{
+			std::cerr << "Brick " << route.brick << " has no room for " << at + count << " fishies (" << room << " slots)!" << std::endl;
+			fits = false;
+			continue;
+		}
+
+		kernel_gather( sorted, staging, lane.lists->getData() + route.list * capacity_, count, lane.stream );	// One list at a time, in stream order
+		copyParticlesAsync( offsetParticles( target.parts[route.part][next]->getArrays(), at ), staging, count, lane.stream );
+		at += count;
+	}
+	return fits;
+}
+
+void OutOfCoreSimulation::updateBounds()
+{
+	// Shift every inner bound by up to one halo width towards the brick with more fishies, like MultiGpuSimulation.
+	float minimumWidth = 4.0f * halo_;
+	for ( size_t k = 0; k + 1 < bricks_.size(); k++ )
+	{
+		Brick& lower = bricks_[k];
+		Brick& upper = bricks_[k + 1];
+		float lowerCount = static_cast< float >( lower.counts[BRICK_OWNED][current_] );
+		float upperCount = static_cast< float >( upper.counts[BRICK_OWNED][current_] );
+		if ( lowerCount + upperCount == 0.0f )
+			continue;
+
+		float imbalance = ( lowerCount - upperCount ) / ( lowerCount + upperCount );
+		float bound = lower.bounds.upper - imbalance * halo_;
+		if ( k > 0 )
+			bound = std::max( bound, lower.bounds.lower + minimumWidth );
+		if ( k + 2 < bricks_.size() )
+			bound = std::min( bound, upper.bounds.upper - minimumWidth );
+		lower.bounds.upper = bound;
+		upper.bounds.lower = bound;
+	}
+}
+
+void OutOfCoreSimulation::run( unsigned int steps )
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	particleUpdates_ = 0.0;
+
+	unsigned int done = 0;
+	while ( done < steps && step() )
+		done++;
+	auto end = std::chrono::high_resolution_clock::now();						// step waits for the last brick
+
+	// The fishies are on the host anyway. Eaten fishies were dropped by the partition.
+	unsigned int live = 0;
+	unsigned int fullest = 0;
+	double sum[3] = { 0.0, 0.0, 0.0 };
+	for ( Brick& brick : bricks_ )
+	{
+		unsigned int owned = brick.counts[BRICK_OWNED][current_];
+		ParticleArrays fishies = brick.parts[BRICK_OWNED][current_]->getArrays();
+		for ( unsigned int i = 0; i < owned; i++ )
+		{
+			sum[0] += fishies.x[i];
+			sum[1] += fishies.y[i];
+			sum[2] += fishies.z[i];
+		}
+		live += owned;
+		fullest = std::max( fullest, owned );
+	}
+
+	double seconds = std::chrono::duration<double>( end - start ).count();
+	std::cout << "Steps:                            " << done << " of " << steps << "\n";
+	std::cout << "Time:                             " << seconds << " s\n";
+	std::cout << "Simulated time:                   " << done * dt_ << " s\n";
+	std::cout << "Steps per second:                 " << done / seconds << "\n";
+	std::cout << "Live particles:                   " << live << " of " << numParticles_ << "\n";
+	std::cout << "Bricks:                           " << bricks_.size() << ", fullest " << fullest << " of " << capacity_ << " slots\n";
+	std::cout << "Particle updates per second:      " << particleUpdates_ / seconds << "\n";
+	if ( live > 0 )
+		std::cout << "Swarm centroid:                   " << sum[0] / live << ", " << sum[1] / live << ", " << sum[2] / live << "\n";
+	std::cout << std::flush;
+}
+
+void OutOfCoreSimulation::cleanUp()
+{
+	device_.destroyStreams();													// Wait for the last step
+	for ( Lane& lane : lanes_ )
+	{
+		use( lane );
+		for ( int i = 0; i < 2; i++ )
+			delete lane.particles[i];											// Free GPU Memory
+		delete lane.lists;
+		delete lane.counts;
+		delete lane.h_counts;
+		CUDA_CHECK( cudaEventDestroy( lane.counted ) );
+		kernel_cleanup();														// Free uniform grid of this lane
+		kernel_destroy_context( lane.context );
+	}
+	restore();
+
+	for ( Brick& brick : bricks_ )
+	{
+		for ( int p = 0; p < BRICK_PART_COUNT; p++ )
+			for ( int i = 0; i < 2; i++ )
+				delete brick.parts[p][i];										// Free pinned memory
+		delete brick.h_stats;
+	}
+	bricks_.clear();
+	delete d_sharks;
+	delete d_shark_state;
+	CUDA_CHECK( cudaEventDestroy( sharksMoved_ ) );
+	delete waypointList;
+}
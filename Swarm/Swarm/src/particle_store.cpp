@@ -0,0 +1,142 @@
+#include <vector>
+
+#include "particle_store.h"
+
+// Particles live on the GPU, in the unified memory mode the host reads them through the same pointers.
+static const CudaMallocAllocator PARTICLE_ALLOCATOR = CudaMallocAllocator::managed( ManagedRole::DEVICE_PREFERRED );
+
+ParticleStore::ParticleStore( size_t size ) :
+	size_( size ),
+	x_( size, MemoryCategory::PARTICLES, PARTICLE_ALLOCATOR ), y_( size, MemoryCategory::PARTICLES, PARTICLE_ALLOCATOR ),
+	z_( size, MemoryCategory::PARTICLES, PARTICLE_ALLOCATOR ), vx_( size, MemoryCategory::PARTICLES, PARTICLE_ALLOCATOR ),
+	vy_( size, MemoryCategory::PARTICLES, PARTICLE_ALLOCATOR ), vz_( size, MemoryCategory::PARTICLES, PARTICLE_ALLOCATOR ),
+	mass_( size, MemoryCategory::PARTICLES, PARTICLE_ALLOCATOR ),
+	alive_( size, MemoryCategory::PARTICLES, PARTICLE_ALLOCATOR ),
+	id_( size, MemoryCategory::PARTICLES, PARTICLE_ALLOCATOR )
+{
+}
+
+void ParticleStore::set( const float* verts, const float* states, size_t size )
+{
+	size = std::min( size, size_ );
+
+	std::vector<float> x( size ), y( size ), z( size );
+	std::vector<float> vx( size ), vy( size ), vz( size ), mass( size );
+	std::vector<unsigned char> alive( size, 1 );
+	std::vector<unsigned int> id( size );
+
+	for ( size_t i = 0; i < size; i++ )								// Split interleaved float4 data into arrays
+	{
+		x[i] = verts[i * 4 + 0];
+		y[i] = verts[i * 4 + 1];
+		z[i] = verts[i * 4 + 2];
+
+		vx[i] = states[i * 4 + 0];
+		vy[i] = states[i * 4 + 1];
+		vz[i] = states[i * 4 + 2];
+		mass[i] = states[i * 4 + 3];
+		id[i] = static_cast< unsigned int >( i );
+	}
+
+	x_.set( x.data(), size );
+	y_.set( y.data(), size );
+	z_.set( z.data(), size );
+	vx_.set( vx.data(), size );
+	vy_.set( vy.data(), size );
+	vz_.set( vz.data(), size );
+	mass_.set( mass.data(), size );
+	alive_.set( alive.data(), size );
+	id_.set( id.data(), size );
+}
+
+void ParticleStore::prefetch( int device, cudaStream_t stream )
+{
+	for ( CudaDeviceArray<float>* a : { &x_, &y_, &z_, &vx_, &vy_, &vz_, &mass_ } )
+		a->prefetch( device, stream );
+	alive_.prefetch( device, stream );
+	id_.prefetch( device, stream );
+}
+
+ParticleArrays ParticleStore::getArrays()
+{
+	ParticleArrays arrays = {
+		x_.getData(), y_.getData(), z_.getData(),
+		vx_.getData(), vy_.getData(), vz_.getData(),
+		mass_.getData(),
+		alive_.getData(),
+		id_.getData()
+	};
+	if ( external_.x != NULL )
+	{
+		arrays.x = external_.x;
+		arrays.y = external_.y;
+		arrays.z = external_.z;
+		arrays.alive = external_.alive;
+	}
+	if ( external_.vx != NULL )
+	{
+		arrays.vx = external_.vx;
+		arrays.vy = external_.vy;
+		arrays.vz = external_.vz;
+	}
+	return arrays;
+}
+
+void ParticleStore::attachPositions( float* x, float* y, float* z, unsigned char* alive, cudaStream_t stream )
+{
+	if ( external_.x == NULL )
+	{
+		CUDA_CHECK( cudaMemcpyAsync( x, x_.getData(), size_ * sizeof( float ), cudaMemcpyDeviceToDevice, stream ) );
+		CUDA_CHECK( cudaMemcpyAsync( y, y_.getData(), size_ * sizeof( float ), cudaMemcpyDeviceToDevice, stream ) );
+		CUDA_CHECK( cudaMemcpyAsync( z, z_.getData(), size_ * sizeof( float ), cudaMemcpyDeviceToDevice, stream ) );
+		CUDA_CHECK( cudaMemcpyAsync( alive, alive_.getData(), size_ * sizeof( unsigned char ), cudaMemcpyDeviceToDevice, stream ) );
+		CUDA_CHECK( cudaStreamSynchronize( stream ) );				// Copied before the own arrays are freed
+		x_ = CudaDeviceArray<float>( PARTICLE_ALLOCATOR );
+		y_ = CudaDeviceArray<float>( PARTICLE_ALLOCATOR );
+		z_ = CudaDeviceArray<float>( PARTICLE_ALLOCATOR );
+		alive_ = CudaDeviceArray<unsigned char>( PARTICLE_ALLOCATOR );
+	}
+	external_.x = x;
+	external_.y = y;
+	external_.z = z;
+	external_.alive = alive;
+}
+
+void ParticleStore::attachSpeeds( float* vx, float* vy, float* vz, cudaStream_t stream )
+{
+	if ( external_.vx == NULL )
+	{
+		CUDA_CHECK( cudaMemcpyAsync( vx, vx_.getData(), size_ * sizeof( float ), cudaMemcpyDeviceToDevice, stream ) );
+		CUDA_CHECK( cudaMemcpyAsync( vy, vy_.getData(), size_ * sizeof( float ), cudaMemcpyDeviceToDevice, stream ) );
+		CUDA_CHECK( cudaMemcpyAsync( vz, vz_.getData(), size_ * sizeof( float ), cudaMemcpyDeviceToDevice, stream ) );
+		CUDA_CHECK( cudaStreamSynchronize( stream ) );				// Copied before the own arrays are freed
+		vx_ = CudaDeviceArray<float>( PARTICLE_ALLOCATOR );
+		vy_ = CudaDeviceArray<float>( PARTICLE_ALLOCATOR );
+		vz_ = CudaDeviceArray<float>( PARTICLE_ALLOCATOR );
+	}
+	external_.vx = vx;
+	external_.vy = vy;
+	external_.vz = vz;
+}
+
+PinnedParticleStore::PinnedParticleStore( size_t size ) :
+	size_( size ),
+	x_( size, cudaHostAllocDefault, MemoryCategory::PARTICLES ), y_( size, cudaHostAllocDefault, MemoryCategory::PARTICLES ),
+	z_( size, cudaHostAllocDefault, MemoryCategory::PARTICLES ), vx_( size, cudaHostAllocDefault, MemoryCategory::PARTICLES ),
+	vy_( size, cudaHostAllocDefault, MemoryCategory::PARTICLES ), vz_( size, cudaHostAllocDefault, MemoryCategory::PARTICLES ),
+	mass_( size, cudaHostAllocDefault, MemoryCategory::PARTICLES ),
+	alive_( size, cudaHostAllocDefault, MemoryCategory::PARTICLES ),
+	id_( size, cudaHostAllocDefault, MemoryCategory::PARTICLES )
+{
+}
+
+ParticleArrays PinnedParticleStore::getArrays()
+{
+	return {
+		x_.getData(), y_.getData(), z_.getData(),
+		vx_.getData(), vy_.getData(), vz_.getData(),
+		mass_.getData(),
+		alive_.getData(),
+		id_.getData()
+	};
+}
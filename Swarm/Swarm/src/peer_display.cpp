@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "peer_display.h"
+#include "nvtx_range.h"
+
+PeerDisplay::PeerDisplay( bool enabled, int computeDevice ) :
+	computeDevice_( computeDevice )
+{
+	if ( !enabled )
+		return;
+
+	std::vector<int> glDevices = CudaDevice::getGLDevices();
+	if ( glDevices.empty() )
+	{
+		std::cerr << "The OpenGL context runs on no CUDA GPU, no split display" << std::endl;
+		return;
+	}
+	if ( std::find( glDevices.begin(), glDevices.end(), computeDevice_ ) != glDevices.end() )
+	{
+		std::cerr << "The simulation runs on the display GPU " << computeDevice_ << ", no split display (--device <index> of another GPU)" << std::endl;
+		return;
+	}
+	int displayDevice = glDevices[0];
+
+	CUDA_CHECK( cudaSetDevice( computeDevice_ ) );
+	int canAccess = 0;
+	CUDA_CHECK( cudaDeviceCanAccessPeer( &canAccess, computeDevice_, displayDevice ) );
+	if ( canAccess )
+	{
+		cudaError_t result = cudaDeviceEnablePeerAccess( displayDevice, 0 );
+		if ( result == cudaErrorPeerAccessAlreadyEnabled )
+			cudaGetLastError();													// Not an error, clear it
+		else
+			CUDA_CHECK( result );
+	}
+	CUDA_CHECK( cudaEventCreateWithFlags( &copied_, cudaEventDisableTiming ) );
+
+	display_ = new CudaDevice( displayDevice );									// Current until makeComputeCurrent
+	displayStream_ = display_->getStream( display_->createStream() );
+	CUDA_CHECK( cudaEventCreateWithFlags( &mapped_, cudaEventDisableTiming ) );
+	makeComputeCurrent();
+
+	std::cout << "Split display:                    simulation on GPU " << computeDevice_ << ", display on GPU " << displayDevice
+			  << ( canAccess ? ", peer to peer" : ", copies go through the host" ) << std::endl;
+}
+
+PeerDisplay::~PeerDisplay()
+{
+	if ( display_ == NULL )
+		return;
+
+	makeDisplayCurrent();
+	display_->destroyStreams();													// Waits for the last unmap
+	CUDA_CHECK( cudaEventDestroy( mapped_ ) );
+	delete display_;
+	display_ = NULL;
+
+	CUDA_CHECK( cudaSetDevice( computeDevice_ ) );
+	CUDA_CHECK( cudaEventDestroy( copied_ ) );
+	for ( CudaDeviceArray<unsigned char>* staging : staging_ )
+		delete staging;
+}
+
+void PeerDisplay::makeDisplayCurrent()
+{
+	if ( display_ != NULL )
+		CUDA_CHECK( cudaSetDevice( display_->getDevice() ) );
+}
+
+void PeerDisplay::makeComputeCurrent()
+{
+	if ( display_ != NULL )
+		CUDA_CHECK( cudaSetDevice( computeDevice_ ) );
+}
+
+void PeerDisplay::map( const std::vector<int>& resources, cudaStream_t stream )
+{
+	NVTX_RANGE( NvtxDomain::DEVICE, "PeerDisplay::map", NVTX_COLOR_INTEROP );
+
+	mappings_.clear();
+	makeDisplayCurrent();
+	display_->mapResources( resources, displayStream_ );						// OpenGL is done with the VBOs once this completes
+	for ( int resource : resources )
+	{
+		Mapping mapping = { resource, NULL, 0, false };
+		display_->getMappedPointer( &mapping.target, &mapping.bytes, resource );
+		mappings_.push_back( mapping );
+	}
+	CUDA_CHECK( cudaEventRecord( mapped_, displayStream_ ) );
+	makeComputeCurrent();
+	CUDA_CHECK( cudaStreamWaitEvent( stream, mapped_, 0 ) );					// The copies of unmap land after the map
+}
+
+void* PeerDisplay::stage( int resource )
+{
+	for ( Mapping& mapping : mappings_ )
+	{
+		if ( mapping.resource != resource )
+			continue;
+
+		if ( static_cast< size_t >( resource ) >= staging_.size() )
+			staging_.resize( resource + 1, NULL );
+		if ( staging_[resource] == NULL )
+			staging_[resource] = new CudaDeviceArray<unsigned char>( mapping.bytes, MemoryCategory::RENDER );	// Compute GPU is current
+		mapping.staged = true;
+		return staging_[resource]->getData();
+	}
+	throw std::runtime_error( "PeerDisplay::stage: resource is not mapped" );
+}
+
+void PeerDisplay::unmap( cudaStream_t stream )
+{
+	NVTX_RANGE( NvtxDomain::DEVICE, "PeerDisplay::unmap", NVTX_COLOR_INTEROP );
+
+	for ( const Mapping& mapping : mappings_ )
+	{
+		if ( mapping.staged )													// Only the packs of this frame
+			CUDA_CHECK( cudaMemcpyPeerAsync( mapping.target, display_->getDevice(), staging_[mapping.resource]->getData(), computeDevice_, mapping.bytes, stream ) );
+	}
+	CUDA_CHECK( cudaEventRecord( copied_, stream ) );
+	mappings_.clear();
+
+	makeDisplayCurrent();
+	CUDA_CHECK( cudaStreamWaitEvent( displayStream_, copied_, 0 ) );			// OpenGL draws the VBOs after the copies
+	display_->unmapResources( displayStream_ );
+	makeComputeCurrent();
+}
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cctype>
+
+#include "perf_hud.h"
+
+static char const FONT_FIRST = ' ';												// First glyph of FONT
+static char const FONT_LAST = 'Z';												// Last glyph, lower case is drawn as upper case
+
+/*!
+ * @brief 5x7 pixel font from space to Z, one byte per row from the top, bit 4 is the left pixel.
+ */
+static unsigned char const FONT[FONT_LAST - FONT_FIRST + 1][7] = {
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// space
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// !
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// "
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// #
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// $
+	{ 0x19, 0x1A, 0x02, 0x04, 0x08, 0x0B, 0x13 },	// %
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// &
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// '
+	{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 },	// (
+	{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 },	// )
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// *
+	{ 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 },	// +
+	{ 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 },	// ,
+	{ 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 },	// -
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C },	// .
+	{ 0x01, 0x02, 0x02, 0x04, 0x08, 0x08, 0x10 },	// /
+	{ 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E },	// 0
+	{ 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },	// 1
+	{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },	// 2
+	{ 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },	// 3
+	{ 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },	// 4
+	{ 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },	// 5
+	{ 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },	// 6
+	{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },	// 7
+	{ 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },	// 8
+	{ 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },	// 9
+	{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 },	// :
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// ;
+	{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 },	// <
+	{ 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 },	// =
+	{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 },	// >
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// ?
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },	// @
+	{ 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },	// A
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E },	// B
+	{ 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E },	// C
+	{ 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C },	// D
+	{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F },	// E
+	{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 },	// F
+	{ 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F },	// G
+	{ 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },	// H
+	{ 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },	// I
+	{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C },	// J
+	{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },	// K
+	{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },	// L
+	{ 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 },	// M
+	{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },	// N
+	{ 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },	// O
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 },	// P
+	{ 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D },	// Q
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 },	// R
+	{ 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E },	// S
+	{ 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },	// T
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },	// U
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 },	// V
+	{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A },	// W
+	{ 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 },	// X
+	{ 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 },	// Y
+	{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F },	// Z
+};
+
+PerfHud::PerfHud( bool shown, float pixel ) :
+	shader_( "hud_vertex.glsl", "fish_fragment.glsl" ),							// Same plain color output as the meshes
+	pixel_( pixel ),
+	shown_( shown )
+{
+	vb_ = new StreamingVertexBuffer( MAX_QUADS * 6 * VERTEX_FLOATS * sizeof( float ) );
+	VertexBufferLayout layout;
+	layout.push<float>( VERTEX_FLOATS, 0 );
+	va_.addBuffer( *vb_, layout );
+	va_.unbind();
+	vb_->unbind();
+}
+
+PerfHud::~PerfHud()
+{
+	delete vb_;
+}
+
+void PerfHud::begin()
+{
+	GLint viewport[4];
+	glGetIntegerv( GL_VIEWPORT, viewport );
+	scaleX_ = viewport[2] > 0 ? 2.0f / viewport[2] : 0.0f;
+	scaleY_ = viewport[3] > 0 ? 2.0f / viewport[3] : 0.0f;
+	vertices_ = static_cast< float* >( vb_->beginWrite() );
+	quads_ = 0;
+}
+
+void PerfHud::addRect( float x, float y, float width, float height, unsigned int color, float alpha )
+{
+	if ( vertices_ == NULL || quads_ >= MAX_QUADS || width <= 0.0f || height <= 0.0f )
+		return;
+
+	float const left = x * scaleX_ - 1.0f;
+	float const right = ( x + width ) * scaleX_ - 1.0f;
+	float const top = 1.0f - y * scaleY_;
+	float const bottom = 1.0f - ( y + height ) * scaleY_;
+	float const rgb = static_cast< float >( color & 0xFFFFFF );					// Exact, a float holds 24 bit integers
+	float const corners[6][2] = { { left, top }, { left, bottom }, { right, bottom }, { left, top }, { right, bottom }, { right, top } };
+
+	float* vertex = vertices_ + quads_ * 6 * VERTEX_FLOATS;
+	for ( int i = 0; i < 6; i++ )
+	{
+		vertex[0] = corners[i][0];
+		vertex[1] = corners[i][1];
+		vertex[2] = rgb;
+		vertex[3] = alpha;
+		vertex += VERTEX_FLOATS;
+	}
+	quads_++;
+}
+
+void PerfHud::addText( float x, float y, const char* text, unsigned int color )
+{
+	for ( size_t c = 0; text[c] != '\0'; c++ )
+	{
+		char glyph = static_cast< char >( std::toupper( static_cast< unsigned char >( text[c] ) ) );
+		if ( glyph < FONT_FIRST || glyph > FONT_LAST )
+			continue;
+
+		float const left = x + c * ( GLYPH_WIDTH + 1 ) * pixel_;
+		for ( unsigned int row = 0; row < GLYPH_HEIGHT; row++ )
+		{
+			unsigned char bits = FONT[glyph - FONT_FIRST][row];
+			unsigned int column = 0;
+			while ( column < GLYPH_WIDTH )										// One quad per run of lit pixels
+			{
+				if ( ( bits & ( 0x10 >> column ) ) == 0 )
+				{
+					column++;
+					continue;
+				}
+				unsigned int start = column;
+				while ( column < GLYPH_WIDTH && ( bits & ( 0x10 >> column ) ) != 0 )
+					column++;
+				addRect( left + start * pixel_, y + row * pixel_, ( column - start ) * pixel_, pixel_, color );
+			}
+		}
+	}
+}
+
+void PerfHud::addGraph( float x, float y, float width, float height, const StageTimes& times, float budget, unsigned int bars )
+{
+	addRect( x, y, width, height, 0x000000, 0.5f );
+	if ( budget <= 0.0f || bars == 0 )
+		return;
+
+	float const barWidth = width / bars;
+	size_t const count = std::min( times.count(), static_cast< size_t >( bars ) );
+	size_t const first = times.count() - count;
+	for ( size_t i = 0; i < count; i++ )
+	{
+		float ms = times.at( first + i );
+		float barHeight = std::min( ms / ( 2.0f * budget ), 1.0f ) * height;	// Twice the budget fills the graph
+		float left = x + width - ( count - i ) * barWidth;						// Newest sample on the right edge
+		addRect( left, y + height - barHeight, std::max( barWidth - 1.0f, 1.0f ), barHeight, ms > budget ? 0xE03020 : 0x40C040 );
+	}
+	addRect( x, y + height * 0.5f, width, 1.0f, 0xFFFFFF, 0.8f );				// Budget
+}
+
+void PerfHud::end()
+{
+	if ( vertices_ == NULL )
+		return;
+	vb_->commit();
+	vertices_ = NULL;
+	if ( quads_ == 0 )
+		return;
+
+	GLboolean const depthTest = glIsEnabled( GL_DEPTH_TEST );
+	glDisable( GL_DEPTH_TEST );
+	shader_.bind();
+	va_.bind();
+	glDrawArrays( GL_TRIANGLES, vb_->getFirstVertex( VERTEX_FLOATS * sizeof( float ) ), quads_ * 6 );	// Everything of the frame at once
+	va_.unbind();
+	shader_.unbind();
+	if ( depthTest )
+		glEnable( GL_DEPTH_TEST );
+}
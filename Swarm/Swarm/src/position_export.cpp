@@ -0,0 +1,196 @@
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "position_export.h"
+#include "cuda_device.h"
+#include "kernel.h"
+#include "nvtx_range.h"
+
+PositionExport::PositionExport( const SwarmConfig& config, unsigned int numParticles, int device ) :
+	name_( config.exportName ),
+	slots_( config.exportSlots )
+{
+	if ( name_.empty() )
+		return;
+
+	entries_ = numParticles;
+	slotBytes_ = ( 3 * entries_ * sizeof( float ) + 255 ) / 256 * 256;		// Every frame starts aligned for the consumers
+	size_t dataOffset = ( sizeof( PositionRingHeader ) + 255 ) / 256 * 256;
+	size_ = dataOffset + slots_ * slotBytes_;
+	if ( !openSharedMemory() )
+	{
+		std::cerr << "Impossible to create the shared memory " << name_ << ", no export!" << std::endl;
+		name_.clear();
+		return;
+	}
+	data_ = reinterpret_cast< char* >( header_ ) + dataOffset;
+
+	if ( cudaHostRegister( header_, size_, cudaHostRegisterDefault ) == cudaSuccess )
+		registered_ = true;														// Copies go straight into the shared memory
+	else
+	{
+		cudaGetLastError();														// Still works, staged by the driver
+		std::cerr << "Shared memory " << name_ << " is not page locked, the export copies are slower" << std::endl;
+	}
+
+	d_ring_.setCategory( MemoryCategory::TRANSFER );
+	d_ring_.resize( slots_ * slotBytes_ );
+	copyStream_ = CudaDevice::newStream( StreamClass::BACKGROUND );				// The copies never delay a step
+	for ( unsigned int s = 0; s < slots_; s++ )
+	{
+		CUDA_CHECK( cudaEventCreateWithFlags( &packed_[s], cudaEventDisableTiming ) );
+		CUDA_CHECK( cudaEventCreateWithFlags( &slotDone_[s], cudaEventDisableTiming ) );
+		CUDA_CHECK( cudaEventRecord( slotDone_[s], copyStream_ ) );				// All slots are free
+		pending_[s].header = header_;
+		pending_[s].slot = s;
+	}
+
+	PositionRingHeader* header = header_;
+	std::memset( static_cast< void* >( header ), 0, sizeof( PositionRingHeader ) );
+	header->version = POSITION_RING_VERSION;
+	header->slots = slots_;
+	header->entries = entries_;
+	header->slotBytes = slotBytes_;
+	header->dataOffset = dataOffset;
+	header->device = device;
+	if ( config.exportIpc )
+	{
+		if ( cudaIpcGetMemHandle( &header->ipcHandle, d_ring_.getData() ) == cudaSuccess )
+			header->ipc = 1;
+		else
+		{
+			cudaGetLastError();													// E.g. no IPC under WDDM, the host ring still works
+			std::cerr << "No CUDA IPC handle for " << name_ << ", only the host ring is exported" << std::endl;
+		}
+	}
+	std::atomic_thread_fence( std::memory_order_release );
+	std::memcpy( header->magic, POSITION_RING_MAGIC, sizeof( POSITION_RING_MAGIC ) );	// Last: consumers wait for the magic
+}
+
+PositionExport::~PositionExport()
+{
+	if ( name_.empty() )
+		return;
+
+	finish();
+	for ( unsigned int s = 0; s < slots_; s++ )
+	{
+		CUDA_CHECK( cudaEventDestroy( packed_[s] ) );
+		CUDA_CHECK( cudaEventDestroy( slotDone_[s] ) );
+	}
+	CUDA_CHECK( cudaStreamDestroy( copyStream_ ) );
+	if ( registered_ )
+		CUDA_CHECK( cudaHostUnregister( header_ ) );
+	closeSharedMemory();
+}
+
+bool PositionExport::openSharedMemory()
+{
+#ifdef _WIN32
+	HANDLE mapping = CreateFileMappingA( INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, static_cast< DWORD >( size_ >> 32 ),
+		static_cast< DWORD >( size_ & 0xFFFFFFFF ), name_.c_str() );			// Backed by the paging file
+	if ( mapping == NULL )
+		return false;
+	mapping_ = mapping;
+	header_ = static_cast< PositionRingHeader* >( MapViewOfFile( mapping, FILE_MAP_ALL_ACCESS, 0, 0, size_ ) );
+#else
+	std::string path = "/" + name_;
+	int fd = shm_open( path.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644 );
+	if ( fd < 0 )
+		return false;
+	if ( ftruncate( fd, static_cast< off_t >( size_ ) ) == 0 )
+	{
+		void* data = mmap( NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+		if ( data != MAP_FAILED )
+			header_ = static_cast< PositionRingHeader* >( data );
+	}
+	close( fd );																// The mapping keeps the memory
+	if ( header_ == NULL )
+		shm_unlink( path.c_str() );
+#endif
+	return header_ != NULL;
+}
+
+void PositionExport::closeSharedMemory()
+{
+#ifdef _WIN32
+	if ( header_ != NULL )
+		UnmapViewOfFile( header_ );
+	if ( mapping_ != NULL )
+		CloseHandle( mapping_ );												// Gone with the last consumer
+	mapping_ = NULL;
+#else
+	if ( header_ != NULL )
+		munmap( header_, size_ );
+	shm_unlink( ( "/" + name_ ).c_str() );										// Mapped consumers keep their view
+#endif
+	header_ = NULL;
+	data_ = NULL;
+}
+
+void PositionExport::publish( ParticleArrays particles, unsigned int mesh_count, unsigned long long step, cudaStream_t stream )
+{
+	if ( header_ == NULL || finished_ )
+		return;
+
+	NVTX_RANGE( NvtxDomain::RENDERER, "PositionExport::publish", NVTX_COLOR_SIMULATION );
+
+	unsigned long long frame = published_ + 1;
+	unsigned int s = static_cast< unsigned int >( frame % slots_ );
+	cudaError_t state = cudaEventQuery( slotDone_[s] );
+	if ( state == cudaErrorNotReady )											// Copy of this slot is behind, don't wait for it
+	{
+		dropped_++;
+		return;
+	}
+	CUDA_CHECK( state );
+
+	PositionRingSlot& slot = header_->slot[s];									// Begin of the write: consumers reject the slot now
+	slot.sequence.store( slot.sequence.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+	slot.frame = frame;
+	slot.step = step;
+	slot.live = mesh_count;
+	pending_[s].frame = frame;
+
+	char* device = d_ring_.getData() + s * slotBytes_;
+	kernel_pack_trajectory( particles, mesh_count, 1, entries_, kernel_get_stats_device(), false, device, stream );	// Float frames need no bounds
+	CUDA_CHECK( cudaEventRecord( packed_[s], stream ) );
+
+	CUDA_CHECK( cudaStreamWaitEvent( copyStream_, packed_[s], 0 ) );			// The simulation goes on while this copy runs
+	CUDA_CHECK( cudaMemcpyAsync( data_ + s * slotBytes_, device, 3 * entries_ * sizeof( float ), cudaMemcpyDeviceToHost, copyStream_ ) );
+	CUDA_CHECK( cudaLaunchHostFunc( copyStream_, &PositionExport::onCopied, &pending_[s] ) );
+	CUDA_CHECK( cudaEventRecord( slotDone_[s], copyStream_ ) );
+	published_ = frame;
+}
+
+void CUDART_CB PositionExport::onCopied( void* pending )
+{
+	const Pending& done = *static_cast< const Pending* >( pending );
+	PositionRingSlot& slot = done.header->slot[done.slot];
+	slot.sequence.store( slot.sequence.load( std::memory_order_relaxed ) + 1, std::memory_order_release );	// End of the write
+	done.header->latest.store( done.frame, std::memory_order_release );
+}
+
+void PositionExport::finish()
+{
+	if ( header_ == NULL || finished_ )
+		return;
+
+	finished_ = true;
+	CUDA_CHECK( cudaStreamSynchronize( copyStream_ ) );							// Last frame is published
+	std::cout << "Export:                           " << published_ << " frames in " << name_;
+	if ( dropped_ > 0 )
+		std::cout << ", " << dropped_ << " frames dropped (copies too slow)";
+	std::cout << std::endl;
+}
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+#include "quality_controller.h"
+
+/*!
+ * @brief A better level only comes back while the load stays this far below the budget, so it has room for the extra work.
+ */
+static const double QUALITY_HYSTERESIS = 0.3;
+
+QualityController::QualityController( const SwarmConfig& config, unsigned int maxSubsteps ) :
+	enabled_( config.qualityBudget > 0.0f && config.gpus == 1 ),
+	budget_( config.qualityBudget )
+{
+	QualityLevel level;
+	level.maxSubsteps = maxSubsteps;
+	level.firstK = config.firstK;
+	level.multiRate = config.multiRate;
+	level.lodDistance = config.lodDistance;
+	level.trailLength = config.trails;
+	level.renderScale = config.renderScale;
+	levels_.push_back( level );
+
+	bool lod = config.culling && config.instanced;								// Else every fish is a point anyway
+	bool grid = config.behaviour == Behaviour::CLASSIC;							// First k and multi-rate are options of the grid search
+	auto cheaper = [this]( const QualityLevel& next )
+	{
+		const QualityLevel& last = levels_.back();
+		if ( next.maxSubsteps != last.maxSubsteps || next.firstK != last.firstK || next.multiRate != last.multiRate
+			|| next.lodDistance != last.lodDistance || next.trailLength != last.trailLength || next.renderScale != last.renderScale )
+			levels_.push_back( next );
+	};
+
+	// Cheapest knobs first: what is drawn, then how exact the steps are, then how many of them run.
+	level.trailLength /= 2;
+	cheaper( level );
+	if ( lod )
+	{
+		level.lodDistance *= 0.5f;
+		cheaper( level );
+	}
+	level.renderScale *= 0.75f;													// Fill rate, a bit more than half of the pixels
+	cheaper( level );
+	if ( grid )
+	{
+		level.multiRate = std::max( level.multiRate, 2u );
+		cheaper( level );
+		if ( level.firstK == 0 || level.firstK > 16 )
+			level.firstK = 16;
+		cheaper( level );
+	}
+	level.maxSubsteps = std::max( level.maxSubsteps / 2, 1u );
+	cheaper( level );
+	if ( grid )
+	{
+		level.multiRate = std::max( level.multiRate, 4u );
+		cheaper( level );
+	}
+	level.renderScale = config.renderScale * 0.5f;								// A quarter of the pixels
+	cheaper( level );
+	level.trailLength = 0;
+	if ( lod )
+		level.lodDistance = 0.0f;												// Only points
+	cheaper( level );
+	if ( grid )
+	{
+		level.firstK = std::min( level.firstK, 4u );
+		cheaper( level );
+	}
+	level.maxSubsteps = std::max( level.maxSubsteps / 2, 1u );
+	cheaper( level );
+
+	if ( config.qualityBudget > 0.0f && !enabled_ )
+		std::cout << "Quality controller needs one GPU, --quality_budget ignored" << std::endl;
+}
+
+void QualityController::change( size_t level )
+{
+	std::cout << std::fixed << std::setprecision( 2 )
+			  << "Quality level:                    " << level_ << " -> " << level << " (" << ( samples_ > 0 ? sum_ / samples_ : 0.0 )
+			  << " ms of " << budget_ << " ms)" << std::defaultfloat << std::endl;
+	level_ = level;
+	sum_ = 0.0;
+	samples_ = 0;
+	calmFrames_ = 0;
+}
+
+bool QualityController::update( double cpuMs, double gpuMs )
+{
+	if ( !enabled_ )
+		return false;
+
+	double load = std::max( cpuMs, gpuMs );										// CPU and GPU overlap, the slower one sets the frame rate
+	sum_ += load;
+	samples_++;
+	sinceUpgrade_++;
+	calmFrames_ = load < budget_ * ( 1.0 - QUALITY_HYSTERESIS ) ? calmFrames_ + 1 : 0;
+
+	if ( upgraded_ && sinceUpgrade_ >= upgradeFrames_ )							// The better level holds, the next try doesn't wait longer
+	{
+		upgraded_ = false;
+		upgradeFrames_ = UPGRADE_FRAMES;
+	}
+
+	if ( samples_ >= WINDOW )
+	{
+		if ( sum_ / samples_ > budget_ && level_ + 1 < levels_.size() )
+		{
+			if ( upgraded_ && sinceUpgrade_ < 2 * WINDOW )						// Didn't fit right after it came back
+				upgradeFrames_ = std::min( upgradeFrames_ * 2, MAX_UPGRADE_FRAMES );
+			upgraded_ = false;
+			change( level_ + 1 );
+			return true;
+		}
+		sum_ = 0.0;
+		samples_ = 0;
+	}
+
+	if ( calmFrames_ >= upgradeFrames_ && level_ > 0 )
+	{
+		change( level_ - 1 );
+		upgraded_ = true;
+		sinceUpgrade_ = 0;
+		return true;
+	}
+	return false;
+}
@@ -1,5 +1,8 @@
 #include "glew.h"
 
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <WindowsNumerics.h>
 #include <glm/glm.hpp>
@@ -7,245 +10,1296 @@
 
 #include "Window.hpp"
 #include "renderer.h"
+#include "frame_uniforms.h"
+#include "gl_features.h"
+#include "multi_gpu_simulation.h"
 #include "kernel.h"
+#include "nvtx_range.h"
+#include "launch_check.h"
+#include "memory_tracker.h"
+#include "startup.h"
 
 #include <device_launch_parameters.h>
 
-/*
- * BoxSize for Random Spawn.
- */
-static float const MAX_X = 5;
-static float const MIN_X = -MAX_X;
-static float const MAX_Y = 5;
-static float const MIN_Y = -MAX_Y;
-static float const MAX_Z = 5;
-static float const MIN_Z = -MAX_Z;
-
-// Constant orange. Is used for random color generation for each particle.
-static GLfloat const color[3] = { 200.0f / 255.0f, 117.0f / 255.0f, 26.0f / 255.0f };
-
-/*!
- * @brief Random Function. Creates a random color value.
- * @return random float value
-*/
-float randC()
+// Fish mesh: x forward, y up, z side, brightness in w. A body of 8 triangles and a tail fin.
+static GLfloat const FISH_MESH[] = {
+	 1.0f,  0.0f,   0.0f,   1.0f,	 0.0f,  0.25f,  0.0f,   1.0f,	 0.0f,  0.0f,   0.12f,  1.0f,	// Head, top
+	 1.0f,  0.0f,   0.0f,   1.0f,	 0.0f,  0.25f,  0.0f,   1.0f,	 0.0f,  0.0f,  -0.12f,  1.0f,
+	 1.0f,  0.0f,   0.0f,   0.6f,	 0.0f, -0.25f,  0.0f,   0.6f,	 0.0f,  0.0f,   0.12f,  0.6f,	// Head, belly
+	 1.0f,  0.0f,   0.0f,   0.6f,	 0.0f, -0.25f,  0.0f,   0.6f,	 0.0f,  0.0f,  -0.12f,  0.6f,
+	-0.6f,  0.0f,   0.0f,   0.9f,	 0.0f,  0.25f,  0.0f,   0.9f,	 0.0f,  0.0f,   0.12f,  0.9f,	// Tail, top
+	-0.6f,  0.0f,   0.0f,   0.9f,	 0.0f,  0.25f,  0.0f,   0.9f,	 0.0f,  0.0f,  -0.12f,  0.9f,
+	-0.6f,  0.0f,   0.0f,   0.5f,	 0.0f, -0.25f,  0.0f,   0.5f,	 0.0f,  0.0f,   0.12f,  0.5f,	// Tail, belly
+	-0.6f,  0.0f,   0.0f,   0.5f,	 0.0f, -0.25f,  0.0f,   0.5f,	 0.0f,  0.0f,  -0.12f,  0.5f,
+	-0.6f,  0.0f,   0.0f,   0.8f,	-1.0f,  0.25f,  0.0f,   0.8f,	-1.0f, -0.25f,  0.0f,   0.8f,	// Fin
+};
+static unsigned int const FISH_MESH_VERTICES = sizeof( FISH_MESH ) / ( 4 * sizeof( GLfloat ) );
+static float const FISH_SIZE = 0.05f;											// Length from head to body center in swarm units
+static float const PICK_RADIUS = 2.0f * FISH_SIZE;								// A click within a fish length of a fish picks it
+
+static unsigned int const OVERLAY_POINTS = 2;									// Swarm center, waypoint
+static double const METRICS_INTERVAL = 0.5;										// Seconds between two publications of the metrics
+static float const SHARK_VIEW_DISTANCE = 0.6f;									// Eye of a shark view behind its shark in swarm units
+
+SwarmConfig Renderer::simulationConfig( const SwarmConfig& config )
 {
-	float inverse_scale = 2;
-	return float( rand() ) / float( RAND_MAX ) / inverse_scale + (1 - 1 / inverse_scale / 2);
-}
-
-/*!
- * @brief Creates a random float value between a and b.
- * @param a first barrier.
- * @param b second barrier.
- * @return random float value.
-*/
-float randf( float a, float b )
-{
-	float random = ( ( float ) rand() ) / ( float ) RAND_MAX;
-	float diff = b - a;
-	float r = random * diff;
-	return a + r;
+	SwarmConfig simulation = config;
+	simulation.restore.clear();													// The window always starts a new swarm
+	if ( config.gpus != 1 )														// The exchange drops eaten fishies and sorts the slots
+	{
+		simulation.graphs = false;
+		simulation.compactInterval = 0;
+		simulation.reorderInterval = 0;
+	}
+	if ( config.pipelineDepth > 0 )												// The back buffers live on the OpenGL GPU
+		simulation.splitDisplay = false;
+	return simulation;
 }
 
-Renderer::Renderer() : shader_( "vertex.glsl", "fragment.glsl" )				// Create Shader Program
+Renderer::Renderer( const SwarmConfig& config, StartupOrchestrator* startup ) :
+	shader_( "vertex.glsl", "fragment.glsl" ),									// Create Shader Program
+	fishShader_( "fish_vertex.glsl", "fish_fragment.glsl" ),					// Shader Program of the fish meshes
+	trailShader_( "trail_vertex.glsl", "fish_fragment.glsl" ),					// Same plain color output as the meshes
+	impostorShader_( "impostor_vertex.glsl", "impostor_fragment.glsl" ),		// Spheres of the point sprites
+	clusterShader_( "cluster_vertex.glsl", "cluster_fragment.glsl" ),			// Splats of the far schools
+	colorMode_( config.colorMode ),
+	schools_( config.schools ),
+	instanced_( config.instanced ),
+	overlay_( config.overlay ),
+	lateInput_( config.lateInput || config.lateLatch ),
+	lateLatch_( config.lateLatch ),
+	culling_( config.culling ),
+	lodDistance_( config.lodDistance ),
+	clusterDistance_( config.clusterDistance ),
+	clusterCellSize_( config.clusterCellSize ),
+	depthSort_( config.depthSort ),
+	impostors_( config.impostors ),
+	density_( config.density ),
+	interpolate_( config.interpolate ),
+	trailLength_( config.trails ),
+	trailDrawn_( config.trails ),
+	trailEvery_( config.trailEvery > 0 ? config.trailEvery : 1 ),
+	trace_( config.trace ),
+	profiler_( config.profileInterval > 0 || trace_.isEnabled(), config.profileInterval, true, &trace_ ),	// The trace needs the stage timers
+	selector_( config ),
+	quality_( config, MAX_SUBSTEPS ),
+	multiRateShark_( config.multiRateShark ),
+	multiRateFocus_( config.multiRateFocus ),
+	frameTimes_( config.frameBudget ),
+	frameDump_( config.frameDump ),
+	metrics_( config.metricsPort ),
+	trajectory_( config, config.numParticles ),
+	numParticles_( config.numParticles ),
+	numSharks_( config.numSharks ),
+	dt_( 1.0 / config.simulationRate )
 {
-	std::vector<Vector3> waypointVector											// Create vector with waypoints for fishies
-	{
-		// zig zag
-		Vector3(-4.0, -3.0, 0.0),
-		Vector3(4.0, -2.0, 0.0),
-		Vector3(-4.0, -1.0, 0.0),
-		Vector3(4.0, 2.0, 0.0),
-		
-		// Square
-		//Vector3(-5.0, 5.0, 0.0),
-		//Vector3(-5.0, -5.0, 0.0),
-		//Vector3(5.0, -5.0, 0.0),
-		//Vector3(5.0, 5.0, 0.0),
-
-		// not moving
-		//Vector3(0,0,0)
-	};
-
-	waypointList = new WaypointList( waypointVector );							// Initialize Linked Waypoint list.
-	swarmCenter = waypointList->get();											// Get first swarm center for particles.
+	shader_.bindUniformBlock( "FrameUniforms", FRAME_UNIFORMS_BINDING );		// Both shaders read the same block
+	fishShader_.bindUniformBlock( "FrameUniforms", FRAME_UNIFORMS_BINDING );
+	trailShader_.bindUniformBlock( "FrameUniforms", FRAME_UNIFORMS_BINDING );
+	impostorShader_.bindUniformBlock( "FrameUniforms", FRAME_UNIFORMS_BINDING );
+	clusterShader_.bindUniformBlock( "FrameUniforms", FRAME_UNIFORMS_BINDING );
+	sharkViews_ = std::min( config.sharkViews, config.numSharks );
+	if ( sharkViews_ > MAX_SHARK_VIEWS )
+		sharkViews_ = MAX_SHARK_VIEWS;
+	frameUniforms_ = new UniformBuffer( sizeof( FrameUniforms ), FRAME_UNIFORMS_BINDING, 1 + sharkViews_ );	// One block per viewport and frame
+	frameTimes_.setTrace( &trace_ );
+	pointSizeLocation_ = shader_.getUniformHandle( "u_pointsize" );				// No string lookup per draw
+	lagLocation_ = shader_.getUniformHandle( "u_lag" );
+	impostorPointSizeLocation_ = impostorShader_.getUniformHandle( "u_pointsize" );
+	impostorLagLocation_ = impostorShader_.getUniformHandle( "u_lag" );
+	impostorViewportLocation_ = impostorShader_.getUniformHandle( "u_viewport" );
+	clusterViewportLocation_ = clusterShader_.getUniformHandle( "u_viewport" );
 
 	glEnable( GL_BLEND );														// clean looking points.
 	glEnable( GL_PROGRAM_POINT_SIZE );											// enable to set the point size.
+	if ( instanced_ || impostors_ )
+		glEnable( GL_DEPTH_TEST );												// Meshes and impostors are opaque, close fishies hide the ones behind
+	if ( culling_ && !GLEW_ARB_draw_indirect )
+	{
+		std::cerr << "glDrawArraysIndirect is not supported, drawing all fishies" << std::endl;
+		culling_ = false;
+	}
+	if ( depthSort_ && ( culling_ || instanced_ ) )								// Culled buffers and meshes have no sortable point draw
+	{
+		std::cerr << "Depth sort needs --culling 0 and --instanced 0, drawing unsorted" << std::endl;
+		depthSort_ = false;
+	}
+	if ( config.splitDisplay && ( culling_ || depthSort_ || density_ || trailLength_ > 0 ) )	// Only the packs are staged and copied
+	{
+		std::cerr << "Split display needs --culling 0, --depth_sort 0, --density 0 and --trails 0, drawing without them" << std::endl;
+		culling_ = false;
+		depthSort_ = false;
+		density_ = false;
+		trailLength_ = 0;
+		trailDrawn_ = 0;
+	}
+	pipeline_ = new FramePipeline( config.pipelineDepth );
+	if ( pipeline_->isEnabled() && ( culling_ || depthSort_ || density_ || trailLength_ > 0 || config.vertexPulling || config.vulkanInterop || config.splitDisplay ) )
+	{
+		std::cerr << "The frame pipeline needs --culling 0, --depth_sort 0, --density 0, --trails 0, --vertex_pulling 0, --vulkan_interop 0 and --split_display 0, drawing without them" << std::endl;
+		culling_ = false;														// Only the packs have back buffers
+		depthSort_ = false;
+		density_ = false;
+		trailLength_ = 0;
+		trailDrawn_ = 0;
+	}
+	if ( clusterDistance_ > 0.0f && !culling_ )									// The clusters are summed up by the culling pass
+	{
+		std::cerr << "Cluster impostors need --culling 1, drawing every fish" << std::endl;
+		clusterDistance_ = 0.0f;
+	}
+	if ( interpolate_ && ( culling_ || instanced_ ) )							// Culled buffers and meshes only hold the newest step
+	{
+		std::cerr << "Interpolation needs --culling 0 and --instanced 0, drawing the newest step" << std::endl;
+		interpolate_ = false;
+	}
+	if ( config.vertexPulling )
+	{
+		if ( !glHasShaderStorage() )
+			std::cerr << "Vertex pulling needs OpenGL 4.3 (--gl 4.5), packing the points" << std::endl;
+		else if ( culling_ || instanced_ || impostors_ || interpolate_ || config.unifiedMemory || config.splitDisplay || pipeline_->isEnabled() )	// Points of the newest step, on the device only
+			std::cerr << "Vertex pulling needs --culling 0, --instanced 0, --impostors 0, --interpolate 0, --unified_memory 0, --split_display 0 and --pipeline 0, packing the points" << std::endl;
+		else
+		{
+			pullShader_ = new Shader( "pull_vertex.glsl", "fragment.glsl" );
+			pullShader_->bindUniformBlock( "FrameUniforms", FRAME_UNIFORMS_BINDING );
+			pullPointSizeLocation_ = pullShader_->getUniformHandle( "u_pointsize" );
+			pullColorModeLocation_ = pullShader_->getUniformHandle( "u_colormode" );
+		}
+	}
+	if ( culling_ && schools_ > 1 )												// One command per school and tier, written by the culling pass
+	{
+		if ( GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_draw_parameters )
+			cullSchools_ = std::min( schools_, CULL_MAX_SCHOOLS );
+		else
+			std::cerr << "Draws per school need ARB_multi_draw_indirect and ARB_shader_draw_parameters, drawing all schools together" << std::endl;
+	}
+	stateColors_ = !culling_ && !instanced_ && !impostors_;						// Meshes, impostors and culled points have shaders of their own
+	bool const schoolColors = colorMode_ == ColorMode::SCHOOL && cullSchools_ > 1 && !impostors_;	// The hue comes with the draw of the school
+	if ( colorMode_ != ColorMode::STATIC && !stateColors_ && !schoolColors )
+	{
+		std::cerr << "Color modes need --culling 0, --instanced 0 and --impostors 0, drawing the static colors" << std::endl;
+		colorMode_ = ColorMode::STATIC;
+	}
+	if ( GLEW_ARB_shader_draw_parameters )										// The shaders have the block then
+	{
+		shader_.bindUniformBlock( "SchoolDraws", SCHOOL_DRAWS_BINDING );
+		fishShader_.bindUniformBlock( "SchoolDraws", SCHOOL_DRAWS_BINDING );
+		schoolDrawsLocation_ = shader_.getUniformHandle( "u_schooldraws" );
+		SchoolDraws draws = {};
+		for ( unsigned int s = 0; s < cullSchools_ && schoolColors; s++ )		// Same color wheel as kernel_pack_colors
+		{
+			float const hue = 6.0f * s / cullSchools_;
+			draws.colors[s] = glm::vec4( glm::clamp( std::abs( hue - 3.0f ) - 1.0f, 0.0f, 1.0f ), glm::clamp( 2.0f - std::abs( hue - 2.0f ), 0.0f, 1.0f ),
+				glm::clamp( 2.0f - std::abs( hue - 4.0f ), 0.0f, 1.0f ), 1.0f );
+		}
+		schoolDraws_ = new UniformBuffer( sizeof( SchoolDraws ), SCHOOL_DRAWS_BINDING );
+		schoolDraws_->upload( &draws );											// Stays bound, never rewritten
+		fishShader_.bind();
+		fishShader_.setUniform1i( "u_schooldraws", cullSchools_ > 1 ? 1 : 0 );	// The mesh shader only draws culled or all fishies
+		fishShader_.unbind();
+	}
+	colorModeLocation_ = shader_.getUniformHandle( "u_colormode" );
 
-	device_ = CudaDevice();														// Create CUDA Device. Automically select the first found device.
-	std::cout << device_ << std::endl;											// Print out some information about the used GPU
+	if ( startup != NULL )
+	{
+		startup->phase( "shaders" );
+		simulation_ = startup->join();											// Spawned while the window opened
+	}
+	if ( simulation_ == NULL )
+	{
+		simulation_ = new SwarmSimulation( simulationConfig( config ), true );	// Device, stores, sharks and colors, the OpenGL GPU first
+		if ( startup != NULL )
+		{
+			startup->append( simulation_->getStartupPhases() );					// Device, context, buffers, kernels, spawn
+			startup->phase( "simulation" );
+		}
+	}
+	peer_ = new PeerDisplay( config.splitDisplay && !pipeline_->isEnabled(), simulation_->getDevice().getDevice() );
+	device_ = peer_->isEnabled() ? &peer_->getDevice() : &simulation_->getDevice();
+	stream_ = simulation_->getStream();
+	telemetry_ = new GpuTelemetry( config.telemetry, simulation_->getDevice().getDevice() );
+	frameTimes_.setTelemetry( telemetry_ );
+	if ( sharkViews_ > 0 )
+		sharkMailbox_ = new CudaMailbox<SharkPositions>( MemoryCategory::RENDER );
+	pickMailbox_ = new CudaMailbox<PickResult>( MemoryCategory::RENDER );
+	statsRing_ = new StatsRing( config.statsHistory, config.statsReadback, simulation_->getParams().fishDist / 4.0f );	// Bins up to 4 fishDist
 
 	Window* window = Window::getInstance();										// Used to set current time
 
-	
-	createBuffers();															// create buffers related to OpenGL and CUDA
-	setLastUpdate(window->getCurrentTime());
-}
+	interop_ = new VulkanInterop( config.vulkanInterop && !peer_->isEnabled() && !pipeline_->isEnabled(), device_->getDevice() );
+	peer_->makeDisplayCurrent();												// The VBOs are registered on the display GPU
+	createBuffers( config );													// create buffers related to OpenGL and CUDA
+	peer_->makeComputeCurrent();
+	pipeline_->attach( *device_, stream_ );
+	if ( startup != NULL )
+		startup->phase( "interop" );
+	for ( Shader* shader : { &shader_, pullShader_ } )
+	{
+		if ( shader == NULL || !stateColors_ )
+			continue;
+		shader->bind();
+		shader->setUniform1f( "u_maxspeed", 2.0f * simulation_->getSpeed() );	// Orange from twice the swarm speed on
+		shader->setUniform1f( "u_feardist", simulation_->getParams().sharkDist );	// Red where the fishies evade
+		shader->setUniform1i( "u_sharkcount", static_cast< int >( numSharks_ ) );
+		shader->setUniform1i( "u_sharks", SHARK_TEXTURE_UNIT );
+		shader->unbind();
+	}
 
-void Renderer::createBuffers()
-{
-	
-	for ( unsigned int i = 0; i < NUM_PARTICLES; i++ )							// init vertex position and color
+	if ( config.gpus != 1 )														// Slabs on all GPUs, this one draws
 	{
-		h_data.push_back( randf( MIN_X, MAX_X) );								// random vertex.x
-		h_data.push_back( randf( MIN_Y, MAX_Y ) );								// random vertex.y
-		h_data.push_back( randf( MIN_Z, MAX_Z ) );								// random vertex.z
-		h_data.push_back( 1.0f );												// vertex.w
+		multi_ = new MultiGpuSimulation( config );
+		simulation_->setLiveCount( multi_->gather( simulation_->getParticles(), simulation_->getSharks(), stream_ ) );
+	}
 
-		h_color.push_back( color[0] * randC() );								// Red
-		h_color.push_back( color[1] * randC() );								// Green
-		h_color.push_back( color[2] * randC() );								// Blue
-		h_color.push_back( 1.0f );												// Alpha
+	if ( !config.events.empty() )
+	{
+		if ( multi_ != NULL )													// The slabs run in contexts of their own
+			std::cout << "Events are only logged on one GPU, --events ignored" << std::endl;
+		else
+			events_ = new EventLog( config, stream_ );
 	}
+	export_ = new PositionExport( config, config.numParticles, simulation_->getDevice().getDevice() );	// Gathered from the slabs too
 
-	VertexBuffer vb( h_data.data(), NUM_PARTICLES * 4 * sizeof( float ) );		// Create buffer for positions
-	VertexBuffer vbC( h_color.data(), NUM_PARTICLES * 4 * sizeof( float ) );	// Create buffer for colors
+	if ( !config.video.empty() )
+	{
+		bool headless = config.headlessSteps > 0;								// One step per frame, so the video plays at simulation speed
+		video_ = new VideoRecorder( config, headless || config.benchmark ? config.simulationRate : 60 );
+		if ( !video_->isEnabled() )
+		{
+			delete video_;
+			video_ = NULL;
+		}
+		else if ( headless )
+			videoFrames_ = config.headlessSteps;
+	}
+	if ( SceneTarget::isNeeded( config ) )
+		sceneTarget_ = new SceneTarget( config.msaa, config.renderScale );		// The window has no samples then
+	hud_ = new PerfHud( config.hud );
+	capture_ = new FrameCapture( config, jobs_ );
+	setLastUpdate(window->getCurrentTime());
+}
+
+void Renderer::createBuffers( const SwarmConfig& config )
+{
+	agents_ = pullShader_ == NULL && !culling_ && !instanced_ && !impostors_ && !depthSort_;	// Only the packed points draw the sharks with the fishies
+	unsigned int const agents = numParticles_ + ( agents_ ? numSharks_ : 0 );	// Sharks behind the fishies
+	vbC_ = createSharedBuffer( NULL, agents * sizeof( uchar4 ), vbCExternal_ );	// Create buffer for colors. Written by CUDA before the first draw, the sharks take theirs from the type.
 
 	VertexBufferLayout layout;													// Create Buffer Layout. Is used to call the VAO how to handle the buffers.
 	layout.push<float>( 4, 0 );													// float values, 4 values per vertice and start at 0 (no offset).
+	VertexBufferLayout colorLayout;												// Fish colors: 4 normalized bytes, a quarter of the fetch of float colors
+	colorLayout.push<unsigned char>( 4, 0 );
+	const VertexBufferElement& color = colorLayout.getElements()[0];
 
-	va_.addBuffer( vb, layout );												// Add 1. Buffer (Position). This buffer will be modified in kernel later.
-	va_.addBuffer( vbC, layout.getElements()[0], 1 );							// Add 2. Buffer (Color). It's a little bit more complicated than the last line, because we need to add an index seperately.
+	if ( pullShader_ != NULL )													// The stores themselves live in storage buffers, nothing is packed
+	{
+		vaPull_.addBuffer( *vbC_, color, 1 );
+		vaPull_.unbind();
+		unsigned int const floats = numParticles_ * sizeof( float );
+		unsigned int const bytes[PULLED_ARRAYS] = { floats, floats, floats, ( numParticles_ + 3 ) / 4 * 4, floats, floats, floats };	// Alive flags as whole words for the shader
+		for ( int store = 0; store < 2; store++ )
+		{
+			for ( unsigned int a = 0; a < PULLED_ARRAYS; a++ )
+			{
+				vbParticles_[store][a] = new VertexBuffer( NULL, bytes[a] );
+				vbParticles_[store][a]->unbind();
+				particleResources_.push_back( device_->registerGLBuffer( *vbParticles_[store][a] ) );	// Read and written in place by the steps
+			}
+		}
+		holdParticles();														// The stores move into the buffers
+	}
+	if ( instanced_ || ( stateColors_ && pullShader_ == NULL ) )				// Mesh orientation or speed colors
+		vbDir_ = new VertexBuffer( NULL, agents * 4 * sizeof( float ) );		// Written with the positions
+	if ( agents_ )																// Type and point size of every agent, never changes
+	{
+		std::vector<float> h_agents( 2 * agents, 1.0f );
+		for ( unsigned int i = 0; i < numParticles_; i++ )
+			h_agents[2 * i] = 0.0f;												// Fishies: type 0, point size of the draw
+		for ( unsigned int i = numParticles_; i < agents; i++ )
+			h_agents[2 * i + 1] = SHARK_POINT_SCALE;							// Sharks: type 1, bigger than fishies
+		vbAgent_ = new VertexBuffer( h_agents.data(), 2 * agents * sizeof( float ) );
+	}
+	VertexBufferLayout agentLayout;
+	agentLayout.push<float>( 2, 0 );
+	for ( int i = 0; i < 2 && pullShader_ == NULL; i++ )						// Two position buffers (ping-pong), packed from the particles every frame.
+	{
+		vb_[i] = createSharedBuffer( NULL, agents * 4 * sizeof( float ), vbExternal_[i] );	// Create buffer for positions, the sharks are copied behind the fishies
 
-	va_.unbind();																// Unbind VAO while unused.
-	vb.unbind();																// Unbind VBO. Unused now.
-	vbC.unbind();																// Unbind VBO. Unused now.
+		va_[i].addBuffer( *vb_[i], layout );									// Add 1. Buffer (Position). This buffer will be modified in kernel later.
+		va_[i].addBuffer( *vbC_, color, 1 );									// Add 2. Buffer (Color). It's a little bit more complicated than the last line, because we need to add an index seperately.
+		if ( stateColors_ )
+			va_[i].addBuffer( *vbDir_, layout.getElements()[0], 3 );			// Speed of the newest step, read by the speed colors
+		if ( agents_ )
+			va_[i].addBuffer( *vbAgent_, agentLayout.getElements()[0], 4 );		// Type and size, fishies and sharks in one draw
 
-	device_.registerGLBuffer( vb );												// CUDA: register opengl buffer object for access CUDA
+		va_[i].unbind();														// Unbind VAO while unused.
+		vb_[i]->unbind();														// Unbind VBO. Unused now.
 
-	for ( unsigned int i = 0; i < NUM_PARTICLES; i++ )							// init forces.
+		if ( vbExternal_[i] < 0 )
+			vbResource_[i] = device_->registerGLBuffer( *vb_[i], cudaGraphicsRegisterFlagsWriteDiscard );	// CUDA: register opengl buffer object for access CUDA. Always overwritten completely.
+	}
+	if ( interpolate_ )															// The other buffer holds the step before
 	{
-		h_state.push_back(0.0f);												// force.x
-		h_state.push_back(0.0f);												// force.y
-		h_state.push_back(0.0f);												// force.z
-		h_state.push_back(static_cast< float >( rand() ) / RAND_MAX / 4 + 0.875);	// random mass for each particle
+		for ( int i = 0; i < 2; i++ )
+		{
+			va_[i].addBuffer( *vb_[1 - i], layout.getElements()[0], 2 );
+			va_[i].unbind();
+		}
 	}
+	vbC_->unbind();																// Unbind VBO. Unused now.
+	if ( vbCExternal_ < 0 )
+		vbCResource_ = device_->registerGLBuffer( *vbC_, cudaGraphicsRegisterFlagsWriteDiscard );	// CUDA: rewrites the colors after fishies moved to other slots.
 
-	h_shark_state = { 0.01, 0.01, 0.01, 0.01 };									// Shark forces and mass 
+	if ( instanced_ )															// One mesh per fish, position, color and direction per instance
+	{
+		vbMesh_ = new VertexBuffer( FISH_MESH, sizeof( FISH_MESH ) );
+		for ( int i = 0; i < 2; i++ )
+		{
+			vaFish_[i].addBuffer( *vb_[i], layout.getElements()[0], 0, 1 );		// Positions: next one per instance
+			vaFish_[i].addBuffer( *vbC_, color, 1, 1 );
+			vaFish_[i].addBuffer( *vbDir_, layout.getElements()[0], 2, 1 );
+			vaFish_[i].addBuffer( *vbMesh_, layout.getElements()[0], 3 );		// Mesh: next one per vertex
+			vaFish_[i].unbind();
+		}
+		vbMesh_->unbind();
+	}
+	if ( vbAgent_ != NULL )
+		vbAgent_->unbind();
+	if ( vbDir_ != NULL )
+	{
+		vbDir_->unbind();
+		vbDirResource_ = device_->registerGLBuffer( *vbDir_, cudaGraphicsRegisterFlagsWriteDiscard );	// CUDA: rewritten with the positions
+	}
 
-	/*
-	 * Explicit creation and copy, because we won't update this values.
-	 */
-	d_state = new CudaDeviceArray<float>( NUM_PARTICLES * 4 );					// Allocate Memory on GPU for force vector
-	d_state->set( h_state.data(), NUM_PARTICLES * 4 );							// Copy force vector to GPU
-	d_color = new CudaDeviceArray<float>(NUM_PARTICLES * 4);					// Allocate Memory on GPU for color vector
-	d_color->set(h_color.data(), NUM_PARTICLES * 4);							// Copy color vector to GPU 
+	if ( culling_ )																// Visible fishies only, compacted by the GPU
+	{
+		for ( int i = 0; i < ( instanced_ ? 3 : 2 ); i++ )
+		{
+			vbCull_[i] = new VertexBuffer( NULL, numParticles_ * ( i == 1 ? sizeof( uchar4 ) : sizeof( float4 ) ) );	// 1: colors
+			vbCullResource_[i] = device_->registerGLBuffer( *vbCull_[i], cudaGraphicsRegisterFlagsWriteDiscard );
+		}
+		unsigned int const commands = 2 * cullSchools_ + 1;
+		std::vector<DrawCommand> h_commands( commands, DrawCommand() );			// Meshes and points per school, cluster impostors
+		vbIndirect_ = new VertexBuffer( h_commands.data(), commands * sizeof( DrawCommand ) );
+		vbIndirectResource_ = device_->registerGLBuffer( *vbIndirect_, cudaGraphicsRegisterFlagsWriteDiscard );
+		d_cullCounts.setCategory( MemoryCategory::RENDER );
+		d_cullCounts.resize( commands );
+		if ( clusterDistance_ > 0.0f )
+		{
+			for ( int i = 0; i < 2; i++ )
+			{
+				vbClusters_[i] = new VertexBuffer( NULL, CULL_CLUSTER_SLOTS * ( i == 1 ? sizeof( uchar4 ) : sizeof( float4 ) ) );	// 1: colors
+				vbClustersResource_[i] = device_->registerGLBuffer( *vbClusters_[i], cudaGraphicsRegisterFlagsWriteDiscard );
+			}
+			vaClusters_.addBuffer( *vbClusters_[0], layout.getElements()[0], 0 );	// Centroid and radius, color per vertex
+			vaClusters_.addBuffer( *vbClusters_[1], color, 1 );
+			vaClusters_.unbind();
+		}
 
-	kernel_init_grid(NUM_PARTICLES);											// Initialize grid depending on the number of particles.
+		vaCullPoints_.addBuffer( *vbCull_[0], layout.getElements()[0], 0 );	// Points: position and color per vertex
+		vaCullPoints_.addBuffer( *vbCull_[1], color, 1 );
+		vaCullPoints_.unbind();
+		if ( instanced_ )
+		{
+			vaCullMesh_.addBuffer( *vbCull_[0], layout.getElements()[0], 0, 1 );	// Meshes: position, color and direction per instance
+			vaCullMesh_.addBuffer( *vbCull_[1], color, 1, 1 );
+			vaCullMesh_.addBuffer( *vbCull_[2], layout.getElements()[0], 2, 1 );
+			vaCullMesh_.addBuffer( *vbMesh_, layout.getElements()[0], 3 );
+			vaCullMesh_.unbind();
+		}
+		vbIndirect_->unbind();
+	}
 
+	if ( density_ )																// One point per texel, rewritten with the positions
+	{
+		vbDensity_[0] = new VertexBuffer( NULL, DENSITY_SIZE * DENSITY_SIZE * sizeof( float4 ) );
+		vbDensity_[1] = new VertexBuffer( NULL, DENSITY_SIZE * DENSITY_SIZE * sizeof( uchar4 ) );
+		vaDensity_.addBuffer( *vbDensity_[0], layout );
+		vaDensity_.addBuffer( *vbDensity_[1], color, 1 );
+		vaDensity_.unbind();
+		vbDensity_[1]->unbind();
+		for ( int i = 0; i < 2; i++ )
+			vbDensityResource_[i] = device_->registerGLBuffer( *vbDensity_[i], cudaGraphicsRegisterFlagsWriteDiscard );
+	}
 
-	// shark buffer
-	h_shark_data.push_back(5.0f);
-	h_shark_data.push_back(5.0f);
-	h_shark_data.push_back(5.0f);
-	h_shark_data.push_back(1.0f);
+	if ( depthSort_ )															// Slots in draw order, rewritten every frame
+	{
+		ibDepth_ = new VertexBuffer( NULL, numParticles_ * sizeof( unsigned int ) );
+		ibDepth_->unbind();
+		ibDepthResource_ = device_->registerGLBuffer( *ibDepth_, cudaGraphicsRegisterFlagsWriteDiscard );
+	}
 
-	// shark color
-	h_shark_color.push_back(0.8f);
-	h_shark_color.push_back(0.8f);
-	h_shark_color.push_back(0.8f);
-	h_shark_color.push_back(1.0f);
+	if ( trailLength_ > 0 )														// Ring buffers by id, the shader reads them as texture buffers
+	{
+		size_t entries = static_cast< size_t >( trailLength_ ) * numParticles_;
+		std::vector<int> trailResources;
+		for ( int i = 0; i < 3; i++ )
+		{
+			vbTrail_[i] = new VertexBuffer( NULL, entries * sizeof( __half ) );
+			vbTrail_[i]->unbind();
+			vbTrailResource_[i] = device_->registerGLBuffer( *vbTrail_[i] );	// Appended in place, the other entries stay
+			trailResources.push_back( vbTrailResource_[i] );
+
+			glGenTextures( 1, &trailTextures_[i] );
+			glBindTexture( GL_TEXTURE_BUFFER, trailTextures_[i] );
+			glTexBuffer( GL_TEXTURE_BUFFER, GL_R16F, vbTrail_[i]->getBufferID() );
+		}
+		glBindTexture( GL_TEXTURE_BUFFER, 0 );
 
-	VertexBuffer vbShark(h_shark_data.data(), NUM_SHARKS * 4 * sizeof(float));	// Shark Position VBO
-	VertexBuffer vbSharkC(h_shark_color.data(), NUM_SHARKS * 4 * sizeof(float));// Shark Color VBO
+		device_->mapResources( trailResources, stream_ );
+		for ( int i = 0; i < 3; i++ )
+		{
+			void* trail;
+			size_t numBytes;
+			device_->getMappedPointer( &trail, &numBytes, vbTrailResource_[i] );
+			CUDA_CHECK( cudaMemsetAsync( trail, 0xFF, numBytes, stream_ ) );	// NaN: no trail until the first append
+		}
+		device_->unmapResources( stream_ );
+
+		trailShader_.bind();
+		trailShader_.setUniform1i( "u_trail_x", 0 );							// Texture units of drawTrails
+		trailShader_.setUniform1i( "u_trail_y", 1 );
+		trailShader_.setUniform1i( "u_trail_z", 2 );
+		trailShader_.setUniform1i( "u_fishies", static_cast< int >( numParticles_ ) );
+		trailShader_.setUniform1i( "u_length", static_cast< int >( trailLength_ ) );
+		trailHeadLocation_ = trailShader_.getUniformHandle( "u_head" );
+		trailShader_.unbind();
+	}
 
-	vaShark.addBuffer(vbShark, layout);											// Add Position VBO to VAO
-	vaShark.addBuffer(vbSharkC, layout.getElements()[0], 1);					// Add Color VBO to VAO
+	std::vector<float> h_shark_data( numSharks_ * 4 );							// Host copies only live until the upload
+	std::vector<float> h_shark_color;
+	CUDA_CHECK( cudaMemcpy( h_shark_data.data(), simulation_->getSharks(), numSharks_ * sizeof( float4 ), cudaMemcpyDeviceToHost ) );	// Sharks spawned by the simulation
+
+	for ( unsigned int i = 0; i < numSharks_; i++ )								// shark color
+	{
+		h_shark_color.push_back( 0.8f );
+		h_shark_color.push_back( 0.8f );
+		h_shark_color.push_back( 0.8f );
+		h_shark_color.push_back( 1.0f );
+	}
+
+	vbShark_ = createSharedBuffer( h_shark_data.data(), numSharks_ * 4 * sizeof( float ), vbSharkExternal_ );	// Shark Position VBO. Stays alive, CUDA writes the new positions into it.
+	vbSharkC_ = new VertexBuffer(h_shark_color.data(), numSharks_ * 4 * sizeof(float));	// Shark Color VBO
+
+	vaShark.addBuffer(*vbShark_, layout);										// Add Position VBO to VAO
+	vaShark.addBuffer(*vbSharkC_, layout.getElements()[0], 1);					// Add Color VBO to VAO
 
 	vaShark.unbind();															// Unbind VAO while unused.
-	vbShark.unbind();															// Unbind VBO. Unused now.
-	vbSharkC.unbind();															// Unbind VBO. Unused now.
+	vbShark_->unbind();															// Unbind VBO. Unused now.
+	vbSharkC_->unbind();														// Unbind VBO. Unused now.
+
+	if ( vbSharkExternal_ < 0 )
+		vbSharkResource_ = device_->registerGLBuffer( *vbShark_, cudaGraphicsRegisterFlagsWriteDiscard );	// CUDA: register shark buffer object
+	if ( stateColors_ )															// The fear colors fetch the sharks of the frame
+	{
+		glGenTextures( 1, &sharkTexture_ );
+		glBindTexture( GL_TEXTURE_BUFFER, sharkTexture_ );
+		glTexBuffer( GL_TEXTURE_BUFFER, GL_RGBA32F, vbShark_->getBufferID() );
+		glBindTexture( GL_TEXTURE_BUFFER, 0 );
+	}
+
+	if ( overlay_ )																// Written by the CPU every frame, never reallocated
+	{
+		for ( int i = 0; i < 2; i++ )
+		{
+			vbOverlay_[i] = new StreamingVertexBuffer( OVERLAY_POINTS * 4 * sizeof( float ) );
+			vaOverlay_.addBuffer( *vbOverlay_[i], layout.getElements()[0], i );
+		}
+		vaOverlay_.unbind();
+		vbOverlay_[1]->unbind();
+	}
+
+	mapList_.reserve( 16 );														// More than any frame maps
+	std::cout << memoryReport();												// Device budget after all buffers of the scene exist
+}
+
+VertexBuffer* Renderer::createSharedBuffer( const void* data, unsigned int size, int& external )
+{
+	external = interop_->createBuffer( size );
+	if ( external < 0 )
+		return new VertexBuffer( data, size );
+
+	VertexBuffer* buffer = new ExternalVertexBuffer( interop_->getMemoryObject( external ), size );
+	interop_->addGLBuffer( buffer->getBufferID() );
+	if ( data != NULL )
+		CUDA_CHECK( cudaMemcpy( interop_->getDevicePointer( external ), data, size, cudaMemcpyHostToDevice ) );	// Before the first draw, nothing to order
+	return buffer;
 }
 
-void Renderer::runCuda()
+void* Renderer::sharedPointer( int resource, int external )
 {
+	if ( external >= 0 )
+		return interop_->getDevicePointer( external );
+	if ( peer_->isEnabled() )
+		return peer_->stage( resource );										// Copied into the VBO by unmap
+	if ( pipeline_->isEnabled() )
+		return pipeline_->stage( resource );									// Copied into the VBO with the next frame
+
+	void* pointer;
+	size_t numBytes;
+	device_->getMappedPointer( &pointer, &numBytes, resource );
+	return pointer;
+}
+
+void Renderer::runCuda( unsigned int steps )
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "Renderer::runCuda", NVTX_COLOR_SIMULATION );
+
+	pipeline_->present( stream_ );												// The packs of the last frame, drawn in this one
+	if ( steps == 0 )															// Rendering runs ahead, draw the last step again
+		return;
+
+	simulation_->updateGridBounds();											// Grid follows the swarm, stats of the last frame
+	fishSteps_ += static_cast< double >( simulation_->getLiveCount() ) * steps;	// Fishies of the advance, before a compaction
+
+	profiler_.tagFrame( selector_.frameTag( steps ) );							// The selector assigns the advance time to the search
+	{
+		ScopedCudaTimer timer( profiler_, FrameStage::ADVANCE, stream_ );
+		if ( multi_ != NULL )
+		{
+			for ( unsigned int i = 0; i < steps && multi_->step(); i++ )
+				;
+			simulation_->setLiveCount( multi_->gather( simulation_->getParticles(), simulation_->getSharks(), stream_ ) );	// Fishies of all GPUs for the VBO
+		}
+		else
+			simulation_->advance( steps );										// One graph launch for all steps, if possible
+	}
+	colorsDirty_ |= simulation_->takeSlotsMoved();								// Compaction, reorder or exchange moved fishies
+
 	float4* vboPtr;
+	float4* sharkPtr = NULL;
 	size_t numBytes;
 
-	device_.mapResources();														// Map Position VBO with CUDA.
-	device_.getMappedPointer( ( void** ) &vboPtr, &numBytes );					// Get Pointer to memory.
+	std::vector<int>& resources = mapList_;
+	resources.clear();
+	bool const sharkBuffer = !agents_ || sharkTexture_ != 0;					// Else only the copy behind the fishies is read
+	if ( sharkBuffer && vbSharkExternal_ < 0 )
+		resources.push_back( vbSharkResource_ );
+	bool const writeDirections = vbDir_ != NULL && ( instanced_ || colorMode_ == ColorMode::SPEED );	// The other color modes need no speed
+	if ( !culling_ )															// The culling pass writes its own buffers
+	{
+		previousValid_ = interpolate_ && steps == 1 && !colorsDirty_;			// Same slots in both buffers, one step apart
+		drawn_ = 1 - drawn_;													// The other buffer keeps the last pack
+		if ( pullShader_ == NULL && vbExternal_[drawn_] < 0 )
+			resources.push_back( vbResource_[drawn_] );
+		if ( colorsDirty_ && vbCExternal_ < 0 )
+			resources.push_back( vbCResource_ );
+		if ( writeDirections )
+			resources.push_back( vbDirResource_ );
+	}
+	if ( density_ )
+		resources.insert( resources.end(), vbDensityResource_, vbDensityResource_ + 2 );
+	bool appendTrail = trailLength_ > 0 && ( stepsSinceTrail_ += steps ) >= trailEvery_;
+	if ( appendTrail )
+		resources.insert( resources.end(), vbTrailResource_, vbTrailResource_ + 3 );
+	{
+		ScopedCudaTimer timer( profiler_, FrameStage::MAP, stream_ );
+		if ( peer_->isEnabled() )
+			peer_->map( resources, stream_ );									// Mapped on the display GPU, written through staging buffers
+		else if ( !pipeline_->isEnabled() )										// The pipeline packs into its back buffers
+			device_->mapResources( resources, stream_ );						// Map only the VBOs written in this frame with CUDA.
+		interop_->acquire( stream_ );											// The shared ones wait for the draws so far instead
+	}
+	if ( sharkBuffer )
+		sharkPtr = static_cast< float4* >( sharedPointer( vbSharkResource_, vbSharkExternal_ ) );	// Get Pointer to memory.
 
-	void* data = d_state->getData();											// Get Pointer to states
+	bool statsPacked = false;
+	profiler_.beginCuda( FrameStage::PACK, stream_ );
+	if ( !culling_ )
+	{
+		if ( colorsDirty_ )															// Colors follow the fishies into their new slots
+		{
+			uchar4* colorPtr = static_cast< uchar4* >( sharedPointer( vbCResource_, vbCExternal_ ) );
+			kernel_pack_colors( simulation_->getParticles().id, simulation_->getColors(), colorPtr, simulation_->getLiveCount(),
+				colorMode_ == ColorMode::SCHOOL ? schools_ : 0, stream_ );
+			colorsDirty_ = false;
+		}
 
-	// Call Kernel
-	kernel_advance(
-		vboPtr,
-		static_cast<float4*>(data),
-		NUM_PARTICLES,
-		speed,
-		swarmCenter,
-		Vector3(h_shark_data[0], h_shark_data[1], h_shark_data[2]));
+		float4* directionPtr = NULL;
+		if ( writeDirections )
+			directionPtr = static_cast< float4* >( sharedPointer( vbDirResource_, -1 ) );
 
-	device_.unmapResources();													// Unmap Resources while unused.
+		if ( pullShader_ == NULL )												// Vertex pulling: the shader reads the stores, nothing to pack
+		{
+			vboPtr = static_cast< float4* >( sharedPointer( vbResource_[drawn_], vbExternal_[drawn_] ) );
+			simulation_->packWithStats( vboPtr, directionPtr );					// Write positions (and directions) of the last step into VBOs, stats in the same pass
+			statsPacked = true;
+			if ( agents_ )
+				CUDA_CHECK( cudaMemcpyAsync( vboPtr + numParticles_, simulation_->getSharks(), numSharks_ * sizeof( float4 ), cudaMemcpyDeviceToDevice, stream_ ) );	// Sharks behind the fishies, drawn with them
+		}
+	}
+	if ( sharkBuffer )
+		CUDA_CHECK( cudaMemcpyAsync( sharkPtr, simulation_->getSharks(), numSharks_ * sizeof( float4 ), cudaMemcpyDeviceToDevice, stream_ ) );	// Write shark positions into VBO
+	if ( density_ )
+	{
+		float4* densityPtr;
+		uchar4* densityColorPtr;
+		device_->getMappedPointer( ( void** ) &densityPtr, &numBytes, vbDensityResource_[0] );
+		device_->getMappedPointer( ( void** ) &densityColorPtr, &numBytes, vbDensityResource_[1] );
+		kernel_density( simulation_->getParticles(), simulation_->getLiveCount(), densityPtr, densityColorPtr, stream_ );	// Splat the fishies of the last step
+	}
+	if ( appendTrail )
+	{
+		__half* trail[3];
+		for ( int i = 0; i < 3; i++ )
+			device_->getMappedPointer( ( void** ) &trail[i], &numBytes, vbTrailResource_[i] );
+		stepsSinceTrail_ = 0;
+		trailHead_ = ( trailHead_ + 1 ) % trailLength_;
+		float maxJump = 8.0f * simulation_->getSpeed() * trailEvery_;			// Faster than any fish: eaten and respawned
+		kernel_append_trail( simulation_->getParticles(), simulation_->getLiveCount(), trail[0], trail[1], trail[2],
+			numParticles_, trailLength_, trailHead_, maxJump, stream_ );
+	}
+	profiler_.endCuda( FrameStage::PACK, stream_ );
+
+	{
+		ScopedCudaTimer timer( profiler_, FrameStage::UNMAP, stream_ );
+		interop_->release( stream_ );											// The next draws wait for the writes
+		if ( peer_->isEnabled() )
+			peer_->unmap( stream_ );											// Peer to peer copies, then the unmap on the display GPU
+		else if ( pipeline_->isEnabled() )
+			pipeline_->finish( stream_ );										// Copied into the VBOs with the next frame
+		else
+			device_->unmapResources( stream_ );									// Unmap Resources while unused.
+	}
+
+	if ( !statsPacked )
+		simulation_->requestStats();											// Centroid, bounding box, ... of this frame. No wait, read by getStats later
+	statsRing_->record( simulation_->getParticles(), simulation_->getLiveCount(), kernel_get_random_step(), stream_ );	// Behind the stats of this frame
+
+	trajectory_.record( simulation_->getParticles(), simulation_->getLiveCount(), kernel_get_random_step(), stream_ );	// Step: number of advances
+	export_->publish( simulation_->getParticles(), simulation_->getLiveCount(), kernel_get_random_step(), stream_ );
+	if ( events_ != NULL )
+		events_->drain();														// Events of the last frame, after all steps of this one
+	CUDA_CHECK_FRAME( stream_ );													// Errors of the finished frames, without waiting
 }
 
-void Renderer::moveSwarmCenter()
+void Renderer::cullFishies( const glm::mat4& modelView, const glm::mat4& projection )
 {
-	Vector3 diff = waypointList->get() - swarmCenter;							// Get Next Swarm center
-	if (diff.length() < WAYPOINT_THRESHOLD)										// Check if center was reached
+	NVTX_RANGE( NvtxDomain::RENDERER, "Renderer::cullFishies", NVTX_COLOR_INTEROP );
+
+	// Frustum planes of projection * modelView (Gribb, Hartmann), in the model space of the fishies.
+	glm::mat4 const mvp = projection * modelView;
+	CullParams params;
+	for ( int i = 0; i < 6; i++ )
 	{
-		diff = waypointList->getNext() - swarmCenter;
+		int axis = i / 2;
+		float sign = i % 2 == 0 ? 1.0f : -1.0f;
+		glm::vec4 plane( mvp[0][3] + sign * mvp[0][axis], mvp[1][3] + sign * mvp[1][axis], mvp[2][3] + sign * mvp[2][axis], mvp[3][3] + sign * mvp[3][axis] );
+		plane /= glm::length( glm::vec3( plane ) );
+		for ( int c = 0; c < 4; c++ )
+			params.planes[i][c] = plane[c];
 	}
+	glm::vec4 const eye = glm::inverse( modelView ) * glm::vec4( 0.0f, 0.0f, 0.0f, 1.0f );
+	params.eyeX = eye.x;
+	params.eyeY = eye.y;
+	params.eyeZ = eye.z;
+	params.radius = FISH_SIZE;													// Mesh reaches from +1 to -1 fish sizes
+	params.lodDistance = instanced_ ? lodDistance_ : 0.0f;
+	params.clusterDistance = clusterDistance_;
+	params.clusterCellSize = clusterCellSize_;
+
+	mapList_.assign( vbCullResource_, vbCullResource_ + ( instanced_ ? 3 : 2 ) );
+	mapList_.push_back( vbIndirectResource_ );
+	if ( clusterDistance_ > 0.0f )
+		mapList_.insert( mapList_.end(), vbClustersResource_, vbClustersResource_ + 2 );
+	device_->mapResources( mapList_, stream_ );
+
+	float4* buffers[3] = {};
+	DrawCommand* commands;
+	size_t numBytes;
+	for ( int i = 0; i < ( instanced_ ? 3 : 2 ); i++ )
+		device_->getMappedPointer( ( void** ) &buffers[i], &numBytes, vbCullResource_[i] );
+	device_->getMappedPointer( ( void** ) &commands, &numBytes, vbIndirectResource_ );
+	float4* clusters = NULL;
+	uchar4* clusterColors = NULL;
+	if ( clusterDistance_ > 0.0f )
+	{
+		device_->getMappedPointer( ( void** ) &clusters, &numBytes, vbClustersResource_[0] );
+		device_->getMappedPointer( ( void** ) &clusterColors, &numBytes, vbClustersResource_[1] );
+	}
+
+	kernel_cull( simulation_->getParticles(), simulation_->getLiveCount(), simulation_->getColors(), params,
+		buffers[0], buffers[2], reinterpret_cast<uchar4*>( buffers[1] ), numParticles_, d_cullCounts.getData(), commands, FISH_MESH_VERTICES,
+		cullSchools_, clusters, clusterColors, stream_ );
+	device_->unmapResources( stream_ );
+}
 
-	diff = diff.normalized() * speed;
-	swarmCenter += diff;
+void Renderer::drawClusters()
+{
+	GLint viewport[4];
+	glGetIntegerv( GL_VIEWPORT, viewport );										// Of the scene target, if there is one
+	clusterShader_.bind();
+	clusterShader_.setUniform1f( clusterViewportLocation_, static_cast< float >( viewport[3] ) );
+	glDepthMask( GL_FALSE );													// Soft splats: tested against the meshes, but hide nothing
+	vaClusters_.bind();
+	glDrawArraysIndirect( GL_POINTS, reinterpret_cast< const void* >( 2 * cullSchools_ * sizeof( DrawCommand ) ) );	// Far schools as cluster impostors
+	vaClusters_.unbind();
+	glDepthMask( GL_TRUE );
+	shader_.bind();
 }
 
-void Renderer::moveShark()
+void Renderer::sortFishies( const glm::mat4& modelView )
 {
-	Vector3 shark_data = { h_shark_data[0], h_shark_data[1], h_shark_data[2] };
-	Vector3 shark_state = { h_shark_state[0], h_shark_state[1], h_shark_state[2] };
-	Vector3 diff = swarmCenter - shark_data;
-
-	// turn back to swarm
-	if (diff.length() > 4.0)
-	{
-		diff = diff.normalized() * speed * 0.2;
-		shark_state.x += diff.x;
-		shark_state.y += diff.y;
-		shark_state.z += diff.z;
-		if (shark_state.length() > speed * 1.3)
+	NVTX_RANGE( NvtxDomain::RENDERER, "Renderer::sortFishies", NVTX_COLOR_INTEROP );
+
+	float4 const depthRow = make_float4( modelView[0][2], modelView[1][2], modelView[2][2], modelView[3][2] );	// View space z of a position
+
+	mapList_.assign( 1, ibDepthResource_ );
+	device_->mapResources( mapList_, stream_ );
+	unsigned int* indices;
+	size_t numBytes;
+	device_->getMappedPointer( ( void** ) &indices, &numBytes, ibDepthResource_ );
+	kernel_depth_sort( simulation_->getParticles(), simulation_->getLiveCount(), depthRow, indices, stream_, impostors_ );	// Opaque spheres front to back for the early depth test
+	device_->unmapResources( stream_ );
+}
+
+void Renderer::holdParticles()
+{
+	device_->holdResources( particleResources_, stream_ );
+	for ( unsigned int store = 0; store < 2; store++ )
+	{
+		void* arrays[PULLED_ARRAYS];
+		size_t numBytes;
+		for ( unsigned int a = 0; a < PULLED_ARRAYS; a++ )
+			device_->getMappedPointer( &arrays[a], &numBytes, particleResources_[store * PULLED_ARRAYS + a] );
+		simulation_->attachPositions( store, static_cast< float* >( arrays[0] ), static_cast< float* >( arrays[1] ),
+			static_cast< float* >( arrays[2] ), static_cast< unsigned char* >( arrays[3] ) );
+		simulation_->attachSpeeds( store, static_cast< float* >( arrays[4] ), static_cast< float* >( arrays[5] ), static_cast< float* >( arrays[6] ) );
+	}
+}
+
+void Renderer::drawPulledFishies()
+{
+	device_->releaseResources( stream_ );										// OpenGL waits for the steps before
+	pullShader_->bind();
+	pullShader_->setUniform1f( pullPointSizeLocation_, 4.0f * pixelScale_ );
+	setFishColors( *pullShader_, pullColorModeLocation_, true );
+	unsigned int const store = simulation_->getCurrentStore();
+	for ( unsigned int a = 0; a < PULLED_ARRAYS; a++ )
+		glBindBufferBase( GL_SHADER_STORAGE_BUFFER, a, vbParticles_[store][a]->getBufferID() );	// x, y, z, alive and speeds, by gl_VertexID
+
+	vaPull_.bind();
+	if ( depthSort_ )
+	{
+		glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibDepth_->getBufferID() );		// Stored in the VAO, the slot is gl_VertexID
+		glDrawElements( GL_POINTS, simulation_->getLiveCount(), GL_UNSIGNED_INT, reinterpret_cast< const void* >( 0 ) );
+	}
+	else
+		glDrawArrays( GL_POINTS, 0, simulation_->getLiveCount() );
+	vaPull_.unbind();
+	setFishColors( *pullShader_, pullColorModeLocation_, false );
+	shader_.bind();
+	holdParticles();															// The next steps wait for the draw
+}
+
+void Renderer::drawScene( float lag )
+{
+	shader_.setUniform1f( pointSizeLocation_, 4.0f * pixelScale_ );
+	if ( culling_ )																// Counts and offsets are on the GPU, no read back
+	{
+		glBindBuffer( GL_DRAW_INDIRECT_BUFFER, vbIndirect_->getBufferID() );
+		if ( instanced_ )
 		{
-			shark_state = shark_state.normalized() * speed * 1.3;
+			fishShader_.bind();
+			vaCullMesh_.bind();
+			if ( cullSchools_ > 1 )
+				glMultiDrawArraysIndirect( GL_TRIANGLES, reinterpret_cast< const void* >( 0 ), cullSchools_, 0 );	// Close fishies as meshes, one command per school
+			else
+				glDrawArraysIndirect( GL_TRIANGLES, reinterpret_cast< const void* >( 0 ) );	// Close fishies as meshes
+			vaCullMesh_.unbind();
+			shader_.bind();
 		}
+		beginFishPoints( 0.0f );
+		vaCullPoints_.bind();
+		if ( cullSchools_ > 1 )
+		{
+			bool const drawData = !impostors_;									// Impostors have a shader without the block
+			if ( drawData )
+				shader_.setUniform1i( schoolDrawsLocation_, 1 );
+			glMultiDrawArraysIndirect( GL_POINTS, reinterpret_cast< const void* >( cullSchools_ * sizeof( DrawCommand ) ), cullSchools_, 0 );	// Far fishies as points, one command per school
+			if ( drawData )
+				shader_.setUniform1i( schoolDrawsLocation_, 0 );
+		}
+		else
+			glDrawArraysIndirect( GL_POINTS, reinterpret_cast< const void* >( sizeof( DrawCommand ) ) );	// Far fishies as points
+		vaCullPoints_.unbind();
+		endFishPoints();
+		if ( clusterDistance_ > 0.0f )
+			drawClusters();
+		glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
 	}
-	// swim through swarm or leave it
+	else if ( instanced_ )
+	{
+		fishShader_.bind();
+		vaFish_[drawn_].bind();													// Bind VAO of the buffer with the new positions
+		glDrawArraysInstanced( GL_TRIANGLES, 0, FISH_MESH_VERTICES, simulation_->getLiveCount() );	// One mesh per live fish, no discard
+		vaFish_[drawn_].unbind();
+		shader_.bind();															// Back to points for the sharks
+	}
+	else if ( pullShader_ != NULL )
+		drawPulledFishies();
 	else
 	{
-		if (shark_state.length() < speed * 3)
+		beginFishPoints( lag );
+		va_[drawn_].bind();														// Bind VAO of the buffer with the new positions
+		if ( depthSort_ )
+		{
+			glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ibDepth_->getBufferID() );	// Stored in the VAO
+			glDrawElements( GL_POINTS, simulation_->getLiveCount(), GL_UNSIGNED_INT, reinterpret_cast< const void* >( 0 ) );	// Back to front, impostors front to back
+		}
+		else if ( agents_ )														// Live fishies and all sharks, the size comes with the type
 		{
-			shark_state.x *= 1.1;
-			shark_state.y *= 1.1;
-			shark_state.z *= 1.1;
+			GLint const first[2] = { 0, static_cast< GLint >( numParticles_ ) };
+			GLsizei const count[2] = { static_cast< GLsizei >( simulation_->getLiveCount() ), static_cast< GLsizei >( numSharks_ ) };
+			glMultiDrawArrays( GL_POINTS, first, count, 2 );
 		}
+		else
+			glDrawArrays( GL_POINTS, 0, simulation_->getLiveCount() );			// Draw live particles
+		va_[drawn_].unbind();													// Unbind, because only on VAO can be active.
+		endFishPoints();
 	}
 
-	h_shark_data[0] += shark_state.x;
-	h_shark_data[1] += shark_state.y;
-	h_shark_data[2] += shark_state.z;
-	h_shark_state[0] = shark_state.x;
-	h_shark_state[1] = shark_state.y;
-	h_shark_state[2] = shark_state.z;
+	if ( trailDrawn_ > 1 )														// A strip needs two entries
+		drawTrails();
+
+	if ( density_ )
+	{
+		vaDensity_.bind();
+		shader_.setUniform1f( pointSizeLocation_, 6.0f * pixelScale_ );			// Texels touch each other in the default view
+		glDrawArrays( GL_POINTS, 0, DENSITY_SIZE * DENSITY_SIZE );
+		vaDensity_.unbind();
+	}
+
+	/*
+	 * Draw Shark
+	 */
+	if ( agents_ )																// Drawn with the fishies
+		return;
+	vaShark.bind();																// Bind shark VAO
+	shader_.setUniform1f( pointSizeLocation_, 4.0f * SHARK_POINT_SCALE * pixelScale_ );	// Set Point Size bigger than fishies
+	glDrawArrays(GL_POINTS, 0, numSharks_);										// Draw sharks
+	vaShark.unbind();															// Unbind, because only on VAO can be active.
 }
 
-void Renderer::render()
+void Renderer::drawSharkViews( const glm::mat4& model, float lag )
 {
+	NVTX_RANGE( NvtxDomain::RENDERER, "Renderer::drawSharkViews", NVTX_COLOR_FRAME );
+
+	const SharkPositions& sharks = sharkMailbox_->value();						// Zero until the first read back arrived
+	GLint viewport[4];
+	glGetIntegerv( GL_VIEWPORT, viewport );										// Of the scene target, if there is one
+	GLsizei const width = viewport[2] / MAX_SHARK_VIEWS;
+	GLsizei const height = viewport[3] / MAX_SHARK_VIEWS;
+	if ( width == 0 || height == 0 )
+		return;
 
-	// Enable V-Sync in Code directly
-	if ( !shouldUpdate() )
+	glEnable( GL_SCISSOR_TEST );												// The clear of a view stays in its rectangle
+	for ( unsigned int i = 0; i < sharkViews_; i++ )
+	{
+		GLint const x = viewport[0] + viewport[2] - static_cast< GLint >( ( i + 1 ) * width );	// Right to left along the top edge
+		GLint const y = viewport[1] + viewport[3] - height;
+		glViewport( x, y, width, height );
+		glScissor( x, y, width, height );
+		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+
+		float4 const& shark = sharks.positions[i];
+		glm::vec4 const eye = model * glm::vec4( shark.x, shark.y, shark.z + SHARK_VIEW_DISTANCE, 1.0f );	// Behind the shark, looking along -z at it
+		Camera camera( CameraType::PERSPECTIVE, eye );
+		camera.setDistancePlanes( 1.0f, 10000.0f );								// Same planes as the camera of the window
+		camera.setWindowSize( static_cast< GLfloat >( width ), static_cast< GLfloat >( height ) );
+
+		FrameUniforms uniforms = {};
+		uniforms.model = model;
+		uniforms.view = camera.viewMatrix();
+		uniforms.projection = camera.projectionMatrix();
+		uniforms.fishSize = FISH_SIZE;
+		frameUniforms_->upload( &uniforms );									// Draws of the views before keep their block
+
+		if ( culling_ )
+			cullFishies( uniforms.view * model, uniforms.projection );			// Into the same buffers, the map waits for the draws before
+		else if ( depthSort_ )
+			sortFishies( uniforms.view * model );
+		drawScene( lag );
+	}
+	glDisable( GL_SCISSOR_TEST );
+	glViewport( viewport[0], viewport[1], viewport[2], viewport[3] );
+}
+
+void Renderer::readSharks()
+{
+	if ( sharkMailbox_ == NULL )
 		return;
 
-	prepare();
+	sharkMailbox_->poll();														// Positions of an earlier frame, no wait
+	CUDA_CHECK( cudaMemcpyAsync( sharkMailbox_->slot(), simulation_->getSharks(), sharkViews_ * sizeof( float4 ), cudaMemcpyDefault, stream_ ) );	// Over the bus into the mapped slot
+	sharkMailbox_->post( stream_ );
+}
+
+void Renderer::pickFish( const glm::mat4& modelView, const glm::mat4& projection )
+{
+	Window* window = Window::getInstance();
+	if ( pickMailbox_->poll() )													// Hit of an earlier click, no wait
+	{
+		const PickResult& pick = pickMailbox_->value();
+		picked_ = pick.id != PICK_NONE;
+		if ( picked_ )
+			std::cout << "Picked fish:                      " << pick.id << " at (" << pick.position.x << ", " << pick.position.y << ", "
+				<< pick.position.z << "), speed " << pick.velocity.w << ", depth " << pick.depth << std::endl;
+		else
+			std::cout << "Picked fish:                      none" << std::endl;
+	}
+
+	Window::CursorPosition click;
+	if ( !window->consumeClick( click ) || window->getWidth() == 0 || window->getHeight() == 0 )
+		return;
+
+	// Cursor to normalized device coordinates, then back through the matrices onto the near and far plane
+	float const x = 2.0f * static_cast< float >( click.x ) / window->getWidth() - 1.0f;
+	float const y = 1.0f - 2.0f * static_cast< float >( click.y ) / window->getHeight();
+	glm::mat4 const unproject = glm::inverse( projection * modelView );
+	glm::vec4 nearPoint = unproject * glm::vec4( x, y, -1.0f, 1.0f );
+	glm::vec4 farPoint = unproject * glm::vec4( x, y, 1.0f, 1.0f );
+	nearPoint /= nearPoint.w;
+	farPoint /= farPoint.w;
+	glm::vec3 const ray = glm::vec3( farPoint - nearPoint );
+	float const length = glm::length( ray );
+	if ( !( length > 0.0f ) )
+		return;
+
+	glm::vec3 const direction = ray / length;
+	kernel_pick( simulation_->getParticles(), simulation_->getLiveCount(), Vector3( nearPoint.x, nearPoint.y, nearPoint.z ),
+		Vector3( direction.x, direction.y, direction.z ), length, PICK_RADIUS, pickMailbox_->slot(), stream_ );
+	pickMailbox_->post( stream_ );
+}
+
+void Renderer::drawOverlay()
+{
+	Vector3 const swarmCenter = simulation_->getSwarmCenter();
+	Vector3 const waypoint = simulation_->getWaypoint();
+	float const positions[OVERLAY_POINTS * 4] = { swarmCenter.x, swarmCenter.y, swarmCenter.z, 1.0f, waypoint.x, waypoint.y, waypoint.z, 1.0f };
+	float const colors[OVERLAY_POINTS * 4] = { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.2f, 0.2f, 1.0f };
+	float const* const data[2] = { positions, colors };
+	for ( int i = 0; i < 2; i++ )
+	{
+		std::memcpy( vbOverlay_[i]->beginWrite(), data[i], sizeof( positions ) );
+		vbOverlay_[i]->commit();
+	}
+
+	vaOverlay_.bind();
+	shader_.setUniform1f( pointSizeLocation_, 10.0f * pixelScale_ );
+	glDrawArrays( GL_POINTS, vbOverlay_[0]->getFirstVertex( 4 * sizeof( float ) ), OVERLAY_POINTS );	// Both buffers are in the same region
+	vaOverlay_.unbind();
+}
+
+void Renderer::readStatsSeries()
+{
+	if ( !statsRing_->update( currentTime_, stream_ ) )
+		return;
+
+	const std::vector<StatsSample>& series = statsRing_->getSeries();
+	const StatsSample& newest = series.back();
+	double nearest = 0.0;
+	double speed = 0.0;
+	double polarisation = 0.0;
+	double cosines = 0.0;
+	unsigned long long sampled = 0;
+	unsigned long long aligned = 0;
+	for ( const StatsSample& sample : series )
+	{
+		nearest += sample.nearestSum;
+		sampled += sample.sampled;
+		speed += sample.stats.meanSpeed;
+		polarisation += StatsRing::polarisation( sample );
+		cosines += sample.alignmentSum;
+		aligned += sample.aligned;
+	}
+	float3 const size = make_float3( newest.stats.boundsMax.x - newest.stats.boundsMin.x, newest.stats.boundsMax.y - newest.stats.boundsMin.y,
+		newest.stats.boundsMax.z - newest.stats.boundsMin.z );
+	series_.seriesFrames = static_cast< unsigned int >( series.size() );
+	series_.nearestP50 = statsRing_->nearestPercentile( newest, 50.0f );
+	series_.nearestP95 = statsRing_->nearestPercentile( newest, 95.0f );
+	series_.nearestMean = sampled > 0 ? static_cast< float >( nearest / sampled ) : 0.0f;
+	series_.meanSpeed = static_cast< float >( speed / series.size() );
+	series_.extent = std::sqrt( size.x * size.x + size.y * size.y + size.z * size.z );
+	series_.polarisation = static_cast< float >( polarisation / series.size() );
+	series_.alignment = aligned > 0 ? static_cast< float >( cosines / aligned ) : 0.0f;
+	series_.cellDensity = StatsRing::densityMedian( newest );
+}
+
+void Renderer::publishMetrics()
+{
+	if ( !metrics_.isEnabled() || ( metricsTime_ >= 0.0 && currentTime_ - metricsTime_ < METRICS_INTERVAL ) )
+		return;
+
+	NVTX_RANGE( NvtxDomain::RENDERER, "Renderer::publishMetrics", NVTX_COLOR_FRAME );
+	const StageTimes& frames = frameTimes_.getTotal();
+	unsigned long long steps = kernel_get_random_step();						// Number of advances
+	MetricsSample sample;
+	sample.frames = frameTimes_.getFrames();
+	sample.overBudget = frameTimes_.getOverBudget();
+	sample.frameP50 = frames.percentile( 50.0f );
+	sample.frameP95 = frames.percentile( 95.0f );
+	sample.frameP99 = frames.percentile( 99.0f );
+	sample.steps = steps;
+	sample.stepsPerSecond = metricsTime_ >= 0.0 ? ( steps - metricsSteps_ ) / ( currentTime_ - metricsTime_ ) : 0.0;
+	sample.liveFishies = simulation_->getLiveCount();
+	sample.deviceBytes = trackedLiveBytes( MemorySpace::DEVICE );
+	sample.devicePeakBytes = trackedPeakBytes( MemorySpace::DEVICE );
+	sample.seriesFrames = series_.seriesFrames;
+	sample.nearestP50 = series_.nearestP50;
+	sample.nearestP95 = series_.nearestP95;
+	sample.nearestMean = series_.nearestMean;
+	sample.meanSpeed = series_.meanSpeed;
+	sample.extent = series_.extent;
+	sample.polarisation = series_.polarisation;
+	sample.alignment = series_.alignment;
+	sample.cellDensity = series_.cellDensity;
+	metrics_.publish( sample );
+	metricsTime_ = currentTime_;
+	metricsSteps_ = steps;
+}
+
+void Renderer::checkAllocations( unsigned long long before, bool reconfigured )
+{
+	if ( !countsHeapAllocations() )
+		return;
+
+	if ( reconfigured )															// Lazily created buffers of the new mode
+		steadyFrames_ = 0;
+	if ( ++steadyFrames_ <= ALLOCATION_WARMUP || allocationReports_ >= MAX_ALLOCATION_REPORTS )
+		return;
+
+	unsigned long long const heap = countedAllocations( AllocationKind::HEAP );
+	unsigned long long const device = countedAllocations( AllocationKind::DEVICE );
+	unsigned long long const pinned = countedAllocations( AllocationKind::PINNED );
+	unsigned long long const allocations = heap + device + pinned - before;
+	if ( allocations == 0 )
+		return;
+	std::cerr << "Steady frame " << frameTimes_.getFrames() << " allocated " << allocations << " times, "
+		<< heap << " heap, " << device << " device and " << pinned << " pinned calls so far" << std::endl;
+	allocationReports_++;
+}
+
+void Renderer::drawHud()
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "Renderer::drawHud", NVTX_COLOR_FRAME );
+
+	static const unsigned int MAX_LINES = static_cast< unsigned int >( FrameStage::COUNT ) + 8;
+	char lines[MAX_LINES][96];													// On the stack, the HUD doesn't allocate
+	size_t count = 0;
+	const StageTimes& frames = frameTimes_.getTotal();
+	std::snprintf( lines[count++], sizeof( lines[0] ), "frame %.2f ms  p99 %.2f ms", frames.mean(), frames.percentile( 99.0f ) );
+	size_t const graphLine = count;
+	for ( unsigned int s = 0; s < static_cast< unsigned int >( FrameStage::COUNT ); s++ )
+	{
+		FrameStage const stage = static_cast< FrameStage >( s );
+		const StageTimes& times = profiler_.getTimes( stage );
+		if ( times.count() == 0 )												// Not timed, e.g. no culling
+			continue;
+		std::snprintf( lines[count++], sizeof( lines[0] ), "%-8s %6.2f ms", frameStageName( stage ), times.mean() );
+	}
+	std::snprintf( lines[count++], sizeof( lines[0] ), "fishies %u / %u", simulation_->getStats().liveCount, numParticles_ );	// Mailbox, a frame old
+	std::snprintf( lines[count++], sizeof( lines[0] ), "search %s", searchModeName( selector_.getMode() ) );
+	if ( quality_.isEnabled() )
+		std::snprintf( lines[count++], sizeof( lines[0] ), "quality %u", static_cast< unsigned int >( quality_.getIndex() ) );
+	std::snprintf( lines[count++], sizeof( lines[0] ), "gpu %.1f mb  pinned %.1f mb", trackedLiveBytes( MemorySpace::DEVICE ) / 1048576.0,
+		trackedLiveBytes( MemorySpace::HOST ) / 1048576.0 );
+	if ( picked_ )
+	{
+		const PickResult& pick = pickMailbox_->value();
+		std::snprintf( lines[count++], sizeof( lines[0] ), "fish %u  speed %.3f", pick.id, pick.velocity.w );
+	}
+	if ( series_.seriesFrames > 0 )
+		std::snprintf( lines[count++], sizeof( lines[0] ), "nearest %.3f  p95 %.3f  (%u frames)", series_.nearestP50, series_.nearestP95,
+			series_.seriesFrames );
+	if ( series_.seriesFrames > 0 )
+		std::snprintf( lines[count++], sizeof( lines[0] ), "order %.2f  align %.2f  cell %u", series_.polarisation, series_.alignment,
+			series_.cellDensity );
+
+	float const pad = 8.0f;
+	float const graphWidth = 240.0f;
+	float const graphHeight = 48.0f;
+	float width = graphWidth;
+	for ( size_t i = 0; i < count; i++ )
+		width = std::max( width, hud_->textWidth( lines[i] ) );
+	float const height = count * hud_->lineHeight() + graphHeight + pad;
+	bool const slow = frames.count() > 0 && frames.at( frames.count() - 1 ) > frameTimes_.getBudget();	// Last frame over budget: red frame line
+
+	hud_->begin();
+	hud_->addRect( pad, pad, width + 2.0f * pad, height + pad, 0x000000, 0.6f );	// Readable over the swarm
+	float y = 2.0f * pad;
+	for ( size_t i = 0; i < count; i++ )
+	{
+		if ( i == graphLine )
+		{
+			hud_->addGraph( 2.0f * pad, y, graphWidth, graphHeight, frames, frameTimes_.getBudget(), 120 );	// Last two seconds at 60 Hz
+			y += graphHeight + pad;
+		}
+		hud_->addText( 2.0f * pad, y, lines[i], i == 0 && slow ? 0xFF6040 : 0xFFFFFF );
+		y += hud_->lineHeight();
+	}
+	hud_->end();
+}
+
+void Renderer::drawTrails()
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "Renderer::drawTrails", NVTX_COLOR_FRAME );
+
+	trailShader_.bind();
+	trailShader_.setUniform1i( trailHeadLocation_, static_cast< int >( trailHead_ ) );
+	for ( int i = 0; i < 3; i++ )
+	{
+		glActiveTexture( GL_TEXTURE0 + i );
+		glBindTexture( GL_TEXTURE_BUFFER, trailTextures_[i] );
+	}
+
+	vaTrail_.bind();
+	glDrawArraysInstanced( GL_LINE_STRIP, trailLength_ - trailDrawn_, trailDrawn_, numParticles_ );	// One strip per fish id, gl_VertexID starts at the first entry
+	vaTrail_.unbind();
+
+	for ( int i = 2; i >= 0; i-- )
+	{
+		glActiveTexture( GL_TEXTURE0 + i );
+		glBindTexture( GL_TEXTURE_BUFFER, 0 );
+	}
+	shader_.bind();
+}
 
+void Renderer::beginFishPoints( float lag )
+{
+	if ( !impostors_ )
+	{
+		shader_.setUniform1f( lagLocation_, lag );
+		setFishColors( shader_, colorModeLocation_, true );
+		return;
+	}
+
+	GLint viewport[4];
+	glGetIntegerv( GL_VIEWPORT, viewport );										// Of the scene target, if there is one
+	impostorShader_.bind();
+	impostorShader_.setUniform1f( impostorPointSizeLocation_, 4.0f * pixelScale_ );
+	impostorShader_.setUniform1f( impostorLagLocation_, lag );
+	impostorShader_.setUniform1f( impostorViewportLocation_, static_cast< float >( viewport[3] ) );
+	glDisable( GL_BLEND );														// Opaque, the depth test decides
+}
+
+void Renderer::endFishPoints()
+{
+	if ( !impostors_ )
+	{
+		shader_.setUniform1f( lagLocation_, 0.0f );								// Sharks and the rest have no previous position
+		setFishColors( shader_, colorModeLocation_, false );					// Nor a state to show
+		return;
+	}
+	glEnable( GL_BLEND );
 	shader_.bind();
-	va_.bind();
+}
+
+void Renderer::setFishColors( Shader& shader, int location, bool fishies )
+{
+	if ( !stateColors_ )
+		return;
+
+	ColorMode const mode = fishies ? colorMode_ : ColorMode::STATIC;
+	shader.setUniform1i( location, static_cast< int >( mode ) );
+	if ( mode != ColorMode::FEAR && fishies )
+		return;
+	glActiveTexture( GL_TEXTURE0 + SHARK_TEXTURE_UNIT );
+	glBindTexture( GL_TEXTURE_BUFFER, fishies ? sharkTexture_ : 0 );
+	glActiveTexture( GL_TEXTURE0 );
+}
+
+bool Renderer::updateQuality()
+{
+	double cpuMs = frameTimes_.getLast( FramePart::SIMULATION ) + frameTimes_.getLast( FramePart::RENDER );
+	double gpuMs = -1.0;
+	const FrameStage gpuStages[] = { FrameStage::MAP, FrameStage::ADVANCE, FrameStage::PACK, FrameStage::CULL, FrameStage::UNMAP, FrameStage::DRAW };
+	for ( FrameStage stage : gpuStages )
+	{
+		unsigned int tag = 0;
+		float ms = profiler_.getCollected( stage, tag );
+		if ( ms >= 0.0f )
+			gpuMs = std::max( gpuMs, 0.0 ) + ms;
+	}
+	if ( !quality_.update( cpuMs, gpuMs ) )
+		return false;
+
+	const QualityLevel& level = quality_.getLevel();
+	maxSubsteps_ = level.maxSubsteps;
+	lodDistance_ = level.lodDistance;
+	trailDrawn_ = level.trailLength;
+	if ( sceneTarget_ != NULL )
+		sceneTarget_->setScale( level.renderScale );
+	kernel_set_first_k( level.firstK );											// New graph with the next step
+	kernel_set_multi_rate( level.multiRate, multiRateShark_, multiRateFocus_ );
+	return true;
+}
 
-	moveSwarmCenter();															// Set new Swarm center
+void Renderer::render()
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "Renderer::render", NVTX_COLOR_FRAME );
+
+	// Enable V-Sync in Code directly
+	if ( !shouldUpdate() )
+		return;
 
 	Window* window = Window::getInstance();
+	jobs_.wait( statsJob_ );													// The only job of the last frame which this one needs
+	window->setTitleInfo( titleInfo_ );											// Shown with the next frame rate update
+	unsigned long long const allocations = countedAllocations();				// Of this thread, the jobs may allocate
+
 	currentTime_ = window->getCurrentTime();
+	profiler_.beginFrame();														// Collects the timers of an old frame, no waiting
+	frameTimes_.beginFrame();													// Wall time since the last frame
+
+	unsigned int tag = 0;
+	float advanceMs = profiler_.getCollected( FrameStage::ADVANCE, tag );
+	bool switchSearch = selector_.update( advanceMs, tag );						// Probe or keep the search
+	if ( window->consumeKeyPress( GLFW_KEY_N ) )								// N: next search by hand, after the last one automatic
+		switchSearch |= selector_.cycle();
+	if ( switchSearch )
+		kernel_set_search_mode( selector_.getMode() );
+	bool reconfigured = updateQuality() || switchSearch;						// Same collected frame as the selector
+
+	/*
+	 * Fixed timestep: simulate as many steps as fit into the elapsed time.
+	 * Can be more than one per frame or none, if rendering runs ahead.
+	 */
+	unsigned int steps = 0;
+	if ( window->isPaused() )													// Simulated time stands still, the accumulator keeps the interpolation
+	{
+		if ( window->consumeStep() )											// Period: one step
+			steps = 1;
+	}
+	else
+	{
+		accumulator_ += currentTime_ - getLastUpdate();
+		if ( window->isBenchmarkMode() )										// One step per frame, so the frame rate shows the kernel time
+		{
+			steps = 1;
+			accumulator_ = 0.0;
+		}
+		double stepTime = dt_ * simulation_->getStepScale();					// Adaptive step: longer steps, fewer per frame
+		while ( accumulator_ >= stepTime && steps < maxSubsteps_ )
+		{
+			accumulator_ -= stepTime;
+			steps++;
+		}
+		if ( steps == maxSubsteps_ )											// Too far behind, drop the rest
+			accumulator_ = 0.0;
+	}
+	setLastUpdate( currentTime_ );
+
+	frameTimes_.beginPart( FramePart::RENDER );
+	if ( video_ != NULL )
+		video_->beginFrame();													// Draws go into the video frame
+	if ( sceneTarget_ != NULL )
+		sceneTarget_->beginFrame();												// Into the scaled target, blitted into the video frame or the window
+	pixelScale_ = sceneTarget_ != NULL ? sceneTarget_->getScale() : 1.0f;
+	prepare();
+
+	shader_.bind();
 	Camera const camera = window->getCamera();
 
 	GLfloat const rotationAngle = static_cast< GLfloat >( 0 ) / 1000.0f * 20.0f;
@@ -262,51 +1316,216 @@ void Renderer::render()
 		0.0f, 1.0f * window->getHeight(),
 		1.f, -1.f );
 
-	shader_.setUniformMat4f( "u_model", modelMatrix );
-	shader_.setUniformMat4f( "u_view", viewMatrix );
-	shader_.setUniformMat4f( "u_projection", projectionMatrix );
-	shader_.setUniform1f( "u_pointsize", 4.0 );
+	FrameUniforms uniforms = {};
+	uniforms.model = modelMatrix;
+	uniforms.view = viewMatrix;
+	uniforms.projection = projectionMatrix;
+	uniforms.fishSize = FISH_SIZE;
 
-	
-	runCuda();																	// Run Cuda Stuff
-
-	glDrawArrays( GL_POINTS, 0, NUM_PARTICLES );								// Draw particles
-	va_.unbind();																// Unbind, because only on VAO can be active.
+	frameTimes_.endPart( FramePart::RENDER );
 
+	{
+		ScopedFramePart timer( frameTimes_, FramePart::SIMULATION );
+		glm::vec4 const eye = glm::inverse( viewMatrix * modelMatrix ) * glm::vec4( 0.0f, 0.0f, 0.0f, 1.0f );
+		kernel_set_focus( Vector3( eye.x, eye.y, eye.z ) );						// Fishies near the camera advance every step
+		runCuda( steps );														// Run Cuda Stuff
+		if ( culling_ || depthSort_ )
+		{
+			ScopedCudaTimer timer( profiler_, FrameStage::CULL, stream_ );		// Main view, the shark views cull while they draw
+			if ( culling_ )
+				cullFishies( viewMatrix * modelMatrix, projectionMatrix );		// Camera may move without steps
+			else
+				sortFishies( viewMatrix * modelMatrix );						// Same, the order depends on the camera
+		}
+		readSharks();
+		pickFish( viewMatrix * modelMatrix, projectionMatrix );					// Grid of this frame's steps
+	}
 
 	/*
-	 * Draw Shark
+	 * Interpolation: the points are drawn lag steps behind the newest step, between it and the one before.
+	 * The accumulator holds the time past the newest step, so the drawn time moves on smoothly between steps.
 	 */
-	vaShark.bind();																// Bind shark VAO
-	shader_.setUniform1f("u_pointsize", 15.0);									// Set Point Size bigger than fishies
-	moveShark();																// Calculate new shark position on CPU.
+	float lag = 0.0f;
+	if ( previousValid_ && !window->isBenchmarkMode() )							// Benchmarks draw every step as it is
+		lag = 1.0f - static_cast< float >( accumulator_ / ( dt_ * simulation_->getStepScale() ) );
 
-	VertexBuffer vbShark(h_shark_data.data(), NUM_SHARKS * 4 * sizeof(float));	// New Vertex Buffer
+	bool report = profiler_.consumeReportDue();
+	statsJob_ = jobs_.submit( [this, report]()									// Formatted while the GPU runs the steps, draw and swap
+	{
+		titleInfo_ = profiler_.summary();
+		if ( report )
+			std::cout << profiler_.report() << std::endl;						// Mean and percentiles on the console
+	} );
 
-	VertexBufferLayout layout;													// Layout for new buffer 
-	layout.push<float>(4, 0);
+	if ( lateInput_ )															// Input of the simulation time, the culling keeps the camera of the frame start
+	{
+		window->pollEvents();
+		Window::CameraState const late = window->getCameraState();
+		uniforms.view = late.view;
+		uniforms.projection = late.projection;
+	}
+	unsigned int const mainRegion = frameUniforms_->upload( &uniforms );		// Once for all draws of the main view
+
+	{
+		ScopedFramePart frameTimer( frameTimes_, FramePart::RENDER );
+		ScopedGlTimer timer( profiler_, FrameStage::DRAW );
+
+		drawScene( lag );
+		if ( overlay_ )
+			drawOverlay();														// Main view only
+		if ( sharkViews_ > 0 && sharkViewsShown_ )
+			drawSharkViews( modelMatrix, lag );
+		pipeline_->fence();														// The next present copies into the VBOs after these draws
+		if ( lateLatch_ )														// Draws the GPU hasn't started yet see the camera of now
+		{
+			window->pollEvents();
+			Window::CameraState const latched = window->getCameraState();
+			uniforms.view = latched.view;
+			uniforms.projection = latched.projection;
+			lateLatch_ = frameUniforms_->rewrite( mainRegion, &uniforms );		// Without persistent mapping once, then never again
+		}
 
-	vaShark.addBuffer(vbShark, layout);											// Push new buffer to VAO
+		if ( sceneTarget_ != NULL )
+			sceneTarget_->endFrame();											// Resolve and scale up
+	}
 
-	glDrawArrays(GL_POINTS, 0, 1);												// Draw new buffer
-	vaShark.unbind();															// Unbind, because only on VAO can be active.
+	if ( video_ != NULL )
+	{
+		ScopedFramePart timer( frameTimes_, FramePart::RENDER );
+		video_->endFrame( stream_ );											// Blit into the window and encode on the GPU
+		if ( videoFrames_ > 0 && video_->getFrames() >= videoFrames_ )
+			window->close();
+	}
+
+	if ( window->consumeKeyPress( GLFW_KEY_H ) )								// H: hide or show the HUD
+	{
+		hud_->toggle();
+		reconfigured = true;
+	}
+	if ( hud_->isShown() )
+	{
+		ScopedFramePart timer( frameTimes_, FramePart::RENDER );
+		drawHud();																// Window resolution, after the scaled scene and without the video
+	}
+
+	readStatsSeries();
+	publishMetrics();
+	checkAllocations( allocations, reconfigured );								// Before the keys and captures, which may allocate
+	capture_->endFrame( window->consumeKeyPress( GLFW_KEY_C ) );				// C: screenshot, read back some frames later
+
+	if ( window->consumeKeyPress( GLFW_KEY_V ) )								// V: hide or show the shark views
+		sharkViewsShown_ = !sharkViewsShown_;
+
+	if ( window->consumeKeyPress( GLFW_KEY_M ) && stateColors_ )				// M: next color mode
+	{
+		ColorMode const next = static_cast< ColorMode >( ( static_cast< int >( colorMode_ ) + 1 ) % 4 );
+		colorsDirty_ |= colorMode_ == ColorMode::SCHOOL || next == ColorMode::SCHOOL;	// Repacked with the next steps
+		colorMode_ = next;
+		std::cout << "Color mode:                       " << colorModeName( colorMode_ ) << std::endl;
+	}
+
+	if ( window->consumeKeyPress( GLFW_KEY_F ) )								// F: write the frame times now
+	{
+		jobs_.wait( dumpJob_ );													// One file at a time
+		std::shared_ptr<FrameTimeRecorder> frames = std::make_shared<FrameTimeRecorder>( frameTimes_ );	// The next frames are recorded meanwhile
+		std::string path = frameDump_.empty() ? "frame_times.csv" : frameDump_;
+		JobSystem::Handle print = jobs_.submit( [frames]() { std::cout << frames->report() << std::endl; } );
+		dumpJob_ = jobs_.submit( [frames, path]() { frames->dump( path ); }, { print } );	// Errors of the file after the report
+	}
 }
 
 void Renderer::cleanUp()
 {
+	delete capture_;															// Reads the last captures, before the jobs are waited for
+	capture_ = NULL;
+	jobs_.waitAll();															// Last report and dump
+	std::cout << frameTimes_.report() << std::endl;								// Tail frame times of the run
+	telemetry_->end();
+	std::cout << telemetry_->report( fishSteps_ ) << std::flush;
+	if ( !frameDump_.empty() )
+		frameTimes_.dump( frameDump_ );
+	delete telemetry_;															// After the dump, which reads its samples
+	telemetry_ = NULL;
 	
-	device_.unregisterGLBuffer();												// unregister buffer object with CUDA
+	trajectory_.finish();														// Writes the last chunk
+	delete export_;																// Removes the shared memory
+	export_ = NULL;
+	delete statsRing_;															// Waits for a read back in flight
+	statsRing_ = NULL;
+	delete events_;																// Writes the last events
+	events_ = NULL;
+	delete video_;																// Ends the stream, before the device is reset
+	video_ = NULL;
+	delete sceneTarget_;
+	sceneTarget_ = NULL;
+	delete hud_;
+	hud_ = NULL;
+	if ( multi_ != NULL )
+	{
+		multi_->cleanUp();														// Free Memory on the other GPUs
+		delete multi_;
+	}
+	device_->releaseResources( stream_ );										// Vertex pulling holds the stores
+	CUDA_CHECK( cudaStreamSynchronize( stream_ ) );								// Wait for the last frame
+	peer_->makeDisplayCurrent();
+	device_->unregisterGLBuffer();												// unregister buffer object with CUDA
+	peer_->makeComputeCurrent();
 	
 	shader_.unbind();															// Unbind Shader and VAOs
-	va_.unbind();
+	va_[drawn_].unbind();
 	vaShark.unbind();
 
-	delete d_state;																// Free GPU Memory
-	delete d_color;																// Free GPU Memory
+	for ( int i = 0; i < 2; i++ )
+	{
+		delete vb_[i];															// Delete position buffers
+	}
+	for ( int store = 0; store < 2; store++ )									// Delete the buffers of the pulled stores
+		for ( unsigned int a = 0; a < PULLED_ARRAYS; a++ )
+			delete vbParticles_[store][a];
+	delete pullShader_;
+	pullShader_ = NULL;
+	delete vbC_;																// Delete color buffer
+	delete vbAgent_;
+	delete vbShark_;															// Delete shark buffers
+	delete vbSharkC_;
+	delete frameUniforms_;
+	delete schoolDraws_;
+	delete sharkMailbox_;
+	sharkMailbox_ = NULL;
+	delete pickMailbox_;
+	pickMailbox_ = NULL;
+	delete vbMesh_;																// Delete fish mesh buffers
+	delete vbDir_;
+	for ( int i = 0; i < 3; i++ )												// Delete culling buffers
+		delete vbCull_[i];
+	delete vbIndirect_;
+	for ( int i = 0; i < 2; i++ )												// Delete cluster impostor buffers
+		delete vbClusters_[i];
+	delete ibDepth_;
+	for ( int i = 0; i < 2; i++ )
+		delete vbDensity_[i];
+	for ( int i = 0; i < 2; i++ )												// Delete overlay buffers
+		delete vbOverlay_[i];
+	for ( int i = 0; i < 3; i++ )												// Delete trail buffers
+		delete vbTrail_[i];
+	glDeleteTextures( 3, trailTextures_ );
+	glDeleteTextures( 1, &sharkTexture_ );
+	delete interop_;															// After the buffers on its memory
+	interop_ = NULL;
+	delete peer_;																// After the unregister
+	peer_ = NULL;
+	delete pipeline_;
+	pipeline_ = NULL;
+	d_cullCounts = CudaDeviceArray<unsigned int>();
+	simulation_->cleanUp();														// Free GPU Memory and uniform grid
+	delete simulation_;
+	simulation_ = NULL;
 }
 
 void Renderer::prepare()
 {
+	NVTX_RANGE( NvtxDomain::RENDERER, "Renderer::prepare", NVTX_COLOR_FRAME );
+
 	// Set the clear color
 	glClearColor( 3.0 / 255.0, 148 / 255.0, 252 / 255.0, 1.0 );					// Set Blue background
 
@@ -316,8 +1535,11 @@ void Renderer::prepare()
 bool Renderer::shouldUpdate()
 {
 	Window* window = Window::getInstance();
+	if ( window->isBenchmarkMode() || window->isPaused() )						// No frame gate in benchmark mode, paused frames are drawn on demand
+		return true;
+
 	double timeDiff = window->getCurrentTime() - getLastUpdate();
-	return timeDiff > 0.006;													// Lock to 60 FPS.
+	return timeDiff > 0.006;													// Limit render rate. Simulation rate is set by dt_.
 }
 
 double Renderer::getLastUpdate()
@@ -0,0 +1,404 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+#ifdef SWARM_NVRTC
+#include <cuda.h>
+#include <nvrtc.h>
+#endif
+
+#include "rtc_advance.h"
+
+/*
+ * Kernel source. Follows d_advanceSorted with GridSearch<0> and d_swim<0> of kernel.cu, keep them in sync.
+ * DeviceVector keeps the quirks of the original (normalized includes w), so both kernels compute the same fishies.
+ * The constants block in front of it is generated by RtcAdvance::source.
+ */
+static const char* const RTC_ADVANCE_SOURCE = R"RTC(
+#define FLT_MAX 3.402823466e+38f
+#define EMPTY_CELL 0xffffffffu
+
+struct ParticleArrays
+{
+	float* x;
+	float* y;
+	float* z;
+	float* vx;
+	float* vy;
+	float* vz;
+	float* mass;
+	unsigned char* alive;
+	unsigned int* id;
+};
+
+struct Float3 { float x, y, z; };
+struct Int3 { int x, y, z; };
+struct alignas( 16 ) Float4 { float x, y, z, w; };
+
+class DeviceVector
+{
+public:
+	float x, y, z, w;
+
+	__device__ DeviceVector() : x( 0 ), y( 0 ), z( 0 ), w( 1 ) {}
+	__device__ DeviceVector( float x, float y, float z ) : x( x ), y( y ), z( z ), w( 1 ) {}
+	__device__ DeviceVector( float x, float y, float z, float w ) : x( x ), y( y ), z( z ), w( w ) {}
+	__device__ DeviceVector( Float4 v ) : x( v.x ), y( v.y ), z( v.z ), w( v.w ) {}
+
+	__device__ float lengthSquared() const { return fmaf( x, x, fmaf( y, y, fmaf( z, z, w * w ) ) ); }
+	__device__ float length3Squared() const { return fmaf( x, x, fmaf( y, y, z * z ) ); }
+	__device__ float length3() const { return sqrtf( length3Squared() ); }
+	__device__ DeviceVector normalized() const { float inv = rsqrtf( lengthSquared() ); return DeviceVector( x * inv, y * inv, z * inv ); }
+	__device__ DeviceVector operator+( const DeviceVector& v ) const { return DeviceVector( x + v.x, y + v.y, z + v.z ); }
+	__device__ DeviceVector operator-( const DeviceVector& v ) const { return DeviceVector( x - v.x, y - v.y, z - v.z ); }
+	__device__ DeviceVector operator*( float n ) const { return DeviceVector( x * n, y * n, z * n ); }
+	__device__ void operator+=( const DeviceVector& v ) { x += v.x; y += v.y; z += v.z; }
+	__device__ void operator-=( const DeviceVector& v ) { x -= v.x; y -= v.y; z -= v.z; }
+	__device__ void operator*=( float n ) { x *= n; y *= n; z *= n; }
+};
+
+__device__ int d_wrapCell( int x, int dim )
+{
+	x %= dim;
+	return x < 0 ? x + dim : x;
+}
+
+__device__ unsigned int d_calcGridHash( int cx, int cy, int cz, Int3 dims )
+{
+	cx = d_wrapCell( cx, dims.x );
+	cy = d_wrapCell( cy, dims.y );
+	cz = d_wrapCell( cz, dims.z );
+	return ( cz * dims.y + cy ) * dims.x + cx;
+}
+
+extern "C" __global__ void __launch_bounds__( BLOCK_SIZE ) d_advance_rtc(
+	ParticleArrays out,
+	ParticleArrays sorted,
+	const unsigned int* __restrict__ gridParticleIndex,
+	const unsigned int* __restrict__ cellStart,
+	const unsigned int* __restrict__ cellEnd,
+	unsigned int mesh_count,
+	Float3 origin,
+	Int3 dims,
+	float speed,
+	Float4 center,
+	const Float4* __restrict__ sharks,
+	unsigned int shark_count,
+	ParticleArrays warm,
+	unsigned int warmCount,
+	unsigned int* nearest)
+{
+	unsigned int in_x = blockIdx.x * BLOCK_SIZE + threadIdx.x;
+	if (in_x >= mesh_count)
+		return;
+
+	DeviceVector vert( sorted.x[in_x], sorted.y[in_x], sorted.z[in_x] );
+	DeviceVector state( sorted.vx[in_x], sorted.vy[in_x], sorted.vz[in_x], sorted.mass[in_x] );
+	unsigned char alive = sorted.alive[in_x];
+	unsigned int originalIndex = gridParticleIndex[in_x];
+
+	if (alive)
+	{
+		float my_speed = speed * state.w;
+		float acceleration_factor = ACCELERATION;
+
+		DeviceVector sharkDiff;
+		float sharkDistance2 = FLT_MAX;
+		for (unsigned int i = 0; i < shark_count; i++)
+		{
+			DeviceVector d = DeviceVector( sharks[i] ) - vert;
+			float d2 = d.length3Squared();
+			if (d2 < sharkDistance2)
+			{
+				sharkDiff = d;
+				sharkDistance2 = d2;
+			}
+		}
+		float sharkDistance = sharkDistance2 < FLT_MAX ? sqrtf( sharkDistance2 ) : FLT_MAX;
+
+		if (sharkDistance < SHARK_BITE_DIST)
+			alive = 0;
+		else if (sharkDistance < SHARK_DIST * state.w)
+		{
+			sharkDiff = sharkDiff.normalized() * my_speed * acceleration_factor;
+			state -= sharkDiff;
+		}
+		else
+		{
+			// Grid search, warm started by the closest fish of the last step.
+			int cx = floorf( ( vert.x - origin.x ) / CELL_SIZE );
+			int cy = floorf( ( vert.y - origin.y ) / CELL_SIZE );
+			int cz = floorf( ( vert.z - origin.z ) / CELL_SIZE );
+			DeviceVector closest;
+			float closestDist2 = FLT_MAX;
+			unsigned int closestIndex = 0;
+
+			bool seeded = nearest != 0;
+			unsigned int slot = seeded ? originalIndex : 0;
+			unsigned int last = seeded ? nearest[slot] : ~0u;
+			float bound2 = FLT_MAX;
+			if (last < warmCount && last != slot && warm.alive[last])
+				bound2 = ( vert - DeviceVector( warm.x[last], warm.y[last], warm.z[last] ) ).length3Squared();
+			DeviceVector inCell( vert.x - ( origin.x + cx * CELL_SIZE ), vert.y - ( origin.y + cy * CELL_SIZE ), vert.z - ( origin.z + cz * CELL_SIZE ) );
+
+#pragma unroll
+			for (int n = 0; n < 27; n++)
+			{
+				if (bound2 < FLT_MAX)
+				{
+					float gapX = n % 3 == 0 ? inCell.x : n % 3 == 2 ? CELL_SIZE - inCell.x : 0.0f;
+					float gapY = n / 3 % 3 == 0 ? inCell.y : n / 3 % 3 == 2 ? CELL_SIZE - inCell.y : 0.0f;
+					float gapZ = n / 9 == 0 ? inCell.z : n / 9 == 2 ? CELL_SIZE - inCell.z : 0.0f;
+					if (gapX * gapX + gapY * gapY + gapZ * gapZ > bound2)
+						continue;
+				}
+				unsigned int hash = d_calcGridHash( cx + n % 3 - 1, cy + n / 3 % 3 - 1, cz + n / 9 - 1, dims );
+				unsigned int start = cellStart[hash];
+				if (start == EMPTY_CELL)
+					continue;
+
+				unsigned int end = cellEnd[hash];
+				for (unsigned int i = start; i < end; i++)
+				{
+					if (i == in_x)
+						continue;
+					DeviceVector d = vert - DeviceVector( sorted.x[i], sorted.y[i], sorted.z[i] );
+					float d2 = d.length3Squared();
+					if (d2 < closestDist2)
+					{
+						closest = d;
+						closestDist2 = d2;
+						closestIndex = i;
+					}
+				}
+			}
+			if (seeded && closestDist2 < FLT_MAX)
+				nearest[slot] = gridParticleIndex[closestIndex];
+			float closest_dist = closestDist2 < FLT_MAX ? sqrtf( closestDist2 ) : FLT_MAX;
+
+			DeviceVector diff = DeviceVector( center ) - vert;
+
+			if (closest_dist < FISH_DIST)
+			{
+				DeviceVector avoid = closest.normalized() * my_speed * acceleration_factor * 0.7f;
+				state -= avoid;
+				vert += state;
+				acceleration_factor /= 2;
+			}
+			if (diff.length3() > CENTER_THRESHOLD * state.w)
+			{
+				diff = diff.normalized() * my_speed * (acceleration_factor * 0.4f);
+				state += diff;
+			}
+		}
+		if (alive)
+		{
+			if (state.length3() > my_speed * 0.75f)
+				state *= 0.96f;
+			vert += state;
+		}
+	}
+
+	out.x[originalIndex] = vert.x;
+	out.y[originalIndex] = vert.y;
+	out.z[originalIndex] = vert.z;
+	out.vx[originalIndex] = state.x;
+	out.vy[originalIndex] = state.y;
+	out.vz[originalIndex] = state.z;
+	out.mass[originalIndex] = state.w;
+	out.alive[originalIndex] = alive;
+}
+)RTC";
+
+bool RtcAdvanceKey::operator==( const RtcAdvanceKey& other ) const
+{
+	return params.fishDist == other.params.fishDist && params.sharkDist == other.params.sharkDist
+		&& params.sharkBiteDist == other.params.sharkBiteDist && params.centerThreshold == other.params.centerThreshold
+		&& params.accelerationFactor == other.params.accelerationFactor && cellSize == other.cellSize && threads == other.threads;
+}
+
+std::string RtcAdvance::source( const RtcAdvanceKey& key )
+{
+	std::ostringstream source;
+	source << std::setprecision( 9 );											// Round trip of a float
+	source << "#define FISH_DIST " << key.params.fishDist << "f\n"
+		   << "#define SHARK_DIST " << key.params.sharkDist << "f\n"
+		   << "#define SHARK_BITE_DIST " << key.params.sharkBiteDist << "f\n"
+		   << "#define CENTER_THRESHOLD " << key.params.centerThreshold << "f\n"
+		   << "#define ACCELERATION " << key.params.accelerationFactor << "f\n"
+		   << "#define CELL_SIZE " << key.cellSize << "f\n"
+		   << "#define BLOCK_SIZE " << key.threads << "u\n"
+		   << RTC_ADVANCE_SOURCE;
+	return source.str();
+}
+
+#ifdef SWARM_NVRTC
+
+/*!
+ * @brief Get the file of a cached cubin.
+ * @param source kernel source.
+ * @param arch architecture, e.g. sm_86.
+ * @return path rtc_cache_<hash>.cubin. FNV-1a of source, architecture and NVRTC version.
+ */
+static std::string cubinCachePath( const std::string& source, const std::string& arch )
+{
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&hash]( const char* data, size_t length ) {
+		for ( size_t i = 0; i < length; i++ )
+			hash = ( hash ^ static_cast< unsigned char >( data[i] ) ) * 1099511628211ull;
+		hash = ( hash ^ 0xff ) * 1099511628211ull;								// Separator, "ab" + "c" != "a" + "bc"
+	};
+	int major = 0, minor = 0;
+	nvrtcVersion( &major, &minor );
+	std::string version = std::to_string( major ) + "." + std::to_string( minor );
+	add( source.data(), source.size() );
+	add( arch.data(), arch.size() );
+	add( version.data(), version.size() );
+
+	std::ostringstream path;
+	path << "rtc_cache_" << std::hex << hash << ".cubin";
+	return path.str();
+}
+
+/*!
+ * @brief Compile a source to a cubin with NVRTC.
+ * @param source kernel source.
+ * @param arch architecture, e.g. sm_86.
+ * @param cubin Output: binary.
+ * @param log stream of the compiler log.
+ * @return true on success.
+ */
+static bool compileCubin( const std::string& source, const std::string& arch, std::vector<char>& cubin, std::ostream& log )
+{
+	nvrtcProgram program;
+	if ( nvrtcCreateProgram( &program, source.c_str(), "advance_rtc.cu", 0, NULL, NULL ) != NVRTC_SUCCESS )
+		return false;
+
+	std::string archOption = "--gpu-architecture=" + arch;
+	const char* options[] = { archOption.c_str(), "--std=c++14" };
+	nvrtcResult result = nvrtcCompileProgram( program, 2, options );
+
+	size_t logSize = 0;
+	nvrtcGetProgramLogSize( program, &logSize );
+	if ( logSize > 1 )
+	{
+		std::string text( logSize, '\0' );
+		nvrtcGetProgramLog( program, &text[0] );
+		log << text << "\n";
+	}
+
+	bool compiled = result == NVRTC_SUCCESS;
+	if ( compiled )
+	{
+		size_t size = 0;
+		compiled = nvrtcGetCUBINSize( program, &size ) == NVRTC_SUCCESS && size > 0;
+		if ( compiled )
+		{
+			cubin.resize( size );
+			compiled = nvrtcGetCUBIN( program, cubin.data() ) == NVRTC_SUCCESS;
+		}
+	}
+	else
+		log << "NVRTC: " << nvrtcGetErrorString( result ) << "\n";
+	nvrtcDestroyProgram( &program );
+	return compiled;
+}
+
+RtcAdvance* RtcAdvance::build( const RtcAdvanceKey& key, const cudaDeviceProp& properties, std::ostream& log )
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	std::string code = source( key );
+	std::string arch = "sm_" + std::to_string( properties.major * 10 + properties.minor );
+	std::string path = cubinCachePath( code, arch );
+
+	std::vector<char> cubin;
+	bool cached = false;
+	std::ifstream file( path, std::ios::binary );
+	if ( file.is_open() )
+	{
+		cubin.assign( std::istreambuf_iterator<char>( file ), std::istreambuf_iterator<char>() );
+		cached = !cubin.empty();
+	}
+	if ( !cached )
+	{
+		if ( !compileCubin( code, arch, cubin, log ) )
+		{
+			log << "Runtime compile of the grid advance for " << arch << " failed, using d_advance_grid" << std::endl;
+			return NULL;
+		}
+		std::ofstream out( path, std::ios::binary );
+		out.write( cubin.data(), static_cast< std::streamsize >( cubin.size() ) );
+	}
+
+	CUmodule module;
+	CUfunction function;
+	if ( cuModuleLoadData( &module, cubin.data() ) != CUDA_SUCCESS )
+	{
+		log << "Can't load " << path << ", using d_advance_grid" << std::endl;
+		std::remove( path.c_str() );											// Broken cache entry, compiled again next time
+		return NULL;
+	}
+	if ( cuModuleGetFunction( &function, module, "d_advance_rtc" ) != CUDA_SUCCESS )
+	{
+		cuModuleUnload( module );
+		return NULL;
+	}
+
+	RtcAdvance* kernel = new RtcAdvance();
+	kernel->key_ = key;
+	kernel->module_ = module;
+	kernel->function_ = function;
+	double ms = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - start ).count();
+	log << "Runtime compiled grid advance for " << arch << ( cached ? " from " + path : std::string( "" ) ) << ": fish distance "
+		<< key.params.fishDist << ", cell size " << key.cellSize << ", " << key.threads << " threads, " << ms << " ms" << std::endl;
+	return kernel;
+}
+
+RtcAdvance::~RtcAdvance()
+{
+	if ( module_ != NULL )
+		cuModuleUnload( static_cast< CUmodule >( module_ ) );
+}
+
+void RtcAdvance::launch( ParticleArrays out, ParticleArrays sorted, const unsigned int* gridParticleIndex, const unsigned int* cellStart,
+	const unsigned int* cellEnd, unsigned int mesh_count, float3 origin, int3 dims, float speed, float4 center,
+	const float4* sharks, unsigned int shark_count, ParticleArrays warm, unsigned int warmCount, unsigned int* nearest,
+	cudaStream_t stream ) const
+{
+	void* args[] = { &out, &sorted, &gridParticleIndex, &cellStart, &cellEnd, &mesh_count, &origin, &dims, &speed, &center,
+		&sharks, &shark_count, &warm, &warmCount, &nearest };
+	unsigned int blocks = ( mesh_count + key_.threads - 1 ) / key_.threads;
+	CUresult result = cuLaunchKernel( static_cast< CUfunction >( function_ ), blocks, 1, 1, key_.threads, 1, 1, 0,
+		reinterpret_cast< CUstream >( stream ), args, NULL );
+	if ( result != CUDA_SUCCESS )
+	{
+		const char* name = NULL;
+		cuGetErrorName( result, &name );
+		std::cerr << "d_advance_rtc: " << ( name != NULL ? name : "launch failed" ) << std::endl;
+	}
+}
+
+#else
+
+RtcAdvance* RtcAdvance::build( const RtcAdvanceKey&, const cudaDeviceProp&, std::ostream& log )
+{
+	log << "Built without NVRTC, define SWARM_NVRTC and link nvrtc.lib and cuda.lib. Using d_advance_grid" << std::endl;
+	return NULL;
+}
+
+RtcAdvance::~RtcAdvance()
+{
+}
+
+void RtcAdvance::launch( ParticleArrays, ParticleArrays, const unsigned int*, const unsigned int*, const unsigned int*, unsigned int, float3,
+	int3, float, float4, const float4*, unsigned int, ParticleArrays, unsigned int, unsigned int*, cudaStream_t ) const
+{
+}
+
+#endif
@@ -0,0 +1,123 @@
+#include "scenario_timeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "swarm_ensemble.h"
+
+/*!
+ * @brief Read "x,y,z".
+ * @param text text.
+ * @param value Output: x, y and z.
+ * @return true, if the text are three numbers.
+ */
+static bool parseTriple( const std::string& text, float* value )
+{
+	std::istringstream in( text );
+	char comma1 = 0, comma2 = 0;
+	return static_cast< bool >( in >> value[0] >> comma1 >> value[1] >> comma2 >> value[2] ) && comma1 == ',' && comma2 == ',';
+}
+
+bool readTimeline( const std::string& path, float simulationRate, std::vector<TimelineEvent>& events )
+{
+	std::ifstream file( path );
+	if ( !file )
+	{
+		std::cerr << "Impossible to open " << path << "!" << std::endl;
+		return false;
+	}
+
+	events.clear();
+	std::string line;
+	for ( unsigned int number = 1; std::getline( file, line ); number++ )
+	{
+		line = line.substr( 0, line.find( '#' ) );
+		if ( line.find_first_not_of( " \t\r" ) == std::string::npos )
+			continue;															// Empty line or comment
+
+		std::istringstream in( line );
+		float seconds = 0.0f;
+		std::string action;
+		bool valid = static_cast< bool >( in >> seconds >> action );
+		TimelineEvent event = {};
+		event.step = static_cast< unsigned int >( std::lround( std::max( seconds, 0.0f ) * simulationRate ) );
+		if ( valid && action == "param" )
+		{
+			// Grid and Verlet lists are sized for fish_dist and skin when the steps are set up, a device event can't change them.
+			std::string key;
+			float SwarmParams::* field = NULL;
+			valid = in >> key >> event.value[0] && findParam( key, field ) && field != &SwarmParams::fishDist && field != &SwarmParams::verletSkin;
+			if ( valid )
+			{
+				SwarmParams params;
+				event.action = TimelineAction::PARAM;
+				event.index = static_cast< unsigned int >( &( params.*field ) - reinterpret_cast< float* >( &params ) );
+			}
+		}
+		else if ( valid && action == "sharks" )
+		{
+			std::string position;
+			event.action = TimelineAction::SHARKS;
+			valid = in >> event.index >> position && parseTriple( position, event.value );
+		}
+		else if ( valid && action == "route" )
+		{
+			std::string offset;
+			event.action = TimelineAction::ROUTE;
+			valid = in >> offset && parseTriple( offset, event.value );
+		}
+		else if ( valid && action == "current" )
+		{
+			event.action = TimelineAction::CURRENT;
+			valid = static_cast< bool >( in >> event.value[0] );
+			event.value[0] /= simulationRate;
+		}
+		else if ( valid && action == "respawn" )
+		{
+			event.action = TimelineAction::RESPAWN;
+			valid = static_cast< bool >( in >> event.index );
+		}
+		else
+			valid = false;
+
+		if ( !valid )
+		{
+			std::cerr << path << ":" << number << ": no valid timeline event!" << std::endl;
+			events.clear();
+			return false;
+		}
+		events.push_back( event );
+	}
+
+	std::stable_sort( events.begin(), events.end(), []( const TimelineEvent& a, const TimelineEvent& b ) { return a.step < b.step; } );
+	if ( events.size() > MAX_TIMELINE_EVENTS )
+	{
+		std::cerr << path << " has more than " << MAX_TIMELINE_EVENTS << " events, the last ones are dropped!" << std::endl;
+		events.resize( MAX_TIMELINE_EVENTS );
+	}
+	return true;
+}
+
+std::vector<TimelineEvent> loadTimeline( const SwarmConfig& config )
+{
+	std::vector<TimelineEvent> events;
+	if ( config.timeline.empty() || !readTimeline( config.timeline, static_cast< float >( config.simulationRate ), events ) )
+		return events;
+
+	for ( TimelineEvent& event : events )
+	{
+		if ( event.action == TimelineAction::SHARKS && event.index > config.numSharks )
+		{
+			std::cerr << "The timeline wakes " << event.index << " sharks, only " << config.numSharks << " are allocated!" << std::endl;
+			event.index = config.numSharks;
+		}
+		else if ( event.action == TimelineAction::RESPAWN && config.respawnRate == 0 )
+			std::cerr << "The timeline sets the respawn, but the emitter is off (--respawn)!" << std::endl;
+		else if ( event.action == TimelineAction::CURRENT && config.current.empty() )
+			std::cerr << "The timeline sets the current, but the water is still (--current)!" << std::endl;
+	}
+	return events;
+}
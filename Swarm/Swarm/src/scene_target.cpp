@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "scene_target.h"
+#include "nvtx_range.h"
+
+SceneTarget::SceneTarget( unsigned int samples, float scale ) :
+	samples_( samples ),
+	scale_( scale )
+{
+}
+
+SceneTarget::~SceneTarget()
+{
+	release();
+}
+
+bool SceneTarget::isNeeded( const SwarmConfig& config )
+{
+	return config.renderScale != 1.0f || ( config.qualityBudget > 0.0f && config.backend == Backend::CUDA );	// Only Renderer has a quality controller
+}
+
+void SceneTarget::release()
+{
+	glDeleteFramebuffers( 1, &sceneFbo_ );										// Names of 0 are ignored
+	glDeleteFramebuffers( 1, &resolveFbo_ );
+	glDeleteRenderbuffers( 1, &sceneColor_ );
+	glDeleteRenderbuffers( 1, &sceneDepth_ );
+	glDeleteRenderbuffers( 1, &resolveColor_ );
+	sceneFbo_ = resolveFbo_ = sceneColor_ = sceneDepth_ = resolveColor_ = 0;
+	width_ = height_ = 0;
+}
+
+bool SceneTarget::resize( GLsizei width, GLsizei height )
+{
+	release();
+	width_ = width;
+	height_ = height;
+
+	GLint maxSamples = 0;
+	glGetIntegerv( GL_MAX_SAMPLES, &maxSamples );
+	GLsizei samples = std::min( static_cast< GLsizei >( samples_ ), static_cast< GLsizei >( maxSamples ) );
+
+	glGenRenderbuffers( 1, &resolveColor_ );
+	glBindRenderbuffer( GL_RENDERBUFFER, resolveColor_ );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, width_, height_ );
+	glGenRenderbuffers( 1, &sceneDepth_ );
+	glBindRenderbuffer( GL_RENDERBUFFER, sceneDepth_ );
+	glRenderbufferStorageMultisample( GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width_, height_ );	// 0 samples: plain storage
+	if ( samples > 0 )
+	{
+		glGenRenderbuffers( 1, &sceneColor_ );
+		glBindRenderbuffer( GL_RENDERBUFFER, sceneColor_ );
+		glRenderbufferStorageMultisample( GL_RENDERBUFFER, samples, GL_RGBA8, width_, height_ );
+	}
+	glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+	glGenFramebuffers( 1, &resolveFbo_ );
+	glBindFramebuffer( GL_FRAMEBUFFER, resolveFbo_ );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolveColor_ );
+	if ( samples == 0 )
+		glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, sceneDepth_ );
+	bool complete = glCheckFramebufferStatus( GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE;
+	if ( samples > 0 )
+	{
+		glGenFramebuffers( 1, &sceneFbo_ );
+		glBindFramebuffer( GL_FRAMEBUFFER, sceneFbo_ );
+		glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, sceneColor_ );
+		glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, sceneDepth_ );
+		complete = complete && glCheckFramebufferStatus( GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE;
+	}
+	glBindFramebuffer( GL_FRAMEBUFFER, destination_ );
+	if ( !complete )
+		std::cerr << "Scene target " << width_ << "x" << height_ << " is incomplete, drawing into the window" << std::endl;
+	return complete;
+}
+
+void SceneTarget::beginFrame()
+{
+	if ( failed_ )
+		return;
+	glGetIntegerv( GL_VIEWPORT, viewport_ );
+	glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &destination_ );
+
+	GLsizei width = std::max( static_cast< GLsizei >( std::lround( viewport_[2] * scale_ ) ), 1 );
+	GLsizei height = std::max( static_cast< GLsizei >( std::lround( viewport_[3] * scale_ ) ), 1 );
+	if ( ( width != width_ || height != height_ ) && !resize( width, height ) )
+	{
+		release();
+		failed_ = true;
+		return;
+	}
+
+	glBindFramebuffer( GL_FRAMEBUFFER, sceneFbo_ != 0 ? sceneFbo_ : resolveFbo_ );
+	glViewport( 0, 0, width_, height_ );
+}
+
+void SceneTarget::endFrame()
+{
+	if ( width_ == 0 )
+		return;
+
+	NVTX_RANGE( NvtxDomain::RENDERER, "SceneTarget::endFrame", NVTX_COLOR_FRAME );
+
+	if ( sceneFbo_ != 0 )														// Resolve at the small size, scaled multisample blits aren't allowed
+	{
+		glBindFramebuffer( GL_READ_FRAMEBUFFER, sceneFbo_ );
+		glBindFramebuffer( GL_DRAW_FRAMEBUFFER, resolveFbo_ );
+		glBlitFramebuffer( 0, 0, width_, height_, 0, 0, width_, height_, GL_COLOR_BUFFER_BIT, GL_NEAREST );
+	}
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, resolveFbo_ );
+	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, destination_ );
+	glBlitFramebuffer( 0, 0, width_, height_, viewport_[0], viewport_[1], viewport_[0] + viewport_[2], viewport_[1] + viewport_[3],
+		GL_COLOR_BUFFER_BIT, GL_LINEAR );
+	glBindFramebuffer( GL_FRAMEBUFFER, destination_ );
+	glViewport( viewport_[0], viewport_[1], viewport_[2], viewport_[3] );
+}
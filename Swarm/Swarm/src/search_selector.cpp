@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <iostream>
+
+#include "search_selector.h"
+
+/*!
+ * @brief Relative gain a probed search needs to replace the current one, so close searches don't toggle.
+ */
+static const float SELECT_HYSTERESIS = 0.1f;
+
+/*!
+ * @brief Below this number of fishies the kernels use the tiled search for AUTO, else the grid (TILED_SEARCH_THRESHOLD).
+ */
+static const unsigned int SELECT_TILED_THRESHOLD = 4096;
+
+SearchSelector::SearchSelector( const SwarmConfig& config ) :
+	enabled_( config.behaviour == Behaviour::CLASSIC && config.gpus == 1 && config.profileInterval > 0 ),
+	interval_( config.searchSelect ),
+	hysteresis_( SELECT_HYSTERESIS )
+{
+	SearchMode start = config.searchMode;
+	if ( start == SearchMode::AUTO )											// The search AUTO runs now
+		start = config.numParticles < SELECT_TILED_THRESHOLD ? SearchMode::TILED : SearchMode::GRID;
+
+	std::vector<SearchMode> modes;
+	if ( config.numParticles <= ALL_PAIRS_LIMIT )								// O(N^2) probes would stall large swarms
+	{
+		modes.push_back( SearchMode::BRUTE_FORCE );
+		modes.push_back( SearchMode::TILED );
+	}
+	modes.push_back( SearchMode::GRID );
+	modes.push_back( SearchMode::CELL );
+	modes.push_back( SearchMode::VERLET );
+	if ( std::find( modes.begin(), modes.end(), start ) == modes.end() )
+		modes.push_back( start );												// E.g. WARP, only probed if configured
+
+	for ( SearchMode mode : modes )
+	{
+		Candidate candidate;
+		candidate.mode = mode;
+		candidates_.push_back( candidate );
+	}
+	current_ = active_ = find( start );
+
+	if ( config.searchSelect > 0 && !enabled_ )
+		std::cout << "Search selector needs the classic behaviour, one GPU and the profiler, --search_select ignored" << std::endl;
+}
+
+size_t SearchSelector::find( SearchMode mode ) const
+{
+	for ( size_t i = 0; i < candidates_.size(); i++ )
+	{
+		if ( candidates_[i].mode == mode )
+			return i;
+	}
+	return candidates_.size();
+}
+
+unsigned int SearchSelector::frameTag( unsigned int steps ) const
+{
+	if ( steps == 0 )
+		return 0;
+	return static_cast< unsigned int >( active_ + 1 ) << 16 | ( steps < 0xFFFF ? steps : 0xFFFF );
+}
+
+bool SearchSelector::update( float ms, unsigned int tag )
+{
+	if ( !enabled_ )
+		return false;
+
+	size_t sampled = ( tag >> 16 ) - 1;
+	unsigned int steps = tag & 0xFFFF;
+	if ( ms >= 0.0f && tag != 0 && sampled < candidates_.size() && steps > 0 )
+	{
+		Candidate& candidate = candidates_[sampled];
+		if ( candidate.samples++ > 0 )											// The first one after a switch pays for capture and build
+			candidate.sum += ms / steps;
+	}
+
+	if ( pinned_ || interval_ == 0 )
+		return false;
+
+	size_t before = active_;
+	if ( !probing_ )
+	{
+		if ( ++framesSinceProbe_ < interval_ )
+			return false;
+		probing_ = true;
+		probeNext_ = 0;
+		nextProbe();
+	}
+	else if ( ++probeFrames_ >= PROBE_TIMEOUT || candidates_[active_].samples >= PROBE_SAMPLES )
+		nextProbe();
+	return active_ != before;
+}
+
+void SearchSelector::nextProbe()
+{
+	while ( probeNext_ < candidates_.size() && probeNext_ == current_ )
+		probeNext_++;															// The current one is measured between the probes
+	if ( probeNext_ < candidates_.size() )
+	{
+		active_ = probeNext_++;
+		probeFrames_ = 0;
+		candidates_[active_].sum = 0.0;
+		candidates_[active_].samples = 0;
+		return;
+	}
+
+	// All probed: the fastest one wins, if it beats the current one clearly.
+	size_t fastest = current_;
+	for ( size_t i = 0; i < candidates_.size(); i++ )
+	{
+		double mean = candidates_[i].mean();
+		if ( mean > 0.0 && ( candidates_[fastest].mean() == 0.0 || mean < candidates_[fastest].mean() ) )
+			fastest = i;
+	}
+	double now = candidates_[current_].mean();
+	if ( fastest != current_ && ( now == 0.0 || candidates_[fastest].mean() < now * ( 1.0 - hysteresis_ ) ) )
+	{
+		std::cout << "Search selector:                  " << searchModeName( candidates_[current_].mode ) << " -> " << searchModeName( candidates_[fastest].mode )
+				  << " (" << candidates_[fastest].mean() << " instead of " << now << " ms per step)" << std::endl;
+		current_ = fastest;
+	}
+
+	for ( Candidate& candidate : candidates_ )
+	{
+		candidate.sum = 0.0;
+		candidate.samples = 0;
+	}
+	active_ = current_;
+	probing_ = false;
+	framesSinceProbe_ = 0;
+}
+
+bool SearchSelector::cycle()
+{
+	if ( !enabled_ )
+		return false;
+
+	for ( Candidate& candidate : candidates_ )
+	{
+		candidate.sum = 0.0;
+		candidate.samples = 0;
+	}
+	probing_ = false;
+	framesSinceProbe_ = 0;
+
+	size_t before = active_;
+	if ( pinned_ && active_ + 1 == candidates_.size() && interval_ > 0 )		// After the last one: automatic again, probe right away
+	{
+		pinned_ = false;
+		framesSinceProbe_ = interval_ - 1;
+		std::cout << "Search selector:                  automatic" << std::endl;
+		return false;
+	}
+
+	pinned_ = true;
+	active_ = current_ = ( active_ + 1 ) % candidates_.size();
+	std::cout << "Search selector:                  " << searchModeName( candidates_[active_].mode ) << " (by hand)" << std::endl;
+	return active_ != before;
+}
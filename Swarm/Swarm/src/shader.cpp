@@ -1,14 +1,110 @@
 #include <glew.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 #include "shader.h"
+#include "gl_features.h"
+
+/*!
+ * @brief Get the file of a cached program binary.
+ * @param _sources sources of all shaders of the program.
+ * @return path shader_cache_<hash>.bin. FNV-1a of the sources, vendor, renderer and version of the driver.
+ */
+static std::string programCachePath( const std::vector<std::string>& _sources )
+{
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&hash]( const char* data, size_t length ) {
+		for ( size_t i = 0; i < length; i++ )
+			hash = ( hash ^ static_cast< unsigned char >( data[i] ) ) * 1099511628211ull;
+		hash = ( hash ^ 0xff ) * 1099511628211ull;								// Separator, "ab" + "c" != "a" + "bc"
+	};
+	for ( const std::string& source : _sources )
+		add( source.data(), source.size() );
+	for ( GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION } )
+	{
+		const char* value = reinterpret_cast< const char* >( glGetString( name ) );
+		if ( value != NULL )
+			add( value, std::char_traits<char>::length( value ) );
+	}
+
+	std::ostringstream path;
+	path << "shader_cache_" << std::hex << hash << ".bin";
+	return path.str();
+}
+
+/*!
+ * @brief Load a program binary from the cache.
+ * @param _path file of programCachePath.
+ * @return linked program, 0 if there is no file or the driver rejects the binary.
+ */
+static unsigned int loadProgramBinary( const std::string& _path )
+{
+	std::ifstream file( _path, std::ios::in | std::ios::binary );
+	GLenum format = 0;
+	if ( !file.read( reinterpret_cast< char* >( &format ), sizeof( format ) ) )
+		return 0;
+	std::vector<char> binary( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+	if ( binary.empty() )
+		return 0;
+
+	unsigned int program = glCreateProgram();
+	glProgramBinary( program, format, binary.data(), static_cast< GLsizei >( binary.size() ) );
+	int result = GL_FALSE;
+	glGetProgramiv( program, GL_LINK_STATUS, &result );
+	if ( result == GL_FALSE )													// Other driver or GPU, compile again
+	{
+		glDeleteProgram( program );
+		return 0;
+	}
+	return program;
+}
+
+/*!
+ * @brief Write the binary of a linked program into the cache. Failures are ignored, the next start compiles again.
+ * @param _program linked program, created with GL_PROGRAM_BINARY_RETRIEVABLE_HINT.
+ * @param _path file of programCachePath.
+ */
+static void saveProgramBinary( unsigned int _program, const std::string& _path )
+{
+	int length = 0;
+	glGetProgramiv( _program, GL_PROGRAM_BINARY_LENGTH, &length );
+	if ( length <= 0 )
+		return;
+
+	std::vector<char> binary( length );
+	GLenum format = 0;
+	glGetProgramBinary( _program, length, &length, &format, binary.data() );
+	std::ofstream file( _path, std::ios::out | std::ios::binary | std::ios::trunc );
+	file.write( reinterpret_cast< const char* >( &format ), sizeof( format ) );
+	file.write( binary.data(), length );
+}
 
 Shader::Shader( const std::string& _vertexFilePath, const std::string& _fragmentFilePath )
 {
 	ShaderProgramSource source = ParseShader( _vertexFilePath, _fragmentFilePath );
 	renderID_ = createShader( source.VertexSource, source.FragmentSource );
+	cacheUniformLocations();
+}
+
+Shader::Shader( const std::string& _computeFilePath )
+{
+	std::ifstream computeShaderStream( _computeFilePath, std::ios::in );
+	if ( !computeShaderStream.is_open() )
+	{
+		std::cout << "Impossible to open " << _computeFilePath << "!" << std::endl;
+		renderID_ = 0;
+		return;
+	}
+	std::stringstream sstr;
+	sstr << computeShaderStream.rdbuf();
+
+	renderID_ = createComputeShader( sstr.str() );
+	cacheUniformLocations();
 }
 
 Shader::~Shader()
@@ -26,19 +122,76 @@ void Shader::unbind() const
 	glUseProgram( 0 );
 }
 
-void Shader::setUniform1i( const std::string& _name, int _value )
+void Shader::dispatch( unsigned int _groupsX, unsigned int _groupsY, unsigned int _groupsZ ) const
+{
+	bind();
+	glDispatchCompute( _groupsX, _groupsY, _groupsZ );
+}
+
+void Shader::setUniform1i( const char* _name, int _value )
+{
+	if ( glHasDirectStateAccess() )
+		glProgramUniform1i( renderID_, getUniformLocation( _name ), _value );
+	else
+		glUniform1i( getUniformLocation( _name ), _value );
+}
+
+void Shader::setUniform1f( const char* _name, float _value )
+{
+	setUniform1f( getUniformLocation( _name ), _value );
+}
+
+void Shader::setUniform3f( const char* _name, const glm::vec3& _vector )
 {
-	glUniform1i( getUniformLocation( _name ), _value );
+	if ( glHasDirectStateAccess() )
+		glProgramUniform3f( renderID_, getUniformLocation( _name ), _vector.x, _vector.y, _vector.z );
+	else
+		glUniform3f( getUniformLocation( _name ), _vector.x, _vector.y, _vector.z );
 }
 
-void Shader::setUniform1f( const std::string& _name, float _value )
+void Shader::setUniformMat4f( const char* _name, const glm::mat4& _matrix )
 {
-	glUniform1f( getUniformLocation( _name ), _value );
+	setUniformMat4f( getUniformLocation( _name ), _matrix );
 }
 
-void Shader::setUniformMat4f( const std::string& _name, const glm::mat4& _matrix )
+int Shader::getUniformHandle( const char* _name )
 {
-	glUniformMatrix4fv( getUniformLocation( _name ), 1, GL_FALSE, &_matrix[0][0] );
+	return getUniformLocation( _name );
+}
+
+void Shader::setUniform1f( int _location, float _value )
+{
+	if ( glHasDirectStateAccess() )
+		glProgramUniform1f( renderID_, _location, _value );
+	else
+		glUniform1f( _location, _value );
+}
+
+void Shader::setUniform1i( int _location, int _value )
+{
+	if ( glHasDirectStateAccess() )
+		glProgramUniform1i( renderID_, _location, _value );
+	else
+		glUniform1i( _location, _value );
+}
+
+void Shader::setUniformMat4f( int _location, const glm::mat4& _matrix )
+{
+	if ( glHasDirectStateAccess() )
+		glProgramUniformMatrix4fv( renderID_, _location, 1, GL_FALSE, &_matrix[0][0] );
+	else
+		glUniformMatrix4fv( _location, 1, GL_FALSE, &_matrix[0][0] );
+}
+
+void Shader::bindUniformBlock( const std::string& _block, unsigned int _binding )
+{
+	unsigned int index = glGetUniformBlockIndex( renderID_, _block.c_str() );
+	if ( index == GL_INVALID_INDEX )
+	{
+		std::cout << "Warning: uniform block '" << _block << "' doesn't exist" << std::endl;
+		return;
+	}
+	glUniformBlockBinding( renderID_, index, _binding );
 }
 
 
@@ -96,7 +249,7 @@ unsigned int Shader::compileShader( unsigned int _type, const std::string& _sour
 		std::vector<char> message( length + 1 );
 		glGetShaderInfoLog( id, length, &length, message.data() );
 
-		std::cout << "Failed to compile " << ( _type == GL_VERTEX_SHADER ? "vertex" : "fragment" ) << " shader!" << std::endl;
+		std::cout << "Failed to compile " << ( _type == GL_VERTEX_SHADER ? "vertex" : _type == GL_COMPUTE_SHADER ? "compute" : "fragment" ) << " shader!" << std::endl;
 		std::cout << message.data() << std::endl;
 		return 0;
 	}
@@ -106,30 +259,86 @@ unsigned int Shader::compileShader( unsigned int _type, const std::string& _sour
 
 unsigned int Shader::createShader( const std::string& _vertexShader, const std::string& _fragmentShader )
 {
-	unsigned int program = glCreateProgram();
-	unsigned int vs = compileShader( GL_VERTEX_SHADER, _vertexShader );
-	unsigned int fs = compileShader( GL_FRAGMENT_SHADER, _fragmentShader );
+	return createProgram( { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER }, { _vertexShader, _fragmentShader } );
+}
+
+unsigned int Shader::createProgram( const std::vector<unsigned int>& _types, const std::vector<std::string>& _sources )
+{
+	bool cache = glHasProgramBinary();
+	std::string path = cache ? programCachePath( _sources ) : std::string();
+	if ( cache )
+	{
+		unsigned int program = loadProgramBinary( path );
+		if ( program != 0 )
+			return program;
+	}
 
-	glAttachShader( program, vs );
-	glAttachShader( program, fs );
+	unsigned int program = glCreateProgram();
+	std::vector<unsigned int> shaders;
+	for ( size_t i = 0; i < _types.size(); i++ )
+	{
+		shaders.push_back( compileShader( _types[i], _sources[i] ) );
+		glAttachShader( program, shaders.back() );
+	}
+	if ( cache )
+		glProgramParameteri( program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
 	glLinkProgram( program );
-	glValidateProgram( program );
+#ifdef _DEBUG
+	glValidateProgram( program );												// Only meaningful with the state of the draw, debug builds only
+#endif
 
-	glDeleteShader( vs );
-	glDeleteShader( fs );
+	for ( unsigned int shader : shaders )
+	{
+		glDetachShader( program, shader );
+		glDeleteShader( shader );
+	}
 
+	int result;
+	glGetProgramiv( program, GL_LINK_STATUS, &result );
+	if ( result == GL_FALSE )
+		std::cout << "Failed to link " << ( _types.size() == 1 && _types[0] == GL_COMPUTE_SHADER ? "compute shader" : "shader program" ) << "!" << std::endl;
+	else if ( cache )
+		saveProgramBinary( program, path );
 	return program;
 }
 
-int Shader::getUniformLocation( const std::string& name )
+void Shader::cacheUniformLocations()
+{
+	int count = 0;
+	int maxLength = 0;
+	glGetProgramiv( renderID_, GL_ACTIVE_UNIFORMS, &count );
+	glGetProgramiv( renderID_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength );
+
+	std::vector<char> name( maxLength + 1 );
+	for ( int i = 0; i < count; i++ )
+	{
+		int length = 0;
+		int size = 0;
+		unsigned int type = 0;
+		glGetActiveUniform( renderID_, i, maxLength + 1, &length, &size, &type, name.data() );
+		int location = glGetUniformLocation( renderID_, name.data() );
+		if ( location != -1 )													// Members of uniform blocks have no location
+			uniformLocationCache_.emplace_back( std::string( name.data(), length ), location );
+	}
+	std::sort( uniformLocationCache_.begin(), uniformLocationCache_.end() );
+}
+
+unsigned int Shader::createComputeShader( const std::string& _computeShader )
+{
+	return createProgram( { GL_COMPUTE_SHADER }, { _computeShader } );
+}
+
+int Shader::getUniformLocation( const char* name )
 {
-	if ( uniformLocationCache_.find( name ) != uniformLocationCache_.end() )
-		return uniformLocationCache_[name];
+	auto before = []( const std::pair<std::string, int>& entry, const char* key ) { return std::strcmp( entry.first.c_str(), key ) < 0; };
+	auto entry = std::lower_bound( uniformLocationCache_.begin(), uniformLocationCache_.end(), name, before );
+	if ( entry != uniformLocationCache_.end() && entry->first == name )
+		return entry->second;
 
-	int location = glGetUniformLocation( renderID_, name.c_str() );
+	int location = glGetUniformLocation( renderID_, name );
 	if ( location == -1 )
 		std::cout << "Warning: uniform '" << name << "' doesn't exist" << std::endl;
 
-	uniformLocationCache_[name] = location;
+	uniformLocationCache_.emplace( entry, std::string( name ), location );		// Misses are rare, the warning only comes once
 	return location;
 }
@@ -0,0 +1,589 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "snapshot.h"
+
+/*!
+ * @brief Offsets of the arrays in a snapshot file.
+ */
+struct SnapshotLayout
+{
+	size_t floats[7];						//!< x, y, z, vx, vy, vz, mass.
+	size_t alive;							//!< Alive flags.
+	size_t id;								//!< Stable ids.
+	size_t sharks;							//!< Shark positions.
+	size_t sharkState;						//!< Shark states.
+	size_t size;							//!< Size of the file.
+};
+
+/*!
+ * @brief Round up to a multiple of SNAPSHOT_ALIGNMENT.
+ * @param offset offset.
+ * @return aligned offset.
+ */
+static size_t align( size_t offset )
+{
+	return ( offset + SNAPSHOT_ALIGNMENT - 1 ) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+/*!
+ * @brief Compute the offsets of the arrays.
+ * @param numParticles number of slots.
+ * @param numSharks number of sharks.
+ * @return offsets.
+ */
+static SnapshotLayout snapshotLayout( unsigned int numParticles, unsigned int numSharks )
+{
+	SnapshotLayout layout;
+	size_t offset = align( sizeof( SnapshotHeader ) );
+	for ( int i = 0; i < 7; i++ )
+	{
+		layout.floats[i] = offset;
+		offset = align( offset + numParticles * sizeof( float ) );
+	}
+	layout.alive = offset;
+	offset = align( offset + numParticles * sizeof( unsigned char ) );
+	layout.id = offset;
+	offset = align( offset + numParticles * sizeof( unsigned int ) );
+	layout.sharks = offset;
+	offset = align( offset + numSharks * 4 * sizeof( float ) );
+	layout.sharkState = offset;
+	layout.size = offset + numSharks * 4 * sizeof( float );
+	return layout;
+}
+
+/*!
+ * @brief Get the arrays of a store in file order.
+ * @param arrays device pointers.
+ * @param pointers Output: x, y, z, vx, vy, vz, mass.
+ */
+static void floatArrays( const ParticleArrays& arrays, float* pointers[7] )
+{
+	float* const all[7] = { arrays.x, arrays.y, arrays.z, arrays.vx, arrays.vy, arrays.vz, arrays.mass };
+	for ( int i = 0; i < 7; i++ )
+		pointers[i] = all[i];
+}
+
+/*!
+ * @brief Get the sizes of the arrays in file order: x, y, z, vx, vy, vz, mass, alive, id, sharks, shark states.
+ * @param numParticles number of slots.
+ * @param numSharks number of sharks.
+ * @param bytes Output: size of every array.
+ */
+static void arrayBytes( unsigned int numParticles, unsigned int numSharks, size_t bytes[11] )
+{
+	for ( int i = 0; i < 7; i++ )
+		bytes[i] = numParticles * sizeof( float );
+	bytes[7] = numParticles * sizeof( unsigned char );
+	bytes[8] = numParticles * sizeof( unsigned int );
+	bytes[9] = numSharks * 4 * sizeof( float );
+	bytes[10] = numSharks * 4 * sizeof( float );
+}
+
+/*!
+ * @brief Offsets of the arrays in a delta checkpoint file.
+ */
+struct DeltaLayout
+{
+	size_t deltas;							//!< First of the CHECKPOINT_COMPONENTS difference arrays.
+	size_t stride;							//!< Entries from one difference array to the next.
+	size_t sharks;							//!< Shark positions.
+	size_t sharkState;						//!< Shark states.
+	size_t events;							//!< Changed slots.
+	size_t size;							//!< Size of the file.
+};
+
+/*!
+ * @brief Compute the offsets of the arrays of a delta checkpoint.
+ * @param numParticles number of slots.
+ * @param numSharks number of sharks.
+ * @param events number of changed slots.
+ * @return offsets.
+ */
+static DeltaLayout deltaLayout( unsigned int numParticles, unsigned int numSharks, unsigned int events )
+{
+	DeltaLayout layout;
+	layout.deltas = align( sizeof( DeltaHeader ) );
+	layout.stride = align( numParticles * sizeof( short ) ) / sizeof( short );
+	layout.sharks = layout.deltas + CHECKPOINT_COMPONENTS * layout.stride * sizeof( short );
+	layout.sharkState = align( layout.sharks + numSharks * 4 * sizeof( float ) );
+	layout.events = align( layout.sharkState + numSharks * 4 * sizeof( float ) );
+	layout.size = layout.events + events * sizeof( CheckpointEvent );
+	return layout;
+}
+
+size_t snapshotSize( unsigned int numParticles, unsigned int numSharks )
+{
+	return snapshotLayout( numParticles, numSharks ).size;
+}
+
+std::string deltaPath( const std::string& snapshot, unsigned int sequence )
+{
+	return snapshot + ".delta" + std::to_string( sequence );
+}
+
+SnapshotWriter::SnapshotWriter( Compression compression ) :
+	compression_( compression )
+{
+	CUDA_CHECK( cudaEventCreateWithFlags( &copied_, cudaEventDisableTiming ) );
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+	wait();
+	delete staging_;
+	delete used_;
+	delete words_;
+	delete flags_;
+	CUDA_CHECK( cudaEventDestroy( copied_ ) );
+}
+
+void SnapshotWriter::write( const std::string& path, SnapshotHeader header, ParticleArrays particles, const float* sharks, const float* sharkState, cudaStream_t stream )
+{
+	wait();																		// staging_ is free again
+
+	SnapshotLayout layout = snapshotLayout( header.numParticles, header.numSharks );
+	size_t bytes[11];
+	arrayBytes( header.numParticles, header.numSharks, bytes );
+	if ( compression_ != Compression::OFF && capacity_ < std::max( header.numParticles, header.numSharks * 4 ) )
+	{
+		delete words_;
+		delete flags_;
+		capacity_ = std::max( header.numParticles, header.numSharks * 4 );
+		words_ = new GpuCompressor( compression_, capacity_ * sizeof( float ), sizeof( float ) );
+		flags_ = new GpuCompressor( words_->isEnabled() ? compression_ : Compression::OFF, capacity_, sizeof( unsigned char ) );	// One message without nvCOMP
+		if ( words_->isEnabled() && used_ == NULL )
+			used_ = new CudaHostArray<unsigned long long>( 1, cudaHostAllocMapped );
+	}
+	bool compressed = words_ != NULL && words_->isEnabled();
+
+	size_t start = align( sizeof( SnapshotHeader ) );
+	size_t maxSize = layout.size;
+	if ( compressed )
+	{
+		maxSize = start;
+		for ( int i = 0; i < 11; i++ )
+			maxSize += ( i == 7 ? flags_ : words_ )->maxRecordSize( bytes[i] );
+	}
+	if ( staging_ == NULL || staging_->getSize() < maxSize )
+	{
+		delete staging_;
+		staging_ = new CudaHostArray<char>( maxSize, compressed ? cudaHostAllocMapped : cudaHostAllocDefault );
+	}
+
+	std::memcpy( header.magic, SNAPSHOT_MAGIC, sizeof( SNAPSHOT_MAGIC ) );
+	header.version = SNAPSHOT_VERSION;
+	header.headerSize = sizeof( SnapshotHeader );
+	header.compression = compressed ? static_cast< unsigned int >( compression_ ) : 0;
+	char* data = staging_->getData();
+	std::memset( data, 0, compressed ? start : layout.size );					// Padding, so files of the same state are equal
+	std::memcpy( data, &header, sizeof( SnapshotHeader ) );
+
+	float* arrays[7];
+	floatArrays( particles, arrays );
+	const void* sources[11] = { arrays[0], arrays[1], arrays[2], arrays[3], arrays[4], arrays[5], arrays[6], particles.alive, particles.id, sharks, sharkState };
+	if ( compressed )
+	{
+		char* deviceData = NULL;
+		unsigned long long* deviceUsed = NULL;
+		CUDA_CHECK( cudaHostGetDevicePointer( reinterpret_cast< void** >( &deviceData ), data, 0 ) );
+		CUDA_CHECK( cudaHostGetDevicePointer( reinterpret_cast< void** >( &deviceUsed ), used_->getData(), 0 ) );
+		*used_->getData() = start;												// The last write is done
+		for ( int i = 0; i < 11; i++ )
+			( i == 7 ? flags_ : words_ )->compress( sources[i], bytes[i], deviceData, deviceUsed, stream );	// Writes through the mapping
+	}
+	else
+	{
+		size_t offsets[11] = { layout.floats[0], layout.floats[1], layout.floats[2], layout.floats[3], layout.floats[4], layout.floats[5], layout.floats[6],
+			layout.alive, layout.id, layout.sharks, layout.sharkState };
+		for ( int i = 0; i < 11; i++ )
+			CUDA_CHECK( cudaMemcpyAsync( data + offsets[i], sources[i], bytes[i], cudaMemcpyDeviceToHost, stream ) );
+	}
+	CUDA_CHECK( cudaEventRecord( copied_, stream ) );
+
+	size_t rawSize = layout.size;
+	worker_ = std::thread( [this, path, data, rawSize, compressed]()
+	{
+		CUDA_CHECK( cudaEventSynchronize( copied_ ) );						// Only this thread waits for the GPU
+		size_t size = compressed ? static_cast< size_t >( *used_->getData() ) : rawSize;
+
+		std::string temporary = path + ".tmp";
+		std::ofstream file( temporary, std::ios::out | std::ios::binary | std::ios::trunc );
+		file.write( data, size );
+		file.close();
+		failed_ = !file;
+		if ( !failed_ )
+		{
+			std::remove( path.c_str() );										// rename doesn't replace files on Windows
+			failed_ = std::rename( temporary.c_str(), path.c_str() ) != 0;
+		}
+		if ( failed_ )
+			std::cerr << "Impossible to write " << path << "!" << std::endl;
+	} );
+}
+
+bool SnapshotWriter::wait()
+{
+	if ( worker_.joinable() )
+		worker_.join();
+	return !failed_;
+}
+
+DeltaWriter::DeltaWriter() :
+	d_deltas_( 0, MemoryCategory::TRANSFER ),
+	d_events_( 0, MemoryCategory::TRANSFER ),
+	d_counters_( CHECKPOINT_COMPONENTS + 1, MemoryCategory::TRANSFER )
+{
+	CUDA_CHECK( cudaEventCreateWithFlags( &copied_, cudaEventDisableTiming ) );
+	counters_ = new CudaHostArray<unsigned int>( CHECKPOINT_COMPONENTS + 1 );
+}
+
+DeltaWriter::~DeltaWriter()
+{
+	wait();
+	delete reference_;
+	delete staging_;
+	delete counters_;
+	CUDA_CHECK( cudaEventDestroy( copied_ ) );
+}
+
+void DeltaWriter::reset( ParticleArrays particles, unsigned int numParticles, unsigned long long baseStep, cudaStream_t stream )
+{
+	wait();																		// The worker reads sequence_ and the buffers
+	if ( reference_ == NULL || reference_->getSize() != numParticles )
+	{
+		delete reference_;
+		reference_ = new ParticleStore( numParticles );
+		stride_ = deltaLayout( numParticles, 0, 0 ).stride;
+		d_deltas_.resize( CHECKPOINT_COMPONENTS * stride_ );
+		maxEvents_ = numParticles / 16 > MIN_EVENTS ? numParticles / 16 : MIN_EVENTS;
+		d_events_.resize( maxEvents_ );
+		CUDA_CHECK( cudaMemsetAsync( d_deltas_.getData(), 0, d_deltas_.getSize() * sizeof( short ), stream ) );	// Padding of the arrays
+	}
+
+	ParticleArrays reference = reference_->getArrays();
+	size_t n = numParticles;
+	float* const sources[7] = { particles.x, particles.y, particles.z, particles.vx, particles.vy, particles.vz, particles.mass };
+	float* const targets[7] = { reference.x, reference.y, reference.z, reference.vx, reference.vy, reference.vz, reference.mass };
+	for ( int i = 0; i < 7; i++ )
+		CUDA_CHECK( cudaMemcpyAsync( targets[i], sources[i], n * sizeof( float ), cudaMemcpyDeviceToDevice, stream ) );
+	CUDA_CHECK( cudaMemcpyAsync( reference.alive, particles.alive, n * sizeof( unsigned char ), cudaMemcpyDeviceToDevice, stream ) );
+	CUDA_CHECK( cudaMemcpyAsync( reference.id, particles.id, n * sizeof( unsigned int ), cudaMemcpyDeviceToDevice, stream ) );
+	baseStep_ = baseStep;
+	sequence_ = 0;
+	needsBase_ = false;
+}
+
+void DeltaWriter::write( const std::string& snapshot, const SnapshotHeader& header, ParticleArrays particles, const float* sharks, const float* sharkState, cudaStream_t stream )
+{
+	wait();																		// staging_ is free again
+	if ( reference_ == NULL || needsBase_ || header.numParticles != reference_->getSize() )
+	{
+		needsBase_ = true;
+		return;
+	}
+
+	DeltaLayout layout = deltaLayout( header.numParticles, header.numSharks, maxEvents_ );
+	if ( staging_ == NULL || staging_->getSize() < layout.size )
+	{
+		delete staging_;
+		staging_ = new CudaHostArray<char>( layout.size );
+	}
+	char* data = staging_->getData();
+	std::memset( data, 0, layout.deltas );										// Header and padding, so files of the same state are equal
+	std::memset( data + layout.sharks, 0, layout.events - layout.sharks );
+
+	kernel_encode_checkpoint( particles, reference_->getArrays(), header.numParticles, d_deltas_.getData(), stride_, d_events_.getData(),
+		maxEvents_, d_counters_.getData(), stream );							// Updates the reference to the decoded state
+	CUDA_CHECK( cudaMemcpyAsync( data + layout.deltas, d_deltas_.getData(), CHECKPOINT_COMPONENTS * stride_ * sizeof( short ), cudaMemcpyDeviceToHost, stream ) );
+	CUDA_CHECK( cudaMemcpyAsync( data + layout.sharks, sharks, header.numSharks * 4 * sizeof( float ), cudaMemcpyDeviceToHost, stream ) );
+	CUDA_CHECK( cudaMemcpyAsync( data + layout.sharkState, sharkState, header.numSharks * 4 * sizeof( float ), cudaMemcpyDeviceToHost, stream ) );
+	CUDA_CHECK( cudaMemcpyAsync( data + layout.events, d_events_.getData(), maxEvents_ * sizeof( CheckpointEvent ), cudaMemcpyDeviceToHost, stream ) );
+	CUDA_CHECK( cudaMemcpyAsync( counters_->getData(), d_counters_.getData(), ( CHECKPOINT_COMPONENTS + 1 ) * sizeof( unsigned int ), cudaMemcpyDeviceToHost, stream ) );
+	CUDA_CHECK( cudaEventRecord( copied_, stream ) );
+
+	DeltaHeader delta = {};
+	std::memcpy( delta.magic, DELTA_MAGIC, sizeof( DELTA_MAGIC ) );
+	delta.version = DELTA_VERSION;
+	delta.headerSize = sizeof( DeltaHeader );
+	delta.state = header;
+	delta.state.compression = 0;
+	delta.baseStep = baseStep_;
+	delta.sequence = ++sequence_;
+	std::string path = deltaPath( snapshot, sequence_ );
+	worker_ = std::thread( [this, path, data, delta]() mutable
+	{
+		CUDA_CHECK( cudaEventSynchronize( copied_ ) );						// Only this thread waits for the GPU
+		const unsigned int* counters = counters_->getData();
+		delta.events = counters[CHECKPOINT_COMPONENTS];
+		if ( delta.events > maxEvents_ )										// The reference has slots which aren't in any file
+		{
+			std::cout << delta.events << " changed slots, too many for a delta checkpoint. The next one is a full snapshot." << std::endl;
+			needsBase_ = true;
+			return;
+		}
+		for ( unsigned int c = 0; c < CHECKPOINT_COMPONENTS; c++ )
+			std::memcpy( &delta.range[c], &counters[c], sizeof( float ) );
+		std::memcpy( data, &delta, sizeof( DeltaHeader ) );
+		size_t size = deltaLayout( delta.state.numParticles, delta.state.numSharks, delta.events ).size;	// The events are last
+
+		std::string temporary = path + ".tmp";
+		std::ofstream file( temporary, std::ios::out | std::ios::binary | std::ios::trunc );
+		file.write( data, size );
+		file.close();
+		failed_ = !file;
+		if ( !failed_ )
+		{
+			std::remove( path.c_str() );										// rename doesn't replace files on Windows
+			failed_ = std::rename( temporary.c_str(), path.c_str() ) != 0;
+		}
+		if ( failed_ )
+		{
+			std::cerr << "Impossible to write " << path << "!" << std::endl;
+			needsBase_ = true;													// The chain has a gap
+		}
+	} );
+}
+
+bool DeltaWriter::needsBase()
+{
+	wait();
+	return needsBase_;
+}
+
+bool DeltaWriter::wait()
+{
+	if ( worker_.joinable() )
+		worker_.join();
+	return !failed_;
+}
+
+SnapshotFile::~SnapshotFile()
+{
+	close();
+}
+
+void SnapshotFile::close()
+{
+#ifdef _WIN32
+	if ( data_ != NULL )
+		UnmapViewOfFile( data_ );
+	if ( mapping_ != NULL )
+		CloseHandle( mapping_ );
+	if ( file_ != NULL )
+		CloseHandle( file_ );
+#else
+	if ( data_ != NULL )
+		munmap( const_cast< char* >( data_ ), size_ );
+#endif
+	data_ = NULL;
+	mapping_ = NULL;
+	file_ = NULL;
+	size_ = 0;
+	deltas_.clear();
+}
+
+bool SnapshotFile::open( const std::string& path )
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if ( file != INVALID_HANDLE_VALUE )
+	{
+		file_ = file;
+		LARGE_INTEGER size;
+		if ( GetFileSizeEx( file, &size ) && size.QuadPart > 0 )
+		{
+			size_ = static_cast< size_t >( size.QuadPart );
+			mapping_ = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+			if ( mapping_ != NULL )
+				data_ = static_cast< const char* >( MapViewOfFile( mapping_, FILE_MAP_READ, 0, 0, 0 ) );
+		}
+	}
+#else
+	int file = ::open( path.c_str(), O_RDONLY );
+	if ( file >= 0 )
+	{
+		struct stat status;
+		if ( fstat( file, &status ) == 0 && status.st_size > 0 )
+		{
+			size_ = static_cast< size_t >( status.st_size );
+			void* data = mmap( NULL, size_, PROT_READ, MAP_PRIVATE, file, 0 );
+			data_ = data == MAP_FAILED ? NULL : static_cast< const char* >( data );
+		}
+		::close( file );														// The mapping keeps the file open
+	}
+#endif
+
+	if ( data_ == NULL )
+	{
+		std::cerr << "Impossible to open " << path << "!" << std::endl;
+		close();
+		return false;
+	}
+
+	const SnapshotHeader& header = getHeader();
+	bool valid = size_ >= sizeof( SnapshotHeader )
+		&& std::memcmp( header.magic, SNAPSHOT_MAGIC, sizeof( SNAPSHOT_MAGIC ) ) == 0
+		&& header.version == SNAPSHOT_VERSION
+		&& header.headerSize == sizeof( SnapshotHeader )
+		&& header.liveParticles <= header.numParticles
+		&& ( header.compression != 0 || size_ >= snapshotSize( header.numParticles, header.numSharks ) );
+	if ( valid && header.compression != 0 )										// Every record in the file with the size of its array
+	{
+		size_t bytes[11];
+		arrayBytes( header.numParticles, header.numSharks, bytes );
+		size_t offset = align( sizeof( SnapshotHeader ) );
+		for ( int i = 0; i < 11 && valid; i++ )
+		{
+			if ( bytes[i] == 0 )
+				continue;
+			unsigned long long record[2] = { 0, 0 };
+			valid = size_ >= offset + sizeof( record );
+			if ( valid )
+				std::memcpy( record, data_ + offset, sizeof( record ) );
+			valid = valid && record[0] <= size_ - offset && record[1] == bytes[i];
+			offset += static_cast< size_t >( record[0] );
+		}
+	}
+	if ( !valid )
+	{
+		std::cerr << path << " is no snapshot of this version!" << std::endl;
+		close();
+	}
+	else
+		openDeltas( path );
+	return valid;
+}
+
+void SnapshotFile::openDeltas( const std::string& path )
+{
+	const SnapshotHeader& base = getBaseHeader();
+	for ( unsigned int sequence = 1; ; sequence++ )
+	{
+		std::ifstream file( deltaPath( path, sequence ), std::ios::in | std::ios::binary | std::ios::ate );
+		if ( !file )
+			break;																// End of the chain
+		std::vector<char> data( static_cast< size_t >( file.tellg() ) );
+		file.seekg( 0 );
+		file.read( data.data(), data.size() );
+
+		const DeltaHeader* header = reinterpret_cast< const DeltaHeader* >( data.data() );
+		bool valid = file && data.size() >= sizeof( DeltaHeader )
+			&& std::memcmp( header->magic, DELTA_MAGIC, sizeof( DELTA_MAGIC ) ) == 0
+			&& header->version == DELTA_VERSION
+			&& header->headerSize == sizeof( DeltaHeader )
+			&& header->baseStep == base.step									// Files of an older chain end it
+			&& header->sequence == sequence
+			&& header->state.numParticles == base.numParticles
+			&& header->state.numSharks == base.numSharks
+			&& header->state.liveParticles <= base.numParticles
+			&& header->events <= base.numParticles
+			&& data.size() >= deltaLayout( base.numParticles, base.numSharks, header->events ).size;
+		if ( !valid )
+			break;
+		deltas_.push_back( std::move( data ) );
+	}
+}
+
+void SnapshotFile::upload( ParticleStore& particles, CudaDeviceArray<float>& sharks, CudaDeviceArray<float>& sharkState, cudaStream_t stream )
+{
+	if ( !uploadBase( particles, sharks, sharkState, stream ) || deltas_.empty() )
+		return;
+
+	// The chain is applied in order on the GPU, each checkpoint goes through pinned memory once.
+	const SnapshotHeader& base = getBaseHeader();
+	size_t largest = 0;
+	for ( const std::vector<char>& delta : deltas_ )
+		largest = std::max( largest, delta.size() );
+	CudaHostArray<char> staging( largest );
+	CudaDeviceArray<char> records( largest );
+	for ( const std::vector<char>& delta : deltas_ )
+	{
+		const DeltaHeader& header = *reinterpret_cast< const DeltaHeader* >( delta.data() );
+		DeltaLayout layout = deltaLayout( base.numParticles, base.numSharks, header.events );
+		std::memcpy( staging.getData(), delta.data(), layout.size );
+		records.setAsync( staging.getData(), layout.size, stream );
+		kernel_apply_checkpoint( particles.getArrays(), base.numParticles, reinterpret_cast< const short* >( records.getData() + layout.deltas ), layout.stride,
+			header.range, reinterpret_cast< const CheckpointEvent* >( records.getData() + layout.events ), header.events, stream );
+		sharks.setAsync( reinterpret_cast< const float* >( staging.getData() + layout.sharks ), base.numSharks * 4, stream );
+		sharkState.setAsync( reinterpret_cast< const float* >( staging.getData() + layout.sharkState ), base.numSharks * 4, stream );
+		CUDA_CHECK( cudaStreamSynchronize( stream ) );							// staging is reused by the next checkpoint
+	}
+}
+
+bool SnapshotFile::uploadBase( ParticleStore& particles, CudaDeviceArray<float>& sharks, CudaDeviceArray<float>& sharkState, cudaStream_t stream )
+{
+	const SnapshotHeader& header = getBaseHeader();
+	SnapshotLayout layout = snapshotLayout( header.numParticles, header.numSharks );
+
+	if ( header.compression != 0 )
+	{
+		// Only the records cross the bus, they are decompressed into the store on the GPU.
+		size_t bytes[11];
+		arrayBytes( header.numParticles, header.numSharks, bytes );
+		size_t start = align( sizeof( SnapshotHeader ) );
+		CudaHostArray<char> staging( size_ - start );
+		std::memcpy( staging.getData(), data_ + start, size_ - start );
+		CudaDeviceArray<char> records( size_ - start );
+		records.setAsync( staging.getData(), size_ - start, stream );
+
+		Compression compression = static_cast< Compression >( header.compression );
+		size_t capacity = std::max( header.numParticles, header.numSharks * 4 );
+		GpuCompressor words( compression, capacity * sizeof( float ), sizeof( float ) );
+		GpuCompressor flags( words.isEnabled() ? compression : Compression::OFF, capacity, sizeof( unsigned char ) );
+		if ( !words.isEnabled() || !flags.isEnabled() )
+		{
+			std::cerr << "The snapshot is compressed (" << compressionName( compression ) << "), nothing restored." << std::endl;
+			return false;
+		}
+
+		float* arrays[7];
+		floatArrays( particles.getArrays(), arrays );
+		void* targets[11] = { arrays[0], arrays[1], arrays[2], arrays[3], arrays[4], arrays[5], arrays[6], particles.getArrays().alive, particles.getArrays().id,
+			sharks.getData(), sharkState.getData() };
+		size_t offset = 0;
+		for ( int i = 0; i < 11; i++ )
+		{
+			if ( bytes[i] == 0 )
+				continue;
+			( i == 7 ? flags : words ).decompress( records.getData() + offset, targets[i], bytes[i], stream );
+			unsigned long long recordBytes;
+			std::memcpy( &recordBytes, staging.getData() + offset, sizeof( recordBytes ) );	// Checked by open
+			offset += static_cast< size_t >( recordBytes );
+		}
+		CUDA_CHECK( cudaStreamSynchronize( stream ) );							// The buffers are freed at the return
+		return true;
+	}
+
+	// The pages of the mapping are read once into pinned memory, so the copies to the GPU run with full bandwidth.
+	CudaHostArray<char> staging( layout.size );
+	std::memcpy( staging.getData(), data_, layout.size );
+	const char* data = staging.getData();
+
+	float* arrays[7];
+	floatArrays( particles.getArrays(), arrays );
+	size_t n = header.numParticles;
+	for ( int i = 0; i < 7; i++ )
+		CUDA_CHECK( cudaMemcpyAsync( arrays[i], data + layout.floats[i], n * sizeof( float ), cudaMemcpyHostToDevice, stream ) );
+	CUDA_CHECK( cudaMemcpyAsync( particles.getArrays().alive, data + layout.alive, n * sizeof( unsigned char ), cudaMemcpyHostToDevice, stream ) );
+	CUDA_CHECK( cudaMemcpyAsync( particles.getArrays().id, data + layout.id, n * sizeof( unsigned int ), cudaMemcpyHostToDevice, stream ) );
+	sharks.setAsync( reinterpret_cast< const float* >( data + layout.sharks ), header.numSharks * 4, stream );
+	sharkState.setAsync( reinterpret_cast< const float* >( data + layout.sharkState ), header.numSharks * 4, stream );
+	CUDA_CHECK( cudaStreamSynchronize( stream ) );								// staging is freed at the return
+	return true;
+}
@@ -0,0 +1,81 @@
+#include <algorithm>
+
+#include "spatial_query.h"
+#include "nvtx_range.h"
+
+SpatialQuery::SpatialQuery( SwarmSimulation& simulation, unsigned int maxProbes, unsigned int maxK ) :
+	simulation_( simulation ),
+	maxProbes_( std::max( maxProbes, 1u ) ),
+	maxK_( std::min( std::max( maxK, 1u ), QUERY_MAX_K ) ),
+	d_probes_( maxProbes_, MemoryCategory::OTHER ),
+	d_counts_( maxProbes_, MemoryCategory::OTHER ),
+	d_ids_( static_cast< size_t >( maxProbes_ ) * maxK_, MemoryCategory::OTHER ),
+	d_distances_( static_cast< size_t >( maxProbes_ ) * maxK_, MemoryCategory::OTHER ),
+	d_fallback_( maxProbes_ + 1, MemoryCategory::OTHER )
+{
+	probesHost_ = new CudaHostArray<float4>( maxProbes_ );
+	counts_ = new CudaHostArray<unsigned int>( maxProbes_ );
+	ids_ = new CudaHostArray<unsigned int>( static_cast< size_t >( maxProbes_ ) * maxK_ );
+	distances_ = new CudaHostArray<float>( static_cast< size_t >( maxProbes_ ) * maxK_ );
+	CUDA_CHECK( cudaEventCreateWithFlags( &done_, cudaEventDisableTiming ) );
+	CUDA_CHECK( cudaEventRecord( done_, simulation_.getStream() ) );			// No query running
+}
+
+SpatialQuery::~SpatialQuery()
+{
+	wait();
+	CUDA_CHECK( cudaEventDestroy( done_ ) );
+	delete probesHost_;
+	delete counts_;
+	delete ids_;
+	delete distances_;
+}
+
+unsigned int SpatialQuery::upload( const float* probes, unsigned int count )
+{
+	wait();																		// probesHost_ is read by the last copy
+	count = std::min( count, maxProbes_ );
+	float4* staging = probesHost_->getData();
+	for ( unsigned int i = 0; i < count; i++ )
+		staging[i] = make_float4( probes[i * 3], probes[i * 3 + 1], probes[i * 3 + 2], 0.0f );
+	CUDA_CHECK( cudaMemcpyAsync( d_probes_.getData(), staging, count * sizeof( float4 ), cudaMemcpyHostToDevice, simulation_.getStream() ) );
+	probeCount_ = count;
+	return count;
+}
+
+void SpatialQuery::countWithin( const float* probes, unsigned int count, float radius )
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "SpatialQuery::countWithin", NVTX_COLOR_SIMULATION );
+
+	cudaStream_t stream = simulation_.getStream();
+	count = upload( probes, count );
+	k_ = 0;
+	kernel_query_radius( simulation_.getParticles(), simulation_.getLiveCount(), d_probes_.getData(), count, radius, d_counts_.getData(), stream );
+	CUDA_CHECK( cudaMemcpyAsync( counts_->getData(), d_counts_.getData(), count * sizeof( unsigned int ), cudaMemcpyDeviceToHost, stream ) );
+	CUDA_CHECK( cudaEventRecord( done_, stream ) );
+}
+
+void SpatialQuery::nearest( const float* probes, unsigned int count, unsigned int k )
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "SpatialQuery::nearest", NVTX_COLOR_SIMULATION );
+
+	cudaStream_t stream = simulation_.getStream();
+	count = upload( probes, count );
+	k_ = std::min( std::max( k, 1u ), maxK_ );
+	kernel_query_nearest( simulation_.getParticles(), simulation_.getLiveCount(), d_probes_.getData(), count, k_,
+		d_ids_.getData(), d_distances_.getData(), d_fallback_.getData(), stream );
+	size_t results = static_cast< size_t >( count ) * k_;
+	CUDA_CHECK( cudaMemcpyAsync( ids_->getData(), d_ids_.getData(), results * sizeof( unsigned int ), cudaMemcpyDeviceToHost, stream ) );
+	CUDA_CHECK( cudaMemcpyAsync( distances_->getData(), d_distances_.getData(), results * sizeof( float ), cudaMemcpyDeviceToHost, stream ) );
+	CUDA_CHECK( cudaEventRecord( done_, stream ) );
+}
+
+bool SpatialQuery::isReady() const
+{
+	return cudaEventQuery( done_ ) == cudaSuccess;
+}
+
+void SpatialQuery::wait() const
+{
+	CUDA_CHECK( cudaEventSynchronize( done_ ) );
+}
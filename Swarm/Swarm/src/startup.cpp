@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "cuda_device.h"
+#include "renderer.h"
+#include "startup.h"
+
+StartupOrchestrator::StartupOrchestrator( const SwarmConfig& config ) :
+	configDevice_( config.device )
+{
+	main_.end( "arguments" );													// Static initialization, config and scenario files
+	if ( !config.parallelStartup || config.backend != Backend::CUDA || CudaDevice::getDeviceCount() == 0 )
+		return;
+
+	SwarmConfig simulation = Renderer::simulationConfig( config );
+	started_ = true;
+	worker_ = std::thread( [this, simulation]()
+	{
+		cuda_ = StartupPhases( "cuda" );
+		CUDA_CHECK( cudaSetDevice( CudaDevice::selectDevice( simulation.device ) ) );	// No OpenGL context here: the configured or the biggest GPU
+		CUDA_CHECK( cudaFree( 0 ) );											// Creates the primary context, shared with the main thread
+		cuda_.end( "CUDA context" );
+		contextMs_ = cuda_.get().back().ms;
+
+		simulation_ = new SwarmSimulation( simulation, true );					// Module loading (kernel_print_resources), grid, spawn kernels
+		cuda_.append( simulation_->getStartupPhases() );
+		CUDA_CHECK( cudaStreamSynchronize( simulation_->getStream() ) );		// Count the spawn here, not in the first frame
+		cuda_.end( "spawn wait" );
+		simulationMs_ = cuda_.lastMs() - cuda_.get().front().startMs - contextMs_;
+	} );
+}
+
+StartupOrchestrator::~StartupOrchestrator()
+{
+	if ( worker_.joinable() )
+		worker_.join();
+	if ( simulation_ != NULL )
+	{
+		simulation_->cleanUp();
+		delete simulation_;
+	}
+}
+
+void StartupOrchestrator::phase( const std::string& name )
+{
+	main_.end( name );
+}
+
+void StartupOrchestrator::phase( const std::string& name, const std::string& tail, double tailMs )
+{
+	main_.end( name, tail, tailMs );
+}
+
+void StartupOrchestrator::append( const StartupPhases& phases )
+{
+	main_.append( phases );
+}
+
+SwarmSimulation* StartupOrchestrator::join()
+{
+	if ( !started_ )
+		return NULL;
+
+	worker_.join();
+	phase( "wait for CUDA" );
+
+	SwarmSimulation* simulation = simulation_;
+	simulation_ = NULL;
+	int device = simulation->getDevice().getDevice();
+	std::vector<int> glDevices = CudaDevice::getGLDevices();
+	if ( configDevice_ < 0 && !glDevices.empty() && std::find( glDevices.begin(), glDevices.end(), device ) == glDevices.end() )
+	{
+		std::cout << "The window runs on another GPU than device " << device << ", spawning the swarm again" << std::endl;
+		simulation->cleanUp();
+		delete simulation;
+		return NULL;
+	}
+
+	CUDA_CHECK( cudaSetDevice( device ) );										// The main thread launches from now on
+	return simulation;
+}
+
+void StartupOrchestrator::report( std::ostream& os ) const
+{
+	os << std::fixed << std::setprecision( 1 ) << "Startup:";
+	const std::vector<StartupPhases::Phase>& phases = main_.get();
+	for ( size_t i = 0; i < phases.size(); i++ )
+		os << ( i == 0 ? " " : ", " ) << phases[i].name << " " << phases[i].ms << " ms";
+	os << ", total " << main_.lastMs() << " ms\n";
+	if ( started_ )
+		os << "Startup in the background: CUDA context " << contextMs_ << " ms, simulation " << simulationMs_ << " ms\n";
+	os << std::defaultfloat << std::flush;
+}
+
+bool StartupOrchestrator::writeJson( const std::string& path ) const
+{
+	std::ofstream file( path );
+	if ( !file )
+	{
+		std::cerr << "Impossible to open " << path << "!" << std::endl;
+		return false;
+	}
+
+	StartupPhases phases = main_;
+	if ( started_ )
+		phases.merge( cuda_ );
+	phases.writeJson( file );
+	return static_cast< bool >( file );
+}
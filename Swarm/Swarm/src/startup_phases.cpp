@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <iomanip>
+
+#include "startup_phases.h"
+
+static const StartupPhases::Clock::time_point PROCESS_START = StartupPhases::Clock::now();	// Static initialization, before main
+
+/*!
+ * @brief Milliseconds between two points of time.
+ * @param from start.
+ * @param to end.
+ * @return ms.
+ */
+static double elapsedMs( StartupPhases::Clock::time_point from, StartupPhases::Clock::time_point to )
+{
+	return std::chrono::duration<double, std::milli>( to - from ).count();
+}
+
+/*!
+ * @brief Write a string as JSON string, with quotes and escapes.
+ * @param os stream.
+ * @param text text.
+ */
+static void writeJsonString( std::ostream& os, const std::string& text )
+{
+	os << '"';
+	for ( char c : text )
+	{
+		if ( c == '"' || c == '\\' )
+			os << '\\';
+		os << c;
+	}
+	os << '"';
+}
+
+StartupPhases::StartupPhases( const std::string& thread ) :
+	thread_( thread ),
+	last_( Clock::now() )
+{
+}
+
+StartupPhases::StartupPhases( const std::string& thread, Clock::time_point start ) :
+	thread_( thread ),
+	last_( start )
+{
+}
+
+double StartupPhases::sinceProcessStart()
+{
+	return elapsedMs( PROCESS_START, Clock::now() );
+}
+
+StartupPhases::Clock::time_point StartupPhases::processStart()
+{
+	return PROCESS_START;
+}
+
+void StartupPhases::end( const std::string& name )
+{
+	Clock::time_point now = Clock::now();
+	phases_.push_back( { name, thread_, elapsedMs( PROCESS_START, last_ ), elapsedMs( last_, now ) } );
+	last_ = now;
+}
+
+void StartupPhases::end( const std::string& name, const std::string& tail, double tailMs )
+{
+	Clock::time_point now = Clock::now();
+	double total = elapsedMs( last_, now );
+	double start = elapsedMs( PROCESS_START, last_ );
+	tailMs = tailMs < total ? tailMs : total;
+	phases_.push_back( { name, thread_, start, total - tailMs } );
+	phases_.push_back( { tail, thread_, start + total - tailMs, tailMs } );
+	last_ = now;
+}
+
+void StartupPhases::append( const StartupPhases& other )
+{
+	for ( Phase phase : other.phases_ )
+	{
+		phase.thread = thread_;
+		phases_.push_back( phase );
+	}
+	if ( other.last_ > last_ )
+		last_ = other.last_;
+}
+
+void StartupPhases::merge( const StartupPhases& other )
+{
+	phases_.insert( phases_.end(), other.phases_.begin(), other.phases_.end() );
+	std::stable_sort( phases_.begin(), phases_.end(), []( const Phase& a, const Phase& b ) { return a.startMs < b.startMs; } );
+}
+
+double StartupPhases::lastMs() const
+{
+	return elapsedMs( PROCESS_START, last_ );
+}
+
+void StartupPhases::writeJson( std::ostream& os ) const
+{
+	os << std::fixed << std::setprecision( 3 ) << "{\n  \"total_ms\": " << lastMs() << ",\n  \"phases\": [";
+	for ( size_t i = 0; i < phases_.size(); i++ )
+	{
+		const Phase& phase = phases_[i];
+		os << ( i == 0 ? "\n" : ",\n" ) << "    { \"name\": ";
+		writeJsonString( os, phase.name );
+		os << ", \"thread\": ";
+		writeJsonString( os, phase.thread );
+		os << ", \"start_ms\": " << phase.startMs << ", \"ms\": " << phase.ms << " }";
+	}
+	os << "\n  ]\n}\n" << std::defaultfloat;
+}
@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <cmath>
+
+#include "stats_ring.h"
+#include "nvtx_range.h"
+
+StatsRing::StatsRing( unsigned int length, float readInterval, float binWidth ) :
+	length_( length ),
+	readInterval_( readInterval ),
+	binWidth_( binWidth ),
+	d_ring_( length, MemoryCategory::SCRATCH ),
+	d_probes_( length > 0 ? PROBES : 0, MemoryCategory::SCRATCH ),
+	d_ids_( length > 0 ? 2 * PROBES : 0, MemoryCategory::SCRATCH ),
+	d_distances_( length > 0 ? 2 * PROBES : 0, MemoryCategory::SCRATCH ),
+	d_fallback_( length > 0 ? PROBES + 1 : 0, MemoryCategory::SCRATCH )
+{
+	if ( length_ == 0 )
+		return;
+
+	host_ = new CudaHostArray<StatsSample>( length_ );
+	series_.reserve( length_ );													// The read backs don't allocate
+	CUDA_CHECK( cudaMemset( d_ring_.getData(), 0, length_ * sizeof( StatsSample ) ) );
+	CUDA_CHECK( cudaEventCreateWithFlags( &copied_, cudaEventDisableTiming ) );
+}
+
+StatsRing::~StatsRing()
+{
+	if ( length_ == 0 )
+		return;
+
+	CUDA_CHECK( cudaEventSynchronize( copied_ ) );								// host_ may still be written
+	CUDA_CHECK( cudaEventDestroy( copied_ ) );
+	delete host_;
+}
+
+void StatsRing::record( ParticleArrays particles, unsigned int mesh_count, unsigned long long step, cudaStream_t stream )
+{
+	if ( length_ == 0 )
+		return;
+
+	NVTX_RANGE( NvtxDomain::RENDERER, "StatsRing::record", NVTX_COLOR_SIMULATION );
+	StatsSample* const sample = d_ring_.getData() + written_ % length_;
+	unsigned int probes = 0;
+	if ( !kernel_has_advance_nearest() )										// Else the analytics take the closest fishies of the step, all of them
+	{
+		probes = std::min( mesh_count, PROBES );
+		kernel_stats_probes( particles, mesh_count, d_probes_.getData(), probes, stream );
+		kernel_query_nearest( particles, mesh_count, d_probes_.getData(), probes, 2, d_ids_.getData(), d_distances_.getData(),
+			d_fallback_.getData(), stream );									// The closest one is the probe itself
+	}
+	kernel_stats_sample( d_probes_.getData(), probes, d_distances_.getData(), binWidth_, step, sample, stream );
+	kernel_swarm_analytics( particles, mesh_count, binWidth_, sample, stream );	// Density, alignment and polarisation
+	written_++;
+}
+
+bool StatsRing::update( double now, cudaStream_t stream )
+{
+	if ( length_ == 0 )
+		return false;
+
+	bool arrived = false;
+	if ( copyPending_ && cudaEventQuery( copied_ ) == cudaSuccess )
+	{
+		unsigned long long const first = copyWritten_ - std::min( copyWritten_, static_cast< unsigned long long >( length_ ) );
+		series_.clear();
+		for ( unsigned long long i = first; i < copyWritten_; i++ )				// Oldest first, the ring wraps around
+			series_.push_back( ( *host_ )[i % length_] );
+		copyPending_ = false;
+		arrived = true;
+	}
+
+	if ( !copyPending_ && written_ > 0 && ( lastRead_ < 0.0 || now - lastRead_ >= readInterval_ ) )
+	{
+		CUDA_CHECK( cudaMemcpyAsync( host_->getData(), d_ring_.getData(), length_ * sizeof( StatsSample ), cudaMemcpyDeviceToHost, stream ) );
+		CUDA_CHECK( cudaEventRecord( copied_, stream ) );
+		copyPending_ = true;
+		copyWritten_ = written_;
+		lastRead_ = now;
+	}
+	return arrived;
+}
+
+float StatsRing::nearestPercentile( const StatsSample& sample, float percent ) const
+{
+	if ( sample.sampled == 0 )
+		return 0.0f;
+
+	float const wanted = percent / 100.0f * sample.sampled;
+	unsigned int below = 0;
+	for ( unsigned int bin = 0; bin < NEAREST_BINS; bin++ )
+	{
+		unsigned int const count = sample.nearest[bin];
+		if ( count > 0 && below + count >= wanted )
+			return ( bin + ( wanted - below ) / count ) * binWidth_;
+		below += count;
+	}
+	return NEAREST_BINS * binWidth_;
+}
+
+float StatsRing::polarisation( const StatsSample& sample )
+{
+	if ( sample.headed == 0 )
+		return 0.0f;
+
+	const float3& sum = sample.headingSum;
+	return std::sqrt( sum.x * sum.x + sum.y * sum.y + sum.z * sum.z ) / sample.headed;
+}
+
+unsigned int StatsRing::densityMedian( const StatsSample& sample )
+{
+	unsigned int total = 0;
+	for ( unsigned int bin = 0; bin < DENSITY_BINS; bin++ )
+		total += sample.density[bin];
+	unsigned int below = 0;
+	for ( unsigned int bin = 0; bin < DENSITY_BINS; bin++ )
+	{
+		below += sample.density[bin];
+		if ( total > 0 && 2 * below >= total )
+			return 1u << bin;													// Lower end of the bin
+	}
+	return 0;
+}
@@ -0,0 +1,66 @@
+#include <glew.h>
+
+#include "streaming_vertex_buffer.h"
+
+StreamingVertexBuffer::StreamingVertexBuffer( unsigned int regionSize ) :
+	VertexBuffer(),
+	regionSize_( regionSize )
+{
+	if ( GLEW_ARB_buffer_storage )
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage( GL_ARRAY_BUFFER, regionSize_ * FRAMES, NULL, flags );
+		mapped_ = static_cast< char* >( glMapBufferRange( GL_ARRAY_BUFFER, 0, regionSize_ * FRAMES, flags ) );	// Stays mapped
+	}
+	else
+	{
+		glBufferData( GL_ARRAY_BUFFER, regionSize_ * FRAMES, NULL, GL_STREAM_DRAW );
+		staging_.resize( regionSize_ );
+	}
+	trackStorage( regionSize_ * FRAMES );
+}
+
+StreamingVertexBuffer::~StreamingVertexBuffer()
+{
+	for ( GLsync fence : fences_ )
+		if ( fence != NULL )
+			glDeleteSync( fence );
+
+	if ( mapped_ != NULL )
+	{
+		bind();
+		glUnmapBuffer( GL_ARRAY_BUFFER );
+		unbind();
+	}
+}
+
+void* StreamingVertexBuffer::beginWrite()
+{
+	if ( mapped_ == NULL )
+	{
+		region_ = ( region_ + 1 ) % FRAMES;
+		return staging_.data();
+	}
+
+	fences_[region_] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );		// After the draws from the last region
+	region_ = ( region_ + 1 ) % FRAMES;
+
+	GLsync& fence = fences_[region_];
+	if ( fence != NULL )														// Normally signaled since two frames
+	{
+		glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64( 1000000000 ) );
+		glDeleteSync( fence );
+		fence = NULL;
+	}
+	return mapped_ + region_ * regionSize_;
+}
+
+void StreamingVertexBuffer::commit()
+{
+	if ( mapped_ != NULL )														// Coherent mapping, nothing to flush
+		return;
+
+	bind();
+	glBufferSubData( GL_ARRAY_BUFFER, region_ * regionSize_, regionSize_, staging_.data() );
+	unbind();
+}
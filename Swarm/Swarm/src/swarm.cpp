@@ -1,7 +1,24 @@
 #include "Window.hpp"
 #include "renderer.h"
+#include "compute_renderer.h"
+#include "gl_features.h"
 #include "vec3.h"
 #include "cuda_device.h"
+#include "swarm_config.h"
+#include "headless_simulation.h"
+#include "ensemble_simulation.h"
+#include "sweep_driver.h"
+#include "cpu_simulation.h"
+#include "thrust_simulation.h"
+#include "multi_gpu_simulation.h"
+#include "out_of_core_simulation.h"
+#include "mpi_simulation.h"
+#include "validation_run.h"
+#include "startup.h"
+#include "scene_target.h"
+#include "camera_path.h"
+#include "trajectory_player.h"
+#include "interop_benchmark.h"
 
 #include <vector>
 #include <fstream>
@@ -16,27 +33,236 @@ std::string windowTitle = "Fish Swarm";
 
 /*!
  * @brief Main
- * @return 0
+ * @param argc number of arguments
+ * @param argv arguments (--config <file>, --particles <n>, --sharks <n>, --headless <steps>, --ensemble <n>, --sweep <param:from:to:n,...>, --gpus <n>, --mpi <0|1>, --bricks <n>, --validate <steps>, --benchmark <0|1>, --backend <cuda|gl|cpu|thrust>, --threads <n>, --video <file>)
+ * @return 0, 1 if the validation failed or the backend isn't supported
  */
-int main()
+int main( int argc, char** argv )
 {
+	SwarmConfig config = SwarmConfig::fromCommandLine( argc, argv );
+	std::cout << config << std::endl;
+	CudaDevice::configureComputeCache( config.computeCache );					// Before the first CUDA call, the driver reads it once
+	CudaDevice::enableGLDevices();												// Rank the GPU of the window first
+	CudaMallocAllocator::setUnifiedMemory( config.unifiedMemory );				// Before any simulation allocates
+
+	bool hasCuda = CudaDevice::getDeviceCount() > 0;
+	if ( !hasCuda && ( config.validateSteps > 0 || config.gpus != 1 || config.mpi || config.bricks > 1 || config.ensemble > 0 || !config.sweep.empty() || !config.playback.empty() ) )
+	{
+		std::cerr << "Validation, ensembles, sweeps, bricks, MPI, several GPUs and the playback need a CUDA device!" << std::endl;
+		return 1;
+	}
+
+	if ( config.validateSteps > 0 )												// Compare the search with brute force, no window
+	{
+		ValidationRun validation( config );
+		bool passed = validation.run( config.validateSteps );
+		validation.cleanUp();
+		return passed ? 0 : 1;
+	}
+
+	if ( config.headlessSteps > 0 && !config.sweep.empty() )					// Run matrix sharded over all GPUs, no window
+	{
+		SweepDriver sweep( config );
+		sweep.run( config.headlessSteps );
+		sweep.cleanUp();
+		return 0;
+	}
+
+	if ( config.headlessSteps > 0 && config.ensemble > 0 )						// Independent swarms in one launch, no window
+	{
+		EnsembleSimulation simulation( config );
+		simulation.run( config.headlessSteps );
+		simulation.cleanUp();
+		return 0;
+	}
+
+	if ( config.headlessSteps > 0 && config.mpi )								// Slabs on the ranks of a cluster, no window
+	{
+#ifdef SWARM_MPI
+		MPI_Init( &argc, &argv );
+		{
+			MpiSimulation simulation( config, MPI_COMM_WORLD );
+			simulation.run( config.headlessSteps );
+			simulation.cleanUp();
+		}
+		MPI_Finalize();
+		return 0;
+#else
+		std::cerr << "Built without MPI, define SWARM_MPI and link the MPI library" << std::endl;
+		return 1;
+#endif
+	}
+
+	if ( config.headlessSteps > 0 && config.bricks > 1 )						// Larger than device memory: bricks streamed through one GPU, no window
+	{
+		OutOfCoreSimulation simulation( config );
+		simulation.run( config.headlessSteps );
+		simulation.cleanUp();
+		return 0;
+	}
+
+	if ( config.headlessSteps > 0 && config.gpus != 1 )							// Slabs on several GPUs, no window
+	{
+		MultiGpuSimulation simulation( config );
+		simulation.run( config.headlessSteps );
+		simulation.cleanUp();
+		return 0;
+	}
+
+	if ( config.headlessSteps > 0 && config.backend == Backend::THRUST && ( hasCuda || !ThrustSimulation::needsCuda() ) )	// Portable reference
+	{
+		ThrustSimulation simulation( config );
+		simulation.run( config.headlessSteps );
+		return 0;
+	}
+
+	if ( config.headlessSteps > 0 && ( config.backend == Backend::CPU || !hasCuda ) )	// No GPU at all
+	{
+		if ( !hasCuda )
+			std::cout << "No CUDA device, simulating on the CPU" << std::endl;
+		CpuSimulation simulation( config );
+		simulation.run( config.headlessSteps );
+		return 0;
+	}
+
+	bool headlessVideo = config.headlessSteps > 0 && !config.video.empty() && config.backend == Backend::CUDA;	// Hidden window, the renderer encodes the frames
+	if ( config.headlessSteps > 0 && !headlessVideo )							// No window, no OpenGL
+	{
+		HeadlessSimulation simulation( config );
+		simulation.run( config.headlessSteps );
+		simulation.cleanUp();
+		return 0;
+	}
+
+	if ( config.backend == Backend::CPU || config.backend == Backend::THRUST )
+	{
+		std::cerr << "The " << ( config.backend == Backend::CPU ? "CPU" : "Thrust" ) << " backend has no window, use --headless <steps>!" << std::endl;
+		return 1;
+	}
+	if ( !hasCuda && config.backend == Backend::CUDA )
+	{
+		std::cout << "No CUDA device, simulating with OpenGL compute shaders" << std::endl;
+		config.backend = Backend::GL_COMPUTE;
+	}
+
+	CameraPath cameraPath( config.cameraRecord, config.cameraReplay, config.seed );
+	if ( cameraPath.isReplaying() )
+	{
+		config.seed = cameraPath.getSeed();										// Same swarm as in the recording
+		if ( config.profileInterval == 0 )
+			config.profileInterval = SwarmConfig().profileInterval;				// The report needs the stage timers
+	}
+	if ( !config.interopBench.empty() && !hasCuda )
+	{
+		std::cerr << "The interop benchmark needs a CUDA device!" << std::endl;
+		return 1;
+	}
+	if ( !config.playback.empty() || !config.interopBench.empty() )
+		config.parallelStartup = false;											// Nothing is simulated
+	StartupOrchestrator startup( config );										// CUDA context and swarm on a thread while the window opens
+
 	Window* window = Window::getInstance();
+	startup.phase( "GLFW init" );
+	window->setBenchmarkMode( config.benchmark || headlessVideo || cameraPath.isReplaying() );	// V-Sync off for benchmarks, one step per video or replayed frame
+	window->setKeyLog( cameraPath.isRecording() );
+	window->setVisible( !headlessVideo );
+	if ( headlessVideo && config.egl )
+		window->setEglDevice( config.device < 0 ? 0 : config.device );			// No window system on render farm nodes, the frames go into the FBOs of the recorder
+	window->setSamples( SceneTarget::isNeeded( config ) ? 0 : config.msaa );	// The scene target has its own samples
+	if ( config.backend == Backend::GL_COMPUTE && config.glVersion < 43 )
+		config.glVersion = 43;													// Compute shaders
+	window->setGLVersion( config.glVersion / 10, config.glVersion % 10 );		// Newer contexts enable direct state access
 
-	window->open( windowTitle, 1600, 1200 );
+	window->open( windowTitle, config.windowWidth, config.windowHeight );
 	window->setEyePoint( glm::vec4( 0.0f, 0.0f, 1000.0f, 1.0f ) );
 	window->setActive();
+	startup.phase( "window", "GLEW init", window->getGlewInitTime() * 1000.0 );
 
-	Renderer renderer;
+	if ( !config.interopBench.empty() )											// Transfer strategies only, no swarm
+	{
+		bool written;
+		{
+			InteropBenchmark benchmark( config );
+			benchmark.run();
+			benchmark.report( std::cout );
+			written = benchmark.writeJson( config.interopBench );
+		}
+		window->close();
+		return written ? 0 : 1;
+	}
 
+	SimulationBackend* renderer = NULL;
+	if ( !config.playback.empty() )
+	{
+		TrajectoryPlayer* player = new TrajectoryPlayer( config );				// Recorded frames instead of steps
+		if ( !player->isOpen() )
+		{
+			player->cleanUp();
+			delete player;
+			return 1;
+		}
+		renderer = player;
+	}
+	else if ( config.backend == Backend::GL_COMPUTE )
+	{
+		if ( window->getGLVersion() < 43 || !glHasComputeShaders() )			// The context fell back to 3.3
+		{
+			std::cerr << "The OpenGL compute backend needs OpenGL 4.3!" << std::endl;
+			return 1;
+		}
+		renderer = new ComputeRenderer( config );								// No CUDA at all
+	}
+	else
+	{
+		renderer = new Renderer( config, &startup );
+	}
+	startup.phase( "renderer" );
+
+	bool firstFrame = true;
 	while ( window->isOpen() )
 	{
-		renderer.render();
+		if ( ( window->isPaused() || window->isIconified() ) && !firstFrame && !window->consumeRedraw() )
+		{
+			window->waitEvents();												// Sleep until a key, resize or expose, no GPU work
+			continue;
+		}
+
+		if ( !cameraPath.frame( *window ) )										// Replay done: the stage times of the flight
+		{
+			std::cout << cameraPath.report() << std::endl;
+			window->close();
+			break;
+		}
+		renderer->render();
+		cameraPath.collect( renderer->getProfiler() );							// Frame of the last beginFrame
+		if ( firstFrame && !config.startupBench.empty() )
+		{
+			glFinish();															// First kernels and draws, without the present
+			startup.phase( "first frame" );
+		}
 
-		window->updateDisplay();
+		{
+			ScopedHostTimer timer( renderer->getProfiler(), FrameStage::SWAP );
+			ScopedFramePart present( renderer->getFrameTimes(), FramePart::PRESENT );
+			window->updateDisplay();
+		}
 		window->setActive();
+
+		if ( firstFrame )														// Time to first frame
+		{
+			startup.phase( config.startupBench.empty() ? "first frame" : "first present" );
+			startup.report( std::cout );
+			firstFrame = false;
+			if ( !config.startupBench.empty() )									// Startup benchmark: one frame only
+			{
+				startup.writeJson( config.startupBench );
+				window->close();
+			}
+		}
 	}
 
-	renderer.cleanUp();
+	renderer->cleanUp();
+	delete renderer;
 
 	return 0;
 }
@@ -0,0 +1,982 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "position_ring.h"
+#include "swarm_config.h"
+
+/*!
+ * @brief Remove leading and trailing whitespaces.
+ * @param str string.
+ * @return trimmed string.
+ */
+static std::string trim( const std::string& str )
+{
+	size_t first = str.find_first_not_of( " \t\r" );
+	if ( first == std::string::npos )
+		return "";
+	size_t last = str.find_last_not_of( " \t\r" );
+	return str.substr( first, last - first + 1 );
+}
+
+/*!
+ * @brief Parse a positive float.
+ * @param value string.
+ * @param result parsed float.
+ * @return true, if value is a positive float.
+ */
+static bool parseFloat( const std::string& value, float& result )
+{
+	std::istringstream stream( value );
+	float number;
+	if ( !( stream >> number ) || number <= 0.0f )
+		return false;
+	result = number;
+	return true;
+}
+
+/*!
+ * @brief Parse a flag (1/0, true/false, on/off).
+ * @param value string.
+ * @param result parsed flag.
+ * @return true, if value is a flag.
+ */
+static bool parseFlag( const std::string& value, bool& result )
+{
+	if ( value == "1" || value == "true" || value == "on" )
+		result = true;
+	else if ( value == "0" || value == "false" || value == "off" )
+		result = false;
+	else
+		return false;
+	return true;
+}
+
+/*!
+ * @brief Parse a number.
+ * @param value string.
+ * @param result parsed number.
+ * @param minimum smallest valid number.
+ * @return true, if value is a number >= minimum.
+ */
+static bool parseCount( const std::string& value, unsigned int& result, long long minimum = 1 )
+{
+	std::istringstream stream( value );
+	long long number;
+	if ( !( stream >> number ) || number < minimum )
+		return false;
+	result = static_cast< unsigned int >( number );
+	return true;
+}
+
+/*!
+ * @brief Parse a vector.
+ * @param value string "x,y,z".
+ * @param result parsed vector.
+ * @return true, if value holds three comma separated floats.
+ */
+static bool parseVector( const std::string& value, Vector3& result )
+{
+	std::istringstream stream( value );
+	float x, y, z;
+	char first = 0, second = 0;
+	if ( !( stream >> x >> first >> y >> second >> z ) || first != ',' || second != ',' || !( stream >> std::ws ).eof() )
+		return false;
+	result = Vector3( x, y, z );
+	return true;
+}
+
+/*!
+ * @brief Parse a route.
+ * @param value string "x,y,z;x,y,z;...".
+ * @param result parsed waypoints.
+ * @return true, if value holds at least one waypoint and all of them are valid.
+ */
+static bool parseWaypoints( const std::string& value, std::vector<Vector3>& result )
+{
+	std::vector<Vector3> waypoints;
+	std::istringstream stream( value );
+	std::string point;
+	while ( std::getline( stream, point, ';' ) )
+	{
+		Vector3 waypoint;
+		if ( !parseVector( trim( point ), waypoint ) )
+			return false;
+		waypoints.push_back( waypoint );
+	}
+	if ( waypoints.empty() )
+		return false;
+	result = waypoints;
+	return true;
+}
+
+/*!
+ * @brief Parse the obstacles.
+ * @param value string "shape:x,y,z:size;...", shape sphere (size: radius), box or tank (size: hx,hy,hz half extent).
+ * @param result parsed obstacles.
+ * @return true, if value holds at least one obstacle and all of them are valid.
+ */
+static bool parseObstacles( const std::string& value, std::vector<Obstacle>& result )
+{
+	std::vector<Obstacle> obstacles;
+	std::istringstream stream( value );
+	std::string item;
+	while ( std::getline( stream, item, ';' ) )
+	{
+		std::istringstream fields( trim( item ) );
+		std::string shape, center, size;
+		if ( !std::getline( fields, shape, ':' ) || !std::getline( fields, center, ':' ) || !std::getline( fields, size ) )
+			return false;
+
+		Obstacle obstacle;
+		if ( !parseVector( trim( center ), obstacle.center ) )
+			return false;
+		shape = trim( shape );
+		if ( shape == "sphere" )
+		{
+			obstacle.shape = ObstacleShape::SPHERE;
+			float radius;
+			if ( !parseFloat( trim( size ), radius ) || radius <= 0.0f )
+				return false;
+			obstacle.size = Vector3( radius, radius, radius );
+		}
+		else if ( shape == "box" || shape == "tank" )
+		{
+			obstacle.shape = shape == "box" ? ObstacleShape::BOX : ObstacleShape::TANK;
+			if ( !parseVector( trim( size ), obstacle.size ) || obstacle.size.x <= 0.0f || obstacle.size.y <= 0.0f || obstacle.size.z <= 0.0f )
+				return false;
+		}
+		else
+			return false;
+		obstacles.push_back( obstacle );
+	}
+	if ( obstacles.empty() )
+		return false;
+	result = obstacles;
+	return true;
+}
+
+/*!
+ * @brief Parse the attractors.
+ * @param value string "x,y,z:strength:radius;...", negative strength: repulsor.
+ * @param result parsed attractors.
+ * @return true, if value holds at least one attractor and all of them are valid.
+ */
+static bool parseAttractors( const std::string& value, std::vector<Attractor>& result )
+{
+	std::vector<Attractor> attractors;
+	std::istringstream stream( value );
+	std::string item;
+	while ( std::getline( stream, item, ';' ) )
+	{
+		std::istringstream fields( trim( item ) );
+		std::string position, strength, radius;
+		if ( !std::getline( fields, position, ':' ) || !std::getline( fields, strength, ':' ) || !std::getline( fields, radius ) )
+			return false;
+
+		Attractor attractor;
+		std::istringstream strengthStream( trim( strength ) );
+		if ( !parseVector( trim( position ), attractor.position ) || !( strengthStream >> attractor.strength ) || !( strengthStream >> std::ws ).eof()
+			|| attractor.strength == 0.0f || !parseFloat( trim( radius ), attractor.radius ) )
+			return false;
+		attractors.push_back( attractor );
+	}
+	if ( attractors.empty() )
+		return false;
+	result = attractors;
+	return true;
+}
+
+/*!
+ * @brief Parse the species.
+ * @param value string "share:speed:perception:fear:mass_min:mass_max;...", perception at most 1, mass_max at least mass_min.
+ * @param result parsed species.
+ * @return true, if value holds one to MAX_SPECIES species and all of them are valid.
+ */
+static bool parseSpecies( const std::string& value, std::vector<SpeciesParams>& result )
+{
+	std::vector<SpeciesParams> species;
+	std::istringstream stream( value );
+	std::string item;
+	while ( std::getline( stream, item, ';' ) )
+	{
+		std::istringstream fields( trim( item ) );
+		std::string share, speed, perception, fear, massMin, massMax;
+		if ( !std::getline( fields, share, ':' ) || !std::getline( fields, speed, ':' ) || !std::getline( fields, perception, ':' )
+			|| !std::getline( fields, fear, ':' ) || !std::getline( fields, massMin, ':' ) || !std::getline( fields, massMax ) )
+			return false;
+
+		SpeciesParams entry;
+		if ( !parseFloat( trim( share ), entry.share ) || !parseFloat( trim( speed ), entry.speed ) || !parseFloat( trim( perception ), entry.perception )
+			|| !parseFloat( trim( fear ), entry.fear ) || !parseFloat( trim( massMin ), entry.massMin ) || !parseFloat( trim( massMax ), entry.massMax )
+			|| entry.perception > 1.0f || entry.massMax < entry.massMin )
+			return false;
+		species.push_back( entry );
+	}
+	if ( species.empty() || species.size() > MAX_SPECIES )
+		return false;
+	result = species;
+	return true;
+}
+
+/*!
+ * @brief Parse parameter sweeps of an ensemble: param:from:to, separated by commas, e.g. shark_dist:0.3:1.2,fish_dist:0.2:0.6.
+ * The axes of a grid sweep also have the number of values: param:from:to:n, e.g. fish_dist:0.2:0.6:5.
+ * @param value string.
+ * @param result parsed sweeps. Unchanged, if value is invalid.
+ * @param grid parse axes with the number of values.
+ * @return true, if every sweep names a behaviour parameter and has two values (and at least one value per axis).
+ */
+static bool parseSweeps( const std::string& value, std::vector<ParamSweep>& result, bool grid = false )
+{
+	std::vector<ParamSweep> sweeps;
+	std::istringstream stream( value );
+	std::string item;
+	while ( std::getline( stream, item, ',' ) )
+	{
+		std::istringstream fields( trim( item ) );
+		std::string name, from, to, values;
+		if ( !std::getline( fields, name, ':' ) || !std::getline( fields, from, ':' ) || !std::getline( fields, to, grid ? ':' : '\n' ) )
+			return false;
+		if ( grid && !std::getline( fields, values ) )
+			return false;
+
+		ParamSweep sweep;
+		sweep.name = trim( name );
+		if ( !findParam( sweep.name, sweep.field ) || !parseFloat( trim( from ), sweep.from ) || !parseFloat( trim( to ), sweep.to ) )
+			return false;
+		if ( grid && !parseCount( trim( values ), sweep.values ) )
+			return false;
+		sweeps.push_back( sweep );
+	}
+	if ( sweeps.empty() )
+		return false;
+	result = sweeps;
+	return true;
+}
+
+/*!
+ * @brief Names of the search modes. Same order as SearchMode.
+ */
+static const char* const SEARCH_MODE_NAMES[] = { "auto", "brute", "tiled", "grid", "warp", "verlet", "tensor", "cell" };
+
+const char* searchModeName( SearchMode mode )
+{
+	return SEARCH_MODE_NAMES[static_cast< int >( mode )];
+}
+
+/*!
+ * @brief Names of the color modes. Same order as ColorMode.
+ */
+static const char* const COLOR_MODE_NAMES[] = { "static", "speed", "fear", "school" };
+
+const char* colorModeName( ColorMode mode )
+{
+	return COLOR_MODE_NAMES[static_cast< int >( mode )];
+}
+
+/*!
+ * @brief Names of the compressions. Same order as Compression.
+ */
+static const char* const COMPRESSION_NAMES[] = { "off", "lz4", "cascaded", "bitcomp" };
+
+const char* compressionName( Compression compression )
+{
+	return COMPRESSION_NAMES[static_cast< int >( compression )];
+}
+
+/*!
+ * @brief Parse a search mode.
+ * @param value string.
+ * @param result parsed search mode.
+ * @return true, if value is the name of a search mode.
+ */
+static bool parseSearchMode( const std::string& value, SearchMode& result )
+{
+	for ( int i = 0; i < static_cast< int >( sizeof( SEARCH_MODE_NAMES ) / sizeof( SEARCH_MODE_NAMES[0] ) ); i++ )
+	{
+		if ( value == SEARCH_MODE_NAMES[i] )
+		{
+			result = static_cast< SearchMode >( i );
+			return true;
+		}
+	}
+	return false;
+}
+
+SwarmConfig SwarmConfig::fromCommandLine( int argc, char** argv )
+{
+	SwarmConfig config;
+
+	// Config file first, so the other arguments can override it.
+	for ( int i = 1; i < argc - 1; i++ )
+	{
+		if ( std::string( argv[i] ) == "--config" )
+			config.load( argv[i + 1] );
+	}
+
+	for ( int i = 1; i < argc; i++ )
+	{
+		std::string arg = argv[i];
+		if ( arg.rfind( "--", 0 ) != 0 || i + 1 >= argc )
+		{
+			std::cerr << "Ignoring argument '" << arg << "'" << std::endl;
+			continue;
+		}
+
+		std::string key = arg.substr( 2 );
+		std::string value = argv[++i];
+		if ( key != "config" )
+			config.set( key, value );
+	}
+
+	return config;
+}
+
+bool SwarmConfig::load( const std::string& path )
+{
+	std::ifstream stream( path, std::ios::in );
+	if ( !stream.is_open() )
+	{
+		std::cerr << "Impossible to open " << path << "!" << std::endl;
+		return false;
+	}
+
+	std::string line;
+	while ( std::getline( stream, line ) )
+	{
+		line = trim( line.substr( 0, line.find( '#' ) ) );
+		if ( line.empty() )
+			continue;
+
+		size_t separator = line.find( '=' );
+		if ( separator == std::string::npos )
+		{
+			std::cerr << "Invalid line in " << path << ": " << line << std::endl;
+			continue;
+		}
+
+		set( trim( line.substr( 0, separator ) ), trim( line.substr( separator + 1 ) ) );
+	}
+
+	return true;
+}
+
+bool SwarmConfig::set( const std::string& key, const std::string& value )
+{
+	bool valid = false;
+	if ( key == "particles" )
+		valid = parseCount( value, numParticles );
+	else if ( key == "sharks" )
+		valid = parseCount( value, numSharks );
+	else if ( key == "rate" )
+		valid = parseCount( value, simulationRate );
+	else if ( key == "headless" )
+		valid = parseCount( value, headlessSteps );
+	else if ( key == "ensemble" )
+		valid = parseCount( value, ensemble, 0 );
+	else if ( key == "ensemble_sweep" )
+		valid = parseSweeps( value, ensembleSweeps );
+	else if ( key == "sweep" )
+		valid = parseSweeps( value, sweep, true );
+	else if ( key == "sweep_output" )
+		sweepOutput = value;
+	else if ( key == "device" )
+	{
+		unsigned int index = 0;
+		valid = value == "auto" || parseCount( value, index, 0 );
+		if ( valid )
+			device = value == "auto" ? -1 : static_cast< int >( index );
+	}
+	else if ( key == "gpus" )
+		valid = parseCount( value, gpus, 0 );
+	else if ( key == "mpi" )
+		valid = parseFlag( value, mpi );
+	else if ( key == "mpi_gpudirect" )
+		valid = parseFlag( value, mpiGpuDirect );
+	else if ( key == "bricks" )
+		valid = parseCount( value, bricks, 0 );
+	else if ( key == "snapshot" || key == "restore" || key == "initial" )
+	{
+		valid = !value.empty();
+		( key == "snapshot" ? snapshot : key == "restore" ? restore : initial ) = value;
+	}
+	else if ( key == "snapshot_interval" )
+		valid = parseCount( value, snapshotInterval, 0 );
+	else if ( key == "snapshot_deltas" )
+		valid = parseCount( value, snapshotDeltas, 0 );
+	else if ( key == "trajectory" )
+	{
+		valid = !value.empty();
+		trajectory = value;
+	}
+	else if ( key == "trajectory_every" )
+		valid = parseCount( value, trajectoryEvery );
+	else if ( key == "trajectory_stride" )
+		valid = parseCount( value, trajectoryStride );
+	else if ( key == "trajectory_quantize" )
+		valid = parseFlag( value, trajectoryQuantize );
+	else if ( key == "trajectory_chunk" )
+		valid = parseCount( value, trajectoryChunk );
+	else if ( key == "play" )
+	{
+		valid = !value.empty();
+		playback = value;
+	}
+	else if ( key == "play_rate" )
+		valid = parseFloat( value, playbackRate ) && playbackRate > 0.0f;
+	else if ( key == "compression" )
+	{
+		valid = value == "off" || value == "lz4" || value == "cascaded" || value == "bitcomp";
+		if ( valid )
+			compression = value == "lz4" ? Compression::LZ4 : value == "cascaded" ? Compression::CASCADED : value == "bitcomp" ? Compression::BITCOMP : Compression::OFF;
+	}
+	else if ( key == "events" )
+	{
+		valid = !value.empty();
+		events = value;
+	}
+	else if ( key == "event_capacity" )
+		valid = parseCount( value, eventCapacity );
+	else if ( key == "export" )
+	{
+		valid = !value.empty();
+		exportName = value;
+	}
+	else if ( key == "export_slots" )
+		valid = parseCount( value, exportSlots ) && exportSlots >= 2 && exportSlots <= EXPORT_MAX_SLOTS;
+	else if ( key == "export_ipc" )
+		valid = parseFlag( value, exportIpc );
+	else if ( key == "validate" )
+		valid = parseCount( value, validateSteps, 0 );
+	else if ( key == "tolerance" )
+		valid = parseFloat( value, tolerance );
+	else if ( key == "behaviour" )
+	{
+		valid = value == "classic" || value == "boids";
+		if ( valid )
+			behaviour = value == "boids" ? Behaviour::BOIDS : Behaviour::CLASSIC;
+	}
+	else if ( key == "mean_field" )
+		valid = parseFlag( value, meanField );
+	else if ( key == "collision_radius" )
+		valid = parseFloat( value, collisionRadius );
+	else if ( key == "collision_iterations" )
+		valid = parseCount( value, collisionIterations, 1 );
+	else if ( key == "shark_target" )
+	{
+		valid = value == "center" || value == "nearest" || value == "densest" || value == "intercept";
+		if ( valid )
+			sharkTarget = value == "nearest" ? SharkTarget::NEAREST : value == "densest" ? SharkTarget::DENSEST
+				: value == "intercept" ? SharkTarget::INTERCEPT : SharkTarget::CENTER;
+	}
+	else if ( key == "integrator" )
+	{
+		valid = value == "legacy" || value == "euler" || value == "verlet";
+		if ( valid )
+			integrator = value == "euler" ? Integrator::EULER : value == "verlet" ? Integrator::VERLET : Integrator::LEGACY;
+	}
+	else if ( key == "adaptive_dt" )
+		valid = parseFlag( value, adaptiveStep );
+	else if ( key == "cfl" )
+		valid = parseFloat( value, cflNumber ) && cflNumber > 0.0f;
+	else if ( key == "max_dt_scale" )
+		valid = parseFloat( value, maxStepScale ) && maxStepScale >= 1.0f;
+	else if ( key == "autotune" )
+	{
+		valid = value == "off" || value == "cached" || value == "force";
+		if ( valid )
+			autotune = value == "cached" ? TuneMode::CACHED : value == "force" ? TuneMode::FORCE : TuneMode::OFF;
+	}
+	else if ( key == "tune_profile" )
+	{
+		valid = !value.empty();
+		tuneProfile = value;
+	}
+	else if ( key == "search" )
+		valid = parseSearchMode( value, searchMode );
+	else if ( key == "search_select" )
+		valid = parseCount( value, searchSelect, 0 );
+	else if ( key == "firstk" )
+		valid = parseCount( value, firstK, 0 );
+	else if ( key == "packed_positions" )
+		valid = parseFlag( value, packedPositions );
+	else if ( key == "cooperative" )
+		valid = parseFlag( value, cooperativeGrid );
+	else if ( key == "warm_start" )
+		valid = parseFlag( value, warmStart );
+	else if ( key == "grid_sort" )
+	{
+		valid = value == "auto" || value == "radix" || value == "counting";
+		if ( valid )
+			gridSort = value == "radix" ? GridSort::RADIX : value == "counting" ? GridSort::COUNTING : GridSort::AUTO;
+	}
+	else if ( key == "multi_rate" )
+		valid = parseCount( value, multiRate, 0 );
+	else if ( key == "multi_rate_shark" )
+		valid = parseFloat( value, multiRateShark );
+	else if ( key == "multi_rate_focus" )
+		valid = parseFloat( value, multiRateFocus );
+	else if ( key == "evasion_split" )
+		valid = parseFlag( value, evasionSplit );
+	else if ( key == "dense_cells" )
+		valid = parseCount( value, denseCells, 0 );
+	else if ( key == "clusters" )
+		valid = parseFlag( value, clusterSearch );
+	else if ( key == "hash_grid" )
+		valid = parseFlag( value, hashGrid );
+	else if ( key == "l2_persistence" )
+		valid = parseFlag( value, l2Persistence );
+	else if ( key == "deterministic" )
+		valid = parseFlag( value, deterministic );
+	else if ( key == "rtc" )
+		valid = parseFlag( value, rtcKernels );
+	else if ( key == "compact" )
+		valid = parseCount( value, compactInterval, 0 );
+	else if ( key == "reorder" )
+		valid = parseCount( value, reorderInterval, 0 );
+	else if ( key == "respawn" )
+		valid = parseCount( value, respawnRate, 0 );
+	else if ( key == "seed" )
+		valid = parseCount( value, seed, 0 );
+	else if ( key == "center_threshold" )
+		valid = parseFloat( value, params.centerThreshold );
+	else if ( key == "shark_dist" )
+		valid = parseFloat( value, params.sharkDist );
+	else if ( key == "shark_bite_dist" )
+		valid = parseFloat( value, params.sharkBiteDist );
+	else if ( key == "fish_dist" )
+		valid = parseFloat( value, params.fishDist );
+	else if ( key == "jitter" )
+		valid = parseFloat( value, params.jitter );
+	else if ( key == "skin" )
+		valid = parseFloat( value, params.verletSkin );
+	else if ( key == "acceleration" )
+		valid = parseFloat( value, params.accelerationFactor );
+	else if ( key == "separation" )
+		valid = parseFloat( value, params.boidsSeparation );
+	else if ( key == "alignment" )
+		valid = parseFloat( value, params.boidsAlignment );
+	else if ( key == "cohesion" )
+		valid = parseFloat( value, params.boidsCohesion );
+	else if ( key == "goal" )
+		valid = parseFloat( value, params.boidsGoal );
+	else if ( key == "benchmark" )
+		valid = parseFlag( value, benchmark );
+	else if ( key == "telemetry" )
+		valid = parseFlag( value, telemetry );
+	else if ( key == "parallel_startup" )
+		valid = parseFlag( value, parallelStartup );
+	else if ( key == "startup_bench" )
+	{
+		valid = !value.empty();
+		startupBench = value;
+	}
+	else if ( key == "interop_bench" )
+	{
+		valid = !value.empty();
+		interopBench = value;
+	}
+	else if ( key == "compute_cache" )
+	{
+		valid = true;															// Empty: default of the driver
+		computeCache = value;
+	}
+	else if ( key == "unified_memory" )
+		valid = parseFlag( value, unifiedMemory );
+	else if ( key == "instanced" )
+		valid = parseFlag( value, instanced );
+	else if ( key == "gl" )
+	{
+		unsigned int major = 0, minor = 0;
+		char dot = 0;
+		std::istringstream stream( value );
+		valid = ( stream >> major >> dot >> minor ) && dot == '.' && minor < 10 && major * 10 + minor >= 33;
+		if ( valid )
+			glVersion = major * 10 + minor;
+	}
+	else if ( key == "backend" )
+	{
+		valid = value == "cuda" || value == "gl" || value == "cpu" || value == "thrust";
+		if ( valid )
+			backend = value == "gl" ? Backend::GL_COMPUTE : value == "cpu" ? Backend::CPU : value == "thrust" ? Backend::THRUST : Backend::CUDA;
+	}
+	else if ( key == "threads" )
+		valid = parseCount( value, threads, 0 );
+	else if ( key == "schools" )
+		valid = parseCount( value, schools ) && schools <= 64;
+	else if ( key == "spline_path" )
+		valid = parseFlag( value, splinePath );
+	else if ( key == "species" )
+		valid = parseSpecies( value, species );
+	else if ( key == "overlay" )
+		valid = parseFlag( value, overlay );
+	else if ( key == "hud" )
+		valid = parseFlag( value, hud );
+	else if ( key == "culling" )
+		valid = parseFlag( value, culling );
+	else if ( key == "lod_distance" )
+		valid = parseFloat( value, lodDistance );
+	else if ( key == "cluster_distance" )
+		valid = parseFloat( value, clusterDistance ) && clusterDistance >= 0.0f;
+	else if ( key == "cluster_cell" )
+		valid = parseFloat( value, clusterCellSize ) && clusterCellSize > 0.0f;
+	else if ( key == "depth_sort" )
+		valid = parseFlag( value, depthSort );
+	else if ( key == "impostors" )
+		valid = parseFlag( value, impostors );
+	else if ( key == "shark_views" )
+		valid = parseCount( value, sharkViews, 0 ) && sharkViews <= 4;
+	else if ( key == "interpolate" )
+		valid = parseFlag( value, interpolate );
+	else if ( key == "vertex_pulling" )
+		valid = parseFlag( value, vertexPulling );
+	else if ( key == "vulkan_interop" )
+		valid = parseFlag( value, vulkanInterop );
+	else if ( key == "split_display" )
+		valid = parseFlag( value, splitDisplay );
+	else if ( key == "late_input" )
+		valid = parseFlag( value, lateInput );
+	else if ( key == "late_latch" )
+		valid = parseFlag( value, lateLatch );
+	else if ( key == "pipeline" )
+		valid = parseCount( value, pipelineDepth ) && pipelineDepth <= 1;
+	else if ( key == "color_mode" )
+	{
+		valid = value == "static" || value == "speed" || value == "fear" || value == "school";
+		if ( valid )
+			colorMode = value == "speed" ? ColorMode::SPEED : value == "fear" ? ColorMode::FEAR : value == "school" ? ColorMode::SCHOOL : ColorMode::STATIC;
+	}
+	else if ( key == "density" )
+		valid = parseFlag( value, density );
+	else if ( key == "trails" )
+		valid = parseCount( value, trails, 0 ) && trails != 1;					// A strip needs two positions
+	else if ( key == "trail_every" )
+		valid = parseCount( value, trailEvery );
+	else if ( key == "graph" )
+		valid = parseFlag( value, graphs );
+	else if ( key == "substeps" )
+		valid = parseFlag( value, substeps );
+	else if ( key == "profile" )
+		valid = parseCount( value, profileInterval, 0 );
+	else if ( key == "budget" )
+		valid = parseFloat( value, frameBudget );
+	else if ( key == "quality_budget" )
+		valid = parseFloat( value, qualityBudget );
+	else if ( key == "frame_dump" )
+	{
+		valid = !value.empty();
+		frameDump = value;
+	}
+	else if ( key == "metrics_port" )
+		valid = parseCount( value, metricsPort, 0 ) && metricsPort <= 65535;
+	else if ( key == "stats_history" )
+		valid = parseCount( value, statsHistory, 0 );
+	else if ( key == "stats_readback" )
+		valid = parseFloat( value, statsReadback );
+	else if ( key == "trace" )
+	{
+		valid = !value.empty();
+		trace = value;
+	}
+	else if ( key == "capture" )
+	{
+		valid = !value.empty();
+		capture = value;
+	}
+	else if ( key == "capture_every" )
+		valid = parseCount( value, captureEvery );
+	else if ( key == "record_camera" )
+	{
+		valid = !value.empty();
+		cameraRecord = value;
+	}
+	else if ( key == "replay_camera" )
+	{
+		valid = !value.empty();
+		cameraReplay = value;
+	}
+	else if ( key == "video" )
+	{
+		valid = !value.empty();
+		video = value;
+	}
+	else if ( key == "egl" )
+		valid = parseFlag( value, egl );
+	else if ( key == "spawn_min" )
+		valid = parseVector( value, spawnMin );
+	else if ( key == "spawn_max" )
+		valid = parseVector( value, spawnMax );
+	else if ( key == "waypoints" )
+		valid = parseWaypoints( value, waypoints );
+	else if ( key == "obstacles" )
+		valid = parseObstacles( value, obstacles );
+	else if ( key == "obstacle_range" )
+		valid = parseFloat( value, obstacleRange ) && obstacleRange > 0.0f;
+	else if ( key == "obstacle_resolution" )
+		valid = parseCount( value, obstacleResolution, 2 );
+	else if ( key == "attractors" )
+		valid = parseAttractors( value, attractors );
+	else if ( key == "attractor_resolution" )
+		valid = parseCount( value, attractorResolution, 2 );
+	else if ( key == "alarm" )
+		valid = parseFloat( value, alarm );
+	else if ( key == "alarm_decay" )
+		valid = parseFloat( value, alarmDecay ) && alarmDecay < 1.0f;
+	else if ( key == "alarm_resolution" )
+		valid = parseCount( value, alarmResolution, 2 );
+	else if ( key == "current" )
+	{
+		valid = !value.empty();
+		current = value;
+	}
+	else if ( key == "timeline" )
+	{
+		valid = !value.empty();
+		timeline = value;
+	}
+	else if ( key == "current_strength" )
+		valid = parseFloat( value, currentStrength );
+	else if ( key == "current_period" )
+		valid = parseCount( value, currentPeriod, 16 );							// At most one new slice per graph
+	else if ( key == "current_resolution" )
+		valid = parseCount( value, currentResolution, 2 );
+	else if ( key == "far_cohesion" )
+		valid = parseFloat( value, farCohesion );
+	else if ( key == "far_alignment" )
+		valid = parseFloat( value, farAlignment );
+	else if ( key == "far_theta" )
+		valid = parseFloat( value, farTheta );
+	else if ( key == "speed" )
+		valid = parseFloat( value, swarmSpeed );
+	else if ( key == "window" )
+	{
+		unsigned int width = 0, height = 0;
+		char x = 0;
+		std::istringstream stream( value );
+		valid = ( stream >> width >> x >> height ) && x == 'x' && width > 0 && height > 0;
+		if ( valid )
+		{
+			windowWidth = width;
+			windowHeight = height;
+		}
+	}
+	else if ( key == "msaa" )
+		valid = parseCount( value, msaa, 0 );
+	else if ( key == "render_scale" )
+		valid = parseFloat( value, renderScale ) && renderScale > 0.0f;
+	else
+	{
+		std::cerr << "Unknown config value '" << key << "'" << std::endl;
+		return false;
+	}
+
+	if ( !valid )
+		std::cerr << "Invalid value for '" << key << "': " << value << std::endl;
+	return valid;
+}
+
+std::ostream& operator<<( std::ostream& os, const SwarmConfig& config )
+{
+	os << "Particles:                        " << config.numParticles << "\n";
+	os << "Sharks:                           " << config.numSharks << "\n";
+	os << "Simulation rate:                  " << config.simulationRate << " steps/s\n";
+	os << "Behaviour:                        " << ( config.behaviour == Behaviour::BOIDS ? "boids" : "classic" ) << "\n";
+	if ( config.collisionRadius > 0.0f )
+		os << "Collisions:                       " << config.collisionRadius << ", " << config.collisionIterations << " iterations\n";
+	if ( config.behaviour == Behaviour::BOIDS && config.meanField )
+		os << "Boids neighbourhood:              mean field of the cells\n";
+	os << "Neighbour search:                 " << searchModeName( config.searchMode ) << "\n";
+	if ( config.searchSelect > 0 )
+		os << "Search selector:                  every " << config.searchSelect << " frames\n";
+	if ( config.sharkTarget != SharkTarget::CENTER )
+		os << "Shark target:                     " << ( config.sharkTarget == SharkTarget::NEAREST ? "nearest fish"
+		: config.sharkTarget == SharkTarget::DENSEST ? "densest cell" : "intercept cell" ) << "\n";
+	if ( config.integrator != Integrator::LEGACY )
+	{
+		os << "Integrator:                       " << ( config.integrator == Integrator::VERLET ? "velocity Verlet" : "semi-implicit Euler" );
+		if ( config.adaptiveStep )
+			os << ", adaptive step (CFL " << config.cflNumber << ", up to " << config.maxStepScale << " base steps)";
+		os << "\n";
+	}
+	os << "Neighbour query:                  " << ( config.firstK > 0 ? "first " + std::to_string( config.firstK ) + " in radius" : std::string( "closest" ) ) << "\n";
+	if ( config.autotune != TuneMode::OFF )
+		os << "Autotune:                         " << ( config.autotune == TuneMode::FORCE ? "force" : "cached" ) << ", " << config.tuneProfile << "\n";
+	if ( config.packedPositions )
+		os << "Packed grid positions:            on\n";
+	if ( config.cooperativeGrid )
+		os << "Cooperative grid:                 on\n";
+	if ( !config.warmStart )
+		os << "Warm start:                       off\n";
+	if ( config.gridSort != GridSort::AUTO )
+		os << "Grid sort:                        " << ( config.gridSort == GridSort::RADIX ? "radix" : "counting" ) << "\n";
+	if ( config.multiRate > 1 )
+		os << "Multi-rate steps:                 every " << config.multiRate << " steps, shark range " << config.multiRateShark << ", focus range " << config.multiRateFocus << "\n";
+	if ( config.substeps )
+		os << "Substeps:                         on\n";
+	if ( config.evasionSplit )
+		os << "Evasion split:                    on\n";
+	if ( config.denseCells > 0 )
+		os << "Dense cells:                      over " << config.denseCells << " candidates\n";
+	if ( config.clusterSearch )
+		os << "Cluster search:                   cells of a cluster in distributed shared memory\n";
+	if ( config.hashGrid )
+		os << "Hashed grid:                      cells in an open addressing table\n";
+	if ( config.l2Persistence )
+		os << "L2 persistence:                   cell tables\n";
+	if ( config.deterministic )
+		os << "Deterministic:                    on\n";
+	if ( config.rtcKernels )
+		os << "Runtime compiled kernels:         on\n";
+	os << "Compaction interval:              " << config.compactInterval << " steps\n";
+	os << "Reorder interval:                 " << config.reorderInterval << " steps\n";
+	if ( config.respawnRate > 0 )
+		os << "Respawn:                          " << config.respawnRate << " per step\n";
+	if ( config.schools > 1 )
+		os << "Schools:                          " << config.schools << "\n";
+	if ( config.splinePath )
+		os << "Path:                             spline\n";
+	if ( !config.species.empty() )
+		os << "Species:                          " << config.species.size() << "\n";
+	os << "Seed:                             " << config.seed << "\n";
+	os << "Spawn box:                        " << config.spawnMin.x << ", " << config.spawnMin.y << ", " << config.spawnMin.z
+	   << " to " << config.spawnMax.x << ", " << config.spawnMax.y << ", " << config.spawnMax.z << "\n";
+	os << "Waypoints:                        " << config.waypoints.size() << "\n";
+	if ( !config.obstacles.empty() )
+		os << "Obstacles:                        " << config.obstacles.size() << ", range " << config.obstacleRange << ", " << config.obstacleResolution << " samples\n";
+	if ( !config.attractors.empty() )
+		os << "Attractors:                       " << config.attractors.size() << ", " << config.attractorResolution << " samples\n";
+	if ( config.alarm > 0.0f )
+		os << "Alarm:                            " << config.alarm << " per step, decay " << config.alarmDecay << ", " << config.alarmResolution << " cells\n";
+	if ( !config.current.empty() )
+		os << "Current:                          " << config.current << ", strength " << config.currentStrength << ", new slice every " << config.currentPeriod << " steps\n";
+	if ( !config.timeline.empty() )
+		os << "Timeline:                         " << config.timeline << "\n";
+	if ( config.farCohesion > 0.0f || config.farAlignment > 0.0f )
+		os << "Far field:                        cohesion " << config.farCohesion << ", alignment " << config.farAlignment << ", theta " << config.farTheta << "\n";
+	os << "Swarm speed:                      " << config.swarmSpeed << " per second\n";
+	os << "Fish / shark / bite distance:     " << config.params.fishDist << " / " << config.params.sharkDist << " / " << config.params.sharkBiteDist << "\n";
+	if ( config.benchmark )
+		os << "Benchmark mode:                   on\n";
+	if ( config.telemetry )
+		os << "GPU telemetry:                    on\n";
+	if ( !config.parallelStartup )
+		os << "Parallel startup:                 off\n";
+	if ( !config.startupBench.empty() )
+		os << "Startup benchmark:                " << config.startupBench << "\n";
+	if ( !config.interopBench.empty() )
+		os << "Interop benchmark:                " << config.interopBench << "\n";
+	if ( config.computeCache != "compute_cache" )
+		os << "Compute cache:                    " << ( config.computeCache.empty() ? std::string( "driver default" ) : config.computeCache ) << "\n";
+	if ( config.unifiedMemory )
+		os << "Unified memory:                   on\n";
+	if ( config.glVersion != 33 )
+		os << "OpenGL context:                   " << config.glVersion / 10 << "." << config.glVersion % 10 << "\n";
+	if ( config.windowWidth != 1600 || config.windowHeight != 1200 )
+		os << "Window:                           " << config.windowWidth << "x" << config.windowHeight << "\n";
+	if ( config.msaa != 4 )
+		os << "Multisampling:                    " << config.msaa << " samples\n";
+	if ( config.renderScale != 1.0f )
+		os << "Render scale:                     " << config.renderScale << "\n";
+	if ( config.backend == Backend::GL_COMPUTE )
+		os << "Simulation backend:               OpenGL compute\n";
+	else if ( config.backend == Backend::CPU )
+		os << "Simulation backend:               CPU, " << ( config.threads > 0 ? std::to_string( config.threads ) : std::string( "all" ) ) << " threads\n";
+	else if ( config.backend == Backend::THRUST )
+		os << "Simulation backend:               Thrust\n";
+	if ( !config.instanced )
+		os << "Fish drawing:                     points\n";
+	if ( !config.culling )
+		os << "Frustum culling:                  off\n";
+	else if ( config.instanced )
+		os << "Meshes closer than:               " << config.lodDistance << "\n";
+	if ( config.culling && config.clusterDistance > 0.0f )
+		os << "Cluster impostors from:           " << config.clusterDistance << " (cell " << config.clusterCellSize << ")\n";
+	if ( config.depthSort )
+		os << "Depth sorted points:              " << ( config.impostors ? "front to back" : "back to front" ) << "\n";
+	if ( config.impostors )
+		os << "Sphere impostors:                 on\n";
+	if ( config.sharkViews > 0 )
+		os << "Shark views:                      " << config.sharkViews << "\n";
+	if ( config.interpolate )
+		os << "Interpolated points:              on\n";
+	if ( config.vertexPulling )
+		os << "Vertex pulling:                   on\n";
+	if ( config.vulkanInterop )
+		os << "Vulkan interop:                   on\n";
+	if ( config.splitDisplay )
+		os << "Split display:                    on\n";
+	if ( config.lateInput || config.lateLatch )
+		os << "Late input:                       " << ( config.lateLatch ? "latched uniforms" : "before the draws" ) << "\n";
+	if ( config.pipelineDepth > 0 )
+		os << "Frame pipeline:                   simulation " << config.pipelineDepth << " frame ahead\n";
+	if ( config.colorMode != ColorMode::STATIC )
+		os << "Color mode:                       " << colorModeName( config.colorMode ) << "\n";
+	if ( config.density )
+		os << "Density map:                      on\n";
+	if ( config.trails > 0 )
+		os << "Trails:                           " << config.trails << " positions, every " << config.trailEvery << " steps\n";
+	if ( config.qualityBudget > 0.0f )
+		os << "Quality budget:                   " << config.qualityBudget << " ms\n";
+	if ( !config.frameDump.empty() )
+		os << "Frame time dump:                  " << config.frameDump << "\n";
+	if ( config.metricsPort > 0 )
+		os << "Metrics port:                     " << config.metricsPort << "\n";
+	if ( config.statsHistory > 0 )
+		os << "Stats history:                    " << config.statsHistory << " frames, read back every " << config.statsReadback << " s\n";
+	if ( !config.trace.empty() )
+		os << "Trace:                            " << config.trace << "\n";
+	if ( !config.capture.empty() )
+		os << "Frame captures:                   " << config.capture << "_<frame>.tga every " << config.captureEvery << " frames\n";
+	if ( !config.cameraRecord.empty() )
+		os << "Camera recording:                 " << config.cameraRecord << "\n";
+	if ( !config.cameraReplay.empty() )
+		os << "Camera replay:                    " << config.cameraReplay << "\n";
+	if ( !config.video.empty() )
+		os << "Video:                            " << config.video << ( config.egl && config.headlessSteps > 0 ? ", EGL" : "" ) << "\n";
+	if ( !config.restore.empty() )
+		os << "Restore:                          " << config.restore << "\n";
+	else if ( !config.initial.empty() )
+		os << "Initial conditions:               " << config.initial << "\n";
+	if ( !config.snapshot.empty() )
+		os << "Snapshot:                         " << config.snapshot << ( config.snapshotInterval > 0 ? " every " + std::to_string( config.snapshotInterval ) + " steps" : std::string() )
+		   << ( config.snapshotInterval > 0 && config.snapshotDeltas > 0 ? ", " + std::to_string( config.snapshotDeltas ) + " deltas between full ones" : std::string() ) << "\n";
+	if ( !config.trajectory.empty() )
+		os << "Trajectory:                       " << config.trajectory << "_*.traj, every " << config.trajectoryEvery << " steps, every "
+		   << config.trajectoryStride << ". fish" << ( config.trajectoryQuantize ? ", 16 bit" : "" ) << "\n";
+	if ( !config.playback.empty() )
+		os << "Playback:                         " << config.playback << "_*.traj at " << config.playbackRate << "x\n";
+	if ( config.compression != Compression::OFF )
+		os << "Compression:                      " << compressionName( config.compression ) << "\n";
+	if ( !config.events.empty() )
+		os << "Events:                           " << config.events << ", up to " << config.eventCapacity << " per drain\n";
+	if ( !config.exportName.empty() )
+		os << "Export:                           " << config.exportName << ", " << config.exportSlots << " slots" << ( config.exportIpc ? ", CUDA IPC" : "" ) << "\n";
+	if ( config.validateSteps > 0 )
+		os << "Validation steps:                 " << config.validateSteps << " (tolerance " << config.tolerance << ")\n";
+	if ( config.headlessSteps > 0 )
+		os << "Headless steps:                   " << config.headlessSteps << "\n";
+	if ( config.ensemble > 0 )
+	{
+		os << "Ensemble:                         " << config.ensemble << " swarms";
+		for ( const ParamSweep& sweep : config.ensembleSweeps )
+			os << ", " << sweep.name << " " << sweep.from << " to " << sweep.to;
+		os << "\n";
+	}
+	if ( !config.sweep.empty() )
+	{
+		os << "Sweep:                            ";
+		for ( size_t a = 0; a < config.sweep.size(); a++ )
+			os << ( a > 0 ? " x " : "" ) << config.sweep[a].name << " " << config.sweep[a].from << " to " << config.sweep[a].to << " (" << config.sweep[a].values << ")";
+		os << ( config.sweepOutput.empty() ? "" : ", into " + config.sweepOutput ) << "\n";
+	}
+	if ( config.device >= 0 )
+		os << "GPU:                              " << config.device << "\n";
+	if ( config.gpus != 1 )
+		os << "GPUs:                             " << ( config.gpus == 0 ? std::string( "all" ) : std::to_string( config.gpus ) ) << "\n";
+	if ( config.mpi )
+		os << "MPI:                              " << ( config.mpiGpuDirect ? "device buffers" : "staged through the host" ) << "\n";
+	if ( config.bricks > 1 )
+		os << "Bricks:                           " << config.bricks << "\n";
+	return os;
+}
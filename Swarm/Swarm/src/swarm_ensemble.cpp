@@ -0,0 +1,83 @@
+#include "swarm_ensemble.h"
+
+/*!
+ * @brief Config key and field of a behaviour parameter.
+ */
+struct ParamName
+{
+	const char* name;
+	float SwarmParams::* field;
+};
+
+static const ParamName PARAM_NAMES[] = {
+	{ "center_threshold", &SwarmParams::centerThreshold },
+	{ "shark_dist", &SwarmParams::sharkDist },
+	{ "shark_bite_dist", &SwarmParams::sharkBiteDist },
+	{ "fish_dist", &SwarmParams::fishDist },
+	{ "acceleration", &SwarmParams::accelerationFactor },
+	{ "jitter", &SwarmParams::jitter },
+	{ "skin", &SwarmParams::verletSkin },
+	{ "separation", &SwarmParams::boidsSeparation },
+	{ "alignment", &SwarmParams::boidsAlignment },
+	{ "cohesion", &SwarmParams::boidsCohesion },
+	{ "goal", &SwarmParams::boidsGoal }
+};
+
+bool findParam( const std::string& name, float SwarmParams::*& field )
+{
+	for ( const ParamName& param : PARAM_NAMES )
+	{
+		if ( name == param.name )
+		{
+			field = param.field;
+			return true;
+		}
+	}
+	return false;
+}
+
+SwarmEnsemble uniformEnsemble( const SwarmParams& base, const std::vector<ParamSweep>& sweeps, unsigned int members, unsigned int fishies, unsigned int sharks )
+{
+	std::vector<SwarmParams> params( members, base );
+	for ( unsigned int m = 0; m < members; m++ )
+	{
+		float t = members > 1 ? static_cast< float >( m ) / ( members - 1 ) : 0.0f;
+		for ( const ParamSweep& sweep : sweeps )
+			params[m].*sweep.field = sweep.from + t * ( sweep.to - sweep.from );
+	}
+	return packEnsemble( params, fishies, sharks );
+}
+
+std::vector<SwarmParams> sweepMatrix( const SwarmParams& base, const std::vector<ParamSweep>& axes )
+{
+	std::vector<SwarmParams> runs( 1, base );
+	for ( const ParamSweep& axis : axes )
+	{
+		std::vector<SwarmParams> expanded;
+		expanded.reserve( runs.size() * axis.values );
+		for ( const SwarmParams& run : runs )
+		{
+			for ( unsigned int v = 0; v < axis.values; v++ )
+			{
+				float t = axis.values > 1 ? static_cast< float >( v ) / ( axis.values - 1 ) : 0.0f;
+				expanded.push_back( run );
+				expanded.back().*axis.field = axis.from + t * ( axis.to - axis.from );
+			}
+		}
+		runs.swap( expanded );
+	}
+	return runs;
+}
+
+SwarmEnsemble packEnsemble( const std::vector<SwarmParams>& params, unsigned int fishies, unsigned int sharks )
+{
+	SwarmEnsemble ensemble;
+	ensemble.sharksPerMember = sharks;
+	ensemble.params = params;
+	for ( size_t m = 0; m < params.size(); m++ )
+	{
+		ensemble.offsets.push_back( static_cast< unsigned int >( m ) * fishies );
+		ensemble.counts.push_back( fishies );
+	}
+	return ensemble;
+}
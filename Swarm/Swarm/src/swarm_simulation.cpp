@@ -0,0 +1,456 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "autotuner.h"
+#include "host_simulation.h"
+#include "initial_conditions.h"
+#include "launch_check.h"
+#include "nvtx_range.h"
+#include "swarm_simulation.h"
+
+SwarmSimulation::SwarmSimulation( const SwarmConfig& config, bool colors ) :
+	numParticles_( config.numParticles ),
+	numSharks_( config.numSharks ),
+	liveParticles_( config.numParticles ),
+	compactInterval_( config.respawnRate > 0 ? 0 : config.compactInterval ),	// The emitter refills dead slots in place, no compaction needed
+	respawnRate_( config.respawnRate ),
+	reorderInterval_( config.reorderInterval ),
+	graphs_( config.graphs ),
+	substeps_( config.substeps ),
+	seed_( config.seed ),
+	dt_( 1.0 / config.simulationRate ),
+	adaptiveStep_( config.adaptiveStep && config.integrator != Integrator::LEGACY ),
+	cflDistance_( config.cflNumber * config.params.fishDist ),
+	maxStepScale_( config.maxStepScale )
+{
+	speed = static_cast< float >( config.swarmSpeed * dt_ );					// Same distance per simulated second for every rate
+
+	waypointList = new WaypointList( config.waypoints );						// Initialize Waypoint path.
+	swarmCenter = waypointList->get();											// Get first swarm center for particles.
+
+	if ( config.splitDisplay )
+		device_ = CudaDevice( CudaDevice::selectComputeDevice( config.device ) );	// Leave the OpenGL GPU to the display
+	else
+		device_ = CudaDevice( CudaDevice::selectDevice( config.device ) );		// Create CUDA Device. The configured one, else the OpenGL GPU or the biggest one.
+	startupPhases_.end( "device select" );
+	CudaDevice::printDevices( std::cout, device_.getDevice() );
+	std::cout << device_ << std::endl;											// Print out some information about the used GPU
+	startupPhases_.end( "device properties" );
+	stream_ = device_.getStream( device_.createStream() );						// Stream for the simulation, the first call which needs the context
+	stats_ = new CudaMailbox<SwarmStats>();										// Mapped on this device, no stats until the first post
+	startupPhases_.end( "CUDA context" );
+
+	SnapshotFile snapshot;
+	bool restored = !config.restore.empty() && snapshot.open( config.restore );
+	SwarmParams params = config.params;
+	if ( restored )																// Continue the run of the snapshot
+	{
+		const SnapshotHeader& header = snapshot.getHeader();
+		numParticles_ = header.numParticles;
+		liveParticles_ = header.liveParticles;
+		numSharks_ = header.numSharks;
+		seed_ = header.seed;
+		stepCount_ = header.step;
+		params = header.params;
+		swarmCenter = Vector3( header.swarmCenter[0], header.swarmCenter[1], header.swarmCenter[2] );
+		Vector3 waypoint( header.waypoint[0], header.waypoint[1], header.waypoint[2] );
+		for ( int i = 0; i < waypointList->length() && ( waypointList->get() - waypoint ).length() > 1e-6f; i++ )
+			waypointList->getNext();											// Same waypoint as the snapshot
+	}
+	InitialConditionFile initial;
+	bool loaded = !restored && !config.initial.empty() && initial.open( config.initial );
+	if ( loaded )																// The file decides the number of fishies
+	{
+		numParticles_ = initial.getCount();
+		liveParticles_ = numParticles_;
+	}
+
+	for ( int i = 0; i < 2; i++ )
+		particles_[i] = new ParticleStore( numParticles_ );						// Allocate Memory on GPU for positions, forces and masses
+	if ( colors )
+	{
+		d_color.setCategory( MemoryCategory::RENDER );
+		d_color.resize( numParticles_ );										// Allocate Memory on GPU for color vector, the fishies keep it when they change slots
+	}
+	d_sharks.setCategory( MemoryCategory::PARTICLES );
+	d_shark_state.setCategory( MemoryCategory::PARTICLES );
+	d_sharks.resize( numSharks_ * 4 );											// Allocate Memory on GPU for shark positions
+	d_shark_state.resize( numSharks_ * 4 );										// Allocate Memory on GPU for shark forces and masses
+	startupPhases_.end( "buffers" );
+
+	kernel_set_params( params );												// Behaviour parameters
+	kernel_set_schools( schoolWaypoints( config.waypoints, config.schools ), config.splinePath );	// Routes of the schools in constant memory
+	kernel_set_species( config.species );										// Species table in constant memory
+	kernel_set_seed( seed_ );													// GPU random numbers
+	kernel_set_spawn_box( config.spawnMin, config.spawnMax );					// Box of the respawned fishies
+	if ( restored )
+		kernel_set_random_step( snapshot.getHeader().randomStep );				// Same random numbers as the run without break
+	kernel_set_behaviour( config.behaviour );									// Fish behaviour
+	kernel_set_mean_field( config.meanField );									// Boids from the cell means
+	kernel_set_collisions( config.collisionRadius, config.collisionIterations );	// Hard collisions after the advance
+	kernel_set_search_mode( config.searchMode );								// Neighbour search
+	kernel_set_first_k( config.firstK );										// Neighbour query semantics
+	kernel_set_packed_positions( config.packedPositions );						// Positions read by the grid search
+	kernel_set_cooperative_grid( config.cooperativeGrid );						// Grid build and search in one launch
+	kernel_set_warm_start( config.warmStart );									// Grid search bounded by the last closest fish
+	kernel_set_grid_sort( config.gridSort );									// Counting or radix sort of the grid build
+	kernel_set_multi_rate( config.multiRate, config.multiRateShark, config.multiRateFocus );	// Unimportant fishies advance less often
+	kernel_set_evasion_split( config.evasionSplit );							// Brute force skips the evading fishies
+	kernel_set_dense_cells( config.denseCells );								// Warps for the fishies of dense cells
+	kernel_set_background_priority( CudaDevice::getStreamPriority( StreamClass::BACKGROUND ) );	// Fills of the current behind the steps
+	kernel_set_cluster_search( config.clusterSearch );							// Cells of a cluster in distributed shared memory on Hopper
+	kernel_set_hash_grid( config.hashGrid );									// Occupied cells in a hash table, no wrapping
+	kernel_set_l2_persistence( config.l2Persistence && device_.supportsL2Persistence() );	// Cell tables persisting in L2 on Ampere or newer
+	kernel_set_deterministic( config.deterministic );							// Fixed-point state, ordered search and reductions
+	kernel_set_rtc( config.rtcKernels );										// Grid advance specialised for the scenario
+	kernel_set_shark_target( config.sharkTarget );								// Sharks hunt in the grid
+	kernel_set_integrator( config.integrator );									// Steering as acceleration over the step length
+	kernel_set_obstacles( bakeObstacles( config.obstacles, config.spawnMin, config.spawnMax, config.waypoints, config.obstacleRange,
+		config.obstacleResolution ), config.obstacleRange );					// Distance field of the obstacles
+	kernel_set_attractors( placeAttractors( config.attractors, config.spawnMin, config.spawnMax, config.waypoints,
+		config.attractorResolution ) );											// Field of the food patches and lures
+	kernel_set_alarm( placeAlarm( config.alarm, config.alarmDecay, config.spawnMin, config.spawnMax, config.waypoints,
+		config.params.centerThreshold, config.alarmResolution ) );				// Alarm waves of the evading fishies
+	kernel_set_current( loadCurrent( config ), config.currentStrength / config.simulationRate, config.currentPeriod );	// Current of the water
+	kernel_set_timeline( loadTimeline( config ) );								// Scripted events, applied on the GPU
+	kernel_set_far_field( config.farCohesion, config.farAlignment, config.farTheta );	// Long range forces on the BVH
+	kernel_init_grid( numParticles_, device_.getProperties() );					// Initialize grid and launch configuration for this device.
+	kernel_print_resources( std::cout, numParticles_, device_.getProperties() );	// Registers and occupancy of the kernels, next to the device info
+	kernel_check_binary( std::cout, device_.getProperties() );					// A JIT compile explains a slow start on new GPUs
+	startupPhases_.end( "kernel setup" );
+
+	if ( restored )
+	{
+		if ( colors )															// Spawn order: slot is id, so the colors are the ones of the first run
+			kernel_spawn( particles_[0]->getArrays(), numParticles_, d_color.getData(), stream_ );
+		for ( int i = 0; i < 2; i++ )											// Both stores, the steps don't copy the ids
+			snapshot.upload( *particles_[i], d_sharks, d_shark_state, stream_ );	// Mapped file, pinned memory, GPU
+		std::cout << "Restored " << config.restore << " at step " << stepCount_
+				  << ( snapshot.getDeltaCount() > 0 ? " with " + std::to_string( snapshot.getDeltaCount() ) + " delta checkpoints" : std::string() ) << std::endl;
+	}
+	else
+	{
+		for ( int i = 0; i < 2; i++ )											// Spawn on the GPU, both stores get the same fishies
+			kernel_spawn( particles_[i]->getArrays(), numParticles_, i == 0 ? d_color.getData() : NULL, stream_ );
+		if ( loaded )															// Ids, alive flags and missing columns stay the spawned ones
+		{
+			auto start = std::chrono::steady_clock::now();
+			size_t bytes = 0;
+			for ( int i = 0; i < 2; i++ )										// The second one reads from the page cache
+				bytes += initial.upload( *particles_[i], stream_ );				// Mapped file, pinned slots, GPU
+			double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+			std::cout << "Loaded " << numParticles_ << " fishies from " << config.initial << " in " << seconds << " s ("
+					  << bytes / ( seconds * 1e6 ) << " MB/s)" << std::endl;
+		}
+
+		std::vector<float> h_shark_data;
+		std::vector<float> h_shark_state;
+		spawnSharks( numSharks_, h_shark_data, h_shark_state, config.spawnMin, config.spawnMax );	// Host copies only live until the upload
+		d_sharks.set( h_shark_data.data(), numSharks_ * 4 );
+		d_shark_state.set( h_shark_state.data(), numSharks_ * 4 );
+	}
+
+	startupPhases_.end( "spawn" );
+
+	Autotuner tuner( config, numParticles_, device_.getProperties() );			// Block size, cell size and skin of this GPU
+	tuner.run( numParticles_, speed, swarmCenter, reinterpret_cast<float4*>( d_sharks.getData() ), numSharks_, stream_ );
+	slotsMoved_ = true;															// Data by slot of the consumers isn't written yet
+	startupPhases_.end( "autotune" );
+}
+
+void SwarmSimulation::moveSwarmCenter()
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "SwarmSimulation::moveSwarmCenter", NVTX_COLOR_SIMULATION );
+
+	Vector3 diff = waypointList->get() - swarmCenter;							// Get Next Swarm center
+	if (diff.length() < WAYPOINT_THRESHOLD)										// Check if center was reached
+	{
+		diff = waypointList->getNext() - swarmCenter;
+	}
+
+	diff = diff.normalized() * ( speed * stepScale_ );
+	swarmCenter += diff;
+}
+
+void SwarmSimulation::advanceStep()
+{
+	unsigned int next = 1 - current_;											// Write into the other store
+
+	device_.beginStages( stream_ );												// Sharks and respawn both only wait for the advance
+	int advance = device_.runStage( {}, [&]( cudaStream_t stream ) {
+		kernel_advance(
+			particles_[current_]->getArrays(),
+			particles_[next]->getArrays(),
+			liveParticles_,
+			speed,
+			swarmCenter,
+			reinterpret_cast<float4*>( d_sharks.getData() ),
+			numSharks_,
+			stream);
+		kernel_resolve_collisions( particles_[next]->getArrays(), liveParticles_, stream );	// Push overlapping fishies apart
+	} );
+
+	current_ = next;															// Swap stores
+
+	std::vector<int> respawnAfter = { advance };
+	if ( numSharks_ > 0 )
+	{
+		int sharks = device_.runStage( { advance }, [&]( cudaStream_t stream ) {
+			kernel_move_sharks(													// Calculate new shark positions on GPU.
+				reinterpret_cast<float4*>( d_sharks.getData() ),
+				reinterpret_cast<float4*>( d_shark_state.getData() ),
+				numSharks_,
+				speed,
+				stream);
+		} );
+		if ( kernel_sharks_hunt() )												// Bites mark fishies the respawn brings back
+			respawnAfter.push_back( sharks );
+	}
+
+	if ( respawnRate_ > 0 )
+	{
+		device_.runStage( respawnAfter, [&]( cudaStream_t stream ) {
+			kernel_respawn(														// Bring eaten fishies back
+				particles_[current_]->getArrays(),
+				liveParticles_,
+				respawnRate_,
+				stream);
+		} );
+	}
+	device_.endStages();														// The next step reads the sharks and the fishies
+}
+
+void SwarmSimulation::step()
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "SwarmSimulation::step", NVTX_COLOR_SIMULATION );
+
+	moveSwarmCenter();															// Set new Swarm center
+	advanceStep();
+	compactParticles();															// Drop eaten fishies now and then
+	reorderParticles();															// Restore memory locality now and then
+	stepCount_++;
+	simulatedTime_ += dt_ * stepScale_;
+}
+
+void SwarmSimulation::advance( unsigned int steps )
+{
+	if ( canSubstep( steps ) )
+	{
+		runSubsteps( steps );													// One block for all steps
+		return;
+	}
+
+	if ( canReplay( steps ) )
+	{
+		replaySteps( steps );													// One launch for all steps
+		return;
+	}
+
+	for ( unsigned int i = 0; i < steps; i++ )
+		step();
+}
+
+bool SwarmSimulation::hostWorkDue( unsigned int steps ) const
+{
+	bool compactDue = compactInterval_ > 0 && stepsSinceCompact_ + steps >= compactInterval_;
+	bool reorderDue = reorderInterval_ > 0 && stepsSinceReorder_ + steps >= reorderInterval_;
+	return compactDue || reorderDue;
+}
+
+bool SwarmSimulation::canReplay( unsigned int steps ) const
+{
+	if ( !graphs_ || !kernel_can_capture( liveParticles_, steps ) )
+		return false;
+	return !hostWorkDue( steps );
+}
+
+bool SwarmSimulation::canSubstep( unsigned int steps ) const
+{
+	if ( !substeps_ || respawnRate_ > 0 || !kernel_can_substep( liveParticles_, numSharks_, steps ) )
+		return false;
+	return !hostWorkDue( steps );
+}
+
+void SwarmSimulation::runSubsteps( unsigned int steps )
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "SwarmSimulation::runSubsteps", NVTX_COLOR_SIMULATION );
+
+	substepCenters_.resize( steps );
+	for ( unsigned int i = 0; i < steps; i++ )
+	{
+		moveSwarmCenter();														// Same centers as step by step
+		substepCenters_[i] = swarmCenter;
+	}
+
+	unsigned int next = 1 - current_;											// Only the last step is written
+	kernel_advance_substeps(
+		particles_[current_]->getArrays(),
+		particles_[next]->getArrays(),
+		liveParticles_,
+		speed,
+		substepCenters_.data(),
+		steps,
+		reinterpret_cast<float4*>( d_sharks.getData() ),
+		reinterpret_cast<float4*>( d_shark_state.getData() ),
+		numSharks_,
+		stream_ );
+	current_ = next;
+
+	if ( compactInterval_ > 0 )
+		stepsSinceCompact_ += steps;
+	if ( reorderInterval_ > 0 )
+		stepsSinceReorder_ += steps;
+	stepCount_ += steps;
+	simulatedTime_ += dt_ * stepScale_ * steps;
+}
+
+void SwarmSimulation::replaySteps( unsigned int steps )
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "SwarmSimulation::replaySteps", NVTX_COLOR_SIMULATION );
+
+	CaptureKey key = { particles_[current_]->getArrays().x, liveParticles_, steps };
+	unsigned int first = current_;
+
+	if ( !kernel_has_capture( key ) )
+	{
+		kernel_begin_capture( stream_ );										// Record the steps, nothing runs yet
+		for ( unsigned int i = 0; i < steps; i++ )
+			advanceStep();
+		kernel_end_capture( key, stream_ );
+		current_ = first;
+	}
+
+	for ( unsigned int i = 0; i < steps; i++ )
+	{
+		moveSwarmCenter();														// Swarm centers of the steps are set per replay
+		kernel_set_captured_step( i, swarmCenter );
+	}
+	kernel_launch_capture( stream_ );
+
+	if ( steps % 2 == 1 )														// Every step swapped the stores
+		current_ = 1 - first;
+	if ( compactInterval_ > 0 )
+		stepsSinceCompact_ += steps;
+	if ( reorderInterval_ > 0 )
+		stepsSinceReorder_ += steps;
+	stepCount_ += steps;
+	simulatedTime_ += dt_ * stepScale_ * steps;
+}
+
+void SwarmSimulation::compactParticles()
+{
+	if ( compactInterval_ == 0 || ++stepsSinceCompact_ < compactInterval_ )
+		return;
+
+	NVTX_RANGE( NvtxDomain::RENDERER, "SwarmSimulation::compactParticles", NVTX_COLOR_SYNC );
+
+	stepsSinceCompact_ = 0;
+	unsigned int next = 1 - current_;
+	liveParticles_ = kernel_compact(											// Copy live fishies to the front of the other store
+		particles_[current_]->getArrays(),
+		particles_[next]->getArrays(),
+		liveParticles_,
+		stream_);
+	current_ = next;
+	slotsMoved_ = true;
+}
+
+void SwarmSimulation::reorderParticles()
+{
+	if ( reorderInterval_ == 0 || ++stepsSinceReorder_ < reorderInterval_ )
+		return;
+
+	NVTX_RANGE( NvtxDomain::RENDERER, "SwarmSimulation::reorderParticles", NVTX_COLOR_SIMULATION );
+
+	stepsSinceReorder_ = 0;
+	unsigned int next = 1 - current_;
+	kernel_reorder(																// Fishies close in space get close in memory
+		particles_[current_]->getArrays(),
+		particles_[next]->getArrays(),
+		liveParticles_,
+		stream_);
+	current_ = next;
+	slotsMoved_ = true;
+}
+
+void SwarmSimulation::updateGridBounds()
+{
+	if ( !stats_->poll() )														// No stats of a request arrived
+		return;
+
+	const SwarmStats& stats = stats_->value();
+	kernel_set_grid_bounds( stats );											// Grid follows the swarm
+	if ( adaptiveStep_ )
+	{
+		// CFL-like bound: the fastest fish moves at most cflDistance_ per step, so it can't skip a neighbour.
+		float scale = stats.maxSpeed > 0.0f ? cflDistance_ / stats.maxSpeed : maxStepScale_;
+		stepScale_ = std::min( std::max( scale, 1.0f ), maxStepScale_ );		// Never shorter than the base step
+		kernel_set_step_scale( stepScale_ );
+	}
+}
+
+void SwarmSimulation::requestStats()
+{
+	kernel_reduce_stats( particles_[current_]->getArrays(), liveParticles_, stream_, stats_->slot() );	// Centroid, bounding box, ... of this step
+	stats_->post( stream_ );													// No wait, polled by getStats later
+}
+
+void SwarmSimulation::attachPositions( unsigned int store, float* x, float* y, float* z, unsigned char* alive )
+{
+	particles_[store]->attachPositions( x, y, z, alive, stream_ );
+}
+
+void SwarmSimulation::attachSpeeds( unsigned int store, float* vx, float* vy, float* vz )
+{
+	particles_[store]->attachSpeeds( vx, vy, vz, stream_ );
+}
+
+void SwarmSimulation::packWithStats( float4* verts, float4* directions )
+{
+	kernel_pack_stats( particles_[current_]->getArrays(), verts, directions, liveParticles_, stream_, stats_->slot() );	// One read of the fishies for both
+	stats_->post( stream_ );
+}
+
+std::vector<float> SwarmSimulation::readPositions()
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "SwarmSimulation::readPositions", NVTX_COLOR_SYNC );
+
+	ParticleArrays particles = particles_[current_]->getArrays();
+	std::vector<float> axes( liveParticles_ * 3 );
+	const float* source[3] = { particles.x, particles.y, particles.z };
+	for ( int axis = 0; axis < 3; axis++ )										// Structure of arrays on the GPU
+		CUDA_CHECK( cudaMemcpyAsync( axes.data() + axis * liveParticles_, source[axis], liveParticles_ * sizeof( float ),
+			cudaMemcpyDeviceToHost, stream_ ) );
+	CUDA_CHECK( cudaStreamSynchronize( stream_ ) );
+
+	std::vector<float> positions( liveParticles_ * 3 );
+	for ( unsigned int i = 0; i < liveParticles_; i++ )							// x, y, z per fish
+		for ( int axis = 0; axis < 3; axis++ )
+			positions[i * 3 + axis] = axes[axis * liveParticles_ + i];
+	return positions;
+}
+
+void SwarmSimulation::setParams( const SwarmParams& params )
+{
+	kernel_set_params( params );
+}
+
+SwarmParams SwarmSimulation::getParams() const
+{
+	return kernel_get_params();
+}
+
+void SwarmSimulation::cleanUp()
+{
+	device_.destroyStreams();													// Wait for the last step
+	delete stats_;
+	stats_ = NULL;
+	for ( int i = 0; i < 2; i++ )
+		delete particles_[i];													// Free GPU Memory
+	d_color = CudaDeviceArray<uchar4>();										// Free GPU Memory
+	d_sharks = CudaDeviceArray<float>();										// Free GPU Memory
+	d_shark_state = CudaDeviceArray<float>();									// Free GPU Memory
+	delete waypointList;
+	kernel_cleanup();															// Free uniform grid
+}
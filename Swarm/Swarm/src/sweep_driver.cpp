@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+#include "current_field.h"
+#include "host_simulation.h"
+#include "launch_check.h"
+#include "memory_tracker.h"
+#include "nvtx_range.h"
+#include "obstacles.h"
+#include "sweep_driver.h"
+
+SweepDriver::SweepDriver( const SwarmConfig& config ) :
+	axes_( config.sweep ),
+	output_( config.sweepOutput ),
+	fishies_( config.numParticles ),
+	sharksPerRun_( config.numSharks ),
+	dt_( 1.0 / config.simulationRate )
+{
+	speed = static_cast< float >( config.swarmSpeed * dt_ );					// Same distance per simulated second for every rate
+	matrix_ = sweepMatrix( config.params, axes_ );
+
+	waypointList = new WaypointList( config.waypoints );						// Initialize Waypoint path.
+	swarmCenter = waypointList->get();											// Get first swarm center for particles.
+
+	std::vector<int> devices = CudaDevice::rankDevices( config.device );		// The configured GPU first
+	if ( config.device >= 0 )
+		devices.resize( 1 );													// Only the configured one
+	unsigned int runs = static_cast< unsigned int >( matrix_.size() );
+	unsigned int gpus = std::min( static_cast< unsigned int >( devices.size() ), runs );
+	if ( !config.events.empty() || config.respawnRate > 0 )
+		std::cerr << "Events and respawn are ignored in a sweep" << std::endl;
+
+	// Shared by all contexts. Set before the contexts are created.
+	kernel_set_params( config.params );											// Parameters of the obstacles, the runs bring their own
+	kernel_set_seed( config.seed );												// GPU random numbers
+	kernel_set_spawn_box( config.spawnMin, config.spawnMax );					// Box of the spawned fishies
+	kernel_set_obstacles( bakeObstacles( config.obstacles, config.spawnMin, config.spawnMax, config.waypoints, config.obstacleRange,
+		config.obstacleResolution ), config.obstacleRange );					// Distance field of the obstacles
+	kernel_set_attractors( placeAttractors( config.attractors, config.spawnMin, config.spawnMax, config.waypoints,
+		config.attractorResolution ) );											// Field of the food patches and lures
+	kernel_set_alarm( placeAlarm( config.alarm, config.alarmDecay, config.spawnMin, config.spawnMax, config.waypoints,
+		config.params.centerThreshold, config.alarmResolution ) );				// Alarm waves of the evading fishies
+	kernel_set_current( loadCurrent( config ), config.currentStrength / config.simulationRate, config.currentPeriod );	// Current of the water
+
+	std::vector<float> h_shark_data;
+	std::vector<float> h_shark_state;
+	spawnSharks( sharksPerRun_, h_shark_data, h_shark_state, config.spawnMin, config.spawnMax );	// Sharks of one run
+
+	shards_.resize( gpus );
+	for ( unsigned int d = 0; d < gpus; d++ )
+	{
+		Shard& shard = shards_[d];
+		shard.first = static_cast< unsigned int >( static_cast< unsigned long long >( runs ) * d / gpus );
+		shard.runs = static_cast< unsigned int >( static_cast< unsigned long long >( runs ) * ( d + 1 ) / gpus ) - shard.first;
+		unsigned int count = shard.runs * fishies_;
+
+		shard.device = new CudaDevice( devices[d] );							// Makes the GPU current
+		std::cout << *shard.device << std::endl;
+		shard.stream = shard.device->getStream( shard.device->createStream() );
+		shard.context = kernel_create_context();
+		kernel_use_context( shard.context );
+		kernel_init_grid( count, shard.device->getProperties() );				// Launch configuration for all fishies of the shard
+		kernel_set_ensemble( packEnsemble( std::vector<SwarmParams>( matrix_.begin() + shard.first, matrix_.begin() + shard.first + shard.runs ),
+			fishies_, sharksPerRun_ ) );										// Offsets and parameter table of the runs
+
+		for ( int i = 0; i < 2; i++ )
+		{
+			shard.particles[i] = new ParticleStore( count );
+			for ( unsigned int r = 0; r < shard.runs; r++ )						// Same start and ids in every run: only the parameters differ
+				kernel_spawn( offsetParticles( shard.particles[i]->getArrays(), r * fishies_ ), fishies_, NULL, shard.stream );
+		}
+
+		std::vector<float> h_all_data, h_all_state;
+		for ( unsigned int r = 0; r < shard.runs; r++ )							// Every run starts with the same sharks
+		{
+			h_all_data.insert( h_all_data.end(), h_shark_data.begin(), h_shark_data.end() );
+			h_all_state.insert( h_all_state.end(), h_shark_state.begin(), h_shark_state.end() );
+		}
+		shard.sharks = new CudaDeviceArray<float>( shard.runs * sharksPerRun_ * 4, MemoryCategory::PARTICLES );
+		shard.sharkState = new CudaDeviceArray<float>( shard.runs * sharksPerRun_ * 4, MemoryCategory::PARTICLES );
+		shard.sharks->set( h_all_data.data(), shard.runs * sharksPerRun_ * 4 );
+		shard.sharkState->set( h_all_state.data(), shard.runs * sharksPerRun_ * 4 );
+		shard.h_metrics = new CudaHostArray<EnsembleMetrics>( shard.runs );
+		shard.telemetry = new GpuTelemetry( config.telemetry, devices[d] );
+	}
+
+	std::cout << "Sweep:                            " << runs << " runs of " << fishies_ << " fishies on " << gpus << " GPUs" << std::endl;
+	restore();
+	std::cout << memoryReport();												// Device budget after all buffers of the sweep exist
+}
+
+void SweepDriver::moveSwarmCenter()
+{
+	Vector3 diff = waypointList->get() - swarmCenter;							// Get Next Swarm center
+	if (diff.length() < WAYPOINT_THRESHOLD)										// Check if center was reached
+	{
+		diff = waypointList->getNext() - swarmCenter;
+	}
+
+	diff = diff.normalized() * speed;
+	swarmCenter += diff;
+}
+
+void SweepDriver::use( const Shard& shard )
+{
+	CUDA_CHECK( cudaSetDevice( shard.device->getDevice() ) );
+	kernel_use_context( shard.context );
+}
+
+void SweepDriver::restore()
+{
+	if ( !shards_.empty() )
+		CUDA_CHECK( cudaSetDevice( shards_[0].device->getDevice() ) );
+	kernel_use_context( NULL );
+}
+
+void SweepDriver::step()
+{
+	NVTX_RANGE( NvtxDomain::RENDERER, "SweepDriver::step", NVTX_COLOR_SIMULATION );
+
+	moveSwarmCenter();															// Set new Swarm center
+	unsigned int randomStep = kernel_get_random_step();
+	unsigned int next = 1 - current_;											// Write into the other stores
+
+	for ( Shard& shard : shards_ )
+	{
+		use( shard );
+		kernel_set_random_step( randomStep );									// Same random numbers on every GPU
+		kernel_advance_ensemble(												// All runs of the GPU in one launch
+			shard.particles[current_]->getArrays(),
+			shard.particles[next]->getArrays(),
+			speed,
+			swarmCenter,
+			reinterpret_cast<float4*>( shard.sharks->getData() ),
+			shard.stream );
+		kernel_move_sharks(														// The sharks of all runs follow the swarm center
+			reinterpret_cast<float4*>( shard.sharks->getData() ),
+			reinterpret_cast<float4*>( shard.sharkState->getData() ),
+			shard.runs * sharksPerRun_,
+			speed,
+			shard.stream );
+		CUDA_CHECK_FRAME( shard.stream );										// Errors of finished steps, without waiting
+	}
+	kernel_set_random_step( randomStep + 1 );
+	current_ = next;															// Swap stores
+}
+
+void SweepDriver::run( unsigned int steps )
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	for ( Shard& shard : shards_ )
+		shard.telemetry->begin();												// Energy of the timed steps only
+
+	for ( unsigned int i = 0; i < steps; i++ )
+		step();
+
+	for ( Shard& shard : shards_ )
+		CUDA_CHECK( cudaStreamSynchronize( shard.stream ) );					// Wait for the last step
+	auto end = std::chrono::high_resolution_clock::now();
+	for ( Shard& shard : shards_ )
+		shard.telemetry->end();
+
+	for ( Shard& shard : shards_ )												// Summaries of the last step, all GPUs at once
+	{
+		use( shard );
+		kernel_ensemble_metrics( shard.particles[current_]->getArrays(), shard.h_metrics->getData(), shard.stream );
+	}
+	for ( Shard& shard : shards_ )
+		CUDA_CHECK( cudaStreamSynchronize( shard.stream ) );
+	restore();
+
+	double seconds = std::chrono::duration<double>( end - start ).count();
+	std::cout << "Steps:                            " << steps << "\n";
+	std::cout << "Time:                             " << seconds << " s\n";
+	std::cout << "Runs:                             " << matrix_.size() << " of " << fishies_ << " fishies\n";
+	for ( size_t d = 0; d < shards_.size(); d++ )
+		std::cout << "GPU " << d << ":                            runs " << shards_[d].first << " to " << shards_[d].first + shards_[d].runs - 1 << "\n";
+	std::cout << "Particle updates per second:      " << static_cast< double >( matrix_.size() ) * fishies_ * steps / seconds << "\n";
+	for ( size_t d = 0; d < shards_.size(); d++ )
+	{
+		if ( shards_[d].telemetry->isEnabled() )
+			std::cout << "GPU " << d << ":\n" << shards_[d].telemetry->report( static_cast< double >( shards_[d].runs ) * fishies_ * steps );
+	}
+
+	if ( output_.empty() )
+		writeSummary( std::cout, steps );
+	else
+	{
+		std::ofstream file( output_, std::ios::out | std::ios::trunc );
+		writeSummary( file, steps );
+		if ( !file )
+			std::cerr << "Impossible to write " << output_ << "!" << std::endl;
+		else
+			std::cout << "Summary:                          " << output_ << "\n";
+	}
+	std::cout << std::flush;
+	if ( launchErrorCount() > 0 )
+		std::cerr << launchErrorCount() << " CUDA errors, the results are invalid" << std::endl;
+}
+
+void SweepDriver::writeSummary( std::ostream& os, unsigned int steps )
+{
+	bool telemetry = !shards_.empty() && shards_[0].telemetry->isEnabled();
+	os << "run,gpu";																// CSV, one line per run
+	for ( const ParamSweep& axis : axes_ )
+		os << "," << axis.name;
+	os << ",live,survival,centroid_x,centroid_y,centroid_z,cohesion,mean_speed,nearest_mean,nearest_stddev,nearest_min";
+	if ( telemetry )
+		os << GpuTelemetry::csvColumns() << ",joules_per_mfish_step";
+	os << "\n";
+	for ( size_t d = 0; d < shards_.size(); d++ )
+	{
+		const Shard& shard = shards_[d];
+		GpuSample mean = shard.telemetry->getMean();							// The runs of a GPU share it, so they share its readings
+		double fishSteps = static_cast< double >( shard.runs ) * fishies_ * steps;
+		for ( unsigned int r = 0; r < shard.runs; r++ )
+		{
+			const EnsembleMetrics& metrics = ( *shard.h_metrics )[r];
+			os << shard.first + r << "," << d;
+			for ( const ParamSweep& axis : axes_ )
+				os << "," << matrix_[shard.first + r].*axis.field;
+			os << "," << metrics.liveCount << "," << metrics.survival << "," << metrics.centroid.x << "," << metrics.centroid.y << "," << metrics.centroid.z
+			   << "," << metrics.cohesion << "," << metrics.meanSpeed / dt_ << "," << metrics.nearestMean << "," << metrics.nearestStdDev << "," << metrics.nearestMin;
+			if ( telemetry )
+			{
+				GpuTelemetry::writeCsv( os, mean );
+				os << "," << ( fishSteps > 0.0 ? shard.telemetry->getJoules() / ( fishSteps * 1e-6 ) : 0.0 );
+			}
+			os << "\n";
+		}
+	}
+}
+
+void SweepDriver::cleanUp()
+{
+	for ( Shard& shard : shards_ )
+	{
+		use( shard );
+		shard.device->destroyStreams();											// Wait for the last step
+		for ( int i = 0; i < 2; i++ )
+			delete shard.particles[i];											// Free GPU Memory
+		delete shard.sharks;
+		delete shard.sharkState;
+		delete shard.h_metrics;
+		delete shard.telemetry;
+		kernel_cleanup();														// Free ensemble tables of this GPU
+		kernel_destroy_context( shard.context );
+	}
+
+	restore();																	// First GPU, the contexts are gone
+	for ( Shard& shard : shards_ )
+		delete shard.device;
+	shards_.clear();
+	delete waypointList;
+}
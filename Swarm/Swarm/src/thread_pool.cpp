@@ -0,0 +1,79 @@
+#include <algorithm>
+
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool( unsigned int threads ) :
+	next_( 0 )
+{
+	if ( threads == 0 )
+		threads = std::max( std::thread::hardware_concurrency(), 1u );		// 0 if unknown
+
+	for ( unsigned int i = 1; i < threads; i++ )								// The caller is the first thread
+		workers_.emplace_back( &ThreadPool::work, this );
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		stop_ = true;
+	}
+	wakeUp_.notify_all();
+	for ( std::thread& worker : workers_ )
+		worker.join();
+}
+
+void ThreadPool::runChunks()
+{
+	while ( true )
+	{
+		unsigned int begin = next_.fetch_add( chunk_ );
+		if ( begin >= count_ )
+			return;
+		( *body_ )( begin, std::min( begin + chunk_, count_ ) );
+	}
+}
+
+void ThreadPool::work()
+{
+	unsigned long long seen = 0;
+	while ( true )
+	{
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			wakeUp_.wait( lock, [this, seen]() { return stop_ || generation_ != seen; } );
+			if ( stop_ )
+				return;
+			seen = generation_;
+		}
+
+		runChunks();
+
+		std::lock_guard<std::mutex> lock( mutex_ );
+		if ( --active_ == 0 )
+			done_.notify_one();
+	}
+}
+
+void ThreadPool::parallelFor( unsigned int count, unsigned int chunk, const RangeBody& body )
+{
+	if ( count == 0 )
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );								// Workers read the settings after taking the lock
+		body_ = &body;
+		count_ = count;
+		chunk_ = std::max( chunk, 1u );
+		next_ = 0;
+		active_ = static_cast< unsigned int >( workers_.size() );
+		generation_++;
+	}
+	wakeUp_.notify_all();
+
+	runChunks();
+
+	std::unique_lock<std::mutex> lock( mutex_ );
+	done_.wait( lock, [this]() { return active_ == 0; } );						// Every worker is out of runChunks
+	body_ = NULL;
+}
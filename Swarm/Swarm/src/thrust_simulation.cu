@@ -0,0 +1,658 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include <thrust/binary_search.h>
+#include <thrust/device_vector.h>
+#include <thrust/for_each.h>
+#include <thrust/gather.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <thrust/sequence.h>
+#include <thrust/sort.h>
+#include <thrust/transform.h>
+#include <thrust/transform_reduce.h>
+
+#include "host_simulation.h"
+#include "thrust_simulation.h"
+
+// Without nvcc thrust defines __host__ and __device__ empty, the functors compile for the OpenMP and TBB systems as well.
+
+static const unsigned int DEAD_CELL = 0xffffffff;		// Cell hash of eaten fishies, sorted behind all cells.
+static const unsigned int RANDOM_JITTER = 0;			// RandomUse of kernel.cu.
+static const unsigned int RANDOM_USES = 2;
+
+/*!
+ * @brief Raw pointers of one store, for the functors.
+ */
+struct StoreView
+{
+	float* x;
+	float* y;
+	float* z;
+	float* vx;
+	float* vy;
+	float* vz;
+	float* mass;
+	unsigned char* alive;
+};
+
+/*!
+ * @brief Placement of the grid, for the functors.
+ */
+struct GridView
+{
+	float origin[3];						//!< Lower corner of cell (0, 0, 0).
+	float cellSize;							//!< Edge length of a cell.
+	int dims[3];							//!< Cells per axis. Cells outside wrap around.
+
+	/*!
+	 * @brief Cell coordinates of a position.
+	 * @param p position.
+	 * @param cell Output: cell coordinates.
+	 */
+	__host__ __device__ void cellOf( const float p[3], int cell[3] ) const
+	{
+		for ( int axis = 0; axis < 3; axis++ )
+			cell[axis] = static_cast< int >( floorf( ( p[axis] - origin[axis] ) / cellSize ) );
+	}
+
+	/*!
+	 * @brief Cell hash, wrapped like d_calcGridHash.
+	 * @param cell cell coordinates.
+	 * @return hash.
+	 */
+	__host__ __device__ unsigned int hash( const int cell[3] ) const
+	{
+		int wrapped[3];
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			int x = cell[axis] % dims[axis];
+			wrapped[axis] = x < 0 ? x + dims[axis] : x;
+		}
+		return ( wrapped[2] * dims[1] + wrapped[1] ) * dims[0] + wrapped[0];
+	}
+};
+
+struct ThrustSimulation::Arrays
+{
+	/*!
+	 * @brief Fishies in SoA layout.
+	 */
+	struct Store
+	{
+		thrust::device_vector<float> x, y, z;		//!< Positions.
+		thrust::device_vector<float> vx, vy, vz;	//!< Speed vectors.
+		thrust::device_vector<float> mass;			//!< Masses.
+		thrust::device_vector<unsigned char> alive;	//!< 0: eaten.
+
+		/*!
+		 * @brief Raw pointers for the functors.
+		 * @return pointers.
+		 */
+		StoreView view()
+		{
+			StoreView v = { thrust::raw_pointer_cast( x.data() ), thrust::raw_pointer_cast( y.data() ), thrust::raw_pointer_cast( z.data() ),
+				thrust::raw_pointer_cast( vx.data() ), thrust::raw_pointer_cast( vy.data() ), thrust::raw_pointer_cast( vz.data() ),
+				thrust::raw_pointer_cast( mass.data() ), thrust::raw_pointer_cast( alive.data() ) };
+			return v;
+		}
+	};
+
+	Store stores[2];										//!< Ping-pong stores.
+	thrust::device_vector<unsigned int> cellOf;				//!< Cell hash per fish, sorted in place by buildGrid.
+	thrust::device_vector<unsigned int> sortedIndex;		//!< Fish index in cell order.
+	thrust::device_vector<unsigned int> cellStart;			//!< Index of the first fish per cell in the sorted arrays, one more entry for the end.
+	thrust::device_vector<float> sortedX, sortedY, sortedZ;	//!< Positions in cell order.
+	thrust::device_vector<float> sharks;					//!< Shark positions (x, y, z, w) of the step.
+};
+
+/*!
+ * @brief Sums of the living fishies, the element of the stats reduction.
+ */
+struct StatsSum
+{
+	double position[3];
+	float boundsMin[3];
+	float boundsMax[3];
+	double speed;
+	unsigned int count;
+};
+
+/*!
+ * @brief One round of Philox4x32-10, as in CpuSimulation.
+ * @param ctr counter. Will be updated.
+ * @param key key of the round.
+ */
+__host__ __device__ static void philoxRound( unsigned int ctr[4], const unsigned int key[2] )
+{
+	unsigned long long p0 = 0xD2511F53ull * ctr[0];
+	unsigned long long p1 = 0xCD9E8D57ull * ctr[2];
+	unsigned int hi0 = static_cast< unsigned int >( p0 >> 32 ), lo0 = static_cast< unsigned int >( p0 );
+	unsigned int hi1 = static_cast< unsigned int >( p1 >> 32 ), lo1 = static_cast< unsigned int >( p1 );
+	unsigned int next[4] = { hi1 ^ ctr[1] ^ key[0], lo1, hi0 ^ ctr[3] ^ key[1], lo0 };
+	for ( int i = 0; i < 4; i++ )
+		ctr[i] = next[i];
+}
+
+/*!
+ * @brief Four uniform random numbers in (0, 1], the same as d_random4 on the GPU.
+ * @param seed seed of the run.
+ * @param id index of the fish.
+ * @param offset ( step * RANDOM_USES + use ) * 4.
+ * @param random Output: random numbers.
+ */
+__host__ __device__ static void philoxUniform4( unsigned long long seed, unsigned int id, unsigned long long offset, float random[4] )
+{
+	unsigned long long block = offset / 4;
+	unsigned int ctr[4] = { static_cast< unsigned int >( block ), static_cast< unsigned int >( block >> 32 ), id, 0 };
+	unsigned int key[2] = { static_cast< unsigned int >( seed ), static_cast< unsigned int >( seed >> 32 ) };
+	for ( int round = 0; round < 10; round++ )
+	{
+		if ( round > 0 )
+		{
+			key[0] += 0x9E3779B9;
+			key[1] += 0xBB67AE85;
+		}
+		philoxRound( ctr, key );
+	}
+	for ( int i = 0; i < 4; i++ )
+		random[i] = ctr[i] * 2.3283064e-10f + 2.3283064e-10f / 2.0f;			// curand_uniform
+}
+
+/*!
+ * @brief Normalize a difference vector like DeviceVector::normalized, which counts w = 1 into the length.
+ * @param v vector. Will be updated.
+ */
+__host__ __device__ static void normalizeDiff( float v[3] )
+{
+	float inv = 1.0f / sqrtf( v[0] * v[0] + v[1] * v[1] + v[2] * v[2] + 1.0f );
+	v[0] *= inv;
+	v[1] *= inv;
+	v[2] *= inv;
+}
+
+/*!
+ * @brief Length of a vector (x, y, z).
+ * @param v vector.
+ * @return length.
+ */
+__host__ __device__ static float length3( const float v[3] )
+{
+	return sqrtf( v[0] * v[0] + v[1] * v[1] + v[2] * v[2] );
+}
+
+/*!
+ * @brief Cell hash per fish, DEAD_CELL for eaten ones.
+ */
+struct CellHash
+{
+	StoreView fishies;
+	GridView grid;
+
+	__host__ __device__ unsigned int operator()( unsigned int i ) const
+	{
+		if ( !fishies.alive[i] )
+			return DEAD_CELL;
+		float p[3] = { fishies.x[i], fishies.y[i], fishies.z[i] };
+		int cell[3];
+		grid.cellOf( p, cell );
+		return grid.hash( cell );
+	}
+};
+
+/*!
+ * @brief Sums of one fish for the stats reduction.
+ */
+struct FishStats
+{
+	StoreView fishies;
+
+	__host__ __device__ StatsSum operator()( unsigned int i ) const
+	{
+		StatsSum sum;
+		float p[3] = { fishies.x[i], fishies.y[i], fishies.z[i] };
+		float v[3] = { fishies.vx[i], fishies.vy[i], fishies.vz[i] };
+		bool alive = fishies.alive[i] != 0;
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			sum.position[axis] = alive ? p[axis] : 0.0;
+			sum.boundsMin[axis] = alive ? p[axis] : FLT_MAX;
+			sum.boundsMax[axis] = alive ? p[axis] : -FLT_MAX;
+		}
+		sum.speed = alive ? length3( v ) : 0.0;
+		sum.count = alive ? 1 : 0;
+		return sum;
+	}
+};
+
+/*!
+ * @brief Combine two sums of the stats reduction.
+ */
+struct AddStats
+{
+	__host__ __device__ StatsSum operator()( const StatsSum& a, const StatsSum& b ) const
+	{
+		StatsSum sum;
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			sum.position[axis] = a.position[axis] + b.position[axis];
+			sum.boundsMin[axis] = fminf( a.boundsMin[axis], b.boundsMin[axis] );
+			sum.boundsMax[axis] = fmaxf( a.boundsMax[axis], b.boundsMax[axis] );
+		}
+		sum.speed = a.speed + b.speed;
+		sum.count = a.count + b.count;
+		return sum;
+	}
+};
+
+/*!
+ * @brief Advance one fish with the rules of d_swim, reading the current store and writing the next one.
+ */
+struct Swim
+{
+	StoreView fishies;						//!< Current store.
+	StoreView next;							//!< Store of the new state.
+	const float* sortedX;					//!< Positions in cell order.
+	const float* sortedY;
+	const float* sortedZ;
+	const unsigned int* sortedIndex;		//!< Fish index in cell order.
+	const unsigned int* cellStart;			//!< First fish per cell, one more entry for the end.
+	const float* sharks;					//!< Shark positions (x, y, z, w).
+	unsigned int numSharks;
+	GridView grid;
+	SwarmParams params;
+	unsigned int firstK;
+	float speed;							//!< Distance per step.
+	float center[3];						//!< Swarm center of the step.
+	unsigned long long seed;
+	unsigned int step;						//!< Random step of this advance.
+
+	/*!
+	 * @brief Find the closest fish in the 27 cells around a position, like GridSearch.
+	 * @param p position.
+	 * @param self index of the searching fish.
+	 * @param closest Output: difference vector to the closest fish.
+	 * @return distance to the closest fish, FLT_MAX if there is none.
+	 */
+	__host__ __device__ float closestFish( const float p[3], unsigned int self, float closest[3] ) const
+	{
+		int cell[3];
+		grid.cellOf( p, cell );
+		float best = FLT_MAX;
+		unsigned int bestSlot = 0;
+		unsigned int found = 0;
+		float fishDist2 = params.fishDist * params.fishDist;
+
+		for ( int n = 0; n < 27 && ( firstK == 0 || found < firstK ); n++ )
+		{
+			int neighbour[3] = { cell[0] + n % 3 - 1, cell[1] + n / 3 % 3 - 1, cell[2] + n / 9 - 1 };
+			unsigned int hash = grid.hash( neighbour );
+			for ( unsigned int i = cellStart[hash]; i < cellStart[hash + 1]; i++ )
+			{
+				if ( sortedIndex[i] == self )
+					continue;
+				float dx = p[0] - sortedX[i], dy = p[1] - sortedY[i], dz = p[2] - sortedZ[i];
+				float d2 = dx * dx + dy * dy + dz * dz;
+				if ( d2 < best )
+				{
+					best = d2;
+					bestSlot = i;
+				}
+				if ( firstK > 0 && d2 < fishDist2 && ++found >= firstK )		// Stops inside a cell like NeighbourQuery
+					break;
+			}
+		}
+
+		if ( best == FLT_MAX )
+			return FLT_MAX;
+		closest[0] = p[0] - sortedX[bestSlot];
+		closest[1] = p[1] - sortedY[bestSlot];
+		closest[2] = p[2] - sortedZ[bestSlot];
+		return sqrtf( best );
+	}
+
+	__host__ __device__ void operator()( unsigned int i ) const
+	{
+		float vert[3] = { fishies.x[i], fishies.y[i], fishies.z[i] };
+		float state[3] = { fishies.vx[i], fishies.vy[i], fishies.vz[i] };
+		float mass = fishies.mass[i];
+		next.mass[i] = mass;
+		next.alive[i] = fishies.alive[i];
+
+		if ( fishies.alive[i] )
+		{
+			float mySpeed = speed * mass;
+			float accelerationFactor = params.accelerationFactor;
+
+			float sharkDiff[3] = { 0.0f, 0.0f, 0.0f };							// nearest shark
+			float sharkDistance2 = FLT_MAX;
+			for ( unsigned int s = 0; s < numSharks; s++ )
+			{
+				float d[3] = { sharks[s * 4] - vert[0], sharks[s * 4 + 1] - vert[1], sharks[s * 4 + 2] - vert[2] };
+				float d2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+				if ( d2 < sharkDistance2 )
+				{
+					for ( int axis = 0; axis < 3; axis++ )
+						sharkDiff[axis] = d[axis];
+					sharkDistance2 = d2;
+				}
+			}
+			float sharkDistance = sharkDistance2 < FLT_MAX ? sqrtf( sharkDistance2 ) : FLT_MAX;
+
+			if ( sharkDistance < params.sharkBiteDist )							// shark eats fish
+			{
+				next.alive[i] = 0;
+			}
+			else
+			{
+				if ( sharkDistance < params.sharkDist * mass )					// evade shark
+				{
+					normalizeDiff( sharkDiff );
+					for ( int axis = 0; axis < 3; axis++ )
+						state[axis] -= sharkDiff[axis] * mySpeed * accelerationFactor;
+				}
+				else
+				{
+					float closest[3];											// find closest fish
+					float closestDist = closestFish( vert, i, closest );
+					float diff[3] = { center[0] - vert[0], center[1] - vert[1], center[2] - vert[2] };
+
+					if ( closestDist < params.fishDist )						// keep distance to other fishies
+					{
+						normalizeDiff( closest );
+						for ( int axis = 0; axis < 3; axis++ )
+						{
+							state[axis] -= closest[axis] * mySpeed * accelerationFactor * 0.7f;
+							vert[axis] += state[axis];
+						}
+						accelerationFactor /= 2;
+					}
+					if ( length3( diff ) > params.centerThreshold * mass )		// return to swarm
+					{
+						normalizeDiff( diff );
+						for ( int axis = 0; axis < 3; axis++ )
+							state[axis] += diff[axis] * mySpeed * ( accelerationFactor * 0.4f );
+					}
+				}
+				if ( params.jitter > 0.0f )
+				{
+					float random[4];
+					philoxUniform4( seed, i, ( static_cast< unsigned long long >( step ) * RANDOM_USES + RANDOM_JITTER ) * 4, random );
+					for ( int axis = 0; axis < 3; axis++ )
+						state[axis] += ( 2.0f * random[axis] - 1.0f ) * ( mySpeed * params.jitter );
+				}
+				if ( length3( state ) > mySpeed * 0.75f )
+				{
+					for ( int axis = 0; axis < 3; axis++ )
+						state[axis] *= 0.96f;
+				}
+				for ( int axis = 0; axis < 3; axis++ )
+					vert[axis] += state[axis];
+			}
+		}
+
+		next.x[i] = vert[0];
+		next.y[i] = vert[1];
+		next.z[i] = vert[2];
+		next.vx[i] = state[0];
+		next.vy[i] = state[1];
+		next.vz[i] = state[2];
+	}
+};
+
+ThrustSimulation::ThrustSimulation( const SwarmConfig& config ) :
+	arrays_( new Arrays() ),
+	numParticles_( config.numParticles ),
+	numSharks_( config.numSharks ),
+	params_( config.params ),
+	firstK_( config.firstK ),
+	seed_( config.seed ),
+	dt_( 1.0 / config.simulationRate )
+{
+	speed = static_cast< float >( config.swarmSpeed * dt_ );					// Same distance per simulated second for every rate
+
+	waypointList = new WaypointList( config.waypoints );						// Initialize Waypoint path.
+	swarmCenter = waypointList->get();											// Get first swarm center for particles.
+
+	std::vector<float> h_data;
+	std::vector<float> h_state;
+	spawnFish( numParticles_, h_data, h_state, config.spawnMin, config.spawnMax );	// Same spawn as the other backends
+	spawnSharks( numSharks_, sharks_, sharkState_, config.spawnMin, config.spawnMax );
+
+	std::vector<float> h_fields[7];												// AoS spawn data to SoA x, y, z, vx, vy, vz, mass
+	for ( int f = 0; f < 7; f++ )
+		h_fields[f].resize( numParticles_ );
+	for ( unsigned int i = 0; i < numParticles_; i++ )
+	{
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			h_fields[axis][i] = h_data[i * 4 + axis];
+			h_fields[3 + axis][i] = h_state[i * 4 + axis];
+		}
+		h_fields[6][i] = h_state[i * 4 + 3];
+	}
+	for ( int s = 0; s < 2; s++ )
+	{
+		Arrays::Store& store = arrays_->stores[s];
+		store.x = h_fields[0];
+		store.y = h_fields[1];
+		store.z = h_fields[2];
+		store.vx = h_fields[3];
+		store.vy = h_fields[4];
+		store.vz = h_fields[5];
+		store.mass = h_fields[6];
+		store.alive.assign( numParticles_, 1 );
+	}
+
+	arrays_->cellOf.resize( numParticles_ );
+	arrays_->sortedIndex.resize( numParticles_ );
+	arrays_->cellStart.resize( GRID_NUM_CELLS + 1 );
+	arrays_->sortedX.resize( numParticles_ );
+	arrays_->sortedY.resize( numParticles_ );
+	arrays_->sortedZ.resize( numParticles_ );
+	arrays_->sharks = sharks_;
+
+	std::cout << "Thrust simulation on the " << deviceSystem() << " device system" << std::endl;
+
+	reduceStats();
+}
+
+ThrustSimulation::~ThrustSimulation()
+{
+	delete arrays_;
+	delete waypointList;
+}
+
+const char* ThrustSimulation::deviceSystem()
+{
+#if THRUST_DEVICE_SYSTEM == THRUST_DEVICE_SYSTEM_CUDA
+	return "CUDA";
+#elif THRUST_DEVICE_SYSTEM == THRUST_DEVICE_SYSTEM_OMP
+	return "OpenMP";
+#elif THRUST_DEVICE_SYSTEM == THRUST_DEVICE_SYSTEM_TBB
+	return "TBB";
+#else
+	return "C++";
+#endif
+}
+
+bool ThrustSimulation::needsCuda()
+{
+	return THRUST_DEVICE_SYSTEM == THRUST_DEVICE_SYSTEM_CUDA;
+}
+
+void ThrustSimulation::moveSwarmCenter()
+{
+	Vector3 diff = waypointList->get() - swarmCenter;							// Get Next Swarm center
+	if (diff.length() < WAYPOINT_THRESHOLD)										// Check if center was reached
+	{
+		diff = waypointList->getNext() - swarmCenter;
+	}
+
+	diff = diff.normalized() * speed;
+	swarmCenter += diff;
+}
+
+void ThrustSimulation::reduceStats()
+{
+	StatsSum init;
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		init.position[axis] = 0.0;
+		init.boundsMin[axis] = FLT_MAX;
+		init.boundsMax[axis] = -FLT_MAX;
+	}
+	init.speed = 0.0;
+	init.count = 0;
+
+	FishStats fishStats = { arrays_->stores[current_].view() };
+	StatsSum total = thrust::transform_reduce( thrust::counting_iterator<unsigned int>( 0 ), thrust::counting_iterator<unsigned int>( numParticles_ ),
+		fishStats, init, AddStats() );
+
+	stats_ = SwarmStats();
+	stats_.liveCount = total.count;
+	if ( total.count == 0 )
+		return;
+	double inv = 1.0 / total.count;
+	stats_.centroid.x = static_cast< float >( total.position[0] * inv );
+	stats_.centroid.y = static_cast< float >( total.position[1] * inv );
+	stats_.centroid.z = static_cast< float >( total.position[2] * inv );
+	stats_.boundsMin.x = total.boundsMin[0];
+	stats_.boundsMin.y = total.boundsMin[1];
+	stats_.boundsMin.z = total.boundsMin[2];
+	stats_.boundsMax.x = total.boundsMax[0];
+	stats_.boundsMax.y = total.boundsMax[1];
+	stats_.boundsMax.z = total.boundsMax[2];
+	stats_.meanSpeed = static_cast< float >( total.speed * inv );
+}
+
+void ThrustSimulation::placeGrid()
+{
+	cellSize_ = params_.fishDist;
+	if ( stats_.liveCount == 0 )
+	{
+		std::fill( origin_, origin_ + 3, 0.0f );
+		std::fill( dims_, dims_ + 3, 3 );
+		return;
+	}
+
+	float margin = 2.0f * cellSize_;											// Same placement as kernel_set_grid_bounds
+	float lower[3] = { stats_.boundsMin.x, stats_.boundsMin.y, stats_.boundsMin.z };
+	float upper[3] = { stats_.boundsMax.x, stats_.boundsMax.y, stats_.boundsMax.z };
+	for ( int axis = 0; axis < 3; axis++ )
+	{
+		float cells = std::ceil( ( upper[axis] - lower[axis] + 2.0f * margin ) / cellSize_ );
+		dims_[axis] = static_cast< int >( std::min( std::max( cells, 3.0f ), static_cast< float >( GRID_SIZE ) ) );
+		origin_[axis] = lower[axis] - margin;
+	}
+}
+
+void ThrustSimulation::buildGrid()
+{
+	Arrays::Store& store = arrays_->stores[current_];
+	GridView grid = { { origin_[0], origin_[1], origin_[2] }, cellSize_, { dims_[0], dims_[1], dims_[2] } };
+	CellHash cellHash = { store.view(), grid };
+	thrust::counting_iterator<unsigned int> first( 0 );
+	thrust::transform( first, first + numParticles_, arrays_->cellOf.begin(), cellHash );
+	thrust::sequence( arrays_->sortedIndex.begin(), arrays_->sortedIndex.end() );
+	thrust::stable_sort_by_key( arrays_->cellOf.begin(), arrays_->cellOf.end(), arrays_->sortedIndex.begin() );	// Keeps the index order inside a cell, eaten fishies last
+
+	unsigned int numCells = dims_[0] * dims_[1] * dims_[2];						// Start of a cell: first sorted hash not below it
+	thrust::lower_bound( arrays_->cellOf.begin(), arrays_->cellOf.end(), first, first + numCells + 1, arrays_->cellStart.begin() );
+	thrust::gather( arrays_->sortedIndex.begin(), arrays_->sortedIndex.end(), store.x.begin(), arrays_->sortedX.begin() );
+	thrust::gather( arrays_->sortedIndex.begin(), arrays_->sortedIndex.end(), store.y.begin(), arrays_->sortedY.begin() );
+	thrust::gather( arrays_->sortedIndex.begin(), arrays_->sortedIndex.end(), store.z.begin(), arrays_->sortedZ.begin() );
+}
+
+void ThrustSimulation::moveSharks()
+{
+	for ( unsigned int s = 0; s < numSharks_; s++ )
+	{
+		float* shark = &sharks_[s * 4];
+		float* state = &sharkState_[s * 4];
+		float diff[3] = { swarmCenter.x - shark[0], swarmCenter.y - shark[1], swarmCenter.z - shark[2] };
+
+		float distance = length3( diff );
+		if ( distance > 4.0f )													// turn back to swarm
+		{
+			for ( int axis = 0; axis < 3; axis++ )
+				state[axis] += diff[axis] * ( speed * 0.2f / distance );
+			float length = length3( state );
+			if ( length > speed * 1.3f )
+			{
+				for ( int axis = 0; axis < 3; axis++ )
+					state[axis] *= speed * 1.3f / length;
+			}
+		}
+		else if ( length3( state ) < speed * 3 )								// swim through swarm or leave it
+		{
+			for ( int axis = 0; axis < 3; axis++ )
+				state[axis] *= 1.1f;
+		}
+
+		for ( int axis = 0; axis < 3; axis++ )
+			shark[axis] += state[axis];
+	}
+	arrays_->sharks = sharks_;													// A few floats, the fishies of the next step read them
+}
+
+void ThrustSimulation::step()
+{
+	moveSwarmCenter();															// Set new Swarm center
+
+	placeGrid();																// Around the fishies of the last step
+	buildGrid();
+
+	stepCount_++;																// Random step of this advance, counted like kernel_advance
+	Swim swim;
+	swim.fishies = arrays_->stores[current_].view();
+	swim.next = arrays_->stores[1 - current_].view();							// Write into the other store
+	swim.sortedX = thrust::raw_pointer_cast( arrays_->sortedX.data() );
+	swim.sortedY = thrust::raw_pointer_cast( arrays_->sortedY.data() );
+	swim.sortedZ = thrust::raw_pointer_cast( arrays_->sortedZ.data() );
+	swim.sortedIndex = thrust::raw_pointer_cast( arrays_->sortedIndex.data() );
+	swim.cellStart = thrust::raw_pointer_cast( arrays_->cellStart.data() );
+	swim.sharks = thrust::raw_pointer_cast( arrays_->sharks.data() );
+	swim.numSharks = numSharks_;
+	swim.grid = { { origin_[0], origin_[1], origin_[2] }, cellSize_, { dims_[0], dims_[1], dims_[2] } };
+	swim.params = params_;
+	swim.firstK = firstK_;
+	swim.speed = speed;
+	swim.center[0] = swarmCenter.x;
+	swim.center[1] = swarmCenter.y;
+	swim.center[2] = swarmCenter.z;
+	swim.seed = seed_;
+	swim.step = stepCount_;
+	thrust::for_each( thrust::counting_iterator<unsigned int>( 0 ), thrust::counting_iterator<unsigned int>( numParticles_ ), swim );
+	current_ = 1 - current_;													// Swap stores
+	particleUpdates_ += stats_.liveCount;
+
+	moveSharks();																// The fishies saw the old shark positions, as on the GPU
+	reduceStats();																// Synchronizes, the result is read on the host
+}
+
+void ThrustSimulation::run( unsigned int steps )
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	particleUpdates_ = 0.0;
+
+	for ( unsigned int i = 0; i < steps; i++ )
+		step();
+
+	auto end = std::chrono::high_resolution_clock::now();
+	const SwarmStats& stats = stats_;
+
+	double seconds = std::chrono::duration<double>( end - start ).count();
+	std::cout << "Steps:                            " << steps << "\n";
+	std::cout << "Time:                             " << seconds << " s\n";
+	std::cout << "Simulated time:                   " << steps * dt_ << " s\n";
+	std::cout << "Steps per second:                 " << steps / seconds << "\n";
+	std::cout << "Live particles:                   " << stats.liveCount << " of " << numParticles_ << "\n";
+	std::cout << "Particle updates per second:      " << particleUpdates_ / seconds << "\n";
+	std::cout << "Swarm centroid:                   " << stats.centroid.x << ", " << stats.centroid.y << ", " << stats.centroid.z << "\n";
+	std::cout << "Swarm bounds:                     " << stats.boundsMin.x << ", " << stats.boundsMin.y << ", " << stats.boundsMin.z
+			  << " to " << stats.boundsMax.x << ", " << stats.boundsMax.y << ", " << stats.boundsMax.z << "\n";
+	std::cout << "Mean speed:                       " << stats.meanSpeed / dt_ << " per s" << std::endl;
+}
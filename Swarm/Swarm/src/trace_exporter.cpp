@@ -0,0 +1,107 @@
+#include <chrono>
+#include <iostream>
+
+#include "trace_exporter.h"
+
+// Names and categories of the tracks, same order as TraceTrack.
+static const char* const TRACK_NAMES[] = { "render thread", "CUDA stream", "OpenGL" };
+static const char* const TRACK_CATEGORIES[] = { "cpu", "cuda", "gl" };
+
+TraceExporter::TraceExporter( const std::string& path ) :
+	path_( path ),
+	epoch_( now() )
+{
+	if ( path_.empty() )
+		return;
+
+	file_ = std::fopen( path_.c_str(), "w" );
+	if ( file_ == NULL )
+	{
+		std::cerr << "Impossible to write " << path_ << "!" << std::endl;
+		return;
+	}
+
+	std::fprintf( file_, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+	std::fprintf( file_, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Swarm\"}}" );
+	for ( unsigned int t = 0; t < static_cast< unsigned int >( TraceTrack::COUNT ); t++ )
+	{
+		std::fprintf( file_, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", t + 1, TRACK_NAMES[t] );
+		std::fprintf( file_, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"sort_index\":%u}}", t + 1, t );
+	}
+	pending_.reserve( BATCH );
+	writer_ = std::thread( &TraceExporter::writeEvents, this );
+}
+
+TraceExporter::~TraceExporter()
+{
+	if ( file_ == NULL )
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		if ( !pending_.empty() )
+			queue_.push_back( std::move( pending_ ) );
+		stop_ = true;
+	}
+	wakeUp_.notify_one();
+	writer_.join();
+
+	std::fprintf( file_, "\n]}\n" );
+	bool written = std::fclose( file_ ) == 0;
+	file_ = NULL;
+	if ( written )
+		std::cout << "Trace:                            " << events_ << " ranges in " << path_ << std::endl;
+	else
+		std::cerr << "Impossible to write " << path_ << "!" << std::endl;
+}
+
+double TraceExporter::now()
+{
+	return std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void TraceExporter::add( const char* name, TraceTrack track, double start, double ms )
+{
+	if ( file_ == NULL )
+		return;
+	pending_.push_back( { name, track, start, ms } );
+}
+
+void TraceExporter::submit()
+{
+	if ( file_ == NULL || pending_.size() < BATCH )
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		queue_.push_back( std::move( pending_ ) );
+	}
+	wakeUp_.notify_one();
+	pending_ = std::vector<TraceEvent>();
+	pending_.reserve( BATCH );
+}
+
+void TraceExporter::writeEvents()
+{
+	for ( ;; )
+	{
+		std::vector<TraceEvent> batch;
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			wakeUp_.wait( lock, [this]() { return stop_ || !queue_.empty(); } );
+			if ( queue_.empty() )
+				return;															// Stopped and everything written
+			batch = std::move( queue_.front() );
+			queue_.pop_front();
+		}
+
+		for ( const TraceEvent& event : batch )
+		{
+			unsigned int track = static_cast< unsigned int >( event.track );
+			std::fprintf( file_, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+				event.name, TRACK_CATEGORIES[track], ( event.start - epoch_ ) * 1e6, event.ms * 1e3, track + 1 );	// Microseconds
+		}
+		std::fflush( file_ );													// A trace of a crashed run keeps the batches so far
+		events_ += batch.size();
+	}
+}
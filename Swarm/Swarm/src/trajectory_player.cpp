@@ -0,0 +1,544 @@
+#include "glew.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Window.hpp"
+#include "trajectory_player.h"
+#include "frame_uniforms.h"
+#include "host_simulation.h"
+#include "kernel.h"
+#include "nvtx_range.h"
+#include "vertex_buffer_layout.h"
+
+static const double SEEK_SECONDS = 10.0;										// Page up and down
+
+/*!
+ * @brief Map a file for reading, like SnapshotFile::open. The pages are read while the loader thread copies the frames.
+ * @param path file.
+ * @param file Output: file handle (Windows).
+ * @param mapping Output: mapping handle (Windows).
+ * @param data Output: mapped file. NULL, if the file can't be mapped.
+ * @param size Output: size of the file.
+ */
+static void mapChunk( const std::string& path, void*& file, void*& mapping, const char*& data, size_t& size )
+{
+	data = NULL;
+	size = 0;
+#ifdef _WIN32
+	HANDLE handle = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if ( handle == INVALID_HANDLE_VALUE )
+		return;
+	file = handle;
+	LARGE_INTEGER length;
+	if ( GetFileSizeEx( handle, &length ) && length.QuadPart > 0 )
+	{
+		size = static_cast< size_t >( length.QuadPart );
+		mapping = CreateFileMappingA( handle, NULL, PAGE_READONLY, 0, 0, NULL );
+		if ( mapping != NULL )
+			data = static_cast< const char* >( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+	}
+#else
+	int handle = ::open( path.c_str(), O_RDONLY );
+	if ( handle < 0 )
+		return;
+	struct stat status;
+	if ( fstat( handle, &status ) == 0 && status.st_size > 0 )
+	{
+		size = static_cast< size_t >( status.st_size );
+		void* view = mmap( NULL, size, PROT_READ, MAP_PRIVATE, handle, 0 );
+		data = view == MAP_FAILED ? NULL : static_cast< const char* >( view );
+		if ( data != NULL )
+			madvise( view, size, MADV_SEQUENTIAL );								// Read ahead, the frames are played in order
+	}
+	::close( handle );															// The mapping keeps the file open
+#endif
+}
+
+/*!
+ * @brief Unmap a file of mapChunk.
+ * @param file file handle (Windows).
+ * @param mapping mapping handle (Windows).
+ * @param data mapped file, NULL: nothing mapped.
+ * @param size size of the file.
+ */
+static void unmapChunk( void* file, void* mapping, const char* data, size_t size )
+{
+#ifdef _WIN32
+	if ( data != NULL )
+		UnmapViewOfFile( data );
+	if ( mapping != NULL )
+		CloseHandle( mapping );
+	if ( file != NULL )
+		CloseHandle( file );
+#else
+	if ( data != NULL )
+		munmap( const_cast< char* >( data ), size );
+#endif
+}
+
+TrajectoryPlayer::TrajectoryPlayer( const SwarmConfig& config ) :
+	device_( CudaDevice::selectDevice( config.device ) ),						// The configured one, else the OpenGL GPU
+	shader_( "vertex.glsl", "fragment.glsl" ),									// Same point shader as the simulating backends
+	profiler_( config.profileInterval > 0, config.profileInterval, true ),
+	frameTimes_( config.frameBudget ),
+	frameDump_( config.frameDump ),
+	stepsPerSecond_( config.simulationRate ),
+	rate_( config.playbackRate )
+{
+	shader_.bindUniformBlock( "FrameUniforms", FRAME_UNIFORMS_BINDING );
+	frameUniforms_ = new UniformBuffer( sizeof( FrameUniforms ), FRAME_UNIFORMS_BINDING );
+	pointSizeLocation_ = shader_.getUniformHandle( "u_pointsize" );
+
+	glEnable( GL_BLEND );														// clean looking points.
+	glEnable( GL_PROGRAM_POINT_SIZE );											// enable to set the point size.
+
+	lastUpdate_ = Window::getInstance()->getCurrentTime();
+	if ( !open( config.playback ) )
+		return;
+
+	slotSize_ = frameSize_;
+	if ( compression_ != 0 )
+	{
+		compressor_ = new GpuCompressor( static_cast< Compression >( compression_ ), frameSize_, quantized_ ? sizeof( unsigned short ) : sizeof( float ) );
+		if ( !compressor_->isEnabled() )
+		{
+			std::cerr << "The recording is compressed (" << compressionName( static_cast< Compression >( compression_ ) ) << "), no playback." << std::endl;
+			frames_.clear();
+			return;
+		}
+		slotSize_ = compressor_->maxRecordSize( frameSize_ );
+		d_frame_.resize( frameSize_ );
+		if ( delta_ )
+		{
+			d_key_.resize( frameSize_ );
+			keyHost_ = new CudaHostArray<char>( slotSize_ );
+			d_keyRecord_.resize( slotSize_ );
+		}
+		statsHost_ = new CudaHostArray<SwarmStats>( 1 );
+		CUDA_CHECK( cudaEventCreateWithFlags( &statsCopied_, cudaEventDisableTiming ) );
+	}
+
+	stream_ = device_.getStream( device_.createStream() );
+	copyStream_ = CudaDevice::newStream( StreamClass::BACKGROUND );			// Uploads never delay an unpack
+	for ( Slot& slot : slots_ )
+	{
+		slot.host = new CudaHostArray<char>( slotSize_ );
+		slot.device.resize( slotSize_ );
+		CUDA_CHECK( cudaEventCreateWithFlags( &slot.copied, cudaEventDisableTiming ) );
+		CUDA_CHECK( cudaEventCreateWithFlags( &slot.unpacked, cudaEventDisableTiming ) );
+		CUDA_CHECK( cudaEventRecord( slot.copied, copyStream_ ) );				// Every slot is free
+		CUDA_CHECK( cudaEventRecord( slot.unpacked, stream_ ) );
+	}
+
+	std::vector<float> h_position( entries_ * 4, 0.0f );
+	for ( unsigned int i = 0; i < entries_; i++ )
+		h_position[i * 4 + 3] = -1.0f;											// Nothing shown before the first frame
+	vb_ = new VertexBuffer( h_position.data(), entries_ * 4 * sizeof( float ) );
+	vbResource_ = device_.registerGLBuffer( *vb_, cudaGraphicsRegisterFlagsWriteDiscard );	// Every unpack writes all entries
+
+	std::vector<unsigned char> h_color;
+	spawnColors( entries_, h_color );
+	vbC_ = new VertexBuffer( h_color.data(), entries_ * 4 );					// RGBA8
+
+	VertexBufferLayout layout;
+	layout.push<float>( 4, 0 );
+	VertexBufferLayout colorLayout;
+	colorLayout.push<unsigned char>( 4, 0 );									// Same packed colors as Renderer
+	va_.addBuffer( *vb_, layout );
+	va_.addBuffer( *vbC_, colorLayout.getElements()[0], 1 );
+	va_.unbind();
+	vbC_->unbind();
+
+	playhead_ = static_cast< double >( frames_.front().step );
+	loader_ = std::thread( &TrajectoryPlayer::loadFrames, this );
+}
+
+TrajectoryPlayer::~TrajectoryPlayer()
+{
+	cleanUp();
+}
+
+bool TrajectoryPlayer::open( const std::string& prefix )
+{
+	for ( unsigned int index = 0; ; index++ )
+	{
+		char name[32];
+		std::snprintf( name, sizeof( name ), "_%05u.traj", index );
+		MappedChunk chunk;
+		mapChunk( prefix + name, chunk.file, chunk.mapping, chunk.data, chunk.size );
+		if ( chunk.data == NULL )
+		{
+			unmapChunk( chunk.file, chunk.mapping, chunk.data, chunk.size );
+			if ( index == 0 )
+				std::cerr << "Impossible to open " << prefix << name << "!" << std::endl;
+			break;																// First missing chunk: end of the recording
+		}
+		chunks_.push_back( chunk );
+
+		TrajectoryChunkHeader header;
+		std::memcpy( &header, chunk.data, std::min( sizeof( header ), chunk.size ) );
+		bool valid = chunk.size >= sizeof( header )
+			&& std::memcmp( header.magic, TRAJECTORY_MAGIC, sizeof( TRAJECTORY_MAGIC ) ) == 0
+			&& header.version == TRAJECTORY_VERSION
+			&& header.entries > 0
+			&& header.frameSize == TRAJECTORY_POSITIONS_OFFSET + 3 * static_cast< size_t >( header.entries ) * ( header.quantized != 0 ? sizeof( unsigned short ) : sizeof( float ) )
+			&& chunk.size >= sizeof( header ) + header.frameCount * ( sizeof( unsigned long long ) + ( header.compression != 0 ? 0 : static_cast< size_t >( header.frameSize ) ) );
+		if ( valid && !frames_.empty() )
+			valid = header.entries == entries_ && ( header.quantized != 0 ) == quantized_ && header.compression == compression_ && ( header.delta != 0 ) == delta_;
+		if ( !valid )
+		{
+			std::cerr << prefix << name << " is no trajectory chunk of this version or doesn't fit to the ones before!" << std::endl;
+			break;
+		}
+
+		entries_ = header.entries;
+		quantized_ = header.quantized != 0;
+		frameSize_ = header.frameSize;
+		compression_ = header.compression;
+		delta_ = header.delta != 0;
+		const char* steps = chunk.data + sizeof( header );
+		const char* data = steps + header.frameCount * sizeof( unsigned long long );
+		const char* end = chunk.data + chunk.size;
+		for ( unsigned int f = 0; f < header.frameCount; f++ )
+		{
+			FrameRef frame;
+			frame.data = data;
+			frame.bytes = frameSize_;
+			frame.key = data;
+			if ( compression_ != 0 )											// Records of different sizes, the first word is the size
+			{
+				unsigned long long bytes = 0;
+				if ( end - data >= static_cast< ptrdiff_t >( sizeof( bytes ) ) )
+					std::memcpy( &bytes, data, sizeof( bytes ) );
+				if ( bytes < 3 * sizeof( unsigned long long ) || bytes > static_cast< unsigned long long >( end - data ) )
+				{
+					std::cerr << prefix << name << " is truncated after " << f << " frames!" << std::endl;
+					break;
+				}
+				frame.bytes = static_cast< size_t >( bytes );
+				frame.key = f == 0 ? data : frames_.back().key;
+			}
+			std::memcpy( &frame.step, steps + f * sizeof( unsigned long long ), sizeof( unsigned long long ) );
+			frames_.push_back( frame );
+			data += frame.bytes;
+		}
+	}
+
+	std::stable_sort( frames_.begin(), frames_.end(), []( const FrameRef& a, const FrameRef& b ) { return a.step < b.step; } );
+	if ( !frames_.empty() )
+		std::cout << "Playback:                         " << frames_.size() << " frames of " << entries_ << " fishies in " << chunks_.size()
+				  << " files, steps " << frames_.front().step << " to " << frames_.back().step << std::endl;
+	return !frames_.empty();
+}
+
+size_t TrajectoryPlayer::frameAt( double step ) const
+{
+	auto after = std::upper_bound( frames_.begin(), frames_.end(), step, []( double s, const FrameRef& frame ) { return s < static_cast< double >( frame.step ); } );
+	return after == frames_.begin() ? 0 : static_cast< size_t >( after - frames_.begin() ) - 1;
+}
+
+bool TrajectoryPlayer::isWanted( size_t frame ) const
+{
+	return frame >= wanted_ && ( frame - wanted_ ) % stride_ == 0 && ( frame - wanted_ ) / stride_ < SLOTS;
+}
+
+void TrajectoryPlayer::loadFrames()
+{
+	while ( true )
+	{
+		Slot* slot = NULL;
+		size_t frame = 0;
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			auto findWork = [this, &slot, &frame]()
+			{
+				slot = NULL;
+				for ( Slot& s : slots_ )
+				{
+					if ( s.state == SlotState::FREE )
+						slot = &s;
+				}
+				for ( unsigned int k = 0; slot != NULL && k < SLOTS; k++ )	// Nearest wanted frame, which is in no slot yet
+				{
+					frame = wanted_ + k * stride_;
+					if ( frame >= frames_.size() )
+						break;
+					bool present = false;
+					for ( const Slot& s : slots_ )
+						present = present || ( s.state != SlotState::FREE && s.frame == frame );
+					if ( !present )
+						return true;
+				}
+				return false;
+			};
+			wakeUp_.wait( lock, [this, &findWork]() { return stop_ || findWork(); } );
+			if ( stop_ )
+				return;
+			slot->state = SlotState::LOADING;
+			slot->frame = frame;
+		}
+
+		NVTX_RANGE( NvtxDomain::RENDERER, "TrajectoryPlayer::load", NVTX_COLOR_INTEROP );
+		std::memcpy( slot->host->getData(), frames_[frame].data, frames_[frame].bytes );	// Page faults: the disk is read here, not in a frame
+
+		std::lock_guard<std::mutex> lock( mutex_ );
+		slot->state = SlotState::LOADED;
+	}
+}
+
+void TrajectoryPlayer::updateSlots()
+{
+	Slot* show = NULL;
+	if ( statsPending_ && cudaEventQuery( statsCopied_ ) == cudaSuccess )		// Stats of the last decompressed frame
+	{
+		stats_ = *statsHost_->getData();
+		statsPending_ = false;
+	}
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		for ( Slot& slot : slots_ )
+		{
+			bool wanted = isWanted( slot.frame );
+			if ( slot.state == SlotState::LOADED && !wanted )
+				slot.state = SlotState::FREE;									// Skipped by a seek or the rate
+			else if ( ( slot.state == SlotState::UPLOADED || slot.state == SlotState::SHOWN ) && !wanted && cudaEventQuery( slot.copied ) == cudaSuccess )
+				slot.state = SlotState::FREE;									// The pinned memory can be loaded again
+			else if ( slot.state == SlotState::LOADED )
+			{
+				CUDA_CHECK( cudaStreamWaitEvent( copyStream_, slot.unpacked, 0 ) );	// The last unpack of this slot has read it
+				CUDA_CHECK( cudaMemcpyAsync( slot.device.getData(), slot.host->getData(), frames_[slot.frame].bytes, cudaMemcpyHostToDevice, copyStream_ ) );
+				CUDA_CHECK( cudaEventRecord( slot.copied, copyStream_ ) );
+				slot.state = SlotState::UPLOADED;
+			}
+
+			if ( slot.state == SlotState::UPLOADED && slot.frame == wanted_ && wanted_ != shown_ )
+				show = &slot;
+		}
+		if ( show != NULL )
+		{
+			show->state = SlotState::SHOWN;
+			shown_ = show->frame;
+		}
+		else if ( wanted_ != shown_ )
+			late_++;															// The last frame stays until the wanted one is there
+	}
+	wakeUp_.notify_one();
+	if ( show == NULL )
+		return;
+
+	if ( compressor_ == NULL )
+		std::memcpy( &stats_, frames_[show->frame].data, sizeof( SwarmStats ) );	// From the mapping, the pages are read already
+
+	{
+		ScopedCudaTimer timer( profiler_, FrameStage::MAP, stream_ );
+		device_.mapResources( std::vector<int>{ vbResource_ }, stream_ );
+	}
+	{
+		ScopedCudaTimer timer( profiler_, FrameStage::PACK, stream_ );
+		void* verts = NULL;
+		size_t size = 0;
+		device_.getMappedPointer( &verts, &size, vbResource_ );
+		CUDA_CHECK( cudaStreamWaitEvent( stream_, show->copied, 0 ) );			// Only the unpack waits for the upload
+		const char* frame = compressor_ != NULL ? decode( *show ) : show->device.getData();
+		kernel_unpack_trajectory( reinterpret_cast< const SwarmStats* >( frame ), frame + TRAJECTORY_POSITIONS_OFFSET, entries_, quantized_, static_cast< float4* >( verts ), stream_ );
+		CUDA_CHECK( cudaEventRecord( show->unpacked, stream_ ) );
+	}
+	{
+		ScopedCudaTimer timer( profiler_, FrameStage::UNMAP, stream_ );
+		device_.unmapResources( stream_ );										// The draw waits for the unpack
+	}
+}
+
+const char* TrajectoryPlayer::decode( const Slot& slot )
+{
+	const FrameRef& frame = frames_[slot.frame];
+	bool isKey = frame.key == frame.data;
+	if ( delta_ && !isKey && keyData_ != frame.key )
+	{
+		const FrameRef& key = *std::find_if( frames_.begin(), frames_.end(), [&frame]( const FrameRef& f ) { return f.data == frame.key; } );
+		CUDA_CHECK( cudaStreamSynchronize( stream_ ) );							// keyHost_ may still be read by the last upload
+		std::memcpy( keyHost_->getData(), key.data, key.bytes );
+		CUDA_CHECK( cudaMemcpyAsync( d_keyRecord_.getData(), keyHost_->getData(), key.bytes, cudaMemcpyHostToDevice, stream_ ) );
+		compressor_->decompress( d_keyRecord_.getData(), d_key_.getData(), frameSize_, stream_ );
+		keyData_ = frame.key;
+	}
+
+	compressor_->decompress( slot.device.getData(), d_frame_.getData(), frameSize_, stream_ );
+	if ( delta_ && isKey )														// A key frame: keep it for the next frames
+	{
+		CUDA_CHECK( cudaMemcpyAsync( d_key_.getData(), d_frame_.getData(), frameSize_, cudaMemcpyDeviceToDevice, stream_ ) );
+		keyData_ = frame.key;
+	}
+	else if ( delta_ )
+	{
+		kernel_delta_trajectory( reinterpret_cast< unsigned short* >( d_frame_.getData() + TRAJECTORY_POSITIONS_OFFSET ),
+			reinterpret_cast< const unsigned short* >( d_key_.getData() + TRAJECTORY_POSITIONS_OFFSET ), 3 * static_cast< size_t >( entries_ ), false, stream_ );
+	}
+	CUDA_CHECK( cudaMemcpyAsync( statsHost_->getData(), d_frame_.getData(), sizeof( SwarmStats ), cudaMemcpyDeviceToHost, stream_ ) );
+	CUDA_CHECK( cudaEventRecord( statsCopied_, stream_ ) );
+	statsPending_ = true;
+	return d_frame_.getData();
+}
+
+void TrajectoryPlayer::handleKeys( double elapsed )
+{
+	Window* window = Window::getInstance();
+	double first = static_cast< double >( frames_.front().step );
+	double last = static_cast< double >( frames_.back().step );
+	double seek = SEEK_SECONDS * stepsPerSecond_;
+
+	if ( window->consumeKeyPress( GLFW_KEY_RIGHT_BRACKET ) )
+		rate_ = std::min( rate_ * 2.0f, 64.0f );
+	if ( window->consumeKeyPress( GLFW_KEY_LEFT_BRACKET ) )
+		rate_ = std::max( rate_ * 0.5f, 1.0f / 64.0f );
+	if ( window->consumeKeyPress( GLFW_KEY_PAGE_UP ) )
+		playhead_ -= seek;
+	if ( window->consumeKeyPress( GLFW_KEY_PAGE_DOWN ) )
+		playhead_ += seek;
+	if ( window->consumeKeyPress( GLFW_KEY_HOME ) )
+		playhead_ = first;
+
+	if ( window->isPaused() )
+	{
+		size_t next = std::min( frameAt( playhead_ ) + 1, frames_.size() - 1 );
+		if ( window->consumeStep() )											// Period: the next recorded frame
+			playhead_ = static_cast< double >( frames_[next].step );
+	}
+	else
+		playhead_ += elapsed * stepsPerSecond_ * rate_;
+	playhead_ = std::min( std::max( playhead_, first ), last );				// Holds the last frame at the end
+
+	// Recorded frames per drawn frame, so the loader fetches the frames that will be shown, not every recorded one.
+	double stepsPerFrame = frames_.size() > 1 ? ( last - first ) / ( frames_.size() - 1 ) : 1.0;
+	double framesPerDraw = window->isPaused() || stepsPerFrame <= 0.0 ? 1.0 : elapsed * stepsPerSecond_ * rate_ / stepsPerFrame;
+
+	std::lock_guard<std::mutex> lock( mutex_ );
+	wanted_ = frameAt( playhead_ );
+	stride_ = static_cast< size_t >( std::max( std::floor( framesPerDraw ), 1.0 ) );
+}
+
+void TrajectoryPlayer::render()
+{
+	if ( frames_.empty() )
+	{
+		Window::getInstance()->close();
+		return;
+	}
+
+	Window* window = Window::getInstance();
+	double currentTime = window->getCurrentTime();
+	if ( !window->isBenchmarkMode() && !window->isPaused() && currentTime - lastUpdate_ <= 0.006 )	// Limit render rate like ComputeRenderer
+		return;
+
+	profiler_.beginFrame();
+	frameTimes_.beginFrame();
+	handleKeys( currentTime - lastUpdate_ );
+	lastUpdate_ = currentTime;
+
+	{
+		ScopedFramePart timer( frameTimes_, FramePart::SIMULATION );
+		updateSlots();
+	}
+
+	{
+		ScopedFramePart frameTimer( frameTimes_, FramePart::RENDER );
+		ScopedGlTimer timer( profiler_, FrameStage::DRAW );
+
+		glClearColor( 3.0 / 255.0, 148 / 255.0, 252 / 255.0, 1.0 );				// Set Blue background
+		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+
+		Camera const camera = window->getCamera();
+		FrameUniforms uniforms = {};
+		uniforms.model = glm::scale( glm::mat4( 1.0f ), glm::vec3( 100.0f, 100.0f, 100.0f ) );	// Same scene scale as Renderer
+		uniforms.view = camera.viewMatrix();
+		uniforms.projection = camera.projectionMatrix();
+		frameUniforms_->upload( &uniforms );
+
+		shader_.bind();
+		shader_.setUniform1f( pointSizeLocation_, 4.0f );
+		va_.bind();
+		glDrawArrays( GL_POINTS, 0, entries_ );									// Dead fishies are discarded by the shader
+		va_.unbind();
+	}
+
+	std::stringstream title;
+	title << "playback " << ( shown_ == SIZE_MAX ? 0 : shown_ + 1 ) << "/" << frames_.size() << ", step "
+		  << ( shown_ == SIZE_MAX ? 0 : frames_[shown_].step ) << ", " << rate_ << "x, " << late_ << " late | " << profiler_.summary();
+	window->setTitleInfo( title.str() );
+	profiler_.reportIfDue();
+
+	if ( window->consumeKeyPress( GLFW_KEY_F ) )								// F: write the frame times now
+	{
+		std::cout << frameTimes_.report() << std::endl;
+		frameTimes_.dump( frameDump_.empty() ? "frame_times.csv" : frameDump_ );
+	}
+}
+
+void TrajectoryPlayer::cleanUp()
+{
+	if ( loader_.joinable() )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex_ );
+			stop_ = true;
+		}
+		wakeUp_.notify_one();
+		loader_.join();
+
+		std::cout << frameTimes_.report() << std::endl;							// Tail frame times of the playback
+		std::cout << "Playback:                         " << late_ << " frames late (upload behind the playhead)" << std::endl;
+		if ( !frameDump_.empty() )
+			frameTimes_.dump( frameDump_ );
+
+		CUDA_CHECK( cudaStreamSynchronize( stream_ ) );
+		CUDA_CHECK( cudaStreamSynchronize( copyStream_ ) );
+		for ( Slot& slot : slots_ )
+		{
+			CUDA_CHECK( cudaEventDestroy( slot.copied ) );
+			CUDA_CHECK( cudaEventDestroy( slot.unpacked ) );
+			delete slot.host;
+			slot.host = NULL;
+		}
+		if ( statsHost_ != NULL )
+			CUDA_CHECK( cudaEventDestroy( statsCopied_ ) );
+		device_.unregisterGLBuffer();
+		device_.destroyStreams();
+		CUDA_CHECK( cudaStreamDestroy( copyStream_ ) );
+	}
+
+	for ( const MappedChunk& chunk : chunks_ )
+		unmapChunk( chunk.file, chunk.mapping, chunk.data, chunk.size );
+	chunks_.clear();
+	frames_.clear();
+	delete compressor_;
+	delete keyHost_;
+	delete statsHost_;
+	compressor_ = NULL;
+	keyHost_ = NULL;
+	statsHost_ = NULL;
+
+	shader_.unbind();
+	delete vb_;
+	delete vbC_;
+	delete frameUniforms_;
+	vb_ = NULL;
+	vbC_ = NULL;
+	frameUniforms_ = NULL;
+}
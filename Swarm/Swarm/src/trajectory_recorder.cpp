@@ -0,0 +1,205 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "trajectory_recorder.h"
+#include "cuda_device.h"
+#include "kernel.h"
+#include "nvtx_range.h"
+
+TrajectoryRecorder::TrajectoryRecorder( const SwarmConfig& config, unsigned int numParticles ) :
+	prefix_( config.trajectory ),
+	every_( config.trajectoryEvery > 0 ? config.trajectoryEvery : 1 ),
+	stride_( config.trajectoryStride > 0 ? config.trajectoryStride : 1 ),
+	quantize_( config.trajectoryQuantize ),
+	framesPerChunk_( config.trajectoryChunk > 0 ? config.trajectoryChunk : 1 ),
+	compression_( config.compression )
+{
+	if ( prefix_.empty() )
+		return;
+
+	entries_ = ( numParticles + stride_ - 1 ) / stride_;
+	frameSize_ = TRAJECTORY_POSITIONS_OFFSET + 3 * entries_ * ( quantize_ ? sizeof( unsigned short ) : sizeof( float ) );
+
+	copyStream_ = CudaDevice::newStream( StreamClass::BACKGROUND );				// The copies never delay a step
+	compressor_ = new GpuCompressor( compression_, frameSize_, quantize_ ? sizeof( unsigned short ) : sizeof( float ) );
+	bool compressed = compressor_->isEnabled();
+	delta_ = compressed && quantize_;											// Float differences wouldn't be lossless
+	if ( delta_ )
+		d_key_.resize( frameSize_ );
+	for ( int i = 0; i < 2; i++ )
+	{
+		d_frame_[i].resize( frameSize_ );
+		CUDA_CHECK( cudaEventCreateWithFlags( &packed_[i], cudaEventDisableTiming ) );
+		CUDA_CHECK( cudaEventCreateWithFlags( &frameCopied_[i], cudaEventDisableTiming ) );
+		CUDA_CHECK( cudaEventRecord( frameCopied_[i], copyStream_ ) );			// Both device frames are free
+
+		if ( compressed )
+		{
+			chunks_[i].data = new CudaHostArray<char>( compressor_->maxRecordSize( frameSize_ ) * framesPerChunk_, cudaHostAllocMapped );
+			chunks_[i].used = new CudaHostArray<unsigned long long>( 1, cudaHostAllocMapped );
+			CUDA_CHECK( cudaHostGetDevicePointer( reinterpret_cast< void** >( &chunks_[i].deviceData ), chunks_[i].data->getData(), 0 ) );
+			CUDA_CHECK( cudaHostGetDevicePointer( reinterpret_cast< void** >( &chunks_[i].deviceUsed ), chunks_[i].used->getData(), 0 ) );
+		}
+		else
+			chunks_[i].data = new CudaHostArray<char>( frameSize_ * framesPerChunk_ );
+		chunks_[i].steps.reserve( framesPerChunk_ );
+		CUDA_CHECK( cudaEventCreateWithFlags( &chunks_[i].copied, cudaEventDisableTiming ) );
+	}
+
+	writer_ = std::thread( &TrajectoryRecorder::writeChunks, this );
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+	if ( prefix_.empty() )
+		return;
+
+	finish();
+	for ( int i = 0; i < 2; i++ )
+	{
+		CUDA_CHECK( cudaEventDestroy( packed_[i] ) );
+		CUDA_CHECK( cudaEventDestroy( frameCopied_[i] ) );
+		CUDA_CHECK( cudaEventDestroy( chunks_[i].copied ) );
+		delete chunks_[i].data;
+		delete chunks_[i].used;
+	}
+	delete compressor_;
+	CUDA_CHECK( cudaStreamDestroy( copyStream_ ) );
+}
+
+void TrajectoryRecorder::record( ParticleArrays particles, unsigned int mesh_count, unsigned long long step, cudaStream_t stream )
+{
+	if ( prefix_.empty() || stop_ || calls_++ % every_ != 0 )
+		return;
+
+	NVTX_RANGE( NvtxDomain::RENDERER, "TrajectoryRecorder::record", NVTX_COLOR_SIMULATION );
+
+	Chunk& chunk = chunks_[filling_];
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		if ( chunk.busy )														// Disk is behind, don't wait for it
+		{
+			dropped_++;
+			return;
+		}
+	}
+
+	unsigned int f = nextFrame_;
+	nextFrame_ = 1 - nextFrame_;
+	char* frame = d_frame_[f].getData();
+
+	CUDA_CHECK( cudaStreamWaitEvent( stream, frameCopied_[f], 0 ) );				// Copy of the frame before last, normally done long ago
+	kernel_reduce_stats( particles, mesh_count, stream );						// Bounding box of this step
+	CUDA_CHECK( cudaMemcpyAsync( frame, kernel_get_stats_device(), sizeof( SwarmStats ), cudaMemcpyDeviceToDevice, stream ) );
+	kernel_pack_trajectory( particles, mesh_count, stride_, entries_, kernel_get_stats_device(), quantize_, frame + TRAJECTORY_POSITIONS_OFFSET, stream );
+	CUDA_CHECK( cudaEventRecord( packed_[f], stream ) );
+
+	CUDA_CHECK( cudaStreamWaitEvent( copyStream_, packed_[f], 0 ) );			// The simulation goes on while this copy runs
+	if ( compressor_->isEnabled() )
+	{
+		if ( chunk.steps.empty() )
+		{
+			*chunk.used->getData() = 0;											// The writer is done with the chunk
+			if ( delta_ )
+				CUDA_CHECK( cudaMemcpyAsync( d_key_.getData(), frame, frameSize_, cudaMemcpyDeviceToDevice, copyStream_ ) );
+		}
+		else if ( delta_ )
+		{
+			kernel_delta_trajectory( reinterpret_cast< unsigned short* >( frame + TRAJECTORY_POSITIONS_OFFSET ),
+				reinterpret_cast< const unsigned short* >( d_key_.getData() + TRAJECTORY_POSITIONS_OFFSET ), 3 * static_cast< size_t >( entries_ ), true, copyStream_ );
+		}
+		compressor_->compress( frame, frameSize_, chunk.deviceData, chunk.deviceUsed, copyStream_ );	// Writes through the mapping
+	}
+	else
+	{
+		char* destination = chunk.data->getData() + chunk.steps.size() * frameSize_;
+		CUDA_CHECK( cudaMemcpyAsync( destination, frame, frameSize_, cudaMemcpyDeviceToHost, copyStream_ ) );
+	}
+	CUDA_CHECK( cudaEventRecord( frameCopied_[f], copyStream_ ) );
+
+	chunk.steps.push_back( step );
+	recorded_++;
+	if ( chunk.steps.size() == framesPerChunk_ )
+		submit();
+}
+
+void TrajectoryRecorder::submit()
+{
+	Chunk& chunk = chunks_[filling_];
+	CUDA_CHECK( cudaEventRecord( chunk.copied, copyStream_ ) );					// After the last frame of the chunk
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		chunk.busy = true;
+		queue_.push_back( std::make_pair( filling_, chunkIndex_++ ) );
+	}
+	wakeUp_.notify_one();
+	filling_ = 1 - filling_;
+}
+
+void TrajectoryRecorder::writeChunks()
+{
+	while ( true )
+	{
+		std::pair<unsigned int, unsigned int> job;
+		{
+			std::unique_lock<std::mutex> lock( mutex_ );
+			wakeUp_.wait( lock, [this]() { return stop_ || !queue_.empty(); } );
+			if ( queue_.empty() )
+				return;																// stop_ and nothing left
+			job = queue_.front();
+			queue_.pop_front();
+		}
+
+		Chunk& chunk = chunks_[job.first];
+		CUDA_CHECK( cudaEventSynchronize( chunk.copied ) );						// Only this thread waits for the copies
+
+		TrajectoryChunkHeader header = {};
+		std::memcpy( header.magic, TRAJECTORY_MAGIC, sizeof( TRAJECTORY_MAGIC ) );
+		header.version = TRAJECTORY_VERSION;
+		header.entries = entries_;
+		header.stride = stride_;
+		header.quantized = quantize_ ? 1 : 0;
+		header.frameCount = static_cast< unsigned int >( chunk.steps.size() );
+		header.frameSize = static_cast< unsigned int >( frameSize_ );
+		header.compression = compressor_->isEnabled() ? static_cast< unsigned int >( compression_ ) : 0;
+		header.delta = delta_ ? 1 : 0;
+		size_t bytes = compressor_->isEnabled() ? static_cast< size_t >( *chunk.used->getData() ) : chunk.steps.size() * frameSize_;
+
+		char name[32];
+		std::snprintf( name, sizeof( name ), "_%05u.traj", job.second );
+		std::string path = prefix_ + name;
+		std::ofstream file( path, std::ios::out | std::ios::binary | std::ios::trunc );
+		file.write( reinterpret_cast< const char* >( &header ), sizeof( header ) );
+		file.write( reinterpret_cast< const char* >( chunk.steps.data() ), chunk.steps.size() * sizeof( unsigned long long ) );
+		file.write( chunk.data->getData(), bytes );
+		file.close();
+		if ( !file )
+			std::cerr << "Impossible to write " << path << "!" << std::endl;
+
+		std::lock_guard<std::mutex> lock( mutex_ );
+		chunk.steps.clear();
+		chunk.busy = false;
+	}
+}
+
+void TrajectoryRecorder::finish()
+{
+	if ( prefix_.empty() || !writer_.joinable() )
+		return;
+
+	if ( !chunks_[filling_].steps.empty() )										// Part of a chunk
+		submit();
+	{
+		std::lock_guard<std::mutex> lock( mutex_ );
+		stop_ = true;
+	}
+	wakeUp_.notify_one();
+	writer_.join();
+
+	std::cout << "Trajectory:                       " << recorded_ << " frames in " << chunkIndex_ << " files " << prefix_ << "_*.traj";
+	if ( dropped_ > 0 )
+		std::cout << ", " << dropped_ << " frames dropped (disk too slow)";
+	std::cout << std::endl;
+}
@@ -0,0 +1,81 @@
+#include <cstring>
+
+#include "uniform_buffer.h"
+
+UniformBuffer::UniformBuffer( size_t size, unsigned int binding, unsigned int uploadsPerFrame ) :
+	binding_( binding ),
+	size_( size ),
+	regions_( FRAMES * ( uploadsPerFrame > 0 ? uploadsPerFrame : 1 ) ),
+	fences_( regions_, NULL ),
+	region_( regions_ - 1 )
+{
+	int alignment = 256;
+	glGetIntegerv( GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment );
+	stride_ = ( size + alignment - 1 ) / alignment * alignment;
+
+	glGenBuffers( 1, &renderID_ );
+	glBindBuffer( GL_UNIFORM_BUFFER, renderID_ );
+	if ( GLEW_ARB_buffer_storage )
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage( GL_UNIFORM_BUFFER, stride_ * regions_, NULL, flags );
+		mapped_ = static_cast< char* >( glMapBufferRange( GL_UNIFORM_BUFFER, 0, stride_ * regions_, flags ) );	// Stays mapped, no map per frame
+	}
+	else
+	{
+		glBufferData( GL_UNIFORM_BUFFER, stride_ * regions_, NULL, GL_DYNAMIC_DRAW );
+	}
+	glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	for ( GLsync fence : fences_ )
+		if ( fence != NULL )
+			glDeleteSync( fence );
+
+	if ( mapped_ != NULL )
+	{
+		glBindBuffer( GL_UNIFORM_BUFFER, renderID_ );
+		glUnmapBuffer( GL_UNIFORM_BUFFER );
+		glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+	}
+	glDeleteBuffers( 1, &renderID_ );
+}
+
+unsigned int UniformBuffer::upload( const void* data )
+{
+	if ( mapped_ != NULL )
+	{
+		fences_[region_] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );	// After the draws of the last upload
+		region_ = ( region_ + 1 ) % regions_;
+
+		GLsync& fence = fences_[region_];
+		if ( fence != NULL )													// Normally signaled since two frames
+		{
+			glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64( 1000000000 ) );
+			glDeleteSync( fence );
+			fence = NULL;
+		}
+		std::memcpy( mapped_ + region_ * stride_, data, size_ );
+	}
+	else
+	{
+		region_ = ( region_ + 1 ) % regions_;
+		glBindBuffer( GL_UNIFORM_BUFFER, renderID_ );
+		glBufferSubData( GL_UNIFORM_BUFFER, region_ * stride_, size_, data );
+		glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+	}
+
+	glBindBufferRange( GL_UNIFORM_BUFFER, binding_, renderID_, region_ * stride_, size_ );
+	return region_;
+}
+
+bool UniformBuffer::rewrite( unsigned int region, const void* data )
+{
+	if ( mapped_ == NULL )
+		return false;
+
+	std::memcpy( mapped_ + region * stride_, data, size_ );						// Coherent: no flush, the fence of the region stays
+	return true;
+}
@@ -0,0 +1,214 @@
+#include <cmath>
+#include <iostream>
+
+#include "validation_run.h"
+#include "host_simulation.h"
+#include "kernel.h"
+#include "swarm_stats.h"
+
+// Names of SearchMode values, same order as the enum.
+static const char* const MODE_NAMES[] = { "auto", "brute", "tiled", "grid", "warp", "verlet", "tensor" };
+
+ValidationRun::ValidationRun( const SwarmConfig& config ) :
+	h_reference_( 3 * config.numParticles ),
+	h_candidate_( 3 * config.numParticles ),
+	h_referenceAlive_( config.numParticles ),
+	h_candidateAlive_( config.numParticles ),
+	numParticles_( config.numParticles ),
+	numSharks_( config.numSharks ),
+	candidateMode_( config.searchMode ),
+	tolerance_( config.tolerance )
+{
+	speed = static_cast< float >( config.swarmSpeed / config.simulationRate );	// Same distance per simulated second for every rate
+
+	waypointList = new WaypointList( config.waypoints );						// Initialize Waypoint path.
+	swarmCenter = waypointList->get();											// Get first swarm center for particles.
+
+	device_ = CudaDevice( CudaDevice::selectDevice( config.device ) );			// Create CUDA Device. The configured one, else the biggest one.
+	std::cout << device_ << std::endl;											// Print out some information about the used GPU
+	stream_ = device_.getStream( device_.createStream() );						// Stream for both searches
+
+	std::vector<float> h_data;
+	std::vector<float> h_state;
+	std::vector<float> h_shark_data;
+	std::vector<float> h_shark_state;
+	spawnFish( numParticles_, h_data, h_state, config.spawnMin, config.spawnMax );	// init vertex position, force and mass
+	spawnSharks( numSharks_, h_shark_data, h_shark_state, config.spawnMin, config.spawnMax );
+
+	for ( int i = 0; i < 2; i++ )
+	{
+		reference_[i] = new ParticleStore( numParticles_ );						// Same spawn for reference and candidate
+		reference_[i]->set( h_data.data(), h_state.data(), numParticles_ );
+	}
+	candidate_ = new ParticleStore( numParticles_ );
+	candidate_->set( h_data.data(), h_state.data(), numParticles_ );
+	d_sharks.resize( numSharks_ * 4 );											// Allocate Memory on GPU for shark positions
+	d_sharks.set( h_shark_data.data(), numSharks_ * 4 );
+	d_shark_state.resize( numSharks_ * 4 );										// Allocate Memory on GPU for shark forces and masses
+	d_shark_state.set( h_shark_state.data(), numSharks_ * 4 );
+
+	kernel_set_params( config.params );											// Behaviour parameters
+	kernel_set_schools( schoolWaypoints( config.waypoints, config.schools ), config.splinePath );	// Routes of the schools in constant memory
+	kernel_set_species( config.species );										// Species table in constant memory
+	kernel_set_seed( config.seed );												// GPU random numbers
+	kernel_set_spawn_box( config.spawnMin, config.spawnMax );					// Box of the respawned fishies
+	kernel_set_behaviour( Behaviour::CLASSIC );									// The reference only exists for the classic behaviour
+	kernel_set_first_k( config.firstK );										// Neighbour query semantics
+	kernel_set_packed_positions( config.packedPositions );						// Positions read by the grid search
+	kernel_set_cooperative_grid( config.cooperativeGrid );						// Grid build and search in one launch
+	kernel_set_warm_start( config.warmStart );									// Grid search bounded by the last closest fish
+	kernel_set_grid_sort( config.gridSort );									// Counting or radix sort of the grid build
+	kernel_set_evasion_split( config.evasionSplit );							// Brute force skips the evading fishies
+	kernel_set_dense_cells( config.denseCells );								// Warps for the fishies of dense cells
+	kernel_set_background_priority( CudaDevice::getStreamPriority( StreamClass::BACKGROUND ) );	// Fills of the current behind the steps
+	kernel_set_cluster_search( config.clusterSearch );							// Cells of a cluster in distributed shared memory on Hopper
+	kernel_set_l2_persistence( config.l2Persistence && device_.supportsL2Persistence() );	// Cell tables persisting in L2 on Ampere or newer
+	kernel_set_deterministic( config.deterministic );							// Fixed-point state, ordered search and reductions
+	kernel_set_rtc( config.rtcKernels );										// Grid advance specialised for the scenario
+	kernel_set_shark_target( SharkTarget::CENTER );								// The reference has no grid for the sharks
+	kernel_set_integrator( Integrator::LEGACY );								// The reference moves with the original update
+	kernel_set_obstacles( bakeObstacles( config.obstacles, config.spawnMin, config.spawnMax, config.waypoints, config.obstacleRange,
+		config.obstacleResolution ), config.obstacleRange );					// Distance field of the obstacles
+	kernel_set_attractors( placeAttractors( config.attractors, config.spawnMin, config.spawnMax, config.waypoints,
+		config.attractorResolution ) );											// Field of the food patches and lures
+	kernel_set_alarm( placeAlarm( config.alarm, config.alarmDecay, config.spawnMin, config.spawnMax, config.waypoints,
+		config.params.centerThreshold, config.alarmResolution ) );				// Alarm waves of the evading fishies
+	kernel_set_current( loadCurrent( config ), config.currentStrength / config.simulationRate, config.currentPeriod );	// Current of the water
+	kernel_set_far_field( config.farCohesion, config.farAlignment, config.farTheta );	// Long range forces on the BVH
+	kernel_init_grid( numParticles_, device_.getProperties() );					// Initialize grid and launch configuration for this device.
+}
+
+void ValidationRun::moveSwarmCenter()
+{
+	Vector3 diff = waypointList->get() - swarmCenter;							// Get Next Swarm center
+	if (diff.length() < WAYPOINT_THRESHOLD)										// Check if center was reached
+	{
+		diff = waypointList->getNext() - swarmCenter;
+	}
+
+	diff = diff.normalized() * speed;
+	swarmCenter += diff;
+}
+
+void ValidationRun::updateGridBounds()
+{
+	CudaHostArray<SwarmStats> h_stats( 1 );
+	kernel_reduce_stats( reference_[current_]->getArrays(), numParticles_, stream_ );
+	kernel_read_stats( h_stats.getData(), stream_ );
+	CUDA_CHECK( cudaStreamSynchronize( stream_ ) );
+	kernel_set_grid_bounds( h_stats[0] );
+}
+
+void ValidationRun::download( ParticleStore& particles, CudaHostArray<float>& positions, CudaHostArray<unsigned char>& alive )
+{
+	ParticleArrays arrays = particles.getArrays();
+	size_t bytes = numParticles_ * sizeof( float );
+	CUDA_CHECK( cudaMemcpyAsync( positions.getData(), arrays.x, bytes, cudaMemcpyDeviceToHost, stream_ ) );
+	CUDA_CHECK( cudaMemcpyAsync( positions.getData() + numParticles_, arrays.y, bytes, cudaMemcpyDeviceToHost, stream_ ) );
+	CUDA_CHECK( cudaMemcpyAsync( positions.getData() + 2 * numParticles_, arrays.z, bytes, cudaMemcpyDeviceToHost, stream_ ) );
+	CUDA_CHECK( cudaMemcpyAsync( alive.getData(), arrays.alive, numParticles_, cudaMemcpyDeviceToHost, stream_ ) );
+}
+
+bool ValidationRun::run( unsigned int steps )
+{
+	std::cout << "Validating " << MODE_NAMES[static_cast< int >( candidateMode_ )] << " against brute over " << steps
+			  << " steps, tolerance " << tolerance_ << std::endl;
+
+	updateGridBounds();
+
+	float maxError = 0.0f;
+	double errorSum = 0.0;
+	unsigned int divergedSteps = 0;
+	unsigned int firstDiverged = 0;
+	unsigned long long aliveMismatches = 0;
+
+	for ( unsigned int s = 1; s <= steps; s++ )
+	{
+		moveSwarmCenter();
+		unsigned int next = 1 - current_;
+		unsigned int randomStep = kernel_get_random_step();
+
+		kernel_set_search_mode( SearchMode::BRUTE_FORCE );						// Reference
+		kernel_advance( reference_[current_]->getArrays(), reference_[next]->getArrays(), numParticles_, speed, swarmCenter,
+			reinterpret_cast<float4*>( d_sharks.getData() ), numSharks_, stream_ );
+
+		kernel_set_random_step( randomStep );									// Candidate: same input, same random numbers
+		kernel_set_search_mode( candidateMode_ );
+		kernel_advance( reference_[current_]->getArrays(), candidate_->getArrays(), numParticles_, speed, swarmCenter,
+			reinterpret_cast<float4*>( d_sharks.getData() ), numSharks_, stream_ );
+
+		kernel_move_sharks(
+			reinterpret_cast<float4*>( d_sharks.getData() ),
+			reinterpret_cast<float4*>( d_shark_state.getData() ),
+			numSharks_,
+			speed,
+			stream_);
+
+		download( *reference_[next], h_reference_, h_referenceAlive_ );
+		download( *candidate_, h_candidate_, h_candidateAlive_ );
+		CUDA_CHECK( cudaStreamSynchronize( stream_ ) );
+		current_ = next;
+
+		// Compare on the host, the run is for correctness, not for speed.
+		float stepError = 0.0f;
+		unsigned int worst = 0;
+		unsigned int overTolerance = 0;
+		unsigned int aliveDiff = 0;
+		for ( unsigned int i = 0; i < numParticles_; i++ )
+		{
+			float dx = h_reference_[i] - h_candidate_[i];
+			float dy = h_reference_[numParticles_ + i] - h_candidate_[numParticles_ + i];
+			float dz = h_reference_[2 * numParticles_ + i] - h_candidate_[2 * numParticles_ + i];
+			float error = std::sqrt( dx * dx + dy * dy + dz * dz );
+			if ( !( error <= tolerance_ ) )										// NaN counts as divergence
+				overTolerance++;
+			if ( !( error <= stepError ) )
+			{
+				stepError = error;
+				worst = i;
+			}
+			if ( h_referenceAlive_[i] != h_candidateAlive_[i] )
+				aliveDiff++;
+		}
+
+		maxError = std::isnan( stepError ) || stepError > maxError ? stepError : maxError;
+		errorSum += stepError;
+		aliveMismatches += aliveDiff;
+		if ( overTolerance > 0 || aliveDiff > 0 )
+		{
+			if ( divergedSteps == 0 )
+				firstDiverged = s;
+			if ( divergedSteps < MAX_REPORTED_STEPS )
+				std::cout << "Step " << s << ": " << overTolerance << " fishies over tolerance, max error " << stepError
+						  << " (fish " << worst << "), " << aliveDiff << " eaten differently" << std::endl;
+			divergedSteps++;
+		}
+
+		if ( s % GRID_UPDATE_INTERVAL == 0 )									// Grid follows the swarm
+			updateGridBounds();
+	}
+
+	bool passed = divergedSteps == 0;
+	std::cout << "Steps:                            " << steps << "\n";
+	std::cout << "Max position error:               " << maxError << "\n";
+	std::cout << "Mean of the step maxima:          " << ( steps > 0 ? errorSum / steps : 0.0 ) << "\n";
+	std::cout << "Diverged steps:                   " << divergedSteps;
+	if ( divergedSteps > 0 )
+		std::cout << " (first: " << firstDiverged << ")";
+	std::cout << "\n";
+	std::cout << "Eaten differently:                " << aliveMismatches << "\n";
+	std::cout << "Result:                           " << ( passed ? "passed" : "FAILED" ) << std::endl;
+	return passed;
+}
+
+void ValidationRun::cleanUp()
+{
+	device_.destroyStreams();													// Wait for the last step
+	for ( int i = 0; i < 2; i++ )
+		delete reference_[i];													// Free GPU Memory
+	delete candidate_;
+	d_sharks = CudaDeviceArray<float>();										// Free GPU Memory
+	d_shark_state = CudaDeviceArray<float>();									// Free GPU Memory
+	delete waypointList;
+	kernel_cleanup();															// Free uniform grid
+}
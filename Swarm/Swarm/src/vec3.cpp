@@ -8,17 +8,22 @@ Vector3::Vector3()
 Vector3::Vector3( float x, float y, float z ) : x(x), y(y), z(z)
 {}
 
-float Vector3::dot( Vector3 * vec )
+float Vector3::dot( const Vector3& vec ) const
 {
-	return x * vec->x + y * vec->y + z * vec->z;
+	return x * vec.x + y * vec.y + z * vec.z;
 }
 
-float Vector3::length()
+float Vector3::dot( const Vector3 * vec ) const
+{
+	return dot( *vec );
+}
+
+float Vector3::length() const
 {
 	return sqrt(pow(x, 2) + pow(y, 2) + pow(z, 2));
 }
 
-Vector3 Vector3::normalized()
+Vector3 Vector3::normalized() const
 {
 	float len = length() + 1e-10;
 	return Vector3(x / len, y / len, z / len);
@@ -1,8 +1,12 @@
 #include "vertex_array.h"
+#include "gl_features.h"
 
 VertexArray::VertexArray()
 {
-	glGenVertexArrays( 1, &renderID_ );
+	if ( glHasDirectStateAccess() )
+		glCreateVertexArrays( 1, &renderID_ );
+	else
+		glGenVertexArrays( 1, &renderID_ );
 }
 
 VertexArray::~VertexArray()
@@ -12,25 +16,35 @@ VertexArray::~VertexArray()
 
 void VertexArray::addBuffer( const VertexBuffer& _vb, const VertexBufferLayout& _layout )
 {
-	bind();
-	_vb.bind();
-
 	const auto& elements = _layout.getElements();
 	for ( unsigned int i = 0; i < elements.size(); ++i )
-	{
-		const auto& element = elements[i];
-		glEnableVertexAttribArray( i );
-		glVertexAttribPointer( i, element.count, element.type, element.normalized, 0, reinterpret_cast< const void* >( element.offset ) );
-	}
+		addAttribute( _vb, elements[i], i, 0 );
 }
 
-void VertexArray::addBuffer( const VertexBuffer& _vb, const VertexBufferElement _vbElement, int _vertexIndex )
+void VertexArray::addBuffer( const VertexBuffer& _vb, const VertexBufferElement _vbElement, int _vertexIndex, unsigned int _divisor )
 {
+	addAttribute( _vb, _vbElement, _vertexIndex, _divisor );
+}
+
+void VertexArray::addAttribute( const VertexBuffer& _vb, const VertexBufferElement& _vbElement, unsigned int _vertexIndex, unsigned int _divisor )
+{
+	if ( glHasDirectStateAccess() )												// Binding i reads the buffer of attribute i
+	{
+		unsigned int stride = _vbElement.count * VertexBufferElement::getSizeOfType( _vbElement.type );	// Tightly packed like stride 0 below
+		glVertexArrayVertexBuffer( renderID_, _vertexIndex, _vb.getBufferID(), _vbElement.offset, stride );
+		glVertexArrayAttribFormat( renderID_, _vertexIndex, _vbElement.count, _vbElement.type, _vbElement.normalized, 0 );
+		glVertexArrayAttribBinding( renderID_, _vertexIndex, _vertexIndex );
+		glVertexArrayBindingDivisor( renderID_, _vertexIndex, _divisor );
+		glEnableVertexArrayAttrib( renderID_, _vertexIndex );
+		return;
+	}
+
 	bind();
 	_vb.bind();
 
 	glEnableVertexAttribArray( _vertexIndex );
 	glVertexAttribPointer( _vertexIndex, _vbElement.count, _vbElement.type, _vbElement.normalized, 0, reinterpret_cast< const void* >( _vbElement.offset ) );
+	glVertexAttribDivisor( _vertexIndex, _divisor );
 }
 
 void VertexArray::bind() const
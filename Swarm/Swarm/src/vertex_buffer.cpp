@@ -1,16 +1,40 @@
 #include <glew.h>
 #include "vertex_buffer.h"
+#include "gl_features.h"
+#include "memory_tracker.h"
 
 VertexBuffer::VertexBuffer( const void* data, unsigned int size )
+{
+	if ( glHasDirectStateAccess() )												// No bind, the current GL_ARRAY_BUFFER stays
+	{
+		glCreateBuffers( 1, &renderID_ );
+		glNamedBufferData( renderID_, size, data, GL_DYNAMIC_DRAW );
+	}
+	else
+	{
+		glGenBuffers( 1, &renderID_ );
+		glBindBuffer( GL_ARRAY_BUFFER, renderID_ );
+		glBufferData( GL_ARRAY_BUFFER, size, data, GL_DYNAMIC_DRAW );
+	}
+	trackStorage( size );
+}
+
+VertexBuffer::VertexBuffer()
 {
 	glGenBuffers( 1, &renderID_ );
 	glBindBuffer( GL_ARRAY_BUFFER, renderID_ );
-	glBufferData( GL_ARRAY_BUFFER, size, data, GL_DYNAMIC_DRAW );
 }
 
 VertexBuffer::~VertexBuffer()
 {
 	glDeleteBuffers( 1, &renderID_ );
+	trackFree( MemorySpace::DEVICE, MemoryCategory::RENDER, size_ );
+}
+
+void VertexBuffer::trackStorage( unsigned int size )
+{
+	size_ = size;
+	trackAllocation( MemorySpace::DEVICE, MemoryCategory::RENDER, size_ );
 }
 
 void VertexBuffer::bind() const
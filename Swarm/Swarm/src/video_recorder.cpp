@@ -0,0 +1,290 @@
+#include <cstdio>
+#include <iostream>
+
+#include "video_recorder.h"
+#include "Window.hpp"
+#include "nvtx_range.h"
+
+#ifdef SWARM_NVENC
+#include <cuda.h>
+#include <nvEncodeAPI.h>
+
+/*!
+ * @brief NVENC session with one registered input and one bitstream buffer. Encodes synchronously, without B frames,
+ * so every EncodePicture gives the bitstream of its own frame.
+ */
+struct VideoRecorder::Encoder
+{
+	NV_ENCODE_API_FUNCTION_LIST api = { NV_ENCODE_API_FUNCTION_LIST_VER };
+	void* session = NULL;					//!< Encode session on the CUDA context.
+	NV_ENC_REGISTERED_PTR input = NULL;		//!< d_frame_.
+	NV_ENC_OUTPUT_PTR bitstream = NULL;		//!< Output of the last frame.
+	std::FILE* file = NULL;					//!< Raw bitstream.
+};
+
+/*!
+ * @brief Print a failed NVENC call.
+ * @param status result of the call.
+ * @param call name of the call.
+ * @return true, if the call succeeded.
+ */
+static bool nvencCheck( NVENCSTATUS status, const char* call )
+{
+	if ( status != NV_ENC_SUCCESS )
+		std::cerr << call << " failed with NVENC status " << status << std::endl;
+	return status == NV_ENC_SUCCESS;
+}
+#else
+struct VideoRecorder::Encoder {};
+#endif
+
+VideoRecorder::VideoRecorder( const SwarmConfig& config, unsigned int fps ) :
+	path_( config.video ),
+	width_( config.windowWidth ),
+	height_( config.windowHeight )
+{
+	if ( path_.empty() )
+		return;
+
+	NVTX_RANGE( NvtxDomain::RENDERER, "VideoRecorder::VideoRecorder", NVTX_COLOR_SETUP );
+
+	glGenRenderbuffers( 1, &sceneColor_ );
+	glBindRenderbuffer( GL_RENDERBUFFER, sceneColor_ );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, width_, height_ );
+	glGenRenderbuffers( 1, &sceneDepth_ );
+	glBindRenderbuffer( GL_RENDERBUFFER, sceneDepth_ );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width_, height_ );
+	glGenRenderbuffers( 1, &captureColor_ );
+	glBindRenderbuffer( GL_RENDERBUFFER, captureColor_ );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, width_, height_ );
+	glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+	glGenFramebuffers( 1, &sceneFbo_ );
+	glBindFramebuffer( GL_FRAMEBUFFER, sceneFbo_ );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, sceneColor_ );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, sceneDepth_ );
+	bool complete = glCheckFramebufferStatus( GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE;
+	glGenFramebuffers( 1, &captureFbo_ );
+	glBindFramebuffer( GL_FRAMEBUFFER, captureFbo_ );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, captureColor_ );
+	complete = complete && glCheckFramebufferStatus( GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+	if ( !complete )
+	{
+		std::cerr << "Video framebuffer is incomplete, recording is off" << std::endl;
+		return;
+	}
+
+	CUDA_CHECK( cudaGraphicsGLRegisterImage( &captureResource_, captureColor_, GL_RENDERBUFFER, cudaGraphicsRegisterFlagsReadOnly ) );
+	d_frame_.setCategory( MemoryCategory::RENDER );
+	d_frame_.resize( static_cast< size_t >( width_ ) * height_ );
+
+	if ( !openEncoder( fps ) )
+	{
+		std::cerr << "No NVENC encoder, " << path_ << " is not recorded" << std::endl;
+		d_frame_ = CudaDeviceArray<uchar4>();
+	}
+}
+
+VideoRecorder::~VideoRecorder()
+{
+	closeEncoder();
+	if ( captureResource_ != NULL )
+		CUDA_CHECK( cudaGraphicsUnregisterResource( captureResource_ ) );
+	glDeleteFramebuffers( 1, &sceneFbo_ );										// Names of 0 are ignored
+	glDeleteFramebuffers( 1, &captureFbo_ );
+	glDeleteRenderbuffers( 1, &sceneColor_ );
+	glDeleteRenderbuffers( 1, &sceneDepth_ );
+	glDeleteRenderbuffers( 1, &captureColor_ );
+}
+
+bool VideoRecorder::openEncoder( unsigned int fps )
+{
+#ifdef SWARM_NVENC
+	std::string extension = path_.substr( path_.find_last_of( '.' ) + 1 );
+	bool hevc = extension == "hevc" || extension == "h265";
+	GUID codec = hevc ? NV_ENC_CODEC_HEVC_GUID : NV_ENC_CODEC_H264_GUID;
+	GUID preset = NV_ENC_PRESET_P4_GUID;
+
+	CUcontext context = NULL;
+	cuCtxGetCurrent( &context );												// Primary context of the runtime, d_frame_ lives there
+
+	Encoder* encoder = new Encoder();
+	if ( !nvencCheck( NvEncodeAPICreateInstance( &encoder->api ), "NvEncodeAPICreateInstance" ) )
+	{
+		delete encoder;
+		return false;
+	}
+
+	NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS open = { NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS_VER };
+	open.device = context;
+	open.deviceType = NV_ENC_DEVICE_TYPE_CUDA;
+	open.apiVersion = NVENCAPI_VERSION;
+	if ( !nvencCheck( encoder->api.nvEncOpenEncodeSessionEx( &open, &encoder->session ), "nvEncOpenEncodeSessionEx" ) )
+	{
+		delete encoder;
+		return false;
+	}
+	encoder_ = encoder;															// closeEncoder cleans up from here on
+
+	NV_ENC_PRESET_CONFIG presetConfig = { NV_ENC_PRESET_CONFIG_VER, { NV_ENC_CONFIG_VER } };
+	if ( !nvencCheck( encoder->api.nvEncGetEncodePresetConfigEx( encoder->session, codec, preset, NV_ENC_TUNING_INFO_HIGH_QUALITY, &presetConfig ), "nvEncGetEncodePresetConfigEx" ) )
+	{
+		closeEncoder();
+		return false;
+	}
+	NV_ENC_CONFIG encodeConfig = presetConfig.presetCfg;
+	encodeConfig.frameIntervalP = 1;											// No B frames: one output per input
+
+	NV_ENC_INITIALIZE_PARAMS init = { NV_ENC_INITIALIZE_PARAMS_VER };
+	init.encodeGUID = codec;
+	init.presetGUID = preset;
+	init.tuningInfo = NV_ENC_TUNING_INFO_HIGH_QUALITY;
+	init.encodeWidth = init.darWidth = width_;
+	init.encodeHeight = init.darHeight = height_;
+	init.frameRateNum = fps;
+	init.frameRateDen = 1;
+	init.enablePTD = 1;															// Picture types by the encoder
+	init.encodeConfig = &encodeConfig;
+	if ( !nvencCheck( encoder->api.nvEncInitializeEncoder( encoder->session, &init ), "nvEncInitializeEncoder" ) )
+	{
+		closeEncoder();
+		return false;
+	}
+
+	NV_ENC_REGISTER_RESOURCE resource = { NV_ENC_REGISTER_RESOURCE_VER };
+	resource.resourceType = NV_ENC_INPUT_RESOURCE_TYPE_CUDADEVICEPTR;
+	resource.resourceToRegister = d_frame_.getData();
+	resource.width = width_;
+	resource.height = height_;
+	resource.pitch = width_ * sizeof( uchar4 );
+	resource.bufferFormat = NV_ENC_BUFFER_FORMAT_ABGR;							// R in the lowest byte, like GL_RGBA8
+	resource.bufferUsage = NV_ENC_INPUT_IMAGE;
+	if ( !nvencCheck( encoder->api.nvEncRegisterResource( encoder->session, &resource ), "nvEncRegisterResource" ) )
+	{
+		closeEncoder();
+		return false;
+	}
+	encoder->input = resource.registeredResource;
+
+	NV_ENC_CREATE_BITSTREAM_BUFFER bitstream = { NV_ENC_CREATE_BITSTREAM_BUFFER_VER };
+	if ( !nvencCheck( encoder->api.nvEncCreateBitstreamBuffer( encoder->session, &bitstream ), "nvEncCreateBitstreamBuffer" ) )
+	{
+		closeEncoder();
+		return false;
+	}
+	encoder->bitstream = bitstream.bitstreamBuffer;
+
+	encoder->file = std::fopen( path_.c_str(), "wb" );
+	if ( encoder->file == NULL )
+	{
+		std::cerr << "Can't open " << path_ << std::endl;
+		closeEncoder();
+		return false;
+	}
+
+	std::cout << "Recording " << width_ << "x" << height_ << " at " << fps << " fps as " << ( hevc ? "HEVC" : "H.264" ) << " into " << path_ << std::endl;
+	return true;
+#else
+	(void)fps;
+	std::cerr << "Built without SWARM_NVENC." << std::endl;
+	return false;
+#endif
+}
+
+void VideoRecorder::encodeFrame()
+{
+#ifdef SWARM_NVENC
+	NVTX_RANGE( NvtxDomain::RENDERER, "VideoRecorder::encodeFrame", NVTX_COLOR_INTEROP );
+
+	Encoder* encoder = encoder_;
+	NV_ENC_MAP_INPUT_RESOURCE map = { NV_ENC_MAP_INPUT_RESOURCE_VER };
+	map.registeredResource = encoder->input;
+	if ( !nvencCheck( encoder->api.nvEncMapInputResource( encoder->session, &map ), "nvEncMapInputResource" ) )
+		return;
+
+	NV_ENC_PIC_PARAMS picture = { NV_ENC_PIC_PARAMS_VER };
+	picture.inputWidth = width_;
+	picture.inputHeight = height_;
+	picture.inputPitch = width_;
+	picture.inputBuffer = map.mappedResource;
+	picture.bufferFmt = map.mappedBufferFmt;
+	picture.outputBitstream = encoder->bitstream;
+	picture.pictureStruct = NV_ENC_PIC_STRUCT_FRAME;
+	picture.inputTimeStamp = frames_;
+	if ( nvencCheck( encoder->api.nvEncEncodePicture( encoder->session, &picture ), "nvEncEncodePicture" ) )
+	{
+		NV_ENC_LOCK_BITSTREAM lock = { NV_ENC_LOCK_BITSTREAM_VER };
+		lock.outputBitstream = encoder->bitstream;
+		if ( nvencCheck( encoder->api.nvEncLockBitstream( encoder->session, &lock ), "nvEncLockBitstream" ) )	// Waits for the encode
+		{
+			std::fwrite( lock.bitstreamBufferPtr, 1, lock.bitstreamSizeInBytes, encoder->file );
+			encoder->api.nvEncUnlockBitstream( encoder->session, encoder->bitstream );
+			frames_++;
+		}
+	}
+	encoder->api.nvEncUnmapInputResource( encoder->session, map.mappedResource );
+#endif
+}
+
+void VideoRecorder::closeEncoder()
+{
+	if ( encoder_ == NULL )
+		return;
+
+#ifdef SWARM_NVENC
+	Encoder* encoder = encoder_;
+	if ( encoder->file != NULL )
+	{
+		NV_ENC_PIC_PARAMS flush = { NV_ENC_PIC_PARAMS_VER };
+		flush.encodePicFlags = NV_ENC_PIC_FLAG_EOS;								// Nothing is pending without B frames, ends the stream
+		nvencCheck( encoder->api.nvEncEncodePicture( encoder->session, &flush ), "nvEncEncodePicture" );
+		std::fclose( encoder->file );
+		std::cout << "Recorded " << frames_ << " frames into " << path_ << std::endl;
+	}
+	if ( encoder->bitstream != NULL )
+		encoder->api.nvEncDestroyBitstreamBuffer( encoder->session, encoder->bitstream );
+	if ( encoder->input != NULL )
+		encoder->api.nvEncUnregisterResource( encoder->session, encoder->input );
+	encoder->api.nvEncDestroyEncoder( encoder->session );
+#endif
+	delete encoder_;
+	encoder_ = NULL;
+}
+
+void VideoRecorder::beginFrame()
+{
+	if ( encoder_ == NULL )
+		return;
+
+	glGetIntegerv( GL_VIEWPORT, viewport_ );
+	glBindFramebuffer( GL_FRAMEBUFFER, sceneFbo_ );
+	glViewport( 0, 0, width_, height_ );
+}
+
+void VideoRecorder::endFrame( cudaStream_t stream )
+{
+	if ( encoder_ == NULL )
+		return;
+
+	NVTX_RANGE( NvtxDomain::RENDERER, "VideoRecorder::endFrame", NVTX_COLOR_INTEROP );
+
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, sceneFbo_ );
+	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, captureFbo_ );
+	glBlitFramebuffer( 0, 0, width_, height_, 0, height_, width_, 0, GL_COLOR_BUFFER_BIT, GL_NEAREST );	// OpenGL starts at the bottom row
+	if ( Window::getInstance()->isVisible() )
+	{
+		glBindFramebuffer( GL_DRAW_FRAMEBUFFER, 0 );
+		glBlitFramebuffer( 0, 0, width_, height_, viewport_[0], viewport_[1], viewport_[0] + viewport_[2], viewport_[1] + viewport_[3], GL_COLOR_BUFFER_BIT, GL_LINEAR );
+	}
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+	glViewport( viewport_[0], viewport_[1], viewport_[2], viewport_[3] );
+
+	cudaArray_t array = NULL;
+	CUDA_CHECK( cudaGraphicsMapResources( 1, &captureResource_, stream ) );		// Waits for the blit
+	CUDA_CHECK( cudaGraphicsSubResourceGetMappedArray( &array, captureResource_, 0, 0 ) );
+	CUDA_CHECK( cudaMemcpy2DFromArrayAsync( d_frame_.getData(), width_ * sizeof( uchar4 ), array, 0, 0, width_ * sizeof( uchar4 ), height_, cudaMemcpyDeviceToDevice, stream ) );
+	CUDA_CHECK( cudaGraphicsUnmapResources( 1, &captureResource_, stream ) );
+	CUDA_CHECK( cudaStreamSynchronize( stream ) );								// NVENC reads d_frame_ outside of the stream
+	encodeFrame();
+}
@@ -0,0 +1,469 @@
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include <glew.h>
+#include <glfw3.h>
+
+#include "vulkan_interop.h"
+#include "macros.h"
+#include "memory_tracker.h"
+
+static const GLenum HANDLE_TYPE_OPAQUE_FD = 0x9586;								// GL_HANDLE_TYPE_OPAQUE_FD_EXT
+static const GLenum HANDLE_TYPE_OPAQUE_WIN32 = 0x9587;							// GL_HANDLE_TYPE_OPAQUE_WIN32_EXT
+
+/*!
+ * @brief Entry points of EXT_memory_object and EXT_semaphore with the handles of the platform. The GLEW of the
+ * framework predates them, so they are loaded here (loadGlExternalObjects).
+ */
+struct GlExternalObjects
+{
+	void ( GLAPIENTRY* createMemoryObjects )( GLsizei n, GLuint* memoryObjects ) = NULL;
+	void ( GLAPIENTRY* deleteMemoryObjects )( GLsizei n, const GLuint* memoryObjects ) = NULL;
+	void ( GLAPIENTRY* bufferStorageMem )( GLenum target, GLsizeiptr size, GLuint memory, GLuint64 offset ) = NULL;
+	void ( GLAPIENTRY* genSemaphores )( GLsizei n, GLuint* semaphores ) = NULL;
+	void ( GLAPIENTRY* deleteSemaphores )( GLsizei n, const GLuint* semaphores ) = NULL;
+	GLboolean ( GLAPIENTRY* isSemaphore )( GLuint semaphore ) = NULL;
+	void ( GLAPIENTRY* waitSemaphore )( GLuint semaphore, GLuint numBufferBarriers, const GLuint* buffers, GLuint numTextureBarriers,
+		const GLuint* textures, const GLenum* srcLayouts ) = NULL;
+	void ( GLAPIENTRY* signalSemaphore )( GLuint semaphore, GLuint numBufferBarriers, const GLuint* buffers, GLuint numTextureBarriers,
+		const GLuint* textures, const GLenum* dstLayouts ) = NULL;
+#ifdef _WIN32
+	void ( GLAPIENTRY* importMemory )( GLuint memory, GLuint64 size, GLenum handleType, void* handle ) = NULL;
+	void ( GLAPIENTRY* importSemaphore )( GLuint semaphore, GLenum handleType, void* handle ) = NULL;
+#else
+	void ( GLAPIENTRY* importMemory )( GLuint memory, GLuint64 size, GLenum handleType, GLint fd ) = NULL;
+	void ( GLAPIENTRY* importSemaphore )( GLuint semaphore, GLenum handleType, GLint fd ) = NULL;
+#endif
+};
+
+static GlExternalObjects gl;													// Of the context of the renderer
+
+/*!
+ * @brief Load the entry points of gl. Needs a current context.
+ * @return true, if the extensions and all entry points are there.
+ */
+static bool loadGlExternalObjects()
+{
+#ifdef _WIN32
+	const char* const platform[2] = { "GL_EXT_memory_object_win32", "GL_EXT_semaphore_win32" };
+	const char* const importMemory = "glImportMemoryWin32HandleEXT";
+	const char* const importSemaphore = "glImportSemaphoreWin32HandleEXT";
+#else
+	const char* const platform[2] = { "GL_EXT_memory_object_fd", "GL_EXT_semaphore_fd" };
+	const char* const importMemory = "glImportMemoryFdEXT";
+	const char* const importSemaphore = "glImportSemaphoreFdEXT";
+#endif
+	if ( !glfwExtensionSupported( "GL_EXT_memory_object" ) || !glfwExtensionSupported( "GL_EXT_semaphore" )
+		|| !glfwExtensionSupported( platform[0] ) || !glfwExtensionSupported( platform[1] ) )
+		return false;
+
+	auto load = []( auto& function, const char* name ) {
+		function = reinterpret_cast< typename std::remove_reference< decltype( function ) >::type >( glfwGetProcAddress( name ) );
+		return function != NULL;
+	};
+	return load( gl.createMemoryObjects, "glCreateMemoryObjectsEXT" ) && load( gl.deleteMemoryObjects, "glDeleteMemoryObjectsEXT" )
+		&& load( gl.bufferStorageMem, "glBufferStorageMemEXT" ) && load( gl.genSemaphores, "glGenSemaphoresEXT" )
+		&& load( gl.deleteSemaphores, "glDeleteSemaphoresEXT" ) && load( gl.isSemaphore, "glIsSemaphoreEXT" )
+		&& load( gl.waitSemaphore, "glWaitSemaphoreEXT" ) && load( gl.signalSemaphore, "glSignalSemaphoreEXT" )
+		&& load( gl.importMemory, importMemory ) && load( gl.importSemaphore, importSemaphore );
+}
+
+#ifdef SWARM_VULKAN
+#ifdef _WIN32
+#define VK_USE_PLATFORM_WIN32_KHR
+#endif
+#include <vulkan/vulkan.h>
+
+#ifdef _WIN32
+typedef HANDLE ExternalHandle;
+typedef PFN_vkGetMemoryWin32HandleKHR GetMemoryHandle;
+typedef PFN_vkGetSemaphoreWin32HandleKHR GetSemaphoreHandle;
+static const char* const GET_MEMORY_HANDLE = "vkGetMemoryWin32HandleKHR";
+static const char* const GET_SEMAPHORE_HANDLE = "vkGetSemaphoreWin32HandleKHR";
+static const VkExternalMemoryHandleTypeFlagBits VK_MEMORY_HANDLE = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_WIN32_BIT;
+static const VkExternalSemaphoreHandleTypeFlagBits VK_SEMAPHORE_HANDLE = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_WIN32_BIT;
+static const char* const DEVICE_EXTENSIONS[] = { VK_KHR_EXTERNAL_MEMORY_WIN32_EXTENSION_NAME, VK_KHR_EXTERNAL_SEMAPHORE_WIN32_EXTENSION_NAME };
+#else
+typedef int ExternalHandle;
+typedef PFN_vkGetMemoryFdKHR GetMemoryHandle;
+typedef PFN_vkGetSemaphoreFdKHR GetSemaphoreHandle;
+static const char* const GET_MEMORY_HANDLE = "vkGetMemoryFdKHR";
+static const char* const GET_SEMAPHORE_HANDLE = "vkGetSemaphoreFdKHR";
+static const VkExternalMemoryHandleTypeFlagBits VK_MEMORY_HANDLE = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+static const VkExternalSemaphoreHandleTypeFlagBits VK_SEMAPHORE_HANDLE = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT;
+static const char* const DEVICE_EXTENSIONS[] = { VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME, VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME };
+#endif
+
+/*!
+ * @brief Vulkan objects of the interop. Vulkan only allocates, it never records or submits commands.
+ */
+struct VulkanInterop::Context
+{
+	VkInstance instance = VK_NULL_HANDLE;
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;	//!< Same UUID as the CUDA device.
+	VkDevice device = VK_NULL_HANDLE;
+	std::vector<VkBuffer> buffers;						//!< One per VulkanInterop::Buffer, keeps the memory requirements valid.
+	std::vector<VkDeviceMemory> memories;				//!< Exported memory, one per VulkanInterop::Buffer.
+	VkSemaphore drawsDone = VK_NULL_HANDLE;				//!< Signaled by OpenGL, waited for by CUDA.
+	VkSemaphore writesDone = VK_NULL_HANDLE;			//!< Signaled by CUDA, waited for by OpenGL.
+	GetMemoryHandle getMemoryHandle = NULL;				//!< Extension function, loaded from the device.
+	GetSemaphoreHandle getSemaphoreHandle = NULL;
+};
+
+/*!
+ * @brief Print a failed Vulkan call.
+ * @param result result of the call.
+ * @param call name of the call.
+ * @return true, if the call succeeded.
+ */
+static bool vulkanCheck( VkResult result, const char* call )
+{
+	if ( result != VK_SUCCESS )
+		std::cerr << call << " failed with VkResult " << result << std::endl;
+	return result == VK_SUCCESS;
+}
+
+/*!
+ * @brief Export a handle of memory. Each import takes its own handle: an fd belongs to its import afterwards.
+ * @param device device of the memory.
+ * @param getMemoryHandle extension function of the device.
+ * @param memory exported memory.
+ * @param handle Output: handle.
+ * @return true, if the handle was exported.
+ */
+static bool exportMemory( VkDevice device, GetMemoryHandle getMemoryHandle, VkDeviceMemory memory, ExternalHandle& handle )
+{
+#ifdef _WIN32
+	VkMemoryGetWin32HandleInfoKHR info = { VK_STRUCTURE_TYPE_MEMORY_GET_WIN32_HANDLE_INFO_KHR };
+#else
+	VkMemoryGetFdInfoKHR info = { VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR };
+#endif
+	info.memory = memory;
+	info.handleType = VK_MEMORY_HANDLE;
+	return vulkanCheck( getMemoryHandle( device, &info, &handle ), GET_MEMORY_HANDLE );
+}
+
+/*!
+ * @brief Export a handle of a semaphore, like exportMemory.
+ * @param device device of the semaphore.
+ * @param getSemaphoreHandle extension function of the device.
+ * @param semaphore exported semaphore.
+ * @param handle Output: handle.
+ * @return true, if the handle was exported.
+ */
+static bool exportSemaphore( VkDevice device, GetSemaphoreHandle getSemaphoreHandle, VkSemaphore semaphore, ExternalHandle& handle )
+{
+#ifdef _WIN32
+	VkSemaphoreGetWin32HandleInfoKHR info = { VK_STRUCTURE_TYPE_SEMAPHORE_GET_WIN32_HANDLE_INFO_KHR };
+#else
+	VkSemaphoreGetFdInfoKHR info = { VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR };
+#endif
+	info.semaphore = semaphore;
+	info.handleType = VK_SEMAPHORE_HANDLE;
+	return vulkanCheck( getSemaphoreHandle( device, &info, &handle ), GET_SEMAPHORE_HANDLE );
+}
+
+/*!
+ * @brief Create an exportable binary semaphore and import it into CUDA and OpenGL.
+ * @param device Vulkan device.
+ * @param getSemaphoreHandle extension function of the device.
+ * @param semaphore Output: Vulkan semaphore.
+ * @param glSemaphore Output: OpenGL import.
+ * @param cudaSemaphore Output: CUDA import.
+ * @return true, if both imports worked.
+ */
+static bool createSemaphore( VkDevice device, GetSemaphoreHandle getSemaphoreHandle, VkSemaphore& semaphore, GLuint& glSemaphore,
+	cudaExternalSemaphore_t& cudaSemaphore )
+{
+	VkExportSemaphoreCreateInfo exportInfo = { VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO };
+	exportInfo.handleTypes = VK_SEMAPHORE_HANDLE;
+	VkSemaphoreCreateInfo info = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+	info.pNext = &exportInfo;
+	if ( !vulkanCheck( vkCreateSemaphore( device, &info, NULL, &semaphore ), "vkCreateSemaphore" ) )
+		return false;
+
+	ExternalHandle handles[2];
+	if ( !exportSemaphore( device, getSemaphoreHandle, semaphore, handles[0] ) || !exportSemaphore( device, getSemaphoreHandle, semaphore, handles[1] ) )
+		return false;
+
+	cudaExternalSemaphoreHandleDesc desc = {};
+#ifdef _WIN32
+	desc.type = cudaExternalSemaphoreHandleTypeOpaqueWin32;
+	desc.handle.win32.handle = handles[0];
+#else
+	desc.type = cudaExternalSemaphoreHandleTypeOpaqueFd;
+	desc.handle.fd = handles[0];
+#endif
+	if ( cudaImportExternalSemaphore( &cudaSemaphore, &desc ) != cudaSuccess )
+	{
+		std::cerr << "cudaImportExternalSemaphore failed" << std::endl;
+		return false;
+	}
+
+	gl.genSemaphores( 1, &glSemaphore );
+#ifdef _WIN32
+	gl.importSemaphore( glSemaphore, HANDLE_TYPE_OPAQUE_WIN32, handles[1] );
+	CloseHandle( handles[0] );													// Win32 imports don't take the handle
+	CloseHandle( handles[1] );
+#else
+	gl.importSemaphore( glSemaphore, HANDLE_TYPE_OPAQUE_FD, handles[1] );
+#endif
+	return gl.isSemaphore( glSemaphore ) == GL_TRUE;
+}
+#else
+struct VulkanInterop::Context {};
+#endif
+
+ExternalVertexBuffer::ExternalVertexBuffer( GLuint memoryObject, unsigned int size ) :
+	VertexBuffer()
+{
+	gl.bufferStorageMem( GL_ARRAY_BUFFER, size, memoryObject, 0 );				// Immutable, the memory belongs to Vulkan
+}
+
+VulkanInterop::VulkanInterop( bool enabled, int cudaDevice )
+{
+	if ( !enabled )
+		return;
+
+#ifdef SWARM_VULKAN
+	if ( !loadGlExternalObjects() )
+	{
+		std::cerr << "Vulkan interop needs EXT_memory_object and EXT_semaphore, mapping the buffers" << std::endl;
+		return;
+	}
+	cudaDeviceProp properties;
+	CUDA_CHECK( cudaGetDeviceProperties( &properties, cudaDevice ) );
+
+	Context* context = new Context();
+	VkApplicationInfo application = { VK_STRUCTURE_TYPE_APPLICATION_INFO };
+	application.pApplicationName = "Swarm";
+	application.apiVersion = VK_API_VERSION_1_1;								// External memory and semaphores are core
+	VkInstanceCreateInfo instanceInfo = { VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO };
+	instanceInfo.pApplicationInfo = &application;
+	bool ready = vulkanCheck( vkCreateInstance( &instanceInfo, NULL, &context->instance ), "vkCreateInstance" );
+
+	uint32_t count = 0;
+	if ( ready )
+		vkEnumeratePhysicalDevices( context->instance, &count, NULL );
+	std::vector<VkPhysicalDevice> physicalDevices( count );
+	if ( count > 0 )
+		vkEnumeratePhysicalDevices( context->instance, &count, physicalDevices.data() );
+	for ( VkPhysicalDevice physicalDevice : physicalDevices )					// The indices of CUDA and Vulkan may differ
+	{
+		VkPhysicalDeviceIDProperties id = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES };
+		VkPhysicalDeviceProperties2 deviceProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+		deviceProperties.pNext = &id;
+		vkGetPhysicalDeviceProperties2( physicalDevice, &deviceProperties );
+		if ( std::memcmp( id.deviceUUID, properties.uuid.bytes, VK_UUID_SIZE ) == 0 )
+			context->physicalDevice = physicalDevice;
+	}
+	if ( ready && context->physicalDevice == VK_NULL_HANDLE )
+	{
+		std::cerr << "No Vulkan device with the UUID of CUDA device " << cudaDevice << std::endl;
+		ready = false;
+	}
+
+	if ( ready )
+	{
+		float const priority = 1.0f;
+		VkDeviceQueueCreateInfo queue = { VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO };
+		queue.queueFamilyIndex = 0;												// A device needs a queue, none is used
+		queue.queueCount = 1;
+		queue.pQueuePriorities = &priority;
+		VkDeviceCreateInfo deviceInfo = { VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
+		deviceInfo.queueCreateInfoCount = 1;
+		deviceInfo.pQueueCreateInfos = &queue;
+		deviceInfo.enabledExtensionCount = sizeof( DEVICE_EXTENSIONS ) / sizeof( DEVICE_EXTENSIONS[0] );
+		deviceInfo.ppEnabledExtensionNames = DEVICE_EXTENSIONS;
+		ready = vulkanCheck( vkCreateDevice( context->physicalDevice, &deviceInfo, NULL, &context->device ), "vkCreateDevice" );
+	}
+	if ( ready )
+	{
+		context->getMemoryHandle = reinterpret_cast< GetMemoryHandle >( vkGetDeviceProcAddr( context->device, GET_MEMORY_HANDLE ) );
+		context->getSemaphoreHandle = reinterpret_cast< GetSemaphoreHandle >( vkGetDeviceProcAddr( context->device, GET_SEMAPHORE_HANDLE ) );
+		ready = context->getMemoryHandle != NULL && context->getSemaphoreHandle != NULL
+			&& createSemaphore( context->device, context->getSemaphoreHandle, context->drawsDone, glDrawsDone_, cudaDrawsDone_ )
+			&& createSemaphore( context->device, context->getSemaphoreHandle, context->writesDone, glWritesDone_, cudaWritesDone_ );
+	}
+
+	context_ = context;
+	if ( !ready )
+	{
+		std::cerr << "Vulkan interop failed, mapping the buffers" << std::endl;
+		destroy();																// Frees what was created
+		return;
+	}
+	std::cout << "Interop:                          Vulkan external memory and semaphores" << std::endl;
+#else
+	(void)cudaDevice;
+	std::cerr << "Built without SWARM_VULKAN, mapping the buffers" << std::endl;
+#endif
+}
+
+VulkanInterop::~VulkanInterop()
+{
+	destroy();
+}
+
+void VulkanInterop::destroy()
+{
+	if ( context_ == NULL )
+		return;
+
+#ifdef SWARM_VULKAN
+	for ( Buffer& buffer : buffers_ )
+	{
+		CUDA_CHECK( cudaFree( buffer.devicePointer ) );							// The mapping, the memory stays with Vulkan
+		CUDA_CHECK( cudaDestroyExternalMemory( buffer.cudaMemory ) );
+		gl.deleteMemoryObjects( 1, &buffer.memoryObject );
+		trackFree( MemorySpace::DEVICE, MemoryCategory::RENDER, buffer.size );
+	}
+	buffers_.clear();
+	if ( cudaDrawsDone_ != NULL )
+		CUDA_CHECK( cudaDestroyExternalSemaphore( cudaDrawsDone_ ) );
+	if ( cudaWritesDone_ != NULL )
+		CUDA_CHECK( cudaDestroyExternalSemaphore( cudaWritesDone_ ) );
+	cudaDrawsDone_ = cudaWritesDone_ = NULL;
+	GLuint const semaphores[2] = { glDrawsDone_, glWritesDone_ };
+	for ( GLuint semaphore : semaphores )
+		if ( semaphore != 0 )
+			gl.deleteSemaphores( 1, &semaphore );
+	glDrawsDone_ = glWritesDone_ = 0;
+
+	Context* context = context_;
+	if ( context->device != VK_NULL_HANDLE )
+	{
+		for ( VkBuffer buffer : context->buffers )
+			vkDestroyBuffer( context->device, buffer, NULL );
+		for ( VkDeviceMemory memory : context->memories )
+			vkFreeMemory( context->device, memory, NULL );
+		vkDestroySemaphore( context->device, context->drawsDone, NULL );		// VK_NULL_HANDLE is ignored
+		vkDestroySemaphore( context->device, context->writesDone, NULL );
+		vkDestroyDevice( context->device, NULL );
+	}
+	if ( context->instance != VK_NULL_HANDLE )
+		vkDestroyInstance( context->instance, NULL );
+	delete context;
+#endif
+	context_ = NULL;
+}
+
+int VulkanInterop::createBuffer( size_t size )
+{
+	if ( context_ == NULL )
+		return -1;
+
+#ifdef SWARM_VULKAN
+	Context& context = *context_;
+	VkExternalMemoryBufferCreateInfo externalInfo = { VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO };
+	externalInfo.handleTypes = VK_MEMORY_HANDLE;
+	VkBufferCreateInfo bufferInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+	bufferInfo.pNext = &externalInfo;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	VkBuffer vkBuffer;
+	if ( !vulkanCheck( vkCreateBuffer( context.device, &bufferInfo, NULL, &vkBuffer ), "vkCreateBuffer" ) )
+		return -1;
+	context.buffers.push_back( vkBuffer );
+
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements( context.device, vkBuffer, &requirements );
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties( context.physicalDevice, &memoryProperties );
+	uint32_t type = memoryProperties.memoryTypeCount;
+	for ( uint32_t i = 0; i < memoryProperties.memoryTypeCount && type == memoryProperties.memoryTypeCount; i++ )
+		if ( ( requirements.memoryTypeBits & ( 1u << i ) ) != 0 && ( memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT ) != 0 )
+			type = i;
+	if ( type == memoryProperties.memoryTypeCount )
+	{
+		std::cerr << "No device local Vulkan memory for the interop" << std::endl;
+		return -1;
+	}
+
+	VkExportMemoryAllocateInfo exportInfo = { VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO };
+	exportInfo.handleTypes = VK_MEMORY_HANDLE;
+	VkMemoryAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+	allocateInfo.pNext = &exportInfo;
+	allocateInfo.allocationSize = requirements.size;							// CUDA and OpenGL import the whole allocation
+	allocateInfo.memoryTypeIndex = type;
+	VkDeviceMemory memory;
+	if ( !vulkanCheck( vkAllocateMemory( context.device, &allocateInfo, NULL, &memory ), "vkAllocateMemory" ) )
+		return -1;
+	context.memories.push_back( memory );
+	vkBindBufferMemory( context.device, vkBuffer, memory, 0 );
+
+	ExternalHandle handles[2];
+	if ( !exportMemory( context.device, context.getMemoryHandle, memory, handles[0] ) || !exportMemory( context.device, context.getMemoryHandle, memory, handles[1] ) )
+		return -1;
+
+	Buffer buffer;
+	buffer.size = size;
+	cudaExternalMemoryHandleDesc memoryDesc = {};
+#ifdef _WIN32
+	memoryDesc.type = cudaExternalMemoryHandleTypeOpaqueWin32;
+	memoryDesc.handle.win32.handle = handles[0];
+#else
+	memoryDesc.type = cudaExternalMemoryHandleTypeOpaqueFd;
+	memoryDesc.handle.fd = handles[0];
+#endif
+	memoryDesc.size = requirements.size;
+	cudaExternalMemoryBufferDesc bufferDesc = {};
+	bufferDesc.size = size;
+	if ( cudaImportExternalMemory( &buffer.cudaMemory, &memoryDesc ) != cudaSuccess
+		|| cudaExternalMemoryGetMappedBuffer( &buffer.devicePointer, buffer.cudaMemory, &bufferDesc ) != cudaSuccess )
+	{
+		std::cerr << "cudaImportExternalMemory failed" << std::endl;
+		if ( buffer.cudaMemory != NULL )
+			cudaDestroyExternalMemory( buffer.cudaMemory );
+		return -1;
+	}
+
+	gl.createMemoryObjects( 1, &buffer.memoryObject );
+#ifdef _WIN32
+	gl.importMemory( buffer.memoryObject, requirements.size, HANDLE_TYPE_OPAQUE_WIN32, handles[1] );
+	CloseHandle( handles[0] );
+	CloseHandle( handles[1] );
+#else
+	gl.importMemory( buffer.memoryObject, requirements.size, HANDLE_TYPE_OPAQUE_FD, handles[1] );
+#endif
+	trackAllocation( MemorySpace::DEVICE, MemoryCategory::RENDER, size );		// The buffers on it don't track their storage
+	buffers_.push_back( buffer );
+	return static_cast< int >( buffers_.size() ) - 1;
+#else
+	(void)size;
+	return -1;
+#endif
+}
+
+void VulkanInterop::addGLBuffer( GLuint glBuffer )
+{
+	glBuffers_.push_back( glBuffer );
+}
+
+void VulkanInterop::acquire( cudaStream_t stream )
+{
+	if ( context_ == NULL )
+		return;
+
+	gl.signalSemaphore( glDrawsDone_, static_cast< GLuint >( glBuffers_.size() ), glBuffers_.data(), 0, NULL, NULL );
+	glFlush();																	// The stream can only pass the wait after OpenGL got the signal
+	cudaExternalSemaphoreWaitParams params = {};
+	CUDA_CHECK( cudaWaitExternalSemaphoresAsync( &cudaDrawsDone_, &params, 1, stream ) );
+}
+
+void VulkanInterop::release( cudaStream_t stream )
+{
+	if ( context_ == NULL )
+		return;
+
+	cudaExternalSemaphoreSignalParams params = {};
+	CUDA_CHECK( cudaSignalExternalSemaphoresAsync( &cudaWritesDone_, &params, 1, stream ) );
+	gl.waitSemaphore( glWritesDone_, static_cast< GLuint >( glBuffers_.size() ), glBuffers_.data(), 0, NULL, NULL );	// GPU wait, the next draws see the writes
+}
@@ -6,175 +6,87 @@ WaypointList::WaypointList()
 WaypointList::WaypointList( std::vector<Vector3> waypoints )
 {
 	append( waypoints );
-	idx = head;
-}
-
-WaypointList::~WaypointList() 
-{
-	clear();
 }
 
 void WaypointList::append( Vector3 data )
 {
-	Node* node = new Node();
-	Node* last = head;
-	
-	node->data = data;
-	node->next = NULL;
-	node->prev = NULL;
-
-	if ( head == NULL )
-	{
-		head = node;
-		head->next = node;
-		head->prev = node;
-		return;
-	}
-		
-	while ( last->next != NULL && last->next != head )
-		last = last->next;
-
-	// Set Next value
-	node->next = head;
-	last->next = node;
-
-	// Set Prev value
-	node->prev = last;
-	head->prev = node;
-	return;
+	points_.push_back( data );
 }
 
 void WaypointList::append( std::vector<Vector3> waypoints )
 {
-	for ( Vector3 wp : waypoints )
-		append( wp );
+	points_.insert( points_.end(), waypoints.begin(), waypoints.end() );
 }
 
 void WaypointList::push( Vector3 data )
 {
-	Node* node = new Node();
-
-	node->data = data;
-	node->next = head;
-	node->prev = head->prev;
-	head->prev = node;
-
-	head = node;
+	points_.insert( points_.begin(), data );
+	if ( points_.size() > 1 )
+		cursor_++;																// Same waypoint as before
 }
 
 void WaypointList::push( std::vector<Vector3> waypoints )
 {
-	for (int i = waypoints.size() - 1; i >= 0; i--)
-		push( waypoints[i] );
+	points_.insert( points_.begin(), waypoints.begin(), waypoints.end() );
+	if ( points_.size() > waypoints.size() )
+		cursor_ += waypoints.size();
 }
 
 void WaypointList::pop()
 {
-	Node* node = head->next;
-
-	head->next->prev = head->prev;
-	head->prev->next = head->next;
-
-	free(head);
-
-	head = node;
+	remove( 0 );
 }
 
 void WaypointList::remove( int index )
 {
-	if ( head == NULL )
-		return;
-
-	Node* tmp = head;
-
-	if ( index == 0 )
-	{
-		pop();
+	if ( index < 0 || static_cast< size_t >( index ) >= points_.size() )
 		return;
-	}
 
-	for ( int i = 0; tmp != head && i < index - 1; i++ )
-		tmp = tmp->next;
-
-	if ( tmp->next == head )
-		return;
-
-	Node* next = tmp->next->next;
-
-	free( tmp->next );
-
-	tmp->next = next;
-	next->prev = tmp;
+	points_.erase( points_.begin() + index );
+	if ( cursor_ > static_cast< size_t >( index ) )
+		cursor_--;																// Same waypoint as before
+	if ( cursor_ >= points_.size() )
+		cursor_ = 0;															// Removed the last one, wrap around
 }
 
 void WaypointList::clear()
 {
-	Node* current = head;
-	Node* next = NULL;
-
-	while ( current != NULL )
-	{
-		next = current->next;
-		free( current );
-		current = next;
-	}
-
-	head = NULL;
-	idx = NULL;
+	points_.clear();
+	cursor_ = 0;
 }
 
-int WaypointList::length()
+int WaypointList::length() const
 {
-	if ( head == NULL )
-		return 0;
-
-	int count = 1;
-	Node* current = head;
-	while ( current->next != head )
-	{
-		count++;
-		current = current->next;
-	}
-
-	return count;
+	return static_cast< int >( points_.size() );
 }
 
-Vector3 WaypointList::get( int index )
+Vector3 WaypointList::get( int index ) const
 {
-	Node* current = head;
-	if ( head == NULL )
-		return Vector3();
-
-	for ( int i = 0; current->next != head && i < index; i++ )
-		current = current->next;
-
-	if ( current->next == head )
+	if ( index < 0 || static_cast< size_t >( index ) >= points_.size() )
 		return Vector3();
 
-	return current->data;
+	return points_[index];
 }
 
-Vector3 WaypointList::get()
+Vector3 WaypointList::get() const
 {
-	if ( idx == NULL )
-		idx = head;
-	return idx->data;
+	if ( points_.empty() )
+		return Vector3();
+	return points_[cursor_];
 }
 
 Vector3 WaypointList::getNext()
 {
-	if ( idx == NULL )
-		idx = head;
-	else
-		idx = idx->next;
-	return idx->data;
+	if ( points_.empty() )
+		return Vector3();
+	cursor_ = ( cursor_ + 1 ) % points_.size();
+	return points_[cursor_];
 }
 
 Vector3 WaypointList::getPrev()
 {
-	if ( idx == NULL )
-		idx = head;
-	else
-		idx = idx->prev;
-	return idx->data;
-}
\ No newline at end of file
+	if ( points_.empty() )
+		return Vector3();
+	cursor_ = ( cursor_ + points_.size() - 1 ) % points_.size();
+	return points_[cursor_];
+}
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <stdexcept>
+#include <algorithm>
+#include <cuda_runtime.h>
+
+#include "macros.h"
+#include "device_allocator.h"
+#include "memory_tracker.h"
+
+
+/*!
+ * @brief CudaDeviceArray Class can be used to create memory with any type easily on both CPU and GPU.
+ *		  The allocated memory can be copied with the given methods to and from the GPU.
+ * @tparam T data type
+ * @tparam Allocator provides allocate(bytes) and deallocate(ptr), e.g. CudaMallocAllocator, StreamOrderedAllocator or ArenaAllocator.
+ *		  The allocations are counted by the memory tracker, unless AllocatorTracking<Allocator>::TRACKED is false.
+ */
+template <class T, class Allocator = CudaMallocAllocator> 
+class CudaDeviceArray 
+{
+public:
+	
+	/*!
+	 * @brief Standard Constructor. Set size to 0
+	 * @param allocator allocator used for all allocations of this array.
+	 */
+	explicit CudaDeviceArray(Allocator allocator = Allocator()) 
+		: start_(0), end_(0), capacity_(0), allocator_(allocator), category_(MemoryCategory::OTHER)
+	{}
+
+	/*!
+	 * @brief Constructor to create a DeviceArray with a given size on the GPU.
+	 * @param size Allocate the given value on GPU
+	 * @param allocator allocator used for all allocations of this array.
+	 */
+	explicit CudaDeviceArray(size_t size, Allocator allocator = Allocator())
+		: allocator_(allocator), category_(MemoryCategory::OTHER)
+	{
+		allocate(size);
+	}
+
+	/*!
+	 * @brief Constructor to create a DeviceArray with a given size on the GPU, counted for the given owner.
+	 * @param size Allocate the given value on GPU
+	 * @param category owner in the memory report.
+	 * @param allocator allocator used for all allocations of this array.
+	 */
+	CudaDeviceArray(size_t size, MemoryCategory category, Allocator allocator = Allocator())
+		: allocator_(allocator), category_(category)
+	{
+		allocate(size);
+	}
+	
+	/*!
+	 * @brief Destructor. Free the allocated memory on GPU.
+	 */
+	~CudaDeviceArray()
+	{
+		free();
+	}
+
+	/*!
+	 * @brief No implicit copies, two instances would free the same memory. Use clone().
+	 */
+	CudaDeviceArray( const CudaDeviceArray& ) = delete;
+	CudaDeviceArray& operator=( const CudaDeviceArray& ) = delete;
+
+	/*!
+	 * @brief Move Constructor. Takes over the memory of another instance.
+	 * @param cdva CudaDeviceArray instance. Is empty afterwards.
+	 */
+	CudaDeviceArray( CudaDeviceArray&& cdva ) noexcept
+		: start_(cdva.start_), end_(cdva.end_), capacity_(cdva.capacity_), allocator_(cdva.allocator_), category_(cdva.category_)
+	{
+		cdva.start_ = cdva.end_ = 0;
+		cdva.capacity_ = 0;
+	}
+
+	/*!
+	 * @brief Move Operator. Frees the own memory and takes over the memory of another instance.
+	 * @param cdva CudaDeviceArray instance. Is empty afterwards.
+	 * @return this instance.
+	 */
+	CudaDeviceArray& operator=( CudaDeviceArray&& cdva ) noexcept
+	{
+		if (this != &cdva)
+		{
+			free();
+			start_ = cdva.start_;
+			end_ = cdva.end_;
+			capacity_ = cdva.capacity_;
+			allocator_ = cdva.allocator_;
+			category_ = cdva.category_;
+			cdva.start_ = cdva.end_ = 0;
+			cdva.capacity_ = 0;
+		}
+		return *this;
+	}
+
+	/*!
+	 * @brief Create a deep copy on the GPU.
+	 * @return new CudaDeviceArray instance with the same content.
+	 */
+	CudaDeviceArray clone() const
+	{
+		CudaDeviceArray copy(getSize(), category_, allocator_);
+		CUDA_CHECK( cudaMemcpy(copy.start_, start_, getSize() * sizeof(T), cudaMemcpyDeviceToDevice) );
+		return copy;
+	}
+
+	/*!
+	 * @brief Resize Array on GPU. Keeps the allocation if the new size fits into it.
+	 * The content is undefined afterwards.
+	 * @param size new size of Array.
+	 */
+	void resize(size_t size)
+	{
+		if (size <= capacity_ && start_ != 0)
+		{
+			end_ = start_ + size;
+			return;
+		}
+		free();
+		allocate(size);
+	}
+
+	/*!
+	 * @brief Set the owner in the memory report. Moves the current allocation to it.
+	 * @param category owner.
+	 */
+	void setCategory(MemoryCategory category)
+	{
+		if (AllocatorTracking<Allocator>::TRACKED && start_ != 0)
+		{
+			trackFree(MemorySpace::DEVICE, category_, capacity_ * sizeof(T));
+			trackAllocation(MemorySpace::DEVICE, category, capacity_ * sizeof(T));
+		}
+		category_ = category;
+	}
+
+	/*!
+	 * @brief Get number of elements that fit into the allocation.
+	 * @return capacity of array.
+	 */
+	size_t getCapacity() const
+	{
+		return capacity_;
+	}
+
+	/*!
+	 * @brief Get Size of Array
+	 * @return size of array.
+	 */
+	size_t getSize() const
+	{
+		return end_ - start_;
+	}
+
+	/*!
+	 * @brief Get Data in array.
+	 * @return data.
+	 */
+	const T* getData() const
+	{
+		return start_;
+	}
+
+	/*!
+	 * @brief Get Data in array.
+	 * @return data.
+	 */
+	T* getData() 
+	{
+		return start_;
+	}
+
+	/*!
+	 * @brief Migrate the memory ahead of its use, if the allocator manages it (CudaMallocAllocator in the unified memory mode).
+	 * Afterwards the host can read getData() once the stream is synchronized, without a copy.
+	 * @param device target GPU, cudaCpuDeviceId: host.
+	 * @param stream the migration is ordered in this stream.
+	 */
+	void prefetch(int device, cudaStream_t stream)
+	{
+		allocator_.prefetch(start_, capacity_ * sizeof(T), device, stream);
+	}
+
+	/*!
+	 * @brief Copy the given data to the GPU Memory. Returns after the copy is done.
+	 * @param src source of data.
+	 * @param size size of the given data.
+	 * @param stream the copy waits for earlier work in this stream only.
+	 */
+	void set(const T* src, size_t size, cudaStream_t stream = 0)
+	{
+		size_t min = std::min(size, getSize());
+		cudaError_t result = cudaMemcpyAsync(start_, src, min * sizeof(T), cudaMemcpyHostToDevice, stream);
+		if (result == cudaSuccess)
+			result = cudaStreamSynchronize(stream);
+		if (result != cudaSuccess)
+		{
+			std::cerr << cudaGetErrorName(result) << ": " << cudaGetErrorString(result) << std::endl;
+			throw std::runtime_error("failed to copy to device memory");
+		}
+	}
+
+	/*!
+	 * @brief Copy the data from the GPU Memory to the given destination pointer on the CPU.
+	 * Returns after the copy is done.
+	 * @param dest Destination to copy the data.
+	 * @param size Size to copy.
+	 * @param stream the copy waits for earlier work in this stream only.
+	 */
+	void get(T* dest, size_t size, cudaStream_t stream = 0)
+	{
+		size_t min = std::min(size, getSize());
+		//std::cout << min << std::endl;
+		cudaError_t result = cudaMemcpyAsync(dest, start_, min * sizeof(T), cudaMemcpyDeviceToHost, stream);
+		if (result == cudaSuccess)
+			result = cudaStreamSynchronize(stream);
+		if (result != cudaSuccess)
+		{
+			std::cerr << cudaGetErrorName(result) << ": " << cudaGetErrorString(result) << std::endl;
+			throw std::runtime_error("failed to copy to host memory!");
+		}
+	}
+
+	/*!
+	 * @brief Start copying the given data to the GPU Memory and return immediately.
+	 * src must stay valid until the stream reached the copy. Only pinned memory (CudaHostArray) is copied asynchronously,
+	 * pageable memory is staged by the driver first.
+	 * @param src source of data.
+	 * @param size size of the given data.
+	 * @param stream stream of the copy.
+	 */
+	void setAsync(const T* src, size_t size, cudaStream_t stream)
+	{
+		size_t min = std::min(size, getSize());
+		CUDA_CHECK( cudaMemcpyAsync(start_, src, min * sizeof(T), cudaMemcpyHostToDevice, stream) );
+	}
+
+	/*!
+	 * @brief Start copying the data from the GPU Memory to the given destination pointer on the CPU and return immediately.
+	 * dest is valid after the stream was synchronized. dest should be pinned memory (CudaHostArray).
+	 * @param dest Destination to copy the data.
+	 * @param size Size to copy.
+	 * @param stream stream of the copy.
+	 */
+	void getAsync(T* dest, size_t size, cudaStream_t stream)
+	{
+		size_t min = std::min(size, getSize());
+		CUDA_CHECK( cudaMemcpyAsync(dest, start_, min * sizeof(T), cudaMemcpyDeviceToHost, stream) );
+	}
+
+private:
+
+	/*!
+	 * @brief Allocate memory on the GPU.
+	 * @param size How much memory shall be allocated.
+	 */
+	void allocate(size_t size)
+	{
+		start_ = static_cast<T*>(allocator_.allocate(size * sizeof(T)));
+		if (start_ == 0 && size > 0)
+		{
+			end_ = 0;
+			capacity_ = 0;
+			throw std::runtime_error("failed to allocate device memory");
+		}
+		end_ = start_ + size;
+		capacity_ = size;
+		if (AllocatorTracking<Allocator>::TRACKED && start_ != 0)
+			trackAllocation(MemorySpace::DEVICE, category_, capacity_ * sizeof(T));
+	}
+
+	/*!
+	 * @brief Free the allocated memory.
+	 */
+	void free()
+	{
+		if (start_ != 0)
+		{
+			allocator_.deallocate(start_);
+			if (AllocatorTracking<Allocator>::TRACKED)
+				trackFree(MemorySpace::DEVICE, category_, capacity_ * sizeof(T));
+			start_ = end_ = 0;
+			capacity_ = 0;
+		}
+	}
+
+	T* start_;	//!< start of the CudaDeviceMemory.
+	T* end_;	//!< end of the CudaDeviceMemory.
+	size_t capacity_;	//!< number of allocated elements (>= size).
+	Allocator allocator_;	//!< allocator of the memory.
+	MemoryCategory category_;	//!< owner in the memory report.
+};
\ No newline at end of file
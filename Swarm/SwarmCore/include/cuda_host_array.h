@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdexcept>
+#include <cuda_runtime.h>
+
+#include "macros.h"
+#include "memory_tracker.h"
+
+
+/*!
+ * @brief CudaHostArray Class holds page-locked (pinned) memory on the CPU.
+ *		  Copies between pinned memory and the GPU run with full bandwidth and can be asynchronous (see CudaDeviceArray::setAsync/getAsync).
+ * @tparam T data type
+ */
+template <class T>
+class CudaHostArray
+{
+public:
+
+	/*!
+	 * @brief Constructor to create a pinned Array with a given size on the CPU.
+	 * @param size Allocate the given value on CPU
+	 * @param flags cudaHostAlloc flags, e.g. cudaHostAllocWriteCombined for buffers only written by the CPU.
+	 * @param category owner in the memory report.
+	 */
+	explicit CudaHostArray(size_t size, unsigned int flags = cudaHostAllocDefault, MemoryCategory category = MemoryCategory::TRANSFER)
+		: category_(category)
+	{
+		allocate(size, flags);
+	}
+
+	/*!
+	 * @brief Destructor. Free the pinned memory.
+	 */
+	~CudaHostArray()
+	{
+		free();
+	}
+
+	CudaHostArray(const CudaHostArray&) = delete;
+	CudaHostArray& operator=(const CudaHostArray&) = delete;
+
+	/*!
+	 * @brief Get Size of Array
+	 * @return size of array.
+	 */
+	size_t getSize() const
+	{
+		return end_ - start_;
+	}
+
+	/*!
+	 * @brief Get Data in array.
+	 * @return data.
+	 */
+	const T* getData() const
+	{
+		return start_;
+	}
+
+	/*!
+	 * @brief Get Data in array.
+	 * @return data.
+	 */
+	T* getData()
+	{
+		return start_;
+	}
+
+	/*!
+	 * @brief Access element.
+	 * @param i index.
+	 * @return element.
+	 */
+	T& operator[](size_t i)
+	{
+		return start_[i];
+	}
+
+	/*!
+	 * @brief Access element.
+	 * @param i index.
+	 * @return element.
+	 */
+	const T& operator[](size_t i) const
+	{
+		return start_[i];
+	}
+
+private:
+
+	/*!
+	 * @brief Allocate pinned memory on the CPU.
+	 * @param size How much memory shall be allocated.
+	 * @param flags cudaHostAlloc flags.
+	 */
+	void allocate(size_t size, unsigned int flags)
+	{
+		cudaError_t result = cudaHostAlloc((void**)&start_, size * sizeof(T), flags);
+		if (result != cudaSuccess)
+		{
+			start_ = end_ = 0;
+			std::cerr << cudaGetErrorName(result) << ": " << cudaGetErrorString(result) << std::endl;
+			throw std::runtime_error("failed to allocate pinned host memory");
+		}
+		end_ = start_ + size;
+		trackAllocation(MemorySpace::HOST, category_, size * sizeof(T));
+	}
+
+	/*!
+	 * @brief Free the allocated memory.
+	 */
+	void free()
+	{
+		if (start_ != 0)
+		{
+			cudaFreeHost(start_);
+			trackFree(MemorySpace::HOST, category_, getSize() * sizeof(T));
+			start_ = end_ = 0;
+		}
+	}
+
+	T* start_;	//!< start of the pinned memory.
+	T* end_;	//!< end of the pinned memory.
+	MemoryCategory category_;	//!< owner in the memory report.
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cuda_runtime.h>
+
+#include "cuda_host_array.h"
+#include "macros.h"
+
+
+/*!
+ * @brief CudaMailbox Class passes small per-frame results (counts, aggregates) from kernels to the host without a copy.
+ *		  The slots are mapped pinned memory (cudaHostAllocMapped): a kernel writes the value of slot() over the bus,
+ *		  post() records an event behind it, poll() takes the newest value whose event completed. Nothing ever blocks the stream.
+ *		  Two slots alternate, so the kernel of the next post never writes the slot the host is reading.
+ *		  poll() and post() must be called by the same thread.
+ * @tparam T data type, trivially copyable.
+ */
+template <class T>
+class CudaMailbox
+{
+public:
+
+	/*!
+	 * @brief Constructor. Allocates the slots and events on the current device.
+	 * @param category owner in the memory report.
+	 */
+	explicit CudaMailbox(MemoryCategory category = MemoryCategory::TRANSFER)
+		: host_(SLOTS, cudaHostAllocMapped, category), value_()
+	{
+		for (unsigned int i = 0; i < SLOTS; i++)
+		{
+			host_[i] = T();
+			CUDA_CHECK( cudaHostGetDevicePointer(reinterpret_cast<void**>(&device_[i]), host_.getData() + i, 0) );
+			CUDA_CHECK( cudaEventCreateWithFlags(&posted_[i], cudaEventDisableTiming) );
+			pending_[i] = false;
+			sequence_[i] = 0;
+		}
+	}
+
+	/*!
+	 * @brief Destructor. Destroys the events, the caller has to be done with the stream.
+	 */
+	~CudaMailbox()
+	{
+		for (unsigned int i = 0; i < SLOTS; i++)
+			cudaEventDestroy(posted_[i]);
+	}
+
+	CudaMailbox(const CudaMailbox&) = delete;
+	CudaMailbox& operator=(const CudaMailbox&) = delete;
+
+	/*!
+	 * @brief Get the device pointer the next kernel writes its result to.
+	 * @return mapped device pointer.
+	 */
+	T* slot()
+	{
+		return device_[write_];
+	}
+
+	/*!
+	 * @brief Mark the value of slot() as sent: it arrives when the stream reaches this point. Switches to the other slot.
+	 * @param stream stream of the writing kernel.
+	 */
+	void post(cudaStream_t stream)
+	{
+		CUDA_CHECK( cudaEventRecord(posted_[write_], stream) );
+		pending_[write_] = true;
+		sequence_[write_] = ++posts_;
+		write_ = 1 - write_;
+	}
+
+	/*!
+	 * @brief Take the newest value that arrived. Doesn't wait.
+	 * @return true, if a new value arrived since the last poll.
+	 */
+	bool poll()
+	{
+		unsigned int newest = SLOTS;
+		for (unsigned int i = 0; i < SLOTS; i++)
+		{
+			if (!pending_[i] || cudaEventQuery(posted_[i]) != cudaSuccess)
+				continue;
+			pending_[i] = false;
+			if (newest == SLOTS || sequence_[i] > sequence_[newest])
+				newest = i;
+		}
+		if (newest == SLOTS || sequence_[newest] <= received_)
+			return false;
+
+		value_ = host_[newest];													// Copy out, a later post may reuse the slot
+		received_ = sequence_[newest];
+		return true;
+	}
+
+	/*!
+	 * @brief Get the value of the last successful poll.
+	 * @return value, T() before the first one.
+	 */
+	const T& value() const
+	{
+		return value_;
+	}
+
+private:
+
+	static const unsigned int SLOTS = 2;	//!< Slots in flight.
+
+	CudaHostArray<T> host_;					//!< Mapped pinned slots.
+	T* device_[SLOTS];						//!< Device pointers of the slots.
+	cudaEvent_t posted_[SLOTS];				//!< Recorded behind the writer of each slot.
+	bool pending_[SLOTS];					//!< Slot was posted and not polled yet.
+	unsigned long long sequence_[SLOTS];	//!< Number of the post of each slot.
+	unsigned long long posts_ = 0;			//!< Posts so far.
+	unsigned long long received_ = 0;		//!< Number of the post of value_.
+	unsigned int write_ = 0;				//!< Slot of the next post.
+	T value_;								//!< Value of the last successful poll.
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include <cuda_runtime.h>
+
+#include "macros.h"
+
+/*!
+ * @brief CudaTimer measures the GPU time between two points of a stream with a pair of CUDA events.
+ * Recording does not stall the stream, only elapsedMs waits for the stop event.
+ */
+class CudaTimer
+{
+private:
+
+	cudaEvent_t start_;		//!< Event recorded by start.
+	cudaEvent_t stop_;		//!< Event recorded by stop.
+
+public:
+
+	/*!
+	 * @brief Constructor. Creates the events.
+	 */
+	CudaTimer()
+	{
+		CUDA_CHECK( cudaEventCreate( &start_ ) );
+		CUDA_CHECK( cudaEventCreate( &stop_ ) );
+	}
+
+	/*!
+	 * @brief Destructor. Destroys the events.
+	 */
+	~CudaTimer()
+	{
+		CUDA_CHECK( cudaEventDestroy( start_ ) );
+		CUDA_CHECK( cudaEventDestroy( stop_ ) );
+	}
+
+	CudaTimer( const CudaTimer& ) = delete;
+	CudaTimer& operator=( const CudaTimer& ) = delete;
+
+	/*!
+	 * @brief Record the start in a stream.
+	 * @param stream timed stream.
+	 */
+	void start( cudaStream_t stream = 0 )
+	{
+		CUDA_CHECK( cudaEventRecord( start_, stream ) );
+	}
+
+	/*!
+	 * @brief Record the stop in a stream.
+	 * @param stream timed stream, the same as for start.
+	 */
+	void stop( cudaStream_t stream = 0 )
+	{
+		CUDA_CHECK( cudaEventRecord( stop_, stream ) );
+	}
+
+	/*!
+	 * @brief Wait for the stop and get the time between start and stop.
+	 * @return time in ms.
+	 */
+	float elapsedMs()
+	{
+		float ms = 0;
+		CUDA_CHECK( cudaEventSynchronize( stop_ ) );
+		CUDA_CHECK( cudaEventElapsedTime( &ms, start_, stop_ ) );
+		return ms;
+	}
+};
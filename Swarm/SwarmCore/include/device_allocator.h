@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <cuda_runtime.h>
+
+#include "macros.h"
+
+/*!
+ * @brief Access pattern of a buffer in the unified memory mode, decides the cudaMemAdvise hints.
+ */
+enum class ManagedRole
+{
+	NONE,				//!< Plain device memory, also in the unified memory mode.
+	DEVICE_PREFERRED,	//!< Lives on the GPU, the host reads it now and then (particle stores).
+	READ_MOSTLY,		//!< Written once by the host, read by the GPU (parameter tables). Each side keeps a read copy.
+	HOST_PREFERRED		//!< Small results the host reads every step (stats). Stays in host memory, the GPU writes through.
+};
+
+/*!
+ * @brief Standard allocator of CudaDeviceArray. Every allocation is a cudaMalloc, every free a cudaFree.
+ * In the unified memory mode (setUnifiedMemory) buffers with a role are allocated with cudaMallocManaged,
+ * advised for their role and prefetched to the GPU, so host code can read them through the pointer without a copy
+ * and the swarm may oversubscribe the GPU memory. Hints and prefetches need concurrent managed access
+ * (Linux, Pascal or newer), without it the memory is managed but migrates on every access.
+ */
+struct CudaMallocAllocator
+{
+	ManagedRole role = ManagedRole::NONE;	//!< Access pattern. NONE: cudaMalloc in every mode.
+
+	/*!
+	 * @brief Get an allocator for a buffer with an access pattern.
+	 * @param role access pattern, used in the unified memory mode.
+	 * @return allocator.
+	 */
+	static CudaMallocAllocator managed( ManagedRole role );
+
+	/*!
+	 * @brief Switch the unified memory mode on or off. Affects the allocations from now on, call it before the simulation is built.
+	 * @param unified true: cudaMallocManaged for buffers with a role.
+	 */
+	static void setUnifiedMemory( bool unified );
+
+	/*!
+	 * @brief Check the unified memory mode.
+	 * @return true, if buffers with a role are managed.
+	 */
+	static bool unifiedMemory();
+
+	/*!
+	 * @brief Allocate device memory.
+	 * @param bytes number of bytes.
+	 * @return device pointer, NULL on failure. Managed pointers are valid on the host too.
+	 */
+	void* allocate( size_t bytes );
+
+	/*!
+	 * @brief Free device memory.
+	 * @param ptr device pointer returned by allocate.
+	 */
+	void deallocate( void* ptr );
+
+	/*!
+	 * @brief Migrate managed memory ahead of its use. Does nothing for device memory.
+	 * @param ptr pointer returned by allocate.
+	 * @param bytes number of bytes.
+	 * @param device target GPU, cudaCpuDeviceId: host.
+	 * @param stream the migration is ordered in this stream.
+	 */
+	void prefetch( void* ptr, size_t bytes, int device, cudaStream_t stream ) const;
+};
+
+/*!
+ * @brief Stream ordered allocator built on the memory pool of cudaMallocAsync.
+ * Freed memory stays in the pool and is handed out again without a device synchronisation.
+ */
+struct StreamOrderedAllocator
+{
+	cudaStream_t stream = 0;			//!< Allocation and free are ordered in this stream.
+
+	/*!
+	 * @brief Allocate device memory from the pool of the current device.
+	 * @param bytes number of bytes.
+	 * @return device pointer, NULL on failure.
+	 */
+	void* allocate( size_t bytes );
+
+	/*!
+	 * @brief Give device memory back to the pool.
+	 * @param ptr device pointer returned by allocate.
+	 */
+	void deallocate( void* ptr );
+
+	/*!
+	 * @brief Keep freed memory in the pool of the current device instead of releasing it at every synchronisation.
+	 */
+	static void keepPoolMemory();
+};
+
+/*!
+ * @brief DeviceArena is a bump allocator for scratch memory which is only needed during one step.
+ * reset() frees everything at once. Allocations which don't fit anymore get their own cudaMalloc,
+ * on the next reset the arena grows, so after the first steps no cudaMalloc is needed at all.
+ * All users must run in the same stream, because memory is reused right after reset().
+ */
+class DeviceArena
+{
+private:
+	static const size_t ALIGNMENT = 256;	//!< Alignment of every allocation (same as cudaMalloc).
+
+	char* base_ = NULL;						//!< Arena memory.
+	size_t capacity_ = 0;					//!< Size of arena memory.
+	size_t offset_ = 0;						//!< Next free byte in arena memory.
+	size_t requested_ = 0;					//!< Bytes requested since the last reset (including the overflow).
+	std::vector<void*> overflow_;			//!< Allocations that didn't fit into the arena.
+	size_t overflowBytes_ = 0;				//!< Size of the overflow allocations.
+
+public:
+
+	/*!
+	 * @brief Constructor.
+	 * @param capacity initial size in bytes.
+	 */
+	explicit DeviceArena( size_t capacity = 0 );
+
+	/*!
+	 * @brief Destructor. Frees all memory.
+	 */
+	~DeviceArena();
+
+	DeviceArena( const DeviceArena& ) = delete;
+	DeviceArena& operator=( const DeviceArena& ) = delete;
+
+	/*!
+	 * @brief Allocate scratch memory. Valid until the next reset.
+	 * @param bytes number of bytes.
+	 * @return device pointer, NULL on failure.
+	 */
+	void* allocate( size_t bytes );
+
+	/*!
+	 * @brief Free all allocations. Grows the arena, if the last step needed more memory.
+	 */
+	void reset();
+
+	/*!
+	 * @brief Get size of the arena.
+	 * @return size in bytes.
+	 */
+	inline size_t getCapacity() const { return capacity_; }
+};
+
+/*!
+ * @brief Tells CudaDeviceArray whether the allocations of an allocator are counted by the memory tracker.
+ * @tparam Allocator allocator of the array.
+ */
+template <class Allocator>
+struct AllocatorTracking
+{
+	static const bool TRACKED = true;	//!< Own device memory, counted per array.
+};
+
+/*!
+ * @brief Allocator for CudaDeviceArray and thrust, which takes its memory from a DeviceArena.
+ * Free does nothing, memory comes back with DeviceArena::reset.
+ */
+struct ArenaAllocator
+{
+	typedef char value_type;			//!< needed by thrust.
+
+	DeviceArena* arena = NULL;			//!< Arena memory is taken from.
+
+	/*!
+	 * @brief Allocate memory in the arena.
+	 * @param bytes number of bytes.
+	 * @return device pointer, NULL on failure.
+	 */
+	void* allocate( size_t bytes ) { return arena->allocate( bytes ); }
+
+	/*!
+	 * @brief Does nothing.
+	 * @param ptr device pointer.
+	 */
+	void deallocate( void* ptr ) {}
+
+	/*!
+	 * @brief Allocate memory for thrust temporary storage.
+	 * @param bytes number of bytes.
+	 * @return device pointer.
+	 */
+	char* allocate( std::ptrdiff_t bytes ) { return static_cast< char* >( arena->allocate( static_cast< size_t >( bytes ) ) ); }
+
+	/*!
+	 * @brief Does nothing (thrust interface).
+	 * @param ptr device pointer.
+	 * @param bytes number of bytes.
+	 */
+	void deallocate( char* ptr, size_t bytes ) {}
+};
+
+/*!
+ * @brief Arena memory is counted once by the DeviceArena, not per array.
+ */
+template <>
+struct AllocatorTracking<ArenaAllocator>
+{
+	static const bool TRACKED = false;	//!< Counted as MemoryCategory::SCRATCH by the arena.
+};
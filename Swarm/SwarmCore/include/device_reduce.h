@@ -0,0 +1,141 @@
+#pragma once
+#include <cuda_runtime.h>
+
+#include "launch_check.h"
+
+/*
+ * Reductions for kernels (nvcc only): warp shuffles, a block reduce over the warp results and a two pass device reduce
+ * with many elements per thread. It is the multi element variant of the reduction sweep of GPU_Uebung (benchmark_reduce),
+ * which keeps up with cub::DeviceReduce there without its temporary storage query and without atomics, so it works for any type.
+ * The operations are functors with an identity, e.g. for centroids (ReduceSum), bounding boxes (ReduceMin, ReduceMax).
+ */
+
+#ifdef __CUDACC__
+
+static const unsigned int REDUCE_THREADS = 256;		//!< Threads per block of deviceReduce.
+static const unsigned int REDUCE_MAX_BLOCKS = 1024;	//!< Blocks of the first pass of deviceReduce, partials it needs.
+
+/*!
+ * @brief Largest and lowest value of a type, the identities of ReduceMin and ReduceMax.
+ * @tparam T float, double, int or unsigned int.
+ */
+template <class T> struct ReduceLimits;
+template <> struct ReduceLimits<float> { __host__ __device__ static float max() { return 3.402823466e+38f; } __host__ __device__ static float lowest() { return -3.402823466e+38f; } };
+template <> struct ReduceLimits<double> { __host__ __device__ static double max() { return 1.7976931348623157e+308; } __host__ __device__ static double lowest() { return -1.7976931348623157e+308; } };
+template <> struct ReduceLimits<int> { __host__ __device__ static int max() { return 0x7fffffff; } __host__ __device__ static int lowest() { return -0x7fffffff - 1; } };
+template <> struct ReduceLimits<unsigned int> { __host__ __device__ static unsigned int max() { return 0xffffffffu; } __host__ __device__ static unsigned int lowest() { return 0u; } };
+
+/*!
+ * @brief Sum.
+ */
+struct ReduceSum
+{
+	template <class T> __host__ __device__ T operator()( T a, T b ) const { return a + b; }
+	template <class T> __host__ __device__ static T identity() { return T( 0 ); }
+};
+
+/*!
+ * @brief Minimum.
+ */
+struct ReduceMin
+{
+	template <class T> __host__ __device__ T operator()( T a, T b ) const { return b < a ? b : a; }
+	template <class T> __host__ __device__ static T identity() { return ReduceLimits<T>::max(); }
+};
+
+/*!
+ * @brief Maximum.
+ */
+struct ReduceMax
+{
+	template <class T> __host__ __device__ T operator()( T a, T b ) const { return a < b ? b : a; }
+	template <class T> __host__ __device__ static T identity() { return ReduceLimits<T>::lowest(); }
+};
+
+/*!
+ * @brief Reduce the values of a full warp with shuffles.
+ * @param value value of the lane.
+ * @param op operation.
+ * @return result in lane 0, partial results in the other lanes.
+ */
+template <class T, class Op>
+__device__ inline T warpReduce( T value, Op op )
+{
+	for (int offset = warpSize / 2; offset > 0; offset /= 2)
+		value = op( value, __shfl_down_sync( 0xffffffff, value, offset ) );
+	return value;
+}
+
+/*!
+ * @brief Reduce the values of a block: every warp with shuffles, then the first warp over the warp results.
+ * All threads of the block must call it. Contains __syncthreads.
+ * @tparam BLOCK threads of the block, a multiple of 32 up to 1024.
+ * @param value value of the thread.
+ * @param op operation.
+ * @return result in thread 0.
+ */
+template <unsigned int BLOCK, class T, class Op>
+__device__ inline T blockReduce( T value, Op op )
+{
+	__shared__ T warps[BLOCK / 32];
+	unsigned int const lane = threadIdx.x % 32, warp = threadIdx.x / 32;
+
+	value = warpReduce( value, op );
+	if (lane == 0)
+		warps[warp] = value;
+	__syncthreads();
+	if (warp == 0)
+		value = warpReduce( lane < BLOCK / 32 ? warps[lane] : Op::template identity<T>(), op );
+	return value;
+}
+
+/*!
+ * @brief One pass of deviceReduce: every thread reduces a grid stride of the data in registers, then the block.
+ * @param data values.
+ * @param count number of values.
+ * @param out Output: result of the block at blockIdx.x.
+ * @param op operation.
+ */
+template <class T, class Op>
+__global__ void deviceReduceKernel( const T* __restrict__ data, size_t count, T* out, Op op )
+{
+	T value = Op::template identity<T>();
+	for (size_t i = blockIdx.x * (size_t)REDUCE_THREADS + threadIdx.x; i < count; i += (size_t)REDUCE_THREADS * gridDim.x)
+		value = op( value, data[i] );
+	value = blockReduce<REDUCE_THREADS>( value, op );
+	if (threadIdx.x == 0)
+		out[blockIdx.x] = value;
+}
+
+/*!
+ * @brief Get the blocks of the first pass of deviceReduce, as many partials as it writes.
+ * @param count number of values.
+ * @return blocks, at least 1 and at most REDUCE_MAX_BLOCKS.
+ */
+inline unsigned int deviceReduceBlocks( size_t count )
+{
+	size_t const blocks = ( count + REDUCE_THREADS * 8 - 1 ) / ( REDUCE_THREADS * 8 );	// At least 8 values per thread
+	return blocks == 0 ? 1u : blocks > REDUCE_MAX_BLOCKS ? REDUCE_MAX_BLOCKS : static_cast< unsigned int >( blocks );
+}
+
+/*!
+ * @brief Reduce an array on the device in two launches: the blocks into partials, then one block over the partials.
+ * Asynchronous, nothing is read back. The order of the operations is fixed for a count, so sums are reproducible.
+ * @param data values.
+ * @param count number of values. 0: the identity.
+ * @param partials scratch for deviceReduceBlocks( count ) values.
+ * @param result Output: one value on the device.
+ * @param op operation.
+ * @param stream stream of the launches.
+ */
+template <class T, class Op>
+void deviceReduce( const T* data, size_t count, T* partials, T* result, Op op, cudaStream_t stream = 0 )
+{
+	unsigned int const blocks = deviceReduceBlocks( count );
+	deviceReduceKernel<T, Op><<<blocks, REDUCE_THREADS, 0, stream>>>( data, count, partials, op );
+	CUDA_CHECK_LAUNCH( "deviceReduceKernel", stream );
+	deviceReduceKernel<T, Op><<<1, REDUCE_THREADS, 0, stream>>>( partials, blocks, result, op );
+	CUDA_CHECK_LAUNCH( "deviceReduceKernel", stream );
+}
+
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+#include <cuda_runtime.h>
+
+/*
+ * Checked kernel launches. CUDA_CHECK only looks at API calls, a failing kernel is silent without these.
+ * CUDA_CHECK_LAUNCH after every <<<...>>> reports invalid launches (configuration, resources) at once, without waiting.
+ * Debug builds (or SWARM_SYNC_LAUNCH_CHECK) also wait for the kernel, so errors while it runs (illegal address, ...)
+ * name the failing kernel. Streams which are captured into a graph are never synchronized.
+ * CUDA_CHECK_FRAME once per frame catches the errors of the finished work with cudaStreamQuery, also without waiting.
+ */
+#if defined( _DEBUG ) && !defined( SWARM_SYNC_LAUNCH_CHECK )
+#define SWARM_SYNC_LAUNCH_CHECK
+#endif
+
+/*!
+ * @brief Check the last launch. Use CUDA_CHECK_LAUNCH.
+ * @param kernel name of the kernel.
+ * @param stream stream of the launch. Synchronized with SWARM_SYNC_LAUNCH_CHECK, unless it is captured.
+ * @param file source file of the launch.
+ * @param line source line of the launch.
+ */
+void checkLaunch( const char* kernel, cudaStream_t stream, const char* file, int line );
+
+/*!
+ * @brief Check the finished work of a stream without waiting. Use CUDA_CHECK_FRAME.
+ * @param stream stream of the frame. Work which still runs is checked by the next call.
+ * @param file source file of the check.
+ * @param line source line of the check.
+ */
+void checkFrame( cudaStream_t stream, const char* file, int line );
+
+/*!
+ * @brief Get the number of errors found by checkLaunch and checkFrame.
+ * @return number of errors. Anything measured after the first error is invalid.
+ */
+unsigned int launchErrorCount();
+
+#define CUDA_CHECK_LAUNCH( kernel, stream ) checkLaunch( kernel, stream, __FILE__, __LINE__ )
+#define CUDA_CHECK_FRAME( stream ) checkFrame( stream, __FILE__, __LINE__ )
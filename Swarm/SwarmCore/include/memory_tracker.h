@@ -0,0 +1,99 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+#if defined( _DEBUG ) && !defined( SWARM_COUNT_ALLOCATIONS )
+#define SWARM_COUNT_ALLOCATIONS 1		// Debug builds replace the global operator new, see countedAllocations
+#endif
+
+/*
+ * Memory accounting. CudaDeviceArray, CudaHostArray, DeviceArena and the vertex buffers register their sizes here,
+ * so a run can tell how much of the device and pinned host memory each part of the simulation holds.
+ * The counters are global and atomic: several GPUs (MultiGpuSimulation) add up, pageable std::vectors are not counted.
+ */
+
+/*!
+ * @brief Owner of an allocation.
+ */
+enum class MemoryCategory
+{
+	PARTICLES,		//!< Particle stores and sharks.
+	NEIGHBOURS,		//!< Grid, sorted copies and Verlet lists.
+	RENDER,			//!< Vertex buffers, colors and culling.
+	SCRATCH,		//!< Arena, free lists, reductions and other per step buffers.
+	TRANSFER,		//!< Pinned uploads and read backs.
+	OTHER,			//!< Not assigned.
+	COUNT			//!< Number of categories.
+};
+
+/*!
+ * @brief Where an allocation lives.
+ */
+enum class MemorySpace
+{
+	DEVICE,			//!< GPU memory (CUDA and OpenGL).
+	HOST,			//!< Pinned CPU memory.
+	COUNT			//!< Number of spaces.
+};
+
+/*!
+ * @brief Kind of an allocation call. The calls are counted per thread, so the frame loop only sees its own.
+ */
+enum class AllocationKind
+{
+	HEAP,			//!< Global operator new. Only counted with SWARM_COUNT_ALLOCATIONS (debug builds).
+	DEVICE,			//!< Tracked device allocations: cudaMalloc of the arrays and the arena, storage of OpenGL buffers.
+	PINNED,			//!< Tracked pinned host allocations.
+	COUNT			//!< Number of kinds.
+};
+
+/*!
+ * @brief Add an allocation to the live bytes and update the peaks. Also counts the call (AllocationKind::DEVICE or PINNED).
+ * @param space device or host.
+ * @param category owner.
+ * @param bytes size of the allocation.
+ */
+void trackAllocation( MemorySpace space, MemoryCategory category, size_t bytes );
+
+/*!
+ * @brief Remove an allocation from the live bytes.
+ * @param space device or host.
+ * @param category owner, same as for trackAllocation.
+ * @param bytes size of the allocation, same as for trackAllocation.
+ */
+void trackFree( MemorySpace space, MemoryCategory category, size_t bytes );
+
+/*!
+ * @brief Get the bytes allocated now.
+ * @param space device or host.
+ * @param category owner. COUNT: all categories.
+ * @return live bytes.
+ */
+size_t trackedLiveBytes( MemorySpace space, MemoryCategory category = MemoryCategory::COUNT );
+
+/*!
+ * @brief Get the most bytes allocated at any time.
+ * @param space device or host.
+ * @param category owner. COUNT: all categories (peak of the sum, not sum of the peaks).
+ * @return peak bytes.
+ */
+size_t trackedPeakBytes( MemorySpace space, MemoryCategory category = MemoryCategory::COUNT );
+
+/*!
+ * @brief Get the allocation calls of the calling thread since it started.
+ * @param kind kind. COUNT: all kinds.
+ * @return number of calls.
+ */
+unsigned long long countedAllocations( AllocationKind kind = AllocationKind::COUNT );
+
+/*!
+ * @brief Check if the build counts operator new (SWARM_COUNT_ALLOCATIONS).
+ * @return true in debug builds.
+ */
+bool countsHeapAllocations();
+
+/*!
+ * @brief Budget report: live and peak bytes per category and space, and the free memory of the current device.
+ * @return report with one line per category.
+ */
+std::string memoryReport();
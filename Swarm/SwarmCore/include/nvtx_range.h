@@ -0,0 +1,101 @@
+#pragma once
+
+/*
+ * Build option: define SWARM_NVTX to annotate the CPU timeline for Nsight Systems with NVTX ranges.
+ * Uses the header only NVTX 3 of the CUDA toolkit, no library has to be linked.
+ * Without SWARM_NVTX the ranges compile to nothing.
+ */
+
+/*!
+ * @brief NVTX domains. Every domain is a separate row in Nsight Systems.
+ */
+enum class NvtxDomain
+{
+	RENDERER,		//!< Frame loop of the Renderer and HeadlessSimulation.
+	DEVICE,			//!< CudaDevice calls, e.g. map and unmap of the VBOs.
+	KERNEL,			//!< Host wrappers of the kernels (kernel.h).
+	COUNT			//!< Number of domains.
+};
+
+// Colors of the ranges (ARGB).
+static const unsigned int NVTX_COLOR_FRAME = 0xFF2E86DE;		// Frame and scene setup.
+static const unsigned int NVTX_COLOR_SIMULATION = 0xFF27AE60;	// Simulation steps.
+static const unsigned int NVTX_COLOR_INTEROP = 0xFFE67E22;		// OpenGL interop.
+static const unsigned int NVTX_COLOR_SYNC = 0xFFC0392B;			// Calls which wait for the GPU.
+static const unsigned int NVTX_COLOR_SETUP = 0xFF8E44AD;		// Allocation, parameters, cleanup.
+
+#ifdef SWARM_NVTX
+
+#include <nvtx3/nvToolsExt.h>
+
+/*!
+ * @brief Get the handle of a domain. Created at the first use.
+ * @param domain domain.
+ * @return handle.
+ */
+inline nvtxDomainHandle_t nvtxDomain( NvtxDomain domain )
+{
+	static const char* const NAMES[] = { "Swarm Renderer", "Swarm CudaDevice", "Swarm Kernels" };
+	static nvtxDomainHandle_t handles[static_cast< int >( NvtxDomain::COUNT )] = {};
+
+	int d = static_cast< int >( domain );
+	if ( handles[d] == NULL )
+		handles[d] = nvtxDomainCreateA( NAMES[d] );
+	return handles[d];
+}
+
+/*!
+ * @brief RAII NVTX range: pushed at construction, popped at destruction.
+ */
+class NvtxRange
+{
+private:
+
+	nvtxDomainHandle_t domain_;				//!< Domain of the range.
+
+public:
+
+	/*!
+	 * @brief Push a range.
+	 * @param domain domain of the range.
+	 * @param name name of the range. Must be a string literal or live longer than the range.
+	 * @param color color of the range (ARGB).
+	 */
+	NvtxRange( NvtxDomain domain, const char* name, unsigned int color ) :
+		domain_( nvtxDomain( domain ) )
+	{
+		nvtxEventAttributes_t attributes = {};
+		attributes.version = NVTX_VERSION;
+		attributes.size = NVTX_EVENT_ATTRIB_STRUCT_SIZE;
+		attributes.colorType = NVTX_COLOR_ARGB;
+		attributes.color = color;
+		attributes.messageType = NVTX_MESSAGE_TYPE_ASCII;
+		attributes.message.ascii = name;
+		nvtxDomainRangePushEx( domain_, &attributes );
+	}
+
+	/*!
+	 * @brief Pop the range.
+	 */
+	~NvtxRange()
+	{
+		nvtxDomainRangePop( domain_ );
+	}
+
+	NvtxRange( const NvtxRange& ) = delete;
+	NvtxRange& operator=( const NvtxRange& ) = delete;
+};
+
+#define NVTX_CONCAT_( a, b ) a##b
+#define NVTX_CONCAT( a, b ) NVTX_CONCAT_( a, b )
+
+/*!
+ * @brief Annotate the rest of the scope with a range.
+ */
+#define NVTX_RANGE( domain, name, color ) NvtxRange NVTX_CONCAT( nvtxRange_, __LINE__ )( domain, name, color )
+
+#else
+
+#define NVTX_RANGE( domain, name, color )
+
+#endif
@@ -0,0 +1,178 @@
+#include "device_allocator.h"
+#include "memory_tracker.h"
+
+/*!
+ * @brief Round up to the alignment.
+ * @param bytes number of bytes.
+ * @param alignment alignment (power of 2).
+ * @return aligned number of bytes.
+ */
+static size_t alignUp( size_t bytes, size_t alignment )
+{
+	return ( bytes + alignment - 1 ) & ~( alignment - 1 );
+}
+
+static bool UNIFIED_MEMORY = false;												// setUnifiedMemory
+
+/*!
+ * @brief Check if the current GPU takes the hints and prefetches of managed memory.
+ * @param device Output: current device.
+ * @return true with concurrent managed access.
+ */
+static bool managedHints( int* device )
+{
+	int concurrent = 0;
+	CUDA_CHECK( cudaGetDevice( device ) );
+	CUDA_CHECK( cudaDeviceGetAttribute( &concurrent, cudaDevAttrConcurrentManagedAccess, *device ) );
+	return concurrent != 0;
+}
+
+CudaMallocAllocator CudaMallocAllocator::managed( ManagedRole role )
+{
+	CudaMallocAllocator allocator;
+	allocator.role = role;
+	return allocator;
+}
+
+void CudaMallocAllocator::setUnifiedMemory( bool unified )
+{
+	UNIFIED_MEMORY = unified;
+}
+
+bool CudaMallocAllocator::unifiedMemory()
+{
+	return UNIFIED_MEMORY;
+}
+
+void* CudaMallocAllocator::allocate( size_t bytes )
+{
+	void* ptr = NULL;
+	if ( !UNIFIED_MEMORY || role == ManagedRole::NONE )
+	{
+		CUDA_CHECK( cudaMalloc( &ptr, bytes ) );
+		return ptr;
+	}
+
+	CUDA_CHECK( cudaMallocManaged( &ptr, bytes, cudaMemAttachGlobal ) );
+	int device = 0;
+	if ( ptr == NULL || bytes == 0 || !managedHints( &device ) )
+		return ptr;
+
+	switch ( role )
+	{
+	case ManagedRole::DEVICE_PREFERRED:
+		CUDA_CHECK( cudaMemAdvise( ptr, bytes, cudaMemAdviseSetPreferredLocation, device ) );
+		CUDA_CHECK( cudaMemAdvise( ptr, bytes, cudaMemAdviseSetAccessedBy, cudaCpuDeviceId ) );	// Host reads map the pages instead of moving them
+		CUDA_CHECK( cudaMemPrefetchAsync( ptr, bytes, device, 0 ) );			// The first step doesn't fault the pages in
+		break;
+	case ManagedRole::READ_MOSTLY:
+		CUDA_CHECK( cudaMemAdvise( ptr, bytes, cudaMemAdviseSetReadMostly, device ) );
+		CUDA_CHECK( cudaMemPrefetchAsync( ptr, bytes, device, 0 ) );
+		break;
+	case ManagedRole::HOST_PREFERRED:
+		CUDA_CHECK( cudaMemAdvise( ptr, bytes, cudaMemAdviseSetPreferredLocation, cudaCpuDeviceId ) );
+		CUDA_CHECK( cudaMemAdvise( ptr, bytes, cudaMemAdviseSetAccessedBy, device ) );	// The GPU writes through the bus
+		break;
+	default:
+		break;
+	}
+	return ptr;
+}
+
+void CudaMallocAllocator::deallocate( void* ptr )
+{
+	CUDA_CHECK( cudaFree( ptr ) );												// Device and managed memory
+}
+
+void CudaMallocAllocator::prefetch( void* ptr, size_t bytes, int device, cudaStream_t stream ) const
+{
+	int current = 0;
+	if ( !UNIFIED_MEMORY || role == ManagedRole::NONE || ptr == NULL || bytes == 0 || !managedHints( &current ) )
+		return;
+	CUDA_CHECK( cudaMemPrefetchAsync( ptr, bytes, device, stream ) );
+}
+
+void* StreamOrderedAllocator::allocate( size_t bytes )
+{
+	void* ptr = NULL;
+	CUDA_CHECK( cudaMallocAsync( &ptr, bytes, stream ) );
+	return ptr;
+}
+
+void StreamOrderedAllocator::deallocate( void* ptr )
+{
+	CUDA_CHECK( cudaFreeAsync( ptr, stream ) );
+}
+
+void StreamOrderedAllocator::keepPoolMemory()
+{
+	int device;
+	cudaMemPool_t pool;
+	CUDA_CHECK( cudaGetDevice( &device ) );
+	CUDA_CHECK( cudaDeviceGetDefaultMemPool( &pool, device ) );
+
+	uint64_t threshold = UINT64_MAX;
+	CUDA_CHECK( cudaMemPoolSetAttribute( pool, cudaMemPoolAttrReleaseThreshold, &threshold ) );
+}
+
+DeviceArena::DeviceArena( size_t capacity )
+{
+	if ( capacity > 0 )
+	{
+		capacity_ = alignUp( capacity, ALIGNMENT );
+		CUDA_CHECK( cudaMalloc( ( void** ) &base_, capacity_ ) );
+		trackAllocation( MemorySpace::DEVICE, MemoryCategory::SCRATCH, capacity_ );
+	}
+}
+
+DeviceArena::~DeviceArena()
+{
+	for ( void* ptr : overflow_ )
+		CUDA_CHECK( cudaFree( ptr ) );
+	if ( base_ != NULL )
+		CUDA_CHECK( cudaFree( base_ ) );
+	trackFree( MemorySpace::DEVICE, MemoryCategory::SCRATCH, capacity_ + overflowBytes_ );
+}
+
+void* DeviceArena::allocate( size_t bytes )
+{
+	bytes = alignUp( bytes, ALIGNMENT );
+	requested_ += bytes;
+
+	if ( base_ != NULL && offset_ + bytes <= capacity_ )
+	{
+		void* ptr = base_ + offset_;
+		offset_ += bytes;
+		return ptr;
+	}
+
+	// Doesn't fit anymore. Use own allocation until the next reset.
+	void* ptr = NULL;
+	CUDA_CHECK( cudaMalloc( &ptr, bytes ) );
+	overflow_.push_back( ptr );
+	overflowBytes_ += bytes;
+	trackAllocation( MemorySpace::DEVICE, MemoryCategory::SCRATCH, bytes );
+	return ptr;
+}
+
+void DeviceArena::reset()
+{
+	if ( !overflow_.empty() )
+	{
+		// Grow, so everything of the last step fits into the arena next time.
+		for ( void* ptr : overflow_ )
+			CUDA_CHECK( cudaFree( ptr ) );
+		overflow_.clear();
+
+		if ( base_ != NULL )
+			CUDA_CHECK( cudaFree( base_ ) );
+		trackFree( MemorySpace::DEVICE, MemoryCategory::SCRATCH, capacity_ + overflowBytes_ );
+		overflowBytes_ = 0;
+		capacity_ = requested_;
+		CUDA_CHECK( cudaMalloc( ( void** ) &base_, capacity_ ) );
+		trackAllocation( MemorySpace::DEVICE, MemoryCategory::SCRATCH, capacity_ );
+	}
+
+	offset_ = 0;
+	requested_ = 0;
+}
@@ -0,0 +1,63 @@
+#include <atomic>
+#include <iostream>
+
+#include "launch_check.h"
+
+static std::atomic<unsigned int> errorCount( 0 );								// Errors since the start
+static std::atomic<int> lastError( cudaSuccess );								// Sticky errors come back on every call, report them once
+
+/*!
+ * @brief Count an error and print it, if it is not the one printed last.
+ * @param error CUDA error.
+ * @param where kernel name or "frame".
+ * @param file source file.
+ * @param line source line.
+ */
+static void report( cudaError_t error, const char* where, const char* file, int line )
+{
+	errorCount++;
+	if ( lastError.exchange( error ) == error )
+		return;
+
+	std::cerr << cudaGetErrorName( error ) << ": " << cudaGetErrorString( error ) << " (" << where << ", " << file << ":" << line << ")" << std::endl;
+}
+
+/*!
+ * @brief Check if a stream records a graph. Synchronizing or querying it would break the capture.
+ * @param stream stream.
+ * @return true, if the stream is captured.
+ */
+static bool isCapturing( cudaStream_t stream )
+{
+	cudaStreamCaptureStatus capture = cudaStreamCaptureStatusNone;
+	cudaStreamIsCapturing( stream, &capture );
+	return capture != cudaStreamCaptureStatusNone;
+}
+
+void checkLaunch( const char* kernel, cudaStream_t stream, const char* file, int line )
+{
+	cudaError_t error = cudaGetLastError();										// Launch errors, the kernel didn't start
+#ifdef SWARM_SYNC_LAUNCH_CHECK
+	if ( error == cudaSuccess && !isCapturing( stream ) )
+		error = cudaStreamSynchronize( stream );								// Errors while the kernel ran
+#endif
+	if ( error != cudaSuccess )
+		report( error, kernel, file, line );
+}
+
+void checkFrame( cudaStream_t stream, const char* file, int line )
+{
+	if ( isCapturing( stream ) )
+		return;
+
+	cudaError_t error = cudaStreamQuery( stream );								// Errors of the finished work, running work is checked next frame
+	if ( error == cudaSuccess || error == cudaErrorNotReady )
+		error = cudaGetLastError();												// Launches without CUDA_CHECK_LAUNCH
+	if ( error != cudaSuccess )
+		report( error, "frame", file, line );
+}
+
+unsigned int launchErrorCount()
+{
+	return errorCount;
+}
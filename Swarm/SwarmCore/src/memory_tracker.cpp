@@ -0,0 +1,156 @@
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <sstream>
+
+#include <cuda_runtime.h>
+
+#include "memory_tracker.h"
+
+static const unsigned int SPACES = static_cast< unsigned int >( MemorySpace::COUNT );
+static const unsigned int CATEGORIES = static_cast< unsigned int >( MemoryCategory::COUNT );
+
+static std::atomic<size_t> liveBytes[SPACES][CATEGORIES + 1];					// Last column: all categories
+static std::atomic<size_t> peakBytes[SPACES][CATEGORIES + 1];
+
+static const char* CATEGORY_NAMES[CATEGORIES] = { "particles", "neighbours", "render", "scratch", "transfer", "other" };
+
+static const unsigned int KINDS = static_cast< unsigned int >( AllocationKind::COUNT );
+static thread_local unsigned long long allocationCalls[KINDS];					// Plain zeros, valid before any constructor of the thread ran
+
+#ifdef SWARM_COUNT_ALLOCATIONS
+void* operator new( std::size_t bytes )
+{
+	allocationCalls[static_cast< unsigned int >( AllocationKind::HEAP )]++;
+	while ( true )
+	{
+		if ( void* memory = std::malloc( bytes > 0 ? bytes : 1 ) )
+			return memory;
+		std::new_handler handler = std::get_new_handler();
+		if ( handler == NULL )
+			throw std::bad_alloc();
+		handler();
+	}
+}
+
+void* operator new[]( std::size_t bytes )
+{
+	return operator new( bytes );
+}
+
+void operator delete( void* memory ) noexcept
+{
+	std::free( memory );
+}
+
+void operator delete[]( void* memory ) noexcept
+{
+	std::free( memory );
+}
+
+void operator delete( void* memory, std::size_t ) noexcept
+{
+	std::free( memory );
+}
+
+void operator delete[]( void* memory, std::size_t ) noexcept
+{
+	std::free( memory );
+}
+#endif
+
+/*!
+ * @brief Raise a peak to a new live value.
+ * @param peak peak counter.
+ * @param live live bytes after an allocation.
+ */
+static void raisePeak( std::atomic<size_t>& peak, size_t live )
+{
+	size_t old = peak.load();
+	while ( live > old && !peak.compare_exchange_weak( old, live ) )
+		;																		// old is reloaded by the failed exchange
+}
+
+/*!
+ * @brief Format bytes as MiB.
+ * @param bytes number of bytes.
+ * @return e.g. "12.50 MiB".
+ */
+static std::string mib( size_t bytes )
+{
+	std::ostringstream out;
+	out << std::fixed << std::setprecision( 2 ) << bytes / ( 1024.0 * 1024.0 ) << " MiB";
+	return out.str();
+}
+
+void trackAllocation( MemorySpace space, MemoryCategory category, size_t bytes )
+{
+	unsigned int s = static_cast< unsigned int >( space );
+	unsigned int c = static_cast< unsigned int >( category );
+	raisePeak( peakBytes[s][c], liveBytes[s][c] += bytes );
+	raisePeak( peakBytes[s][CATEGORIES], liveBytes[s][CATEGORIES] += bytes );
+	allocationCalls[static_cast< unsigned int >( space == MemorySpace::DEVICE ? AllocationKind::DEVICE : AllocationKind::PINNED )]++;
+}
+
+void trackFree( MemorySpace space, MemoryCategory category, size_t bytes )
+{
+	unsigned int s = static_cast< unsigned int >( space );
+	liveBytes[s][static_cast< unsigned int >( category )] -= bytes;
+	liveBytes[s][CATEGORIES] -= bytes;
+}
+
+unsigned long long countedAllocations( AllocationKind kind )
+{
+	if ( kind != AllocationKind::COUNT )
+		return allocationCalls[static_cast< unsigned int >( kind )];
+
+	unsigned long long calls = 0;
+	for ( unsigned int k = 0; k < KINDS; k++ )
+		calls += allocationCalls[k];
+	return calls;
+}
+
+bool countsHeapAllocations()
+{
+#ifdef SWARM_COUNT_ALLOCATIONS
+	return true;
+#else
+	return false;
+#endif
+}
+
+size_t trackedLiveBytes( MemorySpace space, MemoryCategory category )
+{
+	return liveBytes[static_cast< unsigned int >( space )][static_cast< unsigned int >( category )];
+}
+
+size_t trackedPeakBytes( MemorySpace space, MemoryCategory category )
+{
+	return peakBytes[static_cast< unsigned int >( space )][static_cast< unsigned int >( category )];
+}
+
+std::string memoryReport()
+{
+	std::ostringstream out;
+	out << "Memory" << std::setw( 20 ) << "device live" << std::setw( 16 ) << "device peak"
+		<< std::setw( 16 ) << "pinned live" << std::setw( 16 ) << "pinned peak" << std::endl;
+	for ( unsigned int c = 0; c <= CATEGORIES; c++ )
+	{
+		out << std::left << std::setw( 12 ) << ( c < CATEGORIES ? CATEGORY_NAMES[c] : "total" ) << std::right;
+		for ( unsigned int s = 0; s < SPACES; s++ )
+			out << std::setw( 16 ) << mib( liveBytes[s][c] ) << std::setw( 16 ) << mib( peakBytes[s][c] );
+		out << std::endl;
+	}
+
+	size_t free = 0;
+	size_t total = 0;
+	if ( cudaMemGetInfo( &free, &total ) == cudaSuccess )						// Current device only
+	{
+		size_t used = total - free;
+		size_t tracked = liveBytes[static_cast< unsigned int >( MemorySpace::DEVICE )][CATEGORIES];
+		out << "Device: " << mib( used ) << " of " << mib( total ) << " used, " << mib( free ) << " free, "
+			<< mib( used > tracked ? used - tracked : 0 ) << " not tracked (context, libraries, other devices)" << std::endl;
+	}
+	return out.str();
+}